@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Assertions.h>
+#include <base/Noncopyable.h>
+#include <base/NumericLimits.h>
+#include <base/StdLibExtras.h>
+#include <base/Types.h>
+#include <base/kmalloc.h>
+
+namespace Base {
+
+// Bump allocator for lots of small objects that all die together, like
+// the nodes a parser builds. Allocating is a pointer bump in the current
+// chunk, a new chunk is only allocated once that one is full. Nothing is
+// freed on its own: reset() or destroying the arena frees everything at
+// once, running the destructors of what make() created, newest first.
+class Arena {
+    BASE_MAKE_NONCOPYABLE(Arena);
+    BASE_MAKE_NONMOVABLE(Arena);
+
+public:
+    static constexpr size_t default_chunk_size = 64 * KiB;
+    static constexpr size_t default_alignment = 2 * sizeof(void*);
+
+    explicit Arena(size_t chunk_size = default_chunk_size)
+        : m_chunk_size(chunk_size)
+    {
+    }
+
+    ~Arena()
+    {
+        run_destructors();
+        while (m_chunks) {
+            auto* next = m_chunks->next;
+            kfree_sized(m_chunks, m_chunks->size);
+            m_chunks = next;
+        }
+    }
+
+    [[nodiscard]] void* allocate(size_t size, size_t alignment = default_alignment)
+    {
+        VERIFY(alignment && !(alignment & (alignment - 1)));
+        FlatPtr address = (m_next + alignment - 1) & ~(alignment - 1);
+        if (!m_chunks || address + size > m_end || address < m_next) {
+            add_chunk(size + alignment);
+            address = (m_next + alignment - 1) & ~(alignment - 1);
+        }
+        m_next = address + size;
+        return (void*)address;
+    }
+
+    template<typename T>
+    [[nodiscard]] T* allocate_array(size_t count)
+    {
+        VERIFY(count <= NumericLimits<size_t>::max() / sizeof(T));
+        return (T*)allocate(sizeof(T) * count, alignof(T));
+    }
+
+    // A copy that lives as long as the arena, for keys and names that
+    // don't need to become a String.
+    [[nodiscard]] char const* copy(char const* characters, size_t length)
+    {
+        auto* buffer = allocate_array<char>(length + 1);
+        __builtin_memcpy(buffer, characters, length);
+        buffer[length] = '\0';
+        return buffer;
+    }
+
+    template<typename T, typename... Args>
+    T& make(Args&&... args)
+    {
+        if constexpr (IsTriviallyDestructible<T>) {
+            return *new (allocate(sizeof(T), alignof(T))) T(forward<Args>(args)...);
+        } else {
+            auto* destructor = (Destructor*)allocate(sizeof(Destructor), alignof(Destructor));
+            auto* object = new (allocate(sizeof(T), alignof(T))) T(forward<Args>(args)...);
+            destructor->object = object;
+            destructor->destroy = [](void* object) { static_cast<T*>(object)->~T(); };
+            destructor->next = m_destructors;
+            m_destructors = destructor;
+            return *object;
+        }
+    }
+
+    // Destroys everything, but keeps the newest chunk around for reuse.
+    void reset()
+    {
+        run_destructors();
+        if (!m_chunks)
+            return;
+        while (auto* next = m_chunks->next) {
+            m_chunks->next = next->next;
+            kfree_sized(next, next->size);
+        }
+        m_next = (FlatPtr)(m_chunks + 1);
+        m_end = (FlatPtr)m_chunks + m_chunks->size;
+        m_allocated_bytes = m_chunks->size;
+    }
+
+    size_t allocated_bytes() const { return m_allocated_bytes; }
+
+private:
+    struct Chunk {
+        Chunk* next;
+        size_t size;
+    };
+
+    struct Destructor {
+        Destructor* next;
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    void add_chunk(size_t minimum_size)
+    {
+        size_t size = max(m_chunk_size, minimum_size + sizeof(Chunk));
+        auto* chunk = (Chunk*)kmalloc(size);
+        VERIFY(chunk);
+        chunk->size = size;
+        chunk->next = m_chunks;
+        m_chunks = chunk;
+        m_next = (FlatPtr)(chunk + 1);
+        m_end = (FlatPtr)chunk + size;
+        m_allocated_bytes += size;
+    }
+
+    void run_destructors()
+    {
+        while (m_destructors) {
+            auto* destructor = m_destructors;
+            m_destructors = destructor->next;
+            destructor->destroy(destructor->object);
+        }
+    }
+
+    size_t m_chunk_size { default_chunk_size };
+    Chunk* m_chunks { nullptr };
+    FlatPtr m_next { 0 };
+    FlatPtr m_end { 0 };
+    size_t m_allocated_bytes { 0 };
+    Destructor* m_destructors { nullptr };
+};
+
+}
+
+using Base::Arena;
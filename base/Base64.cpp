@@ -8,11 +8,10 @@
 #include <base/Array.h>
 #include <base/Base64.h>
 #include <base/ByteBuffer.h>
+#include <base/SIMD.h>
 #include <base/String.h>
-#include <base/StringBuilder.h>
 #include <base/StringView.h>
 #include <base/Types.h>
-#include <base/Vector.h>
 
 namespace Base {
 
@@ -43,7 +42,8 @@ static constexpr auto make_lookup_table()
 
 size_t calculate_base64_decoded_length(const StringView& input)
 {
-    return input.length() * 3 / 4;
+    // A trailing partial group still decodes to three bytes.
+    return (input.length() + 3) / 4 * 3;
 }
 
 size_t calculate_base64_encoded_length(ReadonlyBytes input)
@@ -51,24 +51,134 @@ size_t calculate_base64_encoded_length(ReadonlyBytes input)
     return ((4 * input.size() / 3) + 3) & ~3;
 }
 
-ByteBuffer decode_base64(const StringView& input)
+// Only userland can use SSSE3, the kernel doesn't save vector registers.
+#if defined(__x86_64__) && !defined(KERNEL)
+#    define BASE64_HAS_SSSE3
+
+__attribute__((target("ssse3"))) static SIMD::u8x16 shuffle_bytes(SIMD::u8x16 bytes, SIMD::u8x16 indices)
+{
+    return (SIMD::u8x16)__builtin_ia32_pshufb128((SIMD::c8x16)bytes, (SIMD::c8x16)indices);
+}
+
+// Mula's encoder: twelve input bytes are spread so every 32-bit lane holds
+// one group of three, two multiplies move each six bits into a byte of its
+// own, and one more shuffle turns those into offsets to add for the
+// alphabet. Reads sixteen bytes of input per block.
+__attribute__((target("ssse3"))) static size_t encode_base64_ssse3(const u8* input, size_t size, u8* output)
+{
+    constexpr SIMD::u8x16 spread = { 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10 };
+    constexpr SIMD::u32x4 high_mask = { 0x0fc0fc00, 0x0fc0fc00, 0x0fc0fc00, 0x0fc0fc00 };
+    constexpr SIMD::u32x4 high_shift = { 0x04000040, 0x04000040, 0x04000040, 0x04000040 };
+    constexpr SIMD::u32x4 low_mask = { 0x003f03f0, 0x003f03f0, 0x003f03f0, 0x003f03f0 };
+    constexpr SIMD::u32x4 low_shift = { 0x01000010, 0x01000010, 0x01000010, 0x01000010 };
+    constexpr u8 lower = 'a' - 26;
+    constexpr u8 digit = '0' - 52;
+    constexpr u8 plus = '+' - 62;
+    constexpr u8 slash = '/' - 63;
+    constexpr SIMD::u8x16 offsets = {
+        lower, digit, digit, digit, digit, digit, digit, digit,
+        digit, digit, digit, plus, slash, 'A', 0, 0
+    };
+
+    size_t consumed = 0;
+    for (; consumed + 16 <= size; consumed += 12) {
+        SIMD::u8x16 bytes;
+        __builtin_memcpy(&bytes, input + consumed, sizeof(bytes));
+        bytes = shuffle_bytes(bytes, spread);
+
+        auto high = (SIMD::u16x8)__builtin_ia32_pmulhuw128((SIMD::i16x8)((SIMD::u32x4)bytes & high_mask), (SIMD::i16x8)high_shift);
+        auto low = (SIMD::u16x8)((SIMD::u16x8)((SIMD::u32x4)bytes & low_mask) * (SIMD::u16x8)low_shift);
+        auto indices = (SIMD::u8x16)(high | low);
+
+        // 0..25 picks offset 13, 26..51 offset 0, and 52..63 offsets 1..12.
+        auto offset_index = (SIMD::u8x16)__builtin_ia32_psubusb128((SIMD::c8x16)indices, (SIMD::c8x16)(SIMD::u8x16 {} + 51));
+        offset_index |= (SIMD::u8x16)(indices < 26) & 13;
+        auto characters = indices + shuffle_bytes(offsets, offset_index);
+        __builtin_memcpy(output + consumed / 3 * 4, &characters, sizeof(characters));
+    }
+    return consumed;
+}
+
+// Mula's decoder: the nibbles of each character look up whether it is in
+// the alphabet and what to add to turn it into its six bits, which two
+// multiply-adds then pack into three bytes per four characters. Stops at
+// the first block with anything but alphabet characters in it, padding
+// included, and returns how many characters it decoded.
+__attribute__((target("ssse3"))) static size_t decode_base64_ssse3(const char* input, size_t length, u8* output)
 {
+    constexpr SIMD::u8x16 low_nibble_classes = {
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a
+    };
+    constexpr SIMD::u8x16 high_nibble_classes = {
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+    };
+    constexpr SIMD::u8x16 offsets = {
+        0, 16, 19, 4, (u8)-65, (u8)-65, (u8)-71, (u8)-71, 0, 0, 0, 0, 0, 0, 0, 0
+    };
+    constexpr SIMD::u8x16 nibble_mask = {
+        0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf
+    };
+    constexpr SIMD::u32x4 merge_pairs = { 0x01400140, 0x01400140, 0x01400140, 0x01400140 };
+    constexpr SIMD::u32x4 merge_quads = { 0x00011000, 0x00011000, 0x00011000, 0x00011000 };
+    constexpr SIMD::u8x16 gather = { 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, 0x80, 0x80, 0x80, 0x80 };
+
+    size_t consumed = 0;
+    for (; consumed + 16 <= length; consumed += 16) {
+        SIMD::u8x16 characters;
+        __builtin_memcpy(&characters, input + consumed, sizeof(characters));
+
+        auto high_nibbles = (SIMD::u8x16)((SIMD::u32x4)characters >> 4) & nibble_mask;
+        auto classes = shuffle_bytes(low_nibble_classes, characters & nibble_mask) & shuffle_bytes(high_nibble_classes, high_nibbles);
+        if (__builtin_ia32_pmovmskb128((SIMD::c8x16)((SIMD::i8x16)classes > 0)))
+            break;
+
+        auto is_slash = (SIMD::u8x16)(characters == '/');
+        auto values = characters + shuffle_bytes(offsets, is_slash + high_nibbles);
+
+        auto pairs = __builtin_ia32_pmaddubsw128((SIMD::c8x16)values, (SIMD::c8x16)merge_pairs);
+        auto quads = __builtin_ia32_pmaddwd128(pairs, (SIMD::i16x8)merge_quads);
+        auto bytes = shuffle_bytes((SIMD::u8x16)quads, gather);
+        __builtin_memcpy(output + consumed / 4 * 3, &bytes, 12);
+    }
+    return consumed;
+}
+#endif
+
+static constexpr auto s_alphabet = make_alphabet();
+static constexpr auto s_lookup_table = make_lookup_table();
+
+size_t decode_base64_into(const StringView& input, Bytes output)
+{
+    VERIFY(output.size() >= calculate_base64_decoded_length(input));
+    auto* characters = input.characters_without_null_termination();
+    size_t length = input.length();
+
     auto get = [&](const size_t offset, bool* is_padding = nullptr) -> u8 {
-        constexpr auto table = make_lookup_table();
-        if (offset >= input.length())
+        if (offset >= length)
             return 0;
-        if (input[offset] == '=') {
+        if (characters[offset] == '=') {
             if (is_padding)
                 *is_padding = true;
             return 0;
         }
-        return table[input[offset]];
+        return s_lookup_table[(u8)characters[offset]];
     };
 
-    Vector<u8> output;
-    output.ensure_capacity(calculate_base64_decoded_length(input));
-
-    for (size_t i = 0; i < input.length(); i += 4) {
+#ifdef BASE64_HAS_SSSE3
+    static bool const has_ssse3 = __builtin_cpu_supports("ssse3");
+#endif
+
+    size_t written = 0;
+    for (size_t i = 0; i < length;) {
+#ifdef BASE64_HAS_SSSE3
+        if (has_ssse3) {
+            auto decoded = decode_base64_ssse3(characters + i, length - i, output.data() + written);
+            i += decoded;
+            written += decoded / 4 * 3;
+            if (i >= length)
+                break;
+        }
+#endif
         bool in2_is_padding = false;
         bool in3_is_padding = false;
 
@@ -77,59 +187,67 @@ ByteBuffer decode_base64(const StringView& input)
         const u8 in2 = get(i + 2, &in2_is_padding);
         const u8 in3 = get(i + 3, &in3_is_padding);
 
-        const u8 out0 = (in0 << 2) | ((in1 >> 4) & 3);
-        const u8 out1 = ((in1 & 0xf) << 4) | ((in2 >> 2) & 0xf);
-        const u8 out2 = ((in2 & 0x3) << 6) | in3;
-
-        output.append(out0);
+        output[written++] = (in0 << 2) | ((in1 >> 4) & 3);
         if (!in2_is_padding)
-            output.append(out1);
+            output[written++] = ((in1 & 0xf) << 4) | ((in2 >> 2) & 0xf);
         if (!in3_is_padding)
-            output.append(out2);
+            output[written++] = ((in2 & 0x3) << 6) | in3;
+        i += 4;
     }
-
-    return ByteBuffer::copy(output.data(), output.size());
+    return written;
 }
 
-String encode_base64(ReadonlyBytes input)
+ByteBuffer decode_base64(const StringView& input)
 {
-    constexpr auto alphabet = make_alphabet();
-    StringBuilder output(calculate_base64_encoded_length(input));
-
-    auto get = [&](const size_t offset, bool* need_padding = nullptr) -> u8 {
-        if (offset >= input.size()) {
-            if (need_padding)
-                *need_padding = true;
-            return 0;
-        }
-        return input[offset];
-    };
+    auto output = ByteBuffer::create_uninitialized(calculate_base64_decoded_length(input));
+    output.resize(decode_base64_into(input, output.bytes()));
+    return output;
+}
 
-    for (size_t i = 0; i < input.size(); i += 3) {
-        bool is_8bit = false;
-        bool is_16bit = false;
+size_t encode_base64_into(ReadonlyBytes input, Bytes output)
+{
+    VERIFY(output.size() >= calculate_base64_encoded_length(input));
+    size_t i = 0;
+    size_t written = 0;
+#ifdef BASE64_HAS_SSSE3
+    static bool const has_ssse3 = __builtin_cpu_supports("ssse3");
+    if (has_ssse3) {
+        i = encode_base64_ssse3(input.data(), input.size(), output.data());
+        written = i / 3 * 4;
+    }
+#endif
+
+    for (; i + 3 <= input.size(); i += 3) {
+        const u8 in0 = input[i];
+        const u8 in1 = input[i + 1];
+        const u8 in2 = input[i + 2];
+        output[written++] = s_alphabet[(in0 >> 2) & 0x3f];
+        output[written++] = s_alphabet[((in0 << 4) | (in1 >> 4)) & 0x3f];
+        output[written++] = s_alphabet[((in1 << 2) | (in2 >> 6)) & 0x3f];
+        output[written++] = s_alphabet[in2 & 0x3f];
+    }
 
-        const u8 in0 = get(i);
-        const u8 in1 = get(i + 1, &is_16bit);
-        const u8 in2 = get(i + 2, &is_8bit);
-
-        const u8 index0 = (in0 >> 2) & 0x3f;
-        const u8 index1 = ((in0 << 4) | (in1 >> 4)) & 0x3f;
-        const u8 index2 = ((in1 << 2) | (in2 >> 6)) & 0x3f;
-        const u8 index3 = in2 & 0x3f;
-
-        const u8 out0 = alphabet[index0];
-        const u8 out1 = alphabet[index1];
-        const u8 out2 = is_16bit ? '=' : alphabet[index2];
-        const u8 out3 = is_8bit ? '=' : alphabet[index3];
-
-        output.append(out0);
-        output.append(out1);
-        output.append(out2);
-        output.append(out3);
+    if (i < input.size()) {
+        bool is_16bit = i + 1 >= input.size();
+        const u8 in0 = input[i];
+        const u8 in1 = is_16bit ? 0 : input[i + 1];
+        output[written++] = s_alphabet[(in0 >> 2) & 0x3f];
+        output[written++] = s_alphabet[((in0 << 4) | (in1 >> 4)) & 0x3f];
+        output[written++] = is_16bit ? '=' : s_alphabet[(in1 << 2) & 0x3f];
+        output[written++] = '=';
     }
+    return written;
+}
 
-    return output.to_string();
+String encode_base64(ReadonlyBytes input)
+{
+    auto length = calculate_base64_encoded_length(input);
+    if (!length)
+        return String::empty();
+    char* buffer;
+    auto impl = StringImpl::create_uninitialized(length, buffer);
+    encode_base64_into(input, { reinterpret_cast<u8*>(buffer), length });
+    return String(move(impl));
 }
 
-}
\ No newline at end of file
+}
@@ -22,7 +22,16 @@ ByteBuffer decode_base64(const StringView&);
 
 String encode_base64(ReadonlyBytes);
 
+// Streaming variants that write into a caller provided buffer, which must
+// hold at least calculate_base64_{de,en}coded_length() bytes. Both return
+// how many bytes they wrote.
+size_t decode_base64_into(const StringView&, Bytes);
+
+size_t encode_base64_into(ReadonlyBytes, Bytes);
+
 }
 
 using Base::decode_base64;
+using Base::decode_base64_into;
 using Base::encode_base64;
+using Base::encode_base64_into;
@@ -7,6 +7,8 @@
 #pragma once
 
 // includes
+#include <base/Endian.h>
+#include <base/MemoryStream.h>
 #include <base/Optional.h>
 #include <base/Stream.h>
 
@@ -19,6 +21,14 @@ public:
     {
     }
 
+    // Over memory, bits are read a whole word at a time straight out of the
+    // buffer instead of one byte at a time through the stream.
+    explicit InputBitStream(InputMemoryStream& stream)
+        : m_stream(stream)
+        , m_memory_stream(&stream)
+    {
+    }
+
     size_t read(Bytes bytes) override
     {
         if (has_any_error())
@@ -63,6 +73,9 @@ public:
 
     u64 read_bits(size_t count)
     {
+        if (u64 fast_result; read_bits_from_memory<false>(count, fast_result))
+            return fast_result;
+
         u64 result = 0;
 
         size_t nread = 0;
@@ -73,7 +86,7 @@ public:
             }
 
             if (m_next_byte.has_value()) {
-                const auto bit = (m_next_byte.value() >> m_bit_offset) & 1;
+                const u64 bit = (m_next_byte.value() >> m_bit_offset) & 1;
                 result |= bit << nread;
                 ++nread;
 
@@ -90,6 +103,9 @@ public:
 
     u64 read_bits_big_endian(size_t count)
     {
+        if (u64 fast_result; read_bits_from_memory<true>(count, fast_result))
+            return fast_result;
+
         u64 result = 0;
 
         size_t nread = 0;
@@ -141,9 +157,48 @@ public:
     }
 
 private:
+    // The fast path for up to 56 bits, which with the bits of the current
+    // byte already used always fit in one word. It takes that word from the
+    // buffer with a single bounds check, and leaves anything shorter than a
+    // word before the end of the buffer, or a stream in error, to the loops
+    // above.
+    template<bool big_endian>
+    bool read_bits_from_memory(size_t count, u64& result)
+    {
+        if (!m_memory_stream || count > 56 || m_stream.has_any_error())
+            return false;
+
+        // m_next_byte, if any, is the byte that was read last.
+        size_t position = m_memory_stream->offset() * 8;
+        if (m_next_byte.has_value())
+            position -= 8 - m_bit_offset;
+        auto bytes = m_memory_stream->bytes();
+        if (bytes.size() - position / 8 < sizeof(u64))
+            return false;
+
+        u64 word;
+        __builtin_memcpy(&word, bytes.data() + position / 8, sizeof(word));
+        if constexpr (big_endian)
+            result = count ? (convert_between_host_and_big_endian(word) << (position % 8)) >> (64 - count) : 0;
+        else
+            result = (convert_between_host_and_little_endian(word) >> (position % 8)) & ((1ull << count) - 1);
+
+        position += count;
+        size_t next_offset = (position + 7) / 8;
+        if (position % 8) {
+            m_next_byte = bytes[position / 8];
+            m_bit_offset = position % 8;
+        } else {
+            m_next_byte.clear();
+        }
+        m_memory_stream->discard_or_error(next_offset - m_memory_stream->offset());
+        return true;
+    }
+
     Optional<u8> m_next_byte;
     size_t m_bit_offset { 0 };
     InputStream& m_stream;
+    InputMemoryStream* m_memory_stream { nullptr };
 };
 
 class OutputBitStream final : public OutputStream {
@@ -10,6 +10,7 @@
 #include <base/Noncopyable.h>
 #include <base/Optional.h>
 #include <base/Platform.h>
+#include <base/ScopeGuard.h>
 #include <base/StdLibExtras.h>
 #include <base/Types.h>
 #include <base/kmalloc.h>
@@ -17,7 +18,7 @@
 namespace Base {
 
 class Bitmap {
-    Base_MAKE_NONCOPYABLE(Bitmap);
+    BASE_MAKE_NONCOPYABLE(Bitmap);
 
 public:
     Bitmap() = default;
@@ -37,12 +38,13 @@ public:
     {
     }
 
-    BitmapView view() { return { m_data, m_size }; }
-    const BitmapView view() const { return { m_data, m_size }; }
+    BitmapView view() { return { m_data, m_size, m_summary }; }
+    const BitmapView view() const { return { m_data, m_size, m_summary }; }
 
     Bitmap(Bitmap&& other)
         : m_data(exchange(other.m_data, nullptr))
         , m_size(exchange(other.m_size, 0))
+        , m_summary(exchange(other.m_summary, nullptr))
     {
     }
 
@@ -52,6 +54,7 @@ public:
             kfree_sized(m_data, size_in_bytes());
             m_data = exchange(other.m_data, nullptr);
             m_size = exchange(other.m_size, 0);
+            m_summary = exchange(other.m_summary, nullptr);
         }
         return *this;
     }
@@ -80,8 +83,21 @@ public:
             m_data[index / 8] |= static_cast<u8>((1u << (index % 8)));
         else
             m_data[index / 8] &= static_cast<u8>(~(1u << (index % 8)));
+        view().update_summary(index, 1);
     }
 
+    // Keeps a summary of the full words in storage, which has to hold
+    // summary_size_in_bytes(size()) bytes and outlive the bitmap. Scans
+    // for unset bits then skip full words 64 at a time.
+    void enable_summary(u8* storage)
+    {
+        VERIFY(!m_summary);
+        m_summary = storage;
+        view().update_summary(0, m_size);
+    }
+
+    static size_t summary_size_in_bytes(size_t size) { return BitmapView::summary_size_in_bytes(size); }
+
     size_t count_slow(bool value) const { return count_in_range(0, m_size, value); }
     size_t count_in_range(size_t start, size_t len, bool value) const { return view().count_in_range(start, len, value); }
 
@@ -93,6 +109,7 @@ public:
     void grow(size_t size, bool default_value)
     {
         VERIFY(size > m_size);
+        VERIFY(!m_summary);
 
         auto previous_size_bytes = size_in_bytes();
         auto previous_size = m_size;
@@ -119,6 +136,8 @@ public:
         if (len == 0)
             return;
 
+        ScopeGuard update_summary([&] { view().update_summary(start, len); });
+
         u8* first = &m_data[start / 8];
         u8* last = &m_data[(start + len) / 8];
         u8 byte_mask = bitmask_first_byte[start % 8];
@@ -187,6 +206,7 @@ public:
     void fill(bool value)
     {
         __builtin_memset(m_data, value ? 0xff : 0x00, size_in_bytes());
+        view().update_summary(0, m_size);
     }
 
     Optional<size_t> find_one_anywhere_set(size_t hint = 0) const { return view().find_one_anywhere<true>(hint); }
@@ -214,6 +234,7 @@ private:
     u8* m_data { nullptr };
     size_t m_size { 0 };
     bool m_is_owning { true };
+    u8* m_summary { nullptr };
 };
 
 }
@@ -19,9 +19,10 @@ static constexpr Array bitmask_last_byte = { 0x00, 0x1, 0x3, 0x7, 0xF, 0x1F, 0x3
 
 class BitmapView {
 public:
-    BitmapView(u8* data, size_t size)
+    BitmapView(u8* data, size_t size, u8* summary = nullptr)
         : m_data(data)
         , m_size(size)
+        , m_summary(summary)
     {
     }
 
@@ -39,6 +40,7 @@ public:
             m_data[index / 8] |= static_cast<u8>((1u << (index % 8)));
         else
             m_data[index / 8] &= static_cast<u8>(~(1u << (index % 8)));
+        update_summary(index, 1);
     }
 
     size_t count_slow(bool value) const
@@ -95,66 +97,43 @@ public:
 
     const u8* data() const { return m_data; }
 
-    template<bool VALUE>
-    Optional<size_t> find_one_anywhere(size_t hint = 0) const
+    // The scans below work on 64-bit words. An optional summary keeps one
+    // bit per word that is set when every bit of the word is, so long runs
+    // of full words (the common case in a busy allocator) are skipped 64
+    // words at a time. Bitmap maintains it, writes through a view keep it
+    // up to date too.
+    static constexpr size_t bits_per_word = 64;
+
+    static size_t summary_size_in_bytes(size_t size)
     {
-        VERIFY(hint < m_size);
-        const u8* end = &m_data[m_size / 8];
-
-        for (;;) {
-            const u32* ptr32 = (const u32*)((FlatPtr)&m_data[hint / 8] & ~(sizeof(u32) - 1));
-            if ((const u8*)ptr32 < &m_data[0]) {
-                ptr32++;
-
-                size_t start_ptr32 = (const u8*)ptr32 - &m_data[0];
-                size_t i = 0;
-                u8 byte = VALUE ? 0x00 : 0xff;
-                while (i < start_ptr32 && m_data[i] == byte)
-                    i++;
-                if (i < start_ptr32) {
-                    byte = m_data[i];
-                    if constexpr (!VALUE)
-                        byte = ~byte;
-                    VERIFY(byte != 0);
-                    return i * 8 + __builtin_ffs(byte) - 1;
-                }
-            }
+        return ceil_div(ceil_div(size, bits_per_word), static_cast<size_t>(8));
+    }
 
-            u32 val32 = VALUE ? 0x0 : 0xffffffff;
-            const u32* end32 = (const u32*)((FlatPtr)end & ~(sizeof(u32) - 1));
-            while (ptr32 < end32 && *ptr32 == val32)
-                ptr32++;
-
-            if (ptr32 == end32) {
-                u8 byte = VALUE ? 0x00 : 0xff;
-                size_t i = (const u8*)ptr32 - &m_data[0];
-                size_t byte_count = m_size / 8;
-                VERIFY(i <= byte_count);
-                while (i < byte_count && m_data[i] == byte)
-                    i++;
-                if (i == byte_count) {
-                    if (hint <= 8)
-                        return {}; 
-
-                    end = (const u8*)((FlatPtr)&m_data[hint / 8] & ~(sizeof(u32) - 1));
-                    hint = 0;
-                    continue;
-                }
-                byte = m_data[i];
-                if constexpr (!VALUE)
-                    byte = ~byte;
-                VERIFY(byte != 0);
-                return i * 8 + __builtin_ffs(byte) - 1;
-            }
+    const u8* summary() const { return m_summary; }
 
-            val32 = *ptr32;
-            if constexpr (!VALUE)
-                val32 = ~val32;
-            VERIFY(val32 != 0);
-            return ((const u8*)ptr32 - &m_data[0]) * 8 + __builtin_ffsl(val32) - 1;
+    void update_summary(size_t start, size_t len) const
+    {
+        if (!m_summary || len == 0)
+            return;
+        size_t last_word = (start + len - 1) / bits_per_word;
+        for (size_t word_index = start / bits_per_word; word_index <= last_word; word_index++) {
+            u8 mask = 1u << (word_index % 8);
+            if (load_word<true>(word_index) == ~0ull)
+                m_summary[word_index / 8] |= mask;
+            else
+                m_summary[word_index / 8] &= ~mask;
         }
     }
 
+    template<bool VALUE>
+    Optional<size_t> find_one_anywhere(size_t hint = 0) const
+    {
+        VERIFY(hint < m_size);
+        if (auto index = find_next<VALUE>(hint, m_size); index.has_value())
+            return index;
+        return find_next<VALUE>(0, hint);
+    }
+
     Optional<size_t> find_one_anywhere_set(size_t hint = 0) const
     {
         return find_one_anywhere<true>(hint);
@@ -168,114 +147,37 @@ public:
     template<bool VALUE>
     Optional<size_t> find_first() const
     {
-        size_t byte_count = m_size / 8;
-        size_t i = 0;
-
-        u8 byte = VALUE ? 0x00 : 0xff;
-        while (i < byte_count && m_data[i] == byte)
-            i++;
-        if (i == byte_count)
-            return {};
-
-        byte = m_data[i];
-        if constexpr (!VALUE)
-            byte = ~byte;
-        VERIFY(byte != 0);
-        return i * 8 + __builtin_ffs(byte) - 1;
+        return find_next<VALUE>(0, m_size);
     }
 
     Optional<size_t> find_first_set() const { return find_first<true>(); }
     Optional<size_t> find_first_unset() const { return find_first<false>(); }
-    
+
+    // Finds the first run of at least min_length unset bits at or after
+    // from, stores its start in from and returns its length, capped at
+    // max_length.
     inline Optional<size_t> find_next_range_of_unset_bits(size_t& from, size_t min_length = 1, size_t max_length = max_size) const
     {
         if (min_length > max_length) {
             return {};
         }
 
-        u32* bitmap32 = (u32*)m_data;
-
-        size_t start_bucket_index = from / 32;
-        size_t start_bucket_bit = from % 32;
-
-        size_t* start_of_free_chunks = &from;
-        size_t free_chunks = 0;
-
-        for (size_t bucket_index = start_bucket_index; bucket_index < m_size / 32; ++bucket_index) {
-            if (bitmap32[bucket_index] == 0xffffffff) {
-                if (free_chunks >= min_length) {
-                    return min(free_chunks, max_length);
-                }
-                free_chunks = 0;
-                start_bucket_bit = 0;
-                continue;
-            }
-            if (bitmap32[bucket_index] == 0x0) {
-
-                if (free_chunks == 0) {
-                    *start_of_free_chunks = bucket_index * 32;
-                }
-                free_chunks += 32;
-                if (free_chunks >= max_length) {
-                    return max_length;
-                }
-                start_bucket_bit = 0;
-                continue;
+        size_t index = from;
+        while (index < m_size) {
+            auto run_start = find_next<false>(index, m_size);
+            if (!run_start.has_value())
+                return {};
+
+            size_t limit = run_start.value() + min(max_length, m_size - run_start.value());
+            size_t run_end = find_next<true>(run_start.value(), limit).value_or(limit);
+            size_t length = run_end - run_start.value();
+            if (length >= min_length) {
+                from = run_start.value();
+                return min(length, max_length);
             }
-
-            u32 bucket = bitmap32[bucket_index];
-            u8 viewed_bits = start_bucket_bit;
-            u32 trailing_zeroes = 0;
-
-            bucket >>= viewed_bits;
-            start_bucket_bit = 0;
-
-            while (viewed_bits < 32) {
-                if (bucket == 0) {
-                    if (free_chunks == 0) {
-                        *start_of_free_chunks = bucket_index * 32 + viewed_bits;
-                    }
-                    free_chunks += 32 - viewed_bits;
-                    viewed_bits = 32;
-                } else {
-                    trailing_zeroes = count_trailing_zeroes_32(bucket);
-                    bucket >>= trailing_zeroes;
-
-                    if (free_chunks == 0) {
-                        *start_of_free_chunks = bucket_index * 32 + viewed_bits;
-                    }
-                    free_chunks += trailing_zeroes;
-                    viewed_bits += trailing_zeroes;
-
-                    if (free_chunks >= min_length) {
-                        return min(free_chunks, max_length);
-                    }
-
-                    u32 trailing_ones = count_trailing_zeroes_32(~bucket);
-                    bucket >>= trailing_ones;
-                    viewed_bits += trailing_ones;
-                    free_chunks = 0;
-                }
-            }
-        }
-
-        if (free_chunks < min_length) {
-            size_t first_trailing_bit = (m_size / 32) * 32;
-            size_t trailing_bits = size() % 32;
-            for (size_t i = 0; i < trailing_bits; ++i) {
-                if (!get(first_trailing_bit + i)) {
-                    if (!free_chunks)
-                        *start_of_free_chunks = first_trailing_bit + i;
-                    if (++free_chunks >= min_length)
-                        return min(free_chunks, max_length);
-                } else {
-                    free_chunks = 0;
-                }
-            }
-            return {};
+            index = run_end;
         }
-
-        return min(free_chunks, max_length);
+        return {};
     }
 
     Optional<size_t> find_longest_range_of_unset_bits(size_t max_length, size_t& found_range_size) const
@@ -320,13 +222,18 @@ public:
         bool found = false;
 
         while (true) {
-            auto length_of_found_range = find_next_range_of_unset_bits(start, minimum_length, best_region_size);
+            // Ask for whole runs, a capped length would restart the scan in
+            // the middle of a run and make its tail look like a better fit.
+            auto length_of_found_range = find_next_range_of_unset_bits(start, minimum_length);
             if (length_of_found_range.has_value()) {
                 if (best_region_size > length_of_found_range.value() || !found) {
                     best_region_start = start;
                     best_region_size = length_of_found_range.value();
                     found = true;
                 }
+                // Nothing fits better than an exact fit.
+                if (best_region_size == minimum_length)
+                    break;
                 start += length_of_found_range.value();
             } else {
 
@@ -343,8 +250,76 @@ public:
     static constexpr size_t max_size = 0xffffffff;
 
 private:
+    size_t word_count() const { return ceil_div(m_size, bits_per_word); }
+
+    // Loads a word of the bitmap, the bits past the end read as PADDING.
+    template<bool PADDING>
+    u64 load_word(size_t word_index) const
+    {
+        size_t offset = word_index * sizeof(u64);
+        u64 word = 0;
+        __builtin_memcpy(&word, &m_data[offset], min(sizeof(u64), size_in_bytes() - offset));
+        size_t valid_bits = m_size - word_index * bits_per_word;
+        if (valid_bits < bits_per_word) {
+            if constexpr (PADDING)
+                word |= ~0ull << valid_bits;
+            else
+                word &= ~(~0ull << valid_bits);
+        }
+        return word;
+    }
+
+    // The first word at or after word_index that the summary doesn't mark full.
+    size_t skip_full_words(size_t word_index) const
+    {
+        size_t words = word_count();
+        while (word_index < words) {
+            size_t summary_index = word_index / 64;
+            u64 summary_word = 0;
+            size_t offset = summary_index * sizeof(u64);
+            __builtin_memcpy(&summary_word, &m_summary[offset], min(sizeof(u64), summary_size_in_bytes(m_size) - offset));
+            u64 not_full = ~summary_word & (~0ull << (word_index % 64));
+            if (not_full)
+                return min(words, summary_index * 64 + count_trailing_zeroes_64(not_full));
+            word_index = (summary_index + 1) * 64;
+        }
+        return words;
+    }
+
+    // First index in [start, end) whose bit is VALUE.
+    template<bool VALUE>
+    Optional<size_t> find_next(size_t start, size_t end) const
+    {
+        size_t end_word = ceil_div(end, bits_per_word);
+        for (size_t word_index = start / bits_per_word; word_index < end_word; word_index++) {
+            if constexpr (!VALUE) {
+                if (m_summary) {
+                    size_t next_word = skip_full_words(word_index);
+                    if (next_word != word_index) {
+                        word_index = next_word;
+                        if (word_index >= end_word)
+                            break;
+                        start = word_index * bits_per_word;
+                    }
+                }
+            }
+
+            u64 word = VALUE ? load_word<false>(word_index) : ~load_word<true>(word_index);
+            if (word_index == start / bits_per_word)
+                word &= ~0ull << (start % bits_per_word);
+            if (word) {
+                size_t index = word_index * bits_per_word + count_trailing_zeroes_64(word);
+                if (index >= end)
+                    break;
+                return index;
+            }
+        }
+        return {};
+    }
+
     u8* m_data { nullptr };
     size_t m_size { 0 };
+    u8* m_summary { nullptr };
 };
 
 }
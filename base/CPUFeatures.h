@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Assertions.h>
+#include <base/EnumBits.h>
+#include <base/Platform.h>
+#include <base/Types.h>
+
+#if !defined(KERNEL) && defined(__pranaos__)
+#    include <kernel/api/TimePage.h>
+#endif
+
+namespace Base {
+
+// The instruction set extensions optimized routines pick variants by. The
+// kernel's own CPUFeature covers what it needs to set the processor up and
+// has no room left, these are only about what code may execute.
+enum class CPUFeatures : u32 {
+    None = 0,
+    SSE2 = 1 << 0,
+    SSE3 = 1 << 1,
+    SSSE3 = 1 << 2,
+    SSE4_1 = 1 << 3,
+    SSE4_2 = 1 << 4,
+    POPCNT = 1 << 5,
+    PCLMUL = 1 << 6,
+    AVX = 1 << 7,
+    AVX2 = 1 << 8,
+    BMI1 = 1 << 9,
+    BMI2 = 1 << 10,
+    ERMS = 1 << 11,
+    FSRM = 1 << 12,
+
+    // Set in whatever the kernel publishes, so a zeroed word isn't taken
+    // for a processor without any of the above.
+    Detected = 1u << 31,
+};
+
+BASE_ENUM_BITWISE_OPERATORS(CPUFeatures);
+
+#if ARCH(I386) || ARCH(X86_64)
+inline CPUFeatures detect_cpu_features()
+{
+    auto cpuid = [](u32 function, u32 subfunction, u32& eax, u32& ebx, u32& ecx, u32& edx) {
+        asm volatile("cpuid"
+                     : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+                     : "a"(function), "c"(subfunction));
+    };
+
+    u32 eax, ebx, ecx, edx;
+    cpuid(0, 0, eax, ebx, ecx, edx);
+    u32 max_function = eax;
+
+    auto features = CPUFeatures::Detected;
+    auto set_if = [&](bool condition, CPUFeatures feature) {
+        if (condition)
+            features |= feature;
+    };
+
+    cpuid(1, 0, eax, ebx, ecx, edx);
+    set_if(edx & (1 << 26), CPUFeatures::SSE2);
+    set_if(ecx & (1 << 0), CPUFeatures::SSE3);
+    set_if(ecx & (1 << 1), CPUFeatures::PCLMUL);
+    set_if(ecx & (1 << 9), CPUFeatures::SSSE3);
+    set_if(ecx & (1 << 19), CPUFeatures::SSE4_1);
+    set_if(ecx & (1 << 20), CPUFeatures::SSE4_2);
+    set_if(ecx & (1 << 23), CPUFeatures::POPCNT);
+
+    // AVX registers are only usable once the kernel has turned on their
+    // state in XCR0, which OSXSAVE says can be read.
+    bool avx_state = false;
+    if ((ecx & (1 << 27)) && (ecx & (1 << 28))) {
+        u32 xcr0_low, xcr0_high;
+        asm volatile("xgetbv"
+                     : "=a"(xcr0_low), "=d"(xcr0_high)
+                     : "c"(0));
+        avx_state = (xcr0_low & 0b110) == 0b110;
+    }
+    set_if(avx_state, CPUFeatures::AVX);
+
+    if (max_function >= 7) {
+        cpuid(7, 0, eax, ebx, ecx, edx);
+        set_if(ebx & (1 << 3), CPUFeatures::BMI1);
+        set_if(avx_state && (ebx & (1 << 5)), CPUFeatures::AVX2);
+        set_if(ebx & (1 << 8), CPUFeatures::BMI2);
+        set_if(ebx & (1 << 9), CPUFeatures::ERMS);
+        set_if(edx & (1 << 4), CPUFeatures::FSRM);
+    }
+
+    return features;
+}
+#else
+inline CPUFeatures detect_cpu_features()
+{
+    return CPUFeatures::Detected;
+}
+#endif
+
+// Userland takes what the kernel put in the time page, which every address
+// space has mapped, instead of running cpuid (which traps under some
+// hypervisors). Elsewhere, and in the kernel, it is detected once.
+inline CPUFeatures cpu_features()
+{
+#if !defined(KERNEL) && defined(__pranaos__)
+    auto published = static_cast<CPUFeatures>(reinterpret_cast<TimePage const*>(time_page_address)->cpu_features);
+    if (has_flag(published, CPUFeatures::Detected))
+        return published;
+#endif
+
+    static u32 s_features;
+    u32 features = __atomic_load_n(&s_features, __ATOMIC_RELAXED);
+    if (!features) {
+        features = static_cast<u32>(detect_cpu_features());
+        __atomic_store_n(&s_features, features, __ATOMIC_RELAXED);
+    }
+    return static_cast<CPUFeatures>(features);
+}
+
+// Picks the first variant whose required features are all there, the first
+// time it is called, and calls straight through the resolved pointer after
+// that. The last variant should require nothing. It is constant-initialized,
+// so it may be used before static constructors run:
+//
+//     static CPUDispatch<u32(u32, u8 const*, size_t)> s_update({
+//         { CPUFeatures::PCLMUL | CPUFeatures::SSE2, update_pclmul },
+//         { CPUFeatures::None, update_sliced },
+//     });
+//
+// In the kernel, variants using vector registers must save the FPU state
+// around themselves.
+template<typename Signature>
+class CPUDispatch;
+
+template<typename R, typename... Args>
+class CPUDispatch<R(Args...)> {
+public:
+    using Function = R (*)(Args...);
+
+    struct Variant {
+        CPUFeatures required;
+        Function function;
+    };
+
+    static constexpr size_t max_variants = 8;
+
+    template<size_t N>
+    constexpr CPUDispatch(Variant const (&variants)[N])
+        : m_count(N)
+    {
+        static_assert(N > 0 && N <= max_variants);
+        for (size_t i = 0; i < N; ++i)
+            m_variants[i] = variants[i];
+    }
+
+    ALWAYS_INLINE R operator()(Args... args)
+    {
+        auto function = __atomic_load_n(&m_resolved, __ATOMIC_ACQUIRE);
+        if (!function) [[unlikely]]
+            function = resolve();
+        return function(args...);
+    }
+
+    // Threads racing here all pick the same variant.
+    Function resolve()
+    {
+        auto features = cpu_features();
+        for (size_t i = 0; i < m_count; ++i) {
+            if (has_flag(features, m_variants[i].required)) {
+                __atomic_store_n(&m_resolved, m_variants[i].function, __ATOMIC_RELEASE);
+                return m_variants[i].function;
+            }
+        }
+        VERIFY_NOT_REACHED();
+    }
+
+private:
+    Variant m_variants[max_variants] {};
+    size_t m_count { 0 };
+    Function m_resolved { nullptr };
+};
+
+}
+
+using Base::CPUDispatch;
+using Base::CPUFeatures;
+using Base::cpu_features;
+using Base::detect_cpu_features;
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/ChaCha20Random.h>
+#include <base/StdLibExtras.h>
+
+#ifdef KERNEL
+#    include <kernel/StdLib.h>
+#else
+#    include <string.h>
+#endif
+
+namespace Base {
+
+// Zeroes memory the compiler would otherwise see is never read again.
+static void clear(void* buffer, size_t length)
+{
+    __builtin_memset(buffer, 0, length);
+    asm volatile(""
+                 :
+                 : "r"(buffer)
+                 : "memory");
+}
+
+static ALWAYS_INLINE u32 rotate_left(u32 value, unsigned bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static ALWAYS_INLINE void quarter_round(u32& a, u32& b, u32& c, u32& d)
+{
+    a += b;
+    d = rotate_left(d ^ a, 16);
+    c += d;
+    b = rotate_left(b ^ c, 12);
+    a += b;
+    d = rotate_left(d ^ a, 8);
+    c += d;
+    b = rotate_left(b ^ c, 7);
+}
+
+// The block function of RFC 8439, with a 64-bit counter and no nonce.
+static void chacha20_block(const u32 (&key)[8], u64 counter, u8* out)
+{
+    u32 input[16] = {
+        0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+        key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+        static_cast<u32>(counter), static_cast<u32>(counter >> 32), 0, 0
+    };
+    u32 x[16];
+    for (size_t i = 0; i < 16; ++i)
+        x[i] = input[i];
+
+    for (size_t round = 0; round < 20; round += 2) {
+        quarter_round(x[0], x[4], x[8], x[12]);
+        quarter_round(x[1], x[5], x[9], x[13]);
+        quarter_round(x[2], x[6], x[10], x[14]);
+        quarter_round(x[3], x[7], x[11], x[15]);
+        quarter_round(x[0], x[5], x[10], x[15]);
+        quarter_round(x[1], x[6], x[11], x[12]);
+        quarter_round(x[2], x[7], x[8], x[13]);
+        quarter_round(x[3], x[4], x[9], x[14]);
+    }
+
+    for (size_t i = 0; i < 16; ++i) {
+        u32 word = x[i] + input[i];
+        out[i * 4 + 0] = word;
+        out[i * 4 + 1] = word >> 8;
+        out[i * 4 + 2] = word >> 16;
+        out[i * 4 + 3] = word >> 24;
+    }
+    clear(x, sizeof(x));
+    clear(input, sizeof(input));
+}
+
+void ChaCha20Random::seed(const u8 (&seed)[seed_size])
+{
+    for (size_t i = 0; i < seed_size; ++i)
+        m_key[i / 4] ^= static_cast<u32>(seed[i]) << (i % 4 * 8);
+    // Whatever was buffered came from the old key.
+    clear(m_buffer, sizeof(m_buffer));
+    m_available = 0;
+    m_bytes_until_reseed = reseed_interval;
+}
+
+void ChaCha20Random::reset()
+{
+    clear(m_key, sizeof(m_key));
+    clear(m_buffer, sizeof(m_buffer));
+    m_available = 0;
+    m_bytes_until_reseed = 0;
+}
+
+void ChaCha20Random::refill()
+{
+    u8 keystream[seed_size + buffer_size];
+    static_assert(sizeof(keystream) % block_size == 0);
+    for (size_t block = 0; block < sizeof(keystream) / block_size; ++block)
+        chacha20_block(m_key, block, keystream + block * block_size);
+
+    for (size_t i = 0; i < seed_size / sizeof(u32); ++i)
+        m_key[i] = keystream[i * 4] | (keystream[i * 4 + 1] << 8) | (keystream[i * 4 + 2] << 16) | (static_cast<u32>(keystream[i * 4 + 3]) << 24);
+    memcpy(m_buffer, keystream + seed_size, buffer_size);
+    clear(keystream, sizeof(keystream));
+    m_available = buffer_size;
+}
+
+void ChaCha20Random::fill(void* buffer, size_t length)
+{
+    auto* out = static_cast<u8*>(buffer);
+    while (length) {
+        if (!m_available)
+            refill();
+        size_t count = min(length, m_available);
+        u8* bytes = m_buffer + buffer_size - m_available;
+        memcpy(out, bytes, count);
+        clear(bytes, count);
+        m_available -= count;
+        out += count;
+        length -= count;
+    }
+    m_bytes_until_reseed -= min(m_bytes_until_reseed, static_cast<size_t>(out - static_cast<u8*>(buffer)));
+}
+
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+
+namespace Base {
+
+// A random number generator that serves requests from a buffer of ChaCha20
+// keystream, so most of them are a copy instead of a trip to the kernel.
+// Every refill takes the next key from the keystream itself and bytes are
+// cleared once handed out, so what it hands out can't be worked out again
+// from a later copy of it.
+//
+// It is not thread safe: its owner keeps one of them per thread or CPU
+// and feeds it entropy when needs_seed() says so.
+class ChaCha20Random {
+public:
+    static constexpr size_t seed_size = 32;
+    static constexpr size_t reseed_interval = 1600 * KiB;
+
+    bool needs_seed() const { return m_bytes_until_reseed == 0; }
+
+    // Mixes the seed into the key instead of replacing it, so a weak seed
+    // never makes things worse than they were.
+    void seed(const u8 (&seed)[seed_size]);
+
+    // Forgets the key, for instance after a fork that would otherwise have
+    // it hand out the same bytes in both processes.
+    void reset();
+
+    void fill(void* buffer, size_t length);
+
+private:
+    static constexpr size_t block_size = 64;
+    static constexpr size_t buffer_size = 8 * block_size - seed_size;
+
+    void refill();
+
+    u32 m_key[seed_size / sizeof(u32)] {};
+    u8 m_buffer[buffer_size] {};
+    size_t m_available { 0 };
+    size_t m_bytes_until_reseed { 0 };
+};
+
+}
+
+using Base::ChaCha20Random;
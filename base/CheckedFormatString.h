@@ -10,6 +10,7 @@
 // includes
 #include <base/AllOf.h>
 #include <base/AnyOf.h>
+#include <base/Span.h>
 #include <base/StdLibExtras.h>
 #include <base/StringView.h>
 
@@ -19,6 +20,24 @@
 #    endif
 #endif
 
+namespace Base {
+
+// A replacement field of a format string together with the literal text in
+// front of it, as offsets into the string. The last segment of a string only
+// holds its trailing text.
+struct FormatSegment {
+    static constexpr size_t implicit_index = ~(size_t)0;
+    static constexpr size_t no_field = ~(size_t)0 - 1;
+
+    size_t literal_start { 0 };
+    size_t literal_length { 0 };
+    size_t flags_start { 0 };
+    size_t flags_length { 0 };
+    size_t index { no_field };
+};
+
+}
+
 #ifdef ENABLE_COMPILETIME_FORMAT_CHECK
 namespace Base::Format::Detail {
 
@@ -133,6 +152,71 @@ consteval auto count_fmt_params(const char (&fmt)[N])
     }
     return result;
 }
+
+template<size_t Capacity>
+struct FormatSegments {
+    Array<FormatSegment, Capacity> segments {};
+    size_t count { 0 };
+};
+
+// Splits fmt the way FormatParser does at runtime. Strings with more
+// replacement fields than Capacity, which only happens when explicit indices
+// repeat an argument, come back empty and are parsed at runtime instead.
+template<size_t N, size_t Capacity>
+consteval auto parse_format_segments(const char (&fmt)[N])
+{
+    FormatSegments<Capacity> result;
+    constexpr size_t length = N - 1;
+    size_t i = 0;
+    for (;;) {
+        size_t literal_start = i;
+        while (i < length) {
+            if (i + 1 < length && (fmt[i] == '{' || fmt[i] == '}') && fmt[i + 1] == fmt[i]) {
+                i += 2;
+                continue;
+            }
+            if (fmt[i] == '{' || fmt[i] == '}')
+                break;
+            ++i;
+        }
+
+        if (result.count == Capacity)
+            return FormatSegments<Capacity> {};
+        auto& segment = result.segments[result.count++];
+        segment.literal_start = literal_start;
+        segment.literal_length = i - literal_start;
+        if (i == length)
+            return result;
+        if (fmt[i] != '{')
+            return FormatSegments<Capacity> {};
+        ++i;
+
+        segment.index = FormatSegment::implicit_index;
+        if (i < length && fmt[i] >= '0' && fmt[i] <= '9') {
+            segment.index = 0;
+            for (; i < length && fmt[i] >= '0' && fmt[i] <= '9'; ++i)
+                segment.index = segment.index * 10 + (fmt[i] - '0');
+        }
+
+        if (i < length && fmt[i] == ':') {
+            segment.flags_start = ++i;
+            size_t level = 1;
+            for (; i < length && level > 0; ++i) {
+                if (fmt[i] == '{')
+                    ++level;
+                else if (fmt[i] == '}')
+                    --level;
+            }
+            if (level > 0)
+                return FormatSegments<Capacity> {};
+            segment.flags_length = i - segment.flags_start - 1;
+        } else {
+            if (i == length || fmt[i] != '}')
+                return FormatSegments<Capacity> {};
+            segment.flags_start = ++i;
+        }
+    }
+}
 }
 
 #endif
@@ -146,6 +230,7 @@ struct CheckedFormatString {
     {
 #ifdef ENABLE_COMPILETIME_FORMAT_CHECK
         check_format_parameter_consistency<N, sizeof...(Args)>(fmt);
+        m_segments = parse_format_segments<N, sizeof...(Args) + 1>(fmt);
 #endif
     }
 
@@ -157,6 +242,17 @@ struct CheckedFormatString {
 
     auto view() const { return m_string; }
 
+    // The string split up at compile time, empty if it has to be parsed at
+    // runtime.
+    Span<const FormatSegment> segments() const
+    {
+#ifdef ENABLE_COMPILETIME_FORMAT_CHECK
+        return { m_segments.segments.__data, m_segments.count };
+#else
+        return {};
+#endif
+    }
+
 private:
 #ifdef ENABLE_COMPILETIME_FORMAT_CHECK
     template<size_t N, size_t param_count>
@@ -207,6 +303,9 @@ private:
 #endif
 
     StringView m_string;
+#ifdef ENABLE_COMPILETIME_FORMAT_CHECK
+    FormatSegments<sizeof...(Args) + 1> m_segments;
+#endif
 };
 }
 
@@ -0,0 +1,1774 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#ifndef KERNEL
+
+// includes
+#include <base/BitCast.h>
+#include <base/CharacterTypes.h>
+#include <base/FloatingPointStringConversions.h>
+#include <base/String.h>
+#include <base/StringView.h>
+#include <stdlib.h>
+
+namespace Base {
+
+struct U128 {
+    u64 high;
+    u64 low;
+};
+
+static inline U128 multiply(u64 a, u64 b)
+{
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 product = (unsigned __int128)a * b;
+    return { (u64)(product >> 64), (u64)product };
+#else
+    u64 a_low = (u32)a;
+    u64 a_high = a >> 32;
+    u64 b_low = (u32)b;
+    u64 b_high = b >> 32;
+    u64 low_low = a_low * b_low;
+    u64 low_high = a_low * b_high;
+    u64 high_low = a_high * b_low;
+    u64 middle = low_high + (low_low >> 32) + (u32)high_low;
+    return { a_high * b_high + (middle >> 32) + (high_low >> 32), (middle << 32) | (u32)low_low };
+#endif
+}
+
+// floor(2^(bit_length(5^q) + 124) / 5^q) + 1, low word first.
+static constexpr u64 s_pow5_inverse_split[342][2] = {
+    { 1u, 2305843009213693952u },
+    { 11068046444225730970u, 1844674407370955161u },
+    { 5165088340638674453u, 1475739525896764129u },
+    { 7821419487252849886u, 1180591620717411303u },
+    { 8824922364862649494u, 1888946593147858085u },
+    { 7059937891890119595u, 1511157274518286468u },
+    { 13026647942995916322u, 1208925819614629174u },
+    { 9774590264567735146u, 1934281311383406679u },
+    { 11509021026396098440u, 1547425049106725343u },
+    { 16585914450600699399u, 1237940039285380274u },
+    { 15469416676735388068u, 1980704062856608439u },
+    { 16064882156130220778u, 1584563250285286751u },
+    { 9162556910162266299u, 1267650600228229401u },
+    { 7281393426775805432u, 2028240960365167042u },
+    { 16893161185646375315u, 1622592768292133633u },
+    { 2446482504291369283u, 1298074214633706907u },
+    { 7603720821608101175u, 2076918743413931051u },
+    { 2393627842544570617u, 1661534994731144841u },
+    { 16672297533003297786u, 1329227995784915872u },
+    { 11918280793837635165u, 2126764793255865396u },
+    { 5845275820328197809u, 1701411834604692317u },
+    { 15744267100488289217u, 1361129467683753853u },
+    { 3054734472329800808u, 2177807148294006166u },
+    { 17201182836831481939u, 1742245718635204932u },
+    { 6382248639981364905u, 1393796574908163946u },
+    { 2832900194486363201u, 2230074519853062314u },
+    { 5955668970331000884u, 1784059615882449851u },
+    { 1075186361522890384u, 1427247692705959881u },
+    { 12788344622662355584u, 2283596308329535809u },
+    { 13920024512871794791u, 1826877046663628647u },
+    { 3757321980813615186u, 1461501637330902918u },
+    { 10384555214134712795u, 1169201309864722334u },
+    { 5547241898389809503u, 1870722095783555735u },
+    { 4437793518711847602u, 1496577676626844588u },
+    { 10928932444453298728u, 1197262141301475670u },
+    { 17486291911125277965u, 1915619426082361072u },
+    { 6610335899416401726u, 1532495540865888858u },
+    { 12666966349016942027u, 1225996432692711086u },
+    { 12888448528943286597u, 1961594292308337738u },
+    { 17689456452638449924u, 1569275433846670190u },
+    { 14151565162110759939u, 1255420347077336152u },
+    { 7885109000409574610u, 2008672555323737844u },
+    { 9997436015069570011u, 1606938044258990275u },
+    { 7997948812055656009u, 1285550435407192220u },
+    { 12796718099289049614u, 2056880696651507552u },
+    { 2858676849947419045u, 1645504557321206042u },
+    { 13354987924183666206u, 1316403645856964833u },
+    { 17678631863951955605u, 2106245833371143733u },
+    { 3074859046935833515u, 1684996666696914987u },
+    { 13527933681774397782u, 1347997333357531989u },
+    { 10576647446613305481u, 2156795733372051183u },
+    { 15840015586774465031u, 1725436586697640946u },
+    { 8982663654677661702u, 1380349269358112757u },
+    { 18061610662226169046u, 2208558830972980411u },
+    { 10759939715039024913u, 1766847064778384329u },
+    { 12297300586773130254u, 1413477651822707463u },
+    { 15986332124095098083u, 2261564242916331941u },
+    { 9099716884534168143u, 1809251394333065553u },
+    { 14658471137111155161u, 1447401115466452442u },
+    { 4348079280205103483u, 1157920892373161954u },
+    { 14335624477811986218u, 1852673427797059126u },
+    { 7779150767507678651u, 1482138742237647301u },
+    { 2533971799264232598u, 1185710993790117841u },
+    { 15122401323048503126u, 1897137590064188545u },
+    { 12097921058438802501u, 1517710072051350836u },
+    { 5988988032009131678u, 1214168057641080669u },
+    { 16961078480698431330u, 1942668892225729070u },
+    { 13568862784558745064u, 1554135113780583256u },
+    { 7165741412905085728u, 1243308091024466605u },
+    { 11465186260648137165u, 1989292945639146568u },
+    { 16550846638002330379u, 1591434356511317254u },
+    { 16930026125143774626u, 1273147485209053803u },
+    { 4951948911778577463u, 2037035976334486086u },
+    { 272210314680951647u, 1629628781067588869u },
+    { 3907117066486671641u, 1303703024854071095u },
+    { 6251387306378674625u, 2085924839766513752u },
+    { 16069156289328670670u, 1668739871813211001u },
+    { 9165976216721026213u, 1334991897450568801u },
+    { 7286864317269821294u, 2135987035920910082u },
+    { 16897537898041588005u, 1708789628736728065u },
+    { 13518030318433270404u, 1367031702989382452u },
+    { 6871453250525591353u, 2187250724783011924u },
+    { 9186511415162383406u, 1749800579826409539u },
+    { 11038557946871817048u, 1399840463861127631u },
+    { 10282995085511086630u, 2239744742177804210u },
+    { 8226396068408869304u, 1791795793742243368u },
+    { 13959814484210916090u, 1433436634993794694u },
+    { 11267656730511734774u, 2293498615990071511u },
+    { 5324776569667477496u, 1834798892792057209u },
+    { 7949170070475892320u, 1467839114233645767u },
+    { 17427382500606444826u, 1174271291386916613u },
+    { 5747719112518849781u, 1878834066219066582u },
+    { 15666221734240810795u, 1503067252975253265u },
+    { 12532977387392648636u, 1202453802380202612u },
+    { 5295368560860596524u, 1923926083808324180u },
+    { 4236294848688477220u, 1539140867046659344u },
+    { 7078384693692692099u, 1231312693637327475u },
+    { 11325415509908307358u, 1970100309819723960u },
+    { 9060332407926645887u, 1576080247855779168u },
+    { 14626963555825137356u, 1260864198284623334u },
+    { 12335095245094488799u, 2017382717255397335u },
+    { 9868076196075591040u, 1613906173804317868u },
+    { 15273158586344293478u, 1291124939043454294u },
+    { 13369007293925138595u, 2065799902469526871u },
+    { 7005857020398200553u, 1652639921975621497u },
+    { 16672732060544291412u, 1322111937580497197u },
+    { 11918976037903224966u, 2115379100128795516u },
+    { 5845832015580669650u, 1692303280103036413u },
+    { 12055363241948356366u, 1353842624082429130u },
+    { 841837113407818570u, 2166148198531886609u },
+    { 4362818505468165179u, 1732918558825509287u },
+    { 14558301248600263113u, 1386334847060407429u },
+    { 12225235553534690011u, 2218135755296651887u },
+    { 2401490813343931363u, 1774508604237321510u },
+    { 1921192650675145090u, 1419606883389857208u },
+    { 17831303500047873437u, 2271371013423771532u },
+    { 6886345170554478103u, 1817096810739017226u },
+    { 1819727321701672159u, 1453677448591213781u },
+    { 16213177116328979020u, 1162941958872971024u },
+    { 14873036941900635463u, 1860707134196753639u },
+    { 15587778368262418694u, 1488565707357402911u },
+    { 8780873879868024632u, 1190852565885922329u },
+    { 2981351763563108441u, 1905364105417475727u },
+    { 13453127855076217722u, 1524291284333980581u },
+    { 7073153469319063855u, 1219433027467184465u },
+    { 11317045550910502167u, 1951092843947495144u },
+    { 12742985255470312057u, 1560874275157996115u },
+    { 10194388204376249646u, 1248699420126396892u },
+    { 1553625868034358140u, 1997919072202235028u },
+    { 8621598323911307159u, 1598335257761788022u },
+    { 17965325103354776697u, 1278668206209430417u },
+    { 13987124906400001422u, 2045869129935088668u },
+    { 121653480894270168u, 1636695303948070935u },
+    { 97322784715416134u, 1309356243158456748u },
+    { 14913111714512307107u, 2094969989053530796u },
+    { 8241140556867935363u, 1675975991242824637u },
+    { 17660958889720079260u, 1340780792994259709u },
+    { 17189487779326395846u, 2145249268790815535u },
+    { 13751590223461116677u, 1716199415032652428u },
+    { 18379969808252713988u, 1372959532026121942u },
+    { 14650556434236701088u, 2196735251241795108u },
+    { 652398703163629901u, 1757388200993436087u },
+    { 11589965406756634890u, 1405910560794748869u },
+    { 7475898206584884855u, 2249456897271598191u },
+    { 2291369750525997561u, 1799565517817278553u },
+    { 9211793429904618695u, 1439652414253822842u },
+    { 18428218302589300235u, 2303443862806116547u },
+    { 7363877012587619542u, 1842755090244893238u },
+    { 13269799239553916280u, 1474204072195914590u },
+    { 10615839391643133024u, 1179363257756731672u },
+    { 2227947767661371545u, 1886981212410770676u },
+    { 16539753473096738529u, 1509584969928616540u },
+    { 13231802778477390823u, 1207667975942893232u },
+    { 6413489186596184024u, 1932268761508629172u },
+    { 16198837793502678189u, 1545815009206903337u },
+    { 5580372605318321905u, 1236652007365522670u },
+    { 8928596168509315048u, 1978643211784836272u },
+    { 18210923379033183008u, 1582914569427869017u },
+    { 7190041073742725760u, 1266331655542295214u },
+    { 436019273762630246u, 2026130648867672343u },
+    { 7727513048493924843u, 1620904519094137874u },
+    { 9871359253537050198u, 1296723615275310299u },
+    { 4726128361433549347u, 2074757784440496479u },
+    { 7470251503888749801u, 1659806227552397183u },
+    { 13354898832594820487u, 1327844982041917746u },
+    { 13989140502667892133u, 2124551971267068394u },
+    { 14880661216876224029u, 1699641577013654715u },
+    { 11904528973500979224u, 1359713261610923772u },
+    { 4289851098633925465u, 2175541218577478036u },
+    { 18189276137874781665u, 1740432974861982428u },
+    { 3483374466074094362u, 1392346379889585943u },
+    { 1884050330976640656u, 2227754207823337509u },
+    { 5196589079523222848u, 1782203366258670007u },
+    { 15225317707844309248u, 1425762693006936005u },
+    { 5913764258841343181u, 2281220308811097609u },
+    { 8420360221814984868u, 1824976247048878087u },
+    { 17804334621677718864u, 1459980997639102469u },
+    { 17932816512084085415u, 1167984798111281975u },
+    { 10245762345624985047u, 1868775676978051161u },
+    { 4507261061758077715u, 1495020541582440929u },
+    { 7295157664148372495u, 1196016433265952743u },
+    { 7982903447895485668u, 1913626293225524389u },
+    { 10075671573058298858u, 1530901034580419511u },
+    { 4371188443704728763u, 1224720827664335609u },
+    { 14372599139411386667u, 1959553324262936974u },
+    { 15187428126271019657u, 1567642659410349579u },
+    { 15839291315758726049u, 1254114127528279663u },
+    { 3206773216762499739u, 2006582604045247462u },
+    { 13633465017635730761u, 1605266083236197969u },
+    { 14596120828850494932u, 1284212866588958375u },
+    { 4907049252451240275u, 2054740586542333401u },
+    { 236290587219081897u, 1643792469233866721u },
+    { 14946427728742906810u, 1315033975387093376u },
+    { 16535586736504830250u, 2104054360619349402u },
+    { 5849771759720043554u, 1683243488495479522u },
+    { 15747863852001765813u, 1346594790796383617u },
+    { 10439186904235184007u, 2154551665274213788u },
+    { 15730047152871967852u, 1723641332219371030u },
+    { 12584037722297574282u, 1378913065775496824u },
+    { 9066413911450387881u, 2206260905240794919u },
+    { 10942479943902220628u, 1765008724192635935u },
+    { 8753983955121776503u, 1412006979354108748u },
+    { 10317025513452932081u, 2259211166966573997u },
+    { 874922781278525018u, 1807368933573259198u },
+    { 8078635854506640661u, 1445895146858607358u },
+    { 13841606313089133175u, 1156716117486885886u },
+    { 14767872471458792434u, 1850745787979017418u },
+    { 746251532941302978u, 1480596630383213935u },
+    { 597001226353042382u, 1184477304306571148u },
+    { 15712597221132509104u, 1895163686890513836u },
+    { 8880728962164096960u, 1516130949512411069u },
+    { 10793931984473187891u, 1212904759609928855u },
+    { 17270291175157100626u, 1940647615375886168u },
+    { 2748186495899949531u, 1552518092300708935u },
+    { 2198549196719959625u, 1242014473840567148u },
+    { 18275073973719576693u, 1987223158144907436u },
+    { 10930710364233751031u, 1589778526515925949u },
+    { 12433917106128911148u, 1271822821212740759u },
+    { 8826220925580526867u, 2034916513940385215u },
+    { 7060976740464421494u, 1627933211152308172u },
+    { 16716827836597268165u, 1302346568921846537u },
+    { 11989529279587987770u, 2083754510274954460u },
+    { 9591623423670390216u, 1667003608219963568u },
+    { 15051996368420132820u, 1333602886575970854u },
+    { 13015147745246481542u, 2133764618521553367u },
+    { 3033420566713364587u, 1707011694817242694u },
+    { 6116085268112601993u, 1365609355853794155u },
+    { 9785736428980163188u, 2184974969366070648u },
+    { 15207286772667951197u, 1747979975492856518u },
+    { 1097782973908629988u, 1398383980394285215u },
+    { 1756452758253807981u, 2237414368630856344u },
+    { 5094511021344956708u, 1789931494904685075u },
+    { 4075608817075965366u, 1431945195923748060u },
+    { 6520974107321544586u, 2291112313477996896u },
+    { 1527430471115325346u, 1832889850782397517u },
+    { 12289990821117991246u, 1466311880625918013u },
+    { 17210690286378213644u, 1173049504500734410u },
+    { 9090360384495590213u, 1876879207201175057u },
+    { 18340334751822203140u, 1501503365760940045u },
+    { 14672267801457762512u, 1201202692608752036u },
+    { 16096930852848599373u, 1921924308174003258u },
+    { 1809498238053148529u, 1537539446539202607u },
+    { 12515645034668249793u, 1230031557231362085u },
+    { 1578287981759648052u, 1968050491570179337u },
+    { 12330676829633449412u, 1574440393256143469u },
+    { 13553890278448669853u, 1259552314604914775u },
+    { 3239480371808320148u, 2015283703367863641u },
+    { 17348979556414297411u, 1612226962694290912u },
+    { 6500486015647617283u, 1289781570155432730u },
+    { 10400777625036187652u, 2063650512248692368u },
+    { 15699319729512770768u, 1650920409798953894u },
+    { 16248804598352126938u, 1320736327839163115u },
+    { 7551343283653851484u, 2113178124542660985u },
+    { 6041074626923081187u, 1690542499634128788u },
+    { 12211557331022285596u, 1352433999707303030u },
+    { 1091747655926105338u, 2163894399531684849u },
+    { 4562746939482794594u, 1731115519625347879u },
+    { 7339546366328145998u, 1384892415700278303u },
+    { 8053925371383123274u, 2215827865120445285u },
+    { 6443140297106498619u, 1772662292096356228u },
+    { 12533209867169019542u, 1418129833677084982u },
+    { 5295740528502789974u, 2269007733883335972u },
+    { 15304638867027962949u, 1815206187106668777u },
+    { 4865013464138549713u, 1452164949685335022u },
+    { 14960057215536570740u, 1161731959748268017u },
+    { 9178696285890871890u, 1858771135597228828u },
+    { 14721654658196518159u, 1487016908477783062u },
+    { 4398626097073393881u, 1189613526782226450u },
+    { 7037801755317430209u, 1903381642851562320u },
+    { 5630241404253944167u, 1522705314281249856u },
+    { 814844308661245011u, 1218164251424999885u },
+    { 1303750893857992017u, 1949062802279999816u },
+    { 15800395974054034906u, 1559250241823999852u },
+    { 5261619149759407279u, 1247400193459199882u },
+    { 12107939454356961969u, 1995840309534719811u },
+    { 5997002748743659252u, 1596672247627775849u },
+    { 8486951013736837725u, 1277337798102220679u },
+    { 2511075177753209390u, 2043740476963553087u },
+    { 13076906586428298482u, 1634992381570842469u },
+    { 14150874083884549109u, 1307993905256673975u },
+    { 4194654460505726958u, 2092790248410678361u },
+    { 18113118827372222859u, 1674232198728542688u },
+    { 3422448617672047318u, 1339385758982834151u },
+    { 16543964232501006678u, 2143017214372534641u },
+    { 9545822571258895019u, 1714413771498027713u },
+    { 15015355686490936662u, 1371531017198422170u },
+    { 5577825024675947042u, 2194449627517475473u },
+    { 11840957649224578280u, 1755559702013980378u },
+    { 16851463748863483271u, 1404447761611184302u },
+    { 12204946739213931940u, 2247116418577894884u },
+    { 13453306206113055875u, 1797693134862315907u },
+    { 3383947335406624054u, 1438154507889852726u },
+    { 16482362180876329456u, 2301047212623764361u },
+    { 9496540929959153242u, 1840837770099011489u },
+    { 11286581558709232917u, 1472670216079209191u },
+    { 5339916432225476010u, 1178136172863367353u },
+    { 4854517476818851293u, 1885017876581387765u },
+    { 3883613981455081034u, 1508014301265110212u },
+    { 14174937629389795797u, 1206411441012088169u },
+    { 11611853762797942306u, 1930258305619341071u },
+    { 5600134195496443521u, 1544206644495472857u },
+    { 15548153800622885787u, 1235365315596378285u },
+    { 6430302007287065643u, 1976584504954205257u },
+    { 16212288050055383484u, 1581267603963364205u },
+    { 12969830440044306787u, 1265014083170691364u },
+    { 9683682259845159889u, 2024022533073106183u },
+    { 15125643437359948558u, 1619218026458484946u },
+    { 8411165935146048523u, 1295374421166787957u },
+    { 17147214310975587960u, 2072599073866860731u },
+    { 10028422634038560045u, 1658079259093488585u },
+    { 8022738107230848036u, 1326463407274790868u },
+    { 9147032156827446534u, 2122341451639665389u },
+    { 11006974540203867551u, 1697873161311732311u },
+    { 5116230817421183718u, 1358298529049385849u },
+    { 15564666937357714594u, 2173277646479017358u },
+    { 1383687105660440706u, 1738622117183213887u },
+    { 12174996128754083534u, 1390897693746571109u },
+    { 8411947361780802685u, 2225436309994513775u },
+    { 6729557889424642148u, 1780349047995611020u },
+    { 5383646311539713719u, 1424279238396488816u },
+    { 1235136468979721303u, 2278846781434382106u },
+    { 15745504434151418335u, 1823077425147505684u },
+    { 16285752362063044992u, 1458461940118004547u },
+    { 5649904260166615347u, 1166769552094403638u },
+    { 5350498001524674232u, 1866831283351045821u },
+    { 591049586477829062u, 1493465026680836657u },
+    { 11540886113407994219u, 1194772021344669325u },
+    { 18673707743239135u, 1911635234151470921u },
+    { 14772334225162232601u, 1529308187321176736u },
+    { 8128518565387875758u, 1223446549856941389u },
+    { 1937583260394870242u, 1957514479771106223u },
+    { 8928764237799716840u, 1566011583816884978u },
+    { 14521709019723594119u, 1252809267053507982u },
+    { 8477339172590109297u, 2004494827285612772u },
+    { 17849917782297818407u, 1603595861828490217u },
+    { 6901236596354434079u, 1282876689462792174u },
+    { 18420676183650915173u, 2052602703140467478u },
+    { 3668494502695001169u, 1642082162512373983u },
+    { 10313493231639821582u, 1313665730009899186u },
+    { 9122891541139893884u, 2101865168015838698u },
+    { 14677010862395735754u, 1681492134412670958u },
+    { 673562245690857633u, 1345193707530136767u },
+};
+
+// 5^i truncated to its 125 most significant bits, low word first.
+static constexpr u64 s_pow5_split[326][2] = {
+    { 0u, 1152921504606846976u },
+    { 0u, 1441151880758558720u },
+    { 0u, 1801439850948198400u },
+    { 0u, 2251799813685248000u },
+    { 0u, 1407374883553280000u },
+    { 0u, 1759218604441600000u },
+    { 0u, 2199023255552000000u },
+    { 0u, 1374389534720000000u },
+    { 0u, 1717986918400000000u },
+    { 0u, 2147483648000000000u },
+    { 0u, 1342177280000000000u },
+    { 0u, 1677721600000000000u },
+    { 0u, 2097152000000000000u },
+    { 0u, 1310720000000000000u },
+    { 0u, 1638400000000000000u },
+    { 0u, 2048000000000000000u },
+    { 0u, 1280000000000000000u },
+    { 0u, 1600000000000000000u },
+    { 0u, 2000000000000000000u },
+    { 0u, 1250000000000000000u },
+    { 0u, 1562500000000000000u },
+    { 0u, 1953125000000000000u },
+    { 0u, 1220703125000000000u },
+    { 0u, 1525878906250000000u },
+    { 0u, 1907348632812500000u },
+    { 0u, 1192092895507812500u },
+    { 0u, 1490116119384765625u },
+    { 4611686018427387904u, 1862645149230957031u },
+    { 9799832789158199296u, 1164153218269348144u },
+    { 12249790986447749120u, 1455191522836685180u },
+    { 15312238733059686400u, 1818989403545856475u },
+    { 14528612397897220096u, 2273736754432320594u },
+    { 13692068767113150464u, 1421085471520200371u },
+    { 12503399940464050176u, 1776356839400250464u },
+    { 15629249925580062720u, 2220446049250313080u },
+    { 9768281203487539200u, 1387778780781445675u },
+    { 7598665485932036096u, 1734723475976807094u },
+    { 274959820560269312u, 2168404344971008868u },
+    { 9395221924704944128u, 1355252715606880542u },
+    { 2520655369026404352u, 1694065894508600678u },
+    { 12374191248137781248u, 2117582368135750847u },
+    { 14651398557727195136u, 1323488980084844279u },
+    { 13702562178731606016u, 1654361225106055349u },
+    { 3293144668132343808u, 2067951531382569187u },
+    { 18199116482078572544u, 1292469707114105741u },
+    { 8913837547316051968u, 1615587133892632177u },
+    { 15753982952572452864u, 2019483917365790221u },
+    { 12152082354571476992u, 1262177448353618888u },
+    { 15190102943214346240u, 1577721810442023610u },
+    { 9764256642163156992u, 1972152263052529513u },
+    { 17631875447420442880u, 1232595164407830945u },
+    { 8204786253993389888u, 1540743955509788682u },
+    { 1032610780636961552u, 1925929944387235853u },
+    { 2951224747111794922u, 1203706215242022408u },
+    { 3689030933889743652u, 1504632769052528010u },
+    { 13834660704216955373u, 1880790961315660012u },
+    { 17870034976990372916u, 1175494350822287507u },
+    { 17725857702810578241u, 1469367938527859384u },
+    { 3710578054803671186u, 1836709923159824231u },
+    { 26536550077201078u, 2295887403949780289u },
+    { 11545800389866720434u, 1434929627468612680u },
+    { 14432250487333400542u, 1793662034335765850u },
+    { 8816941072311974870u, 2242077542919707313u },
+    { 17039803216263454053u, 1401298464324817070u },
+    { 12076381983474541759u, 1751623080406021338u },
+    { 5872105442488401391u, 2189528850507526673u },
+    { 15199280947623720629u, 1368455531567204170u },
+    { 9775729147674874978u, 1710569414459005213u },
+    { 16831347453020981627u, 2138211768073756516u },
+    { 1296220121283337709u, 1336382355046097823u },
+    { 15455333206886335848u, 1670477943807622278u },
+    { 10095794471753144002u, 2088097429759527848u },
+    { 6309871544845715001u, 1305060893599704905u },
+    { 12499025449484531656u, 1631326116999631131u },
+    { 11012095793428276666u, 2039157646249538914u },
+    { 11494245889320060820u, 1274473528905961821u },
+    { 532749306367912313u, 1593091911132452277u },
+    { 5277622651387278295u, 1991364888915565346u },
+    { 7910200175544436838u, 1244603055572228341u },
+    { 14499436237857933952u, 1555753819465285426u },
+    { 8900923260467641632u, 1944692274331606783u },
+    { 12480606065433357876u, 1215432671457254239u },
+    { 10989071563364309441u, 1519290839321567799u },
+    { 9124653435777998898u, 1899113549151959749u },
+    { 8008751406574943263u, 1186945968219974843u },
+    { 5399253239791291175u, 1483682460274968554u },
+    { 15972438586593889776u, 1854603075343710692u },
+    { 759402079766405302u, 1159126922089819183u },
+    { 14784310654990170340u, 1448908652612273978u },
+    { 9257016281882937117u, 1811135815765342473u },
+    { 16182956370781059300u, 2263919769706678091u },
+    { 7808504722524468110u, 1414949856066673807u },
+    { 5148944884728197234u, 1768687320083342259u },
+    { 1824495087482858639u, 2210859150104177824u },
+    { 1140309429676786649u, 1381786968815111140u },
+    { 1425386787095983311u, 1727233711018888925u },
+    { 6393419502297367043u, 2159042138773611156u },
+    { 13219259225790630210u, 1349401336733506972u },
+    { 16524074032238287762u, 1686751670916883715u },
+    { 16043406521870471799u, 2108439588646104644u },
+    { 803757039314269066u, 1317774742903815403u },
+    { 14839754354425000045u, 1647218428629769253u },
+    { 4714634887749086344u, 2059023035787211567u },
+    { 9864175832484260821u, 1286889397367007229u },
+    { 16941905809032713930u, 1608611746708759036u },
+    { 2730638187581340797u, 2010764683385948796u },
+    { 10930020904093113806u, 1256727927116217997u },
+    { 18274212148543780162u, 1570909908895272496u },
+    { 4396021111970173586u, 1963637386119090621u },
+    { 5053356204195052443u, 1227273366324431638u },
+    { 15540067292098591362u, 1534091707905539547u },
+    { 14813398096695851299u, 1917614634881924434u },
+    { 13870059828862294966u, 1198509146801202771u },
+    { 12725888767650480803u, 1498136433501503464u },
+    { 15907360959563101004u, 1872670541876879330u },
+    { 14553786618154326031u, 1170419088673049581u },
+    { 4357175217410743827u, 1463023860841311977u },
+    { 10058155040190817688u, 1828779826051639971u },
+    { 7961007781811134206u, 2285974782564549964u },
+    { 14199001900486734687u, 1428734239102843727u },
+    { 13137066357181030455u, 1785917798878554659u },
+    { 11809646928048900164u, 2232397248598193324u },
+    { 16604401366885338411u, 1395248280373870827u },
+    { 16143815690179285109u, 1744060350467338534u },
+    { 10956397575869330579u, 2180075438084173168u },
+    { 6847748484918331612u, 1362547148802608230u },
+    { 17783057643002690323u, 1703183936003260287u },
+    { 17617136035325974999u, 2128979920004075359u },
+    { 17928239049719816230u, 1330612450002547099u },
+    { 17798612793722382384u, 1663265562503183874u },
+    { 13024893955298202172u, 2079081953128979843u },
+    { 5834715712847682405u, 1299426220705612402u },
+    { 16516766677914378815u, 1624282775882015502u },
+    { 11422586310538197711u, 2030353469852519378u },
+    { 11750802462513761473u, 1268970918657824611u },
+    { 10076817059714813937u, 1586213648322280764u },
+    { 12596021324643517422u, 1982767060402850955u },
+    { 5566670318688504437u, 1239229412751781847u },
+    { 2346651879933242642u, 1549036765939727309u },
+    { 7545000868343941206u, 1936295957424659136u },
+    { 4715625542714963254u, 1210184973390411960u },
+    { 5894531928393704067u, 1512731216738014950u },
+    { 16591536947346905892u, 1890914020922518687u },
+    { 17287239619732898039u, 1181821263076574179u },
+    { 16997363506238734644u, 1477276578845717724u },
+    { 2799960309088866689u, 1846595723557147156u },
+    { 10973347230035317489u, 1154122327223216972u },
+    { 13716684037544146861u, 1442652909029021215u },
+    { 12534169028502795672u, 1803316136286276519u },
+    { 11056025267201106687u, 2254145170357845649u },
+    { 18439230838069161439u, 1408840731473653530u },
+    { 13825666510731675991u, 1761050914342066913u },
+    { 3447025083132431277u, 2201313642927583642u },
+    { 6766076695385157452u, 1375821026829739776u },
+    { 8457595869231446815u, 1719776283537174720u },
+    { 10571994836539308519u, 2149720354421468400u },
+    { 6607496772837067824u, 1343575221513417750u },
+    { 17482743002901110588u, 1679469026891772187u },
+    { 17241742735199000331u, 2099336283614715234u },
+    { 15387775227926763111u, 1312085177259197021u },
+    { 5399660979626290177u, 1640106471573996277u },
+    { 11361262242960250625u, 2050133089467495346u },
+    { 11712474920277544544u, 1281333180917184591u },
+    { 10028907631919542777u, 1601666476146480739u },
+    { 7924448521472040567u, 2002083095183100924u },
+    { 14176152362774801162u, 1251301934489438077u },
+    { 3885132398186337741u, 1564127418111797597u },
+    { 9468101516160310080u, 1955159272639746996u },
+    { 15140935484454969608u, 1221974545399841872u },
+    { 479425281859160394u, 1527468181749802341u },
+    { 5210967620751338397u, 1909335227187252926u },
+    { 17091912818251750210u, 1193334516992033078u },
+    { 12141518985959911954u, 1491668146240041348u },
+    { 15176898732449889943u, 1864585182800051685u },
+    { 11791404716994875166u, 1165365739250032303u },
+    { 10127569877816206054u, 1456707174062540379u },
+    { 8047776328842869663u, 1820883967578175474u },
+    { 836348374198811271u, 2276104959472719343u },
+    { 7440246761515338900u, 1422565599670449589u },
+    { 13911994470321561530u, 1778206999588061986u },
+    { 8166621051047176104u, 2222758749485077483u },
+    { 2798295147690791113u, 1389224218428173427u },
+    { 17332926989895652603u, 1736530273035216783u },
+    { 17054472718942177850u, 2170662841294020979u },
+    { 8353202440125167204u, 1356664275808763112u },
+    { 10441503050156459005u, 1695830344760953890u },
+    { 3828506775840797949u, 2119787930951192363u },
+    { 86973725686804766u, 1324867456844495227u },
+    { 13943775212390669669u, 1656084321055619033u },
+    { 3594660960206173375u, 2070105401319523792u },
+    { 2246663100128858359u, 1293815875824702370u },
+    { 12031700912015848757u, 1617269844780877962u },
+    { 5816254103165035138u, 2021587305976097453u },
+    { 5941001823691840913u, 1263492066235060908u },
+    { 7426252279614801142u, 1579365082793826135u },
+    { 4671129331091113523u, 1974206353492282669u },
+    { 5225298841145639904u, 1233878970932676668u },
+    { 6531623551432049880u, 1542348713665845835u },
+    { 3552843420862674446u, 1927935892082307294u },
+    { 16055585193321335241u, 1204959932551442058u },
+    { 10846109454796893243u, 1506199915689302573u },
+    { 18169322836923504458u, 1882749894611628216u },
+    { 11355826773077190286u, 1176718684132267635u },
+    { 9583097447919099954u, 1470898355165334544u },
+    { 11978871809898874942u, 1838622943956668180u },
+    { 14973589762373593678u, 2298278679945835225u },
+    { 2440964573842414192u, 1436424174966147016u },
+    { 3051205717303017741u, 1795530218707683770u },
+    { 13037379183483547984u, 2244412773384604712u },
+    { 8148361989677217490u, 1402757983365377945u },
+    { 14797138505523909766u, 1753447479206722431u },
+    { 13884737113477499304u, 2191809349008403039u },
+    { 15595489723564518921u, 1369880843130251899u },
+    { 14882676136028260747u, 1712351053912814874u },
+    { 9379973133180550126u, 2140438817391018593u },
+    { 17391698254306313589u, 1337774260869386620u },
+    { 3292878744173340370u, 1672217826086733276u },
+    { 4116098430216675462u, 2090272282608416595u },
+    { 266718509671728212u, 1306420176630260372u },
+    { 333398137089660265u, 1633025220787825465u },
+    { 5028433689789463235u, 2041281525984781831u },
+    { 10060300083759496378u, 1275800953740488644u },
+    { 12575375104699370472u, 1594751192175610805u },
+    { 1884160825592049379u, 1993438990219513507u },
+    { 17318501580490888525u, 1245899368887195941u },
+    { 7813068920331446945u, 1557374211108994927u },
+    { 5154650131986920777u, 1946717763886243659u },
+    { 915813323278131534u, 1216698602428902287u },
+    { 14979824709379828129u, 1520873253036127858u },
+    { 9501408849870009354u, 1901091566295159823u },
+    { 12855909558809837702u, 1188182228934474889u },
+    { 2234828893230133415u, 1485227786168093612u },
+    { 2793536116537666769u, 1856534732710117015u },
+    { 8663489100477123587u, 1160334207943823134u },
+    { 1605989338741628675u, 1450417759929778918u },
+    { 11230858710281811652u, 1813022199912223647u },
+    { 9426887369424876662u, 2266277749890279559u },
+    { 12809333633531629769u, 1416423593681424724u },
+    { 16011667041914537212u, 1770529492101780905u },
+    { 6179525747111007803u, 2213161865127226132u },
+    { 13085575628799155685u, 1383226165704516332u },
+    { 16356969535998944606u, 1729032707130645415u },
+    { 15834525901571292854u, 2161290883913306769u },
+    { 2979049660840976177u, 1350806802445816731u },
+    { 17558870131333383934u, 1688508503057270913u },
+    { 8113529608884566205u, 2110635628821588642u },
+    { 9682642023980241782u, 1319147268013492901u },
+    { 16714988548402690132u, 1648934085016866126u },
+    { 11670363648648586857u, 2061167606271082658u },
+    { 11905663298832754689u, 1288229753919426661u },
+    { 1047021068258779650u, 1610287192399283327u },
+    { 15143834390605638274u, 2012858990499104158u },
+    { 4853210475701136017u, 1258036869061940099u },
+    { 1454827076199032118u, 1572546086327425124u },
+    { 1818533845248790147u, 1965682607909281405u },
+    { 3442426662494187794u, 1228551629943300878u },
+    { 13526405364972510550u, 1535689537429126097u },
+    { 3072948650933474476u, 1919611921786407622u },
+    { 15755650962115585259u, 1199757451116504763u },
+    { 15082877684217093670u, 1499696813895630954u },
+    { 9630225068416591280u, 1874621017369538693u },
+    { 8324733676974063502u, 1171638135855961683u },
+    { 5794231077790191473u, 1464547669819952104u },
+    { 7242788847237739342u, 1830684587274940130u },
+    { 18276858095901949986u, 2288355734093675162u },
+    { 16034722328366106645u, 1430222333808546976u },
+    { 1596658836748081690u, 1787777917260683721u },
+    { 6607509564362490017u, 2234722396575854651u },
+    { 1823850468512862308u, 1396701497859909157u },
+    { 6891499104068465790u, 1745876872324886446u },
+    { 17837745916940358045u, 2182346090406108057u },
+    { 4231062170446641922u, 1363966306503817536u },
+    { 5288827713058302403u, 1704957883129771920u },
+    { 6611034641322878003u, 2131197353912214900u },
+    { 13355268687681574560u, 1331998346195134312u },
+    { 16694085859601968200u, 1664997932743917890u },
+    { 11644235287647684442u, 2081247415929897363u },
+    { 4971804045566108824u, 1300779634956185852u },
+    { 6214755056957636030u, 1625974543695232315u },
+    { 3156757802769657134u, 2032468179619040394u },
+    { 6584659645158423613u, 1270292612261900246u },
+    { 17454196593302805324u, 1587865765327375307u },
+    { 17206059723201118751u, 1984832206659219134u },
+    { 6142101308573311315u, 1240520129162011959u },
+    { 3065940617289251240u, 1550650161452514949u },
+    { 8444111790038951954u, 1938312701815643686u },
+    { 665883850346957067u, 1211445438634777304u },
+    { 832354812933696334u, 1514306798293471630u },
+    { 10263815553021896226u, 1892883497866839537u },
+    { 17944099766707154901u, 1183052186166774710u },
+    { 13206752671529167818u, 1478815232708468388u },
+    { 16508440839411459773u, 1848519040885585485u },
+    { 12623618533845856310u, 1155324400553490928u },
+    { 15779523167307320387u, 1444155500691863660u },
+    { 1277659885424598868u, 1805194375864829576u },
+    { 1597074856780748586u, 2256492969831036970u },
+    { 5609857803915355770u, 1410308106144398106u },
+    { 16235694291748970521u, 1762885132680497632u },
+    { 1847873790976661535u, 2203606415850622041u },
+    { 12684136165428883219u, 1377254009906638775u },
+    { 11243484188358716120u, 1721567512383298469u },
+    { 219297180166231438u, 2151959390479123087u },
+    { 7054589765244976505u, 1344974619049451929u },
+    { 13429923224983608535u, 1681218273811814911u },
+    { 12175718012802122765u, 2101522842264768639u },
+    { 14527352785642408584u, 1313451776415480399u },
+    { 13547504963625622826u, 1641814720519350499u },
+    { 12322695186104640628u, 2052268400649188124u },
+    { 16925056528170176201u, 1282667750405742577u },
+    { 7321262604930556539u, 1603334688007178222u },
+    { 18374950293017971482u, 2004168360008972777u },
+    { 4566814905495150320u, 1252605225005607986u },
+    { 14931890668723713708u, 1565756531257009982u },
+    { 9441491299049866327u, 1957195664071262478u },
+    { 1289246043478778550u, 1223247290044539049u },
+    { 6223243572775861092u, 1529059112555673811u },
+    { 3167368447542438461u, 1911323890694592264u },
+    { 1979605279714024038u, 1194577431684120165u },
+    { 7086192618069917952u, 1493221789605150206u },
+    { 18081112809442173248u, 1866527237006437757u },
+    { 13606538515115052232u, 1166579523129023598u },
+    { 7784801107039039482u, 1458224403911279498u },
+    { 507629346944023544u, 1822780504889099373u },
+    { 5246222702107417334u, 2278475631111374216u },
+    { 3278889188817135834u, 1424047269444608885u },
+    { 8710297504448807696u, 1780059086805761106u },
+};
+
+// 5^q normalized to 128 bits, for q in [-342, 308], high word first.
+static constexpr u64 s_powers_of_five_128[651][2] = {
+    { 0xeef453d6923bd65au, 0x113faa2906a13b3fu },
+    { 0x9558b4661b6565f8u, 0x4ac7ca59a424c507u },
+    { 0xbaaee17fa23ebf76u, 0x5d79bcf00d2df649u },
+    { 0xe95a99df8ace6f53u, 0xf4d82c2c107973dcu },
+    { 0x91d8a02bb6c10594u, 0x79071b9b8a4be869u },
+    { 0xb64ec836a47146f9u, 0x9748e2826cdee284u },
+    { 0xe3e27a444d8d98b7u, 0xfd1b1b2308169b25u },
+    { 0x8e6d8c6ab0787f72u, 0xfe30f0f5e50e20f7u },
+    { 0xb208ef855c969f4fu, 0xbdbd2d335e51a935u },
+    { 0xde8b2b66b3bc4723u, 0xad2c788035e61382u },
+    { 0x8b16fb203055ac76u, 0x4c3bcb5021afcc31u },
+    { 0xaddcb9e83c6b1793u, 0xdf4abe242a1bbf3du },
+    { 0xd953e8624b85dd78u, 0xd71d6dad34a2af0du },
+    { 0x87d4713d6f33aa6bu, 0x8672648c40e5ad68u },
+    { 0xa9c98d8ccb009506u, 0x680efdaf511f18c2u },
+    { 0xd43bf0effdc0ba48u, 0x0212bd1b2566def2u },
+    { 0x84a57695fe98746du, 0x014bb630f7604b57u },
+    { 0xa5ced43b7e3e9188u, 0x419ea3bd35385e2du },
+    { 0xcf42894a5dce35eau, 0x52064cac828675b9u },
+    { 0x818995ce7aa0e1b2u, 0x7343efebd1940993u },
+    { 0xa1ebfb4219491a1fu, 0x1014ebe6c5f90bf8u },
+    { 0xca66fa129f9b60a6u, 0xd41a26e077774ef6u },
+    { 0xfd00b897478238d0u, 0x8920b098955522b4u },
+    { 0x9e20735e8cb16382u, 0x55b46e5f5d5535b0u },
+    { 0xc5a890362fddbc62u, 0xeb2189f734aa831du },
+    { 0xf712b443bbd52b7bu, 0xa5e9ec7501d523e4u },
+    { 0x9a6bb0aa55653b2du, 0x47b233c92125366eu },
+    { 0xc1069cd4eabe89f8u, 0x999ec0bb696e840au },
+    { 0xf148440a256e2c76u, 0xc00670ea43ca250du },
+    { 0x96cd2a865764dbcau, 0x380406926a5e5728u },
+    { 0xbc807527ed3e12bcu, 0xc605083704f5ecf2u },
+    { 0xeba09271e88d976bu, 0xf7864a44c633682eu },
+    { 0x93445b8731587ea3u, 0x7ab3ee6afbe0211du },
+    { 0xb8157268fdae9e4cu, 0x5960ea05bad82964u },
+    { 0xe61acf033d1a45dfu, 0x6fb92487298e33bdu },
+    { 0x8fd0c16206306babu, 0xa5d3b6d479f8e056u },
+    { 0xb3c4f1ba87bc8696u, 0x8f48a4899877186cu },
+    { 0xe0b62e2929aba83cu, 0x331acdabfe94de87u },
+    { 0x8c71dcd9ba0b4925u, 0x9ff0c08b7f1d0b14u },
+    { 0xaf8e5410288e1b6fu, 0x07ecf0ae5ee44dd9u },
+    { 0xdb71e91432b1a24au, 0xc9e82cd9f69d6150u },
+    { 0x892731ac9faf056eu, 0xbe311c083a225cd2u },
+    { 0xab70fe17c79ac6cau, 0x6dbd630a48aaf406u },
+    { 0xd64d3d9db981787du, 0x092cbbccdad5b108u },
+    { 0x85f0468293f0eb4eu, 0x25bbf56008c58ea5u },
+    { 0xa76c582338ed2621u, 0xaf2af2b80af6f24eu },
+    { 0xd1476e2c07286faau, 0x1af5af660db4aee1u },
+    { 0x82cca4db847945cau, 0x50d98d9fc890ed4du },
+    { 0xa37fce126597973cu, 0xe50ff107bab528a0u },
+    { 0xcc5fc196fefd7d0cu, 0x1e53ed49a96272c8u },
+    { 0xff77b1fcbebcdc4fu, 0x25e8e89c13bb0f7au },
+    { 0x9faacf3df73609b1u, 0x77b191618c54e9acu },
+    { 0xc795830d75038c1du, 0xd59df5b9ef6a2417u },
+    { 0xf97ae3d0d2446f25u, 0x4b0573286b44ad1du },
+    { 0x9becce62836ac577u, 0x4ee367f9430aec32u },
+    { 0xc2e801fb244576d5u, 0x229c41f793cda73fu },
+    { 0xf3a20279ed56d48au, 0x6b43527578c1110fu },
+    { 0x9845418c345644d6u, 0x830a13896b78aaa9u },
+    { 0xbe5691ef416bd60cu, 0x23cc986bc656d553u },
+    { 0xedec366b11c6cb8fu, 0x2cbfbe86b7ec8aa8u },
+    { 0x94b3a202eb1c3f39u, 0x7bf7d71432f3d6a9u },
+    { 0xb9e08a83a5e34f07u, 0xdaf5ccd93fb0cc53u },
+    { 0xe858ad248f5c22c9u, 0xd1b3400f8f9cff68u },
+    { 0x91376c36d99995beu, 0x23100809b9c21fa1u },
+    { 0xb58547448ffffb2du, 0xabd40a0c2832a78au },
+    { 0xe2e69915b3fff9f9u, 0x16c90c8f323f516cu },
+    { 0x8dd01fad907ffc3bu, 0xae3da7d97f6792e3u },
+    { 0xb1442798f49ffb4au, 0x99cd11cfdf41779cu },
+    { 0xdd95317f31c7fa1du, 0x40405643d711d583u },
+    { 0x8a7d3eef7f1cfc52u, 0x482835ea666b2572u },
+    { 0xad1c8eab5ee43b66u, 0xda3243650005eecfu },
+    { 0xd863b256369d4a40u, 0x90bed43e40076a82u },
+    { 0x873e4f75e2224e68u, 0x5a7744a6e804a291u },
+    { 0xa90de3535aaae202u, 0x711515d0a205cb36u },
+    { 0xd3515c2831559a83u, 0x0d5a5b44ca873e03u },
+    { 0x8412d9991ed58091u, 0xe858790afe9486c2u },
+    { 0xa5178fff668ae0b6u, 0x626e974dbe39a872u },
+    { 0xce5d73ff402d98e3u, 0xfb0a3d212dc8128fu },
+    { 0x80fa687f881c7f8eu, 0x7ce66634bc9d0b99u },
+    { 0xa139029f6a239f72u, 0x1c1fffc1ebc44e80u },
+    { 0xc987434744ac874eu, 0xa327ffb266b56220u },
+    { 0xfbe9141915d7a922u, 0x4bf1ff9f0062baa8u },
+    { 0x9d71ac8fada6c9b5u, 0x6f773fc3603db4a9u },
+    { 0xc4ce17b399107c22u, 0xcb550fb4384d21d3u },
+    { 0xf6019da07f549b2bu, 0x7e2a53a146606a48u },
+    { 0x99c102844f94e0fbu, 0x2eda7444cbfc426du },
+    { 0xc0314325637a1939u, 0xfa911155fefb5308u },
+    { 0xf03d93eebc589f88u, 0x793555ab7eba27cau },
+    { 0x96267c7535b763b5u, 0x4bc1558b2f3458deu },
+    { 0xbbb01b9283253ca2u, 0x9eb1aaedfb016f16u },
+    { 0xea9c227723ee8bcbu, 0x465e15a979c1cadcu },
+    { 0x92a1958a7675175fu, 0x0bfacd89ec191ec9u },
+    { 0xb749faed14125d36u, 0xcef980ec671f667bu },
+    { 0xe51c79a85916f484u, 0x82b7e12780e7401au },
+    { 0x8f31cc0937ae58d2u, 0xd1b2ecb8b0908810u },
+    { 0xb2fe3f0b8599ef07u, 0x861fa7e6dcb4aa15u },
+    { 0xdfbdcece67006ac9u, 0x67a791e093e1d49au },
+    { 0x8bd6a141006042bdu, 0xe0c8bb2c5c6d24e0u },
+    { 0xaecc49914078536du, 0x58fae9f773886e18u },
+    { 0xda7f5bf590966848u, 0xaf39a475506a899eu },
+    { 0x888f99797a5e012du, 0x6d8406c952429603u },
+    { 0xaab37fd7d8f58178u, 0xc8e5087ba6d33b83u },
+    { 0xd5605fcdcf32e1d6u, 0xfb1e4a9a90880a64u },
+    { 0x855c3be0a17fcd26u, 0x5cf2eea09a55067fu },
+    { 0xa6b34ad8c9dfc06fu, 0xf42faa48c0ea481eu },
+    { 0xd0601d8efc57b08bu, 0xf13b94daf124da26u },
+    { 0x823c12795db6ce57u, 0x76c53d08d6b70858u },
+    { 0xa2cb1717b52481edu, 0x54768c4b0c64ca6eu },
+    { 0xcb7ddcdda26da268u, 0xa9942f5dcf7dfd09u },
+    { 0xfe5d54150b090b02u, 0xd3f93b35435d7c4cu },
+    { 0x9efa548d26e5a6e1u, 0xc47bc5014a1a6dafu },
+    { 0xc6b8e9b0709f109au, 0x359ab6419ca1091bu },
+    { 0xf867241c8cc6d4c0u, 0xc30163d203c94b62u },
+    { 0x9b407691d7fc44f8u, 0x79e0de63425dcf1du },
+    { 0xc21094364dfb5636u, 0x985915fc12f542e4u },
+    { 0xf294b943e17a2bc4u, 0x3e6f5b7b17b2939du },
+    { 0x979cf3ca6cec5b5au, 0xa705992ceecf9c42u },
+    { 0xbd8430bd08277231u, 0x50c6ff782a838353u },
+    { 0xece53cec4a314ebdu, 0xa4f8bf5635246428u },
+    { 0x940f4613ae5ed136u, 0x871b7795e136be99u },
+    { 0xb913179899f68584u, 0x28e2557b59846e3fu },
+    { 0xe757dd7ec07426e5u, 0x331aeada2fe589cfu },
+    { 0x9096ea6f3848984fu, 0x3ff0d2c85def7621u },
+    { 0xb4bca50b065abe63u, 0x0fed077a756b53a9u },
+    { 0xe1ebce4dc7f16dfbu, 0xd3e8495912c62894u },
+    { 0x8d3360f09cf6e4bdu, 0x64712dd7abbbd95cu },
+    { 0xb080392cc4349decu, 0xbd8d794d96aacfb3u },
+    { 0xdca04777f541c567u, 0xecf0d7a0fc5583a0u },
+    { 0x89e42caaf9491b60u, 0xf41686c49db57244u },
+    { 0xac5d37d5b79b6239u, 0x311c2875c522ced5u },
+    { 0xd77485cb25823ac7u, 0x7d633293366b828bu },
+    { 0x86a8d39ef77164bcu, 0xae5dff9c02033197u },
+    { 0xa8530886b54dbdebu, 0xd9f57f830283fdfcu },
+    { 0xd267caa862a12d66u, 0xd072df63c324fd7bu },
+    { 0x8380dea93da4bc60u, 0x4247cb9e59f71e6du },
+    { 0xa46116538d0deb78u, 0x52d9be85f074e608u },
+    { 0xcd795be870516656u, 0x67902e276c921f8bu },
+    { 0x806bd9714632dff6u, 0x00ba1cd8a3db53b6u },
+    { 0xa086cfcd97bf97f3u, 0x80e8a40eccd228a4u },
+    { 0xc8a883c0fdaf7df0u, 0x6122cd128006b2cdu },
+    { 0xfad2a4b13d1b5d6cu, 0x796b805720085f81u },
+    { 0x9cc3a6eec6311a63u, 0xcbe3303674053bb0u },
+    { 0xc3f490aa77bd60fcu, 0xbedbfc4411068a9cu },
+    { 0xf4f1b4d515acb93bu, 0xee92fb5515482d44u },
+    { 0x991711052d8bf3c5u, 0x751bdd152d4d1c4au },
+    { 0xbf5cd54678eef0b6u, 0xd262d45a78a0635du },
+    { 0xef340a98172aace4u, 0x86fb897116c87c34u },
+    { 0x9580869f0e7aac0eu, 0xd45d35e6ae3d4da0u },
+    { 0xbae0a846d2195712u, 0x8974836059cca109u },
+    { 0xe998d258869facd7u, 0x2bd1a438703fc94bu },
+    { 0x91ff83775423cc06u, 0x7b6306a34627ddcfu },
+    { 0xb67f6455292cbf08u, 0x1a3bc84c17b1d542u },
+    { 0xe41f3d6a7377eecau, 0x20caba5f1d9e4a93u },
+    { 0x8e938662882af53eu, 0x547eb47b7282ee9cu },
+    { 0xb23867fb2a35b28du, 0xe99e619a4f23aa43u },
+    { 0xdec681f9f4c31f31u, 0x6405fa00e2ec94d4u },
+    { 0x8b3c113c38f9f37eu, 0xde83bc408dd3dd04u },
+    { 0xae0b158b4738705eu, 0x9624ab50b148d445u },
+    { 0xd98ddaee19068c76u, 0x3badd624dd9b0957u },
+    { 0x87f8a8d4cfa417c9u, 0xe54ca5d70a80e5d6u },
+    { 0xa9f6d30a038d1dbcu, 0x5e9fcf4ccd211f4cu },
+    { 0xd47487cc8470652bu, 0x7647c3200069671fu },
+    { 0x84c8d4dfd2c63f3bu, 0x29ecd9f40041e073u },
+    { 0xa5fb0a17c777cf09u, 0xf468107100525890u },
+    { 0xcf79cc9db955c2ccu, 0x7182148d4066eeb4u },
+    { 0x81ac1fe293d599bfu, 0xc6f14cd848405530u },
+    { 0xa21727db38cb002fu, 0xb8ada00e5a506a7cu },
+    { 0xca9cf1d206fdc03bu, 0xa6d90811f0e4851cu },
+    { 0xfd442e4688bd304au, 0x908f4a166d1da663u },
+    { 0x9e4a9cec15763e2eu, 0x9a598e4e043287feu },
+    { 0xc5dd44271ad3cdbau, 0x40eff1e1853f29fdu },
+    { 0xf7549530e188c128u, 0xd12bee59e68ef47cu },
+    { 0x9a94dd3e8cf578b9u, 0x82bb74f8301958ceu },
+    { 0xc13a148e3032d6e7u, 0xe36a52363c1faf01u },
+    { 0xf18899b1bc3f8ca1u, 0xdc44e6c3cb279ac1u },
+    { 0x96f5600f15a7b7e5u, 0x29ab103a5ef8c0b9u },
+    { 0xbcb2b812db11a5deu, 0x7415d448f6b6f0e7u },
+    { 0xebdf661791d60f56u, 0x111b495b3464ad21u },
+    { 0x936b9fcebb25c995u, 0xcab10dd900beec34u },
+    { 0xb84687c269ef3bfbu, 0x3d5d514f40eea742u },
+    { 0xe65829b3046b0afau, 0x0cb4a5a3112a5112u },
+    { 0x8ff71a0fe2c2e6dcu, 0x47f0e785eaba72abu },
+    { 0xb3f4e093db73a093u, 0x59ed216765690f56u },
+    { 0xe0f218b8d25088b8u, 0x306869c13ec3532cu },
+    { 0x8c974f7383725573u, 0x1e414218c73a13fbu },
+    { 0xafbd2350644eeacfu, 0xe5d1929ef90898fau },
+    { 0xdbac6c247d62a583u, 0xdf45f746b74abf39u },
+    { 0x894bc396ce5da772u, 0x6b8bba8c328eb783u },
+    { 0xab9eb47c81f5114fu, 0x066ea92f3f326564u },
+    { 0xd686619ba27255a2u, 0xc80a537b0efefebdu },
+    { 0x8613fd0145877585u, 0xbd06742ce95f5f36u },
+    { 0xa798fc4196e952e7u, 0x2c48113823b73704u },
+    { 0xd17f3b51fca3a7a0u, 0xf75a15862ca504c5u },
+    { 0x82ef85133de648c4u, 0x9a984d73dbe722fbu },
+    { 0xa3ab66580d5fdaf5u, 0xc13e60d0d2e0ebbau },
+    { 0xcc963fee10b7d1b3u, 0x318df905079926a8u },
+    { 0xffbbcfe994e5c61fu, 0xfdf17746497f7052u },
+    { 0x9fd561f1fd0f9bd3u, 0xfeb6ea8bedefa633u },
+    { 0xc7caba6e7c5382c8u, 0xfe64a52ee96b8fc0u },
+    { 0xf9bd690a1b68637bu, 0x3dfdce7aa3c673b0u },
+    { 0x9c1661a651213e2du, 0x06bea10ca65c084eu },
+    { 0xc31bfa0fe5698db8u, 0x486e494fcff30a62u },
+    { 0xf3e2f893dec3f126u, 0x5a89dba3c3efccfau },
+    { 0x986ddb5c6b3a76b7u, 0xf89629465a75e01cu },
+    { 0xbe89523386091465u, 0xf6bbb397f1135823u },
+    { 0xee2ba6c0678b597fu, 0x746aa07ded582e2cu },
+    { 0x94db483840b717efu, 0xa8c2a44eb4571cdcu },
+    { 0xba121a4650e4ddebu, 0x92f34d62616ce413u },
+    { 0xe896a0d7e51e1566u, 0x77b020baf9c81d17u },
+    { 0x915e2486ef32cd60u, 0x0ace1474dc1d122eu },
+    { 0xb5b5ada8aaff80b8u, 0x0d819992132456bau },
+    { 0xe3231912d5bf60e6u, 0x10e1fff697ed6c69u },
+    { 0x8df5efabc5979c8fu, 0xca8d3ffa1ef463c1u },
+    { 0xb1736b96b6fd83b3u, 0xbd308ff8a6b17cb2u },
+    { 0xddd0467c64bce4a0u, 0xac7cb3f6d05ddbdeu },
+    { 0x8aa22c0dbef60ee4u, 0x6bcdf07a423aa96bu },
+    { 0xad4ab7112eb3929du, 0x86c16c98d2c953c6u },
+    { 0xd89d64d57a607744u, 0xe871c7bf077ba8b7u },
+    { 0x87625f056c7c4a8bu, 0x11471cd764ad4972u },
+    { 0xa93af6c6c79b5d2du, 0xd598e40d3dd89bcfu },
+    { 0xd389b47879823479u, 0x4aff1d108d4ec2c3u },
+    { 0x843610cb4bf160cbu, 0xcedf722a585139bau },
+    { 0xa54394fe1eedb8feu, 0xc2974eb4ee658828u },
+    { 0xce947a3da6a9273eu, 0x733d226229feea32u },
+    { 0x811ccc668829b887u, 0x0806357d5a3f525fu },
+    { 0xa163ff802a3426a8u, 0xca07c2dcb0cf26f7u },
+    { 0xc9bcff6034c13052u, 0xfc89b393dd02f0b5u },
+    { 0xfc2c3f3841f17c67u, 0xbbac2078d443ace2u },
+    { 0x9d9ba7832936edc0u, 0xd54b944b84aa4c0du },
+    { 0xc5029163f384a931u, 0x0a9e795e65d4df11u },
+    { 0xf64335bcf065d37du, 0x4d4617b5ff4a16d5u },
+    { 0x99ea0196163fa42eu, 0x504bced1bf8e4e45u },
+    { 0xc06481fb9bcf8d39u, 0xe45ec2862f71e1d6u },
+    { 0xf07da27a82c37088u, 0x5d767327bb4e5a4cu },
+    { 0x964e858c91ba2655u, 0x3a6a07f8d510f86fu },
+    { 0xbbe226efb628afeau, 0x890489f70a55368bu },
+    { 0xeadab0aba3b2dbe5u, 0x2b45ac74ccea842eu },
+    { 0x92c8ae6b464fc96fu, 0x3b0b8bc90012929du },
+    { 0xb77ada0617e3bbcbu, 0x09ce6ebb40173744u },
+    { 0xe55990879ddcaabdu, 0xcc420a6a101d0515u },
+    { 0x8f57fa54c2a9eab6u, 0x9fa946824a12232du },
+    { 0xb32df8e9f3546564u, 0x47939822dc96abf9u },
+    { 0xdff9772470297ebdu, 0x59787e2b93bc56f7u },
+    { 0x8bfbea76c619ef36u, 0x57eb4edb3c55b65au },
+    { 0xaefae51477a06b03u, 0xede622920b6b23f1u },
+    { 0xdab99e59958885c4u, 0xe95fab368e45ecedu },
+    { 0x88b402f7fd75539bu, 0x11dbcb0218ebb414u },
+    { 0xaae103b5fcd2a881u, 0xd652bdc29f26a119u },
+    { 0xd59944a37c0752a2u, 0x4be76d3346f0495fu },
+    { 0x857fcae62d8493a5u, 0x6f70a4400c562ddbu },
+    { 0xa6dfbd9fb8e5b88eu, 0xcb4ccd500f6bb952u },
+    { 0xd097ad07a71f26b2u, 0x7e2000a41346a7a7u },
+    { 0x825ecc24c873782fu, 0x8ed400668c0c28c8u },
+    { 0xa2f67f2dfa90563bu, 0x728900802f0f32fau },
+    { 0xcbb41ef979346bcau, 0x4f2b40a03ad2ffb9u },
+    { 0xfea126b7d78186bcu, 0xe2f610c84987bfa8u },
+    { 0x9f24b832e6b0f436u, 0x0dd9ca7d2df4d7c9u },
+    { 0xc6ede63fa05d3143u, 0x91503d1c79720dbbu },
+    { 0xf8a95fcf88747d94u, 0x75a44c6397ce912au },
+    { 0x9b69dbe1b548ce7cu, 0xc986afbe3ee11abau },
+    { 0xc24452da229b021bu, 0xfbe85badce996168u },
+    { 0xf2d56790ab41c2a2u, 0xfae27299423fb9c3u },
+    { 0x97c560ba6b0919a5u, 0xdccd879fc967d41au },
+    { 0xbdb6b8e905cb600fu, 0x5400e987bbc1c920u },
+    { 0xed246723473e3813u, 0x290123e9aab23b68u },
+    { 0x9436c0760c86e30bu, 0xf9a0b6720aaf6521u },
+    { 0xb94470938fa89bceu, 0xf808e40e8d5b3e69u },
+    { 0xe7958cb87392c2c2u, 0xb60b1d1230b20e04u },
+    { 0x90bd77f3483bb9b9u, 0xb1c6f22b5e6f48c2u },
+    { 0xb4ecd5f01a4aa828u, 0x1e38aeb6360b1af3u },
+    { 0xe2280b6c20dd5232u, 0x25c6da63c38de1b0u },
+    { 0x8d590723948a535fu, 0x579c487e5a38ad0eu },
+    { 0xb0af48ec79ace837u, 0x2d835a9df0c6d851u },
+    { 0xdcdb1b2798182244u, 0xf8e431456cf88e65u },
+    { 0x8a08f0f8bf0f156bu, 0x1b8e9ecb641b58ffu },
+    { 0xac8b2d36eed2dac5u, 0xe272467e3d222f3fu },
+    { 0xd7adf884aa879177u, 0x5b0ed81dcc6abb0fu },
+    { 0x86ccbb52ea94baeau, 0x98e947129fc2b4e9u },
+    { 0xa87fea27a539e9a5u, 0x3f2398d747b36224u },
+    { 0xd29fe4b18e88640eu, 0x8eec7f0d19a03aadu },
+    { 0x83a3eeeef9153e89u, 0x1953cf68300424acu },
+    { 0xa48ceaaab75a8e2bu, 0x5fa8c3423c052dd7u },
+    { 0xcdb02555653131b6u, 0x3792f412cb06794du },
+    { 0x808e17555f3ebf11u, 0xe2bbd88bbee40bd0u },
+    { 0xa0b19d2ab70e6ed6u, 0x5b6aceaeae9d0ec4u },
+    { 0xc8de047564d20a8bu, 0xf245825a5a445275u },
+    { 0xfb158592be068d2eu, 0xeed6e2f0f0d56712u },
+    { 0x9ced737bb6c4183du, 0x55464dd69685606bu },
+    { 0xc428d05aa4751e4cu, 0xaa97e14c3c26b886u },
+    { 0xf53304714d9265dfu, 0xd53dd99f4b3066a8u },
+    { 0x993fe2c6d07b7fabu, 0xe546a8038efe4029u },
+    { 0xbf8fdb78849a5f96u, 0xde98520472bdd033u },
+    { 0xef73d256a5c0f77cu, 0x963e66858f6d4440u },
+    { 0x95a8637627989aadu, 0xdde7001379a44aa8u },
+    { 0xbb127c53b17ec159u, 0x5560c018580d5d52u },
+    { 0xe9d71b689dde71afu, 0xaab8f01e6e10b4a6u },
+    { 0x9226712162ab070du, 0xcab3961304ca70e8u },
+    { 0xb6b00d69bb55c8d1u, 0x3d607b97c5fd0d22u },
+    { 0xe45c10c42a2b3b05u, 0x8cb89a7db77c506au },
+    { 0x8eb98a7a9a5b04e3u, 0x77f3608e92adb242u },
+    { 0xb267ed1940f1c61cu, 0x55f038b237591ed3u },
+    { 0xdf01e85f912e37a3u, 0x6b6c46dec52f6688u },
+    { 0x8b61313bbabce2c6u, 0x2323ac4b3b3da015u },
+    { 0xae397d8aa96c1b77u, 0xabec975e0a0d081au },
+    { 0xd9c7dced53c72255u, 0x96e7bd358c904a21u },
+    { 0x881cea14545c7575u, 0x7e50d64177da2e54u },
+    { 0xaa242499697392d2u, 0xdde50bd1d5d0b9e9u },
+    { 0xd4ad2dbfc3d07787u, 0x955e4ec64b44e864u },
+    { 0x84ec3c97da624ab4u, 0xbd5af13bef0b113eu },
+    { 0xa6274bbdd0fadd61u, 0xecb1ad8aeacdd58eu },
+    { 0xcfb11ead453994bau, 0x67de18eda5814af2u },
+    { 0x81ceb32c4b43fcf4u, 0x80eacf948770ced7u },
+    { 0xa2425ff75e14fc31u, 0xa1258379a94d028du },
+    { 0xcad2f7f5359a3b3eu, 0x096ee45813a04330u },
+    { 0xfd87b5f28300ca0du, 0x8bca9d6e188853fcu },
+    { 0x9e74d1b791e07e48u, 0x775ea264cf55347eu },
+    { 0xc612062576589ddau, 0x95364afe032a819eu },
+    { 0xf79687aed3eec551u, 0x3a83ddbd83f52205u },
+    { 0x9abe14cd44753b52u, 0xc4926a9672793543u },
+    { 0xc16d9a0095928a27u, 0x75b7053c0f178294u },
+    { 0xf1c90080baf72cb1u, 0x5324c68b12dd6339u },
+    { 0x971da05074da7beeu, 0xd3f6fc16ebca5e04u },
+    { 0xbce5086492111aeau, 0x88f4bb1ca6bcf585u },
+    { 0xec1e4a7db69561a5u, 0x2b31e9e3d06c32e6u },
+    { 0x9392ee8e921d5d07u, 0x3aff322e62439fd0u },
+    { 0xb877aa3236a4b449u, 0x09befeb9fad487c3u },
+    { 0xe69594bec44de15bu, 0x4c2ebe687989a9b4u },
+    { 0x901d7cf73ab0acd9u, 0x0f9d37014bf60a11u },
+    { 0xb424dc35095cd80fu, 0x538484c19ef38c95u },
+    { 0xe12e13424bb40e13u, 0x2865a5f206b06fbau },
+    { 0x8cbccc096f5088cbu, 0xf93f87b7442e45d4u },
+    { 0xafebff0bcb24aafeu, 0xf78f69a51539d749u },
+    { 0xdbe6fecebdedd5beu, 0xb573440e5a884d1cu },
+    { 0x89705f4136b4a597u, 0x31680a88f8953031u },
+    { 0xabcc77118461cefcu, 0xfdc20d2b36ba7c3eu },
+    { 0xd6bf94d5e57a42bcu, 0x3d32907604691b4du },
+    { 0x8637bd05af6c69b5u, 0xa63f9a49c2c1b110u },
+    { 0xa7c5ac471b478423u, 0x0fcf80dc33721d54u },
+    { 0xd1b71758e219652bu, 0xd3c36113404ea4a9u },
+    { 0x83126e978d4fdf3bu, 0x645a1cac083126eau },
+    { 0xa3d70a3d70a3d70au, 0x3d70a3d70a3d70a4u },
+    { 0xccccccccccccccccu, 0xcccccccccccccccdu },
+    { 0x8000000000000000u, 0x0000000000000000u },
+    { 0xa000000000000000u, 0x0000000000000000u },
+    { 0xc800000000000000u, 0x0000000000000000u },
+    { 0xfa00000000000000u, 0x0000000000000000u },
+    { 0x9c40000000000000u, 0x0000000000000000u },
+    { 0xc350000000000000u, 0x0000000000000000u },
+    { 0xf424000000000000u, 0x0000000000000000u },
+    { 0x9896800000000000u, 0x0000000000000000u },
+    { 0xbebc200000000000u, 0x0000000000000000u },
+    { 0xee6b280000000000u, 0x0000000000000000u },
+    { 0x9502f90000000000u, 0x0000000000000000u },
+    { 0xba43b74000000000u, 0x0000000000000000u },
+    { 0xe8d4a51000000000u, 0x0000000000000000u },
+    { 0x9184e72a00000000u, 0x0000000000000000u },
+    { 0xb5e620f480000000u, 0x0000000000000000u },
+    { 0xe35fa931a0000000u, 0x0000000000000000u },
+    { 0x8e1bc9bf04000000u, 0x0000000000000000u },
+    { 0xb1a2bc2ec5000000u, 0x0000000000000000u },
+    { 0xde0b6b3a76400000u, 0x0000000000000000u },
+    { 0x8ac7230489e80000u, 0x0000000000000000u },
+    { 0xad78ebc5ac620000u, 0x0000000000000000u },
+    { 0xd8d726b7177a8000u, 0x0000000000000000u },
+    { 0x878678326eac9000u, 0x0000000000000000u },
+    { 0xa968163f0a57b400u, 0x0000000000000000u },
+    { 0xd3c21bcecceda100u, 0x0000000000000000u },
+    { 0x84595161401484a0u, 0x0000000000000000u },
+    { 0xa56fa5b99019a5c8u, 0x0000000000000000u },
+    { 0xcecb8f27f4200f3au, 0x0000000000000000u },
+    { 0x813f3978f8940984u, 0x4000000000000000u },
+    { 0xa18f07d736b90be5u, 0x5000000000000000u },
+    { 0xc9f2c9cd04674edeu, 0xa400000000000000u },
+    { 0xfc6f7c4045812296u, 0x4d00000000000000u },
+    { 0x9dc5ada82b70b59du, 0xf020000000000000u },
+    { 0xc5371912364ce305u, 0x6c28000000000000u },
+    { 0xf684df56c3e01bc6u, 0xc732000000000000u },
+    { 0x9a130b963a6c115cu, 0x3c7f400000000000u },
+    { 0xc097ce7bc90715b3u, 0x4b9f100000000000u },
+    { 0xf0bdc21abb48db20u, 0x1e86d40000000000u },
+    { 0x96769950b50d88f4u, 0x1314448000000000u },
+    { 0xbc143fa4e250eb31u, 0x17d955a000000000u },
+    { 0xeb194f8e1ae525fdu, 0x5dcfab0800000000u },
+    { 0x92efd1b8d0cf37beu, 0x5aa1cae500000000u },
+    { 0xb7abc627050305adu, 0xf14a3d9e40000000u },
+    { 0xe596b7b0c643c719u, 0x6d9ccd05d0000000u },
+    { 0x8f7e32ce7bea5c6fu, 0xe4820023a2000000u },
+    { 0xb35dbf821ae4f38bu, 0xdda2802c8a800000u },
+    { 0xe0352f62a19e306eu, 0xd50b2037ad200000u },
+    { 0x8c213d9da502de45u, 0x4526f422cc340000u },
+    { 0xaf298d050e4395d6u, 0x9670b12b7f410000u },
+    { 0xdaf3f04651d47b4cu, 0x3c0cdd765f114000u },
+    { 0x88d8762bf324cd0fu, 0xa5880a69fb6ac800u },
+    { 0xab0e93b6efee0053u, 0x8eea0d047a457a00u },
+    { 0xd5d238a4abe98068u, 0x72a4904598d6d880u },
+    { 0x85a36366eb71f041u, 0x47a6da2b7f864750u },
+    { 0xa70c3c40a64e6c51u, 0x999090b65f67d924u },
+    { 0xd0cf4b50cfe20765u, 0xfff4b4e3f741cf6du },
+    { 0x82818f1281ed449fu, 0xbff8f10e7a8921a4u },
+    { 0xa321f2d7226895c7u, 0xaff72d52192b6a0du },
+    { 0xcbea6f8ceb02bb39u, 0x9bf4f8a69f764490u },
+    { 0xfee50b7025c36a08u, 0x02f236d04753d5b4u },
+    { 0x9f4f2726179a2245u, 0x01d762422c946590u },
+    { 0xc722f0ef9d80aad6u, 0x424d3ad2b7b97ef5u },
+    { 0xf8ebad2b84e0d58bu, 0xd2e0898765a7deb2u },
+    { 0x9b934c3b330c8577u, 0x63cc55f49f88eb2fu },
+    { 0xc2781f49ffcfa6d5u, 0x3cbf6b71c76b25fbu },
+    { 0xf316271c7fc3908au, 0x8bef464e3945ef7au },
+    { 0x97edd871cfda3a56u, 0x97758bf0e3cbb5acu },
+    { 0xbde94e8e43d0c8ecu, 0x3d52eeed1cbea317u },
+    { 0xed63a231d4c4fb27u, 0x4ca7aaa863ee4bddu },
+    { 0x945e455f24fb1cf8u, 0x8fe8caa93e74ef6au },
+    { 0xb975d6b6ee39e436u, 0xb3e2fd538e122b44u },
+    { 0xe7d34c64a9c85d44u, 0x60dbbca87196b616u },
+    { 0x90e40fbeea1d3a4au, 0xbc8955e946fe31cdu },
+    { 0xb51d13aea4a488ddu, 0x6babab6398bdbe41u },
+    { 0xe264589a4dcdab14u, 0xc696963c7eed2dd1u },
+    { 0x8d7eb76070a08aecu, 0xfc1e1de5cf543ca2u },
+    { 0xb0de65388cc8ada8u, 0x3b25a55f43294bcbu },
+    { 0xdd15fe86affad912u, 0x49ef0eb713f39ebeu },
+    { 0x8a2dbf142dfcc7abu, 0x6e3569326c784337u },
+    { 0xacb92ed9397bf996u, 0x49c2c37f07965404u },
+    { 0xd7e77a8f87daf7fbu, 0xdc33745ec97be906u },
+    { 0x86f0ac99b4e8dafdu, 0x69a028bb3ded71a3u },
+    { 0xa8acd7c0222311bcu, 0xc40832ea0d68ce0cu },
+    { 0xd2d80db02aabd62bu, 0xf50a3fa490c30190u },
+    { 0x83c7088e1aab65dbu, 0x792667c6da79e0fau },
+    { 0xa4b8cab1a1563f52u, 0x577001b891185938u },
+    { 0xcde6fd5e09abcf26u, 0xed4c0226b55e6f86u },
+    { 0x80b05e5ac60b6178u, 0x544f8158315b05b4u },
+    { 0xa0dc75f1778e39d6u, 0x696361ae3db1c721u },
+    { 0xc913936dd571c84cu, 0x03bc3a19cd1e38e9u },
+    { 0xfb5878494ace3a5fu, 0x04ab48a04065c723u },
+    { 0x9d174b2dcec0e47bu, 0x62eb0d64283f9c76u },
+    { 0xc45d1df942711d9au, 0x3ba5d0bd324f8394u },
+    { 0xf5746577930d6500u, 0xca8f44ec7ee36479u },
+    { 0x9968bf6abbe85f20u, 0x7e998b13cf4e1ecbu },
+    { 0xbfc2ef456ae276e8u, 0x9e3fedd8c321a67eu },
+    { 0xefb3ab16c59b14a2u, 0xc5cfe94ef3ea101eu },
+    { 0x95d04aee3b80ece5u, 0xbba1f1d158724a12u },
+    { 0xbb445da9ca61281fu, 0x2a8a6e45ae8edc97u },
+    { 0xea1575143cf97226u, 0xf52d09d71a3293bdu },
+    { 0x924d692ca61be758u, 0x593c2626705f9c56u },
+    { 0xb6e0c377cfa2e12eu, 0x6f8b2fb00c77836cu },
+    { 0xe498f455c38b997au, 0x0b6dfb9c0f956447u },
+    { 0x8edf98b59a373fecu, 0x4724bd4189bd5eacu },
+    { 0xb2977ee300c50fe7u, 0x58edec91ec2cb657u },
+    { 0xdf3d5e9bc0f653e1u, 0x2f2967b66737e3edu },
+    { 0x8b865b215899f46cu, 0xbd79e0d20082ee74u },
+    { 0xae67f1e9aec07187u, 0xecd8590680a3aa11u },
+    { 0xda01ee641a708de9u, 0xe80e6f4820cc9495u },
+    { 0x884134fe908658b2u, 0x3109058d147fdcddu },
+    { 0xaa51823e34a7eedeu, 0xbd4b46f0599fd415u },
+    { 0xd4e5e2cdc1d1ea96u, 0x6c9e18ac7007c91au },
+    { 0x850fadc09923329eu, 0x03e2cf6bc604ddb0u },
+    { 0xa6539930bf6bff45u, 0x84db8346b786151cu },
+    { 0xcfe87f7cef46ff16u, 0xe612641865679a63u },
+    { 0x81f14fae158c5f6eu, 0x4fcb7e8f3f60c07eu },
+    { 0xa26da3999aef7749u, 0xe3be5e330f38f09du },
+    { 0xcb090c8001ab551cu, 0x5cadf5bfd3072cc5u },
+    { 0xfdcb4fa002162a63u, 0x73d9732fc7c8f7f6u },
+    { 0x9e9f11c4014dda7eu, 0x2867e7fddcdd9afau },
+    { 0xc646d63501a1511du, 0xb281e1fd541501b8u },
+    { 0xf7d88bc24209a565u, 0x1f225a7ca91a4226u },
+    { 0x9ae757596946075fu, 0x3375788de9b06958u },
+    { 0xc1a12d2fc3978937u, 0x0052d6b1641c83aeu },
+    { 0xf209787bb47d6b84u, 0xc0678c5dbd23a49au },
+    { 0x9745eb4d50ce6332u, 0xf840b7ba963646e0u },
+    { 0xbd176620a501fbffu, 0xb650e5a93bc3d898u },
+    { 0xec5d3fa8ce427affu, 0xa3e51f138ab4cebeu },
+    { 0x93ba47c980e98cdfu, 0xc66f336c36b10137u },
+    { 0xb8a8d9bbe123f017u, 0xb80b0047445d4184u },
+    { 0xe6d3102ad96cec1du, 0xa60dc059157491e5u },
+    { 0x9043ea1ac7e41392u, 0x87c89837ad68db2fu },
+    { 0xb454e4a179dd1877u, 0x29babe4598c311fbu },
+    { 0xe16a1dc9d8545e94u, 0xf4296dd6fef3d67au },
+    { 0x8ce2529e2734bb1du, 0x1899e4a65f58660cu },
+    { 0xb01ae745b101e9e4u, 0x5ec05dcff72e7f8fu },
+    { 0xdc21a1171d42645du, 0x76707543f4fa1f73u },
+    { 0x899504ae72497ebau, 0x6a06494a791c53a8u },
+    { 0xabfa45da0edbde69u, 0x0487db9d17636892u },
+    { 0xd6f8d7509292d603u, 0x45a9d2845d3c42b6u },
+    { 0x865b86925b9bc5c2u, 0x0b8a2392ba45a9b2u },
+    { 0xa7f26836f282b732u, 0x8e6cac7768d7141eu },
+    { 0xd1ef0244af2364ffu, 0x3207d795430cd926u },
+    { 0x8335616aed761f1fu, 0x7f44e6bd49e807b8u },
+    { 0xa402b9c5a8d3a6e7u, 0x5f16206c9c6209a6u },
+    { 0xcd036837130890a1u, 0x36dba887c37a8c0fu },
+    { 0x802221226be55a64u, 0xc2494954da2c9789u },
+    { 0xa02aa96b06deb0fdu, 0xf2db9baa10b7bd6cu },
+    { 0xc83553c5c8965d3du, 0x6f92829494e5acc7u },
+    { 0xfa42a8b73abbf48cu, 0xcb772339ba1f17f9u },
+    { 0x9c69a97284b578d7u, 0xff2a760414536efbu },
+    { 0xc38413cf25e2d70du, 0xfef5138519684abau },
+    { 0xf46518c2ef5b8cd1u, 0x7eb258665fc25d69u },
+    { 0x98bf2f79d5993802u, 0xef2f773ffbd97a61u },
+    { 0xbeeefb584aff8603u, 0xaafb550ffacfd8fau },
+    { 0xeeaaba2e5dbf6784u, 0x95ba2a53f983cf38u },
+    { 0x952ab45cfa97a0b2u, 0xdd945a747bf26183u },
+    { 0xba756174393d88dfu, 0x94f971119aeef9e4u },
+    { 0xe912b9d1478ceb17u, 0x7a37cd5601aab85du },
+    { 0x91abb422ccb812eeu, 0xac62e055c10ab33au },
+    { 0xb616a12b7fe617aau, 0x577b986b314d6009u },
+    { 0xe39c49765fdf9d94u, 0xed5a7e85fda0b80bu },
+    { 0x8e41ade9fbebc27du, 0x14588f13be847307u },
+    { 0xb1d219647ae6b31cu, 0x596eb2d8ae258fc8u },
+    { 0xde469fbd99a05fe3u, 0x6fca5f8ed9aef3bbu },
+    { 0x8aec23d680043beeu, 0x25de7bb9480d5854u },
+    { 0xada72ccc20054ae9u, 0xaf561aa79a10ae6au },
+    { 0xd910f7ff28069da4u, 0x1b2ba1518094da04u },
+    { 0x87aa9aff79042286u, 0x90fb44d2f05d0842u },
+    { 0xa99541bf57452b28u, 0x353a1607ac744a53u },
+    { 0xd3fa922f2d1675f2u, 0x42889b8997915ce8u },
+    { 0x847c9b5d7c2e09b7u, 0x69956135febada11u },
+    { 0xa59bc234db398c25u, 0x43fab9837e699095u },
+    { 0xcf02b2c21207ef2eu, 0x94f967e45e03f4bbu },
+    { 0x8161afb94b44f57du, 0x1d1be0eebac278f5u },
+    { 0xa1ba1ba79e1632dcu, 0x6462d92a69731732u },
+    { 0xca28a291859bbf93u, 0x7d7b8f7503cfdcfeu },
+    { 0xfcb2cb35e702af78u, 0x5cda735244c3d43eu },
+    { 0x9defbf01b061adabu, 0x3a0888136afa64a7u },
+    { 0xc56baec21c7a1916u, 0x088aaa1845b8fdd0u },
+    { 0xf6c69a72a3989f5bu, 0x8aad549e57273d45u },
+    { 0x9a3c2087a63f6399u, 0x36ac54e2f678864bu },
+    { 0xc0cb28a98fcf3c7fu, 0x84576a1bb416a7ddu },
+    { 0xf0fdf2d3f3c30b9fu, 0x656d44a2a11c51d5u },
+    { 0x969eb7c47859e743u, 0x9f644ae5a4b1b325u },
+    { 0xbc4665b596706114u, 0x873d5d9f0dde1feeu },
+    { 0xeb57ff22fc0c7959u, 0xa90cb506d155a7eau },
+    { 0x9316ff75dd87cbd8u, 0x09a7f12442d588f2u },
+    { 0xb7dcbf5354e9beceu, 0x0c11ed6d538aeb2fu },
+    { 0xe5d3ef282a242e81u, 0x8f1668c8a86da5fau },
+    { 0x8fa475791a569d10u, 0xf96e017d694487bcu },
+    { 0xb38d92d760ec4455u, 0x37c981dcc395a9acu },
+    { 0xe070f78d3927556au, 0x85bbe253f47b1417u },
+    { 0x8c469ab843b89562u, 0x93956d7478ccec8eu },
+    { 0xaf58416654a6babbu, 0x387ac8d1970027b2u },
+    { 0xdb2e51bfe9d0696au, 0x06997b05fcc0319eu },
+    { 0x88fcf317f22241e2u, 0x441fece3bdf81f03u },
+    { 0xab3c2fddeeaad25au, 0xd527e81cad7626c3u },
+    { 0xd60b3bd56a5586f1u, 0x8a71e223d8d3b074u },
+    { 0x85c7056562757456u, 0xf6872d5667844e49u },
+    { 0xa738c6bebb12d16cu, 0xb428f8ac016561dbu },
+    { 0xd106f86e69d785c7u, 0xe13336d701beba52u },
+    { 0x82a45b450226b39cu, 0xecc0024661173473u },
+    { 0xa34d721642b06084u, 0x27f002d7f95d0190u },
+    { 0xcc20ce9bd35c78a5u, 0x31ec038df7b441f4u },
+    { 0xff290242c83396ceu, 0x7e67047175a15271u },
+    { 0x9f79a169bd203e41u, 0x0f0062c6e984d386u },
+    { 0xc75809c42c684dd1u, 0x52c07b78a3e60868u },
+    { 0xf92e0c3537826145u, 0xa7709a56ccdf8a82u },
+    { 0x9bbcc7a142b17ccbu, 0x88a66076400bb691u },
+    { 0xc2abf989935ddbfeu, 0x6acff893d00ea435u },
+    { 0xf356f7ebf83552feu, 0x0583f6b8c4124d43u },
+    { 0x98165af37b2153deu, 0xc3727a337a8b704au },
+    { 0xbe1bf1b059e9a8d6u, 0x744f18c0592e4c5cu },
+    { 0xeda2ee1c7064130cu, 0x1162def06f79df73u },
+    { 0x9485d4d1c63e8be7u, 0x8addcb5645ac2ba8u },
+    { 0xb9a74a0637ce2ee1u, 0x6d953e2bd7173692u },
+    { 0xe8111c87c5c1ba99u, 0xc8fa8db6ccdd0437u },
+    { 0x910ab1d4db9914a0u, 0x1d9c9892400a22a2u },
+    { 0xb54d5e4a127f59c8u, 0x2503beb6d00cab4bu },
+    { 0xe2a0b5dc971f303au, 0x2e44ae64840fd61du },
+    { 0x8da471a9de737e24u, 0x5ceaecfed289e5d2u },
+    { 0xb10d8e1456105dadu, 0x7425a83e872c5f47u },
+    { 0xdd50f1996b947518u, 0xd12f124e28f77719u },
+    { 0x8a5296ffe33cc92fu, 0x82bd6b70d99aaa6fu },
+    { 0xace73cbfdc0bfb7bu, 0x636cc64d1001550bu },
+    { 0xd8210befd30efa5au, 0x3c47f7e05401aa4eu },
+    { 0x8714a775e3e95c78u, 0x65acfaec34810a71u },
+    { 0xa8d9d1535ce3b396u, 0x7f1839a741a14d0du },
+    { 0xd31045a8341ca07cu, 0x1ede48111209a050u },
+    { 0x83ea2b892091e44du, 0x934aed0aab460432u },
+    { 0xa4e4b66b68b65d60u, 0xf81da84d5617853fu },
+    { 0xce1de40642e3f4b9u, 0x36251260ab9d668eu },
+    { 0x80d2ae83e9ce78f3u, 0xc1d72b7c6b426019u },
+    { 0xa1075a24e4421730u, 0xb24cf65b8612f81fu },
+    { 0xc94930ae1d529cfcu, 0xdee033f26797b627u },
+    { 0xfb9b7cd9a4a7443cu, 0x169840ef017da3b1u },
+    { 0x9d412e0806e88aa5u, 0x8e1f289560ee864eu },
+    { 0xc491798a08a2ad4eu, 0xf1a6f2bab92a27e2u },
+    { 0xf5b5d7ec8acb58a2u, 0xae10af696774b1dbu },
+    { 0x9991a6f3d6bf1765u, 0xacca6da1e0a8ef29u },
+    { 0xbff610b0cc6edd3fu, 0x17fd090a58d32af3u },
+    { 0xeff394dcff8a948eu, 0xddfc4b4cef07f5b0u },
+    { 0x95f83d0a1fb69cd9u, 0x4abdaf101564f98eu },
+    { 0xbb764c4ca7a4440fu, 0x9d6d1ad41abe37f1u },
+    { 0xea53df5fd18d5513u, 0x84c86189216dc5edu },
+    { 0x92746b9be2f8552cu, 0x32fd3cf5b4e49bb4u },
+    { 0xb7118682dbb66a77u, 0x3fbc8c33221dc2a1u },
+    { 0xe4d5e82392a40515u, 0x0fabaf3feaa5334au },
+    { 0x8f05b1163ba6832du, 0x29cb4d87f2a7400eu },
+    { 0xb2c71d5bca9023f8u, 0x743e20e9ef511012u },
+    { 0xdf78e4b2bd342cf6u, 0x914da9246b255416u },
+    { 0x8bab8eefb6409c1au, 0x1ad089b6c2f7548eu },
+    { 0xae9672aba3d0c320u, 0xa184ac2473b529b1u },
+    { 0xda3c0f568cc4f3e8u, 0xc9e5d72d90a2741eu },
+    { 0x8865899617fb1871u, 0x7e2fa67c7a658892u },
+    { 0xaa7eebfb9df9de8du, 0xddbb901b98feeab7u },
+    { 0xd51ea6fa85785631u, 0x552a74227f3ea565u },
+    { 0x8533285c936b35deu, 0xd53a88958f87275fu },
+    { 0xa67ff273b8460356u, 0x8a892abaf368f137u },
+    { 0xd01fef10a657842cu, 0x2d2b7569b0432d85u },
+    { 0x8213f56a67f6b29bu, 0x9c3b29620e29fc73u },
+    { 0xa298f2c501f45f42u, 0x8349f3ba91b47b8fu },
+    { 0xcb3f2f7642717713u, 0x241c70a936219a73u },
+    { 0xfe0efb53d30dd4d7u, 0xed238cd383aa0110u },
+    { 0x9ec95d1463e8a506u, 0xf4363804324a40aau },
+    { 0xc67bb4597ce2ce48u, 0xb143c6053edcd0d5u },
+    { 0xf81aa16fdc1b81dau, 0xdd94b7868e94050au },
+    { 0x9b10a4e5e9913128u, 0xca7cf2b4191c8326u },
+    { 0xc1d4ce1f63f57d72u, 0xfd1c2f611f63a3f0u },
+    { 0xf24a01a73cf2dccfu, 0xbc633b39673c8cecu },
+    { 0x976e41088617ca01u, 0xd5be0503e085d813u },
+    { 0xbd49d14aa79dbc82u, 0x4b2d8644d8a74e18u },
+    { 0xec9c459d51852ba2u, 0xddf8e7d60ed1219eu },
+    { 0x93e1ab8252f33b45u, 0xcabb90e5c942b503u },
+    { 0xb8da1662e7b00a17u, 0x3d6a751f3b936243u },
+    { 0xe7109bfba19c0c9du, 0x0cc512670a783ad4u },
+    { 0x906a617d450187e2u, 0x27fb2b80668b24c5u },
+    { 0xb484f9dc9641e9dau, 0xb1f9f660802dedf6u },
+    { 0xe1a63853bbd26451u, 0x5e7873f8a0396973u },
+    { 0x8d07e33455637eb2u, 0xdb0b487b6423e1e8u },
+    { 0xb049dc016abc5e5fu, 0x91ce1a9a3d2cda62u },
+    { 0xdc5c5301c56b75f7u, 0x7641a140cc7810fbu },
+    { 0x89b9b3e11b6329bau, 0xa9e904c87fcb0a9du },
+    { 0xac2820d9623bf429u, 0x546345fa9fbdcd44u },
+    { 0xd732290fbacaf133u, 0xa97c177947ad4095u },
+    { 0x867f59a9d4bed6c0u, 0x49ed8eabcccc485du },
+    { 0xa81f301449ee8c70u, 0x5c68f256bfff5a74u },
+    { 0xd226fc195c6a2f8cu, 0x73832eec6fff3111u },
+    { 0x83585d8fd9c25db7u, 0xc831fd53c5ff7eabu },
+    { 0xa42e74f3d032f525u, 0xba3e7ca8b77f5e55u },
+    { 0xcd3a1230c43fb26fu, 0x28ce1bd2e55f35ebu },
+    { 0x80444b5e7aa7cf85u, 0x7980d163cf5b81b3u },
+    { 0xa0555e361951c366u, 0xd7e105bcc332621fu },
+    { 0xc86ab5c39fa63440u, 0x8dd9472bf3fefaa7u },
+    { 0xfa856334878fc150u, 0xb14f98f6f0feb951u },
+    { 0x9c935e00d4b9d8d2u, 0x6ed1bf9a569f33d3u },
+    { 0xc3b8358109e84f07u, 0x0a862f80ec4700c8u },
+    { 0xf4a642e14c6262c8u, 0xcd27bb612758c0fau },
+    { 0x98e7e9cccfbd7dbdu, 0x8038d51cb897789cu },
+    { 0xbf21e44003acdd2cu, 0xe0470a63e6bd56c3u },
+    { 0xeeea5d5004981478u, 0x1858ccfce06cac74u },
+    { 0x95527a5202df0ccbu, 0x0f37801e0c43ebc8u },
+    { 0xbaa718e68396cffdu, 0xd30560258f54e6bau },
+    { 0xe950df20247c83fdu, 0x47c6b82ef32a2069u },
+    { 0x91d28b7416cdd27eu, 0x4cdc331d57fa5441u },
+    { 0xb6472e511c81471du, 0xe0133fe4adf8e952u },
+    { 0xe3d8f9e563a198e5u, 0x58180fddd97723a6u },
+    { 0x8e679c2f5e44ff8fu, 0x570f09eaa7ea7648u },
+};
+static constexpr int double_mantissa_bits = 52;
+static constexpr int double_exponent_bias = 1023;
+static constexpr int pow5_bit_count = 125;
+static constexpr int pow5_inverse_bit_count = 125;
+
+// These are exact for the exponent ranges of doubles.
+static inline i32 pow5_bits(i32 e) { return (i32)(((u32)e * 1217359) >> 19) + 1; }
+static inline u32 log10_pow2(i32 e) { return ((u32)e * 78913) >> 18; }
+static inline u32 log10_pow5(i32 e) { return ((u32)e * 732923) >> 20; }
+
+static inline u32 pow5_factor(u64 value)
+{
+    u32 count = 0;
+    while (value % 5 == 0) {
+        value /= 5;
+        count++;
+    }
+    return count;
+}
+
+static inline bool is_multiple_of_power_of_5(u64 value, u32 p) { return pow5_factor(value) >= p; }
+static inline bool is_multiple_of_power_of_2(u64 value, u32 p) { return (value & ((1ull << p) - 1)) == 0; }
+
+// (m * multiplier) >> shift, with multiplier a 128 bit value and 64 < shift < 128.
+static inline u64 multiply_shift(u64 m, u64 const* multiplier, i32 shift)
+{
+    auto low = multiply(m, multiplier[0]);
+    auto high = multiply(m, multiplier[1]);
+    u64 sum_low = high.low + low.high;
+    u64 sum_high = high.high + (sum_low < high.low);
+    shift -= 64;
+    return (sum_high << (64 - shift)) | (sum_low >> shift);
+}
+
+FloatingPointDecimal shortest_decimal_for(double value)
+{
+    u64 bits = bit_cast<u64>(value);
+    bool is_negative = bits >> 63;
+    u64 ieee_mantissa = bits & ((1ull << double_mantissa_bits) - 1);
+    u32 ieee_exponent = (bits >> double_mantissa_bits) & 0x7ff;
+    VERIFY(ieee_exponent != 0x7ff);
+    if (!ieee_exponent && !ieee_mantissa)
+        return { 0, 0, is_negative };
+
+    // Everything is computed on 4 * mantissa, so that the halfway points to
+    // the neighbouring doubles are integers too.
+    i32 e2;
+    u64 m2;
+    if (!ieee_exponent) {
+        e2 = 1 - double_exponent_bias - double_mantissa_bits - 2;
+        m2 = ieee_mantissa;
+    } else {
+        e2 = (i32)ieee_exponent - double_exponent_bias - double_mantissa_bits - 2;
+        m2 = (1ull << double_mantissa_bits) | ieee_mantissa;
+    }
+    // Round to even: the bounds themselves read back as this double if its
+    // mantissa is even.
+    bool accept_bounds = !(m2 & 1);
+
+    u64 mv = 4 * m2;
+    // The gap to the next lower double is half as big at powers of two.
+    u32 mm_shift = ieee_mantissa || ieee_exponent <= 1;
+    u64 mp = mv + 2;
+    u64 mm = mv - 1 - mm_shift;
+
+    u64 vr, vp, vm;
+    i32 e10;
+    bool vm_is_trailing_zeros = false;
+    bool vr_is_trailing_zeros = false;
+    if (e2 >= 0) {
+        u32 q = log10_pow2(e2) - (e2 > 3);
+        e10 = (i32)q;
+        i32 k = pow5_inverse_bit_count + pow5_bits((i32)q) - 1;
+        i32 i = -e2 + (i32)q + k;
+        vr = multiply_shift(mv, s_pow5_inverse_split[q], i);
+        vp = multiply_shift(mp, s_pow5_inverse_split[q], i);
+        vm = multiply_shift(mm, s_pow5_inverse_split[q], i);
+        if (q <= 21) {
+            // Only one of mp, mv and mm can be a multiple of 5, if any.
+            if (mv % 5 == 0)
+                vr_is_trailing_zeros = is_multiple_of_power_of_5(mv, q);
+            else if (accept_bounds)
+                vm_is_trailing_zeros = is_multiple_of_power_of_5(mm, q);
+            else
+                vp -= is_multiple_of_power_of_5(mp, q);
+        }
+    } else {
+        u32 q = log10_pow5(-e2) - (-e2 > 1);
+        e10 = (i32)q + e2;
+        i32 i = -e2 - (i32)q;
+        i32 k = pow5_bits(i) - pow5_bit_count;
+        i32 j = (i32)q - k;
+        vr = multiply_shift(mv, s_pow5_split[i], j);
+        vp = multiply_shift(mp, s_pow5_split[i], j);
+        vm = multiply_shift(mm, s_pow5_split[i], j);
+        if (q <= 1) {
+            // mv = 4 * m2 always has at least two trailing zero bits.
+            vr_is_trailing_zeros = true;
+            if (accept_bounds)
+                vm_is_trailing_zeros = mm_shift == 1;
+            else
+                --vp;
+        } else if (q < 63) {
+            vr_is_trailing_zeros = is_multiple_of_power_of_2(mv, q);
+        }
+    }
+
+    // Drop digits for as long as vp and vm still differ.
+    i32 removed = 0;
+    u8 last_removed_digit = 0;
+    u64 output;
+    if (vm_is_trailing_zeros || vr_is_trailing_zeros) {
+        // The rare case where the bounds or the value itself are exact in
+        // decimal and ties have to be broken correctly.
+        while (vp / 10 > vm / 10) {
+            vm_is_trailing_zeros &= vm % 10 == 0;
+            vr_is_trailing_zeros &= last_removed_digit == 0;
+            last_removed_digit = vr % 10;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            ++removed;
+        }
+        if (vm_is_trailing_zeros) {
+            while (vm % 10 == 0) {
+                vr_is_trailing_zeros &= last_removed_digit == 0;
+                last_removed_digit = vr % 10;
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                ++removed;
+            }
+        }
+        if (vr_is_trailing_zeros && last_removed_digit == 5 && vr % 2 == 0)
+            last_removed_digit = 4;
+        output = vr + ((vr == vm && (!accept_bounds || !vm_is_trailing_zeros)) || last_removed_digit >= 5);
+    } else {
+        bool round_up = false;
+        if (vp / 100 > vm / 100) {
+            round_up = vr % 100 >= 50;
+            vr /= 100;
+            vp /= 100;
+            vm /= 100;
+            removed += 2;
+        }
+        while (vp / 10 > vm / 10) {
+            round_up = vr % 10 >= 5;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            ++removed;
+        }
+        output = vr + (vr == vm || round_up);
+    }
+
+    i32 exponent = e10 + removed;
+    while (output % 10 == 0) {
+        output /= 10;
+        exponent++;
+    }
+    return { output, exponent, is_negative };
+}
+
+static inline size_t write_digits(u64 value, char* buffer)
+{
+    char digits[20];
+    size_t length = 0;
+    do {
+        digits[length++] = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+    for (size_t i = 0; i < length; i++)
+        buffer[i] = digits[length - i - 1];
+    return length;
+}
+
+size_t format_shortest(double value, char* buffer)
+{
+    char* out = buffer;
+    u64 bits = bit_cast<u64>(value);
+    if (((bits >> double_mantissa_bits) & 0x7ff) == 0x7ff) {
+        if (bits & ((1ull << double_mantissa_bits) - 1)) {
+            __builtin_memcpy(out, "nan", 3);
+            return 3;
+        }
+        if (bits >> 63)
+            *out++ = '-';
+        __builtin_memcpy(out, "inf", 3);
+        return out + 3 - buffer;
+    }
+
+    auto decimal = shortest_decimal_for(value);
+    if (decimal.is_negative)
+        *out++ = '-';
+
+    char digits[20];
+    i32 digit_count = (i32)write_digits(decimal.significand, digits);
+    // The value is 0.digits * 10^point.
+    i32 point = decimal.exponent + digit_count;
+
+    if (digit_count <= point && point <= 21) {
+        __builtin_memcpy(out, digits, digit_count);
+        out += digit_count;
+        for (i32 i = digit_count; i < point; i++)
+            *out++ = '0';
+    } else if (0 < point && point <= 21) {
+        __builtin_memcpy(out, digits, point);
+        out += point;
+        *out++ = '.';
+        __builtin_memcpy(out, digits + point, digit_count - point);
+        out += digit_count - point;
+    } else if (-6 < point && point <= 0) {
+        *out++ = '0';
+        *out++ = '.';
+        for (i32 i = point; i < 0; i++)
+            *out++ = '0';
+        __builtin_memcpy(out, digits, digit_count);
+        out += digit_count;
+    } else {
+        *out++ = digits[0];
+        if (digit_count > 1) {
+            *out++ = '.';
+            __builtin_memcpy(out, digits + 1, digit_count - 1);
+            out += digit_count - 1;
+        }
+        *out++ = 'e';
+        i32 exponent = point - 1;
+        *out++ = exponent < 0 ? '-' : '+';
+        out += write_digits(exponent < 0 ? -exponent : exponent, out);
+    }
+    return out - buffer;
+}
+
+static constexpr i32 smallest_power_of_ten = -342;
+static constexpr i32 largest_power_of_ten = 308;
+
+// Eisel-Lemire: significand * 10^exponent rounded to the nearest double,
+// given at most 19 significant digits. Returns the bits without the sign.
+static u64 compute_double_bits(u64 significand, i32 exponent)
+{
+    constexpr u64 infinity_bits = 0x7ffull << double_mantissa_bits;
+    if (!significand || exponent < smallest_power_of_ten)
+        return 0;
+    if (exponent > largest_power_of_ten)
+        return infinity_bits;
+
+    // w * 5^q, normalized so that the top bit is set; 10^q's power of two is
+    // added to the exponent at the end.
+    auto leading_zeros = __builtin_clzll(significand);
+    significand <<= leading_zeros;
+    auto const* power_of_five = s_powers_of_five_128[exponent - smallest_power_of_ten];
+    auto product = multiply(significand, power_of_five[0]);
+    // The low half of the power only matters if the bits that decide the
+    // rounding could still carry over.
+    constexpr u64 precision_mask = ~0ull >> (double_mantissa_bits + 3);
+    if ((product.high & precision_mask) == precision_mask) {
+        auto second_product = multiply(significand, power_of_five[1]);
+        product.low += second_product.high;
+        if (second_product.high > product.low)
+            product.high++;
+    }
+
+    int upper_bit = product.high >> 63;
+    int shift = upper_bit + 64 - double_mantissa_bits - 3;
+    u64 mantissa = product.high >> shift;
+    // floor(log2(10^q)) + 63, plus the normalization of the product.
+    i32 power2 = (((152170 + 65536) * exponent) >> 16) + 63 + upper_bit - leading_zeros + double_exponent_bias;
+
+    if (power2 <= 0) {
+        // Subnormal, or rounds up into the smallest normal double.
+        if (-power2 + 1 >= 64)
+            return 0;
+        mantissa >>= -power2 + 1;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+        power2 = mantissa < (1ull << double_mantissa_bits) ? 0 : 1;
+        return mantissa | ((u64)power2 << double_mantissa_bits);
+    }
+
+    // Exactly halfway between two doubles is only possible for these small
+    // powers, break the tie to even.
+    if (product.low <= 1 && exponent >= -4 && exponent <= 23 && (mantissa & 3) == 1) {
+        if ((mantissa << shift) == product.high)
+            mantissa &= ~1ull;
+    }
+
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= (2ull << double_mantissa_bits)) {
+        mantissa = 1ull << double_mantissa_bits;
+        power2++;
+    }
+    mantissa &= ~(1ull << double_mantissa_bits);
+    if (power2 >= 0x7ff)
+        return infinity_bits;
+    return mantissa | ((u64)power2 << double_mantissa_bits);
+}
+
+static constexpr double s_exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+Optional<double> parse_double(StringView const& string)
+{
+    auto const* characters = string.characters_without_null_termination();
+    auto const* end = characters + string.length();
+    auto const* p = characters;
+
+    bool is_negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        is_negative = *p == '-';
+        p++;
+    }
+
+    // The first 19 significant digits fit in a u64, the rest can only
+    // decide the rounding.
+    u64 significand = 0;
+    int significant_digits = 0;
+    bool is_truncated = false;
+    i64 exponent = 0;
+    bool has_digits = false;
+    auto consume_digit = [&](char ch, bool in_fraction) {
+        has_digits = true;
+        if (!significant_digits && ch == '0') {
+            exponent -= in_fraction;
+            return;
+        }
+        if (significant_digits < 19) {
+            significand = significand * 10 + (ch - '0');
+            significant_digits++;
+            exponent -= in_fraction;
+            return;
+        }
+        is_truncated |= ch != '0';
+        exponent += !in_fraction;
+    };
+
+    for (; p < end && is_ascii_digit(*p); p++)
+        consume_digit(*p, false);
+    if (p < end && *p == '.') {
+        p++;
+        for (; p < end && is_ascii_digit(*p); p++)
+            consume_digit(*p, true);
+    }
+    if (!has_digits)
+        return {};
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool exponent_is_negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            exponent_is_negative = *p == '-';
+            p++;
+        }
+        if (p == end || !is_ascii_digit(*p))
+            return {};
+        i64 explicit_exponent = 0;
+        for (; p < end && is_ascii_digit(*p); p++) {
+            // Anything this big is 0 or infinity either way.
+            if (explicit_exponent < 100000)
+                explicit_exponent = explicit_exponent * 10 + (*p - '0');
+        }
+        exponent += exponent_is_negative ? -explicit_exponent : explicit_exponent;
+    }
+    if (p != end)
+        return {};
+
+    double sign = is_negative ? -1.0 : 1.0;
+    if (!significand)
+        return sign * 0.0;
+
+#if __FLT_EVAL_METHOD__ == 0
+    // Both operands are exact doubles, so IEEE arithmetic rounds the result
+    // correctly (Clinger).
+    if (!is_truncated && exponent >= -22 && exponent <= 22 && significand <= (1ull << 53)) {
+        double value = (double)significand;
+        if (exponent < 0)
+            value /= s_exact_powers_of_ten[-exponent];
+        else
+            value *= s_exact_powers_of_ten[exponent];
+        return sign * value;
+    }
+#endif
+
+    if (exponent < smallest_power_of_ten - 19)
+        return sign * 0.0;
+    if (exponent > largest_power_of_ten + 1)
+        return sign * __builtin_huge_val();
+
+    u64 bits = compute_double_bits(significand, (i32)exponent);
+    // The dropped digits put the exact value somewhere between significand
+    // and significand + 1, if both round the same way that's the answer.
+    if (is_truncated && bits != compute_double_bits(significand + 1, (i32)exponent)) {
+        String copy { string };
+        return strtod(copy.characters(), nullptr);
+    }
+    return sign * bit_cast<double>(bits);
+}
+
+}
+
+#endif
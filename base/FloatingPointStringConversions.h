@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+#ifndef KERNEL
+
+// includes
+#include <base/Forward.h>
+#include <base/Optional.h>
+#include <base/Types.h>
+
+namespace Base {
+
+// significand * 10^exponent, significand has no trailing zeros unless it is 0.
+struct FloatingPointDecimal {
+    u64 significand { 0 };
+    i32 exponent { 0 };
+    bool is_negative { false };
+};
+
+// The shortest decimal that reads back as the same double, and of those the
+// closest one to it (Ryu). value has to be finite.
+FloatingPointDecimal shortest_decimal_for(double value);
+
+// Long enough for anything format_shortest() writes.
+static constexpr size_t shortest_double_max_length = 32;
+
+// Writes value the shortest way that round trips, with the notation of
+// JavaScript's Number::toString (which JSON output wants too): plain digits
+// for magnitudes within [1e-6, 1e21), exponent notation outside of it.
+// Returns the number of characters written, nothing is null terminated.
+size_t format_shortest(double value, char* buffer);
+
+// Correctly rounded parse of a whole decimal number, as JSON and strtod()
+// write them: -?digits(.digits)?([eE][+-]?digits)? with an optional leading
+// '+'. Uses Clinger's fast path for short exact values and Eisel-Lemire for
+// everything else, only falling back to strtod() for inputs with more than 19
+// significant digits that land right between two doubles.
+Optional<double> parse_double(StringView const&);
+
+}
+
+using Base::format_shortest;
+using Base::parse_double;
+using Base::shortest_decimal_for;
+
+#endif
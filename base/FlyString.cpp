@@ -4,14 +4,21 @@
  * SPDX-License-Identifier: BSD-2-Clause
 */
 
+#include <base/Atomic.h>
 #include <base/FlyString.h>
 #include <base/HashTable.h>
 #include <base/Optional.h>
+#include <base/Platform.h>
 #include <base/Singleton.h>
 #include <base/String.h>
+#include <base/StringHash.h>
 #include <base/StringUtils.h>
 #include <base/StringView.h>
 
+#ifndef KERNEL
+#    include <sched.h>
+#endif
+
 namespace Base {
 
 struct FlyStringImplTraits : public Traits<StringImpl*> {
@@ -24,53 +31,117 @@ struct FlyStringImplTraits : public Traits<StringImpl*> {
     }
 };
 
-static Base::Singleton<HashTable<StringImpl*, FlyStringImplTraits>> s_table;
+// The interned impls are spread over shards by the top bits of their hash,
+// each with its own lock, so threads interning different strings rarely
+// meet. The locks are only held for one table lookup or update.
+static constexpr size_t fly_string_shard_bits = 4;
+static constexpr size_t fly_string_shard_count = 1 << fly_string_shard_bits;
+
+struct alignas(64) FlyStringShard {
+    Atomic<bool> locked { false };
+    HashTable<StringImpl*, FlyStringImplTraits> impls;
+
+    void lock()
+    {
+        for (size_t spins = 0; locked.exchange(true, Base::memory_order_acquire); ++spins) {
+            while (locked.load(Base::memory_order_relaxed)) {
+#if ARCH(I386) || ARCH(X86_64)
+                __builtin_ia32_pause();
+#endif
+#ifndef KERNEL
+                if (spins >= 64)
+                    sched_yield();
+#endif
+            }
+        }
+    }
+
+    void unlock() { locked.store(false, Base::memory_order_release); }
+};
+
+struct FlyStringShardLocker {
+    explicit FlyStringShardLocker(FlyStringShard& shard)
+        : m_shard(shard)
+    {
+        m_shard.lock();
+    }
+    ~FlyStringShardLocker() { m_shard.unlock(); }
+
+    FlyStringShard& m_shard;
+};
+
+struct FlyStringTable {
+    FlyStringShard shards[fly_string_shard_count];
+};
+
+static Base::Singleton<FlyStringTable> s_table;
 
-static HashTable<StringImpl*, FlyStringImplTraits>& fly_impls()
+static FlyStringShard& shard_for(unsigned hash)
 {
-    return *s_table;
+    return s_table->shards[hash >> (32 - fly_string_shard_bits)];
 }
 
 void FlyString::did_destroy_impl(Badge<StringImpl>, StringImpl& impl)
 {
-    fly_impls().remove(&impl);
+    auto& shard = shard_for(impl.existing_hash());
+    FlyStringShardLocker locker(shard);
+    // intern() may already have replaced this impl with a live one.
+    auto it = shard.impls.find(&impl);
+    if (it != shard.impls.end() && *it == &impl)
+        shard.impls.remove(it);
+}
+
+NonnullRefPtr<StringImpl> FlyString::intern(unsigned hash, StringView const& string, StringImpl* candidate)
+{
+    auto& shard = shard_for(hash);
+    FlyStringShardLocker locker(shard);
+    auto it = shard.impls.find(hash, [&](auto* existing) {
+        return existing->view() == string;
+    });
+    if (it != shard.impls.end()) {
+        // Another thread may be dropping the last reference, in which case
+        // the impl is about to be destroyed and must not be handed out.
+        if ((*it)->try_ref())
+            return adopt_ref(**it);
+        shard.impls.remove(it);
+    }
+
+    RefPtr<StringImpl> impl = candidate;
+    if (!impl)
+        impl = StringImpl::create(string.characters_without_null_termination(), string.length());
+    impl->set_fly({}, true);
+    shard.impls.set(impl.ptr());
+    return impl.release_nonnull();
 }
 
 FlyString::FlyString(const String& string)
 {
     if (string.is_null())
         return;
-    if (string.impl()->is_fly()) {
-        m_impl = string.impl();
+    auto* impl = const_cast<StringImpl*>(string.impl());
+    // Only ever goes from false to true, under the shard lock, so seeing a
+    // stale false just means taking the lock.
+    if (impl->is_fly()) {
+        m_impl = impl;
         return;
     }
-    auto it = fly_impls().find(const_cast<StringImpl*>(string.impl()));
-    if (it == fly_impls().end()) {
-        fly_impls().set(const_cast<StringImpl*>(string.impl()));
-        string.impl()->set_fly({}, true);
-        m_impl = string.impl();
-    } else {
-        VERIFY((*it)->is_fly());
-        m_impl = *it;
-    }
+    m_impl = intern(impl->hash(), impl->view(), impl);
 }
 
 FlyString::FlyString(StringView const& string)
+    : FlyString(string, string.is_empty() ? 0 : seeded_string_hash(string.characters_without_null_termination(), string.length()))
+{
+}
+
+FlyString::FlyString(StringView const& string, unsigned hash)
 {
     if (string.is_null())
         return;
-    auto it = fly_impls().find(string.hash(), [&](auto& candidate) {
-        return string == candidate;
-    });
-    if (it == fly_impls().end()) {
-        auto new_string = string.to_string();
-        fly_impls().set(new_string.impl());
-        new_string.impl()->set_fly({}, true);
-        m_impl = new_string.impl();
-    } else {
-        VERIFY((*it)->is_fly());
-        m_impl = *it;
+    if (string.is_empty()) {
+        m_impl = StringImpl::the_empty_stringimpl();
+        return;
     }
+    m_impl = intern(hash, string, nullptr);
 }
 
 template<typename T>
@@ -117,13 +188,12 @@ FlyString FlyString::to_lowercase() const
 
 bool FlyString::operator==(const String& other) const
 {
-    if (m_impl == other.impl())
-        return true;
-
+    // Not through other.impl(), which would move a short String into a
+    // StringImpl just to compare it.
     if (!m_impl)
-        return !other.impl();
+        return other.is_null();
 
-    if (!other.impl())
+    if (other.is_null())
         return false;
 
     if (length() != other.length())
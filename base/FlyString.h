@@ -24,6 +24,9 @@ public:
     }
     FlyString(const String&);
     FlyString(const StringView&);
+    // For callers that hashed the characters already, hash has to be what
+    // StringImpl::hash() gives for them.
+    FlyString(const StringView&, unsigned hash);
     FlyString(const char* string)
         : FlyString(static_cast<String>(string))
     {
@@ -91,6 +94,8 @@ public:
     }
 
 private:
+    static NonnullRefPtr<StringImpl> intern(unsigned hash, StringView const&, StringImpl* candidate);
+
     RefPtr<StringImpl> m_impl;
 };
 
@@ -5,8 +5,10 @@
 */
 
 #include <base/CharacterTypes.h>
+#include <base/FloatingPointStringConversions.h>
 #include <base/Format.h>
 #include <base/GenericLexer.h>
+#include <base/IntegerConversions.h>
 #include <base/String.h>
 #include <base/StringBuilder.h>
 #include <base/kstdio.h>
@@ -19,8 +21,10 @@
 #    include <kernel/Process.h>
 #    include <kernel/Thread.h>
 #else
+#    include <errno.h>
 #    include <stdio.h>
 #    include <string.h>
+#    include <unistd.h>
 #endif
 
 namespace Base {
@@ -29,34 +33,6 @@ namespace {
 
 static constexpr size_t use_next_index = NumericLimits<size_t>::max();
 
-static constexpr size_t convert_unsigned_to_string(u64 value, Array<u8, 128>& buffer, u8 base, bool upper_case)
-{
-    VERIFY(base >= 2 && base <= 16);
-
-    constexpr const char* lowercase_lookup = "0123456789abcdef";
-    constexpr const char* uppercase_lookup = "0123456789ABCDEF";
-
-    if (value == 0) {
-        buffer[0] = '0';
-        return 1;
-    }
-
-    size_t used = 0;
-    while (value > 0) {
-        if (upper_case)
-            buffer[used++] = uppercase_lookup[value % base];
-        else
-            buffer[used++] = lowercase_lookup[value % base];
-
-        value /= base;
-    }
-
-    for (size_t i = 0; i < used / 2; ++i)
-        swap(buffer[i], buffer[used - i - 1]);
-
-    return used;
-}
-
 void vformat_impl(TypeErasedFormatParams& params, FormatBuilder& builder, FormatParser& parser)
 {
     const auto literal = parser.consume_literal();
@@ -79,6 +55,23 @@ void vformat_impl(TypeErasedFormatParams& params, FormatBuilder& builder, Format
     vformat_impl(params, builder, parser);
 }
 
+static_assert(FormatSegment::implicit_index == use_next_index);
+
+void vformat_impl(TypeErasedFormatParams& params, FormatBuilder& builder, StringView fmtstr, Span<const FormatSegment> segments)
+{
+    for (auto& segment : segments) {
+        builder.put_literal(fmtstr.substring_view(segment.literal_start, segment.literal_length));
+        if (segment.index == FormatSegment::no_field)
+            return;
+
+        auto index = segment.index == use_next_index ? params.take_next_index() : segment.index;
+        auto& parameter = params.parameters().at(index);
+
+        FormatParser argparser { fmtstr.substring_view(segment.flags_start, segment.flags_length) };
+        parameter.formatter(params, builder, argparser, parameter.value);
+    }
+}
+
 } 
 
 FormatParser::FormatParser(StringView input)
@@ -171,18 +164,39 @@ bool FormatParser::consume_replacement_field(size_t& index)
     return true;
 }
 
+void FormatBuilder::append(char ch)
+{
+    if (m_sink)
+        m_sink->append(ch);
+    else
+        m_builder->append(ch);
+}
+
+void FormatBuilder::append(const char* characters, size_t length)
+{
+    if (m_sink)
+        m_sink->append(characters, length);
+    else
+        m_builder->append(characters, length);
+}
+
 void FormatBuilder::put_padding(char fill, size_t amount)
 {
     for (size_t i = 0; i < amount; ++i)
-        m_builder.append(fill);
+        append(fill);
 }
 void FormatBuilder::put_literal(StringView value)
 {
+    // Escaped braces are doubled, everything in between goes out as is.
+    size_t start = 0;
     for (size_t i = 0; i < value.length(); ++i) {
-        m_builder.append(value[i]);
-        if (value[i] == '{' || value[i] == '}')
-            ++i;
+        if (value[i] == '{' || value[i] == '}') {
+            append(value.characters_without_null_termination() + start, i + 1 - start);
+            start = ++i + 1;
+        }
     }
+    if (start < value.length())
+        append(value.characters_without_null_termination() + start, value.length() - start);
 }
 void FormatBuilder::put_string(
     StringView value,
@@ -198,18 +212,18 @@ void FormatBuilder::put_string(
         value = value.substring_view(0, used_by_string);
 
     if (align == Align::Left || align == Align::Default) {
-        m_builder.append(value);
+        append(value);
         put_padding(fill, used_by_padding);
     } else if (align == Align::Center) {
         const auto used_by_left_padding = used_by_padding / 2;
         const auto used_by_right_padding = ceil_div<size_t, size_t>(used_by_padding, 2);
 
         put_padding(fill, used_by_left_padding);
-        m_builder.append(value);
+        append(value);
         put_padding(fill, used_by_right_padding);
     } else if (align == Align::Right) {
         put_padding(fill, used_by_padding);
-        m_builder.append(value);
+        append(value);
     }
 }
 void FormatBuilder::put_u64(
@@ -227,9 +241,9 @@ void FormatBuilder::put_u64(
     if (align == Align::Default)
         align = Align::Right;
 
-    Array<u8, 128> buffer;
+    char buffer[max_digits_of_u64];
 
-    const auto used_by_digits = convert_unsigned_to_string(value, buffer, base, upper_case);
+    const auto used_by_digits = convert_unsigned_to_digits(value, buffer, base, upper_case);
 
     size_t used_by_prefix = 0;
     if (align == Align::Right && zero_pad) {
@@ -254,31 +268,30 @@ void FormatBuilder::put_u64(
 
     const auto put_prefix = [&]() {
         if (is_negative)
-            m_builder.append('-');
+            append('-');
         else if (sign_mode == SignMode::Always)
-            m_builder.append('+');
+            append('+');
         else if (sign_mode == SignMode::Reserved)
-            m_builder.append(' ');
+            append(' ');
 
         if (prefix) {
             if (base == 2) {
                 if (upper_case)
-                    m_builder.append("0B");
+                    append("0B"sv);
                 else
-                    m_builder.append("0b");
+                    append("0b"sv);
             } else if (base == 8) {
-                m_builder.append("0");
+                append("0"sv);
             } else if (base == 16) {
                 if (upper_case)
-                    m_builder.append("0X");
+                    append("0X"sv);
                 else
-                    m_builder.append("0x");
+                    append("0x"sv);
             }
         }
     };
     const auto put_digits = [&]() {
-        for (size_t i = 0; i < used_by_digits; ++i)
-            m_builder.append(buffer[i]);
+        append(buffer, used_by_digits);
     };
 
     if (align == Align::Left) {
@@ -375,6 +388,24 @@ void FormatBuilder::put_f64(
     put_string(string_builder.string_view(), align, min_width, NumericLimits<size_t>::max(), fill);
 }
 
+void FormatBuilder::put_f64_shortest(
+    double value,
+    Align align,
+    size_t min_width,
+    char fill,
+    SignMode sign_mode)
+{
+    char buffer[shortest_double_max_length + 1];
+    char* digits = buffer + 1;
+    size_t length = format_shortest(value, digits);
+    if (*digits != '-' && *digits != 'n' && sign_mode != SignMode::OnlyIfNeeded) {
+        *--digits = sign_mode == SignMode::Always ? '+' : ' ';
+        length++;
+    }
+
+    put_string(StringView { digits, length }, align, min_width, NumericLimits<size_t>::max(), fill);
+}
+
 void FormatBuilder::put_f80(
     long double value,
     u8 base,
@@ -426,7 +457,7 @@ void FormatBuilder::put_hexdump(ReadonlyBytes bytes, size_t width, char fill)
         put_padding(fill, 4);
         for (size_t j = i - width; j < i; ++j) {
             auto ch = bytes[j];
-            m_builder.append(ch >= 32 && ch <= 127 ? ch : '.');
+            append(ch >= 32 && ch <= 127 ? ch : '.');
         }
     };
     for (size_t i = 0; i < bytes.size(); ++i) {
@@ -443,14 +474,68 @@ void FormatBuilder::put_hexdump(ReadonlyBytes bytes, size_t width, char fill)
         put_char_view(bytes.size());
 }
 
-void vformat(StringBuilder& builder, StringView fmtstr, TypeErasedFormatParams params)
+static void vformat_into(FormatBuilder& fmtbuilder, StringView fmtstr, TypeErasedFormatParams& params, Span<const FormatSegment> segments)
 {
-    FormatBuilder fmtbuilder { builder };
-    FormatParser parser { fmtstr };
+    if (!segments.is_empty()) {
+        vformat_impl(params, fmtbuilder, fmtstr, segments);
+        return;
+    }
 
+    FormatParser parser { fmtstr };
     vformat_impl(params, fmtbuilder, parser);
 }
 
+void vformat(StringBuilder& builder, StringView fmtstr, TypeErasedFormatParams params, Span<const FormatSegment> segments)
+{
+    FormatBuilder fmtbuilder { builder };
+    vformat_into(fmtbuilder, fmtstr, params, segments);
+}
+
+void vformat(FormatSink& sink, StringView fmtstr, TypeErasedFormatParams params, Span<const FormatSegment> segments)
+{
+    FormatBuilder fmtbuilder { sink };
+    vformat_into(fmtbuilder, fmtstr, params, segments);
+}
+
+void FormatSink::append(const char* characters, size_t length)
+{
+    // Whatever wouldn't fit into an empty buffer skips it.
+    if (length >= buffer_size) {
+        flush();
+        write(characters, length);
+        return;
+    }
+    if (length > buffer_size - m_used)
+        flush();
+    __builtin_memcpy(m_buffer + m_used, characters, length);
+    m_used += length;
+}
+
+void FormatSink::flush()
+{
+    if (!m_used)
+        return;
+    write(m_buffer, m_used);
+    m_used = 0;
+}
+
+#ifndef KERNEL
+void FileDescriptorFormatSink::write(const char* characters, size_t length)
+{
+    while (length && m_successful) {
+        auto rc = ::write(m_fd, characters, length);
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc <= 0) {
+            m_successful = false;
+            return;
+        }
+        characters += rc;
+        length -= rc;
+    }
+}
+#endif
+
 void StandardFormatter::parse(TypeErasedFormatParams& params, FormatParser& parser)
 {
     if (StringView { "<^>" }.contains(parser.peek(1))) {
@@ -684,6 +769,13 @@ void Formatter<double>::format(FormatBuilder& builder, double value)
     }
 
     m_width = m_width.value_or(0);
+
+    // Without a precision, print just enough digits to round trip.
+    if (base == 10 && !m_precision.has_value() && !m_zero_pad) {
+        builder.put_f64_shortest(value, m_align, m_width.value(), m_fill, m_sign_mode);
+        return;
+    }
+
     m_precision = m_precision.value_or(6);
 
     builder.put_f64(value, base, upper_case, m_zero_pad, m_align, m_width.value(), m_precision.value(), m_fill, m_sign_mode);
@@ -691,24 +783,68 @@ void Formatter<double>::format(FormatBuilder& builder, double value)
 void Formatter<float>::format(FormatBuilder& builder, float value)
 {
     Formatter<double> formatter { *this };
+    // The shortest digits of the widened double would be the float's exact
+    // binary value, not its shortest form, so floats keep the fixed default.
+    formatter.m_precision = m_precision.value_or(6);
     formatter.format(builder, value);
 }
 #endif
 
+namespace {
+
+// Hands whatever was formatted to one of the console's putstr functions.
+class ConsoleFormatSink final : public FormatSink {
+public:
+    explicit ConsoleFormatSink(void (*putstr)(const char*, size_t))
+        : m_putstr(putstr)
+    {
+    }
+
+private:
+    virtual void write(const char* characters, size_t length) override { m_putstr(characters, length); }
+
+    void (*m_putstr)(const char*, size_t);
+};
+
+#ifndef KERNEL
+class FileFormatSink final : public FormatSink {
+public:
+    explicit FileFormatSink(FILE* file)
+        : m_file(file)
+    {
+    }
+
+    size_t length() const { return m_length; }
+    size_t written() const { return m_written; }
+
+private:
+    virtual void write(const char* characters, size_t length) override
+    {
+        m_length += length;
+        m_written += ::fwrite(characters, 1, length, m_file);
+    }
+
+    FILE* m_file { nullptr };
+    size_t m_length { 0 };
+    size_t m_written { 0 };
+};
+#endif
+
+}
+
 #ifndef KERNEL
-void vout(FILE* file, StringView fmtstr, TypeErasedFormatParams params, bool newline)
+void vout(FILE* file, StringView fmtstr, TypeErasedFormatParams params, bool newline, Span<const FormatSegment> segments)
 {
-    StringBuilder builder;
-    vformat(builder, fmtstr, params);
+    FileFormatSink sink { file };
+    vformat(sink, fmtstr, params, segments);
 
     if (newline)
-        builder.append('\n');
+        sink.append('\n');
+    sink.flush();
 
-    const auto string = builder.string_view();
-    const auto retval = ::fwrite(string.characters_without_null_termination(), 1, string.length(), file);
-    if (static_cast<size_t>(retval) != string.length()) {
+    if (sink.written() != sink.length()) {
         auto error = ferror(file);
-        dbgln("vout() failed ({} written out of {}), error was {} ({})", retval, string.length(), error, strerror(error));
+        dbgln("vout() failed ({} written out of {}), error was {} ({})", sink.written(), sink.length(), error, strerror(error));
     }
 }
 #endif
@@ -720,20 +856,20 @@ void set_debug_enabled(bool value)
     is_debug_enabled = value;
 }
 
-void vdbgln(StringView fmtstr, TypeErasedFormatParams params)
+void vdbgln(StringView fmtstr, TypeErasedFormatParams params, Span<const FormatSegment> segments)
 {
     if (!is_debug_enabled)
         return;
 
-    StringBuilder builder;
+    ConsoleFormatSink sink { dbgputstr };
 
 #ifdef __pranaos__
 #    ifdef KERNEL
     if (Kernel::Processor::is_initialized() && Kernel::Thread::current()) {
         auto& thread = *Kernel::Thread::current();
-        builder.appendff("\033[34;1m[#{} {}({}:{})]\033[0m: ", Kernel::Processor::id(), thread.process().name(), thread.pid().value(), thread.tid().value());
+        sink.appendff("\033[34;1m[#{} {}({}:{})]\033[0m: ", Kernel::Processor::id(), thread.process().name(), thread.pid().value(), thread.tid().value());
     } else {
-        builder.appendff("\033[34;1m[#{} Kernel]\033[0m: ", Kernel::Processor::id());
+        sink.appendff("\033[34;1m[#{} Kernel]\033[0m: ", Kernel::Processor::id());
     }
 #    else
     static TriState got_process_name = TriState::Unknown;
@@ -746,57 +882,50 @@ void vdbgln(StringView fmtstr, TypeErasedFormatParams params)
             got_process_name = TriState::False;
     }
     if (got_process_name == TriState::True)
-        builder.appendff("\033[33;1m{}({}:{})\033[0m: ", process_name_buffer, getpid(), gettid());
+        sink.appendff("\033[33;1m{}({}:{})\033[0m: ", process_name_buffer, getpid(), gettid());
 #    endif
 #endif
 
-    vformat(builder, fmtstr, params);
-    builder.append('\n');
-
-    const auto string = builder.string_view();
-
-    dbgputstr(string.characters_without_null_termination(), string.length());
+    vformat(sink, fmtstr, params, segments);
+    sink.append('\n');
+    sink.flush();
 }
 
 #ifdef KERNEL
-void vdmesgln(StringView fmtstr, TypeErasedFormatParams params)
+void vdmesgln(StringView fmtstr, TypeErasedFormatParams params, Span<const FormatSegment> segments)
 {
-    StringBuilder builder;
+    ConsoleFormatSink sink { kernelputstr };
 
 #    ifdef __pranaos__
     if (Kernel::Processor::is_initialized() && Kernel::Thread::current()) {
         auto& thread = *Kernel::Thread::current();
-        builder.appendff("\033[34;1m[{}({}:{})]\033[0m: ", thread.process().name(), thread.pid().value(), thread.tid().value());
+        sink.appendff("\033[34;1m[{}({}:{})]\033[0m: ", thread.process().name(), thread.pid().value(), thread.tid().value());
     } else {
-        builder.appendff("\033[34;1m[Kernel]\033[0m: ");
+        sink.appendff("\033[34;1m[Kernel]\033[0m: ");
     }
 #    endif
 
-    vformat(builder, fmtstr, params);
-    builder.append('\n');
-
-    const auto string = builder.string_view();
-    kernelputstr(string.characters_without_null_termination(), string.length());
+    vformat(sink, fmtstr, params, segments);
+    sink.append('\n');
+    sink.flush();
 }
 
-void v_critical_dmesgln(StringView fmtstr, TypeErasedFormatParams params)
+void v_critical_dmesgln(StringView fmtstr, TypeErasedFormatParams params, Span<const FormatSegment> segments)
 {
+    ConsoleFormatSink sink { kernelcriticalputstr };
 
-    StringBuilder builder;
 #    ifdef __pranaos__
     if (Kernel::Processor::is_initialized() && Kernel::Thread::current()) {
         auto& thread = *Kernel::Thread::current();
-        builder.appendff("[{}({}:{})]: ", thread.process().name(), thread.pid().value(), thread.tid().value());
+        sink.appendff("[{}({}:{})]: ", thread.process().name(), thread.pid().value(), thread.tid().value());
     } else {
-        builder.appendff("[Kernel]: ");
+        sink.appendff("[Kernel]: ");
     }
 #    endif
 
-    vformat(builder, fmtstr, params);
-    builder.append('\n');
-
-    const auto string = builder.string_view();
-    kernelcriticalputstr(string.characters_without_null_termination(), string.length());
+    vformat(sink, fmtstr, params, segments);
+    sink.append('\n');
+    sink.flush();
 }
 
 #endif
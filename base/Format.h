@@ -12,6 +12,7 @@
 #include <base/AnyOf.h>
 #include <base/Array.h>
 #include <base/GenericLexer.h>
+#include <base/Noncopyable.h>
 #include <base/Optional.h>
 #include <base/StringView.h>
 
@@ -24,6 +25,7 @@ namespace Base {
 class TypeErasedFormatParams;
 class FormatParser;
 class FormatBuilder;
+class FormatSink;
 
 template<typename T, typename = void>
 struct Formatter {
@@ -151,7 +153,12 @@ public:
     };
 
     explicit FormatBuilder(StringBuilder& builder)
-        : m_builder(builder)
+        : m_builder(&builder)
+    {
+    }
+
+    explicit FormatBuilder(FormatSink& sink)
+        : m_sink(&sink)
     {
     }
 
@@ -210,6 +217,14 @@ public:
         size_t precision = 6,
         char fill = ' ',
         SignMode sign_mode = SignMode::OnlyIfNeeded);
+
+    // The shortest digits that read back as the same double.
+    void put_f64_shortest(
+        double value,
+        Align align = Align::Right,
+        size_t min_width = 0,
+        char fill = ' ',
+        SignMode sign_mode = SignMode::OnlyIfNeeded);
 #endif
 
     void put_hexdump(
@@ -217,14 +232,26 @@ public:
         size_t width,
         char fill = ' ');
 
+    // Only for builders that write into a StringBuilder.
     const StringBuilder& builder() const
     {
-        return m_builder;
+        VERIFY(m_builder);
+        return *m_builder;
+    }
+    StringBuilder& builder()
+    {
+        VERIFY(m_builder);
+        return *m_builder;
     }
-    StringBuilder& builder() { return m_builder; }
 
 private:
-    StringBuilder& m_builder;
+    void append(char);
+    void append(const char*, size_t);
+    void append(StringView value) { append(value.characters_without_null_termination(), value.length()); }
+
+    // Exactly one of them is set.
+    StringBuilder* m_builder { nullptr };
+    FormatSink* m_sink { nullptr };
 };
 
 class TypeErasedFormatParams {
@@ -477,16 +504,77 @@ struct Formatter<std::nullptr_t> : Formatter<FlatPtr> {
     }
 };
 
-void vformat(StringBuilder&, StringView fmtstr, TypeErasedFormatParams);
+void vformat(StringBuilder&, StringView fmtstr, TypeErasedFormatParams, Span<const FormatSegment> segments = {});
+void vformat(FormatSink&, StringView fmtstr, TypeErasedFormatParams, Span<const FormatSegment> segments = {});
+
+// Where a FormatBuilder writes to instead of a StringBuilder. Output is
+// gathered in a buffer on the stack and handed to write() whenever that
+// fills up, so output of any length is written without allocating. Lines
+// longer than the buffer reach the destination in more than one write.
+// Whoever formats into a sink calls flush() once done.
+class FormatSink {
+    BASE_MAKE_NONCOPYABLE(FormatSink);
+    BASE_MAKE_NONMOVABLE(FormatSink);
+
+public:
+    static constexpr size_t buffer_size = 256;
+
+    void append(char ch)
+    {
+        if (m_used == buffer_size)
+            flush();
+        m_buffer[m_used++] = ch;
+    }
+    void append(const char*, size_t);
+    void append(StringView value) { append(value.characters_without_null_termination(), value.length()); }
+
+    template<typename... Parameters>
+    void appendff(CheckedFormatString<Parameters...>&& fmtstr, const Parameters&... parameters)
+    {
+        vformat(*this, fmtstr.view(), VariadicFormatParams { parameters... }, fmtstr.segments());
+    }
+
+    void flush();
+
+protected:
+    FormatSink() = default;
+    ~FormatSink() = default;
+
+    virtual void write(const char*, size_t) = 0;
+
+private:
+    char m_buffer[buffer_size];
+    size_t m_used { 0 };
+};
+
+#ifndef KERNEL
+// Writes straight to a file descriptor, retrying writes that were cut
+// short. Whether all of it made it is for was_successful() to say.
+class FileDescriptorFormatSink final : public FormatSink {
+public:
+    explicit FileDescriptorFormatSink(int fd)
+        : m_fd(fd)
+    {
+    }
+
+    bool was_successful() const { return m_successful; }
+
+private:
+    virtual void write(const char*, size_t) override;
+
+    int m_fd { -1 };
+    bool m_successful { true };
+};
+#endif
 
 #ifndef KERNEL
-void vout(FILE*, StringView fmtstr, TypeErasedFormatParams, bool newline = false);
+void vout(FILE*, StringView fmtstr, TypeErasedFormatParams, bool newline = false, Span<const FormatSegment> segments = {});
 
 template<typename... Parameters>
-void out(FILE* file, CheckedFormatString<Parameters...>&& fmtstr, const Parameters&... parameters) { vout(file, fmtstr.view(), VariadicFormatParams { parameters... }); }
+void out(FILE* file, CheckedFormatString<Parameters...>&& fmtstr, const Parameters&... parameters) { vout(file, fmtstr.view(), VariadicFormatParams { parameters... }, false, fmtstr.segments()); }
 
 template<typename... Parameters>
-void outln(FILE* file, CheckedFormatString<Parameters...>&& fmtstr, const Parameters&... parameters) { vout(file, fmtstr.view(), VariadicFormatParams { parameters... }, true); }
+void outln(FILE* file, CheckedFormatString<Parameters...>&& fmtstr, const Parameters&... parameters) { vout(file, fmtstr.view(), VariadicFormatParams { parameters... }, true, fmtstr.segments()); }
 
 inline void outln(FILE* file) { fputc('\n', file); }
 
@@ -523,12 +611,12 @@ inline void warnln() { outln(stderr); }
 
 #endif
 
-void vdbgln(StringView fmtstr, TypeErasedFormatParams);
+void vdbgln(StringView fmtstr, TypeErasedFormatParams, Span<const FormatSegment> segments = {});
 
 template<typename... Parameters>
 void dbgln(CheckedFormatString<Parameters...>&& fmtstr, const Parameters&... parameters)
 {
-    vdbgln(fmtstr.view(), VariadicFormatParams { parameters... });
+    vdbgln(fmtstr.view(), VariadicFormatParams { parameters... }, fmtstr.segments());
 }
 
 inline void dbgln() { dbgln(""); }
@@ -536,20 +624,20 @@ inline void dbgln() { dbgln(""); }
 void set_debug_enabled(bool);
 
 #ifdef KERNEL
-void vdmesgln(StringView fmtstr, TypeErasedFormatParams);
+void vdmesgln(StringView fmtstr, TypeErasedFormatParams, Span<const FormatSegment> segments = {});
 
 template<typename... Parameters>
 void dmesgln(CheckedFormatString<Parameters...>&& fmt, const Parameters&... parameters)
 {
-    vdmesgln(fmt.view(), VariadicFormatParams { parameters... });
+    vdmesgln(fmt.view(), VariadicFormatParams { parameters... }, fmt.segments());
 }
 
-void v_critical_dmesgln(StringView fmtstr, TypeErasedFormatParams);
+void v_critical_dmesgln(StringView fmtstr, TypeErasedFormatParams, Span<const FormatSegment> segments = {});
 
 template<typename... Parameters>
 void critical_dmesgln(CheckedFormatString<Parameters...>&& fmt, const Parameters&... parameters)
 {
-    v_critical_dmesgln(fmt.view(), VariadicFormatParams { parameters... });
+    v_critical_dmesgln(fmt.view(), VariadicFormatParams { parameters... }, fmt.segments());
 }
 #endif
 
@@ -602,6 +690,7 @@ struct Formatter<FormatString> : Formatter<String> {
 using Base::critical_dmesgln;
 using Base::dmesgln;
 #else
+using Base::FileDescriptorFormatSink;
 using Base::out;
 using Base::outln;
 
@@ -613,6 +702,7 @@ using Base::dbgln;
 
 using Base::CheckedFormatString;
 using Base::FormatIfSupported;
+using Base::FormatSink;
 using Base::FormatString;
 
 #define dbgln_if(flag, fmt, ...)       \
@@ -17,6 +17,7 @@ template<size_t inline_capacity>
 class ByteBuffer;
 }
 
+class Arena;
 class Bitmap;
 using ByteBuffer = Base::Detail::ByteBuffer<32>;
 class IPv4Address;
@@ -30,6 +31,7 @@ class StringImpl;
 class StringView;
 class Time;
 class URL;
+class URLView;
 class FlyString;
 class Utf32View;
 class Utf8View;
@@ -68,6 +70,12 @@ class DoublyLinkedList;
 template<typename T, size_t capacity>
 class CircularQueue;
 
+template<typename T, size_t Capacity>
+class SPSCQueue;
+
+template<typename T, size_t Capacity>
+class MPMCQueue;
+
 template<typename T>
 struct Traits;
 
@@ -127,6 +135,7 @@ requires(!IsRvalueReference<T>) class Vector;
 
 }
 
+using Base::Arena;
 using Base::Array;
 using Base::Atomic;
 using Base::Badge;
@@ -149,6 +158,7 @@ using Base::IPv4Address;
 using Base::JsonArray;
 using Base::JsonObject;
 using Base::JsonValue;
+using Base::MPMCQueue;
 using Base::NonnullOwnPtr;
 using Base::NonnullOwnPtrVector;
 using Base::NonnullRefPtr;
@@ -161,6 +171,7 @@ using Base::OwnPtr;
 using Base::ReadonlyBytes;
 using Base::RefPtr;
 using Base::SinglyLinkedList;
+using Base::SPSCQueue;
 using Base::Span;
 using Base::StackInfo;
 using Base::String;
@@ -170,6 +181,7 @@ using Base::StringView;
 using Base::Time;
 using Base::Traits;
 using Base::URL;
+using Base::URLView;
 using Base::Utf32View;
 using Base::Utf8View;
 using Base::Vector;
\ No newline at end of file
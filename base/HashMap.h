@@ -95,6 +95,7 @@ public:
     }
 
     void ensure_capacity(size_t capacity) { m_table.ensure_capacity(capacity); }
+    [[nodiscard]] bool has_room_for_one_more() const { return m_table.has_room_for_one_more(); }
 
     Optional<typename Traits<V>::PeekType> get(const K& key) const requires(!IsPointer<typename Traits<V>::PeekType>)
     {
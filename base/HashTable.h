@@ -8,6 +8,8 @@
 
 #include <base/Forward.h>
 #include <base/HashFunctions.h>
+#include <base/Platform.h>
+#include <base/SIMD.h>
 #include <base/StdLibExtras.h>
 #include <base/Types.h>
 #include <base/kmalloc.h>
@@ -464,6 +466,459 @@ private:
     size_t m_capacity { 0 };
     size_t m_deleted_count { 0 };
 };
+
+namespace Detail {
+
+// Every slot of an unordered HashTable has a control byte: 7 bits of the
+// hash of a full slot, or one of these two, which a full slot never is.
+static constexpr u8 hash_table_control_empty = 0x80;
+static constexpr u8 hash_table_control_deleted = 0xfe;
+
+template<size_t BitsPerSlot>
+class HashTableGroupMask {
+public:
+    explicit HashTableGroupMask(u64 bits)
+        : m_bits(bits)
+    {
+    }
+
+    explicit operator bool() const { return m_bits != 0; }
+    size_t lowest() const { return count_trailing_zeroes_64(m_bits) / BitsPerSlot; }
+    void clear_lowest() { m_bits &= m_bits - 1; }
+
+private:
+    u64 m_bits;
+};
+
+#ifdef __SSE2__
+// Sixteen control bytes, matched with one compare.
+class HashTableGroup {
+public:
+    static constexpr size_t width = 16;
+    using Mask = HashTableGroupMask<1>;
+
+    explicit HashTableGroup(const u8* control) { __builtin_memcpy(&m_control, control, width); }
+
+    Mask match(u8 h2) const { return mask_of(m_control == splat(h2)); }
+    Mask match_empty() const { return mask_of(m_control == splat(hash_table_control_empty)); }
+    Mask match_empty_or_deleted() const { return mask_of(m_control); }
+
+private:
+    static SIMD::u8x16 splat(u8 value)
+    {
+        SIMD::u8x16 result;
+        for (size_t i = 0; i < width; ++i)
+            result[i] = value;
+        return result;
+    }
+
+    // Gathers the top bit of every byte.
+    template<typename Vector>
+    static Mask mask_of(Vector bytes) { return Mask(static_cast<u16>(__builtin_ia32_pmovmskb128((SIMD::c8x16)bytes))); }
+
+    SIMD::u8x16 m_control;
+};
+#else
+// Eight control bytes in a word, matched with bit tricks. The kernel is
+// built without SSE, so it always uses this one.
+class HashTableGroup {
+public:
+    static constexpr size_t width = 8;
+    using Mask = HashTableGroupMask<8>;
+
+    explicit HashTableGroup(const u8* control) { __builtin_memcpy(&m_control, control, width); }
+
+    // May also report a byte right after a real match, which the caller's
+    // predicate then rejects.
+    Mask match(u8 h2) const
+    {
+        u64 x = m_control ^ (lsbs * h2);
+        return Mask((x - lsbs) & ~x & msbs);
+    }
+
+    // Empty is the only control byte with the top bit set and bit 1 clear.
+    Mask match_empty() const { return Mask(m_control & (~m_control << 6) & msbs); }
+    Mask match_empty_or_deleted() const { return Mask(m_control & msbs); }
+
+private:
+    static constexpr u64 lsbs = 0x0101010101010101ull;
+    static constexpr u64 msbs = 0x8080808080808080ull;
+
+    u64 m_control;
+};
+#endif
+
+}
+
+template<typename HashTableType, typename T>
+class HashTableSlotIterator {
+    friend HashTableType;
+
+public:
+    bool operator==(const HashTableSlotIterator& other) const { return m_slot == other.m_slot; }
+    bool operator!=(const HashTableSlotIterator& other) const { return m_slot != other.m_slot; }
+    T& operator*() { return *m_slot; }
+    T* operator->() { return m_slot; }
+    void operator++() { skip_to_next(); }
+
+private:
+    void skip_to_next()
+    {
+        if (!m_slot)
+            return;
+        do {
+            ++m_control;
+            ++m_slot;
+            if (m_control == m_control_end) {
+                m_control = nullptr;
+                m_slot = nullptr;
+                return;
+            }
+        } while (*m_control & 0x80);
+    }
+
+    HashTableSlotIterator(const u8* control, const u8* control_end, T* slot)
+        : m_control(control)
+        , m_control_end(control_end)
+        , m_slot(slot)
+    {
+    }
+
+    const u8* m_control { nullptr };
+    const u8* m_control_end { nullptr };
+    T* m_slot { nullptr };
+};
+
+// Unordered tables keep their control bytes apart from the slots, so a
+// lookup compares a whole group of them against the hash at once and only
+// touches the slots whose bytes match. Capacity is a power of two, probing
+// goes from group to group.
+template<typename T, typename TraitsForT>
+class HashTable<T, TraitsForT, false> {
+    using Group = Detail::HashTableGroup;
+
+public:
+    HashTable() = default;
+    explicit HashTable(size_t capacity) { rehash(capacity_for(capacity)); }
+
+    ~HashTable()
+    {
+        if (!m_control)
+            return;
+
+        for (size_t i = 0; i < m_capacity; ++i) {
+            if (is_full(m_control[i]))
+                m_slots[i].~T();
+        }
+
+        kfree_sized(m_control, size_in_bytes(m_capacity));
+    }
+
+    HashTable(const HashTable& other)
+    {
+        if (!other.is_empty())
+            rehash(capacity_for(other.size()));
+        for (auto& it : other)
+            set(it);
+    }
+
+    HashTable& operator=(const HashTable& other)
+    {
+        HashTable temporary(other);
+        swap(*this, temporary);
+        return *this;
+    }
+
+    HashTable(HashTable&& other) noexcept
+        : m_control(other.m_control)
+        , m_slots(other.m_slots)
+        , m_size(other.m_size)
+        , m_capacity(other.m_capacity)
+        , m_deleted_count(other.m_deleted_count)
+    {
+        other.m_control = nullptr;
+        other.m_slots = nullptr;
+        other.m_size = 0;
+        other.m_capacity = 0;
+        other.m_deleted_count = 0;
+    }
+
+    HashTable& operator=(HashTable&& other) noexcept
+    {
+        HashTable temporary { move(other) };
+        swap(*this, temporary);
+        return *this;
+    }
+
+    friend void swap(HashTable& a, HashTable& b) noexcept
+    {
+        swap(a.m_control, b.m_control);
+        swap(a.m_slots, b.m_slots);
+        swap(a.m_size, b.m_size);
+        swap(a.m_capacity, b.m_capacity);
+        swap(a.m_deleted_count, b.m_deleted_count);
+    }
+
+    [[nodiscard]] bool is_empty() const { return !m_size; }
+    [[nodiscard]] size_t size() const { return m_size; }
+    [[nodiscard]] size_t capacity() const { return m_capacity; }
+
+    template<typename U, size_t N>
+    void set_from(U (&from_array)[N])
+    {
+        for (size_t i = 0; i < N; ++i) {
+            set(from_array[i]);
+        }
+    }
+
+    void ensure_capacity(size_t capacity)
+    {
+        VERIFY(capacity >= size());
+        auto new_capacity = capacity_for(capacity);
+        if (new_capacity > m_capacity)
+            rehash(new_capacity);
+    }
+
+    // Whether set() can add one more entry without allocating.
+    [[nodiscard]] bool has_room_for_one_more() const { return m_control && !should_grow(); }
+
+    bool contains(const T& value) const
+    {
+        return find(value) != end();
+    }
+
+    using Iterator = HashTableSlotIterator<HashTable, T>;
+
+    Iterator begin()
+    {
+        for (size_t i = 0; i < m_capacity; ++i) {
+            if (is_full(m_control[i]))
+                return Iterator(&m_control[i], m_control + m_capacity, &m_slots[i]);
+        }
+        return end();
+    }
+
+    Iterator end()
+    {
+        return Iterator(nullptr, nullptr, nullptr);
+    }
+
+    using ConstIterator = HashTableSlotIterator<const HashTable, const T>;
+
+    ConstIterator begin() const
+    {
+        for (size_t i = 0; i < m_capacity; ++i) {
+            if (is_full(m_control[i]))
+                return ConstIterator(&m_control[i], m_control + m_capacity, &m_slots[i]);
+        }
+        return end();
+    }
+
+    ConstIterator end() const
+    {
+        return ConstIterator(nullptr, nullptr, nullptr);
+    }
+
+    void clear()
+    {
+        *this = HashTable();
+    }
+
+    template<typename U = T>
+    HashSetResult set(U&& value, HashSetExistingEntryBehavior existing_entry_behaviour = HashSetExistingEntryBehavior::Replace)
+    {
+        auto hash = TraitsForT::hash(value);
+        if (auto* slot = lookup_with_hash(hash, [&](auto& entry) { return TraitsForT::equals(entry, value); })) {
+            if (existing_entry_behaviour == HashSetExistingEntryBehavior::Keep)
+                return HashSetResult::KeptExistingEntry;
+            (*slot) = forward<U>(value);
+            return HashSetResult::ReplacedExistingEntry;
+        }
+
+        if (should_grow())
+            grow();
+
+        auto index = find_insert_index(hash);
+        if (m_control[index] == Detail::hash_table_control_deleted)
+            --m_deleted_count;
+        m_control[index] = h2(hash);
+        new (&m_slots[index]) T(forward<U>(value));
+        ++m_size;
+        return HashSetResult::InsertedNewEntry;
+    }
+
+    template<typename TUnaryPredicate>
+    Iterator find(unsigned hash, TUnaryPredicate predicate)
+    {
+        return iterator_for(lookup_with_hash(hash, move(predicate)));
+    }
+
+    Iterator find(const T& value)
+    {
+        return find(TraitsForT::hash(value), [&](auto& other) { return TraitsForT::equals(value, other); });
+    }
+
+    template<typename TUnaryPredicate>
+    ConstIterator find(unsigned hash, TUnaryPredicate predicate) const
+    {
+        auto* slot = lookup_with_hash(hash, move(predicate));
+        if (!slot)
+            return end();
+        return ConstIterator(m_control + (slot - m_slots), m_control + m_capacity, slot);
+    }
+
+    ConstIterator find(const T& value) const
+    {
+        return find(TraitsForT::hash(value), [&](auto& other) { return TraitsForT::equals(value, other); });
+    }
+
+    bool remove(const T& value)
+    {
+        auto it = find(value);
+        if (it != end()) {
+            remove(it);
+            return true;
+        }
+        return false;
+    }
+
+    void remove(Iterator iterator)
+    {
+        VERIFY(iterator.m_slot);
+        size_t index = iterator.m_slot - m_slots;
+        VERIFY(is_full(m_control[index]));
+
+        m_slots[index].~T();
+        --m_size;
+
+        // A lookup stops at the first group with an empty byte, so if this
+        // group has one, no probe ever went past it and the slot can be
+        // empty again.
+        if (Group(m_control + (index & ~(Group::width - 1))).match_empty()) {
+            m_control[index] = Detail::hash_table_control_empty;
+        } else {
+            m_control[index] = Detail::hash_table_control_deleted;
+            ++m_deleted_count;
+        }
+    }
+
+private:
+    static bool is_full(u8 control) { return !(control & 0x80); }
+    static u8 h2(unsigned hash) { return hash & 0x7f; }
+    static size_t h1(unsigned hash) { return hash >> 7; }
+
+    static size_t capacity_for(size_t size)
+    {
+        size_t capacity = Group::width;
+        while (size * 8 > capacity * 7)
+            capacity *= 2;
+        return capacity;
+    }
+
+    static size_t slots_offset(size_t capacity)
+    {
+        return (capacity + alignof(T) - 1) & ~(alignof(T) - 1);
+    }
+
+    static size_t size_in_bytes(size_t capacity)
+    {
+        return slots_offset(capacity) + sizeof(T) * capacity;
+    }
+
+    Iterator iterator_for(T* slot)
+    {
+        if (!slot)
+            return end();
+        return Iterator(m_control + (slot - m_slots), m_control + m_capacity, slot);
+    }
+
+    void grow()
+    {
+        // Mostly tombstones, cleaning them out is enough.
+        if (m_deleted_count > m_size)
+            rehash(m_capacity);
+        else
+            rehash(m_capacity ? m_capacity * 2 : Group::width);
+    }
+
+    void rehash(size_t new_capacity)
+    {
+        VERIFY(!(new_capacity & (new_capacity - 1)));
+        VERIFY(new_capacity >= Group::width);
+
+        auto* old_control = m_control;
+        auto* old_slots = m_slots;
+        auto old_capacity = m_capacity;
+
+        m_control = (u8*)kmalloc(size_in_bytes(new_capacity));
+        m_slots = (T*)(m_control + slots_offset(new_capacity));
+        __builtin_memset(m_control, Detail::hash_table_control_empty, new_capacity);
+
+        m_capacity = new_capacity;
+        m_deleted_count = 0;
+
+        if (!old_control)
+            return;
+
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (!is_full(old_control[i]))
+                continue;
+            auto hash = TraitsForT::hash(old_slots[i]);
+            auto index = find_insert_index(hash);
+            m_control[index] = h2(hash);
+            new (&m_slots[index]) T(move(old_slots[i]));
+            old_slots[i].~T();
+        }
+
+        kfree_sized(old_control, size_in_bytes(old_capacity));
+    }
+
+    template<typename TUnaryPredicate>
+    T* lookup_with_hash(unsigned hash, TUnaryPredicate predicate) const
+    {
+        if (is_empty())
+            return nullptr;
+
+        size_t group_mask = m_capacity / Group::width - 1;
+        size_t group_index = h1(hash) & group_mask;
+        // Triangular steps, which visit every group of a power of two.
+        for (size_t step = 1;; ++step) {
+            Group group(m_control + group_index * Group::width);
+            for (auto match = group.match(h2(hash)); match; match.clear_lowest()) {
+                auto& slot = m_slots[group_index * Group::width + match.lowest()];
+                if (predicate(slot))
+                    return &slot;
+            }
+
+            if (group.match_empty())
+                return nullptr;
+
+            group_index = (group_index + step) & group_mask;
+        }
+    }
+
+    size_t find_insert_index(unsigned hash) const
+    {
+        size_t group_mask = m_capacity / Group::width - 1;
+        size_t group_index = h1(hash) & group_mask;
+        for (size_t step = 1;; ++step) {
+            auto match = Group(m_control + group_index * Group::width).match_empty_or_deleted();
+            if (match)
+                return group_index * Group::width + match.lowest();
+            group_index = (group_index + step) & group_mask;
+        }
+    }
+
+    // Deleted slots count too, at least one in eight stays empty so every
+    // probe ends.
+    [[nodiscard]] bool should_grow() const { return (m_size + m_deleted_count + 1) * 8 > m_capacity * 7; }
+
+    u8* m_control { nullptr };
+    T* m_slots { nullptr };
+    size_t m_size { 0 };
+    size_t m_capacity { 0 };
+    size_t m_deleted_count { 0 };
+};
 }
 
 using Base::HashTable;
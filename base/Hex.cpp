@@ -5,47 +5,148 @@
 */
 
 // includes
-#include <base/Array.h>
 #include <base/ByteBuffer.h>
 #include <base/Hex.h>
+#include <base/SIMD.h>
 #include <base/String.h>
-#include <base/StringBuilder.h>
 #include <base/StringView.h>
 #include <base/Types.h>
-#include <base/Vector.h>
 
 namespace Base {
 
-Optional<ByteBuffer> decode_hex(const StringView& input)
+#ifdef __SSE2__
+// Each nibble becomes '0' + nibble, plus the distance from '9' + 1 to 'a'
+// for the ones past nine. The high and low nibble characters are then
+// interleaved into the thirty-two characters of sixteen bytes.
+static size_t encode_hex_sse2(const u8* input, size_t size, u8* output)
+{
+    size_t consumed = 0;
+    for (; consumed + 16 <= size; consumed += 16) {
+        SIMD::u8x16 bytes;
+        __builtin_memcpy(&bytes, input + consumed, sizeof(bytes));
+
+        auto high = bytes >> 4;
+        auto low = bytes & 0xf;
+        high += '0' + ((SIMD::u8x16)(high > 9) & ('a' - '9' - 1));
+        low += '0' + ((SIMD::u8x16)(low > 9) & ('a' - '9' - 1));
+
+        auto first = __builtin_ia32_punpcklbw128((SIMD::c8x16)high, (SIMD::c8x16)low);
+        auto second = __builtin_ia32_punpckhbw128((SIMD::c8x16)high, (SIMD::c8x16)low);
+        __builtin_memcpy(output + consumed * 2, &first, sizeof(first));
+        __builtin_memcpy(output + consumed * 2 + 16, &second, sizeof(second));
+    }
+    return consumed;
+}
+
+// Turns sixteen characters into their nibble values, or returns false if
+// any of them isn't a hex digit.
+static bool decode_hex_digits_sse2(SIMD::u8x16 characters, SIMD::u8x16& values)
+{
+    auto digits = characters - '0';
+    // Folding to lower case doesn't turn anything else into 'a' to 'f'.
+    auto letters = (characters | 0x20) - 'a';
+    auto is_digit = (SIMD::u8x16)(digits < 10);
+    auto is_letter = (SIMD::u8x16)(letters < 6);
+    if (__builtin_ia32_pmovmskb128((SIMD::c8x16)(is_digit | is_letter)) != 0xffff)
+        return false;
+    values = (digits & is_digit) | ((letters + 10) & is_letter);
+    return true;
+}
+
+// Decodes thirty-two characters per block. Every little endian 16-bit lane
+// holds the high nibble in its low byte and the low nibble in its high
+// byte, which a shift and a saturating pack turn into one byte each.
+static Optional<size_t> decode_hex_sse2(const char* input, size_t length, u8* output)
+{
+    size_t consumed = 0;
+    for (; consumed + 32 <= length; consumed += 32) {
+        SIMD::u8x16 first;
+        SIMD::u8x16 second;
+        __builtin_memcpy(&first, input + consumed, sizeof(first));
+        __builtin_memcpy(&second, input + consumed + 16, sizeof(second));
+        if (!decode_hex_digits_sse2(first, first) || !decode_hex_digits_sse2(second, second))
+            return {};
+
+        auto first_lanes = (SIMD::u16x8)first;
+        auto second_lanes = (SIMD::u16x8)second;
+        first_lanes = ((first_lanes & 0xff) << 4) | (first_lanes >> 8);
+        second_lanes = ((second_lanes & 0xff) << 4) | (second_lanes >> 8);
+        auto bytes = __builtin_ia32_packuswb128((SIMD::i16x8)first_lanes, (SIMD::i16x8)second_lanes);
+        __builtin_memcpy(output + consumed / 2, &bytes, sizeof(bytes));
+    }
+    return consumed;
+}
+#endif
+
+Optional<size_t> decode_hex_into(const StringView& input, Bytes output)
 {
     if ((input.length() % 2) != 0)
         return {};
+    VERIFY(output.size() >= input.length() / 2);
 
-    auto output = ByteBuffer::create_zeroed(input.length() / 2);
+    auto* characters = input.characters_without_null_termination();
+    size_t i = 0;
+#ifdef __SSE2__
+    auto decoded = decode_hex_sse2(characters, input.length(), output.data());
+    if (!decoded.has_value())
+        return {};
+    i = decoded.value();
+#endif
 
-    for (size_t i = 0; i < input.length() / 2; ++i) {
-        const auto c1 = decode_hex_digit(input[i * 2]);
+    for (; i < input.length(); i += 2) {
+        const auto c1 = decode_hex_digit(characters[i]);
         if (c1 >= 16)
             return {};
 
-        const auto c2 = decode_hex_digit(input[i * 2 + 1]);
+        const auto c2 = decode_hex_digit(characters[i + 1]);
         if (c2 >= 16)
             return {};
 
-        output[i] = (c1 << 4) + c2;
+        output[i / 2] = (c1 << 4) + c2;
     }
 
+    return input.length() / 2;
+}
+
+Optional<ByteBuffer> decode_hex(const StringView& input)
+{
+    if ((input.length() % 2) != 0)
+        return {};
+
+    auto output = ByteBuffer::create_uninitialized(input.length() / 2);
+    if (!decode_hex_into(input, output.bytes()).has_value())
+        return {};
+
     return output;
 }
 
-String encode_hex(const ReadonlyBytes input)
+size_t encode_hex_into(const ReadonlyBytes input, Bytes output)
 {
-    StringBuilder output(input.size() * 2);
+    VERIFY(output.size() >= input.size() * 2);
+    constexpr char digits[] = "0123456789abcdef";
 
-    for (auto ch : input)
-        output.appendff("{:02x}", ch);
+    size_t i = 0;
+#ifdef __SSE2__
+    i = encode_hex_sse2(input.data(), input.size(), output.data());
+#endif
 
-    return output.build();
+    for (; i < input.size(); ++i) {
+        output[i * 2] = digits[input[i] >> 4];
+        output[i * 2 + 1] = digits[input[i] & 0xf];
+    }
+
+    return input.size() * 2;
+}
+
+String encode_hex(const ReadonlyBytes input)
+{
+    if (input.is_empty())
+        return String::empty();
+
+    char* buffer;
+    auto impl = StringImpl::create_uninitialized(input.size() * 2, buffer);
+    encode_hex_into(input, { reinterpret_cast<u8*>(buffer), input.size() * 2 });
+    return String(move(impl));
 }
 
-}
\ No newline at end of file
+}
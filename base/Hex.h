@@ -29,8 +29,17 @@ Optional<ByteBuffer> decode_hex(const StringView&);
 
 String encode_hex(ReadonlyBytes);
 
+// Streaming variants that write into a caller provided buffer. Decoding
+// needs half the input length and fails like decode_hex(), encoding needs
+// twice the input size. Both return how many bytes they wrote.
+Optional<size_t> decode_hex_into(const StringView&, Bytes);
+
+size_t encode_hex_into(ReadonlyBytes, Bytes);
+
 }
 
 using Base::decode_hex;
 using Base::decode_hex_digit;
-using Base::encode_hex;
\ No newline at end of file
+using Base::decode_hex_into;
+using Base::encode_hex;
+using Base::encode_hex_into;
\ No newline at end of file
@@ -8,39 +8,167 @@
 
 // includes
 #include <base/Forward.h>
-#include <base/HashTable.h>
+#include <base/NumericLimits.h>
+#include <base/Optional.h>
+#include <base/Platform.h>
+#include <base/Random.h>
+#include <base/Vector.h>
 
 namespace Base {
 
+// Hands out IDs from 1 to max_id. The allocated ones are bits of a bitmap,
+// with a summary of the words that are full, so finding a free ID looks at
+// a handful of words at most.
+//
+// LowestFree always returns the lowest ID that isn't taken, which keeps
+// them small and dense. Randomized picks one at random among the free ones
+// for IDs that shouldn't be guessable; it keeps the bitmap at least twice
+// as large as what is allocated so there is always plenty to pick from.
 class IDAllocator {
-
 public:
-    IDAllocator() = default;
+    enum class Mode {
+        LowestFree,
+        Randomized,
+    };
+
+    explicit IDAllocator(Mode mode = Mode::LowestFree, int max_id = NumericLimits<int>::max())
+        : m_mode(mode)
+        , m_max_id(max_id)
+    {
+        VERIFY(max_id > 0);
+    }
+
     ~IDAllocator() = default;
 
     int allocate()
     {
-        int r = rand();
-        for (int i = 0; i < 100000; ++i) {
-            int allocated_id = r + i;
-            if (allocated_id == 0)
-                ++allocated_id;
-            if (!m_allocated_ids.contains(allocated_id)) {
-                m_allocated_ids.set(allocated_id);
-                return allocated_id;
-            }
+        auto id = try_allocate();
+        VERIFY(id.has_value());
+        return id.value();
+    }
+
+    Optional<int> try_allocate()
+    {
+        if (m_allocated_count == (size_t)m_max_id)
+            return {};
+
+        size_t wanted_capacity = m_mode == Mode::Randomized ? (m_allocated_count + 1) * 2 : m_allocated_count + 1;
+        if (wanted_capacity > capacity())
+            grow(wanted_capacity);
+
+        size_t index;
+        if (m_mode == Mode::Randomized) {
+            index = find_free(get_random_uniform(capacity()));
+        } else {
+            index = find_free(m_first_maybe_free_word * 64);
         }
-        VERIFY_NOT_REACHED();
+
+        take(index);
+        return (int)(index + 1);
     }
 
     void deallocate(int id)
     {
-        m_allocated_ids.remove(id);
+        VERIFY(id > 0 && id <= m_max_id && (size_t)id <= capacity());
+        size_t index = id - 1;
+        size_t word_index = index / 64;
+        u64 bit = 1ull << (index % 64);
+        VERIFY(m_words[word_index] & bit);
+
+        m_words[word_index] &= ~bit;
+        m_full[word_index / 64] &= ~(1ull << (word_index % 64));
+        m_first_maybe_free_word = min(m_first_maybe_free_word, word_index);
+        --m_allocated_count;
+    }
+
+    bool is_allocated(int id) const
+    {
+        if (id <= 0 || id > m_max_id || (size_t)id > capacity())
+            return false;
+        size_t index = id - 1;
+        return m_words[index / 64] & (1ull << (index % 64));
     }
 
+    size_t allocated_count() const { return m_allocated_count; }
+
 private:
-    HashTable<int> m_allocated_ids;
+    // Every ID the bitmap covers, some of them past max_id while it isn't a
+    // multiple of 64; those are marked allocated from the start.
+    size_t capacity() const { return m_words.size() * 64; }
+
+    void grow(size_t wanted_capacity)
+    {
+        size_t word_count = max<size_t>(m_words.size() * 2, 1);
+        while (word_count * 64 < wanted_capacity)
+            word_count *= 2;
+
+        size_t max_word_count = ceil_div((size_t)m_max_id, (size_t)64);
+        word_count = min(word_count, max_word_count);
+
+        size_t previous_word_count = m_words.size();
+        m_words.resize(word_count);
+        m_full.resize(ceil_div(word_count, (size_t)64));
+
+        // The IDs past max_id in the last word are never handed out.
+        if (word_count == max_word_count && m_max_id % 64) {
+            m_words[word_count - 1] |= ~0ull << (m_max_id % 64);
+            if (m_words[word_count - 1] == ~0ull)
+                m_full[(word_count - 1) / 64] |= 1ull << ((word_count - 1) % 64);
+        }
+
+        if (m_mode == Mode::LowestFree)
+            m_first_maybe_free_word = min(m_first_maybe_free_word, previous_word_count);
+    }
+
+    // The first free index at or after start, wrapping around at the end.
+    // There is always one since the caller grew the bitmap as needed.
+    size_t find_free(size_t start) const
+    {
+        size_t word_count = m_words.size();
+        size_t word_index = start / 64;
+        u64 word = ~m_words[word_index] & (~0ull << (start % 64));
+        if (word)
+            return word_index * 64 + count_trailing_zeroes_64(word);
+
+        // One summary word covers 64 words. Going once around all of them
+        // comes back to the start word, whose lower part is then looked at.
+        size_t next = word_index + 1;
+        for (size_t i = 0; i <= m_full.size(); ++i) {
+            if (next >= word_count)
+                next = 0;
+            u64 not_full = ~m_full[next / 64] & (~0ull << (next % 64));
+            if (not_full) {
+                size_t free_word = (next / 64) * 64 + count_trailing_zeroes_64(not_full);
+                if (free_word < word_count)
+                    return free_word * 64 + count_trailing_zeroes_64(~m_words[free_word]);
+            }
+            next = (next / 64 + 1) * 64;
+        }
+
+        VERIFY_NOT_REACHED();
+    }
+
+    void take(size_t index)
+    {
+        size_t word_index = index / 64;
+        m_words[word_index] |= 1ull << (index % 64);
+        if (m_words[word_index] == ~0ull) {
+            m_full[word_index / 64] |= 1ull << (word_index % 64);
+            if (word_index == m_first_maybe_free_word)
+                ++m_first_maybe_free_word;
+        }
+        ++m_allocated_count;
+    }
+
+    Mode m_mode;
+    int m_max_id;
+    size_t m_allocated_count { 0 };
+    // Every word before this one is full.
+    size_t m_first_maybe_free_word { 0 };
+    Vector<u64> m_words;
+    Vector<u64> m_full;
 };
+
 }
 
-using Base::IDAllocator;
\ No newline at end of file
+using Base::IDAllocator;
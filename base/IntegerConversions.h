@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Assertions.h>
+#include <base/NumericLimits.h>
+#include <base/Types.h>
+
+namespace Base {
+
+namespace Detail {
+
+// "00" to "99", so decimal digits go out two at a time.
+inline constexpr char decimal_digit_pairs[201] = "00010203040506070809"
+                                                 "10111213141516171819"
+                                                 "20212223242526272829"
+                                                 "30313233343536373839"
+                                                 "40414243444546474849"
+                                                 "50515253545556575859"
+                                                 "60616263646566676869"
+                                                 "70717273747576777879"
+                                                 "80818283848586878889"
+                                                 "90919293949596979899";
+
+inline constexpr u64 powers_of_ten[20] = {
+    1ull,
+    10ull,
+    100ull,
+    1000ull,
+    10000ull,
+    100000ull,
+    1000000ull,
+    10000000ull,
+    100000000ull,
+    1000000000ull,
+    10000000000ull,
+    100000000000ull,
+    1000000000000ull,
+    10000000000000ull,
+    100000000000000ull,
+    1000000000000000ull,
+    10000000000000000ull,
+    100000000000000000ull,
+    1000000000000000000ull,
+    10000000000000000000ull,
+};
+
+inline constexpr char lowercase_digits[] = "0123456789abcdef";
+inline constexpr char uppercase_digits[] = "0123456789ABCDEF";
+
+constexpr size_t significant_bits(u64 value)
+{
+    return 64 - __builtin_clzll(value | 1);
+}
+
+}
+
+// As many digits as the longest u64 takes in any base there is a digit
+// for, which is 64 in base 2.
+static constexpr size_t max_digits_of_u64 = 64;
+
+// How many digits value has, at least one for zero. The bit count is
+// close enough to the decimal count that one comparison settles it.
+constexpr size_t count_decimal_digits(u64 value)
+{
+    size_t guess = (Detail::significant_bits(value) * 1233) >> 12;
+    return guess + (value >= Detail::powers_of_ten[guess]) + (value == 0);
+}
+
+constexpr size_t count_hex_digits(u64 value)
+{
+    return (Detail::significant_bits(value) + 3) / 4;
+}
+
+// Fills buffer[0, digits) with value, the last digit first, filling up
+// with leading zeros. digits must be count_decimal_digits(value) or more.
+constexpr void write_decimal_digits(u64 value, char* buffer, size_t digits)
+{
+    char* out = buffer + digits;
+    while (value >= 100) {
+        size_t pair = (value % 100) * 2;
+        value /= 100;
+        out -= 2;
+        out[0] = Detail::decimal_digit_pairs[pair];
+        out[1] = Detail::decimal_digit_pairs[pair + 1];
+    }
+    if (value >= 10) {
+        out -= 2;
+        out[0] = Detail::decimal_digit_pairs[value * 2];
+        out[1] = Detail::decimal_digit_pairs[value * 2 + 1];
+    } else {
+        *--out = '0' + value;
+    }
+    VERIFY(out >= buffer);
+    while (out > buffer)
+        *--out = '0';
+}
+
+constexpr void write_hex_digits(u64 value, char* buffer, size_t digits, bool upper_case)
+{
+    const char* lookup = upper_case ? Detail::uppercase_digits : Detail::lowercase_digits;
+    for (size_t i = digits; i > 0; --i) {
+        buffer[i - 1] = lookup[value & 0xf];
+        value >>= 4;
+    }
+}
+
+// Writes the digits of value in base to buffer, which has room for
+// max_digits_of_u64 of them. Returns how many there are.
+constexpr size_t convert_unsigned_to_digits(u64 value, char* buffer, u8 base, bool upper_case)
+{
+    VERIFY(base >= 2 && base <= 16);
+
+    if (base == 10) {
+        size_t digits = count_decimal_digits(value);
+        write_decimal_digits(value, buffer, digits);
+        return digits;
+    }
+    if (base == 16) {
+        size_t digits = count_hex_digits(value);
+        write_hex_digits(value, buffer, digits, upper_case);
+        return digits;
+    }
+
+    const char* lookup = upper_case ? Detail::uppercase_digits : Detail::lowercase_digits;
+    size_t digits = 1;
+    for (u64 rest = value / base; rest; rest /= base)
+        ++digits;
+    for (size_t i = digits; i > 0; --i) {
+        buffer[i - 1] = lookup[value % base];
+        value /= base;
+    }
+    return digits;
+}
+
+// The value of a hex digit, or 0xff if c isn't one.
+constexpr u8 hex_digit_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return 10 + (c - 'a');
+    if (c >= 'A' && c <= 'F')
+        return 10 + (c - 'A');
+    return 0xff;
+}
+
+// How many decimal digits always fit into a T, so parsing that many needs
+// no overflow checks.
+template<typename T>
+inline constexpr size_t decimal_digits_without_overflow = count_decimal_digits(NumericLimits<T>::max()) - 1;
+
+}
+
+using Base::convert_unsigned_to_digits;
+using Base::count_decimal_digits;
+using Base::count_hex_digits;
+using Base::max_digits_of_u64;
+using Base::write_decimal_digits;
+using Base::write_hex_digits;
@@ -50,6 +50,20 @@ public:
         node.m_in_tree = true;
     }
 
+    // Replaces the contents with count values in O(count). next() is called
+    // count times and must return the values in ascending key order.
+    template<typename Callback>
+    void build_from_sorted(size_t count, Callback next)
+    {
+        clear();
+        this->link_sorted(count, [&]() -> typename BaseTree::Node* {
+            auto& node = next().*member;
+            VERIFY(!node.m_in_tree);
+            node.m_in_tree = true;
+            return &node;
+        });
+    }
+
     template<typename ElementType>
     class BaseIterator {
     public:
@@ -98,13 +112,13 @@ public:
 
     using Iterator = BaseIterator<V>;
     Iterator begin() { return Iterator(static_cast<TreeNode*>(this->m_minimum)); }
-    Iterator end() { return {}; }
+    Iterator end() { return Iterator(nullptr, static_cast<TreeNode*>(this->m_maximum)); }
     Iterator begin_from(K key) { return Iterator(static_cast<TreeNode*>(BaseTree::find(this->m_root, key))); }
 
     using ConstIterator = BaseIterator<const V>;
     ConstIterator begin() const { return ConstIterator(static_cast<TreeNode*>(this->m_minimum)); }
-    ConstIterator end() const { return {}; }
-    ConstIterator begin_from(K key) const { return ConstIterator(static_cast<TreeNode*>(BaseTree::find(this->m_rootF, key))); }
+    ConstIterator end() const { return ConstIterator(nullptr, static_cast<TreeNode*>(this->m_maximum)); }
+    ConstIterator begin_from(K key) const { return ConstIterator(static_cast<TreeNode*>(BaseTree::find(this->m_root, key))); }
 
     bool remove(K key)
     {
@@ -126,6 +140,7 @@ public:
         clear_nodes(static_cast<TreeNode*>(this->m_root));
         this->m_root = nullptr;
         this->m_minimum = nullptr;
+        this->m_maximum = nullptr;
         this->m_size = 0;
     }
 
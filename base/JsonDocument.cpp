@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/HashMap.h>
+#include <base/JsonDocument.h>
+
+namespace Base {
+
+OwnPtr<JsonDocument> JsonDocument::parse(const StringView& input)
+{
+    auto document = adopt_own_if_nonnull(new (nothrow) JsonDocument);
+    if (!document || !document->build(input))
+        return {};
+    return document;
+}
+
+StringView JsonDocument::unescape(const JsonPullParser::Token& token)
+{
+    if (!token.has_escapes)
+        return token.text;
+    auto* buffer = m_arena.allocate_array<char>(token.text.length());
+    auto length = JsonPullParser::unescape_into(token.text, buffer);
+    return { buffer, length };
+}
+
+bool JsonDocument::build(const StringView& input)
+{
+    using TokenType = JsonPullParser::TokenType;
+
+    struct OpenContainer {
+        JsonNode* node;
+        JsonNode* last_child;
+    };
+
+    auto structural_index = JsonStructuralIndex::create(input);
+    JsonPullParser parser(input, structural_index.has_value() ? &structural_index.value() : nullptr);
+    Vector<OpenContainer, 32> open_containers;
+    HashMap<StringView, StringView> escaped_keys;
+    StringView key;
+
+    for (;;) {
+        auto token = parser.next();
+        switch (token.type) {
+        case TokenType::Error:
+            return false;
+        case TokenType::End:
+            return m_root != nullptr;
+        case TokenType::Key:
+            if (token.has_escapes) {
+                auto it = escaped_keys.find(token.text);
+                if (it == escaped_keys.end()) {
+                    key = unescape(token);
+                    escaped_keys.set(token.text, key);
+                } else {
+                    key = it->value;
+                }
+            } else {
+                key = token.text;
+            }
+            continue;
+        case TokenType::ObjectEnd:
+        case TokenType::ArrayEnd:
+            open_containers.take_last();
+            continue;
+        default:
+            break;
+        }
+
+        auto& node = m_arena.make<JsonNode>();
+        switch (token.type) {
+        case TokenType::ObjectStart:
+            node.type = JsonNode::Type::Object;
+            break;
+        case TokenType::ArrayStart:
+            node.type = JsonNode::Type::Array;
+            break;
+        case TokenType::String:
+            node.type = JsonNode::Type::String;
+            node.text = unescape(token);
+            break;
+        case TokenType::Number:
+            node.type = JsonNode::Type::Number;
+            node.text = token.text;
+            break;
+        case TokenType::True:
+        case TokenType::False:
+            node.type = JsonNode::Type::Boolean;
+            node.boolean = token.type == TokenType::True;
+            break;
+        default:
+            break;
+        }
+
+        node.key = key;
+        key = {};
+        if (open_containers.is_empty()) {
+            m_root = &node;
+        } else {
+            auto& parent = open_containers.last();
+            if (parent.last_child)
+                parent.last_child->next_sibling = &node;
+            else
+                parent.node->first_child = &node;
+            parent.last_child = &node;
+            parent.node->child_count++;
+        }
+        if (node.is_object() || node.is_array())
+            open_containers.append({ &node, nullptr });
+    }
+}
+
+}
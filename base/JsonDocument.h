@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Arena.h>
+#include <base/FloatingPointStringConversions.h>
+#include <base/JsonPullParser.h>
+#include <base/OwnPtr.h>
+
+namespace Base {
+
+// One value of a JsonDocument. Nodes live in the document's arena and
+// link to their children, nothing in them is reference counted.
+struct JsonNode {
+    enum class Type : u8 {
+        Null,
+        Boolean,
+        Number,
+        String,
+        Array,
+        Object,
+    };
+
+    Type type { Type::Null };
+    bool boolean { false };
+    // Set for the members of an object.
+    StringView key;
+    // Strings unescaped, numbers as written.
+    StringView text;
+    JsonNode* first_child { nullptr };
+    JsonNode* next_sibling { nullptr };
+    size_t child_count { 0 };
+
+    bool is_null() const { return type == Type::Null; }
+    bool is_boolean() const { return type == Type::Boolean; }
+    bool is_number() const { return type == Type::Number; }
+    bool is_string() const { return type == Type::String; }
+    bool is_array() const { return type == Type::Array; }
+    bool is_object() const { return type == Type::Object; }
+
+    Optional<i64> to_i64() const { return is_number() ? text.to_int<i64>() : Optional<i64> {}; }
+    Optional<u64> to_u64() const { return is_number() ? text.to_uint<u64>() : Optional<u64> {}; }
+#ifndef KERNEL
+    Optional<double> to_double() const { return is_number() ? parse_double(text) : Optional<double> {}; }
+#endif
+
+    const JsonNode* get(const StringView& member_key) const
+    {
+        for (auto* child = first_child; child; child = child->next_sibling) {
+            if (child->key == member_key)
+                return child;
+        }
+        return nullptr;
+    }
+
+    // Members of an object or elements of an array, in document order.
+    template<typename Callback>
+    void for_each_child(Callback callback) const
+    {
+        for (auto* child = first_child; child; child = child->next_sibling)
+            callback(*child);
+    }
+};
+
+// A parsed document whose nodes all live in one arena. Strings and numbers
+// without escapes point straight into the input, which therefore has to
+// outlive the document; only escaped ones are copied, and every distinct
+// escaped key is unescaped once however often it repeats.
+class JsonDocument {
+    BASE_MAKE_NONCOPYABLE(JsonDocument);
+    BASE_MAKE_NONMOVABLE(JsonDocument);
+
+public:
+    static OwnPtr<JsonDocument> parse(const StringView& input);
+
+    const JsonNode& root() const { return *m_root; }
+    size_t allocated_bytes() const { return m_arena.allocated_bytes(); }
+
+private:
+    JsonDocument() = default;
+
+    bool build(const StringView& input);
+    StringView unescape(const JsonPullParser::Token&);
+
+    Arena m_arena;
+    JsonNode* m_root { nullptr };
+};
+
+}
+
+using Base::JsonDocument;
+using Base::JsonNode;
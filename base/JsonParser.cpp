@@ -6,6 +6,7 @@
 
 // includes
 #include <base/CharacterTypes.h>
+#include <base/FloatingPointStringConversions.h>
 #include <base/JsonArray.h>
 #include <base/JsonObject.h>
 #include <base/JsonParser.h>
@@ -19,6 +20,17 @@ constexpr bool is_space(int ch)
 
 String JsonParser::consume_and_unescape_string()
 {
+    // Strings without escapes are taken as they are, escaped ones still
+    // go through the loop below.
+    if (m_structural_index.has_value() && next_is('"')) {
+        auto string = m_structural_index->find_string(m_index, m_structural_cursor);
+        if (string.has_value() && !string->has_escapes) {
+            auto text = m_input.substring_view(m_index + 1, string->closing_quote - m_index - 1);
+            m_index = string->closing_quote + 1;
+            return text;
+        }
+    }
+
     if (!consume_specific('"'))
         return {};
     StringBuilder final_sb;
@@ -196,8 +208,9 @@ Optional<JsonValue> JsonParser::parse_number()
 {
     JsonValue value;
     Vector<char, 128> number_buffer;
-    Vector<char, 128> fraction_buffer;
 
+    size_t start = m_index;
+    size_t fraction_digits = 0;
     bool is_double = false;
     for (;;) {
         char ch = peek();
@@ -214,7 +227,7 @@ Optional<JsonValue> JsonParser::parse_number()
                 if (ch == '-')
                     return {};
 
-                fraction_buffer.append(ch);
+                ++fraction_digits;
             } else {
                 if (number_buffer.size() > 0) {
                     if (number_buffer.at(0) == '0')
@@ -234,33 +247,28 @@ Optional<JsonValue> JsonParser::parse_number()
         break;
     }
 
+    if (is_double && !fraction_digits)
+        return {};
+
+#ifndef KERNEL
+    if (next_is('e') || next_is('E')) {
+        is_double = true;
+        ++m_index;
+        if (next_is('+') || next_is('-'))
+            ++m_index;
+        ignore_while(is_ascii_digit);
+    }
+#endif
+
     StringView number_string(number_buffer.data(), number_buffer.size());
-    StringView fraction_string(fraction_buffer.data(), fraction_buffer.size());
 
 #ifndef KERNEL
     if (is_double) {
-        int whole = 0;
-        auto to_signed_result = number_string.to_uint();
-        if (to_signed_result.has_value()) {
-            whole = to_signed_result.value();
-        } else {
-            auto number = number_string.to_int();
-            if (!number.has_value())
-                return {};
-            whole = number.value();
-        }
-
-        auto fraction_string_uint = fraction_string.to_uint();
-        if (!fraction_string_uint.has_value())
+        // parse_double() checks the whole number text, exponent included.
+        auto number = parse_double(m_input.substring_view(start, m_index - start));
+        if (!number.has_value())
             return {};
-        int fraction = fraction_string_uint.value();
-        fraction *= (whole < 0) ? -1 : 1;
-
-        auto divider = 1;
-        for (size_t i = 0; i < fraction_buffer.size(); ++i) {
-            divider *= 10;
-        }
-        value = JsonValue((double)whole + ((double)fraction / divider));
+        value = JsonValue(number.value());
     } else {
 #endif
         auto to_unsigned_result = number_string.to_uint<u64>();
@@ -344,6 +352,7 @@ Optional<JsonValue> JsonParser::parse_helper()
 
 Optional<JsonValue> JsonParser::parse()
 {
+    m_structural_index = JsonStructuralIndex::create(m_input);
     auto result = parse_helper();
     if (!result.has_value())
         return {};
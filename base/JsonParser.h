@@ -8,6 +8,7 @@
 
 // includes
 #include <base/GenericLexer.h>
+#include <base/JsonStructuralIndex.h>
 #include <base/JsonValue.h>
 
 namespace Base {
@@ -34,6 +35,8 @@ private:
     Optional<JsonValue> parse_null();
 
     String m_last_string_starting_with_character[256];
+    Optional<JsonStructuralIndex> m_structural_index;
+    size_t m_structural_cursor { 0 };
 };
 
 }
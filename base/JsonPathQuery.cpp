@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/JsonPathQuery.h>
+#include <base/JsonValue.h>
+#include <base/Platform.h>
+
+namespace Base {
+
+JsonPathQuery::JsonPathQuery(const JsonPath& path)
+    : JsonPathQuery(Vector<JsonPath> { path })
+{
+}
+
+JsonPathQuery::JsonPathQuery(const Vector<JsonPath>& paths)
+    : m_paths(paths)
+{
+    VERIFY(m_paths.size() <= max_paths);
+
+    size_t longest = 0;
+    for (auto& path : m_paths)
+        longest = max(longest, path.size());
+    m_ending_at.resize(longest + 1);
+    m_longer_than.resize(longest + 1);
+
+    for (size_t i = 0; i < m_paths.size(); ++i) {
+        u64 bit = 1ull << i;
+        auto& path = m_paths[i];
+        m_all_paths |= bit;
+        m_ending_at[path.size()] |= bit;
+        for (size_t depth = 0; depth < path.size(); ++depth) {
+            m_longer_than[depth] |= bit;
+            auto kind = path[depth].kind();
+            if (kind == JsonPathElement::Kind::AnyKey || kind == JsonPathElement::Kind::AnyIndex)
+                m_wildcard_paths |= bit;
+        }
+    }
+}
+
+Optional<JsonValue> JsonPathQuery::Match::to_value() const
+{
+    if (type == JsonPullParser::TokenType::String)
+        return JsonValue(JsonPullParser::unescape({ type, text, has_escapes }));
+    return JsonValue::from_string(text);
+}
+
+static bool element_matches(const JsonPathElement& element, bool in_object, const StringView& key, size_t index)
+{
+    switch (element.kind()) {
+    case JsonPathElement::Kind::Key:
+        return in_object && element.key() == key;
+    case JsonPathElement::Kind::AnyKey:
+        return in_object;
+    case JsonPathElement::Kind::Index:
+        return !in_object && element.index() == index;
+    case JsonPathElement::Kind::AnyIndex:
+        return !in_object;
+    }
+    VERIFY_NOT_REACHED();
+}
+
+bool JsonPathQuery::run(const StringView& input, Function<IterationDecision(const Match&)> callback, const JsonStructuralIndex* structural_index) const
+{
+    using TokenType = JsonPullParser::TokenType;
+
+    // An object or array some path ends at or goes into. Those no path
+    // cares about never get one.
+    struct Container {
+        u64 ending { 0 };
+        u64 continuing { 0 };
+        size_t start { 0 };
+        size_t next_index { 0 };
+        bool is_object { false };
+    };
+
+    JsonPullParser parser(input, structural_index);
+    Vector<Container, 16> containers;
+    u64 pending = m_all_paths;
+    JsonPullParser::Token key;
+    Vector<char, 128> key_buffer;
+
+    // Whether to carry on reading.
+    auto yield = [&](u64 paths, TokenType type, const StringView& text, bool has_escapes) {
+        for (paths &= pending; paths; paths &= paths - 1) {
+            size_t path_index = count_trailing_zeroes_64(paths);
+            if (!(m_wildcard_paths & (1ull << path_index)))
+                pending &= ~(1ull << path_index);
+            if (callback({ path_index, type, text, has_escapes }) == IterationDecision::Break)
+                return false;
+        }
+        return pending != 0;
+    };
+
+    for (;;) {
+        auto token = parser.next();
+        switch (token.type) {
+        case TokenType::Error:
+            return false;
+        case TokenType::End:
+            return true;
+        case TokenType::Key:
+            key = token;
+            continue;
+        case TokenType::ObjectEnd:
+        case TokenType::ArrayEnd: {
+            auto container = containers.take_last();
+            auto type = container.is_object ? TokenType::ObjectStart : TokenType::ArrayStart;
+            if (!yield(container.ending, type, input.substring_view(container.start, parser.offset() - container.start), false))
+                return true;
+            continue;
+        }
+        default:
+            break;
+        }
+
+        // A value, at the depth of the containers around it.
+        size_t depth = containers.size();
+        u64 candidates = 0;
+        if (containers.is_empty()) {
+            candidates = pending;
+        } else {
+            auto& parent = containers.last();
+            size_t index = parent.next_index++;
+            u64 parent_paths = parent.continuing & pending;
+            if (parent_paths) {
+                StringView key_text = key.text;
+                if (parent.is_object && key.has_escapes) {
+                    key_buffer.resize(key.text.length());
+                    key_text = { key_buffer.data(), JsonPullParser::unescape_into(key.text, key_buffer.data()) };
+                }
+                for (u64 paths = parent_paths; paths; paths &= paths - 1) {
+                    size_t path_index = count_trailing_zeroes_64(paths);
+                    if (element_matches(m_paths[path_index][depth - 1], parent.is_object, key_text, index))
+                        candidates |= 1ull << path_index;
+                }
+            }
+        }
+
+        u64 ending = depth < m_ending_at.size() ? candidates & m_ending_at[depth] : 0;
+        u64 continuing = depth < m_longer_than.size() ? candidates & m_longer_than[depth] : 0;
+
+        if (token.type == TokenType::ObjectStart || token.type == TokenType::ArrayStart) {
+            if (ending || continuing) {
+                containers.append({ ending, continuing, parser.offset() - 1, 0, token.type == TokenType::ObjectStart });
+                continue;
+            }
+            // Nothing in here can match, so it is only read past.
+            while (parser.depth() > depth) {
+                if (parser.next().type == TokenType::Error)
+                    return false;
+            }
+            continue;
+        }
+
+        if (!ending)
+            continue;
+        StringView text = token.text;
+        switch (token.type) {
+        case TokenType::True:
+            text = input.substring_view(parser.offset() - 4, 4);
+            break;
+        case TokenType::False:
+            text = input.substring_view(parser.offset() - 5, 5);
+            break;
+        case TokenType::Null:
+            text = input.substring_view(parser.offset() - 4, 4);
+            break;
+        default:
+            break;
+        }
+        if (!yield(ending, token.type, text, token.has_escapes))
+            return true;
+    }
+}
+
+}
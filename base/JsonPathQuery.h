@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Function.h>
+#include <base/IterationDecision.h>
+#include <base/JsonPath.h>
+#include <base/JsonPullParser.h>
+#include <base/Optional.h>
+
+namespace Base {
+
+// JsonPaths compiled to run over the text of a document with a
+// JsonPullParser, instead of resolving against a parsed JsonValue. Values
+// none of the paths lead into are skipped token by token without building
+// anything, and once every path without a wildcard has matched, the rest
+// of the input isn't read at all.
+//
+// A path without a wildcard matches at most once, at the first value it
+// leads to; JsonPath::resolve() would take the last one of duplicate keys.
+class JsonPathQuery {
+public:
+    static constexpr size_t max_paths = 64;
+
+    explicit JsonPathQuery(const JsonPath&);
+    explicit JsonPathQuery(const Vector<JsonPath>&);
+
+    struct Match {
+        // Which path matched, in the order they were given.
+        size_t path_index { 0 };
+        // ObjectStart or ArrayStart for objects and arrays.
+        JsonPullParser::TokenType type { JsonPullParser::TokenType::Null };
+        // Strings as in a token, without their quotes and still escaped.
+        // Anything else as written, objects and arrays in full.
+        StringView text;
+        bool has_escapes { false };
+
+        // Parses or unescapes the text, only what was matched.
+        Optional<JsonValue> to_value() const;
+    };
+
+    // Calls the callback with every match, in the order the values end in
+    // the input, until it returns IterationDecision::Break. Returns false
+    // if the input turned out not to be JSON before the query was done.
+    bool run(const StringView& input, Function<IterationDecision(const Match&)> callback, const JsonStructuralIndex* = nullptr) const;
+
+private:
+    Vector<JsonPath> m_paths;
+    // Per depth, the paths that end there and the ones that go deeper.
+    Vector<u64> m_ending_at;
+    Vector<u64> m_longer_than;
+    // Paths with a wildcard, which go on matching until the end.
+    u64 m_wildcard_paths { 0 };
+    u64 m_all_paths { 0 };
+};
+
+}
+
+using Base::JsonPathQuery;
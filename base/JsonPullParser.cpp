@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/CharacterTypes.h>
+#include <base/JsonPullParser.h>
+
+namespace Base {
+
+static constexpr bool is_space(int ch)
+{
+    return ch == '\t' || ch == '\n' || ch == '\r' || ch == ' ';
+}
+
+static constexpr bool is_digit(int ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+static bool has_valid_escapes(const StringView& text)
+{
+    for (size_t i = 0; i < text.length(); ++i) {
+        if (text[i] != '\\')
+            continue;
+        if (++i == text.length())
+            return false;
+        switch (text[i]) {
+        case '"':
+        case '\\':
+        case '/':
+        case 'b':
+        case 'f':
+        case 'n':
+        case 'r':
+        case 't':
+            break;
+        case 'u':
+            if (text.length() - i <= 4)
+                return false;
+            for (size_t digit = 0; digit < 4; ++digit) {
+                if (!is_ascii_hex_digit(text[++i]))
+                    return false;
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+JsonPullParser::Token JsonPullParser::fail()
+{
+    m_failed = true;
+    return { TokenType::Error, {}, false };
+}
+
+JsonPullParser::Token JsonPullParser::next()
+{
+    if (m_failed)
+        return fail();
+
+    ignore_while(is_space);
+    switch (m_expect) {
+    case Expect::Done:
+        if (!is_eof())
+            return fail();
+        return { TokenType::End, {}, false };
+    case Expect::CommaOrEnd:
+        if (next_is(m_containers.last() ? '}' : ']'))
+            return close_container();
+        if (!consume_specific(','))
+            return fail();
+        ignore_while(is_space);
+        if (m_containers.last())
+            return lex_key();
+        return lex_value();
+    case Expect::FirstKeyOrObjectEnd:
+        if (next_is('}'))
+            return close_container();
+        return lex_key();
+    case Expect::FirstValueOrArrayEnd:
+        if (next_is(']'))
+            return close_container();
+        return lex_value();
+    case Expect::Key:
+        return lex_key();
+    case Expect::Value:
+        return lex_value();
+    }
+    VERIFY_NOT_REACHED();
+}
+
+void JsonPullParser::finish_value()
+{
+    m_expect = m_containers.is_empty() ? Expect::Done : Expect::CommaOrEnd;
+}
+
+JsonPullParser::Token JsonPullParser::open_container(bool is_object)
+{
+    if (m_containers.size() == max_depth)
+        return fail();
+    ignore();
+    m_containers.append(is_object);
+    m_expect = is_object ? Expect::FirstKeyOrObjectEnd : Expect::FirstValueOrArrayEnd;
+    return { is_object ? TokenType::ObjectStart : TokenType::ArrayStart, {}, false };
+}
+
+JsonPullParser::Token JsonPullParser::close_container()
+{
+    ignore();
+    bool is_object = m_containers.take_last();
+    finish_value();
+    return { is_object ? TokenType::ObjectEnd : TokenType::ArrayEnd, {}, false };
+}
+
+JsonPullParser::Token JsonPullParser::lex_key()
+{
+    if (!next_is('"'))
+        return fail();
+    auto token = lex_string(TokenType::Key);
+    if (token.type == TokenType::Error)
+        return token;
+    ignore_while(is_space);
+    if (!consume_specific(':'))
+        return fail();
+    m_expect = Expect::Value;
+    return token;
+}
+
+JsonPullParser::Token JsonPullParser::lex_value()
+{
+    switch (peek()) {
+    case '{':
+        return open_container(true);
+    case '[':
+        return open_container(false);
+    case '"': {
+        auto token = lex_string(TokenType::String);
+        if (token.type != TokenType::Error)
+            finish_value();
+        return token;
+    }
+    case '-':
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+        return lex_number();
+    case 'f':
+        return lex_literal("false", TokenType::False);
+    case 't':
+        return lex_literal("true", TokenType::True);
+    case 'n':
+        return lex_literal("null", TokenType::Null);
+    }
+    return fail();
+}
+
+JsonPullParser::Token JsonPullParser::lex_string(TokenType type)
+{
+    if (m_structural_index) {
+        if (auto string = m_structural_index->find_string(m_index, m_structural_cursor); string.has_value()) {
+            size_t start = m_index + 1;
+            m_index = string->closing_quote + 1;
+            auto text = m_input.substring_view(start, string->closing_quote - start);
+            if (string->has_escapes && !has_valid_escapes(text))
+                return fail();
+            return { type, text, string->has_escapes };
+        }
+    }
+
+    ignore();
+    size_t start = m_index;
+    bool has_escapes = false;
+    for (;;) {
+        if (is_eof())
+            return fail();
+        char ch = consume();
+        if (ch == '"')
+            break;
+        if (is_ascii_c0_control(ch))
+            return fail();
+        if (ch != '\\')
+            continue;
+
+        has_escapes = true;
+        if (is_eof())
+            return fail();
+        switch (consume()) {
+        case '"':
+        case '\\':
+        case '/':
+        case 'b':
+        case 'f':
+        case 'n':
+        case 'r':
+        case 't':
+            break;
+        case 'u':
+            for (size_t i = 0; i < 4; ++i) {
+                if (!is_ascii_hex_digit(peek()))
+                    return fail();
+                ignore();
+            }
+            break;
+        default:
+            return fail();
+        }
+    }
+    return { type, m_input.substring_view(start, m_index - start - 1), has_escapes };
+}
+
+JsonPullParser::Token JsonPullParser::lex_number()
+{
+    size_t start = m_index;
+    consume_specific('-');
+    if (next_is('0'))
+        ignore();
+    else if (next_is(is_digit))
+        ignore_while(is_digit);
+    else
+        return fail();
+
+    if (consume_specific('.')) {
+        if (!next_is(is_digit))
+            return fail();
+        ignore_while(is_digit);
+    }
+
+    if (consume_specific('e') || consume_specific('E')) {
+        if (!consume_specific('+'))
+            consume_specific('-');
+        if (!next_is(is_digit))
+            return fail();
+        ignore_while(is_digit);
+    }
+
+    finish_value();
+    return { TokenType::Number, m_input.substring_view(start, m_index - start), false };
+}
+
+JsonPullParser::Token JsonPullParser::lex_literal(const char* literal, TokenType type)
+{
+    if (!consume_specific(literal))
+        return fail();
+    finish_value();
+    return { type, {}, false };
+}
+
+size_t JsonPullParser::unescape_into(const StringView& text, char* buffer)
+{
+    size_t length = 0;
+    for (size_t i = 0; i < text.length(); ++i) {
+        char ch = text[i];
+        if (ch != '\\') {
+            buffer[length++] = ch;
+            continue;
+        }
+
+        switch (ch = text[++i]) {
+        case 'b':
+            buffer[length++] = '\b';
+            break;
+        case 'f':
+            buffer[length++] = '\f';
+            break;
+        case 'n':
+            buffer[length++] = '\n';
+            break;
+        case 'r':
+            buffer[length++] = '\r';
+            break;
+        case 't':
+            buffer[length++] = '\t';
+            break;
+        case 'u': {
+            // Six bytes of escape never become more than three of UTF-8.
+            u32 code_point = 0;
+            for (size_t digit = 0; digit < 4; ++digit)
+                code_point = code_point * 16 + parse_ascii_hex_digit(text[++i]);
+            if (code_point < 0x80) {
+                buffer[length++] = code_point;
+            } else if (code_point < 0x800) {
+                buffer[length++] = 0xc0 | (code_point >> 6);
+                buffer[length++] = 0x80 | (code_point & 0x3f);
+            } else {
+                buffer[length++] = 0xe0 | (code_point >> 12);
+                buffer[length++] = 0x80 | ((code_point >> 6) & 0x3f);
+                buffer[length++] = 0x80 | (code_point & 0x3f);
+            }
+            break;
+        }
+        default:
+            buffer[length++] = ch;
+            break;
+        }
+    }
+    return length;
+}
+
+String JsonPullParser::unescape(const Token& token)
+{
+    if (!token.has_escapes)
+        return token.text;
+
+    Vector<char, 128> buffer;
+    buffer.resize(token.text.length());
+    auto length = unescape_into(token.text, buffer.data());
+    return String(buffer.data(), length);
+}
+
+}
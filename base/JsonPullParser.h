@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/GenericLexer.h>
+#include <base/JsonStructuralIndex.h>
+#include <base/String.h>
+#include <base/Vector.h>
+
+namespace Base {
+
+// Streaming JSON parser: next() hands out one token at a time and builds
+// nothing. Token text points into the input, keys and strings still have
+// their escapes, which unescape() resolves for the ones that matter.
+// After an Error or the End of the document, next() keeps returning it.
+class JsonPullParser : private GenericLexer {
+public:
+    static constexpr size_t max_depth = 1024;
+
+    enum class TokenType {
+        ObjectStart,
+        ObjectEnd,
+        ArrayStart,
+        ArrayEnd,
+        Key,
+        String,
+        Number,
+        True,
+        False,
+        Null,
+        End,
+        Error,
+    };
+
+    struct Token {
+        TokenType type { TokenType::Error };
+        // Keys and strings without their quotes, numbers as written.
+        StringView text;
+        bool has_escapes { false };
+    };
+
+    // With a structural index of the input, strings are skipped over in
+    // one go instead of byte by byte.
+    explicit JsonPullParser(const StringView& input, const JsonStructuralIndex* structural_index = nullptr)
+        : GenericLexer(input)
+        , m_structural_index(structural_index)
+    {
+    }
+
+    Token next();
+
+    // How many objects and arrays the last token is inside of.
+    size_t depth() const { return m_containers.size(); }
+
+    // How far into the input the last token went.
+    size_t offset() const { return tell(); }
+
+    static String unescape(const Token&);
+
+    // Text of a Key or String token, unescaped into a buffer of at least
+    // text.length() bytes. Returns how many bytes it wrote.
+    static size_t unescape_into(const StringView& text, char* buffer);
+
+private:
+    enum class Expect {
+        Value,
+        FirstValueOrArrayEnd,
+        FirstKeyOrObjectEnd,
+        Key,
+        CommaOrEnd,
+        Done,
+    };
+
+    Token fail();
+    Token lex_value();
+    Token lex_key();
+    Token lex_string(TokenType);
+    Token lex_number();
+    Token lex_literal(const char*, TokenType);
+    Token open_container(bool is_object);
+    Token close_container();
+    void finish_value();
+
+    // True for objects, false for arrays.
+    Vector<bool, 32> m_containers;
+    const JsonStructuralIndex* m_structural_index { nullptr };
+    size_t m_structural_cursor { 0 };
+    Expect m_expect { Expect::Value };
+    bool m_failed { false };
+};
+
+}
+
+using Base::JsonPullParser;
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/JsonStructuralIndex.h>
+#include <base/Platform.h>
+#include <base/SIMD.h>
+
+namespace Base {
+
+// One bit per byte of a 64 byte block.
+struct JsonBlockMasks {
+    u64 quote { 0 };
+    u64 backslash { 0 };
+    u64 op { 0 };
+    u64 whitespace { 0 };
+    u64 control { 0 };
+};
+
+using JsonClassifyFunction = void (*)(const u8*, JsonBlockMasks&);
+
+static void classify_scalar(const u8* block, JsonBlockMasks& masks)
+{
+    masks = {};
+    for (size_t i = 0; i < 64; ++i) {
+        u64 bit = 1ull << i;
+        switch (block[i]) {
+        case '"':
+            masks.quote |= bit;
+            break;
+        case '\\':
+            masks.backslash |= bit;
+            break;
+        case '{':
+        case '}':
+        case '[':
+        case ']':
+        case ':':
+        case ',':
+            masks.op |= bit;
+            break;
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+            masks.whitespace |= bit;
+            break;
+        default:
+            break;
+        }
+        if (block[i] < 0x20)
+            masks.control |= bit;
+    }
+}
+
+#ifdef __SSE2__
+static void classify_sse2(const u8* block, JsonBlockMasks& masks)
+{
+    auto splat = [](u8 value) {
+        SIMD::u8x16 result;
+        for (size_t i = 0; i < 16; ++i)
+            result[i] = value;
+        return result;
+    };
+    auto mask_of = [](auto bytes) -> u64 { return (u16)__builtin_ia32_pmovmskb128((SIMD::c8x16)bytes); };
+
+    masks = {};
+    for (size_t chunk = 0; chunk < 4; ++chunk) {
+        SIMD::u8x16 bytes;
+        __builtin_memcpy(&bytes, block + chunk * 16, sizeof(bytes));
+        size_t shift = chunk * 16;
+        masks.quote |= mask_of(bytes == splat('"')) << shift;
+        masks.backslash |= mask_of(bytes == splat('\\')) << shift;
+        masks.op |= mask_of((bytes == splat('{')) | (bytes == splat('}')) | (bytes == splat('[')) | (bytes == splat(']')) | (bytes == splat(':')) | (bytes == splat(','))) << shift;
+        masks.whitespace |= mask_of((bytes == splat(' ')) | (bytes == splat('\t')) | (bytes == splat('\n')) | (bytes == splat('\r'))) << shift;
+        masks.control |= mask_of(bytes < splat(0x20)) << shift;
+    }
+}
+#endif
+
+// Only userland can use AVX2, the kernel doesn't save its registers.
+#if defined(__x86_64__) && !defined(KERNEL)
+#    define JSON_STRUCTURAL_INDEX_HAS_AVX2
+__attribute__((target("avx2"))) static SIMD::u8x32 splat_avx2(u8 value)
+{
+    SIMD::u8x32 result;
+    for (size_t i = 0; i < 32; ++i)
+        result[i] = value;
+    return result;
+}
+
+__attribute__((target("avx2"))) static u64 mask_of_avx2(SIMD::i8x32 bytes)
+{
+    return (u32)__builtin_ia32_pmovmskb256((SIMD::c8x32)bytes);
+}
+
+__attribute__((target("avx2"))) static void classify_avx2(const u8* block, JsonBlockMasks& masks)
+{
+    auto splat = splat_avx2;
+    auto mask_of = [](auto bytes) __attribute__((target("avx2"))) { return mask_of_avx2((SIMD::i8x32)bytes); };
+
+    masks = {};
+    for (size_t chunk = 0; chunk < 2; ++chunk) {
+        SIMD::u8x32 bytes;
+        __builtin_memcpy(&bytes, block + chunk * 32, sizeof(bytes));
+        size_t shift = chunk * 32;
+        masks.quote |= mask_of(bytes == splat('"')) << shift;
+        masks.backslash |= mask_of(bytes == splat('\\')) << shift;
+        masks.op |= mask_of((bytes == splat('{')) | (bytes == splat('}')) | (bytes == splat('[')) | (bytes == splat(']')) | (bytes == splat(':')) | (bytes == splat(','))) << shift;
+        masks.whitespace |= mask_of((bytes == splat(' ')) | (bytes == splat('\t')) | (bytes == splat('\n')) | (bytes == splat('\r'))) << shift;
+        masks.control |= mask_of(bytes < splat(0x20)) << shift;
+    }
+}
+#endif
+
+static JsonClassifyFunction select_classify_function()
+{
+#ifdef JSON_STRUCTURAL_INDEX_HAS_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        return classify_avx2;
+#endif
+#ifdef __SSE2__
+    return classify_sse2;
+#else
+    return classify_scalar;
+#endif
+}
+
+// The characters escaped by an odd-length run of backslashes. A run that
+// reaches the end of the block is carried over into the next one.
+static u64 find_escaped(u64 backslash, u64& escape_carry)
+{
+    constexpr u64 even_bits = 0x5555555555555555ull;
+
+    backslash &= ~escape_carry;
+    u64 follows_escape = (backslash << 1) | escape_carry;
+    u64 odd_sequence_starts = backslash & ~even_bits & ~follows_escape;
+    u64 sequences_starting_on_even_bits;
+    escape_carry = __builtin_add_overflow(odd_sequence_starts, backslash, &sequences_starting_on_even_bits);
+    u64 invert_mask = sequences_starting_on_even_bits << 1;
+    return (even_bits ^ invert_mask) & follows_escape;
+}
+
+// Bit n is set if an odd number of bits up to and including n are.
+static u64 prefix_xor(u64 bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+Optional<JsonStructuralIndex> JsonStructuralIndex::create(const StringView& input)
+{
+    static JsonClassifyFunction const classify = select_classify_function();
+
+    if (input.length() >= has_escapes_flag)
+        return {};
+
+    JsonStructuralIndex index;
+    auto* characters = (const u8*)input.characters_without_null_termination();
+    u64 escape_carry = 0;
+    u64 in_string_carry = 0;
+    // The start of the input counts as whitespace before it.
+    u64 separator_carry = 1;
+    bool string_has_escapes = false;
+
+    for (size_t block_start = 0; block_start < input.length(); block_start += 64) {
+        JsonBlockMasks masks;
+        size_t block_length = min(input.length() - block_start, (size_t)64);
+        if (block_length == 64) {
+            classify(characters + block_start, masks);
+        } else {
+            // Spaces change nothing about the JSON around them.
+            u8 block[64];
+            __builtin_memset(block, ' ', sizeof(block));
+            __builtin_memcpy(block, characters + block_start, block_length);
+            classify(block, masks);
+        }
+
+        u64 escaped = find_escaped(masks.backslash, escape_carry);
+        u64 quote = masks.quote & ~escaped;
+        // Opening quotes and string contents, not closing quotes.
+        u64 in_string = prefix_xor(quote) ^ in_string_carry;
+        in_string_carry = (u64)((i64)in_string >> 63);
+
+        if (masks.control & in_string)
+            return {};
+
+        u64 op = masks.op & ~in_string;
+        u64 closing_quote = quote & ~in_string;
+        u64 separator = op | (masks.whitespace & ~in_string) | closing_quote;
+        u64 scalar = ~(separator | quote | in_string);
+        u64 scalar_start = scalar & ((separator << 1) | separator_carry);
+        separator_carry = separator >> 63;
+
+        u64 structural = op | quote | scalar_start;
+        u64 string_backslash = masks.backslash & in_string;
+        for (u64 events = structural | string_backslash; events; events &= events - 1) {
+            size_t bit_index = count_trailing_zeroes_64(events);
+            u64 bit = 1ull << bit_index;
+            if (bit & string_backslash) {
+                string_has_escapes = true;
+                continue;
+            }
+
+            u32 entry = block_start + bit_index;
+            if (bit & in_string)
+                string_has_escapes = false;
+            else if ((bit & quote) && string_has_escapes)
+                entry |= has_escapes_flag;
+            index.m_entries.append(entry);
+        }
+    }
+
+    if (in_string_carry)
+        return {};
+    return index;
+}
+
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Optional.h>
+#include <base/StringView.h>
+#include <base/Vector.h>
+
+namespace Base {
+
+// Stage one of parsing JSON, 64 bytes at a time: the offsets of every
+// structural character outside of strings, of both quotes of every string
+// and of the first byte of every number or literal. The escaped quotes and
+// the string contents never show up, so a parser can go from an opening
+// quote straight to its closing one.
+//
+// Fails for input with an unterminated string or a control character in
+// a string, which no parser accepts either.
+class JsonStructuralIndex {
+public:
+    // Set on a closing quote if its string contains escapes.
+    static constexpr u32 has_escapes_flag = 1u << 31;
+
+    static Optional<JsonStructuralIndex> create(const StringView& input);
+
+    size_t size() const { return m_entries.size(); }
+    size_t offset(size_t index) const { return m_entries[index] & ~has_escapes_flag; }
+    bool has_escapes(size_t index) const { return m_entries[index] & has_escapes_flag; }
+
+    struct StringExtent {
+        size_t closing_quote;
+        bool has_escapes;
+    };
+
+    // The string that starts with the quote at quote_offset. The cursor
+    // remembers where the last lookup left off, so walking the input from
+    // front to back stays linear.
+    Optional<StringExtent> find_string(size_t quote_offset, size_t& cursor) const
+    {
+        while (cursor < size() && offset(cursor) < quote_offset)
+            ++cursor;
+        if (cursor + 1 >= size() || offset(cursor) != quote_offset)
+            return {};
+        StringExtent string { offset(cursor + 1), has_escapes(cursor + 1) };
+        cursor += 2;
+        return string;
+    }
+
+private:
+    JsonStructuralIndex() = default;
+
+    Vector<u32> m_entries;
+};
+
+}
+
+using Base::JsonStructuralIndex;
@@ -7,7 +7,9 @@
 #pragma once
 
 // includes
+#include <base/Endian.h>
 #include <base/NumericLimits.h>
+#include <base/StdLibExtras.h>
 #include <base/Stream.h>
 #include <base/Types.h>
 
@@ -17,6 +19,19 @@ struct LEB128 {
     template<typename StreamT, typename ValueType = size_t>
     static bool read_unsigned(StreamT& stream, ValueType& result)
     {
+        if constexpr (IsSame<StreamT, InputMemoryStream>) {
+            u64 value;
+            if (read_from_memory(stream, value)) {
+                // At most 56 bits, only narrower types can overflow.
+                if constexpr (sizeof(ValueType) < sizeof(u64)) {
+                    if (value > static_cast<u64>(NumericLimits<ValueType>::max()))
+                        return false;
+                }
+                result = static_cast<ValueType>(value);
+                return true;
+            }
+        }
+
         [[maybe_unused]] size_t backup_offset = 0;
         if constexpr (requires { stream.offset(); })
             backup_offset = stream.offset();
@@ -56,6 +71,22 @@ struct LEB128 {
     {
 
         static_assert(sizeof(ValueType) <= sizeof(u64), "Error checking logic assumes 64 bits or less!");
+
+        if constexpr (IsSame<StreamT, InputMemoryStream>) {
+            u64 value;
+            if (auto length = read_from_memory(stream, value)) {
+                // Sign-extend from the top bit of the last group.
+                auto unused_bits = 64 - length * 7;
+                auto extended = static_cast<i64>(value << unused_bits) >> unused_bits;
+                if constexpr (sizeof(ValueType) < sizeof(u64)) {
+                    if (extended > NumericLimits<ValueType>::max() || extended < NumericLimits<ValueType>::min())
+                        return false;
+                }
+                result = static_cast<ValueType>(extended);
+                return true;
+            }
+        }
+
         [[maybe_unused]] size_t backup_offset = 0;
         if constexpr (requires { stream.offset(); })
             backup_offset = stream.offset();
@@ -102,6 +133,38 @@ struct LEB128 {
 
         return true;
     }
+
+private:
+    // Decodes a value of up to eight bytes with one load out of the stream's
+    // buffer and one bounds check. The first byte with its top bit clear is
+    // the last one, and the groups of seven bits are packed together by
+    // three rounds of shifting every other group over the gap next to it.
+    // Returns how many bytes the value took, or zero to leave longer values,
+    // the end of the buffer and streams in error to the byte loops above.
+    template<typename StreamT>
+    static size_t read_from_memory(StreamT& stream, u64& value)
+    {
+        if (stream.has_any_error() || stream.remaining() < sizeof(u64))
+            return 0;
+
+        u64 word;
+        __builtin_memcpy(&word, stream.bytes().data() + stream.offset(), sizeof(word));
+        word = convert_between_host_and_little_endian(word);
+        u64 last_bytes = ~word & 0x8080808080808080ull;
+        if (!last_bytes)
+            return 0;
+        size_t length = __builtin_ctzll(last_bytes) / 8 + 1;
+
+        // Everything up to the top bit of the last byte, but no top bits.
+        word &= (last_bytes ^ (last_bytes - 1)) & 0x7f7f7f7f7f7f7f7full;
+        word = ((word & 0x7f007f007f007f00ull) >> 1) | (word & 0x007f007f007f007full);
+        word = ((word & 0x3fff00003fff0000ull) >> 2) | (word & 0x00003fff00003fffull);
+        word = ((word & 0x0fffffff00000000ull) >> 4) | (word & 0x000000000fffffffull);
+        value = word;
+
+        stream.discard_or_error(length);
+        return length;
+    }
 };
 
 }
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Atomic.h>
+#include <base/Noncopyable.h>
+#include <base/NumericLimits.h>
+#include <base/StdLibExtras.h>
+#include <base/Types.h>
+
+namespace Base {
+
+// Durations in nanoseconds, counted in log-linear buckets: every power of
+// two is split into sub_bucket_count buckets of equal width, so whatever
+// it reports is within an eighth of what was recorded, from nanoseconds to
+// years. Recording is a few relaxed atomic adds and nothing is locked, so
+// any number of threads may record at once. Hot paths on many threads can
+// still keep one each and merge them for reading:
+//
+//     static thread_local LatencyHistogram s_lookup_latency;
+//     ScopedTimer timer(s_lookup_latency);
+class LatencyHistogram {
+    BASE_MAKE_NONCOPYABLE(LatencyHistogram);
+    BASE_MAKE_NONMOVABLE(LatencyHistogram);
+
+public:
+    static constexpr size_t sub_bucket_bits = 3;
+    static constexpr size_t sub_bucket_count = 1 << sub_bucket_bits;
+    static constexpr size_t bucket_count = sub_bucket_count + (64 - sub_bucket_bits) * sub_bucket_count;
+
+    constexpr LatencyHistogram() = default;
+
+    static constexpr size_t bucket_for(u64 ns)
+    {
+        if (ns < sub_bucket_count)
+            return ns;
+        size_t shift = 63 - __builtin_clzll(ns) - sub_bucket_bits;
+        return sub_bucket_count + shift * sub_bucket_count + ((ns >> shift) & (sub_bucket_count - 1));
+    }
+
+    // The largest duration bucket holds.
+    static constexpr u64 bucket_limit_ns(size_t bucket)
+    {
+        if (bucket < sub_bucket_count)
+            return bucket;
+        size_t shift = (bucket - sub_bucket_count) / sub_bucket_count;
+        u64 lowest = static_cast<u64>(sub_bucket_count + bucket % sub_bucket_count) << shift;
+        return lowest + ((1ull << shift) - 1);
+    }
+
+    void record(u64 ns)
+    {
+        m_buckets[bucket_for(ns)].fetch_add(1);
+        m_count.fetch_add(1);
+        m_sum_ns.fetch_add(ns);
+        u64 max_ns = m_max_ns.load();
+        while (ns > max_ns && !m_max_ns.compare_exchange_strong(max_ns, ns)) {
+        }
+    }
+
+    void merge(LatencyHistogram const& other)
+    {
+        for (size_t i = 0; i < bucket_count; ++i) {
+            if (u64 count = other.m_buckets[i].load())
+                m_buckets[i].fetch_add(count);
+        }
+        m_count.fetch_add(other.m_count.load());
+        m_sum_ns.fetch_add(other.m_sum_ns.load());
+        u64 other_max_ns = other.m_max_ns.load();
+        u64 max_ns = m_max_ns.load();
+        while (other_max_ns > max_ns && !m_max_ns.compare_exchange_strong(max_ns, other_max_ns)) {
+        }
+    }
+
+    void clear()
+    {
+        for (auto& bucket : m_buckets)
+            bucket.store(0);
+        m_count.store(0);
+        m_sum_ns.store(0);
+        m_max_ns.store(0);
+    }
+
+    u64 count() const { return m_count.load(); }
+    u64 sum_ns() const { return m_sum_ns.load(); }
+    u64 max_ns() const { return m_max_ns.load(); }
+    u64 bucket(size_t index) const { return m_buckets[index].load(); }
+
+    // How long at most the fastest per_mille thousandths of the durations
+    // took, to the bucket: p99 is percentile_ns(990). Records racing with
+    // it may or may not be counted.
+    u64 percentile_ns(u32 per_mille) const
+    {
+        u64 count = 0;
+        for (auto& bucket : m_buckets)
+            count += bucket.load();
+        u64 max_ns = this->max_ns();
+        if (!count)
+            return 0;
+
+        u64 rank = max<u64>((count * per_mille + 999) / 1000, 1);
+        u64 seen = 0;
+        for (size_t i = 0; i < bucket_count; ++i) {
+            seen += m_buckets[i].load();
+            if (seen >= rank)
+                return min(bucket_limit_ns(i), max_ns);
+        }
+        return max_ns;
+    }
+
+private:
+    using Counter = Atomic<u64, MemoryOrder::memory_order_relaxed>;
+
+    Counter m_buckets[bucket_count] {};
+    Counter m_count { 0 };
+    Counter m_sum_ns { 0 };
+    Counter m_max_ns { 0 };
+};
+
+}
+
+using Base::LatencyHistogram;
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Atomic.h>
+#include <base/Noncopyable.h>
+#include <base/Optional.h>
+#include <base/StdLibExtras.h>
+#include <base/Types.h>
+
+namespace Base {
+
+// Bounded lock-free queue for any number of producers and consumers, after
+// Dmitry Vyukov's. Every cell carries a sequence number that tells whose
+// turn it is. It equals the position for its next enqueue while the cell
+// is empty, and that position plus one once it is filled. Claiming a
+// position is the only contended step; a thread that is preempted after
+// claiming holds up only the cell it claimed.
+template<typename T, size_t Capacity>
+class MPMCQueue {
+    static_assert(Capacity >= 2 && !(Capacity & (Capacity - 1)), "MPMCQueue capacity must be a power of two");
+
+    BASE_MAKE_NONCOPYABLE(MPMCQueue);
+    BASE_MAKE_NONMOVABLE(MPMCQueue);
+
+public:
+    MPMCQueue()
+    {
+        for (size_t i = 0; i < Capacity; ++i)
+            m_cells[i].sequence.store(i, Base::memory_order_relaxed);
+    }
+
+    ~MPMCQueue()
+    {
+        size_t tail = m_tail.load(Base::memory_order_relaxed);
+        for (size_t head = m_head.load(Base::memory_order_relaxed); head != tail; ++head)
+            m_cells[head & (Capacity - 1)].value().~T();
+    }
+
+    size_t capacity() const { return Capacity; }
+
+    // Only a snapshot while other threads are using the queue.
+    size_t size() const
+    {
+        size_t head = m_head.load(Base::memory_order_acquire);
+        size_t tail = m_tail.load(Base::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+    bool is_empty() const { return !size(); }
+
+    template<typename U = T>
+    [[nodiscard]] bool try_enqueue(U&& value)
+    {
+        size_t position;
+        if (!claim(m_tail, position, 1, 0))
+            return false;
+        auto& cell = m_cells[position & (Capacity - 1)];
+        new (cell.storage) T(forward<U>(value));
+        cell.sequence.store(position + 1, Base::memory_order_release);
+        return true;
+    }
+
+    // Claims up to count consecutive cells with one compare-exchange,
+    // copies values into them, and returns how many it claimed.
+    size_t try_enqueue_batch(T const* values, size_t count)
+    {
+        size_t position;
+        count = claim(m_tail, position, count, 0);
+        for (size_t i = 0; i < count; ++i) {
+            auto& cell = m_cells[(position + i) & (Capacity - 1)];
+            new (cell.storage) T(values[i]);
+            cell.sequence.store(position + i + 1, Base::memory_order_release);
+        }
+        return count;
+    }
+
+    Optional<T> try_dequeue()
+    {
+        size_t position;
+        if (!claim(m_head, position, 1, 1))
+            return {};
+        auto& cell = m_cells[position & (Capacity - 1)];
+        Optional<T> value = move(cell.value());
+        cell.value().~T();
+        cell.sequence.store(position + Capacity, Base::memory_order_release);
+        return value;
+    }
+
+    size_t try_dequeue_batch(T* values, size_t count)
+    {
+        size_t position;
+        count = claim(m_head, position, count, 1);
+        for (size_t i = 0; i < count; ++i) {
+            auto& cell = m_cells[(position + i) & (Capacity - 1)];
+            values[i] = move(cell.value());
+            cell.value().~T();
+            cell.sequence.store(position + i + Capacity, Base::memory_order_release);
+        }
+        return count;
+    }
+
+private:
+    struct Cell {
+        Atomic<size_t> sequence { 0 };
+        alignas(T) u8 storage[sizeof(T)];
+
+        T& value() { return *reinterpret_cast<T*>(storage); }
+    };
+
+    // Advances index past up to wanted cells whose sequence is ready, which
+    // is the position plus ready_offset, and returns how many it took. A
+    // ready cell stays ready until whoever claims its position is done, so
+    // checking them before the compare-exchange is enough.
+    size_t claim(Atomic<size_t>& index, size_t& position, size_t wanted, size_t ready_offset)
+    {
+        if (!wanted)
+            return 0;
+        wanted = min(wanted, Capacity);
+        position = index.load(Base::memory_order_relaxed);
+        for (;;) {
+            size_t ready = 0;
+            bool stale = false;
+            for (; ready < wanted; ++ready) {
+                size_t sequence = m_cells[(position + ready) & (Capacity - 1)].sequence.load(Base::memory_order_acquire);
+                auto difference = static_cast<ssize_t>(sequence - (position + ready + ready_offset));
+                if (difference == 0)
+                    continue;
+                // Ahead of us, another thread already took this position.
+                stale = ready == 0 && difference > 0;
+                break;
+            }
+            if (stale) {
+                position = index.load(Base::memory_order_relaxed);
+                continue;
+            }
+            // Full for producers, empty for consumers.
+            if (!ready)
+                return 0;
+            if (index.compare_exchange_strong(position, position + ready, Base::memory_order_relaxed))
+                return ready;
+        }
+    }
+
+    alignas(64) Atomic<size_t> m_tail { 0 };
+    alignas(64) Atomic<size_t> m_head { 0 };
+    alignas(64) Cell m_cells[Capacity];
+};
+
+}
+
+using Base::MPMCQueue;
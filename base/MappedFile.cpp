@@ -6,6 +6,8 @@
 
 // includes
 #include <base/MappedFile.h>
+#include <base/NumericLimits.h>
+#include <base/Platform.h>
 #include <base/ScopeGuard.h>
 #include <base/String.h>
 #include <errno.h>
@@ -16,41 +18,193 @@
 
 namespace Base {
 
-Result<NonnullRefPtr<MappedFile>, OSError> MappedFile::map(const String& path)
+static Result<int, OSError> open_for(const String& path, MappedFile::Mode mode)
 {
-    int fd = open(path.characters(), O_RDONLY | O_CLOEXEC, 0);
+    int flags = mode == MappedFile::Mode::ReadWrite ? O_RDWR : O_RDONLY;
+    int fd = open(path.characters(), flags | O_CLOEXEC, 0);
     if (fd < 0)
         return OSError(errno);
+    return fd;
+}
+
+static Result<u64, OSError> size_of(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+        return OSError(errno);
+    return static_cast<u64>(st.st_size);
+}
+
+Result<NonnullRefPtr<MappedFile>, OSError> MappedFile::map(const String& path)
+{
+    return map(path, Options {});
+}
+
+Result<NonnullRefPtr<MappedFile>, OSError> MappedFile::map(const String& path, const Options& options)
+{
+    return map(path, 0, NumericLimits<size_t>::max(), options);
+}
+
+Result<NonnullRefPtr<MappedFile>, OSError> MappedFile::map(const String& path, u64 offset, size_t size, const Options& options)
+{
+    auto fd_or_error = open_for(path, options.mode);
+    if (fd_or_error.is_error())
+        return fd_or_error.error();
+    int fd = fd_or_error.value();
 
     ScopeGuard fd_close_guard = [fd] {
         close(fd);
     };
 
-    struct stat st;
-    if (fstat(fd, &st) < 0) {
-        auto saved_errno = errno;
-        return OSError(saved_errno);
-    }
+    auto file_size_or_error = size_of(fd);
+    if (file_size_or_error.is_error())
+        return file_size_or_error.error();
+    u64 file_size = file_size_or_error.value();
+    if (offset > file_size)
+        return OSError(EINVAL);
 
-    auto size = st.st_size;
-    auto* ptr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    // Everything left, unless that doesn't fit into the address space.
+    u64 available = file_size - offset;
+    if (size == NumericLimits<size_t>::max() && available > NumericLimits<size_t>::max())
+        return OSError(EOVERFLOW);
+    size = min(static_cast<u64>(size), available);
 
-    if (ptr == MAP_FAILED)
-        return OSError(errno);
+    auto file = adopt_ref(*new MappedFile(fd, file_size, options));
+    auto result = file->map_range(offset, size);
+    // The mapping keeps the file's contents around by itself.
+    file->m_fd = -1;
+    if (result.is_error())
+        return result.error();
+    return file;
+}
+
+Result<NonnullRefPtr<MappedFile>, OSError> MappedFile::map_window(const String& path, size_t window_size, const Options& options)
+{
+    VERIFY(window_size);
+    auto fd_or_error = open_for(path, options.mode);
+    if (fd_or_error.is_error())
+        return fd_or_error.error();
+    int fd = fd_or_error.value();
+
+    auto file_size_or_error = size_of(fd);
+    if (file_size_or_error.is_error()) {
+        close(fd);
+        return file_size_or_error.error();
+    }
 
-    return adopt_ref(*new MappedFile(ptr, size));
+    // From here on the file owns the descriptor.
+    auto file = adopt_ref(*new MappedFile(fd, file_size_or_error.value(), options));
+    file->m_window_size = window_size;
+    auto result = file->slide_window(0);
+    if (result.is_error())
+        return result.error();
+    return file;
 }
 
-MappedFile::MappedFile(void* ptr, size_t size)
-    : m_data(ptr)
-    , m_size(size)
+MappedFile::MappedFile(int fd, u64 file_size, const Options& options)
+    : m_fd(fd)
+    , m_file_size(file_size)
+    , m_options(options)
 {
 }
 
 MappedFile::~MappedFile()
 {
-    auto rc = munmap(m_data, m_size);
+    unmap();
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+Result<void, OSError> MappedFile::slide_window(u64 offset)
+{
+    VERIFY(m_window_size);
+    if (offset > m_file_size)
+        return OSError(EINVAL);
+    size_t size = min(static_cast<u64>(m_window_size), m_file_size - offset);
+
+    if (m_mapping && offset >= m_mapping_offset && offset + size <= m_mapping_offset + m_mapping_size) {
+        m_data = static_cast<u8*>(m_mapping) + (offset - m_mapping_offset);
+        m_size = size;
+        m_offset = offset;
+        return {};
+    }
+    return map_range(offset, size);
+}
+
+Result<void, OSError> MappedFile::map_range(u64 offset, size_t size)
+{
+    // mmap() wants page aligned offsets, so the mapping starts at the page
+    // the range does.
+    u64 page_size = PAGE_SIZE;
+    u64 mapping_offset = offset - offset % page_size;
+    size_t offset_in_mapping = offset - mapping_offset;
+    if (size > NumericLimits<size_t>::max() - offset_in_mapping)
+        return OSError(EOVERFLOW);
+    size_t mapping_size = offset_in_mapping + size;
+
+    unmap();
+    m_data = nullptr;
+    m_size = 0;
+    m_offset = offset;
+
+    // Nothing to map for ranges that are empty.
+    if (!size)
+        return {};
+
+    int protection = PROT_READ;
+    int flags = MAP_SHARED;
+    switch (m_options.mode) {
+    case Mode::ReadOnly:
+        break;
+    case Mode::ReadWrite:
+        protection |= PROT_WRITE;
+        break;
+    case Mode::CopyOnWrite:
+        protection |= PROT_WRITE;
+        flags = MAP_PRIVATE;
+        break;
+    }
+#ifdef MAP_POPULATE
+    if (m_options.populate)
+        flags |= MAP_POPULATE;
+#endif
+
+    auto* ptr = mmap(nullptr, mapping_size, protection, flags, m_fd, static_cast<off_t>(mapping_offset));
+    if (ptr == MAP_FAILED)
+        return OSError(errno);
+
+    m_mapping = ptr;
+    m_mapping_size = mapping_size;
+    m_mapping_offset = mapping_offset;
+    m_data = static_cast<u8*>(ptr) + offset_in_mapping;
+    m_size = size;
+
+    // The hints only tune read ahead, so failing to give them is no error.
+    switch (m_options.access_hint) {
+    case AccessHint::Normal:
+        break;
+    case AccessHint::Sequential:
+        (void)madvise(m_mapping, m_mapping_size, MADV_SEQUENTIAL);
+        break;
+    case AccessHint::Random:
+        (void)madvise(m_mapping, m_mapping_size, MADV_RANDOM);
+        break;
+    }
+#ifndef MAP_POPULATE
+    if (m_options.populate)
+        (void)madvise(m_mapping, m_mapping_size, MADV_WILLNEED);
+#endif
+    return {};
+}
+
+void MappedFile::unmap()
+{
+    if (!m_mapping)
+        return;
+    auto rc = munmap(m_mapping, m_mapping_size);
     VERIFY(rc == 0);
+    m_mapping = nullptr;
+    m_mapping_size = 0;
 }
 
-}
\ No newline at end of file
+}
@@ -20,23 +20,82 @@ class MappedFile : public RefCounted<MappedFile> {
     BASE_MAKE_NONMOVABLE(MappedFile);
 
 public:
+    enum class Mode {
+        ReadOnly,
+        // Writes go to the file.
+        ReadWrite,
+        // Writes stay private to the mapping, the file is only read.
+        CopyOnWrite,
+    };
+
+    enum class AccessHint {
+        Normal,
+        Sequential,
+        Random,
+    };
+
+    struct Options {
+        Mode mode { Mode::ReadOnly };
+        AccessHint access_hint { AccessHint::Normal };
+        // Faults every page in up front instead of on first touch.
+        bool populate { false };
+    };
+
     static Result<NonnullRefPtr<MappedFile>, OSError> map(const String& path);
+    static Result<NonnullRefPtr<MappedFile>, OSError> map(const String& path, const Options&);
+
+    // size bytes from offset on, or up to the end of the file if there are
+    // fewer. The offset needn't be page aligned.
+    static Result<NonnullRefPtr<MappedFile>, OSError> map(const String& path, u64 offset, size_t size, const Options& = {});
+
+    // A window of window_size bytes onto a file that may be too large to
+    // map at once, starting at the beginning. The file stays open for
+    // slide_window() to map other parts of it.
+    static Result<NonnullRefPtr<MappedFile>, OSError> map_window(const String& path, size_t window_size, const Options& = {});
+
     ~MappedFile();
 
+    // Maps the window at offset instead, keeping to one mapping whenever
+    // the window is already inside of it. Only for map_window() files.
+    Result<void, OSError> slide_window(u64 offset);
+
     void* data() { return m_data; }
     const void* data() const { return m_data; }
 
     size_t size() const { return m_size; }
 
+    // Where data() is in the file, and how large the whole file is.
+    u64 offset() const { return m_offset; }
+    u64 file_size() const { return m_file_size; }
+
     ReadonlyBytes bytes() const { return { m_data, m_size }; }
+    Bytes writable_bytes()
+    {
+        VERIFY(m_options.mode != Mode::ReadOnly);
+        return { m_data, m_size };
+    }
 
 private:
-    explicit MappedFile(void*, size_t);
+    MappedFile(int fd, u64 file_size, const Options&);
+
+    Result<void, OSError> map_range(u64 offset, size_t size);
+    void unmap();
+
+    // Only kept open for windows.
+    int m_fd { -1 };
+    u64 m_file_size { 0 };
+    Options m_options;
 
-    void* m_data { nullptr };
+    // The page aligned mapping, and the part of it that was asked for.
+    void* m_mapping { nullptr };
+    size_t m_mapping_size { 0 };
+    u64 m_mapping_offset { 0 };
+    u8* m_data { nullptr };
     size_t m_size { 0 };
+    u64 m_offset { 0 };
+    size_t m_window_size { 0 };
 };
 
 }
 
-using Base::MappedFile;
\ No newline at end of file
+using Base::MappedFile;
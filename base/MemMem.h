@@ -9,6 +9,9 @@
 // includes
 #include <base/Array.h>
 #include <base/Assertions.h>
+#include <base/Optional.h>
+#include <base/Platform.h>
+#include <base/SIMD.h>
 #include <base/Span.h>
 #include <base/Types.h>
 #include <base/Vector.h>
@@ -29,13 +32,13 @@ const static void* bitap_bitwise(const void* haystack, size_t haystack_length, c
         needle_mask[i] = 0xffffffff;
 
     for (size_t i = 0; i < needle_length; ++i)
-        needle_mask[((const u8*)needle)[i]] &= ~(0x00000001 << i);
+        needle_mask[((const u8*)needle)[i]] &= ~(1ull << i);
 
     for (size_t i = 0; i < haystack_length; ++i) {
         lookup |= needle_mask[((const u8*)haystack)[i]];
         lookup <<= 1;
 
-        if (!(lookup & (0x00000001 << needle_length)))
+        if (!(lookup & (1ull << needle_length)))
             return ((const u8*)haystack) + i - needle_length + 1;
     }
 
@@ -43,6 +46,252 @@ const static void* bitap_bitwise(const void* haystack, size_t haystack_length, c
 }
 }
 
+namespace Detail {
+
+static constexpr u64 memmem_low_bits = 0x0101010101010101ull;
+static constexpr u64 memmem_high_bits = 0x8080808080808080ull;
+
+// Flags (at least) every byte of the word that equals zero.
+static inline u64 memmem_zero_bytes(u64 word)
+{
+    return (word - memmem_low_bits) & ~word & memmem_high_bits;
+}
+
+#ifdef __SSE2__
+static inline SIMD::u8x16 memmem_splat(u8 value)
+{
+    SIMD::u8x16 result;
+    for (size_t i = 0; i < 16; ++i)
+        result[i] = value;
+    return result;
+}
+
+static inline SIMD::u8x16 memmem_load(const u8* bytes)
+{
+    SIMD::u8x16 result;
+    __builtin_memcpy(&result, bytes, sizeof(result));
+    return result;
+}
+
+// One bit per byte, set where the compare matched.
+template<typename Vector>
+static inline u32 memmem_mask(Vector compare)
+{
+    return (u16)__builtin_ia32_pmovmskb128((SIMD::c8x16)compare);
+}
+#endif
+
+// Crochemore and Perrin's maximal suffix of needle, by the ordering or
+// its reverse, and its period.
+static inline ssize_t two_way_maximal_suffix(const u8* needle, ssize_t needle_length, ssize_t& period, bool reversed)
+{
+    ssize_t suffix = -1;
+    ssize_t j = 0;
+    ssize_t k = 1;
+    period = 1;
+    while (j + k < needle_length) {
+        u8 a = needle[j + k];
+        u8 b = needle[suffix + k];
+        if (reversed ? a > b : a < b) {
+            j += k;
+            k = 1;
+            period = j - suffix;
+        } else if (a == b) {
+            if (k != period) {
+                ++k;
+            } else {
+                j += period;
+                k = 1;
+            }
+        } else {
+            suffix = j++;
+            k = period = 1;
+        }
+    }
+    return suffix;
+}
+
+// Two-Way string matching: linear time and constant space, for needles too
+// long for the byte filters to be cheap in the worst case.
+static inline Optional<size_t> two_way_memmem(const u8* haystack, ssize_t haystack_length, const u8* needle, ssize_t needle_length)
+{
+    ssize_t period;
+    ssize_t reversed_period;
+    ssize_t critical = two_way_maximal_suffix(needle, needle_length, period, false);
+    ssize_t reversed_critical = two_way_maximal_suffix(needle, needle_length, reversed_period, true);
+    if (reversed_critical > critical) {
+        critical = reversed_critical;
+        period = reversed_period;
+    }
+
+    if (__builtin_memcmp(needle, needle + period, critical + 1) == 0) {
+        // Periodic needle: remember how much of the left half matched
+        // already, which keeps the whole search linear.
+        ssize_t memory = -1;
+        for (ssize_t j = 0; j <= haystack_length - needle_length;) {
+            ssize_t i = max(critical, memory) + 1;
+            while (i < needle_length && needle[i] == haystack[i + j])
+                ++i;
+            if (i < needle_length) {
+                j += i - critical;
+                memory = -1;
+                continue;
+            }
+            i = critical;
+            while (i > memory && needle[i] == haystack[i + j])
+                --i;
+            if (i <= memory)
+                return j;
+            j += period;
+            memory = needle_length - period - 1;
+        }
+        return {};
+    }
+
+    period = max(critical + 1, needle_length - critical - 1) + 1;
+    for (ssize_t j = 0; j <= haystack_length - needle_length;) {
+        ssize_t i = critical + 1;
+        while (i < needle_length && needle[i] == haystack[i + j])
+            ++i;
+        if (i < needle_length) {
+            j += i - critical;
+            continue;
+        }
+        i = critical;
+        while (i >= 0 && needle[i] == haystack[i + j])
+            --i;
+        if (i < 0)
+            return j;
+        j += period;
+    }
+    return {};
+}
+
+#ifdef __SSE2__
+// Candidates are where both the first and the last byte of the needle
+// match, sixteen positions at a time, only those get compared in full.
+static inline Optional<size_t> first_and_last_byte_memmem(const u8* haystack, size_t haystack_length, const u8* needle, size_t needle_length)
+{
+    auto first = memmem_splat(needle[0]);
+    auto last = memmem_splat(needle[needle_length - 1]);
+    size_t last_start = haystack_length - needle_length;
+    size_t offset = 0;
+    for (; offset + 16 <= last_start + 1; offset += 16) {
+        u32 candidates = memmem_mask((memmem_load(haystack + offset) == first) & (memmem_load(haystack + offset + needle_length - 1) == last));
+        for (; candidates; candidates &= candidates - 1) {
+            size_t start = offset + count_trailing_zeroes_32(candidates);
+            if (!__builtin_memcmp(haystack + start + 1, needle + 1, needle_length - 2))
+                return start;
+        }
+    }
+    for (; offset <= last_start; ++offset) {
+        if (haystack[offset] == needle[0] && !__builtin_memcmp(haystack + offset + 1, needle + 1, needle_length - 1))
+            return offset;
+    }
+    return {};
+}
+#endif
+
+}
+
+// Like memchr and memrchr, sixteen bytes at a time with SSE2 and eight at a
+// time in a word otherwise.
+static inline Optional<size_t> find_byte(const void* haystack, size_t haystack_length, u8 needle)
+{
+    auto* bytes = (const u8*)haystack;
+    size_t offset = 0;
+#ifdef __SSE2__
+    auto splat = Detail::memmem_splat(needle);
+    for (; offset + 16 <= haystack_length; offset += 16) {
+        if (u32 matches = Detail::memmem_mask(Detail::memmem_load(bytes + offset) == splat))
+            return offset + count_trailing_zeroes_32(matches);
+    }
+#else
+    for (; offset + 8 <= haystack_length; offset += 8) {
+        u64 word;
+        __builtin_memcpy(&word, bytes + offset, sizeof(word));
+        if (Detail::memmem_zero_bytes(word ^ (Detail::memmem_low_bits * needle)))
+            break;
+    }
+#endif
+    for (; offset < haystack_length; ++offset) {
+        if (bytes[offset] == needle)
+            return offset;
+    }
+    return {};
+}
+
+static inline Optional<size_t> find_last_byte(const void* haystack, size_t haystack_length, u8 needle)
+{
+    auto* bytes = (const u8*)haystack;
+    size_t end = haystack_length;
+#ifdef __SSE2__
+    auto splat = Detail::memmem_splat(needle);
+    for (; end >= 16; end -= 16) {
+        if (u32 matches = Detail::memmem_mask(Detail::memmem_load(bytes + end - 16) == splat))
+            return end - 16 + 31 - __builtin_clz(matches);
+    }
+#else
+    for (; end >= 8; end -= 8) {
+        u64 word;
+        __builtin_memcpy(&word, bytes + end - 8, sizeof(word));
+        if (Detail::memmem_zero_bytes(word ^ (Detail::memmem_low_bits * needle)))
+            break;
+    }
+#endif
+    for (; end > 0; --end) {
+        if (bytes[end - 1] == needle)
+            return end - 1;
+    }
+    return {};
+}
+
+// The first byte that is any of the needles. Small sets are compared
+// sixteen bytes at a time, larger ones go through a table.
+static inline Optional<size_t> find_any_byte_of(const void* haystack, size_t haystack_length, const void* needles, size_t needle_count)
+{
+    auto* bytes = (const u8*)haystack;
+    auto* needle_bytes = (const u8*)needles;
+    if (needle_count == 0)
+        return {};
+    size_t offset = 0;
+#ifdef __SSE2__
+    if (needle_count <= 4) {
+        SIMD::u8x16 splats[4];
+        for (size_t i = 0; i < 4; ++i)
+            splats[i] = Detail::memmem_splat(needle_bytes[min(i, needle_count - 1)]);
+        for (; offset + 16 <= haystack_length; offset += 16) {
+            auto block = Detail::memmem_load(bytes + offset);
+            auto matches = Detail::memmem_mask((block == splats[0]) | (block == splats[1]) | (block == splats[2]) | (block == splats[3]));
+            if (matches)
+                return offset + count_trailing_zeroes_32(matches);
+        }
+    }
+#endif
+    bool table[256] {};
+    for (size_t i = 0; i < needle_count; ++i)
+        table[needle_bytes[i]] = true;
+    for (; offset < haystack_length; ++offset) {
+        if (table[bytes[offset]])
+            return offset;
+    }
+    return {};
+}
+
+static inline Optional<size_t> find_last_any_byte_of(const void* haystack, size_t haystack_length, const void* needles, size_t needle_count)
+{
+    auto* bytes = (const u8*)haystack;
+    auto* needle_bytes = (const u8*)needles;
+    bool table[256] {};
+    for (size_t i = 0; i < needle_count; ++i)
+        table[needle_bytes[i]] = true;
+    for (size_t end = haystack_length; end > 0; --end) {
+        if (table[bytes[end - 1]])
+            return end - 1;
+    }
+    return {};
+}
+
 template<typename HaystackIterT>
 static inline Optional<size_t> memmem(const HaystackIterT& haystack_begin, const HaystackIterT& haystack_end, Span<const u8> needle) requires(requires { (*haystack_begin).data(); (*haystack_begin).size(); })
 {
@@ -115,15 +364,21 @@ static inline Optional<size_t> memmem_optional(const void* haystack, size_t hays
         return {};
     }
 
+    if (needle_length == 1)
+        return find_byte(haystack, haystack_length, *(const u8*)needle);
+
     if (needle_length < 32) {
+#ifdef __SSE2__
+        return Detail::first_and_last_byte_memmem((const u8*)haystack, haystack_length, (const u8*)needle, needle_length);
+#else
         auto ptr = bitap_bitwise(haystack, haystack_length, needle, needle_length);
         if (ptr)
             return static_cast<size_t>((FlatPtr)ptr - (FlatPtr)haystack);
         return {};
+#endif
     }
 
-    Array<Span<const u8>, 1> spans { Span<const u8> { (const u8*)haystack, haystack_length } };
-    return memmem(spans.begin(), spans.end(), { (const u8*)needle, needle_length });
+    return Detail::two_way_memmem((const u8*)haystack, haystack_length, (const u8*)needle, needle_length);
 }
 
 static inline const void* memmem(const void* haystack, size_t haystack_length, const void* needle, size_t needle_length)
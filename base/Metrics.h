@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Atomic.h>
+#include <base/LatencyHistogram.h>
+#include <base/Noncopyable.h>
+#include <base/Types.h>
+
+#ifndef KERNEL
+#    include <stdio.h>
+#    include <unistd.h>
+#endif
+
+namespace Base {
+
+// Which shard of a ShardedCounter the caller adds to: its CPU in the
+// kernel, see kernel/Metrics.cpp, and one per thread in userland.
+#ifdef KERNEL
+size_t metrics_shard_index();
+#else
+inline size_t metrics_shard_index()
+{
+    static Atomic<size_t, MemoryOrder::memory_order_relaxed> s_next_shard { 0 };
+    static thread_local size_t t_shard_plus_one = 0;
+    if (!t_shard_plus_one)
+        t_shard_plus_one = s_next_shard.fetch_add(1) + 1;
+    return t_shard_plus_one - 1;
+}
+#endif
+
+// Something MetricsRegistry exports by name. Metrics are meant to be
+// static: they register themselves once constructed, and stay registered.
+class Metric {
+    BASE_MAKE_NONCOPYABLE(Metric);
+    BASE_MAKE_NONMOVABLE(Metric);
+
+public:
+    enum class Type {
+        Counter,
+        Latency,
+    };
+
+    const char* name() const { return m_name; }
+    Type type() const { return m_type; }
+
+protected:
+    Metric(const char* name, Type);
+
+private:
+    friend class MetricsRegistry;
+
+    const char* m_name { nullptr };
+    Type m_type;
+    Metric* m_next { nullptr };
+};
+
+// A count that every CPU or thread adds to at once without them fighting
+// over a cache line: each adds to a shard of its own, value() sums them.
+class ShardedCounter final : public Metric {
+public:
+    static constexpr size_t shard_count = 16;
+
+    explicit ShardedCounter(const char* name)
+        : Metric(name, Type::Counter)
+    {
+    }
+
+    void add(u64 value = 1) { m_shards[metrics_shard_index() % shard_count].value.fetch_add(value); }
+
+    u64 value() const
+    {
+        u64 value = 0;
+        for (auto& shard : m_shards)
+            value += shard.value.load();
+        return value;
+    }
+
+private:
+    struct alignas(64) Shard {
+        Atomic<u64, MemoryOrder::memory_order_relaxed> value { 0 };
+    };
+
+    Shard m_shards[shard_count];
+};
+
+// A LatencyHistogram that is exported, usually recorded into with a
+// ScopedTimer.
+class LatencyMetric final
+    : public Metric
+    , public LatencyHistogram {
+public:
+    explicit LatencyMetric(const char* name)
+        : Metric(name, Type::Latency)
+    {
+    }
+};
+
+// Every metric there is. Adding one is lock-free and they are never taken
+// out, so readers walk the list without locking either.
+class MetricsRegistry {
+public:
+    // Constant-initialized, so metrics may register from any static
+    // constructor.
+    static MetricsRegistry& the()
+    {
+        static MetricsRegistry s_the;
+        return s_the;
+    }
+
+    constexpr MetricsRegistry() = default;
+
+    void add(Metric& metric)
+    {
+        Metric* first = m_first.load(MemoryOrder::memory_order_relaxed);
+        do {
+            metric.m_next = first;
+        } while (!m_first.compare_exchange_strong(first, &metric, MemoryOrder::memory_order_release));
+    }
+
+    // Calls callback(name, field, value) for every value there is: a
+    // counter has one with an empty field, a latency metric its count, sum
+    // and percentiles.
+    template<typename Callback>
+    void for_each_value(Callback callback) const
+    {
+        for (auto* metric = m_first.load(MemoryOrder::memory_order_acquire); metric; metric = metric->m_next) {
+            if (metric->type() == Metric::Type::Counter) {
+                callback(metric->name(), "", static_cast<ShardedCounter const*>(metric)->value());
+                continue;
+            }
+            auto& histogram = *static_cast<LatencyMetric const*>(metric);
+            callback(metric->name(), "count", histogram.count());
+            callback(metric->name(), "sum", histogram.sum_ns());
+            callback(metric->name(), "p50", histogram.percentile_ns(500));
+            callback(metric->name(), "p90", histogram.percentile_ns(900));
+            callback(metric->name(), "p99", histogram.percentile_ns(990));
+            callback(metric->name(), "p999", histogram.percentile_ns(999));
+            callback(metric->name(), "max", histogram.max_ns());
+        }
+    }
+
+#ifndef KERNEL
+    // One "name value" or "name.field value" line per value, to a file or
+    // a socket. Returns false if writing failed.
+    bool write_to(int fd) const
+    {
+        bool ok = true;
+        for_each_value([&](const char* name, const char* field, u64 value) {
+            char line[256];
+            int length = snprintf(line, sizeof(line), "%s%s%s %llu\n", name, *field ? "." : "", field, static_cast<unsigned long long>(value));
+            if (ok && length > 0)
+                ok = write(fd, line, min(static_cast<size_t>(length), sizeof(line) - 1)) >= 0;
+        });
+        return ok;
+    }
+#endif
+
+private:
+    Atomic<Metric*> m_first { nullptr };
+};
+
+inline Metric::Metric(const char* name, Type type)
+    : m_name(name)
+    , m_type(type)
+{
+    MetricsRegistry::the().add(*this);
+}
+
+}
+
+using Base::LatencyMetric;
+using Base::Metric;
+using Base::MetricsRegistry;
+using Base::ShardedCounter;
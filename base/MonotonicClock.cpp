@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/MonotonicClock.h>
+
+#ifdef KERNEL
+#    include <kernel/time/TimePage.h>
+#endif
+
+namespace Base {
+
+#ifdef KERNEL
+// The time page is only there once TimeManagement has set it up, and its
+// clock starts at zero anyway.
+u64 MonotonicClock::now_ns()
+{
+    if (!Kernel::KernelTimePage::is_initialized())
+        return 0;
+    return Kernel::KernelTimePage::the().monotonic_ns();
+}
+#endif
+
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Time.h>
+#include <base/Types.h>
+
+#ifndef KERNEL
+#    if defined(__pranaos__)
+#        include <kernel/api/TimePage.h>
+#    endif
+#    include <time.h>
+#endif
+
+namespace Base {
+
+// CLOCK_MONOTONIC, cheap enough to take timestamps with on hot paths. On
+// pranaOS it is the TSC scaled by the kernel's calibration in the time
+// page, which the kernel only allows when the TSC is invariant, so no
+// syscall is made. Otherwise it falls back to clock_gettime().
+class MonotonicClock {
+public:
+    static u64 now_ns();
+    static Time now() { return Time::from_nanoseconds(now_ns()); }
+};
+
+#ifndef KERNEL
+inline u64 MonotonicClock::now_ns()
+{
+#    if defined(__pranaos__)
+    auto const& page = *reinterpret_cast<TimePage const*>(time_page_address);
+    if (page.tsc_usable) {
+        u64 monotonic_ns;
+        i64 realtime_offset_ns;
+        time_page_read(page, true, monotonic_ns, realtime_offset_ns);
+        return monotonic_ns;
+    }
+#    endif
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<u64>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+#endif
+
+}
+
+using Base::MonotonicClock;
@@ -17,7 +17,7 @@
 #    include <kernel/arch/x86/ScopedCritical.h>
 #endif
 
-namespace AK {
+namespace Base {
 
 template<typename T>
 class OwnPtr;
@@ -38,6 +38,17 @@ ALWAYS_INLINE void unref_if_not_null(T* ptr)
         ptr->unref();
 }
 
+// Objects counted with ThreadSafety::Single never have their pointers shared
+// across threads either, so the pointer slot can skip the lock bit.
+template<typename T>
+inline constexpr bool is_single_threaded_ref_counted()
+{
+    if constexpr (requires { T::is_single_threaded_ref_counted; })
+        return T::is_single_threaded_ref_counted;
+    else
+        return false;
+}
+
 template<typename T>
 class NonnullRefPtr {
     template<typename U, typename P>
@@ -97,9 +108,9 @@ public:
         assign(nullptr);
 #ifdef SANITIZE_PTRS
         if constexpr (sizeof(T*) == 8)
-            m_bits.store(0xb0b0b0b0b0b0b0b0, AK::MemoryOrder::memory_order_relaxed);
+            m_bits.store(0xb0b0b0b0b0b0b0b0, Base::MemoryOrder::memory_order_relaxed);
         else
-            m_bits.store(0xb0b0b0b0, AK::MemoryOrder::memory_order_relaxed);
+            m_bits.store(0xb0b0b0b0, Base::MemoryOrder::memory_order_relaxed);
 #endif
     }
 
@@ -228,12 +239,12 @@ private:
 
     ALWAYS_INLINE T* as_ptr() const
     {
-        return (T*)(m_bits.load(AK::MemoryOrder::memory_order_relaxed) & ~(FlatPtr)1);
+        return (T*)(m_bits.load(Base::MemoryOrder::memory_order_relaxed) & ~(FlatPtr)1);
     }
 
     ALWAYS_INLINE RETURNS_NONNULL T* as_nonnull_ptr() const
     {
-        T* ptr = (T*)(m_bits.load(AK::MemoryOrder::memory_order_relaxed) & ~(FlatPtr)1);
+        T* ptr = (T*)(m_bits.load(Base::MemoryOrder::memory_order_relaxed) & ~(FlatPtr)1);
         VERIFY(ptr);
         return ptr;
     }
@@ -241,12 +252,16 @@ private:
     template<typename F>
     void do_while_locked(F f) const
     {
+        if constexpr (is_single_threaded_ref_counted<T>()) {
+            f((T*)m_bits.load(Base::MemoryOrder::memory_order_relaxed));
+            return;
+        }
 #ifdef KERNEL
         kernel::ScopedCritical critical;
 #endif
         FlatPtr bits;
         for (;;) {
-            bits = m_bits.fetch_or(1, AK::MemoryOrder::memory_order_acq_rel);
+            bits = m_bits.fetch_or(1, Base::MemoryOrder::memory_order_acq_rel);
             if (!(bits & 1))
                 break;
 #ifdef KERNEL
@@ -255,7 +270,7 @@ private:
         }
         VERIFY(!(bits & 1));
         f((T*)bits);
-        m_bits.store(bits, AK::MemoryOrder::memory_order_release);
+        m_bits.store(bits, Base::MemoryOrder::memory_order_release);
     }
 
     ALWAYS_INLINE void assign(T* new_ptr)
@@ -267,13 +282,18 @@ private:
     ALWAYS_INLINE T* exchange(T* new_ptr)
     {
         VERIFY(!((FlatPtr)new_ptr & 1));
+        if constexpr (is_single_threaded_ref_counted<T>()) {
+            T* prev_ptr = (T*)m_bits.load(Base::MemoryOrder::memory_order_relaxed);
+            m_bits.store((FlatPtr)new_ptr, Base::MemoryOrder::memory_order_relaxed);
+            return prev_ptr;
+        }
 #ifdef KERNEL
         kernel::ScopedCritical critical;
 #endif
-        FlatPtr expected = m_bits.load(AK::MemoryOrder::memory_order_relaxed);
+        FlatPtr expected = m_bits.load(Base::MemoryOrder::memory_order_relaxed);
         for (;;) {
             expected &= ~(FlatPtr)1;
-            if (m_bits.compare_exchange_strong(expected, (FlatPtr)new_ptr, AK::MemoryOrder::memory_order_acq_rel))
+            if (m_bits.compare_exchange_strong(expected, (FlatPtr)new_ptr, Base::MemoryOrder::memory_order_acq_rel))
                 break;
 #ifdef KERNEL
             kernel::Processor::wait_check();
@@ -285,13 +305,18 @@ private:
 
     T* add_ref() const
     {
+        if constexpr (is_single_threaded_ref_counted<T>()) {
+            T* ptr = (T*)m_bits.load(Base::MemoryOrder::memory_order_relaxed);
+            ref_if_not_null(ptr);
+            return ptr;
+        }
 #ifdef KERNEL
         kernel::ScopedCritical critical;
 #endif
-        FlatPtr expected = m_bits.load(AK::MemoryOrder::memory_order_relaxed);
+        FlatPtr expected = m_bits.load(Base::MemoryOrder::memory_order_relaxed);
         for (;;) {
             expected &= ~(FlatPtr)1;
-            if (m_bits.compare_exchange_strong(expected, expected | 1, AK::MemoryOrder::memory_order_acq_rel))
+            if (m_bits.compare_exchange_strong(expected, expected | 1, Base::MemoryOrder::memory_order_acq_rel))
                 break;
 #ifdef KERNEL
             kernel::Processor::wait_check();
@@ -300,7 +325,7 @@ private:
 
         ref_if_not_null((T*)expected);
 
-        m_bits.store(expected, AK::MemoryOrder::memory_order_release);
+        m_bits.store(expected, Base::MemoryOrder::memory_order_release);
         return (T*)expected;
     }
 
@@ -348,6 +373,6 @@ static unsigned hash(const NonnullRefPtr<T>& p) { return ptr_hash(p.ptr()); }
 static bool equals(const NonnullRefPtr<T>& a, const NonnullRefPtr<T>& b) { return a.ptr() == b.ptr(); }
 };
 
-using AK::adopt_ref;
-using AK::create;
-using AK::NonnullRefPtr;
\ No newline at end of file
+using Base::adopt_ref;
+using Base::create;
+using Base::NonnullRefPtr;
\ No newline at end of file
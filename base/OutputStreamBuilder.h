@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Noncopyable.h>
+#include <base/Stream.h>
+#include <base/StringBuilder.h>
+
+namespace Base {
+
+// Takes the same appends as StringBuilder, but passes them on to an
+// OutputStream through a fixed buffer instead of keeping everything, so
+// the Json serializers can produce any amount of output in constant
+// memory:
+//
+//     OutputStreamBuilder builder { stream };
+//     JsonObjectSerializer object { builder };
+//
+// Formatted values go through a scratch StringBuilder whose inline buffer
+// fits any number. After the stream fails once, everything else is
+// dropped and has_error() says so.
+class OutputStreamBuilder {
+    BASE_MAKE_NONCOPYABLE(OutputStreamBuilder);
+    BASE_MAKE_NONMOVABLE(OutputStreamBuilder);
+
+public:
+    static constexpr size_t buffer_size = 4096;
+
+    explicit OutputStreamBuilder(OutputStream& stream)
+        : m_stream(stream)
+    {
+    }
+
+    ~OutputStreamBuilder()
+    {
+        flush();
+    }
+
+    void append(char ch)
+    {
+        if (m_used == buffer_size)
+            flush();
+        m_buffer[m_used++] = ch;
+    }
+
+    void append(const char* characters, size_t length)
+    {
+        while (length) {
+            if (m_used == buffer_size)
+                flush();
+            size_t chunk = min(length, buffer_size - m_used);
+            __builtin_memcpy(m_buffer + m_used, characters, chunk);
+            m_used += chunk;
+            characters += chunk;
+            length -= chunk;
+        }
+    }
+
+    void append(const StringView& string)
+    {
+        append(string.characters_without_null_termination(), string.length());
+    }
+
+    void append(const char* string)
+    {
+        append(string, __builtin_strlen(string));
+    }
+
+    void append_escaped_for_json(const StringView& string)
+    {
+        size_t unescaped_start = 0;
+        for (size_t i = 0; i < string.length(); ++i) {
+            const char* escape = nullptr;
+            switch (string[i]) {
+            case '\e':
+                escape = "\\u001B";
+                break;
+            case '\b':
+                escape = "\\b";
+                break;
+            case '\n':
+                escape = "\\n";
+                break;
+            case '\t':
+                escape = "\\t";
+                break;
+            case '\"':
+                escape = "\\\"";
+                break;
+            case '\\':
+                escape = "\\\\";
+                break;
+            default:
+                continue;
+            }
+            append(string.substring_view(unescaped_start, i - unescaped_start));
+            append(escape);
+            unescaped_start = i + 1;
+        }
+        append(string.substring_view(unescaped_start));
+    }
+
+    template<typename... Parameters>
+    void appendff(CheckedFormatString<Parameters...>&& fmtstr, const Parameters&... parameters)
+    {
+        m_scratch.clear();
+        vformat(m_scratch, fmtstr.view(), VariadicFormatParams { parameters... }, fmtstr.segments());
+        append(m_scratch.string_view());
+    }
+
+    bool flush()
+    {
+        if (m_used && !m_has_error)
+            m_has_error = !m_stream.write_or_error({ m_buffer, m_used });
+        m_used = 0;
+        return !m_has_error;
+    }
+
+    bool has_error() const { return m_has_error; }
+
+private:
+    OutputStream& m_stream;
+    StringBuilder m_scratch;
+    size_t m_used { 0 };
+    bool m_has_error { false };
+    u8 m_buffer[buffer_size];
+};
+
+}
+
+using Base::OutputStreamBuilder;
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/QuickSort.h>
+#include <base/StdLibExtras.h>
+#include <base/Types.h>
+
+#ifndef KERNEL
+#    include <pthread.h>
+#    include <unistd.h>
+
+namespace Base {
+
+namespace Detail {
+
+// Below this a range is sorted on the thread that partitioned it, starting
+// a thread costs more than what it would save.
+static constexpr size_t parallel_sort_min_range_size = 32 * 1024;
+
+template<typename Collection, typename LessThan>
+void parallel_introsort(Collection&, size_t begin, size_t end, LessThan&, int split_depth, int bad_partitions_allowed, bool leftmost);
+
+template<typename Collection, typename LessThan>
+struct ParallelSortTask {
+    Collection& col;
+    size_t begin;
+    size_t end;
+    LessThan& less_than;
+    int split_depth;
+    int bad_partitions_allowed;
+    bool leftmost;
+
+    void run()
+    {
+        parallel_introsort(col, begin, end, less_than, split_depth, bad_partitions_allowed, leftmost);
+    }
+
+    static void* thread_entry(void* task)
+    {
+        static_cast<ParallelSortTask*>(task)->run();
+        return nullptr;
+    }
+};
+
+// The same partitioning as introsort, but while split_depth lasts, the left
+// side of every partition is sorted on a new thread.
+template<typename Collection, typename LessThan>
+void parallel_introsort(Collection& col, size_t begin, size_t end, LessThan& less_than, int split_depth, int bad_partitions_allowed, bool leftmost)
+{
+    size_t size = end - begin;
+    if (split_depth == 0 || size < parallel_sort_min_range_size) {
+        introsort(col, begin, end, less_than, bad_partitions_allowed, leftmost);
+        return;
+    }
+
+    choose_pivot(col, begin, end, less_than);
+    if (!leftmost && !less_than(col[begin - 1], col[begin])) {
+        begin = partition_left(col, begin, end, less_than) + 1;
+        parallel_introsort(col, begin, end, less_than, split_depth, bad_partitions_allowed, false);
+        return;
+    }
+
+    PartitionResult result;
+    if constexpr (use_branchless_partition<Collection>)
+        result = partition_right_branchless(col, begin, end, less_than);
+    else
+        result = partition_right(col, begin, end, less_than);
+    size_t pivot_position = result.pivot_position;
+
+    if (pivot_position - begin < size / 8 || end - (pivot_position + 1) < size / 8) {
+        if (--bad_partitions_allowed == 0) {
+            heap_sort(col, begin, end, less_than);
+            return;
+        }
+        break_patterns(col, begin, pivot_position);
+        break_patterns(col, pivot_position + 1, end);
+    }
+
+    ParallelSortTask<Collection, LessThan> left { col, begin, pivot_position, less_than, split_depth - 1, bad_partitions_allowed, leftmost };
+    pthread_t thread;
+    bool spawned = pthread_create(&thread, nullptr, ParallelSortTask<Collection, LessThan>::thread_entry, &left) == 0;
+    if (!spawned)
+        left.run();
+
+    parallel_introsort(col, pivot_position + 1, end, less_than, split_depth - 1, bad_partitions_allowed, false);
+
+    if (spawned)
+        pthread_join(thread, nullptr);
+}
+
+inline int parallel_sort_split_depth()
+{
+    long processor_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (processor_count <= 1)
+        return 0;
+    // Split into about twice as many ranges as there are processors, the
+    // partitions are rarely even.
+    int depth = 1;
+    while ((1l << depth) < 2 * processor_count)
+        ++depth;
+    return depth;
+}
+
+}
+
+// Sorts like quick_sort, spread over all online processors once the
+// collection is large enough. less_than is called from several threads at
+// once and must not touch shared state without its own locking.
+template<typename Collection, typename LessThan>
+void parallel_sort(Collection& collection, LessThan less_than)
+{
+    size_t size = collection.size();
+    if (size < 2)
+        return;
+    Detail::parallel_introsort(collection, 0, size, less_than, Detail::parallel_sort_split_depth(), Detail::introsort_bad_partitions_allowed(size), true);
+}
+
+template<typename Collection>
+void parallel_sort(Collection& collection)
+{
+    parallel_sort(collection, [](auto& a, auto& b) { return a < b; });
+}
+
+}
+
+using Base::parallel_sort;
+
+#endif
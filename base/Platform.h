@@ -108,6 +108,27 @@ ALWAYS_INLINE int count_trailing_zeroes_32_safe(unsigned int val)
         return 32;
     return count_trailing_zeroes_32(val);
 }
+
+ALWAYS_INLINE int count_trailing_zeroes_64(unsigned long long val)
+{
+#    if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(val);
+#    else
+    for (u8 i = 0; i < 64; ++i) {
+        if ((val >> i) & 1) {
+            return i;
+        }
+    }
+    return 0;
+#    endif
+}
+
+ALWAYS_INLINE int count_trailing_zeroes_64_safe(unsigned long long val)
+{
+    if (val == 0)
+        return 64;
+    return count_trailing_zeroes_64(val);
+}
 #endif
 
 #ifdef BASE_OS_BSD_GENERIC
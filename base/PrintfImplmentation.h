@@ -8,6 +8,7 @@
 
 // includes
 #include <base/Format.h>
+#include <base/IntegerConversions.h>
 #include <base/StdLibExtras.h>
 #include <base/Types.h>
 #include <stdarg.h>
@@ -25,11 +26,9 @@ ALWAYS_INLINE int print_hex(PutChFunc putch, char*& bufptr, T number, bool upper
 {
     int ret = 0;
 
-    int digits = 0;
-    for (T n = number; n > 0; n >>= 4)
-        ++digits;
-    if (digits == 0)
-        digits = 1;
+    char buffer[max_digits_of_u64];
+    int digits = count_hex_digits(number);
+    write_hex_digits(number, buffer, digits, upper_case);
 
     if (left_pad) {
         int stop_at = field_width - digits;
@@ -56,49 +55,18 @@ ALWAYS_INLINE int print_hex(PutChFunc putch, char*& bufptr, T number, bool upper
         }
     }
 
-    if (number == 0) {
-        putch(bufptr, '0');
+    for (int i = 0; i < digits; ++i) {
+        putch(bufptr, buffer[i]);
         ++ret;
-    } else {
-        u8 shift_count = digits * 4;
-        while (shift_count) {
-            constexpr const char* printf_hex_digits_lower = "0123456789abcdef";
-            constexpr const char* printf_hex_digits_upper = "0123456789ABCDEF";
-
-            shift_count -= 4;
-            putch(bufptr,
-                  upper_case
-                  ? printf_hex_digits_upper[(number >> shift_count) & 0x0f]
-                  : printf_hex_digits_lower[(number >> shift_count) & 0x0f]);
-            ++ret;
-        }
     }
 
     return ret;
 }
 
+// Pads the digits of a number out to field_width.
 template<typename PutChFunc>
-ALWAYS_INLINE int print_number(PutChFunc putch, char*& bufptr, u32 number, bool left_pad, bool zero_pad, u32 field_width)
+ALWAYS_INLINE int print_digits(PutChFunc putch, char*& bufptr, const char* digits, size_t numlen, bool left_pad, bool zero_pad, u32 field_width)
 {
-    u32 divisor = 1000000000;
-    char ch;
-    char padding = 1;
-    char buf[16];
-    char* p = buf;
-
-    for (;;) {
-        ch = '0' + (number / divisor);
-        number %= divisor;
-        if (ch != '0')
-            padding = 0;
-        if (!padding || divisor == 1)
-            *(p++) = ch;
-        if (divisor == 1)
-            break;
-        divisor /= 10;
-    }
-
-    size_t numlen = p - buf;
     if (!field_width || field_width < numlen)
         field_width = numlen;
     if (!left_pad) {
@@ -107,7 +75,7 @@ ALWAYS_INLINE int print_number(PutChFunc putch, char*& bufptr, u32 number, bool
         }
     }
     for (unsigned i = 0; i < numlen; ++i) {
-        putch(bufptr, buf[i]);
+        putch(bufptr, digits[i]);
     }
     if (left_pad) {
         for (unsigned i = 0; i < field_width - numlen; ++i) {
@@ -121,42 +89,16 @@ ALWAYS_INLINE int print_number(PutChFunc putch, char*& bufptr, u32 number, bool
 template<typename PutChFunc>
 ALWAYS_INLINE int print_u64(PutChFunc putch, char*& bufptr, u64 number, bool left_pad, bool zero_pad, u32 field_width)
 {
-    u64 divisor = 10000000000000000000LLU;
-    char ch;
-    char padding = 1;
-    char buf[16];
-    char* p = buf;
-
-    for (;;) {
-        ch = '0' + (number / divisor);
-        number %= divisor;
-        if (ch != '0')
-            padding = 0;
-        if (!padding || divisor == 1)
-            *(p++) = ch;
-        if (divisor == 1)
-            break;
-        divisor /= 10;
-    }
-
-    size_t numlen = p - buf;
-    if (!field_width || field_width < numlen)
-        field_width = numlen;
-    if (!left_pad) {
-        for (unsigned i = 0; i < field_width - numlen; ++i) {
-            putch(bufptr, zero_pad ? '0' : ' ');
-        }
-    }
-    for (unsigned i = 0; i < numlen; ++i) {
-        putch(bufptr, buf[i]);
-    }
-    if (left_pad) {
-        for (unsigned i = 0; i < field_width - numlen; ++i) {
-            putch(bufptr, ' ');
-        }
-    }
+    char buf[max_digits_of_u64];
+    size_t numlen = count_decimal_digits(number);
+    write_decimal_digits(number, buf, numlen);
+    return print_digits(putch, bufptr, buf, numlen, left_pad, zero_pad, field_width);
+}
 
-    return field_width;
+template<typename PutChFunc>
+ALWAYS_INLINE int print_number(PutChFunc putch, char*& bufptr, u32 number, bool left_pad, bool zero_pad, u32 field_width)
+{
+    return print_u64(putch, bufptr, number, left_pad, zero_pad, field_width);
 }
 
 template<typename PutChFunc>
@@ -194,42 +136,9 @@ ALWAYS_INLINE int print_i64(PutChFunc putch, char*& bufptr, i64 number, bool lef
 template<typename PutChFunc>
 ALWAYS_INLINE int print_octal_number(PutChFunc putch, char*& bufptr, u32 number, bool left_pad, bool zero_pad, u32 field_width)
 {
-    u32 divisor = 134217728;
-    char ch;
-    char padding = 1;
-    char buf[32];
-    char* p = buf;
-
-    for (;;) {
-        ch = '0' + (number / divisor);
-        number %= divisor;
-        if (ch != '0')
-            padding = 0;
-        if (!padding || divisor == 1)
-            *(p++) = ch;
-        if (divisor == 1)
-            break;
-        divisor /= 8;
-    }
-
-    size_t numlen = p - buf;
-    if (!field_width || field_width < numlen)
-        field_width = numlen;
-    if (!left_pad) {
-        for (unsigned i = 0; i < field_width - numlen; ++i) {
-            putch(bufptr, zero_pad ? '0' : ' ');
-        }
-    }
-    for (unsigned i = 0; i < numlen; ++i) {
-        putch(bufptr, buf[i]);
-    }
-    if (left_pad) {
-        for (unsigned i = 0; i < field_width - numlen; ++i) {
-            putch(bufptr, ' ');
-        }
-    }
-
-    return field_width;
+    char buf[max_digits_of_u64];
+    size_t numlen = convert_unsigned_to_digits(number, buf, 8, false);
+    return print_digits(putch, bufptr, buf, numlen, left_pad, zero_pad, field_width);
 }
 
 template<typename PutChFunc>
@@ -8,8 +8,9 @@
 
 // includes
 #include <base/StdLibExtras.h>
+#include <base/Types.h>
 
-namespace AK {
+namespace Base {
 
 template<typename Collection, typename LessThan>
 void dual_pivot_quick_sort(Collection& col, int start, int end, LessThan less_than)
@@ -118,31 +119,455 @@ void single_pivot_quick_sort(Iterator start, Iterator end, LessThan less_than)
     }
 }
 
+namespace Detail {
+
+// Pattern-defeating quicksort, after Orson Peters' pdqsort: median of three
+// (or of nine) pivots, insertion sort for short ranges, a bounded number of
+// badly unbalanced partitions before falling back to heapsort, and a cheap
+// check for ranges that are already sorted.
+static constexpr size_t introsort_insertion_sort_threshold = 24;
+static constexpr size_t introsort_ninther_threshold = 128;
+static constexpr size_t introsort_partial_insertion_sort_limit = 8;
+static constexpr size_t introsort_block_size = 64;
+
+template<typename Iterator>
+struct IteratorSortRange {
+    Iterator start;
+    decltype(auto) operator[](size_t index) const { return *(start + index); }
+};
+
+template<typename Collection>
+using SortValueType = RemoveCVReference<decltype(declval<Collection&>()[0])>;
+
+// The block partition only pays off when comparing is cheap and can't
+// branch on its own.
+template<typename Collection>
+inline constexpr bool use_branchless_partition = IsArithmetic<SortValueType<Collection>> || IsPointer<SortValueType<Collection>>;
+
+template<typename Collection, typename LessThan>
+void insertion_sort(Collection& col, size_t begin, size_t end, LessThan& less_than)
+{
+    if (begin == end)
+        return;
+    for (size_t i = begin + 1; i < end; ++i) {
+        if (!less_than(col[i], col[i - 1]))
+            continue;
+        auto value = move(col[i]);
+        size_t j = i;
+        do {
+            col[j] = move(col[j - 1]);
+            --j;
+        } while (j != begin && less_than(value, col[j - 1]));
+        col[j] = move(value);
+    }
+}
+
+// Requires an element before begin that is no greater than anything in the
+// range to stop the scan.
+template<typename Collection, typename LessThan>
+void unguarded_insertion_sort(Collection& col, size_t begin, size_t end, LessThan& less_than)
+{
+    for (size_t i = begin + 1; i < end; ++i) {
+        if (!less_than(col[i], col[i - 1]))
+            continue;
+        auto value = move(col[i]);
+        size_t j = i;
+        do {
+            col[j] = move(col[j - 1]);
+            --j;
+        } while (less_than(value, col[j - 1]));
+        col[j] = move(value);
+    }
+}
+
+// Gives up, leaving the range partly sorted, once it had to move more than
+// a handful of elements.
+template<typename Collection, typename LessThan>
+bool partial_insertion_sort(Collection& col, size_t begin, size_t end, LessThan& less_than)
+{
+    if (begin == end)
+        return true;
+    size_t moves = 0;
+    for (size_t i = begin + 1; i < end; ++i) {
+        if (!less_than(col[i], col[i - 1]))
+            continue;
+        auto value = move(col[i]);
+        size_t j = i;
+        do {
+            col[j] = move(col[j - 1]);
+            --j;
+        } while (j != begin && less_than(value, col[j - 1]));
+        col[j] = move(value);
+        moves += i - j;
+        if (moves > introsort_partial_insertion_sort_limit)
+            return false;
+    }
+    return true;
+}
+
+template<typename Collection, typename LessThan>
+void heap_sort(Collection& col, size_t begin, size_t end, LessThan& less_than)
+{
+    auto sift_down = [&](size_t root, size_t size) {
+        for (;;) {
+            size_t child = 2 * root + 1;
+            if (child >= size)
+                return;
+            if (child + 1 < size && less_than(col[begin + child], col[begin + child + 1]))
+                ++child;
+            if (!less_than(col[begin + root], col[begin + child]))
+                return;
+            swap(col[begin + root], col[begin + child]);
+            root = child;
+        }
+    };
+
+    size_t size = end - begin;
+    for (size_t i = size / 2; i-- > 0;)
+        sift_down(i, size);
+    for (size_t i = size; i-- > 1;) {
+        swap(col[begin], col[begin + i]);
+        sift_down(0, i);
+    }
+}
+
+template<typename Collection, typename LessThan>
+ALWAYS_INLINE void sort2(Collection& col, size_t a, size_t b, LessThan& less_than)
+{
+    if (less_than(col[b], col[a]))
+        swap(col[a], col[b]);
+}
+
+template<typename Collection, typename LessThan>
+ALWAYS_INLINE void sort3(Collection& col, size_t a, size_t b, size_t c, LessThan& less_than)
+{
+    sort2(col, a, b, less_than);
+    sort2(col, b, c, less_than);
+    sort2(col, a, b, less_than);
+}
+
+// Moves the median of a few samples to begin, the pivot for the partitions
+// below.
+template<typename Collection, typename LessThan>
+void choose_pivot(Collection& col, size_t begin, size_t end, LessThan& less_than)
+{
+    size_t size = end - begin;
+    size_t half = size / 2;
+    if (size > introsort_ninther_threshold) {
+        sort3(col, begin, begin + half, end - 1, less_than);
+        sort3(col, begin + 1, begin + half - 1, end - 2, less_than);
+        sort3(col, begin + 2, begin + half + 1, end - 3, less_than);
+        sort3(col, begin + half - 1, begin + half, begin + half + 1, less_than);
+        swap(col[begin], col[begin + half]);
+    } else {
+        sort3(col, begin + half, begin, end - 1, less_than);
+    }
+}
+
+struct PartitionResult {
+    size_t pivot_position;
+    bool was_partitioned;
+};
+
+// Partitions around col[begin], with elements equal to the pivot going
+// right. Needs an element no smaller than the pivot at end - 1, which
+// choose_pivot leaves there.
+template<typename Collection, typename LessThan>
+PartitionResult partition_right(Collection& col, size_t begin, size_t end, LessThan& less_than)
+{
+    auto pivot = move(col[begin]);
+    size_t first = begin;
+    size_t last = end;
+
+    while (less_than(col[++first], pivot)) {
+    }
+    if (first - 1 == begin) {
+        while (first < last && !less_than(col[--last], pivot)) {
+        }
+    } else {
+        while (!less_than(col[--last], pivot)) {
+        }
+    }
+
+    bool was_partitioned = first >= last;
+    while (first < last) {
+        swap(col[first], col[last]);
+        while (less_than(col[++first], pivot)) {
+        }
+        while (!less_than(col[--last], pivot)) {
+        }
+    }
+
+    size_t pivot_position = first - 1;
+    col[begin] = move(col[pivot_position]);
+    col[pivot_position] = move(pivot);
+    return { pivot_position, was_partitioned };
+}
+
+template<typename Collection>
+ALWAYS_INLINE void swap_offsets(Collection& col, size_t left_base, size_t right_base, u8 const* left_offsets, u8 const* right_offsets, size_t count, bool use_swaps)
+{
+    if (use_swaps) {
+        // Descending input needs real swaps to stay linear.
+        for (size_t i = 0; i < count; ++i)
+            swap(col[left_base + left_offsets[i]], col[right_base - right_offsets[i]]);
+        return;
+    }
+    if (!count)
+        return;
+    // One cycle instead of count swaps.
+    size_t left = left_base + left_offsets[0];
+    size_t right = right_base - right_offsets[0];
+    auto value = move(col[left]);
+    col[left] = move(col[right]);
+    for (size_t i = 1; i < count; ++i) {
+        left = left_base + left_offsets[i];
+        col[right] = move(col[left]);
+        right = right_base - right_offsets[i];
+        col[left] = move(col[right]);
+    }
+    col[right] = move(value);
+}
+
+// Same contract as partition_right, but scans blocks of elements into
+// offset buffers without branching on the comparisons, after Edelkamp and
+// Weiss' BlockQuicksort.
+template<typename Collection, typename LessThan>
+PartitionResult partition_right_branchless(Collection& col, size_t begin, size_t end, LessThan& less_than)
+{
+    auto pivot = move(col[begin]);
+    size_t first = begin;
+    size_t last = end;
+
+    while (less_than(col[++first], pivot)) {
+    }
+    if (first - 1 == begin) {
+        while (first < last && !less_than(col[--last], pivot)) {
+        }
+    } else {
+        while (!less_than(col[--last], pivot)) {
+        }
+    }
+
+    bool was_partitioned = first >= last;
+    if (!was_partitioned) {
+        swap(col[first], col[last]);
+        ++first;
+
+        alignas(64) u8 left_offsets[introsort_block_size];
+        alignas(64) u8 right_offsets[introsort_block_size];
+        size_t left_base = first;
+        size_t right_base = last;
+        size_t left_count = 0;
+        size_t right_count = 0;
+        size_t left_start = 0;
+        size_t right_start = 0;
+
+        while (first < last) {
+            size_t unknown = last - first;
+            size_t left_split = left_count == 0 ? (right_count == 0 ? unknown / 2 : unknown) : 0;
+            size_t right_split = right_count == 0 ? unknown - left_split : 0;
+
+            if (left_split > introsort_block_size)
+                left_split = introsort_block_size;
+            for (size_t i = 0; i < left_split; ++i) {
+                left_offsets[left_count] = i;
+                left_count += !less_than(col[first], pivot);
+                ++first;
+            }
+
+            if (right_split > introsort_block_size)
+                right_split = introsort_block_size;
+            for (size_t i = 0; i < right_split;) {
+                right_offsets[right_count] = ++i;
+                right_count += less_than(col[--last], pivot);
+            }
+
+            size_t count = min(left_count, right_count);
+            swap_offsets(col, left_base, right_base, left_offsets + left_start, right_offsets + right_start, count, left_count == right_count);
+            left_count -= count;
+            right_count -= count;
+            left_start += count;
+            right_start += count;
+
+            if (left_count == 0) {
+                left_start = 0;
+                left_base = first;
+            }
+            if (right_count == 0) {
+                right_start = 0;
+                right_base = last;
+            }
+        }
+
+        // One side may still have misplaced elements, which all belong on
+        // the far end of what's left.
+        if (left_count) {
+            while (left_count--)
+                swap(col[left_base + left_offsets[left_start + left_count]], col[--last]);
+            first = last;
+        }
+        if (right_count) {
+            while (right_count--)
+                swap(col[right_base - right_offsets[right_start + right_count]], col[first++]);
+        }
+    }
+
+    size_t pivot_position = first - 1;
+    col[begin] = move(col[pivot_position]);
+    col[pivot_position] = move(pivot);
+    return { pivot_position, was_partitioned };
+}
+
+// Puts everything equal to the pivot on the left, used when the element
+// before the range is equal to the pivot, so those never need sorting
+// again.
+template<typename Collection, typename LessThan>
+size_t partition_left(Collection& col, size_t begin, size_t end, LessThan& less_than)
+{
+    auto pivot = move(col[begin]);
+    size_t first = begin;
+    size_t last = end;
+
+    while (less_than(pivot, col[--last])) {
+    }
+    if (last + 1 == end) {
+        while (first < last && !less_than(pivot, col[++first])) {
+        }
+    } else {
+        while (!less_than(pivot, col[++first])) {
+        }
+    }
+
+    while (first < last) {
+        swap(col[first], col[last]);
+        while (less_than(pivot, col[--last])) {
+        }
+        while (!less_than(pivot, col[++first])) {
+        }
+    }
+
+    col[begin] = move(col[last]);
+    col[last] = move(pivot);
+    return last;
+}
+
+// Scatters a few elements of a badly unbalanced side so the next pivot is
+// unlikely to be as bad.
+template<typename Collection>
+void break_patterns(Collection& col, size_t begin, size_t end)
+{
+    size_t size = end - begin;
+    if (size < introsort_insertion_sort_threshold)
+        return;
+    size_t quarter = size / 4;
+    swap(col[begin], col[begin + quarter]);
+    swap(col[end - 1], col[end - quarter]);
+    if (size > introsort_ninther_threshold) {
+        swap(col[begin + 1], col[begin + quarter + 1]);
+        swap(col[begin + 2], col[begin + quarter + 2]);
+        swap(col[end - 2], col[end - quarter - 1]);
+        swap(col[end - 3], col[end - quarter - 2]);
+    }
+}
+
+// leftmost is false when col[begin - 1] is known to be no greater than
+// anything in the range.
+template<typename Collection, typename LessThan>
+void introsort(Collection& col, size_t begin, size_t end, LessThan& less_than, int bad_partitions_allowed, bool leftmost)
+{
+    for (;;) {
+        size_t size = end - begin;
+        if (size < introsort_insertion_sort_threshold) {
+            if (leftmost)
+                insertion_sort(col, begin, end, less_than);
+            else
+                unguarded_insertion_sort(col, begin, end, less_than);
+            return;
+        }
+
+        choose_pivot(col, begin, end, less_than);
+
+        // The pivot equals the element before the range, so nothing in the
+        // range is smaller and everything equal to it is already in place.
+        if (!leftmost && !less_than(col[begin - 1], col[begin])) {
+            begin = partition_left(col, begin, end, less_than) + 1;
+            continue;
+        }
+
+        PartitionResult result;
+        if constexpr (use_branchless_partition<Collection>)
+            result = partition_right_branchless(col, begin, end, less_than);
+        else
+            result = partition_right(col, begin, end, less_than);
+        size_t pivot_position = result.pivot_position;
+
+        size_t left_size = pivot_position - begin;
+        size_t right_size = end - (pivot_position + 1);
+        if (left_size < size / 8 || right_size < size / 8) {
+            if (--bad_partitions_allowed == 0) {
+                heap_sort(col, begin, end, less_than);
+                return;
+            }
+            break_patterns(col, begin, pivot_position);
+            break_patterns(col, pivot_position + 1, end);
+        } else if (result.was_partitioned
+            && partial_insertion_sort(col, begin, pivot_position, less_than)
+            && partial_insertion_sort(col, pivot_position + 1, end, less_than)) {
+            return;
+        }
+
+        introsort(col, begin, pivot_position, less_than, bad_partitions_allowed, leftmost);
+        begin = pivot_position + 1;
+        leftmost = false;
+    }
+}
+
+inline int introsort_bad_partitions_allowed(size_t size)
+{
+    int log2 = 0;
+    while (size >>= 1)
+        ++log2;
+    return log2;
+}
+
+}
+
+template<typename Collection, typename LessThan>
+void introsort(Collection& col, size_t begin, size_t end, LessThan less_than)
+{
+    if (end - begin < 2)
+        return;
+    Detail::introsort(col, begin, end, less_than, Detail::introsort_bad_partitions_allowed(end - begin), true);
+}
+
 template<typename Iterator>
 void quick_sort(Iterator start, Iterator end)
 {
-    single_pivot_quick_sort(start, end, [](auto& a, auto& b) { return a < b; });
+    Detail::IteratorSortRange<Iterator> range { start };
+    introsort(range, 0, end - start, [](auto& a, auto& b) { return a < b; });
 }
 
 template<typename Iterator, typename LessThan>
 void quick_sort(Iterator start, Iterator end, LessThan less_than)
 {
-    single_pivot_quick_sort(start, end, move(less_than));
+    Detail::IteratorSortRange<Iterator> range { start };
+    introsort(range, 0, end - start, move(less_than));
 }
 
 template<typename Collection, typename LessThan>
 void quick_sort(Collection& collection, LessThan less_than)
 {
-    dual_pivot_quick_sort(collection, 0, collection.size() - 1, move(less_than));
+    introsort(collection, 0, collection.size(), move(less_than));
 }
 
 template<typename Collection>
 void quick_sort(Collection& collection)
 {
-    dual_pivot_quick_sort(collection, 0, collection.size() - 1,
-                          [](auto& a, auto& b) { return a < b; });
+    introsort(collection, 0, collection.size(), [](auto& a, auto& b) { return a < b; });
 }
 
 }
 
-using Base::quick_sort;
\ No newline at end of file
+using Base::introsort;
+using Base::quick_sort;
@@ -0,0 +1,546 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Noncopyable.h>
+#include <base/Optional.h>
+#include <base/SIMD.h>
+#include <base/Span.h>
+#include <base/StdLibExtras.h>
+#include <base/Types.h>
+#include <base/Vector.h>
+
+namespace Base {
+
+// A Trie over byte strings, laid out as an adaptive radix tree (Leis et
+// al.): a node stores up to 4, 16 or 48 children in small arrays and grows
+// into the next layout when they fill up, and chains of single-child nodes
+// are collapsed into a prefix on the node below, so a lookup touches one
+// node per branching byte instead of hashing at every byte.
+//
+// Every node stands for the key made of all the prefixes and branch bytes
+// on its path and can carry metadata. Inserting can move nodes, so
+// references into the trie are only good until the next insert.
+template<typename MetadataT>
+class RadixTrie {
+    BASE_MAKE_NONCOPYABLE(RadixTrie);
+    BASE_MAKE_NONMOVABLE(RadixTrie);
+
+public:
+    using MetadataType = MetadataT;
+
+    class Node {
+        BASE_MAKE_NONCOPYABLE(Node);
+        BASE_MAKE_NONMOVABLE(Node);
+
+    public:
+        [[nodiscard]] bool has_metadata() const { return m_metadata.has_value(); }
+        Optional<MetadataType> const& metadata() const { return m_metadata; }
+        MetadataType const& metadata_value() const { return m_metadata.value(); }
+        void set_metadata(MetadataType metadata) { m_metadata = move(metadata); }
+        void clear_metadata() { m_metadata.clear(); }
+
+        [[nodiscard]] size_t child_count() const { return m_child_count; }
+
+    private:
+        friend class RadixTrie;
+
+        enum class Kind : u8 {
+            Node4,
+            Node16,
+            Node48,
+            Node256,
+        };
+
+        explicit Node(Kind kind)
+            : m_kind(kind)
+        {
+        }
+
+        ~Node()
+        {
+            if (m_prefix_length > max_inline_prefix_length)
+                delete[] m_heap_prefix;
+        }
+
+        u8 const* prefix() const { return m_prefix_length > max_inline_prefix_length ? m_heap_prefix : m_inline_prefix; }
+
+        // bytes may point into the current prefix.
+        void set_prefix(u8 const* bytes, size_t length)
+        {
+            u8* old_heap_prefix = m_prefix_length > max_inline_prefix_length ? m_heap_prefix : nullptr;
+            if (length > max_inline_prefix_length) {
+                auto* heap_prefix = new u8[length];
+                __builtin_memcpy(heap_prefix, bytes, length);
+                m_heap_prefix = heap_prefix;
+            } else if (length) {
+                __builtin_memmove(m_inline_prefix, bytes, length);
+            }
+            m_prefix_length = length;
+            delete[] old_heap_prefix;
+        }
+
+        void take_prefix_from(Node& other)
+        {
+            m_prefix_length = other.m_prefix_length;
+            if (m_prefix_length > max_inline_prefix_length)
+                m_heap_prefix = other.m_heap_prefix;
+            else
+                __builtin_memcpy(m_inline_prefix, other.m_inline_prefix, m_prefix_length);
+            other.m_prefix_length = 0;
+        }
+
+        static constexpr size_t max_inline_prefix_length = 14;
+
+        Kind m_kind;
+        u16 m_child_count { 0 };
+        u32 m_prefix_length { 0 };
+        union {
+            u8 m_inline_prefix[max_inline_prefix_length];
+            u8* m_heap_prefix;
+        };
+        Optional<MetadataType> m_metadata;
+    };
+
+    RadixTrie()
+        : m_root(new Node4)
+    {
+    }
+
+    ~RadixTrie()
+    {
+        destroy(m_root);
+    }
+
+    Node& root() { return *m_root; }
+    Node const& root() const { return *m_root; }
+
+    [[nodiscard]] bool is_empty() const { return !m_root->m_child_count && !m_root->has_metadata(); }
+
+    void clear()
+    {
+        destroy(m_root);
+        m_root = new Node4;
+    }
+
+    // Advances it past the key of the deepest node that is a prefix of
+    // [it, end) and returns that node.
+    template<typename It>
+    Node& traverse_until_last_accessible_node(It& it, It const& end)
+    {
+        Node* node = m_root;
+        while (it != end) {
+            auto* slot = find_child(*node, static_cast<u8>(*it));
+            if (!slot)
+                break;
+            Node* child = *slot;
+            auto next = it;
+            ++next;
+            if (!matches_whole_prefix(*child, next, end))
+                break;
+            it = next;
+            node = child;
+        }
+        return *node;
+    }
+
+    template<typename It>
+    Node const& traverse_until_last_accessible_node(It& it, It const& end) const { return const_cast<RadixTrie*>(this)->traverse_until_last_accessible_node(it, end); }
+
+    template<typename It>
+    Node& traverse_until_last_accessible_node(It const& begin, It const& end)
+    {
+        auto it = begin;
+        return traverse_until_last_accessible_node(it, end);
+    }
+
+    template<typename It>
+    Node const& traverse_until_last_accessible_node(It const& begin, It const& end) const
+    {
+        auto it = begin;
+        return const_cast<RadixTrie*>(this)->traverse_until_last_accessible_node(it, end);
+    }
+
+    // Returns the node for exactly [begin, end), making it and splitting
+    // compressed prefixes as needed.
+    template<typename It>
+    Node& insert(It& it, It const& end)
+    {
+        Node** slot = &m_root;
+        for (;;) {
+            Node* node = *slot;
+            size_t matched = 0;
+            auto* prefix = node->prefix();
+            while (matched < node->m_prefix_length && it != end && prefix[matched] == static_cast<u8>(*it)) {
+                ++matched;
+                ++it;
+            }
+
+            if (matched < node->m_prefix_length) {
+                // The key leaves the prefix partway, so what's matched so far
+                // becomes a node of its own above the old one.
+                Node* split = new Node4;
+                split->set_prefix(prefix, matched);
+                u8 old_byte = prefix[matched];
+                node->set_prefix(prefix + matched + 1, node->m_prefix_length - matched - 1);
+                add_child(split, old_byte, node);
+                *slot = split;
+                if (it == end)
+                    return *split;
+                return add_leaf(*slot, it, end);
+            }
+
+            if (it == end)
+                return *node;
+
+            auto* child_slot = find_child(*node, static_cast<u8>(*it));
+            if (!child_slot)
+                return add_leaf(*slot, it, end);
+            ++it;
+            slot = child_slot;
+        }
+    }
+
+    template<typename It>
+    Node& insert(It const& begin, It const& end)
+    {
+        auto it = begin;
+        return insert(it, end);
+    }
+
+    template<typename It>
+    Node& insert(It const& begin, It const& end, MetadataType metadata)
+    {
+        auto& node = insert(begin, end);
+        node.set_metadata(move(metadata));
+        return node;
+    }
+
+    template<typename It>
+    Node* find(It const& begin, It const& end)
+    {
+        auto it = begin;
+        auto& node = traverse_until_last_accessible_node(it, end);
+        if (it != end || !node.has_metadata())
+            return nullptr;
+        return &node;
+    }
+
+    template<typename It>
+    Node const* find(It const& begin, It const& end) const { return const_cast<RadixTrie*>(this)->find(begin, end); }
+
+    // The node with metadata whose key is the longest prefix of [begin,
+    // end), the usual question for path and URL tables.
+    template<typename It>
+    Node* longest_prefix_match(It const& begin, It const& end)
+    {
+        Node* node = m_root;
+        Node* best = node->has_metadata() ? node : nullptr;
+        auto it = begin;
+        while (it != end) {
+            auto* slot = find_child(*node, static_cast<u8>(*it));
+            if (!slot)
+                break;
+            auto next = it;
+            ++next;
+            if (!matches_whole_prefix(**slot, next, end))
+                break;
+            it = next;
+            node = *slot;
+            if (node->has_metadata())
+                best = node;
+        }
+        return best;
+    }
+
+    template<typename It>
+    Node const* longest_prefix_match(It const& begin, It const& end) const { return const_cast<RadixTrie*>(this)->longest_prefix_match(begin, end); }
+
+    // Calls callback(key, node) for every node with metadata, in byte order
+    // of the keys.
+    template<typename Callback>
+    void for_each(Callback callback) const
+    {
+        Vector<u8> key;
+        for_each(*m_root, key, callback);
+    }
+
+private:
+    using Kind = typename Node::Kind;
+
+    struct Node4 : Node {
+        Node4()
+            : Node(Kind::Node4)
+        {
+        }
+        u8 keys[4];
+        Node* children[4];
+    };
+
+    struct Node16 : Node {
+        Node16()
+            : Node(Kind::Node16)
+        {
+        }
+        u8 keys[16];
+        Node* children[16];
+    };
+
+    struct Node48 : Node {
+        Node48()
+            : Node(Kind::Node48)
+        {
+            __builtin_memset(child_index, 0, sizeof(child_index));
+        }
+        // One more than the index into children, 0 if there is no child.
+        u8 child_index[256];
+        Node* children[48];
+    };
+
+    struct Node256 : Node {
+        Node256()
+            : Node(Kind::Node256)
+        {
+            __builtin_memset(children, 0, sizeof(children));
+        }
+        Node* children[256];
+    };
+
+    template<typename It>
+    static bool matches_whole_prefix(Node const& node, It& it, It const& end)
+    {
+        auto* prefix = node.prefix();
+        for (size_t i = 0; i < node.m_prefix_length; ++i, ++it) {
+            if (it == end || prefix[i] != static_cast<u8>(*it))
+                return false;
+        }
+        return true;
+    }
+
+    static Node** find_child(Node& node, u8 byte)
+    {
+        switch (node.m_kind) {
+        case Kind::Node4: {
+            auto& node4 = static_cast<Node4&>(node);
+            for (size_t i = 0; i < node.m_child_count; ++i) {
+                if (node4.keys[i] == byte)
+                    return &node4.children[i];
+            }
+            return nullptr;
+        }
+        case Kind::Node16: {
+            auto& node16 = static_cast<Node16&>(node);
+#ifdef __SSE2__
+            SIMD::u8x16 keys;
+            __builtin_memcpy(&keys, node16.keys, sizeof(keys));
+            SIMD::u8x16 splat = SIMD::u8x16 {} + byte;
+            u32 mask = (u16)__builtin_ia32_pmovmskb128((SIMD::c8x16)(keys == splat));
+            mask &= (1u << node.m_child_count) - 1;
+            if (!mask)
+                return nullptr;
+            return &node16.children[__builtin_ctz(mask)];
+#else
+            for (size_t i = 0; i < node.m_child_count; ++i) {
+                if (node16.keys[i] == byte)
+                    return &node16.children[i];
+            }
+            return nullptr;
+#endif
+        }
+        case Kind::Node48: {
+            auto& node48 = static_cast<Node48&>(node);
+            auto index = node48.child_index[byte];
+            return index ? &node48.children[index - 1] : nullptr;
+        }
+        case Kind::Node256: {
+            auto& node256 = static_cast<Node256&>(node);
+            return node256.children[byte] ? &node256.children[byte] : nullptr;
+        }
+        }
+        VERIFY_NOT_REACHED();
+    }
+
+    // The byte-ordered layouts keep their keys sorted so for_each can walk
+    // them in order.
+    template<typename SmallNode>
+    static void insert_sorted(SmallNode& node, u8 byte, Node* child)
+    {
+        size_t position = 0;
+        while (position < node.m_child_count && node.keys[position] < byte)
+            ++position;
+        for (size_t i = node.m_child_count; i > position; --i) {
+            node.keys[i] = node.keys[i - 1];
+            node.children[i] = node.children[i - 1];
+        }
+        node.keys[position] = byte;
+        node.children[position] = child;
+        ++node.m_child_count;
+    }
+
+    template<typename Grown>
+    static Grown* start_growing(Node& node)
+    {
+        auto* grown = new Grown;
+        grown->take_prefix_from(node);
+        grown->m_metadata = move(node.m_metadata);
+        grown->m_child_count = node.m_child_count;
+        return grown;
+    }
+
+    // May replace the node at slot with a bigger layout.
+    static void add_child(Node*& slot, u8 byte, Node* child)
+    {
+        Node* node = slot;
+        switch (node->m_kind) {
+        case Kind::Node4: {
+            auto& node4 = static_cast<Node4&>(*node);
+            if (node->m_child_count < 4) {
+                insert_sorted(node4, byte, child);
+                return;
+            }
+            auto* grown = start_growing<Node16>(*node);
+            __builtin_memcpy(grown->keys, node4.keys, sizeof(node4.keys));
+            __builtin_memcpy(grown->children, node4.children, sizeof(node4.children));
+            delete &node4;
+            slot = grown;
+            insert_sorted(*grown, byte, child);
+            return;
+        }
+        case Kind::Node16: {
+            auto& node16 = static_cast<Node16&>(*node);
+            if (node->m_child_count < 16) {
+                insert_sorted(node16, byte, child);
+                return;
+            }
+            auto* grown = start_growing<Node48>(*node);
+            for (size_t i = 0; i < 16; ++i) {
+                grown->child_index[node16.keys[i]] = i + 1;
+                grown->children[i] = node16.children[i];
+            }
+            delete &node16;
+            slot = grown;
+            add_child(slot, byte, child);
+            return;
+        }
+        case Kind::Node48: {
+            auto& node48 = static_cast<Node48&>(*node);
+            if (node->m_child_count < 48) {
+                node48.children[node->m_child_count] = child;
+                node48.child_index[byte] = static_cast<u8>(++node->m_child_count);
+                return;
+            }
+            auto* grown = start_growing<Node256>(*node);
+            for (size_t i = 0; i < 256; ++i) {
+                if (auto index = node48.child_index[i])
+                    grown->children[i] = node48.children[index - 1];
+            }
+            delete &node48;
+            slot = grown;
+            add_child(slot, byte, child);
+            return;
+        }
+        case Kind::Node256: {
+            auto& node256 = static_cast<Node256&>(*node);
+            node256.children[byte] = child;
+            ++node->m_child_count;
+            return;
+        }
+        }
+        VERIFY_NOT_REACHED();
+    }
+
+    // Hangs the rest of the key, which starts at the byte to branch on, off
+    // the node at slot as a single node carrying it as its prefix.
+    template<typename It>
+    static Node& add_leaf(Node*& slot, It& it, It const& end)
+    {
+        u8 byte = static_cast<u8>(*it);
+        ++it;
+        Vector<u8, Node::max_inline_prefix_length> rest;
+        for (; it != end; ++it)
+            rest.append(static_cast<u8>(*it));
+        auto* leaf = new Node4;
+        leaf->set_prefix(rest.data(), rest.size());
+        add_child(slot, byte, leaf);
+        return *leaf;
+    }
+
+    template<typename Callback>
+    static void for_each_child(Node& node, Callback callback)
+    {
+        switch (node.m_kind) {
+        case Kind::Node4: {
+            auto& node4 = static_cast<Node4&>(node);
+            for (size_t i = 0; i < node.m_child_count; ++i)
+                callback(node4.keys[i], *node4.children[i]);
+            return;
+        }
+        case Kind::Node16: {
+            auto& node16 = static_cast<Node16&>(node);
+            for (size_t i = 0; i < node.m_child_count; ++i)
+                callback(node16.keys[i], *node16.children[i]);
+            return;
+        }
+        case Kind::Node48: {
+            auto& node48 = static_cast<Node48&>(node);
+            for (size_t i = 0; i < 256; ++i) {
+                if (auto index = node48.child_index[i])
+                    callback(static_cast<u8>(i), *node48.children[index - 1]);
+            }
+            return;
+        }
+        case Kind::Node256: {
+            auto& node256 = static_cast<Node256&>(node);
+            for (size_t i = 0; i < 256; ++i) {
+                if (node256.children[i])
+                    callback(static_cast<u8>(i), *node256.children[i]);
+            }
+            return;
+        }
+        }
+    }
+
+    template<typename Callback>
+    static void for_each(Node& node, Vector<u8>& key, Callback& callback)
+    {
+        if (node.has_metadata())
+            callback(ReadonlyBytes { key.data(), key.size() }, static_cast<Node const&>(node));
+        for_each_child(node, [&](u8 byte, Node& child) {
+            auto length = key.size();
+            key.append(byte);
+            key.append(child.prefix(), child.m_prefix_length);
+            for_each(child, key, callback);
+            key.shrink(length);
+        });
+    }
+
+    static void destroy(Node* node)
+    {
+        for_each_child(*node, [](u8, Node& child) { destroy(&child); });
+        switch (node->m_kind) {
+        case Kind::Node4:
+            delete static_cast<Node4*>(node);
+            return;
+        case Kind::Node16:
+            delete static_cast<Node16*>(node);
+            return;
+        case Kind::Node48:
+            delete static_cast<Node48*>(node);
+            return;
+        case Kind::Node256:
+            delete static_cast<Node256*>(node);
+            return;
+        }
+    }
+
+    Node* m_root { nullptr };
+};
+
+}
+
+using Base::RadixTrie;
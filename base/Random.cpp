@@ -7,8 +7,60 @@
 // includes
 #include <base/Random.h>
 
+#ifdef KERNEL
+#    include <kernel/ProcessorRandom.h>
+#else
+#    include <base/ChaCha20Random.h>
+#    include <pthread.h>
+#    include <string.h>
+#    if defined(__pranaos__)
+#        include <stdlib.h>
+#    endif
+#    if defined(__unix__)
+#        include <unistd.h>
+#    endif
+#    if defined(__APPLE__)
+#        include <sys/random.h>
+#    endif
+#endif
+
 namespace Base {
 
+#ifndef KERNEL
+static thread_local ChaCha20Random t_random;
+
+static void seed_thread_random()
+{
+    // A forked child starts out with its parent's generator, which would
+    // hand out the very bytes the parent does next.
+    [[maybe_unused]] static bool s_fork_handler_registered = [] {
+        pthread_atfork(nullptr, nullptr, [] { t_random.reset(); });
+        return true;
+    }();
+
+    u8 seed[ChaCha20Random::seed_size] {};
+#    if defined(__pranaos__)
+    arc4random_buf(seed, sizeof(seed));
+#    elif defined(OSS_FUZZ)
+#    elif defined(__unix__) or defined(__APPLE__)
+    [[maybe_unused]] int rc = getentropy(seed, sizeof(seed));
+#    endif
+    t_random.seed(seed);
+    memset(seed, 0, sizeof(seed));
+}
+#endif
+
+void fill_with_random(void* buffer, size_t length)
+{
+#ifdef KERNEL
+    Kernel::fill_with_processor_random(buffer, length);
+#else
+    if (t_random.needs_seed())
+        seed_thread_random();
+    t_random.fill(buffer, length);
+#endif
+}
+
 u32 get_random_uniform(u32 max_bounds)
 {
     const u32 max_usable = UINT32_MAX - (static_cast<u64>(UINT32_MAX) + 1) % max_bounds;
@@ -20,4 +72,4 @@ u32 get_random_uniform(u32 max_bounds)
     return random_value % max_bounds;
 }
 
-}
\ No newline at end of file
+}
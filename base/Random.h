@@ -10,29 +10,12 @@
 #include <base/Platform.h>
 #include <base/Types.h>
 
-#if defined(__pranaos__)
-#    include <stdlib.h>
-#endif
-
-#if defined(__unix__)
-#    include <unistd.h>
-#endif
-
-#if defined(__APPLE__)
-#    include <sys/random.h>
-#endif
-
 namespace Base {
 
-inline void fill_with_random([[maybe_unused]] void* buffer, [[maybe_unused]] size_t length)
-{
-#if defined(__pranaos__)
-    arc4random_buf(buffer, length);
-#elif defined(OSS_FUZZ)
-#elif defined(__unix__) or defined(__APPLE__)
-    [[maybe_unused]] int rc = getentropy(buffer, length);
-#endif
-}
+// Cryptographically secure random bytes. They come from a ChaCha20Random
+// per thread, or per CPU in the kernel, which the system's random source
+// seeds, so most calls never leave the process.
+void fill_with_random(void* buffer, size_t length);
 
 template<typename T>
 inline T get_random()
@@ -48,4 +31,4 @@ u32 get_random_uniform(u32 max_bounds);
 
 using Base::fill_with_random;
 using Base::get_random;
-using Base::get_random_uniform;
\ No newline at end of file
+using Base::get_random_uniform;
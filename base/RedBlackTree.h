@@ -8,6 +8,9 @@
 
 // includes
 #include <base/Concepts.h>
+#include <base/Noncopyable.h>
+#include <base/NumericLimits.h>
+#include <base/kmalloc.h>
 
 namespace Base {
 
@@ -120,6 +123,22 @@ protected:
         return candidate;
     }
 
+    static Node* find_smallest_not_below(Node* node, K key)
+    {
+        Node* candidate = nullptr;
+        while (node) {
+            if (key == node->key) {
+                return node;
+            } else if (node->key < key) {
+                node = node->right_child;
+            } else {
+                candidate = node;
+                node = node->left_child;
+            }
+        }
+        return candidate;
+    }
+
     void insert(Node* node)
     {
         VERIFY(node);
@@ -138,6 +157,7 @@ protected:
             m_root = node;
             m_size = 1;
             m_minimum = node;
+            m_maximum = node;
             return;
         } else if (node->key < parent->key) { 
             parent->left_child = node;
@@ -152,6 +172,8 @@ protected:
         m_size++;
         if (m_minimum->left_child == node)
             m_minimum = node;
+        if (m_maximum->right_child == node)
+            m_maximum = node;
     }
 
     void insert_fixups(Node* node)
@@ -202,12 +224,16 @@ protected:
 
         if (m_size == 1) {
             m_root = nullptr;
+            m_minimum = nullptr;
+            m_maximum = nullptr;
             m_size = 0;
             return;
         }
 
         if (m_minimum == node)
             m_minimum = successor(node);
+        if (m_maximum == node)
+            m_maximum = predecessor(node);
 
         if (node->left_child && node->right_child) {
             auto* successor_node = successor(node); 
@@ -363,9 +389,55 @@ protected:
         }
     }
 
+    // Builds a balanced tree out of count nodes that make_node() hands out
+    // in ascending key order. Every node on the last, partly filled level
+    // is red, which gives each path the same number of black nodes.
+    template<typename MakeNode>
+    static Node* link_sorted(size_t count, size_t depth, size_t red_depth, MakeNode& make_node)
+    {
+        if (!count)
+            return nullptr;
+        size_t middle = count / 2;
+        auto* left = link_sorted(middle, depth + 1, red_depth, make_node);
+        auto* node = make_node();
+        node->color = depth == red_depth ? Color::Red : Color::Black;
+        node->left_child = left;
+        if (left)
+            left->parent = node;
+        auto* right = link_sorted(count - middle - 1, depth + 1, red_depth, make_node);
+        node->right_child = right;
+        if (right)
+            right->parent = node;
+        return node;
+    }
+
+    template<typename MakeNode>
+    void link_sorted(size_t count, MakeNode make_node)
+    {
+        VERIFY(!m_root);
+        if (!count)
+            return;
+        size_t full_levels = 1;
+        while ((static_cast<size_t>(2) << full_levels) - 1 <= count)
+            ++full_levels;
+        // A perfect tree has no partial level to color red.
+        size_t red_depth = (static_cast<size_t>(1) << full_levels) - 1 == count ? NumericLimits<size_t>::max() : full_levels;
+        m_root = link_sorted(count, 0, red_depth, make_node);
+        m_root->parent = nullptr;
+        m_root->color = Color::Black;
+        m_size = count;
+        m_minimum = m_root;
+        while (m_minimum->left_child)
+            m_minimum = m_minimum->left_child;
+        m_maximum = m_root;
+        while (m_maximum->right_child)
+            m_maximum = m_maximum->right_child;
+    }
+
     Node* m_root { nullptr };
     size_t m_size { 0 };
-    Node* m_minimum { nullptr }; 
+    Node* m_minimum { nullptr };
+    Node* m_maximum { nullptr };
 };
 
 template<typename TreeType, typename ElementType>
@@ -414,6 +486,11 @@ public:
     virtual ~RedBlackTree() override
     {
         clear();
+        while (m_pooled_nodes) {
+            auto* pooled = m_pooled_nodes;
+            m_pooled_nodes = pooled->next;
+            kfree_sized(pooled, sizeof(Node));
+        }
     }
 
     using BaseTree = BaseRedBlackTree<K>;
@@ -434,6 +511,14 @@ public:
         return &node->value;
     }
 
+    [[nodiscard]] V* find_smallest_not_below(K key)
+    {
+        auto* node = static_cast<Node*>(BaseTree::find_smallest_not_below(this->m_root, key));
+        if (!node)
+            return nullptr;
+        return &node->value;
+    }
+
     void insert(K key, const V& value)
     {
         insert(key, V(value));
@@ -441,10 +526,46 @@ public:
 
     [[nodiscard]] bool try_insert(K key, V&& value)
     {
-        auto* node = new (nothrow) Node(key, move(value));
-        if (!node)
+        auto* storage = allocate_node_storage();
+        if (!storage)
             return false;
-        BaseTree::insert(node);
+        BaseTree::insert(new (storage) Node(key, move(value)));
+        return true;
+    }
+
+    // Makes sure the next count inserts, or a build of count elements,
+    // won't have to allocate.
+    [[nodiscard]] bool try_reserve_nodes(size_t count)
+    {
+        while (m_pooled_node_count < count) {
+            auto* storage = kmalloc(sizeof(Node));
+            if (!storage)
+                return false;
+            pool_node_storage(storage);
+        }
+        return true;
+    }
+
+    // Replaces the contents with count elements in O(count), without any
+    // rebalancing. next(key) is called count times and must hand out the
+    // elements in ascending key order, filling in key and returning the
+    // value.
+    template<typename Callback>
+    [[nodiscard]] bool try_build_from_sorted(size_t count, Callback next)
+    {
+        clear();
+        if (!try_reserve_nodes(count))
+            return false;
+        [[maybe_unused]] K previous_key {};
+        bool is_first = true;
+        this->link_sorted(count, [&]() -> typename BaseTree::Node* {
+            K key {};
+            V value = next(key);
+            VERIFY(is_first || previous_key <= key);
+            previous_key = key;
+            is_first = false;
+            return new (allocate_node_storage()) Node(key, move(value));
+        });
         return true;
     }
 
@@ -457,18 +578,44 @@ public:
     using Iterator = RedBlackTreeIterator<RedBlackTree, V>;
     friend Iterator;
     Iterator begin() { return Iterator(static_cast<Node*>(this->m_minimum)); }
-    Iterator end() { return {}; }
+    Iterator end() { return Iterator(nullptr, static_cast<Node*>(this->m_maximum)); }
     Iterator begin_from(K key) { return Iterator(static_cast<Node*>(BaseTree::find(this->m_root, key))); }
 
     using ConstIterator = RedBlackTreeIterator<const RedBlackTree, const V>;
     friend ConstIterator;
     ConstIterator begin() const { return ConstIterator(static_cast<Node*>(this->m_minimum)); }
-    ConstIterator end() const { return {}; }
+    ConstIterator end() const { return ConstIterator(nullptr, static_cast<Node*>(this->m_maximum)); }
     ConstIterator begin_from(K key) const { return ConstIterator(static_cast<Node*>(BaseTree::find(this->m_root, key))); }
 
+    Iterator find_largest_not_above_iterator(K key)
+    {
+        auto node = static_cast<Node*>(BaseTree::find_largest_not_above(this->m_root, key));
+        if (!node)
+            return end();
+        return Iterator(node, static_cast<Node*>(BaseTree::predecessor(node)));
+    }
+
     ConstIterator find_largest_not_above_iterator(K key) const
     {
         auto node = static_cast<Node*>(BaseTree::find_largest_not_above(this->m_root, key));
+        if (!node)
+            return end();
+        return ConstIterator(node, static_cast<Node*>(BaseTree::predecessor(node)));
+    }
+
+    Iterator find_smallest_not_below_iterator(K key)
+    {
+        auto node = static_cast<Node*>(BaseTree::find_smallest_not_below(this->m_root, key));
+        if (!node)
+            return end();
+        return Iterator(node, static_cast<Node*>(BaseTree::predecessor(node)));
+    }
+
+    ConstIterator find_smallest_not_below_iterator(K key) const
+    {
+        auto node = static_cast<Node*>(BaseTree::find_smallest_not_below(this->m_root, key));
+        if (!node)
+            return end();
         return ConstIterator(node, static_cast<Node*>(BaseTree::predecessor(node)));
     }
 
@@ -481,9 +628,7 @@ public:
 
         V temp = move(static_cast<Node*>(node)->value);
 
-        node->right_child = nullptr;
-        node->left_child = nullptr;
-        delete node;
+        release_node(static_cast<Node*>(node));
 
         return temp;
     }
@@ -496,20 +641,38 @@ public:
 
         BaseTree::remove(node);
 
-        node->right_child = nullptr;
-        node->left_child = nullptr;
-        delete node;
+        release_node(static_cast<Node*>(node));
 
         return true;
     }
 
     void clear()
     {
-        if (this->m_root) {
-            delete this->m_root;
-            this->m_root = nullptr;
+        // Walk down to a leaf, release it, and continue from its parent, so
+        // deep trees don't recurse.
+        auto* node = this->m_root;
+        while (node) {
+            if (node->left_child) {
+                node = node->left_child;
+                continue;
+            }
+            if (node->right_child) {
+                node = node->right_child;
+                continue;
+            }
+            auto* parent = node->parent;
+            if (parent) {
+                if (parent->left_child == node)
+                    parent->left_child = nullptr;
+                else
+                    parent->right_child = nullptr;
+            }
+            release_node(static_cast<Node*>(node));
+            node = parent;
         }
+        this->m_root = nullptr;
         this->m_minimum = nullptr;
+        this->m_maximum = nullptr;
         this->m_size = 0;
     }
 
@@ -523,15 +686,46 @@ private:
             , value(move(value))
         {
         }
+    };
 
-        ~Node()
-        {
-            if (this->left_child)
-                delete this->left_child;
-            if (this->right_child)
-                delete this->right_child;
-        }
+    // Removed nodes are kept for later inserts instead of going back to
+    // kmalloc, so a tree that churns around the same size, like a process'
+    // regions under mmap and munmap, stops allocating.
+    static constexpr size_t max_pooled_nodes = 64;
+
+    struct PooledNode {
+        PooledNode* next;
     };
+    static_assert(sizeof(PooledNode) <= sizeof(Node));
+
+    void* allocate_node_storage()
+    {
+        if (!m_pooled_nodes)
+            return kmalloc(sizeof(Node));
+        auto* pooled = m_pooled_nodes;
+        m_pooled_nodes = pooled->next;
+        --m_pooled_node_count;
+        return pooled;
+    }
+
+    void pool_node_storage(void* storage)
+    {
+        auto* pooled = new (storage) PooledNode { m_pooled_nodes };
+        m_pooled_nodes = pooled;
+        ++m_pooled_node_count;
+    }
+
+    void release_node(Node* node)
+    {
+        node->~Node();
+        if (m_pooled_node_count < max_pooled_nodes)
+            pool_node_storage(node);
+        else
+            kfree_sized(node, sizeof(Node));
+    }
+
+    PooledNode* m_pooled_nodes { nullptr };
+    size_t m_pooled_node_count { 0 };
 };
 
 }
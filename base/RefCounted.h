@@ -40,6 +40,16 @@ constexpr auto call_one_ref_left_if_present(...) -> FalseType
     return {};
 }
 
+// Whether references to an object may be taken and dropped from more than
+// one thread. Single counts with plain increments, and RefPtr and
+// NonnullRefPtr skip the atomics on their pointer slot too, so only use it
+// for objects that never leave their thread, like the nodes of a tree built
+// and torn down in one place.
+enum class ThreadSafety {
+    Multi,
+    Single,
+};
+
 class RefCountedBase {
     BASE_MAKE_NONCOPYABLE(RefCountedBase);
     BASE_MAKE_NONMOVABLE(RefCountedBase);
@@ -47,6 +57,7 @@ class RefCountedBase {
 public:
     using RefCountType = unsigned int;
     using AllowOwnPtr = FalseType;
+    static constexpr bool is_single_threaded_ref_counted = false;
 
     void ref() const
     {
@@ -89,12 +100,60 @@ protected:
     mutable Atomic<RefCountType> m_ref_count { 1 };
 };
 
+class SingleThreadedRefCountedBase {
+    BASE_MAKE_NONCOPYABLE(SingleThreadedRefCountedBase);
+    BASE_MAKE_NONMOVABLE(SingleThreadedRefCountedBase);
+
+public:
+    using RefCountType = unsigned int;
+    using AllowOwnPtr = FalseType;
+    static constexpr bool is_single_threaded_ref_counted = true;
+
+    ALWAYS_INLINE void ref() const
+    {
+        VERIFY(m_ref_count > 0);
+        VERIFY(!Checked<RefCountType>::addition_would_overflow(m_ref_count, 1));
+        ++m_ref_count;
+    }
+
+    [[nodiscard]] bool try_ref() const
+    {
+        if (!m_ref_count)
+            return false;
+        ref();
+        return true;
+    }
+
+    [[nodiscard]] RefCountType ref_count() const
+    {
+        return m_ref_count;
+    }
+
+protected:
+    SingleThreadedRefCountedBase() = default;
+    ~SingleThreadedRefCountedBase()
+    {
+        VERIFY(!m_ref_count);
+    }
+
+    ALWAYS_INLINE RefCountType deref_base() const
+    {
+        VERIFY(m_ref_count > 0);
+        return --m_ref_count;
+    }
+
+    mutable RefCountType m_ref_count { 1 };
+};
+
 template<typename T>
-class RefCounted : public RefCountedBase {
+inline constexpr bool IsRefCounted = IsBaseOf<RefCountedBase, T> || IsBaseOf<SingleThreadedRefCountedBase, T>;
+
+template<typename T, ThreadSafety thread_safety = ThreadSafety::Multi>
+class RefCounted : public Conditional<thread_safety == ThreadSafety::Single, SingleThreadedRefCountedBase, RefCountedBase> {
 public:
     bool unref() const
     {
-        auto new_ref_count = deref_base();
+        auto new_ref_count = this->deref_base();
         if (new_ref_count == 0) {
             call_will_be_destroyed_if_present(static_cast<const T*>(this));
             delete static_cast<const T*>(this);
@@ -108,4 +167,5 @@ public:
 
 }
 
-using Base::RefCounted;
\ No newline at end of file
+using Base::RefCounted;
+using Base::ThreadSafety;
\ No newline at end of file
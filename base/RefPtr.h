@@ -193,9 +193,9 @@ public:
         if (this == &other)
             return;
 
-        FlatPtr other_bits = PtrTraits::exchange(other.m_bits, PtrTraits::default_null_value);
-        FlatPtr bits = PtrTraits::exchange(m_bits, other_bits);
-        PtrTraits::exchange(other.m_bits, bits);
+        FlatPtr other_bits = other.exchange_bits(PtrTraits::default_null_value);
+        FlatPtr bits = exchange_bits(other_bits);
+        other.exchange_bits(bits);
     }
 
     template<typename U, typename P = RefPtrTraits<U>>
@@ -298,13 +298,13 @@ public:
 
     [[nodiscard]] T* leak_ref()
     {
-        FlatPtr bits = PtrTraits::exchange(m_bits, PtrTraits::default_null_value);
+        FlatPtr bits = exchange_bits(PtrTraits::default_null_value);
         return PtrTraits::as_ptr(bits);
     }
 
     NonnullRefPtr<T> release_nonnull()
     {
-        FlatPtr bits = PtrTraits::exchange(m_bits, PtrTraits::default_null_value);
+        FlatPtr bits = exchange_bits(PtrTraits::default_null_value);
         VERIFY(!PtrTraits::is_null(bits));
         return NonnullRefPtr<T>(NonnullRefPtr<T>::Adopt, *PtrTraits::as_ptr(bits));
     }
@@ -373,6 +373,10 @@ private:
     template<typename F>
     void do_while_locked(F f) const
     {
+        if constexpr (is_single_threaded_ref_counted<T>()) {
+            f(PtrTraits::as_ptr(m_bits.load(Base::MemoryOrder::memory_order_relaxed)));
+            return;
+        }
 #ifdef KERNEL
         Kernel::ScopedCritical critical;
 #endif
@@ -382,13 +386,31 @@ private:
         PtrTraits::unlock(m_bits, bits);
     }
 
+    // Stands in for PtrTraits::exchange on slots that never see another
+    // thread.
+    ALWAYS_INLINE FlatPtr exchange_bits(FlatPtr new_bits)
+    {
+        if constexpr (is_single_threaded_ref_counted<T>()) {
+            FlatPtr bits = m_bits.load(Base::MemoryOrder::memory_order_relaxed);
+            m_bits.store(new_bits, Base::MemoryOrder::memory_order_relaxed);
+            return bits;
+        } else {
+            return PtrTraits::exchange(m_bits, new_bits);
+        }
+    }
+
     [[nodiscard]] ALWAYS_INLINE FlatPtr leak_ref_raw()
     {
-        return PtrTraits::exchange(m_bits, PtrTraits::default_null_value);
+        return exchange_bits(PtrTraits::default_null_value);
     }
 
     [[nodiscard]] ALWAYS_INLINE FlatPtr add_ref_raw() const
     {
+        if constexpr (is_single_threaded_ref_counted<T>()) {
+            FlatPtr bits = m_bits.load(Base::MemoryOrder::memory_order_relaxed);
+            ref_if_not_null(PtrTraits::as_ptr(bits));
+            return bits;
+        }
 #ifdef KERNEL
         Kernel::ScopedCritical critical;
 #endif
@@ -402,7 +424,7 @@ private:
 
     ALWAYS_INLINE void assign_raw(FlatPtr bits)
     {
-        FlatPtr prev_bits = PtrTraits::exchange(m_bits, bits);
+        FlatPtr prev_bits = exchange_bits(bits);
         unref_if_not_null(PtrTraits::as_ptr(prev_bits));
     }
 
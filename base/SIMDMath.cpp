@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Math.h>
+#include <base/SIMDMath.h>
+#include <base/StdLibExtras.h>
+
+namespace Base::SIMD {
+
+template<typename Function>
+static void for_each_vector(Span<const float> input, Span<float> output, Function function)
+{
+    VERIFY(output.size() >= input.size());
+    size_t i = 0;
+    for (; i + 4 <= input.size(); i += 4)
+        store4(output.data() + i, function(load4(input.data() + i)));
+
+    // The last few values go through the vector code too, padded with ones,
+    // so they come out exactly as they would anywhere else in the array.
+    size_t rest = input.size() - i;
+    if (rest) {
+        float tail[4] = { 1, 1, 1, 1 };
+        __builtin_memcpy(tail, input.data() + i, rest * sizeof(float));
+        store4(tail, function(load4(tail)));
+        __builtin_memcpy(output.data() + i, tail, rest * sizeof(float));
+    }
+}
+
+void exp(Span<const float> input, Span<float> output)
+{
+    for_each_vector(input, output, [](f32x4 x) { return exp(x); });
+}
+
+void log(Span<const float> input, Span<float> output)
+{
+    for_each_vector(input, output, [](f32x4 x) { return log(x); });
+}
+
+void sin(Span<const float> input, Span<float> output)
+{
+    for_each_vector(input, output, [](f32x4 x) { return sin(x); });
+}
+
+void cos(Span<const float> input, Span<float> output)
+{
+    for_each_vector(input, output, [](f32x4 x) { return cos(x); });
+}
+
+void sqrt(Span<const float> input, Span<float> output)
+{
+    for_each_vector(input, output, [](f32x4 x) { return sqrt(x); });
+}
+
+void complex_multiply_accumulate(Span<Complex<float>> accumulator, Span<const Complex<float>> a, Span<const Complex<float>> b)
+{
+    static_assert(sizeof(Complex<float>) == 2 * sizeof(float));
+    size_t count = a.size();
+    VERIFY(b.size() == count && accumulator.size() >= count);
+
+    // Two complex numbers per vector, their real and imaginary parts
+    // interleaved as they are in memory.
+    auto* sums = reinterpret_cast<float*>(accumulator.data());
+    auto const* left = reinterpret_cast<float const*>(a.data());
+    auto const* right = reinterpret_cast<float const*>(b.data());
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        auto x = load4(left + i * 2);
+        auto y = load4(right + i * 2);
+        auto x_real = __builtin_shufflevector(x, x, 0, 0, 2, 2);
+        auto x_imag = __builtin_shufflevector(x, x, 1, 1, 3, 3);
+        auto y_swapped = __builtin_shufflevector(y, y, 1, 0, 3, 2);
+        auto product = x_real * y + x_imag * y_swapped * f32x4 { -1, 1, -1, 1 };
+        store4(sums + i * 2, load4(sums + i * 2) + product);
+    }
+
+    for (; i < count; ++i) {
+        auto x = a[i];
+        accumulator[i] += x * b[i];
+    }
+}
+
+static void transform(Span<Complex<float>> data, bool inverse)
+{
+    size_t count = data.size();
+    VERIFY((count & (count - 1)) == 0);
+    if (count <= 1)
+        return;
+
+    for (size_t i = 1, j = 0; i < count; ++i) {
+        size_t bit = count >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+            swap(data[i], data[j]);
+    }
+
+    for (size_t length = 2; length <= count; length <<= 1) {
+        size_t half = length / 2;
+        double step = (inverse ? 2 : -2) * Pi<double> / length;
+        for (size_t k = 0; k < half; ++k) {
+            // Computed in double for each k instead of by multiplying up,
+            // which would let rounding errors add up over large transforms.
+            Complex<float> twiddle { static_cast<float>(Base::cos(step * k)), static_cast<float>(Base::sin(step * k)) };
+            for (size_t start = 0; start < count; start += length) {
+                auto even = data[start + k];
+                auto odd = data[start + k + half] * twiddle;
+                data[start + k] = even + odd;
+                data[start + k + half] = even - odd;
+            }
+        }
+    }
+
+    if (inverse) {
+        float scale = 1.0f / count;
+        for (auto& value : data)
+            value *= scale;
+    }
+}
+
+void fft(Span<Complex<float>> data)
+{
+    transform(data, false);
+}
+
+void inverse_fft(Span<Complex<float>> data)
+{
+    transform(data, true);
+}
+
+}
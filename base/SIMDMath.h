@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Complex.h>
+#include <base/Platform.h>
+#include <base/SIMD.h>
+#include <base/Span.h>
+#include <base/Types.h>
+
+// Math on four floats at a time, for code that runs the same function over
+// whole arrays: samples, pixels, cells. base/Math.h goes through the x87
+// for every value, these are polynomials the compiler keeps in vector
+// registers. Results are within a few ulps of the scalar functions.
+namespace Base::SIMD {
+
+namespace Detail {
+
+ALWAYS_INLINE f32x4 expand4(float value) { return f32x4 { value, value, value, value }; }
+ALWAYS_INLINE i32x4 expand4(i32 value) { return i32x4 { value, value, value, value }; }
+
+// mask lanes are either all ones or all zeroes, as comparisons leave them.
+ALWAYS_INLINE f32x4 select(i32x4 mask, f32x4 if_set, f32x4 if_clear)
+{
+    return (f32x4)((mask & (i32x4)if_set) | (~mask & (i32x4)if_clear));
+}
+
+ALWAYS_INLINE f32x4 floor_int_range(f32x4 x)
+{
+    auto truncated = __builtin_convertvector(__builtin_convertvector(x, i32x4), f32x4);
+    return truncated - (f32x4)((i32x4)(truncated > x) & (i32x4)expand4(1.0f));
+}
+
+}
+
+ALWAYS_INLINE f32x4 load4(float const* values)
+{
+    f32x4 vector;
+    __builtin_memcpy(&vector, values, sizeof(vector));
+    return vector;
+}
+
+ALWAYS_INLINE void store4(float* values, f32x4 vector)
+{
+    __builtin_memcpy(values, &vector, sizeof(vector));
+}
+
+ALWAYS_INLINE f32x4 sqrt(f32x4 x)
+{
+#ifdef __SSE__
+    return __builtin_ia32_sqrtps(x);
+#else
+    return f32x4 { __builtin_sqrtf(x[0]), __builtin_sqrtf(x[1]), __builtin_sqrtf(x[2]), __builtin_sqrtf(x[3]) };
+#endif
+}
+
+// e^x, rounding x to the nearest multiple of ln 2 and a polynomial for
+// the rest. Overflows to infinity and underflows to zero.
+ALWAYS_INLINE f32x4 exp(f32x4 x)
+{
+    using namespace Detail;
+    auto is_nan = x != x;
+    auto overflows = x > 88.3762626647949f;
+    auto underflows = x < -87.3365447504f;
+    auto input = x;
+    // Keeps the lanes picked below in range for the conversions.
+    x = select(is_nan | overflows | underflows, expand4(0.0f), x);
+
+    auto n = floor_int_range(x * 1.44269504088896341f + 0.5f);
+    auto r = x - n * 0.693359375f + n * 2.12194440e-4f;
+
+    auto p = expand4(1.9875691500e-4f);
+    p = p * r + 1.3981999507e-3f;
+    p = p * r + 8.3334519073e-3f;
+    p = p * r + 4.1665795894e-2f;
+    p = p * r + 1.6666665459e-1f;
+    p = p * r + 5.0000001201e-1f;
+    p = p * r * r + r + 1.0f;
+
+    auto scale = (__builtin_convertvector(n, i32x4) + 127) << 23;
+    auto result = p * (f32x4)scale;
+    result = select(overflows, expand4(__builtin_huge_valf()), result);
+    result = select(underflows, expand4(0.0f), result);
+    return select(is_nan, input, result);
+}
+
+// The natural logarithm, splitting x into its exponent and a mantissa
+// near 1. Zero gives -infinity, negative numbers NaN. Subnormals are taken
+// for zero.
+ALWAYS_INLINE f32x4 log(f32x4 x)
+{
+    using namespace Detail;
+    auto is_negative_or_nan = !(x >= 0.0f);
+    auto is_zero = x < 1.17549435e-38f;
+    auto is_infinite = x == __builtin_huge_valf();
+
+    auto bits = (i32x4)x;
+    auto e = __builtin_convertvector((bits >> 23) - 126, f32x4);
+    auto m = (f32x4)((bits & 0x007fffff) | 0x3f000000);
+
+    // m is in [0.5, 1), move it to [sqrt(1/2), sqrt(2)) instead.
+    auto is_small = m < 0.707106781186547524f;
+    e = e - (f32x4)(is_small & (i32x4)expand4(1.0f));
+    m = m + (f32x4)(is_small & (i32x4)m) - 1.0f;
+
+    auto z = m * m;
+    auto y = expand4(7.0376836292e-2f);
+    y = y * m - 1.1514610310e-1f;
+    y = y * m + 1.1676998740e-1f;
+    y = y * m - 1.2420140846e-1f;
+    y = y * m + 1.4249322787e-1f;
+    y = y * m - 1.6668057665e-1f;
+    y = y * m + 2.0000714765e-1f;
+    y = y * m - 2.4999993993e-1f;
+    y = y * m + 3.3333331174e-1f;
+    y = y * m * z;
+    y = y - e * 2.12194440e-4f;
+    y = y - z * 0.5f;
+    auto result = m + y + e * 0.693359375f;
+
+    result = select(is_zero, expand4(-__builtin_huge_valf()), result);
+    result = select(is_infinite, x, result);
+    return select(is_negative_or_nan, expand4(__builtin_nanf("")), result);
+}
+
+namespace Detail {
+
+// Reduces |x| to [-pi/4, pi/4] and returns the octant it was in, made even.
+// Loses precision beyond a few thousand radians.
+ALWAYS_INLINE i32x4 reduce_angle(f32x4& x)
+{
+    auto octant = __builtin_convertvector(x * 1.27323954473516f, i32x4);
+    octant = (octant + 1) & ~1;
+    auto y = __builtin_convertvector(octant, f32x4);
+    x = ((x - y * 0.78515625f) - y * 2.4187564849853515625e-4f) - y * 3.77489497744594108e-8f;
+    return octant;
+}
+
+ALWAYS_INLINE f32x4 sin_polynomial(f32x4 x, f32x4 z)
+{
+    auto y = expand4(-1.9515295891e-4f);
+    y = y * z + 8.3321608736e-3f;
+    y = y * z - 1.6666654611e-1f;
+    return y * z * x + x;
+}
+
+ALWAYS_INLINE f32x4 cos_polynomial(f32x4 z)
+{
+    auto y = expand4(2.443315711809948e-5f);
+    y = y * z - 1.388731625493765e-3f;
+    y = y * z + 4.166664568298827e-2f;
+    return y * z * z - z * 0.5f + 1.0f;
+}
+
+}
+
+ALWAYS_INLINE f32x4 sin(f32x4 x)
+{
+    using namespace Detail;
+    auto sign = (i32x4)x & (i32)0x80000000;
+    x = (f32x4)((i32x4)x & 0x7fffffff);
+
+    auto octant = reduce_angle(x);
+    sign ^= (octant & 4) << 29;
+    auto z = x * x;
+    auto y = select((octant & 2) == 0, sin_polynomial(x, z), cos_polynomial(z));
+    return (f32x4)((i32x4)y ^ sign);
+}
+
+ALWAYS_INLINE f32x4 cos(f32x4 x)
+{
+    using namespace Detail;
+    x = (f32x4)((i32x4)x & 0x7fffffff);
+
+    auto octant = reduce_angle(x) - 2;
+    auto sign = (~octant & 4) << 29;
+    auto z = x * x;
+    auto y = select((octant & 2) == 0, sin_polynomial(x, z), cos_polynomial(z));
+    return (f32x4)((i32x4)y ^ sign);
+}
+
+// The same over arrays: output[i] = f(input[i]). output must be at least
+// as long as input, and may be input itself.
+void exp(Span<const float> input, Span<float> output);
+void log(Span<const float> input, Span<float> output);
+void sin(Span<const float> input, Span<float> output);
+void cos(Span<const float> input, Span<float> output);
+void sqrt(Span<const float> input, Span<float> output);
+
+// accumulator[i] += a[i] * b[i], as in filters and convolutions.
+void complex_multiply_accumulate(Span<Complex<float>> accumulator, Span<const Complex<float>> a, Span<const Complex<float>> b);
+
+// An in-place radix-2 FFT, for sizes that are powers of two. The inverse
+// divides by the size, so it undoes the forward transform.
+void fft(Span<Complex<float>> data);
+void inverse_fft(Span<Complex<float>> data);
+
+}
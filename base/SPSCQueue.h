@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Atomic.h>
+#include <base/Noncopyable.h>
+#include <base/Optional.h>
+#include <base/StdLibExtras.h>
+#include <base/Types.h>
+
+namespace Base {
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. Each side owns one index and only reads the other's, and keeps a
+// cached copy of it so a queue that is neither empty nor full never touches
+// the other side's cache line.
+template<typename T, size_t Capacity>
+class SPSCQueue {
+    static_assert(Capacity && !(Capacity & (Capacity - 1)), "SPSCQueue capacity must be a power of two");
+
+    BASE_MAKE_NONCOPYABLE(SPSCQueue);
+    BASE_MAKE_NONMOVABLE(SPSCQueue);
+
+public:
+    SPSCQueue() = default;
+
+    ~SPSCQueue()
+    {
+        size_t tail = m_producer.tail.load(Base::memory_order_relaxed);
+        for (size_t head = m_consumer.head.load(Base::memory_order_relaxed); head != tail; ++head)
+            slot(head).~T();
+    }
+
+    size_t capacity() const { return Capacity; }
+
+    // Only exact when called from one of the two sides with the other idle.
+    size_t size() const
+    {
+        return m_producer.tail.load(Base::memory_order_acquire) - m_consumer.head.load(Base::memory_order_acquire);
+    }
+    bool is_empty() const { return !size(); }
+
+    // Producer side.
+    template<typename U = T>
+    [[nodiscard]] bool try_enqueue(U&& value)
+    {
+        size_t tail = m_producer.tail.load(Base::memory_order_relaxed);
+        if (!reserve_for_enqueue(tail, 1))
+            return false;
+        new (&slot(tail)) T(forward<U>(value));
+        m_producer.tail.store(tail + 1, Base::memory_order_release);
+        return true;
+    }
+
+    // Copies as many of values as there is room for, publishing them all at
+    // once, and returns how many that was.
+    size_t try_enqueue_batch(T const* values, size_t count)
+    {
+        size_t tail = m_producer.tail.load(Base::memory_order_relaxed);
+        count = min(count, reserve_for_enqueue(tail, count));
+        for (size_t i = 0; i < count; ++i)
+            new (&slot(tail + i)) T(values[i]);
+        if (count)
+            m_producer.tail.store(tail + count, Base::memory_order_release);
+        return count;
+    }
+
+    // Consumer side.
+    Optional<T> try_dequeue()
+    {
+        size_t head = m_consumer.head.load(Base::memory_order_relaxed);
+        if (!available_for_dequeue(head, 1))
+            return {};
+        auto& element = slot(head);
+        Optional<T> value = move(element);
+        element.~T();
+        m_consumer.head.store(head + 1, Base::memory_order_release);
+        return value;
+    }
+
+    // Moves up to count elements into values and returns how many were
+    // there.
+    size_t try_dequeue_batch(T* values, size_t count)
+    {
+        size_t head = m_consumer.head.load(Base::memory_order_relaxed);
+        count = min(count, available_for_dequeue(head, count));
+        for (size_t i = 0; i < count; ++i) {
+            auto& element = slot(head + i);
+            values[i] = move(element);
+            element.~T();
+        }
+        if (count)
+            m_consumer.head.store(head + count, Base::memory_order_release);
+        return count;
+    }
+
+private:
+    // Both return the room or the elements there are, looking at the other
+    // side's index again only when the cached one says there isn't enough.
+    size_t reserve_for_enqueue(size_t tail, size_t wanted)
+    {
+        size_t room = Capacity - (tail - m_producer.cached_head);
+        if (room < wanted) {
+            m_producer.cached_head = m_consumer.head.load(Base::memory_order_acquire);
+            room = Capacity - (tail - m_producer.cached_head);
+        }
+        return room;
+    }
+
+    size_t available_for_dequeue(size_t head, size_t wanted)
+    {
+        size_t available = m_consumer.cached_tail - head;
+        if (available < wanted) {
+            m_consumer.cached_tail = m_producer.tail.load(Base::memory_order_acquire);
+            available = m_consumer.cached_tail - head;
+        }
+        return available;
+    }
+
+    T& slot(size_t index) { return reinterpret_cast<T*>(m_storage)[index & (Capacity - 1)]; }
+
+    struct alignas(64) Producer {
+        Atomic<size_t> tail { 0 };
+        size_t cached_head { 0 };
+    };
+    struct alignas(64) Consumer {
+        Atomic<size_t> head { 0 };
+        size_t cached_tail { 0 };
+    };
+
+    Producer m_producer;
+    Consumer m_consumer;
+    alignas(64) alignas(T) u8 m_storage[sizeof(T) * Capacity];
+};
+
+}
+
+using Base::SPSCQueue;
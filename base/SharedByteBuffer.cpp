@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/SharedByteBuffer.h>
+#include <base/kmalloc.h>
+
+#ifndef KERNEL
+#    include <sys/mman.h>
+#endif
+
+namespace Base {
+
+SharedByteBuffer::Storage::~Storage()
+{
+    switch (m_kind) {
+    case Kind::Heap:
+        kfree_sized(m_allocation, m_allocation_size);
+        break;
+    case Kind::Mapping: {
+#ifndef KERNEL
+        auto rc = munmap(m_allocation, m_allocation_size);
+        VERIFY(rc == 0);
+#else
+        VERIFY_NOT_REACHED();
+#endif
+        break;
+    }
+    }
+}
+
+SharedByteBuffer SharedByteBuffer::create_uninitialized(size_t size, size_t alignment)
+{
+    VERIFY(alignment && (alignment & (alignment - 1)) == 0);
+
+    // Allocating alignment - 1 bytes more leaves room to align the start,
+    // whatever the allocator hands out.
+    size_t allocation_size = max<size_t>(size + alignment - 1, 1);
+    VERIFY(allocation_size >= size);
+    void* allocation = kmalloc(allocation_size);
+    VERIFY(allocation);
+
+    auto storage = adopt_ref(*new Storage(Storage::Kind::Heap, allocation, allocation_size));
+    auto* data = reinterpret_cast<u8*>((reinterpret_cast<FlatPtr>(allocation) + alignment - 1) & ~static_cast<FlatPtr>(alignment - 1));
+    return SharedByteBuffer(move(storage), data, size);
+}
+
+SharedByteBuffer SharedByteBuffer::create_zeroed(size_t size, size_t alignment)
+{
+    auto buffer = create_uninitialized(size, alignment);
+    if (size != 0)
+        __builtin_memset(buffer.data(), 0, size);
+    return buffer;
+}
+
+SharedByteBuffer SharedByteBuffer::copy(void const* data, size_t size, size_t alignment)
+{
+    auto buffer = create_uninitialized(size, alignment);
+    if (size != 0)
+        __builtin_memcpy(buffer.data(), data, size);
+    return buffer;
+}
+
+#ifndef KERNEL
+SharedByteBuffer SharedByteBuffer::adopt_mapping(void* mapping, size_t size)
+{
+    VERIFY(mapping && mapping != MAP_FAILED);
+    auto storage = adopt_ref(*new Storage(Storage::Kind::Mapping, mapping, size));
+    return SharedByteBuffer(move(storage), static_cast<u8*>(mapping), size);
+}
+#endif
+
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Assertions.h>
+#include <base/ByteBuffer.h>
+#include <base/RefCounted.h>
+#include <base/RefPtr.h>
+#include <base/Span.h>
+#include <base/Types.h>
+
+namespace Base {
+
+// A view of bytes kept alive by a reference count, so handing a buffer or
+// any part of it to someone else is a pointer copy instead of a memcpy.
+// Slices share the bytes of what they were taken from: writing through one
+// shows up in all of them.
+//
+// Buffers are allocated at whatever alignment the caller needs, such as a
+// cache line for vector code or a page for DMA. A slice is only that well
+// aligned if it starts at a multiple of the alignment.
+class SharedByteBuffer {
+public:
+    static constexpr size_t default_alignment = 16;
+
+    SharedByteBuffer() = default;
+
+    [[nodiscard]] static SharedByteBuffer create_uninitialized(size_t size, size_t alignment = default_alignment);
+    [[nodiscard]] static SharedByteBuffer create_zeroed(size_t size, size_t alignment = default_alignment);
+    [[nodiscard]] static SharedByteBuffer copy(void const* data, size_t size, size_t alignment = default_alignment);
+    [[nodiscard]] static SharedByteBuffer copy(ReadonlyBytes bytes, size_t alignment = default_alignment) { return copy(bytes.data(), bytes.size(), alignment); }
+
+#ifndef KERNEL
+    // Takes over a mapping made with mmap(), which is unmapped once the
+    // last slice of it is gone.
+    [[nodiscard]] static SharedByteBuffer adopt_mapping(void* mapping, size_t size);
+#endif
+
+    // Shares the bytes instead of copying them.
+    [[nodiscard]] SharedByteBuffer slice(size_t offset, size_t size) const
+    {
+        VERIFY(offset <= m_size && size <= m_size - offset);
+        return SharedByteBuffer(m_storage, m_data + offset, size);
+    }
+
+    [[nodiscard]] bool is_null() const { return !m_storage; }
+    [[nodiscard]] bool is_empty() const { return m_size == 0; }
+    [[nodiscard]] size_t size() const { return m_size; }
+
+    // Whether anyone else holds on to these bytes, or some of them.
+    [[nodiscard]] bool is_shared() const { return m_storage && m_storage->ref_count() > 1; }
+
+    [[nodiscard]] u8* data() { return m_data; }
+    [[nodiscard]] u8 const* data() const { return m_data; }
+
+    [[nodiscard]] u8& operator[](size_t i)
+    {
+        VERIFY(i < m_size);
+        return m_data[i];
+    }
+    [[nodiscard]] u8 const& operator[](size_t i) const
+    {
+        VERIFY(i < m_size);
+        return m_data[i];
+    }
+
+    [[nodiscard]] Bytes bytes() { return { m_data, m_size }; }
+    [[nodiscard]] ReadonlyBytes bytes() const { return { m_data, m_size }; }
+
+    operator Bytes() { return bytes(); }
+    operator ReadonlyBytes() const { return bytes(); }
+
+    // For the APIs that want a buffer of their own.
+    [[nodiscard]] ByteBuffer to_byte_buffer() const { return ByteBuffer::copy(m_data, m_size); }
+
+private:
+    class Storage : public RefCounted<Storage> {
+    public:
+        enum class Kind {
+            Heap,
+            Mapping,
+        };
+
+        Storage(Kind kind, void* allocation, size_t allocation_size)
+            : m_kind(kind)
+            , m_allocation(allocation)
+            , m_allocation_size(allocation_size)
+        {
+        }
+
+        ~Storage();
+
+    private:
+        Kind m_kind;
+        void* m_allocation { nullptr };
+        size_t m_allocation_size { 0 };
+    };
+
+    SharedByteBuffer(RefPtr<Storage> storage, u8* data, size_t size)
+        : m_storage(move(storage))
+        , m_data(data)
+        , m_size(size)
+    {
+    }
+
+    RefPtr<Storage> m_storage;
+    u8* m_data { nullptr };
+    size_t m_size { 0 };
+};
+
+}
+
+using Base::SharedByteBuffer;
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/LatencyHistogram.h>
+#include <base/MonotonicClock.h>
+#include <base/Noncopyable.h>
+
+namespace Base {
+
+// Nanoseconds since it was started, off MonotonicClock.
+class Stopwatch {
+public:
+    Stopwatch()
+        : m_start_ns(MonotonicClock::now_ns())
+    {
+    }
+
+    void restart() { m_start_ns = MonotonicClock::now_ns(); }
+    u64 elapsed_ns() const { return MonotonicClock::now_ns() - m_start_ns; }
+
+private:
+    u64 m_start_ns { 0 };
+};
+
+// Records how long the scope took into a histogram once it is left.
+class ScopedTimer {
+    BASE_MAKE_NONCOPYABLE(ScopedTimer);
+    BASE_MAKE_NONMOVABLE(ScopedTimer);
+
+public:
+    explicit ScopedTimer(LatencyHistogram& histogram)
+        : m_histogram(histogram)
+    {
+    }
+
+    ~ScopedTimer() { m_histogram.record(m_stopwatch.elapsed_ns()); }
+
+private:
+    LatencyHistogram& m_histogram;
+    Stopwatch m_stopwatch;
+};
+
+}
+
+using Base::ScopedTimer;
+using Base::Stopwatch;
@@ -6,16 +6,63 @@
 
 // includes
 #include <base/ByteBuffer.h>
+#include <base/CharacterTypes.h>
 #include <base/FlyString.h>
 #include <base/Format.h>
 #include <base/Memory.h>
 #include <base/StdLibExtras.h>
 #include <base/String.h>
+#include <base/StringHash.h>
+#include <base/StringUtils.h>
 #include <base/StringView.h>
 #include <base/Vector.h>
 
 namespace Base {
 
+void String::initialize(const char* cstring, size_t length, ShouldChomp should_chomp)
+{
+    if (!cstring) {
+        set_impl(nullptr);
+        return;
+    }
+
+    if (should_chomp) {
+        while (length) {
+            char last_ch = cstring[length - 1];
+            if (!last_ch || last_ch == '\n' || last_ch == '\r')
+                --length;
+            else
+                break;
+        }
+    }
+
+    if (length > inline_capacity) {
+        set_impl(StringImpl::create(cstring, length).leak_ref());
+        return;
+    }
+
+    __builtin_memcpy(m_storage, cstring, length);
+    m_storage[length] = '\0';
+    m_inline_length = length;
+}
+
+void String::promote_to_impl() const
+{
+    set_impl(StringImpl::create(m_storage, m_inline_length).leak_ref());
+}
+
+u32 String::hash() const
+{
+    if (!is_inline()) {
+        auto* impl = impl_pointer();
+        return impl ? impl->hash() : 0;
+    }
+    // Has to agree with StringImpl::hash() for the same characters.
+    if (!m_inline_length)
+        return 0;
+    return seeded_string_hash(m_storage, m_inline_length);
+}
+
 bool String::operator==(const FlyString& fly_string) const
 {
     return *this == String(fly_string.impl());
@@ -23,18 +70,24 @@ bool String::operator==(const FlyString& fly_string) const
 
 bool String::operator==(const String& other) const
 {
-    if (!m_impl)
-        return !other.m_impl;
+    if (is_null())
+        return other.is_null();
 
-    if (!other.m_impl)
+    if (other.is_null())
+        return false;
+
+    if (!is_inline() && !other.is_inline())
+        return *impl_pointer() == *other.impl_pointer();
+
+    if (length() != other.length())
         return false;
 
-    return *m_impl == *other.m_impl;
+    return !memcmp(characters(), other.characters(), length());
 }
 
 bool String::operator==(const StringView& other) const
 {
-    if (!m_impl)
+    if (is_null())
         return !other.m_characters;
 
     if (!other.m_characters)
@@ -48,10 +101,10 @@ bool String::operator==(const StringView& other) const
 
 bool String::operator<(const String& other) const
 {
-    if (!m_impl)
-        return other.m_impl;
+    if (is_null())
+        return !other.is_null();
 
-    if (!other.m_impl)
+    if (other.is_null())
         return false;
 
     return strcmp(characters(), other.characters()) < 0;
@@ -59,10 +112,10 @@ bool String::operator<(const String& other) const
 
 bool String::operator>(const String& other) const
 {
-    if (!m_impl)
-        return other.m_impl;
+    if (is_null())
+        return !other.is_null();
 
-    if (!other.m_impl)
+    if (other.is_null())
         return false;
 
     return strcmp(characters(), other.characters()) > 0;
@@ -81,13 +134,16 @@ bool String::copy_characters_to_buffer(char* buffer, size_t buffer_size) const
 
 String String::isolated_copy() const
 {
-    if (!m_impl)
+    if (is_null())
         return {};
-    if (!m_impl->length())
+    // An inline copy shares nothing with this one.
+    if (is_inline())
+        return *this;
+    if (!length())
         return empty();
     char* buffer;
     auto impl = StringImpl::create_uninitialized(length(), buffer);
-    memcpy(buffer, m_impl->characters(), m_impl->length());
+    memcpy(buffer, characters(), length());
     return String(move(*impl));
 }
 
@@ -95,30 +151,30 @@ String String::substring(size_t start, size_t length) const
 {
     if (!length)
         return String::empty();
-    VERIFY(m_impl);
+    VERIFY(!is_null());
     VERIFY(!Checked<size_t>::addition_would_overflow(start, length));
-    VERIFY(start + length <= m_impl->length());
+    VERIFY(start + length <= this->length());
     return { characters() + start, length };
 }
 
 String String::substring(size_t start) const
 {
-    VERIFY(m_impl);
+    VERIFY(!is_null());
     VERIFY(start <= length());
     return { characters() + start, length() - start };
 }
 
 StringView String::substring_view(size_t start, size_t length) const
 {
-    VERIFY(m_impl);
+    VERIFY(!is_null());
     VERIFY(!Checked<size_t>::addition_would_overflow(start, length));
-    VERIFY(start + length <= m_impl->length());
+    VERIFY(start + length <= this->length());
     return { characters() + start, length };
 }
 
 StringView String::substring_view(size_t start) const
 {
-    VERIFY(m_impl);
+    VERIFY(!is_null());
     VERIFY(start <= length());
     return { characters() + start, length() - start };
 }
@@ -174,7 +230,7 @@ Vector<StringView> String::split_view(const char separator, bool keep_empty) con
 
 ByteBuffer String::to_byte_buffer() const
 {
-    if (!m_impl)
+    if (is_null())
         return {};
     return ByteBuffer::copy(reinterpret_cast<const u8*>(characters()), length());
 }
@@ -368,7 +424,7 @@ int String::replace(const String& needle, const String& replacement, bool all_oc
         lastpos = pos + needle.length();
     }
     b.append(substring_view(lastpos, length() - lastpos));
-    m_impl = StringImpl::create(b.build().characters());
+    *this = b.build();
     return positions.size();
 }
 
@@ -414,22 +470,30 @@ String escape_html_entities(const StringView& html)
 }
 
 String::String(const FlyString& string)
-    : m_impl(string.impl())
+    : String(string.impl())
 {
 }
 
 String String::to_lowercase() const
 {
-    if (!m_impl)
+    if (is_null())
         return {};
-    return m_impl->to_lowercase();
+    if (!is_inline())
+        return impl_pointer()->to_lowercase();
+    String lowercased = *this;
+    StringUtils::copy_as_ascii_lowercase(m_storage, lowercased.m_storage, m_inline_length);
+    return lowercased;
 }
 
 String String::to_uppercase() const
 {
-    if (!m_impl)
+    if (is_null())
         return {};
-    return m_impl->to_uppercase();
+    if (!is_inline())
+        return impl_pointer()->to_uppercase();
+    String uppercased = *this;
+    StringUtils::copy_as_ascii_uppercase(m_storage, uppercased.m_storage, m_inline_length);
+    return uppercased;
 }
 
 String String::to_snakecase() const
@@ -501,10 +565,10 @@ InputStream& operator>>(InputStream& stream, String& string)
     }
 }
 
-String String::vformatted(StringView fmtstr, TypeErasedFormatParams params)
+String String::vformatted(StringView fmtstr, TypeErasedFormatParams params, Span<const FormatSegment> segments)
 {
     StringBuilder builder;
-    vformat(builder, fmtstr, params);
+    vformat(builder, fmtstr, params, segments);
     return builder.to_string();
 }
 
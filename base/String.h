@@ -18,60 +18,67 @@
 
 namespace Base {
 
+// Strings of up to inline_capacity characters live inside the String
+// itself, longer ones (and the null string) in a shared StringImpl. Asking
+// an inline string for its impl() moves it into a StringImpl for good, which
+// is what FlyString and JsonValue do.
 class String {
 public:
-    ~String() = default;
+    ~String() { clear(); }
 
     String() = default;
 
     String(const StringView& view)
     {
-        m_impl = StringImpl::create(view.characters_without_null_termination(), view.length());
+        initialize(view.characters_without_null_termination(), view.length(), NoChomp);
     }
 
     String(const String& other)
-        : m_impl(const_cast<String&>(other).m_impl)
     {
+        copy_from(other);
     }
 
     String(String&& other)
-        : m_impl(move(other.m_impl))
     {
+        move_from(other);
     }
 
     String(const char* cstring, ShouldChomp shouldChomp = NoChomp)
-        : m_impl(StringImpl::create(cstring, shouldChomp))
     {
+        initialize(cstring, cstring ? __builtin_strlen(cstring) : 0, shouldChomp);
     }
 
     String(const char* cstring, size_t length, ShouldChomp shouldChomp = NoChomp)
-        : m_impl(StringImpl::create(cstring, length, shouldChomp))
     {
+        initialize(cstring, length, shouldChomp);
     }
 
     explicit String(ReadonlyBytes bytes, ShouldChomp shouldChomp = NoChomp)
-        : m_impl(StringImpl::create(bytes, shouldChomp))
     {
+        initialize(reinterpret_cast<const char*>(bytes.data()), bytes.size(), shouldChomp);
     }
 
     String(const StringImpl& impl)
-        : m_impl(const_cast<StringImpl&>(impl))
     {
+        impl.ref();
+        set_impl(const_cast<StringImpl*>(&impl));
     }
 
     String(const StringImpl* impl)
-        : m_impl(const_cast<StringImpl*>(impl))
     {
+        if (impl)
+            impl->ref();
+        set_impl(const_cast<StringImpl*>(impl));
     }
 
     String(RefPtr<StringImpl>&& impl)
-        : m_impl(move(impl))
     {
+        set_impl(impl.leak_ref());
     }
 
     String(NonnullRefPtr<StringImpl>&& impl)
-        : m_impl(move(impl))
     {
+        set_impl(&impl.leak_ref());
     }
 
     String(const FlyString&);
@@ -136,25 +143,39 @@ public:
     [[nodiscard]] StringView substring_view(size_t start, size_t length) const;
     [[nodiscard]] StringView substring_view(size_t start) const;
 
-    [[nodiscard]] bool is_null() const { return !m_impl; }
+    [[nodiscard]] bool is_null() const { return !is_inline() && !impl_pointer(); }
     [[nodiscard]] ALWAYS_INLINE bool is_empty() const { return length() == 0; }
-    [[nodiscard]] ALWAYS_INLINE size_t length() const { return m_impl ? m_impl->length() : 0; }
-    [[nodiscard]] ALWAYS_INLINE const char* characters() const { return m_impl ? m_impl->characters() : nullptr; }
+
+    [[nodiscard]] ALWAYS_INLINE size_t length() const
+    {
+        if (is_inline())
+            return m_inline_length;
+        auto* impl = impl_pointer();
+        return impl ? impl->length() : 0;
+    }
+
+    [[nodiscard]] ALWAYS_INLINE const char* characters() const
+    {
+        if (is_inline())
+            return m_storage;
+        auto* impl = impl_pointer();
+        return impl ? impl->characters() : nullptr;
+    }
 
     [[nodiscard]] bool copy_characters_to_buffer(char* buffer, size_t buffer_size) const;
 
     [[nodiscard]] ALWAYS_INLINE ReadonlyBytes bytes() const
     {
-        if (m_impl) {
-            return m_impl->bytes();
-        }
-        return {};
+        if (is_null())
+            return {};
+        return { characters(), length() };
     }
 
     [[nodiscard]] ALWAYS_INLINE const char& operator[](size_t i) const
     {
         VERIFY(!is_null());
-        return (*m_impl)[i];
+        VERIFY(i < length());
+        return characters()[i];
     }
 
     using ConstIterator = SimpleIterator<const String, const char>;
@@ -193,44 +214,55 @@ public:
 
     [[nodiscard]] static String empty()
     {
-        return StringImpl::the_empty_stringimpl();
+        return { "", 0 };
     }
 
-    [[nodiscard]] StringImpl* impl() { return m_impl.ptr(); }
-    [[nodiscard]] const StringImpl* impl() const { return m_impl.ptr(); }
+    [[nodiscard]] StringImpl* impl()
+    {
+        if (is_inline())
+            promote_to_impl();
+        return impl_pointer();
+    }
+
+    [[nodiscard]] const StringImpl* impl() const
+    {
+        if (is_inline())
+            promote_to_impl();
+        return impl_pointer();
+    }
 
     String& operator=(String&& other)
     {
-        if (this != &other)
-            m_impl = move(other.m_impl);
+        if (this != &other) {
+            clear();
+            move_from(other);
+        }
         return *this;
     }
 
     String& operator=(const String& other)
     {
-        if (this != &other)
-            m_impl = const_cast<String&>(other).m_impl;
+        if (this != &other) {
+            clear();
+            copy_from(other);
+        }
         return *this;
     }
 
     String& operator=(std::nullptr_t)
     {
-        m_impl = nullptr;
+        clear();
         return *this;
     }
 
     String& operator=(ReadonlyBytes bytes)
     {
-        m_impl = StringImpl::create(bytes);
+        clear();
+        initialize(reinterpret_cast<const char*>(bytes.data()), bytes.size(), NoChomp);
         return *this;
     }
 
-    [[nodiscard]] u32 hash() const
-    {
-        if (!m_impl)
-            return 0;
-        return m_impl->hash();
-    }
+    [[nodiscard]] u32 hash() const;
 
     [[nodiscard]] ByteBuffer to_byte_buffer() const;
 
@@ -242,12 +274,12 @@ public:
         return String((const char*)buffer.data(), buffer.size(), should_chomp);
     }
 
-    [[nodiscard]] static String vformatted(StringView fmtstr, TypeErasedFormatParams);
+    [[nodiscard]] static String vformatted(StringView fmtstr, TypeErasedFormatParams, Span<const FormatSegment> segments = {});
 
     template<typename... Parameters>
     [[nodiscard]] static String formatted(CheckedFormatString<Parameters...>&& fmtstr, const Parameters&... parameters)
     {
-        return vformatted(fmtstr.view(), VariadicFormatParams { parameters... });
+        return vformatted(fmtstr.view(), VariadicFormatParams { parameters... }, fmtstr.segments());
     }
 
     template<typename T>
@@ -272,16 +304,69 @@ public:
     }
 
 private:
-    RefPtr<StringImpl> m_impl;
+    static constexpr size_t inline_capacity = 3 * sizeof(void*) - 2;
+    static constexpr u8 impl_tag = 0xff;
+
+    ALWAYS_INLINE bool is_inline() const { return m_inline_length != impl_tag; }
+
+    ALWAYS_INLINE StringImpl* impl_pointer() const
+    {
+        StringImpl* impl;
+        __builtin_memcpy(&impl, m_storage, sizeof(impl));
+        return impl;
+    }
+
+    // Takes over a reference to impl.
+    ALWAYS_INLINE void set_impl(StringImpl* impl) const
+    {
+        __builtin_memcpy(m_storage, &impl, sizeof(impl));
+        m_inline_length = impl_tag;
+    }
+
+    ALWAYS_INLINE void clear()
+    {
+        if (!is_inline()) {
+            if (auto* impl = impl_pointer())
+                impl->unref();
+        }
+        set_impl(nullptr);
+    }
+
+    ALWAYS_INLINE void copy_from(const String& other)
+    {
+        __builtin_memcpy(m_storage, other.m_storage, sizeof(m_storage));
+        m_inline_length = other.m_inline_length;
+        if (!is_inline()) {
+            if (auto* impl = impl_pointer())
+                impl->ref();
+        }
+    }
+
+    ALWAYS_INLINE void move_from(String& other)
+    {
+        __builtin_memcpy(m_storage, other.m_storage, sizeof(m_storage));
+        m_inline_length = other.m_inline_length;
+        other.set_impl(nullptr);
+    }
+
+    void initialize(const char* cstring, size_t length, ShouldChomp);
+    void promote_to_impl() const;
+
+    // Inline characters, null terminated, or else the StringImpl pointer.
+    // Only impl() writes these in a const String.
+    alignas(StringImpl*) mutable char m_storage[inline_capacity + 1] {};
+    mutable u8 m_inline_length { impl_tag };
 };
 
+static_assert(sizeof(String) == 3 * sizeof(void*));
+
 template<>
 struct Traits<String> : public GenericTraits<String> {
-    static unsigned hash(const String& s) { return s.impl() ? s.impl()->hash() : 0; }
+    static unsigned hash(const String& s) { return s.hash(); }
 };
 
 struct CaseInsensitiveStringTraits : public Traits<String> {
-    static unsigned hash(const String& s) { return s.impl() ? s.to_lowercase().impl()->hash() : 0; }
+    static unsigned hash(const String& s) { return s.is_null() ? 0 : s.to_lowercase().hash(); }
     static bool equals(const String& a, const String& b) { return a.to_lowercase() == b.to_lowercase(); }
 };
 
@@ -35,7 +35,7 @@ public:
     template<typename... Parameters>
     void appendff(CheckedFormatString<Parameters...>&& fmtstr, const Parameters&... parameters)
     {
-        vformat(*this, fmtstr.view(), VariadicFormatParams { parameters... });
+        vformat(*this, fmtstr.view(), VariadicFormatParams { parameters... }, fmtstr.segments());
     }
 
     [[nodiscard]] String build() const;
@@ -6,6 +6,10 @@
 
 #pragma once
 
+// includes
+#include <base/StdLibExtras.h>
+#include <base/Types.h>
+
 namespace Base {
 
 constexpr u32 string_hash(char const* characters, size_t length)
@@ -22,6 +26,91 @@ constexpr u32 string_hash(char const* characters, size_t length)
     return hash;
 }
 
+struct StringHashKey {
+    u64 k0;
+    u64 k1;
+};
+
+namespace Detail {
+
+constexpr u64 sip_rotate_left(u64 value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+}
+
+// SipHash-1-3, eight bytes per round. Without the key, nobody can build
+// keys that all collide, so use it for anything hashing untrusted input.
+constexpr u64 sip_hash_1_3(char const* characters, size_t length, StringHashKey key)
+{
+    u64 v0 = 0x736f6d6570736575ull ^ key.k0;
+    u64 v1 = 0x646f72616e646f6dull ^ key.k1;
+    u64 v2 = 0x6c7967656e657261ull ^ key.k0;
+    u64 v3 = 0x7465646279746573ull ^ key.k1;
+
+    auto round = [&] {
+        v0 += v1;
+        v1 = Detail::sip_rotate_left(v1, 13);
+        v1 ^= v0;
+        v0 = Detail::sip_rotate_left(v0, 32);
+        v2 += v3;
+        v3 = Detail::sip_rotate_left(v3, 16);
+        v3 ^= v2;
+        v0 += v3;
+        v3 = Detail::sip_rotate_left(v3, 21);
+        v3 ^= v0;
+        v2 += v1;
+        v1 = Detail::sip_rotate_left(v1, 17);
+        v1 ^= v2;
+        v2 = Detail::sip_rotate_left(v2, 32);
+    };
+
+    auto load = [&](size_t offset, size_t count) {
+        u64 word = 0;
+        if (is_constant_evaluated()) {
+            for (size_t i = 0; i < count; ++i)
+                word |= (u64)(u8)characters[offset + i] << (i * 8);
+        } else {
+            __builtin_memcpy(&word, characters + offset, count);
+        }
+        return word;
+    };
+
+    size_t offset = 0;
+    for (; offset + 8 <= length; offset += 8) {
+        u64 word = load(offset, 8);
+        v3 ^= word;
+        round();
+        v0 ^= word;
+    }
+
+    u64 last_word = ((u64)length << 56) | load(offset, length - offset);
+    v3 ^= last_word;
+    round();
+    v0 ^= last_word;
+
+    v2 ^= 0xff;
+    round();
+    round();
+    round();
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+constexpr u32 keyed_string_hash(char const* characters, size_t length, StringHashKey key)
+{
+    u64 hash = sip_hash_1_3(characters, length, key);
+    return (u32)(hash ^ (hash >> 32));
+}
+
+// Keyed with a random key picked once per boot, or per process in
+// userland. The value is only stable until then, never store it.
+u32 seeded_string_hash(char const* characters, size_t length);
+
 }
 
-using Base::string_hash;
\ No newline at end of file
+using Base::keyed_string_hash;
+using Base::seeded_string_hash;
+using Base::sip_hash_1_3;
+using Base::string_hash;
+using Base::StringHashKey;
\ No newline at end of file
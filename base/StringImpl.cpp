@@ -12,8 +12,15 @@
 #include <base/StdLibExtras.h>
 #include <base/StringHash.h>
 #include <base/StringImpl.h>
+#include <base/StringUtils.h>
 #include <base/kmalloc.h>
 
+#ifdef KERNEL
+#    include <kernel/Random.h>
+#else
+#    include <base/Random.h>
+#endif
+
 namespace Base {
 
 static StringImpl* s_the_empty_stringimpl = nullptr;
@@ -95,8 +102,7 @@ RefPtr<StringImpl> StringImpl::create_lowercased(char const* cstring, size_t len
         return the_empty_stringimpl();
     char* buffer;
     auto impl = create_uninitialized(length, buffer);
-    for (size_t i = 0; i < length; ++i)
-        buffer[i] = (char)to_ascii_lowercase(cstring[i]);
+    StringUtils::copy_as_ascii_lowercase(cstring, buffer, length);
     return impl;
 }
 
@@ -108,35 +114,48 @@ RefPtr<StringImpl> StringImpl::create_uppercased(char const* cstring, size_t len
         return the_empty_stringimpl();
     char* buffer;
     auto impl = create_uninitialized(length, buffer);
-    for (size_t i = 0; i < length; ++i)
-        buffer[i] = (char)to_ascii_uppercase(cstring[i]);
+    StringUtils::copy_as_ascii_uppercase(cstring, buffer, length);
     return impl;
 }
 
 NonnullRefPtr<StringImpl> StringImpl::to_lowercase() const
 {
-    for (size_t i = 0; i < m_length; ++i) {
-        if (is_ascii_upper_alpha(characters()[i]))
-            return create_lowercased(characters(), m_length).release_nonnull();
-    }
+    if (StringUtils::contains_ascii_uppercase(characters(), m_length))
+        return create_lowercased(characters(), m_length).release_nonnull();
     return const_cast<StringImpl&>(*this);
 }
 
 NonnullRefPtr<StringImpl> StringImpl::to_uppercase() const
 {
-    for (size_t i = 0; i < m_length; ++i) {
-        if (is_ascii_lower_alpha(characters()[i]))
-            return create_uppercased(characters(), m_length).release_nonnull();
-    }
+    if (StringUtils::contains_ascii_lowercase(characters(), m_length))
+        return create_uppercased(characters(), m_length).release_nonnull();
     return const_cast<StringImpl&>(*this);
 }
 
+static StringHashKey string_hash_key()
+{
+    StringHashKey key;
+#ifdef KERNEL
+    key.k0 = Kernel::get_fast_random<u64>();
+    key.k1 = Kernel::get_fast_random<u64>();
+#else
+    fill_with_random(&key, sizeof(key));
+#endif
+    return key;
+}
+
+u32 seeded_string_hash(char const* characters, size_t length)
+{
+    static StringHashKey const key = string_hash_key();
+    return keyed_string_hash(characters, length, key);
+}
+
 void StringImpl::compute_hash() const
 {
     if (!length())
         m_hash = 0;
     else
-        m_hash = string_hash(characters(), m_length);
+        m_hash = seeded_string_hash(characters(), m_length);
     m_has_hash = true;
 }
 
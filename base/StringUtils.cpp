@@ -5,9 +5,13 @@
  */
 
 #include <base/CharacterTypes.h>
+#include <base/FloatingPointStringConversions.h>
+#include <base/IntegerConversions.h>
 #include <base/MemMem.h>
 #include <base/Memory.h>
 #include <base/Optional.h>
+#include <base/Platform.h>
+#include <base/SIMD.h>
 #include <base/String.h>
 #include <base/StringBuilder.h>
 #include <base/StringUtils.h>
@@ -106,6 +110,13 @@ Optional<T> convert_to_int(const StringView& str, TrimWhitespace trim_whitespace
     }
 
     T value = 0;
+    // The first few digits can't overflow T, whatever they are.
+    const auto unchecked_length = min(string.length(), i + decimal_digits_without_overflow<T>);
+    for (; i < unchecked_length; i++) {
+        if (characters[i] < '0' || characters[i] > '9')
+            return {};
+        value = value * 10 + sign * (characters[i] - '0');
+    }
     for (; i < string.length(); i++) {
         if (characters[i] < '0' || characters[i] > '9')
             return {};
@@ -136,7 +147,15 @@ Optional<T> convert_to_uint(const StringView& str, TrimWhitespace trim_whitespac
     T value = 0;
     const auto characters = string.characters_without_null_termination();
 
-    for (size_t i = 0; i < string.length(); i++) {
+    // The first few digits can't overflow T, whatever they are.
+    const auto unchecked_length = min(string.length(), decimal_digits_without_overflow<T>);
+    size_t i = 0;
+    for (; i < unchecked_length; i++) {
+        if (characters[i] < '0' || characters[i] > '9')
+            return {};
+        value = value * 10 + (characters[i] - '0');
+    }
+    for (; i < string.length(); i++) {
         if (characters[i] < '0' || characters[i] > '9')
             return {};
 
@@ -170,20 +189,12 @@ Optional<T> convert_to_uint_from_hex(const StringView& str, TrimWhitespace trim_
     const T upper_bound = NumericLimits<T>::max();
 
     for (size_t i = 0; i < count; i++) {
-        char digit = string[i];
-        u8 digit_val;
         if (value > (upper_bound >> 4))
             return {};
 
-        if (digit >= '0' && digit <= '9') {
-            digit_val = digit - '0';
-        } else if (digit >= 'a' && digit <= 'f') {
-            digit_val = 10 + (digit - 'a');
-        } else if (digit >= 'A' && digit <= 'F') {
-            digit_val = 10 + (digit - 'A');
-        } else {
+        u8 digit_val = hex_digit_value(string[i]);
+        if (digit_val == 0xff)
             return {};
-        }
 
         value = (value << 4) + digit_val;
     }
@@ -195,17 +206,128 @@ template Optional<u16> convert_to_uint_from_hex(const StringView& str, TrimWhite
 template Optional<u32> convert_to_uint_from_hex(const StringView& str, TrimWhitespace);
 template Optional<u64> convert_to_uint_from_hex(const StringView& str, TrimWhitespace);
 
+#ifndef KERNEL
+Optional<double> convert_to_double(const StringView& str, TrimWhitespace trim_whitespace)
+{
+    auto string = trim_whitespace == TrimWhitespace::Yes
+        ? str.trim_whitespace()
+        : str;
+    return parse_double(string);
+}
+#endif
+
 bool equals_ignoring_case(const StringView& a, const StringView& b)
 {
     if (a.length() != b.length())
         return false;
-    for (size_t i = 0; i < a.length(); ++i) {
-        if (to_ascii_lowercase(a.characters_without_null_termination()[i]) != to_ascii_lowercase(b.characters_without_null_termination()[i]))
+    return equals_ignoring_ascii_case(a.characters_without_null_termination(), b.characters_without_null_termination(), a.length());
+}
+
+#ifdef __SSE2__
+static ALWAYS_INLINE SIMD::u8x16 load16(char const* characters)
+{
+    SIMD::u8x16 vector;
+    __builtin_memcpy(&vector, characters, sizeof(vector));
+    return vector;
+}
+
+static ALWAYS_INLINE void store16(char* characters, SIMD::u8x16 vector)
+{
+    __builtin_memcpy(characters, &vector, sizeof(vector));
+}
+
+// 0xff in the lanes holding one of the 26 letters from first on.
+static ALWAYS_INLINE SIMD::u8x16 letter_mask(SIMD::u8x16 characters, u8 first)
+{
+    return (SIMD::u8x16)((SIMD::u8x16)(characters - first) < 26);
+}
+
+static ALWAYS_INLINE SIMD::u8x16 to_lowercase16(SIMD::u8x16 characters)
+{
+    return characters | (letter_mask(characters, 'A') & 0x20);
+}
+
+static ALWAYS_INLINE SIMD::u8x16 to_uppercase16(SIMD::u8x16 characters)
+{
+    return characters ^ (letter_mask(characters, 'a') & 0x20);
+}
+
+static ALWAYS_INLINE int lane_bits(SIMD::u8x16 mask)
+{
+    return __builtin_ia32_pmovmskb128((SIMD::c8x16)mask);
+}
+#endif
+
+bool equals_ignoring_ascii_case(char const* a, char const* b, size_t length)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= length; i += 16) {
+        if (lane_bits((SIMD::u8x16)(to_lowercase16(load16(a + i)) == to_lowercase16(load16(b + i)))) != 0xffff)
+            return false;
+    }
+#endif
+    for (; i < length; ++i) {
+        if (to_ascii_lowercase(a[i]) != to_ascii_lowercase(b[i]))
             return false;
     }
     return true;
 }
 
+void copy_as_ascii_lowercase(char const* input, char* output, size_t length)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= length; i += 16)
+        store16(output + i, to_lowercase16(load16(input + i)));
+#endif
+    for (; i < length; ++i)
+        output[i] = (char)to_ascii_lowercase(input[i]);
+}
+
+void copy_as_ascii_uppercase(char const* input, char* output, size_t length)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= length; i += 16)
+        store16(output + i, to_uppercase16(load16(input + i)));
+#endif
+    for (; i < length; ++i)
+        output[i] = (char)to_ascii_uppercase(input[i]);
+}
+
+bool contains_ascii_uppercase(char const* characters, size_t length)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= length; i += 16) {
+        if (lane_bits(letter_mask(load16(characters + i), 'A')))
+            return true;
+    }
+#endif
+    for (; i < length; ++i) {
+        if (is_ascii_upper_alpha(characters[i]))
+            return true;
+    }
+    return false;
+}
+
+bool contains_ascii_lowercase(char const* characters, size_t length)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= length; i += 16) {
+        if (lane_bits(letter_mask(load16(characters + i), 'a')))
+            return true;
+    }
+#endif
+    for (; i < length; ++i) {
+        if (is_ascii_lower_alpha(characters[i]))
+            return true;
+    }
+    return false;
+}
+
 bool ends_with(const StringView& str, const StringView& end, CaseSensitivity case_sensitivity)
 {
     if (end.is_empty())
@@ -221,12 +343,7 @@ bool ends_with(const StringView& str, const StringView& end, CaseSensitivity cas
     auto str_chars = str.characters_without_null_termination();
     auto end_chars = end.characters_without_null_termination();
 
-    size_t si = str.length() - end.length();
-    for (size_t ei = 0; ei < end.length(); ++si, ++ei) {
-        if (to_ascii_lowercase(str_chars[si]) != to_ascii_lowercase(end_chars[ei]))
-            return false;
-    }
-    return true;
+    return equals_ignoring_ascii_case(str_chars + (str.length() - end.length()), end_chars, end.length());
 }
 
 bool starts_with(const StringView& str, const StringView& start, CaseSensitivity case_sensitivity)
@@ -246,12 +363,7 @@ bool starts_with(const StringView& str, const StringView& start, CaseSensitivity
     auto str_chars = str.characters_without_null_termination();
     auto start_chars = start.characters_without_null_termination();
 
-    size_t si = 0;
-    for (size_t starti = 0; starti < start.length(); ++si, ++starti) {
-        if (to_ascii_lowercase(str_chars[si]) != to_ascii_lowercase(start_chars[starti]))
-            return false;
-    }
-    return true;
+    return equals_ignoring_ascii_case(str_chars, start_chars, start.length());
 }
 
 bool contains(const StringView& str, const StringView& needle, CaseSensitivity case_sensitivity)
@@ -324,18 +436,15 @@ Optional<size_t> find(StringView const& haystack, char needle, size_t start)
 {
     if (start >= haystack.length())
         return {};
-    for (size_t i = start; i < haystack.length(); ++i) {
-        if (haystack[i] == needle)
-            return i;
-    }
-    return {};
+    auto index = find_byte(haystack.characters_without_null_termination() + start, haystack.length() - start, needle);
+    return index.has_value() ? (*index + start) : index;
 }
 
 Optional<size_t> find(StringView const& haystack, StringView const& needle, size_t start)
 {
     if (start > haystack.length())
         return {};
-    auto index = base::memmem_optional(
+    auto index = Base::memmem_optional(
         haystack.characters_without_null_termination() + start, haystack.length() - start,
         needle.characters_without_null_termination(), needle.length());
     return index.has_value() ? (*index + start) : index;
@@ -343,11 +452,7 @@ Optional<size_t> find(StringView const& haystack, StringView const& needle, size
 
 Optional<size_t> find_last(StringView const& haystack, char needle)
 {
-    for (size_t i = haystack.length(); i > 0; --i) {
-        if (haystack[i - 1] == needle)
-            return i - 1;
-    }
-    return {};
+    return find_last_byte(haystack.characters_without_null_termination(), haystack.length(), needle);
 }
 
 Vector<size_t> find_all(StringView const& haystack, StringView const& needle)
@@ -355,7 +460,7 @@ Vector<size_t> find_all(StringView const& haystack, StringView const& needle)
     Vector<size_t> positions;
     size_t current_position = 0;
     while (current_position <= haystack.length()) {
-        auto maybe_position = base::memmem_optional(
+        auto maybe_position = Base::memmem_optional(
             haystack.characters_without_null_termination() + current_position, haystack.length() - current_position,
             needle.characters_without_null_termination(), needle.length());
         if (!maybe_position.has_value())
@@ -370,17 +475,10 @@ Optional<size_t> find_any_of(StringView const& haystack, StringView const& needl
 {
     if (haystack.is_empty() || needles.is_empty())
         return {};
-    if (direction == SearchDirection::Forward) {
-        for (size_t i = 0; i < haystack.length(); ++i) {
-            if (needles.contains(haystack[i]))
-                return i;
-        }
-    } else if (direction == SearchDirection::Backward) {
-        for (size_t i = haystack.length(); i > 0; --i) {
-            if (needles.contains(haystack[i - 1]))
-                return i - 1;
-        }
-    }
+    if (direction == SearchDirection::Forward)
+        return find_any_byte_of(haystack.characters_without_null_termination(), haystack.length(), needles.characters_without_null_termination(), needles.length());
+    if (direction == SearchDirection::Backward)
+        return find_last_any_byte_of(haystack.characters_without_null_termination(), haystack.length(), needles.characters_without_null_termination(), needles.length());
     return {};
 }
 
@@ -50,7 +50,20 @@ template<typename T = unsigned>
 Optional<T> convert_to_uint(const StringView&, TrimWhitespace = TrimWhitespace::Yes);
 template<typename T = unsigned>
 Optional<T> convert_to_uint_from_hex(const StringView&, TrimWhitespace = TrimWhitespace::Yes);
+#ifndef KERNEL
+// Correctly rounded, see parse_double().
+Optional<double> convert_to_double(const StringView&, TrimWhitespace = TrimWhitespace::Yes);
+#endif
 bool equals_ignoring_case(const StringView&, const StringView&);
+
+// Sixteen bytes at a time where SSE2 is available. Only A-Z and a-z change
+// case, every other byte, UTF-8 included, is left as it is.
+bool equals_ignoring_ascii_case(char const* a, char const* b, size_t length);
+void copy_as_ascii_lowercase(char const* input, char* output, size_t length);
+void copy_as_ascii_uppercase(char const* input, char* output, size_t length);
+bool contains_ascii_uppercase(char const* characters, size_t length);
+bool contains_ascii_lowercase(char const* characters, size_t length);
+
 bool ends_with(const StringView& a, const StringView& b, CaseSensitivity);
 bool starts_with(const StringView&, const StringView&, CaseSensitivity);
 bool contains(const StringView&, const StringView&, CaseSensitivity);
@@ -13,8 +13,6 @@
 #include <base/NumericLimits.h>
 #include <base/StdLibExtraDetails.h>
 #include <base/StdLibExtras.h>
-#include <base/String.h>
-#include <base/StringBuilder.h>
 
 namespace Base {
 
@@ -486,6 +484,20 @@ public:
             return *this;
         }
 
+        if constexpr (sizeof(U) <= sizeof(u64)) {
+            u64 small_remainder = 0;
+            R quotient = div_mod_u64(divisor, small_remainder);
+            remainder = static_cast<U>(small_remainder);
+            return quotient;
+        } else {
+            if (sizeof(U) * 8 - divisor.clz() <= 64) {
+                u64 small_remainder = 0;
+                R quotient = div_mod_u64(static_cast<u64>(divisor), small_remainder);
+                remainder = static_cast<U>(small_remainder);
+                return quotient;
+            }
+        }
+
         remainder = 0u;
         R quotient = 0u;
 
@@ -501,9 +513,86 @@ public:
         return quotient;
     }
 
+    // Short division, one 64 bit limb at a time from the top. remainder is
+    // what is left from the more significant limbs, below divisor.
+    constexpr R div_mod_u64(u64 divisor, u64& remainder) const
+    {
+        if constexpr (IsSame<T, u64>) {
+            T high = div_limb(m_high, divisor, remainder);
+            T low = div_limb(m_low, divisor, remainder);
+            return { low, high };
+        } else {
+            T high = m_high.div_mod_u64(divisor, remainder);
+            T low = m_low.div_mod_u64(divisor, remainder);
+            return { low, high };
+        }
+    }
+
+    // The full product, twice as wide. Halves of 64 bits are multiplied with
+    // __int128, which is a single mul (or mulx with BMI2) on x86_64. Below
+    // 512 bits the four products of the halves are cheaper than the extra
+    // additions of Karatsuba, which takes three.
+    constexpr auto wide_multiply(const R& other) const
+    {
+        if constexpr (sizeof(R) >= 64) {
+            R low_product = wide_multiply_halves(m_low, other.low());
+            R high_product = wide_multiply_halves(m_high, other.high());
+
+            bool carry = false;
+            T sum = m_low.addc(m_high, carry);
+            bool other_carry = false;
+            T other_sum = other.low().addc(other.high(), other_carry);
+
+            // (sum + carry * 2^n) * (other_sum + other_carry * 2^n), the
+            // bits past 2n in middle_top.
+            R middle = wide_multiply_halves(sum, other_sum);
+            u8 middle_top = carry && other_carry;
+            if (carry) {
+                bool c = false;
+                middle = middle.addc(R { T(0u), other_sum }, c);
+                middle_top += c;
+            }
+            if (other_carry) {
+                bool c = false;
+                middle = middle.addc(R { T(0u), sum }, c);
+                middle_top += c;
+            }
+
+            bool borrow = false;
+            middle = middle.subc(low_product, borrow);
+            middle_top -= borrow;
+            borrow = false;
+            middle = middle.subc(high_product, borrow);
+            middle_top -= borrow;
+
+            return add_middle(low_product, middle, middle_top, high_product);
+        } else {
+            R low_low = wide_multiply_halves(m_low, other.low());
+            R low_high = wide_multiply_halves(m_low, other.high());
+            R high_low = wide_multiply_halves(m_high, other.low());
+            R high_high = wide_multiply_halves(m_high, other.high());
+
+            bool carry = false;
+            R middle = low_high.addc(high_low, carry);
+
+            return add_middle(low_low, middle, carry, high_high);
+        }
+    }
+
     template<Unsigned U>
     constexpr R operator*(U other) const
     {
+        if constexpr (IsSame<U, R>) {
+            // Only the lower half of the product: the low halves fully, the
+            // cross products truncated, the high ones not at all.
+            R result = wide_multiply_halves(m_low, other.low());
+            result.high() += m_low * other.high();
+            result.high() += m_high * other.low();
+            return result;
+        } else if constexpr (sizeof(U) <= sizeof(T)) {
+            return *this * R { other };
+        }
+
         R res = 0u;
         R that = *this;
         for (; other != 0u; other >>= 1u) {
@@ -655,10 +744,161 @@ public:
     }
 
 private:
+    static constexpr R wide_multiply_halves(const T& a, const T& b)
+    {
+        if constexpr (IsSame<T, u64>) {
+#ifdef __SIZEOF_INT128__
+            unsigned __int128 product = (unsigned __int128)a * b;
+            return { (u64)product, (u64)(product >> 64) };
+#else
+            u64 a_low = (u32)a;
+            u64 a_high = a >> 32;
+            u64 b_low = (u32)b;
+            u64 b_high = b >> 32;
+            u64 low_low = a_low * b_low;
+            u64 low_high = a_low * b_high;
+            u64 high_low = a_high * b_low;
+            u64 middle = low_high + (low_low >> 32) + (u32)high_low;
+            return { (middle << 32) | (u32)low_low, a_high * b_high + (middle >> 32) + (high_low >> 32) };
+#endif
+        } else {
+            return a.wide_multiply(b);
+        }
+    }
+
+    // low + middle * 2^n + high * 2^2n, n being the width of T and middle_top
+    // the bit of middle past 2n.
+    static constexpr auto add_middle(R low, const R& middle, bool middle_top, R high)
+    {
+        bool carry = false;
+        low = low.addc(R { T(0u), middle.low() }, carry);
+        high = high.addc(R { middle.high(), middle_top ? T(1u) : T(0u) }, carry);
+        return UFixedBigInt<R> { low, high };
+    }
+
+    static constexpr u64 div_limb(u64 limb, u64 divisor, u64& remainder)
+    {
+#ifdef __SIZEOF_INT128__
+        unsigned __int128 dividend = ((unsigned __int128)remainder << 64) | limb;
+        remainder = (u64)(dividend % divisor);
+        return (u64)(dividend / divisor);
+#else
+        if (!remainder) {
+            remainder = limb % divisor;
+            return limb / divisor;
+        }
+
+        u64 quotient = 0;
+        for (ssize_t i = 63; i >= 0; --i) {
+            bool overflow = remainder >> 63;
+            remainder = (remainder << 1) | ((limb >> i) & 1u);
+            if (overflow || remainder >= divisor) {
+                remainder -= divisor;
+                quotient |= 1ull << i;
+            }
+        }
+        return quotient;
+#endif
+    }
+
     T m_low;
     T m_high;
 };
 
+// Multiplication modulo an odd modulus of the width of Int, without
+// dividing: numbers are kept as x * 2^n mod modulus, n being the width of
+// Int, and products reduced with Montgomery's REDC. Converting in and out
+// costs a multiplication each, so this pays off for exponentiation and
+// longer chains of products, which is what RSA and Diffie-Hellman do.
+template<typename Int>
+class MontgomeryModulus {
+public:
+    using Wide = UFixedBigInt<Int>;
+
+    constexpr explicit MontgomeryModulus(const Int& modulus)
+        : m_modulus(modulus)
+    {
+        VERIFY(modulus & 1u);
+
+        // Newton's iteration for modulus^-1 mod 2^n, the starting value is
+        // correct for the lowest 3 bits and every step doubles that.
+        Int inverse = modulus;
+        for (size_t bits = 3; bits < sizeof(Int) * 8; bits *= 2)
+            inverse *= Int(2u) - modulus * inverse;
+        m_negated_inverse = Int(0u) - inverse;
+
+        // 2^n mod modulus, then doubled n times more for 2^2n.
+        Int r = Int(0u) - modulus;
+        if (r >= modulus)
+            r = r % modulus;
+        m_one = r;
+        for (size_t i = 0; i < sizeof(Int) * 8; ++i)
+            r = add(r, r);
+        m_r_squared = r;
+    }
+
+    constexpr const Int& modulus() const { return m_modulus; }
+
+    // x has to be below the modulus.
+    constexpr Int to_montgomery(const Int& x) const { return multiply(x, m_r_squared); }
+    constexpr Int from_montgomery(const Int& x) const { return reduce(Wide { x, Int(0u) }); }
+
+    // Both in the Montgomery form, as is the result.
+    constexpr Int multiply(const Int& a, const Int& b) const { return reduce(a.wide_multiply(b)); }
+
+    constexpr Int add(const Int& a, const Int& b) const
+    {
+        bool carry = false;
+        Int sum = a.addc(b, carry);
+        if (carry || sum >= m_modulus)
+            sum -= m_modulus;
+        return sum;
+    }
+
+    // base^exponent mod modulus, base and result in the usual form. Goes
+    // through the exponent four bits at a time with a table of the first 16
+    // powers, a quarter of the multiplications of one bit at a time.
+    constexpr Int pow(const Int& base, const Int& exponent) const
+    {
+        Int powers[16];
+        powers[0] = m_one;
+        powers[1] = to_montgomery(base >= m_modulus ? base % m_modulus : base);
+        for (size_t i = 2; i < 16; ++i)
+            powers[i] = multiply(powers[i - 1], powers[1]);
+
+        Int result = m_one;
+        size_t bits = exponent ? sizeof(Int) * 8 - exponent.clz() : 0;
+        for (ssize_t shift = (ssize_t)((bits + 3) / 4 * 4) - 4; shift >= 0; shift -= 4) {
+            for (size_t i = 0; i < 4; ++i)
+                result = multiply(result, result);
+            result = multiply(result, powers[(exponent >> (size_t)shift) & 15u]);
+        }
+        return from_montgomery(result);
+    }
+
+private:
+    // t * 2^-n mod modulus, for any t below modulus * 2^n.
+    constexpr Int reduce(const Wide& t) const
+    {
+        Int m = t.low() * m_negated_inverse;
+        Wide mn = m.wide_multiply(m_modulus);
+
+        bool carry = false;
+        Wide sum = t.addc(mn, carry);
+        Int result = sum.high();
+        if (carry || result >= m_modulus)
+            result -= m_modulus;
+        return result;
+    }
+
+    Int m_modulus;
+    Int m_negated_inverse;
+    // 2^n and 2^2n mod modulus, 1 in the Montgomery form and what takes a
+    // number into it.
+    Int m_one;
+    Int m_r_squared;
+};
+
 template<Unsigned U, Unsigned T>
 requires(sizeof(U) < sizeof(T) * 2) constexpr bool operator<(const U a, const UFixedBigInt<T>& b) { return b >= a; }
 template<Unsigned U, Unsigned T>
@@ -728,4 +968,6 @@ using u256 = Base::UFixedBigInt<u128>;
 using u512 = Base::UFixedBigInt<u256>;
 using u1024 = Base::UFixedBigInt<u512>;
 using u2048 = Base::UFixedBigInt<u1024>;
-using u4096 = Base::UFixedBigInt<u2048>;
\ No newline at end of file
+using u4096 = Base::UFixedBigInt<u2048>;
+
+using Base::MontgomeryModulus;
\ No newline at end of file
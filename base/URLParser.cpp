@@ -649,4 +649,193 @@ URL URLParser::parse(Badge<URL>, StringView const& raw_input, URL const* base_ur
     return url;
 }
 
-}
\ No newline at end of file
+static bool is_forbidden_host_code_point(u8 code_point, bool include_percent)
+{
+    return "\0\t\n\r #/:<>?@[\\]^|"sv.contains(code_point) || (include_percent && code_point == '%');
+}
+
+// The same checks parse_host() makes, without decoding into a new string.
+static bool is_valid_host_for_view(StringView const& host, bool is_opaque)
+{
+    for (size_t i = 0; i < host.length(); ++i) {
+        u8 code_point = host[i];
+        if (is_opaque) {
+            if (is_forbidden_host_code_point(code_point, false))
+                return false;
+            continue;
+        }
+        if (code_point == '%' && i + 2 < host.length() && is_ascii_hex_digit(host[i + 1]) && is_ascii_hex_digit(host[i + 2])) {
+            code_point = (parse_ascii_hex_digit(host[i + 1]) << 4) | parse_ascii_hex_digit(host[i + 2]);
+            i += 2;
+        }
+        if (is_forbidden_host_code_point(code_point, true))
+            return false;
+    }
+    return true;
+}
+
+URLView URLParser::parse_view(Badge<URLView>, StringView const& raw_input)
+{
+    dbgln_if(URL_PARSER_DEBUG, "URLParser::parse_view: Parsing '{}'", raw_input);
+
+    size_t start_index = 0;
+    size_t end_index = raw_input.length();
+    while (start_index < end_index && static_cast<u8>(raw_input[start_index]) <= 0x20)
+        ++start_index;
+    while (end_index > start_index && static_cast<u8>(raw_input[end_index - 1]) <= 0x20)
+        --end_index;
+    if (start_index == end_index)
+        return {};
+
+    // The copy drops tabs and newlines like parse() does, and is what every
+    // component points into.
+    size_t length = 0;
+    for (size_t i = start_index; i < end_index; ++i) {
+        if (raw_input[i] != '\t' && raw_input[i] != '\n')
+            ++length;
+    }
+    if (length >= URLView::Component::null_offset)
+        return {};
+
+    char* buffer;
+    auto impl = StringImpl::create_uninitialized(length, buffer);
+    for (size_t i = start_index, j = 0; i < end_index; ++i) {
+        if (raw_input[i] != '\t' && raw_input[i] != '\n')
+            buffer[j++] = raw_input[i];
+    }
+
+    auto component = [](size_t offset, size_t component_length) {
+        return URLView::Component { static_cast<u32>(offset), static_cast<u32>(component_length) };
+    };
+    auto has_at = [&](size_t offset, char character) {
+        return offset < length && buffer[offset] == character;
+    };
+
+    URLView url;
+
+    if (!is_ascii_alpha(buffer[0]))
+        return {};
+    size_t i = 1;
+    while (i < length && (is_ascii_alphanumeric(buffer[i]) || buffer[i] == '+' || buffer[i] == '-' || buffer[i] == '.'))
+        ++i;
+    if (!has_at(i, ':'))
+        return {};
+    for (size_t j = 0; j < i; ++j)
+        buffer[j] = to_ascii_lowercase(buffer[j]);
+    url.m_scheme = component(0, i);
+    StringView scheme { buffer, i };
+    bool is_special = URL::is_special_scheme(scheme);
+    bool is_file = scheme == "file"sv;
+    ++i;
+
+    // Only the authority and the path take backslashes for slashes.
+    if (is_special) {
+        for (size_t j = i; j < length && buffer[j] != '?' && buffer[j] != '#'; ++j) {
+            if (buffer[j] == '\\') {
+                report_validation_error();
+                buffer[j] = '/';
+            }
+        }
+    }
+
+    bool has_authority = false;
+    if (is_file || !is_special) {
+        has_authority = has_at(i, '/') && has_at(i + 1, '/');
+        if (has_authority)
+            i += 2;
+    } else {
+        has_authority = true;
+        while (has_at(i, '/'))
+            ++i;
+    }
+
+    if (has_authority) {
+        size_t authority_end = i;
+        while (authority_end < length && buffer[authority_end] != '/' && buffer[authority_end] != '?' && buffer[authority_end] != '#')
+            ++authority_end;
+
+        // The last at sign ends the userinfo, any earlier ones are part of it.
+        size_t host_start = i;
+        for (size_t j = authority_end; j > i; --j) {
+            if (buffer[j - 1] == '@') {
+                host_start = j;
+                break;
+            }
+        }
+        if (host_start != i) {
+            report_validation_error();
+            if (is_file || host_start == authority_end)
+                return {};
+            size_t userinfo_end = host_start - 1;
+            size_t colon = i;
+            while (colon < userinfo_end && buffer[colon] != ':')
+                ++colon;
+            url.m_username = component(i, colon - i);
+            if (colon < userinfo_end)
+                url.m_password = component(colon + 1, userinfo_end - colon - 1);
+        }
+
+        size_t host_end = authority_end;
+        if (!is_file) {
+            size_t colon = host_start;
+            while (colon < authority_end && buffer[colon] != ':')
+                ++colon;
+            if (colon < authority_end) {
+                if (colon == host_start) {
+                    report_validation_error();
+                    return {};
+                }
+                u32 port = 0;
+                for (size_t j = colon + 1; j < authority_end; ++j) {
+                    if (is_ascii_digit(buffer[j]))
+                        port = port * 10 + parse_ascii_digit(buffer[j]);
+                    if (!is_ascii_digit(buffer[j]) || port > 65535) {
+                        report_validation_error();
+                        return {};
+                    }
+                }
+                if (colon + 1 < authority_end && port != URL::default_port_for_scheme(scheme))
+                    url.m_port = port;
+                host_end = colon;
+            }
+        }
+
+        StringView host { buffer + host_start, host_end - host_start };
+        if (is_special && !is_file && host.is_empty()) {
+            report_validation_error();
+            return {};
+        }
+        if (!is_valid_host_for_view(host, is_file || !is_special)) {
+            report_validation_error();
+            return {};
+        }
+        url.m_host = component(host_start, is_file && host == "localhost"sv ? 0 : host.length());
+        i = authority_end;
+    } else if (is_file) {
+        url.m_host = component(i, 0);
+    }
+
+    url.m_cannot_be_a_base_url = !has_authority && !is_special && !has_at(i, '/');
+
+    size_t path_end = i;
+    while (path_end < length && buffer[path_end] != '?' && buffer[path_end] != '#')
+        ++path_end;
+    url.m_path = component(i, path_end - i);
+    i = path_end;
+
+    if (has_at(i, '?')) {
+        size_t query_end = i + 1;
+        while (query_end < length && buffer[query_end] != '#')
+            ++query_end;
+        url.m_query = component(i + 1, query_end - i - 1);
+        i = query_end;
+    }
+    if (has_at(i, '#'))
+        url.m_fragment = component(i + 1, length - i - 1);
+
+    url.m_buffer = move(impl);
+    url.m_valid = true;
+    return url;
+}
+
+}
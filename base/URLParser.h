@@ -10,6 +10,7 @@
 #include <base/Optional.h>
 #include <base/StringView.h>
 #include <base/URL.h>
+#include <base/URLView.h>
 
 namespace Base {
 
@@ -58,6 +59,10 @@ public:
 
     static URL parse(Badge<URL>, StringView const& input, URL const* base_url = nullptr);
 
+    // Parses an absolute URL without building a String per component.
+    // Relative references, which need a base URL, are left to parse().
+    static URLView parse_view(Badge<URLView>, StringView const& input);
+
 private:
     static Optional<URL> parse_data_url(StringView const& raw_input);
 };
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/StringBuilder.h>
+#include <base/URLParser.h>
+#include <base/URLView.h>
+
+namespace Base {
+
+URLView::URLView(StringView const& string)
+    : URLView(URLParser::parse_view({}, string))
+{
+}
+
+String URLView::host() const
+{
+    if (m_host.is_null())
+        return {};
+    // Opaque hosts, which file URLs have too, are kept percent-encoded like
+    // URL keeps them.
+    if (!is_special() || scheme() == "file"sv)
+        return URL::percent_encode(raw_host(), URL::PercentEncodeSet::C0Control);
+    return URL::percent_decode(raw_host());
+}
+
+static bool is_single_dot_segment(StringView const& segment)
+{
+    return segment == "."sv || segment.equals_ignoring_case("%2e"sv);
+}
+
+static bool is_double_dot_segment(StringView const& segment)
+{
+    return segment == ".."sv || segment.equals_ignoring_case(".%2e"sv) || segment.equals_ignoring_case("%2e."sv) || segment.equals_ignoring_case("%2e%2e"sv);
+}
+
+Vector<String> URLView::paths() const
+{
+    Vector<String> paths;
+    if (m_cannot_be_a_base_url) {
+        paths.append(URL::percent_decode(raw_path()));
+        return paths;
+    }
+
+    // Dot segments are resolved here rather than while parsing, so a URL
+    // whose path is never looked at doesn't pay for them.
+    size_t remaining = 0;
+    for_each_raw_path_segment([&](auto) { ++remaining; });
+    for_each_raw_path_segment([&](StringView const& segment) {
+        bool is_last = --remaining == 0;
+        if (is_double_dot_segment(segment)) {
+            if (!paths.is_empty())
+                paths.take_last();
+            if (is_last)
+                paths.append("");
+        } else if (is_single_dot_segment(segment)) {
+            if (is_last)
+                paths.append("");
+        } else {
+            paths.append(URL::percent_decode(segment));
+        }
+    });
+    return paths;
+}
+
+String URLView::path() const
+{
+    auto segments = paths();
+    if (m_cannot_be_a_base_url)
+        return segments[0];
+    StringBuilder builder;
+    for (auto& segment : segments) {
+        builder.append('/');
+        builder.append(segment);
+    }
+    return builder.to_string();
+}
+
+URL URLView::to_url() const
+{
+    if (!m_valid)
+        return {};
+    // Only URL knows how to split data URLs into type and payload.
+    if (scheme() == "data"sv)
+        return URL(m_buffer);
+    URL url;
+    url.set_scheme(scheme());
+    url.set_username(username());
+    url.set_password(password());
+    url.set_host(host());
+    url.set_port(m_port);
+    url.set_cannot_be_a_base_url(m_cannot_be_a_base_url);
+    url.set_paths(paths());
+    url.set_query(query());
+    url.set_fragment(fragment());
+    return url;
+}
+
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/NumericLimits.h>
+#include <base/String.h>
+#include <base/StringView.h>
+#include <base/URL.h>
+#include <base/Vector.h>
+
+namespace Base {
+
+// A parsed absolute URL that keeps one copy of its input and describes each
+// component by its offset and length in it. Parsing allocates nothing but
+// that copy; percent-decoding happens when a decoded component is asked
+// for, and the raw_*() accessors never allocate at all.
+class URLView {
+    friend class URLParser;
+
+public:
+    URLView() = default;
+    URLView(StringView const&);
+
+    bool is_valid() const { return m_valid; }
+
+    // Always lower case, which needs no decoding.
+    StringView scheme() const { return view(m_scheme); }
+    bool is_special() const { return URL::is_special_scheme(scheme()); }
+    bool cannot_be_a_base_url() const { return m_cannot_be_a_base_url; }
+
+    StringView raw_username() const { return view(m_username); }
+    StringView raw_password() const { return view(m_password); }
+    StringView raw_host() const { return view(m_host); }
+    StringView raw_path() const { return view(m_path); }
+    StringView raw_query() const { return view(m_query); }
+    StringView raw_fragment() const { return view(m_fragment); }
+
+    bool has_host() const { return !m_host.is_null(); }
+    bool has_query() const { return !m_query.is_null(); }
+    bool has_fragment() const { return !m_fragment.is_null(); }
+
+    u16 port() const { return m_port ? m_port : URL::default_port_for_scheme(scheme()); }
+
+    // The decoded components, the same as URL would have parsed them.
+    String username() const { return URL::percent_decode(raw_username()); }
+    String password() const { return URL::percent_decode(raw_password()); }
+    String host() const;
+    Vector<String> paths() const;
+    String path() const;
+    String query() const { return decode(m_query); }
+    String fragment() const { return decode(m_fragment); }
+
+    // Calls callback with each raw path segment, before dot segments are
+    // resolved or anything is decoded.
+    template<typename Callback>
+    void for_each_raw_path_segment(Callback callback) const
+    {
+        auto path = raw_path();
+        if (m_cannot_be_a_base_url) {
+            callback(path);
+            return;
+        }
+        if (path.starts_with('/'))
+            path = path.substring_view(1);
+        else if (path.is_empty() && !is_special())
+            return;
+        for (;;) {
+            auto slash = path.find('/');
+            if (!slash.has_value()) {
+                callback(path);
+                return;
+            }
+            callback(path.substring_view(0, slash.value()));
+            path = path.substring_view(slash.value() + 1);
+        }
+    }
+
+    URL to_url() const;
+
+private:
+    struct Component {
+        static constexpr u32 null_offset = NumericLimits<u32>::max();
+
+        u32 offset { null_offset };
+        u32 length { 0 };
+
+        bool is_null() const { return offset == null_offset; }
+    };
+
+    StringView view(Component component) const
+    {
+        if (component.is_null())
+            return {};
+        return m_buffer.substring_view(component.offset, component.length);
+    }
+    String decode(Component component) const
+    {
+        if (component.is_null())
+            return {};
+        return URL::percent_decode(view(component));
+    }
+
+    String m_buffer;
+    Component m_scheme;
+    Component m_username;
+    Component m_password;
+    Component m_host;
+    Component m_path;
+    Component m_query;
+    Component m_fragment;
+    u16 m_port { 0 };
+    bool m_valid { false };
+    bool m_cannot_be_a_base_url { false };
+};
+
+}
+
+using Base::URLView;
@@ -6,10 +6,18 @@
 
 // includes
 #include <base/Array.h>
+#include <base/CharacterTypes.h>
 #include <base/Optional.h>
 #include <base/StringView.h>
 #include <base/UnicodeUtils.h>
 
+// Generated at configure time when the Unicode Character Database is
+// downloaded, like the PCI and USB ids.
+#if __has_include(<base/UnicodeTables.h>)
+#    include <base/UnicodeTables.h>
+#    define HAVE_UNICODE_TABLES
+#endif
+
 namespace Base::UnicodeUtils {
 
 Optional<StringView> get_unicode_control_code_point_alias(u32 code_point)
@@ -35,4 +43,112 @@ Optional<StringView> get_unicode_control_code_point_alias(u32 code_point)
     return {};
 }
 
-}
\ No newline at end of file
+#ifdef HAVE_UNICODE_TABLES
+static Detail::CodePointProperties const& properties_of(u32 code_point)
+{
+    static constexpr Detail::CodePointProperties unassigned { 0, 0, 0, 0 };
+    if (code_point >= 0x110000)
+        return unassigned;
+    constexpr u32 block_mask = (1u << Detail::code_point_block_shift) - 1;
+    size_t block = Detail::code_point_blocks[code_point >> Detail::code_point_block_shift];
+    return Detail::code_point_properties[Detail::code_point_property_indices[(block << Detail::code_point_block_shift) | (code_point & block_mask)]];
+}
+#endif
+
+GeneralCategory general_category(u32 code_point)
+{
+#ifdef HAVE_UNICODE_TABLES
+    return static_cast<GeneralCategory>(properties_of(code_point).category);
+#else
+    if (is_ascii_upper_alpha(code_point))
+        return GeneralCategory::UppercaseLetter;
+    if (is_ascii_lower_alpha(code_point))
+        return GeneralCategory::LowercaseLetter;
+    if (is_ascii_digit(code_point))
+        return GeneralCategory::DecimalNumber;
+    if (code_point == ' ' || code_point == 0xa0)
+        return GeneralCategory::SpaceSeparator;
+    if (is_ascii_c0_control(code_point) || code_point == 0x7f || (code_point >= 0x80 && code_point < 0xa0))
+        return GeneralCategory::Control;
+    if (code_point >= 0xd800 && code_point <= 0xdfff)
+        return GeneralCategory::Surrogate;
+    if ((code_point >= 0xe000 && code_point <= 0xf8ff) || (code_point >= 0xf0000 && code_point <= 0x10ffff && (code_point & 0xfffe) != 0xfffe))
+        return GeneralCategory::PrivateUse;
+    if (is_ascii(code_point)) {
+        switch (code_point) {
+        case '$':
+            return GeneralCategory::CurrencySymbol;
+        case '+':
+        case '<':
+        case '=':
+        case '>':
+        case '|':
+        case '~':
+            return GeneralCategory::MathSymbol;
+        case '^':
+        case '`':
+            return GeneralCategory::ModifierSymbol;
+        case '(':
+        case '[':
+        case '{':
+            return GeneralCategory::OpenPunctuation;
+        case ')':
+        case ']':
+        case '}':
+            return GeneralCategory::ClosePunctuation;
+        case '-':
+            return GeneralCategory::DashPunctuation;
+        case '_':
+            return GeneralCategory::ConnectorPunctuation;
+        default:
+            return GeneralCategory::OtherPunctuation;
+        }
+    }
+    return GeneralCategory::Unassigned;
+#endif
+}
+
+bool is_unicode_letter(u32 code_point)
+{
+    if (is_ascii(code_point))
+        return is_ascii_alpha(code_point);
+    auto category = general_category(code_point);
+    return category >= GeneralCategory::UppercaseLetter && category <= GeneralCategory::OtherLetter;
+}
+
+bool is_unicode_whitespace(u32 code_point)
+{
+    if (is_ascii(code_point))
+        return is_ascii_space(code_point);
+#ifdef HAVE_UNICODE_TABLES
+    return properties_of(code_point).flags & Detail::code_point_flag_whitespace;
+#else
+    // White_Space is short and hasn't changed in years.
+    return code_point == 0x85 || code_point == 0xa0 || code_point == 0x1680 || (code_point >= 0x2000 && code_point <= 0x200a)
+        || code_point == 0x2028 || code_point == 0x2029 || code_point == 0x202f || code_point == 0x205f || code_point == 0x3000;
+#endif
+}
+
+u32 to_unicode_lowercase(u32 code_point)
+{
+    if (is_ascii(code_point))
+        return to_ascii_lowercase(code_point);
+#ifdef HAVE_UNICODE_TABLES
+    return code_point + properties_of(code_point).lowercase_offset;
+#else
+    return code_point;
+#endif
+}
+
+u32 to_unicode_uppercase(u32 code_point)
+{
+    if (is_ascii(code_point))
+        return to_ascii_uppercase(code_point);
+#ifdef HAVE_UNICODE_TABLES
+    return code_point + properties_of(code_point).uppercase_offset;
+#else
+    return code_point;
+#endif
+}
+
+}
@@ -18,4 +18,50 @@ constexpr bool is_unicode_control_code_point(u32 code_point)
 
 Optional<StringView> get_unicode_control_code_point_alias(u32);
 
+// In the order of the Unicode Character Database's two letter names, Lu
+// to Co, with code points it doesn't assign anything to first.
+enum class GeneralCategory : u8 {
+    Unassigned,
+    UppercaseLetter,
+    LowercaseLetter,
+    TitlecaseLetter,
+    ModifierLetter,
+    OtherLetter,
+    NonspacingMark,
+    SpacingMark,
+    EnclosingMark,
+    DecimalNumber,
+    LetterNumber,
+    OtherNumber,
+    ConnectorPunctuation,
+    DashPunctuation,
+    OpenPunctuation,
+    ClosePunctuation,
+    InitialPunctuation,
+    FinalPunctuation,
+    OtherPunctuation,
+    MathSymbol,
+    CurrencySymbol,
+    ModifierSymbol,
+    OtherSymbol,
+    SpaceSeparator,
+    LineSeparator,
+    ParagraphSeparator,
+    Control,
+    Format,
+    Surrogate,
+    PrivateUse,
+};
+
+// Looked up in tables meta/generate-unicode-tables.py makes from the
+// Unicode Character Database at build time. Builds without the database
+// only know about ASCII, controls, surrogates and private use.
+GeneralCategory general_category(u32 code_point);
+bool is_unicode_letter(u32 code_point);
+bool is_unicode_whitespace(u32 code_point);
+
+// Simple case mappings, one code point to one code point.
+u32 to_unicode_lowercase(u32 code_point);
+u32 to_unicode_uppercase(u32 code_point);
+
 }
\ No newline at end of file
@@ -42,12 +42,16 @@ static Vector<u16> to_utf16_impl(UtfViewType const& view) requires(IsSame<UtfVie
 
 Vector<u16> utf8_to_utf16(StringView const& utf8_view)
 {
-    return to_utf16_impl(Utf8View { utf8_view });
+    return utf8_to_utf16(Utf8View { utf8_view });
 }
 
 Vector<u16> utf8_to_utf16(Utf8View const& utf8_view)
 {
-    return to_utf16_impl(utf8_view);
+    // There are never more UTF-16 code units than UTF-8 bytes.
+    Vector<u16> utf16_data;
+    utf16_data.resize(utf8_view.byte_length());
+    utf16_data.resize_and_keep_capacity(utf8_view.to_utf16(utf16_data.data()));
+    return utf16_data;
 }
 
 Vector<u16> utf32_to_utf16(Utf32View const& utf32_view)
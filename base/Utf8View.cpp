@@ -7,6 +7,8 @@
 // includes
 #include <base/Assertions.h>
 #include <base/Format.h>
+#include <base/Platform.h>
+#include <base/SIMD.h>
 #include <base/Utf8View.h>
 
 namespace Base {
@@ -122,34 +124,296 @@ static inline bool decode_first_byte(
     return false;
 }
 
-bool Utf8View::validate(size_t& valid_bytes) const
+static size_t ascii_prefix_length(const unsigned char* bytes, size_t length)
 {
-    valid_bytes = 0;
-    for (auto ptr = begin_ptr(); ptr < end_ptr(); ptr++) {
+    size_t offset = 0;
+    for (; offset + 8 <= length; offset += 8) {
+        u64 word;
+        __builtin_memcpy(&word, bytes + offset, sizeof(word));
+        if (word & 0x8080808080808080ull)
+            break;
+    }
+    while (offset < length && bytes[offset] < 0x80)
+        ++offset;
+    return offset;
+}
+
+// Rejects overlong forms, surrogates and anything above U+10FFFF, just
+// like the vectorized path.
+static size_t valid_prefix_length(const unsigned char* bytes, size_t length)
+{
+    size_t offset = 0;
+    for (;;) {
+        offset += ascii_prefix_length(bytes + offset, length - offset);
+        if (offset == length)
+            return offset;
+
+        u8 lead = bytes[offset];
+        u8 second_min = 0x80;
+        u8 second_max = 0xbf;
         size_t code_point_length_in_bytes;
-        u32 value;
-        bool first_byte_makes_sense = decode_first_byte(*ptr, code_point_length_in_bytes, value);
-        if (!first_byte_makes_sense)
-            return false;
+        if (lead >= 0xc2 && lead <= 0xdf) {
+            code_point_length_in_bytes = 2;
+        } else if (lead >= 0xe0 && lead <= 0xef) {
+            code_point_length_in_bytes = 3;
+            if (lead == 0xe0)
+                second_min = 0xa0;
+            else if (lead == 0xed)
+                second_max = 0x9f;
+        } else if (lead >= 0xf0 && lead <= 0xf4) {
+            code_point_length_in_bytes = 4;
+            if (lead == 0xf0)
+                second_min = 0x90;
+            else if (lead == 0xf4)
+                second_max = 0x8f;
+        } else {
+            return offset;
+        }
 
-        for (size_t i = 1; i < code_point_length_in_bytes; i++) {
-            ptr++;
-            if (ptr >= end_ptr())
-                return false;
-            if (*ptr >> 6 != 2)
-                return false;
+        if (length - offset < code_point_length_in_bytes)
+            return offset;
+        if (bytes[offset + 1] < second_min || bytes[offset + 1] > second_max)
+            return offset;
+        for (size_t i = 2; i < code_point_length_in_bytes; i++) {
+            if (bytes[offset + i] >> 6 != 2)
+                return offset;
         }
+        offset += code_point_length_in_bytes;
+    }
+}
 
-        valid_bytes += code_point_length_in_bytes;
+// Only userland can use SSSE3, the kernel doesn't save vector registers.
+#if defined(__x86_64__) && !defined(KERNEL)
+#    define UTF8_VIEW_HAS_SSSE3
+
+// Keiser and Lemire's validation, sixteen bytes at a time: three table
+// lookups on the nibbles of each byte and the one before it flag every
+// invalid pair of bytes, and the three and four byte sequences are checked
+// for their continuation bytes separately.
+struct Utf8ValidationState {
+    // The previous block, then the current one.
+    alignas(16) u8 window[32] {};
+    SIMD::u8x16 error {};
+    SIMD::u8x16 previous_incomplete {};
+};
+
+__attribute__((target("ssse3"))) static SIMD::u8x16 lookup_nibbles(SIMD::u8x16 table, SIMD::u8x16 nibbles)
+{
+    return (SIMD::u8x16)__builtin_ia32_pshufb128((SIMD::c8x16)table, (SIMD::c8x16)nibbles);
+}
+
+__attribute__((target("ssse3"))) static SIMD::u8x16 saturating_subtract(SIMD::u8x16 a, SIMD::u8x16 b)
+{
+    return (SIMD::u8x16)__builtin_ia32_psubusb128((SIMD::c8x16)a, (SIMD::c8x16)b);
+}
+
+__attribute__((target("ssse3"))) static bool is_ascii(SIMD::u8x16 bytes)
+{
+    return !__builtin_ia32_pmovmskb128((SIMD::c8x16)bytes);
+}
+
+__attribute__((target("ssse3"))) static void check_block(Utf8ValidationState& state, SIMD::u8x16 input)
+{
+    constexpr u8 too_short = 1 << 0;
+    constexpr u8 too_long = 1 << 1;
+    constexpr u8 overlong_3 = 1 << 2;
+    constexpr u8 too_large = 1 << 3;
+    constexpr u8 surrogate = 1 << 4;
+    constexpr u8 overlong_2 = 1 << 5;
+    constexpr u8 too_large_1000 = 1 << 6;
+    constexpr u8 overlong_4 = 1 << 6;
+    constexpr u8 two_continuations = 1 << 7;
+    constexpr u8 carry = too_short | too_long | two_continuations;
+
+    // By the high nibble of the first byte of a pair...
+    constexpr SIMD::u8x16 byte_1_high = {
+        too_long, too_long, too_long, too_long, too_long, too_long, too_long, too_long,
+        two_continuations, two_continuations, two_continuations, two_continuations,
+        too_short | overlong_2,
+        too_short,
+        too_short | overlong_3 | surrogate,
+        too_short | too_large | too_large_1000 | overlong_4
+    };
+    // ...its low nibble...
+    constexpr SIMD::u8x16 byte_1_low = {
+        carry | overlong_3 | overlong_2 | overlong_4,
+        carry | overlong_2,
+        carry,
+        carry,
+        carry | too_large,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000 | surrogate,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000
+    };
+    // ...and the high nibble of the second byte.
+    constexpr SIMD::u8x16 byte_2_high = {
+        too_short, too_short, too_short, too_short, too_short, too_short, too_short, too_short,
+        too_long | overlong_2 | two_continuations | overlong_3 | too_large_1000 | overlong_4,
+        too_long | overlong_2 | two_continuations | overlong_3 | too_large,
+        too_long | overlong_2 | two_continuations | surrogate | too_large,
+        too_long | overlong_2 | two_continuations | surrogate | too_large,
+        too_short, too_short, too_short, too_short
+    };
+    // A lead byte this close to the end of a block continues in the next.
+    constexpr SIMD::u8x16 incomplete_max = {
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 0xef, 0xdf, 0xbf
+    };
+    constexpr SIMD::u8x16 nibble_mask = {
+        0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf, 0xf
+    };
+    constexpr SIMD::u8x16 third_byte_min = {
+        0xdf, 0xdf, 0xdf, 0xdf, 0xdf, 0xdf, 0xdf, 0xdf, 0xdf, 0xdf, 0xdf, 0xdf, 0xdf, 0xdf, 0xdf, 0xdf
+    };
+    constexpr SIMD::u8x16 fourth_byte_min = {
+        0xef, 0xef, 0xef, 0xef, 0xef, 0xef, 0xef, 0xef, 0xef, 0xef, 0xef, 0xef, 0xef, 0xef, 0xef, 0xef
+    };
+
+    __builtin_memcpy(state.window + 16, &input, sizeof(input));
+    if (is_ascii(input)) {
+        state.error |= state.previous_incomplete;
+        state.previous_incomplete = SIMD::u8x16 {};
+    } else {
+        SIMD::u8x16 previous_1;
+        SIMD::u8x16 previous_2;
+        SIMD::u8x16 previous_3;
+        __builtin_memcpy(&previous_1, state.window + 15, sizeof(previous_1));
+        __builtin_memcpy(&previous_2, state.window + 14, sizeof(previous_2));
+        __builtin_memcpy(&previous_3, state.window + 13, sizeof(previous_3));
+
+        SIMD::u8x16 special_cases = lookup_nibbles(byte_1_high, (previous_1 >> 4) & nibble_mask)
+            & lookup_nibbles(byte_1_low, previous_1 & nibble_mask)
+            & lookup_nibbles(byte_2_high, (input >> 4) & nibble_mask);
+
+        // Continuation bytes two or three after a three or four byte lead
+        // are the only ones allowed to follow another continuation byte.
+        SIMD::u8x16 must_be_continuation = saturating_subtract(previous_2, third_byte_min) | saturating_subtract(previous_3, fourth_byte_min);
+        SIMD::u8x16 must_be_continuation_80 = (SIMD::u8x16)(must_be_continuation != SIMD::u8x16 {}) & two_continuations;
+        state.error |= must_be_continuation_80 ^ special_cases;
+        state.previous_incomplete = saturating_subtract(input, incomplete_max);
     }
+    __builtin_memcpy(state.window, state.window + 16, 16);
+}
 
-    return true;
+__attribute__((target("ssse3"))) static bool validate_ssse3(const unsigned char* bytes, size_t length)
+{
+    Utf8ValidationState state;
+    size_t offset = 0;
+    for (; offset + 16 <= length; offset += 16) {
+        SIMD::u8x16 input;
+        __builtin_memcpy(&input, bytes + offset, sizeof(input));
+        check_block(state, input);
+    }
+    if (offset < length) {
+        // The zeroes after the end catch a sequence cut short by it.
+        SIMD::u8x16 input {};
+        __builtin_memcpy(&input, bytes + offset, length - offset);
+        check_block(state, input);
+    }
+    state.error |= state.previous_incomplete;
+    return is_ascii((SIMD::u8x16)(state.error != SIMD::u8x16 {}));
+}
+#endif
+
+bool Utf8View::validate(size_t& valid_bytes) const
+{
+#ifdef UTF8_VIEW_HAS_SSSE3
+    static bool const has_ssse3 = __builtin_cpu_supports("ssse3");
+    // Finding out how much of it is valid is left to the slow path.
+    if (has_ssse3 && validate_ssse3(begin_ptr(), byte_length())) {
+        valid_bytes = byte_length();
+        return true;
+    }
+#endif
+    valid_bytes = valid_prefix_length(begin_ptr(), byte_length());
+    return valid_bytes == byte_length();
+}
+
+// Decodes like the iterator does: anything that doesn't make sense becomes
+// U+FFFD and only moves on by one byte.
+static u32 decode_code_point(const unsigned char* bytes, size_t length, size_t& code_point_length_in_bytes)
+{
+    u32 value;
+    if (!decode_first_byte(bytes[0], code_point_length_in_bytes, value) || code_point_length_in_bytes > length) {
+        code_point_length_in_bytes = 1;
+        return 0xfffd;
+    }
+    for (size_t offset = 1; offset < code_point_length_in_bytes; offset++) {
+        if (bytes[offset] >> 6 != 2) {
+            code_point_length_in_bytes = 1;
+            return 0xfffd;
+        }
+        value = (value << 6) | (bytes[offset] & 63);
+    }
+    return value;
+}
+
+template<typename CodeUnit, typename Callback>
+static size_t transcode(const unsigned char* bytes, size_t length, CodeUnit* buffer, Callback append_code_point)
+{
+    size_t buffer_length = 0;
+    size_t offset = 0;
+    while (offset < length) {
+        size_t ascii_length = ascii_prefix_length(bytes + offset, length - offset);
+        for (size_t i = 0; i < ascii_length; i++)
+            buffer[buffer_length++] = bytes[offset + i];
+        offset += ascii_length;
+        if (offset == length)
+            break;
+
+        size_t code_point_length_in_bytes;
+        u32 code_point = decode_code_point(bytes + offset, length - offset, code_point_length_in_bytes);
+        append_code_point(code_point, buffer, buffer_length);
+        offset += code_point_length_in_bytes;
+    }
+    return buffer_length;
+}
+
+size_t Utf8View::to_utf32(u32* buffer) const
+{
+    return transcode(begin_ptr(), byte_length(), buffer, [](u32 code_point, u32* buffer, size_t& buffer_length) {
+        buffer[buffer_length++] = code_point;
+    });
+}
+
+size_t Utf8View::to_utf16(u16* buffer) const
+{
+    return transcode(begin_ptr(), byte_length(), buffer, [](u32 code_point, u16* buffer, size_t& buffer_length) {
+        // Leading bytes 0xf5 to 0xf7 decode past U+10FFFF.
+        if (code_point > 0x10ffff)
+            code_point = 0xfffd;
+        if (code_point < 0x10000) {
+            buffer[buffer_length++] = code_point;
+            return;
+        }
+        code_point -= 0x10000;
+        buffer[buffer_length++] = 0xd800 | (code_point >> 10);
+        buffer[buffer_length++] = 0xdc00 | (code_point & 0x3ff);
+    });
 }
 
 size_t Utf8View::calculate_length() const
 {
     size_t length = 0;
-    for ([[maybe_unused]] auto code_point : *this) {
+    auto* bytes = begin_ptr();
+    size_t offset = 0;
+    while (offset < byte_length()) {
+        size_t ascii_length = ascii_prefix_length(bytes + offset, byte_length() - offset);
+        length += ascii_length;
+        offset += ascii_length;
+        if (offset == byte_length())
+            break;
+
+        size_t code_point_length_in_bytes;
+        decode_code_point(bytes + offset, byte_length() - offset, code_point_length_in_bytes);
+        offset += code_point_length_in_bytes;
         ++length;
     }
     return length;
@@ -88,6 +88,13 @@ public:
         return validate(valid_bytes);
     }
 
+    // Decode everything at once into a buffer of at least byte_length()
+    // code units, taking runs of ASCII eight bytes at a time. Like the
+    // iterator, anything invalid becomes U+FFFD. Both return how many code
+    // units they wrote.
+    size_t to_utf32(u32* buffer) const;
+    size_t to_utf16(u16* buffer) const;
+
     size_t length() const
     {
         if (!m_have_length) {
@@ -79,20 +79,50 @@ struct Variant<IndexType, InitialIndex> {
     ALWAYS_INLINE static void copy_(IndexType, const void*, void*) { }
 };
 
+// Dispatches on the index with branches for up to three alternatives, and
+// through a table of one function per alternative for more, so a visit
+// costs the same whichever alternative is held.
 template<typename IndexType, typename... Ts>
 struct VisitImpl {
-    template<typename Visitor, IndexType CurrentIndex = 0>
-    ALWAYS_INLINE static constexpr decltype(auto) visit(IndexType id, const void* data, Visitor&& visitor) requires(CurrentIndex < sizeof...(Ts))
+    template<typename Visitor>
+    using ReturnType = decltype(declval<Visitor&>()(declval<typename TypeList<Ts...>::template Type<0>&>()));
+
+    template<typename Visitor, IndexType Index>
+    ALWAYS_INLINE static constexpr ReturnType<Visitor> visit_one(const void* data, Visitor& visitor)
+    {
+        using T = typename TypeList<Ts...>::template Type<Index>;
+        return visitor(*bit_cast<T*>(data));
+    }
+
+    template<typename Visitor, IndexType... Indices>
+    static constexpr auto make_table(IntegerSequence<IndexType, Indices...>)
     {
-        using T = typename TypeList<Ts...>::template Type<CurrentIndex>;
+        using Entry = ReturnType<Visitor> (*)(const void*, Visitor&);
+        return Array<Entry, sizeof...(Ts)> { &visit_one<Visitor, Indices>... };
+    }
 
-        if (id == CurrentIndex)
-            return visitor(*bit_cast<T*>(data));
+    template<typename Visitor>
+    static constexpr auto table = make_table<Visitor>(MakeIntegerSequence<IndexType, sizeof...(Ts)>());
 
-        if constexpr ((CurrentIndex + 1) < sizeof...(Ts))
-            return visit<Visitor, CurrentIndex + 1>(id, data, forward<Visitor>(visitor));
-        else
+    template<typename Visitor>
+    ALWAYS_INLINE static constexpr decltype(auto) visit(IndexType id, const void* data, Visitor&& visitor)
+    {
+        if constexpr (sizeof...(Ts) <= 3) {
+            if (id == 0)
+                return visit_one<Visitor, 0>(data, visitor);
+            if constexpr (sizeof...(Ts) >= 2) {
+                if (id == 1)
+                    return visit_one<Visitor, 1>(data, visitor);
+            }
+            if constexpr (sizeof...(Ts) >= 3) {
+                if (id == 2)
+                    return visit_one<Visitor, 2>(data, visitor);
+            }
             VERIFY_NOT_REACHED();
+        } else {
+            VERIFY(id < sizeof...(Ts));
+            return table<Visitor>[id](data, visitor);
+        }
     }
 };
 
@@ -173,7 +173,7 @@ template<typename T>
 template<typename U>
 inline WeakPtr<U> Weakable<T>::make_weak_ptr() const
 {
-    if constexpr (IsBaseOf<RefCountedBase, T>) {
+    if constexpr (IsRefCounted<T>) {
         
         if (!static_cast<const T*>(this)->try_ref())
             return {};
@@ -189,7 +189,7 @@ inline WeakPtr<U> Weakable<T>::make_weak_ptr() const
 
     WeakPtr<U> weak_ptr(m_link);
 
-    if constexpr (IsBaseOf<RefCountedBase, T>) {
+    if constexpr (IsRefCounted<T>) {
 
         if (static_cast<const T*>(this)->unref()) {
             
@@ -4,22 +4,189 @@
  * SPDX-License-Identifier: BSD-2-Clause
 */
 
-#if defined(__SANITIZE_ADDRESS__)
+// This file is built without instrumentation, so it can't test for
+// __SANITIZE_ADDRESS__ like the code it serves.
+#if defined(ENABLE_KERNEL_ADDRESS_SANITIZER)
 
+// includes
+#    include <base/Format.h>
 #    include <kernel/AddressSanitizer.h>
+#    include <kernel/KSyms.h>
+#    include <kernel/Panic.h>
+#    include <kernel/Thread.h>
+#    include <kernel/vm/AnonymousVMObject.h>
+#    include <kernel/vm/MemoryManager.h>
 
-void Kernel::AddressSanitizer::shadow_va_check_load(unsigned long address, size_t size, void* return_address)
+extern u8 start_of_kernel_image[];
+extern u8 end_of_kernel_image[];
+
+namespace Kernel::AddressSanitizer {
+
+READONLY_AFTER_INIT static bool s_initialized;
+READONLY_AFTER_INIT static Region* s_shadow_region;
+
+UNMAP_AFTER_INIT void init()
+{
+    VERIFY(!s_initialized);
+
+    // Not backed up front, reads of a shadow page nobody has written to
+    // see the shared zero page, which says the memory is accessible.
+    auto vmobject = AnonymousVMObject::try_create_with_size(shadow_size, AllocationStrategy::None);
+    VERIFY(vmobject);
+    auto range = MM.kernel_page_directory().range_allocator().allocate_specific(VirtualAddress(shadow_base), shadow_size);
+    VERIFY(range.has_value());
+    auto region = MM.allocate_kernel_region_with_vmobject(range.value(), *vmobject, "KASAN shadow", Region::Access::Read | Region::Access::Write);
+    VERIFY(region);
+    s_shadow_region = region.leak_ptr();
+
+    s_initialized = true;
+
+    populate_shadow((FlatPtr)start_of_kernel_image, (FlatPtr)end_of_kernel_image - (FlatPtr)start_of_kernel_image);
+    dmesgln("KASAN: Shadow for {:p}-{:p} at {:p}", covered_base, covered_base + covered_size - 1, shadow_base);
+}
+
+bool is_initialized()
+{
+    return s_initialized;
+}
+
+static void fill_shadow(FlatPtr address, size_t size, u8 value)
+{
+    VERIFY(!(address % shadow_granule));
+    if (!s_initialized || !size || !is_covered(address))
+        return;
+    size = min(size, covered_base + covered_size - address);
+    __builtin_memset(shadow_for(address), value, (size + shadow_granule - 1) >> shadow_scale_shift);
+}
+
+void populate_shadow(FlatPtr address, size_t size)
+{
+    if (!s_initialized || !size || !is_covered(address))
+        return;
+    FlatPtr end = min(address + size, covered_base + covered_size);
+    FlatPtr shadow_start = page_round_down((FlatPtr)shadow_for(address));
+    FlatPtr shadow_end = (FlatPtr)shadow_for(end - 1);
+
+    // Writing a page's first byte is enough for the fault handler to give
+    // it a page of its own, everything past it is cleared below.
+    for (FlatPtr page = shadow_start; page <= shadow_end; page += PAGE_SIZE)
+        *reinterpret_cast<u8 volatile*>(page) = 0;
+    unpoison(address, size);
+}
+
+void poison(FlatPtr address, size_t size, ShadowType type)
+{
+    FlatPtr start = address & ~(shadow_granule - 1);
+    FlatPtr end = address + size;
+    fill_shadow(start, end - start, static_cast<u8>(type));
+}
+
+void unpoison(FlatPtr address, size_t size)
+{
+    FlatPtr start = address & ~(shadow_granule - 1);
+    FlatPtr end = address + size;
+    FlatPtr aligned_end = end & ~(shadow_granule - 1);
+    fill_shadow(start, aligned_end - start, 0);
+    if (end != aligned_end && s_initialized && is_covered(aligned_end))
+        *shadow_for(aligned_end) = end - aligned_end;
+}
+
+void mark_allocated(FlatPtr address, size_t size, size_t usable_size, ShadowType redzone)
+{
+    poison(address, usable_size, redzone);
+    unpoison(address, size);
+}
+
+// The byte at address is accessible if its granule is fully accessible,
+// or if it lies before the partial granule's first inaccessible byte.
+ALWAYS_INLINE static bool is_poisoned(FlatPtr address)
+{
+    i8 shadow = static_cast<i8>(*shadow_for(address));
+    return shadow && static_cast<i8>(address & (shadow_granule - 1)) >= shadow;
+}
+
+// Returns the first poisoned byte in the range, or 0.
+static FlatPtr find_poisoned(FlatPtr address, size_t size)
+{
+    if (!size || !s_initialized || !is_covered(address) || !is_covered(address + size - 1))
+        return 0;
+
+    // The common sizes fit in one granule or straddle two, their first
+    // and last bytes decide.
+    if (size <= shadow_granule) {
+        if (is_poisoned(address))
+            return address;
+        if (is_poisoned(address + size - 1))
+            return address + size - 1;
+        return 0;
+    }
+
+    FlatPtr end = address + size;
+    for (FlatPtr granule = address; granule < end; granule = (granule & ~(shadow_granule - 1)) + shadow_granule) {
+        if (*shadow_for(granule) == 0)
+            continue;
+        for (FlatPtr byte = granule; byte < min(end, (granule & ~(shadow_granule - 1)) + shadow_granule); byte++) {
+            if (is_poisoned(byte))
+                return byte;
+        }
+    }
+    return 0;
+}
+
+static StringView shadow_type_name(u8 shadow)
+{
+    switch (static_cast<ShadowType>(shadow)) {
+    case ShadowType::StackLeft:
+    case ShadowType::StackMiddle:
+    case ShadowType::StackRight:
+        return "stack-buffer-overflow";
+    case ShadowType::UseAfterReturn:
+        return "stack-use-after-return";
+    case ShadowType::UseAfterScope:
+        return "stack-use-after-scope";
+    case ShadowType::Global:
+        return "global-buffer-overflow";
+    case ShadowType::Malloc:
+    case ShadowType::Slab:
+        return "heap-buffer-overflow";
+    case ShadowType::Free:
+    case ShadowType::SlabFree:
+        return "use-after-free";
+    default:
+        return shadow < shadow_granule ? "heap-buffer-overflow" : "wild-access";
+    }
+}
+
+[[gnu::noinline]] static void report(FlatPtr address, size_t size, bool is_write, bool recover, void* return_address)
+{
+    FlatPtr bad_address = find_poisoned(address, size);
+    if (!bad_address)
+        bad_address = address;
+    u8 shadow = *shadow_for(bad_address);
+    dbgln("KASAN: {} on {} of size {} at {:p}, shadow {:#02x}, from {:p}",
+        shadow_type_name(shadow), is_write ? "write" : "read", size, address, shadow, return_address);
+
+    if (!recover)
+        PANIC("KASAN: Invalid memory access");
+    dump_backtrace();
+}
+
+ALWAYS_INLINE static void check(unsigned long address, size_t size, bool is_write, void* return_address)
+{
+    if (find_poisoned(address, size)) [[unlikely]]
+        report(address, size, is_write, true, return_address);
+}
+
+void shadow_va_check_load(unsigned long address, size_t size, void* return_address)
 {
-    (void)address;
-    (void)size;
-    (void)return_address;
+    check(address, size, false, return_address);
 }
 
-void Kernel::AddressSanitizer::shadow_va_check_store(unsigned long address, size_t size, void* return_address)
+void shadow_va_check_store(unsigned long address, size_t size, void* return_address)
 {
-    (void)address;
-    (void)size;
-    (void)return_address;
+    check(address, size, true, return_address);
+}
+
 }
 
 using namespace Kernel;
@@ -27,6 +194,7 @@ using namespace Kernel::AddressSanitizer;
 
 extern "C" {
 
+// Outline checks, one call per access.
 #    define ADDRESS_SANITIZER_LOAD_STORE(size)                                 \
         void __asan_load##size(unsigned long);                                 \
         void __asan_load##size(unsigned long address)                          \
@@ -81,9 +249,158 @@ void __asan_storeN_noabort(unsigned long address, size_t size)
     shadow_va_check_store(address, size, __builtin_return_address(0));
 }
 
+// Inline checks test the shadow themselves and only call out here once
+// they found a poisoned byte.
+#    define ADDRESS_SANITIZER_REPORT(size)                                                  \
+        void __asan_report_load##size(unsigned long);                                       \
+        void __asan_report_load##size(unsigned long address)                                \
+        {                                                                                   \
+            report(address, size, false, false, __builtin_return_address(0));               \
+        }                                                                                   \
+        void __asan_report_load##size##_noabort(unsigned long);                             \
+        void __asan_report_load##size##_noabort(unsigned long address)                      \
+        {                                                                                   \
+            report(address, size, false, true, __builtin_return_address(0));                \
+        }                                                                                   \
+        void __asan_report_store##size(unsigned long);                                      \
+        void __asan_report_store##size(unsigned long address)                               \
+        {                                                                                   \
+            report(address, size, true, false, __builtin_return_address(0));                \
+        }                                                                                   \
+        void __asan_report_store##size##_noabort(unsigned long);                            \
+        void __asan_report_store##size##_noabort(unsigned long address)                     \
+        {                                                                                   \
+            report(address, size, true, true, __builtin_return_address(0));                 \
+        }
+
+ADDRESS_SANITIZER_REPORT(1);
+ADDRESS_SANITIZER_REPORT(2);
+ADDRESS_SANITIZER_REPORT(4);
+ADDRESS_SANITIZER_REPORT(8);
+ADDRESS_SANITIZER_REPORT(16);
+
+#    undef ADDRESS_SANITIZER_REPORT
+
+void __asan_report_load_n(unsigned long, size_t);
+void __asan_report_load_n(unsigned long address, size_t size)
+{
+    report(address, size, false, false, __builtin_return_address(0));
+}
+
+void __asan_report_load_n_noabort(unsigned long, size_t);
+void __asan_report_load_n_noabort(unsigned long address, size_t size)
+{
+    report(address, size, false, true, __builtin_return_address(0));
+}
+
+void __asan_report_store_n(unsigned long, size_t);
+void __asan_report_store_n(unsigned long address, size_t size)
+{
+    report(address, size, true, false, __builtin_return_address(0));
+}
+
+void __asan_report_store_n_noabort(unsigned long, size_t);
+void __asan_report_store_n_noabort(unsigned long address, size_t size)
+{
+    report(address, size, true, true, __builtin_return_address(0));
+}
+
+// Stack frames with many locals get their redzones set up through these.
+#    define ADDRESS_SANITIZER_SET_SHADOW(value)                           \
+        void __asan_set_shadow_##value(unsigned long, size_t);            \
+        void __asan_set_shadow_##value(unsigned long shadow, size_t size) \
+        {                                                                 \
+            __builtin_memset((void*)shadow, 0x##value, size);             \
+        }
+
+ADDRESS_SANITIZER_SET_SHADOW(00);
+ADDRESS_SANITIZER_SET_SHADOW(f1);
+ADDRESS_SANITIZER_SET_SHADOW(f2);
+ADDRESS_SANITIZER_SET_SHADOW(f3);
+ADDRESS_SANITIZER_SET_SHADOW(f5);
+ADDRESS_SANITIZER_SET_SHADOW(f8);
+
+#    undef ADDRESS_SANITIZER_SET_SHADOW
+
+void __asan_poison_stack_memory(unsigned long, size_t);
+void __asan_poison_stack_memory(unsigned long address, size_t size)
+{
+    poison(address, round_up_to_power_of_two(size, shadow_granule), ShadowType::UseAfterScope);
+}
+
+void __asan_unpoison_stack_memory(unsigned long, size_t);
+void __asan_unpoison_stack_memory(unsigned long address, size_t size)
+{
+    unpoison(address, size);
+}
+
+void __asan_alloca_poison(unsigned long, size_t);
+void __asan_alloca_poison(unsigned long address, size_t size)
+{
+    // The compiler leaves a 32 byte redzone on either side.
+    constexpr size_t alloca_redzone = 32;
+    poison(address - alloca_redzone, alloca_redzone, ShadowType::StackLeft);
+    mark_allocated(address, size, round_up_to_power_of_two(size, alloca_redzone) + alloca_redzone, ShadowType::StackRight);
+}
+
+void __asan_allocas_unpoison(unsigned long, unsigned long);
+void __asan_allocas_unpoison(unsigned long top, unsigned long bottom)
+{
+    if (top < bottom)
+        unpoison(top, bottom - top);
+}
+
+void __asan_poison_memory_region(void const volatile*, size_t);
+void __asan_poison_memory_region(void const volatile* address, size_t size)
+{
+    poison((FlatPtr)address, size, ShadowType::Generic);
+}
+
+void __asan_unpoison_memory_region(void const volatile*, size_t);
+void __asan_unpoison_memory_region(void const volatile* address, size_t size)
+{
+    unpoison((FlatPtr)address, size);
+}
+
+struct AddressSanitizerGlobal {
+    FlatPtr address;
+    size_t size;
+    size_t size_with_redzone;
+    char const* name;
+    char const* module_name;
+    size_t has_dynamic_init;
+    void* location;
+    size_t odr_indicator;
+};
+
+// Globals registered before the shadow is up keep their redzones
+// accessible.
+void __asan_register_globals(AddressSanitizerGlobal*, size_t);
+void __asan_register_globals(AddressSanitizerGlobal* globals, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        mark_allocated(globals[i].address, globals[i].size, globals[i].size_with_redzone, ShadowType::Global);
+}
+
+void __asan_unregister_globals(AddressSanitizerGlobal*, size_t);
+void __asan_unregister_globals(AddressSanitizerGlobal* globals, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        unpoison(globals[i].address, globals[i].size_with_redzone);
+}
+
+// Whatever frames a noreturn call skips never unpoison their redzones,
+// the whole stack below the caller is free again.
 void __asan_handle_no_return(void);
 void __asan_handle_no_return(void)
 {
+    auto* thread = Thread::current();
+    if (!thread)
+        return;
+    FlatPtr stack_pointer = (FlatPtr)__builtin_frame_address(0);
+    FlatPtr stack_base = thread->kernel_stack_base();
+    if (stack_pointer > stack_base && stack_pointer <= thread->kernel_stack_top())
+        unpoison(stack_base, stack_pointer - stack_base);
 }
 
 void __asan_before_dynamic_init(const char*);
@@ -97,4 +414,4 @@ void __asan_after_dynamic_init()
 }
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -8,11 +8,96 @@
 
 // includes
 #include <base/Types.h>
+#include <kernel/Sections.h>
 
 namespace Kernel::AddressSanitizer {
 
-void shadow_va_check_load(unsigned long address, size_t size, void* return_addr);
+// Every 8 byte granule of the kernel half of the address space has one
+// shadow byte: 0 if all of it is accessible, 1 to 7 if only that many
+// leading bytes are, or one of the poisoned values below.
+//
+// The shadow lives at a fixed address so instrumented code can find it
+// with a shift and an add. Kernel objects are built with
+//     -fsanitize=kernel-address -fasan-shadow-offset=<shadow_offset>
+//     --param asan-instrumentation-with-call-threshold=10000
+// for inline checks, the allocator, the MemoryManager and this file with
+// -fno-sanitize=kernel-address since they touch poisoned memory and the
+// shadow itself. Shadow pages are only backed once the region they
+// describe is, so anything that runs before init() must not be
+// instrumented either.
+enum class ShadowType : u8 {
+    Unpoisoned8Bytes = 0,
+    Unpoisoned1Byte = 1,
+    Unpoisoned2Bytes = 2,
+    Unpoisoned3Bytes = 3,
+    Unpoisoned4Bytes = 4,
+    Unpoisoned5Bytes = 5,
+    Unpoisoned6Bytes = 6,
+    Unpoisoned7Bytes = 7,
+    StackLeft = 0xf1,
+    StackMiddle = 0xf2,
+    StackRight = 0xf3,
+    UseAfterReturn = 0xf5,
+    UseAfterScope = 0xf8,
+    Global = 0xf9,
+    Generic = 0xfa,
+    Malloc = 0xfb,
+    Free = 0xfc,
+    Slab = 0xfd,
+    SlabFree = 0xfe,
+};
+
+static constexpr size_t shadow_scale_shift = 3;
+static constexpr size_t shadow_granule = 1 << shadow_scale_shift;
+
+static constexpr FlatPtr covered_base = kernel_base;
+static constexpr size_t covered_size = 0x40000000;
+static constexpr size_t shadow_size = covered_size >> shadow_scale_shift;
+
+// Carved out of the kernel range allocator at boot, well past the image.
+static constexpr FlatPtr shadow_base = kernel_base + 0x28000000;
+static constexpr FlatPtr shadow_offset = shadow_base - (covered_base >> shadow_scale_shift);
+
+ALWAYS_INLINE bool is_covered(FlatPtr address)
+{
+    return address - covered_base < covered_size;
+}
+
+ALWAYS_INLINE u8* shadow_for(FlatPtr address)
+{
+    return reinterpret_cast<u8*>((address >> shadow_scale_shift) + shadow_offset);
+}
+
+#ifdef ENABLE_KERNEL_ADDRESS_SANITIZER
+
+// Reserves the shadow and backs it for the kernel image, called by the
+// MemoryManager once the kernel page directory is live.
+void init();
+bool is_initialized();
 
+// Backs the shadow of a newly mapped kernel region and unpoisons it, so
+// poisoning it later never has to fault in interrupt context.
+void populate_shadow(FlatPtr address, size_t size);
+
+void poison(FlatPtr address, size_t size, ShadowType);
+void unpoison(FlatPtr address, size_t size);
+
+// A heap block of usable_size bytes of which only the first size are
+// handed out, the rest is poisoned as a redzone.
+void mark_allocated(FlatPtr address, size_t size, size_t usable_size, ShadowType redzone);
+
+void shadow_va_check_load(unsigned long address, size_t size, void* return_addr);
 void shadow_va_check_store(unsigned long address, size_t size, void* return_addr);
 
-}
\ No newline at end of file
+#else
+
+ALWAYS_INLINE void init() { }
+ALWAYS_INLINE bool is_initialized() { return false; }
+ALWAYS_INLINE void populate_shadow(FlatPtr, size_t) { }
+ALWAYS_INLINE void poison(FlatPtr, size_t, ShadowType) { }
+ALWAYS_INLINE void unpoison(FlatPtr, size_t) { }
+ALWAYS_INLINE void mark_allocated(FlatPtr, size_t, size_t, ShadowType) { }
+
+#endif
+
+}
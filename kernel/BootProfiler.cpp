@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Atomic.h>
+#include <base/Format.h>
+#include <kernel/arch/x86/ASM_wrapper.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/BootProfiler.h>
+
+namespace Kernel {
+
+struct PhaseRecord {
+    const char* name { nullptr };
+    u32 cpu { 0 };
+    u64 start_tsc { 0 };
+    // Stored last: 0 while the phase is running.
+    Atomic<u64> end_tsc { 0 };
+};
+
+// Static storage, as the earliest phases run before there is a heap.
+static PhaseRecord s_phases[BootProfiler::max_phases];
+static Atomic<size_t> s_phase_count { 0 };
+static u64 s_tsc_frequency { 0 };
+
+void BootProfiler::set_tsc_frequency(u64 frequency)
+{
+    s_tsc_frequency = frequency;
+}
+
+size_t BootProfiler::begin(const char* name)
+{
+    size_t phase = s_phase_count.fetch_add(1, Base::memory_order_relaxed);
+    if (phase >= max_phases)
+        return phase;
+
+    auto& record = s_phases[phase];
+    record.name = name;
+    // Before the GDT is set up there is no Processor to ask, but then
+    // nothing else runs either.
+    record.cpu = Processor::is_initialized() ? Processor::id() : 0;
+    record.start_tsc = read_tsc();
+    return phase;
+}
+
+void BootProfiler::end(size_t phase)
+{
+    if (phase >= max_phases)
+        return;
+    s_phases[phase].end_tsc.store(read_tsc(), Base::memory_order_release);
+}
+
+// APs' TSCs can lag the boot processor's by a little.
+static u64 since(u64 tsc, u64 first_tsc)
+{
+    return tsc > first_tsc ? tsc - first_tsc : 0;
+}
+
+static u64 to_ns(u64 ticks)
+{
+    if (!s_tsc_frequency)
+        return ticks;
+    // Split to keep ticks * 10^9 from overflowing after a few seconds.
+    return (ticks / s_tsc_frequency) * 1'000'000'000 + (ticks % s_tsc_frequency) * 1'000'000'000 / s_tsc_frequency;
+}
+
+void BootProfiler::report()
+{
+    size_t count = min(s_phase_count.load(Base::memory_order_acquire), max_phases);
+    if (!count)
+        return;
+
+    auto unit = s_tsc_frequency ? "ns"sv : "tsc"sv;
+    u64 first_tsc = s_phases[0].start_tsc;
+    u64 last_tsc = first_tsc;
+    for (size_t i = 0; i < count; ++i) {
+        auto& record = s_phases[i];
+        u64 end_tsc = record.end_tsc.load(Base::memory_order_acquire);
+        if (!end_tsc) {
+            dbgln("boot-phase {{\"name\":\"{}\",\"cpu\":{},\"start_{}\":{},\"running\":true}}", record.name, record.cpu, unit, to_ns(since(record.start_tsc, first_tsc)));
+            continue;
+        }
+        last_tsc = max(last_tsc, end_tsc);
+        dbgln("boot-phase {{\"name\":\"{}\",\"cpu\":{},\"start_{}\":{},\"duration_{}\":{}}}", record.name, record.cpu, unit, to_ns(since(record.start_tsc, first_tsc)), unit, to_ns(since(end_tsc, record.start_tsc)));
+    }
+
+    size_t dropped = s_phase_count.load(Base::memory_order_relaxed) - count;
+    dbgln("boot-phase-total {{\"phases\":{},\"dropped\":{},\"{}\":{}}}", count, dropped, unit, to_ns(last_tsc - first_tsc));
+}
+
+}
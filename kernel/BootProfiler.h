@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Noncopyable.h>
+#include <base/Types.h>
+
+namespace Kernel {
+
+// Records how long each phase of the boot took, on which processor, from
+// the very first instructions on. Phases are stamped with the TSC, which
+// needs no setup; they are converted to nanoseconds at report time, once
+// the TSC frequency is known.
+//
+// report() prints one line per phase to the debug console, in the order
+// they started:
+//
+//     boot-phase {"name":"MemoryManager::initialize","cpu":0,"start_ns":21000000,"duration_ns":1700000}
+//
+// followed by a boot-phase-total line. start_ns counts from the first
+// phase, so tools can lay them out on a timeline.
+class BootProfiler {
+public:
+    static constexpr size_t max_phases = 128;
+
+    // Called by TimeManagement once the TSC is calibrated. Until then, and
+    // if it never is, phases are reported in TSC ticks.
+    static void set_tsc_frequency(u64 frequency);
+
+    // Both are safe to call from any processor at the same time. Phases
+    // past max_phases are counted but not kept.
+    static size_t begin(const char* name);
+    static void end(size_t phase);
+
+    // Once booting is done. Later phases are still recorded for the next
+    // report.
+    static void report();
+};
+
+// Marks the scope it lives in as a boot phase.
+class BootPhase {
+    BASE_MAKE_NONCOPYABLE(BootPhase);
+    BASE_MAKE_NONMOVABLE(BootPhase);
+
+public:
+    explicit BootPhase(const char* name)
+        : m_phase(BootProfiler::begin(name))
+    {
+    }
+
+    ~BootPhase() { BootProfiler::end(m_phase); }
+
+private:
+    size_t m_phase;
+};
+
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/ScopeGuard.h>
+#include <base/String.h>
+#include <kernel/ELFLoader.h>
+#include <kernel/filesystem/Inode.h>
+#include <kernel/heap/kmalloc.h>
+#include <kernel/UserOrKernelBuffer.h>
+#include <kernel/vm/MemoryManager.h>
+#include <kernel/vm/Region.h>
+#include <kernel/vm/SharedInodeVMObject.h>
+#include <kernel/vm/Space.h>
+#include <libfile/ELF.h>
+
+namespace Kernel {
+
+#if ARCH(I386)
+using ELF = ELF32;
+#else
+using ELF = ELF64;
+#endif
+
+// Way more than any real object has, it keeps a broken header from making
+// us read the whole file.
+static constexpr size_t max_program_header_count = 128;
+
+static KResult read_exactly(Inode& inode, size_t offset, void* data, size_t size)
+{
+    auto buffer = UserOrKernelBuffer::for_kernel_buffer((u8*)data);
+    auto result = inode.read_bytes(offset, size, buffer, nullptr);
+    if (result.is_error())
+        return result.error();
+    if (result.value() != size)
+        return ENOEXEC;
+    return KSuccess;
+}
+
+static int prot_from_program_flags(u32 flags)
+{
+    int prot = 0;
+    if (flags & ELF_PROGRAM_R)
+        prot |= PROT_READ;
+    if (flags & ELF_PROGRAM_W)
+        prot |= PROT_WRITE;
+    if (flags & ELF_PROGRAM_X)
+        prot |= PROT_EXEC;
+    return prot;
+}
+
+static bool program_header_is_sane(ELF::Program const& program, size_t file_size, FlatPtr load_base)
+{
+    if (program.filesz > program.memsz)
+        return false;
+    if (program.offset > file_size || program.filesz > file_size - program.offset)
+        return false;
+    // Mapping whole pages of the file only works if the segment sits at the
+    // same place in their pages in memory as in the file.
+    if (program.offset % PAGE_SIZE != program.vaddr % PAGE_SIZE)
+        return false;
+    FlatPtr start = load_base + program.vaddr;
+    if (start < load_base || page_round_up_would_wrap(start + program.memsz) || start + program.memsz < start)
+        return false;
+    return is_user_range(VirtualAddress(page_round_down(start)), page_round_up(start + program.memsz) - page_round_down(start));
+}
+
+// Fills the pages of a writable segment that have file contents, through
+// the physical pages since the space may not be the current one. The
+// part of the last one past the file contents is where .bss starts and
+// stays zero.
+static KResult fill_writable_segment(Region& region, Inode& inode, ELF::Program const& program)
+{
+    size_t offset_in_page = program.offset % PAGE_SIZE;
+    size_t file_start = program.offset - offset_in_page;
+    size_t file_end = program.offset + program.filesz;
+    size_t page_count = (offset_in_page + program.filesz + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    u8* buffer = (u8*)kmalloc(PAGE_SIZE);
+    if (!buffer)
+        return ENOMEM;
+    ScopeGuard free_buffer([&] { kfree(buffer); });
+
+    for (size_t i = 0; i < page_count; ++i) {
+        size_t page_offset = file_start + i * PAGE_SIZE;
+        size_t size = min((size_t)PAGE_SIZE, file_end - page_offset);
+        auto result = read_exactly(inode, page_offset, buffer, size);
+        if (result.is_error())
+            return result;
+        memset(buffer + size, 0, PAGE_SIZE - size);
+
+        auto response = region.populate(i, 1);
+        if (response == PageFaultResponse::OutOfMemory)
+            return ENOMEM;
+        if (response != PageFaultResponse::Continue)
+            return EFAULT;
+
+        auto* page = region.physical_page(i);
+        VERIFY(page);
+        u8* dest = MM.quickmap_page(page->paddr());
+        memcpy(dest, buffer, PAGE_SIZE);
+        MM.unquickmap_page();
+    }
+    return KSuccess;
+}
+
+KResultOr<LoadedELF> load_elf(Space& space, Inode& inode, FlatPtr load_base, StringView name)
+{
+    size_t file_size = inode.size();
+
+    ELF::Header header;
+    auto result = read_exactly(inode, 0, &header, sizeof(header));
+    if (result.is_error())
+        return result;
+    if (!header.valid())
+        return ENOEXEC;
+    if (header.type != ELF_ETYPE_EXEC && header.type != ELF_ETYPE_DYN)
+        return ENOEXEC;
+    if (header.type == ELF_ETYPE_EXEC && load_base != 0)
+        return EINVAL;
+    if (header.phentsize != sizeof(ELF::Program) || header.phnum == 0 || header.phnum > max_program_header_count)
+        return ENOEXEC;
+
+    Vector<ELF::Program> programs;
+    programs.resize(header.phnum);
+    result = read_exactly(inode, header.phoff, programs.data(), header.phnum * sizeof(ELF::Program));
+    if (result.is_error())
+        return result;
+
+    LoadedELF loaded;
+    loaded.load_base = load_base;
+    loaded.entry = load_base + header.entry;
+    loaded.program_header_count = header.phnum;
+    loaded.program_header_size = header.phentsize;
+
+    bool succeeded = false;
+    ScopeGuard unmap_on_failure([&] {
+        if (succeeded)
+            return;
+        for (auto* region : loaded.regions)
+            space.deallocate_region(*region);
+    });
+
+    RefPtr<SharedInodeVMObject> shared_vmobject;
+
+    for (auto& program : programs) {
+        switch (program.type) {
+        case ELF_PROGRAM_TYPE_INTERP:
+            if (program.offset > file_size || program.filesz > file_size - program.offset)
+                return ENOEXEC;
+            loaded.interpreter_offset = program.offset;
+            loaded.interpreter_size = program.filesz;
+            continue;
+        case ELF_PROGRAM_TYPE_TLS:
+            loaded.tls_image = load_base + program.vaddr;
+            loaded.tls_image_size = program.filesz;
+            loaded.tls_size = program.memsz;
+            loaded.tls_alignment = program.align;
+            continue;
+        case ELF_PROGRAM_TYPE_LOAD:
+            break;
+        default:
+            continue;
+        }
+
+        if (program.memsz == 0)
+            continue;
+        if (!program_header_is_sane(program, file_size, load_base))
+            return ENOEXEC;
+
+        FlatPtr start = page_round_down(load_base + program.vaddr);
+        FlatPtr end = page_round_up(load_base + program.vaddr + program.memsz);
+        int prot = prot_from_program_flags(program.flags);
+
+        auto range = space.allocate_range(VirtualAddress(start), end - start);
+        if (!range.has_value())
+            return ENOMEM;
+
+        // A read-only segment that is larger in memory than in the file
+        // would see the bytes after it in the file instead of zeroes.
+        bool map_from_inode = !(prot & PROT_WRITE) && program.memsz == program.filesz;
+
+        auto region_name = String::formatted("{}: {}", name, (prot & PROT_EXEC) ? "text"sv : (prot & PROT_WRITE) ? "data"sv : "rodata"sv);
+
+        if (map_from_inode) {
+            if (!shared_vmobject) {
+                shared_vmobject = SharedInodeVMObject::try_create_with_inode(inode);
+                if (!shared_vmobject)
+                    return ENOMEM;
+            }
+            auto region_or_error = space.allocate_region_with_vmobject(range.value(), *shared_vmobject, page_round_down(program.offset), region_name, prot, true);
+            if (region_or_error.is_error())
+                return region_or_error.error();
+            loaded.regions.append(region_or_error.value());
+        } else {
+            // Writable while it's filled in, so the pages get allocated.
+            auto region_or_error = space.allocate_region(range.value(), region_name, prot | PROT_WRITE, AllocationStrategy::Reserve);
+            if (region_or_error.is_error())
+                return region_or_error.error();
+            auto* region = region_or_error.value();
+            loaded.regions.append(region);
+            result = fill_writable_segment(*region, inode, program);
+            if (result.is_error())
+                return result;
+            if (!(prot & PROT_WRITE)) {
+                region->set_writable(false);
+                region->remap();
+            }
+        }
+
+        loaded.end = max(loaded.end, end);
+
+        // The program headers are usually at the start of the first
+        // segment, which is where PT_PHDR points at when there is one.
+        if (header.phoff >= program.offset && header.phoff - program.offset + header.phnum * sizeof(ELF::Program) <= program.filesz)
+            loaded.program_headers = load_base + program.vaddr + (header.phoff - program.offset);
+    }
+
+    if (loaded.regions.is_empty())
+        return ENOEXEC;
+
+    succeeded = true;
+    return loaded;
+}
+
+}
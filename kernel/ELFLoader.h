@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Optional.h>
+#include <base/Types.h>
+#include <base/Vector.h>
+#include <kernel/Forward.h>
+#include <kernel/KResult.h>
+
+namespace Kernel {
+
+// Where an ELF image ended up in the address space it was loaded into, as
+// the auxiliary vector and the dynamic loader want to know it.
+struct LoadedELF {
+    FlatPtr load_base { 0 };
+    FlatPtr entry { 0 };
+    FlatPtr end { 0 };
+
+    // Zero when the program headers aren't part of a loaded segment.
+    FlatPtr program_headers { 0 };
+    size_t program_header_count { 0 };
+    size_t program_header_size { 0 };
+
+    // The PT_INTERP path, as an offset and size in the file.
+    Optional<size_t> interpreter_offset;
+    size_t interpreter_size { 0 };
+
+    // The PT_TLS initialization image, in the loaded image.
+    FlatPtr tls_image { 0 };
+    size_t tls_image_size { 0 };
+    size_t tls_size { 0 };
+    size_t tls_alignment { 0 };
+
+    Vector<Region*> regions;
+};
+
+// Maps the PT_LOAD segments of an executable or shared object into space,
+// at load_base (which has to be 0 for ET_EXEC).
+//
+// Segments that aren't writable are mapped from the SharedInodeVMObject of
+// the inode, so they are paged in on first access with the usual
+// read-ahead, and every process mapping the same file shares their pages
+// and page tables. Writable segments are private anonymous memory: only
+// the pages that have file contents are filled in here, the rest of the
+// .bss is left to zero faults.
+//
+// Nothing is relocated, that is up to the dynamic loader in the new
+// process. On failure, whatever was mapped is unmapped again.
+KResultOr<LoadedELF> load_elf(Space&, Inode&, FlatPtr load_base, StringView name);
+
+}
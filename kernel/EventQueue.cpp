@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/EventQueue.h>
+#include <kernel/filesystem/FileDescription.h>
+
+namespace Kernel {
+
+KResultOr<NonnullRefPtr<EventQueue>> EventQueue::create()
+{
+    auto queue = adopt_ref_if_nonnull(new (nothrow) EventQueue);
+    if (!queue)
+        return ENOMEM;
+    return queue.release_nonnull();
+}
+
+EventQueue::~EventQueue()
+{
+    ScopedSpinLock lock(m_lock);
+    while (m_ready_list.take_first())
+        ;
+}
+
+EventQueue::Interest::Interest(EventQueue& queue, NonnullRefPtr<FileDescription> description, EventQueueEvent const& event)
+    : m_queue(queue)
+    , m_description(move(description))
+    , m_events(event.events)
+    , m_flags(event.flags)
+    , m_user_data(event.user_data)
+{
+    // Puts the interest on the ready list right away if the file already
+    // is, through unblock().
+    set_block_condition(m_description->block_condition());
+}
+
+EventQueue::Interest::~Interest()
+{
+}
+
+bool EventQueue::Interest::unblock(bool, void*)
+{
+    m_queue.notify(*this);
+    return false;
+}
+
+EventQueueEvents EventQueue::Interest::ready_events() const
+{
+    auto events = EventQueueEvents::None;
+    if (m_description->can_read())
+        events |= EventQueueEvents::Read;
+    if (m_description->can_write())
+        events |= EventQueueEvents::Write;
+    return events;
+}
+
+void EventQueue::notify(Interest& interest)
+{
+    auto ready = interest.ready_events() & interest.m_events;
+    if (ready == EventQueueEvents::None)
+        return;
+
+    {
+        ScopedSpinLock lock(m_lock);
+        if (!interest.m_armed || interest.m_ready_list_node.is_in_list())
+            return;
+        m_ready_list.append(interest);
+    }
+    m_wait_queue.wake_all();
+    evaluate_block_conditions();
+}
+
+KResult EventQueue::add(int fd, NonnullRefPtr<FileDescription> description, EventQueueEvent const& event)
+{
+    {
+        ScopedSpinLock lock(m_lock);
+        if (m_interests.contains(fd))
+            return EEXIST;
+    }
+
+    // Registering calls back into notify(), which takes m_lock.
+    auto interest = adopt_own_if_nonnull(new (nothrow) Interest(*this, move(description), event));
+    if (!interest)
+        return ENOMEM;
+
+    ScopedSpinLock lock(m_lock);
+    if (m_interests.contains(fd)) {
+        if (interest->m_ready_list_node.is_in_list())
+            m_ready_list.remove(*interest);
+        return EEXIST;
+    }
+    m_interests.set(fd, interest.release_nonnull());
+    return KSuccess;
+}
+
+KResult EventQueue::modify(int fd, EventQueueEvent const& event)
+{
+    Interest* interest;
+    {
+        ScopedSpinLock lock(m_lock);
+        auto it = m_interests.find(fd);
+        if (it == m_interests.end())
+            return ENOENT;
+        interest = it->value.ptr();
+        interest->m_events = event.events;
+        interest->m_flags = event.flags;
+        interest->m_user_data = event.user_data;
+        interest->m_armed = true;
+        if (interest->m_ready_list_node.is_in_list())
+            m_ready_list.remove(*interest);
+    }
+
+    // The file may have become ready for what is asked now.
+    notify(*interest);
+    return KSuccess;
+}
+
+KResult EventQueue::remove(int fd)
+{
+    OwnPtr<Interest> interest;
+    {
+        ScopedSpinLock lock(m_lock);
+        auto it = m_interests.find(fd);
+        if (it == m_interests.end())
+            return ENOENT;
+        interest = move(it->value);
+        m_interests.remove(it);
+        if (interest->m_ready_list_node.is_in_list())
+            m_ready_list.remove(*interest);
+    }
+
+    // Destroying the interest takes it off the block condition, which
+    // can't happen under m_lock.
+    interest = nullptr;
+    return KSuccess;
+}
+
+KResultOr<size_t> EventQueue::wait(Vector<EventQueueEvent>& events, size_t max_events, Time const* timeout)
+{
+    VERIFY(max_events);
+    if (!events.try_ensure_capacity(max_events))
+        return ENOMEM;
+
+    Thread::BlockTimeout block_timeout(false, timeout);
+    for (;;) {
+        {
+            ScopedSpinLock lock(m_lock);
+            Interest::ReadyList still_ready;
+            while (events.size() < max_events) {
+                auto* interest = m_ready_list.take_first();
+                if (!interest)
+                    break;
+
+                // Dropped if it isn't ready anymore, the file puts it back
+                // when that changes.
+                auto ready = interest->ready_events() & interest->m_events;
+                if (ready == EventQueueEvents::None)
+                    continue;
+
+                events.unchecked_append({ ready, interest->m_flags, interest->m_user_data });
+                if (has_flag(interest->m_flags, EventQueueInterestFlags::OneShot))
+                    interest->m_armed = false;
+                else if (!has_flag(interest->m_flags, EventQueueInterestFlags::EdgeTriggered))
+                    still_ready.append(*interest);
+            }
+
+            // Level-triggered interests are looked at again on the next
+            // wait, behind those that weren't reported this time.
+            while (auto* interest = still_ready.take_first())
+                m_ready_list.append(*interest);
+        }
+
+        if (!events.is_empty() || (timeout && timeout->is_zero()))
+            return events.size();
+
+        auto result = m_wait_queue.wait_on(block_timeout, "EventQueue");
+        if (result.was_interrupted())
+            return EINTR;
+        if (result == Thread::BlockResult::InterruptedByTimeout)
+            return 0;
+    }
+}
+
+bool EventQueue::can_read(FileDescription const&, size_t) const
+{
+    ScopedSpinLock lock(m_lock);
+    return !m_ready_list.is_empty();
+}
+
+String EventQueue::absolute_path(FileDescription const&) const
+{
+    return "event-queue";
+}
+
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/HashMap.h>
+#include <base/IntrusiveList.h>
+#include <base/NonnullOwnPtr.h>
+#include <base/Time.h>
+#include <kernel/api/EventQueue.h>
+#include <kernel/filesystem/File.h>
+#include <kernel/SpinLock.h>
+#include <kernel/Thread.h>
+#include <kernel/WaitQueue.h>
+
+namespace Kernel {
+
+// Interest in a set of file descriptors, registered once instead of on
+// every poll().
+//
+// Every interest sits on its file description's block condition like a
+// blocked poll() would, so the file pushes it onto the ready list when
+// its state changes. wait() only looks at the ready list, the cost of a
+// wakeup doesn't grow with the number of registered descriptors.
+// Readable whenever something is on the ready list.
+class EventQueue final : public File {
+public:
+    static KResultOr<NonnullRefPtr<EventQueue>> create();
+    virtual ~EventQueue() override;
+
+    KResult add(int fd, NonnullRefPtr<FileDescription>, EventQueueEvent const&);
+    KResult modify(int fd, EventQueueEvent const&);
+    KResult remove(int fd);
+
+    // Fills events with up to max_events ready interests, blocking for at
+    // most timeout (forever if null) if there are none yet.
+    KResultOr<size_t> wait(Vector<EventQueueEvent>& events, size_t max_events, Time const* timeout);
+
+    virtual bool can_read(FileDescription const&, size_t) const override;
+    virtual KResultOr<size_t> read(FileDescription&, u64, UserOrKernelBuffer&, size_t) override { return EINVAL; }
+    virtual bool can_write(FileDescription const&, size_t) const override { return false; }
+    virtual KResultOr<size_t> write(FileDescription&, u64, UserOrKernelBuffer const&, size_t) override { return EINVAL; }
+
+    virtual bool is_event_queue() const override { return true; }
+    virtual String absolute_path(FileDescription const&) const override;
+    virtual StringView class_name() const override { return "EventQueue"sv; };
+
+private:
+    class Interest final : public Thread::FileBlocker {
+    public:
+        Interest(EventQueue&, NonnullRefPtr<FileDescription>, EventQueueEvent const&);
+        virtual ~Interest() override;
+
+        virtual StringView state_string() const override { return "EventQueue"sv; }
+        virtual void not_blocking(bool) override { }
+        // Called by the file's block condition whenever its state changes.
+        // Never unblocks, the interest stays registered until removed.
+        virtual bool unblock(bool from_add_blocker, void*) override;
+
+        EventQueueEvents ready_events() const;
+
+        EventQueue& m_queue;
+        NonnullRefPtr<FileDescription> m_description;
+        EventQueueEvents m_events;
+        EventQueueInterestFlags m_flags;
+        u64 m_user_data { 0 };
+        bool m_armed { true };
+
+        IntrusiveListNode<Interest> m_ready_list_node;
+        using ReadyList = IntrusiveList<Interest, RawPtr<Interest>, &Interest::m_ready_list_node>;
+    };
+
+    EventQueue() = default;
+
+    void notify(Interest&);
+
+    mutable SpinLock<u8> m_lock;
+    HashMap<int, NonnullOwnPtr<Interest>> m_interests;
+    Interest::ReadyList m_ready_list;
+    WaitQueue m_wait_queue;
+};
+
+}
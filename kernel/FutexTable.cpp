@@ -0,0 +1,441 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/HashFunctions.h>
+#include <base/Singleton.h>
+#include <kernel/arch/x86/SafeMem.h>
+#include <kernel/FutexTable.h>
+#include <kernel/Process.h>
+#include <kernel/vm/MemoryManager.h>
+#include <kernel/vm/Space.h>
+
+namespace Kernel {
+
+static Base::Singleton<FutexTable> s_the;
+
+FutexTable& FutexTable::the()
+{
+    return *s_the;
+}
+
+KResultOr<FutexKey> FutexKey::create(Process& process, FlatPtr user_address, bool is_private)
+{
+    if (user_address & (alignof(u32) - 1))
+        return EINVAL;
+    if (!is_user_range(VirtualAddress(user_address), sizeof(u32)))
+        return EFAULT;
+
+    auto& space = process.space();
+    if (is_private)
+        return FutexKey { &space, nullptr, user_address };
+
+    ScopedSpinLock lock(space.get_lock());
+    auto* region = space.find_region_containing(Range { VirtualAddress(user_address), sizeof(u32) });
+    if (!region)
+        return EFAULT;
+    // Nobody else can see a private mapping, and copy-on-write would split
+    // its pages off the VMObject anyway.
+    if (!region->is_shared())
+        return FutexKey { &space, nullptr, user_address };
+    return FutexKey { nullptr, region->vmobject(), region->offset_in_vmobject() + (user_address - region->vaddr().get()) };
+}
+
+unsigned FutexKey::hash() const
+{
+    void const* object = space ? static_cast<void const*>(space) : vmobject.ptr();
+    return pair_int_hash(ptr_hash(object), ptr_hash(offset));
+}
+
+// Holds the locks of two buckets, in address order so two requeues in
+// opposite directions can't deadlock.
+class BucketPairLocker {
+public:
+    BucketPairLocker(SpinLock<u8>& a, SpinLock<u8>& b)
+        : m_first(&a < &b ? a : b)
+        , m_second(&a < &b ? b : a)
+    {
+        m_first_flags = m_first.lock();
+        if (&m_second != &m_first)
+            m_second_flags = m_second.lock();
+    }
+
+    ~BucketPairLocker()
+    {
+        if (&m_second != &m_first)
+            m_second.unlock(m_second_flags);
+        m_first.unlock(m_first_flags);
+    }
+
+private:
+    SpinLock<u8>& m_first;
+    SpinLock<u8>& m_second;
+    u32 m_first_flags { 0 };
+    u32 m_second_flags { 0 };
+};
+
+void FutexTable::enqueue_locked(Bucket& bucket, Waiter& waiter)
+{
+    waiter.bucket_index.store(static_cast<u32>(&bucket - m_buckets.data()), Base::memory_order_release);
+    bucket.waiters.append(waiter);
+}
+
+KResult FutexTable::finish_wait(Waiter& waiter, Thread::BlockResult result)
+{
+    for (;;) {
+        auto index = waiter.bucket_index.load(Base::memory_order_acquire);
+        auto& bucket = m_buckets[index];
+        ScopedSpinLock lock(bucket.lock);
+        // Requeued onto another bucket before we got the lock.
+        if (waiter.bucket_index.load(Base::memory_order_relaxed) != index)
+            continue;
+
+        // A wake that raced with a timeout or signal still counts, the
+        // waker has already taken it into account.
+        if (waiter.woken)
+            return KSuccess;
+        bucket.waiters.remove(waiter);
+
+        // Whatever priority this waiter lent the owner goes back.
+        if (waiter.is_pi) {
+            if (auto* state = find_pi_state(bucket, waiter.key)) {
+                auto priority = max(state->base_priority, highest_pi_waiter_priority(bucket, waiter.key).value_or(0));
+                state->owner->set_priority(priority);
+            }
+        }
+        break;
+    }
+
+    if (result == Thread::BlockResult::InterruptedByTimeout)
+        return ETIMEDOUT;
+    return EINTR;
+}
+
+KResult FutexTable::wait(FutexKey const& key, u32* user_address, u32 expected, u32 bitset, Thread::BlockTimeout const& timeout)
+{
+    if (!bitset)
+        return EINVAL;
+
+    Waiter waiter(key, bitset, *Thread::current(), false);
+    {
+        auto& bucket = bucket_for(key);
+        ScopedSpinLock lock(bucket.lock);
+        // Looked at under the bucket lock, a waker that changes the word
+        // and then wakes can't slip in between.
+        auto value = safe_atomic_load_relaxed(user_address);
+        if (!value.has_value())
+            return EFAULT;
+        if (value.value() != expected)
+            return EAGAIN;
+        enqueue_locked(bucket, waiter);
+    }
+
+    auto result = waiter.wait_queue.wait_on(timeout, "Futex");
+    return finish_wait(waiter, result);
+}
+
+u32 FutexTable::wake_locked(Bucket& bucket, FutexKey const& key, u32 count, u32 bitset)
+{
+    u32 woken = 0;
+    for (auto it = bucket.waiters.begin(); it != bucket.waiters.end() && woken < count;) {
+        auto& waiter = *it;
+        ++it;
+        if (waiter.is_pi || !(waiter.bitset & bitset) || !(waiter.key == key))
+            continue;
+        bucket.waiters.remove(waiter);
+        // The waiter can't go away before we drop the bucket lock, it has
+        // to take it to see it was woken.
+        waiter.woken = true;
+        waiter.wait_queue.wake_all();
+        woken++;
+    }
+    return woken;
+}
+
+u32 FutexTable::wake(FutexKey const& key, u32 count, u32 bitset)
+{
+    if (!count || !bitset)
+        return 0;
+    auto& bucket = bucket_for(key);
+    ScopedSpinLock lock(bucket.lock);
+    return wake_locked(bucket, key, count, bitset);
+}
+
+KResultOr<u32> FutexTable::requeue(FutexKey const& from, FutexKey const& to, u32 wake_count, u32 requeue_count, u32* user_address, Optional<u32> expected)
+{
+    auto& from_bucket = bucket_for(from);
+    auto& to_bucket = bucket_for(to);
+    BucketPairLocker locker(from_bucket.lock, to_bucket.lock);
+
+    if (expected.has_value()) {
+        auto value = safe_atomic_load_relaxed(user_address);
+        if (!value.has_value())
+            return EFAULT;
+        if (value.value() != expected.value())
+            return EAGAIN;
+    }
+
+    u32 woken = wake_locked(from_bucket, from, wake_count, FUTEX_BITSET_MATCH_ANY);
+    if (from == to)
+        return woken;
+
+    // Broadcasts move the waiters onto the mutex instead of waking them
+    // all to fight over it.
+    u32 moved = 0;
+    auto to_index = bucket_index_for(to);
+    for (auto it = from_bucket.waiters.begin(); it != from_bucket.waiters.end() && moved < requeue_count;) {
+        auto& waiter = *it;
+        ++it;
+        if (waiter.is_pi || !(waiter.key == from))
+            continue;
+        waiter.key = to;
+        if (&from_bucket != &to_bucket) {
+            from_bucket.waiters.remove(waiter);
+            to_bucket.waiters.append(waiter);
+        }
+        waiter.bucket_index.store(to_index, Base::memory_order_release);
+        moved++;
+    }
+    return woken + moved;
+}
+
+KResultOr<u32> FutexTable::wake_op(FutexKey const& key, FutexKey const& key2, u32* user_address2, u32 count, u32 count2, u32 encoded_op)
+{
+    u32 op = (encoded_op >> 28) & 7;
+    bool shift_oparg = (encoded_op >> 28) & FUTEX_OP_ARG_SHIFT;
+    u32 cmp = (encoded_op >> 24) & 0xf;
+    // Both arguments are sign extended 12-bit values.
+    i32 oparg = static_cast<i32>(encoded_op << 8) >> 20;
+    i32 cmparg = static_cast<i32>(encoded_op << 20) >> 20;
+    if (shift_oparg) {
+        if (oparg < 0 || oparg > 31)
+            return EINVAL;
+        oparg = 1 << oparg;
+    }
+    if (op > FUTEX_OP_XOR || cmp > FUTEX_OP_CMP_GE)
+        return EINVAL;
+
+    auto& bucket = bucket_for(key);
+    auto& bucket2 = bucket_for(key2);
+    BucketPairLocker locker(bucket.lock, bucket2.lock);
+
+    Optional<u32> old_value;
+    switch (op) {
+    case FUTEX_OP_SET:
+        old_value = safe_atomic_exchange_relaxed(user_address2, oparg);
+        break;
+    case FUTEX_OP_ADD:
+        old_value = safe_atomic_fetch_add_relaxed(user_address2, oparg);
+        break;
+    case FUTEX_OP_OR:
+        old_value = safe_atomic_fetch_or_relaxed(user_address2, oparg);
+        break;
+    case FUTEX_OP_ANDN:
+        old_value = safe_atomic_fetch_and_not_relaxed(user_address2, oparg);
+        break;
+    case FUTEX_OP_XOR:
+        old_value = safe_atomic_fetch_xor_relaxed(user_address2, oparg);
+        break;
+    }
+    if (!old_value.has_value())
+        return EFAULT;
+
+    u32 woken = wake_locked(bucket, key, count, FUTEX_BITSET_MATCH_ANY);
+
+    auto old = static_cast<i32>(old_value.value());
+    bool matches = false;
+    switch (cmp) {
+    case FUTEX_OP_CMP_EQ:
+        matches = old == cmparg;
+        break;
+    case FUTEX_OP_CMP_NE:
+        matches = old != cmparg;
+        break;
+    case FUTEX_OP_CMP_LT:
+        matches = old < cmparg;
+        break;
+    case FUTEX_OP_CMP_LE:
+        matches = old <= cmparg;
+        break;
+    case FUTEX_OP_CMP_GT:
+        matches = old > cmparg;
+        break;
+    case FUTEX_OP_CMP_GE:
+        matches = old >= cmparg;
+        break;
+    }
+    if (matches)
+        woken += wake_locked(bucket2, key2, count2, FUTEX_BITSET_MATCH_ANY);
+    return woken;
+}
+
+FutexTable::PIState* FutexTable::find_pi_state(Bucket& bucket, FutexKey const& key)
+{
+    for (auto& state : bucket.pi_states) {
+        if (state.key == key)
+            return &state;
+    }
+    return nullptr;
+}
+
+Optional<u32> FutexTable::highest_pi_waiter_priority(Bucket& bucket, FutexKey const& key, Waiter const* except)
+{
+    Optional<u32> highest;
+    for (auto& waiter : bucket.waiters) {
+        if (!waiter.is_pi || &waiter == except || !(waiter.key == key))
+            continue;
+        auto priority = waiter.thread.priority();
+        if (!highest.has_value() || priority > highest.value())
+            highest = priority;
+    }
+    return highest;
+}
+
+KResult FutexTable::lock_pi(FutexKey const& key, u32* user_address, bool try_only, Thread::BlockTimeout const& timeout)
+{
+    auto& current = *Thread::current();
+    u32 tid = current.tid().value();
+    VERIFY(!(tid & ~FUTEX_TID_MASK));
+
+    // Can't be allocated under the bucket lock, it's only kept if we are
+    // the first to contend.
+    OwnPtr<PIState> new_state;
+    if (!try_only)
+        new_state = adopt_own_if_nonnull(new (nothrow) PIState);
+
+    Waiter waiter(key, FUTEX_BITSET_MATCH_ANY, current, true);
+    {
+        auto& bucket = bucket_for(key);
+        ScopedSpinLock lock(bucket.lock);
+
+        u32 owner_tid = 0;
+        for (;;) {
+            u32 value = 0;
+            auto locked = safe_atomic_compare_exchange_relaxed(user_address, value, tid);
+            if (!locked.has_value())
+                return EFAULT;
+            if (locked.value())
+                return KSuccess;
+
+            owner_tid = value & FUTEX_TID_MASK;
+            if (owner_tid == tid)
+                return EDEADLK;
+            if (!owner_tid) {
+                // The owner died with waiters left, whoever comes first
+                // inherits the lock and the waiters.
+                auto taken = safe_atomic_compare_exchange_relaxed(user_address, value, tid | (value & FUTEX_WAITERS));
+                if (!taken.has_value())
+                    return EFAULT;
+                if (!taken.value())
+                    continue;
+                if (auto* state = find_pi_state(bucket, key)) {
+                    state->owner = current;
+                    state->base_priority = current.priority();
+                }
+                return KSuccess;
+            }
+            if (try_only)
+                return EAGAIN;
+
+            // Makes the owner come through unlock_pi() instead of just
+            // clearing the word.
+            if (value & FUTEX_WAITERS)
+                break;
+            auto marked = safe_atomic_compare_exchange_relaxed(user_address, value, value | FUTEX_WAITERS);
+            if (!marked.has_value())
+                return EFAULT;
+            if (marked.value())
+                break;
+        }
+
+        auto* state = find_pi_state(bucket, key);
+        if (!state) {
+            auto owner = Thread::from_tid(owner_tid);
+            if (!owner)
+                return ESRCH;
+            if (!new_state)
+                return ENOMEM;
+            state = new_state.leak_ptr();
+            state->key = key;
+            state->owner = move(owner);
+            state->base_priority = state->owner->priority();
+            bucket.pi_states.append(*state);
+        }
+        if (current.priority() > state->owner->priority())
+            state->owner->set_priority(current.priority());
+        enqueue_locked(bucket, waiter);
+    }
+
+    auto result = waiter.wait_queue.wait_on(timeout, "FutexPI");
+    return finish_wait(waiter, result);
+}
+
+KResult FutexTable::unlock_pi(FutexKey const& key, u32* user_address)
+{
+    auto& current = *Thread::current();
+    u32 tid = current.tid().value();
+
+    // Dropped once the bucket lock is, it holds a reference to a thread.
+    OwnPtr<PIState> finished_state;
+    {
+        auto& bucket = bucket_for(key);
+        ScopedSpinLock lock(bucket.lock);
+
+        auto value = safe_atomic_load_relaxed(user_address);
+        if (!value.has_value())
+            return EFAULT;
+        if ((value.value() & FUTEX_TID_MASK) != tid)
+            return EPERM;
+
+        Waiter* next = nullptr;
+        for (auto& waiter : bucket.waiters) {
+            if (!waiter.is_pi || !(waiter.key == key))
+                continue;
+            if (!next || waiter.thread.priority() > next->thread.priority())
+                next = &waiter;
+        }
+
+        auto* state = find_pi_state(bucket, key);
+        if (!next) {
+            if (!safe_atomic_store_relaxed(user_address, 0))
+                return EFAULT;
+            if (state) {
+                if (state->owner == &current)
+                    current.set_priority(state->base_priority);
+                bucket.pi_states.remove(*state);
+                finished_state = adopt_own(*state);
+            }
+            return KSuccess;
+        }
+
+        // Handed straight over, so a lower priority thread that happens to
+        // run first can't barge in.
+        VERIFY(state);
+        auto highest_remaining = highest_pi_waiter_priority(bucket, key, next);
+        u32 new_value = next->thread.tid().value() | (highest_remaining.has_value() ? FUTEX_WAITERS : 0);
+        if (!safe_atomic_store_relaxed(user_address, new_value))
+            return EFAULT;
+
+        if (state->owner == &current)
+            current.set_priority(state->base_priority);
+        if (highest_remaining.has_value()) {
+            state->owner = next->thread;
+            state->base_priority = next->thread.priority();
+            if (highest_remaining.value() > state->base_priority)
+                next->thread.set_priority(highest_remaining.value());
+        } else {
+            bucket.pi_states.remove(*state);
+            finished_state = adopt_own(*state);
+        }
+
+        bucket.waiters.remove(*next);
+        next->woken = true;
+        next->wait_queue.wake_all();
+    }
+    return KSuccess;
+}
+
+}
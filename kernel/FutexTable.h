@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Array.h>
+#include <base/Atomic.h>
+#include <base/IntrusiveList.h>
+#include <base/Optional.h>
+#include <base/RefPtr.h>
+#include <kernel/api/Futex.h>
+#include <kernel/KResult.h>
+#include <kernel/SpinLock.h>
+#include <kernel/Thread.h>
+#include <kernel/vm/VMObject.h>
+#include <kernel/WaitQueue.h>
+
+namespace Kernel {
+
+class Process;
+
+// What a futex address refers to. Private futexes go by the address in
+// their space, shared ones by what backs the address, so every process
+// mapping the same memory agrees on the key.
+struct FutexKey {
+    Space const* space { nullptr };
+    RefPtr<VMObject> vmobject;
+    FlatPtr offset { 0 };
+
+    static KResultOr<FutexKey> create(Process&, FlatPtr user_address, bool is_private);
+
+    unsigned hash() const;
+    bool operator==(FutexKey const& other) const { return space == other.space && vmobject == other.vmobject && offset == other.offset; }
+};
+
+// Waiters on all futexes, spread over hashed buckets that each have their
+// own lock, so unrelated futexes don't contend on one table lock.
+class FutexTable {
+public:
+    static FutexTable& the();
+
+    // Blocks until woken if *user_address is expected, with EAGAIN if not.
+    KResult wait(FutexKey const&, u32* user_address, u32 expected, u32 bitset, Thread::BlockTimeout const&);
+    u32 wake(FutexKey const&, u32 count, u32 bitset);
+
+    // Wakes wake_count waiters on from and moves up to requeue_count of
+    // the rest onto to, without waking them. Checks *user_address against
+    // expected first if given. Returns how many were woken and moved.
+    KResultOr<u32> requeue(FutexKey const& from, FutexKey const& to, u32 wake_count, u32 requeue_count, u32* user_address, Optional<u32> expected);
+    KResultOr<u32> wake_op(FutexKey const& key, FutexKey const& key2, u32* user_address2, u32 count, u32 count2, u32 encoded_op);
+
+    KResult lock_pi(FutexKey const&, u32* user_address, bool try_only, Thread::BlockTimeout const&);
+    KResult unlock_pi(FutexKey const&, u32* user_address);
+
+private:
+    struct Waiter {
+        Waiter(FutexKey const& key, u32 bitset, Thread& thread, bool is_pi)
+            : key(key)
+            , bitset(bitset)
+            , thread(thread)
+            , is_pi(is_pi)
+        {
+        }
+
+        // Only changes under the lock of the bucket it sits in, and with
+        // the lock of the bucket it moves to held as well.
+        FutexKey key;
+        u32 bitset { FUTEX_BITSET_MATCH_ANY };
+        Thread& thread;
+        bool is_pi { false };
+        bool woken { false };
+        // Which bucket the waiter sits in, for the waiter to find it again
+        // once unblocked.
+        Atomic<u32> bucket_index { 0 };
+        WaitQueue wait_queue;
+
+        IntrusiveListNode<Waiter> list_node;
+        using List = IntrusiveList<Waiter, RawPtr<Waiter>, &Waiter::list_node>;
+    };
+
+    // Who holds a contended PI futex, and the priority to give back to it
+    // when it unlocks.
+    struct PIState {
+        FutexKey key;
+        RefPtr<Thread> owner;
+        u32 base_priority { 0 };
+
+        IntrusiveListNode<PIState> list_node;
+        using List = IntrusiveList<PIState, RawPtr<PIState>, &PIState::list_node>;
+    };
+
+    struct Bucket {
+        SpinLock<u8> lock;
+        Waiter::List waiters;
+        PIState::List pi_states;
+    };
+
+    static constexpr size_t bucket_count = 256;
+
+    static u32 bucket_index_for(FutexKey const& key) { return key.hash() % bucket_count; }
+    Bucket& bucket_for(FutexKey const& key) { return m_buckets[bucket_index_for(key)]; }
+    void enqueue_locked(Bucket&, Waiter&);
+    KResult finish_wait(Waiter&, Thread::BlockResult);
+
+    static u32 wake_locked(Bucket&, FutexKey const&, u32 count, u32 bitset);
+    static PIState* find_pi_state(Bucket&, FutexKey const&);
+    static Optional<u32> highest_pi_waiter_priority(Bucket&, FutexKey const&, Waiter const* except = nullptr);
+
+    Array<Bucket, bucket_count> m_buckets;
+};
+
+}
@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Atomic.h>
+#include <base/NumericLimits.h>
+#include <kernel/api/Syscall.h>
+#include <kernel/filesystem/FileDescription.h>
+#include <kernel/IORing.h>
+#include <kernel/Process.h>
+#include <kernel/Thread.h>
+#include <kernel/vm/MemoryManager.h>
+#include <kernel/vm/Space.h>
+
+namespace Kernel {
+
+static constexpr u32 io_ring_entry_alignment = 64;
+
+KResultOr<NonnullRefPtr<IORing>> IORing::create(Process& process, u32 entries)
+{
+    if (!entries || entries > io_ring_max_entries)
+        return EINVAL;
+    u32 submission_entries = 1;
+    while (submission_entries < entries)
+        submission_entries <<= 1;
+    // Completions of deferred submissions pile up while new ones come in.
+    u32 completion_entries = submission_entries * 2;
+
+    u32 submission_offset = round_up_to_power_of_two(sizeof(IORingHeader), io_ring_entry_alignment);
+    u32 completion_offset = round_up_to_power_of_two(submission_offset + submission_entries * sizeof(IORingSubmission), io_ring_entry_alignment);
+    u32 size = page_round_up(completion_offset + completion_entries * sizeof(IORingCompletion));
+
+    auto vmobject = AnonymousVMObject::try_create_with_size(size, AllocationStrategy::AllocateNow);
+    if (!vmobject)
+        return ENOMEM;
+    auto region = MM.allocate_kernel_region_with_vmobject(*vmobject, size, "IORing", Region::Access::Read | Region::Access::Write);
+    if (!region)
+        return ENOMEM;
+    memset(region->vaddr().as_ptr(), 0, size);
+
+    auto& header = *reinterpret_cast<IORingHeader*>(region->vaddr().as_ptr());
+    header.submission.entries = submission_entries;
+    header.completion.entries = completion_entries;
+    header.submission_offset = submission_offset;
+    header.completion_offset = completion_offset;
+    header.size = size;
+
+    auto ring = adopt_ref_if_nonnull(new (nothrow) IORing(process, vmobject.release_nonnull(), region.release_nonnull(), submission_entries, completion_entries, submission_offset, completion_offset));
+    if (!ring)
+        return ENOMEM;
+    return ring.release_nonnull();
+}
+
+IORing::IORing(Process& process, NonnullRefPtr<AnonymousVMObject> vmobject, NonnullOwnPtr<Region> region, u32 submission_entries, u32 completion_entries, u32 submission_offset, u32 completion_offset)
+    : m_process(process)
+    , m_vmobject(move(vmobject))
+    , m_region(move(region))
+    , m_submission_entries(submission_entries)
+    , m_completion_entries(completion_entries)
+    , m_submission_offset(submission_offset)
+    , m_completion_offset(completion_offset)
+{
+}
+
+IORing::~IORing()
+{
+}
+
+// The offsets in the header are userland's to scribble over, the kernel
+// goes by the ones it computed.
+IORingSubmission const& IORing::submission_at(u32 index) const
+{
+    return reinterpret_cast<IORingSubmission const*>(m_region->vaddr().offset(m_submission_offset).as_ptr())[index & (m_submission_entries - 1)];
+}
+
+IORingCompletion& IORing::completion_at(u32 index)
+{
+    return reinterpret_cast<IORingCompletion*>(m_region->vaddr().offset(m_completion_offset).as_ptr())[index & (m_completion_entries - 1)];
+}
+
+u32 IORing::completions_waiting() const
+{
+    auto& completion = header().completion;
+    return completion.tail - Base::atomic_load(&completion.head, Base::memory_order_acquire);
+}
+
+bool IORing::can_read(FileDescription const&, size_t) const
+{
+    return completions_waiting() > 0;
+}
+
+KResultOr<FlatPtr> IORing::enter(u32 to_submit, u32 min_complete)
+{
+    auto process = m_process.strong_ref();
+    if (!process || process != Process::current())
+        return EBADF;
+
+    auto& submission = header().submission;
+    u32 head = submission.head;
+    u32 tail = Base::atomic_load(&submission.tail, Base::memory_order_acquire);
+
+    u32 submitted = 0;
+    while (submitted < to_submit && head != tail) {
+        {
+            ScopedSpinLock lock(m_lock);
+            if (completions_waiting() + m_in_flight >= m_completion_entries)
+                break;
+            m_in_flight++;
+        }
+
+        // Copied out first, userland may rewrite the slot as soon as it
+        // sees the head move.
+        IORingSubmission entry = submission_at(head);
+        Base::atomic_store(&submission.head, ++head, Base::memory_order_release);
+        submitted++;
+
+        if (would_block(*process, entry))
+            defer(entry);
+        else
+            complete(entry.user_data, execute(*process, entry));
+    }
+
+    while (completions_waiting() < min_complete) {
+        {
+            ScopedSpinLock lock(m_lock);
+            if (!m_in_flight)
+                break;
+        }
+        if (m_completion_queue.wait_forever("IORing").was_interrupted())
+            return submitted ? submitted : KResultOr<FlatPtr>(EINTR);
+    }
+    return submitted;
+}
+
+bool IORing::would_block(Process& process, IORingSubmission const& entry) const
+{
+    if (entry.opcode != IORingOpcode::Read && entry.opcode != IORingOpcode::Write && entry.opcode != IORingOpcode::Accept)
+        return false;
+    auto description = process.fds().file_description(entry.fd);
+    if (!description || !description->is_blocking())
+        return false;
+    if (entry.opcode == IORingOpcode::Write)
+        return !description->can_write();
+    return !description->can_read();
+}
+
+i64 IORing::execute(Process& process, IORingSubmission const& entry)
+{
+    auto as_result = [](KResultOr<FlatPtr> result) -> i64 {
+        if (result.is_error())
+            return result.error().error();
+        return result.value();
+    };
+
+    switch (entry.opcode) {
+    case IORingOpcode::Nop:
+        return 0;
+    case IORingOpcode::Read:
+    case IORingOpcode::Write: {
+        bool is_read = entry.opcode == IORingOpcode::Read;
+        if (entry.length > NumericLimits<ssize_t>::max())
+            return -EINVAL;
+        if (entry.offset < 0) {
+            if (is_read)
+                return as_result(process.sys$read(entry.fd, Userspace<u8*>(entry.address), entry.length));
+            return as_result(process.sys$write(entry.fd, Userspace<u8 const*>(entry.address), entry.length));
+        }
+
+        auto description = process.fds().file_description(entry.fd);
+        if (!description)
+            return -EBADF;
+        if (is_read ? !description->is_readable() : !description->is_writable())
+            return -EBADF;
+        if (!description->file().is_seekable())
+            return -ESPIPE;
+        auto buffer = UserOrKernelBuffer::for_user_buffer(Userspace<u8*>(entry.address), entry.length);
+        if (!buffer.has_value())
+            return -EFAULT;
+        KResultOr<size_t> result = is_read
+            ? description->file().read(*description, entry.offset, buffer.value(), entry.length)
+            : description->file().write(*description, entry.offset, buffer.value(), entry.length);
+        if (result.is_error())
+            return result.error().error();
+        return result.value();
+    }
+    case IORingOpcode::Open:
+        return as_result(process.sys$open(Userspace<Syscall::SC_open_params const*>(entry.address)));
+    case IORingOpcode::Close:
+        return as_result(process.sys$close(entry.fd));
+    case IORingOpcode::Accept:
+        return as_result(process.sys$accept4(Userspace<Syscall::SC_accept4_params const*>(entry.address)));
+    }
+    return -EINVAL;
+}
+
+void IORing::complete(u64 user_data, i64 result)
+{
+    {
+        ScopedSpinLock lock(m_lock);
+        auto& completion = header().completion;
+        u32 tail = completion.tail;
+        completion_at(tail) = { user_data, result };
+        Base::atomic_store(&completion.tail, tail + 1, Base::memory_order_release);
+        VERIFY(m_in_flight);
+        m_in_flight--;
+    }
+    m_completion_queue.wake_all();
+    evaluate_block_conditions();
+}
+
+void IORing::defer(IORingSubmission const& entry)
+{
+    bool start_worker = false;
+    {
+        ScopedSpinLock lock(m_lock);
+        if (!m_deferred.try_append(entry)) {
+            lock.unlock();
+            complete(entry.user_data, -ENOMEM);
+            return;
+        }
+        start_worker = !m_has_worker;
+        m_has_worker = true;
+    }
+
+    if (start_worker) {
+        // The worker owns a reference until it exits.
+        ref();
+        auto process = m_process.strong_ref();
+        if (!process || !process->create_kernel_thread(worker_entry, this, THREAD_PRIORITY_NORMAL, "IORing", THREAD_AFFINITY_DEFAULT, false)) {
+            unref();
+            Vector<IORingSubmission> orphans;
+            {
+                ScopedSpinLock lock(m_lock);
+                m_has_worker = false;
+                orphans = move(m_deferred);
+            }
+            for (auto& orphan : orphans)
+                complete(orphan.user_data, -EAGAIN);
+            return;
+        }
+    }
+    m_work_queue.wake_all();
+}
+
+void IORing::worker_entry(void* data)
+{
+    auto ring = adopt_ref(*static_cast<IORing*>(data));
+    ring->run_worker();
+    ring = nullptr;
+    Thread::current()->exit();
+}
+
+void IORing::run_worker()
+{
+    for (;;) {
+        Optional<IORingSubmission> entry;
+        {
+            ScopedSpinLock lock(m_lock);
+            if (!m_deferred.is_empty())
+                entry = m_deferred.take_first();
+            else if (m_closing)
+                return;
+        }
+        if (!entry.has_value()) {
+            m_work_queue.wait_forever("IORing");
+            continue;
+        }
+
+        auto process = m_process.strong_ref();
+        if (!process) {
+            complete(entry->user_data, -ESRCH);
+            continue;
+        }
+        Locker locker(process->big_lock());
+        complete(entry->user_data, execute(*process, *entry));
+    }
+}
+
+KResultOr<Region*> IORing::mmap(Process& process, FileDescription&, Range const& range, u64 offset, int prot, bool shared)
+{
+    if (!shared || offset)
+        return EINVAL;
+    if (prot & PROT_EXEC)
+        return EACCES;
+    if (range.size() > m_vmobject->size())
+        return EINVAL;
+    return process.space().allocate_region_with_vmobject(range, m_vmobject, 0, "IORing", prot, true);
+}
+
+KResult IORing::close()
+{
+    {
+        ScopedSpinLock lock(m_lock);
+        m_closing = true;
+    }
+    m_work_queue.wake_all();
+    return KSuccess;
+}
+
+String IORing::absolute_path(FileDescription const&) const
+{
+    return "io-ring";
+}
+
+}
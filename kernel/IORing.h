@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/NonnullOwnPtr.h>
+#include <base/Vector.h>
+#include <base/WeakPtr.h>
+#include <kernel/api/IORing.h>
+#include <kernel/filesystem/File.h>
+#include <kernel/SpinLock.h>
+#include <kernel/vm/AnonymousVMObject.h>
+#include <kernel/WaitQueue.h>
+
+namespace Kernel {
+
+// The kernel's end of an IORingHeader and its rings, mapped into the
+// kernel once and into the owning process through mmap().
+//
+// io_ring_enter() runs every submission that can complete right away in
+// the submitting thread. Those that would block are handed to a kernel
+// thread of the same process, so they can still reach its memory, and
+// complete from there. Readable whenever completions are waiting.
+class IORing final : public File {
+public:
+    static KResultOr<NonnullRefPtr<IORing>> create(Process&, u32 entries);
+    virtual ~IORing() override;
+
+    // Consumes up to to_submit submissions, then waits until at least
+    // min_complete completions are waiting. Returns how many were
+    // consumed.
+    KResultOr<FlatPtr> enter(u32 to_submit, u32 min_complete);
+
+    virtual bool can_read(FileDescription const&, size_t) const override;
+    virtual KResultOr<size_t> read(FileDescription&, u64, UserOrKernelBuffer&, size_t) override { return EINVAL; }
+    virtual bool can_write(FileDescription const&, size_t) const override { return false; }
+    virtual KResultOr<size_t> write(FileDescription&, u64, UserOrKernelBuffer const&, size_t) override { return EINVAL; }
+    virtual KResultOr<Region*> mmap(Process&, FileDescription&, Range const&, u64 offset, int prot, bool shared) override;
+    virtual KResult close() override;
+
+    virtual bool is_io_ring() const override { return true; }
+    virtual String absolute_path(FileDescription const&) const override;
+    virtual StringView class_name() const override { return "IORing"sv; };
+
+private:
+    IORing(Process&, NonnullRefPtr<AnonymousVMObject>, NonnullOwnPtr<Region>, u32 submission_entries, u32 completion_entries, u32 submission_offset, u32 completion_offset);
+
+    IORingHeader& header() { return *reinterpret_cast<IORingHeader*>(m_region->vaddr().as_ptr()); }
+    IORingHeader const& header() const { return *reinterpret_cast<IORingHeader const*>(m_region->vaddr().as_ptr()); }
+    IORingSubmission const& submission_at(u32 index) const;
+    IORingCompletion& completion_at(u32 index);
+    u32 completions_waiting() const;
+
+    bool would_block(Process&, IORingSubmission const&) const;
+    i64 execute(Process&, IORingSubmission const&);
+    void complete(u64 user_data, i64 result);
+    void defer(IORingSubmission const&);
+
+    static void worker_entry(void*);
+    void run_worker();
+
+    WeakPtr<Process> m_process;
+    NonnullRefPtr<AnonymousVMObject> m_vmobject;
+    NonnullOwnPtr<Region> m_region;
+    u32 m_submission_entries { 0 };
+    u32 m_completion_entries { 0 };
+    u32 m_submission_offset { 0 };
+    u32 m_completion_offset { 0 };
+
+    // Guards the completion tail and everything below.
+    mutable SpinLock<u8> m_lock;
+    // Consumed but not completed yet, never more than fit into the
+    // completion ring next to what userland hasn't reaped.
+    u32 m_in_flight { 0 };
+    Vector<IORingSubmission> m_deferred;
+    bool m_has_worker { false };
+    bool m_closing { false };
+
+    WaitQueue m_work_queue;
+    WaitQueue m_completion_queue;
+};
+
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Format.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/BootProfiler.h>
+#include <kernel/Initcall.h>
+#include <kernel/Panic.h>
+#include <kernel/Sections.h>
+
+namespace Kernel {
+
+static Atomic<InitcallGraph*> s_running_graph { nullptr };
+// Counted before s_running_graph is looked at, so that run() can't return,
+// and its graph go away, under a helper that just found it.
+static Atomic<u32> s_helper_count { 0 };
+
+UNMAP_AFTER_INIT InitcallGraph::InitcallGraph(Span<Initcall const> initcalls)
+    : m_initcalls(initcalls)
+{
+    VERIFY(initcalls.size() <= max_initcalls);
+    m_all = initcalls.size() == max_initcalls ? ~(u64)0 : ((u64)1 << initcalls.size()) - 1;
+
+    for (size_t i = 0; i < initcalls.size(); ++i) {
+        for (auto* dependency : initcalls[i].dependencies) {
+            if (!dependency)
+                continue;
+            size_t j = 0;
+            while (j < initcalls.size() && __builtin_strcmp(initcalls[j].name, dependency) != 0)
+                ++j;
+            if (j == initcalls.size())
+                PANIC("Initcall {} depends on {}, which isn't there", initcalls[i].name, dependency);
+            m_dependencies[i] |= (u64)1 << j;
+        }
+    }
+
+    // Every initcall can run once those it depends on could, or there is
+    // a cycle among the ones that can't.
+    u64 resolved = 0;
+    while (resolved != m_all) {
+        u64 resolved_before = resolved;
+        for (size_t i = 0; i < initcalls.size(); ++i) {
+            if ((m_dependencies[i] & ~resolved) == 0)
+                resolved |= (u64)1 << i;
+        }
+        if (resolved == resolved_before) {
+            size_t first_stuck = __builtin_ctzll(m_all & ~resolved);
+            PANIC("Initcall {} is part of a dependency cycle", initcalls[first_stuck].name);
+        }
+    }
+}
+
+bool InitcallGraph::run_one_ready(bool on_bootstrap_processor)
+{
+    u64 done = m_done.load(Base::memory_order_acquire);
+    u64 candidates = m_all & ~m_started.load(Base::memory_order_relaxed);
+    while (candidates) {
+        size_t i = __builtin_ctzll(candidates);
+        u64 bit = (u64)1 << i;
+        candidates &= ~bit;
+
+        auto& initcall = m_initcalls[i];
+        if ((m_dependencies[i] & ~done) != 0)
+            continue;
+        if (initcall.bootstrap_processor_only && !on_bootstrap_processor)
+            continue;
+        // Someone else got to it first.
+        if (m_started.fetch_or(bit, Base::memory_order_acq_rel) & bit)
+            continue;
+
+        {
+            BootPhase phase(initcall.name);
+            initcall.function();
+        }
+        m_done.fetch_or(bit, Base::memory_order_release);
+        return true;
+    }
+    return false;
+}
+
+UNMAP_AFTER_INIT void InitcallGraph::run()
+{
+    VERIFY(Processor::is_bootstrap_processor());
+    BootPhase phase("InitcallGraph::run");
+
+    s_running_graph.store(this, Base::memory_order_release);
+    while (!all_done()) {
+        if (!run_one_ready(true))
+            asm volatile("pause");
+    }
+    s_running_graph.store(nullptr);
+
+    // The graph may be on the stack, wait for the helpers to let go of it.
+    while (s_helper_count.load())
+        asm volatile("pause");
+}
+
+UNMAP_AFTER_INIT void InitcallGraph::help_running_graph()
+{
+    s_helper_count.fetch_add(1);
+    if (auto* graph = s_running_graph.load()) {
+        while (!graph->all_started()) {
+            if (!graph->run_one_ready(false))
+                asm volatile("pause");
+        }
+    }
+    s_helper_count.fetch_sub(1, Base::memory_order_release);
+}
+
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Array.h>
+#include <base/Atomic.h>
+#include <base/Noncopyable.h>
+#include <base/Span.h>
+#include <base/Types.h>
+
+namespace Kernel {
+
+// One step of kernel initialization, and the steps that have to be done
+// before it can start.
+struct Initcall {
+    static constexpr size_t max_dependencies = 4;
+
+    const char* name { nullptr };
+    void (*function)() { nullptr };
+    // Names of other initcalls of the same graph, the unused ones null.
+    Array<const char*, max_dependencies> dependencies {};
+    // For steps that set up the boot processor itself, like its local
+    // APIC, rather than something of the whole system.
+    bool bootstrap_processor_only { false };
+};
+
+// Runs initcalls as soon as what they depend on is done, on every
+// processor that helps, so that independent steps like probing USB
+// controllers and parsing ACPI tables overlap instead of waiting on each
+// other. Each one is recorded as a BootPhase.
+//
+// The boot processor calls run(). Application processors that come up in
+// the meantime call help_running_graph() before they go idle and take
+// whatever is ready; starting the APs can itself be one of the initcalls.
+// With no APs, run() goes through the graph alone, in dependency order.
+//
+//     static Initcall const s_initcalls[] = {
+//         { "ACPI", ACPI::initialize },
+//         { "PCI", PCI::initialize, { "ACPI" } },
+//         { "USB", USB::HostController::detect, { "PCI" } },
+//         { "APs", start_application_processors, { "ACPI" }, true },
+//     };
+//     InitcallGraph(s_initcalls).run();
+class InitcallGraph {
+    BASE_MAKE_NONCOPYABLE(InitcallGraph);
+    BASE_MAKE_NONMOVABLE(InitcallGraph);
+
+public:
+    static constexpr size_t max_initcalls = 64;
+
+    // Panics on a dependency that isn't in the graph and on cycles, which
+    // would otherwise hang the boot.
+    explicit InitcallGraph(Span<Initcall const>);
+
+    // Returns once every initcall is done.
+    void run();
+
+    // Runs initcalls of the graph run() is going through, if any, until
+    // none are left to start.
+    static void help_running_graph();
+
+private:
+    bool run_one_ready(bool on_bootstrap_processor);
+    bool all_started() const { return (m_started.load(Base::memory_order_acquire) & m_all) == m_all; }
+    bool all_done() const { return (m_done.load(Base::memory_order_acquire) & m_all) == m_all; }
+
+    Span<Initcall const> m_initcalls;
+    // Bit i of m_dependencies[j] is set if initcall j depends on initcall i.
+    u64 m_dependencies[max_initcalls] {};
+    u64 m_all { 0 };
+    Atomic<u64> m_started { 0 };
+    Atomic<u64> m_done { 0 };
+};
+
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/CharacterTypes.h>
+#include <base/QuickSort.h>
+#include <base/StringView.h>
+#include <kernel/arch/x86/SafeMem.h>
+#include <kernel/heap/kmalloc.h>
+#include <kernel/KSyms.h>
+#include <kernel/Sections.h>
+
+extern u8 start_of_kernel_ksyms[];
+extern u8 end_of_kernel_ksyms[];
+
+namespace Kernel {
+
+FlatPtr g_lowest_kernel_symbol_address = 0xffffffff;
+FlatPtr g_highest_kernel_symbol_address = 0;
+bool g_kernel_symbols_available = false;
+
+// Sorted by address. Lookups only touch the addresses of the symbols they
+// compare against, the names are elsewhere.
+static KernelSymbol* s_symbols;
+static size_t s_symbol_count = 0;
+
+const KernelSymbol* symbolicate_kernel_address(FlatPtr address)
+{
+    if (!s_symbol_count || address < g_lowest_kernel_symbol_address || address > g_highest_kernel_symbol_address)
+        return nullptr;
+
+    // The last symbol at or below address, without a hard to predict branch
+    // per step. The first one is at or below it, see the check above.
+    const KernelSymbol* base = s_symbols;
+    size_t count = s_symbol_count;
+    while (count > 1) {
+        size_t half = count / 2;
+        base = base[half].address <= address ? base + half : base;
+        count -= half;
+    }
+    return base;
+}
+
+FlatPtr address_for_kernel_symbol(StringView name)
+{
+    for (size_t i = 0; i < s_symbol_count; ++i) {
+        if (name == s_symbols[i].name)
+            return s_symbols[i].address;
+    }
+    return 0;
+}
+
+// The map is what nm -n prints, after its line count in 8 hex digits:
+// an address in hex, the symbol type and the name on every line.
+UNMAP_AFTER_INIT void load_kernel_symbol_table()
+{
+    auto* data = (const char*)start_of_kernel_ksyms;
+    auto* end = (const char*)end_of_kernel_ksyms;
+    if (end - data < 9)
+        return;
+
+    size_t declared_count = 0;
+    for (size_t i = 0; i < 8; ++i)
+        declared_count = (declared_count << 4) | parse_ascii_hex_digit(*data++);
+    ++data;
+
+    // The names all go in one allocation, which needs their total size
+    // first.
+    size_t name_bytes = 0;
+    size_t symbol_count = 0;
+    for (auto* line = data; line < end && symbol_count < declared_count; ++symbol_count) {
+        auto* name = line + sizeof(FlatPtr) * 2 + 3;
+        if (name >= end)
+            break;
+        auto* name_end = name;
+        while (name_end < end && *name_end != '\n' && *name_end != '\0')
+            ++name_end;
+        name_bytes += name_end - name + 1;
+        line = name_end + 1;
+    }
+    if (!symbol_count)
+        return;
+
+    s_symbols = static_cast<KernelSymbol*>(kmalloc_eternal(sizeof(KernelSymbol) * symbol_count));
+    auto* names = static_cast<char*>(kmalloc_eternal(name_bytes));
+
+    auto* line = data;
+    bool sorted = true;
+    for (size_t i = 0; i < symbol_count; ++i) {
+        FlatPtr address = 0;
+        for (size_t j = 0; j < sizeof(FlatPtr) * 2; ++j)
+            address = (address << 4) | parse_ascii_hex_digit(*line++);
+        line += 3;
+
+        auto* name_start = line;
+        while (line < end && *line != '\n' && *line != '\0')
+            ++line;
+        size_t length = line - name_start;
+        ++line;
+
+        memcpy(names, name_start, length);
+        names[length] = '\0';
+
+        if (i && address < s_symbols[i - 1].address)
+            sorted = false;
+        s_symbols[i] = { address, names };
+        names += length + 1;
+    }
+
+    if (!sorted)
+        quick_sort(s_symbols, s_symbols + symbol_count, [](auto& a, auto& b) { return a.address < b.address; });
+
+    s_symbol_count = symbol_count;
+    g_lowest_kernel_symbol_address = s_symbols[0].address;
+    g_highest_kernel_symbol_address = s_symbols[symbol_count - 1].address;
+    g_kernel_symbols_available = true;
+}
+
+NEVER_INLINE static void dump_backtrace_impl(FlatPtr base_pointer, PrintToScreen print_to_screen)
+{
+    auto print = [&](auto address, auto* symbol) {
+        if (!symbol) {
+            if (print_to_screen == PrintToScreen::Yes)
+                dmesgln("{:p}", address);
+            else
+                dbgln("{:p}", address);
+            return;
+        }
+        if (print_to_screen == PrintToScreen::Yes)
+            dmesgln("{:p}  {} +{:#x}", address, symbol->name, address - symbol->address);
+        else
+            dbgln("{:p}  {} +{:#x}", address, symbol->name, address - symbol->address);
+    };
+
+    static constexpr size_t max_frame_count = 256;
+    FlatPtr* frame = (FlatPtr*)base_pointer;
+    for (size_t i = 0; frame && i < max_frame_count; ++i) {
+        FlatPtr copied[2];
+        void* fault_at;
+        if (!safe_memcpy(copied, frame, sizeof(copied), fault_at))
+            break;
+        FlatPtr return_address = copied[1];
+        if (!return_address)
+            break;
+        print(return_address, g_kernel_symbols_available ? symbolicate_kernel_address(return_address) : nullptr);
+        frame = (FlatPtr*)copied[0];
+    }
+}
+
+void dump_backtrace(PrintToScreen print_to_screen)
+{
+    static bool in_dump_backtrace = false;
+    if (in_dump_backtrace)
+        return;
+    in_dump_backtrace = true;
+    dump_backtrace_impl((FlatPtr)__builtin_frame_address(0), print_to_screen);
+    in_dump_backtrace = false;
+}
+
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Forward.h>
+#include <base/Types.h>
+
+namespace Kernel {
+
+struct KernelSymbol {
+    FlatPtr address;
+    const char* name;
+};
+
+enum class PrintToScreen {
+    No,
+    Yes,
+};
+
+// The symbol an address is in, as in the one with the highest address at
+// or below it. nullptr past either end of the kernel.
+const KernelSymbol* symbolicate_kernel_address(FlatPtr);
+FlatPtr address_for_kernel_symbol(StringView name);
+
+// Copies the symbol map embedded in the kernel out before it's unmapped,
+// sorted by address, with all the names in one allocation.
+void load_kernel_symbol_table();
+
+void dump_backtrace(PrintToScreen print_to_screen = PrintToScreen::No);
+
+extern bool g_kernel_symbols_available;
+extern FlatPtr g_lowest_kernel_symbol_address;
+extern FlatPtr g_highest_kernel_symbol_address;
+
+}
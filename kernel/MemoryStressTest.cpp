@@ -0,0 +1,452 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/NumericLimits.h>
+#include <base/QuickSort.h>
+#include <base/Vector.h>
+#include <kernel/arch/x86/ASM_wrapper.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/CommandLine.h>
+#include <kernel/heap/SlabAllocator.h>
+#include <kernel/heap/kmalloc.h>
+#include <kernel/MemoryStressTest.h>
+#include <kernel/Process.h>
+#include <kernel/Scheduler.h>
+#include <kernel/Thread.h>
+#include <kernel/time/TimeManagement.h>
+#include <kernel/vm/AnonymousVMObject.h>
+#include <kernel/vm/MemoryManager.h>
+#include <kernel/vm/RangeAllocator.h>
+
+namespace Kernel {
+
+// Affinities are a mask of 32 CPUs.
+#define MEMORY_STRESS_TEST_MAX_WORKERS 32
+#define MEMORY_STRESS_TEST_LIVE_SET 256
+
+enum class MemoryStressPhase : u32 {
+    Kmalloc,
+    Slab,
+    Physical,
+    Range,
+    Map,
+    Fault,
+    Cow,
+    __Count,
+};
+
+static StringView memory_stress_phase_name(MemoryStressPhase phase)
+{
+    switch (phase) {
+    case MemoryStressPhase::Kmalloc:
+        return "kmalloc"sv;
+    case MemoryStressPhase::Slab:
+        return "slab"sv;
+    case MemoryStressPhase::Physical:
+        return "physical"sv;
+    case MemoryStressPhase::Range:
+        return "range"sv;
+    case MemoryStressPhase::Map:
+        return "map"sv;
+    case MemoryStressPhase::Fault:
+        return "fault"sv;
+    case MemoryStressPhase::Cow:
+        return "cow"sv;
+    case MemoryStressPhase::__Count:
+        break;
+    }
+    VERIFY_NOT_REACHED();
+}
+
+// Operations each worker does in a phase.
+static size_t memory_stress_phase_operations(MemoryStressPhase phase)
+{
+    switch (phase) {
+    case MemoryStressPhase::Kmalloc:
+    case MemoryStressPhase::Slab:
+    case MemoryStressPhase::Range:
+        return 200'000;
+    case MemoryStressPhase::Physical:
+        return 50'000;
+    case MemoryStressPhase::Map:
+        return 2'000;
+    case MemoryStressPhase::Fault:
+    case MemoryStressPhase::Cow:
+        return 8'192;
+    case MemoryStressPhase::__Count:
+        break;
+    }
+    VERIFY_NOT_REACHED();
+}
+
+// Random enough to spread sizes and slots, and cheap enough not to show
+// up in the latencies, which get_fast_random() would.
+struct MemoryStressRandom {
+    u32 state;
+
+    u32 next()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+};
+
+struct MemoryStressWorker {
+    u32 cpu { 0 };
+    MemoryStressRandom random { 0 };
+    size_t operations { 0 };
+    size_t failures { 0 };
+    size_t stride { 1 };
+    Vector<u32> samples;
+
+    void record(u64 cycles)
+    {
+        if (operations++ % stride == 0 && samples.size() < MEMORY_STRESS_TEST_SAMPLE_COUNT)
+            samples.unchecked_append(cycles > NumericLimits<u32>::max() ? NumericLimits<u32>::max() : (u32)cycles);
+    }
+};
+
+static MemoryStressWorker s_workers[MEMORY_STRESS_TEST_MAX_WORKERS];
+static u32 s_worker_count;
+
+// The coordinator sets s_phase_generation to the phase plus one to start
+// it, and waits for every worker to count itself in s_finished_count.
+static Atomic<u32> s_phase_generation { 0 };
+static Atomic<u32> s_finished_count { 0 };
+
+// Mostly small sizes, with a tail up to a few pages like the kernel's own.
+static size_t random_kmalloc_size(MemoryStressRandom& random)
+{
+    u32 value = random.next();
+    return 8 + (value >> 8) % (16u << (value % 9));
+}
+
+static void stress_kmalloc(MemoryStressWorker& worker, size_t operations)
+{
+    void* pointers[MEMORY_STRESS_TEST_LIVE_SET] {};
+    size_t sizes[MEMORY_STRESS_TEST_LIVE_SET] {};
+
+    for (size_t i = 0; i < operations; ++i) {
+        auto slot = worker.random.next() % MEMORY_STRESS_TEST_LIVE_SET;
+        if (pointers[slot]) {
+            u64 start = read_tsc();
+            kfree_sized(pointers[slot], sizes[slot]);
+            worker.record(read_tsc() - start);
+            pointers[slot] = nullptr;
+            continue;
+        }
+
+        auto size = random_kmalloc_size(worker.random);
+        u64 start = read_tsc();
+        pointers[slot] = kmalloc(size);
+        worker.record(read_tsc() - start);
+        if (!pointers[slot]) {
+            worker.failures++;
+            continue;
+        }
+        sizes[slot] = size;
+        // Touched so the allocator's cache misses are part of the storm.
+        *(volatile u8*)pointers[slot] = 0;
+    }
+
+    for (size_t slot = 0; slot < MEMORY_STRESS_TEST_LIVE_SET; ++slot) {
+        if (pointers[slot])
+            kfree_sized(pointers[slot], sizes[slot]);
+    }
+}
+
+static void stress_slab(MemoryStressWorker& worker, size_t operations)
+{
+    static constexpr size_t slab_sizes[] = { 16, 32, 64, 128 };
+
+    void* pointers[MEMORY_STRESS_TEST_LIVE_SET] {};
+
+    // Each slot keeps one size so frees go back to the cache they came from.
+    auto slab_size_of = [](size_t slot) { return slab_sizes[slot % array_size(slab_sizes)]; };
+
+    for (size_t i = 0; i < operations; ++i) {
+        auto slot = worker.random.next() % MEMORY_STRESS_TEST_LIVE_SET;
+        u64 start = read_tsc();
+        if (pointers[slot]) {
+            slab_dealloc(pointers[slot], slab_size_of(slot));
+            pointers[slot] = nullptr;
+        } else {
+            pointers[slot] = slab_alloc(slab_size_of(slot));
+            if (!pointers[slot])
+                worker.failures++;
+        }
+        worker.record(read_tsc() - start);
+    }
+
+    for (size_t slot = 0; slot < MEMORY_STRESS_TEST_LIVE_SET; ++slot) {
+        if (pointers[slot])
+            slab_dealloc(pointers[slot], slab_size_of(slot));
+    }
+}
+
+static void stress_physical(MemoryStressWorker& worker, size_t operations)
+{
+    static constexpr size_t live_pages = 64;
+
+    RefPtr<PhysicalPage> pages[live_pages];
+
+    for (size_t i = 0; i < operations; ++i) {
+        auto slot = worker.random.next() % live_pages;
+        u64 start = read_tsc();
+        if (pages[slot]) {
+            // The last reference returns the page to its zone.
+            pages[slot] = nullptr;
+        } else {
+            pages[slot] = MM.allocate_user_physical_page(MemoryManager::ShouldZeroFill::No);
+            if (!pages[slot])
+                worker.failures++;
+        }
+        worker.record(read_tsc() - start);
+    }
+}
+
+static void stress_range(MemoryStressWorker& worker, size_t operations)
+{
+    // Only bookkeeping, nothing is mapped at this address.
+    RangeAllocator allocator;
+    allocator.initialize_with_range(VirtualAddress(0x40000000), 256 * MiB);
+
+    Optional<Range> ranges[MEMORY_STRESS_TEST_LIVE_SET];
+
+    for (size_t i = 0; i < operations; ++i) {
+        auto slot = worker.random.next() % MEMORY_STRESS_TEST_LIVE_SET;
+        u64 start = read_tsc();
+        if (ranges[slot].has_value()) {
+            allocator.deallocate(ranges[slot].value());
+            ranges[slot] = {};
+        } else {
+            ranges[slot] = allocator.allocate_anywhere(PAGE_SIZE * (1 + worker.random.next() % 16));
+            if (!ranges[slot].has_value())
+                worker.failures++;
+        }
+        worker.record(read_tsc() - start);
+    }
+
+    for (auto& range : ranges) {
+        if (range.has_value())
+            allocator.deallocate(range.value());
+    }
+}
+
+static void stress_map(MemoryStressWorker& worker, size_t operations)
+{
+    for (size_t i = 0; i < operations; ++i) {
+        size_t size = PAGE_SIZE * (1 + worker.random.next() % 8);
+        u64 start = read_tsc();
+        auto region = MM.allocate_kernel_region(size, "Memory stress test"sv, Region::Access::Read | Region::Access::Write, AllocationStrategy::AllocateNow);
+        if (!region) {
+            worker.failures++;
+            continue;
+        }
+        *(volatile u8*)region->vaddr().as_ptr() = 1;
+        // Unmapping flushes this range out of every CPU's TLB.
+        region = nullptr;
+        worker.record(read_tsc() - start);
+    }
+}
+
+static void stress_fault(MemoryStressWorker& worker, size_t operations)
+{
+    static constexpr size_t region_pages = 256;
+
+    while (operations) {
+        auto region = MM.allocate_kernel_region(region_pages * PAGE_SIZE, "Memory stress test"sv, Region::Access::Read | Region::Access::Write, AllocationStrategy::Reserve);
+        if (!region) {
+            worker.failures++;
+            return;
+        }
+
+        size_t pages = min(operations, region_pages);
+        for (size_t page = 0; page < pages; ++page) {
+            auto* address = (volatile u8*)region->vaddr().offset(page * PAGE_SIZE).as_ptr();
+            u64 start = read_tsc();
+            *address = 1;
+            worker.record(read_tsc() - start);
+        }
+        operations -= pages;
+    }
+}
+
+static void stress_cow(MemoryStressWorker& worker, size_t operations)
+{
+    static constexpr size_t region_pages = 64;
+    static constexpr size_t size = region_pages * PAGE_SIZE;
+
+    while (operations) {
+        auto vmobject = AnonymousVMObject::try_create_with_size(size, AllocationStrategy::AllocateNow);
+        if (!vmobject) {
+            worker.failures++;
+            return;
+        }
+        auto region = MM.allocate_kernel_region_with_vmobject(*vmobject, size, "Memory stress test"sv, Region::Access::Read | Region::Access::Write);
+        if (!region) {
+            worker.failures++;
+            return;
+        }
+        for (size_t page = 0; page < region_pages; ++page)
+            *(volatile u8*)region->vaddr().offset(page * PAGE_SIZE).as_ptr() = 1;
+
+        // What fork does to a private region: both sides share the pages
+        // until one of them writes, and the parent's mapping goes read-only.
+        auto clone = vmobject->try_clone();
+        if (!clone) {
+            worker.failures++;
+            return;
+        }
+        region->remap();
+
+        auto clone_region = MM.allocate_kernel_region_with_vmobject(*clone, size, "Memory stress test"sv, Region::Access::Read | Region::Access::Write);
+        if (!clone_region) {
+            worker.failures++;
+            return;
+        }
+
+        size_t pages = min(operations, region_pages);
+        for (size_t page = 0; page < pages; ++page) {
+            auto* address = (volatile u8*)clone_region->vaddr().offset(page * PAGE_SIZE).as_ptr();
+            u64 start = read_tsc();
+            *address = 2;
+            worker.record(read_tsc() - start);
+        }
+        operations -= pages;
+    }
+}
+
+static void run_phase(MemoryStressWorker& worker, MemoryStressPhase phase)
+{
+    auto operations = memory_stress_phase_operations(phase);
+
+    worker.operations = 0;
+    worker.failures = 0;
+    worker.stride = max<size_t>(1, operations / MEMORY_STRESS_TEST_SAMPLE_COUNT);
+    worker.samples.clear_with_capacity();
+
+    switch (phase) {
+    case MemoryStressPhase::Kmalloc:
+        stress_kmalloc(worker, operations);
+        break;
+    case MemoryStressPhase::Slab:
+        stress_slab(worker, operations);
+        break;
+    case MemoryStressPhase::Physical:
+        stress_physical(worker, operations);
+        break;
+    case MemoryStressPhase::Range:
+        stress_range(worker, operations);
+        break;
+    case MemoryStressPhase::Map:
+        stress_map(worker, operations);
+        break;
+    case MemoryStressPhase::Fault:
+        stress_fault(worker, operations);
+        break;
+    case MemoryStressPhase::Cow:
+        stress_cow(worker, operations);
+        break;
+    case MemoryStressPhase::__Count:
+        VERIFY_NOT_REACHED();
+    }
+}
+
+static void memory_stress_worker_main(void* data)
+{
+    auto& worker = *static_cast<MemoryStressWorker*>(data);
+
+    for (u32 phase = 0; phase < (u32)MemoryStressPhase::__Count; ++phase) {
+        while (s_phase_generation.load() != phase + 1)
+            Scheduler::yield();
+
+        run_phase(worker, (MemoryStressPhase)phase);
+        s_finished_count.fetch_add(1);
+    }
+}
+
+static void report_phase(MemoryStressPhase phase, u64 elapsed_ms)
+{
+    Vector<u32> samples;
+    size_t operations = 0;
+    size_t failures = 0;
+
+    for (u32 i = 0; i < s_worker_count; ++i) {
+        auto& worker = s_workers[i];
+        samples.append(worker.samples.data(), worker.samples.size());
+        operations += worker.operations;
+        failures += worker.failures;
+    }
+
+    if (samples.is_empty()) {
+        dmesgln("MemoryStressTest: {}: nothing measured, {} failures", memory_stress_phase_name(phase), failures);
+        return;
+    }
+
+    quick_sort(samples);
+
+    auto percentile = [&](size_t per_mille) {
+        return samples[min(samples.size() - 1, samples.size() * per_mille / 1000)];
+    };
+
+    u64 per_second = elapsed_ms ? operations * 1000 / elapsed_ms : 0;
+
+    dmesgln("MemoryStressTest: {}: {} CPUs, {} ops in {} ms, {} ops/s, {} failures", memory_stress_phase_name(phase), s_worker_count, operations, elapsed_ms, per_second, failures);
+    dmesgln("MemoryStressTest: {}: cycles p50 {} p90 {} p99 {} p99.9 {} max {}", memory_stress_phase_name(phase), percentile(500), percentile(900), percentile(990), percentile(999), samples.last());
+}
+
+static void memory_stress_test_main(void*)
+{
+    s_worker_count = min(Processor::count(), (u32)MEMORY_STRESS_TEST_MAX_WORKERS);
+
+    for (u32 cpu = 0; cpu < s_worker_count; ++cpu) {
+        auto& worker = s_workers[cpu];
+        worker.cpu = cpu;
+        worker.random.state = 0x9e3779b9 * (cpu + 1);
+        // Reserved here so recording a sample never allocates.
+        worker.samples.ensure_capacity(MEMORY_STRESS_TEST_SAMPLE_COUNT);
+
+        RefPtr<Thread> thread;
+        if (!Process::create_kernel_process(thread, String::formatted("MemoryStress {}", cpu), memory_stress_worker_main, &worker, 1u << cpu)) {
+            dmesgln("MemoryStressTest: Could not create the worker of CPU {}", cpu);
+            s_worker_count = cpu;
+            break;
+        }
+    }
+
+    if (!s_worker_count)
+        return;
+
+    dmesgln("MemoryStressTest: Starting on {} CPUs", s_worker_count);
+
+    for (u32 phase = 0; phase < (u32)MemoryStressPhase::__Count; ++phase) {
+        s_finished_count.store(0);
+        u64 start_ms = TimeManagement::the().uptime_ms();
+        s_phase_generation.store(phase + 1);
+
+        while (s_finished_count.load() != s_worker_count)
+            Scheduler::yield();
+
+        report_phase((MemoryStressPhase)phase, TimeManagement::the().uptime_ms() - start_ms);
+    }
+
+    dmesgln("MemoryStressTest: Done");
+}
+
+void memory_stress_test_start()
+{
+    if (!kernel_command_line().contains("memory_stress_test"))
+        return;
+
+    RefPtr<Thread> thread;
+    Process::create_kernel_process(thread, "MemoryStressTest", memory_stress_test_main, nullptr);
+}
+
+}
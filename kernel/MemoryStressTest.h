@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+
+namespace Kernel {
+
+// Boot time stress test and benchmark of the heap and VM, run when the
+// kernel command line has memory_stress_test. One kernel thread per CPU
+// runs each phase at the same time as the others:
+//
+// - kmalloc: random sizes allocated and freed around a live set.
+// - slab: the same with the slab sizes.
+// - physical: user physical pages allocated and released, which goes
+//   through PhysicalZone::allocate_block().
+// - range: RangeAllocator::allocate_anywhere() and deallocate() churn on
+//   an allocator of the thread's own.
+// - map: kernel regions mapped, touched and unmapped, which takes the
+//   kernel range allocator and flushes the TLB of every CPU.
+// - fault: first writes to pages of a lazily committed region.
+// - cow: writes to a clone of a populated region, the page faults a
+//   fork leaves after it.
+//
+// Every phase prints its operations per second and the p50, p90, p99,
+// p99.9 and maximum latency in TSC cycles to the console. The latencies
+// are those of a sample of MEMORY_STRESS_TEST_SAMPLE_COUNT operations per
+// thread, so a phase costs about the same to report however long it ran.
+
+#define MEMORY_STRESS_TEST_SAMPLE_COUNT 4096
+
+// Called once the scheduler runs, does nothing unless the test was asked
+// for.
+void memory_stress_test_start();
+
+}
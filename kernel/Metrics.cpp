@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/filesystem/SysFS.h>
+#include <kernel/KBufferBuilder.h>
+#include <kernel/Metrics.h>
+#include <kernel/Sections.h>
+
+namespace Base {
+
+size_t metrics_shard_index()
+{
+    return Kernel::Processor::id();
+}
+
+}
+
+namespace Kernel {
+
+class SysFSMetrics final : public SysFSComponent {
+public:
+    static NonnullRefPtr<SysFSMetrics> create()
+    {
+        return adopt_ref(*new (nothrow) SysFSMetrics);
+    }
+
+    virtual KResultOr<size_t> read_bytes(off_t offset, size_t count, UserOrKernelBuffer& buffer, FileDescription*) const override
+    {
+        auto data = try_to_generate_buffer();
+        if (!data)
+            return ENOMEM;
+
+        if ((size_t)offset >= data->size())
+            return KSuccess;
+
+        ssize_t nread = min(static_cast<off_t>(data->size() - offset), static_cast<off_t>(count));
+        if (!buffer.write(data->data() + offset, nread))
+            return EFAULT;
+        return nread;
+    }
+
+private:
+    SysFSMetrics()
+        : SysFSComponent("metrics"sv)
+    {
+    }
+
+    OwnPtr<KBuffer> try_to_generate_buffer() const
+    {
+        KBufferBuilder builder;
+        MetricsRegistry::the().for_each_value([&](const char* name, const char* field, u64 value) {
+            if (*field)
+                builder.appendff("{}.{} {}\n", name, field, value);
+            else
+                builder.appendff("{} {}\n", name, value);
+        });
+        return builder.build();
+    }
+};
+
+UNMAP_AFTER_INIT void metrics_initialize()
+{
+    SysFSComponentRegistry::the().register_new_component(SysFSMetrics::create());
+}
+
+}
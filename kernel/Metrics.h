@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Metrics.h>
+
+namespace Kernel {
+
+// Exports every Base::Metric of the kernel as the metrics SysFS component,
+// one "name value" or "name.field value" line per value, see
+// MetricsRegistry::for_each_value(). Recording costs a few relaxed atomic
+// adds and never takes a lock, unlike logging from a hot path.
+void metrics_initialize();
+
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/ChaCha20Random.h>
+#include <kernel/arch/x86/InterruptDisabler.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/ProcessorRandom.h>
+#include <kernel/Random.h>
+
+namespace Kernel {
+
+struct alignas(64) ProcessorRandom {
+    ChaCha20Random generator;
+};
+
+static ProcessorRandom s_processor_randoms[ProcessorContainer().size()];
+
+void fill_with_processor_random(void* buffer, size_t length)
+{
+    // Nothing else runs on this CPU in the meantime, and we stay on it.
+    InterruptDisabler disabler;
+    auto& generator = s_processor_randoms[Processor::id()].generator;
+    if (generator.needs_seed()) {
+        // Interrupts may be off, so this mustn't wait for entropy.
+        u8 seed[ChaCha20Random::seed_size];
+        get_good_random_bytes(seed, sizeof(seed), false);
+        generator.seed(seed);
+    }
+    generator.fill(buffer, length);
+}
+
+}
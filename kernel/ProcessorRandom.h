@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+
+namespace Kernel {
+
+// Random bytes from a ChaCha20 generator of the current CPU. It is seeded
+// from the entropy pool and reseeded every ChaCha20Random::reseed_interval
+// bytes, so the many small requests of address randomization and the like
+// don't each take the pool's lock. Safe to call with interrupts disabled.
+void fill_with_processor_random(void* buffer, size_t length);
+
+template<typename T>
+inline T get_processor_random()
+{
+    T value;
+    fill_with_processor_random(&value, sizeof(T));
+    return value;
+}
+
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/arch/x86/InterruptDisabler.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/RCU.h>
+#include <kernel/SpinLock.h>
+#include <kernel/WaitQueue.h>
+
+namespace Kernel {
+
+// A processor's callbacks, only touched by it with interrupts disabled.
+// Those in the next list haven't been given a grace period yet, those in
+// the waiting list run once grace period waiting_for has completed.
+struct alignas(64) RCUProcessorData {
+    RCUHead* next_head { nullptr };
+    RCUHead** next_tail { &next_head };
+    RCUHead* waiting_head { nullptr };
+    RCUHead** waiting_tail { &waiting_head };
+    u64 waiting_for { 0 };
+};
+
+// One per possible CPU, like the idle mask has bits for.
+static RCUProcessorData s_processor_data[32];
+
+// Grace periods are numbered from 1. One is in progress while started is
+// ahead of completed, until every processor in the pending mask has passed
+// through a quiescent state.
+static SpinLock<u8> s_lock;
+static u64 s_started;
+static u64 s_requested;
+static Atomic<u64> s_completed;
+static Atomic<u32> s_pending_processors;
+
+static Atomic<u64> s_callbacks_queued;
+static Atomic<u64> s_callbacks_invoked;
+
+static void start_grace_period()
+{
+    VERIFY(s_lock.own_lock());
+    ++s_started;
+
+    // Idle processors have no readers and their next read section starts
+    // after this, so they'd only hold it up. The unlinks before call_rcu
+    // must be visible before the idle mask is looked at.
+    Base::atomic_thread_fence(Base::MemoryOrder::memory_order_seq_cst);
+    u32 count = min(Processor::count(), 32u);
+    u32 online = count == 32 ? ~0u : (1u << count) - 1;
+    u32 pending = online & ~Processor::idle_cpu_mask();
+    pending |= 1u << Processor::id();
+
+    s_pending_processors.store(pending, Base::MemoryOrder::memory_order_release);
+}
+
+// A grace period that is already running may have started before the
+// caller's unlinks, so they need the one after it.
+static u64 request_next_grace_period()
+{
+    ScopedSpinLock lock(s_lock);
+    u64 number = s_started + 1;
+    s_requested = max(s_requested, number);
+    if (s_started == s_completed.load(Base::MemoryOrder::memory_order_relaxed))
+        start_grace_period();
+    return number;
+}
+
+static void invoke_callbacks(RCUHead* head)
+{
+    u64 invoked = 0;
+    while (head) {
+        // The callback may free what the head is in.
+        auto* next = head->next;
+        head->callback(*head);
+        head = next;
+        ++invoked;
+    }
+    s_callbacks_invoked.fetch_add(invoked, Base::MemoryOrder::memory_order_relaxed);
+}
+
+// Hands the waiting batch to the deferred call queue once its grace period
+// is over, and gives the next batch one.
+static void advance_callbacks(RCUProcessorData& data)
+{
+    if (data.waiting_head && s_completed.load(Base::MemoryOrder::memory_order_acquire) >= data.waiting_for) {
+        auto* batch = data.waiting_head;
+        data.waiting_head = nullptr;
+        data.waiting_tail = &data.waiting_head;
+        Processor::deferred_call_queue([batch] {
+            invoke_callbacks(batch);
+        });
+    }
+
+    if (data.waiting_head || !data.next_head)
+        return;
+
+    data.waiting_head = data.next_head;
+    data.waiting_tail = data.next_tail;
+    data.next_head = nullptr;
+    data.next_tail = &data.next_head;
+    data.waiting_for = request_next_grace_period();
+}
+
+void call_rcu(RCUHead& head, RCUHead::Callback callback)
+{
+    head.next = nullptr;
+    head.callback = callback;
+    s_callbacks_queued.fetch_add(1, Base::MemoryOrder::memory_order_relaxed);
+
+    InterruptDisabler disabler;
+    auto& data = s_processor_data[Processor::id()];
+    *data.next_tail = &head;
+    data.next_tail = &head.next;
+    advance_callbacks(data);
+}
+
+void rcu_note_quiescent_state()
+{
+    InterruptDisabler disabler;
+    u32 cpu = Processor::id();
+    u32 bit = 1u << cpu;
+
+    if (s_pending_processors.load(Base::MemoryOrder::memory_order_relaxed) & bit) {
+        ScopedSpinLock lock(s_lock);
+        if (s_pending_processors.fetch_and(~bit, Base::MemoryOrder::memory_order_acq_rel) == bit) {
+            s_completed.store(s_started, Base::MemoryOrder::memory_order_release);
+            if (s_requested > s_started)
+                start_grace_period();
+        }
+    }
+
+    advance_callbacks(s_processor_data[cpu]);
+}
+
+struct RCUSynchronizer {
+    RCUHead head;
+    Atomic<bool> done { false };
+    Atomic<bool> woken { false };
+    WaitQueue wait_queue;
+};
+
+void synchronize_rcu()
+{
+    VERIFY(!Processor::current().in_critical());
+
+    RCUSynchronizer synchronizer;
+    call_rcu(synchronizer.head, [](RCUHead& head) {
+        auto& synchronizer = *reinterpret_cast<RCUSynchronizer*>(&head);
+        synchronizer.done.store(true, Base::MemoryOrder::memory_order_release);
+        synchronizer.wait_queue.wake_all();
+        synchronizer.woken.store(true, Base::MemoryOrder::memory_order_release);
+    });
+
+    // A wake that comes before the wait is kept by the wait queue.
+    while (!synchronizer.done.load(Base::MemoryOrder::memory_order_acquire))
+        synchronizer.wait_queue.wait_forever("RCU");
+
+    // The wait queue lives on this stack, the callback must be out of it.
+    while (!synchronizer.woken.load(Base::MemoryOrder::memory_order_acquire))
+        Processor::wait_check();
+}
+
+RCUStats rcu_stats()
+{
+    return {
+        .grace_periods = s_completed.load(Base::MemoryOrder::memory_order_relaxed),
+        .callbacks_queued = s_callbacks_queued.load(Base::MemoryOrder::memory_order_relaxed),
+        .callbacks_invoked = s_callbacks_invoked.load(Base::MemoryOrder::memory_order_relaxed),
+    };
+}
+
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Atomic.h>
+#include <base/Noncopyable.h>
+#include <base/Types.h>
+#include <kernel/arch/x86/ScopedCritical.h>
+
+namespace Kernel {
+
+// Read-copy-update: readers walk a structure without taking its lock, and
+// writers that unlink something from it leave it alone until every reader
+// that might still see it is done.
+//
+// A read section keeps its processor from switching threads, so once every
+// processor has switched threads, gone idle or taken a timer tick outside a
+// read section since the unlink, no reader can see the old object anymore.
+// That is a grace period. Read sections are critical sections and keep
+// interrupts disabled, so they must not sleep and should be short.
+
+// Embedded in whatever call_rcu frees.
+struct RCUHead {
+    using Callback = void (*)(RCUHead&);
+
+    RCUHead* next { nullptr };
+    Callback callback { nullptr };
+};
+
+class RCUReadLock {
+    BASE_MAKE_NONCOPYABLE(RCUReadLock);
+    BASE_MAKE_NONMOVABLE(RCUReadLock);
+
+public:
+    RCUReadLock() = default;
+
+private:
+    ScopedCritical m_critical;
+};
+
+// Loads a pointer that a writer published with rcu_assign_pointer(), so the
+// object it points to is seen as it was when it was published.
+template<typename T>
+ALWAYS_INLINE T* rcu_dereference(T* const& pointer)
+{
+    return Base::atomic_load(const_cast<T**>(&pointer), Base::MemoryOrder::memory_order_consume);
+}
+
+// Publishes a pointer once the object behind it is completely set up.
+template<typename T>
+ALWAYS_INLINE void rcu_assign_pointer(T*& pointer, T* value)
+{
+    Base::atomic_store(&pointer, value, Base::MemoryOrder::memory_order_release);
+}
+
+// Calls the callback once a grace period has passed, from the deferred call
+// queue of the processor that queued it. Callbacks queued on one processor
+// during a grace period go together in a batch. They run with interrupts
+// disabled and must not sleep, hand anything heavier to a work queue.
+void call_rcu(RCUHead&, RCUHead::Callback);
+
+// Sleeps until a grace period has passed. Not from a read section.
+void synchronize_rcu();
+
+// Called by the processor when it switches threads, goes idle or takes a
+// timer interrupt, none of which happen inside a read section.
+void rcu_note_quiescent_state();
+
+struct RCUStats {
+    u64 grace_periods;
+    u64 callbacks_queued;
+    u64 callbacks_invoked;
+};
+
+RCUStats rcu_stats();
+
+}
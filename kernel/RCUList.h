@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Assertions.h>
+#include <base/Concepts.h>
+#include <base/IterationDecision.h>
+#include <base/Noncopyable.h>
+#include <kernel/RCU.h>
+
+namespace Kernel {
+
+template<typename T>
+class RCUListNode {
+public:
+    RCUListNode() = default;
+
+    ~RCUListNode()
+    {
+        VERIFY(!m_in_list);
+    }
+
+    bool is_in_list() const { return m_in_list; }
+
+private:
+    template<typename T_, RCUListNode<T_> T_::*member>
+    friend class RCUList;
+
+    T* m_next { nullptr };
+    T* m_prev { nullptr };
+    bool m_in_list { false };
+};
+
+// An intrusive list that can be walked inside an RCUReadLock while it is
+// changed. Writers still serialize on a lock of their own, and walking it
+// under that lock works as well.
+//
+// A removed value keeps pointing at the one after it, so readers that are
+// on it carry on. It must not be freed or put back in a list before a grace
+// period has passed.
+template<typename T, RCUListNode<T> T::*member>
+class RCUList {
+    BASE_MAKE_NONCOPYABLE(RCUList);
+    BASE_MAKE_NONMOVABLE(RCUList);
+
+public:
+    RCUList() = default;
+
+    ~RCUList()
+    {
+        VERIFY(is_empty());
+    }
+
+    [[nodiscard]] bool is_empty() const { return !rcu_dereference(m_first); }
+
+    T* first() const { return rcu_dereference(m_first); }
+    static T* next(T& value) { return rcu_dereference((value.*member).m_next); }
+
+    void append(T& value)
+    {
+        auto& node = value.*member;
+        VERIFY(!node.m_in_list);
+        node.m_next = nullptr;
+        node.m_prev = m_last;
+        node.m_in_list = true;
+
+        // The value is complete before readers can get to it.
+        if (m_last)
+            rcu_assign_pointer((m_last->*member).m_next, &value);
+        else
+            rcu_assign_pointer(m_first, &value);
+        m_last = &value;
+    }
+
+    void prepend(T& value)
+    {
+        auto& node = value.*member;
+        VERIFY(!node.m_in_list);
+        node.m_next = m_first;
+        node.m_prev = nullptr;
+        node.m_in_list = true;
+
+        if (m_first)
+            (m_first->*member).m_prev = &value;
+        else
+            m_last = &value;
+        rcu_assign_pointer(m_first, &value);
+    }
+
+    void remove(T& value)
+    {
+        auto& node = value.*member;
+        VERIFY(node.m_in_list);
+
+        if (node.m_prev)
+            rcu_assign_pointer((node.m_prev->*member).m_next, node.m_next);
+        else
+            rcu_assign_pointer(m_first, node.m_next);
+
+        if (node.m_next)
+            (node.m_next->*member).m_prev = node.m_prev;
+        else
+            m_last = node.m_prev;
+
+        node.m_prev = nullptr;
+        node.m_in_list = false;
+    }
+
+    class Iterator {
+    public:
+        Iterator() = default;
+        Iterator(T* value)
+            : m_value(value)
+        {
+        }
+
+        T& operator*() { return *m_value; }
+        T* operator->() { return m_value; }
+        bool operator==(Iterator const& other) const { return other.m_value == m_value; }
+        bool operator!=(Iterator const& other) const { return !(*this == other); }
+        Iterator& operator++()
+        {
+            m_value = RCUList::next(*m_value);
+            return *this;
+        }
+
+    private:
+        T* m_value { nullptr };
+    };
+
+    Iterator begin() { return Iterator { first() }; }
+    Iterator end() { return Iterator {}; }
+
+    // Walks it inside a read section of its own.
+    template<IteratorFunction<T&> Callback>
+    IterationDecision for_each(Callback callback)
+    {
+        RCUReadLock lock;
+        for (auto* value = first(); value; value = next(*value)) {
+            if (callback(*value) == IterationDecision::Break)
+                return IterationDecision::Break;
+        }
+        return IterationDecision::Continue;
+    }
+
+private:
+    T* m_first { nullptr };
+    T* m_last { nullptr };
+};
+
+}
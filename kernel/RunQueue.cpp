@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/RunQueue.h>
+
+namespace Kernel {
+
+static RunQueue s_run_queues[RUN_QUEUE_MAX_CPUS];
+
+u32 RunQueueEntry::bucket_for_priority(u32 priority, u32 max_priority)
+{
+    VERIFY(max_priority);
+    return min(priority, max_priority) * (RUN_QUEUE_PRIORITY_BUCKETS - 1) / max_priority;
+}
+
+RunQueue& RunQueue::for_cpu(u32 cpu)
+{
+    VERIFY(cpu < RUN_QUEUE_MAX_CPUS);
+    return s_run_queues[cpu];
+}
+
+u32 RunQueue::pick_cpu(RunQueueEntry const& entry)
+{
+    u32 cpu_count = Processor::count();
+    CPUAffinityMask online = cpu_count >= 32 ? CPU_AFFINITY_ALL : (1u << cpu_count) - 1;
+    CPUAffinityMask allowed = entry.affinity & online;
+    // A mask with none of the CPUs that are up still has to run somewhere.
+    if (!allowed)
+        allowed = online;
+
+    u32 last = entry.last_cpu;
+    CPUAffinityMask idle = Processor::idle_cpu_mask() & allowed;
+
+    if ((allowed & (1u << last)) && ((idle & (1u << last)) || !idle))
+        return last;
+    if (idle)
+        return __builtin_ctz(idle);
+
+    // Everyone it may run on is busy, the shortest queue it is.
+    u32 best = __builtin_ctz(allowed);
+    for (u32 cpu = best + 1; cpu < cpu_count; ++cpu) {
+        if ((allowed & (1u << cpu)) && for_cpu(cpu).size() < for_cpu(best).size())
+            best = cpu;
+    }
+    return best;
+}
+
+u32 RunQueue::enqueue_thread(RunQueueEntry& entry)
+{
+    u32 cpu = pick_cpu(entry);
+    for_cpu(cpu).enqueue(entry);
+    return cpu;
+}
+
+void RunQueue::enqueue(RunQueueEntry& entry)
+{
+    VERIFY(entry.bucket < RUN_QUEUE_PRIORITY_BUCKETS);
+    ScopedSpinLock lock(m_lock);
+    VERIFY(!entry.list_node.is_in_list());
+    m_buckets[entry.bucket].append(entry);
+    m_non_empty |= 1u << entry.bucket;
+    entry.queued_on = this - s_run_queues;
+    m_size.fetch_add(1, Base::MemoryOrder::memory_order_relaxed);
+}
+
+bool RunQueue::remove(RunQueueEntry& entry)
+{
+    ScopedSpinLock lock(m_lock);
+    if (!entry.list_node.is_in_list() || entry.queued_on != (u32)(this - s_run_queues))
+        return false;
+    auto& bucket = m_buckets[entry.bucket];
+    bucket.remove(entry);
+    if (bucket.is_empty())
+        m_non_empty &= ~(1u << entry.bucket);
+    m_size.fetch_sub(1, Base::MemoryOrder::memory_order_relaxed);
+    return true;
+}
+
+RunQueueEntry* RunQueue::take_highest(u32 cpu)
+{
+    ScopedSpinLock lock(m_lock);
+
+    u32 non_empty = m_non_empty;
+    while (non_empty) {
+        u32 index = 31 - __builtin_clz(non_empty);
+        non_empty &= ~(1u << index);
+
+        auto& bucket = m_buckets[index];
+        for (auto& entry : bucket) {
+            if (!entry.may_run_on(cpu))
+                continue;
+            bucket.remove(entry);
+            if (bucket.is_empty())
+                m_non_empty &= ~(1u << index);
+            m_size.fetch_sub(1, Base::MemoryOrder::memory_order_relaxed);
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+RunQueueEntry* RunQueue::steal_for(u32 cpu)
+{
+    // Only the busiest queue is tried. A steal that finds nothing it may
+    // take leaves the CPU idle until the next one.
+    u32 cpu_count = Processor::count();
+    u32 busiest = cpu;
+    size_t busiest_size = 0;
+    for (u32 other = 0; other < cpu_count; ++other) {
+        if (other == cpu)
+            continue;
+        size_t size = for_cpu(other).size();
+        if (size > busiest_size) {
+            busiest = other;
+            busiest_size = size;
+        }
+    }
+    if (busiest == cpu)
+        return nullptr;
+    return for_cpu(busiest).take_highest(cpu);
+}
+
+RunQueueEntry* RunQueue::dequeue_next(u32 cpu)
+{
+    auto* entry = take_highest(cpu);
+    if (!entry)
+        entry = steal_for(cpu);
+    if (entry)
+        entry->last_cpu = cpu;
+    return entry;
+}
+
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Array.h>
+#include <base/Atomic.h>
+#include <base/IntrusiveList.h>
+#include <base/Types.h>
+#include <kernel/Forward.h>
+#include <kernel/SpinLock.h>
+
+namespace Kernel {
+
+// One bit per CPU, like Processor's idle mask.
+using CPUAffinityMask = u32;
+static constexpr CPUAffinityMask CPU_AFFINITY_ALL = 0xffffffff;
+
+static constexpr size_t RUN_QUEUE_MAX_CPUS = 32;
+static constexpr size_t RUN_QUEUE_PRIORITY_BUCKETS = 32;
+
+// What a Thread keeps for the run queues: where it can and last did run.
+// The priority is the thread's priority folded into a bucket, higher
+// buckets run first.
+struct RunQueueEntry {
+    IntrusiveListNode<RunQueueEntry> list_node;
+    Thread* thread { nullptr };
+    u32 bucket { 0 };
+    u32 last_cpu { 0 };
+    CPUAffinityMask affinity { CPU_AFFINITY_ALL };
+    // The CPU whose queue it is on, while it is on one.
+    u32 queued_on { 0 };
+
+    static u32 bucket_for_priority(u32 priority, u32 max_priority);
+    bool may_run_on(u32 cpu) const { return affinity & (1u << cpu); }
+};
+
+// The runnable threads of one CPU, one FIFO per priority bucket and a
+// bitmap of the non-empty ones, so picking the next thread is a bit scan.
+class RunQueue {
+    BASE_MAKE_NONCOPYABLE(RunQueue);
+    BASE_MAKE_NONMOVABLE(RunQueue);
+
+public:
+    RunQueue() = default;
+
+    static RunQueue& for_cpu(u32 cpu);
+
+    // Where a thread that became runnable goes: the CPU it last ran on,
+    // where its cache is warm, unless that one is busy and another one it
+    // may run on is idle.
+    static u32 pick_cpu(RunQueueEntry const&);
+
+    // Queues it on pick_cpu() and returns that CPU, which has to be woken
+    // if it's idle.
+    static u32 enqueue_thread(RunQueueEntry&);
+
+    void enqueue(RunQueueEntry&);
+    // False if it wasn't queued here, it may have just been taken.
+    bool remove(RunQueueEntry&);
+
+    // The first thread of the highest bucket, or one stolen from the
+    // busiest other CPU if this one has none.
+    RunQueueEntry* dequeue_next(u32 cpu);
+
+    size_t size() const { return m_size.load(Base::MemoryOrder::memory_order_relaxed); }
+
+private:
+    RunQueueEntry* take_highest(u32 cpu);
+    static RunQueueEntry* steal_for(u32 cpu);
+
+    using List = IntrusiveList<RunQueueEntry, RawPtr<RunQueueEntry>, &RunQueueEntry::list_node>;
+
+    SpinLock<u8> m_lock;
+    Array<List, RUN_QUEUE_PRIORITY_BUCKETS> m_buckets;
+    u32 m_non_empty { 0 };
+    // Read without the lock to find the busiest CPU.
+    Atomic<size_t> m_size { 0 };
+};
+
+}
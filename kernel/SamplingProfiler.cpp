@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/HashFunctions.h>
+#include <base/NumericLimits.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/arch/x86/RegisterState.h>
+#include <kernel/arch/x86/SafeMem.h>
+#include <kernel/arch/x86/SmapDisabler.h>
+#include <kernel/filesystem/SysFS.h>
+#include <kernel/heap/kmalloc.h>
+#include <kernel/KBufferBuilder.h>
+#include <kernel/KSyms.h>
+#include <kernel/Process.h>
+#include <kernel/SamplingProfiler.h>
+#include <kernel/Sections.h>
+#include <kernel/SpinLock.h>
+#include <kernel/Thread.h>
+#include <kernel/vm/MemoryManager.h>
+
+namespace Kernel {
+
+#define SAMPLING_PROFILER_RING_SIZE 128
+#define SAMPLING_PROFILER_MAX_STACKS 1024
+
+struct SamplingProfilerSample {
+    u32 pid;
+    u32 tid;
+    u32 depth;
+    // Innermost first.
+    FlatPtr frames[SAMPLING_PROFILER_BACKTRACE_DEPTH];
+};
+
+// Only the timer interrupt of its CPU writes head, and only readers of the
+// profile write tail.
+struct alignas(64) SamplingProfilerRing {
+    Atomic<u32> head { 0 };
+    Atomic<u32> tail { 0 };
+    u32 ticks_until_sample { 0 };
+    Atomic<u32, Base::MemoryOrder::memory_order_relaxed> dropped_sample_count { 0 };
+    SamplingProfilerSample samples[SAMPLING_PROFILER_RING_SIZE];
+};
+
+struct SamplingProfilerStack {
+    unsigned hash;
+    u32 count;
+    SamplingProfilerSample sample;
+};
+
+static_assert(!(SAMPLING_PROFILER_RING_SIZE & (SAMPLING_PROFILER_RING_SIZE - 1)));
+
+static Atomic<u32, Base::MemoryOrder::memory_order_relaxed> s_sample_period { 0 };
+static SamplingProfilerRing s_rings[ProcessorContainer().size()];
+
+// Everything below is only touched under s_stacks_lock, which the timer
+// interrupt never takes.
+static SpinLock<u8> s_stacks_lock;
+static SamplingProfilerStack s_stacks[SAMPLING_PROFILER_MAX_STACKS];
+static size_t s_stack_count;
+static size_t s_dropped_stack_count;
+
+static u32 capture_backtrace(RegisterState const& regs, FlatPtr* frames)
+{
+    u32 depth = 0;
+    frames[depth++] = regs.ip();
+
+    // The outermost kernel frame links to the userland frame that made the
+    // syscall or took the interrupt, so one walk covers both.
+    bool in_userland = is_user_address(VirtualAddress(regs.ip()));
+    FlatPtr* frame = (FlatPtr*)regs.bp();
+    SmapDisabler disabler;
+    while (frame && depth < SAMPLING_PROFILER_BACKTRACE_DEPTH) {
+        bool frame_in_userland = is_user_address(VirtualAddress(frame));
+        // Frames only ever lead from the kernel out to userland.
+        if (in_userland && !frame_in_userland)
+            break;
+        in_userland = frame_in_userland;
+
+        FlatPtr frame_data[2];
+        void* fault_at;
+        if (!safe_memcpy(frame_data, frame, sizeof(frame_data), fault_at) || !frame_data[1])
+            break;
+        frames[depth++] = frame_data[1];
+        frame = (FlatPtr*)frame_data[0];
+    }
+    return depth;
+}
+
+void sampling_profiler_timer_tick(RegisterState const& regs)
+{
+    u32 period = s_sample_period;
+    if (!period || !Processor::is_initialized())
+        return;
+
+    auto& ring = s_rings[Processor::id()];
+    if (ring.ticks_until_sample > 1) {
+        ring.ticks_until_sample--;
+        return;
+    }
+    ring.ticks_until_sample = period;
+
+    auto* thread = Processor::current_thread();
+    if (!thread)
+        return;
+
+    u32 head = ring.head.load(Base::memory_order_relaxed);
+    if (head - ring.tail.load(Base::memory_order_acquire) >= SAMPLING_PROFILER_RING_SIZE) {
+        ring.dropped_sample_count++;
+        return;
+    }
+
+    auto& sample = ring.samples[head & (SAMPLING_PROFILER_RING_SIZE - 1)];
+    sample.pid = thread->pid().value();
+    sample.tid = thread->tid().value();
+    sample.depth = capture_backtrace(regs, sample.frames);
+    ring.head.store(head + 1, Base::memory_order_release);
+}
+
+static void add_sample_locked(SamplingProfilerSample const& sample)
+{
+    unsigned hash = pair_int_hash(sample.pid, sample.tid);
+    for (u32 i = 0; i < sample.depth; i++)
+        hash = pair_int_hash(hash, ptr_hash(sample.frames[i]));
+
+    for (size_t i = 0; i < s_stack_count; i++) {
+        auto& stack = s_stacks[i];
+        if (stack.hash != hash || stack.sample.pid != sample.pid || stack.sample.tid != sample.tid || stack.sample.depth != sample.depth)
+            continue;
+        if (__builtin_memcmp(stack.sample.frames, sample.frames, sample.depth * sizeof(FlatPtr)))
+            continue;
+        stack.count++;
+        return;
+    }
+
+    if (s_stack_count == SAMPLING_PROFILER_MAX_STACKS) {
+        s_dropped_stack_count++;
+        return;
+    }
+    s_stacks[s_stack_count++] = { hash, 1, sample };
+}
+
+static void drain_rings_locked()
+{
+    for (auto& ring : s_rings) {
+        u32 tail = ring.tail.load(Base::memory_order_relaxed);
+        u32 head = ring.head.load(Base::memory_order_acquire);
+        for (; tail != head; tail++)
+            add_sample_locked(ring.samples[tail & (SAMPLING_PROFILER_RING_SIZE - 1)]);
+        ring.tail.store(tail, Base::memory_order_release);
+    }
+}
+
+void sampling_profiler_set_period(u32 ticks)
+{
+    s_sample_period = 0;
+
+    ScopedSpinLock lock(s_stacks_lock);
+    for (auto& ring : s_rings) {
+        ring.tail.store(ring.head.load(Base::memory_order_acquire), Base::memory_order_release);
+        ring.dropped_sample_count = 0;
+    }
+    s_stack_count = 0;
+    s_dropped_stack_count = 0;
+    s_sample_period = ticks;
+}
+
+class SysFSCPUProfile final : public SysFSComponent {
+public:
+    static NonnullRefPtr<SysFSCPUProfile> create()
+    {
+        return adopt_ref(*new (nothrow) SysFSCPUProfile);
+    }
+
+    virtual KResultOr<size_t> read_bytes(off_t offset, size_t count, UserOrKernelBuffer& buffer, FileDescription*) const override
+    {
+        auto data = try_to_generate_buffer();
+        if (!data)
+            return ENOMEM;
+
+        if ((size_t)offset >= data->size())
+            return KSuccess;
+
+        ssize_t nread = min(static_cast<off_t>(data->size() - offset), static_cast<off_t>(count));
+        if (!buffer.write(data->data() + offset, nread))
+            return EFAULT;
+        return nread;
+    }
+
+    virtual KResultOr<size_t> write_bytes(off_t, size_t count, UserOrKernelBuffer const& buffer, FileDescription*) override
+    {
+        char digits[11];
+        if (!count || count > sizeof(digits))
+            return EINVAL;
+        if (!buffer.read(digits, count))
+            return EFAULT;
+
+        u64 ticks = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (digits[i] == '\n' && i == count - 1)
+                break;
+            if (digits[i] < '0' || digits[i] > '9')
+                return EINVAL;
+            ticks = ticks * 10 + (digits[i] - '0');
+        }
+        if (ticks > NumericLimits<u32>::max())
+            return EINVAL;
+        sampling_profiler_set_period(ticks);
+        return count;
+    }
+
+private:
+    SysFSCPUProfile()
+        : SysFSComponent("cpu_profile"sv)
+    {
+    }
+
+    OwnPtr<KBuffer> try_to_generate_buffer() const
+    {
+        // Take a copy first, building the output allocates.
+        auto* stacks = (SamplingProfilerStack*)kmalloc(sizeof(s_stacks));
+        if (!stacks)
+            return {};
+        size_t stack_count;
+        size_t dropped_count;
+        {
+            ScopedSpinLock lock(s_stacks_lock);
+            drain_rings_locked();
+            __builtin_memcpy(stacks, s_stacks, s_stack_count * sizeof(SamplingProfilerStack));
+            stack_count = s_stack_count;
+            dropped_count = s_dropped_stack_count;
+            for (auto& ring : s_rings)
+                dropped_count += ring.dropped_sample_count.load();
+        }
+
+        KBufferBuilder builder;
+        for (size_t i = 0; i < stack_count; i++) {
+            auto& sample = stacks[i].sample;
+            builder.appendff("pid {};tid {}", sample.pid, sample.tid);
+            for (u32 frame = sample.depth; frame-- > 0;) {
+                auto address = sample.frames[frame];
+                if (is_user_address(VirtualAddress(address))) {
+                    builder.appendff(";{:#x}", address);
+                    continue;
+                }
+                auto* symbol = g_kernel_symbols_available ? symbolicate_kernel_address(address) : nullptr;
+                if (symbol)
+                    builder.appendff(";{}", symbol->name);
+                else
+                    builder.appendff(";{:#x}", address);
+            }
+            builder.appendff(" {}\n", stacks[i].count);
+        }
+        // Samples that never made it count as one stack, so the flamegraph
+        // shows how much is missing.
+        if (dropped_count)
+            builder.appendff("[dropped] {}\n", dropped_count);
+
+        kfree(stacks);
+        return builder.build();
+    }
+};
+
+UNMAP_AFTER_INIT void sampling_profiler_initialize()
+{
+    SysFSComponentRegistry::the().register_new_component(SysFSCPUProfile::create());
+}
+
+}
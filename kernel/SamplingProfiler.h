@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+
+namespace Kernel {
+
+struct RegisterState;
+
+// Timer driven CPU profiler. Every sample period's worth of timer ticks,
+// the tick captures the backtrace of whatever thread it interrupted, from
+// the kernel frames out into the userland ones, into a ring of its own
+// CPU. Nothing is locked or allocated in the tick, a full ring just drops
+// the sample.
+//
+// Reading the cpu_profile SysFS component drains the rings and exports
+// every stack seen since profiling was started in the folded format that
+// flamegraph tools take, one "pid;tid;outermost;...;innermost count" line
+// per stack. Writing a period to it, in ticks, starts profiling over; 0
+// stops it.
+
+#define SAMPLING_PROFILER_BACKTRACE_DEPTH 32
+
+void sampling_profiler_initialize();
+
+void sampling_profiler_set_period(u32 ticks);
+
+// Called from the timer interrupt of every CPU.
+void sampling_profiler_timer_tick(RegisterState const&);
+
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/arch/x86/ASM_wrapper.h>
+#include <kernel/arch/x86/InterruptDisabler.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/Process.h>
+#include <kernel/SpinLock.h>
+#include <kernel/Thread.h>
+#include <kernel/TraceBuffer.h>
+#include <kernel/Tracing.h>
+#include <kernel/vm/MemoryManager.h>
+#include <kernel/vm/Space.h>
+
+namespace Kernel {
+
+static constexpr u32 trace_entries_per_ring = 4096;
+
+Atomic<u32, Base::MemoryOrder::memory_order_relaxed> g_trace_enabled_events { 0 };
+
+static SpinLock<u8> s_trace_buffer_lock;
+// Set once, never cleared.
+static Atomic<TraceBuffer*> s_trace_buffer;
+
+void trace_event_slow(TraceEvent event, u64 a, u64 b, u64 c)
+{
+    auto* buffer = s_trace_buffer.load(Base::memory_order_acquire);
+    if (!buffer || !Processor::is_initialized())
+        return;
+    buffer->write(event, a, b, c);
+}
+
+KResultOr<NonnullRefPtr<TraceBuffer>> TraceBuffer::open(u32 events)
+{
+    if (!events || (events & ~((1u << trace_event_count) - 1)))
+        return EINVAL;
+
+    ScopedSpinLock lock(s_trace_buffer_lock);
+    if (auto* buffer = s_trace_buffer.load(Base::memory_order_relaxed)) {
+        if (buffer->m_is_open)
+            return EBUSY;
+        buffer->m_is_open = true;
+        g_trace_enabled_events = events;
+        return NonnullRefPtr<TraceBuffer>(*buffer);
+    }
+    lock.unlock();
+
+    // Every processor is up before userland can get here.
+    u32 ring_count = Processor::count();
+    u32 ring_offset = PAGE_SIZE;
+    u32 ring_stride = page_round_up(sizeof(TraceRingHeader) + trace_entries_per_ring * sizeof(TraceRecord));
+    u32 size = ring_offset + ring_count * ring_stride;
+
+    auto vmobject = AnonymousVMObject::try_create_with_size(size, AllocationStrategy::AllocateNow);
+    if (!vmobject)
+        return ENOMEM;
+    auto region = MM.allocate_kernel_region_with_vmobject(*vmobject, size, "TraceBuffer", Region::Access::Read | Region::Access::Write);
+    if (!region)
+        return ENOMEM;
+    memset(region->vaddr().as_ptr(), 0, size);
+
+    auto& header = *reinterpret_cast<TraceBufferHeader*>(region->vaddr().as_ptr());
+    header.ring_count = ring_count;
+    header.entries_per_ring = trace_entries_per_ring;
+    header.ring_offset = ring_offset;
+    header.ring_stride = ring_stride;
+    header.size = size;
+
+    auto buffer = adopt_ref_if_nonnull(new (nothrow) TraceBuffer(vmobject.release_nonnull(), region.release_nonnull(), ring_count, ring_offset, ring_stride));
+    if (!buffer)
+        return ENOMEM;
+
+    lock.lock();
+    // Lost a race with another opener.
+    if (s_trace_buffer.load(Base::memory_order_relaxed))
+        return EBUSY;
+    // The reference held through s_trace_buffer is never dropped.
+    buffer->ref();
+    buffer->m_is_open = true;
+    s_trace_buffer.store(buffer.ptr(), Base::memory_order_release);
+    g_trace_enabled_events = events;
+    return buffer.release_nonnull();
+}
+
+TraceBuffer::TraceBuffer(NonnullRefPtr<AnonymousVMObject> vmobject, NonnullOwnPtr<Region> region, u32 ring_count, u32 ring_offset, u32 ring_stride)
+    : m_vmobject(move(vmobject))
+    , m_region(move(region))
+    , m_ring_count(ring_count)
+    , m_ring_offset(ring_offset)
+    , m_ring_stride(ring_stride)
+{
+}
+
+TraceBuffer::~TraceBuffer()
+{
+}
+
+TraceRecord& TraceBuffer::record_at(u32 ring, u64 sequence)
+{
+    auto* records = reinterpret_cast<TraceRecord*>(&ring_at(ring) + 1);
+    return records[sequence % trace_entries_per_ring];
+}
+
+void TraceBuffer::write(TraceEvent event, u64 a, u64 b, u64 c)
+{
+    // Keeps interrupts on this processor from writing to the same ring
+    // halfway through a record.
+    InterruptDisabler disabler;
+    u32 processor = Processor::id();
+    if (processor >= m_ring_count)
+        return;
+
+    auto& ring = ring_at(processor);
+    u64 sequence = ring.head;
+    auto& record = record_at(processor, sequence);
+
+    // Tells readers the slot is being rewritten before anything else in
+    // it changes.
+    Base::atomic_store(&record.sequence, ~0ull, Base::memory_order_relaxed);
+    Base::full_memory_barrier();
+
+    auto* thread = Processor::current_thread();
+    record.timestamp = read_tsc();
+    record.event = event;
+    record.processor = processor;
+    record.tid = thread ? thread->tid().value() : 0;
+    record.args[0] = a;
+    record.args[1] = b;
+    record.args[2] = c;
+
+    Base::atomic_store(&record.sequence, sequence, Base::memory_order_release);
+    Base::atomic_store(&ring.head, sequence + 1, Base::memory_order_release);
+}
+
+KResultOr<Region*> TraceBuffer::mmap(Process& process, FileDescription&, Range const& range, u64 offset, int prot, bool shared)
+{
+    if (offset)
+        return EINVAL;
+    if (prot & (PROT_WRITE | PROT_EXEC))
+        return EACCES;
+    if (range.size() > m_vmobject->size())
+        return EINVAL;
+    return process.space().allocate_region_with_vmobject(range, m_vmobject, 0, "TraceBuffer", prot, shared);
+}
+
+KResult TraceBuffer::close()
+{
+    ScopedSpinLock lock(s_trace_buffer_lock);
+    g_trace_enabled_events = 0;
+    m_is_open = false;
+    return KSuccess;
+}
+
+String TraceBuffer::absolute_path(FileDescription const&) const
+{
+    return "trace-buffer";
+}
+
+}
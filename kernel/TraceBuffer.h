@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/NonnullOwnPtr.h>
+#include <kernel/api/Trace.h>
+#include <kernel/filesystem/File.h>
+#include <kernel/vm/AnonymousVMObject.h>
+
+namespace Kernel {
+
+// The per-processor rings tracepoints write to, made once and kept for
+// good, so a tracepoint never races with the buffer going away. Only one
+// file descriptor refers to it at a time, tracing stops when that one is
+// closed.
+class TraceBuffer final : public File {
+public:
+    static KResultOr<NonnullRefPtr<TraceBuffer>> open(u32 events);
+    virtual ~TraceBuffer() override;
+
+    void write(TraceEvent, u64, u64, u64);
+
+    virtual bool can_read(FileDescription const&, size_t) const override { return false; }
+    virtual KResultOr<size_t> read(FileDescription&, u64, UserOrKernelBuffer&, size_t) override { return EINVAL; }
+    virtual bool can_write(FileDescription const&, size_t) const override { return false; }
+    virtual KResultOr<size_t> write(FileDescription&, u64, UserOrKernelBuffer const&, size_t) override { return EINVAL; }
+    virtual KResultOr<Region*> mmap(Process&, FileDescription&, Range const&, u64 offset, int prot, bool shared) override;
+    virtual KResult close() override;
+
+    virtual String absolute_path(FileDescription const&) const override;
+    virtual StringView class_name() const override { return "TraceBuffer"sv; };
+
+private:
+    TraceBuffer(NonnullRefPtr<AnonymousVMObject>, NonnullOwnPtr<Region>, u32 ring_count, u32 ring_offset, u32 ring_stride);
+
+    TraceRingHeader& ring_at(u32 index) { return *reinterpret_cast<TraceRingHeader*>(m_region->vaddr().offset(m_ring_offset + index * m_ring_stride).as_ptr()); }
+    TraceRecord& record_at(u32 ring, u64 sequence);
+
+    NonnullRefPtr<AnonymousVMObject> m_vmobject;
+    NonnullOwnPtr<Region> m_region;
+    u32 m_ring_count { 0 };
+    u32 m_ring_offset { 0 };
+    u32 m_ring_stride { 0 };
+    bool m_is_open { false };
+};
+
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Atomic.h>
+#include <base/Platform.h>
+#include <kernel/api/Trace.h>
+
+namespace Kernel {
+
+// Bit n is set while TraceEvent n is written to the trace buffer. A
+// disabled tracepoint costs a load and a branch that is predicted not
+// taken, and its arguments are never computed.
+extern Atomic<u32, Base::MemoryOrder::memory_order_relaxed> g_trace_enabled_events;
+
+void trace_event_slow(TraceEvent, u64, u64, u64);
+
+ALWAYS_INLINE bool trace_event_enabled(TraceEvent event)
+{
+    return __builtin_expect(g_trace_enabled_events.load() & (1u << static_cast<u32>(event)), 0);
+}
+
+}
+
+// Arguments are only evaluated if the event is enabled, and may be
+// pointers or enums as well as integers.
+#define TRACE_EVENT(event, a, b, c)                                                     \
+    do {                                                                                \
+        if (Kernel::trace_event_enabled(TraceEvent::event))                             \
+            Kernel::trace_event_slow(TraceEvent::event, (u64)(a), (u64)(b), (u64)(c)); \
+    } while (0)
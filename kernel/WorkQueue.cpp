@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/Process.h>
+#include <kernel/Scheduler.h>
+#include <kernel/Sections.h>
+#include <kernel/Thread.h>
+#include <kernel/WorkQueue.h>
+
+namespace Kernel {
+
+struct WorkQueue::Worker {
+    Pool* pool { nullptr };
+    RefPtr<Thread> thread;
+};
+
+SpinLock<u8> WorkQueue::s_workers_lock;
+Vector<WorkQueue::Worker*>* WorkQueue::s_workers;
+
+READONLY_AFTER_INIT static WorkQueue* s_system;
+READONLY_AFTER_INIT static WorkQueue* s_system_unbound;
+
+UNMAP_AFTER_INIT void WorkQueue::initialize()
+{
+    s_workers = new Vector<Worker*>;
+    s_system = try_create("WorkQueue", Kind::Bound).leak_ptr();
+    s_system_unbound = try_create("WorkQueueUnbound", Kind::Unbound, 4 * Processor::count()).leak_ptr();
+    VERIFY(s_system && s_system_unbound);
+}
+
+bool WorkQueue::is_initialized()
+{
+    return s_system_unbound;
+}
+
+WorkQueue& WorkQueue::system()
+{
+    return *s_system;
+}
+
+WorkQueue& WorkQueue::system_unbound()
+{
+    return *s_system_unbound;
+}
+
+OwnPtr<WorkQueue> WorkQueue::try_create(String name, Kind kind, u32 max_workers_per_pool)
+{
+    auto queue = adopt_own_if_nonnull(new WorkQueue(move(name), kind, max(max_workers_per_pool, 1u)));
+    if (!queue)
+        return {};
+
+    u32 pool_count = kind == Kind::Bound ? Processor::count() : 1;
+    for (u32 i = 0; i < pool_count; ++i) {
+        auto* pool = new Pool;
+        pool->queue = queue.ptr();
+        if (kind == Kind::Bound)
+            pool->cpu = i;
+        queue->m_pools.append(pool);
+
+        // Every pool starts out with one worker, more come as they block.
+        pool->worker_count = 1;
+        if (!queue->spawn_worker(*pool))
+            return {};
+    }
+    return queue;
+}
+
+WorkQueue::WorkQueue(String name, Kind kind, u32 max_workers_per_pool)
+    : m_name(move(name))
+    , m_kind(kind)
+    , m_max_workers_per_pool(max_workers_per_pool)
+{
+}
+
+WorkQueue::~WorkQueue()
+{
+    m_exiting.store(true);
+    for (auto* pool : m_pools)
+        pool->wait_queue.wake_all();
+
+    // The workers finish what is pending first.
+    for (auto* pool : m_pools) {
+        for (;;) {
+            {
+                ScopedSpinLock lock(pool->lock);
+                if (!pool->worker_count)
+                    break;
+            }
+            pool->wait_queue.wake_all();
+            Scheduler::yield();
+        }
+        delete pool;
+    }
+}
+
+WorkQueue::Pool& WorkQueue::pool_for(u32 cpu)
+{
+    if (m_kind == Kind::Unbound)
+        return *m_pools[0];
+    return *m_pools[cpu < m_pools.size() ? cpu : 0];
+}
+
+bool WorkQueue::queue(WorkItem& item)
+{
+    return queue_in(pool_for(Processor::id()), item);
+}
+
+bool WorkQueue::queue_on(u32 cpu, WorkItem& item)
+{
+    return queue_in(pool_for(cpu), item);
+}
+
+bool WorkQueue::queue_in(Pool& pool, WorkItem& item)
+{
+    VERIFY(!m_exiting.load());
+    if (item.m_pending.exchange(true, Base::MemoryOrder::memory_order_acq_rel))
+        return false;
+
+    ScopedSpinLock lock(pool.lock);
+    pool.pending.append(item);
+    if (pool.idle_count)
+        pool.wait_queue.wake_one();
+    else
+        maybe_add_worker(pool);
+    return true;
+}
+
+bool WorkQueue::queue_delayed(DelayedWorkItem& item, u64 delay_ns)
+{
+    return queue_delayed_on(Processor::id(), item, delay_ns);
+}
+
+bool WorkQueue::queue_delayed_on(u32 cpu, DelayedWorkItem& item, u64 delay_ns)
+{
+    if (item.m_timer.is_armed() || item.m_work.is_pending())
+        return false;
+    item.m_queue = this;
+    item.m_cpu = cpu;
+    DeadlineTimerQueue::current().add(item.m_timer, delay_ns);
+    return true;
+}
+
+bool WorkQueue::cancel(WorkItem& item)
+{
+    for (auto* pool : m_pools) {
+        ScopedSpinLock lock(pool->lock);
+        if (pool->pending.contains(item)) {
+            pool->pending.remove(item);
+            item.m_pending.store(false, Base::MemoryOrder::memory_order_release);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WorkQueue::cancel(DelayedWorkItem& item)
+{
+    if (item.m_timer.cancel())
+        return true;
+    return cancel(item.m_work);
+}
+
+// Called with the pool's lock held, from anywhere, so the thread itself is
+// created in a deferred call.
+void WorkQueue::maybe_add_worker(Pool& pool)
+{
+    u32 wanted_running = pool.cpu.has_value() ? 1 : Processor::count();
+    if (pool.idle_count || pool.running_count >= wanted_running || pool.worker_count >= m_max_workers_per_pool)
+        return;
+
+    pool.worker_count++;
+    Processor::deferred_call_queue([this, &pool] {
+        if (!spawn_worker(pool)) {
+            ScopedSpinLock lock(pool.lock);
+            pool.worker_count--;
+        }
+    });
+}
+
+bool WorkQueue::spawn_worker(Pool& pool)
+{
+    auto* worker = new Worker;
+    if (!worker)
+        return false;
+    worker->pool = &pool;
+
+    {
+        ScopedSpinLock lock(pool.lock);
+        pool.running_count++;
+    }
+
+    auto name = pool.cpu.has_value() ? String::formatted("{} {}", m_name, pool.cpu.value()) : m_name;
+    u32 affinity = pool.cpu.has_value() ? 1u << pool.cpu.value() : THREAD_AFFINITY_DEFAULT;
+    if (!Process::create_kernel_process(worker->thread, move(name), worker_main, worker, affinity)) {
+        ScopedSpinLock lock(pool.lock);
+        pool.running_count--;
+        delete worker;
+        return false;
+    }
+
+    ScopedSpinLock lock(s_workers_lock);
+    s_workers->append(worker);
+    return true;
+}
+
+void WorkQueue::worker_main(void* argument)
+{
+    auto* worker = static_cast<Worker*>(argument);
+    auto& pool = *worker->pool;
+    auto& queue = *pool.queue;
+
+    for (;;) {
+        WorkItem* item = nullptr;
+        bool exit = false;
+        {
+            ScopedSpinLock lock(pool.lock);
+            if (!pool.pending.is_empty()) {
+                item = pool.pending.take_first();
+            } else if (queue.m_exiting.load() || pool.idle_count) {
+                // Workers that were added while others slept go away once
+                // there is nothing left, one idle worker is enough.
+                exit = true;
+                pool.running_count--;
+                pool.worker_count--;
+            } else {
+                pool.running_count--;
+                pool.idle_count++;
+            }
+        }
+
+        if (exit)
+            break;
+
+        if (!item) {
+            // A wake that comes before this is kept by the wait queue.
+            pool.wait_queue.wait_forever("WorkQueue");
+            ScopedSpinLock lock(pool.lock);
+            pool.idle_count--;
+            pool.running_count++;
+            continue;
+        }
+
+        // Cleared first, so the item may queue itself again while it runs.
+        item->m_pending.store(false, Base::MemoryOrder::memory_order_release);
+        item->m_function();
+    }
+
+    {
+        ScopedSpinLock lock(s_workers_lock);
+        s_workers->remove_first_matching([&](auto* other) { return other == worker; });
+    }
+    delete worker;
+}
+
+WorkQueue::BlockingScope::BlockingScope()
+{
+    auto* current = Thread::current();
+    {
+        ScopedSpinLock lock(s_workers_lock);
+        if (!s_workers)
+            return;
+        for (auto* worker : *s_workers) {
+            if (worker->thread == current) {
+                m_worker = worker;
+                break;
+            }
+        }
+    }
+    if (!m_worker)
+        return;
+
+    auto& pool = *m_worker->pool;
+    ScopedSpinLock lock(pool.lock);
+    pool.running_count--;
+    if (pool.pending.is_empty())
+        return;
+    if (pool.idle_count)
+        pool.wait_queue.wake_one();
+    else
+        pool.queue->maybe_add_worker(pool);
+}
+
+WorkQueue::BlockingScope::~BlockingScope()
+{
+    if (!m_worker)
+        return;
+    auto& pool = *m_worker->pool;
+    ScopedSpinLock lock(pool.lock);
+    pool.running_count++;
+}
+
+}
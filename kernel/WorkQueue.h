@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Atomic.h>
+#include <base/Function.h>
+#include <base/IntrusiveList.h>
+#include <base/Optional.h>
+#include <base/OwnPtr.h>
+#include <base/RefPtr.h>
+#include <base/String.h>
+#include <base/Types.h>
+#include <base/Vector.h>
+#include <kernel/SpinLock.h>
+#include <kernel/time/DeadlineTimerQueue.h>
+#include <kernel/WaitQueue.h>
+
+namespace Kernel {
+
+class WorkQueue;
+
+// Runs its function on a worker thread, where it may sleep. Queueing an item
+// that is still pending does nothing, so it runs once however often it was
+// queued before it got to run.
+class WorkItem {
+    BASE_MAKE_NONCOPYABLE(WorkItem);
+    BASE_MAKE_NONMOVABLE(WorkItem);
+
+public:
+    explicit WorkItem(Function<void()> function)
+        : m_function(move(function))
+    {
+    }
+
+    bool is_pending() const { return m_pending.load(Base::MemoryOrder::memory_order_acquire); }
+
+private:
+    friend class WorkQueue;
+
+    IntrusiveListNode<WorkItem> m_list_node;
+    Function<void()> m_function;
+    Atomic<bool> m_pending { false };
+};
+
+// A WorkItem that is queued once a timeout has passed.
+class DelayedWorkItem {
+    BASE_MAKE_NONCOPYABLE(DelayedWorkItem);
+    BASE_MAKE_NONMOVABLE(DelayedWorkItem);
+
+public:
+    explicit DelayedWorkItem(Function<void()> function)
+        : m_work(move(function))
+        , m_timer([this] { m_queue->queue_on(m_cpu, m_work); })
+    {
+    }
+
+    WorkItem& work() { return m_work; }
+
+private:
+    friend class WorkQueue;
+
+    WorkItem m_work;
+    DeadlineTimer m_timer;
+    WorkQueue* m_queue { nullptr };
+    u32 m_cpu { 0 };
+};
+
+// Worker threads that run WorkItems. A bound queue has workers per CPU,
+// pinned to it, and each item runs on the CPU it was queued on. An unbound
+// queue has one pool whose workers run anywhere.
+//
+// A pool keeps one worker busy per CPU it serves. When that worker sleeps
+// inside an item, another one takes over the items behind it, up to
+// max_workers. Items should mark where they sleep with BlockingScope, so
+// that the pool knows about it.
+class WorkQueue {
+    BASE_MAKE_NONCOPYABLE(WorkQueue);
+    BASE_MAKE_NONMOVABLE(WorkQueue);
+
+    struct Worker;
+
+public:
+    enum class Kind {
+        Bound,
+        Unbound,
+    };
+
+    // The system queues, created once the scheduler runs.
+    static void initialize();
+    static bool is_initialized();
+    static WorkQueue& system();
+    static WorkQueue& system_unbound();
+
+    static OwnPtr<WorkQueue> try_create(String name, Kind, u32 max_workers_per_pool = 8);
+
+    ~WorkQueue();
+
+    // Queues on the calling CPU for bound queues. Returns false if it was
+    // already pending.
+    bool queue(WorkItem&);
+    bool queue_on(u32 cpu, WorkItem&);
+    bool queue_delayed(DelayedWorkItem&, u64 delay_ns);
+    bool queue_delayed_on(u32 cpu, DelayedWorkItem&, u64 delay_ns);
+
+    // Takes it off the queue if it hasn't started yet.
+    bool cancel(WorkItem&);
+    bool cancel(DelayedWorkItem&);
+
+    // Worker threads leave the pool's running count while one of these
+    // lives, and another worker is woken or spawned for the pending items.
+    class BlockingScope {
+    public:
+        BlockingScope();
+        ~BlockingScope();
+
+    private:
+        Worker* m_worker { nullptr };
+    };
+
+private:
+    friend class BlockingScope;
+
+    struct Pool {
+        WorkQueue* queue { nullptr };
+        // Bound pools' CPU, unbound ones have none.
+        Optional<u32> cpu;
+        SpinLock<u8> lock;
+        IntrusiveList<WorkItem, RawPtr<WorkItem>, &WorkItem::m_list_node> pending;
+        WaitQueue wait_queue;
+        u32 idle_count { 0 };
+        u32 running_count { 0 };
+        u32 worker_count { 0 };
+    };
+
+    WorkQueue(String name, Kind, u32 max_workers_per_pool);
+
+    Pool& pool_for(u32 cpu);
+    bool queue_in(Pool&, WorkItem&);
+    void maybe_add_worker(Pool&);
+    bool spawn_worker(Pool&);
+    static void worker_main(void*);
+
+    // Every worker of every queue, for BlockingScope to find the current one.
+    static SpinLock<u8> s_workers_lock;
+    static Vector<Worker*>* s_workers;
+
+    String m_name;
+    Kind m_kind;
+    u32 m_max_workers_per_pool;
+    Vector<Pool*> m_pools;
+    Atomic<bool> m_exiting { false };
+};
+
+}
@@ -283,6 +283,62 @@ struct [[gnu::packed]] MADT {
     MADTEntryHeader entries[];
 };
 
+enum class SRATEntryType {
+    ProcessorLocalAPIC = 0x0,
+    Memory = 0x1,
+    ProcessorLocalx2APIC = 0x2,
+};
+
+struct [[gnu::packed]] SRATEntryHeader {
+    u8 type;
+    u8 length;
+};
+
+namespace SRATEntries {
+
+enum class Flags : u32 {
+    Enabled = 1 << 0,
+};
+
+struct [[gnu::packed]] ProcessorLocalAPIC {
+    SRATEntryHeader h;
+    u8 proximity_domain_low;
+    u8 apic_id;
+    u32 flags;
+    u8 local_sapic_eid;
+    u8 proximity_domain_high[3];
+    u32 clock_domain;
+};
+
+struct [[gnu::packed]] Memory {
+    SRATEntryHeader h;
+    u32 proximity_domain;
+    u16 reserved1;
+    u64 base_address;
+    u64 range_length;
+    u32 reserved2;
+    u32 flags;
+    u64 reserved3;
+};
+
+struct [[gnu::packed]] ProcessorLocalx2APIC {
+    SRATEntryHeader h;
+    u16 reserved1;
+    u32 proximity_domain;
+    u32 x2apic_id;
+    u32 flags;
+    u32 clock_domain;
+    u32 reserved2;
+};
+}
+
+struct [[gnu::packed]] SRAT {
+    SDTHeader h;
+    u32 reserved1;
+    u64 reserved2;
+    SRATEntryHeader entries[];
+};
+
 struct [[gnu::packed]] AMLTable {
     SDTHeader h;
     char aml_code[];
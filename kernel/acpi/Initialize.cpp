@@ -6,6 +6,7 @@
 
 // includes
 #include <kernel/acpi/DynamicParser.h>
+#include <kernel/BootProfiler.h>
 #include <kernel/CommandLine.h>
 #include <kernel/Sections.h>
 
@@ -13,6 +14,7 @@ namespace Kernel::ACPI {
 
 UNMAP_AFTER_INIT void initialize()
 {
+    BootPhase phase("ACPI::initialize");
     auto feature_level = kernel_command_line().acpi_feature_level();
     if (feature_level == AcpiFeatureLevel::Disabled)
         return;
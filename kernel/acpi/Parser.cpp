@@ -33,25 +33,23 @@ UNMAP_AFTER_INIT NonnullRefPtr<ACPISysFSComponent> ACPISysFSComponent::create(St
 
 KResultOr<size_t> ACPISysFSComponent::read_bytes(off_t offset, size_t count, UserOrKernelBuffer& buffer, FileDescription*) const
 {
-    auto blob = try_to_generate_buffer();
-    if (!blob)
-        return KResult(EFAULT);
-
-    if ((size_t)offset >= blob->size())
+    if ((size_t)offset >= m_length)
         return KSuccess;
 
-    ssize_t nread = min(static_cast<off_t>(blob->size() - offset), static_cast<off_t>(count));
-    if (!buffer.write(blob->data() + offset, nread))
+    Locker locker(m_mapping_lock);
+    if (!m_mapping.has_value()) {
+        auto mapping = map_typed<u8>(m_paddr, m_length);
+        if (!mapping.region)
+            return KResult(ENOMEM);
+        m_mapping = move(mapping);
+    }
+
+    ssize_t nread = min(static_cast<off_t>(m_length - offset), static_cast<off_t>(count));
+    if (!buffer.write(m_mapping->ptr() + offset, nread))
         return KResult(EFAULT);
     return nread;
 }
 
-OwnPtr<KBuffer> ACPISysFSComponent::try_to_generate_buffer() const
-{
-    auto acpi_blob = map_typed<u8>((m_paddr), m_length);
-    return KBuffer::try_create_with_bytes(Span<u8> { acpi_blob.ptr(), m_length });
-}
-
 UNMAP_AFTER_INIT ACPISysFSComponent::ACPISysFSComponent(String name, PhysicalAddress paddr, size_t table_size)
     : SysFSComponent(name)
     , m_paddr(paddr)
@@ -93,12 +91,56 @@ UNMAP_AFTER_INIT ACPISysFSDirectory::ACPISysFSDirectory()
 
 void Parser::enumerate_static_tables(Function<void(const StringView&, PhysicalAddress, size_t)> callback)
 {
-    for (auto& p_table : m_sdt_pointers) {
-        auto table = map_typed<Structures::SDTHeader>(p_table);
-        callback({ table->sig, 4 }, p_table, table->length);
+    for (auto& table : m_tables)
+        callback({ table.signature, 4 }, table.paddr, table.length);
+}
+
+template<typename Callback>
+static void for_each_srat_entry(PhysicalAddress srat, Callback callback)
+{
+    if (srat.is_null())
+        return;
+    size_t length = map_typed<Structures::SDTHeader>(srat)->length;
+    auto table = map_typed<Structures::SRAT>(srat, length);
+    auto* entry = table->entries;
+    auto* end = (u8 const*)table.ptr() + length;
+    while ((u8 const*)entry + sizeof(Structures::SRATEntryHeader) <= end && entry->length) {
+        callback(*entry);
+        entry = (Structures::SRATEntryHeader*)((u8*)entry + entry->length);
     }
 }
 
+UNMAP_AFTER_INIT void Parser::enumerate_memory_affinity(Function<void(u32, PhysicalAddress, u64)> callback)
+{
+    for_each_srat_entry(find_table("SRAT"), [&](auto& entry) {
+        if (entry.type != (u8)Structures::SRATEntryType::Memory)
+            return;
+        auto& memory = (Structures::SRATEntries::Memory const&)entry;
+        if (!(memory.flags & (u32)Structures::SRATEntries::Flags::Enabled))
+            return;
+        callback(memory.proximity_domain, PhysicalAddress(memory.base_address), memory.range_length);
+    });
+}
+
+UNMAP_AFTER_INIT void Parser::enumerate_processor_affinity(Function<void(u32, u32)> callback)
+{
+    for_each_srat_entry(find_table("SRAT"), [&](auto& entry) {
+        if (entry.type == (u8)Structures::SRATEntryType::ProcessorLocalAPIC) {
+            auto& processor = (Structures::SRATEntries::ProcessorLocalAPIC const&)entry;
+            if (!(processor.flags & (u32)Structures::SRATEntries::Flags::Enabled))
+                return;
+            u32 proximity_domain = processor.proximity_domain_low | (processor.proximity_domain_high[0] << 8)
+                | (processor.proximity_domain_high[1] << 16) | (processor.proximity_domain_high[2] << 24);
+            callback(proximity_domain, processor.apic_id);
+        } else if (entry.type == (u8)Structures::SRATEntryType::ProcessorLocalx2APIC) {
+            auto& processor = (Structures::SRATEntries::ProcessorLocalx2APIC const&)entry;
+            if (!(processor.flags & (u32)Structures::SRATEntries::Flags::Enabled))
+                return;
+            callback(processor.proximity_domain, processor.x2apic_id);
+        }
+    });
+}
+
 void Parser::set_the(Parser& parser)
 {
     VERIFY(!s_acpi_parser);
@@ -115,26 +157,25 @@ UNMAP_AFTER_INIT void Parser::locate_static_data()
     locate_main_system_description_table();
     initialize_main_system_description_table();
     init_fadt();
-    init_facs();
 }
 
-UNMAP_AFTER_INIT PhysicalAddress Parser::find_table(const StringView& signature)
+PhysicalAddress Parser::find_table(const StringView& signature)
 {
     dbgln_if(ACPI_DEBUG, "ACPI: Calling Find Table method!");
-    for (auto p_sdt : m_sdt_pointers) {
-        auto sdt = map_typed<Structures::SDTHeader>(p_sdt);
-        dbgln_if(ACPI_DEBUG, "ACPI: Examining Table @ {}", p_sdt);
-        if (!strncmp(sdt->sig, signature.characters_without_null_termination(), 4)) {
-            dbgln_if(ACPI_DEBUG, "ACPI: Found Table @ {}", p_sdt);
-            return p_sdt;
+    for (auto& table : m_tables) {
+        if (!strncmp(table.signature, signature.characters_without_null_termination(), 4)) {
+            dbgln_if(ACPI_DEBUG, "ACPI: Found Table @ {}", table.paddr);
+            return table.paddr;
         }
     }
     return {};
 }
 
-UNMAP_AFTER_INIT void Parser::init_facs()
+PhysicalAddress Parser::facs()
 {
-    m_facs = find_table("FACS");
+    if (!m_facs.has_value())
+        m_facs = find_table("FACS");
+    return m_facs.value();
 }
 
 UNMAP_AFTER_INIT void Parser::init_fadt()
@@ -308,6 +349,7 @@ UNMAP_AFTER_INIT void Parser::initialize_main_system_description_table()
 
     dmesgln("ACPI: Main Description Table valid? {}", validate_table(*sdt, length));
 
+    Vector<PhysicalAddress> sdt_pointers;
     if (m_xsdt_supported) {
         auto& xsdt = (const Structures::XSDT&)*sdt;
         dmesgln("ACPI: Using XSDT, enumerating tables @ {}", m_main_system_description_table);
@@ -315,7 +357,7 @@ UNMAP_AFTER_INIT void Parser::initialize_main_system_description_table()
         dbgln_if(ACPI_DEBUG, "ACPI: XSDT pointer @ {}", VirtualAddress { &xsdt });
         for (u32 i = 0; i < ((length - sizeof(Structures::SDTHeader)) / sizeof(u64)); i++) {
             dbgln_if(ACPI_DEBUG, "ACPI: Found new table [{0}], @ V{1:p} - P{1:p}", i, &xsdt.table_ptrs[i]);
-            m_sdt_pointers.append(PhysicalAddress(xsdt.table_ptrs[i]));
+            sdt_pointers.append(PhysicalAddress(xsdt.table_ptrs[i]));
         }
     } else {
         auto& rsdt = (const Structures::RSDT&)*sdt;
@@ -324,9 +366,35 @@ UNMAP_AFTER_INIT void Parser::initialize_main_system_description_table()
         dbgln_if(ACPI_DEBUG, "ACPI: RSDT pointer @ V{}", &rsdt);
         for (u32 i = 0; i < ((length - sizeof(Structures::SDTHeader)) / sizeof(u32)); i++) {
             dbgln_if(ACPI_DEBUG, "ACPI: Found new table [{0}], @ V{1:p} - P{1:p}", i, &rsdt.table_ptrs[i]);
-            m_sdt_pointers.append(PhysicalAddress(rsdt.table_ptrs[i]));
+            sdt_pointers.append(PhysicalAddress(rsdt.table_ptrs[i]));
         }
     }
+    read_table_headers(sdt_pointers);
+}
+
+// Firmware mostly packs the tables next to each other, so one mapping of
+// a few pages covers the headers of many, instead of mapping each one.
+UNMAP_AFTER_INIT void Parser::read_table_headers(Vector<PhysicalAddress> const& sdt_pointers)
+{
+    static constexpr size_t window_size = 4 * PAGE_SIZE;
+
+    Optional<TypedMapping<u8>> window;
+    PhysicalPtr window_base = 0;
+    m_tables.ensure_capacity(sdt_pointers.size());
+    for (auto paddr : sdt_pointers) {
+        if (paddr.is_null())
+            continue;
+        if (!window.has_value() || paddr.get() < window_base || paddr.get() + sizeof(Structures::SDTHeader) > window_base + window_size) {
+            window_base = paddr.page_base().get();
+            window = map_typed<u8>(PhysicalAddress(window_base), window_size);
+        }
+
+        auto& header = *reinterpret_cast<Structures::SDTHeader const*>(window->ptr() + (paddr.get() - window_base));
+        TableHeader table { paddr, {}, header.length };
+        __builtin_memcpy(table.signature, header.sig, sizeof(table.signature));
+        dbgln_if(ACPI_DEBUG, "ACPI: Table {} @ {}, length {}", StringView { table.signature, 4 }, paddr, table.length);
+        m_tables.unchecked_append(table);
+    }
 }
 
 UNMAP_AFTER_INIT void Parser::locate_main_system_description_table()
@@ -11,9 +11,11 @@
 #include <kernel/acpi/Definitions.h>
 #include <kernel/acpi/Initialize.h>
 #include <kernel/filesystem/SysFSComponent.h>
+#include <kernel/Lock.h>
 #include <kernel/PhysicalAddress.h>
 #include <kernel/vm/Region.h>
 #include <kernel/VirtualAddress.h>
+#include <kernel/vm/TypedMapping.h>
 
 namespace Kernel::ACPI {
 
@@ -32,11 +34,14 @@ public:
     virtual KResultOr<size_t> read_bytes(off_t, size_t, UserOrKernelBuffer&, FileDescription*) const override;
 
 protected:
-    OwnPtr<KBuffer> try_to_generate_buffer() const;
     ACPISysFSComponent(String name, PhysicalAddress, size_t table_size);
 
     PhysicalAddress m_paddr;
     size_t m_length;
+
+    // Mapped on the first read and kept, reads copy straight out of it.
+    mutable Lock m_mapping_lock;
+    mutable Optional<TypedMapping<u8>> m_mapping;
 };
 
 class Parser {
@@ -57,11 +62,18 @@ public:
     virtual bool can_shutdown() { return false; }
 
     PhysicalAddress rsdp() const { return m_rsdp; }
+    // Looked up on first use, nothing at boot needs it.
+    PhysicalAddress facs();
     PhysicalAddress main_system_description_table() const { return m_main_system_description_table; }
     bool is_xsdt_supported() const { return m_xsdt_supported; }
 
     void enumerate_static_tables(Function<void(const StringView&, PhysicalAddress, size_t)>);
 
+    // The enabled entries of the SRAT, if there is one: which proximity
+    // domain each memory range and each processor (by APIC ID) is in.
+    void enumerate_memory_affinity(Function<void(u32 proximity_domain, PhysicalAddress, u64 length)>);
+    void enumerate_processor_affinity(Function<void(u32 proximity_domain, u32 apic_id)>);
+
     virtual bool have_8042() const
     {
         return m_x86_specific_flags.keyboard_8042;
@@ -87,8 +99,8 @@ private:
     void initialize_main_system_description_table();
     size_t get_table_size(PhysicalAddress);
     u8 get_table_revision(PhysicalAddress);
+    void read_table_headers(Vector<PhysicalAddress> const&);
     void init_fadt();
-    void init_facs();
 
     bool validate_reset_register();
     void access_generic_address(const Structures::GenericAddressStructure&, u32 value);
@@ -96,9 +108,16 @@ private:
     PhysicalAddress m_rsdp;
     PhysicalAddress m_main_system_description_table;
 
-    Vector<PhysicalAddress> m_sdt_pointers;
+    // Signature and length of every table, read once while enumerating
+    // the main SDT, so looking tables up doesn't map them again.
+    struct TableHeader {
+        PhysicalAddress paddr;
+        char signature[4];
+        u32 length;
+    };
+    Vector<TableHeader> m_tables;
     PhysicalAddress m_fadt;
-    PhysicalAddress m_facs;
+    Optional<PhysicalAddress> m_facs;
 
     bool m_xsdt_supported { false };
     FADTFlags::HardwareFeatures m_hardware_flags;
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/EnumBits.h>
+#include <base/Types.h>
+
+// Readiness of a file descriptor registered with an event queue.
+enum class EventQueueEvents : u32 {
+    None = 0,
+    Read = 1 << 0,
+    Write = 1 << 1,
+};
+
+BASE_ENUM_BITWISE_OPERATORS(EventQueueEvents);
+
+enum class EventQueueInterestFlags : u32 {
+    // Level-triggered by default: reported on every wait for as long as
+    // the file descriptor stays ready. Edge-triggered interests are only
+    // reported again once the file changed state.
+    EdgeTriggered = 1 << 0,
+    // Disarmed after one report until modified again.
+    OneShot = 1 << 1,
+};
+
+BASE_ENUM_BITWISE_OPERATORS(EventQueueInterestFlags);
+
+enum class EventQueueControl : u32 {
+    Add = 1,
+    Modify = 2,
+    Remove = 3,
+};
+
+struct EventQueueEvent {
+    EventQueueEvents events;
+    EventQueueInterestFlags flags;
+    // Whatever was registered with the interest, handed back untouched.
+    u64 user_data;
+};
+
+static constexpr u32 event_queue_max_events = 1024;
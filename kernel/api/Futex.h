@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+
+#define FUTEX_WAIT 1
+#define FUTEX_WAKE 2
+// Wakes val waiters on userspace_address and moves up to val2 of the
+// others over to userspace_address2.
+#define FUTEX_REQUEUE 3
+// Like FUTEX_REQUEUE, but only if *userspace_address still is val3.
+#define FUTEX_CMP_REQUEUE 4
+// Applies the operation encoded in val3 to *userspace_address2, wakes val
+// waiters on userspace_address and, if the old value of
+// *userspace_address2 passes the comparison in val3, val2 waiters on it.
+#define FUTEX_WAKE_OP 5
+
+// The futex word holds the owner's thread id, or 0 if unlocked. Waiters
+// lend the owner their priority until it unlocks, which hands the lock
+// straight to the highest priority waiter.
+#define FUTEX_LOCK_PI 6
+#define FUTEX_UNLOCK_PI 7
+#define FUTEX_TRYLOCK_PI 8
+
+// Only wait for and wake waiters whose val3 has bits in common. The
+// timeout is absolute.
+#define FUTEX_WAIT_BITSET 9
+#define FUTEX_WAKE_BITSET 10
+
+// Only shared with threads of the same process, which spares the kernel
+// from looking up what backs the address.
+#define FUTEX_PRIVATE_FLAG (1 << 7)
+#define FUTEX_CLOCK_REALTIME (1 << 8)
+#define FUTEX_CMD_MASK ~(FUTEX_PRIVATE_FLAG | FUTEX_CLOCK_REALTIME)
+
+#define FUTEX_BITSET_MATCH_ANY 0xffffffff
+
+// Bits of a PI futex word.
+#define FUTEX_WAITERS 0x80000000u
+#define FUTEX_OWNER_DIED 0x40000000u
+#define FUTEX_TID_MASK 0x3fffffffu
+
+// Encoding of the val3 of FUTEX_WAKE_OP.
+#define FUTEX_OP_SET 0
+#define FUTEX_OP_ADD 1
+#define FUTEX_OP_OR 2
+#define FUTEX_OP_ANDN 3
+#define FUTEX_OP_XOR 4
+// Use 1 << oparg as the operand.
+#define FUTEX_OP_ARG_SHIFT 8
+
+#define FUTEX_OP_CMP_EQ 0
+#define FUTEX_OP_CMP_NE 1
+#define FUTEX_OP_CMP_LT 2
+#define FUTEX_OP_CMP_LE 3
+#define FUTEX_OP_CMP_GT 4
+#define FUTEX_OP_CMP_GE 5
+
+#define FUTEX_OP(op, oparg, cmp, cmparg) \
+    ((((op)&0xf) << 28) | (((cmp)&0xf) << 24) | (((oparg)&0xfff) << 12) | ((cmparg)&0xfff))
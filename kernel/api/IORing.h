@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+
+// A submission and a completion ring shared between a process and the
+// kernel. io_ring_setup() returns a file descriptor, mmap() it with
+// MAP_SHARED to get an IORingHeader followed by the submission entries
+// at submission_offset and the completion entries at completion_offset.
+//
+// Userland fills submissions and advances submission.tail, the kernel
+// consumes them up to it on io_ring_enter(). The kernel appends
+// completions and advances completion.tail, userland reaps them and
+// advances completion.head. Each side only ever writes its own index,
+// with release semantics, and reads the other one with acquire.
+enum class IORingOpcode : u8 {
+    Nop = 0,
+    // fd, address, length, offset (-1 for the current file offset).
+    Read = 1,
+    Write = 2,
+    // address points to a Syscall::SC_open_params, the result is the fd.
+    Open = 3,
+    // fd.
+    Close = 4,
+    // address points to a Syscall::SC_accept4_params, the result is the fd.
+    Accept = 5,
+};
+
+struct IORingSubmission {
+    IORingOpcode opcode;
+    u8 reserved[3];
+    i32 fd;
+    u64 address;
+    u64 length;
+    i64 offset;
+    // Handed back untouched in the completion.
+    u64 user_data;
+};
+
+static_assert(sizeof(IORingSubmission) == 40);
+
+struct IORingCompletion {
+    u64 user_data;
+    // What the equivalent syscall would have returned, negative errno
+    // values on failure.
+    i64 result;
+};
+
+static_assert(sizeof(IORingCompletion) == 16);
+
+struct IORingIndices {
+    volatile u32 head;
+    volatile u32 tail;
+    u32 entries;
+    u32 reserved;
+};
+
+struct IORingHeader {
+    IORingIndices submission;
+    IORingIndices completion;
+    u32 submission_offset;
+    u32 completion_offset;
+    u32 size;
+    u32 reserved;
+};
+
+static constexpr u32 io_ring_max_entries = 4096;
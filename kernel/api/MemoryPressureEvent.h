@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/EnumBits.h>
+#include <base/Types.h>
+
+// Read from a memory pressure watcher, one for every change of the level.
+// The levels follow the watermarks the kernel reclaims memory by.
+struct [[gnu::packed]] MemoryPressureEvent {
+    enum class Level : u32 {
+        // Free memory is above the high watermark.
+        None = 0,
+        // Below the high watermark, the kernel will reclaim memory soon.
+        Low = 1,
+        // Still below the low watermark after reclaiming.
+        Medium = 2,
+        // Below half the low watermark, allocations are about to fail.
+        Critical = 3,
+    };
+
+    Level level { Level::None };
+    u64 free_pages { 0 };
+    u64 total_pages { 0 };
+};
+
+enum class MemoryPressureWatcherFlags : u32 {
+    None = 0,
+    Nonblock = 1 << 0,
+    CloseOnExec = 1 << 1,
+};
+
+BASE_ENUM_BITWISE_OPERATORS(MemoryPressureWatcherFlags);
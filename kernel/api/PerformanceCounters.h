@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+
+enum class PerformanceCounterEvent : u32 {
+    Cycles = 0,
+    Instructions,
+    LLCMisses,
+    BranchMisses,
+    __Count,
+};
+
+static constexpr size_t performance_counter_event_count = static_cast<size_t>(PerformanceCounterEvent::__Count);
+
+enum class PerformanceCounterScope : u32 {
+    // Only what the calling thread ran.
+    Thread = 0,
+    // Everything every CPU ran since boot, for the superuser only.
+    System = 1,
+};
+
+struct PerformanceCounterValues {
+    // Bit n is set if the CPU can count PerformanceCounterEvent n, the
+    // values of the others are always 0.
+    u32 available_events;
+    u32 reserved;
+    u64 values[performance_counter_event_count];
+};
@@ -11,6 +11,7 @@
 #include <base/Userspace.h>
 
 #ifdef __pranaos__
+#    include <kernel/api/TimePage.h>
 #    include <libc/fd_set.h>
 #endif
 
@@ -34,159 +35,170 @@ enum class NeedsBigProcessLock {
     No
 };
 
-#define ENUMERATE_SYSCALLS(S)                               \
-    S(yield, NeedsBigProcessLock::No)                       \
-    S(open, NeedsBigProcessLock::Yes)                       \
-    S(close, NeedsBigProcessLock::Yes)                      \
-    S(read, NeedsBigProcessLock::Yes)                       \
-    S(lseek, NeedsBigProcessLock::Yes)                      \
-    S(kill, NeedsBigProcessLock::Yes)                       \
-    S(getuid, NeedsBigProcessLock::Yes)                     \
-    S(exit, NeedsBigProcessLock::Yes)                       \
-    S(geteuid, NeedsBigProcessLock::Yes)                    \
-    S(getegid, NeedsBigProcessLock::Yes)                    \
-    S(getgid, NeedsBigProcessLock::Yes)                     \
-    S(getpid, NeedsBigProcessLock::No)                      \
-    S(getppid, NeedsBigProcessLock::Yes)                    \
-    S(getresuid, NeedsBigProcessLock::Yes)                  \
-    S(getresgid, NeedsBigProcessLock::Yes)                  \
-    S(waitid, NeedsBigProcessLock::Yes)                     \
-    S(mmap, NeedsBigProcessLock::Yes)                       \
-    S(munmap, NeedsBigProcessLock::Yes)                     \
-    S(get_dir_entries, NeedsBigProcessLock::Yes)            \
-    S(getcwd, NeedsBigProcessLock::Yes)                     \
-    S(gettimeofday, NeedsBigProcessLock::Yes)               \
-    S(gethostname, NeedsBigProcessLock::No)                 \
-    S(sethostname, NeedsBigProcessLock::No)                 \
-    S(chdir, NeedsBigProcessLock::Yes)                      \
-    S(uname, NeedsBigProcessLock::No)                       \
-    S(set_mmap_name, NeedsBigProcessLock::Yes)              \
-    S(readlink, NeedsBigProcessLock::Yes)                   \
-    S(write, NeedsBigProcessLock::Yes)                      \
-    S(ttyname, NeedsBigProcessLock::Yes)                    \
-    S(stat, NeedsBigProcessLock::Yes)                       \
-    S(getsid, NeedsBigProcessLock::Yes)                     \
-    S(setsid, NeedsBigProcessLock::Yes)                     \
-    S(getpgid, NeedsBigProcessLock::Yes)                    \
-    S(setpgid, NeedsBigProcessLock::Yes)                    \
-    S(getpgrp, NeedsBigProcessLock::Yes)                    \
-    S(fork, NeedsBigProcessLock::Yes)                       \
-    S(execve, NeedsBigProcessLock::Yes)                     \
-    S(dup2, NeedsBigProcessLock::Yes)                       \
-    S(sigaction, NeedsBigProcessLock::Yes)                  \
-    S(umask, NeedsBigProcessLock::Yes)                      \
-    S(getgroups, NeedsBigProcessLock::Yes)                  \
-    S(setgroups, NeedsBigProcessLock::Yes)                  \
-    S(sigreturn, NeedsBigProcessLock::Yes)                  \
-    S(sigprocmask, NeedsBigProcessLock::Yes)                \
-    S(sigpending, NeedsBigProcessLock::Yes)                 \
-    S(pipe, NeedsBigProcessLock::Yes)                       \
-    S(killpg, NeedsBigProcessLock::Yes)                     \
-    S(seteuid, NeedsBigProcessLock::Yes)                    \
-    S(setegid, NeedsBigProcessLock::Yes)                    \
-    S(setuid, NeedsBigProcessLock::Yes)                     \
-    S(setgid, NeedsBigProcessLock::Yes)                     \
-    S(setreuid, NeedsBigProcessLock::Yes)                   \
-    S(setresuid, NeedsBigProcessLock::Yes)                  \
-    S(setresgid, NeedsBigProcessLock::Yes)                  \
-    S(alarm, NeedsBigProcessLock::Yes)                      \
-    S(fstat, NeedsBigProcessLock::Yes)                      \
-    S(access, NeedsBigProcessLock::Yes)                     \
-    S(fcntl, NeedsBigProcessLock::Yes)                      \
-    S(ioctl, NeedsBigProcessLock::Yes)                      \
-    S(mkdir, NeedsBigProcessLock::Yes)                      \
-    S(times, NeedsBigProcessLock::Yes)                      \
-    S(utime, NeedsBigProcessLock::Yes)                      \
-    S(sync, NeedsBigProcessLock::Yes)                       \
-    S(ptsname, NeedsBigProcessLock::Yes)                    \
-    S(select, NeedsBigProcessLock::Yes)                     \
-    S(unlink, NeedsBigProcessLock::Yes)                     \
-    S(poll, NeedsBigProcessLock::Yes)                       \
-    S(rmdir, NeedsBigProcessLock::Yes)                      \
-    S(chmod, NeedsBigProcessLock::Yes)                      \
-    S(socket, NeedsBigProcessLock::Yes)                     \
-    S(bind, NeedsBigProcessLock::Yes)                       \
-    S(accept4, NeedsBigProcessLock::Yes)                    \
-    S(listen, NeedsBigProcessLock::Yes)                     \
-    S(connect, NeedsBigProcessLock::Yes)                    \
-    S(link, NeedsBigProcessLock::Yes)                       \
-    S(chown, NeedsBigProcessLock::Yes)                      \
-    S(fchmod, NeedsBigProcessLock::Yes)                     \
-    S(symlink, NeedsBigProcessLock::Yes)                    \
-    S(sendmsg, NeedsBigProcessLock::Yes)                    \
-    S(recvmsg, NeedsBigProcessLock::Yes)                    \
-    S(getsockopt, NeedsBigProcessLock::Yes)                 \
-    S(setsockopt, NeedsBigProcessLock::Yes)                 \
-    S(create_thread, NeedsBigProcessLock::Yes)              \
-    S(gettid, NeedsBigProcessLock::No)                      \
-    S(rename, NeedsBigProcessLock::Yes)                     \
-    S(ftruncate, NeedsBigProcessLock::Yes)                  \
-    S(exit_thread, NeedsBigProcessLock::Yes)                \
-    S(mknod, NeedsBigProcessLock::Yes)                      \
-    S(writev, NeedsBigProcessLock::Yes)                     \
-    S(beep, NeedsBigProcessLock::Yes)                       \
-    S(getsockname, NeedsBigProcessLock::Yes)                \
-    S(getpeername, NeedsBigProcessLock::Yes)                \
-    S(socketpair, NeedsBigProcessLock::Yes)                 \
-    S(sched_setparam, NeedsBigProcessLock::Yes)             \
-    S(sched_getparam, NeedsBigProcessLock::Yes)             \
-    S(fchown, NeedsBigProcessLock::Yes)                     \
-    S(halt, NeedsBigProcessLock::Yes)                       \
-    S(reboot, NeedsBigProcessLock::Yes)                     \
-    S(mount, NeedsBigProcessLock::Yes)                      \
-    S(umount, NeedsBigProcessLock::Yes)                     \
-    S(dump_backtrace, NeedsBigProcessLock::Yes)             \
-    S(dbgputch, NeedsBigProcessLock::Yes)                   \
-    S(dbgputstr, NeedsBigProcessLock::Yes)                  \
-    S(create_inode_watcher, NeedsBigProcessLock::Yes)       \
-    S(inode_watcher_add_watch, NeedsBigProcessLock::Yes)    \
-    S(inode_watcher_remove_watch, NeedsBigProcessLock::Yes) \
-    S(mprotect, NeedsBigProcessLock::Yes)                   \
-    S(realpath, NeedsBigProcessLock::Yes)                   \
-    S(get_process_name, NeedsBigProcessLock::Yes)           \
-    S(fchdir, NeedsBigProcessLock::Yes)                     \
-    S(getrandom, NeedsBigProcessLock::Yes)                  \
-    S(getkeymap, NeedsBigProcessLock::Yes)                  \
-    S(setkeymap, NeedsBigProcessLock::Yes)                  \
-    S(clock_gettime, NeedsBigProcessLock::Yes)              \
-    S(clock_settime, NeedsBigProcessLock::Yes)              \
-    S(clock_nanosleep, NeedsBigProcessLock::Yes)            \
-    S(join_thread, NeedsBigProcessLock::Yes)                \
-    S(module_load, NeedsBigProcessLock::Yes)                \
-    S(module_unload, NeedsBigProcessLock::Yes)              \
-    S(detach_thread, NeedsBigProcessLock::Yes)              \
-    S(set_thread_name, NeedsBigProcessLock::Yes)            \
-    S(get_thread_name, NeedsBigProcessLock::Yes)            \
-    S(madvise, NeedsBigProcessLock::Yes)                    \
-    S(purge, NeedsBigProcessLock::Yes)                      \
-    S(profiling_enable, NeedsBigProcessLock::Yes)           \
-    S(profiling_disable, NeedsBigProcessLock::Yes)          \
-    S(profiling_free_buffer, NeedsBigProcessLock::Yes)      \
-    S(futex, NeedsBigProcessLock::Yes)                      \
-    S(chroot, NeedsBigProcessLock::Yes)                     \
-    S(pledge, NeedsBigProcessLock::Yes)                     \
-    S(unveil, NeedsBigProcessLock::Yes)                     \
-    S(perf_event, NeedsBigProcessLock::Yes)                 \
-    S(shutdown, NeedsBigProcessLock::Yes)                   \
-    S(get_stack_bounds, NeedsBigProcessLock::Yes)           \
-    S(ptrace, NeedsBigProcessLock::Yes)                     \
-    S(sendfd, NeedsBigProcessLock::Yes)                     \
-    S(recvfd, NeedsBigProcessLock::Yes)                     \
-    S(sysconf, NeedsBigProcessLock::Yes)                    \
-    S(set_process_name, NeedsBigProcessLock::Yes)           \
-    S(disown, NeedsBigProcessLock::Yes)                     \
-    S(adjtime, NeedsBigProcessLock::Yes)                    \
-    S(allocate_tls, NeedsBigProcessLock::Yes)               \
-    S(prctl, NeedsBigProcessLock::Yes)                      \
-    S(mremap, NeedsBigProcessLock::Yes)                     \
-    S(set_coredump_metadata, NeedsBigProcessLock::Yes)      \
-    S(anon_create, NeedsBigProcessLock::Yes)                \
-    S(msyscall, NeedsBigProcessLock::Yes)                   \
-    S(readv, NeedsBigProcessLock::Yes)                      \
-    S(emuctl, NeedsBigProcessLock::Yes)                     \
-    S(statvfs, NeedsBigProcessLock::Yes)                    \
-    S(fstatvfs, NeedsBigProcessLock::Yes)                   \
-    S(kill_thread, NeedsBigProcessLock::Yes)
+#define ENUMERATE_SYSCALLS(S)                                   \
+    S(yield, NeedsBigProcessLock::No)                           \
+    S(open, NeedsBigProcessLock::Yes)                           \
+    S(close, NeedsBigProcessLock::Yes)                          \
+    S(read, NeedsBigProcessLock::Yes)                           \
+    S(lseek, NeedsBigProcessLock::Yes)                          \
+    S(kill, NeedsBigProcessLock::Yes)                           \
+    S(getuid, NeedsBigProcessLock::Yes)                         \
+    S(exit, NeedsBigProcessLock::Yes)                           \
+    S(geteuid, NeedsBigProcessLock::Yes)                        \
+    S(getegid, NeedsBigProcessLock::Yes)                        \
+    S(getgid, NeedsBigProcessLock::Yes)                         \
+    S(getpid, NeedsBigProcessLock::No)                          \
+    S(getppid, NeedsBigProcessLock::Yes)                        \
+    S(getresuid, NeedsBigProcessLock::Yes)                      \
+    S(getresgid, NeedsBigProcessLock::Yes)                      \
+    S(waitid, NeedsBigProcessLock::Yes)                         \
+    S(mmap, NeedsBigProcessLock::Yes)                           \
+    S(munmap, NeedsBigProcessLock::Yes)                         \
+    S(get_dir_entries, NeedsBigProcessLock::Yes)                \
+    S(getcwd, NeedsBigProcessLock::Yes)                         \
+    S(gettimeofday, NeedsBigProcessLock::Yes)                   \
+    S(gethostname, NeedsBigProcessLock::No)                     \
+    S(sethostname, NeedsBigProcessLock::No)                     \
+    S(chdir, NeedsBigProcessLock::Yes)                          \
+    S(uname, NeedsBigProcessLock::No)                           \
+    S(set_mmap_name, NeedsBigProcessLock::Yes)                  \
+    S(readlink, NeedsBigProcessLock::Yes)                       \
+    S(write, NeedsBigProcessLock::Yes)                          \
+    S(ttyname, NeedsBigProcessLock::Yes)                        \
+    S(stat, NeedsBigProcessLock::Yes)                           \
+    S(getsid, NeedsBigProcessLock::Yes)                         \
+    S(setsid, NeedsBigProcessLock::Yes)                         \
+    S(getpgid, NeedsBigProcessLock::Yes)                        \
+    S(setpgid, NeedsBigProcessLock::Yes)                        \
+    S(getpgrp, NeedsBigProcessLock::Yes)                        \
+    S(fork, NeedsBigProcessLock::Yes)                           \
+    S(execve, NeedsBigProcessLock::Yes)                         \
+    S(dup2, NeedsBigProcessLock::Yes)                           \
+    S(sigaction, NeedsBigProcessLock::Yes)                      \
+    S(umask, NeedsBigProcessLock::Yes)                          \
+    S(getgroups, NeedsBigProcessLock::Yes)                      \
+    S(setgroups, NeedsBigProcessLock::Yes)                      \
+    S(sigreturn, NeedsBigProcessLock::Yes)                      \
+    S(sigprocmask, NeedsBigProcessLock::Yes)                    \
+    S(sigpending, NeedsBigProcessLock::Yes)                     \
+    S(pipe, NeedsBigProcessLock::Yes)                           \
+    S(killpg, NeedsBigProcessLock::Yes)                         \
+    S(seteuid, NeedsBigProcessLock::Yes)                        \
+    S(setegid, NeedsBigProcessLock::Yes)                        \
+    S(setuid, NeedsBigProcessLock::Yes)                         \
+    S(setgid, NeedsBigProcessLock::Yes)                         \
+    S(setreuid, NeedsBigProcessLock::Yes)                       \
+    S(setresuid, NeedsBigProcessLock::Yes)                      \
+    S(setresgid, NeedsBigProcessLock::Yes)                      \
+    S(alarm, NeedsBigProcessLock::Yes)                          \
+    S(fstat, NeedsBigProcessLock::Yes)                          \
+    S(access, NeedsBigProcessLock::Yes)                         \
+    S(fcntl, NeedsBigProcessLock::Yes)                          \
+    S(ioctl, NeedsBigProcessLock::Yes)                          \
+    S(mkdir, NeedsBigProcessLock::Yes)                          \
+    S(times, NeedsBigProcessLock::Yes)                          \
+    S(utime, NeedsBigProcessLock::Yes)                          \
+    S(sync, NeedsBigProcessLock::Yes)                           \
+    S(ptsname, NeedsBigProcessLock::Yes)                        \
+    S(select, NeedsBigProcessLock::Yes)                         \
+    S(unlink, NeedsBigProcessLock::Yes)                         \
+    S(poll, NeedsBigProcessLock::Yes)                           \
+    S(rmdir, NeedsBigProcessLock::Yes)                          \
+    S(chmod, NeedsBigProcessLock::Yes)                          \
+    S(socket, NeedsBigProcessLock::Yes)                         \
+    S(bind, NeedsBigProcessLock::Yes)                           \
+    S(accept4, NeedsBigProcessLock::Yes)                        \
+    S(listen, NeedsBigProcessLock::Yes)                         \
+    S(connect, NeedsBigProcessLock::Yes)                        \
+    S(link, NeedsBigProcessLock::Yes)                           \
+    S(chown, NeedsBigProcessLock::Yes)                          \
+    S(fchmod, NeedsBigProcessLock::Yes)                         \
+    S(symlink, NeedsBigProcessLock::Yes)                        \
+    S(sendmsg, NeedsBigProcessLock::Yes)                        \
+    S(recvmsg, NeedsBigProcessLock::Yes)                        \
+    S(getsockopt, NeedsBigProcessLock::Yes)                     \
+    S(setsockopt, NeedsBigProcessLock::Yes)                     \
+    S(create_thread, NeedsBigProcessLock::Yes)                  \
+    S(gettid, NeedsBigProcessLock::No)                          \
+    S(rename, NeedsBigProcessLock::Yes)                         \
+    S(ftruncate, NeedsBigProcessLock::Yes)                      \
+    S(exit_thread, NeedsBigProcessLock::Yes)                    \
+    S(mknod, NeedsBigProcessLock::Yes)                          \
+    S(writev, NeedsBigProcessLock::Yes)                         \
+    S(beep, NeedsBigProcessLock::Yes)                           \
+    S(getsockname, NeedsBigProcessLock::Yes)                    \
+    S(getpeername, NeedsBigProcessLock::Yes)                    \
+    S(socketpair, NeedsBigProcessLock::Yes)                     \
+    S(sched_setparam, NeedsBigProcessLock::Yes)                 \
+    S(sched_getparam, NeedsBigProcessLock::Yes)                 \
+    S(fchown, NeedsBigProcessLock::Yes)                         \
+    S(halt, NeedsBigProcessLock::Yes)                           \
+    S(reboot, NeedsBigProcessLock::Yes)                         \
+    S(mount, NeedsBigProcessLock::Yes)                          \
+    S(umount, NeedsBigProcessLock::Yes)                         \
+    S(dump_backtrace, NeedsBigProcessLock::Yes)                 \
+    S(dbgputch, NeedsBigProcessLock::Yes)                       \
+    S(dbgputstr, NeedsBigProcessLock::Yes)                      \
+    S(create_inode_watcher, NeedsBigProcessLock::Yes)           \
+    S(inode_watcher_add_watch, NeedsBigProcessLock::Yes)        \
+    S(inode_watcher_remove_watch, NeedsBigProcessLock::Yes)     \
+    S(mprotect, NeedsBigProcessLock::Yes)                       \
+    S(realpath, NeedsBigProcessLock::Yes)                       \
+    S(get_process_name, NeedsBigProcessLock::Yes)               \
+    S(fchdir, NeedsBigProcessLock::Yes)                         \
+    S(getrandom, NeedsBigProcessLock::Yes)                      \
+    S(getkeymap, NeedsBigProcessLock::Yes)                      \
+    S(setkeymap, NeedsBigProcessLock::Yes)                      \
+    S(clock_gettime, NeedsBigProcessLock::Yes)                  \
+    S(clock_settime, NeedsBigProcessLock::Yes)                  \
+    S(clock_nanosleep, NeedsBigProcessLock::Yes)                \
+    S(join_thread, NeedsBigProcessLock::Yes)                    \
+    S(module_load, NeedsBigProcessLock::Yes)                    \
+    S(module_unload, NeedsBigProcessLock::Yes)                  \
+    S(detach_thread, NeedsBigProcessLock::Yes)                  \
+    S(set_thread_name, NeedsBigProcessLock::Yes)                \
+    S(get_thread_name, NeedsBigProcessLock::Yes)                \
+    S(madvise, NeedsBigProcessLock::Yes)                        \
+    S(purge, NeedsBigProcessLock::Yes)                          \
+    S(profiling_enable, NeedsBigProcessLock::Yes)               \
+    S(profiling_disable, NeedsBigProcessLock::Yes)              \
+    S(profiling_free_buffer, NeedsBigProcessLock::Yes)          \
+    S(futex, NeedsBigProcessLock::Yes)                          \
+    S(chroot, NeedsBigProcessLock::Yes)                         \
+    S(pledge, NeedsBigProcessLock::Yes)                         \
+    S(unveil, NeedsBigProcessLock::Yes)                         \
+    S(perf_event, NeedsBigProcessLock::Yes)                     \
+    S(shutdown, NeedsBigProcessLock::Yes)                       \
+    S(get_stack_bounds, NeedsBigProcessLock::Yes)               \
+    S(ptrace, NeedsBigProcessLock::Yes)                         \
+    S(sendfd, NeedsBigProcessLock::Yes)                         \
+    S(recvfd, NeedsBigProcessLock::Yes)                         \
+    S(sysconf, NeedsBigProcessLock::Yes)                        \
+    S(set_process_name, NeedsBigProcessLock::Yes)               \
+    S(disown, NeedsBigProcessLock::Yes)                         \
+    S(adjtime, NeedsBigProcessLock::Yes)                        \
+    S(allocate_tls, NeedsBigProcessLock::Yes)                   \
+    S(prctl, NeedsBigProcessLock::Yes)                          \
+    S(mremap, NeedsBigProcessLock::Yes)                         \
+    S(set_coredump_metadata, NeedsBigProcessLock::Yes)          \
+    S(anon_create, NeedsBigProcessLock::Yes)                    \
+    S(msyscall, NeedsBigProcessLock::Yes)                       \
+    S(readv, NeedsBigProcessLock::Yes)                          \
+    S(emuctl, NeedsBigProcessLock::Yes)                         \
+    S(statvfs, NeedsBigProcessLock::Yes)                        \
+    S(fstatvfs, NeedsBigProcessLock::Yes)                       \
+    S(kill_thread, NeedsBigProcessLock::Yes)                    \
+    S(create_memory_pressure_watcher, NeedsBigProcessLock::Yes) \
+    S(io_ring_setup, NeedsBigProcessLock::Yes)                  \
+    S(io_ring_enter, NeedsBigProcessLock::Yes)                  \
+    S(event_queue_create, NeedsBigProcessLock::Yes)             \
+    S(event_queue_ctl, NeedsBigProcessLock::Yes)                \
+    S(event_queue_wait, NeedsBigProcessLock::Yes)               \
+    S(perf_counters_read, NeedsBigProcessLock::No)              \
+    S(trace_buffer_open, NeedsBigProcessLock::Yes)              \
+    S(set_thread_affinity, NeedsBigProcessLock::No)             \
+    S(get_thread_affinity, NeedsBigProcessLock::No)             \
+    S(swapon, NeedsBigProcessLock::Yes)
 
 namespace Syscall {
 
@@ -271,6 +283,22 @@ struct SC_poll_params {
     const u32* sigmask;
 };
 
+struct SC_event_queue_ctl_params {
+    int queue_fd;
+    u32 control;
+    int fd;
+    // An EventQueueEvent with the events and flags to watch for.
+    const void* event;
+};
+
+struct SC_event_queue_wait_params {
+    int queue_fd;
+    // Room for max_events EventQueueEvents.
+    void* events;
+    unsigned max_events;
+    const struct timespec* timeout;
+};
+
 struct SC_clock_nanosleep_params {
     int clock_id;
     int flags;
@@ -476,8 +504,41 @@ struct SC_statvfs_params {
 void initialize();
 int sync();
 
+#    if ARCH(I386)
+// Set by the kernel once every processor takes SYSENTER.
+inline bool fast_syscall_available()
+{
+    return reinterpret_cast<TimePage const*>(time_page_address)->fast_syscall;
+}
+
+// SYSENTER takes the return address in edx and the stack pointer in ecx,
+// the first two arguments go in edi and ebp instead, see
+// kernel/arch/x86/FastSyscall.h. The kernel leaves everything but eax,
+// edx and ecx as it was, except ebp, which is saved here.
+inline uintptr_t fast_invoke(Function function, uintptr_t arg1 = 0, uintptr_t arg2 = 0, uintptr_t arg3 = 0, uintptr_t arg4 = 0)
+{
+    uintptr_t result;
+    asm volatile("push %%ebp\n"
+                 "mov %%ecx, %%ebp\n"
+                 "mov %%esp, %%ecx\n"
+                 "call 0f\n"
+                 "0: pop %%edx\n"
+                 "add $1f-0b, %%edx\n"
+                 "sysenter\n"
+                 "1: pop %%ebp\n"
+                 : "=a"(result), "+c"(arg2)
+                 : "a"(function), "D"(arg1), "b"(arg3), "S"(arg4)
+                 : "edx", "memory");
+    return result;
+}
+#    endif
+
 inline uintptr_t invoke(Function function)
 {
+#    if ARCH(I386)
+    if (fast_syscall_available())
+        return fast_invoke(function);
+#    endif
     uintptr_t result;
     asm volatile("int $0x82"
                  : "=a"(result)
@@ -489,6 +550,10 @@ inline uintptr_t invoke(Function function)
 template<typename T1>
 inline uintptr_t invoke(Function function, T1 arg1)
 {
+#    if ARCH(I386)
+    if (fast_syscall_available())
+        return fast_invoke(function, (uintptr_t)arg1);
+#    endif
     uintptr_t result;
     asm volatile("int $0x82"
                  : "=a"(result)
@@ -500,6 +565,10 @@ inline uintptr_t invoke(Function function, T1 arg1)
 template<typename T1, typename T2>
 inline uintptr_t invoke(Function function, T1 arg1, T2 arg2)
 {
+#    if ARCH(I386)
+    if (fast_syscall_available())
+        return fast_invoke(function, (uintptr_t)arg1, (uintptr_t)arg2);
+#    endif
     uintptr_t result;
     asm volatile("int $0x82"
                  : "=a"(result)
@@ -511,6 +580,10 @@ inline uintptr_t invoke(Function function, T1 arg1, T2 arg2)
 template<typename T1, typename T2, typename T3>
 inline uintptr_t invoke(Function function, T1 arg1, T2 arg2, T3 arg3)
 {
+#    if ARCH(I386)
+    if (fast_syscall_available())
+        return fast_invoke(function, (uintptr_t)arg1, (uintptr_t)arg2, (uintptr_t)arg3);
+#    endif
     uintptr_t result;
     asm volatile("int $0x82"
                  : "=a"(result)
@@ -522,6 +595,10 @@ inline uintptr_t invoke(Function function, T1 arg1, T2 arg2, T3 arg3)
 template<typename T1, typename T2, typename T3, typename T4>
 inline uintptr_t invoke(Function function, T1 arg1, T2 arg2, T3 arg3, T4 arg4)
 {
+#    if ARCH(I386)
+    if (fast_syscall_available())
+        return fast_invoke(function, (uintptr_t)arg1, (uintptr_t)arg2, (uintptr_t)arg3, (uintptr_t)arg4);
+#    endif
     uintptr_t result;
     asm volatile("int $0x82"
                  : "=a"(result)
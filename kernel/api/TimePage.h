@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+
+// Mapped read-only at time_page_address into every address space, so the
+// clocks can be read without a syscall.
+//
+// The kernel bumps sequence to an odd value before it rewrites the page
+// and back to an even one after. A reader copies the page out and
+// retries if the sequence was odd or changed meanwhile.
+struct TimePage {
+    volatile u32 sequence;
+
+    // Set if the TSC ticks at a constant rate on every processor, the
+    // clocks are then extrapolated from tsc_at_update on read. Otherwise
+    // readers only get the time of the last update.
+    u32 tsc_usable;
+    u32 tsc_to_ns_multiplier;
+    u32 tsc_to_ns_shift;
+    u64 tsc_at_update;
+
+    // CLOCK_MONOTONIC at the last update, and what to add to it for
+    // CLOCK_REALTIME.
+    u64 monotonic_ns;
+    i64 realtime_offset_ns;
+
+    // Not a clock, but every process has this page mapped already. Set
+    // once every processor takes syscalls through SYSENTER, see
+    // Syscall::invoke().
+    u32 fast_syscall;
+
+    // Base::CPUFeatures of the boot processor, read by Base::cpu_features()
+    // so userland doesn't run cpuid for itself.
+    u32 cpu_features;
+};
+
+static constexpr FlatPtr time_page_address = 0x00800000;
+
+// The nanoseconds since the last update for tsc ticks.
+inline u64 time_page_tsc_delta_to_ns(TimePage const& page, u64 tsc)
+{
+    return ((tsc - page.tsc_at_update) * page.tsc_to_ns_multiplier) >> page.tsc_to_ns_shift;
+}
+
+inline u64 time_page_read_tsc()
+{
+    u32 lsw;
+    u32 msw;
+    asm volatile("rdtsc"
+                 : "=d"(msw), "=a"(lsw));
+    return ((u64)msw << 32) | lsw;
+}
+
+// CLOCK_MONOTONIC and what to add to it for CLOCK_REALTIME, as of one
+// version of the page. Extrapolated with the TSC if asked to and it is
+// usable, the time of the last update otherwise.
+inline void time_page_read(TimePage const& page, bool extrapolate, u64& monotonic_ns, i64& realtime_offset_ns)
+{
+    for (;;) {
+        u32 sequence = __atomic_load_n(&page.sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1) {
+            asm volatile("pause");
+            continue;
+        }
+
+        monotonic_ns = page.monotonic_ns;
+        if (extrapolate && page.tsc_usable)
+            monotonic_ns += time_page_tsc_delta_to_ns(page, time_page_read_tsc());
+        realtime_offset_ns = page.realtime_offset_ns;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page.sequence, __ATOMIC_RELAXED) == sequence)
+            return;
+    }
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+
+enum class TraceEvent : u16 {
+    // args: faulting address, fault code, response.
+    PageFault = 0,
+    // args: address, requested size.
+    Kmalloc,
+    // args: address.
+    Kfree,
+    // args: target processor (or ~0 for a broadcast), message type.
+    SMPMessage,
+    // args: controller, transfer type, length.
+    USBTransfer,
+    __Count,
+};
+
+static constexpr u32 trace_event_count = static_cast<u32>(TraceEvent::__Count);
+
+// trace_buffer_open() returns a file descriptor, mmap() it read-only to get
+// a TraceBufferHeader followed by one ring per processor, ring_stride bytes
+// apart starting at ring_offset. Each ring is a TraceRingHeader followed
+// by entries_per_ring records.
+//
+// The kernel never waits for readers, it overwrites the oldest records.
+// Record n of a ring lives in slot n % entries_per_ring and has n as its
+// sequence once complete. Readers copy a record out and check its
+// sequence before and after, a mismatch means it was overwritten and the
+// reader fell behind.
+struct TraceRecord {
+    volatile u64 sequence;
+    u64 timestamp;
+    TraceEvent event;
+    u16 processor;
+    u32 tid;
+    u64 args[3];
+};
+
+static_assert(sizeof(TraceRecord) == 48);
+
+struct TraceRingHeader {
+    // Sequence of the next record to be written.
+    volatile u64 head;
+    u64 reserved[7];
+};
+
+struct TraceBufferHeader {
+    u32 ring_count;
+    u32 entries_per_ring;
+    u32 ring_offset;
+    u32 ring_stride;
+    u32 size;
+    u32 reserved[3];
+};
@@ -13,9 +13,9 @@ namespace Kernel {
 
 class CPUID {
 public:
-    explicit CPUID(u32 function) { asm volatile("cpuid"
-                                                : "=a"(m_eax), "=b"(m_ebx), "=c"(m_ecx), "=d"(m_edx)
-                                                : "a"(function), "c"(0)); }
+    explicit CPUID(u32 function, u32 subfunction = 0) { asm volatile("cpuid"
+                                                                     : "=a"(m_eax), "=b"(m_ebx), "=c"(m_ecx), "=d"(m_edx)
+                                                                     : "a"(function), "c"(subfunction)); }
     u32 eax() const { return m_eax; }
     u32 ebx() const { return m_ebx; }
     u32 ecx() const { return m_ecx; }
@@ -56,6 +56,10 @@ enum class CPUFeature : u32 {
     FXSR = (1 << 23),
     LM = (1 << 24),
     HYPERVISOR = (1 << 25),
+    PCID = (1 << 26),
+    X2APIC = (1 << 27),
+    XSAVEOPT = (1 << 28),
+    XSAVES = (1 << 29),
 };
 
 }
\ No newline at end of file
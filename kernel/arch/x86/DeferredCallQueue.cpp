@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/arch/x86/DeferredCallQueue.h>
+#include <kernel/arch/x86/InterruptDisabler.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/heap/SlabAllocator.h>
+#include <kernel/heap/kmalloc.h>
+
+namespace Kernel {
+
+static SlabCache s_deferred_call_cache { "deferred-call", sizeof(DeferredCallEntry) };
+
+void DeferredCallQueue::initialize()
+{
+    m_head = nullptr;
+    m_tail = nullptr;
+    m_free_list = nullptr;
+    m_free_count = 0;
+    for (auto& entry : m_static_pool)
+        return_entry(&entry);
+}
+
+bool DeferredCallQueue::is_static_entry(DeferredCallEntry const* entry) const
+{
+    return entry >= &m_static_pool[0] && entry < &m_static_pool[static_pool_size];
+}
+
+DeferredCallEntry* DeferredCallQueue::take_free_entry()
+{
+    if (auto* entry = m_free_list) {
+        m_free_list = entry->next;
+        m_free_count--;
+        return entry;
+    }
+
+    if (auto* entry = (DeferredCallEntry*)s_deferred_call_cache.alloc()) {
+        m_stats.slab_allocations++;
+        return entry;
+    }
+
+    // Even the slab cache is out of memory, this is the allocation the
+    // pool is there to avoid.
+    m_stats.emergency_allocations++;
+    auto* entry = (DeferredCallEntry*)kmalloc(sizeof(DeferredCallEntry));
+    VERIFY(entry);
+    return entry;
+}
+
+void DeferredCallQueue::return_entry(DeferredCallEntry* entry)
+{
+    if (!is_static_entry(entry) && m_free_count >= free_list_high_watermark) {
+        s_deferred_call_cache.dealloc(entry);
+        return;
+    }
+    entry->next = m_free_list;
+    m_free_list = entry;
+    m_free_count++;
+}
+
+void DeferredCallQueue::refill_free_list()
+{
+    if (m_free_count >= free_list_low_watermark)
+        return;
+
+    // Refill all the way to the high watermark so a burst doesn't bring
+    // us straight back here.
+    while (m_free_count < free_list_high_watermark) {
+        auto* entry = (DeferredCallEntry*)s_deferred_call_cache.alloc();
+        if (!entry)
+            break;
+        m_stats.slab_allocations++;
+        entry->next = m_free_list;
+        m_free_list = entry;
+        m_free_count++;
+    }
+}
+
+void DeferredCallQueue::queue(Function<void()> callback)
+{
+    InterruptDisabler disabler;
+
+    auto* entry = take_free_entry();
+    new (entry->handler_storage) DeferredCallEntry::HandlerFunction(move(callback));
+    entry->next = nullptr;
+
+    if (m_tail)
+        m_tail->next = entry;
+    else
+        m_head = entry;
+    m_tail = entry;
+
+    m_stats.queued++;
+    if (++m_stats.depth > m_stats.max_depth)
+        m_stats.max_depth = m_stats.depth;
+}
+
+void DeferredCallQueue::execute_pending()
+{
+    VERIFY(!are_interrupts_enabled());
+    if (!m_head)
+        return;
+
+    // Take the whole queue at once, calls queued by the handlers form the
+    // next batch and still run before we return.
+    while (auto* entry = m_head) {
+        m_head = nullptr;
+        m_tail = nullptr;
+        m_stats.batches++;
+
+        while (entry) {
+            auto* next = entry->next;
+            entry->invoke_handler();
+            entry->handler_value().~Function();
+            m_stats.executed++;
+            m_stats.depth--;
+            return_entry(entry);
+            entry = next;
+        }
+    }
+
+    refill_free_list();
+}
+
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Function.h>
+#include <base/Types.h>
+
+namespace Kernel {
+
+struct DeferredCallEntry {
+    using HandlerFunction = Function<void()>;
+
+    DeferredCallEntry* next;
+    alignas(HandlerFunction) u8 handler_storage[sizeof(HandlerFunction)];
+
+    HandlerFunction& handler_value()
+    {
+        return *bit_cast<HandlerFunction*>(&handler_storage);
+    }
+
+    void invoke_handler()
+    {
+        handler_value()();
+    }
+};
+
+struct DeferredCallStats {
+    size_t queued;
+    size_t executed;
+    size_t depth;
+    size_t max_depth;
+    size_t batches;
+    size_t slab_allocations;
+    size_t emergency_allocations;
+};
+
+// The deferred calls of one processor, run in the order they were queued
+// once it leaves its outermost critical section or interrupt handler.
+//
+// Entries come from a per-processor free list that starts out with a
+// static pool. When it runs dry the queue takes entries from a slab cache,
+// and it tops the free list back up after every batch, so queueing from an
+// interrupt handler only allocates when a storm outruns the refill.
+//
+// Only ever touched by its own processor with interrupts disabled.
+class DeferredCallQueue {
+    BASE_MAKE_NONCOPYABLE(DeferredCallQueue);
+    BASE_MAKE_NONMOVABLE(DeferredCallQueue);
+
+public:
+    static constexpr size_t static_pool_size = 16;
+    static constexpr size_t free_list_low_watermark = 8;
+    static constexpr size_t free_list_high_watermark = 64;
+
+    DeferredCallQueue() = default;
+
+    void initialize();
+
+    void queue(Function<void()>);
+    void execute_pending();
+
+    bool has_pending() const { return m_head; }
+    DeferredCallStats stats() const { return m_stats; }
+
+private:
+    DeferredCallEntry* take_free_entry();
+    void return_entry(DeferredCallEntry*);
+    void refill_free_list();
+    bool is_static_entry(DeferredCallEntry const*) const;
+
+    DeferredCallEntry* m_head { nullptr };
+    DeferredCallEntry* m_tail { nullptr };
+
+    DeferredCallEntry* m_free_list { nullptr };
+    size_t m_free_count { 0 };
+
+    DeferredCallStats m_stats {};
+    DeferredCallEntry m_static_pool[static_pool_size];
+};
+
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+#include <kernel/arch/x86/ASM_wrapper.h>
+#include <kernel/arch/x86/CPUID.h>
+#include <kernel/arch/x86/Processor.h>
+
+namespace Kernel::FPU {
+
+static constexpr u64 XCR0_X87 = 1 << 0;
+static constexpr u64 XCR0_SSE = 1 << 1;
+static constexpr u64 XCR0_AVX = 1 << 2;
+// FPUState is sized for exactly these.
+static constexpr u64 supported_state_components = XCR0_X87 | XCR0_SSE | XCR0_AVX;
+
+static constexpr FlatPtr CR0_TASK_SWITCHED = 1 << 3;
+static constexpr FlatPtr CR4_OSXSAVE = 1 << 18;
+
+enum class SaveMethod : u8 {
+    FXSAVE,
+    XSAVE,
+    XSAVEOPT,
+    XSAVES,
+};
+
+inline SaveMethod best_save_method(Processor const& processor)
+{
+    if (!processor.has_feature(CPUFeature::XSAVE))
+        return SaveMethod::FXSAVE;
+    if (processor.has_feature(CPUFeature::XSAVES))
+        return SaveMethod::XSAVES;
+    if (processor.has_feature(CPUFeature::XSAVEOPT))
+        return SaveMethod::XSAVEOPT;
+    return SaveMethod::XSAVE;
+}
+
+// Turns on XSAVE with every state component FPUState has room for that the
+// CPU supports, and returns the size the enabled components take up.
+inline size_t enable_xsave()
+{
+    write_cr4(read_cr4() | CR4_OSXSAVE);
+
+    CPUID xsave_leaf(0xd, 0);
+    u64 hardware_components = ((u64)xsave_leaf.edx() << 32) | xsave_leaf.eax();
+    write_xcr0(hardware_components & supported_state_components);
+
+    // EBX reflects what XCR0 enables right now.
+    CPUID enabled_leaf(0xd, 0);
+    size_t state_size = enabled_leaf.ebx();
+    VERIFY(state_size <= sizeof(FPUState));
+    return state_size;
+}
+
+// XSAVEOPT skips components still in their init state or unchanged since
+// the last XRSTOR of this buffer. XSAVES does that too and writes the
+// compacted format, which XRSTORS reads back.
+ALWAYS_INLINE void save(FPUState& state, SaveMethod method)
+{
+    u32 low = supported_state_components & 0xffffffff;
+    u32 high = supported_state_components >> 32;
+    switch (method) {
+    case SaveMethod::FXSAVE:
+        asm volatile("fxsave %0"
+                     : "=m"(state));
+        break;
+    case SaveMethod::XSAVE:
+        asm volatile("xsave %0"
+                     : "+m"(state)
+                     : "a"(low), "d"(high));
+        break;
+    case SaveMethod::XSAVEOPT:
+        asm volatile("xsaveopt %0"
+                     : "+m"(state)
+                     : "a"(low), "d"(high));
+        break;
+    case SaveMethod::XSAVES:
+        asm volatile("xsaves %0"
+                     : "+m"(state)
+                     : "a"(low), "d"(high));
+        break;
+    }
+}
+
+ALWAYS_INLINE void restore(FPUState const& state, SaveMethod method)
+{
+    u32 low = supported_state_components & 0xffffffff;
+    u32 high = supported_state_components >> 32;
+    switch (method) {
+    case SaveMethod::FXSAVE:
+        asm volatile("fxrstor %0" ::"m"(state));
+        break;
+    case SaveMethod::XSAVE:
+    case SaveMethod::XSAVEOPT:
+        asm volatile("xrstor %0" ::"m"(state), "a"(low), "d"(high));
+        break;
+    case SaveMethod::XSAVES:
+        asm volatile("xrstors %0" ::"m"(state), "a"(low), "d"(high));
+        break;
+    }
+}
+
+// Lazy switching: with CR0.TS set the next FPU or SSE instruction raises
+// #NM, so a thread that never touches the FPU never has its state loaded.
+ALWAYS_INLINE void trap_next_use()
+{
+    write_cr0(read_cr0() | CR0_TASK_SWITCHED);
+}
+
+ALWAYS_INLINE void allow_use()
+{
+    asm volatile("clts");
+}
+
+}
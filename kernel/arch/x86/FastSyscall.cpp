@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Atomic.h>
+#include <base/Stopwatch.h>
+#include <kernel/arch/x86/DescriptorTable.h>
+#include <kernel/arch/x86/FastSyscall.h>
+#include <kernel/arch/x86/MSR.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/arch/x86/TrapFrame.h>
+#include <kernel/Metrics.h>
+#include <kernel/Sections.h>
+#include <kernel/time/TimePage.h>
+#include <kernel/vm/MemoryManager.h>
+
+namespace Kernel {
+
+#if ARCH(I386)
+
+// SYSENTER loads esp from an MSR that is the same for every thread, the
+// entry finds the kernel stack of the current one in the TSS of its
+// processor. The MSR points at the top slot of this, which holds the TSS.
+// Nothing is pushed here by the entry itself, the room below is for an NMI
+// or the single step trap taken before it switched stacks.
+struct FastSyscallEntryStack {
+    u8 room[512 - sizeof(TSS*)];
+    TSS* tss;
+};
+
+static_assert(__builtin_offsetof(TSS32, esp0) == 4);
+
+extern "C" void fast_syscall_entry();
+extern "C" void fast_syscall_entry_single_step();
+extern "C" void syscall_handler(TrapFrame*) __attribute__((used));
+extern "C" void fast_syscall_handler(TrapFrame*) __attribute__((used));
+
+// clang-format off
+asm(
+".globl fast_syscall_entry_single_step\n"
+"fast_syscall_entry_single_step:\n"
+"    movl (%esp), %esp\n"
+"    movl 4(%esp), %esp\n"
+"    pushl $0x23\n" // userspace_ss, GDT_SELECTOR_DATA3 | 3
+"    pushl %ecx\n" // userspace_esp
+"    pushfl\n"
+"    orl $0x300, (%esp)\n" // IF and the TF the debug trap took away
+"    jmp 1f\n"
+".globl fast_syscall_entry\n"
+"fast_syscall_entry:\n"
+"    movl (%esp), %esp\n"
+"    movl 4(%esp), %esp\n"
+"    pushl $0x23\n" // userspace_ss, GDT_SELECTOR_DATA3 | 3
+"    pushl %ecx\n" // userspace_esp
+"    pushfl\n"
+"    orl $0x200, (%esp)\n" // SYSENTER cleared IF, userland always has it
+"1:\n"
+"    pushl $0x1b\n" // cs, GDT_SELECTOR_CODE3 | 3
+"    pushl %edx\n" // eip
+"    pushl $0x0\n" // exception_code and isr_number
+// What pusha would have pushed, with the arguments back in edx and ecx.
+"    pushl %eax\n"
+"    pushl %ebp\n" // ecx = arg2
+"    pushl %edi\n" // edx = arg1
+"    pushl %ebx\n"
+"    pushl $0x0\n" // esp, ignored by popa
+"    pushl $0x0\n" // ebp, the stub saved its own
+"    pushl %esi\n"
+"    pushl %edi\n"
+"    pushl %ds\n"
+"    pushl %es\n"
+"    pushl %fs\n"
+"    pushl %gs\n"
+"    pushl %ss\n"
+"    mov $0x10, %ax\n" // GDT_SELECTOR_DATA0
+"    mov %ax, %ds\n"
+"    mov %ax, %es\n"
+"    mov $0x30, %ax\n" // GDT_SELECTOR_PROC
+"    mov %ax, %gs\n"
+"    cld\n"
+"    movl %esp, %ebp\n"
+"    pushl %ecx\n" // FastSyscallFrame::entry_esp
+"    pushl %edx\n" // FastSyscallFrame::entry_eip
+"    pushl %ebp\n" // TrapFrame::regs
+"    subl $" __STRINGIFY(TRAP_FRAME_SIZE - 4) ", %esp\n"
+"    movl %esp, %ebx\n"
+"    pushl %ebx\n"
+"    call enter_trap_no_irq\n"
+"    call fast_syscall_handler\n"
+"    movl %ebx, 0(%esp)\n"
+"    call exit_trap\n"
+"    addl $" __STRINGIFY(TRAP_FRAME_SIZE + 4) ", %esp\n"
+"    pushl %esp\n"
+"    call fast_syscall_can_sysexit\n"
+"    addl $0xc, %esp\n"
+"    testb %al, %al\n" // Neither pop nor popa touch the flags.
+"    popl %gs\n"
+"    popl %gs\n"
+"    popl %fs\n"
+"    popl %es\n"
+"    popl %ds\n"
+"    popa\n"
+"    jz 2f\n"
+"    movl 4(%esp), %edx\n" // eip
+"    movl 16(%esp), %ecx\n" // userspace_esp
+"    sti\n" // Takes effect after sysexit, nothing in between is interrupted.
+"    sysexit\n"
+"2:\n"
+"    addl $0x4, %esp\n"
+"    iret\n"
+);
+// clang-format on
+
+static ShardedCounter s_syscall_count { "syscalls" };
+static LatencyMetric s_syscall_latency { "syscall_ns" };
+
+// Syscalls made through the interrupt gate go straight to syscall_handler()
+// and aren't counted, the ones that can take SYSENTER all do.
+extern "C" void fast_syscall_handler(TrapFrame* trap)
+{
+    s_syscall_count.add();
+    ScopedTimer timer(s_syscall_latency);
+    syscall_handler(trap);
+}
+
+// The flags a thread can have on the way back in little enough state for
+// SYSEXIT to restore it: IF, the reserved bit 1 and the arithmetic flags,
+// which the stub doesn't expect to keep anyway.
+static constexpr FlatPtr sysexit_eflags_mask = 0x200 | 0x2 | 0x8d5;
+
+extern "C" bool fast_syscall_can_sysexit(FastSyscallFrame const* frame)
+{
+    auto& regs = frame->regs;
+
+    // SYSEXIT clobbers edx and ecx and leaves ebp to the stub, which is only
+    // fine when the thread goes back to the stub on the stack it left.
+    if (regs.eip != frame->entry_eip || regs.userspace_esp != frame->entry_esp)
+        return false;
+    if (regs.cs != (GDT_SELECTOR_CODE3 | 3) || regs.userspace_ss != (GDT_SELECTOR_DATA3 | 3))
+        return false;
+    if ((regs.eflags & ~sysexit_eflags_mask) != 0 || !(regs.eflags & 0x200))
+        return false;
+    if (!is_user_address(VirtualAddress(regs.eip)))
+        return false;
+    return true;
+}
+
+static Atomic<u32> s_ready_count;
+static Atomic<bool> s_unsupported;
+
+UNMAP_AFTER_INIT void fast_syscall_initialize()
+{
+    auto& processor = Processor::current();
+    if (!processor.has_feature(CPUFeature::SEP)) {
+        dmesgln("CPU[{}]: No SYSENTER, syscalls go through the interrupt gate", processor.get_id());
+        s_unsupported = true;
+        if (KernelTimePage::is_initialized())
+            KernelTimePage::the().set_fast_syscall(false);
+        return;
+    }
+
+    auto* entry_stack = new FastSyscallEntryStack;
+    entry_stack->tss = &processor.tss();
+
+    MSR(MSR_IA32_SYSENTER_CS).set(GDT_SELECTOR_CODE0);
+    MSR(MSR_IA32_SYSENTER_ESP).set((FlatPtr)&entry_stack->tss);
+    MSR(MSR_IA32_SYSENTER_EIP).set((FlatPtr)&fast_syscall_entry);
+
+    ++s_ready_count;
+    if (KernelTimePage::is_initialized() && fast_syscall_enabled_everywhere())
+        KernelTimePage::the().set_fast_syscall(true);
+}
+
+bool fast_syscall_enabled_everywhere()
+{
+    return !s_unsupported && s_ready_count == Processor::count();
+}
+
+bool fast_syscall_handle_debug_trap(RegisterState& regs)
+{
+    if (regs.cs & 3)
+        return false;
+    if (regs.eip != (FlatPtr)&fast_syscall_entry)
+        return false;
+    regs.eip = (FlatPtr)&fast_syscall_entry_single_step;
+    regs.eflags &= ~0x100;
+    return true;
+}
+
+#else
+
+// SYSCALL on x86_64 needs the user code and data selectors in the order
+// STAR expects them, which isn't the one of the GDT here yet.
+
+void fast_syscall_initialize()
+{
+}
+
+bool fast_syscall_enabled_everywhere()
+{
+    return false;
+}
+
+bool fast_syscall_handle_debug_trap(RegisterState&)
+{
+    return false;
+}
+
+extern "C" bool fast_syscall_can_sysexit(FastSyscallFrame const*)
+{
+    return false;
+}
+
+#endif
+
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+#include <kernel/arch/x86/RegisterState.h>
+
+namespace Kernel {
+
+// Syscalls through SYSENTER/SYSEXIT instead of the int $0x82 gate, on i386
+// processors that have them. Userland looks at TimePage::fast_syscall to
+// pick one or the other, the gate stays in place for everything else.
+//
+// SYSENTER doesn't save anything, userland hands its return address in
+// edx and stack pointer in ecx, so the first two arguments move to edi and
+// ebp:
+//
+//     eax = function, edi = arg1, ebp = arg2, ebx = arg3, esi = arg4
+//
+// The entry moves them back where the gate has them, so syscall_handler()
+// gets the same RegisterState whichever way the syscall came in. SYSEXIT
+// only restores eip and esp, when the syscall changed anything else the
+// thread would see (signals, sigreturn, ptrace), the way out is iret.
+
+// Sits right below the RegisterState on the kernel stack.
+struct [[gnu::packed]] FastSyscallFrame {
+    FlatPtr entry_eip;
+    FlatPtr entry_esp;
+    RegisterState regs;
+};
+
+// Called on every processor from cpu_setup(), after its TSS is set up.
+void fast_syscall_initialize();
+
+// Whether every processor initialized so far takes SYSENTER.
+bool fast_syscall_enabled_everywhere();
+
+// SYSENTER leaves TF as it was, a single stepped thread traps on the first
+// kernel instruction, before the entry switched stacks. The debug handler
+// calls this first; when that is what happened it clears TF, sends the
+// entry down a path that puts TF back in the saved flags, and returns
+// true. The thread then gets its trap after the syscall, through iret.
+bool fast_syscall_handle_debug_trap(RegisterState&);
+
+extern "C" bool fast_syscall_can_sysexit(FastSyscallFrame const*) __attribute__((used));
+
+}
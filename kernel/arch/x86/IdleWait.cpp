@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Atomic.h>
+#include <kernel/arch/x86/CPUID.h>
+#include <kernel/arch/x86/IdleWait.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/Sections.h>
+
+namespace Kernel {
+
+enum IdleState : u32 {
+    Running,
+    Monitoring,
+    Halted,
+};
+
+// The monitored line holds nothing but the flag, so that only a wakeup
+// ends the MWAIT and not some unrelated write next to it.
+struct alignas(64) IdleWakeLine {
+    Atomic<u32> need_resched { 0 };
+    u8 padding[64 - sizeof(Atomic<u32>)];
+};
+
+struct alignas(64) IdleCPUState {
+    Atomic<u32> state { Running };
+};
+
+// One per possible CPU, s_idle_cpu_mask has a bit for each.
+static IdleWakeLine s_wake_lines[32];
+static IdleCPUState s_states[32];
+
+READONLY_AFTER_INIT static bool s_has_mwait;
+// Bit 1 of the MWAIT extensions: interrupts end it even with IF clear,
+// which lets pending work be checked before sti.
+READONLY_AFTER_INIT static bool s_mwait_breaks_on_interrupt;
+READONLY_AFTER_INIT static u32 s_shallow_hint;
+READONLY_AFTER_INIT static u32 s_deep_hint;
+
+UNMAP_AFTER_INIT void idle_wait_initialize()
+{
+    // MONITOR/MWAIT is CPUID.1:ECX[3], leaf 5 describes it.
+    if (!(CPUID(1).ecx() & (1 << 3)) || CPUID(0).eax() < 5) {
+        dmesgln("Idle: No MWAIT, idle CPUs halt and are woken with IPIs");
+        return;
+    }
+
+    CPUID leaf(5);
+    if (!(leaf.ecx() & 1)) {
+        // No enumeration of the C-states, only the C1 hint is safe.
+        s_has_mwait = true;
+        dmesgln("Idle: MWAIT with C1 only");
+        return;
+    }
+
+    s_mwait_breaks_on_interrupt = leaf.ecx() & 2;
+
+    // EDX has four bits per C-state from C0 up with how many sub-states
+    // MWAIT supports there. The hint for C(n + 1) is n << 4.
+    s_shallow_hint = 0;
+    s_deep_hint = 0;
+    for (u32 cstate = 1; cstate < 8; ++cstate) {
+        u32 substates = (leaf.edx() >> (cstate * 4)) & 0xf;
+        if (substates)
+            s_deep_hint = ((cstate - 1) << 4) | (substates - 1);
+    }
+
+    s_has_mwait = true;
+    dmesgln("Idle: MWAIT, deepest hint {:#x}", s_deep_hint);
+}
+
+bool idle_wait_uses_mwait()
+{
+    return s_has_mwait;
+}
+
+bool idle_wait(u32 cpu, IdleDepth depth)
+{
+    VERIFY(cpu < 32);
+    auto& line = s_wake_lines[cpu];
+    auto& state = s_states[cpu].state;
+
+    // The state is published before need_resched is looked at, and a waker
+    // sets need_resched before it looks at the state, so one of the two
+    // always sees the other. Interrupts stay off until the CPU sleeps, a
+    // wakeup IPI can't be taken between the check and hlt.
+    cli();
+    if (s_has_mwait) {
+        state.store(Monitoring);
+        asm volatile("monitor" ::"a"(line.need_resched.ptr()), "c"(0), "d"(0));
+        if (!line.need_resched.load()) {
+            u32 hint = depth == IdleDepth::Long ? s_deep_hint : s_shallow_hint;
+            if (s_mwait_breaks_on_interrupt) {
+                // Interrupts are taken once they are enabled again below.
+                asm volatile("mwait" ::"a"(hint), "c"(1));
+            } else {
+                // sti only takes effect after the next instruction, an
+                // interrupt can't get in between it and mwait.
+                asm volatile("sti; mwait" ::"a"(hint), "c"(0));
+            }
+        }
+    } else {
+        state.store(Halted);
+        if (!line.need_resched.load())
+            asm volatile("sti; hlt");
+    }
+
+    sti();
+    state.store(Running);
+    return line.need_resched.exchange(0);
+}
+
+bool idle_wake(u32 cpu)
+{
+    VERIFY(cpu < 32);
+    if (s_wake_lines[cpu].need_resched.exchange(1))
+        return false;
+    return s_states[cpu].state.load() == Halted;
+}
+
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+
+namespace Kernel {
+
+// How long the idle CPU expects to stay idle, which picks how deep a
+// C-state MWAIT is asked for. Deeper ones save more power and take longer
+// to come back from.
+enum class IdleDepth {
+    Short,
+    Long,
+};
+
+// Looks for MONITOR/MWAIT once on the boot processor. Without it idle CPUs
+// fall back to hlt and need an IPI to be woken.
+void idle_wait_initialize();
+
+bool idle_wait_uses_mwait();
+
+// Called from the idle loop with the CPU's bit set in s_idle_cpu_mask, see
+// Processor::idle_begin(). Sleeps until an interrupt or idle_wake(), and
+// returns whether it was idle_wake(), the scheduler should then run.
+bool idle_wait(u32 cpu, IdleDepth);
+
+// Asks an idle CPU to reschedule. A CPU waiting in MWAIT wakes up from the
+// write alone. Returns whether it still has to be sent an IPI, because it
+// is halted instead.
+[[nodiscard]] bool idle_wake(u32 cpu);
+
+}
@@ -13,6 +13,11 @@
 
 namespace Kernel {
 
+#define MSR_IA32_SYSENTER_CS 0x174
+#define MSR_IA32_SYSENTER_ESP 0x175
+#define MSR_IA32_SYSENTER_EIP 0x176
+#define MSR_IA32_PAT 0x277
+
 class MSR {
     uint32_t m_msr;
 
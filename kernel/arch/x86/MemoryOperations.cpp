@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/CPUFeatures.h>
+#include <kernel/arch/x86/MemoryOperations.h>
+#include <kernel/Sections.h>
+
+namespace Kernel {
+
+// The kernel doesn't save the SSE state for itself, so the small moves go
+// through general purpose registers, eight bytes as two four byte halves.
+typedef u32 __attribute__((aligned(1), may_alias)) UnalignedU32;
+
+// Below this, ERMS rep movsb/stosb is slower to start than rep movsl/stosl.
+static constexpr size_t ERMS_THRESHOLD = 256;
+
+static constexpr size_t SMALL_SIZE = 32;
+
+struct UnalignedU64 {
+    u32 low;
+    u32 high;
+};
+
+ALWAYS_INLINE static UnalignedU64 load_64(u8 const* src)
+{
+    return { *(UnalignedU32 const*)src, *(UnalignedU32 const*)(src + 4) };
+}
+
+ALWAYS_INLINE static void store_64(u8* dest, UnalignedU64 value)
+{
+    *(UnalignedU32*)dest = value.low;
+    *(UnalignedU32*)(dest + 4) = value.high;
+}
+
+// Everything is loaded before anything is stored, so the ranges may overlap
+// the way memmove allows, which the overlapping moves need anyway.
+ALWAYS_INLINE static void copy_small(u8* dest, u8 const* src, size_t n)
+{
+    if (n >= 16) {
+        auto a = load_64(src);
+        auto b = load_64(src + 8);
+        auto c = load_64(src + n - 16);
+        auto d = load_64(src + n - 8);
+        store_64(dest, a);
+        store_64(dest + 8, b);
+        store_64(dest + n - 16, c);
+        store_64(dest + n - 8, d);
+    } else if (n >= 8) {
+        auto a = load_64(src);
+        auto b = load_64(src + n - 8);
+        store_64(dest, a);
+        store_64(dest + n - 8, b);
+    } else if (n >= 4) {
+        u32 a = *(UnalignedU32 const*)src;
+        u32 b = *(UnalignedU32 const*)(src + n - 4);
+        *(UnalignedU32*)dest = a;
+        *(UnalignedU32*)(dest + n - 4) = b;
+    } else if (n > 0) {
+        u8 a = src[0];
+        u8 b = src[n / 2];
+        u8 c = src[n - 1];
+        dest[0] = a;
+        dest[n / 2] = b;
+        dest[n - 1] = c;
+    }
+}
+
+ALWAYS_INLINE static void fill_small(u8* dest, u32 pattern, size_t n)
+{
+    if (n >= 16) {
+        UnalignedU64 value { pattern, pattern };
+        store_64(dest, value);
+        store_64(dest + 8, value);
+        store_64(dest + n - 16, value);
+        store_64(dest + n - 8, value);
+    } else if (n >= 8) {
+        UnalignedU64 value { pattern, pattern };
+        store_64(dest, value);
+        store_64(dest + n - 8, value);
+    } else if (n >= 4) {
+        *(UnalignedU32*)dest = pattern;
+        *(UnalignedU32*)(dest + n - 4) = pattern;
+    } else if (n > 0) {
+        dest[0] = (u8)pattern;
+        dest[n / 2] = (u8)pattern;
+        dest[n - 1] = (u8)pattern;
+    }
+}
+
+static void copy_rep_movsb(u8* dest, u8 const* src, size_t n)
+{
+    asm volatile("rep movsb"
+                 : "+D"(dest), "+S"(src), "+c"(n)
+                 :
+                 : "memory");
+}
+
+static void copy_rep_movsl(u8* dest, u8 const* src, size_t n)
+{
+    size_t words = n / sizeof(u32);
+    size_t rest = n % sizeof(u32);
+    asm volatile("rep movsl"
+                 : "+D"(dest), "+S"(src), "+c"(words)
+                 :
+                 : "memory");
+    // dest and src are past the words now. Past SMALL_SIZE there are at
+    // least four bytes behind the tail.
+    if (rest)
+        *(UnalignedU32*)(dest + rest - 4) = *(UnalignedU32 const*)(src + rest - 4);
+}
+
+static void copy_erms(u8* dest, u8 const* src, size_t n)
+{
+    if (n >= ERMS_THRESHOLD)
+        copy_rep_movsb(dest, src, n);
+    else
+        copy_rep_movsl(dest, src, n);
+}
+
+static void fill_rep_stosb(u8* dest, u32 pattern, size_t n)
+{
+    asm volatile("rep stosb"
+                 : "+D"(dest), "+c"(n)
+                 : "a"(pattern)
+                 : "memory");
+}
+
+static void fill_rep_stosl(u8* dest, u32 pattern, size_t n)
+{
+    size_t words = n / sizeof(u32);
+    size_t rest = n % sizeof(u32);
+    asm volatile("rep stosl"
+                 : "+D"(dest), "+c"(words)
+                 : "a"(pattern)
+                 : "memory");
+    if (rest)
+        *(UnalignedU32*)(dest + rest - 4) = pattern;
+}
+
+static void fill_erms(u8* dest, u32 pattern, size_t n)
+{
+    if (n >= ERMS_THRESHOLD)
+        fill_rep_stosb(dest, pattern, n);
+    else
+        fill_rep_stosl(dest, pattern, n);
+}
+
+READONLY_AFTER_INIT static void (*s_copy_large)(u8*, u8 const*, size_t) = copy_rep_movsl;
+READONLY_AFTER_INIT static void (*s_fill_large)(u8*, u32, size_t) = fill_rep_stosl;
+
+UNMAP_AFTER_INIT void initialize_memory_operations()
+{
+    auto features = cpu_features();
+    if (has_flag(features, CPUFeatures::FSRM)) {
+        s_copy_large = copy_rep_movsb;
+        s_fill_large = fill_rep_stosb;
+    } else if (has_flag(features, CPUFeatures::ERMS)) {
+        s_copy_large = copy_erms;
+        s_fill_large = fill_erms;
+    }
+}
+
+void* fast_memcpy(void* dest, void const* src, size_t n)
+{
+    if (n <= SMALL_SIZE)
+        copy_small((u8*)dest, (u8 const*)src, n);
+    else
+        s_copy_large((u8*)dest, (u8 const*)src, n);
+    return dest;
+}
+
+void* fast_memset(void* dest, int c, size_t n)
+{
+    u32 pattern = (u8)c * 0x01010101u;
+    if (n <= SMALL_SIZE)
+        fill_small((u8*)dest, pattern, n);
+    else
+        s_fill_large((u8*)dest, pattern, n);
+    return dest;
+}
+
+static constexpr FlatPtr LOW_BITS = (FlatPtr)0x0101010101010101ull;
+static constexpr FlatPtr HIGH_BITS = LOW_BITS << 7;
+
+// Flags every zero byte, with no false positives before the first one.
+ALWAYS_INLINE static FlatPtr zero_bytes(FlatPtr word)
+{
+    return (word - LOW_BITS) & ~word & HIGH_BITS;
+}
+
+size_t fast_strlen(char const* str)
+{
+    char const* p = str;
+
+    while ((FlatPtr)p % sizeof(FlatPtr)) {
+        if (!*p)
+            return p - str;
+        p++;
+    }
+
+    // An aligned word is never split over two pages, so reading all of
+    // the one with the terminator can't fault.
+    auto const* word = (FlatPtr const*)p;
+    while (!zero_bytes(*word))
+        word++;
+
+    p = (char const*)word;
+    while (*p)
+        p++;
+    return p - str;
+}
+
+void* fast_memchr(void const* ptr, int c, size_t n)
+{
+    auto const* p = (u8 const*)ptr;
+    u8 byte = (u8)c;
+
+    while (n && (FlatPtr)p % sizeof(FlatPtr)) {
+        if (*p == byte)
+            return const_cast<u8*>(p);
+        p++;
+        n--;
+    }
+
+    FlatPtr repeated = LOW_BITS * byte;
+    while (n >= sizeof(FlatPtr)) {
+        if (zero_bytes(*(FlatPtr const*)p ^ repeated))
+            break;
+        p += sizeof(FlatPtr);
+        n -= sizeof(FlatPtr);
+    }
+
+    for (; n; p++, n--) {
+        if (*p == byte)
+            return const_cast<u8*>(p);
+    }
+    return nullptr;
+}
+
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+
+namespace Kernel {
+
+// Picks the copy and fill routines for the boot processor's features:
+// rep movsb/stosb for everything past the small sizes on CPUs with fast
+// short strings (FSRM), for large sizes with ERMS, and rep movsl/stosl
+// otherwise. Up to 32 bytes never use rep, they are done with a few
+// overlapping unaligned moves whatever the CPU.
+void initialize_memory_operations();
+
+void* fast_memcpy(void* dest, void const* src, size_t n);
+void* fast_memset(void* dest, int c, size_t n);
+
+// Word at a time, with aligned loads that never cross into the next page.
+size_t fast_strlen(char const* str);
+void* fast_memchr(void const* ptr, int c, size_t n);
+
+}
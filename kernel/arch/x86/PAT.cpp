@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/arch/x86/CPUID.h>
+#include <kernel/arch/x86/MSR.h>
+#include <kernel/arch/x86/PAT.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/Sections.h>
+
+namespace Kernel {
+
+bool g_write_combining_available = false;
+
+static constexpr u64 pat_uncacheable = 0x00;
+static constexpr u64 pat_write_combining = 0x01;
+static constexpr u64 pat_write_through = 0x04;
+static constexpr u64 pat_write_back = 0x06;
+static constexpr u64 pat_uncached = 0x07; // UC-, an MTRR can still make it WC.
+
+// Entries 0 to 3 keep their power-on values, so nothing mapped before this
+// changes type and no cache flush is needed. 4 to 7 aren't used by any
+// mapping before they are set.
+static constexpr u64 pat_value = pat_write_back
+    | pat_write_through << 8
+    | pat_uncached << 16
+    | pat_uncacheable << 24
+    | pat_write_back << 32
+    | pat_write_combining << 40
+    | pat_uncached << 48
+    | pat_uncacheable << 56;
+
+UNMAP_AFTER_INIT void pat_initialize()
+{
+    CPUID id(1);
+    if (!(id.edx() & (1 << 16))) {
+        dmesgln("CPU[{}]: No PAT, write combining mappings are uncacheable", Processor::id());
+        return;
+    }
+
+    MSR(MSR_IA32_PAT).set(pat_value);
+    Processor::flush_entire_tlb_local();
+
+    // Every CPU of a system has a PAT or none does, the first one to get
+    // here decides.
+    g_write_combining_available = true;
+}
+
+}
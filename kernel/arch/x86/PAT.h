@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Platform.h>
+#include <base/Types.h>
+
+namespace Kernel {
+
+// How the CPU caches the memory behind a mapping.
+enum class MemoryType : u8 {
+    WriteBack,
+    WriteThrough,
+    // Writes are gathered and go out in bursts, reads aren't cached. Made
+    // for framebuffers, which are written a lot more than read.
+    WriteCombining,
+    // Every access goes to the device as it is, in order. MMIO registers.
+    Uncacheable,
+};
+
+extern bool g_write_combining_available;
+
+// The PAT entry a page table entry has to select for type: bit 0 is its
+// PWT bit, bit 1 PCD and bit 2 the PAT bit. Entries 0 to 3 are those the
+// CPU starts out with, write combining is in 5. Without a PAT it degrades
+// to uncacheable.
+ALWAYS_INLINE u8 pat_index_for(MemoryType type)
+{
+    switch (type) {
+    case MemoryType::WriteBack:
+        return 0;
+    case MemoryType::WriteThrough:
+        return 1;
+    case MemoryType::WriteCombining:
+        return g_write_combining_available ? 5 : 3;
+    case MemoryType::Uncacheable:
+        return 3;
+    }
+    return 3;
+}
+
+// Programs the PAT of the calling CPU. All of them have to agree on it, so
+// every CPU calls this before it maps anything write combining.
+void pat_initialize();
+
+}
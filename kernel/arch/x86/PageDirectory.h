@@ -9,6 +9,7 @@
 // includes
 #include <base/Badge.h>
 #include <base/Types.h>
+#include <kernel/arch/x86/PAT.h>
 #include <kernel/PhysicalAddress.h>
 
 namespace Kernel {
@@ -25,6 +26,14 @@ public:
         m_raw |= PhysicalAddress::physical_page_base(value);
     }
 
+    // The 2 MiB page mapped by a huge entry.
+    PhysicalPtr large_page_base() const { return m_raw & 0x000fffffffe00000ULL; }
+    void set_large_page_base(PhysicalPtr value)
+    {
+        m_raw &= 0x8000000000000fffULL;
+        m_raw |= value & 0x000fffffffe00000ULL;
+    }
+
     bool is_null() const { return m_raw == 0; }
     void clear() { m_raw = 0; }
 
@@ -37,8 +46,10 @@ public:
         UserSupervisor = 1 << 2,
         WriteThrough = 1 << 3,
         CacheDisabled = 1 << 4,
+        Accessed = 1 << 5,
         Huge = 1 << 7,
         Global = 1 << 8,
+        LargePAT = 1 << 12,
         NoExecute = 0x8000000000000000ULL,
     };
 
@@ -60,6 +71,20 @@ public:
     bool is_cache_disabled() const { return raw() & CacheDisabled; }
     void set_cache_disabled(bool b) { set_bit(CacheDisabled, b); }
 
+    // Only for huge entries, whose PAT bit is where a table address goes
+    // otherwise.
+    void set_memory_type(MemoryType type)
+    {
+        u8 index = pat_index_for(type);
+        set_bit(WriteThrough, index & 1);
+        set_bit(CacheDisabled, index & 2);
+        set_bit(LargePAT, index & 4);
+    }
+
+    // Set by the CPU whenever the entry is used to translate an address.
+    bool is_accessed() const { return raw() & Accessed; }
+    void set_accessed(bool b) { set_bit(Accessed, b); }
+
     bool is_global() const { return raw() & Global; }
     void set_global(bool b) { set_bit(Global, b); }
 
@@ -95,6 +120,8 @@ public:
         UserSupervisor = 1 << 2,
         WriteThrough = 1 << 3,
         CacheDisabled = 1 << 4,
+        Accessed = 1 << 5,
+        PAT = 1 << 7,
         Global = 1 << 8,
         NoExecute = 0x8000000000000000ULL,
     };
@@ -114,6 +141,18 @@ public:
     bool is_cache_disabled() const { return raw() & CacheDisabled; }
     void set_cache_disabled(bool b) { set_bit(CacheDisabled, b); }
 
+    void set_memory_type(MemoryType type)
+    {
+        u8 index = pat_index_for(type);
+        set_bit(WriteThrough, index & 1);
+        set_bit(CacheDisabled, index & 2);
+        set_bit(PAT, index & 4);
+    }
+
+    // Set by the CPU whenever the entry is used to translate an address.
+    bool is_accessed() const { return raw() & Accessed; }
+    void set_accessed(bool b) { set_bit(Accessed, b); }
+
     bool is_global() const { return raw() & Global; }
     void set_global(bool b) { set_bit(Global, b); }
 
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/arch/x86/CPUID.h>
+#include <kernel/arch/x86/PageOperations.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/Sections.h>
+
+namespace Kernel {
+
+static void zero_page_rep_stosb(void* page)
+{
+    FlatPtr dest = (FlatPtr)page;
+    size_t count = PAGE_SIZE;
+    asm volatile("rep stosb"
+                 : "+D"(dest), "+c"(count)
+                 : "a"(0)
+                 : "memory");
+}
+
+static void zero_page_rep_stosl(void* page)
+{
+    FlatPtr dest = (FlatPtr)page;
+    size_t count = PAGE_SIZE / sizeof(u32);
+    asm volatile("rep stosl"
+                 : "+D"(dest), "+c"(count)
+                 : "a"(0)
+                 : "memory");
+}
+
+static void zero_page_non_temporal(void* page)
+{
+    u8* dest = (u8*)page;
+    for (size_t i = 0; i < PAGE_SIZE; i += 4 * sizeof(u32)) {
+        asm volatile(
+            "movnti %1, 0(%0)\n"
+            "movnti %1, 4(%0)\n"
+            "movnti %1, 8(%0)\n"
+            "movnti %1, 12(%0)\n" ::"r"(dest + i),
+            "r"(0u)
+            : "memory");
+    }
+    asm volatile("sfence" ::
+                     : "memory");
+}
+
+static void copy_page_rep_movsb(void* dest_page, void const* src_page)
+{
+    FlatPtr dest = (FlatPtr)dest_page;
+    FlatPtr src = (FlatPtr)src_page;
+    size_t count = PAGE_SIZE;
+    asm volatile("rep movsb"
+                 : "+D"(dest), "+S"(src), "+c"(count)
+                 :
+                 : "memory");
+}
+
+static void copy_page_rep_movsl(void* dest_page, void const* src_page)
+{
+    FlatPtr dest = (FlatPtr)dest_page;
+    FlatPtr src = (FlatPtr)src_page;
+    size_t count = PAGE_SIZE / sizeof(u32);
+    asm volatile("rep movsl"
+                 : "+D"(dest), "+S"(src), "+c"(count)
+                 :
+                 : "memory");
+}
+
+static void copy_page_non_temporal(void* dest_page, void const* src_page)
+{
+    // The kernel doesn't touch the SSE registers, the stores go through
+    // general purpose ones.
+    u8* dest = (u8*)dest_page;
+    u8 const* src = (u8 const*)src_page;
+    for (size_t i = 0; i < PAGE_SIZE; i += 2 * sizeof(u32)) {
+        u32 low, high;
+        asm volatile(
+            "mov 0(%2), %0\n"
+            "mov 4(%2), %1\n"
+            "movnti %0, 0(%3)\n"
+            "movnti %1, 4(%3)\n"
+            : "=&r"(low), "=&r"(high)
+            : "r"(src + i), "r"(dest + i)
+            : "memory");
+    }
+    asm volatile("sfence" ::
+                     : "memory");
+}
+
+READONLY_AFTER_INIT static void (*s_zero_page_hot)(void*) = zero_page_rep_stosl;
+READONLY_AFTER_INIT static void (*s_zero_page_cold)(void*) = zero_page_rep_stosl;
+READONLY_AFTER_INIT static void (*s_copy_page_hot)(void*, void const*) = copy_page_rep_movsl;
+READONLY_AFTER_INIT static void (*s_copy_page_cold)(void*, void const*) = copy_page_rep_movsl;
+
+UNMAP_AFTER_INIT void initialize_page_operations()
+{
+    // Enhanced rep movsb/stosb is CPUID.(EAX=7,ECX=0):EBX[9].
+    bool has_erms = CPUID(0).eax() >= 7 && (CPUID(7).ebx() & (1 << 9));
+    if (has_erms) {
+        s_zero_page_hot = zero_page_rep_stosb;
+        s_copy_page_hot = copy_page_rep_movsb;
+    }
+    s_zero_page_cold = s_zero_page_hot;
+    s_copy_page_cold = s_copy_page_hot;
+
+    if (Processor::current().has_feature(CPUFeature::SSE2)) {
+        s_zero_page_cold = zero_page_non_temporal;
+        s_copy_page_cold = copy_page_non_temporal;
+    }
+}
+
+void zero_page(void* page, PageTemporality temporality)
+{
+    if (temporality == PageTemporality::Cold)
+        s_zero_page_cold(page);
+    else
+        s_zero_page_hot(page);
+}
+
+void copy_page(void* dest_page, void const* src_page, PageTemporality temporality)
+{
+    if (temporality == PageTemporality::Cold)
+        s_copy_page_cold(dest_page, src_page);
+    else
+        s_copy_page_hot(dest_page, src_page);
+}
+
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+
+namespace Kernel {
+
+// Whether the page is about to be used by whoever asked for it. Hot pages
+// are written through the cache, cold ones (background clearing, bulk
+// populates, migrations) around it, so they don't evict what's in there.
+enum class PageTemporality {
+    Hot,
+    Cold,
+};
+
+// Picks the routines for the boot processor's features: rep stosb/movsb
+// where the CPU has fast strings (ERMS), wider rep stos/movs otherwise,
+// and non-temporal stores for cold pages if there is SSE2.
+void initialize_page_operations();
+
+void zero_page(void* page, PageTemporality = PageTemporality::Hot);
+void copy_page(void* dest_page, void const* src_page, PageTemporality = PageTemporality::Hot);
+
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Atomic.h>
+#include <kernel/arch/x86/CPUID.h>
+#include <kernel/arch/x86/InterruptDisabler.h>
+#include <kernel/arch/x86/MSR.h>
+#include <kernel/arch/x86/PerformanceCounters.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/Sections.h>
+
+namespace Kernel {
+
+#define MSR_IA32_PMC0 0xc1
+#define MSR_IA32_PERFEVTSEL0 0x186
+#define MSR_IA32_PERF_GLOBAL_CTRL 0x38f
+
+#define PERFEVTSEL_USR (1 << 16)
+#define PERFEVTSEL_OS (1 << 17)
+#define PERFEVTSEL_EN (1 << 22)
+
+struct ArchitecturalEvent {
+    // Bit in CPUID.0AH:EBX that is set if the event is *not* available.
+    u8 unavailable_bit;
+    u8 event_select;
+    u8 unit_mask;
+};
+
+static constexpr ArchitecturalEvent s_architectural_events[performance_counter_event_count] = {
+    { 0, 0x3c, 0x00 }, // UnHalted Core Cycles
+    { 1, 0xc0, 0x00 }, // Instructions Retired
+    { 4, 0x2e, 0x41 }, // LLC Misses
+    { 6, 0xc5, 0x00 }, // Branch Mispredicts Retired
+};
+
+READONLY_AFTER_INIT static u32 s_version;
+READONLY_AFTER_INIT static u32 s_available_events;
+READONLY_AFTER_INIT static u64 s_counter_mask;
+// Which general purpose counter counts each event, if available.
+READONLY_AFTER_INIT static u8 s_counter_for_event[performance_counter_event_count];
+
+struct alignas(64) ProcessorPerformanceCounters {
+    u64 switched_in_at[performance_counter_event_count] {};
+    // Read by other processors for system-wide counts.
+    Atomic<u64, Base::MemoryOrder::memory_order_relaxed> totals[performance_counter_event_count] {};
+};
+
+static ProcessorPerformanceCounters s_processors[ProcessorContainer().size()];
+
+UNMAP_AFTER_INIT static void detect()
+{
+    if (CPUID(0).eax() < 0xa || !MSR::have())
+        return;
+
+    CPUID leaf(0xa);
+    u32 version = leaf.eax() & 0xff;
+    u32 counter_count = (leaf.eax() >> 8) & 0xff;
+    u32 counter_width = (leaf.eax() >> 16) & 0xff;
+    u32 vector_length = (leaf.eax() >> 24) & 0xff;
+    if (!version || !counter_count || !counter_width)
+        return;
+
+    u32 next_counter = 0;
+    for (size_t event = 0; event < performance_counter_event_count && next_counter < counter_count; event++) {
+        auto& architectural_event = s_architectural_events[event];
+        if (architectural_event.unavailable_bit >= vector_length || (leaf.ebx() & (1u << architectural_event.unavailable_bit)))
+            continue;
+        s_counter_for_event[event] = next_counter++;
+        s_available_events |= 1u << event;
+    }
+
+    s_version = version;
+    s_counter_mask = counter_width >= 64 ? ~0ull : (1ull << counter_width) - 1;
+    dmesgln("PerformanceCounters: Architectural PMU version {}, {} counters of {} bits, event mask {:#x}", version, counter_count, counter_width, s_available_events);
+}
+
+static u64 read_counter(size_t event)
+{
+    return MSR(MSR_IA32_PMC0 + s_counter_for_event[event]).get();
+}
+
+UNMAP_AFTER_INIT void PerformanceCounters::initialize()
+{
+    if (Processor::is_bootstrap_processor())
+        detect();
+    if (!s_available_events)
+        return;
+
+    u64 global_enable = 0;
+    for (size_t event = 0; event < performance_counter_event_count; event++) {
+        if (!(s_available_events & (1u << event)))
+            continue;
+        auto& architectural_event = s_architectural_events[event];
+        auto counter = s_counter_for_event[event];
+        MSR(MSR_IA32_PERFEVTSEL0 + counter).set(0);
+        MSR(MSR_IA32_PMC0 + counter).set(0);
+        MSR(MSR_IA32_PERFEVTSEL0 + counter).set(architectural_event.event_select | (architectural_event.unit_mask << 8) | PERFEVTSEL_USR | PERFEVTSEL_OS | PERFEVTSEL_EN);
+        global_enable |= 1ull << counter;
+    }
+    // Version 1 has no global control, the counters run as soon as their
+    // event select enables them.
+    if (s_version >= 2)
+        MSR(MSR_IA32_PERF_GLOBAL_CTRL).set(global_enable);
+
+    switch_in();
+}
+
+u32 PerformanceCounters::available_events()
+{
+    return s_available_events;
+}
+
+void PerformanceCounters::switch_in()
+{
+    if (!s_available_events)
+        return;
+    auto& processor = s_processors[Processor::id()];
+    for (size_t event = 0; event < performance_counter_event_count; event++) {
+        if (s_available_events & (1u << event))
+            processor.switched_in_at[event] = read_counter(event);
+    }
+}
+
+void PerformanceCounters::switch_out(ThreadPerformanceCounters& thread)
+{
+    if (!s_available_events)
+        return;
+    auto& processor = s_processors[Processor::id()];
+    for (size_t event = 0; event < performance_counter_event_count; event++) {
+        if (!(s_available_events & (1u << event)))
+            continue;
+        // The counters are narrower than 64 bits and wrap around.
+        u64 now = read_counter(event);
+        u64 delta = (now - processor.switched_in_at[event]) & s_counter_mask;
+        thread.totals[event] += delta;
+        processor.totals[event] += delta;
+        processor.switched_in_at[event] = now;
+    }
+}
+
+void PerformanceCounters::read_thread(ThreadPerformanceCounters const& thread, bool is_current, PerformanceCounterValues& values)
+{
+    values = {};
+    values.available_events = s_available_events;
+    if (!s_available_events)
+        return;
+
+    InterruptDisabler disabler;
+    auto& processor = s_processors[Processor::id()];
+    for (size_t event = 0; event < performance_counter_event_count; event++) {
+        if (!(s_available_events & (1u << event)))
+            continue;
+        values.values[event] = thread.totals[event];
+        // What the thread ran since it was last switched in isn't in its
+        // totals yet.
+        if (is_current)
+            values.values[event] += (read_counter(event) - processor.switched_in_at[event]) & s_counter_mask;
+    }
+}
+
+void PerformanceCounters::read_system(PerformanceCounterValues& values)
+{
+    values = {};
+    values.available_events = s_available_events;
+    if (!s_available_events)
+        return;
+
+    // Other processors only add what ran until their last context switch.
+    InterruptDisabler disabler;
+    auto current_id = Processor::id();
+    for (size_t id = 0; id < Processor::count(); id++) {
+        auto& processor = s_processors[id];
+        for (size_t event = 0; event < performance_counter_event_count; event++) {
+            if (!(s_available_events & (1u << event)))
+                continue;
+            values.values[event] += processor.totals[event].load();
+            if (id == current_id)
+                values.values[event] += (read_counter(event) - processor.switched_in_at[event]) & s_counter_mask;
+        }
+    }
+}
+
+}
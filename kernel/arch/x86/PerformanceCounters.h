@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+#include <kernel/api/PerformanceCounters.h>
+
+namespace Kernel {
+
+// What a thread ran while it was on a CPU, kept up to date on every
+// context switch.
+struct ThreadPerformanceCounters {
+    u64 totals[performance_counter_event_count] {};
+};
+
+// The general purpose counters of the architectural performance monitoring
+// unit (CPUID leaf 0xA), programmed once per CPU to count in both rings
+// and left running. Per-thread counts come from the deltas between
+// switching a thread in and out, system-wide ones from per-CPU sums of the
+// same deltas.
+class PerformanceCounters {
+public:
+    // Detects the PMU on the bootstrap processor, then programs the
+    // counters of the calling processor.
+    static void initialize();
+
+    static bool is_available() { return available_events() != 0; }
+    static u32 available_events();
+
+    // Context switch hooks, called with interrupts disabled.
+    static void switch_out(ThreadPerformanceCounters&);
+    static void switch_in();
+
+    // The thread has to be the current one, or not running at all.
+    static void read_thread(ThreadPerformanceCounters const&, bool is_current, PerformanceCounterValues&);
+    static void read_system(PerformanceCounterValues&);
+};
+
+}
@@ -13,6 +13,7 @@
 #include <base/Types.h>
 #include <kernel/arch/x86/ASM_wrapper.h>
 #include <kernel/arch/x86/CPUID.h>
+#include <kernel/arch/x86/DeferredCallQueue.h>
 #include <kernel/arch/x86/DescriptorTable.h>
 #include <kernel/arch/x86/PageDirectory.h>
 #include <kernel/arch/x86/TSS.h>
@@ -34,9 +35,14 @@ extern "C" void thread_context_first_enter(void);
 extern "C" void exit_kernel_thread(void);
 extern "C" void do_assume_context(Thread* thread, u32 flags);
 
-struct [[gnu::aligned(16)]] FPUState
+// From kernel/RCU.h, which needs this header.
+void rcu_note_quiescent_state();
+
+// Big enough for the XSAVE layout of x87, SSE and AVX state: the legacy
+// region, the XSAVE header and the upper halves of the YMM registers.
+struct [[gnu::aligned(64)]] FPUState
 {
-    u8 buffer[512];
+    u8 buffer[512 + 64 + 256];
 };
 
 struct ProcessorMessage {
@@ -60,6 +66,9 @@ struct ProcessorMessage {
 
     volatile bool async;
 
+    // The processor whose pool it came from, and goes back to.
+    u32 owner;
+
     ProcessorMessageEntry* per_proc_entries;
 
     CallbackFunction& callback_value()
@@ -79,24 +88,6 @@ struct ProcessorMessageEntry {
     ProcessorMessage* msg;
 };
 
-struct DeferredCallEntry {
-    using HandlerFunction = Function<void()>;
-
-    DeferredCallEntry* next;
-    alignas(HandlerFunction) u8 handler_storage[sizeof(HandlerFunction)];
-    bool was_allocated;
-
-    HandlerFunction& handler_value()
-    {
-        return *bit_cast<HandlerFunction*>(&handler_storage);
-    }
-
-    void invoke_handler()
-    {
-        handler_value()();
-    }
-};
-
 class Processor;
 
 using ProcessorContainer = Array<Processor*, 8>;
@@ -132,13 +123,18 @@ class Processor {
 
     Atomic<ProcessorMessageEntry*> m_message_queue;
 
+    // Messages this processor sends come from its own pool, which only it
+    // touches, with interrupts disabled. Those it gets back from the others
+    // are pushed onto m_returned_messages and taken over in one go once
+    // the pool runs dry.
+    ProcessorMessage* m_message_pool;
+    Atomic<ProcessorMessage*> m_returned_messages;
+
     bool m_invoke_scheduler_async;
     bool m_scheduler_initialized;
     Atomic<bool> m_halt_requested;
 
-    DeferredCallEntry* m_pending_deferred_calls; 
-    DeferredCallEntry* m_free_deferred_call_pool_entry;
-    DeferredCallEntry m_deferred_call_pool[5];
+    DeferredCallQueue m_deferred_call_queue;
 
     void gdt_init();
     void write_raw_gdt_entry(u16 selector, u32 low, u32 high);
@@ -154,11 +150,8 @@ class Processor {
     static void smp_broadcast_wait_sync(ProcessorMessage& msg);
     static void smp_broadcast_halt();
 
-    void deferred_call_pool_init();
-    void deferred_call_execute_pending();
-    DeferredCallEntry* deferred_call_get_free();
-    void deferred_call_return_to_pool(DeferredCallEntry*);
-    void deferred_call_queue_entry(DeferredCallEntry*);
+    void deferred_call_pool_init() { m_deferred_call_queue.initialize(); }
+    void deferred_call_execute_pending() { m_deferred_call_queue.execute_pending(); }
 
     void cpu_detect();
     void cpu_setup();
@@ -176,6 +169,7 @@ public:
 
     void idle_begin()
     {
+        rcu_note_quiescent_state();
         s_idle_cpu_mask.fetch_or(1u << m_cpu, Base::MemoryOrder::memory_order_relaxed);
     }
 
@@ -184,6 +178,12 @@ public:
         s_idle_cpu_mask.fetch_and(~(1u << m_cpu), Base::MemoryOrder::memory_order_relaxed);
     }
 
+    // Which CPUs are between idle_begin() and idle_end(), one bit each.
+    static u32 idle_cpu_mask()
+    {
+        return s_idle_cpu_mask.load(Base::MemoryOrder::memory_order_relaxed);
+    }
+
     static u32 count()
     {
         return *g_total_processors.ptr();
@@ -407,13 +407,20 @@ public:
     static void smp_broadcast_flush_tlb(const PageDirectory*, VirtualAddress, size_t);
     static u32 smp_wake_n_idle_processors(u32 wake_count);
 
-    static void deferred_call_queue(Function<void()> callback);
+    static void deferred_call_queue(Function<void()> callback)
+    {
+        current().m_deferred_call_queue.queue(move(callback));
+    }
+
+    DeferredCallStats deferred_call_stats() const { return m_deferred_call_queue.stats(); }
 
     ALWAYS_INLINE bool has_feature(CPUFeature f) const
     {
         return (static_cast<u32>(m_features) & static_cast<u32>(f)) != 0;
     }
 
+    ALWAYS_INLINE TSS& tss() { return m_tss; }
+
     void check_invoke_scheduler();
     void invoke_scheduler_async() { m_invoke_scheduler_async = true; }
 
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/arch/x86/InterruptDisabler.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/interrupts/APIC.h>
+#include <kernel/Process.h>
+#include <kernel/vm/MemoryManager.h>
+#include <kernel/vm/PageDirectory.h>
+
+namespace Kernel {
+
+static constexpr size_t messages_per_processor = 100;
+
+static volatile bool s_smp_enabled;
+
+UNMAP_AFTER_INIT void Processor::smp_enable()
+{
+    size_t processor_count = Processor::count();
+    size_t message_count = processor_count * messages_per_processor;
+
+    auto* messages = new ProcessorMessage[message_count];
+    auto* entries = new ProcessorMessageEntry[message_count * processor_count];
+
+    // Each processor gets a contiguous share of the messages, each message
+    // an entry for every processor it can be queued on.
+    for (size_t i = 0; i < message_count; i++) {
+        auto& message = messages[i];
+        bool last_of_pool = (i + 1) % messages_per_processor == 0;
+        message.next = last_of_pool ? nullptr : &messages[i + 1];
+        message.owner = i / messages_per_processor;
+        message.per_proc_entries = &entries[i * processor_count];
+        for (size_t k = 0; k < processor_count; k++)
+            message.per_proc_entries[k].msg = &message;
+    }
+
+    for_each([&](Processor& processor) {
+        processor.m_returned_messages.store(nullptr, Base::MemoryOrder::memory_order_relaxed);
+        processor.m_message_pool = &messages[processor.get_id() * messages_per_processor];
+    });
+
+    Base::atomic_thread_fence(Base::MemoryOrder::memory_order_release);
+    s_smp_enabled = true;
+}
+
+void Processor::smp_return_to_pool(ProcessorMessage& msg)
+{
+    InterruptDisabler disabler;
+    auto& processor = current();
+
+    if (msg.owner == processor.get_id()) {
+        msg.next = processor.m_message_pool;
+        processor.m_message_pool = &msg;
+        return;
+    }
+
+    auto& owner = *processors()[msg.owner];
+    ProcessorMessage* next = owner.m_returned_messages.load(Base::MemoryOrder::memory_order_relaxed);
+    do {
+        msg.next = next;
+    } while (!owner.m_returned_messages.compare_exchange_strong(next, &msg, Base::MemoryOrder::memory_order_release));
+}
+
+ProcessorMessage& Processor::smp_get_from_pool()
+{
+    for (;;) {
+        {
+            InterruptDisabler disabler;
+            auto& processor = current();
+
+            if (!processor.m_message_pool)
+                processor.m_message_pool = processor.m_returned_messages.exchange(nullptr, Base::MemoryOrder::memory_order_acquire);
+
+            if (auto* msg = processor.m_message_pool) {
+                processor.m_message_pool = msg->next;
+                return *msg;
+            }
+        }
+
+        // All of ours are still on their way. Handling what was sent to us
+        // meanwhile is what gives some of them back.
+        if (!current().smp_process_pending_messages())
+            asm volatile("pause");
+    }
+}
+
+void Processor::smp_cleanup_message(ProcessorMessage& msg)
+{
+    switch (msg.type) {
+    case ProcessorMessage::Callback:
+        msg.callback_value().~Function();
+        break;
+    default:
+        break;
+    }
+}
+
+// Everything queued so far is taken in one exchange and handled in one
+// pass, whatever number of IPIs announced it.
+bool Processor::smp_process_pending_messages()
+{
+    bool did_process = false;
+    u32 prev_flags;
+    enter_critical(prev_flags);
+
+    if (auto* pending = m_message_queue.exchange(nullptr, Base::MemoryOrder::memory_order_acq_rel)) {
+        // Pushed last first, turned around to handle them in order.
+        ProcessorMessageEntry* in_order = nullptr;
+        while (pending) {
+            auto* next = pending->next;
+            pending->next = in_order;
+            in_order = pending;
+            pending = next;
+        }
+
+        ProcessorMessageEntry* next_entry;
+        for (auto* entry = in_order; entry; entry = next_entry) {
+            next_entry = entry->next;
+            auto* msg = entry->msg;
+
+            switch (msg->type) {
+            case ProcessorMessage::Callback:
+                msg->invoke_callback();
+                break;
+            case ProcessorMessage::FlushTlb:
+                if (is_user_address(VirtualAddress(msg->flush_tlb.ptr))) {
+                    VERIFY(is_user_range(VirtualAddress(msg->flush_tlb.ptr), msg->flush_tlb.page_count * PAGE_SIZE));
+                    // Not the address space this processor is in.
+                    if (read_cr3() != msg->flush_tlb.page_directory->cr3())
+                        break;
+                }
+                flush_tlb_local(VirtualAddress(msg->flush_tlb.ptr), msg->flush_tlb.page_count);
+                break;
+            }
+
+            // Read before the reference goes, the message may be reused
+            // right after.
+            bool is_async = msg->async;
+            auto prev_refs = msg->refs.fetch_sub(1u, Base::MemoryOrder::memory_order_acq_rel);
+            VERIFY(prev_refs != 0);
+            if (prev_refs == 1 && is_async) {
+                smp_cleanup_message(*msg);
+                smp_return_to_pool(*msg);
+            }
+
+            if (m_halt_requested.load(Base::MemoryOrder::memory_order_relaxed))
+                halt_this();
+        }
+        did_process = true;
+    } else if (m_halt_requested.load(Base::MemoryOrder::memory_order_relaxed)) {
+        halt_this();
+    }
+
+    leave_critical(prev_flags);
+    return did_process;
+}
+
+// Tells whether the queue was empty. If it wasn't, an IPI for what is
+// already there is on its way or being handled, and the message will be
+// taken along with it.
+bool Processor::smp_queue_message(ProcessorMessage& msg)
+{
+    auto& entry = msg.per_proc_entries[get_id()];
+    VERIFY(entry.msg == &msg);
+    ProcessorMessageEntry* next = m_message_queue.load(Base::MemoryOrder::memory_order_relaxed);
+    do {
+        entry.next = next;
+    } while (!m_message_queue.compare_exchange_strong(next, &entry, Base::MemoryOrder::memory_order_acq_rel));
+    return next == nullptr;
+}
+
+void Processor::smp_broadcast_message(ProcessorMessage& msg)
+{
+    auto& cur_proc = Processor::current();
+
+    msg.refs.store(count() - 1, Base::MemoryOrder::memory_order_release);
+    VERIFY(msg.refs > 0);
+
+    u32 needs_ipi = 0;
+    u32 others = 0;
+    for_each([&](Processor& proc) {
+        if (&proc == &cur_proc)
+            return;
+        others |= 1u << proc.get_id();
+        if (proc.smp_queue_message(msg))
+            needs_ipi |= 1u << proc.get_id();
+    });
+
+    // One broadcast when every other processor needs waking, an IPI each
+    // otherwise, and none for those that already had messages pending.
+    if (needs_ipi == others) {
+        APIC::the().broadcast_ipi();
+        return;
+    }
+
+    for (u32 cpu = 0; needs_ipi; cpu++, needs_ipi >>= 1) {
+        if (needs_ipi & 1)
+            APIC::the().send_ipi(cpu);
+    }
+}
+
+// If synchronous, the sender returns the message to the pool once every
+// target is done with it. Otherwise the last target does.
+static void wait_for_targets(Processor& cur_proc, ProcessorMessage& msg)
+{
+    while (msg.refs.load(Base::MemoryOrder::memory_order_consume) != 0) {
+        // Handle what was sent to us while we wait, and halt if asked to.
+        cur_proc.smp_process_pending_messages();
+    }
+}
+
+void Processor::smp_broadcast_wait_sync(ProcessorMessage& msg)
+{
+    VERIFY(!msg.async);
+    wait_for_targets(Processor::current(), msg);
+    smp_cleanup_message(msg);
+    smp_return_to_pool(msg);
+}
+
+void Processor::smp_broadcast(Function<void()> callback, bool async)
+{
+    auto& msg = smp_get_from_pool();
+    msg.async = async;
+    msg.type = ProcessorMessage::Callback;
+    new (msg.callback_storage) ProcessorMessage::CallbackFunction(move(callback));
+    smp_broadcast_message(msg);
+    if (!async)
+        smp_broadcast_wait_sync(msg);
+}
+
+void Processor::smp_unicast_message(u32 cpu, ProcessorMessage& msg, bool async)
+{
+    auto& cur_proc = Processor::current();
+    VERIFY(cpu != cur_proc.get_id());
+    auto& target_proc = processors()[cpu];
+    msg.async = async;
+
+    msg.refs.store(1u, Base::MemoryOrder::memory_order_release);
+    if (target_proc->smp_queue_message(msg))
+        APIC::the().send_ipi(cpu);
+
+    if (!async) {
+        wait_for_targets(cur_proc, msg);
+        smp_cleanup_message(msg);
+        smp_return_to_pool(msg);
+    }
+}
+
+void Processor::smp_unicast(u32 cpu, Function<void()> callback, bool async)
+{
+    auto& msg = smp_get_from_pool();
+    msg.type = ProcessorMessage::Callback;
+    new (msg.callback_storage) ProcessorMessage::CallbackFunction(move(callback));
+    smp_unicast_message(cpu, msg, async);
+}
+
+void Processor::flush_tlb(const PageDirectory* page_directory, VirtualAddress vaddr, size_t page_count)
+{
+    if (s_smp_enabled && (!is_user_address(vaddr) || Process::current()->thread_count() > 1))
+        smp_broadcast_flush_tlb(page_directory, vaddr, page_count);
+    else
+        flush_tlb_local(vaddr, page_count);
+}
+
+void Processor::smp_broadcast_flush_tlb(const PageDirectory* page_directory, VirtualAddress vaddr, size_t page_count)
+{
+    auto& msg = smp_get_from_pool();
+    msg.async = false;
+    msg.type = ProcessorMessage::FlushTlb;
+    msg.flush_tlb.page_directory = page_directory;
+    msg.flush_tlb.ptr = vaddr.as_ptr();
+    msg.flush_tlb.page_count = page_count;
+    smp_broadcast_message(msg);
+    // Ours while the others do theirs.
+    flush_tlb_local(vaddr, page_count);
+    smp_broadcast_wait_sync(msg);
+}
+
+void Processor::smp_broadcast_halt()
+{
+    // Without a message, this may come from being out of memory.
+    for_each([&](Processor& proc) {
+        proc.m_halt_requested.store(true, Base::MemoryOrder::memory_order_release);
+    });
+
+    APIC::the().broadcast_ipi();
+}
+
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/arch/x86/SMPBoot.h>
+#include <kernel/BootProfiler.h>
+#include <kernel/IO.h>
+#include <kernel/Sections.h>
+#include <kernel/vm/MemoryManager.h>
+
+namespace Kernel {
+
+#define ICR_DELIVERY_MODE_INIT (5 << 8)
+#define ICR_DELIVERY_MODE_STARTUP (6 << 8)
+#define ICR_LEVEL_ASSERT (1 << 14)
+#define ICR_TRIGGER_MODE_LEVEL (1 << 15)
+#define ICR_ALL_EXCLUDING_SELF (3 << 18)
+
+READONLY_AFTER_INIT static u32 s_ap_count;
+READONLY_AFTER_INIT static Region* s_init_stacks;
+READONLY_AFTER_INIT static FlatPtr* s_init_stack_tops;
+READONLY_AFTER_INIT static Processor* s_processors;
+
+static Atomic<u32> s_aps_online { 0 };
+
+UNMAP_AFTER_INIT bool SMPBoot::prepare(u32 ap_count)
+{
+    VERIFY(!s_ap_count);
+    if (!ap_count)
+        return false;
+
+    auto stacks = MM.allocate_kernel_region(ap_count * init_stack_size, "AP init stacks", Region::Access::Read | Region::Access::Write, AllocationStrategy::AllocateNow);
+    auto* stack_tops = new (nothrow) FlatPtr[ap_count];
+    auto* processors = new (nothrow) Processor[ap_count];
+    if (!stacks || !stack_tops || !processors) {
+        delete[] stack_tops;
+        delete[] processors;
+        return false;
+    }
+
+    for (u32 i = 0; i < ap_count; i++)
+        stack_tops[i] = stacks->vaddr().offset((i + 1) * init_stack_size).get();
+
+    s_init_stacks = stacks.leak_ptr();
+    s_init_stack_tops = stack_tops;
+    s_processors = processors;
+    s_ap_count = ap_count;
+    return true;
+}
+
+u32 SMPBoot::ap_count()
+{
+    return s_ap_count;
+}
+
+FlatPtr const* SMPBoot::init_stack_tops()
+{
+    return s_init_stack_tops;
+}
+
+Processor& SMPBoot::processor_for(u32 cpu)
+{
+    VERIFY(cpu >= 1 && cpu <= s_ap_count);
+    return s_processors[cpu - 1];
+}
+
+UNMAP_AFTER_INIT void SMPBoot::start_all(u8 trampoline_page, void (*write_icr)(u32))
+{
+    BootPhase phase("SMPBoot::start_all");
+    VERIFY(s_ap_count);
+    write_icr(ICR_ALL_EXCLUDING_SELF | ICR_TRIGGER_MODE_LEVEL | ICR_LEVEL_ASSERT | ICR_DELIVERY_MODE_INIT);
+    IO::delay(10 * 1000);
+
+    // Processors that already started ignore the second SIPI.
+    for (int i = 0; i < 2; i++) {
+        write_icr(ICR_ALL_EXCLUDING_SELF | ICR_LEVEL_ASSERT | ICR_DELIVERY_MODE_STARTUP | trampoline_page);
+        IO::delay(200);
+    }
+}
+
+UNMAP_AFTER_INIT void SMPBoot::ap_online()
+{
+    s_aps_online.fetch_add(1, Base::memory_order_acq_rel);
+}
+
+UNMAP_AFTER_INIT bool SMPBoot::wait_until_online(u32 timeout_ms)
+{
+    BootPhase phase("SMPBoot::wait_until_online");
+    for (u32 waited_us = 0; s_aps_online.load(Base::memory_order_acquire) < s_ap_count; waited_us += 100) {
+        if (waited_us >= timeout_ms * 1000) {
+            dmesgln("SMP: Only {} of {} application processors came up", s_aps_online.load(), s_ap_count);
+            return false;
+        }
+        IO::delay(100);
+    }
+    dmesgln("SMP: {} application processors online", s_ap_count);
+    return true;
+}
+
+}
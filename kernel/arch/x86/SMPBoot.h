@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Atomic.h>
+#include <base/Types.h>
+
+namespace Kernel {
+
+class Processor;
+
+// Starts every application processor at once instead of one after the
+// other.
+//
+// Everything the APs need is set aside up front: their init stacks in one
+// kernel region and their Processor structures, GDT included, in one
+// array. A single broadcast INIT-SIPI-SIPI then starts them all, each AP
+// takes the next free slot with a locked increment in the trampoline and
+// runs its per-CPU setup concurrently with the others. The bootstrap
+// processor only waits once, for all of them to check in.
+class SMPBoot {
+public:
+    static constexpr size_t init_stack_size = 64 * KiB;
+
+    static bool prepare(u32 ap_count);
+    static u32 ap_count();
+
+    // One stack top per AP, for the trampoline to pick from.
+    static FlatPtr const* init_stack_tops();
+    // cpu counts from 1, 0 is the bootstrap processor.
+    static Processor& processor_for(u32 cpu);
+
+    // Broadcasts INIT, then the two SIPIs pointing at the trampoline, to
+    // every processor but this one. write_icr writes the low half of the
+    // ICR, in whichever mode the local APIC is.
+    static void start_all(u8 trampoline_page, void (*write_icr)(u32));
+
+    // Called by each AP once its per-CPU setup is done. It then takes part
+    // in the rest of the boot with InitcallGraph::help_running_graph().
+    static void ap_online();
+    // The final barrier, false if some APs never checked in.
+    static bool wait_until_online(u32 timeout_ms);
+};
+
+}
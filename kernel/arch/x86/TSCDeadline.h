@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+#include <kernel/arch/x86/CPUID.h>
+#include <kernel/arch/x86/MSR.h>
+#include <kernel/arch/x86/X2APIC.h>
+
+namespace Kernel {
+
+// The local APIC timer in TSC-deadline mode fires once when the TSC reaches
+// the value written to IA32_TSC_DEADLINE, with no divider or initial count
+// to calibrate. Writing 0 disarms it.
+class TSCDeadline {
+public:
+    static constexpr u32 MSR_IA32_TSC_DEADLINE = 0x6e0;
+    static constexpr u32 MSR_LVT_TIMER = 0x832;
+    static constexpr u32 LVT_TIMER_MODE_TSC_DEADLINE = 2 << 17;
+
+    // The LVT is only programmed through its x2APIC MSR here, the xAPIC
+    // MMIO window belongs to the APIC driver.
+    static bool is_supported()
+    {
+        CPUID id(1);
+        return (id.ecx() & (1 << 24)) != 0 && X2APIC::is_enabled();
+    }
+
+    // Every CPU sets up its own LVT.
+    static void enable(u8 vector)
+    {
+        MSR lvt(MSR_LVT_TIMER);
+        lvt.set(LVT_TIMER_MODE_TSC_DEADLINE | vector);
+        // The SDM asks for a fence between switching the mode and the first
+        // write of the deadline.
+        asm volatile("mfence" ::
+                         : "memory");
+    }
+
+    static void arm(u64 tsc)
+    {
+        MSR deadline(MSR_IA32_TSC_DEADLINE);
+        // 0 would disarm it, and anything in the past fires right away.
+        deadline.set(tsc ? tsc : 1);
+    }
+
+    static void disarm()
+    {
+        MSR deadline(MSR_IA32_TSC_DEADLINE);
+        deadline.set(0);
+    }
+};
+
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+#include <kernel/arch/x86/CPUID.h>
+#include <kernel/arch/x86/MSR.h>
+
+namespace Kernel {
+
+// The x2APIC exposes the local APIC through MSRs instead of MMIO. Sending
+// an IPI is a single 64-bit write of the ICR, with no second register for
+// the destination and no delivery status to poll.
+class X2APIC {
+public:
+    static constexpr u32 IA32_APIC_BASE = 0x1b;
+    static constexpr u64 IA32_APIC_BASE_ENABLE = 1 << 11;
+    static constexpr u64 IA32_APIC_BASE_X2APIC_ENABLE = 1 << 10;
+
+    static constexpr u32 MSR_ID = 0x802;
+    static constexpr u32 MSR_EOI = 0x80b;
+    static constexpr u32 MSR_LOGICAL_DESTINATION = 0x80d;
+    static constexpr u32 MSR_ICR = 0x830;
+
+    static constexpr u64 ICR_DESTINATION_LOGICAL = 1 << 11;
+    static constexpr u64 ICR_LEVEL_ASSERT = 1 << 14;
+    static constexpr u64 ICR_ALL_EXCLUDING_SELF = 3 << 18;
+
+    static bool is_supported()
+    {
+        CPUID id(1);
+        return (id.ecx() & (1 << 21)) != 0;
+    }
+
+    static bool is_enabled()
+    {
+        MSR apic_base(IA32_APIC_BASE);
+        return (apic_base.get() & IA32_APIC_BASE_X2APIC_ENABLE) != 0;
+    }
+
+    // Going from xAPIC to x2APIC is allowed with the APIC enabled, the
+    // other way round needs a trip through the disabled state.
+    static void enable()
+    {
+        MSR apic_base(IA32_APIC_BASE);
+        apic_base.set(apic_base.get() | IA32_APIC_BASE_ENABLE | IA32_APIC_BASE_X2APIC_ENABLE);
+    }
+
+    static u32 id()
+    {
+        MSR id_register(MSR_ID);
+        return id_register.get();
+    }
+
+    // The logical ID is fixed by the hardware in x2APIC mode: the cluster
+    // (x2APIC ID / 16) in the upper half, a one-hot bit for the CPU's
+    // position in the cluster in the lower half.
+    static u32 logical_id()
+    {
+        MSR ldr(MSR_LOGICAL_DESTINATION);
+        return ldr.get();
+    }
+
+    static constexpr u32 cluster_of(u32 logical_id) { return logical_id >> 16; }
+
+    static void send_ipi(u32 x2apic_id, u8 vector)
+    {
+        write_icr(((u64)x2apic_id << 32) | ICR_LEVEL_ASSERT | vector);
+    }
+
+    // One write reaches every CPU of a cluster whose bit is in the mask,
+    // a multicast needs a write per cluster rather than per target.
+    static void send_ipi_to_cluster(u32 cluster, u16 member_mask, u8 vector)
+    {
+        u64 destination = ((u64)cluster << 16) | member_mask;
+        write_icr((destination << 32) | ICR_DESTINATION_LOGICAL | ICR_LEVEL_ASSERT | vector);
+    }
+
+    static void broadcast_ipi(u8 vector)
+    {
+        write_icr(ICR_ALL_EXCLUDING_SELF | ICR_LEVEL_ASSERT | vector);
+    }
+
+    static void eoi()
+    {
+        MSR eoi_register(MSR_EOI);
+        eoi_register.set(0);
+    }
+
+private:
+    static void write_icr(u64 value)
+    {
+        MSR icr(MSR_ICR);
+        icr.set(value);
+    }
+};
+
+}
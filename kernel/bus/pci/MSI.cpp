@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Atomic.h>
+#include <base/Vector.h>
+#include <kernel/arch/x86/CPU.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/bus/pci/MSI.h>
+#include <kernel/interrupts/APIC.h>
+#include <kernel/SpinLock.h>
+#include <kernel/vm/MemoryManager.h>
+
+namespace Kernel::PCI {
+
+static constexpr u8 capability_id_msi = 0x05;
+static constexpr u8 capability_id_msix = 0x11;
+
+static constexpr u32 field_command = 0x04;
+static constexpr u32 field_status = 0x06;
+static constexpr u32 field_capabilities_pointer = 0x34;
+
+static constexpr u16 command_interrupt_disable = 1 << 10;
+static constexpr u16 status_capabilities_list = 1 << 4;
+
+static constexpr u16 msi_control_enable = 1 << 0;
+static constexpr u16 msi_control_multiple_message_enable = 0x7 << 4;
+static constexpr u16 msi_control_64bit = 1 << 7;
+static constexpr u16 msi_control_per_vector_masking = 1 << 8;
+
+static constexpr u16 msix_control_function_mask = 1 << 14;
+static constexpr u16 msix_control_enable = 1 << 15;
+static constexpr size_t msix_entry_size = 16;
+static constexpr u32 msix_vector_control_mask = 1 << 0;
+
+// Physical destination mode, fixed delivery, edge triggered. Only 8 bits
+// of APIC ID fit in the address without interrupt remapping.
+static constexpr u32 message_address_base = 0xfee00000;
+static constexpr u32 max_message_apic_id = 0xff;
+
+// Above the interrupt numbers of the I/O APIC pins and below the syscall
+// gate and the IPIs, vectors 0x90 to 0xdf.
+static constexpr u8 first_msi_interrupt_number = 0x40;
+static constexpr u8 msi_interrupt_number_count = 0x50;
+static_assert(IRQ_VECTOR_BASE + first_msi_interrupt_number + msi_interrupt_number_count <= 0xe0);
+
+static SpinLock<u8> s_lock;
+static u64 s_used_interrupt_numbers[(msi_interrupt_number_count + 63) / 64];
+static Vector<MessageSignaledInterrupt*>* s_enabled;
+static Atomic<u32> s_next_cpu;
+
+static Optional<u8> allocate_interrupt_number()
+{
+    ScopedSpinLock lock(s_lock);
+    for (u8 i = 0; i < msi_interrupt_number_count; ++i) {
+        u64& word = s_used_interrupt_numbers[i / 64];
+        if (word & (1ull << (i % 64)))
+            continue;
+        word |= 1ull << (i % 64);
+        return first_msi_interrupt_number + i;
+    }
+    return {};
+}
+
+static void free_interrupt_number(u8 interrupt_number)
+{
+    ScopedSpinLock lock(s_lock);
+    u8 i = interrupt_number - first_msi_interrupt_number;
+    s_used_interrupt_numbers[i / 64] &= ~(1ull << (i % 64));
+}
+
+static Optional<u8> find_capability(Address address, u8 id)
+{
+    if (!(read16(address, field_status) & status_capabilities_list))
+        return {};
+    u8 pointer = read8(address, field_capabilities_pointer) & ~0x3;
+    // Capabilities are in the 192 bytes after the header, a loop in a
+    // broken list ends after that many.
+    for (size_t i = 0; pointer && i < 48; ++i) {
+        if (read8(address, pointer) == id)
+            return pointer;
+        pointer = read8(address, pointer + 1) & ~0x3;
+    }
+    return {};
+}
+
+static bool can_target(u32 cpu)
+{
+    return cpu < Processor::count() && Processor::by_id(cpu).info().apic_id() <= max_message_apic_id;
+}
+
+// Round robin, so devices that enable one after the other don't all end up
+// on the boot processor like the I/O APIC pins do.
+static u32 pick_cpu(Optional<u32> cpu)
+{
+    if (cpu.has_value() && can_target(cpu.value()))
+        return cpu.value();
+    for (u32 i = 0; i < Processor::count(); ++i) {
+        u32 candidate = s_next_cpu++ % Processor::count();
+        if (can_target(candidate))
+            return candidate;
+    }
+    return 0;
+}
+
+OwnPtr<MessageSignaledInterrupt> MessageSignaledInterrupt::try_enable(Address address, IRQHandler& device, Optional<u32> cpu)
+{
+    bool msix = true;
+    auto capability = find_capability(address, capability_id_msix);
+    if (!capability.has_value()) {
+        msix = false;
+        capability = find_capability(address, capability_id_msi);
+    }
+    if (!capability.has_value())
+        return {};
+
+    auto interrupt_number = allocate_interrupt_number();
+    if (!interrupt_number.has_value()) {
+        dmesgln("PCI: {} has {}, but no vector is left for it", address, msix ? "MSI-X" : "MSI");
+        return {};
+    }
+
+    auto handler = adopt_own_if_nonnull(new (nothrow) MessageSignaledInterrupt(interrupt_number.value(), address, device, capability.value(), msix, pick_cpu(cpu)));
+    if (!handler) {
+        free_interrupt_number(interrupt_number.value());
+        return {};
+    }
+    if (msix && !handler->map_msix_table())
+        return {};
+
+    handler->register_interrupt_handler();
+
+    // The pin must not fire as well, and both kinds of messages can't be
+    // enabled at once.
+    write16(address, field_command, read16(address, field_command) | command_interrupt_disable);
+
+    u8 cap = capability.value();
+    if (msix) {
+        u16 control = read16(address, cap + 2);
+        write16(address, cap + 2, control | msix_control_enable | msix_control_function_mask);
+        handler->write_message();
+        handler->mask(false);
+        write16(address, cap + 2, (control | msix_control_enable) & ~msix_control_function_mask);
+    } else {
+        u16 control = read16(address, cap + 2);
+        handler->write_message();
+        if (control & msi_control_per_vector_masking)
+            handler->mask(false);
+        // One message only, so a single vector is enough.
+        write16(address, cap + 2, (control & ~msi_control_multiple_message_enable) | msi_control_enable);
+    }
+
+    {
+        ScopedSpinLock lock(s_lock);
+        if (!s_enabled)
+            s_enabled = new Vector<MessageSignaledInterrupt*>;
+        s_enabled->append(handler.ptr());
+    }
+
+    dmesgln("PCI: {} interrupts through {} on vector {:#02x}, CPU #{}", address, handler->controller(), IRQ_VECTOR_BASE + handler->interrupt_number(), handler->cpu());
+    return handler;
+}
+
+MessageSignaledInterrupt::MessageSignaledInterrupt(u8 interrupt_number, Address address, IRQHandler& device, u8 capability, bool msix, u32 cpu)
+    : GenericInterruptHandler(interrupt_number, true)
+    , m_device(device)
+    , m_address(address)
+    , m_capability(capability)
+    , m_msix(msix)
+    , m_cpu(cpu)
+{
+}
+
+MessageSignaledInterrupt::~MessageSignaledInterrupt()
+{
+    {
+        ScopedSpinLock lock(s_lock);
+        if (s_enabled)
+            s_enabled->remove_first_matching([&](auto* entry) { return entry == this; });
+    }
+
+    if (is_registered()) {
+        u16 control = read16(m_address, m_capability + 2);
+        if (m_msix)
+            write16(m_address, m_capability + 2, control & ~msix_control_enable);
+        else
+            write16(m_address, m_capability + 2, control & ~msi_control_enable);
+        write16(m_address, field_command, read16(m_address, field_command) & ~command_interrupt_disable);
+        unregister_interrupt_handler();
+    }
+    free_interrupt_number(interrupt_number());
+}
+
+bool MessageSignaledInterrupt::map_msix_table()
+{
+    u32 table = read32(m_address, m_capability + 4);
+    u8 bar = table & 0x7;
+    u32 offset = table & ~0x7;
+    if (bar > 5)
+        return false;
+
+    u64 bar_value = get_BAR(m_address, bar);
+    PhysicalAddress bar_base(bar_value & ~0xf);
+    if (((bar_value >> 1) & 0x3) == 0x2 && bar < 5)
+        bar_base = PhysicalAddress(bar_base.get() | ((u64)get_BAR(m_address, bar + 1) << 32));
+
+    auto entry = bar_base.offset(offset);
+    m_msix_table_offset_in_page = entry.offset_in_page();
+    m_msix_table = MM.allocate_kernel_region(entry.page_base(), page_round_up(m_msix_table_offset_in_page + msix_entry_size), "MSI-X Table", Region::Access::Read | Region::Access::Write, Region::Cacheable::No);
+    return m_msix_table;
+}
+
+void MessageSignaledInterrupt::write_message()
+{
+    u32 apic_id = Processor::by_id(m_cpu).info().apic_id();
+    u32 message_address = message_address_base | (apic_id << 12);
+    u16 message_data = IRQ_VECTOR_BASE + interrupt_number();
+
+    if (m_msix) {
+        auto* entry = reinterpret_cast<u32 volatile*>(m_msix_table->vaddr().offset(m_msix_table_offset_in_page).as_ptr());
+        entry[0] = message_address;
+        entry[1] = 0;
+        entry[2] = message_data;
+        return;
+    }
+
+    u16 control = read16(m_address, m_capability + 2);
+    write32(m_address, m_capability + 4, message_address);
+    if (control & msi_control_64bit) {
+        write32(m_address, m_capability + 8, 0);
+        write16(m_address, m_capability + 0xc, message_data);
+    } else {
+        write16(m_address, m_capability + 8, message_data);
+    }
+}
+
+void MessageSignaledInterrupt::mask(bool masked)
+{
+    if (m_msix) {
+        auto* entry = reinterpret_cast<u32 volatile*>(m_msix_table->vaddr().offset(m_msix_table_offset_in_page).as_ptr());
+        entry[3] = masked ? (entry[3] | msix_vector_control_mask) : (entry[3] & ~msix_vector_control_mask);
+        return;
+    }
+
+    u16 control = read16(m_address, m_capability + 2);
+    if (!(control & msi_control_per_vector_masking))
+        return;
+    u32 field = m_capability + ((control & msi_control_64bit) ? 0x10 : 0xc);
+    u32 bits = read32(m_address, field);
+    write32(m_address, field, masked ? (bits | 1) : (bits & ~1u));
+}
+
+void MessageSignaledInterrupt::set_cpu(u32 cpu)
+{
+    if (!can_target(cpu) || cpu == m_cpu)
+        return;
+    // Without masking the device could send half of the old message and
+    // half of the new one. MSI without per vector masking can't be
+    // masked, the address and data writes are close enough there.
+    mask(true);
+    m_cpu = cpu;
+    write_message();
+    mask(false);
+}
+
+bool MessageSignaledInterrupt::handle_interrupt(const RegisterState& regs)
+{
+    u32 cpu = Processor::id();
+    if (cpu < max_counted_cpus)
+        ++m_counts[cpu];
+    increment_invoking_counter();
+    return m_device.handle_irq(regs);
+}
+
+bool MessageSignaledInterrupt::eoi()
+{
+    APIC::the().eoi();
+    return true;
+}
+
+void MessageSignaledInterrupt::for_each(Function<void(MessageSignaledInterrupt const&)> callback)
+{
+    ScopedSpinLock lock(s_lock);
+    if (!s_enabled)
+        return;
+    for (auto* handler : *s_enabled)
+        callback(*handler);
+}
+
+void MessageSignaledInterrupt::dump_counts()
+{
+    for_each([](auto& handler) {
+        dmesgln("{} {} vector {:#02x}, CPU #{}:", handler.address(), handler.controller(), IRQ_VECTOR_BASE + handler.interrupt_number(), handler.cpu());
+        for (u32 cpu = 0; cpu < min((size_t)Processor::count(), max_counted_cpus); ++cpu) {
+            if (auto count = handler.count_on(cpu))
+                dmesgln("    CPU #{}: {}", cpu, count);
+        }
+    });
+}
+
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Function.h>
+#include <base/Optional.h>
+#include <base/OwnPtr.h>
+#include <base/Types.h>
+#include <kernel/bus/pci/Access.h>
+#include <kernel/interrupts/GenericInterruptHandler.h>
+#include <kernel/interrupts/IRQHandler.h>
+#include <kernel/vm/Region.h>
+
+namespace Kernel::PCI {
+
+// A vector of its own for the first MSI or MSI-X message of a device.
+// Unlike the interrupt pin it is never shared with other devices and goes
+// to the one CPU picked here, not wherever the I/O APIC sends the line. The
+// message is edge triggered, the local APIC is the only thing to send an
+// EOI to.
+class MessageSignaledInterrupt final : public GenericInterruptHandler {
+public:
+    // MSI-X when the device has it, MSI otherwise. Returns nullptr when it
+    // has neither or no vector is free, the caller then uses the pin. The
+    // handle_irq() of the device is called on the CPU the message goes to,
+    // without a CPU the devices are spread over all of them.
+    static OwnPtr<MessageSignaledInterrupt> try_enable(Address, IRQHandler& device, Optional<u32> cpu = {});
+
+    virtual ~MessageSignaledInterrupt() override;
+
+    // Sends the message to another CPU from now on. One in flight may still
+    // arrive at the old one.
+    void set_cpu(u32 cpu);
+    u32 cpu() const { return m_cpu; }
+
+    bool is_msix() const { return m_msix; }
+    Address address() const { return m_address; }
+
+    // How many times the device interrupted each CPU. Only that CPU writes
+    // its count, reading it from elsewhere may be a message behind.
+    static constexpr size_t max_counted_cpus = 64;
+    u64 count_on(u32 cpu) const { return cpu < max_counted_cpus ? m_counts[cpu] : 0; }
+
+    static void for_each(Function<void(MessageSignaledInterrupt const&)>);
+    static void dump_counts();
+
+    virtual bool handle_interrupt(const RegisterState&) override;
+    virtual bool eoi() override;
+
+    virtual HandlerType type() const override { return HandlerType::IRQHandler; }
+    virtual StringView purpose() const override { return m_device.purpose(); }
+    virtual StringView controller() const override { return m_msix ? "MSI-X"sv : "MSI"sv; }
+    virtual size_t sharing_devices_count() const override { return 0; }
+    virtual bool is_shared_handler() const override { return false; }
+    virtual bool is_sharing_with_others() const override { return false; }
+
+private:
+    MessageSignaledInterrupt(u8 interrupt_number, Address, IRQHandler& device, u8 capability, bool msix, u32 cpu);
+
+    bool map_msix_table();
+    void write_message();
+    void mask(bool);
+
+    IRQHandler& m_device;
+    Address m_address;
+    u8 m_capability { 0 };
+    bool m_msix { false };
+    u32 m_cpu { 0 };
+
+    // The MSI-X table, entry 0 is the one in use.
+    OwnPtr<Region> m_msix_table;
+    size_t m_msix_table_offset_in_page { 0 };
+
+    u64 m_counts[max_counted_cpus] {};
+};
+
+}
@@ -8,6 +8,7 @@
 #include <base/JsonArraySerializer.h>
 #include <base/JsonObjectSerializer.h>
 #include <base/Platform.h>
+#include <base/Stopwatch.h>
 #include <kernel/bus/usb/UHCIController.h>
 #include <kernel/bus/usb/USBRequest.h>
 #include <kernel/CommandLine.h>
@@ -18,11 +19,10 @@
 #include <kernel/Sections.h>
 #include <kernel/StdLib.h>
 #include <kernel/time/TimeManagement.h>
+#include <kernel/Tracing.h>
 #include <kernel/vm/AnonymousVMObject.h>
 #include <kernel/vm/MemoryManager.h>
 
-static constexpr u8 MAXIMUM_NUMBER_OF_TDS = 128; 
-static constexpr u8 MAXIMUM_NUMBER_OF_QHS = 64;
 static constexpr u8 RETRY_COUNTER_RELOAD = 3;
 
 namespace Kernel::USB {
@@ -53,7 +53,6 @@ static constexpr u8 UHCI_USBINTR_SHORT_PACKET_INTR_ENABLE = 0x08;
 static constexpr u16 UHCI_FRAMELIST_FRAME_COUNT = 1024; 
 static constexpr u16 UHCI_FRAMELIST_FRAME_INVALID = 0x0001;
 
-static constexpr u8 UHCI_ROOT_PORT_COUNT = 2;
 static constexpr u16 UHCI_PORTSC_CURRRENT_CONNECT_STATUS = 0x0001;
 static constexpr u16 UHCI_PORTSC_CONNECT_STATUS_CHANGED = 0x0002;
 static constexpr u16 UHCI_PORTSC_PORT_ENABLED = 0x0004;
@@ -241,8 +240,14 @@ UNMAP_AFTER_INIT UHCIController::UHCIController(PCI::Address address, PCI::ID id
     dmesgln("UHCI: I/O base {}", m_io_base);
     dmesgln("UHCI: Interrupt line: {}", PCI::get_interrupt_line(pci_address()));
 
+    for (u8 port = 0; port < root_port_count; port++)
+        m_port_work[port] = make<WorkItem>([this, port] { handle_port_change(port); });
+
     reset();
     start();
+
+    write_usbintr(UHCI_USBINTR_TIMEOUT_CRC_ENABLE | UHCI_USBINTR_RESUME_INTR_ENABLE | UHCI_USBINTR_IOC_ENABLE | UHCI_USBINTR_SHORT_PACKET_INTR_ENABLE);
+    enable_irq();
 }
 
 UNMAP_AFTER_INIT UHCIController::~UHCIController()
@@ -251,14 +256,13 @@ UNMAP_AFTER_INIT UHCIController::~UHCIController()
 
 RefPtr<USB::Device> const UHCIController::get_device_at_port(USB::Device::PortNumber port)
 {
-    if (!m_devices.at(to_underlying(port)))
-        return nullptr;
-
+    ScopedSpinLock lock(m_devices_lock);
     return m_devices.at(to_underlying(port));
 }
 
 RefPtr<USB::Device> const UHCIController::get_device_from_address(u8 device_address)
 {
+    ScopedSpinLock lock(m_devices_lock);
     for (auto const& device : m_devices) {
         if (!device)
             continue;
@@ -300,26 +304,27 @@ void UHCIController::reset()
 
 UNMAP_AFTER_INIT void UHCIController::create_structures()
 {
-    auto qh_pool_vmobject = AnonymousVMObject::try_create_physically_contiguous_with_size(2 * PAGE_SIZE);
-    m_qh_pool = MemoryManager::the().allocate_kernel_region_with_vmobject(*qh_pool_vmobject, 2 * PAGE_SIZE, "UHCI Queue Head Pool", Region::Access::Write);
-    memset(m_qh_pool->vaddr().as_ptr(), 0, 2 * PAGE_SIZE); 
+    m_queue_head_pool = UHCIDescriptorPool<QueueHead>::try_create("UHCI Queue Head Pool"sv);
+    VERIFY(m_queue_head_pool);
+    m_transfer_descriptor_pool = UHCIDescriptorPool<TransferDescriptor>::try_create("UHCI Transfer Descriptor Pool"sv);
+    VERIFY(m_transfer_descriptor_pool);
 
-    m_free_qh_pool.resize(MAXIMUM_NUMBER_OF_TDS);
-    for (size_t i = 0; i < m_free_qh_pool.size(); i++) {
-        auto placement_addr = reinterpret_cast<void*>(m_qh_pool->vaddr().get() + (i * sizeof(QueueHead)));
-        auto paddr = static_cast<u32>(m_qh_pool->physical_page(0)->paddr().get() + (i * sizeof(QueueHead)));
-        m_free_qh_pool.at(i) = new (placement_addr) QueueHead(paddr);
-    }
+    // Every pending transfer owns a queue head, so this never has to grow
+    // while the interrupt handler might be looking at it.
+    m_pending_transfers.ensure_capacity(UHCIDescriptorPool<QueueHead>::max_descriptors);
 
     m_interrupt_transfer_queue = allocate_queue_head();
+    m_interrupt_qh_skeleton[0] = m_interrupt_transfer_queue;
+    for (size_t i = 1; i < interrupt_skeleton_size; i++)
+        m_interrupt_qh_skeleton[i] = allocate_queue_head();
     m_lowspeed_control_qh = allocate_queue_head();
     m_fullspeed_control_qh = allocate_queue_head();
     m_bulk_qh = allocate_queue_head();
     m_dummy_qh = allocate_queue_head();
 
-    auto td_pool_vmobject = AnonymousVMObject::try_create_physically_contiguous_with_size(2 * PAGE_SIZE);
-    m_td_pool = MemoryManager::the().allocate_kernel_region_with_vmobject(*td_pool_vmobject, 2 * PAGE_SIZE, "UHCI Transfer Descriptor Pool", Region::Access::Write);
-    memset(m_td_pool->vaddr().as_ptr(), 0, 2 * PAGE_SIZE);
+    auto td_pool_vmobject = AnonymousVMObject::try_create_physically_contiguous_with_size(PAGE_SIZE);
+    m_td_pool = MemoryManager::the().allocate_kernel_region_with_vmobject(*td_pool_vmobject, PAGE_SIZE, "UHCI Isochronous Transfer Descriptors", Region::Access::Write);
+    memset(m_td_pool->vaddr().as_ptr(), 0, PAGE_SIZE);
 
     m_iso_td_list.resize(UHCI_NUMBER_OF_ISOCHRONOUS_TDS);
     for (size_t i = 0; i < m_iso_td_list.size(); i++) {
@@ -330,34 +335,29 @@ UNMAP_AFTER_INIT void UHCIController::create_structures()
         auto transfer_descriptor = m_iso_td_list.at(i);
         transfer_descriptor->set_in_use(true);
         transfer_descriptor->set_isochronous();
-        transfer_descriptor->link_queue_head(m_interrupt_transfer_queue->paddr());
 
         if constexpr (UHCI_VERBOSE_DEBUG)
             transfer_descriptor->print();
     }
 
-    m_free_td_pool.resize(MAXIMUM_NUMBER_OF_TDS);
-    for (size_t i = 0; i < m_free_td_pool.size(); i++) {
-        auto placement_addr = reinterpret_cast<void*>(m_td_pool->vaddr().offset(PAGE_SIZE).get() + (i * sizeof(Kernel::USB::TransferDescriptor)));
-        auto paddr = static_cast<u32>(m_td_pool->physical_page(1)->paddr().get() + (i * sizeof(Kernel::USB::TransferDescriptor)));
-
-        m_free_td_pool.at(i) = new (placement_addr) Kernel::USB::TransferDescriptor(paddr);
-
-        if constexpr (UHCI_VERBOSE_DEBUG) {
-            auto transfer_descriptor = m_free_td_pool.at(i);
-            transfer_descriptor->print();
-        }
-    }
-
     if constexpr (UHCI_DEBUG) {
         dbgln("UHCI: Pool information:");
-        dbgln("    qh_pool: {}, length: {}", PhysicalAddress(m_qh_pool->physical_page(0)->paddr()), m_qh_pool->range().size());
-        dbgln("    td_pool: {}, length: {}", PhysicalAddress(m_td_pool->physical_page(0)->paddr()), m_td_pool->range().size());
+        dbgln("    qh_pool: capacity: {}", m_queue_head_pool->capacity());
+        dbgln("    td_pool: capacity: {}", m_transfer_descriptor_pool->capacity());
+        dbgln("    iso_td_list: {}, length: {}", PhysicalAddress(m_td_pool->physical_page(0)->paddr()), m_td_pool->range().size());
     }
 }
 
 UNMAP_AFTER_INIT void UHCIController::setup_schedule()
 {
+    // The interrupt skeleton is a chain from the longest polling interval
+    // down to the shortest, a frame enters it at the longest interval that
+    // divides its number and so runs every queue whose interval is due.
+    for (size_t i = interrupt_skeleton_size - 1; i > 0; i--) {
+        m_interrupt_qh_skeleton[i]->link_next_queue_head(m_interrupt_qh_skeleton[i - 1]);
+        m_interrupt_qh_skeleton[i]->terminate_element_link_ptr();
+    }
+
     m_interrupt_transfer_queue->link_next_queue_head(m_lowspeed_control_qh);
     m_interrupt_transfer_queue->terminate_element_link_ptr();
 
@@ -378,6 +378,11 @@ UNMAP_AFTER_INIT void UHCIController::setup_schedule()
     m_dummy_qh->terminate_with_stray_descriptor(piix4_td_hack);
     m_dummy_qh->terminate_element_link_ptr();
 
+    for (size_t i = 0; i < m_iso_td_list.size(); i++) {
+        size_t skeleton_index = min<size_t>(count_trailing_zeroes_32_safe(i), interrupt_skeleton_size - 1);
+        m_iso_td_list.at(i)->link_queue_head(m_interrupt_qh_skeleton[skeleton_index]->paddr());
+    }
+
     u32* framelist = reinterpret_cast<u32*>(m_framelist->vaddr().as_ptr());
     for (int frame = 0; frame < UHCI_NUMBER_OF_FRAMES; frame++) {
 
@@ -391,30 +396,34 @@ UNMAP_AFTER_INIT void UHCIController::setup_schedule()
     m_dummy_qh->print();
 }
 
-QueueHead* UHCIController::allocate_queue_head() const
+QueueHead* UHCIController::allocate_queue_head()
 {
-    for (QueueHead* queue_head : m_free_qh_pool) {
-        if (!queue_head->in_use()) {
-            queue_head->set_in_use(true);
-            dbgln_if(UHCI_DEBUG, "UHCI: Allocated a new Queue Head! Located @ {} ({})", VirtualAddress(queue_head), PhysicalAddress(queue_head->paddr()));
-            return queue_head;
-        }
-    }
+    QueueHead* queue_head = m_queue_head_pool->try_take_free_descriptor();
+    if (!queue_head)
+        return nullptr;
 
-    return nullptr; 
+    VERIFY(!queue_head->in_use());
+    queue_head->set_in_use(true);
+    dbgln_if(UHCI_DEBUG, "UHCI: Allocated a new Queue Head! Located @ {} ({})", VirtualAddress(queue_head), PhysicalAddress(queue_head->paddr()));
+    return queue_head;
 }
 
-TransferDescriptor* UHCIController::allocate_transfer_descriptor() const
+TransferDescriptor* UHCIController::allocate_transfer_descriptor()
 {
-    for (TransferDescriptor* transfer_descriptor : m_free_td_pool) {
-        if (!transfer_descriptor->in_use()) {
-            transfer_descriptor->set_in_use(true);
-            dbgln_if(UHCI_DEBUG, "UHCI: Allocated a new Transfer Descriptor! Located @ {} ({})", VirtualAddress(transfer_descriptor), PhysicalAddress(transfer_descriptor->paddr()));
-            return transfer_descriptor;
-        }
-    }
+    TransferDescriptor* transfer_descriptor = m_transfer_descriptor_pool->try_take_free_descriptor();
+    if (!transfer_descriptor)
+        return nullptr;
 
-    return nullptr; 
+    VERIFY(!transfer_descriptor->in_use());
+    transfer_descriptor->set_in_use(true);
+    dbgln_if(UHCI_DEBUG, "UHCI: Allocated a new Transfer Descriptor! Located @ {} ({})", VirtualAddress(transfer_descriptor), PhysicalAddress(transfer_descriptor->paddr()));
+    return transfer_descriptor;
+}
+
+void UHCIController::free_queue_head(QueueHead& queue_head)
+{
+    queue_head.free();
+    m_queue_head_pool->release_to_pool(&queue_head);
 }
 
 void UHCIController::stop()
@@ -511,13 +520,17 @@ void UHCIController::free_descriptor_chain(TransferDescriptor* first_descriptor)
     TransferDescriptor* descriptor = first_descriptor;
 
     while (descriptor) {
+        auto* next_descriptor = descriptor->next_td();
         descriptor->free();
-        descriptor = descriptor->next_td();
+        m_transfer_descriptor_pool->release_to_pool(descriptor);
+        descriptor = next_descriptor;
     }
 }
 
 KResultOr<size_t> UHCIController::submit_control_transfer(Transfer& transfer)
 {
+    TRACE_EVENT(USBTransfer, this, 0, transfer.transfer_data_size());
+    ScopedTimer timer(g_usb_control_transfer_latency);
     Pipe& pipe = transfer.pipe();
     bool direction_in = (transfer.request().request_type & USB_DEVICE_REQUEST_DEVICE_TO_HOST) == USB_DEVICE_REQUEST_DEVICE_TO_HOST;
 
@@ -549,6 +562,9 @@ KResultOr<size_t> UHCIController::submit_control_transfer(Transfer& transfer)
         return ENOMEM;
     }
     status_td->terminate();
+    // The status stage retires last, an error on an earlier descriptor
+    // raises the error interrupt on its own.
+    status_td->set_interrupt_on_complete();
 
     if (data_descriptor_chain) {
         setup_td->insert_next_transfer_descriptor(data_descriptor_chain);
@@ -577,18 +593,278 @@ KResultOr<size_t> UHCIController::submit_control_transfer(Transfer& transfer)
     transfer_queue->attach_transfer_descriptor_chain(setup_td);
     transfer_queue->set_transfer(&transfer);
 
-    m_fullspeed_control_qh->attach_transfer_queue(*transfer_queue);
+    return run_transfer_queue(*m_fullspeed_control_qh, *transfer_queue);
+}
 
-    size_t transfer_size = 0;
+KResultOr<size_t> UHCIController::submit_bulk_transfer(Transfer& transfer)
+{
+    TRACE_EVENT(USBTransfer, this, 2, transfer.transfer_data_size());
+    ScopedTimer timer(g_usb_bulk_transfer_latency);
+    auto* transfer_queue = create_data_transfer_queue(transfer);
+    if (!transfer_queue)
+        return ENOMEM;
+
+    return run_transfer_queue(*m_bulk_qh, *transfer_queue);
+}
+
+KResultOr<size_t> UHCIController::submit_interrupt_transfer(Transfer& transfer, u8 polling_interval)
+{
+    TRACE_EVENT(USBTransfer, this, 3, transfer.transfer_data_size());
+    auto* transfer_queue = create_data_transfer_queue(transfer);
+    if (!transfer_queue)
+        return ENOMEM;
+
+    return run_transfer_queue(interrupt_skeleton_for(polling_interval), *transfer_queue);
+}
+
+QueueHead& UHCIController::interrupt_skeleton_for(u8 polling_interval)
+{
+    // Round the interval down to the skeleton, polling more often than the
+    // endpoint asked for is allowed, polling less often is not.
+    size_t skeleton_index = 0;
+    while (skeleton_index + 1 < interrupt_skeleton_size && (2u << skeleton_index) <= polling_interval)
+        skeleton_index++;
+    return *m_interrupt_qh_skeleton[skeleton_index];
+}
+
+KResult UHCIController::create_data_chain(Transfer& transfer, TransferDescriptor** td_chain, TransferDescriptor** last_td)
+{
+    Pipe& pipe = transfer.pipe();
+    bool direction_in = pipe.direction() == Pipe::Direction::In;
+
+    auto buffer_address = Ptr32<u8>(transfer.buffer_physical().as_ptr());
+    auto transfer_chain_create_result = create_chain(pipe,
+        direction_in ? PacketID::IN : PacketID::OUT,
+        buffer_address,
+        pipe.max_packet_size(),
+        transfer.transfer_data_size(),
+        td_chain,
+        last_td);
+
+    if (transfer_chain_create_result != KSuccess)
+        return transfer_chain_create_result;
+    if (!*td_chain)
+        return EINVAL;
+
+    (*last_td)->terminate();
+    (*last_td)->set_interrupt_on_complete();
+    return KSuccess;
+}
+
+QueueHead* UHCIController::create_data_transfer_queue(Transfer& transfer)
+{
+    TransferDescriptor* last_data_descriptor = nullptr;
+    TransferDescriptor* data_descriptor_chain = nullptr;
+    if (create_data_chain(transfer, &data_descriptor_chain, &last_data_descriptor) != KSuccess)
+        return nullptr;
+
+    QueueHead* transfer_queue = allocate_queue_head();
+    if (!transfer_queue) {
+        free_descriptor_chain(data_descriptor_chain);
+        return nullptr;
+    }
+
+    transfer_queue->attach_transfer_descriptor_chain(data_descriptor_chain);
+    transfer_queue->set_transfer(&transfer);
+    return transfer_queue;
+}
+
+KResultOr<size_t> UHCIController::run_transfer_queue(QueueHead& anchor, QueueHead& transfer_queue)
+{
+    auto& transfer = *transfer_queue.transfer();
+
+    WaitQueue completion_queue;
+    {
+        ScopedSpinLock lock(m_pending_transfers_lock);
+        m_pending_transfers.append({ &transfer_queue, &completion_queue });
+    }
+
+    link_transfer_queue(anchor, transfer_queue);
+
+    // We are the only one waiting on completion_queue, so a wake from the
+    // interrupt handler before we block is remembered rather than lost.
     while (!transfer.complete())
-        transfer_size = poll_transfer_queue(*transfer_queue);
+        completion_queue.wait_forever("UHCITransfer");
+
+    {
+        ScopedSpinLock lock(m_pending_transfers_lock);
+        m_pending_transfers.remove_first_matching([&](auto& pending) { return pending.transfer_queue == &transfer_queue; });
+    }
+
+    unlink_transfer_queue(transfer_queue);
 
-    free_descriptor_chain(transfer_queue->get_first_td());
-    transfer_queue->free();
+    size_t transfer_size = poll_transfer_queue(transfer_queue);
+    bool error_occurred = transfer.error_occurred();
 
+    free_descriptor_chain(transfer_queue.get_first_td());
+    free_queue_head(transfer_queue);
+
+    if (error_occurred)
+        return EIO;
     return transfer_size;
 }
 
+void UHCIController::link_transfer_queue(QueueHead& anchor, QueueHead& transfer_queue)
+{
+    // The queue goes in right behind the skeleton queue head, the controller
+    // follows the new link from the next frame on.
+    ScopedSpinLock lock(m_schedule_lock);
+    auto* next = anchor.next_qh();
+    transfer_queue.set_link_ptr(anchor.link_ptr());
+    transfer_queue.set_next_qh(next);
+    transfer_queue.set_previous_qh(&anchor);
+    if (next)
+        next->set_previous_qh(&transfer_queue);
+    anchor.set_next_qh(&transfer_queue);
+    full_memory_barrier();
+    anchor.link_next_queue_head(&transfer_queue);
+}
+
+void UHCIController::unlink_transfer_queue(QueueHead& transfer_queue)
+{
+    {
+        ScopedSpinLock lock(m_schedule_lock);
+        auto* previous = transfer_queue.prev_qh();
+        auto* next = transfer_queue.next_qh();
+        VERIFY(previous);
+        previous->set_link_ptr(transfer_queue.link_ptr());
+        previous->set_next_qh(next);
+        if (next)
+            next->set_previous_qh(previous);
+    }
+
+    // The controller may still be in the middle of the queue, give it a
+    // frame to move past before the queue head is reused.
+    IO::delay(1000);
+}
+
+KResult UHCIController::submit_async_transfer(NonnullRefPtr<Transfer> transfer, u8 polling_interval, TransferCompletionHandler completion_handler)
+{
+    Pipe& pipe = transfer->pipe();
+    if (pipe.type() != Pipe::Type::Bulk && pipe.type() != Pipe::Type::Interrupt)
+        return ENOTSUP;
+
+    TransferDescriptor* first_td = nullptr;
+    TransferDescriptor* last_td = nullptr;
+    auto result = create_data_chain(*transfer, &first_td, &last_td);
+    if (result != KSuccess)
+        return result;
+
+    ScopedSpinLock lock(m_endpoint_streams_lock);
+    auto it = m_endpoint_streams.find(&pipe);
+    if (it == m_endpoint_streams.end()) {
+        auto* queue_head = allocate_queue_head();
+        auto stream = adopt_own_if_nonnull(new (nothrow) EndpointStream);
+        if (!queue_head || !stream) {
+            if (queue_head)
+                free_queue_head(*queue_head);
+            free_descriptor_chain(first_td);
+            return ENOMEM;
+        }
+        queue_head->terminate_element_link_ptr();
+        stream->queue_head = queue_head;
+        link_transfer_queue(pipe.type() == Pipe::Type::Bulk ? *m_bulk_qh : interrupt_skeleton_for(polling_interval), *queue_head);
+        m_endpoint_streams.set(&pipe, stream.release_nonnull());
+        it = m_endpoint_streams.find(&pipe);
+    }
+
+    auto& stream = *it->value;
+    if (stream.transfers.is_empty()) {
+        stream.queue_head->attach_transfer_descriptor_chain(first_td);
+    } else {
+        // Chain onto the transfer in front of us so the controller goes
+        // straight on to it. If it already retired the last descriptor
+        // and left the queue head empty, start the queue again ourselves.
+        stream.transfers.last().last_td->insert_next_transfer_descriptor(first_td);
+        full_memory_barrier();
+        if (stream.queue_head->element_terminated())
+            stream.queue_head->attach_transfer_descriptor_chain(first_td);
+    }
+    stream.transfers.append({ move(transfer), first_td, last_td, move(completion_handler) });
+    return KSuccess;
+}
+
+void UHCIController::close_endpoint_stream(Pipe& pipe)
+{
+    OwnPtr<EndpointStream> stream;
+    {
+        ScopedSpinLock lock(m_endpoint_streams_lock);
+        auto it = m_endpoint_streams.find(&pipe);
+        if (it == m_endpoint_streams.end())
+            return;
+        it->value->queue_head->terminate_element_link_ptr();
+        stream = move(it->value);
+        m_endpoint_streams.remove(it);
+    }
+
+    unlink_transfer_queue(*stream->queue_head);
+    while (!stream->transfers.is_empty())
+        complete_async_transfer(stream->transfers.take_first(), ECANCELED);
+    free_queue_head(*stream->queue_head);
+}
+
+void UHCIController::complete_async_transfer(AsyncTransfer&& async_transfer, KResultOr<size_t> result)
+{
+    // The chain may lead on into the next transfer, cut it off first.
+    async_transfer.last_td->set_next_td(nullptr);
+    free_descriptor_chain(async_transfer.first_td);
+
+    // The handler may well submit the next transfer, run it outside of
+    // the interrupt handler and our locks.
+    Processor::deferred_call_queue([async_transfer = move(async_transfer), result]() mutable {
+        async_transfer.completion_handler(*async_transfer.transfer, result);
+    });
+}
+
+void UHCIController::poll_endpoint_stream(EndpointStream& stream)
+{
+    while (!stream.transfers.is_empty()) {
+        auto& async_transfer = stream.transfers.first();
+        size_t transfer_size = 0;
+        bool short_packet = false;
+
+        auto* descriptor = async_transfer.first_td;
+        for (;;) {
+            u32 status = descriptor->status();
+            if (status & TransferDescriptor::StatusBits::Active)
+                return;
+
+            if (status & TransferDescriptor::StatusBits::ErrorMask) {
+                // The queue head halted on the failed descriptor, none of
+                // the transfers behind it will run either.
+                dbgln_if(UHCI_DEBUG, "UHCIController: Async transfer failed! Reason: {:08x}", status);
+                stream.queue_head->terminate_element_link_ptr();
+                while (!stream.transfers.is_empty())
+                    complete_async_transfer(stream.transfers.take_first(), EIO);
+                return;
+            }
+
+            transfer_size += descriptor->actual_packet_length();
+            if (descriptor->actual_packet_length() < descriptor->max_packet_length()) {
+                short_packet = true;
+                break;
+            }
+            if (descriptor == async_transfer.last_td)
+                break;
+            descriptor = descriptor->next_td();
+        }
+
+        auto completed = stream.transfers.take_first();
+
+        // A short packet halts the queue head on its descriptor, point it
+        // at whatever comes next by hand.
+        if (short_packet && descriptor != completed.last_td) {
+            if (stream.transfers.is_empty())
+                stream.queue_head->terminate_element_link_ptr();
+            else
+                stream.queue_head->attach_transfer_descriptor_chain(stream.transfers.first().first_td);
+        }
+
+        completed.transfer->set_complete();
+        complete_async_transfer(move(completed), transfer_size);
+    }
+}
+
 size_t UHCIController::poll_transfer_queue(QueueHead& transfer_queue)
 {
     Transfer* transfer = transfer_queue.transfer();
@@ -621,89 +897,89 @@ size_t UHCIController::poll_transfer_queue(QueueHead& transfer_queue)
     return transfer_size;
 }
 
+void UHCIController::handle_port_change(u8 port)
+{
+    WorkQueue::BlockingScope blocking_scope;
+
+    u16 port_data = read_portsc(port);
+    if (!(port_data & UHCI_PORTSC_CONNECT_STATUS_CHANGED))
+        return;
+
+    // Acknowledged before looking at the connect status, so a change that
+    // comes in meanwhile is seen on the next pass.
+    write_portsc(port, (port_data & ~UHCI_PORTSC_PORT_ENABLE_CHANGED) | UHCI_PORTSC_CONNECT_STATUS_CHANGED);
+
+    // An unplug and plug between two passes looks like a plug, the device
+    // that was there is gone either way.
+    handle_port_disconnect(port);
+    if (port_data & UHCI_PORTSC_CURRRENT_CONNECT_STATUS)
+        handle_port_connect(port);
+}
+
+void UHCIController::handle_port_connect(u8 port)
+{
+    dmesgln("UHCI: Device attach detected on Root Port {}", port + 1);
+
+    // The change bits are write one to clear, keep them out of the writes
+    // that don't mean to.
+    u16 port_data = read_portsc(port) & ~(UHCI_PORTSC_CONNECT_STATUS_CHANGED | UHCI_PORTSC_PORT_ENABLE_CHANGED);
+    write_portsc(port, port_data | UHCI_PORTSC_PORT_RESET);
+    (void)Thread::current()->sleep(Time::from_milliseconds(50));
+
+    write_portsc(port, port_data & ~UHCI_PORTSC_PORT_RESET);
+    IO::delay(100);
+
+    port_data = read_portsc(port);
+    write_portsc(port, (port_data & ~UHCI_PORTSC_CONNECT_STATUS_CHANGED) | UHCI_PORTSC_PORT_ENABLED | UHCI_PORTSC_PORT_ENABLE_CHANGED);
+    dbgln_if(UHCI_DEBUG, "UHCI: Port {} should be enabled now: {:#04x}", port + 1, read_portsc(port));
+
+    // Reset recovery, the device doesn't have to answer before this.
+    (void)Thread::current()->sleep(Time::from_milliseconds(10));
+
+    USB::Device::DeviceSpeed speed = (port_data & UHCI_PORTSC_LOW_SPEED_DEVICE) ? USB::Device::DeviceSpeed::LowSpeed : USB::Device::DeviceSpeed::FullSpeed;
+    auto device = USB::Device::try_create(*this, static_cast<USB::Device::PortNumber>(port), speed);
+    if (device.is_error()) {
+        dmesgln("UHCI: Device creation failed on port {} ({})", port + 1, device.error());
+        return;
+    }
+
+    {
+        ScopedSpinLock lock(m_devices_lock);
+        m_devices[port] = device.value();
+    }
+    VERIFY(s_procfs_usb_bus_directory);
+    s_procfs_usb_bus_directory->plug(device.value());
+}
+
+void UHCIController::handle_port_disconnect(u8 port)
+{
+    RefPtr<USB::Device> device;
+    {
+        ScopedSpinLock lock(m_devices_lock);
+        device = move(m_devices[port]);
+    }
+    if (!device)
+        return;
+
+    dmesgln("UHCI: Device detach detected on Root Port {}", port + 1);
+    VERIFY(s_procfs_usb_bus_directory);
+    s_procfs_usb_bus_directory->unplug(*device);
+}
+
 void UHCIController::spawn_port_proc()
 {
     RefPtr<Thread> usb_hotplug_thread;
 
+    // Only looks for changes, the port work items do the slow part.
     Process::create_kernel_process(usb_hotplug_thread, "UHCIHotplug", [&] {
         for (;;) {
-            for (int port = 0; port < UHCI_ROOT_PORT_COUNT; port++) {
-                u16 port_data = 0;
-
-                if (port == 1) {
-                    port_data = read_portsc1();
-                    if (port_data & UHCI_PORTSC_CONNECT_STATUS_CHANGED) {
-                        if (port_data & UHCI_PORTSC_CURRRENT_CONNECT_STATUS) {
-                            dmesgln("UHCI: Device attach detected on Root Port 1!");
-
-                            port_data = read_portsc1();
-                            write_portsc1(port_data | UHCI_PORTSC_PORT_RESET);
-                            IO::delay(500);
-
-                            write_portsc1(port_data & ~UHCI_PORTSC_PORT_RESET);
-                            IO::delay(500);
-
-                            write_portsc1(port_data & (~UHCI_PORTSC_PORT_ENABLE_CHANGED | ~UHCI_PORTSC_CONNECT_STATUS_CHANGED));
-
-                            port_data = read_portsc1();
-                            write_portsc1(port_data | UHCI_PORTSC_PORT_ENABLED);
-                            dbgln("port should be enabled now: {:#04x}\n", read_portsc1());
-
-                            USB::Device::DeviceSpeed speed = (port_data & UHCI_PORTSC_LOW_SPEED_DEVICE) ? USB::Device::DeviceSpeed::LowSpeed : USB::Device::DeviceSpeed::FullSpeed;
-                            auto device = USB::Device::try_create(USB::Device::PortNumber::Port1, speed);
-
-                            if (device.is_error())
-                                dmesgln("UHCI: Device creation failed on port 1 ({})", device.error());
-
-                            m_devices.at(0) = device.value();
-                            VERIFY(s_procfs_usb_bus_directory);
-                            s_procfs_usb_bus_directory->plug(device.value());
-                        } else {
-                            VERIFY(s_procfs_usb_bus_directory);
-                            VERIFY(m_devices.at(0));
-                            dmesgln("UHCI: Device detach detected on Root Port 1");
-                            s_procfs_usb_bus_directory->unplug(*m_devices.at(0));
-                        }
-                    }
-                } else {
-                    port_data = UHCIController::the().read_portsc2();
-                    if (port_data & UHCI_PORTSC_CONNECT_STATUS_CHANGED) {
-                        if (port_data & UHCI_PORTSC_CURRRENT_CONNECT_STATUS) {
-                            dmesgln("UHCI: Device attach detected on Root Port 2");
-
-                            port_data = read_portsc2();
-                            write_portsc2(port_data | UHCI_PORTSC_PORT_RESET);
-                            for (size_t i = 0; i < 50000; ++i)
-                                IO::in8(0x80);
-
-                            write_portsc2(port_data & ~UHCI_PORTSC_PORT_RESET);
-                            for (size_t i = 0; i < 100000; ++i)
-                                IO::in8(0x80);
-
-                            write_portsc2(port_data & (~UHCI_PORTSC_PORT_ENABLE_CHANGED | ~UHCI_PORTSC_CONNECT_STATUS_CHANGED));
-
-                            port_data = read_portsc2();
-                            write_portsc1(port_data | UHCI_PORTSC_PORT_ENABLED);
-                            dbgln("port should be enabled now: {:#04x}\n", read_portsc1());
-                            USB::Device::DeviceSpeed speed = (port_data & UHCI_PORTSC_LOW_SPEED_DEVICE) ? USB::Device::DeviceSpeed::LowSpeed : USB::Device::DeviceSpeed::FullSpeed;
-                            auto device = USB::Device::try_create(USB::Device::PortNumber::Port2, speed);
-
-                            if (device.is_error())
-                                dmesgln("UHCI: Device creation failed on port 2 ({})", device.error());
-
-                            m_devices.at(1) = device.value();
-                            VERIFY(s_procfs_usb_bus_directory);
-                            s_procfs_usb_bus_directory->plug(device.value());
-                        } else {
-                            VERIFY(s_procfs_usb_bus_directory);
-                            VERIFY(m_devices.at(1));
-                            dmesgln("UHCI: Device detach detected on Root Port 2");
-                            s_procfs_usb_bus_directory->unplug(*m_devices.at(1));
-                        }
-                    }
-                }
+            for (u8 port = 0; port < root_port_count; port++) {
+                if (read_portsc(port) & UHCI_PORTSC_CONNECT_STATUS_CHANGED)
+                    WorkQueue::system_unbound().queue(*m_port_work[port]);
             }
-            (void)Thread::current()->sleep(Time::from_seconds(1));
+            auto timeout = Time::from_seconds(1);
+            Thread::BlockTimeout block_timeout(false, &timeout);
+            (void)m_root_hub_wait_queue.wait_on(block_timeout, "UHCIHotplug");
         }
     });
 }
@@ -721,6 +997,31 @@ bool UHCIController::handle_irq(const RegisterState&)
     }
 
     write_usbsts(status);
+
+    // A device signalled resume, likely because it was just plugged in.
+    if (status & UHCI_USBSTS_RESUME_RECEIVED)
+        m_root_hub_wait_queue.wake_one();
+
+    if (!(status & (UHCI_USBSTS_USB_INTERRUPT | UHCI_USBSTS_USB_ERROR_INTERRUPT)))
+        return true;
+
+    // Only the queues with a transfer in flight are looked at, and only
+    // their submitters are woken.
+    {
+        ScopedSpinLock lock(m_pending_transfers_lock);
+        for (auto& pending : m_pending_transfers) {
+            auto* transfer = pending.transfer_queue->transfer();
+            if (transfer->complete())
+                continue;
+            poll_transfer_queue(*pending.transfer_queue);
+            if (transfer->complete())
+                pending.completion_queue->wake_all();
+        }
+    }
+
+    ScopedSpinLock lock(m_endpoint_streams_lock);
+    for (auto& it : m_endpoint_streams)
+        poll_endpoint_stream(*it.value);
     return true;
 }
 
@@ -7,20 +7,29 @@
 #pragma once
 
 // includes
+#include <base/Function.h>
+#include <base/HashMap.h>
 #include <base/Platform.h>
 #include <base/NonnullOwnPtr.h>
 #include <kernel/bus/pci/Device.h>
+#include <kernel/bus/usb/UHCIDescriptorPool.h>
 #include <kernel/bus/usb/UHCIDescriptorTypes.h>
 #include <kernel/bus/usb/USBDevice.h>
+#include <kernel/bus/usb/USBHostController.h>
 #include <kernel/bus/usb/USBTransfer.h>
 #include <kernel/IO.h>
 #include <kernel/Process.h>
+#include <kernel/SpinLock.h>
 #include <kernel/time/TimeManagement.h>
 #include <kernel/vm/AnonymousVMObject.h>
+#include <kernel/WaitQueue.h>
+#include <kernel/WorkQueue.h>
 
 namespace Kernel::USB {
 
-class UHCIController final : public PCI::Device {
+class UHCIController final
+    : public PCI::Device
+    , public HostController {
 
 public:
     static void detect();
@@ -29,18 +38,31 @@ public:
     virtual ~UHCIController() override;
 
     virtual StringView purpose() const override { return "UHCI"; }
+    virtual StringView controller_name() const override { return "UHCI"; }
 
-    void reset();
-    void stop();
-    void start();
+    virtual void reset() override;
+    virtual void stop() override;
+    virtual void start() override;
     void spawn_port_proc();
 
     void do_debug_transfer();
 
-    KResultOr<size_t> submit_control_transfer(Transfer& transfer);
+    virtual KResultOr<size_t> submit_control_transfer(Transfer& transfer) override;
+    virtual KResultOr<size_t> submit_bulk_transfer(Transfer& transfer) override;
+    virtual KResultOr<size_t> submit_interrupt_transfer(Transfer& transfer, u8 polling_interval) override;
 
-    RefPtr<USB::Device> const get_device_at_port(USB::Device::PortNumber);
-    RefPtr<USB::Device> const get_device_from_address(u8 device_address);
+    // Queues a bulk or interrupt transfer and returns right away, the
+    // handler runs once it is done. Transfers on the same pipe are chained
+    // in submission order and kept in flight back to back; the polling
+    // interval only matters for the first transfer on an interrupt pipe.
+    using TransferCompletionHandler = Function<void(Transfer&, KResultOr<size_t>)>;
+    KResult submit_async_transfer(NonnullRefPtr<Transfer>, u8 polling_interval, TransferCompletionHandler);
+
+    // Cancels whatever is still queued on the pipe with ECANCELED.
+    void close_endpoint_stream(Pipe&);
+
+    virtual RefPtr<USB::Device> const get_device_at_port(USB::Device::PortNumber) override;
+    virtual RefPtr<USB::Device> const get_device_from_address(u8 device_address) override;
 
 private:
     UHCIController(PCI::Address, PCI::ID);
@@ -51,8 +73,7 @@ private:
     u16 read_frnum() { return m_io_base.offset(0x6).in<u16>(); }
     u32 read_flbaseadd() { return m_io_base.offset(0x8).in<u32>(); }
     u8 read_sofmod() { return m_io_base.offset(0xc).in<u8>(); }
-    u16 read_portsc1() { return m_io_base.offset(0x10).in<u16>(); }
-    u16 read_portsc2() { return m_io_base.offset(0x12).in<u16>(); }
+    u16 read_portsc(u8 port) { return m_io_base.offset(0x10 + port * 2).in<u16>(); }
 
     void write_usbcmd(u16 value) { m_io_base.offset(0).out(value); }
     void write_usbsts(u16 value) { m_io_base.offset(0x2).out(value); }
@@ -60,29 +81,75 @@ private:
     void write_frnum(u16 value) { m_io_base.offset(0x6).out(value); }
     void write_flbaseadd(u32 value) { m_io_base.offset(0x8).out(value); }
     void write_sofmod(u8 value) { m_io_base.offset(0xc).out(value); }
-    void write_portsc1(u16 value) { m_io_base.offset(0x10).out(value); }
-    void write_portsc2(u16 value) { m_io_base.offset(0x12).out(value); }
+    void write_portsc(u8 port, u16 value) { m_io_base.offset(0x10 + port * 2).out(value); }
 
     virtual bool handle_irq(const RegisterState&) override;
 
+    void handle_port_change(u8 port);
+    void handle_port_connect(u8 port);
+    void handle_port_disconnect(u8 port);
+
     void create_structures();
     void setup_schedule();
     size_t poll_transfer_queue(QueueHead& transfer_queue);
 
+    QueueHead& interrupt_skeleton_for(u8 polling_interval);
+    KResult create_data_chain(Transfer& transfer, TransferDescriptor** td_chain, TransferDescriptor** last_td);
+    QueueHead* create_data_transfer_queue(Transfer& transfer);
+    KResultOr<size_t> run_transfer_queue(QueueHead& anchor, QueueHead& transfer_queue);
+    void link_transfer_queue(QueueHead& anchor, QueueHead& transfer_queue);
+    void unlink_transfer_queue(QueueHead& transfer_queue);
+
     TransferDescriptor* create_transfer_descriptor(Pipe& pipe, PacketID direction, size_t data_len);
     KResult create_chain(Pipe& pipe, PacketID direction, Ptr32<u8>& buffer_address, size_t max_size, size_t transfer_size, TransferDescriptor** td_chain, TransferDescriptor** last_td);
     void free_descriptor_chain(TransferDescriptor* first_descriptor);
 
-    QueueHead* allocate_queue_head() const;
-    TransferDescriptor* allocate_transfer_descriptor() const;
+    QueueHead* allocate_queue_head();
+    TransferDescriptor* allocate_transfer_descriptor();
+    void free_queue_head(QueueHead&);
 
 private:
+    // A transfer queue the controller still has to retire, along with the
+    // queue its submitter sleeps on until the interrupt handler sees it done.
+    struct PendingTransfer {
+        QueueHead* transfer_queue;
+        WaitQueue* completion_queue;
+    };
+
+    struct AsyncTransfer {
+        NonnullRefPtr<Transfer> transfer;
+        TransferDescriptor* first_td;
+        TransferDescriptor* last_td;
+        TransferCompletionHandler completion_handler;
+    };
+
+    // One queue head per pipe with async transfers, the descriptor chains
+    // of its transfers are linked one after another below it.
+    struct EndpointStream {
+        QueueHead* queue_head { nullptr };
+        Vector<AsyncTransfer> transfers;
+    };
+
+    void poll_endpoint_stream(EndpointStream&);
+    void complete_async_transfer(AsyncTransfer&&, KResultOr<size_t>);
+
     IOAddress m_io_base;
 
-    Vector<QueueHead*> m_free_qh_pool;
-    Vector<TransferDescriptor*> m_free_td_pool;
+    OwnPtr<UHCIDescriptorPool<QueueHead>> m_queue_head_pool;
+    OwnPtr<UHCIDescriptorPool<TransferDescriptor>> m_transfer_descriptor_pool;
     Vector<TransferDescriptor*> m_iso_td_list;
 
+    SpinLock<u8> m_pending_transfers_lock;
+    Vector<PendingTransfer> m_pending_transfers;
+
+    SpinLock<u8> m_endpoint_streams_lock;
+    HashMap<Pipe*, NonnullOwnPtr<EndpointStream>> m_endpoint_streams;
+
+    // One queue head per polling interval, 1, 2, 4 up to 128 frames.
+    static constexpr size_t interrupt_skeleton_size = 8;
+    Array<QueueHead*, interrupt_skeleton_size> m_interrupt_qh_skeleton;
+    SpinLock<u8> m_schedule_lock;
+
     QueueHead* m_interrupt_transfer_queue;
     QueueHead* m_lowspeed_control_qh;
     QueueHead* m_fullspeed_control_qh;
@@ -90,10 +157,19 @@ private:
     QueueHead* m_dummy_qh; 
 
     OwnPtr<Region> m_framelist;
-    OwnPtr<Region> m_qh_pool;
     OwnPtr<Region> m_td_pool;
 
-    Array<RefPtr<USB::Device>, 2> m_devices; 
+    static constexpr size_t root_port_count = 2;
+
+    // The root hub has no port change interrupt, only a resume interrupt
+    // while suspended, which wakes the hotplug thread ahead of its next
+    // look at the ports. Each port is then handled on a work queue of its
+    // own, so a slow device doesn't hold up enumerating the other one.
+    WaitQueue m_root_hub_wait_queue;
+    Array<OwnPtr<WorkItem>, root_port_count> m_port_work;
+
+    SpinLock<u8> m_devices_lock;
+    Array<RefPtr<USB::Device>, root_port_count> m_devices; 
 };
 
 }
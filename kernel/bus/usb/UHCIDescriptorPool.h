@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Array.h>
+#include <base/Atomic.h>
+#include <base/NonnullOwnPtr.h>
+#include <base/OwnPtr.h>
+#include <base/StringView.h>
+#include <kernel/Debug.h>
+#include <kernel/vm/MemoryManager.h>
+
+namespace Kernel::USB {
+
+// A pool of descriptors the controller can DMA from, carved out of
+// physically contiguous pages so every descriptor knows its physical
+// address from the moment it is constructed.
+//
+// Free descriptors sit on a lock-free stack of indices. The head carries
+// a generation in its upper half so a descriptor that is taken and put
+// back between a load and a compare-exchange can't corrupt the stack.
+// The pool grows a chunk at a time when it runs dry, chunks are never
+// given back.
+template<typename T>
+class UHCIDescriptorPool {
+    BASE_MAKE_NONCOPYABLE(UHCIDescriptorPool);
+    BASE_MAKE_NONMOVABLE(UHCIDescriptorPool);
+
+    static_assert(sizeof(T) <= PAGE_SIZE);
+
+public:
+    static constexpr size_t chunk_size = PAGE_SIZE;
+    static constexpr size_t descriptors_per_chunk = chunk_size / sizeof(T);
+    static constexpr size_t max_chunks = 8;
+    static constexpr size_t max_descriptors = descriptors_per_chunk * max_chunks;
+
+    static OwnPtr<UHCIDescriptorPool> try_create(StringView name)
+    {
+        auto pool = adopt_own_if_nonnull(new (nothrow) UHCIDescriptorPool(name));
+        if (!pool || !pool->grow())
+            return {};
+        return pool;
+    }
+
+    T* try_take_free_descriptor()
+    {
+        for (;;) {
+            u32 head = m_free_head.load(Base::memory_order_acquire);
+            u16 index = head & 0xffff;
+            if (index == empty) {
+                if (!grow())
+                    return nullptr;
+                continue;
+            }
+
+            u32 new_head = ((head & 0xffff0000) + 0x10000) | m_next_free[index].load(Base::memory_order_relaxed);
+            if (m_free_head.compare_exchange_strong(head, new_head, Base::memory_order_acq_rel)) {
+                T* descriptor = descriptor_at(index);
+                dbgln_if(UHCI_VERBOSE_DEBUG, "UHCI: Took descriptor {} from {}", VirtualAddress(descriptor), m_name);
+                return descriptor;
+            }
+        }
+    }
+
+    void release_to_pool(T* descriptor)
+    {
+        push(index_of(descriptor));
+    }
+
+    size_t capacity() const { return m_chunk_count.load() * descriptors_per_chunk; }
+
+private:
+    static constexpr u16 empty = 0xffff;
+    static_assert(max_descriptors < empty);
+
+    explicit UHCIDescriptorPool(StringView name)
+        : m_name(name)
+    {
+    }
+
+    T* descriptor_at(u16 index)
+    {
+        auto& chunk = *m_chunks[index / descriptors_per_chunk];
+        return reinterpret_cast<T*>(chunk.vaddr().get() + (index % descriptors_per_chunk) * sizeof(T));
+    }
+
+    u16 index_of(T* descriptor)
+    {
+        auto address = VirtualAddress(descriptor);
+        size_t chunk_count = m_chunk_count.load(Base::memory_order_acquire);
+        for (size_t i = 0; i < chunk_count; i++) {
+            if (m_chunks[i]->contains(address))
+                return i * descriptors_per_chunk + (address.get() - m_chunks[i]->vaddr().get()) / sizeof(T);
+        }
+        VERIFY_NOT_REACHED();
+    }
+
+    void push(u16 index)
+    {
+        u32 head = m_free_head.load(Base::memory_order_relaxed);
+        for (;;) {
+            m_next_free[index].store(head & 0xffff, Base::memory_order_relaxed);
+            u32 new_head = ((head & 0xffff0000) + 0x10000) | index;
+            if (m_free_head.compare_exchange_strong(head, new_head, Base::memory_order_acq_rel))
+                return;
+        }
+    }
+
+    bool grow()
+    {
+        // Someone else already growing the pool counts as success, the
+        // caller just looks at the stack again.
+        if (m_growing.exchange(true))
+            return true;
+
+        size_t chunk_count = m_chunk_count.load(Base::memory_order_relaxed);
+        if (chunk_count == max_chunks) {
+            m_growing = false;
+            return false;
+        }
+
+        auto region = MM.allocate_contiguous_kernel_region(chunk_size, m_name, Region::Access::Read | Region::Access::Write, Region::Cacheable::No);
+        if (!region) {
+            m_growing = false;
+            return false;
+        }
+        memset(region->vaddr().as_ptr(), 0, chunk_size);
+
+        auto base_paddr = region->physical_page(0)->paddr().get();
+        for (size_t i = 0; i < descriptors_per_chunk; i++)
+            new (region->vaddr().offset(i * sizeof(T)).as_ptr()) T(static_cast<u32>(base_paddr + i * sizeof(T)));
+
+        m_chunks[chunk_count] = region.release_nonnull();
+        m_chunk_count.store(chunk_count + 1, Base::memory_order_release);
+
+        for (size_t i = descriptors_per_chunk; i > 0; i--)
+            push(chunk_count * descriptors_per_chunk + i - 1);
+
+        m_growing = false;
+        return true;
+    }
+
+    StringView m_name;
+    Atomic<u32> m_free_head { empty };
+    Array<Atomic<u16>, max_descriptors> m_next_free;
+    Array<OwnPtr<Region>, max_chunks> m_chunks;
+    Atomic<size_t> m_chunk_count { 0 };
+    Atomic<bool> m_growing { false };
+};
+
+}
@@ -75,6 +75,7 @@ struct alignas(16) TransferDescriptor final {
     u32 token() const { return m_token; }
     u32 buffer_ptr() const { return m_buffer_ptr; }
     u16 actual_packet_length() const { return (m_control_status + 1) & 0x7ff; }
+    u16 max_packet_length() const { return ((m_token >> TD_TOKEN_MAXLEN_SHIFT) + 1) & 0x7ff; }
 
     bool in_use() const { return m_in_use; }
     bool stalled() const { return m_control_status & StatusBits::Stalled; }
@@ -215,6 +216,8 @@ struct alignas(16) TransferDescriptor final {
         m_link_ptr = 0;
         m_control_status = 0;
         m_token = 0;
+        m_next_td = nullptr;
+        m_prev_td = nullptr;
         m_in_use = false;
     }
 
@@ -298,6 +301,8 @@ struct alignas(16) QueueHead {
         return m_first_td;
     }
 
+    bool element_terminated() const { return m_element_link_ptr & static_cast<u32>(LinkPointerBits::Terminate); }
+
     void terminate() { m_link_ptr |= static_cast<u32>(LinkPointerBits::Terminate); }
 
     void terminate_element_link_ptr()
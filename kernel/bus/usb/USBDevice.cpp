@@ -8,22 +8,28 @@
 #include <base/OwnPtr.h>
 #include <base/Types.h>
 #include <base/Vector.h>
-#include <kernel/bus/usb/UHCIController.h>
 #include <kernel/bus/usb/USBDescriptors.h>
 #include <kernel/bus/usb/USBDevice.h>
+#include <kernel/bus/usb/USBHostController.h>
 #include <kernel/bus/usb/USBRequest.h>
 
-static u32 s_next_usb_address = 1; 
-
 namespace Kernel::USB {
 
-KResultOr<NonnullRefPtr<Device>> Device::try_create(PortNumber port, DeviceSpeed speed)
+KResultOr<NonnullRefPtr<Device>> Device::try_create(HostController& controller, PortNumber port, DeviceSpeed speed)
 {
-    auto pipe_or_error = Pipe::try_create_pipe(Pipe::Type::Control, Pipe::Direction::Bidirectional, 0, 8, 0);
+    // Low and full speed devices are only guaranteed to take 8 byte packets
+    // on the default pipe until we have read their device descriptor.
+    u16 default_max_packet_size = 8;
+    if (speed == DeviceSpeed::HighSpeed)
+        default_max_packet_size = 64;
+    else if (speed == DeviceSpeed::SuperSpeed)
+        default_max_packet_size = 512;
+
+    auto pipe_or_error = Pipe::try_create_pipe(controller, Pipe::Type::Control, Pipe::Direction::Bidirectional, 0, default_max_packet_size, 0);
     if (pipe_or_error.is_error())
         return pipe_or_error.error();
 
-    auto device = AK::try_create<Device>(port, speed, pipe_or_error.release_value());
+    auto device = AK::try_create<Device>(controller, port, speed, pipe_or_error.release_value());
     if (!device)
         return ENOMEM;
 
@@ -34,8 +40,9 @@ KResultOr<NonnullRefPtr<Device>> Device::try_create(PortNumber port, DeviceSpeed
     return device.release_nonnull();
 }
 
-Device::Device(PortNumber port, DeviceSpeed speed, NonnullOwnPtr<Pipe> default_pipe)
-    : m_device_port(port)
+Device::Device(HostController& controller, PortNumber port, DeviceSpeed speed, NonnullOwnPtr<Pipe> default_pipe)
+    : m_controller(controller)
+    , m_device_port(port)
     , m_device_speed(speed)
     , m_address(0)
     , m_default_pipe(move(default_pipe))
@@ -46,26 +53,38 @@ KResult Device::enumerate()
 {
     USBDeviceDescriptor dev_descriptor {};
 
-    auto transfer_length_or_error = m_default_pipe->control_transfer(USB_DEVICE_REQUEST_DEVICE_TO_HOST, USB_REQUEST_GET_DESCRIPTOR, 0x100, 0, 8, &dev_descriptor);
+    {
+        // Until SET_ADDRESS the device answers at address 0, as does any
+        // other one that was just reset, so one device at a time gets here.
+        Locker locker(m_controller.default_address_lock());
 
-    if (transfer_length_or_error.is_error())
-        return transfer_length_or_error.error();
+        auto transfer_length_or_error = m_default_pipe->control_transfer(USB_DEVICE_REQUEST_DEVICE_TO_HOST, USB_REQUEST_GET_DESCRIPTOR, 0x100, 0, 8, &dev_descriptor);
 
-    auto transfer_length = transfer_length_or_error.release_value();
+        if (transfer_length_or_error.is_error())
+            return transfer_length_or_error.error();
 
-    VERIFY(transfer_length > 0);
+        VERIFY(transfer_length_or_error.value() > 0);
 
-    VERIFY(dev_descriptor.descriptor_header.descriptor_type == DESCRIPTOR_TYPE_DEVICE);
-    m_default_pipe->set_max_packet_size(dev_descriptor.max_packet_size);
+        VERIFY(dev_descriptor.descriptor_header.descriptor_type == DESCRIPTOR_TYPE_DEVICE);
+        m_default_pipe->set_max_packet_size(dev_descriptor.max_packet_size);
+
+        u8 new_address = m_controller.allocate_device_address();
+        transfer_length_or_error = m_default_pipe->control_transfer(USB_DEVICE_REQUEST_HOST_TO_DEVICE, USB_REQUEST_SET_ADDRESS, new_address, 0, 0, nullptr);
 
-    transfer_length_or_error = m_default_pipe->control_transfer(USB_DEVICE_REQUEST_DEVICE_TO_HOST, USB_REQUEST_GET_DESCRIPTOR, 0x100, 0, sizeof(USBDeviceDescriptor), &dev_descriptor);
+        if (transfer_length_or_error.is_error())
+            return transfer_length_or_error.error();
+
+        VERIFY(transfer_length_or_error.value() > 0);
+        m_address = new_address;
+        m_default_pipe->set_device_address(new_address);
+    }
+
+    auto transfer_length_or_error = m_default_pipe->control_transfer(USB_DEVICE_REQUEST_DEVICE_TO_HOST, USB_REQUEST_GET_DESCRIPTOR, 0x100, 0, sizeof(USBDeviceDescriptor), &dev_descriptor);
 
     if (transfer_length_or_error.is_error())
         return transfer_length_or_error.error();
 
-    transfer_length = transfer_length_or_error.release_value();
-
-    VERIFY(transfer_length > 0);
+    VERIFY(transfer_length_or_error.value() > 0);
 
     VERIFY(dev_descriptor.descriptor_header.descriptor_type == DESCRIPTOR_TYPE_DEVICE);
 
@@ -78,17 +97,36 @@ KResult Device::enumerate()
         dbgln("Number of configurations: {:02x}", dev_descriptor.num_configurations);
     }
 
-    transfer_length_or_error = m_default_pipe->control_transfer(USB_DEVICE_REQUEST_HOST_TO_DEVICE, USB_REQUEST_SET_ADDRESS, s_next_usb_address, 0, 0, nullptr);
+    memcpy(&m_device_descriptor, &dev_descriptor, sizeof(USBDeviceDescriptor));
+    m_vendor_id = dev_descriptor.vendor_id;
+    m_product_id = dev_descriptor.product_id;
 
-    if (transfer_length_or_error.is_error())
-        return transfer_length_or_error.error();
+    return read_configuration_descriptors();
+}
 
-    transfer_length = transfer_length_or_error.release_value();
+KResult Device::read_configuration_descriptors()
+{
+    for (u8 index = 0; index < m_device_descriptor.num_configurations; ++index) {
+        // The header first, for the length of everything that comes with it.
+        USBConfigurationDescriptor configuration_descriptor {};
+        u16 value = (DESCRIPTOR_TYPE_CONFIGURATION << 8) | index;
+        auto transfer_length_or_error = m_default_pipe->control_transfer(USB_DEVICE_REQUEST_DEVICE_TO_HOST, USB_REQUEST_GET_DESCRIPTOR, value, 0, sizeof(USBConfigurationDescriptor), &configuration_descriptor);
 
-    VERIFY(transfer_length > 0);
-    m_address = s_next_usb_address++;
+        if (transfer_length_or_error.is_error())
+            return transfer_length_or_error.error();
 
-    memcpy(&m_device_descriptor, &dev_descriptor, sizeof(USBDeviceDescriptor));
+        if (configuration_descriptor.descriptor_header.descriptor_type != DESCRIPTOR_TYPE_CONFIGURATION || configuration_descriptor.total_length < sizeof(USBConfigurationDescriptor))
+            return EIO;
+
+        auto descriptors = ByteBuffer::create_uninitialized(configuration_descriptor.total_length);
+        transfer_length_or_error = m_default_pipe->control_transfer(USB_DEVICE_REQUEST_DEVICE_TO_HOST, USB_REQUEST_GET_DESCRIPTOR, value, 0, descriptors.size(), descriptors.data());
+
+        if (transfer_length_or_error.is_error())
+            return transfer_length_or_error.error();
+
+        if (!m_configuration_descriptors.try_append(move(descriptors)))
+            return ENOMEM;
+    }
     return KSuccess;
 }
 
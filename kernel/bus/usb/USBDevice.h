@@ -7,12 +7,15 @@
 #pragma once
 
 // includes
+#include <base/ByteBuffer.h>
 #include <base/OwnPtr.h>
 #include <base/Types.h>
+#include <base/Vector.h>
 #include <kernel/bus/usb/USBPipe.h>
 
 namespace Kernel::USB {
 
+class HostController;
 
 class Device : public RefCounted<Device> {
 public:
@@ -23,13 +26,15 @@ public:
 
     enum class DeviceSpeed : u8 {
         FullSpeed = 0,
-        LowSpeed
+        LowSpeed,
+        HighSpeed,
+        SuperSpeed
     };
 
 public:
-    static KResultOr<NonnullRefPtr<Device>> try_create(PortNumber, DeviceSpeed);
+    static KResultOr<NonnullRefPtr<Device>> try_create(HostController&, PortNumber, DeviceSpeed);
 
-    Device(PortNumber, DeviceSpeed, NonnullOwnPtr<Pipe> default_pipe);
+    Device(HostController&, PortNumber, DeviceSpeed, NonnullOwnPtr<Pipe> default_pipe);
     ~Device();
 
     KResult enumerate();
@@ -39,9 +44,19 @@ public:
 
     u8 address() const { return m_address; }
 
+    HostController& controller() { return m_controller; }
+
     const USBDeviceDescriptor& device_descriptor() const { return m_device_descriptor; }
 
+    // Every configuration descriptor along with its interface and endpoint
+    // descriptors, as the device returned them. They are read once while
+    // enumerating, so looking at them again never goes to the device.
+    Vector<ByteBuffer> const& configuration_descriptors() const { return m_configuration_descriptors; }
+
 private:
+    KResult read_configuration_descriptors();
+
+    HostController& m_controller;
     PortNumber m_device_port;   
     DeviceSpeed m_device_speed; 
     u8 m_address { 0 };         
@@ -49,6 +64,7 @@ private:
     u16 m_vendor_id { 0 };                   
     u16 m_product_id { 0 };                  
     USBDeviceDescriptor m_device_descriptor; 
+    Vector<ByteBuffer> m_configuration_descriptors;
 
     NonnullOwnPtr<Pipe> m_default_pipe; 
 };
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/bus/usb/UHCIController.h>
+#include <kernel/bus/usb/USBHostController.h>
+#include <kernel/bus/usb/XHCIController.h>
+#include <kernel/BootProfiler.h>
+#include <kernel/Sections.h>
+
+namespace Kernel::USB {
+
+LatencyMetric g_usb_control_transfer_latency { "usb_control_transfer_ns" };
+LatencyMetric g_usb_bulk_transfer_latency { "usb_bulk_transfer_ns" };
+
+UNMAP_AFTER_INIT void HostController::detect()
+{
+    {
+        BootPhase phase("UHCIController::detect");
+        UHCIController::detect();
+    }
+    BootPhase phase("XHCIController::detect");
+    XHCIController::detect();
+}
+
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Atomic.h>
+#include <base/Metrics.h>
+#include <base/RefPtr.h>
+#include <base/Types.h>
+#include <kernel/bus/usb/USBDevice.h>
+#include <kernel/bus/usb/USBTransfer.h>
+#include <kernel/KResult.h>
+#include <kernel/Lock.h>
+
+namespace Kernel::USB {
+
+// How long control and bulk transfers take, whichever controller ran them.
+extern LatencyMetric g_usb_control_transfer_latency;
+extern LatencyMetric g_usb_bulk_transfer_latency;
+
+// What USB::Device and USB::Pipe need from a host controller, whatever
+// generation of the spec it implements.
+class HostController {
+public:
+    virtual ~HostController() = default;
+
+    // Probes every host controller driver.
+    static void detect();
+
+    virtual StringView controller_name() const = 0;
+
+    virtual void reset() = 0;
+    virtual void stop() = 0;
+    virtual void start() = 0;
+
+    virtual KResultOr<size_t> submit_control_transfer(Transfer&) = 0;
+    virtual KResultOr<size_t> submit_bulk_transfer(Transfer&) = 0;
+    virtual KResultOr<size_t> submit_interrupt_transfer(Transfer&, u8 polling_interval) = 0;
+
+    virtual RefPtr<Device> const get_device_at_port(Device::PortNumber) = 0;
+    virtual RefPtr<Device> const get_device_from_address(u8 device_address) = 0;
+
+    // Addresses are handed out per bus, every controller drives one.
+    u8 allocate_device_address()
+    {
+        u8 address = m_next_device_address.fetch_add(1, Base::MemoryOrder::memory_order_relaxed);
+        VERIFY(address < 128);
+        return address;
+    }
+
+    // Held by whoever talks to a device at address 0, between its port
+    // reset and SET_ADDRESS. Ports enumerate concurrently otherwise.
+    Lock& default_address_lock() { return m_default_address_lock; }
+
+protected:
+    HostController() = default;
+
+private:
+    Atomic<u8> m_next_device_address { 1 };
+    Lock m_default_address_lock { "USBDefaultAddress" };
+};
+
+}
@@ -0,0 +1,645 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Platform.h>
+#include <base/Stopwatch.h>
+#include <kernel/bus/pci/Access.h>
+#include <kernel/bus/usb/USBRequest.h>
+#include <kernel/bus/usb/XHCIController.h>
+#include <kernel/Debug.h>
+#include <kernel/IO.h>
+#include <kernel/Process.h>
+#include <kernel/Sections.h>
+#include <kernel/StdLib.h>
+#include <kernel/time/TimeManagement.h>
+#include <kernel/Tracing.h>
+
+namespace Kernel::USB {
+
+static constexpr u32 XHCI_CAPLENGTH = 0x00;
+static constexpr u32 XHCI_HCSPARAMS1 = 0x04;
+static constexpr u32 XHCI_HCSPARAMS2 = 0x08;
+static constexpr u32 XHCI_HCCPARAMS1 = 0x10;
+static constexpr u32 XHCI_DBOFF = 0x14;
+static constexpr u32 XHCI_RTSOFF = 0x18;
+
+static constexpr u32 XHCI_HCCPARAMS1_CONTEXT_SIZE = 1 << 2;
+
+static constexpr u32 XHCI_USBCMD = 0x00;
+static constexpr u32 XHCI_USBSTS = 0x04;
+static constexpr u32 XHCI_CRCR = 0x18;
+static constexpr u32 XHCI_DCBAAP = 0x30;
+static constexpr u32 XHCI_CONFIG = 0x38;
+
+static constexpr u32 XHCI_USBCMD_RUN = 1 << 0;
+static constexpr u32 XHCI_USBCMD_HOST_CONTROLLER_RESET = 1 << 1;
+static constexpr u32 XHCI_USBCMD_INTERRUPTER_ENABLE = 1 << 2;
+
+static constexpr u32 XHCI_USBSTS_HOST_CONTROLLER_HALTED = 1 << 0;
+static constexpr u32 XHCI_USBSTS_EVENT_INTERRUPT = 1 << 3;
+static constexpr u32 XHCI_USBSTS_CONTROLLER_NOT_READY = 1 << 11;
+
+static constexpr u32 XHCI_CRCR_RING_CYCLE_STATE = 1 << 0;
+
+static constexpr u32 XHCI_PORTSC_CURRENT_CONNECT_STATUS = 1 << 0;
+static constexpr u32 XHCI_PORTSC_PORT_ENABLED = 1 << 1;
+static constexpr u32 XHCI_PORTSC_PORT_RESET = 1 << 4;
+static constexpr u32 XHCI_PORTSC_SPEED_SHIFT = 10;
+static constexpr u32 XHCI_PORTSC_SPEED_MASK = 0xf;
+static constexpr u32 XHCI_PORTSC_CONNECT_STATUS_CHANGE = 1 << 17;
+static constexpr u32 XHCI_PORTSC_PORT_RESET_CHANGE = 1 << 21;
+// Every change bit is write-one-to-clear, and so is the enable bit.
+static constexpr u32 XHCI_PORTSC_WRITE_ONE_TO_CLEAR = 0x00fe0000 | XHCI_PORTSC_PORT_ENABLED;
+
+static constexpr u32 XHCI_PORT_SPEED_FULL = 1;
+static constexpr u32 XHCI_PORT_SPEED_LOW = 2;
+static constexpr u32 XHCI_PORT_SPEED_HIGH = 3;
+
+static constexpr u32 XHCI_IMAN = 0x20;
+static constexpr u32 XHCI_IMOD = 0x24;
+static constexpr u32 XHCI_ERSTSZ = 0x28;
+static constexpr u32 XHCI_ERSTBA = 0x30;
+static constexpr u32 XHCI_ERDP = 0x38;
+
+static constexpr u32 XHCI_IMAN_INTERRUPT_PENDING = 1 << 0;
+static constexpr u32 XHCI_IMAN_INTERRUPT_ENABLE = 1 << 1;
+static constexpr u32 XHCI_ERDP_EVENT_HANDLER_BUSY = 1 << 3;
+
+// 250ns units, at most one interrupt every millisecond.
+static constexpr u32 XHCI_INTERRUPT_MODERATION_INTERVAL = 4000;
+
+static constexpr u8 XHCI_TRANSFER_TYPE_OUT_DATA = 2;
+static constexpr u8 XHCI_TRANSFER_TYPE_IN_DATA = 3;
+static constexpr u32 XHCI_EP0_DOORBELL_TARGET = 1;
+
+static XHCIController* s_the;
+
+UNMAP_AFTER_INIT void XHCIController::detect()
+{
+    PCI::enumerate([&](const PCI::Address& address, PCI::ID id) {
+        if (address.is_null())
+            return;
+
+        if (PCI::get_class(address) == 0xc && PCI::get_subclass(address) == 0x03 && PCI::get_programming_interface(address) == 0x30) {
+            if (!s_the) {
+                s_the = new XHCIController(address, id);
+                s_the->spawn_port_proc();
+            }
+        }
+    });
+}
+
+UNMAP_AFTER_INIT XHCIController::XHCIController(PCI::Address address, PCI::ID id)
+    : PCI::Device(address)
+{
+    u64 bar0 = PCI::get_BAR0(pci_address());
+    PhysicalAddress registers_base = PhysicalAddress(bar0 & ~0xf);
+    if (((bar0 >> 1) & 0x3) == 0x2)
+        registers_base = PhysicalAddress(registers_base.get() | ((u64)PCI::get_BAR1(pci_address()) << 32));
+    size_t registers_size = PCI::get_BAR_space_size(pci_address(), 0);
+
+    dmesgln("xHCI: Controller found {} @ {}", id, address);
+    dmesgln("xHCI: Registers @ {}, size {}", registers_base, registers_size);
+    dmesgln("xHCI: Interrupt line: {}", PCI::get_interrupt_line(pci_address()));
+
+    PCI::enable_bus_mastering(pci_address());
+    m_registers = MM.allocate_kernel_region(registers_base.page_base(), page_round_up(registers_size), "xHCI Registers", Region::Access::Read | Region::Access::Write, Region::Cacheable::No);
+    VERIFY(m_registers);
+
+    m_operational_offset = read_capability(XHCI_CAPLENGTH) & 0xff;
+    m_runtime_offset = read_capability(XHCI_RTSOFF) & ~0x1f;
+    m_doorbell_offset = read_capability(XHCI_DBOFF) & ~0x3;
+
+    u32 hcsparams1 = read_capability(XHCI_HCSPARAMS1);
+    m_max_slots = hcsparams1 & 0xff;
+    m_max_ports = hcsparams1 >> 24;
+    if (read_capability(XHCI_HCCPARAMS1) & XHCI_HCCPARAMS1_CONTEXT_SIZE)
+        m_context_size = 64;
+
+    dmesgln("xHCI: {} device slots, {} ports, {} byte contexts", m_max_slots, m_max_ports, m_context_size);
+
+    m_slots.resize(m_max_slots + 1);
+    m_devices.resize(m_max_ports);
+
+    reset();
+    // A vector of its own when the controller can send messages, which
+    // its event ring interrupter does as MSI-X entry 0. The pin otherwise.
+    m_msi = PCI::MessageSignaledInterrupt::try_enable(pci_address(), *this);
+    start();
+    if (!m_msi)
+        enable_irq();
+}
+
+UNMAP_AFTER_INIT XHCIController::~XHCIController()
+{
+}
+
+OwnPtr<Region> XHCIController::allocate_dma_region(size_t size, StringView name)
+{
+    auto region = MM.allocate_contiguous_kernel_region(page_round_up(size), name, Region::Access::Read | Region::Access::Write, Region::Cacheable::No);
+    if (region)
+        memset(region->vaddr().as_ptr(), 0, page_round_up(size));
+    return region;
+}
+
+bool XHCIController::create_ring(ProducerRing& ring, StringView name)
+{
+    ring.region = allocate_dma_region(PAGE_SIZE, name);
+    if (!ring.region)
+        return false;
+    ring.enqueue_index = 0;
+    ring.cycle = true;
+
+    auto& link = ring.trbs()[trbs_per_ring - 1];
+    link.parameter = ring.paddr();
+    link.control = TransferRequestBlock::control_for(TransferRequestBlock::Type::Link) | TransferRequestBlock::ControlBits::ToggleCycle;
+    return true;
+}
+
+u64 XHCIController::enqueue_trb(ProducerRing& ring, u64 parameter, u32 status, u32 control)
+{
+    auto& trb = ring.trbs()[ring.enqueue_index];
+    u64 trb_paddr = ring.paddr() + ring.enqueue_index * sizeof(TransferRequestBlock);
+
+    trb.parameter = parameter;
+    trb.status = status;
+    // The cycle bit hands the TRB to the controller, it goes in last.
+    full_memory_barrier();
+    trb.control = control | (ring.cycle ? TransferRequestBlock::ControlBits::Cycle : 0);
+
+    if (++ring.enqueue_index == trbs_per_ring - 1) {
+        auto& link = ring.trbs()[trbs_per_ring - 1];
+        u32 link_control = link.control & ~TransferRequestBlock::ControlBits::Cycle;
+        full_memory_barrier();
+        link.control = link_control | (ring.cycle ? TransferRequestBlock::ControlBits::Cycle : 0);
+        ring.enqueue_index = 0;
+        ring.cycle = !ring.cycle;
+    }
+    return trb_paddr;
+}
+
+void XHCIController::stop()
+{
+    write_operational(XHCI_USBCMD, read_operational(XHCI_USBCMD) & ~XHCI_USBCMD_RUN);
+    while (!(read_operational(XHCI_USBSTS) & XHCI_USBSTS_HOST_CONTROLLER_HALTED))
+        ;
+}
+
+void XHCIController::reset()
+{
+    stop();
+
+    write_operational(XHCI_USBCMD, XHCI_USBCMD_HOST_CONTROLLER_RESET);
+    while (read_operational(XHCI_USBCMD) & XHCI_USBCMD_HOST_CONTROLLER_RESET)
+        ;
+    while (read_operational(XHCI_USBSTS) & XHCI_USBSTS_CONTROLLER_NOT_READY)
+        ;
+
+    write_operational(XHCI_CONFIG, m_max_slots);
+
+    m_device_context_base_array = allocate_dma_region((m_max_slots + 1) * sizeof(u64), "xHCI Device Context Base Array");
+    VERIFY(m_device_context_base_array);
+    auto* device_context_base_array = reinterpret_cast<u64*>(m_device_context_base_array->vaddr().as_ptr());
+
+    u32 hcsparams2 = read_capability(XHCI_HCSPARAMS2);
+    size_t scratchpad_count = (((hcsparams2 >> 21) & 0x1f) << 5) | ((hcsparams2 >> 27) & 0x1f);
+    if (scratchpad_count) {
+        m_scratchpad_array = allocate_dma_region(scratchpad_count * sizeof(u64), "xHCI Scratchpad Array");
+        VERIFY(m_scratchpad_array);
+        auto* scratchpad_array = reinterpret_cast<u64*>(m_scratchpad_array->vaddr().as_ptr());
+        for (size_t i = 0; i < scratchpad_count; i++) {
+            auto buffer = allocate_dma_region(PAGE_SIZE, "xHCI Scratchpad");
+            VERIFY(buffer);
+            scratchpad_array[i] = buffer->physical_page(0)->paddr().get();
+            m_scratchpad_buffers.append(buffer.release_nonnull());
+        }
+        device_context_base_array[0] = m_scratchpad_array->physical_page(0)->paddr().get();
+    }
+    write_operational64(XHCI_DCBAAP, m_device_context_base_array->physical_page(0)->paddr().get());
+
+    VERIFY(create_ring(m_command_ring, "xHCI Command Ring"));
+    write_operational64(XHCI_CRCR, m_command_ring.paddr() | XHCI_CRCR_RING_CYCLE_STATE);
+
+    m_event_ring = allocate_dma_region(PAGE_SIZE, "xHCI Event Ring");
+    m_event_ring_segment_table = allocate_dma_region(sizeof(EventRingSegmentTableEntry), "xHCI Event Ring Segment Table");
+    VERIFY(m_event_ring && m_event_ring_segment_table);
+    auto& segment = *reinterpret_cast<EventRingSegmentTableEntry*>(m_event_ring_segment_table->vaddr().as_ptr());
+    segment.ring_segment_base = m_event_ring->physical_page(0)->paddr().get();
+    segment.ring_segment_size = trbs_per_ring;
+    m_event_dequeue_index = 0;
+    m_event_cycle = true;
+
+    write_runtime(XHCI_ERSTSZ, 1);
+    write_runtime64(XHCI_ERDP, segment.ring_segment_base);
+    write_runtime64(XHCI_ERSTBA, m_event_ring_segment_table->physical_page(0)->paddr().get());
+    write_runtime(XHCI_IMOD, XHCI_INTERRUPT_MODERATION_INTERVAL);
+    write_runtime(XHCI_IMAN, XHCI_IMAN_INTERRUPT_PENDING | XHCI_IMAN_INTERRUPT_ENABLE);
+
+    dbgln("xHCI: Reset completed");
+}
+
+void XHCIController::start()
+{
+    write_operational(XHCI_USBCMD, read_operational(XHCI_USBCMD) | XHCI_USBCMD_RUN | XHCI_USBCMD_INTERRUPTER_ENABLE);
+    while (read_operational(XHCI_USBSTS) & XHCI_USBSTS_HOST_CONTROLLER_HALTED)
+        ;
+    dbgln("xHCI: Started");
+}
+
+KResultOr<TransferRequestBlock> XHCIController::wait_for_completion(Completion& completion)
+{
+    // Commands and transfers are serialized by their locks, so there is a
+    // single waiter and a wake before we block is remembered.
+    while (!completion.done)
+        completion.wait_queue.wait_forever("xHCICompletion");
+
+    auto event = completion.event;
+    if (event.completion_code() != TransferRequestBlock::CompletionCode::Success && event.completion_code() != TransferRequestBlock::CompletionCode::ShortPacket) {
+        dbgln_if(USB_DEBUG, "xHCI: Request failed with completion code {}", (u8)event.completion_code());
+        return EIO;
+    }
+    return event;
+}
+
+KResultOr<TransferRequestBlock> XHCIController::submit_command(u64 parameter, u32 status, u32 control)
+{
+    Locker locker(m_command_lock);
+    m_command_completion.done = false;
+    m_command_completion.trb_paddr = enqueue_trb(m_command_ring, parameter, status, control);
+    ring_doorbell(0, 0);
+    return wait_for_completion(m_command_completion);
+}
+
+KResultOr<u8> XHCIController::enable_slot()
+{
+    auto event_or_error = submit_command(0, 0, TransferRequestBlock::control_for(TransferRequestBlock::Type::EnableSlotCommand));
+    if (event_or_error.is_error())
+        return event_or_error.error();
+    return event_or_error.value().slot_id();
+}
+
+void XHCIController::disable_slot(DeviceSlot& slot)
+{
+    (void)submit_command(0, 0, TransferRequestBlock::control_for(TransferRequestBlock::Type::DisableSlotCommand) | (slot.slot_id << TransferRequestBlock::slot_id_shift));
+    reinterpret_cast<u64*>(m_device_context_base_array->vaddr().as_ptr())[slot.slot_id] = 0;
+}
+
+u32* XHCIController::input_context(DeviceSlot& slot, size_t index)
+{
+    // Index 0 is the input control context, the slot context and the
+    // endpoint contexts follow in device context order.
+    return reinterpret_cast<u32*>(slot.input_context->vaddr().offset(index * m_context_size).as_ptr());
+}
+
+KResult XHCIController::address_device(DeviceSlot& slot, bool block_set_address_request)
+{
+    memset(slot.input_context->vaddr().as_ptr(), 0, PAGE_SIZE);
+
+    input_context(slot, 0)[InputControlContext::add_flags] = 0b11;
+
+    auto* slot_context = input_context(slot, 1);
+    slot_context[SlotContext::route_and_speed] = (slot.speed_id << SlotContext::speed_shift) | (1 << SlotContext::context_entries_shift);
+    slot_context[SlotContext::root_hub_port] = (slot.port + 1) << SlotContext::root_hub_port_shift;
+
+    auto* ep0_context = input_context(slot, 2);
+    ep0_context[EndpointContext::error_count_and_type] = (3 << EndpointContext::error_count_shift) | (EndpointContext::type_control << EndpointContext::type_shift) | (slot.ep0_max_packet_size << EndpointContext::max_packet_size_shift);
+    u64 dequeue_pointer = slot.ep0_ring.paddr() | (slot.ep0_ring.cycle ? 1 : 0);
+    ep0_context[EndpointContext::dequeue_pointer_low] = dequeue_pointer & 0xffffffff;
+    ep0_context[EndpointContext::dequeue_pointer_high] = dequeue_pointer >> 32;
+    ep0_context[EndpointContext::average_trb_length] = 8;
+
+    u32 control = TransferRequestBlock::control_for(TransferRequestBlock::Type::AddressDeviceCommand) | (slot.slot_id << TransferRequestBlock::slot_id_shift);
+    if (block_set_address_request)
+        control |= TransferRequestBlock::ControlBits::BlockSetAddressRequest;
+
+    auto event_or_error = submit_command(slot.input_context->physical_page(0)->paddr().get(), 0, control);
+    if (event_or_error.is_error())
+        return event_or_error.error();
+    return KSuccess;
+}
+
+KResult XHCIController::update_ep0_max_packet_size(DeviceSlot& slot, u16 max_packet_size)
+{
+    memset(slot.input_context->vaddr().as_ptr(), 0, PAGE_SIZE);
+    input_context(slot, 0)[InputControlContext::add_flags] = 0b10;
+    input_context(slot, 2)[EndpointContext::error_count_and_type] = (3 << EndpointContext::error_count_shift) | (EndpointContext::type_control << EndpointContext::type_shift) | (max_packet_size << EndpointContext::max_packet_size_shift);
+
+    auto event_or_error = submit_command(slot.input_context->physical_page(0)->paddr().get(), 0, TransferRequestBlock::control_for(TransferRequestBlock::Type::EvaluateContextCommand) | (slot.slot_id << TransferRequestBlock::slot_id_shift));
+    if (event_or_error.is_error())
+        return event_or_error.error();
+    slot.ep0_max_packet_size = max_packet_size;
+    return KSuccess;
+}
+
+XHCIController::DeviceSlot* XHCIController::slot_for_address(u8 usb_address)
+{
+    ScopedSpinLock lock(m_slots_lock);
+    // Until SET_ADDRESS, the device being enumerated answers at address 0.
+    if (usb_address == 0)
+        return m_default_state_slot;
+    for (auto& slot : m_slots) {
+        if (slot && slot->usb_address == usb_address)
+            return slot.ptr();
+    }
+    return nullptr;
+}
+
+KResultOr<size_t> XHCIController::submit_control_transfer(Transfer& transfer)
+{
+    TRACE_EVENT(USBTransfer, this, 0, transfer.transfer_data_size());
+    ScopedTimer timer(g_usb_control_transfer_latency);
+    Pipe& pipe = transfer.pipe();
+    auto const& request = transfer.request();
+
+    auto* slot = slot_for_address(pipe.device_address());
+    if (!slot)
+        return ENODEV;
+
+    // The controller owns device addresses, SET_ADDRESS becomes an
+    // Address Device command. Like the UHCI driver, the setup stage
+    // counts towards the transferred length.
+    if (request.request == USB_REQUEST_SET_ADDRESS) {
+        auto result = address_device(*slot, false);
+        if (result.is_error())
+            return result;
+        ScopedSpinLock lock(m_slots_lock);
+        slot->usb_address = request.value;
+        if (m_default_state_slot == slot)
+            m_default_state_slot = nullptr;
+        return sizeof(USBRequestData);
+    }
+
+    if (pipe.max_packet_size() != slot->ep0_max_packet_size) {
+        auto result = update_ep0_max_packet_size(*slot, pipe.max_packet_size());
+        if (result.is_error())
+            return result;
+    }
+
+    bool direction_in = (request.request_type & USB_DEVICE_REQUEST_DEVICE_TO_HOST) == USB_DEVICE_REQUEST_DEVICE_TO_HOST;
+    size_t data_size = transfer.transfer_data_size();
+
+    Locker locker(m_transfer_lock);
+    m_transfer_completion.done = false;
+    m_transfer_completion.data_trb_paddr = 0;
+    m_transfer_completion.data_residue = 0;
+
+    u64 setup_packet = 0;
+    memcpy(&setup_packet, &request, sizeof(USBRequestData));
+    u32 setup_control = TransferRequestBlock::control_for(TransferRequestBlock::Type::SetupStage) | TransferRequestBlock::ControlBits::ImmediateData;
+    if (data_size)
+        setup_control |= (direction_in ? XHCI_TRANSFER_TYPE_IN_DATA : XHCI_TRANSFER_TYPE_OUT_DATA) << TransferRequestBlock::transfer_type_shift;
+    enqueue_trb(slot->ep0_ring, setup_packet, sizeof(USBRequestData), setup_control);
+
+    if (data_size) {
+        u32 data_control = TransferRequestBlock::control_for(TransferRequestBlock::Type::DataStage) | TransferRequestBlock::ControlBits::InterruptOnShortPacket;
+        if (direction_in)
+            data_control |= TransferRequestBlock::ControlBits::DirectionIn;
+        m_transfer_completion.data_trb_paddr = enqueue_trb(slot->ep0_ring, transfer.buffer_physical().offset(sizeof(USBRequestData)).get(), data_size, data_control);
+    }
+
+    // The status stage goes the other way, or in if there was no data.
+    u32 status_control = TransferRequestBlock::control_for(TransferRequestBlock::Type::StatusStage) | TransferRequestBlock::ControlBits::InterruptOnCompletion;
+    if (!data_size || !direction_in)
+        status_control |= TransferRequestBlock::ControlBits::DirectionIn;
+    m_transfer_completion.trb_paddr = enqueue_trb(slot->ep0_ring, 0, 0, status_control);
+
+    ring_doorbell(slot->slot_id, XHCI_EP0_DOORBELL_TARGET);
+
+    auto event_or_error = wait_for_completion(m_transfer_completion);
+    if (event_or_error.is_error()) {
+        transfer.set_complete();
+        transfer.set_error_occurred();
+        return event_or_error.error();
+    }
+
+    transfer.set_complete();
+    return sizeof(USBRequestData) + data_size - m_transfer_completion.data_residue;
+}
+
+KResultOr<size_t> XHCIController::submit_bulk_transfer(Transfer&)
+{
+    // Needs a Configure Endpoint command per pipe, which is still missing.
+    return ENOTSUP;
+}
+
+KResultOr<size_t> XHCIController::submit_interrupt_transfer(Transfer&, u8)
+{
+    return ENOTSUP;
+}
+
+RefPtr<USB::Device> const XHCIController::get_device_at_port(USB::Device::PortNumber port)
+{
+    if (to_underlying(port) >= m_devices.size())
+        return nullptr;
+    return m_devices.at(to_underlying(port));
+}
+
+RefPtr<USB::Device> const XHCIController::get_device_from_address(u8 device_address)
+{
+    for (auto const& device : m_devices) {
+        if (device && device->address() == device_address)
+            return device;
+    }
+    return nullptr;
+}
+
+bool XHCIController::reset_port(u8 port)
+{
+    // USB 3 ports train on their own and come up enabled, USB 2 ports
+    // need a reset first.
+    u32 port_status = read_portsc(port);
+    if (port_status & XHCI_PORTSC_PORT_ENABLED)
+        return true;
+
+    write_portsc(port, (port_status & ~XHCI_PORTSC_WRITE_ONE_TO_CLEAR) | XHCI_PORTSC_PORT_RESET);
+    for (size_t i = 0; i < 100; i++) {
+        port_status = read_portsc(port);
+        if (port_status & XHCI_PORTSC_PORT_RESET_CHANGE)
+            break;
+        IO::delay(1000);
+    }
+    write_portsc(port, (port_status & ~XHCI_PORTSC_WRITE_ONE_TO_CLEAR) | XHCI_PORTSC_PORT_RESET_CHANGE);
+    return read_portsc(port) & XHCI_PORTSC_PORT_ENABLED;
+}
+
+void XHCIController::handle_port_connect(u8 port)
+{
+    dmesgln("xHCI: Device attach detected on root port {}", port + 1);
+    if (!reset_port(port)) {
+        dmesgln("xHCI: Port {} did not come up after reset", port + 1);
+        return;
+    }
+
+    u32 speed_id = (read_portsc(port) >> XHCI_PORTSC_SPEED_SHIFT) & XHCI_PORTSC_SPEED_MASK;
+    USB::Device::DeviceSpeed speed = USB::Device::DeviceSpeed::SuperSpeed;
+    u16 max_packet_size = 512;
+    if (speed_id == XHCI_PORT_SPEED_FULL || speed_id == XHCI_PORT_SPEED_LOW) {
+        speed = speed_id == XHCI_PORT_SPEED_LOW ? USB::Device::DeviceSpeed::LowSpeed : USB::Device::DeviceSpeed::FullSpeed;
+        max_packet_size = 8;
+    } else if (speed_id == XHCI_PORT_SPEED_HIGH) {
+        speed = USB::Device::DeviceSpeed::HighSpeed;
+        max_packet_size = 64;
+    }
+
+    auto slot_id_or_error = enable_slot();
+    if (slot_id_or_error.is_error()) {
+        dmesgln("xHCI: Could not enable a slot for port {} ({})", port + 1, slot_id_or_error.error());
+        return;
+    }
+
+    auto slot = make<DeviceSlot>();
+    slot->slot_id = slot_id_or_error.value();
+    slot->port = port;
+    slot->speed_id = speed_id;
+    slot->ep0_max_packet_size = max_packet_size;
+    slot->input_context = allocate_dma_region(PAGE_SIZE, "xHCI Input Context");
+    slot->device_context = allocate_dma_region(PAGE_SIZE, "xHCI Device Context");
+    if (!slot->input_context || !slot->device_context || !create_ring(slot->ep0_ring, "xHCI EP0 Ring")) {
+        disable_slot(*slot);
+        return;
+    }
+    reinterpret_cast<u64*>(m_device_context_base_array->vaddr().as_ptr())[slot->slot_id] = slot->device_context->physical_page(0)->paddr().get();
+
+    // Stop short of SET_ADDRESS so USB::Device can enumerate the same way
+    // on every controller, we turn its SET_ADDRESS into the real command.
+    if (address_device(*slot, true).is_error()) {
+        dmesgln("xHCI: Could not address the device on port {}", port + 1);
+        disable_slot(*slot);
+        return;
+    }
+
+    auto* slot_ptr = slot.ptr();
+    {
+        ScopedSpinLock lock(m_slots_lock);
+        m_slots[slot_ptr->slot_id] = move(slot);
+        m_default_state_slot = slot_ptr;
+    }
+
+    auto device = USB::Device::try_create(*this, static_cast<USB::Device::PortNumber>(port), speed);
+    {
+        ScopedSpinLock lock(m_slots_lock);
+        if (m_default_state_slot == slot_ptr)
+            m_default_state_slot = nullptr;
+    }
+    if (device.is_error()) {
+        dmesgln("xHCI: Device creation failed on port {} ({})", port + 1, device.error());
+        return;
+    }
+    m_devices[port] = device.release_value();
+}
+
+void XHCIController::handle_port_disconnect(u8 port)
+{
+    dmesgln("xHCI: Device detach detected on root port {}", port + 1);
+    m_devices[port] = nullptr;
+
+    OwnPtr<DeviceSlot> slot;
+    {
+        ScopedSpinLock lock(m_slots_lock);
+        for (auto& candidate : m_slots) {
+            if (candidate && candidate->port == port) {
+                slot = move(candidate);
+                break;
+            }
+        }
+    }
+    if (slot)
+        disable_slot(*slot);
+}
+
+void XHCIController::spawn_port_proc()
+{
+    RefPtr<Thread> xhci_hotplug_thread;
+
+    Process::create_kernel_process(xhci_hotplug_thread, "xHCIHotplug", [&] {
+        for (;;) {
+            for (u8 port = 0; port < m_max_ports; port++) {
+                u32 port_status = read_portsc(port);
+                if (!(port_status & XHCI_PORTSC_CONNECT_STATUS_CHANGE))
+                    continue;
+                write_portsc(port, (port_status & ~XHCI_PORTSC_WRITE_ONE_TO_CLEAR) | XHCI_PORTSC_CONNECT_STATUS_CHANGE);
+
+                if (port_status & XHCI_PORTSC_CURRENT_CONNECT_STATUS)
+                    handle_port_connect(port);
+                else
+                    handle_port_disconnect(port);
+            }
+            // Every change raises a Port Status Change event, a change
+            // made while we were looking at the ports has already woken us.
+            m_port_change_wait_queue.wait_forever("xHCIHotplug");
+        }
+    });
+}
+
+void XHCIController::handle_event(TransferRequestBlock const& event)
+{
+    switch (event.type()) {
+    case TransferRequestBlock::Type::CommandCompletionEvent:
+        if (event.parameter == m_command_completion.trb_paddr && !m_command_completion.done) {
+            m_command_completion.event = event;
+            m_command_completion.done = true;
+            m_command_completion.wait_queue.wake_all();
+        }
+        break;
+    case TransferRequestBlock::Type::TransferEvent: {
+        auto& completion = m_transfer_completion;
+        if (completion.done)
+            break;
+        bool failed = event.completion_code() != TransferRequestBlock::CompletionCode::Success && event.completion_code() != TransferRequestBlock::CompletionCode::ShortPacket;
+        if (event.parameter == completion.data_trb_paddr)
+            completion.data_residue = event.transfer_length();
+        // A failed stage halts the endpoint, no status event follows it.
+        if (event.parameter == completion.trb_paddr || failed) {
+            completion.event = event;
+            completion.done = true;
+            completion.wait_queue.wake_all();
+        }
+        break;
+    }
+    case TransferRequestBlock::Type::PortStatusChangeEvent:
+        // The hotplug thread picks the change up from PORTSC.
+        m_port_change_wait_queue.wake_one();
+        break;
+    default:
+        dbgln_if(USB_DEBUG, "xHCI: Unhandled event type {}", (u8)event.type());
+        break;
+    }
+}
+
+bool XHCIController::handle_irq(const RegisterState&)
+{
+    u32 status = read_operational(XHCI_USBSTS);
+    if (!(status & XHCI_USBSTS_EVENT_INTERRUPT))
+        return false;
+
+    write_operational(XHCI_USBSTS, XHCI_USBSTS_EVENT_INTERRUPT);
+    write_runtime(XHCI_IMAN, read_runtime(XHCI_IMAN) | XHCI_IMAN_INTERRUPT_PENDING);
+
+    auto* events = reinterpret_cast<TransferRequestBlock volatile*>(m_event_ring->vaddr().as_ptr());
+    for (;;) {
+        auto& slot = events[m_event_dequeue_index];
+        if (((slot.control & TransferRequestBlock::ControlBits::Cycle) != 0) != m_event_cycle)
+            break;
+
+        TransferRequestBlock event;
+        event.parameter = slot.parameter;
+        event.status = slot.status;
+        event.control = slot.control;
+        handle_event(event);
+
+        if (++m_event_dequeue_index == trbs_per_ring) {
+            m_event_dequeue_index = 0;
+            m_event_cycle = !m_event_cycle;
+        }
+    }
+
+    u64 dequeue_pointer = m_event_ring->physical_page(0)->paddr().get() + m_event_dequeue_index * sizeof(TransferRequestBlock);
+    write_runtime64(XHCI_ERDP, dequeue_pointer | XHCI_ERDP_EVENT_HANDLER_BUSY);
+    return true;
+}
+
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/NonnullOwnPtr.h>
+#include <base/Platform.h>
+#include <base/Vector.h>
+#include <kernel/bus/pci/Device.h>
+#include <kernel/bus/pci/MSI.h>
+#include <kernel/bus/usb/USBDevice.h>
+#include <kernel/bus/usb/USBHostController.h>
+#include <kernel/bus/usb/USBTransfer.h>
+#include <kernel/bus/usb/XHCIDescriptorTypes.h>
+#include <kernel/Lock.h>
+#include <kernel/SpinLock.h>
+#include <kernel/vm/MemoryManager.h>
+#include <kernel/WaitQueue.h>
+
+namespace Kernel::USB {
+
+// eXtensible Host Controller Interface, the USB 3 host controller which
+// also drives low, full and high speed devices on its USB 2 ports.
+//
+// Commands and control transfers are issued one at a time and finish
+// through the event ring of the primary interrupter. Only the default
+// control endpoint of each device is set up so far.
+class XHCIController final
+    : public PCI::Device
+    , public HostController {
+
+public:
+    static void detect();
+
+    virtual ~XHCIController() override;
+
+    virtual StringView purpose() const override { return "xHCI"; }
+    virtual StringView controller_name() const override { return "xHCI"; }
+
+    virtual void reset() override;
+    virtual void stop() override;
+    virtual void start() override;
+    void spawn_port_proc();
+
+    virtual KResultOr<size_t> submit_control_transfer(Transfer& transfer) override;
+    virtual KResultOr<size_t> submit_bulk_transfer(Transfer& transfer) override;
+    virtual KResultOr<size_t> submit_interrupt_transfer(Transfer& transfer, u8 polling_interval) override;
+
+    virtual RefPtr<USB::Device> const get_device_at_port(USB::Device::PortNumber) override;
+    virtual RefPtr<USB::Device> const get_device_from_address(u8 device_address) override;
+
+private:
+    // A ring software produces into: the command ring and every transfer
+    // ring. One page, the last TRB links back to the first.
+    struct ProducerRing {
+        OwnPtr<Region> region;
+        size_t enqueue_index { 0 };
+        bool cycle { true };
+
+        TransferRequestBlock* trbs() { return reinterpret_cast<TransferRequestBlock*>(region->vaddr().as_ptr()); }
+        u64 paddr() const { return region->physical_page(0)->paddr().get(); }
+    };
+
+    struct DeviceSlot {
+        u8 slot_id { 0 };
+        u8 port { 0 };
+        u8 usb_address { 0 };
+        u8 speed_id { 0 };
+        u16 ep0_max_packet_size { 0 };
+        OwnPtr<Region> input_context;
+        OwnPtr<Region> device_context;
+        ProducerRing ep0_ring;
+    };
+
+    // The one command or transfer in flight and the event that retired it.
+    struct Completion {
+        u64 trb_paddr { 0 };
+        u64 data_trb_paddr { 0 };
+        u32 data_residue { 0 };
+        bool done { false };
+        TransferRequestBlock event {};
+        WaitQueue wait_queue;
+    };
+
+    static constexpr size_t trbs_per_ring = PAGE_SIZE / sizeof(TransferRequestBlock);
+
+    XHCIController(PCI::Address, PCI::ID);
+
+    u32 read_capability(u32 offset) const { return *reinterpret_cast<u32 volatile*>(m_registers->vaddr().offset(offset).as_ptr()); }
+    u32 read_operational(u32 offset) const { return *reinterpret_cast<u32 volatile*>(m_registers->vaddr().offset(m_operational_offset + offset).as_ptr()); }
+    void write_operational(u32 offset, u32 value) { *reinterpret_cast<u32 volatile*>(m_registers->vaddr().offset(m_operational_offset + offset).as_ptr()) = value; }
+    void write_operational64(u32 offset, u64 value)
+    {
+        write_operational(offset, value & 0xffffffff);
+        write_operational(offset + 4, value >> 32);
+    }
+    u32 read_runtime(u32 offset) const { return *reinterpret_cast<u32 volatile*>(m_registers->vaddr().offset(m_runtime_offset + offset).as_ptr()); }
+    void write_runtime(u32 offset, u32 value) { *reinterpret_cast<u32 volatile*>(m_registers->vaddr().offset(m_runtime_offset + offset).as_ptr()) = value; }
+    void write_runtime64(u32 offset, u64 value)
+    {
+        write_runtime(offset, value & 0xffffffff);
+        write_runtime(offset + 4, value >> 32);
+    }
+    void ring_doorbell(u8 slot_id, u32 target) { *reinterpret_cast<u32 volatile*>(m_registers->vaddr().offset(m_doorbell_offset + slot_id * 4).as_ptr()) = target; }
+
+    u32 read_portsc(u8 port) const { return read_operational(0x400 + 0x10 * port); }
+    void write_portsc(u8 port, u32 value) { write_operational(0x400 + 0x10 * port, value); }
+
+    virtual bool handle_irq(const RegisterState&) override;
+    void handle_event(TransferRequestBlock const&);
+
+    OwnPtr<Region> allocate_dma_region(size_t size, StringView name);
+    bool create_ring(ProducerRing&, StringView name);
+    u64 enqueue_trb(ProducerRing&, u64 parameter, u32 status, u32 control);
+
+    KResultOr<TransferRequestBlock> submit_command(u64 parameter, u32 status, u32 control);
+    KResultOr<TransferRequestBlock> wait_for_completion(Completion&);
+
+    KResultOr<u8> enable_slot();
+    void disable_slot(DeviceSlot&);
+    KResult address_device(DeviceSlot&, bool block_set_address_request);
+    KResult update_ep0_max_packet_size(DeviceSlot&, u16 max_packet_size);
+    u32* input_context(DeviceSlot&, size_t index);
+    DeviceSlot* slot_for_address(u8 usb_address);
+
+    bool reset_port(u8 port);
+    void handle_port_connect(u8 port);
+    void handle_port_disconnect(u8 port);
+
+    OwnPtr<Region> m_registers;
+    OwnPtr<PCI::MessageSignaledInterrupt> m_msi;
+    u32 m_operational_offset { 0 };
+    u32 m_runtime_offset { 0 };
+    u32 m_doorbell_offset { 0 };
+    u8 m_max_slots { 0 };
+    u8 m_max_ports { 0 };
+    size_t m_context_size { 32 };
+
+    OwnPtr<Region> m_device_context_base_array;
+    OwnPtr<Region> m_scratchpad_array;
+    Vector<NonnullOwnPtr<Region>> m_scratchpad_buffers;
+
+    ProducerRing m_command_ring;
+    OwnPtr<Region> m_event_ring;
+    OwnPtr<Region> m_event_ring_segment_table;
+    size_t m_event_dequeue_index { 0 };
+    bool m_event_cycle { true };
+
+    Lock m_command_lock { "xHCICommand" };
+    Completion m_command_completion;
+
+    Lock m_transfer_lock { "xHCITransfer" };
+    Completion m_transfer_completion;
+
+    SpinLock<u8> m_slots_lock;
+    Vector<OwnPtr<DeviceSlot>> m_slots;
+    DeviceSlot* m_default_state_slot { nullptr };
+
+    // Woken by Port Status Change events. Ports are handled one at a time,
+    // commands and control transfers are too anyway.
+    WaitQueue m_port_change_wait_queue;
+
+    Vector<RefPtr<USB::Device>> m_devices;
+};
+
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+
+namespace Kernel::USB {
+
+// Transfer Request Block, the unit every xHCI ring is made of.
+struct alignas(16) TransferRequestBlock {
+    enum class Type : u8 {
+        Normal = 1,
+        SetupStage = 2,
+        DataStage = 3,
+        StatusStage = 4,
+        Link = 6,
+        NoOp = 8,
+        EnableSlotCommand = 9,
+        DisableSlotCommand = 10,
+        AddressDeviceCommand = 11,
+        ConfigureEndpointCommand = 12,
+        EvaluateContextCommand = 13,
+        NoOpCommand = 23,
+        TransferEvent = 32,
+        CommandCompletionEvent = 33,
+        PortStatusChangeEvent = 34,
+    };
+
+    enum ControlBits : u32 {
+        Cycle = 1 << 0,
+        ToggleCycle = 1 << 1,
+        InterruptOnShortPacket = 1 << 2,
+        Chain = 1 << 4,
+        InterruptOnCompletion = 1 << 5,
+        ImmediateData = 1 << 6,
+        BlockSetAddressRequest = 1 << 9,
+        DirectionIn = 1 << 16,
+    };
+
+    enum class CompletionCode : u8 {
+        Invalid = 0,
+        Success = 1,
+        ShortPacket = 13,
+    };
+
+    static constexpr u32 type_shift = 10;
+    static constexpr u32 slot_id_shift = 24;
+    static constexpr u32 transfer_type_shift = 16;
+
+    u64 parameter;
+    u32 status;
+    u32 control;
+
+    Type type() const { return static_cast<Type>((control >> type_shift) & 0x3f); }
+    bool cycle() const { return control & ControlBits::Cycle; }
+    u8 slot_id() const { return control >> slot_id_shift; }
+    CompletionCode completion_code() const { return static_cast<CompletionCode>(status >> 24); }
+    u32 transfer_length() const { return status & 0xffffff; }
+
+    static u32 control_for(Type type) { return static_cast<u32>(type) << type_shift; }
+};
+
+static_assert(sizeof(TransferRequestBlock) == 16);
+
+// One entry of the event ring segment table.
+struct [[gnu::packed]] EventRingSegmentTableEntry {
+    u64 ring_segment_base;
+    u32 ring_segment_size;
+    u32 reserved;
+};
+
+static_assert(sizeof(EventRingSegmentTableEntry) == 16);
+
+// Slot and endpoint contexts are 32 or 64 bytes depending on the
+// controller, they are only ever touched through these dword indices.
+namespace SlotContext {
+static constexpr u32 route_and_speed = 0;
+static constexpr u32 speed_shift = 20;
+static constexpr u32 context_entries_shift = 27;
+static constexpr u32 root_hub_port = 1;
+static constexpr u32 root_hub_port_shift = 16;
+static constexpr u32 device_address_and_state = 3;
+}
+
+namespace EndpointContext {
+static constexpr u32 error_count_and_type = 1;
+static constexpr u32 error_count_shift = 1;
+static constexpr u32 type_shift = 3;
+static constexpr u32 max_packet_size_shift = 16;
+static constexpr u32 dequeue_pointer_low = 2;
+static constexpr u32 dequeue_pointer_high = 3;
+static constexpr u32 average_trb_length = 4;
+
+static constexpr u32 type_control = 4;
+}
+
+namespace InputControlContext {
+static constexpr u32 drop_flags = 0;
+static constexpr u32 add_flags = 1;
+}
+
+}
@@ -12,6 +12,7 @@
 #include <base/TemporaryChange.h>
 #include <base/Vector.h>
 #include <base/kmalloc.h>
+#include <kernel/heap/HeapScrub.h>
 
 namespace Kernel {
 
@@ -39,9 +40,18 @@ class Heap {
         return (const AllocationHeader*)((((const u8*)ptr) - sizeof(AllocationHeader)));
     }
 
+    // The chunks are followed by the bitmap and then its summary.
+    static size_t memory_for_chunks(size_t chunks)
+    {
+        return chunks * CHUNK_SIZE + (chunks + 7) / 8 + Bitmap::summary_size_in_bytes(chunks);
+    }
+
     static size_t calculate_chunks(size_t memory_size)
     {
-        return (sizeof(u8) * memory_size) / (sizeof(u8) * CHUNK_SIZE + 1);
+        size_t chunks = (sizeof(u8) * memory_size) / (sizeof(u8) * CHUNK_SIZE + 1);
+        while (chunks && memory_for_chunks(chunks) > memory_size)
+            chunks--;
+        return chunks;
     }
 
 public:
@@ -51,14 +61,15 @@ public:
         , m_bitmap(memory + m_total_chunks * CHUNK_SIZE, m_total_chunks)
     {
 
-        VERIFY(m_total_chunks * CHUNK_SIZE + (m_total_chunks + 7) / 8 <= memory_size);
+        VERIFY(memory_for_chunks(m_total_chunks) <= memory_size);
+        m_bitmap.enable_summary(memory + m_total_chunks * CHUNK_SIZE + (m_total_chunks + 7) / 8);
     }
     ~Heap() = default;
 
     static size_t calculate_memory_for_bytes(size_t bytes)
     {
         size_t needed_chunks = (sizeof(AllocationHeader) + bytes + CHUNK_SIZE - 1) / CHUNK_SIZE;
-        return needed_chunks * CHUNK_SIZE + (needed_chunks + 7) / 8;
+        return memory_for_chunks(needed_chunks);
     }
 
     void* allocate(size_t size)
@@ -89,7 +100,8 @@ public:
 
         m_allocated_chunks += chunks_needed;
         if constexpr (HEAP_SCRUB_BYTE_ALLOC != 0) {
-            __builtin_memset(ptr, HEAP_SCRUB_BYTE_ALLOC, (chunks_needed * CHUNK_SIZE) - sizeof(AllocationHeader));
+            if (heap_should_scrub_on_alloc())
+                __builtin_memset(ptr, HEAP_SCRUB_BYTE_ALLOC, (chunks_needed * CHUNK_SIZE) - sizeof(AllocationHeader));
         }
         return ptr;
     }
@@ -112,10 +124,27 @@ public:
         m_allocated_chunks -= a->allocation_size_in_chunks;
 
         if constexpr (HEAP_SCRUB_BYTE_FREE != 0) {
-            __builtin_memset(a, HEAP_SCRUB_BYTE_FREE, a->allocation_size_in_chunks * CHUNK_SIZE);
+            if (heap_should_scrub_on_free())
+                __builtin_memset(a, HEAP_SCRUB_BYTE_FREE, a->allocation_size_in_chunks * CHUNK_SIZE);
         }
     }
 
+    // Size of an allocation including its header, read back from the header.
+    static size_t allocation_size_in_chunks(const void* ptr)
+    {
+        return ((const AllocationHeader*)((const u8*)ptr - sizeof(AllocationHeader)))->allocation_size_in_chunks;
+    }
+
+    static size_t chunks_for_size(size_t size)
+    {
+        return (size + sizeof(AllocationHeader) + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    }
+
+    static size_t usable_size_for_chunks(size_t chunks)
+    {
+        return chunks * CHUNK_SIZE - sizeof(AllocationHeader);
+    }
+
     bool contains(const void* ptr) const
     {
         const auto* a = allocation_header(ptr);
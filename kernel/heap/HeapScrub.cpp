@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/heap/HeapScrub.h>
+#include <kernel/heap/kmalloc.h>
+
+namespace Kernel {
+
+Atomic<u8, Base::MemoryOrder::memory_order_relaxed> g_heap_scrub_mode { static_cast<u8>(HeapScrubMode::Full) };
+
+// A countdown per processor, so sampling doesn't bounce a shared cache line
+// around. Losing a decrement to an interrupt only shifts the next sample.
+struct alignas(64) HeapScrubCountdown {
+    i32 frees_until_sample { HEAP_SCRUB_SAMPLE_RATE };
+};
+
+static HeapScrubCountdown s_scrub_countdowns[KMALLOC_MAX_SHARDS];
+
+void set_heap_scrub_mode(HeapScrubMode mode)
+{
+    g_heap_scrub_mode = static_cast<u8>(mode);
+}
+
+bool heap_scrub_take_sample()
+{
+    auto& countdown = s_scrub_countdowns[Processor::is_initialized() ? Processor::id() : 0];
+    if (--countdown.frees_until_sample > 0)
+        return false;
+    countdown.frees_until_sample = HEAP_SCRUB_SAMPLE_RATE;
+    return true;
+}
+
+}
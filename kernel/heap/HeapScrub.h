@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Atomic.h>
+#include <base/Types.h>
+
+namespace Kernel {
+
+// How much scrubbing kmalloc and the slab caches do. Scrubbing on free is
+// what catches use-after-free, scrubbing on allocation only makes reads of
+// uninitialized memory stand out, so a production kernel can drop the
+// latter and, for less bandwidth still, scrub only a sample of the frees.
+enum class HeapScrubMode : u8 {
+    Full,
+    FreeOnly,
+    SampledFree,
+    None,
+};
+
+// With HeapScrubMode::SampledFree one in this many frees is scrubbed.
+#define HEAP_SCRUB_SAMPLE_RATE 16
+
+extern Atomic<u8, Base::MemoryOrder::memory_order_relaxed> g_heap_scrub_mode;
+
+void set_heap_scrub_mode(HeapScrubMode);
+
+inline HeapScrubMode heap_scrub_mode()
+{
+    return static_cast<HeapScrubMode>(g_heap_scrub_mode.load());
+}
+
+bool heap_scrub_take_sample();
+
+ALWAYS_INLINE bool heap_should_scrub_on_alloc()
+{
+    return heap_scrub_mode() == HeapScrubMode::Full;
+}
+
+ALWAYS_INLINE bool heap_should_scrub_on_free()
+{
+    switch (heap_scrub_mode()) {
+    case HeapScrubMode::Full:
+    case HeapScrubMode::FreeOnly:
+        return true;
+    case HeapScrubMode::SampledFree:
+        return heap_scrub_take_sample();
+    case HeapScrubMode::None:
+        return false;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/HashFunctions.h>
+#include <base/JsonArraySerializer.h>
+#include <base/JsonObjectSerializer.h>
+#include <kernel/arch/x86/InterruptDisabler.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/arch/x86/SafeMem.h>
+#include <kernel/filesystem/SysFS.h>
+#include <kernel/heap/KmallocProfiler.h>
+#include <kernel/heap/kmalloc.h>
+#include <kernel/KBufferBuilder.h>
+#include <kernel/KSyms.h>
+#include <kernel/Sections.h>
+#include <kernel/SpinLock.h>
+#include <kernel/vm/MemoryManager.h>
+
+namespace Kernel {
+
+#define KMALLOC_PROFILER_MAX_SITES 512
+#define KMALLOC_PROFILER_MAX_SAMPLES 4096
+#define KMALLOC_PROFILER_FILTER_SIZE 16384
+
+struct KmallocProfileSite {
+    FlatPtr backtrace[KMALLOC_PROFILER_BACKTRACE_DEPTH];
+    unsigned hash;
+    size_t sample_count;
+    size_t total_bytes;
+    size_t live_bytes;
+};
+
+struct KmallocProfileSample {
+    static constexpr FlatPtr empty = 0;
+    static constexpr FlatPtr removed = 1;
+
+    FlatPtr address;
+    u16 site;
+    size_t weight;
+};
+
+struct alignas(64) KmallocProfilerCountdown {
+    ssize_t bytes_until_sample { KMALLOC_PROFILER_DEFAULT_SAMPLE_INTERVAL };
+    u32 random_state { 0x2545f491 };
+};
+
+static Atomic<size_t, Base::MemoryOrder::memory_order_relaxed> s_sample_interval { KMALLOC_PROFILER_DEFAULT_SAMPLE_INTERVAL };
+static KmallocProfilerCountdown s_countdowns[KMALLOC_MAX_SHARDS];
+
+// Everything below is only touched under s_profiler_lock, except the
+// filter: a counter per hash bucket of the sampled pointers, so kfree can
+// tell almost every pointer was never sampled without taking the lock.
+static SpinLock<u8> s_profiler_lock;
+static Atomic<u8, Base::MemoryOrder::memory_order_relaxed> s_sample_filter[KMALLOC_PROFILER_FILTER_SIZE];
+static KmallocProfileSite s_sites[KMALLOC_PROFILER_MAX_SITES];
+static size_t s_site_count;
+static KmallocProfileSample s_samples[KMALLOC_PROFILER_MAX_SAMPLES];
+static size_t s_sample_count;
+static size_t s_dropped_sample_count;
+
+static size_t capture_backtrace(FlatPtr* backtrace)
+{
+    // Skip the frame of kmalloc itself, the first interesting address is
+    // where kmalloc was called from.
+    size_t skip = 1;
+    size_t depth = 0;
+    FlatPtr* frame = (FlatPtr*)__builtin_frame_address(0);
+
+    while (frame && depth < KMALLOC_PROFILER_BACKTRACE_DEPTH && !is_user_address(VirtualAddress(frame))) {
+        FlatPtr frame_data[2];
+        void* fault_at;
+        if (!safe_memcpy(frame_data, frame, sizeof(frame_data), fault_at) || !frame_data[1])
+            break;
+        if (skip)
+            skip--;
+        else
+            backtrace[depth++] = frame_data[1];
+        frame = (FlatPtr*)frame_data[0];
+    }
+    return depth;
+}
+
+static Optional<u16> find_or_add_site(FlatPtr const* backtrace)
+{
+    unsigned hash = 0;
+    for (size_t i = 0; i < KMALLOC_PROFILER_BACKTRACE_DEPTH; i++)
+        hash = pair_int_hash(hash, ptr_hash(backtrace[i]));
+
+    for (size_t i = 0; i < s_site_count; i++) {
+        auto& site = s_sites[i];
+        if (site.hash == hash && !__builtin_memcmp(site.backtrace, backtrace, sizeof(site.backtrace)))
+            return i;
+    }
+
+    if (s_site_count == KMALLOC_PROFILER_MAX_SITES)
+        return {};
+
+    auto& site = s_sites[s_site_count];
+    __builtin_memcpy(site.backtrace, backtrace, sizeof(site.backtrace));
+    site.hash = hash;
+    return s_site_count++;
+}
+
+static size_t filter_index(FlatPtr address)
+{
+    return ptr_hash(address) % KMALLOC_PROFILER_FILTER_SIZE;
+}
+
+void kmalloc_profiler_set_sample_interval(size_t interval)
+{
+    s_sample_interval = interval;
+}
+
+void kmalloc_profiler_did_allocate(void* ptr, size_t size)
+{
+    size_t interval = s_sample_interval;
+    if (!interval || !Processor::is_initialized())
+        return;
+
+    {
+        InterruptDisabler disabler;
+        auto& countdown = s_countdowns[Processor::id()];
+        countdown.bytes_until_sample -= size;
+        if (countdown.bytes_until_sample > 0)
+            return;
+
+        // Jitter the distance to the next sample so periodic allocation
+        // patterns don't always hit or always miss.
+        countdown.random_state ^= countdown.random_state << 13;
+        countdown.random_state ^= countdown.random_state >> 17;
+        countdown.random_state ^= countdown.random_state << 5;
+        countdown.bytes_until_sample = interval / 2 + countdown.random_state % interval;
+    }
+
+    FlatPtr backtrace[KMALLOC_PROFILER_BACKTRACE_DEPTH] = {};
+    capture_backtrace(backtrace);
+    size_t weight = max(size, interval);
+
+    ScopedSpinLock lock(s_profiler_lock);
+    auto site_index = find_or_add_site(backtrace);
+    if (!site_index.has_value() || s_sample_count >= KMALLOC_PROFILER_MAX_SAMPLES * 3 / 4) {
+        s_dropped_sample_count++;
+        return;
+    }
+
+    auto& site = s_sites[site_index.value()];
+    site.sample_count++;
+    site.total_bytes += weight;
+    site.live_bytes += weight;
+
+    FlatPtr address = (FlatPtr)ptr;
+    for (size_t i = ptr_hash(address) % KMALLOC_PROFILER_MAX_SAMPLES;; i = (i + 1) % KMALLOC_PROFILER_MAX_SAMPLES) {
+        auto& sample = s_samples[i];
+        if (sample.address == KmallocProfileSample::empty || sample.address == KmallocProfileSample::removed) {
+            sample = { address, site_index.value(), weight };
+            break;
+        }
+    }
+    s_sample_count++;
+
+    auto& filter = s_sample_filter[filter_index(address)];
+    if (filter < NumericLimits<u8>::max())
+        filter++;
+}
+
+void kmalloc_profiler_will_free(void* ptr)
+{
+    FlatPtr address = (FlatPtr)ptr;
+    if (!s_sample_filter[filter_index(address)])
+        return;
+
+    ScopedSpinLock lock(s_profiler_lock);
+    for (size_t i = ptr_hash(address) % KMALLOC_PROFILER_MAX_SAMPLES;; i = (i + 1) % KMALLOC_PROFILER_MAX_SAMPLES) {
+        auto& sample = s_samples[i];
+        if (sample.address == KmallocProfileSample::empty)
+            return;
+        if (sample.address != address)
+            continue;
+
+        s_sites[sample.site].live_bytes -= sample.weight;
+        sample.address = KmallocProfileSample::removed;
+        s_sample_count--;
+
+        // A saturated counter stays that way, it no longer knows how many
+        // sampled pointers it stands for.
+        auto& filter = s_sample_filter[filter_index(address)];
+        if (filter < NumericLimits<u8>::max())
+            filter--;
+        return;
+    }
+}
+
+class SysFSKmallocProfile final : public SysFSComponent {
+public:
+    static NonnullRefPtr<SysFSKmallocProfile> create()
+    {
+        return adopt_ref(*new (nothrow) SysFSKmallocProfile);
+    }
+
+    virtual KResultOr<size_t> read_bytes(off_t offset, size_t count, UserOrKernelBuffer& buffer, FileDescription*) const override
+    {
+        auto data = try_to_generate_buffer();
+        if (!data)
+            return ENOMEM;
+
+        if ((size_t)offset >= data->size())
+            return KSuccess;
+
+        ssize_t nread = min(static_cast<off_t>(data->size() - offset), static_cast<off_t>(count));
+        if (!buffer.write(data->data() + offset, nread))
+            return EFAULT;
+        return nread;
+    }
+
+private:
+    SysFSKmallocProfile()
+        : SysFSComponent("kmalloc_profile"sv)
+    {
+    }
+
+    OwnPtr<KBuffer> try_to_generate_buffer() const
+    {
+        // Take a copy first, building the output allocates and kmalloc may
+        // want the profiler lock.
+        auto* sites = (KmallocProfileSite*)kmalloc(sizeof(s_sites));
+        size_t site_count;
+        size_t dropped_sample_count;
+        {
+            ScopedSpinLock lock(s_profiler_lock);
+            __builtin_memcpy(sites, s_sites, sizeof(s_sites));
+            site_count = s_site_count;
+            dropped_sample_count = s_dropped_sample_count;
+        }
+
+        KBufferBuilder builder;
+        JsonObjectSerializer<KBufferBuilder> json { builder };
+        json.add("sample_interval", s_sample_interval.load());
+        json.add("dropped_samples", dropped_sample_count);
+
+        auto sites_array = json.add_array("sites");
+        for (size_t i = 0; i < site_count; i++) {
+            auto& site = sites[i];
+            auto site_object = sites_array.add_object();
+            site_object.add("samples", site.sample_count);
+            site_object.add("total_bytes", site.total_bytes);
+            site_object.add("live_bytes", site.live_bytes);
+
+            auto frames = site_object.add_array("backtrace");
+            for (auto address : site.backtrace) {
+                if (!address)
+                    break;
+                auto frame = frames.add_object();
+                frame.add("address", address);
+                if (g_kernel_symbols_available) {
+                    if (auto* symbol = symbolicate_kernel_address(address))
+                        frame.add("symbol", String::formatted("{}+{:#x}", symbol->name, address - symbol->address));
+                }
+                frame.finish();
+            }
+            frames.finish();
+            site_object.finish();
+        }
+        sites_array.finish();
+        json.finish();
+
+        kfree(sites);
+        return builder.build();
+    }
+};
+
+UNMAP_AFTER_INIT void kmalloc_profiler_initialize()
+{
+    SysFSComponentRegistry::the().register_new_component(SysFSKmallocProfile::create());
+}
+
+}
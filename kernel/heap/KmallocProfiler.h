@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+
+namespace Kernel {
+
+// Sampling heap profiler for kmalloc. Roughly one in every sample interval
+// bytes is sampled, and the backtrace of the allocation is charged with the
+// interval's worth of bytes (or the allocation's size if it is larger).
+// Sampled pointers are remembered until they are freed, so every site has
+// an estimate of both the bytes it allocated and the bytes it still holds.
+//
+// The results are exported as the kmalloc_profile SysFS component.
+
+#define KMALLOC_PROFILER_DEFAULT_SAMPLE_INTERVAL (512 * KiB)
+#define KMALLOC_PROFILER_BACKTRACE_DEPTH 6
+
+void kmalloc_profiler_initialize();
+
+// An interval of 0 turns sampling off.
+void kmalloc_profiler_set_sample_interval(size_t);
+
+void kmalloc_profiler_did_allocate(void* ptr, size_t size);
+void kmalloc_profiler_will_free(void* ptr);
+
+}
@@ -7,165 +7,333 @@
 // includes
 #include <base/Assertions.h>
 #include <base/Memory.h>
+#include <kernel/AddressSanitizer.h>
+#include <kernel/heap/HeapScrub.h>
 #include <kernel/heap/SlabAllocator.h>
 #include <kernel/heap/kmalloc.h>
 #include <kernel/Sections.h>
+#include <kernel/SpinLock.h>
+#include <kernel/arch/x86/InterruptDisabler.h>
+#include <kernel/arch/x86/MemoryOperations.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/vm/MemoryManager.h>
 #include <kernel/vm/Region.h>
 
 #define SANITIZE_SLABS
 
 namespace Kernel {
 
-template<size_t templated_slab_size>
-class SlabAllocator {
-public:
-    SlabAllocator() = default;
+static_assert(SlabCache::max_processors == ProcessorContainer().size());
 
-    void init(size_t size)
-    {
-        m_base = kmalloc_eternal(size);
-        m_end = (u8*)m_base + size;
-        FreeSlab* slabs = (FreeSlab*)m_base;
-        m_slab_count = size / templated_slab_size;
-        for (size_t i = 1; i < m_slab_count; ++i) {
-            slabs[i].next = &slabs[i - 1];
-        }
-        slabs[0].next = nullptr;
-        m_freelist = &slabs[m_slab_count - 1];
-        m_num_allocated = 0;
-    }
+static constexpr size_t SLAB_OBJECT_ALIGNMENT = 16;
 
-    constexpr size_t slab_size() const { return templated_slab_size; }
-    size_t slab_count() const { return m_slab_count; }
+Atomic<SlabCache*> SlabCache::s_caches { nullptr };
 
-    void* alloc()
-    {
-        FreeSlab* free_slab;
+SlabCache::SlabCache(char const* name, size_t object_size)
+    : m_name(name)
+    , m_object_size(round_up_to_power_of_two(max(object_size, sizeof(FreeSlab)), SLAB_OBJECT_ALIGNMENT))
+{
+    VERIFY(m_object_size <= PAGE_SIZE / 2);
+
+    auto* next = s_caches.load(Base::memory_order_relaxed);
+    do {
+        m_next_cache = next;
+    } while (!s_caches.compare_exchange_strong(next, this, Base::memory_order_acq_rel));
+}
+
+SlabCache::Magazine* SlabCache::current_magazine()
+{
+    // Early allocations happen before the processor structures are set up.
+    if (!Processor::is_initialized())
+        return nullptr;
+    return &m_magazines[Processor::id()];
+}
+
+SlabCache::SlabPage& SlabCache::page_of(FreeSlab* slab)
+{
+    auto& page = *(SlabPage*)page_round_down((FlatPtr)slab);
+    VERIFY(page.cache == this);
+    return page;
+}
+
+void* SlabCache::alloc()
+{
+    bool counted = false;
+    for (;;) {
+        FreeSlab* free_slab = nullptr;
         {
-            ScopedCritical critical;
-            FreeSlab* next_free;
-            free_slab = m_freelist.load(Base::memory_order_consume);
-            do {
-                if (!free_slab)
-                    return kmalloc(slab_size());
-                next_free = free_slab->next;
-            } while (!m_freelist.compare_exchange_strong(free_slab, next_free, Base::memory_order_acq_rel));
-
-            m_num_allocated++;
+            InterruptDisabler disabler;
+            auto* magazine = current_magazine();
+            if (!magazine) {
+                free_slab = depot_pop();
+            } else {
+                if (!counted) {
+                    if (magazine->count)
+                        magazine->hits++;
+                    else
+                        magazine->misses++;
+                    counted = true;
+                }
+                if (!magazine->count)
+                    refill(*magazine);
+                if (magazine->count)
+                    free_slab = magazine->slabs[--magazine->count];
+            }
         }
 
+        if (free_slab) {
+            AddressSanitizer::unpoison((FlatPtr)free_slab, m_object_size);
 #ifdef SANITIZE_SLABS
-        memset(free_slab, SLAB_ALLOC_SCRUB_BYTE, slab_size());
+            if (heap_should_scrub_on_alloc())
+                fast_memset(free_slab, SLAB_ALLOC_SCRUB_BYTE, m_object_size);
 #endif
-        return free_slab;
+            return free_slab;
+        }
+
+        // The depot is empty, grow with interrupts back in the caller's state.
+        if (!grow())
+            return nullptr;
     }
+}
 
-    void dealloc(void* ptr)
-    {
-        VERIFY(ptr);
-        if (ptr < m_base || ptr >= m_end) {
-            kfree(ptr);
-            return;
-        }
-        FreeSlab* free_slab = (FreeSlab*)ptr;
+void SlabCache::dealloc(void* ptr)
+{
+    VERIFY(ptr);
+    FreeSlab* free_slab = (FreeSlab*)ptr;
+    AddressSanitizer::poison((FlatPtr)ptr, m_object_size, AddressSanitizer::ShadowType::SlabFree);
 #ifdef SANITIZE_SLABS
-        if (slab_size() > sizeof(FreeSlab*))
-            memset(free_slab->padding, SLAB_DEALLOC_SCRUB_BYTE, sizeof(FreeSlab::padding));
+    if (heap_should_scrub_on_free())
+        fast_memset((u8*)ptr + sizeof(FreeSlab), SLAB_DEALLOC_SCRUB_BYTE, m_object_size - sizeof(FreeSlab));
 #endif
 
-        ScopedCritical critical;
-        FreeSlab* next_free = m_freelist.load(Base::memory_order_consume);
-        do {
-            free_slab->next = next_free;
-        } while (!m_freelist.compare_exchange_strong(next_free, free_slab, Base::memory_order_acq_rel));
+    InterruptDisabler disabler;
+    auto* magazine = current_magazine();
+    if (!magazine) {
+        depot_push(free_slab);
+        return;
+    }
+    if (magazine->count == magazine_size)
+        flush(*magazine);
+    magazine->slabs[magazine->count++] = free_slab;
+}
+
+SlabCache::FreeSlab* SlabCache::depot_pop()
+{
+    ScopedSpinLock lock(m_depot_lock);
+    return depot_pop_locked();
+}
 
-        m_num_allocated--;
+SlabCache::FreeSlab* SlabCache::depot_pop_locked()
+{
+    VERIFY(m_depot_lock.is_locked());
+    auto* page = m_partial_pages.first();
+    if (!page)
+        page = m_free_pages.first();
+    if (!page)
+        return nullptr;
+
+    FreeSlab* free_slab = page->freelist;
+    page->freelist = free_slab->next;
+    if (page->in_use++ == 0) {
+        m_free_pages.remove(*page);
+        m_partial_pages.append(*page);
     }
+    if (page->in_use == page->capacity)
+        m_partial_pages.remove(*page);
+    m_depot_count--;
+    return free_slab;
+}
 
-    size_t num_allocated() const { return m_num_allocated; }
-    size_t num_free() const { return m_slab_count - m_num_allocated; }
+void SlabCache::depot_push(FreeSlab* free_slab)
+{
+    ScopedSpinLock lock(m_depot_lock);
+    depot_push_locked(free_slab);
+}
 
-private:
-    struct FreeSlab {
-        FreeSlab* next;
-        char padding[templated_slab_size - sizeof(FreeSlab*)];
-    };
+void SlabCache::depot_push_locked(FreeSlab* free_slab)
+{
+    VERIFY(m_depot_lock.is_locked());
+    auto& page = page_of(free_slab);
+    free_slab->next = page.freelist;
+    page.freelist = free_slab;
+    if (page.in_use-- == page.capacity)
+        m_partial_pages.append(page);
+    if (page.in_use == 0) {
+        m_partial_pages.remove(page);
+        m_free_pages.append(page);
+    }
+    m_depot_count++;
+}
 
-    Atomic<FreeSlab*> m_freelist { nullptr };
-    Atomic<size_t, Base::MemoryOrder::memory_order_relaxed> m_num_allocated;
-    size_t m_slab_count;
-    void* m_base { nullptr };
-    void* m_end { nullptr };
+// A whole batch moves under one acquisition of the depot lock.
+void SlabCache::refill(Magazine& magazine)
+{
+    ScopedSpinLock lock(m_depot_lock);
+    while (magazine.count < magazine_batch) {
+        auto* free_slab = depot_pop_locked();
+        if (!free_slab)
+            break;
+        magazine.slabs[magazine.count++] = free_slab;
+    }
+}
 
-    static_assert(sizeof(FreeSlab) == templated_slab_size);
-};
+void SlabCache::flush(Magazine& magazine)
+{
+    ScopedSpinLock lock(m_depot_lock);
+    while (magazine.count > magazine_batch)
+        depot_push_locked(magazine.slabs[--magazine.count]);
+}
 
-static SlabAllocator<16> s_slab_allocator_16;
-static SlabAllocator<32> s_slab_allocator_32;
-static SlabAllocator<64> s_slab_allocator_64;
-static SlabAllocator<128> s_slab_allocator_128;
-static SlabAllocator<256> s_slab_allocator_256;
+bool SlabCache::grow()
+{
+    void* memory = nullptr;
+    Region* region = nullptr;
 
-#if ARCH(I386)
-static_assert(sizeof(Region) <= s_slab_allocator_128.slab_size());
-#endif
+    // Growing the cache Regions come from needs a Region itself, that one
+    // (and anything else racing with a grow) gets a page from kmalloc.
+    if (MemoryManager::is_initialized() && !m_growing.exchange(true)) {
+        auto page_region = MM.allocate_kernel_region(PAGE_SIZE, m_name, Region::Access::Read | Region::Access::Write, AllocationStrategy::AllocateNow);
+        m_growing = false;
+        if (page_region) {
+            memory = page_region->vaddr().as_ptr();
+            region = page_region.leak_ptr();
+        }
+    }
+    if (!memory)
+        memory = kmalloc_aligned<PAGE_SIZE>(PAGE_SIZE);
+
+    auto* page = new (memory) SlabPage;
+    page->cache = this;
+    page->region = region;
+
+    FlatPtr first = round_up_to_power_of_two((FlatPtr)memory + sizeof(SlabPage), SLAB_OBJECT_ALIGNMENT);
+    page->capacity = ((FlatPtr)memory + PAGE_SIZE - first) / m_object_size;
+    AddressSanitizer::poison((FlatPtr)memory, PAGE_SIZE, AddressSanitizer::ShadowType::Slab);
+    AddressSanitizer::poison(first, page->capacity * m_object_size, AddressSanitizer::ShadowType::SlabFree);
+    for (size_t i = page->capacity; i > 0; --i) {
+        auto* free_slab = (FreeSlab*)(first + (i - 1) * m_object_size);
+        free_slab->next = page->freelist;
+        page->freelist = free_slab;
+    }
+
+    ScopedSpinLock lock(m_depot_lock);
+    m_free_pages.append(*page);
+    m_depot_count += page->capacity;
+    m_total_count += page->capacity;
+    m_page_count++;
+    return true;
+}
+
+void SlabCache::release_page(SlabPage& page)
+{
+    VERIFY(page.in_use == 0);
+    if (auto* region = page.region) {
+        page.~SlabPage();
+        delete region;
+    } else {
+        page.~SlabPage();
+        kfree_aligned(&page);
+    }
+}
+
+size_t SlabCache::reclaim()
+{
+    // The magazines are left alone, they will drain into the depot over time.
+    SlabPage::List pages;
+    {
+        ScopedSpinLock lock(m_depot_lock);
+        while (auto* page = m_free_pages.take_first()) {
+            pages.append(*page);
+            m_depot_count -= page->capacity;
+            m_total_count -= page->capacity;
+            m_page_count--;
+        }
+    }
+
+    // Regions are freed without holding the depot lock, the MemoryManager
+    // takes its own lock while it calls into us.
+    size_t count = 0;
+    while (auto* page = pages.take_first()) {
+        release_page(*page);
+        count++;
+    }
+    return count;
+}
+
+size_t SlabCache::num_free() const
+{
+    // The magazines are read without taking them, so this is only a snapshot.
+    size_t free = m_depot_count;
+    for (auto& magazine : m_magazines)
+        free += magazine.count;
+    return free;
+}
 
-template<typename Callback>
-void for_each_allocator(Callback callback)
+SlabCacheStats SlabCache::cache_stats(u32 cpu) const
 {
-    callback(s_slab_allocator_16);
-    callback(s_slab_allocator_32);
-    callback(s_slab_allocator_64);
-    callback(s_slab_allocator_128);
-    callback(s_slab_allocator_256);
+    auto& magazine = m_magazines[cpu];
+    return { magazine.hits, magazine.misses, magazine.count };
 }
 
+static constexpr size_t slab_cache_count = 5;
+
+// Constructed by slab_alloc_init(), like the kmalloc heap is by
+// kmalloc_init(), rather than by whenever global constructors run.
+alignas(SlabCache) static u8 s_slab_cache_storage[slab_cache_count][sizeof(SlabCache)];
+READONLY_AFTER_INIT static SlabCache* s_slab_caches[slab_cache_count];
+
 UNMAP_AFTER_INIT void slab_alloc_init()
 {
-    s_slab_allocator_16.init(128 * KiB);
-    s_slab_allocator_32.init(128 * KiB);
-    s_slab_allocator_64.init(512 * KiB);
-    s_slab_allocator_128.init(512 * KiB);
-    s_slab_allocator_256.init(128 * KiB);
+    static constexpr char const* names[slab_cache_count] = { "slab-16", "slab-32", "slab-64", "slab-128", "slab-256" };
+
+    // The caches grow on demand, there is no pool to carve out up front.
+    for (size_t i = 0; i < slab_cache_count; i++)
+        s_slab_caches[i] = new (s_slab_cache_storage[i]) SlabCache(names[i], 16 << i);
 }
 
-void* slab_alloc(size_t slab_size)
+static SlabCache& cache_for_size(size_t slab_size)
 {
-    if (slab_size <= 16)
-        return s_slab_allocator_16.alloc();
-    if (slab_size <= 32)
-        return s_slab_allocator_32.alloc();
-    if (slab_size <= 64)
-        return s_slab_allocator_64.alloc();
-    if (slab_size <= 128)
-        return s_slab_allocator_128.alloc();
-    if (slab_size <= 256)
-        return s_slab_allocator_256.alloc();
+    for (size_t i = 0; i < slab_cache_count; i++) {
+        if (slab_size <= (16u << i)) {
+            VERIFY(s_slab_caches[i]);
+            return *s_slab_caches[i];
+        }
+    }
     VERIFY_NOT_REACHED();
 }
 
+void* slab_alloc(size_t slab_size)
+{
+    return cache_for_size(slab_size).alloc();
+}
+
 void slab_dealloc(void* ptr, size_t slab_size)
 {
-    if (slab_size <= 16)
-        return s_slab_allocator_16.dealloc(ptr);
-    if (slab_size <= 32)
-        return s_slab_allocator_32.dealloc(ptr);
-    if (slab_size <= 64)
-        return s_slab_allocator_64.dealloc(ptr);
-    if (slab_size <= 128)
-        return s_slab_allocator_128.dealloc(ptr);
-    if (slab_size <= 256)
-        return s_slab_allocator_256.dealloc(ptr);
-    VERIFY_NOT_REACHED();
+    cache_for_size(slab_size).dealloc(ptr);
 }
 
 void slab_alloc_stats(Function<void(size_t slab_size, size_t allocated, size_t free)> callback)
 {
-    for_each_allocator([&](auto& allocator) {
-        auto num_allocated = allocator.num_allocated();
-        auto num_free = allocator.slab_count() - num_allocated;
-        callback(allocator.slab_size(), num_allocated, num_free);
+    SlabCache::for_each([&](auto& cache) {
+        callback(cache.object_size(), cache.num_allocated(), cache.num_free());
+    });
+}
+
+void slab_alloc_cache_stats(Function<void(size_t slab_size, u32 cpu, SlabCacheStats const&)> callback)
+{
+    SlabCache::for_each([&](auto& cache) {
+        for (u32 cpu = 0; cpu < Processor::count(); cpu++)
+            callback(cache.object_size(), cpu, cache.cache_stats(cpu));
     });
 }
 
-}
\ No newline at end of file
+size_t slab_alloc_reclaim()
+{
+    size_t count = 0;
+    SlabCache::for_each([&](auto& cache) {
+        count += cache.reclaim();
+    });
+    return count;
+}
+
+}
@@ -8,17 +8,129 @@
 
 // includes
 #include <base/Function.h>
+#include <base/IntrusiveList.h>
 #include <base/Types.h>
+#include <kernel/SpinLock.h>
 
 namespace Kernel {
 
+class Region;
+
 #define SLAB_ALLOC_SCRUB_BYTE 0xab
 #define SLAB_DEALLOC_SCRUB_BYTE 0xbc
 
+// Per-processor magazine counters: a miss means the magazine was empty and
+// had to be refilled from the shared depot.
+struct SlabCacheStats {
+    size_t hits;
+    size_t misses;
+    size_t cached;
+};
+
+// A cache of equally sized objects carved out of whole pages. Caches grow
+// a page at a time from the MemoryManager and keep their free pages until
+// reclaim() hands them back.
+//
+// Each processor keeps a magazine of free objects in front of the shared
+// pages (the depot), refilled from and flushed to the depot half a
+// magazine at a time, so the common path stays on the local processor.
+class SlabCache {
+    BASE_MAKE_NONCOPYABLE(SlabCache);
+    BASE_MAKE_NONMOVABLE(SlabCache);
+
+public:
+    static constexpr size_t magazine_size = 32;
+    static constexpr size_t magazine_batch = magazine_size / 2;
+    static constexpr size_t max_processors = 8;
+
+    SlabCache(char const* name, size_t object_size);
+
+    char const* name() const { return m_name; }
+    size_t object_size() const { return m_object_size; }
+
+    [[nodiscard]] void* alloc();
+    void dealloc(void*);
+
+    // Gives every completely free page back, returns how many there were.
+    size_t reclaim();
+
+    size_t num_allocated() const { return m_total_count - num_free(); }
+    size_t num_free() const;
+    size_t num_pages() const { return m_page_count; }
+    SlabCacheStats cache_stats(u32 cpu) const;
+
+    template<typename Callback>
+    static void for_each(Callback);
+
+private:
+    struct FreeSlab {
+        FreeSlab* next;
+    };
+
+    // Lives at the start of every page handed to the cache.
+    struct SlabPage {
+        SlabCache* cache { nullptr };
+        Region* region { nullptr };
+        FreeSlab* freelist { nullptr };
+        u16 in_use { 0 };
+        u16 capacity { 0 };
+        IntrusiveListNode<SlabPage> list_node;
+
+        using List = IntrusiveList<SlabPage, RawPtr<SlabPage>, &SlabPage::list_node>;
+    };
+
+    // Only ever touched by its own processor with interrupts disabled.
+    struct alignas(64) Magazine {
+        FreeSlab* slabs[magazine_size];
+        size_t count { 0 };
+        size_t hits { 0 };
+        size_t misses { 0 };
+    };
+
+    Magazine* current_magazine();
+    SlabPage& page_of(FreeSlab*);
+
+    FreeSlab* depot_pop();
+    void depot_push(FreeSlab*);
+    FreeSlab* depot_pop_locked();
+    void depot_push_locked(FreeSlab*);
+    void refill(Magazine&);
+    void flush(Magazine&);
+    bool grow();
+    void release_page(SlabPage&);
+
+    char const* m_name;
+    size_t m_object_size;
+
+    Magazine m_magazines[max_processors];
+
+    SpinLock<u8> m_depot_lock;
+    SlabPage::List m_partial_pages;
+    SlabPage::List m_free_pages;
+    size_t m_depot_count { 0 };
+    size_t m_total_count { 0 };
+    size_t m_page_count { 0 };
+    Atomic<bool> m_growing { false };
+
+    SlabCache* m_next_cache { nullptr };
+    static Atomic<SlabCache*> s_caches;
+};
+
+template<typename Callback>
+void SlabCache::for_each(Callback callback)
+{
+    for (auto* cache = s_caches.load(); cache; cache = cache->m_next_cache)
+        callback(*cache);
+}
+
 void* slab_alloc(size_t slab_size);
 void slab_dealloc(void*, size_t slab_size);
 void slab_alloc_init();
 void slab_alloc_stats(Function<void(size_t slab_size, size_t allocated, size_t free)>);
+void slab_alloc_cache_stats(Function<void(size_t slab_size, u32 cpu, SlabCacheStats const&)>);
+
+// Called by the MemoryManager when it runs out of physical pages.
+size_t slab_alloc_reclaim();
 
 #define MAKE_SLAB_ALLOCATED(type)                                            \
 public:                                                                      \
@@ -41,4 +153,28 @@ public:                                                                      \
                                                                              \
 private:
 
-}
\ No newline at end of file
+// Like MAKE_SLAB_ALLOCATED, but with a cache of its own. The cache has to
+// be defined next to the type: SlabCache Type::s_slab_cache { "Type", sizeof(Type) };
+#define MAKE_SLAB_CACHE_ALLOCATED(type)                                      \
+public:                                                                      \
+    [[nodiscard]] void* operator new(size_t)                                 \
+    {                                                                        \
+        void* ptr = s_slab_cache.alloc();                                    \
+        VERIFY(ptr);                                                         \
+        return ptr;                                                          \
+    }                                                                        \
+    [[nodiscard]] void* operator new(size_t, const std::nothrow_t&) noexcept \
+    {                                                                        \
+        return s_slab_cache.alloc();                                         \
+    }                                                                        \
+    void operator delete(void* ptr) noexcept                                 \
+    {                                                                        \
+        if (!ptr)                                                            \
+            return;                                                          \
+        s_slab_cache.dealloc(ptr);                                           \
+    }                                                                        \
+                                                                             \
+private:                                                                     \
+    static SlabCache s_slab_cache;
+
+}
@@ -6,17 +6,26 @@
 
 // includes
 #include <base/Assertions.h>
+#include <base/HashMap.h>
 #include <base/NonnullOwnPtrVector.h>
+#include <base/Stopwatch.h>
 #include <base/Types.h>
+#include <kernel/AddressSanitizer.h>
 #include <kernel/Debug.h>
 #include <kernel/heap/Heap.h>
+#include <kernel/heap/HeapScrub.h>
+#include <kernel/heap/KmallocProfiler.h>
 #include <kernel/heap/kmalloc.h>
 #include <kernel/KSyms.h>
+#include <kernel/Metrics.h>
 #include <kernel/Panic.h>
 #include <kernel/PerformanceManager.h>
 #include <kernel/Sections.h>
+#include <kernel/arch/x86/InterruptDisabler.h>
+#include <kernel/arch/x86/MemoryOperations.h>
 #include <kernel/SpinLock.h>
 #include <kernel/StdLib.h>
+#include <kernel/Tracing.h>
 #include <kernel/vm/MemoryManager.h>
 
 #define CHUNK_SIZE 32
@@ -151,6 +160,285 @@ struct KmallocGlobalHeap {
     }
 };
 
+// Segregated free lists in front of the bitmap heap. Allocations of up to
+// KMALLOC_SIZE_CLASS_MAX_CHUNKS chunks are rounded up to a power of two
+// chunks, and freed blocks of such a size are kept on a list per class
+// instead of going back to the bitmap. Hits take only the class lock and
+// never scan, the bitmap is left to large and rare allocations.
+#define KMALLOC_SIZE_CLASS_COUNT 8
+#define KMALLOC_SIZE_CLASS_MAX_CHUNKS (1u << (KMALLOC_SIZE_CLASS_COUNT - 1))
+#define KMALLOC_SIZE_CLASS_CACHE_BYTES (64 * KiB)
+
+using KmallocChunkHeap = Heap<CHUNK_SIZE, KMALLOC_SCRUB_BYTE, KFREE_SCRUB_BYTE>;
+
+struct KmallocSizeClass {
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    SpinLock<u8> lock;
+    FreeBlock* free_blocks { nullptr };
+    size_t free_count { 0 };
+};
+
+static KmallocSizeClass s_size_classes[KMALLOC_SIZE_CLASS_COUNT];
+static Atomic<size_t, Base::MemoryOrder::memory_order_relaxed> s_size_class_cached_bytes;
+
+static inline Optional<size_t> kmalloc_size_class_for_chunks(size_t chunks)
+{
+    if (chunks > KMALLOC_SIZE_CLASS_MAX_CHUNKS)
+        return {};
+    size_t size_class = 0;
+    while ((1u << size_class) < chunks)
+        size_class++;
+    return size_class;
+}
+
+static size_t kmalloc_size_class_limit(size_t size_class)
+{
+    return max<size_t>(8, KMALLOC_SIZE_CLASS_CACHE_BYTES / ((1u << size_class) * CHUNK_SIZE));
+}
+
+static void* kmalloc_size_class_take(size_t size_class)
+{
+    auto& klass = s_size_classes[size_class];
+    ScopedSpinLock lock(klass.lock);
+    auto* block = klass.free_blocks;
+    if (!block)
+        return nullptr;
+    klass.free_blocks = block->next;
+    klass.free_count--;
+    s_size_class_cached_bytes -= (1u << size_class) * CHUNK_SIZE;
+    return block;
+}
+
+static bool kmalloc_size_class_give(void* ptr)
+{
+    size_t chunks = KmallocChunkHeap::allocation_size_in_chunks(ptr);
+    auto size_class = kmalloc_size_class_for_chunks(chunks);
+    if (!size_class.has_value() || (1u << size_class.value()) != chunks)
+        return false;
+
+    auto& klass = s_size_classes[size_class.value()];
+    ScopedSpinLock lock(klass.lock);
+    if (klass.free_count >= kmalloc_size_class_limit(size_class.value()))
+        return false;
+
+    if (heap_should_scrub_on_free())
+        fast_memset(ptr, KFREE_SCRUB_BYTE, KmallocChunkHeap::usable_size_for_chunks(chunks));
+    auto* block = (KmallocSizeClass::FreeBlock*)ptr;
+    block->next = klass.free_blocks;
+    klass.free_blocks = block;
+    klass.free_count++;
+    s_size_class_cached_bytes += chunks * CHUNK_SIZE;
+    return true;
+}
+
+// Per-processor shards of the heap. Every processor allocates from its own
+// segments first, with interrupts disabled and without taking s_lock. A
+// block freed on another processor is pushed onto the owner's remote free
+// list, which the owner drains the next time it allocates. The shared heap
+// behind s_lock serves whatever the shards can't.
+#define KMALLOC_SHARD_SEGMENT_SIZE (512 * KiB)
+#define KMALLOC_SHARD_MAX_SEGMENTS 4
+
+struct KmallocShard {
+    struct RemoteFree {
+        RemoteFree* next;
+    };
+
+    struct Segment {
+        KmallocChunkHeap* heap { nullptr };
+        Region* region { nullptr };
+    };
+
+    Segment segments[KMALLOC_SHARD_MAX_SEGMENTS];
+    Atomic<size_t> segment_count { 0 };
+    bool growing { false };
+
+    Atomic<RemoteFree*> remote_frees { nullptr };
+    Atomic<size_t, Base::MemoryOrder::memory_order_relaxed> remote_free_count { 0 };
+
+    KmallocChunkHeap* segment_containing(const void* ptr)
+    {
+        size_t count = segment_count.load(Base::memory_order_acquire);
+        for (size_t i = 0; i < count; i++) {
+            if (segments[i].heap->contains(ptr))
+                return segments[i].heap;
+        }
+        return nullptr;
+    }
+
+    void drain_remote_frees()
+    {
+        auto* block = remote_frees.exchange(nullptr, Base::memory_order_acq_rel);
+        while (block) {
+            auto* next = block->next;
+            segment_containing(block)->deallocate(block);
+            block = next;
+        }
+    }
+
+    void* allocate(size_t size)
+    {
+        if (remote_frees.load(Base::memory_order_relaxed))
+            drain_remote_frees();
+
+        size_t count = segment_count.load(Base::memory_order_relaxed);
+        for (size_t i = 0; i < count; i++) {
+            if (void* ptr = segments[i].heap->allocate(size))
+                return ptr;
+        }
+        return nullptr;
+    }
+
+    bool grow()
+    {
+        if (growing || segment_count >= KMALLOC_SHARD_MAX_SEGMENTS || !MemoryManager::is_initialized())
+            return false;
+
+        // Allocating the region calls back into kmalloc, which must not grow again.
+        TemporaryChange change(growing, true);
+        auto region = MM.allocate_kernel_region(KMALLOC_SHARD_SEGMENT_SIZE, "kmalloc shard", Region::Access::Read | Region::Access::Write, AllocationStrategy::AllocateNow);
+        if (!region)
+            return false;
+
+        u8* memory = region->vaddr().as_ptr();
+        auto& segment = segments[segment_count.load()];
+        segment.heap = new (memory) KmallocChunkHeap(memory + sizeof(KmallocChunkHeap), KMALLOC_SHARD_SEGMENT_SIZE - sizeof(KmallocChunkHeap));
+        segment.region = region.leak_ptr();
+        segment_count.fetch_add(1, Base::memory_order_release);
+        return true;
+    }
+};
+
+static_assert(KMALLOC_MAX_SHARDS == ProcessorContainer().size());
+static KmallocShard s_shards[KMALLOC_MAX_SHARDS];
+
+static KmallocShard* kmalloc_current_shard()
+{
+    if (!Processor::is_initialized())
+        return nullptr;
+    return &s_shards[Processor::id()];
+}
+
+static void* kmalloc_shard_allocate(size_t size)
+{
+    InterruptDisabler disabler;
+    auto* shard = kmalloc_current_shard();
+    if (!shard)
+        return nullptr;
+    if (void* ptr = shard->allocate(size))
+        return ptr;
+    if (!shard->grow())
+        return nullptr;
+    return shard->allocate(size);
+}
+
+static bool kmalloc_shard_deallocate(void* ptr)
+{
+    InterruptDisabler disabler;
+    auto* current = kmalloc_current_shard();
+    for (auto& shard : s_shards) {
+        auto* heap = shard.segment_containing(ptr);
+        if (!heap)
+            continue;
+
+        if (&shard == current) {
+            heap->deallocate(ptr);
+            return true;
+        }
+
+        auto* block = (KmallocShard::RemoteFree*)ptr;
+        auto* head = shard.remote_frees.load(Base::memory_order_relaxed);
+        do {
+            block->next = head;
+        } while (!shard.remote_frees.compare_exchange_strong(head, block, Base::memory_order_acq_rel));
+        shard.remote_free_count++;
+        return true;
+    }
+    return false;
+}
+
+// Allocations of KMALLOC_LARGE_THRESHOLD or more get kernel regions of
+// their own, so a single big buffer doesn't grow the heap for good. Their
+// regions are found again on kfree through a table keyed by address,
+// large allocations are always page aligned so only such pointers need
+// a lookup.
+#define KMALLOC_LARGE_THRESHOLD (128 * KiB)
+
+using KmallocLargeAllocations = HashMap<FlatPtr, Region*>;
+
+// Never held across a kmalloc or kfree: the table grows into a copy made
+// without it.
+static SpinLock<u8> s_large_lock;
+READONLY_AFTER_INIT static KmallocLargeAllocations* s_large_allocations;
+alignas(KmallocLargeAllocations) static u8 s_large_allocations_storage[sizeof(KmallocLargeAllocations)];
+static Atomic<size_t, Base::MemoryOrder::memory_order_relaxed> s_large_bytes;
+
+static void* kmalloc_large(size_t size)
+{
+    if (size < KMALLOC_LARGE_THRESHOLD || !MemoryManager::is_initialized())
+        return nullptr;
+
+    auto region = MM.allocate_kernel_region(page_round_up(size), "kmalloc large", Region::Access::Read | Region::Access::Write, AllocationStrategy::AllocateNow);
+    if (!region)
+        return nullptr;
+
+    void* ptr = region->vaddr().as_ptr();
+    s_large_bytes += region->size();
+
+    for (;;) {
+        size_t size;
+        {
+            ScopedSpinLock lock(s_large_lock);
+            if (s_large_allocations->has_room_for_one_more()) {
+                s_large_allocations->set((FlatPtr)ptr, region.leak_ptr());
+                return ptr;
+            }
+            size = s_large_allocations->size();
+        }
+
+        KmallocLargeAllocations grown;
+        grown.ensure_capacity(size * 2 + 1);
+
+        {
+            ScopedSpinLock lock(s_large_lock);
+            // Unless another kmalloc_large() got there first, or added so
+            // many that this one is already too small.
+            if (!s_large_allocations->has_room_for_one_more() && s_large_allocations->size() <= size) {
+                for (auto& it : *s_large_allocations)
+                    grown.set(it.key, it.value);
+                swap(*s_large_allocations, grown);
+            }
+        }
+
+        // What is left in grown, the old table or the unused copy, is freed
+        // here without the lock.
+    }
+}
+
+static bool kfree_large(void* ptr)
+{
+    if ((FlatPtr)ptr % PAGE_SIZE)
+        return false;
+
+    Region* region;
+    {
+        ScopedSpinLock lock(s_large_lock);
+        auto it = s_large_allocations->find((FlatPtr)ptr);
+        if (it == s_large_allocations->end())
+            return false;
+        region = it->value;
+        s_large_allocations->remove(it);
+    }
+
+    s_large_bytes -= region->size();
+    AddressSanitizer::poison((FlatPtr)ptr, region->size(), AddressSanitizer::ShadowType::Free);
+    delete region;
+    return true;
+}
+
 READONLY_AFTER_INIT static KmallocGlobalHeap* g_kmalloc_global;
 alignas(KmallocGlobalHeap) static u8 g_kmalloc_global_heap[sizeof(KmallocGlobalHeap)];
 
@@ -158,9 +446,12 @@ __attribute__((section(".heap"))) static u8 kmalloc_eternal_heap[ETERNAL_RANGE_S
 __attribute__((section(".heap"))) static u8 kmalloc_pool_heap[POOL_SIZE];
 
 static size_t g_kmalloc_bytes_eternal = 0;
-static size_t g_kmalloc_call_count;
-static size_t g_kfree_call_count;
-static size_t g_nested_kfree_calls;
+static Atomic<size_t, Base::MemoryOrder::memory_order_relaxed> g_kmalloc_call_count;
+static Atomic<size_t, Base::MemoryOrder::memory_order_relaxed> g_kfree_call_count;
+// Per processor, only touched by its own with interrupts disabled. One
+// global count would skip the perf events of kfrees on every other
+// processor while one of them is recording its own.
+static size_t s_nested_kfree_calls[KMALLOC_MAX_SHARDS];
 bool g_dump_kmalloc_stacks;
 
 static u8* s_next_eternal_ptr;
@@ -188,8 +479,10 @@ UNMAP_AFTER_INIT void kmalloc_init()
     memset(kmalloc_eternal_heap, 0, sizeof(kmalloc_eternal_heap));
     memset(kmalloc_pool_heap, 0, sizeof(kmalloc_pool_heap));
     g_kmalloc_global = new (g_kmalloc_global_heap) KmallocGlobalHeap(kmalloc_pool_heap, sizeof(kmalloc_pool_heap));
+    s_large_allocations = new (s_large_allocations_storage) KmallocLargeAllocations;
 
     s_lock.initialize();
+    s_large_lock.initialize();
 
     s_next_eternal_ptr = kmalloc_eternal_heap;
     s_end_of_eternal_range = s_next_eternal_ptr + sizeof(kmalloc_eternal_heap);
@@ -209,22 +502,47 @@ void* kmalloc_eternal(size_t size)
     return ptr;
 }
 
+static LatencyMetric s_kmalloc_latency { "kmalloc_ns" };
+
 void* kmalloc(size_t size)
 {
     kmalloc_verify_nospinlock_held();
-    ScopedSpinLock lock(s_lock);
     ++g_kmalloc_call_count;
+    ScopedTimer timer(s_kmalloc_latency);
 
     if (g_dump_kmalloc_stacks && Kernel::g_kernel_symbols_available) {
         dbgln("kmalloc({})", size);
         Kernel::dump_backtrace();
     }
 
-    void* ptr = g_kmalloc_global->m_heap.allocate(size);
+    size_t requested_size = size;
+    void* ptr = kmalloc_large(size);
+    bool is_large = ptr;
+    auto size_class = kmalloc_size_class_for_chunks(KmallocChunkHeap::chunks_for_size(size));
+    if (!ptr && size_class.has_value()) {
+        size_t class_size = KmallocChunkHeap::usable_size_for_chunks(1u << size_class.value());
+        ptr = kmalloc_size_class_take(size_class.value());
+        if (ptr && heap_should_scrub_on_alloc())
+            fast_memset(ptr, KMALLOC_SCRUB_BYTE, class_size);
+        size = class_size;
+    }
+
+    if (!ptr)
+        ptr = kmalloc_shard_allocate(size);
+    if (!ptr) {
+        ScopedSpinLock lock(s_lock);
+        ptr = g_kmalloc_global->m_heap.allocate(size);
+    }
     if (!ptr) {
         PANIC("kmalloc: Out of memory (requested size: {})", size);
     }
 
+    size_t usable_size = is_large ? page_round_up(requested_size) : KmallocChunkHeap::usable_size_for_chunks(KmallocChunkHeap::allocation_size_in_chunks(ptr));
+    AddressSanitizer::mark_allocated((FlatPtr)ptr, requested_size, usable_size, AddressSanitizer::ShadowType::Malloc);
+
+    kmalloc_profiler_did_allocate(ptr, size);
+    TRACE_EVENT(Kmalloc, ptr, requested_size, 0);
+
     Thread* current_thread = Thread::current();
     if (!current_thread)
         current_thread = Processor::idle_thread();
@@ -246,25 +564,42 @@ void kfree(void* ptr)
         return;
 
     kmalloc_verify_nospinlock_held();
-    ScopedSpinLock lock(s_lock);
     ++g_kfree_call_count;
-    ++g_nested_kfree_calls;
-
-    if (g_nested_kfree_calls == 1) {
-        Thread* current_thread = Thread::current();
-        if (!current_thread)
-            current_thread = Processor::idle_thread();
-        if (current_thread)
-            PerformanceManager::add_kfree_perf_event(*current_thread, 0, (FlatPtr)ptr);
+
+    kmalloc_profiler_will_free(ptr);
+    TRACE_EVENT(Kfree, ptr, 0, 0);
+
+    {
+        // Recording the event may kfree, that kfree isn't recorded.
+        InterruptDisabler disabler;
+        auto& nested_kfree_calls = s_nested_kfree_calls[Processor::is_initialized() ? Processor::id() : 0];
+        if (nested_kfree_calls++ == 0) {
+            Thread* current_thread = Thread::current();
+            if (!current_thread)
+                current_thread = Processor::idle_thread();
+            if (current_thread)
+                PerformanceManager::add_kfree_perf_event(*current_thread, 0, (FlatPtr)ptr);
+        }
+        nested_kfree_calls--;
     }
 
-    g_kmalloc_global->m_heap.deallocate(ptr);
-    --g_nested_kfree_calls;
+    if (!kfree_large(ptr)) {
+        // Poisoned before the block is back on any list, once it is another
+        // processor may hand it out and unpoison it again.
+        AddressSanitizer::poison((FlatPtr)ptr, KmallocChunkHeap::usable_size_for_chunks(KmallocChunkHeap::allocation_size_in_chunks(ptr)), AddressSanitizer::ShadowType::Free);
+        if (!kmalloc_size_class_give(ptr) && !kmalloc_shard_deallocate(ptr)) {
+            ScopedSpinLock lock(s_lock);
+            g_kmalloc_global->m_heap.deallocate(ptr);
+        }
+    }
 }
 
 size_t kmalloc_good_size(size_t size)
 {
-    return size;
+    auto size_class = kmalloc_size_class_for_chunks(KmallocChunkHeap::chunks_for_size(size));
+    if (!size_class.has_value())
+        return size;
+    return KmallocChunkHeap::usable_size_for_chunks(1u << size_class.value());
 }
 
 [[gnu::malloc, gnu::alloc_size(1), gnu::alloc_align(2)]] static void* kmalloc_aligned_cxx(size_t size, size_t alignment)
@@ -342,9 +677,25 @@ void operator delete[](void* ptr, size_t size) noexcept
 void get_kmalloc_stats(kmalloc_stats& stats)
 {
     ScopedSpinLock lock(s_lock);
-    stats.bytes_allocated = g_kmalloc_global->m_heap.allocated_bytes();
-    stats.bytes_free = g_kmalloc_global->m_heap.free_bytes() + g_kmalloc_global->backup_memory_bytes();
+    size_t cached_bytes = s_size_class_cached_bytes;
+    stats.bytes_allocated = g_kmalloc_global->m_heap.allocated_bytes() - cached_bytes + s_large_bytes;
+    stats.bytes_free = g_kmalloc_global->m_heap.free_bytes() + g_kmalloc_global->backup_memory_bytes() + cached_bytes;
     stats.bytes_eternal = g_kmalloc_bytes_eternal;
     stats.kmalloc_call_count = g_kmalloc_call_count;
     stats.kfree_call_count = g_kfree_call_count;
+
+    // The shards are read without stopping their owners, so this is a snapshot.
+    for (size_t i = 0; i < KMALLOC_MAX_SHARDS; i++) {
+        auto& shard = s_shards[i];
+        auto& shard_stats = stats.shards[i];
+        shard_stats = {};
+        size_t count = shard.segment_count.load(Base::memory_order_acquire);
+        for (size_t j = 0; j < count; j++) {
+            shard_stats.bytes_allocated += shard.segments[j].heap->allocated_bytes();
+            shard_stats.bytes_free += shard.segments[j].heap->free_bytes();
+        }
+        shard_stats.remote_free_count = shard.remote_free_count;
+        stats.bytes_allocated += shard_stats.bytes_allocated;
+        stats.bytes_free += shard_stats.bytes_free;
+    }
 }
\ No newline at end of file
@@ -44,12 +44,21 @@ void kmalloc_init();
 void kfree(void*);
 void kfree_sized(void*, size_t);
 
+#define KMALLOC_MAX_SHARDS 8
+
+struct kmalloc_shard_stats {
+    size_t bytes_allocated;
+    size_t bytes_free;
+    size_t remote_free_count;
+};
+
 struct kmalloc_stats {
     size_t bytes_allocated;
     size_t bytes_free;
     size_t bytes_eternal;
     size_t kmalloc_call_count;
     size_t kfree_call_count;
+    kmalloc_shard_stats shards[KMALLOC_MAX_SHARDS];
 };
 void get_kmalloc_stats(kmalloc_stats&);
 
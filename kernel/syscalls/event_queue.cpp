@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/EventQueue.h>
+#include <kernel/filesystem/FileDescription.h>
+#include <kernel/Process.h>
+
+namespace Kernel {
+
+KResultOr<FlatPtr> Process::sys$event_queue_create(u32 flags)
+{
+    REQUIRE_PROMISE(stdio);
+    if (flags & ~O_CLOEXEC)
+        return EINVAL;
+
+    auto fd_or_error = m_fds.allocate();
+    if (fd_or_error.is_error())
+        return fd_or_error.error();
+    auto queue_fd = fd_or_error.release_value();
+
+    auto queue_or_error = EventQueue::create();
+    if (queue_or_error.is_error())
+        return queue_or_error.error();
+
+    auto description_or_error = FileDescription::create(*queue_or_error.value());
+    if (description_or_error.is_error())
+        return description_or_error.error();
+
+    auto description = description_or_error.release_value();
+    description->set_readable(true);
+
+    m_fds[queue_fd.fd].set(move(description), (flags & O_CLOEXEC) ? FD_CLOEXEC : 0);
+    return queue_fd.fd;
+}
+
+static RefPtr<EventQueue> event_queue_for(RefPtr<FileDescription> const& description)
+{
+    if (!description || !description->file().is_event_queue())
+        return {};
+    return static_cast<EventQueue&>(description->file());
+}
+
+KResultOr<FlatPtr> Process::sys$event_queue_ctl(Userspace<Syscall::SC_event_queue_ctl_params const*> user_params)
+{
+    REQUIRE_PROMISE(stdio);
+    Syscall::SC_event_queue_ctl_params params;
+    if (!copy_from_user(&params, user_params))
+        return EFAULT;
+
+    auto queue = event_queue_for(fds().file_description(params.queue_fd));
+    if (!queue)
+        return EBADF;
+
+    auto control = static_cast<EventQueueControl>(params.control);
+    if (control == EventQueueControl::Remove)
+        return queue->remove(params.fd);
+
+    EventQueueEvent event;
+    if (!copy_from_user(&event, static_cast<EventQueueEvent const*>(params.event)))
+        return EFAULT;
+
+    switch (control) {
+    case EventQueueControl::Add: {
+        auto description = fds().file_description(params.fd);
+        if (!description)
+            return EBADF;
+        // A queue watching itself would notify itself forever.
+        if (&description->file() == queue.ptr())
+            return EINVAL;
+        return queue->add(params.fd, description.release_nonnull(), event);
+    }
+    case EventQueueControl::Modify:
+        return queue->modify(params.fd, event);
+    default:
+        return EINVAL;
+    }
+}
+
+KResultOr<FlatPtr> Process::sys$event_queue_wait(Userspace<Syscall::SC_event_queue_wait_params const*> user_params)
+{
+    REQUIRE_PROMISE(stdio);
+    Syscall::SC_event_queue_wait_params params;
+    if (!copy_from_user(&params, user_params))
+        return EFAULT;
+    if (!params.max_events || params.max_events > event_queue_max_events)
+        return EINVAL;
+
+    auto queue = event_queue_for(fds().file_description(params.queue_fd));
+    if (!queue)
+        return EBADF;
+
+    Optional<Time> timeout;
+    if (params.timeout) {
+        timeout = copy_time_from_user(params.timeout);
+        if (!timeout.has_value())
+            return EFAULT;
+    }
+
+    Vector<EventQueueEvent> events;
+    auto count_or_error = queue->wait(events, params.max_events, timeout.has_value() ? &timeout.value() : nullptr);
+    if (count_or_error.is_error())
+        return count_or_error.error();
+
+    if (!copy_n_to_user(static_cast<EventQueueEvent*>(params.events), events.data(), events.size()))
+        return EFAULT;
+    return events.size();
+}
+
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Time.h>
+#include <kernel/api/Futex.h>
+#include <kernel/FutexTable.h>
+#include <kernel/Process.h>
+
+namespace Kernel {
+
+static KResultOr<FlatPtr> as_count(KResultOr<u32> result)
+{
+    if (result.is_error())
+        return result.error();
+    return result.value();
+}
+
+KResultOr<FlatPtr> Process::sys$futex(Userspace<const Syscall::SC_futex_params*> user_params)
+{
+    REQUIRE_PROMISE(thread);
+    Syscall::SC_futex_params params;
+    if (!copy_from_user(&params, user_params))
+        return EFAULT;
+
+    bool is_private = params.futex_op & FUTEX_PRIVATE_FLAG;
+    int cmd = params.futex_op & FUTEX_CMD_MASK;
+    if ((params.futex_op & FUTEX_CLOCK_REALTIME) && cmd != FUTEX_WAIT && cmd != FUTEX_WAIT_BITSET && cmd != FUTEX_LOCK_PI)
+        return ENOSYS;
+
+    auto key_or_error = FutexKey::create(*this, FlatPtr(params.userspace_address), is_private);
+    if (key_or_error.is_error())
+        return key_or_error.error();
+    auto& key = key_or_error.value();
+    auto& table = FutexTable::the();
+
+    auto second_key = [&]() -> KResultOr<FutexKey> {
+        return FutexKey::create(*this, FlatPtr(params.userspace_address2), is_private);
+    };
+
+    // FUTEX_WAIT takes a relative timeout, the others an absolute one.
+    Time timeout {};
+    bool has_timeout = false;
+    bool uses_timeout = cmd == FUTEX_WAIT || cmd == FUTEX_WAIT_BITSET || cmd == FUTEX_LOCK_PI;
+    if (uses_timeout && params.timeout) {
+        auto timeout_time = copy_time_from_user(params.timeout);
+        if (!timeout_time.has_value())
+            return EFAULT;
+        timeout = timeout_time.value();
+        has_timeout = true;
+    }
+    clockid_t clock_id = (params.futex_op & FUTEX_CLOCK_REALTIME) ? CLOCK_REALTIME_COARSE : CLOCK_MONOTONIC_COARSE;
+    Thread::BlockTimeout block_timeout(cmd != FUTEX_WAIT, has_timeout ? &timeout : nullptr, nullptr, clock_id);
+
+    switch (cmd) {
+    case FUTEX_WAIT:
+    case FUTEX_WAIT_BITSET: {
+        u32 bitset = cmd == FUTEX_WAIT ? FUTEX_BITSET_MATCH_ANY : params.val3;
+        auto result = table.wait(key, params.userspace_address, params.val, bitset, block_timeout);
+        if (result.is_error())
+            return result;
+        return 0;
+    }
+    case FUTEX_WAKE:
+    case FUTEX_WAKE_BITSET: {
+        u32 bitset = cmd == FUTEX_WAKE ? FUTEX_BITSET_MATCH_ANY : params.val3;
+        if (!bitset)
+            return EINVAL;
+        return table.wake(key, params.val, bitset);
+    }
+    case FUTEX_REQUEUE:
+    case FUTEX_CMP_REQUEUE: {
+        auto key2_or_error = second_key();
+        if (key2_or_error.is_error())
+            return key2_or_error.error();
+        Optional<u32> expected;
+        if (cmd == FUTEX_CMP_REQUEUE)
+            expected = params.val3;
+        return as_count(table.requeue(key, key2_or_error.value(), params.val, params.val2, params.userspace_address, expected));
+    }
+    case FUTEX_WAKE_OP: {
+        auto key2_or_error = second_key();
+        if (key2_or_error.is_error())
+            return key2_or_error.error();
+        return as_count(table.wake_op(key, key2_or_error.value(), params.userspace_address2, params.val, params.val2, params.val3));
+    }
+    case FUTEX_LOCK_PI:
+    case FUTEX_TRYLOCK_PI: {
+        auto result = table.lock_pi(key, params.userspace_address, cmd == FUTEX_TRYLOCK_PI, block_timeout);
+        if (result.is_error())
+            return result;
+        return 0;
+    }
+    case FUTEX_UNLOCK_PI: {
+        auto result = table.unlock_pi(key, params.userspace_address);
+        if (result.is_error())
+            return result;
+        return 0;
+    }
+    }
+    return ENOSYS;
+}
+
+}
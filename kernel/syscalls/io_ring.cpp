@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/filesystem/FileDescription.h>
+#include <kernel/IORing.h>
+#include <kernel/Process.h>
+
+namespace Kernel {
+
+KResultOr<FlatPtr> Process::sys$io_ring_setup(u32 entries, u32 flags)
+{
+    REQUIRE_PROMISE(stdio);
+    if (flags & ~O_CLOEXEC)
+        return EINVAL;
+
+    auto fd_or_error = m_fds.allocate();
+    if (fd_or_error.is_error())
+        return fd_or_error.error();
+    auto ring_fd = fd_or_error.release_value();
+
+    auto ring_or_error = IORing::create(*this, entries);
+    if (ring_or_error.is_error())
+        return ring_or_error.error();
+
+    auto description_or_error = FileDescription::create(*ring_or_error.value());
+    if (description_or_error.is_error())
+        return description_or_error.error();
+
+    auto description = description_or_error.release_value();
+    description->set_readable(true);
+
+    m_fds[ring_fd.fd].set(move(description), (flags & O_CLOEXEC) ? FD_CLOEXEC : 0);
+    return ring_fd.fd;
+}
+
+KResultOr<FlatPtr> Process::sys$io_ring_enter(int fd, u32 to_submit, u32 min_complete)
+{
+    REQUIRE_PROMISE(stdio);
+    auto description = fds().file_description(fd);
+    if (!description)
+        return EBADF;
+    if (!description->file().is_io_ring())
+        return EINVAL;
+    return static_cast<IORing&>(description->file()).enter(to_submit, min_complete);
+}
+
+}
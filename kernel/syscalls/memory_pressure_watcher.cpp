@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/api/MemoryPressureEvent.h>
+#include <kernel/filesystem/FileDescription.h>
+#include <kernel/Process.h>
+#include <kernel/vm/MemoryPressureWatcher.h>
+
+namespace Kernel {
+
+KResultOr<FlatPtr> Process::sys$create_memory_pressure_watcher(u32 flags)
+{
+    REQUIRE_PROMISE(stdio);
+
+    auto fd_or_error = m_fds.allocate();
+    if (fd_or_error.is_error())
+        return fd_or_error.error();
+    auto watcher_fd = fd_or_error.release_value();
+
+    auto watcher_or_error = MemoryPressureWatcher::create();
+    if (watcher_or_error.is_error())
+        return watcher_or_error.error();
+
+    auto description_or_error = FileDescription::create(*watcher_or_error.value());
+    if (description_or_error.is_error())
+        return description_or_error.error();
+
+    auto description = description_or_error.release_value();
+    description->set_readable(true);
+    description->set_blocking(!(flags & static_cast<unsigned>(MemoryPressureWatcherFlags::Nonblock)));
+
+    u32 fd_flags = 0;
+    if (flags & static_cast<unsigned>(MemoryPressureWatcherFlags::CloseOnExec))
+        fd_flags |= FD_CLOEXEC;
+
+    m_fds[watcher_fd.fd].set(move(description), fd_flags);
+    return watcher_fd.fd;
+}
+
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/arch/x86/PerformanceCounters.h>
+#include <kernel/Process.h>
+#include <kernel/Thread.h>
+
+namespace Kernel {
+
+KResultOr<FlatPtr> Process::sys$perf_counters_read(u32 scope, Userspace<PerformanceCounterValues*> user_values)
+{
+    REQUIRE_PROMISE(stdio);
+    if (!PerformanceCounters::is_available())
+        return ENOTSUP;
+
+    PerformanceCounterValues values;
+    switch (static_cast<PerformanceCounterScope>(scope)) {
+    case PerformanceCounterScope::Thread:
+        PerformanceCounters::read_thread(Thread::current()->performance_counters(), true, values);
+        break;
+    case PerformanceCounterScope::System:
+        // These count what every other process ran too.
+        if (!is_superuser())
+            return EPERM;
+        PerformanceCounters::read_system(values);
+        break;
+    default:
+        return EINVAL;
+    }
+
+    if (!copy_to_user(user_values, &values))
+        return EFAULT;
+    return 0;
+}
+
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/filesystem/FileDescription.h>
+#include <kernel/Process.h>
+#include <kernel/vm/SwapArea.h>
+
+namespace Kernel {
+
+KResultOr<FlatPtr> Process::sys$swapon(int fd, size_t size)
+{
+    REQUIRE_PROMISE(stdio);
+    // Every process's memory may end up in there.
+    if (!is_superuser())
+        return EPERM;
+
+    auto description = fds().file_description(fd);
+    if (!description)
+        return EBADF;
+
+    auto result = SwapArea::activate(*description, size);
+    if (result.is_error())
+        return result;
+    return 0;
+}
+
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/Process.h>
+#include <kernel/RunQueue.h>
+#include <kernel/Thread.h>
+
+namespace Kernel {
+
+// 0 is the calling thread, others have to be in the calling process.
+static RefPtr<Thread> thread_for_affinity(Process& process, pid_t tid)
+{
+    if (!tid)
+        return Thread::current();
+    auto thread = Thread::from_tid(tid);
+    if (!thread || thread->pid() != process.pid())
+        return {};
+    return thread;
+}
+
+KResultOr<FlatPtr> Process::sys$set_thread_affinity(pid_t tid, u32 mask)
+{
+    REQUIRE_PROMISE(proc);
+    u32 cpu_count = Processor::count();
+    CPUAffinityMask online = cpu_count >= 32 ? CPU_AFFINITY_ALL : (1u << cpu_count) - 1;
+    if (!(mask & online))
+        return EINVAL;
+
+    auto thread = thread_for_affinity(*this, tid);
+    if (!thread)
+        return ESRCH;
+
+    // A thread that is running elsewhere moves at its next reschedule,
+    // one that is queued is put on a CPU it may use now.
+    auto& entry = thread->run_queue_entry();
+    entry.affinity = mask;
+    u32 queued_on = entry.queued_on;
+    if (!entry.may_run_on(queued_on) && RunQueue::for_cpu(queued_on).remove(entry))
+        RunQueue::enqueue_thread(entry);
+    return 0;
+}
+
+KResultOr<FlatPtr> Process::sys$get_thread_affinity(pid_t tid, Userspace<u32*> user_mask)
+{
+    REQUIRE_PROMISE(proc);
+    auto thread = thread_for_affinity(*this, tid);
+    if (!thread)
+        return ESRCH;
+
+    u32 mask = thread->run_queue_entry().affinity;
+    if (!copy_to_user(user_mask, &mask))
+        return EFAULT;
+    return 0;
+}
+
+}
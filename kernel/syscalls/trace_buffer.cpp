@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/filesystem/FileDescription.h>
+#include <kernel/Process.h>
+#include <kernel/TraceBuffer.h>
+
+namespace Kernel {
+
+KResultOr<FlatPtr> Process::sys$trace_buffer_open(u32 events)
+{
+    REQUIRE_PROMISE(stdio);
+    // Every thread's page faults and allocations end up in the buffer.
+    if (!is_superuser())
+        return EPERM;
+
+    auto fd_or_error = m_fds.allocate();
+    if (fd_or_error.is_error())
+        return fd_or_error.error();
+    auto buffer_fd = fd_or_error.release_value();
+
+    auto buffer_or_error = TraceBuffer::open(events);
+    if (buffer_or_error.is_error())
+        return buffer_or_error.error();
+
+    auto description_or_error = FileDescription::create(*buffer_or_error.value());
+    if (description_or_error.is_error()) {
+        buffer_or_error.value()->close();
+        return description_or_error.error();
+    }
+
+    auto description = description_or_error.release_value();
+    description->set_readable(true);
+
+    m_fds[buffer_fd.fd].set(move(description), FD_CLOEXEC);
+    return buffer_fd.fd;
+}
+
+}
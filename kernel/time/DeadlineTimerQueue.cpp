@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/arch/x86/ASM_wrapper.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/arch/x86/TSCDeadline.h>
+#include <kernel/BootProfiler.h>
+#include <kernel/RCU.h>
+#include <kernel/Sections.h>
+#include <kernel/time/DeadlineTimerQueue.h>
+
+namespace Kernel {
+
+// One per possible CPU, like s_idle_cpu_mask.
+static DeadlineTimerQueue s_queues[32];
+
+READONLY_AFTER_INIT static u64 s_tsc_frequency;
+READONLY_AFTER_INIT static bool s_tickless;
+READONLY_AFTER_INIT static u8 s_vector;
+
+DeadlineTimer::~DeadlineTimer()
+{
+    cancel();
+}
+
+bool DeadlineTimer::cancel()
+{
+    auto* queue = m_queue;
+    return queue && queue->cancel(*this);
+}
+
+UNMAP_AFTER_INIT void DeadlineTimerQueue::initialize(u64 tsc_frequency, u8 vector)
+{
+    s_tsc_frequency = tsc_frequency;
+    s_vector = vector;
+    BootProfiler::set_tsc_frequency(tsc_frequency);
+    s_tickless = tsc_frequency && TSCDeadline::is_supported();
+    if (s_tickless)
+        dmesgln("Timers: Tickless, on the TSC-deadline timer");
+    else
+        dmesgln("Timers: No TSC-deadline timer, timers fire on the tick");
+}
+
+UNMAP_AFTER_INIT void DeadlineTimerQueue::initialize_for_this_processor(Function<void()> tick, u64 tick_period_ns)
+{
+    auto& queue = current();
+    queue.m_tick.m_callback = move(tick);
+    if (!s_tickless)
+        return;
+
+    TSCDeadline::enable(s_vector);
+    queue.m_tick_period_tsc = ns_to_tsc(tick_period_ns);
+    queue.add_at_tsc(queue.m_tick, read_tsc() + queue.m_tick_period_tsc);
+}
+
+bool DeadlineTimerQueue::is_tickless()
+{
+    return s_tickless;
+}
+
+DeadlineTimerQueue& DeadlineTimerQueue::current()
+{
+    return s_queues[Processor::id()];
+}
+
+u64 DeadlineTimerQueue::ns_to_tsc(u64 ns)
+{
+    // Split so the product doesn't overflow for timeouts of many seconds.
+    return (ns / 1'000'000'000) * s_tsc_frequency + (ns % 1'000'000'000) * s_tsc_frequency / 1'000'000'000;
+}
+
+void DeadlineTimerQueue::add(DeadlineTimer& timer, u64 timeout_ns)
+{
+    if (!s_tsc_frequency) {
+        // Without a calibrated TSC there's no way to tell the time in
+        // ticks, it fires on the next interrupt.
+        add_at_tsc(timer, 0);
+        return;
+    }
+    add_at_tsc(timer, read_tsc() + ns_to_tsc(timeout_ns));
+}
+
+void DeadlineTimerQueue::add_at_tsc(DeadlineTimer& timer, u64 deadline_tsc)
+{
+    ScopedSpinLock lock(m_lock);
+    VERIFY(!timer.is_armed());
+    insert(timer, deadline_tsc);
+    rearm();
+}
+
+void DeadlineTimerQueue::insert(DeadlineTimer& timer, u64 deadline_tsc)
+{
+    // A TSC tick is well below a nanosecond, moving a timer by a few of
+    // them to keep the keys unique changes nothing.
+    while (m_timers.find(deadline_tsc))
+        deadline_tsc++;
+    timer.m_tree_node.key = deadline_tsc;
+    timer.m_queue = this;
+    m_timers.insert(timer);
+}
+
+bool DeadlineTimerQueue::cancel(DeadlineTimer& timer)
+{
+    ScopedSpinLock lock(m_lock);
+    if (!timer.is_armed())
+        return false;
+    m_timers.remove(timer.m_tree_node.key);
+    timer.m_queue = nullptr;
+    rearm();
+    return true;
+}
+
+void DeadlineTimerQueue::stop_tick()
+{
+    ScopedSpinLock lock(m_lock);
+    if (!s_tickless || m_tick_stopped)
+        return;
+    if (m_tick.is_armed())
+        m_timers.remove(m_tick.m_tree_node.key);
+    m_tick_stopped = true;
+    rearm();
+}
+
+void DeadlineTimerQueue::start_tick()
+{
+    ScopedSpinLock lock(m_lock);
+    if (!s_tickless || !m_tick_stopped)
+        return;
+    m_tick_stopped = false;
+    insert(m_tick, read_tsc() + m_tick_period_tsc);
+    rearm();
+}
+
+void DeadlineTimerQueue::rearm()
+{
+    VERIFY(m_lock.is_locked());
+    if (!s_tickless)
+        return;
+
+    auto first = m_timers.begin();
+    if (first.is_end()) {
+        if (m_armed_tsc)
+            TSCDeadline::disarm();
+        m_armed_tsc = 0;
+        return;
+    }
+
+    if (first.key() != m_armed_tsc) {
+        TSCDeadline::arm(first.key());
+        m_armed_tsc = first.key();
+    }
+}
+
+void DeadlineTimerQueue::handle_interrupt()
+{
+    // Read sections keep interrupts disabled, so whatever this interrupted
+    // wasn't in one.
+    rcu_note_quiescent_state();
+
+    ScopedSpinLock lock(m_lock);
+    m_armed_tsc = 0;
+
+    for (;;) {
+        auto first = m_timers.begin();
+        if (first.is_end() || first.key() > read_tsc())
+            break;
+
+        auto& timer = *first;
+        m_timers.remove(first.key());
+        timer.m_queue = nullptr;
+
+        // The tick goes back in before it runs, so it stays armed whatever
+        // the scheduler does in it.
+        if (&timer == &m_tick)
+            insert(m_tick, read_tsc() + m_tick_period_tsc);
+
+        // The callback may add or cancel timers here.
+        lock.unlock();
+        if (timer.m_callback)
+            timer.m_callback();
+        lock.lock();
+    }
+
+    rearm();
+}
+
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Function.h>
+#include <base/IntrusiveRedBlackTree.h>
+#include <base/Types.h>
+#include <kernel/SpinLock.h>
+
+namespace Kernel {
+
+class DeadlineTimerQueue;
+
+// Runs its callback once, in interrupt context on the CPU it was added on.
+class DeadlineTimer {
+    BASE_MAKE_NONCOPYABLE(DeadlineTimer);
+    BASE_MAKE_NONMOVABLE(DeadlineTimer);
+
+public:
+    explicit DeadlineTimer(Function<void()> callback)
+        : m_callback(move(callback))
+    {
+    }
+
+    ~DeadlineTimer();
+
+    bool is_armed() const { return m_tree_node.is_in_tree(); }
+
+    // Takes it off whichever queue it was added to, if it hasn't fired.
+    bool cancel();
+
+private:
+    friend class DeadlineTimerQueue;
+
+    // The key is the TSC value it's due at, bumped past any other timer's
+    // so keys stay unique.
+    IntrusiveRedBlackTreeNode<u64> m_tree_node { 0 };
+    Function<void()> m_callback;
+    DeadlineTimerQueue* m_queue { nullptr };
+};
+
+// Everything due on one CPU, the scheduler tick included while it runs
+// anything. In tickless mode the TSC-deadline timer is armed for the
+// earliest of them and an idle CPU stops its tick, so it sleeps until
+// something is actually due. Otherwise the periodic timer interrupt calls
+// handle_interrupt() and timers are as precise as the tick.
+class DeadlineTimerQueue {
+    BASE_MAKE_NONCOPYABLE(DeadlineTimerQueue);
+    BASE_MAKE_NONMOVABLE(DeadlineTimerQueue);
+
+public:
+    DeadlineTimerQueue() = default;
+
+    // On the boot processor, once the TSC is calibrated. tsc_frequency is
+    // 0 if it couldn't be.
+    static void initialize(u64 tsc_frequency, u8 vector);
+
+    // On every processor including the boot one, before it takes timers.
+    static void initialize_for_this_processor(Function<void()> tick, u64 tick_period_ns);
+
+    static bool is_tickless();
+    static DeadlineTimerQueue& current();
+
+    static u64 ns_to_tsc(u64 ns);
+
+    // From now, in nanoseconds.
+    void add(DeadlineTimer&, u64 timeout_ns);
+    void add_at_tsc(DeadlineTimer&, u64 deadline_tsc);
+    bool cancel(DeadlineTimer&);
+
+    // For the idle loop: no tick while nothing runs.
+    void stop_tick();
+    void start_tick();
+
+    void handle_interrupt();
+
+private:
+    void insert(DeadlineTimer&, u64 deadline_tsc);
+    void rearm();
+
+    SpinLock<u8> m_lock;
+    IntrusiveRedBlackTree<u64, DeadlineTimer, &DeadlineTimer::m_tree_node> m_timers;
+    DeadlineTimer m_tick { Function<void()> {} };
+    u64 m_tick_period_tsc { 0 };
+    bool m_tick_stopped { false };
+    // What the TSC-deadline timer is armed for, 0 if nothing.
+    u64 m_armed_tsc { 0 };
+};
+
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Atomic.h>
+#include <base/CPUFeatures.h>
+#include <base/NumericLimits.h>
+#include <kernel/arch/x86/ASM_wrapper.h>
+#include <kernel/arch/x86/FastSyscall.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/Sections.h>
+#include <kernel/time/TimePage.h>
+#include <kernel/vm/MemoryManager.h>
+#include <kernel/vm/Space.h>
+
+namespace Kernel {
+
+READONLY_AFTER_INIT static KernelTimePage* s_the;
+
+UNMAP_AFTER_INIT void KernelTimePage::initialize(u64 tsc_frequency)
+{
+    VERIFY(!s_the);
+    auto vmobject = AnonymousVMObject::try_create_with_size(PAGE_SIZE, AllocationStrategy::AllocateNow);
+    VERIFY(vmobject);
+    auto region = MM.allocate_kernel_region_with_vmobject(*vmobject, PAGE_SIZE, "Time page", Region::Access::Read | Region::Access::Write);
+    VERIFY(region);
+    memset(region->vaddr().as_ptr(), 0, PAGE_SIZE);
+
+    s_the = new KernelTimePage(vmobject.release_nonnull(), region.release_nonnull());
+    s_the->set_tsc_frequency(tsc_frequency);
+    s_the->set_fast_syscall(fast_syscall_enabled_everywhere());
+    s_the->page().cpu_features = static_cast<u32>(cpu_features());
+}
+
+bool KernelTimePage::is_initialized()
+{
+    return s_the;
+}
+
+KernelTimePage& KernelTimePage::the()
+{
+    VERIFY(s_the);
+    return *s_the;
+}
+
+KernelTimePage::KernelTimePage(NonnullRefPtr<AnonymousVMObject> vmobject, NonnullOwnPtr<Region> region)
+    : m_vmobject(move(vmobject))
+    , m_region(move(region))
+{
+}
+
+TimePage& KernelTimePage::page()
+{
+    return *reinterpret_cast<TimePage*>(m_region->vaddr().as_ptr());
+}
+
+UNMAP_AFTER_INIT void KernelTimePage::set_tsc_frequency(u64 tsc_frequency)
+{
+    auto& processor = Processor::current();
+    bool tsc_usable = tsc_frequency
+        && processor.has_feature(CPUFeature::TSC)
+        && processor.has_feature(CPUFeature::CONSTANT_TSC)
+        && processor.has_feature(CPUFeature::NONSTOP_TSC);
+    if (!tsc_usable) {
+        dmesgln("Time page: No invariant TSC, clocks advance once per tick");
+        return;
+    }
+
+    // The largest shift that still keeps the multiplier in 32 bits gives
+    // the most precision, a timer tick's worth of TSC ticks times it
+    // stays far below 64 bits.
+    u32 shift = 32;
+    while (shift && (1'000'000'000ull << shift) / tsc_frequency > NumericLimits<u32>::max())
+        shift--;
+
+    auto& page = this->page();
+    page.tsc_to_ns_multiplier = (1'000'000'000ull << shift) / tsc_frequency;
+    page.tsc_to_ns_shift = shift;
+    page.tsc_usable = true;
+    dmesgln("Time page: TSC at {} kHz, multiplier {} >> {}", tsc_frequency / 1000, page.tsc_to_ns_multiplier, shift);
+}
+
+void KernelTimePage::set_fast_syscall(bool enabled)
+{
+    page().fast_syscall = enabled;
+}
+
+void KernelTimePage::update(Time monotonic, Time realtime)
+{
+    auto& page = this->page();
+    page.sequence = page.sequence + 1;
+    full_memory_barrier();
+
+    if (page.tsc_usable)
+        page.tsc_at_update = read_tsc();
+    page.monotonic_ns = monotonic.to_nanoseconds();
+    page.realtime_offset_ns = realtime.to_nanoseconds() - monotonic.to_nanoseconds();
+
+    full_memory_barrier();
+    page.sequence = page.sequence + 1;
+}
+
+u64 KernelTimePage::monotonic_ns() const
+{
+    u64 monotonic_ns;
+    i64 realtime_offset_ns;
+    time_page_read(*reinterpret_cast<TimePage const*>(m_region->vaddr().as_ptr()), true, monotonic_ns, realtime_offset_ns);
+    return monotonic_ns;
+}
+
+KResult KernelTimePage::map_into(Space& space)
+{
+    ScopedSpinLock lock(space.get_lock());
+    auto range = space.allocate_range(VirtualAddress(time_page_address), PAGE_SIZE);
+    if (!range.has_value())
+        return ENOMEM;
+    auto region_or_error = space.allocate_region_with_vmobject(range.value(), m_vmobject, 0, "Time page", PROT_READ, true);
+    if (region_or_error.is_error())
+        return region_or_error.error();
+    return KSuccess;
+}
+
+}
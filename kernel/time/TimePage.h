@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/OwnPtr.h>
+#include <base/RefPtr.h>
+#include <base/Time.h>
+#include <kernel/api/TimePage.h>
+#include <kernel/KResult.h>
+#include <kernel/vm/AnonymousVMObject.h>
+
+namespace Kernel {
+
+class Region;
+class Space;
+
+// The kernel's end of the TimePage: one page shared by every address
+// space, rewritten by TimeManagement on each timer tick.
+class KernelTimePage {
+    BASE_MAKE_NONCOPYABLE(KernelTimePage);
+    BASE_MAKE_NONMOVABLE(KernelTimePage);
+
+public:
+    // tsc_frequency is 0 if TimeManagement couldn't calibrate the TSC.
+    static void initialize(u64 tsc_frequency);
+    static bool is_initialized();
+    static KernelTimePage& the();
+
+    // Only ever called on the processor that handles the timer.
+    void update(Time monotonic, Time realtime);
+
+    void set_fast_syscall(bool);
+
+    // CLOCK_MONOTONIC extrapolated from the last update with the TSC, or
+    // as of the last update if the TSC isn't usable.
+    u64 monotonic_ns() const;
+
+    KResult map_into(Space&);
+
+private:
+    KernelTimePage(NonnullRefPtr<AnonymousVMObject>, NonnullOwnPtr<Region>);
+
+    void set_tsc_frequency(u64);
+    TimePage& page();
+
+    NonnullRefPtr<AnonymousVMObject> m_vmobject;
+    NonnullOwnPtr<Region> m_region;
+};
+
+}
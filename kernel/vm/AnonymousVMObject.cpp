@@ -4,8 +4,11 @@
  * SPDX-License-Identifier: BSD-2-Clause
 */
 
-#include <kernel/arch/x86/SmapDisabler.h>
+#include <base/QuickSort.h>
+#include <base/ScopeGuard.h>
+#include <kernel/arch/x86/PageOperations.h>
 #include <kernel/Debug.h>
+#include <kernel/heap/kmalloc.h>
 #include <kernel/Process.h>
 #include <kernel/vm/AnonymousVMObject.h>
 #include <kernel/vm/MemoryManage.h>
@@ -17,6 +20,10 @@ RefPtr<VMObject> AnonymousVMObject::try_clone()
 {
     ScopedSpinLock lock(m_lock);
 
+    // The clone shares our physical pages, it has no use for our handles.
+    if (!decompress_all_pages())
+        return {};
+
     size_t need_cow_pages = 0;
 
     for_each_nonvolatile_range([&](VolatilePageRange const& nonvolatile_range) {
@@ -37,6 +44,11 @@ RefPtr<VMObject> AnonymousVMObject::try_clone()
 
     ensure_or_reset_cow_map();
 
+    // Everything resident is shared with the clone now.
+    for_each_region([](auto& region) {
+        region.recount_pages();
+    });
+
     return adopt_ref_if_nonnull(new (nothrow) AnonymousVMObject(*this));
 }
 
@@ -69,8 +81,23 @@ AnonymousVMObject::AnonymousVMObject(size_t size, AllocationStrategy strategy)
     , m_unused_committed_pages(strategy == AllocationStrategy::Reserve ? page_count() : 0)
 {
     if (strategy == AllocationStrategy::AllocateNow) {
-        for (size_t i = 0; i < page_count(); ++i)
-            physical_pages()[i] = MM.allocate_committed_user_physical_page(MemoryManager::ShouldZeroFill::Yes);
+        // Whole 2 MiB chunks are backed by a large page's worth of
+        // contiguous memory if there is any, so they can be mapped as one.
+        constexpr size_t large_page_count = (2 * MiB) / PAGE_SIZE;
+        size_t i = 0;
+        while (i < page_count()) {
+            if (i + large_page_count <= page_count()) {
+                auto large_page = MM.allocate_committed_user_physical_large_page(MemoryManager::ShouldZeroFill::Yes);
+                if (!large_page.is_empty()) {
+                    for (auto& page : large_page)
+                        physical_pages()[i++] = page;
+                    continue;
+                }
+            }
+            size_t count = min(large_page_count, page_count() - i);
+            MM.allocate_committed_user_physical_pages(physical_pages().slice(i, count), MemoryManager::ShouldZeroFill::Yes);
+            i += count;
+        }
     } else {
         auto& initial_page = (strategy == AllocationStrategy::Reserve) ? MM.lazy_committed_page() : MM.shared_zero_page();
         for (size_t i = 0; i < page_count(); ++i)
@@ -104,10 +131,17 @@ AnonymousVMObject::AnonymousVMObject(AnonymousVMObject const& other)
     , m_unused_committed_pages(other.m_unused_committed_pages)
     , m_cow_map()                                 
     , m_shared_committed_cow_pages(other.m_shared_committed_cow_pages) 
+    , m_swap_slots(other.m_swap_slots)
 {
     VERIFY(other.m_lock.is_locked());
     m_lock.initialize();
 
+    if (!m_swap_slots.is_empty()) {
+        auto* swap_area = SwapArea::active();
+        for (auto& it : m_swap_slots)
+            swap_area->ref_slot(it.value);
+    }
+
     ensure_or_reset_cow_map();
 
     if (m_unused_committed_pages > 0) {
@@ -126,6 +160,13 @@ AnonymousVMObject::AnonymousVMObject(AnonymousVMObject const& other)
 
 AnonymousVMObject::~AnonymousVMObject()
 {
+    for (auto& it : m_compressed_pages)
+        CompressedPageStore::the().free(it.value);
+    if (!m_swap_slots.is_empty()) {
+        auto* swap_area = SwapArea::active();
+        for (auto& it : m_swap_slots)
+            swap_area->free_slot(it.value);
+    }
     if (m_unused_committed_pages > 0)
         MM.uncommit_user_physical_pages(m_unused_committed_pages);
 }
@@ -142,8 +183,10 @@ int AnonymousVMObject::purge()
             if (phys_page && !phys_page->is_shared_zero_page()) {
                 VERIFY(!phys_page->is_lazy_committed_page());
                 ++purged_in_range;
+            } else if (!phys_page && (drop_compressed_page(i) || drop_swapped_page(i))) {
+                ++purged_in_range;
             }
-            phys_page = MM.shared_zero_page();
+            set_physical_page(i, MM.shared_zero_page());
         }
 
         if (purged_in_range > 0) {
@@ -171,6 +214,413 @@ int AnonymousVMObject::purge()
     return purged_page_count;
 }
 
+size_t AnonymousVMObject::discard_pages(size_t page_index, size_t page_count)
+{
+    VERIFY(page_index + page_count <= this->page_count());
+    ScopedSpinLock lock(m_lock);
+
+    size_t count = 0;
+    for (size_t i = page_index; i < page_index + page_count; ++i) {
+        auto& phys_page = m_physical_pages[i];
+        if (!phys_page && (drop_compressed_page(i) || drop_swapped_page(i))) {
+            set_physical_page(i, MM.shared_zero_page());
+            ++count;
+            continue;
+        }
+        if (!phys_page || phys_page->is_shared_zero_page() || phys_page->is_lazy_committed_page())
+            continue;
+        // Memory of a physical range isn't ours to throw away.
+        if (!phys_page->may_return_to_freelist())
+            continue;
+        bool was_shared = is_page_shared(i);
+        phys_page = MM.shared_zero_page();
+        if (!m_cow_map.is_null())
+            m_cow_map.set(i, false);
+        account_page_change(i, true, was_shared);
+        ++count;
+    }
+    if (count) {
+        for_each_region([&](auto& region) {
+            region.remap_vmobject_page_range(page_index, page_count);
+        });
+    }
+    return count;
+}
+
+bool AnonymousVMObject::is_page_movable(size_t page_index) const
+{
+    auto& phys_page = m_physical_pages[page_index];
+    if (!phys_page || phys_page->is_shared_zero_page() || phys_page->is_lazy_committed_page())
+        return false;
+    if (!phys_page->may_return_to_freelist() || phys_page->ref_count() != 1)
+        return false;
+    bool is_user_only = true;
+    const_cast<AnonymousVMObject&>(*this).for_each_region([&](auto& region) {
+        if (!region.is_user())
+            is_user_only = false;
+    });
+    return is_user_only;
+}
+
+void AnonymousVMObject::migrate_page(size_t page_index, NonnullRefPtr<PhysicalPage> new_page)
+{
+    ScopedSpinLock lock(m_lock);
+    auto old_page = move(m_physical_pages[page_index]);
+    VERIFY(old_page);
+
+    // Nobody may write to the page while it's being copied. Faults on it
+    // wait for our lock in Region::handle_fault().
+    for_each_region([&](auto& region) {
+        region.remap_vmobject_page_range(page_index, 1);
+    });
+
+    MM.copy_physical_page(*new_page, *old_page, PageTemporality::Cold);
+
+    m_physical_pages[page_index] = move(new_page);
+    for_each_region([&](auto& region) {
+        region.remap_vmobject_page_range(page_index, 1);
+    });
+}
+
+void AnonymousVMObject::age_pages()
+{
+    ScopedSpinLock lock(m_lock);
+    Bitmap accessed(page_count(), false);
+    size_t accessed_count = 0;
+    for_each_region([&](auto& region) {
+        accessed_count += region.collect_accessed_pages(&accessed);
+    });
+    if (accessed_count)
+        m_idle_sweeps = 0;
+    else if (m_idle_sweeps < NumericLimits<u32>::max())
+        m_idle_sweeps++;
+
+    // Only pages of our own can be inactive, one that replaces the zero
+    // page stays active until the sweep after.
+    if (m_inactive_pages.is_null())
+        m_inactive_pages = Bitmap { page_count(), false };
+    for (size_t i = 0; i < page_count(); ++i) {
+        auto& phys_page = m_physical_pages[i];
+        bool has_own_page = phys_page && !phys_page->is_shared_zero_page() && !phys_page->is_lazy_committed_page();
+        m_inactive_pages.set(i, has_own_page && !accessed.get(i));
+    }
+}
+
+size_t AnonymousVMObject::compress_inactive_pages(size_t max_count)
+{
+    ScopedSpinLock lock(m_lock);
+
+    // Committed COW pages are there for whoever copies out of a shared page
+    // first, compressing one would leave them unaccounted for.
+    if (m_inactive_pages.is_null() || m_shared_committed_cow_pages)
+        return 0;
+
+    auto& store = CompressedPageStore::the();
+    size_t count = 0;
+    for (size_t i = 0; i < page_count() && count < max_count; ++i) {
+        if (!m_inactive_pages.get(i) || !is_page_movable(i))
+            continue;
+        m_inactive_pages.set(i, false);
+
+        // Unmapped before it's compressed, so nobody writes to it meanwhile.
+        // Faults on it wait for our lock in Region::handle_fault(). A page
+        // nobody else has a reference to doesn't need copying on write.
+        NonnullRefPtr<PhysicalPage> page = *m_physical_pages[i];
+        set_should_cow(i, false);
+        set_physical_page(i, nullptr);
+        for_each_region([&](auto& region) {
+            region.remap_vmobject_page_range(i, 1);
+        });
+
+        auto handle = store.store(MM.quickmap_page(*page));
+        MM.unquickmap_page();
+        if (handle.is_null()) {
+            set_physical_page(i, move(page));
+            for_each_region([&](auto& region) {
+                region.remap_vmobject_page_range(i, 1);
+            });
+            continue;
+        }
+        m_compressed_pages.set(i, handle);
+        ++count;
+    }
+    return count;
+}
+
+bool AnonymousVMObject::decompress_page(size_t page_index)
+{
+    VERIFY(m_lock.is_locked());
+    VERIFY(!m_physical_pages[page_index]);
+
+    auto page = MM.allocate_user_physical_page(MemoryManager::ShouldZeroFill::No);
+    if (!page)
+        return false;
+
+    // Making room for it may have purged the page, its slot has the zero
+    // page then.
+    auto it = m_compressed_pages.find(page_index);
+    if (it == m_compressed_pages.end())
+        return true;
+    auto handle = it->value;
+    m_compressed_pages.remove(it);
+
+    CompressedPageStore::the().load(handle, MM.quickmap_page(*page));
+    MM.unquickmap_page();
+    set_physical_page(page_index, move(page));
+    return true;
+}
+
+bool AnonymousVMObject::decompress_all_pages()
+{
+    VERIFY(m_lock.is_locked());
+    while (!m_compressed_pages.is_empty()) {
+        if (!decompress_page(m_compressed_pages.begin()->key))
+            return false;
+    }
+    return true;
+}
+
+size_t AnonymousVMObject::swap_out_inactive_pages(SwapArea& swap_area, size_t max_count)
+{
+    VERIFY(!m_lock.own_lock());
+    constexpr size_t batch_page_count = 16;
+
+    u8* buffer = (u8*)kmalloc(batch_page_count * PAGE_SIZE);
+    if (!buffer)
+        return 0;
+    ScopeGuard free_buffer([&] {
+        kfree(buffer);
+    });
+
+    size_t count = 0;
+    size_t page_index = 0;
+    while (count < max_count) {
+        size_t first_page_index = 0;
+        size_t run_count = 0;
+        u32 first_slot = 0;
+        NonnullRefPtrVector<PhysicalPage, batch_page_count> pages;
+        {
+            ScopedSpinLock lock(m_lock);
+            // Committed COW pages are there for whoever copies out of a
+            // shared page first, see compress_inactive_pages().
+            if (m_inactive_pages.is_null() || m_shared_committed_cow_pages)
+                break;
+
+            auto is_candidate = [&](size_t i) {
+                return m_inactive_pages.get(i) && !m_swap_slots.contains(i) && is_page_movable(i);
+            };
+            while (page_index < page_count() && !is_candidate(page_index))
+                ++page_index;
+            if (page_index == page_count())
+                break;
+            first_page_index = page_index;
+            size_t wanted = min(batch_page_count, max_count - count);
+            while (run_count < wanted && first_page_index + run_count < page_count() && is_candidate(first_page_index + run_count))
+                ++run_count;
+
+            auto slot = swap_area.allocate_slots(run_count, run_count);
+            if (!slot.has_value())
+                break;
+            first_slot = slot.value();
+            page_index = first_page_index + run_count;
+
+            // Write-protected before they're copied, so a write that comes
+            // in while they're on their way out is seen afterwards.
+            for (size_t i = 0; i < run_count; ++i) {
+                m_inactive_pages.set(first_page_index + i, false);
+                pages.append(*m_physical_pages[first_page_index + i]);
+                set_should_cow(first_page_index + i, true);
+            }
+            for_each_region([&](auto& region) {
+                region.remap_vmobject_page_range(first_page_index, run_count);
+            });
+            for (size_t i = 0; i < run_count; ++i) {
+                copy_page(buffer + i * PAGE_SIZE, MM.quickmap_page(pages[i]), PageTemporality::Cold);
+                MM.unquickmap_page();
+            }
+        }
+
+        auto result = swap_area.write_pages(first_slot, buffer, run_count);
+        if (result.is_error())
+            dmesgln("Swap: Error ({}) while writing {} pages at slot {}", result.error(), run_count, first_slot);
+
+        ScopedSpinLock lock(m_lock);
+        for (size_t i = 0; i < run_count; ++i) {
+            size_t index = first_page_index + i;
+            bool is_our_page = m_physical_pages[index] == &pages[i];
+            // A write fault took the page out of COW, or copied it away.
+            bool is_unchanged = is_our_page && is_cow(index);
+            if (result.is_error() || !is_unchanged || m_shared_committed_cow_pages) {
+                swap_area.free_slot(first_slot + i);
+                // Unless a clone shares it now, the page is ours alone again.
+                if (is_unchanged && !m_shared_committed_cow_pages)
+                    set_should_cow(index, false);
+                continue;
+            }
+            set_should_cow(index, false);
+            set_physical_page(index, nullptr);
+            m_swap_slots.set(index, first_slot + i);
+            ++count;
+        }
+        for_each_region([&](auto& region) {
+            region.remap_vmobject_page_range(first_page_index, run_count);
+        });
+        if (result.is_error())
+            break;
+    }
+    return count;
+}
+
+PageFaultResponse AnonymousVMObject::swap_in_pages(size_t page_index, size_t window, size_t& swapped_in_count)
+{
+    VERIFY(!m_lock.own_lock());
+    VERIFY(window >= 1);
+    swapped_in_count = 0;
+
+    u32 first_slot = 0;
+    size_t count = 1;
+    for (;;) {
+        ScopedSpinLock lock(m_lock);
+        auto it = m_swap_slots.find(page_index);
+        // Read in by someone else, or purged while we waited.
+        if (it == m_swap_slots.end())
+            return PageFaultResponse::Continue;
+        if (m_swap_ins_in_flight.is_null())
+            m_swap_ins_in_flight = Bitmap { page_count(), false };
+        if (!m_swap_ins_in_flight.get(page_index)) {
+            first_slot = it->value;
+            while (count < window && page_index + count < page_count() && !m_swap_ins_in_flight.get(page_index + count)) {
+                auto next = m_swap_slots.find(page_index + count);
+                if (next == m_swap_slots.end() || next->value != first_slot + count)
+                    break;
+                ++count;
+            }
+            for (size_t i = 0; i < count; ++i)
+                m_swap_ins_in_flight.set(page_index + i, true);
+            break;
+        }
+        lock.unlock();
+        // Any swap-in finishing wakes us, then we look again.
+        m_swap_in_queue.wait_forever("SwapIn");
+    }
+    ScopeGuard finish_swap_in([&] {
+        {
+            ScopedSpinLock lock(m_lock);
+            for (size_t i = 0; i < count; ++i)
+                m_swap_ins_in_flight.set(page_index + i, false);
+        }
+        m_swap_in_queue.wake_all();
+    });
+
+    u8 page_buffer[PAGE_SIZE];
+    u8* read_buffer = page_buffer;
+    if (count > 1) {
+        read_buffer = (u8*)kmalloc(count * PAGE_SIZE);
+        if (!read_buffer) {
+            read_buffer = page_buffer;
+            count = 1;
+        }
+    }
+    ScopeGuard free_read_buffer([&] {
+        if (read_buffer != page_buffer)
+            kfree(read_buffer);
+    });
+
+    // Pages are only swapped out while there is a swap area, and it stays.
+    auto& swap_area = *SwapArea::active();
+    auto result = swap_area.read_pages(first_slot, read_buffer, count);
+    if (result.is_error()) {
+        dmesgln("Swap: Error ({}) while reading {} pages at slot {}", result.error(), count, first_slot);
+        return PageFaultResponse::ShouldCrash;
+    }
+
+    ScopedSpinLock lock(m_lock);
+    for (size_t i = 0; i < count; ++i) {
+        // Making room may purge pages of ours, so the slot is looked at
+        // once the page is there.
+        auto page = MM.allocate_user_physical_page(MemoryManager::ShouldZeroFill::No);
+        if (page.is_null()) {
+            // The pages read ahead are only a bonus.
+            if (i != 0)
+                break;
+            dmesgln("MM: swap_in_pages was unable to allocate a physical page");
+            return PageFaultResponse::OutOfMemory;
+        }
+        auto it = m_swap_slots.find(page_index + i);
+        if (it == m_swap_slots.end() || it->value != first_slot + i)
+            continue;
+        VERIFY(!m_physical_pages[page_index + i]);
+
+        copy_page(MM.quickmap_page(*page), read_buffer + i * PAGE_SIZE, i ? PageTemporality::Cold : PageTemporality::Hot);
+        MM.unquickmap_page();
+        m_swap_slots.remove(it);
+        swap_area.free_slot(first_slot + i);
+        set_physical_page(page_index + i, move(page));
+        swapped_in_count = i + 1;
+    }
+    return PageFaultResponse::Continue;
+}
+
+bool AnonymousVMObject::drop_swapped_page(size_t page_index)
+{
+    VERIFY(m_lock.is_locked());
+    auto it = m_swap_slots.find(page_index);
+    if (it == m_swap_slots.end())
+        return false;
+    SwapArea::active()->free_slot(it->value);
+    m_swap_slots.remove(it);
+    return true;
+}
+
+bool AnonymousVMObject::drop_compressed_page(size_t page_index)
+{
+    VERIFY(m_lock.is_locked());
+    auto it = m_compressed_pages.find(page_index);
+    if (it == m_compressed_pages.end())
+        return false;
+    CompressedPageStore::the().free(it->value);
+    m_compressed_pages.remove(it);
+    return true;
+}
+
+bool AnonymousVMObject::is_page_mergeable(size_t page_index) const
+{
+    // Pages of committed COW memory have to be copied out into the pages
+    // committed for them, merged pages don't have any.
+    if (m_shared_committed_cow_pages || !m_purgeable_ranges.is_empty())
+        return false;
+    auto& phys_page = m_physical_pages[page_index];
+    if (!phys_page || phys_page->is_shared_zero_page() || phys_page->is_lazy_committed_page())
+        return false;
+    if (!phys_page->may_return_to_freelist() || (phys_page->ref_count() != 1 && !phys_page->is_merged()))
+        return false;
+    bool is_mergeable = true;
+    const_cast<AnonymousVMObject&>(*this).for_each_region([&](auto& region) {
+        if (!region.is_user() || region.is_shared() || !region.is_mergeable())
+            is_mergeable = false;
+    });
+    return is_mergeable;
+}
+
+void AnonymousVMObject::write_protect_page(size_t page_index)
+{
+    ScopedSpinLock lock(m_lock);
+    set_should_cow(page_index, true);
+    for_each_region([&](auto& region) {
+        region.remap_vmobject_page_range(page_index, 1);
+    });
+}
+
+void AnonymousVMObject::merge_page(size_t page_index, NonnullRefPtr<PhysicalPage> page)
+{
+    ScopedSpinLock lock(m_lock);
+    VERIFY(is_cow(page_index));
+    set_physical_page(page_index, move(page));
+    for_each_region([&](auto& region) {
+        region.remap_vmobject_page_range(page_index, 1);
+    });
+}
+
 void AnonymousVMObject::set_was_purged(VolatilePageRange const& range)
 {
     VERIFY(m_lock.is_locked());
@@ -184,6 +634,7 @@ void AnonymousVMObject::register_purgeable_page_ranges(PurgeablePageRanges& purg
     purgeable_page_ranges.set_vmobject(this);
     VERIFY(!m_purgeable_ranges.contains_slow(&purgeable_page_ranges));
     m_purgeable_ranges.append(&purgeable_page_ranges);
+    m_volatile_ranges_cache_dirty = true;
 }
 
 void AnonymousVMObject::unregister_purgeable_page_ranges(PurgeablePageRanges& purgeable_page_ranges)
@@ -194,6 +645,7 @@ void AnonymousVMObject::unregister_purgeable_page_ranges(PurgeablePageRanges& pu
             continue;
         purgeable_page_ranges.set_vmobject(nullptr);
         m_purgeable_ranges.remove(i);
+        m_volatile_ranges_cache_dirty = true;
         return;
     }
     VERIFY_NOT_REACHED();
@@ -202,12 +654,9 @@ void AnonymousVMObject::unregister_purgeable_page_ranges(PurgeablePageRanges& pu
 bool AnonymousVMObject::is_any_volatile() const
 {
     ScopedSpinLock lock(m_lock);
-    for (auto& volatile_ranges : m_purgeable_ranges) {
-        ScopedSpinLock lock(volatile_ranges->m_volatile_ranges_lock);
-        if (!volatile_ranges->is_empty())
-            return true;
-    }
-    return false;
+    if (m_volatile_ranges_cache_dirty)
+        update_volatile_cache();
+    return !m_volatile_ranges_cache.ranges().is_empty();
 }
 
 size_t AnonymousVMObject::remove_lazy_commit_pages(VolatilePageRange const& range)
@@ -229,22 +678,58 @@ size_t AnonymousVMObject::remove_lazy_commit_pages(VolatilePageRange const& rang
     return removed_count;
 }
 
-void AnonymousVMObject::update_volatile_cache()
+void AnonymousVMObject::update_volatile_cache() const
 {
     VERIFY(m_lock.is_locked());
     VERIFY(m_volatile_ranges_cache_dirty);
 
     m_volatile_ranges_cache.clear();
-    for_each_nonvolatile_range([&](VolatilePageRange const& range) {
-        m_volatile_ranges_cache.add_unchecked(range);
+    m_volatile_ranges_cache_dirty = false;
+    if (m_purgeable_ranges.is_empty())
+        return;
+
+    // Each range covers its pages once, and the ranges of one set don't
+    // overlap, so a page is volatile where the coverage is the number of
+    // sets. One sorted pass over all their edges finds those stretches.
+    struct Edge {
+        size_t page_index;
+        ssize_t delta;
+    };
+    Vector<Edge, 32> edges;
+    for (auto* purgeable_ranges : m_purgeable_ranges) {
+        ScopedSpinLock purgeable_lock(purgeable_ranges->m_volatile_ranges_lock);
+        for (auto& range : purgeable_ranges->volatile_ranges().ranges()) {
+            edges.append({ range.base, 1 });
+            edges.append({ range.base + range.count, -1 });
+        }
+    }
+    quick_sort(edges, [](auto& a, auto& b) {
+        return a.page_index < b.page_index;
     });
 
-    m_volatile_ranges_cache_dirty = false;
+    auto needed_coverage = static_cast<ssize_t>(m_purgeable_ranges.size());
+    ssize_t coverage = 0;
+    Optional<size_t> volatile_base;
+    for (size_t i = 0; i < edges.size();) {
+        size_t page_index = edges[i].page_index;
+        for (; i < edges.size() && edges[i].page_index == page_index; ++i)
+            coverage += edges[i].delta;
+
+        bool is_volatile = coverage == needed_coverage;
+        if (is_volatile && !volatile_base.has_value()) {
+            volatile_base = page_index;
+        } else if (!is_volatile && volatile_base.has_value()) {
+            m_volatile_ranges_cache.add_unchecked({ volatile_base.value(), page_index - volatile_base.value() });
+            volatile_base.clear();
+        }
+    }
+    VERIFY(!coverage && !volatile_base.has_value());
 }
 
 void AnonymousVMObject::range_made_volatile(VolatilePageRange const& range)
 {
     VERIFY(m_lock.is_locked());
+    m_volatile_ranges_cache_dirty = true;
 
     if (m_unused_committed_pages == 0)
         return;
@@ -264,8 +749,6 @@ void AnonymousVMObject::range_made_volatile(VolatilePageRange const& range)
         dbgln_if(COMMIT_DEBUG, "Uncommit {} lazy-commit pages from {:p}", uncommit_page_count, this);
         MM.uncommit_user_physical_pages(uncommit_page_count);
     }
-
-    m_volatile_ranges_cache_dirty = true;
 }
 
 void AnonymousVMObject::range_made_nonvolatile(VolatilePageRange const&)
@@ -282,7 +765,7 @@ size_t AnonymousVMObject::count_needed_commit_pages_for_nonvolatile_range(Volati
     size_t need_commit_pages = 0;
     auto range_end = range.base + range.count;
     for (size_t page_index = range.base; page_index < range_end; page_index++) {
-        if (!m_cow_map.is_null() && m_cow_map.get(page_index))
+        if (is_cow(page_index))
             continue;
         auto& phys_page = m_physical_pages[page_index];
         if (phys_page && phys_page->is_shared_zero_page())
@@ -300,7 +783,7 @@ size_t AnonymousVMObject::mark_committed_pages_for_nonvolatile_range(VolatilePag
     size_t pages_updated = 0;
     auto range_end = range.base + range.count;
     for (size_t page_index = range.base; page_index < range_end; page_index++) {
-        if (!m_cow_map.is_null() && m_cow_map.get(page_index))
+        if (is_cow(page_index))
             continue;
         auto& phys_page = m_physical_pages[page_index];
         if (phys_page && phys_page->is_shared_zero_page()) {
@@ -341,15 +824,15 @@ Bitmap& AnonymousVMObject::ensure_cow_map()
 {
     if (m_cow_map.is_null())
         m_cow_map = Bitmap { page_count(), true };
+    else if (m_all_pages_cow)
+        m_cow_map.fill(true);
+    m_all_pages_cow = false;
     return m_cow_map;
 }
 
 void AnonymousVMObject::ensure_or_reset_cow_map()
 {
-    if (m_cow_map.is_null())
-        ensure_cow_map();
-    else
-        m_cow_map.fill(true);
+    m_all_pages_cow = true;
 }
 
 bool AnonymousVMObject::should_cow(size_t page_index, bool is_shared) const
@@ -359,16 +842,21 @@ bool AnonymousVMObject::should_cow(size_t page_index, bool is_shared) const
         return true;
     if (is_shared)
         return false;
-    return !m_cow_map.is_null() && m_cow_map.get(page_index);
+    return is_cow(page_index);
 }
 
 void AnonymousVMObject::set_should_cow(size_t page_index, bool cow)
 {
+    ScopedSpinLock lock(m_lock);
+    bool was_shared = is_page_shared(page_index);
     ensure_cow_map().set(page_index, cow);
+    account_page_change(page_index, is_page_resident(page_index), was_shared);
 }
 
 size_t AnonymousVMObject::cow_pages() const
 {
+    if (m_all_pages_cow)
+        return page_count();
     if (m_cow_map.is_null())
         return 0;
     return m_cow_map.count_slow(true);
@@ -410,24 +898,11 @@ PageFaultResponse AnonymousVMObject::handle_cow_fault(size_t page_index, Virtual
         }
     }
 
-    u8* dest_ptr = MM.quickmap_page(*page);
-    dbgln_if(PAGE_FAULT_DEBUG, "      >> COW {} <- {}", page->paddr(), page_slot->paddr());
-    {
-        SmapDisabler disabler;
-        void* fault_at;
-        if (!safe_memcpy(dest_ptr, vaddr.as_ptr(), PAGE_SIZE, fault_at)) {
-            if ((u8*)fault_at >= dest_ptr && (u8*)fault_at <= dest_ptr + PAGE_SIZE)
-                dbgln("      >> COW: error copying page {}/{} to {}/{}: failed to write to page at {}",
-                    page_slot->paddr(), vaddr, page->paddr(), VirtualAddress(dest_ptr), VirtualAddress(fault_at));
-            else if ((u8*)fault_at >= vaddr.as_ptr() && (u8*)fault_at <= vaddr.as_ptr() + PAGE_SIZE)
-                dbgln("      >> COW: error copying page {}/{} to {}/{}: failed to read from page at {}",
-                    page_slot->paddr(), vaddr, page->paddr(), VirtualAddress(dest_ptr), VirtualAddress(fault_at));
-            else
-                VERIFY_NOT_REACHED();
-        }
-    }
-    page_slot = move(page);
-    MM.unquickmap_page();
+    // Both pages are mapped at once, the copy doesn't go through the
+    // faulting address and can't fault itself.
+    dbgln_if(PAGE_FAULT_DEBUG, "      >> COW {} <- {} for {}", page->paddr(), page_slot->paddr(), vaddr);
+    MM.copy_physical_page(*page, *page_slot);
+    set_physical_page(page_index, move(page));
     set_should_cow(page_index, false);
     return PageFaultResponse::Continue;
 }
@@ -6,12 +6,16 @@
 
 #pragma once
 
+#include <base/HashMap.h>
 #include <kernel/PhysicalAddress.h>
 #include <kernel/vm/AllocationStrategy.h>
+#include <kernel/vm/CompressedPageStore.h>
 #include <kernel/vm/MemoryManager.h>
 #include <kernel/vm/PageFaultResponse.h>
 #include <kernel/vm/PurgeablePageRanges.h>
+#include <kernel/vm/SwapArea.h>
 #include <kernel/vm/VMObject.h>
+#include <kernel/WaitQueue.h>
 
 namespace Kernel {
 
@@ -37,37 +41,71 @@ public:
 
     int purge();
 
+    // Counts the sweeps since any of our pages was last accessed, so the
+    // least recently used volatile memory can be purged first. Pages that
+    // weren't accessed since the last sweep become inactive.
+    void age_pages();
+    u32 idle_sweeps() const { return m_idle_sweeps; }
+
+    // Moves up to max_count inactive movable pages into the compressed page
+    // store, and returns how many physical pages that gave back. Their slots
+    // are left empty, so touching them faults.
+    size_t compress_inactive_pages(size_t max_count);
+    bool is_page_compressed(size_t page_index) const { return m_compressed_pages.contains(page_index); }
+    size_t compressed_page_count() const { return m_compressed_pages.size(); }
+    // Puts a compressed page back into a physical page of its own, expects
+    // m_lock to be held. Fails if no page can be allocated.
+    bool decompress_page(size_t page_index);
+
+    // Writes up to max_count inactive movable pages out to the swap area,
+    // neighbouring ones in one request, and returns how many physical pages
+    // that gave back. Pages are write-protected while they're written out,
+    // any that are written to meanwhile stay. Blocks, so no spinlocks may
+    // be held.
+    size_t swap_out_inactive_pages(SwapArea&, size_t max_count);
+    bool is_page_swapped(size_t page_index) const { return m_swap_slots.contains(page_index); }
+
+    // Reads a swapped out page back in along with up to window - 1 pages
+    // after it whose slots follow its own, and sets how many of those it
+    // put back. A fault on a page another one is reading in waits for it.
+    // Blocks, so m_lock must not be held.
+    static constexpr size_t max_swap_read_ahead_pages = 8;
+    PageFaultResponse swap_in_pages(size_t page_index, size_t window, size_t& swapped_in_count);
+
+    // Replaces the pages with the shared zero page. The memory goes back
+    // to the free pool uncommitted, like purged memory does.
+    size_t discard_pages(size_t page_index, size_t page_count);
+
+    // Whether compaction may move the page to another physical page: it
+    // is private to this object, which is only mapped into userspace.
+    bool is_page_movable(size_t page_index) const;
+    void migrate_page(size_t page_index, NonnullRefPtr<PhysicalPage>);
+
+    // Whether the page may be shared with identical pages: it is private
+    // to this object, or already shared that way, and every region of
+    // ours is a private mergeable userspace mapping.
+    bool is_page_mergeable(size_t page_index) const;
+    // Makes the page copy-on-write and maps it read-only, so it doesn't
+    // change until the next write fault.
+    void write_protect_page(size_t page_index);
+    // Replaces a write-protected page with an identical one.
+    void merge_page(size_t page_index, NonnullRefPtr<PhysicalPage>);
+
     bool is_any_volatile() const;
 
+    // The pages that every registered PurgeablePageRanges has made
+    // volatile, merged into one set that is only rebuilt when one of them
+    // changes.
     template<IteratorFunction<VolatilePageRange const&> F>
     IterationDecision for_each_volatile_range(F f) const
     {
         VERIFY(m_lock.is_locked());
-        for (auto* purgeable_range : m_purgeable_ranges) {
-            ScopedSpinLock purgeable_lock(purgeable_range->m_volatile_ranges_lock);
-            for (auto& r1 : purgeable_range->volatile_ranges().ranges()) {
-                VolatilePageRange range(r1);
-                for (auto* purgeable_range2 : m_purgeable_ranges) {
-                    if (purgeable_range2 == purgeable_range)
-                        continue;
-                    ScopedSpinLock purgeable2_lock(purgeable_range2->m_volatile_ranges_lock);
-                    if (purgeable_range2->is_empty()) {
-                        return IterationDecision::Continue;
-                    }
-                    for (auto const& r2 : purgeable_range2->volatile_ranges().ranges()) {
-                        range = range.intersected(r2);
-                        if (range.is_empty())
-                            break;
-                    }
-                    if (range.is_empty())
-                        break;
-                }
-                if (range.is_empty())
-                    continue;
-                IterationDecision decision = f(range);
-                if (decision != IterationDecision::Continue)
-                    return decision;
-            }
+        if (m_volatile_ranges_cache_dirty)
+            update_volatile_cache();
+        for (auto& range : m_volatile_ranges_cache.ranges()) {
+            IterationDecision decision = f(range);
+            if (decision != IterationDecision::Continue)
+                return decision;
         }
         return IterationDecision::Continue;
     }
@@ -116,7 +154,7 @@ private:
 
     virtual StringView class_name() const override { return "AnonymousVMObject"sv; }
 
-    void update_volatile_cache();
+    void update_volatile_cache() const;
     void set_was_purged(VolatilePageRange const&);
     size_t remove_lazy_commit_pages(VolatilePageRange const&);
     void range_made_volatile(VolatilePageRange const&);
@@ -124,6 +162,9 @@ private:
     size_t count_needed_commit_pages_for_nonvolatile_range(VolatilePageRange const&);
     size_t mark_committed_pages_for_nonvolatile_range(VolatilePageRange const&, size_t);
     bool is_nonvolatile(size_t page_index);
+    bool decompress_all_pages();
+    bool drop_compressed_page(size_t page_index);
+    bool drop_swapped_page(size_t page_index);
 
     AnonymousVMObject& operator=(AnonymousVMObject const&) = delete;
     AnonymousVMObject& operator=(AnonymousVMObject&&) = delete;
@@ -133,14 +174,27 @@ private:
 
     Bitmap& ensure_cow_map();
     void ensure_or_reset_cow_map();
+    bool is_cow(size_t page_index) const { return m_all_pages_cow || (!m_cow_map.is_null() && m_cow_map.get(page_index)); }
+    virtual bool is_page_cow(size_t page_index) const override { return is_cow(page_index); }
 
-    VolatilePageRanges m_volatile_ranges_cache;
-    bool m_volatile_ranges_cache_dirty { true };
+    mutable VolatilePageRanges m_volatile_ranges_cache;
+    mutable bool m_volatile_ranges_cache_dirty { true };
     Vector<PurgeablePageRanges*> m_purgeable_ranges;
     size_t m_unused_committed_pages { 0 };
+    u32 m_idle_sweeps { 0 };
+    Bitmap m_inactive_pages;
+    HashMap<size_t, CompressedPageStore::Handle> m_compressed_pages;
+    // Slots in the active swap area, which a clone shares with us.
+    HashMap<size_t, u32> m_swap_slots;
+    Bitmap m_swap_ins_in_flight;
+    WaitQueue m_swap_in_queue;
 
     Bitmap m_cow_map;
 
+    // Set by a fork, when every page becomes copy-on-write. m_cow_map is
+    // only brought up to date once a page stops being so.
+    bool m_all_pages_cow { false };
+
     RefPtr<CommittedCowPages> m_shared_committed_cow_pages;
 };
 
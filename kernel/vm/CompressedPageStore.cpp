@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Singleton.h>
+#include <kernel/StdLib.h>
+#include <kernel/vm/CompressedPageStore.h>
+#include <kernel/vm/MemoryManager.h>
+#include <kernel/vm/Region.h>
+
+namespace Kernel {
+
+static Base::Singleton<CompressedPageStore> s_the;
+
+CompressedPageStore& CompressedPageStore::the()
+{
+    return *s_the;
+}
+
+// One page as an LZ4 block, the same format libcompression reads and
+// writes. Matches never reach outside the page.
+static constexpr size_t lz4_min_match = 4;
+static constexpr size_t lz4_match_find_limit = 12;
+static constexpr size_t lz4_last_literals = 5;
+static constexpr size_t lz4_hash_bits = 12;
+
+static ALWAYS_INLINE u32 read32(u8 const* data)
+{
+    u32 value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static ALWAYS_INLINE u32 lz4_hash(u32 sequence)
+{
+    return (sequence * 2654435761u) >> (32 - lz4_hash_bits);
+}
+
+static u8* lz4_write_length(u8* out, size_t length)
+{
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = length;
+    return out;
+}
+
+// Returns nullptr if the sequence doesn't fit before out_end.
+static u8* lz4_write_sequence(u8* out, u8* out_end, u8 const* literals, size_t literal_length, size_t offset, size_t match_length)
+{
+    size_t worst_case = 1 + literal_length / 255 + 1 + literal_length + 2 + match_length / 255 + 1;
+    if (worst_case > static_cast<size_t>(out_end - out))
+        return nullptr;
+
+    u8* token = out++;
+    *token = min(literal_length, static_cast<size_t>(15)) << 4;
+    if (literal_length >= 15)
+        out = lz4_write_length(out, literal_length - 15);
+    memcpy(out, literals, literal_length);
+    out += literal_length;
+
+    // The last sequence has no match.
+    if (match_length == 0)
+        return out;
+
+    *out++ = offset & 0xff;
+    *out++ = offset >> 8;
+    match_length -= lz4_min_match;
+    *token |= min(match_length, static_cast<size_t>(15));
+    if (match_length >= 15)
+        out = lz4_write_length(out, match_length - 15);
+    return out;
+}
+
+// Returns the compressed size, or 0 if it would take more than out_capacity
+// bytes. The table holds position + 1 of the last 4 bytes with each hash.
+static size_t lz4_compress_page(u8 const* data, u8* out, size_t out_capacity, u16* table)
+{
+    memset(table, 0, sizeof(u16) << lz4_hash_bits);
+    u8* out_start = out;
+    u8* out_end = out + out_capacity;
+
+    size_t anchor = 0;
+    size_t ip = 0;
+    size_t find_limit = PAGE_SIZE - lz4_match_find_limit;
+    size_t match_limit = PAGE_SIZE - lz4_last_literals;
+
+    // Every 64 misses in a row the step grows, so incompressible pages are
+    // given up on quickly.
+    unsigned misses = 0;
+    while (ip <= find_limit) {
+        u32 sequence = read32(data + ip);
+        u32 hash = lz4_hash(sequence);
+        size_t candidate = table[hash];
+        table[hash] = ip + 1;
+
+        if (!candidate || read32(data + candidate - 1) != sequence) {
+            ip += 1 + (misses++ >> 6);
+            continue;
+        }
+        misses = 0;
+
+        size_t match = candidate - 1;
+        while (ip > anchor && match > 0 && data[ip - 1] == data[match - 1]) {
+            --ip;
+            --match;
+        }
+        size_t length = lz4_min_match;
+        while (ip + length < match_limit && data[ip + length] == data[match + length])
+            ++length;
+
+        out = lz4_write_sequence(out, out_end, data + anchor, ip - anchor, ip - match, length);
+        if (!out)
+            return 0;
+        ip += length;
+        anchor = ip;
+
+        // The middle of the match would never be looked up otherwise.
+        if (ip - 2 <= find_limit)
+            table[lz4_hash(read32(data + ip - 2))] = ip - 2 + 1;
+    }
+
+    out = lz4_write_sequence(out, out_end, data + anchor, PAGE_SIZE - anchor, 0, 0);
+    if (!out)
+        return 0;
+    return out - out_start;
+}
+
+static bool lz4_read_length(u8 const*& in, u8 const* in_end, size_t& length)
+{
+    u8 byte;
+    do {
+        if (in == in_end)
+            return false;
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// Whether the block was well formed and decoded to exactly one page.
+static bool lz4_decompress_page(u8 const* in, size_t size, u8* out)
+{
+    u8 const* in_end = in + size;
+    u8* op = out;
+    u8* out_end = out + PAGE_SIZE;
+
+    while (in < in_end) {
+        u8 token = *in++;
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !lz4_read_length(in, in_end, literal_length))
+            return false;
+        if (literal_length > static_cast<size_t>(in_end - in) || literal_length > static_cast<size_t>(out_end - op))
+            return false;
+        memcpy(op, in, literal_length);
+        op += literal_length;
+        in += literal_length;
+
+        if (in == in_end)
+            break;
+
+        if (in_end - in < 2)
+            return false;
+        size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+        if (!offset || offset > static_cast<size_t>(op - out))
+            return false;
+
+        size_t match_length = token & 15;
+        if (match_length == 15 && !lz4_read_length(in, in_end, match_length))
+            return false;
+        match_length += lz4_min_match;
+        if (match_length > static_cast<size_t>(out_end - op))
+            return false;
+
+        // A match may overlap the bytes it produces, so byte by byte.
+        u8 const* match = op - offset;
+        for (size_t i = 0; i < match_length; ++i)
+            op[i] = match[i];
+        op += match_length;
+    }
+    return op == out_end;
+}
+
+CompressedPageStore::CompressedPageStore()
+{
+    // A size class takes its objects' largest size, and as many pages per
+    // zspage as leave the least of them unused.
+    for (size_t i = 0; i < size_class_count; ++i) {
+        auto& size_class = m_size_classes[i];
+        size_class.object_size = (i + 1) * size_class_granularity;
+        size_t best_waste_percent = 100;
+        for (size_t pages = 1; pages <= max_pages_per_zspage; ++pages) {
+            size_t bytes = pages * PAGE_SIZE;
+            size_t waste_percent = (bytes % size_class.object_size) * 100 / bytes;
+            if (waste_percent < best_waste_percent) {
+                best_waste_percent = waste_percent;
+                size_class.pages_per_zspage = pages;
+            }
+        }
+        size_class.capacity = size_class.pages_per_zspage * PAGE_SIZE / size_class.object_size;
+    }
+}
+
+CompressedPageStore::ZSPage* CompressedPageStore::create_zspage(size_t size_class_index)
+{
+    auto& size_class = m_size_classes[size_class_index];
+    auto region = MM.allocate_kernel_region(size_class.pages_per_zspage * PAGE_SIZE, "CompressedPageStore", Region::Access::Read | Region::Access::Write, AllocationStrategy::AllocateNow);
+    if (!region)
+        return nullptr;
+    auto* zspage = new (nothrow) ZSPage;
+    if (!zspage)
+        return nullptr;
+
+    zspage->region = region.leak_ptr();
+    zspage->data = zspage->region->vaddr().as_ptr();
+    zspage->size_class = size_class_index;
+    zspage->capacity = size_class.capacity;
+    for (u16 slot = 0; slot < zspage->capacity; ++slot) {
+        auto* free_slot = reinterpret_cast<FreeSlot*>(zspage->data + slot * size_class.object_size);
+        free_slot->next = slot + 1;
+    }
+    return zspage;
+}
+
+void CompressedPageStore::destroy_zspage(ZSPage& zspage)
+{
+    VERIFY(!zspage.in_use);
+    delete zspage.region;
+    delete &zspage;
+}
+
+CompressedPageStore::Handle CompressedPageStore::store(u8 const* page_data)
+{
+    ScopedSpinLock compress_lock(m_compress_lock);
+    size_t compressed_size = lz4_compress_page(page_data, m_compressed, sizeof(m_compressed), m_hash_table);
+    if (!compressed_size) {
+        ScopedSpinLock lock(m_lock);
+        ++m_rejected_pages;
+        return {};
+    }
+
+    auto size_class_index = size_class_for(compressed_size);
+    auto& size_class = m_size_classes[size_class_index];
+
+    ScopedSpinLock lock(m_lock);
+    auto* zspage = size_class.partial_zspages.first();
+    if (!zspage) {
+        // Growing the pool takes the MemoryManager's lock, which may be
+        // held by someone waiting for ours.
+        lock.unlock();
+        auto* new_zspage = create_zspage(size_class_index);
+        lock.lock();
+        if (!new_zspage) {
+            ++m_rejected_pages;
+            return {};
+        }
+        m_pool_pages += size_class.pages_per_zspage;
+        size_class.partial_zspages.append(*new_zspage);
+        zspage = size_class.partial_zspages.first();
+    }
+
+    u16 slot = zspage->free_slot;
+    u8* object = zspage->data + slot * size_class.object_size;
+    zspage->free_slot = reinterpret_cast<FreeSlot*>(object)->next;
+    if (++zspage->in_use == zspage->capacity)
+        size_class.partial_zspages.remove(*zspage);
+    memcpy(object, m_compressed, compressed_size);
+
+    ++m_stored_pages;
+    m_compressed_bytes += compressed_size;
+    return { zspage, slot, static_cast<u16>(compressed_size) };
+}
+
+void CompressedPageStore::load(Handle handle, u8* page_data)
+{
+    VERIFY(!handle.is_null());
+    {
+        ScopedSpinLock lock(m_lock);
+        auto& size_class = m_size_classes[handle.zspage->size_class];
+        u8 const* object = handle.zspage->data + handle.slot * size_class.object_size;
+        bool is_intact = lz4_decompress_page(object, handle.size, page_data);
+        VERIFY(is_intact);
+        ++m_loaded_pages;
+    }
+    free(handle);
+}
+
+void CompressedPageStore::free(Handle handle)
+{
+    VERIFY(!handle.is_null());
+    ScopedSpinLock lock(m_lock);
+    auto& zspage = *handle.zspage;
+    auto& size_class = m_size_classes[zspage.size_class];
+    VERIFY(zspage.in_use);
+
+    auto* free_slot = reinterpret_cast<FreeSlot*>(zspage.data + handle.slot * size_class.object_size);
+    free_slot->next = zspage.free_slot;
+    zspage.free_slot = handle.slot;
+    if (zspage.in_use-- == zspage.capacity)
+        size_class.partial_zspages.append(zspage);
+
+    --m_stored_pages;
+    m_compressed_bytes -= handle.size;
+}
+
+size_t CompressedPageStore::shrink()
+{
+    ZSPage::List empty_zspages;
+    size_t page_count = 0;
+    {
+        ScopedSpinLock lock(m_lock);
+        for (auto& size_class : m_size_classes) {
+            for (auto it = size_class.partial_zspages.begin(); it != size_class.partial_zspages.end();) {
+                auto& zspage = *it;
+                ++it;
+                if (zspage.in_use)
+                    continue;
+                size_class.partial_zspages.remove(zspage);
+                empty_zspages.append(zspage);
+                page_count += size_class.pages_per_zspage;
+            }
+        }
+        m_pool_pages -= page_count;
+    }
+
+    // Regions are freed without holding our lock, see store().
+    while (auto* zspage = empty_zspages.take_first())
+        destroy_zspage(*zspage);
+    return page_count;
+}
+
+CompressedPageStore::Stats CompressedPageStore::stats() const
+{
+    ScopedSpinLock lock(m_lock);
+    return {
+        .stored_pages = m_stored_pages,
+        .compressed_bytes = m_compressed_bytes,
+        .pool_pages = m_pool_pages,
+        .rejected_pages = m_rejected_pages,
+        .loaded_pages = m_loaded_pages,
+    };
+}
+
+}
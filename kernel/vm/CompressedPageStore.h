@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/IntrusiveList.h>
+#include <base/Noncopyable.h>
+#include <base/Types.h>
+#include <kernel/SpinLock.h>
+
+namespace Kernel {
+
+class Region;
+
+// Anonymous pages that weren't touched for a while are kept here, LZ4
+// compressed, instead of in a physical page of their own, and decompressed
+// again when they fault back in. There is no swap, so this is where memory
+// goes once there is nothing left to purge.
+//
+// Compressed pages are packed like zsmalloc does: every size class has
+// zspages of a few virtually contiguous pages, as many as waste the least
+// of them, and its objects may straddle the page boundaries in there.
+class CompressedPageStore {
+    BASE_MAKE_NONCOPYABLE(CompressedPageStore);
+    BASE_MAKE_NONMOVABLE(CompressedPageStore);
+
+private:
+    struct ZSPage;
+
+public:
+    static constexpr size_t size_class_granularity = 64;
+    // Pages that don't compress better than this stay where they are, they
+    // would save too little for what decompressing them costs.
+    static constexpr size_t max_compressed_size = PAGE_SIZE * 3 / 4;
+    static constexpr size_t size_class_count = max_compressed_size / size_class_granularity;
+    static constexpr size_t max_pages_per_zspage = 4;
+
+    struct Handle {
+        ZSPage* zspage { nullptr };
+        u16 slot { 0 };
+        u16 size { 0 };
+
+        bool is_null() const { return !zspage; }
+    };
+
+    struct Stats {
+        size_t stored_pages { 0 };
+        size_t compressed_bytes { 0 };
+        size_t pool_pages { 0 };
+        u64 rejected_pages { 0 };
+        u64 loaded_pages { 0 };
+    };
+
+    CompressedPageStore();
+
+    static CompressedPageStore& the();
+
+    // Compresses a page worth of data. The handle is null if it doesn't get
+    // small enough or the pool can't grow.
+    Handle store(u8 const* page_data);
+    // Decompresses into a page worth of data and frees the handle.
+    void load(Handle, u8* page_data);
+    void free(Handle);
+
+    // Gives every empty zspage back, returns how many pages that was.
+    size_t shrink();
+
+    Stats stats() const;
+
+private:
+    struct FreeSlot {
+        u16 next;
+    };
+
+    struct ZSPage {
+        Region* region { nullptr };
+        u8* data { nullptr };
+        u8 size_class { 0 };
+        u16 capacity { 0 };
+        u16 in_use { 0 };
+        u16 free_slot { 0 };
+        IntrusiveListNode<ZSPage> list_node;
+
+        using List = IntrusiveList<ZSPage, RawPtr<ZSPage>, &ZSPage::list_node>;
+    };
+
+    // Zspages with a free slot are on the partial list, the others aren't
+    // on any.
+    struct SizeClass {
+        size_t object_size { 0 };
+        size_t pages_per_zspage { 0 };
+        u16 capacity { 0 };
+        ZSPage::List partial_zspages;
+    };
+
+    static size_t size_class_for(size_t compressed_size) { return (compressed_size - 1) / size_class_granularity; }
+
+    ZSPage* create_zspage(size_t size_class);
+    static void destroy_zspage(ZSPage&);
+
+    SizeClass m_size_classes[size_class_count];
+
+    // Taken around compressing, for the scratch space below.
+    SpinLock<u8> m_compress_lock;
+    u16 m_hash_table[1 << 12];
+    u8 m_compressed[max_compressed_size];
+
+    mutable SpinLock<u8> m_lock;
+    size_t m_stored_pages { 0 };
+    size_t m_compressed_bytes { 0 };
+    size_t m_pool_pages { 0 };
+    u64 m_rejected_pages { 0 };
+    u64 m_loaded_pages { 0 };
+};
+
+}
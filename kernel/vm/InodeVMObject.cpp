@@ -14,6 +14,8 @@ InodeVMObject::InodeVMObject(Inode& inode, size_t size)
     : VMObject(size)
     , m_inode(inode)
     , m_dirty_pages(page_count(), false)
+    , m_inactive_pages(page_count(), false)
+    , m_pages_in_flight(page_count(), false)
 {
 }
 
@@ -21,6 +23,8 @@ InodeVMObject::InodeVMObject(InodeVMObject const& other)
     : VMObject(other)
     , m_inode(other.m_inode)
     , m_dirty_pages(page_count(), false)
+    , m_inactive_pages(page_count(), false)
+    , m_pages_in_flight(page_count(), false)
 {
     for (size_t i = 0; i < page_count(); ++i)
         m_dirty_pages.set(i, other.m_dirty_pages.get(i));
@@ -30,6 +34,44 @@ InodeVMObject::~InodeVMObject()
 {
 }
 
+size_t InodeVMObject::read_ahead_pages_for_fault(size_t page_index)
+{
+    ScopedSpinLock locker(m_lock);
+    if (page_index == m_next_sequential_page)
+        m_read_ahead_pages = min(m_read_ahead_pages * 2, max_read_ahead_pages);
+    else
+        m_read_ahead_pages = 1;
+    m_next_sequential_page = page_index + m_read_ahead_pages;
+    return m_read_ahead_pages;
+}
+
+void InodeVMObject::start_page_in(size_t page_index, size_t page_count)
+{
+    VERIFY(m_lock.own_lock());
+    for (size_t i = page_index; i < page_index + page_count; ++i) {
+        VERIFY(!m_pages_in_flight.get(i));
+        m_pages_in_flight.set(i, true);
+    }
+}
+
+void InodeVMObject::finish_page_in(size_t page_index, size_t page_count)
+{
+    {
+        ScopedSpinLock locker(m_lock);
+        for (size_t i = page_index; i < page_index + page_count; ++i)
+            m_pages_in_flight.set(i, false);
+    }
+    m_page_in_queue.wake_all();
+}
+
+void InodeVMObject::wait_for_page_in()
+{
+    VERIFY(!m_lock.own_lock());
+    // Any page-in finishing wakes us, the caller checks again whether its
+    // page is still in flight.
+    m_page_in_queue.wait_forever("InodePageIn");
+}
+
 size_t InodeVMObject::amount_clean() const
 {
     size_t count = 0;
@@ -58,7 +100,8 @@ int InodeVMObject::release_all_clean_pages()
     int count = 0;
     for (size_t i = 0; i < page_count(); ++i) {
         if (!m_dirty_pages.get(i) && m_physical_pages[i]) {
-            m_physical_pages[i] = nullptr;
+            set_physical_page(i, nullptr);
+            m_inactive_pages.set(i, false);
             ++count;
         }
     }
@@ -70,6 +113,66 @@ int InodeVMObject::release_all_clean_pages()
     return count;
 }
 
+size_t InodeVMObject::release_clean_pages(size_t page_index, size_t page_count)
+{
+    VERIFY(page_index + page_count <= this->page_count());
+    ScopedSpinLock locker(m_lock);
+
+    size_t count = 0;
+    for (size_t i = page_index; i < page_index + page_count; ++i) {
+        if (!m_dirty_pages.get(i) && m_physical_pages[i]) {
+            set_physical_page(i, nullptr);
+            m_inactive_pages.set(i, false);
+            ++count;
+        }
+    }
+    if (count) {
+        for_each_region([&](auto& region) {
+            region.remap_vmobject_page_range(page_index, page_count);
+        });
+    }
+    return count;
+}
+
+size_t InodeVMObject::age_pages()
+{
+    ScopedSpinLock locker(m_lock);
+
+    Bitmap accessed(page_count(), false);
+    for_each_region([&](auto& region) {
+        region.collect_accessed_pages(&accessed);
+    });
+
+    size_t inactive_count = 0;
+    for (size_t i = 0; i < page_count(); ++i) {
+        bool is_inactive = m_physical_pages[i] && !accessed.get(i);
+        m_inactive_pages.set(i, is_inactive);
+        if (is_inactive && !m_dirty_pages.get(i))
+            ++inactive_count;
+    }
+    return inactive_count;
+}
+
+size_t InodeVMObject::release_inactive_clean_pages(size_t max_count, bool include_active)
+{
+    ScopedSpinLock locker(m_lock);
+
+    size_t count = 0;
+    for (size_t i = 0; i < page_count() && count < max_count; ++i) {
+        if (m_dirty_pages.get(i) || !m_physical_pages[i])
+            continue;
+        if (!include_active && !m_inactive_pages.get(i))
+            continue;
+        set_physical_page(i, nullptr);
+        m_inactive_pages.set(i, false);
+        for_each_region([&](auto& region) {
+            region.remap_vmobject_page_range(i, 1);
+        });
+        ++count;
+    }
+    return count;
+}
+
 u32 InodeVMObject::writable_mappings() const
 {
     u32 count = 0;
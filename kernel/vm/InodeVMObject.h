@@ -9,6 +9,7 @@
 // includes
 #include <base/Bitmap.h>
 #include <kernel/UnixTypes.h>
+#include <kernel/WaitQueue.h>
 #include <kernel/vm/VMObject.h>
 
 namespace Kernel {
@@ -24,10 +25,32 @@ public:
     size_t amount_clean() const;
 
     int release_all_clean_pages();
+    size_t release_clean_pages(size_t page_index, size_t page_count);
+
+    // Pages mapped since the last sweep are active, the others inactive.
+    // Returns how many clean pages are inactive after this one.
+    size_t age_pages();
+    // Drops up to max_count clean pages, just the inactive ones unless
+    // include_active is set.
+    size_t release_inactive_clean_pages(size_t max_count, bool include_active = false);
 
     u32 writable_mappings() const;
     u32 executable_mappings() const;
 
+    // How many pages to read in for a fault at page_index. Faults right
+    // behind the previous read double the window, up to max_read_ahead_pages,
+    // any other fault goes back to reading a single page.
+    static constexpr size_t max_read_ahead_pages = 16;
+    size_t read_ahead_pages_for_fault(size_t page_index);
+
+    // Pages a fault is reading in are in flight, faults on them wait for
+    // that read instead of issuing their own. The first two expect m_lock
+    // to be held, waiting must be done without it.
+    bool is_page_in_flight(size_t page_index) const { return m_pages_in_flight.get(page_index); }
+    void start_page_in(size_t page_index, size_t page_count);
+    void finish_page_in(size_t page_index, size_t page_count);
+    void wait_for_page_in();
+
 protected:
     explicit InodeVMObject(Inode&, size_t);
     explicit InodeVMObject(InodeVMObject const&);
@@ -40,6 +63,14 @@ protected:
 
     NonnullRefPtr<Inode> m_inode;
     Bitmap m_dirty_pages;
+
+private:
+    Bitmap m_inactive_pages;
+    Bitmap m_pages_in_flight;
+    WaitQueue m_page_in_queue;
+
+    size_t m_next_sequential_page { 0 };
+    size_t m_read_ahead_pages { 1 };
 };
 
 }
\ No newline at end of file
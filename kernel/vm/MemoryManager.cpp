@@ -6,23 +6,40 @@
 
 // includes
 #include <base/Assertions.h>
+#include <base/HashMap.h>
 #include <base/Memory.h>
+#include <base/StringHash.h>
+#include <base/QuickSort.h>
+#include <base/Stopwatch.h>
 #include <base/StringView.h>
+#include <base/Time.h>
+#include <kernel/AddressSanitizer.h>
+#include <kernel/acpi/Parser.h>
+#include <kernel/arch/x86/CPUID.h>
+#include <kernel/arch/x86/InterruptDisabler.h>
+#include <kernel/arch/x86/MemoryOperations.h>
+#include <kernel/arch/x86/PageOperations.h>
 #include <kernel/BootInfo.h>
+#include <kernel/BootProfiler.h>
 #include <kernel/CMOS.h>
 #include <kernel/filesystem/Inode.h>
 #include <kernel/heap/kmalloc.h>
+#include <kernel/Metrics.h>
 #include <kernel/Multiboot.h>
 #include <kernel/Panic.h>
 #include <kernel/Process.h>
 #include <kernel/Sections.h>
 #include <kernel/StdLib.h>
+#include <kernel/Tracing.h>
 #include <kernel/vm/AnonymousVMObject.h>
+#include <kernel/vm/CompressedPageStore.h>
 #include <kernel/vm/ContiguousVMObject.h>
 #include <kernel/vm/MemoryManager.h>
+#include <kernel/vm/MemoryPressureWatcher.h>
 #include <kernel/vm/PageDirectory.h>
 #include <kernel/vm/PhysicalRegion.h>
 #include <kernel/vm/SharedInodeVMObject.h>
+#include <kernel/vm/SwapArea.h>
 
 extern u8 start_of_kernel_image[];
 extern u8 end_of_kernel_image[];
@@ -59,6 +76,8 @@ bool MemoryManager::is_initialized()
 UNMAP_AFTER_INIT MemoryManager::MemoryManager()
 {
     s_the = this;
+    initialize_page_operations();
+    initialize_memory_operations();
 
     ScopedSpinLock lock(s_mm_lock);
     parse_memory_map();
@@ -94,6 +113,7 @@ UNMAP_AFTER_INIT void MemoryManager::protect_kernel_image()
 
 UNMAP_AFTER_INIT void MemoryManager::protect_readonly_after_init_memory()
 {
+    BootPhase phase("MemoryManager::protect_readonly_after_init_memory");
     ScopedSpinLock mm_lock(s_mm_lock);
     ScopedSpinLock page_lock(kernel_page_directory().get_lock());
 
@@ -479,7 +499,7 @@ PageTableEntry* MemoryManager::pte(PageDirectory& page_directory, VirtualAddress
 
     auto* pd = quickmap_pd(const_cast<PageDirectory&>(page_directory), page_directory_table_index);
     PageDirectoryEntry const& pde = pd[page_directory_index];
-    if (!pde.is_present())
+    if (!pde.is_present() || pde.is_huge())
         return nullptr;
 
     return &quickmap_pt(PhysicalAddress((FlatPtr)pde.page_table_base()))[page_table_index];
@@ -519,11 +539,239 @@ PageTableEntry* MemoryManager::ensure_pte(PageDirectory& page_directory, Virtual
         auto result = page_directory.m_page_tables.set(vaddr.get() & ~(FlatPtr)0x1fffff, move(page_table));
 
         VERIFY(result == Base::HashSetResult::InsertedNewEntry);
+    } else if (pde.is_huge()) {
+        if (!split_large_page(page_directory, vaddr))
+            return nullptr;
     }
 
     return &quickmap_pt(PhysicalAddress((FlatPtr)pde.page_table_base()))[page_table_index];
 }
 
+PageTableEntry* MemoryManager::ensure_shared_page_table(PageDirectory& page_directory, VirtualAddress vaddr, SharedInodeVMObject& vmobject, size_t key, bool& is_new)
+{
+    VERIFY_INTERRUPTS_DISABLED();
+    VERIFY(s_mm_lock.own_lock());
+    VERIFY(page_directory.get_lock().own_lock());
+    VERIFY(!(vaddr.get() & 0x1fffff));
+    u32 page_directory_table_index = (vaddr.get() >> 30) & 0x1ff;
+    u32 page_directory_index = (vaddr.get() >> 21) & 0x1ff;
+
+    is_new = false;
+    if (auto existing_key = page_directory.m_shared_page_table_keys.get(vaddr.get()); existing_key.has_value()) {
+        if (existing_key.value() == key) {
+            auto* pd = quickmap_pd(page_directory, page_directory_table_index);
+            return quickmap_pt(PhysicalAddress((FlatPtr)pd[page_directory_index].page_table_base()));
+        }
+        release_shared_page_table(page_directory, vaddr, vmobject);
+    }
+
+    auto* pd = quickmap_pd(page_directory, page_directory_table_index);
+    PageDirectoryEntry& pde = pd[page_directory_index];
+    if (pde.is_present())
+        return nullptr;
+
+    RefPtr<PhysicalPage> page_table;
+    if (auto it = vmobject.m_shared_page_tables.find(key); it != vmobject.m_shared_page_tables.end()) {
+        page_table = it->value;
+    } else {
+        bool did_purge = false;
+        page_table = allocate_user_physical_page(ShouldZeroFill::Yes, &did_purge);
+        if (!page_table)
+            return nullptr;
+        if (did_purge) {
+            pd = quickmap_pd(page_directory, page_directory_table_index);
+            VERIFY(&pde == &pd[page_directory_index]);
+            VERIFY(!pde.is_present());
+        }
+        vmobject.m_shared_page_tables.set(key, *page_table);
+        is_new = true;
+    }
+
+    // Nothing is ever written through a shared table, keep it that way
+    // even if one of its entries were to say otherwise.
+    pde.set_page_table_base(page_table->paddr().get());
+    pde.set_user_allowed(true);
+    pde.set_present(true);
+    pde.set_writable(false);
+    pde.set_global(false);
+
+    auto result = page_directory.m_page_tables.set(vaddr.get(), page_table);
+    VERIFY(result == Base::HashSetResult::InsertedNewEntry);
+    page_directory.m_shared_page_table_keys.set(vaddr.get(), key);
+
+    return quickmap_pt(page_table->paddr());
+}
+
+bool MemoryManager::release_shared_page_table(PageDirectory& page_directory, VirtualAddress vaddr, SharedInodeVMObject& vmobject)
+{
+    VERIFY_INTERRUPTS_DISABLED();
+    VERIFY(s_mm_lock.own_lock());
+    VERIFY(page_directory.get_lock().own_lock());
+    if (vaddr.get() & 0x1fffff)
+        return false;
+    auto key = page_directory.m_shared_page_table_keys.get(vaddr.get());
+    if (!key.has_value())
+        return false;
+    page_directory.m_shared_page_table_keys.remove(vaddr.get());
+
+    // The entries stay, the others sharing the table still use them.
+    u32 page_directory_table_index = (vaddr.get() >> 30) & 0x1ff;
+    u32 page_directory_index = (vaddr.get() >> 21) & 0x1ff;
+    auto* pd = quickmap_pd(page_directory, page_directory_table_index);
+    pd[page_directory_index].clear();
+    auto result = page_directory.m_page_tables.remove(vaddr.get());
+    VERIFY(result);
+
+    auto it = vmobject.m_shared_page_tables.find(key.value());
+    VERIFY(it != vmobject.m_shared_page_tables.end());
+    if (it->value->ref_count() == 1)
+        vmobject.m_shared_page_tables.remove(it);
+    return true;
+}
+
+PageDirectoryEntry* MemoryManager::ensure_large_pde(PageDirectory& page_directory, VirtualAddress vaddr)
+{
+    VERIFY_INTERRUPTS_DISABLED();
+    VERIFY(s_mm_lock.own_lock());
+    VERIFY(page_directory.get_lock().own_lock());
+    VERIFY(!(vaddr.get() & 0x1fffff));
+    u32 page_directory_table_index = (vaddr.get() >> 30) & 0x1ff;
+    u32 page_directory_index = (vaddr.get() >> 21) & 0x1ff;
+
+    // A page table that is already there may still map other pages.
+    auto* pd = quickmap_pd(page_directory, page_directory_table_index);
+    PageDirectoryEntry& pde = pd[page_directory_index];
+    if (pde.is_present() && !pde.is_huge())
+        return nullptr;
+    return &pde;
+}
+
+void MemoryManager::write_protect_range(PageDirectory& page_directory, VirtualAddress vaddr, size_t page_count)
+{
+    VERIFY_INTERRUPTS_DISABLED();
+    VERIFY(s_mm_lock.own_lock());
+    VERIFY(page_directory.get_lock().own_lock());
+
+    // One page table at a time, there is no need to look up every page.
+    size_t index = 0;
+    while (index < page_count) {
+        auto page_vaddr = vaddr.offset(index * PAGE_SIZE);
+        u32 page_directory_table_index = (page_vaddr.get() >> 30) & 0x1ff;
+        u32 page_directory_index = (page_vaddr.get() >> 21) & 0x1ff;
+        u32 page_table_index = (page_vaddr.get() >> 12) & 0x1ff;
+        size_t count = min(page_count - index, (size_t)(512 - page_table_index));
+
+        auto* pd = quickmap_pd(page_directory, page_directory_table_index);
+        PageDirectoryEntry& pde = pd[page_directory_index];
+        if (pde.is_present() && pde.is_huge()) {
+            pde.set_writable(false);
+        } else if (pde.is_present()) {
+            auto* pt = quickmap_pt(PhysicalAddress((FlatPtr)pde.page_table_base()));
+            for (size_t i = 0; i < count; ++i)
+                pt[page_table_index + i].set_writable(false);
+        }
+        index += count;
+    }
+    flush_tlb(&page_directory, vaddr, page_count);
+}
+
+size_t MemoryManager::clear_accessed_range(PageDirectory& page_directory, VirtualAddress vaddr, size_t page_count, Bitmap* accessed, size_t first_bit)
+{
+    VERIFY_INTERRUPTS_DISABLED();
+    VERIFY(s_mm_lock.own_lock());
+    VERIFY(page_directory.get_lock().own_lock());
+
+    size_t accessed_count = 0;
+    auto mark_accessed = [&](size_t index) {
+        if (accessed)
+            accessed->set(first_bit + index, true);
+        accessed_count++;
+    };
+
+    size_t index = 0;
+    while (index < page_count) {
+        auto page_vaddr = vaddr.offset(index * PAGE_SIZE);
+        u32 page_directory_table_index = (page_vaddr.get() >> 30) & 0x1ff;
+        u32 page_directory_index = (page_vaddr.get() >> 21) & 0x1ff;
+        u32 page_table_index = (page_vaddr.get() >> 12) & 0x1ff;
+        size_t count = min(page_count - index, (size_t)(512 - page_table_index));
+
+        auto* pd = quickmap_pd(page_directory, page_directory_table_index);
+        PageDirectoryEntry& pde = pd[page_directory_index];
+        if (pde.is_present() && pde.is_huge()) {
+            // A large page only has the one bit for all of its pages.
+            if (pde.is_accessed()) {
+                pde.set_accessed(false);
+                for (size_t i = 0; i < count; ++i)
+                    mark_accessed(index + i);
+            }
+        } else if (pde.is_present()) {
+            auto* pt = quickmap_pt(PhysicalAddress((FlatPtr)pde.page_table_base()));
+            for (size_t i = 0; i < count; ++i) {
+                auto& pte = pt[page_table_index + i];
+                if (!pte.is_present() || !pte.is_accessed())
+                    continue;
+                pte.set_accessed(false);
+                mark_accessed(index + i);
+            }
+        }
+        index += count;
+    }
+
+    // The CPU only sets the bit again for translations it doesn't have
+    // cached, so the next access has to miss the TLB.
+    if (accessed_count)
+        flush_tlb(&page_directory, vaddr, page_count);
+    return accessed_count;
+}
+
+bool MemoryManager::split_large_page(PageDirectory& page_directory, VirtualAddress vaddr)
+{
+    VERIFY(s_mm_lock.own_lock());
+    u32 page_directory_table_index = (vaddr.get() >> 30) & 0x1ff;
+    u32 page_directory_index = (vaddr.get() >> 21) & 0x1ff;
+    auto large_page_vaddr = VirtualAddress(vaddr.get() & ~(FlatPtr)0x1fffff);
+
+    auto page_table = allocate_user_physical_page(ShouldZeroFill::No);
+    if (!page_table) {
+        dbgln("MM: Unable to allocate page table to split large page at {}", large_page_vaddr);
+        return false;
+    }
+
+    auto* pd = quickmap_pd(page_directory, page_directory_table_index);
+    PageDirectoryEntry& pde = pd[page_directory_index];
+    VERIFY(pde.is_present() && pde.is_huge());
+
+    // Every 4 KiB page inherits the permissions of the large page.
+    auto* pt = quickmap_pt(page_table->paddr());
+    for (u32 i = 0; i <= 0x1ff; i++) {
+        auto& pte = pt[i];
+        pte.clear();
+        pte.set_physical_page_base(pde.large_page_base() + i * PAGE_SIZE);
+        pte.set_writable(pde.is_writable());
+        pte.set_user_allowed(pde.is_user_allowed());
+        pte.set_write_through(pde.is_write_through());
+        pte.set_cache_disabled(pde.is_cache_disabled());
+        pte.set_execute_disabled(pde.is_execute_disabled());
+        pte.set_global(pde.is_global());
+        pte.set_present(true);
+    }
+
+    pde.clear();
+    pde.set_page_table_base(page_table->paddr().get());
+    pde.set_user_allowed(true);
+    pde.set_present(true);
+    pde.set_writable(true);
+    pde.set_global(&page_directory == m_kernel_page_directory.ptr());
+
+    auto result = page_directory.m_page_tables.set(large_page_vaddr.get(), move(page_table));
+    VERIFY(result == Base::HashSetResult::InsertedNewEntry);
+
+    // Changing the page size of a mapping requires the old entries to go.
+    flush_tlb(&page_directory, large_page_vaddr, 512);
+    return true;
+}
+
 void MemoryManager::release_pte(PageDirectory& page_directory, VirtualAddress vaddr, bool is_last_release)
 {
     VERIFY_INTERRUPTS_DISABLED();
@@ -535,7 +783,11 @@ void MemoryManager::release_pte(PageDirectory& page_directory, VirtualAddress va
 
     auto* pd = quickmap_pd(page_directory, page_directory_table_index);
     PageDirectoryEntry& pde = pd[page_directory_index];
-    if (pde.is_present()) {
+    if (pde.is_present() && pde.is_huge()) {
+        // Large pages are only used for wholly mapped 2 MiB ranges, the
+        // region releasing one of its pages releases all of them.
+        pde.clear();
+    } else if (pde.is_present()) {
         auto* page_table = quickmap_pt(PhysicalAddress((FlatPtr)pde.page_table_base()));
         auto& pte = page_table[page_table_index];
         pte.clear();
@@ -561,13 +813,26 @@ void MemoryManager::release_pte(PageDirectory& page_directory, VirtualAddress va
 
 UNMAP_AFTER_INIT void MemoryManager::initialize(u32 cpu)
 {
+    BootPhase phase("MemoryManager::initialize");
     auto mm_data = new MemoryManagerData;
     Processor::current().set_mm_data(*mm_data);
 
     if (cpu == 0) {
         new MemoryManager;
+        AddressSanitizer::init();
         kmalloc_enable_expand();
+#if ARCH(X86_64)
+        s_the->m_pcid_enabled = CPUID(1).ecx() & (1 << 17);
+#endif
     }
+
+#if ARCH(X86_64)
+    // CR4.PCIDE can only be set while CR3 holds PCID 0, as it does here.
+    if (s_the->m_pcid_enabled)
+        write_cr4(read_cr4() | (1 << 17));
+#endif
+
+    s_the->fill_page_directory_page_cache();
 }
 
 Region* MemoryManager::kernel_region_from_vaddr(VirtualAddress vaddr)
@@ -588,6 +853,8 @@ Region* MemoryManager::find_user_region_from_vaddr_no_lock(Space& space, Virtual
 
 Region* MemoryManager::find_user_region_from_vaddr(Space& space, VirtualAddress vaddr)
 {
+    if (auto* region = space.find_cached_region_containing({ vaddr, 1 }))
+        return region;
     ScopedSpinLock lock(space.get_lock());
     return find_user_region_from_vaddr_no_lock(space, vaddr);
 }
@@ -632,19 +899,32 @@ void MemoryManager::validate_syscall_preconditions(Space& space, RegisterState c
 
 Region* MemoryManager::find_region_from_vaddr(VirtualAddress vaddr)
 {
+    // Faults on user addresses in the current process don't take the global
+    // lock, so threads faulting on their own regions don't serialize.
+    if (is_user_address(vaddr)) {
+        auto* process = Process::current();
+        if (process && process->space().page_directory().cr3() == (read_cr3() & ~PageDirectory::cr3_pcid_mask))
+            return find_user_region_from_vaddr(process->space(), vaddr);
+    }
+
     ScopedSpinLock lock(s_mm_lock);
     if (auto* region = kernel_region_from_vaddr(vaddr))
         return region;
-    auto page_directory = PageDirectory::find_by_cr3(read_cr3());
+    auto page_directory = PageDirectory::find_by_cr3(read_cr3() & ~PageDirectory::cr3_pcid_mask);
     if (!page_directory)
         return nullptr;
     VERIFY(page_directory->space());
     return find_user_region_from_vaddr(*page_directory->space(), vaddr);
 }
 
+static ShardedCounter s_page_fault_count { "page_faults" };
+static LatencyMetric s_page_fault_latency { "page_fault_ns" };
+
 PageFaultResponse MemoryManager::handle_page_fault(PageFault const& fault)
 {
     VERIFY_INTERRUPTS_DISABLED();
+    s_page_fault_count.add();
+    ScopedTimer timer(s_page_fault_latency);
     if (Processor::current().in_irq()) {
         dbgln("CPU[{}] BUG! Page fault while handling IRQ! code={}, vaddr={}, irq level: {}",
             Processor::id(), fault.code(), fault.vaddr(), Processor::current().in_irq());
@@ -654,9 +934,12 @@ PageFaultResponse MemoryManager::handle_page_fault(PageFault const& fault)
     dbgln_if(PAGE_FAULT_DEBUG, "MM: CPU[{}] handle_page_fault({:#04x}) at {}", Processor::id(), fault.code(), fault.vaddr());
     auto* region = find_region_from_vaddr(fault.vaddr());
     if (!region) {
+        TRACE_EVENT(PageFault, fault.vaddr().get(), fault.code(), PageFaultResponse::ShouldCrash);
         return PageFaultResponse::ShouldCrash;
     }
-    return region->handle_fault(fault);
+    auto response = region->handle_fault(fault);
+    TRACE_EVENT(PageFault, fault.vaddr().get(), fault.code(), response);
+    return response;
 }
 
 OwnPtr<Region> MemoryManager::allocate_contiguous_kernel_region(size_t size, StringView name, Region::Access access, Region::Cacheable cacheable)
@@ -674,6 +957,19 @@ OwnPtr<Region> MemoryManager::allocate_contiguous_kernel_region(size_t size, Str
     return allocate_kernel_region_with_vmobject(range.value(), *vmobject, name, access, cacheable);
 }
 
+// Regions of 2 MiB or more are placed on a 2 MiB boundary when there's room,
+// so Region::map() can use large pages for them.
+Optional<Range> MemoryManager::allocate_kernel_range(size_t size, PhysicalAddress paddr)
+{
+    VERIFY(s_mm_lock.own_lock());
+    constexpr size_t large_page_size = 2 * MiB;
+    if (size >= large_page_size && !(paddr.get() % large_page_size)) {
+        if (auto range = kernel_page_directory().range_allocator().allocate_anywhere(size, large_page_size); range.has_value())
+            return range;
+    }
+    return kernel_page_directory().range_allocator().allocate_anywhere(size);
+}
+
 OwnPtr<Region> MemoryManager::allocate_kernel_region(size_t size, StringView name, Region::Access access, AllocationStrategy strategy, Region::Cacheable cacheable)
 {
     VERIFY(!(size % PAGE_SIZE));
@@ -681,7 +977,7 @@ OwnPtr<Region> MemoryManager::allocate_kernel_region(size_t size, StringView nam
     if (!vm_object)
         return {};
     ScopedSpinLock lock(s_mm_lock);
-    auto range = kernel_page_directory().range_allocator().allocate_anywhere(size);
+    auto range = allocate_kernel_range(size);
     if (!range.has_value())
         return {};
     return allocate_kernel_region_with_vmobject(range.value(), vm_object.release_nonnull(), name, access, cacheable);
@@ -694,12 +990,30 @@ OwnPtr<Region> MemoryManager::allocate_kernel_region(PhysicalAddress paddr, size
         return {};
     VERIFY(!(size % PAGE_SIZE));
     ScopedSpinLock lock(s_mm_lock);
-    auto range = kernel_page_directory().range_allocator().allocate_anywhere(size);
+    auto range = allocate_kernel_range(size, paddr);
     if (!range.has_value())
         return {};
     return allocate_kernel_region_with_vmobject(range.value(), *vm_object, name, access, cacheable);
 }
 
+OwnPtr<Region> MemoryManager::allocate_kernel_region(PhysicalAddress paddr, size_t size, StringView name, Region::Access access, MemoryType memory_type)
+{
+    auto vm_object = AnonymousVMObject::try_create_for_physical_range(paddr, size);
+    if (!vm_object)
+        return {};
+    VERIFY(!(size % PAGE_SIZE));
+    ScopedSpinLock lock(s_mm_lock);
+    auto range = allocate_kernel_range(size, paddr);
+    if (!range.has_value())
+        return {};
+    auto region = Region::try_create_kernel_only(range.value(), *vm_object, 0, KString::try_create(name), access, Region::Cacheable::No);
+    if (region) {
+        region->set_memory_type(memory_type);
+        region->map(kernel_page_directory());
+    }
+    return region;
+}
+
 OwnPtr<Region> MemoryManager::allocate_kernel_region_identity(PhysicalAddress paddr, size_t size, StringView name, Region::Access access, Region::Cacheable cacheable)
 {
     auto vm_object = AnonymousVMObject::try_create_for_physical_range(paddr, size);
@@ -717,8 +1031,10 @@ OwnPtr<Region> MemoryManager::allocate_kernel_region_with_vmobject(Range const&
 {
     ScopedSpinLock lock(s_mm_lock);
     auto region = Region::try_create_kernel_only(range, vmobject, 0, KString::try_create(name), access, cacheable);
-    if (region)
+    if (region) {
         region->map(kernel_page_directory());
+        AddressSanitizer::populate_shadow(region->vaddr().get(), region->size());
+    }
     return region;
 }
 
@@ -736,6 +1052,8 @@ bool MemoryManager::commit_user_physical_pages(size_t page_count)
 {
     VERIFY(page_count > 0);
     ScopedSpinLock lock(s_mm_lock);
+    if (m_system_memory_info.user_physical_pages_uncommitted < page_count)
+        drain_user_physical_page_caches();
     if (m_system_memory_info.user_physical_pages_uncommitted < page_count)
         return false;
 
@@ -756,6 +1074,9 @@ void MemoryManager::uncommit_user_physical_pages(size_t page_count)
 
 void MemoryManager::deallocate_physical_page(PhysicalAddress paddr)
 {
+    if (cache_user_physical_page(paddr))
+        return;
+
     ScopedSpinLock lock(s_mm_lock);
 
     for (auto& region : m_user_physical_regions) {
@@ -783,7 +1104,91 @@ void MemoryManager::deallocate_physical_page(PhysicalAddress paddr)
     PANIC("MM: deallocate_user_physical_page couldn't figure out region for page @ {}", paddr);
 }
 
-RefPtr<PhysicalPage> MemoryManager::find_free_user_physical_page(bool committed)
+UNMAP_AFTER_INIT void MemoryManager::initialize_numa_nodes()
+{
+    auto* acpi_parser = ACPI::Parser::the();
+    if (!acpi_parser)
+        return;
+
+    ScopedSpinLock lock(s_mm_lock);
+    acpi_parser->enumerate_memory_affinity([&](u32 proximity_domain, PhysicalAddress base, u64 length) {
+        auto numa_node = numa_node_for_proximity_domain(proximity_domain);
+        if (!numa_node.has_value())
+            return;
+        for (auto& region : m_user_physical_regions)
+            region.set_numa_node(base, length, numa_node.value());
+    });
+    acpi_parser->enumerate_processor_affinity([&](u32 proximity_domain, u32 apic_id) {
+        auto numa_node = numa_node_for_proximity_domain(proximity_domain);
+        if (numa_node.has_value())
+            m_apic_id_numa_nodes.set(apic_id, numa_node.value());
+    });
+
+    if (m_numa_node_count > 1) {
+        for (auto& node : get_numa_node_info())
+            dmesgln("MM: NUMA node with proximity domain {}: {} KiB of user memory", node.proximity_domain, node.user_physical_pages * PAGE_SIZE / KiB);
+    }
+}
+
+u32 MemoryManager::current_numa_node()
+{
+    VERIFY_INTERRUPTS_DISABLED();
+    if (m_numa_node_count <= 1 || !Processor::is_initialized())
+        return 0;
+    auto& data = get_data();
+    if (!data.m_numa_node_known) {
+        u32 apic_id = CPUID(1).ebx() >> 24;
+        data.m_numa_node = m_apic_id_numa_nodes.get(apic_id).value_or(0);
+        data.m_numa_node_known = true;
+    }
+    return data.m_numa_node;
+}
+
+Vector<MemoryManager::NumaNodeInfo> MemoryManager::get_numa_node_info()
+{
+    ScopedSpinLock lock(s_mm_lock);
+    Vector<NumaNodeInfo> nodes;
+    for (u32 numa_node = 0; numa_node < numa_node_count(); ++numa_node) {
+        NumaNodeInfo info;
+        info.proximity_domain = m_numa_proximity_domains[numa_node];
+        for (auto& region : m_user_physical_regions) {
+            info.user_physical_pages += region.page_count_in_numa_node(numa_node);
+            info.user_physical_pages_free += region.free_pages_in_numa_node(numa_node);
+        }
+        nodes.append(info);
+    }
+    return nodes;
+}
+
+RefPtr<PhysicalPage> MemoryManager::take_free_user_physical_page()
+{
+    // The processor's own node first, any other one after that.
+    auto numa_node = current_numa_node();
+    for (auto& region : m_user_physical_regions) {
+        if (auto page = region.take_free_page(numa_node))
+            return page;
+    }
+    for (auto& region : m_user_physical_regions) {
+        if (auto page = region.take_free_page())
+            return page;
+    }
+    return {};
+}
+
+Optional<u32> MemoryManager::numa_node_for_proximity_domain(u32 proximity_domain)
+{
+    for (u32 numa_node = 0; numa_node < m_numa_node_count; ++numa_node) {
+        if (m_numa_proximity_domains[numa_node] == proximity_domain)
+            return numa_node;
+    }
+    if (m_numa_node_count == PhysicalRegion::max_numa_nodes) {
+        dmesgln("MM: Too many NUMA nodes, treating proximity domain {} as local to everything", proximity_domain);
+        return {};
+    }
+    m_numa_proximity_domains[m_numa_node_count] = proximity_domain;
+    return m_numa_node_count++;
+}
+
 {
     VERIFY(s_mm_lock.is_locked());
     RefPtr<PhysicalPage> page;
@@ -791,17 +1196,28 @@ RefPtr<PhysicalPage> MemoryManager::find_free_user_physical_page(bool committed)
         VERIFY(m_system_memory_info.user_physical_pages_committed > 0);
         m_system_memory_info.user_physical_pages_committed--;
     } else {
-        if (m_system_memory_info.user_physical_pages_uncommitted == 0)
+        if (m_system_memory_info.user_physical_pages_uncommitted == 0 && !drain_user_physical_page_caches())
             return {};
         m_system_memory_info.user_physical_pages_uncommitted--;
     }
-    for (auto& region : m_user_physical_regions) {
-        page = region.take_free_page();
-        if (!page.is_null()) {
-            ++m_system_memory_info.user_physical_pages_used;
-            break;
+
+    if (should_zero_fill == ShouldZeroFill::Yes && m_zeroed_page_count) {
+        page = move(m_zeroed_pages[--m_zeroed_page_count]);
+    } else {
+        page = take_free_user_physical_page();
+
+        // Pages in the zeroed pool are still free as far as the accounting
+        // goes, so they are handed out once the regions run dry.
+        if (!page && m_zeroed_page_count) {
+            page = move(m_zeroed_pages[--m_zeroed_page_count]);
+        } else if (page && should_zero_fill == ShouldZeroFill::Yes) {
+            zero_page(quickmap_page(*page));
+            unquickmap_page();
         }
     }
+
+    if (page)
+        ++m_system_memory_info.user_physical_pages_used;
     VERIFY(!committed || !page.is_null());
     return page;
 }
@@ -809,50 +1225,698 @@ RefPtr<PhysicalPage> MemoryManager::find_free_user_physical_page(bool committed)
 NonnullRefPtr<PhysicalPage> MemoryManager::allocate_committed_user_physical_page(ShouldZeroFill should_zero_fill)
 {
     ScopedSpinLock lock(s_mm_lock);
-    auto page = find_free_user_physical_page(true);
-    if (should_zero_fill == ShouldZeroFill::Yes) {
-        auto* ptr = quickmap_page(*page);
-        memset(ptr, 0, PAGE_SIZE);
-        unquickmap_page();
-    }
+    auto page = find_free_user_physical_page(true, should_zero_fill);
     return page.release_nonnull();
 }
 
+void MemoryManager::allocate_committed_user_physical_pages(Span<RefPtr<PhysicalPage>> pages, ShouldZeroFill should_zero_fill)
+{
+    constexpr size_t batch_size = UserPhysicalPageCache::batch;
+    size_t index = 0;
+    while (index < pages.size()) {
+        PhysicalAddress batch[batch_size];
+        size_t wanted = min(batch_size, pages.size() - index);
+        size_t taken = 0;
+        {
+            ScopedSpinLock lock(s_mm_lock);
+            VERIFY(m_system_memory_info.user_physical_pages_committed >= wanted);
+            auto numa_node = current_numa_node();
+            for (auto& region : m_user_physical_regions) {
+                if (taken == wanted)
+                    break;
+                taken += region.take_free_pages(batch + taken, wanted - taken, numa_node);
+            }
+            for (auto& region : m_user_physical_regions) {
+                if (taken == wanted)
+                    break;
+                taken += region.take_free_pages(batch + taken, wanted - taken);
+            }
+            m_system_memory_info.user_physical_pages_committed -= taken;
+            m_system_memory_info.user_physical_pages_used += taken;
+        }
+
+        // Clearing happens without the lock, a page at a time.
+        for (size_t i = 0; i < taken; ++i) {
+            auto page = PhysicalPage::create(batch[i]);
+            if (should_zero_fill == ShouldZeroFill::Yes) {
+                InterruptDisabler disabler;
+                zero_page(quickmap_page(*page), PageTemporality::Cold);
+                unquickmap_page();
+            }
+            pages[index++] = move(page);
+        }
+
+        // The rest of the committed pages sit in the zeroed pool or in
+        // a processor's cache, those are picked up one by one.
+        if (taken < wanted)
+            pages[index++] = allocate_committed_user_physical_page(should_zero_fill);
+    }
+}
+
+NonnullRefPtrVector<PhysicalPage> MemoryManager::allocate_committed_user_physical_large_page(ShouldZeroFill should_zero_fill)
+{
+    constexpr size_t page_count = (2 * MiB) / PAGE_SIZE;
+
+    ScopedSpinLock lock(s_mm_lock);
+    VERIFY(m_system_memory_info.user_physical_pages_committed >= page_count);
+
+    auto take_free_large_page = [&]() -> Optional<PhysicalAddress> {
+        for (auto& region : m_user_physical_regions) {
+            if (auto page_base = region.take_free_large_page(); page_base.has_value())
+                return page_base;
+        }
+        return {};
+    };
+    auto page_base = take_free_large_page();
+    if (!page_base.has_value() && compact_user_physical_memory(9))
+        page_base = take_free_large_page();
+    if (!page_base.has_value())
+        return {};
+
+    m_system_memory_info.user_physical_pages_committed -= page_count;
+    m_system_memory_info.user_physical_pages_used += page_count;
+
+    NonnullRefPtrVector<PhysicalPage> physical_pages;
+    physical_pages.ensure_capacity(page_count);
+    for (size_t i = 0; i < page_count; ++i) {
+        auto page = PhysicalPage::create(page_base.value().offset(i * PAGE_SIZE));
+        if (should_zero_fill == ShouldZeroFill::Yes) {
+            zero_page(quickmap_page(*page), PageTemporality::Cold);
+            unquickmap_page();
+        }
+        physical_pages.append(move(page));
+    }
+    return physical_pages;
+}
+
+RefPtr<PhysicalPage> MemoryManager::take_cached_user_physical_page()
+{
+    InterruptDisabler disabler;
+    if (!Processor::is_initialized())
+        return {};
+
+    auto& cache = get_data().m_user_page_cache;
+    {
+        ScopedSpinLock lock(cache.lock);
+        if (cache.count)
+            return PhysicalPage::create(cache.pages[--cache.count]);
+    }
+
+    PhysicalAddress pages[UserPhysicalPageCache::batch];
+    size_t taken = 0;
+    {
+        ScopedSpinLock lock(s_mm_lock);
+        size_t wanted = min(UserPhysicalPageCache::batch, (size_t)m_system_memory_info.user_physical_pages_uncommitted);
+        auto numa_node = current_numa_node();
+        for (auto& region : m_user_physical_regions) {
+            if (taken == wanted)
+                break;
+            taken += region.take_free_pages(pages + taken, wanted - taken, numa_node);
+        }
+        for (auto& region : m_user_physical_regions) {
+            if (taken == wanted)
+                break;
+            taken += region.take_free_pages(pages + taken, wanted - taken);
+        }
+        m_system_memory_info.user_physical_pages_uncommitted -= taken;
+        m_system_memory_info.user_physical_pages_used += taken;
+    }
+    if (!taken)
+        return {};
+
+    // Nothing else fills this processor's cache while interrupts are
+    // disabled, so the rest of the batch always fits.
+    auto paddr = pages[--taken];
+    ScopedSpinLock lock(cache.lock);
+    VERIFY(cache.count + taken <= UserPhysicalPageCache::capacity);
+    while (taken)
+        cache.pages[cache.count++] = pages[--taken];
+    return PhysicalPage::create(paddr);
+}
+
+bool MemoryManager::cache_user_physical_page(PhysicalAddress paddr)
+{
+    // The user regions don't change after boot, they can be searched
+    // without holding the lock.
+    bool is_user_page = false;
+    for (auto& region : m_user_physical_regions) {
+        if (region.contains(paddr)) {
+            is_user_page = true;
+            break;
+        }
+    }
+    if (!is_user_page)
+        return false;
+
+    InterruptDisabler disabler;
+    if (!Processor::is_initialized())
+        return false;
+
+    auto& cache = get_data().m_user_page_cache;
+    PhysicalAddress pages[UserPhysicalPageCache::batch];
+    size_t drained = 0;
+    {
+        ScopedSpinLock lock(cache.lock);
+        if (cache.count == UserPhysicalPageCache::capacity) {
+            while (drained < UserPhysicalPageCache::batch)
+                pages[drained++] = cache.pages[--cache.count];
+        }
+        cache.pages[cache.count++] = paddr;
+    }
+    if (drained)
+        return_user_physical_pages(pages, drained);
+    return true;
+}
+
+void MemoryManager::return_user_physical_pages(PhysicalAddress const* pages, size_t count)
+{
+    ScopedSpinLock lock(s_mm_lock);
+    for (size_t i = 0; i < count; i++) {
+        bool returned = false;
+        for (auto& region : m_user_physical_regions) {
+            if (region.contains(pages[i])) {
+                region.return_page(pages[i]);
+                returned = true;
+                break;
+            }
+        }
+        VERIFY(returned);
+    }
+    VERIFY(m_system_memory_info.user_physical_pages_used >= count);
+    m_system_memory_info.user_physical_pages_used -= count;
+    m_system_memory_info.user_physical_pages_uncommitted += count;
+}
+
+// Makes room for a block of 2^order pages by moving the user pages in the
+// way somewhere else. Only blocks that are free apart from movable pages
+// are considered, and of those the one that needs the fewest moves.
+bool MemoryManager::compact_user_physical_memory(size_t order)
+{
+    VERIFY(s_mm_lock.own_lock());
+    PhysicalPtr block_size = PAGE_SIZE << order;
+    size_t pages_per_block = 1u << order;
+
+    drain_user_physical_page_caches();
+
+    HashMap<PhysicalPtr, size_t> movable_pages_per_block;
+    for_each_vmobject([&](auto& vmobject) {
+        if (!vmobject.is_anonymous())
+            return;
+        auto& anonymous_vmobject = static_cast<AnonymousVMObject&>(vmobject);
+        ScopedSpinLock lock(anonymous_vmobject.m_lock);
+        for (size_t i = 0; i < anonymous_vmobject.page_count(); ++i) {
+            if (anonymous_vmobject.is_page_movable(i))
+                movable_pages_per_block.ensure(anonymous_vmobject.physical_pages()[i]->paddr().get() & ~(block_size - 1))++;
+        }
+    });
+
+    Optional<PhysicalPtr> best_block;
+    size_t best_move_count = pages_per_block;
+    for (auto& it : movable_pages_per_block) {
+        if (it.value >= best_move_count || it.value > m_system_memory_info.user_physical_pages_uncommitted)
+            continue;
+        for (auto& region : m_user_physical_regions) {
+            if (!region.contains(PhysicalAddress(it.key)))
+                continue;
+            auto free_pages = region.free_pages_in_block(PhysicalAddress(it.key), order);
+            if (free_pages.has_value() && free_pages.value() + it.value == pages_per_block) {
+                best_block = it.key;
+                best_move_count = it.value;
+            }
+            break;
+        }
+    }
+    if (!best_block.has_value())
+        return false;
+
+    auto block_base = best_block.value();
+    auto block_contains = [&](PhysicalPage const& page) {
+        return page.paddr().get() >= block_base && page.paddr().get() < block_base + block_size;
+    };
+
+    // New pages that land in the block itself are held on to until the
+    // block is cleared, so they aren't handed out again right away.
+    NonnullRefPtrVector<PhysicalPage> pages_in_block;
+    bool moved_everything = true;
+    for_each_vmobject([&](auto& vmobject) {
+        if (!moved_everything || !vmobject.is_anonymous())
+            return;
+        auto& anonymous_vmobject = static_cast<AnonymousVMObject&>(vmobject);
+        ScopedSpinLock lock(anonymous_vmobject.m_lock);
+        for (size_t i = 0; i < anonymous_vmobject.page_count() && moved_everything; ++i) {
+            if (!anonymous_vmobject.is_page_movable(i) || !block_contains(*anonymous_vmobject.physical_pages()[i]))
+                continue;
+            RefPtr<PhysicalPage> new_page;
+            while ((new_page = find_free_user_physical_page(false, ShouldZeroFill::No)) && block_contains(*new_page))
+                pages_in_block.append(new_page.release_nonnull());
+            if (!new_page) {
+                moved_everything = false;
+                break;
+            }
+            anonymous_vmobject.migrate_page(i, new_page.release_nonnull());
+        }
+    });
+    pages_in_block.clear();
+
+    // The pages that were moved away from went into this processor's cache.
+    drain_user_physical_page_caches();
+    dbgln_if(PAGE_FAULT_DEBUG, "MM: Compaction moved {} pages out of {}", best_move_count, PhysicalAddress(block_base));
+    return moved_everything;
+}
+
+size_t MemoryManager::drain_user_physical_page_caches()
+{
+    VERIFY(s_mm_lock.is_locked());
+    size_t count = 0;
+    Processor::for_each([&](Processor& processor) {
+        auto& cache = processor.get_mm_data().m_user_page_cache;
+        ScopedSpinLock lock(cache.lock);
+        return_user_physical_pages(cache.pages, cache.count);
+        count += cache.count;
+        cache.count = 0;
+    });
+    return count;
+}
+
 RefPtr<PhysicalPage> MemoryManager::allocate_user_physical_page(ShouldZeroFill should_zero_fill, bool* did_purge)
 {
+    // Zero-filled pages are taken from the zeroed pool while it has any,
+    // everything else comes from this processor's cache when it can.
+    if (should_zero_fill == ShouldZeroFill::No || !m_zeroed_page_count) {
+        if (auto page = take_cached_user_physical_page()) {
+            if (should_zero_fill == ShouldZeroFill::Yes) {
+                InterruptDisabler disabler;
+                zero_page(quickmap_page(*page));
+                unquickmap_page();
+            }
+            if (did_purge)
+                *did_purge = false;
+            return page;
+        }
+    }
+
     ScopedSpinLock lock(s_mm_lock);
-    auto page = find_free_user_physical_page(false);
+    auto page = find_free_user_physical_page(false, should_zero_fill);
     bool purged_pages = false;
 
     if (!page) {
-        for_each_vmobject([&](auto& vmobject) {
-            if (!vmobject.is_anonymous())
-                return IterationDecision::Continue;
-            int purged_page_count = static_cast<AnonymousVMObject&>(vmobject).purge();
-            if (purged_page_count) {
-                dbgln("MM: Purge saved the day! Purged {} pages from AnonymousVMObject", purged_page_count);
-                page = find_free_user_physical_page(false);
-                purged_pages = true;
-                VERIFY(page);
-                return IterationDecision::Break;
-            }
-            return IterationDecision::Continue;
-        });
+        // The reclaim thread didn't keep up, do its job right here. Stale
+        // page cache is no reason to fail, even recently used clean pages
+        // go before we give up.
+        if (auto reclaimed_page_count = reclaim_pages(UserPhysicalPageCache::batch, true, &purged_pages)) {
+            dbgln("MM: Reclaim saved the day! Reclaimed {} pages", reclaimed_page_count);
+            page = find_free_user_physical_page(false, should_zero_fill);
+        }
+        if (!page && slab_alloc_reclaim()) {
+            dbgln("MM: Gave back free slab pages");
+            page = find_free_user_physical_page(false, should_zero_fill);
+        }
         if (!page) {
             dmesgln("MM: no user physical pages available");
+            update_memory_pressure_level();
             return {};
         }
     }
 
-    if (should_zero_fill == ShouldZeroFill::Yes) {
-        auto* ptr = quickmap_page(*page);
-        memset(ptr, 0, PAGE_SIZE);
+    if (did_purge)
+        *did_purge = purged_pages;
+    return page;
+}
+
+RefPtr<PhysicalPage> MemoryManager::take_page_directory_page()
+{
+    {
+        InterruptDisabler disabler;
+        auto& cache = get_data().m_page_directory_page_cache;
+        if (cache.count)
+            return move(cache.pages[--cache.count]);
+    }
+    return allocate_user_physical_page(ShouldZeroFill::Yes);
+}
+
+void MemoryManager::recycle_page_directory_page(RefPtr<PhysicalPage>&& page)
+{
+    if (!page || page->ref_count() != 1)
+        return;
+
+    InterruptDisabler disabler;
+    auto& cache = get_data().m_page_directory_page_cache;
+    if (cache.count == PageDirectoryPageCache::capacity)
+        return;
+    // Most of these pages are all zeroes but for a few entries. The next
+    // process to use them should find them in the cache.
+    zero_page(quickmap_page(*page));
+    unquickmap_page();
+    cache.pages[cache.count++] = move(page);
+}
+
+void MemoryManager::fill_page_directory_page_cache()
+{
+    // Half full, for the first processes created on this processor; the
+    // rest fills up as address spaces go away.
+    for (size_t i = 0; i < PageDirectoryPageCache::capacity / 2; ++i) {
+        auto page = allocate_user_physical_page(ShouldZeroFill::Yes);
+        if (!page)
+            return;
+        InterruptDisabler disabler;
+        auto& cache = get_data().m_page_directory_page_cache;
+        if (cache.count == PageDirectoryPageCache::capacity)
+            return;
+        cache.pages[cache.count++] = move(page);
+    }
+}
+
+bool MemoryManager::replenish_zeroed_pages(size_t max_count)
+{
+    for (size_t i = 0; i < max_count; i++) {
+        // One page per lock hold, so a fault on another processor never
+        // waits for more than a single memset.
+        ScopedSpinLock lock(s_mm_lock);
+        if (m_zeroed_page_count == zeroed_page_pool_size)
+            return false;
+
+        RefPtr<PhysicalPage> page;
+        for (auto& region : m_user_physical_regions) {
+            page = region.take_free_page();
+            if (!page.is_null())
+                break;
+        }
+        if (!page)
+            return false;
+
+        // Nobody is waiting for these, keep them out of the caches.
+        zero_page(quickmap_page(*page), PageTemporality::Cold);
         unquickmap_page();
+        m_zeroed_pages[m_zeroed_page_count++] = move(page);
+    }
+    return true;
+}
+
+UNMAP_AFTER_INIT void MemoryManager::start_page_reclaim_thread()
+{
+    RefPtr<Thread> page_reclaim_thread;
+    Process::create_kernel_process(page_reclaim_thread, "PageReclaim", [] {
+        for (;;) {
+            MM.balance_free_pages();
+            (void)Thread::current()->sleep(Time::from_seconds(1));
+        }
+    });
+}
+
+void MemoryManager::balance_free_pages()
+{
+    age_pages();
+    CompressedPageStore::the().shrink();
+
+    // The low watermark is 1/64th of user memory, the high one twice that.
+    ScopedSpinLock lock(s_mm_lock);
+    size_t low_watermark = m_system_memory_info.user_physical_pages / 64;
+    size_t high_watermark = low_watermark * 2;
+    size_t free_pages = m_system_memory_info.user_physical_pages_uncommitted;
+    size_t swap_page_count = 0;
+    if (free_pages < low_watermark) {
+        auto reclaimed_page_count = reclaim_pages(high_watermark - free_pages, false);
+        dbgln_if(PAGE_FAULT_DEBUG, "MM: Below the low watermark with {} free pages, reclaimed {}", free_pages, reclaimed_page_count);
+
+        free_pages = m_system_memory_info.user_physical_pages_uncommitted;
+        if (free_pages < high_watermark) {
+            auto compressed_page_count = compress_inactive_pages(high_watermark - free_pages);
+            dbgln_if(PAGE_FAULT_DEBUG, "MM: Still {} free pages, compressed {}", free_pages, compressed_page_count);
+        }
+
+        free_pages = m_system_memory_info.user_physical_pages_uncommitted;
+        if (free_pages < high_watermark)
+            swap_page_count = high_watermark - free_pages;
     }
+    update_memory_pressure_level();
 
+    // Writing pages out blocks, which can't be done with s_mm_lock held.
+    if (swap_page_count && SwapArea::active()) {
+        lock.unlock();
+        auto swapped_page_count = swap_out_inactive_pages(swap_page_count);
+        dbgln_if(PAGE_FAULT_DEBUG, "MM: Still {} free pages, swapped out {}", free_pages, swapped_page_count);
+        lock.lock();
+        update_memory_pressure_level();
+    }
+}
+
+MemoryPressureEvent MemoryManager::memory_pressure_event()
+{
+    ScopedSpinLock lock(s_mm_lock);
+    return memory_pressure_event_no_lock();
+}
+
+MemoryPressureEvent MemoryManager::memory_pressure_event_no_lock() const
+{
+    VERIFY(s_mm_lock.own_lock());
+    size_t low_watermark = m_system_memory_info.user_physical_pages / 64;
+    size_t high_watermark = low_watermark * 2;
+    size_t free_pages = m_system_memory_info.user_physical_pages_uncommitted;
+
+    MemoryPressureEvent event;
+    if (free_pages < low_watermark / 2)
+        event.level = MemoryPressureEvent::Level::Critical;
+    else if (free_pages < low_watermark)
+        event.level = MemoryPressureEvent::Level::Medium;
+    else if (free_pages < high_watermark)
+        event.level = MemoryPressureEvent::Level::Low;
+    event.free_pages = free_pages;
+    event.total_pages = m_system_memory_info.user_physical_pages;
+    return event;
+}
+
+void MemoryManager::update_memory_pressure_level()
+{
+    VERIFY(s_mm_lock.own_lock());
+    auto event = memory_pressure_event_no_lock();
+    if (event.level == m_memory_pressure_level)
+        return;
+    dbgln_if(PAGE_FAULT_DEBUG, "MM: Memory pressure level {} with {} free pages", (u32)event.level, (u64)event.free_pages);
+    m_memory_pressure_level = event.level;
+
+    // Waking the watchers can't be done with s_mm_lock held.
+    Processor::deferred_call_queue([event] {
+        MemoryPressureWatcher::notify_all(event);
+    });
+}
+
+void MemoryManager::age_pages()
+{
+    for_each_vmobject([&](auto& vmobject) {
+        if (vmobject.is_inode())
+            static_cast<InodeVMObject&>(vmobject).age_pages();
+        else if (vmobject.is_anonymous())
+            static_cast<AnonymousVMObject&>(vmobject).age_pages();
+        return IterationDecision::Continue;
+    });
+}
+
+size_t MemoryManager::reclaim_pages(size_t page_count, bool include_active_pages, bool* did_purge)
+{
+    ScopedSpinLock lock(s_mm_lock);
+    size_t reclaimed_page_count = 0;
+    bool purged_pages = false;
+
+    // Inactive clean file pages go first, nobody touched them for a while
+    // and they can always be read back in.
+    auto release_clean_pages = [&](bool include_active) {
+        for_each_vmobject([&](auto& vmobject) {
+            if (reclaimed_page_count >= page_count)
+                return IterationDecision::Break;
+            if (vmobject.is_inode())
+                reclaimed_page_count += static_cast<InodeVMObject&>(vmobject).release_inactive_clean_pages(page_count - reclaimed_page_count, include_active);
+            return IterationDecision::Continue;
+        });
+    };
+    release_clean_pages(false);
+
+    // Then volatile memory, whatever was used least recently first.
+    if (reclaimed_page_count < page_count) {
+        Vector<AnonymousVMObject*, 16> volatile_vmobjects;
+        for_each_vmobject([&](auto& vmobject) {
+            if (!vmobject.is_anonymous())
+                return;
+            auto& anonymous_vmobject = static_cast<AnonymousVMObject&>(vmobject);
+            if (anonymous_vmobject.is_any_volatile())
+                volatile_vmobjects.append(&anonymous_vmobject);
+        });
+        quick_sort(volatile_vmobjects, [](auto* a, auto* b) {
+            return a->idle_sweeps() > b->idle_sweeps();
+        });
+        for (auto* vmobject : volatile_vmobjects) {
+            if (reclaimed_page_count >= page_count)
+                break;
+            if (auto purged_page_count = vmobject->purge()) {
+                reclaimed_page_count += purged_page_count;
+                purged_pages = true;
+            }
+        }
+    }
+
+    if (include_active_pages && reclaimed_page_count < page_count)
+        release_clean_pages(true);
+
+    // The pages we let go of may be sitting in this processor's cache.
+    if (reclaimed_page_count)
+        drain_user_physical_page_caches();
     if (did_purge)
         *did_purge = purged_pages;
-    return page;
+    return reclaimed_page_count;
+}
+
+// Unlike reclaiming, this doesn't run when an allocation fails: the store
+// grows its pool with allocations of its own.
+size_t MemoryManager::compress_inactive_pages(size_t page_count)
+{
+    VERIFY(s_mm_lock.own_lock());
+    size_t compressed_page_count = 0;
+    for_each_vmobject([&](auto& vmobject) {
+        if (compressed_page_count >= page_count)
+            return IterationDecision::Break;
+        if (vmobject.is_anonymous())
+            compressed_page_count += static_cast<AnonymousVMObject&>(vmobject).compress_inactive_pages(page_count - compressed_page_count);
+        return IterationDecision::Continue;
+    });
+
+    // The pages we let go of may be sitting in this processor's cache.
+    if (compressed_page_count)
+        drain_user_physical_page_caches();
+    return compressed_page_count;
+}
+
+size_t MemoryManager::swap_out_inactive_pages(size_t page_count)
+{
+    VERIFY(!s_mm_lock.own_lock());
+    auto* swap_area = SwapArea::active();
+    if (!swap_area)
+        return 0;
+
+    // Whatever was used least recently goes first. The objects are
+    // collected up front, writing them out can't be done inside the walk.
+    NonnullRefPtrVector<AnonymousVMObject> vmobjects;
+    for_each_vmobject([&](auto& vmobject) {
+        if (vmobject.is_anonymous() && vmobject.try_ref())
+            vmobjects.append(adopt_ref(static_cast<AnonymousVMObject&>(vmobject)));
+        return IterationDecision::Continue;
+    });
+    quick_sort(vmobjects, [](auto& a, auto& b) {
+        return a.idle_sweeps() > b.idle_sweeps();
+    });
+
+    size_t swapped_page_count = 0;
+    for (auto& vmobject : vmobjects) {
+        if (swapped_page_count >= page_count || !swap_area->free_slot_count())
+            break;
+        swapped_page_count += vmobject.swap_out_inactive_pages(*swap_area, page_count - swapped_page_count);
+    }
+
+    if (swapped_page_count) {
+        ScopedSpinLock lock(s_mm_lock);
+        drain_user_physical_page_caches();
+    }
+    return swapped_page_count;
+}
+
+bool MemoryManager::merge_identical_pages(size_t max_pages)
+{
+    ScopedSpinLock lock(s_mm_lock);
+
+    // A pass picks up where the last call left off, or starts over if the
+    // VMObject it was looking at went away.
+    VMObject* resume_vmobject = m_merge_scan_vmobject.unsafe_ptr();
+    size_t scanned_pages = 0;
+    for (auto& vmobject : m_vmobjects) {
+        size_t first_page_index = 0;
+        if (resume_vmobject) {
+            if (&vmobject != resume_vmobject)
+                continue;
+            resume_vmobject = nullptr;
+            first_page_index = m_merge_scan_page_index;
+        }
+        if (!vmobject.is_anonymous())
+            continue;
+        auto& anonymous_vmobject = static_cast<AnonymousVMObject&>(vmobject);
+        ScopedSpinLock vmobject_lock(anonymous_vmobject.m_lock);
+        for (size_t i = first_page_index; i < anonymous_vmobject.page_count(); ++i) {
+            if (scanned_pages++ == max_pages) {
+                m_merge_scan_vmobject = anonymous_vmobject.make_weak_ptr();
+                m_merge_scan_page_index = i;
+                return true;
+            }
+            merge_page_if_identical(anonymous_vmobject, i);
+        }
+    }
+
+    m_system_memory_info.user_physical_pages_merged = m_merge_scan_merged_slots - m_merge_scan_merged_pages.size();
+    m_merge_candidates.clear();
+    m_merge_scan_vmobject = nullptr;
+    m_merge_scan_page_index = 0;
+    m_merge_scan_merged_slots = 0;
+    m_merge_scan_merged_pages.clear();
+    return false;
+}
+
+void MemoryManager::merge_page_if_identical(AnonymousVMObject& vmobject, size_t page_index)
+{
+    VERIFY(s_mm_lock.own_lock());
+    VERIFY(vmobject.m_lock.own_lock());
+    if (!vmobject.is_page_mergeable(page_index))
+        return;
+
+    NonnullRefPtr<PhysicalPage> page = *vmobject.physical_pages()[page_index];
+    if (page->is_merged()) {
+        m_merge_scan_merged_slots++;
+        m_merge_scan_merged_pages.set(page->paddr().get());
+    }
+
+    u32 hash = string_hash((char const*)quickmap_page(*page), PAGE_SIZE);
+    unquickmap_page();
+
+    auto remember_page = [&] {
+        m_merge_candidates.set(hash, { vmobject.make_weak_ptr(), page_index, page->paddr() });
+    };
+
+    auto it = m_merge_candidates.find(hash);
+    if (it == m_merge_candidates.end()) {
+        remember_page();
+        return;
+    }
+
+    // The candidate was hashed earlier in the pass, it has to still be the
+    // same page, and both have to stay put while they're compared.
+    auto candidate_vmobject = it->value.vmobject.strong_ref();
+    size_t candidate_index = it->value.page_index;
+    if (!candidate_vmobject || !candidate_vmobject->is_anonymous()) {
+        remember_page();
+        return;
+    }
+    auto& candidate = static_cast<AnonymousVMObject&>(*candidate_vmobject);
+    ScopedSpinLock candidate_lock(candidate.m_lock);
+    if (candidate_index >= candidate.page_count() || !candidate.physical_pages()[candidate_index]
+        || candidate.physical_pages()[candidate_index]->paddr() != it->value.paddr || !candidate.is_page_mergeable(candidate_index)) {
+        remember_page();
+        return;
+    }
+    NonnullRefPtr<PhysicalPage> candidate_page = *candidate.physical_pages()[candidate_index];
+    if (candidate_page.ptr() == page.ptr())
+        return;
+
+    // Writes to either page fault from here on, and wait for our locks.
+    vmobject.write_protect_page(page_index);
+    candidate.write_protect_page(candidate_index);
+
+    auto* page_ptr = quickmap_page(*page);
+    bool is_identical = !__builtin_memcmp(page_ptr, quickmap_page(*candidate_page), PAGE_SIZE);
+    unquickmap_page();
+    unquickmap_page();
+    if (!is_identical) {
+        remember_page();
+        return;
+    }
+
+    dbgln_if(PAGE_FAULT_DEBUG, "MM: Merging {} into {}", page->paddr(), candidate_page->paddr());
+    candidate_page->m_merged = true;
+    vmobject.merge_page(page_index, move(candidate_page));
 }
 
 NonnullRefPtrVector<PhysicalPage> MemoryManager::allocate_contiguous_supervisor_physical_pages(size_t size)
@@ -865,7 +1929,7 @@ NonnullRefPtrVector<PhysicalPage> MemoryManager::allocate_contiguous_supervisor_
     for (auto& region : m_super_physical_regions) {
         physical_pages = region.take_contiguous_free_pages(count);
         if (!physical_pages.is_empty())
-            continue;
+            break;
     }
 
     if (physical_pages.is_empty()) {
@@ -921,8 +1985,59 @@ void MemoryManager::enter_space(Space& space)
     VERIFY(current_thread != nullptr);
     ScopedSpinLock lock(s_mm_lock);
 
+    // The saved CR3 is loaded without going through cr3_for_entering(),
+    // so it must not carry a PCID that may be handed out again.
     current_thread->regs().cr3 = space.page_directory().cr3();
-    write_cr3(space.page_directory().cr3());
+    write_cr3(MM.cr3_for_entering(space.page_directory()));
+}
+
+FlatPtr MemoryManager::cr3_for_entering(PageDirectory& page_directory)
+{
+    VERIFY(s_mm_lock.own_lock());
+#if ARCH(X86_64)
+    // The kernel page directory, and everything loaded from a saved
+    // CR3, uses PCID 0, which is flushed by every switch to it.
+    if (!m_pcid_enabled || &page_directory == m_kernel_page_directory.ptr())
+        return page_directory.cr3();
+
+    if (page_directory.m_pcid_generation != m_pcid_generation) {
+        if (m_next_pcid == MemoryManagerData::pcid_count) {
+            m_pcid_generation++;
+            m_next_pcid = 1;
+        }
+        page_directory.m_pcid = m_next_pcid++;
+        page_directory.m_pcid_generation = m_pcid_generation;
+    }
+
+    // Kernel mappings are shared by every PCID, but a kernel flush only
+    // reached the entries of the PCID that was current at the time. And
+    // after the PCIDs have been recycled, entries of this processor may
+    // belong to a previous owner of the PCID. Either way, start over.
+    auto& mm_data = get_data();
+    u32 kernel_tlb_generation = m_kernel_tlb_generation.load();
+    if (mm_data.m_pcid_generation != m_pcid_generation || mm_data.m_kernel_tlb_generation != kernel_tlb_generation) {
+        // Toggling CR4.PGE flushes the entries of every PCID.
+        constexpr FlatPtr cr4_pge = 1 << 7;
+        FlatPtr cr4 = read_cr4();
+        write_cr4(cr4 & ~cr4_pge);
+        write_cr4(cr4);
+        __builtin_memset(mm_data.m_pcid_tlb_generation, 0, sizeof(mm_data.m_pcid_tlb_generation));
+        mm_data.m_pcid_generation = m_pcid_generation;
+        mm_data.m_kernel_tlb_generation = kernel_tlb_generation;
+    }
+
+    // The generation is read before the switch, a flush racing with it
+    // only makes the next switch to this directory flush again.
+    u32 tlb_generation = page_directory.m_tlb_generation.load();
+    auto& seen_tlb_generation = mm_data.m_pcid_tlb_generation[page_directory.m_pcid];
+    FlatPtr cr3 = page_directory.cr3() | page_directory.m_pcid;
+    if (seen_tlb_generation == tlb_generation)
+        cr3 |= 1ull << 63;
+    seen_tlb_generation = tlb_generation;
+    return cr3;
+#else
+    return page_directory.cr3();
+#endif
 }
 
 void MemoryManager::flush_tlb_local(VirtualAddress vaddr, size_t page_count)
@@ -932,6 +2047,12 @@ void MemoryManager::flush_tlb_local(VirtualAddress vaddr, size_t page_count)
 
 void MemoryManager::flush_tlb(PageDirectory const* page_directory, VirtualAddress vaddr, size_t page_count)
 {
+    // Processor::flush_tlb() only reaches the PCIDs that are current, the
+    // generations make everyone else flush the next time they switch.
+    if (page_directory == MM.m_kernel_page_directory.ptr())
+        MM.m_kernel_tlb_generation++;
+    else if (page_directory)
+        const_cast<PageDirectory*>(page_directory)->m_tlb_generation++;
     Processor::flush_tlb(page_directory, vaddr, page_count);
 }
 
@@ -946,6 +2067,7 @@ PageDirectoryEntry* MemoryManager::quickmap_pd(PageDirectory& directory, size_t
         pte.set_present(true);
         pte.set_writable(true);
         pte.set_user_allowed(false);
+        pte.set_global(true);
 
         flush_tlb_local(VirtualAddress(KERNEL_QUICKMAP_PD));
     } else {
@@ -967,6 +2089,7 @@ PageTableEntry* MemoryManager::quickmap_pt(PhysicalAddress pt_paddr)
         pte.set_present(true);
         pte.set_writable(true);
         pte.set_user_allowed(false);
+        pte.set_global(true);
 
         flush_tlb_local(VirtualAddress(KERNEL_QUICKMAP_PT));
     } else {
@@ -978,14 +2101,22 @@ PageTableEntry* MemoryManager::quickmap_pt(PhysicalAddress pt_paddr)
     return (PageTableEntry*)KERNEL_QUICKMAP_PT;
 }
 
+static VirtualAddress quickmap_slot_vaddr(u32 slot)
+{
+    return VirtualAddress(KERNEL_QUICKMAP_PER_CPU_BASE + (Processor::id() * MemoryManager::quickmap_slots_per_processor + slot) * PAGE_SIZE);
+}
+
 u8* MemoryManager::quickmap_page(PhysicalAddress const& physical_address)
 {
-    VERIFY_INTERRUPTS_DISABLED();
+    u32 prev_flags;
+    Processor::current().enter_critical(prev_flags);
     auto& mm_data = get_data();
-    mm_data.m_quickmap_prev_flags = mm_data.m_quickmap_in_use.lock();
-    ScopedSpinLock lock(s_mm_lock);
+    VERIFY(mm_data.m_quickmap_depth < quickmap_slots_per_processor);
+    if (mm_data.m_quickmap_depth == 0)
+        mm_data.m_quickmap_prev_flags = prev_flags;
 
-    VirtualAddress vaddr(KERNEL_QUICKMAP_PER_CPU_BASE + Processor::id() * PAGE_SIZE);
+    // The PTE is private to this processor, s_mm_lock isn't needed.
+    auto vaddr = quickmap_slot_vaddr(mm_data.m_quickmap_depth++);
     u32 pte_idx = (vaddr.get() - KERNEL_PT1024_BASE) / PAGE_SIZE;
 
     auto& pte = ((PageTableEntry*)boot_pd_kernel_pt1023)[pte_idx];
@@ -994,6 +2125,7 @@ u8* MemoryManager::quickmap_page(PhysicalAddress const& physical_address)
         pte.set_present(true);
         pte.set_writable(true);
         pte.set_user_allowed(false);
+        pte.set_global(true);
         flush_tlb_local(vaddr);
     }
     return vaddr.as_ptr();
@@ -1002,15 +2134,23 @@ u8* MemoryManager::quickmap_page(PhysicalAddress const& physical_address)
 void MemoryManager::unquickmap_page()
 {
     VERIFY_INTERRUPTS_DISABLED();
-    ScopedSpinLock lock(s_mm_lock);
     auto& mm_data = get_data();
-    VERIFY(mm_data.m_quickmap_in_use.is_locked());
-    VirtualAddress vaddr(KERNEL_QUICKMAP_PER_CPU_BASE + Processor::id() * PAGE_SIZE);
+    VERIFY(mm_data.m_quickmap_depth > 0);
+    auto vaddr = quickmap_slot_vaddr(--mm_data.m_quickmap_depth);
     u32 pte_idx = (vaddr.get() - KERNEL_PT1024_BASE) / PAGE_SIZE;
     auto& pte = ((PageTableEntry*)boot_pd_kernel_pt1023)[pte_idx];
     pte.clear();
     flush_tlb_local(vaddr);
-    mm_data.m_quickmap_in_use.unlock(mm_data.m_quickmap_prev_flags);
+    Processor::current().leave_critical(mm_data.m_quickmap_depth == 0 ? mm_data.m_quickmap_prev_flags : 0);
+}
+
+void MemoryManager::copy_physical_page(PhysicalPage& dest, PhysicalPage& src, PageTemporality dest_temporality)
+{
+    auto* src_ptr = quickmap_page(src);
+    auto* dest_ptr = quickmap_page(dest);
+    copy_page(dest_ptr, src_ptr, dest_temporality);
+    unquickmap_page();
+    unquickmap_page();
 }
 
 bool MemoryManager::validate_user_stack_no_lock(Space& space, VirtualAddress vaddr) const
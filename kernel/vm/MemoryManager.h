@@ -8,11 +8,15 @@
 
 // includes
 #include <base/Concepts.h>
+#include <base/HashMap.h>
 #include <base/HashTable.h>
 #include <base/NonnullOwnPtrVector.h>
 #include <base/NonnullRefPtrVector.h>
 #include <base/String.h>
+#include <base/WeakPtr.h>
 #include <kernel/arch/x86/PageFault.h>
+#include <kernel/arch/x86/PageOperations.h>
+#include <kernel/api/MemoryPressureEvent.h>
 #include <kernel/arch/x86/TrapFrame.h>
 #include <kernel/Forward.h>
 #include <kernel/SpinLock.h>
@@ -96,12 +100,54 @@ struct PhysicalMemoryRange {
 
 #define MM Kernel::MemoryManager::the()
 
+// Free order-0 user pages kept by a processor, refilled from and drained
+// to the physical regions a batch at a time. The pages count as used, so
+// only their owner touches them, except for a drain under memory pressure.
+struct UserPhysicalPageCache {
+    static constexpr size_t capacity = 64;
+    static constexpr size_t batch = capacity / 2;
+
+    SpinLock<u8> lock;
+    PhysicalAddress pages[capacity];
+    size_t count { 0 };
+};
+
+// Zeroed pages for the top levels of new address spaces, so creating a
+// process neither goes to the physical regions nor clears pages. They come
+// back when address spaces go away, and are only touched by their
+// processor with interrupts disabled. A handful per processor isn't worth
+// draining under memory pressure.
+struct PageDirectoryPageCache {
+    static constexpr size_t capacity = 16;
+
+    RefPtr<PhysicalPage> pages[capacity];
+    size_t count { 0 };
+};
+
 struct MemoryManagerData {
-    SpinLock<u8> m_quickmap_in_use;
-    u32 m_quickmap_prev_flags;
+    // Quickmap slots of this processor in use, they are taken and given
+    // back like a stack.
+    u32 m_quickmap_depth { 0 };
+    u32 m_quickmap_prev_flags { 0 };
 
     PhysicalAddress m_last_quickmap_pd;
     PhysicalAddress m_last_quickmap_pt;
+
+    UserPhysicalPageCache m_user_page_cache;
+    PageDirectoryPageCache m_page_directory_page_cache;
+
+    // The node of the memory closest to this processor, looked up the
+    // first time it allocates.
+    bool m_numa_node_known { false };
+    u32 m_numa_node { 0 };
+
+    // The TLB generation of each PCID's page directory when this processor
+    // last entered it, entries of a PCID are only reused if it hasn't moved
+    // since. Reset whenever the PCIDs are recycled or kernel mappings change.
+    static constexpr size_t pcid_count = 4096;
+    u32 m_pcid_generation { 0 };
+    u32 m_kernel_tlb_generation { 0 };
+    u32 m_pcid_tlb_generation[pcid_count] {};
 };
 
 extern RecursiveSpinLock s_mm_lock;
@@ -111,6 +157,7 @@ class MemoryManager {
     friend class PageDirectory;
     friend class AnonymousVMObject;
     friend class Region;
+    friend class TLBFlushBatch;
     friend class VMObject;
 
 public:
@@ -135,6 +182,12 @@ public:
     static void enter_process_paging_scope(Process&);
     static void enter_space(Space&);
 
+    // The CR3 value to switch to the page directory with. With PCIDs it
+    // tags the TLB entries with the directory's PCID, and asks the CPU to
+    // keep them when nothing was flushed since this processor last used it.
+    FlatPtr cr3_for_entering(PageDirectory&);
+    bool is_pcid_enabled() const { return m_pcid_enabled; }
+
     bool validate_user_stack_no_lock(Space&, VirtualAddress) const;
     bool validate_user_stack(Space&, VirtualAddress) const;
 
@@ -146,14 +199,53 @@ public:
     bool commit_user_physical_pages(size_t);
     void uncommit_user_physical_pages(size_t);
     NonnullRefPtr<PhysicalPage> allocate_committed_user_physical_page(ShouldZeroFill = ShouldZeroFill::Yes);
+    // Fills every slot with a page committed earlier, taking them from the
+    // zones in batches instead of one lock round trip per page.
+    void allocate_committed_user_physical_pages(Span<RefPtr<PhysicalPage>>, ShouldZeroFill = ShouldZeroFill::Yes);
+    // 512 physically contiguous pages on a 2 MiB boundary, out of pages
+    // committed earlier. Empty if no such run is free.
+    NonnullRefPtrVector<PhysicalPage> allocate_committed_user_physical_large_page(ShouldZeroFill = ShouldZeroFill::Yes);
     RefPtr<PhysicalPage> allocate_user_physical_page(ShouldZeroFill = ShouldZeroFill::Yes, bool* did_purge = nullptr);
     RefPtr<PhysicalPage> allocate_supervisor_physical_page();
     NonnullRefPtrVector<PhysicalPage> allocate_contiguous_supervisor_physical_pages(size_t size);
     void deallocate_physical_page(PhysicalAddress);
 
+    // Copies between two physical pages with both mapped at once, so
+    // neither has to go through a buffer on the stack.
+    void copy_physical_page(PhysicalPage& dest, PhysicalPage& src, PageTemporality dest_temporality = PageTemporality::Hot);
+
+    // Zeroes up to max_count free user pages into the pool the page fault
+    // path takes zero-filled pages from first. Meant for the idle loop, it
+    // returns whether the pool could take more.
+    bool replenish_zeroed_pages(size_t max_count);
+
+    // Looks at up to max_pages pages of memory marked mergeable, and has
+    // pages with identical contents share one read-only physical page.
+    // Writing to one copies it out again, like any copy-on-write page.
+    // Meant for the idle loop, it returns whether a pass is under way.
+    bool merge_identical_pages(size_t max_pages);
+
+    // Page reclaim keeps the free pool between two watermarks: once it
+    // drops below the low one, clean file pages that weren't touched for
+    // a while and volatile anonymous memory, least recently used first,
+    // are given back until it's above the high one again. If that isn't
+    // enough, inactive anonymous pages go into the CompressedPageStore,
+    // and then out to the SwapArea if there is one.
+    void start_page_reclaim_thread();
+    void balance_free_pages();
+    // The level is looked at after every balance and failed allocation,
+    // watchers hear about it when it changes. See MemoryPressureWatcher.
+    MemoryPressureEvent memory_pressure_event();
+    // One sweep over the accessed bits of every mapped page, so pages
+    // that weren't used since the last one become inactive.
+    void age_pages();
+
     OwnPtr<Region> allocate_contiguous_kernel_region(size_t, StringView name, Region::Access access, Region::Cacheable = Region::Cacheable::Yes);
     OwnPtr<Region> allocate_kernel_region(size_t, StringView name, Region::Access access, AllocationStrategy strategy = AllocationStrategy::Reserve, Region::Cacheable = Region::Cacheable::Yes);
     OwnPtr<Region> allocate_kernel_region(PhysicalAddress, size_t, StringView name, Region::Access access, Region::Cacheable = Region::Cacheable::Yes);
+    // Device memory with a type of its own, write combining for a
+    // framebuffer.
+    OwnPtr<Region> allocate_kernel_region(PhysicalAddress, size_t, StringView name, Region::Access access, MemoryType);
     OwnPtr<Region> allocate_kernel_region_identity(PhysicalAddress, size_t, StringView name, Region::Access access, Region::Cacheable = Region::Cacheable::Yes);
     OwnPtr<Region> allocate_kernel_region_with_vmobject(VMObject&, size_t, StringView name, Region::Access access, Region::Cacheable = Region::Cacheable::Yes);
     OwnPtr<Region> allocate_kernel_region_with_vmobject(Range const&, VMObject&, StringView name, Region::Access access, Region::Cacheable = Region::Cacheable::Yes);
@@ -163,6 +255,8 @@ public:
         PhysicalSize user_physical_pages_used { 0 };
         PhysicalSize user_physical_pages_committed { 0 };
         PhysicalSize user_physical_pages_uncommitted { 0 };
+        // Pages saved by merging identical pages, as of the last full pass.
+        PhysicalSize user_physical_pages_merged { 0 };
         PhysicalSize super_physical_pages { 0 };
         PhysicalSize super_physical_pages_used { 0 };
     };
@@ -173,14 +267,27 @@ public:
         return m_system_memory_info;
     }
 
+    // Sorts the user memory into nodes by the ACPI SRAT, so user pages
+    // can be allocated from the node local to the faulting processor.
+    // Has to run once the ACPI parser is up.
+    void initialize_numa_nodes();
+    u32 numa_node_count() const { return max(m_numa_node_count, 1u); }
+
+    struct NumaNodeInfo {
+        u32 proximity_domain { 0 };
+        PhysicalSize user_physical_pages { 0 };
+        PhysicalSize user_physical_pages_free { 0 };
+    };
+    // Free pages are those in the zones, not in a processor's cache.
+    Vector<NumaNodeInfo> get_numa_node_info();
+
+    // Walks the list in a read section instead of under s_mm_lock. A
+    // VMObject that loses its last reference meanwhile may still be handed
+    // to the callback, it isn't destroyed until the walk is over.
     template<IteratorFunction<VMObject&> Callback>
     static void for_each_vmobject(Callback callback)
     {
-        ScopedSpinLock locker(s_mm_lock);
-        for (auto& vmobject : MM.m_vmobjects) {
-            if (callback(vmobject) == IterationDecision::Break)
-                break;
-        }
+        MM.m_vmobjects.for_each(callback);
     }
 
     template<VoidFunction<VMObject&> Callback>
@@ -228,7 +335,30 @@ private:
 
     static Region* find_region_from_vaddr(VirtualAddress);
 
-    RefPtr<PhysicalPage> find_free_user_physical_page(bool);
+    u32 current_numa_node();
+    Optional<u32> numa_node_for_proximity_domain(u32 proximity_domain);
+    RefPtr<PhysicalPage> take_free_user_physical_page();
+    RefPtr<PhysicalPage> find_free_user_physical_page(bool, ShouldZeroFill);
+    RefPtr<PhysicalPage> take_cached_user_physical_page();
+    RefPtr<PhysicalPage> take_page_directory_page();
+    void recycle_page_directory_page(RefPtr<PhysicalPage>&&);
+    void fill_page_directory_page_cache();
+    bool cache_user_physical_page(PhysicalAddress);
+    void return_user_physical_pages(PhysicalAddress const*, size_t count);
+    size_t drain_user_physical_page_caches();
+    bool compact_user_physical_memory(size_t order);
+    void merge_page_if_identical(AnonymousVMObject&, size_t page_index);
+    size_t reclaim_pages(size_t page_count, bool include_active_pages, bool* did_purge = nullptr);
+    size_t compress_inactive_pages(size_t page_count);
+    size_t swap_out_inactive_pages(size_t page_count);
+    MemoryPressureEvent memory_pressure_event_no_lock() const;
+    void update_memory_pressure_level();
+
+    // Every processor has a few slots of its own, so mapping only has to
+    // stay on the processor and doesn't serialize with anyone else. A nested
+    // quickmap (like a copy mapping its destination) takes the next slot,
+    // and pages are unmapped in reverse order.
+    static constexpr size_t quickmap_slots_per_processor = 4;
 
     ALWAYS_INLINE u8* quickmap_page(PhysicalPage& page)
     {
@@ -242,6 +372,18 @@ private:
 
     PageTableEntry* pte(PageDirectory&, VirtualAddress);
     PageTableEntry* ensure_pte(PageDirectory&, VirtualAddress);
+    PageDirectoryEntry* ensure_large_pde(PageDirectory&, VirtualAddress);
+    bool split_large_page(PageDirectory&, VirtualAddress);
+    // Points the page directory at the page table the vmobject shares for
+    // key, for the 2 MiB at vaddr. Creates the table if there isn't one
+    // yet, and sets is_new since the caller has to fill it in then.
+    // Returns nullptr if the range has a page table of its own.
+    PageTableEntry* ensure_shared_page_table(PageDirectory&, VirtualAddress, SharedInodeVMObject&, size_t key, bool& is_new);
+    // Returns false if the page table at vaddr isn't shared.
+    bool release_shared_page_table(PageDirectory&, VirtualAddress, SharedInodeVMObject&);
+    void write_protect_range(PageDirectory&, VirtualAddress, size_t page_count);
+    size_t clear_accessed_range(PageDirectory&, VirtualAddress, size_t page_count, Bitmap* accessed, size_t first_bit);
+    Optional<Range> allocate_kernel_range(size_t, PhysicalAddress = {});
     void release_pte(PageDirectory&, VirtualAddress, bool);
 
     RefPtr<PageDirectory> m_kernel_page_directory;
@@ -250,6 +392,34 @@ private:
     RefPtr<PhysicalPage> m_lazy_committed_page;
 
     SystemMemoryInfo m_system_memory_info;
+    MemoryPressureEvent::Level m_memory_pressure_level { MemoryPressureEvent::Level::None };
+
+    bool m_pcid_enabled { false };
+    u16 m_next_pcid { 1 };
+    u32 m_pcid_generation { 1 };
+    Atomic<u32> m_kernel_tlb_generation { 1 };
+
+    static constexpr size_t zeroed_page_pool_size = 64;
+    RefPtr<PhysicalPage> m_zeroed_pages[zeroed_page_pool_size];
+    size_t m_zeroed_page_count { 0 };
+
+    // A page seen by the current merge pass, by the hash of its contents.
+    struct MergeCandidate {
+        WeakPtr<VMObject> vmobject;
+        size_t page_index { 0 };
+        PhysicalAddress paddr;
+    };
+    // Node 0 is everything until the SRAT names the first proximity domain,
+    // the memory it doesn't mention stays in there.
+    u32 m_numa_node_count { 0 };
+    u32 m_numa_proximity_domains[PhysicalRegion::max_numa_nodes] {};
+    HashMap<u32, u32> m_apic_id_numa_nodes;
+
+    HashMap<u32, MergeCandidate> m_merge_candidates;
+    WeakPtr<VMObject> m_merge_scan_vmobject;
+    size_t m_merge_scan_page_index { 0 };
+    size_t m_merge_scan_merged_slots { 0 };
+    HashTable<PhysicalPtr> m_merge_scan_merged_pages;
 
     NonnullOwnPtrVector<PhysicalRegion> m_user_physical_regions;
     NonnullOwnPtrVector<PhysicalRegion> m_super_physical_regions;
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/vm/MemoryManager.h>
+#include <kernel/vm/MemoryPressureWatcher.h>
+
+namespace Kernel {
+
+SpinLock<u8> MemoryPressureWatcher::s_watchers_lock;
+MemoryPressureWatcher::List MemoryPressureWatcher::s_watchers;
+
+KResultOr<NonnullRefPtr<MemoryPressureWatcher>> MemoryPressureWatcher::create()
+{
+    auto watcher = adopt_ref_if_nonnull(new (nothrow) MemoryPressureWatcher);
+    if (!watcher)
+        return ENOMEM;
+
+    // Someone starting to watch while memory is already short wants to
+    // know right away.
+    auto event = MM.memory_pressure_event();
+    if (event.level != MemoryPressureEvent::Level::None) {
+        watcher->m_event = event;
+        watcher->m_has_event = true;
+    }
+
+    ScopedSpinLock lock(s_watchers_lock);
+    s_watchers.append(*watcher);
+    return watcher.release_nonnull();
+}
+
+MemoryPressureWatcher::~MemoryPressureWatcher()
+{
+    ScopedSpinLock lock(s_watchers_lock);
+    s_watchers.remove(*this);
+}
+
+void MemoryPressureWatcher::notify_all(MemoryPressureEvent const& event)
+{
+    ScopedSpinLock lock(s_watchers_lock);
+    for (auto& watcher : s_watchers)
+        watcher.notify(event);
+}
+
+void MemoryPressureWatcher::notify(MemoryPressureEvent const& event)
+{
+    {
+        ScopedSpinLock lock(m_lock);
+        m_event = event;
+        m_has_event = true;
+    }
+    evaluate_block_conditions();
+}
+
+bool MemoryPressureWatcher::can_read(FileDescription const&, size_t) const
+{
+    ScopedSpinLock lock(m_lock);
+    return m_has_event;
+}
+
+KResultOr<size_t> MemoryPressureWatcher::read(FileDescription&, u64, UserOrKernelBuffer& buffer, size_t buffer_size)
+{
+    if (buffer_size < sizeof(MemoryPressureEvent))
+        return EINVAL;
+
+    MemoryPressureEvent event;
+    {
+        ScopedSpinLock lock(m_lock);
+        if (!m_has_event)
+            return EAGAIN;
+        event = m_event;
+        m_has_event = false;
+    }
+
+    if (!buffer.write(&event, sizeof(event)))
+        return EFAULT;
+    return sizeof(event);
+}
+
+String MemoryPressureWatcher::absolute_path(FileDescription const&) const
+{
+    return "memory-pressure-watcher";
+}
+
+}
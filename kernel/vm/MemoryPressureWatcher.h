@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/IntrusiveList.h>
+#include <kernel/api/MemoryPressureEvent.h>
+#include <kernel/filesystem/File.h>
+#include <kernel/SpinLock.h>
+
+namespace Kernel {
+
+// Readable whenever the memory pressure level changed since the last read,
+// so userland can shed caches before allocations start to fail.
+class MemoryPressureWatcher final : public File {
+public:
+    static KResultOr<NonnullRefPtr<MemoryPressureWatcher>> create();
+    virtual ~MemoryPressureWatcher() override;
+
+    // Called by the MemoryManager, without s_mm_lock.
+    static void notify_all(MemoryPressureEvent const&);
+
+    virtual bool can_read(FileDescription const&, size_t) const override;
+    virtual KResultOr<size_t> read(FileDescription&, u64, UserOrKernelBuffer&, size_t) override;
+    virtual bool can_write(FileDescription const&, size_t) const override { return true; }
+    virtual KResultOr<size_t> write(FileDescription&, u64, UserOrKernelBuffer const&, size_t) override { return EIO; }
+
+    virtual String absolute_path(FileDescription const&) const override;
+    virtual StringView class_name() const override { return "MemoryPressureWatcher"sv; };
+
+private:
+    MemoryPressureWatcher() = default;
+
+    void notify(MemoryPressureEvent const&);
+
+    mutable SpinLock<u8> m_lock;
+    MemoryPressureEvent m_event;
+    // Only the latest level is kept, one that was missed doesn't matter.
+    bool m_has_event { false };
+
+    IntrusiveListNode<MemoryPressureWatcher> m_list_node;
+
+    using List = IntrusiveList<MemoryPressureWatcher, RawPtr<MemoryPressureWatcher>, &MemoryPressureWatcher::m_list_node>;
+    static SpinLock<u8> s_watchers_lock;
+    static List s_watchers;
+};
+
+}
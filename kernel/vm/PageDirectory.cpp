@@ -54,6 +54,31 @@ UNMAP_AFTER_INIT void PageDirectory::allocate_kernel_directory()
     m_directory_pages[(kernel_base >> 30) & 0x1ff] = PhysicalPage::create(boot_pd_kernel, MayReturnToFreeList::No);
 }
 
+// What every new address space gets of the kernel's, worked out once. The
+// kernel half itself is shared by reference, as the same page directory;
+// only the entries pointing to it are copied.
+struct KernelMappingTemplate {
+    bool is_ready { false };
+    // The first entry of the lowest page directory, mapping the first 2 MiB
+    // the way the prekernel set them up. It's never replaced.
+    PageDirectoryEntry low_memory_entry;
+    u64 max_physical_address { 0 };
+};
+
+static KernelMappingTemplate s_kernel_mapping_template;
+
+static KernelMappingTemplate const& kernel_mapping_template()
+{
+    VERIFY(s_mm_lock.own_lock());
+    auto& mapping_template = s_kernel_mapping_template;
+    if (!mapping_template.is_ready) {
+        memcpy(&mapping_template.low_memory_entry, MM.quickmap_pd(MM.kernel_page_directory(), 0), sizeof(PageDirectoryEntry));
+        mapping_template.max_physical_address = (1ULL << Processor::current().physical_address_bit_width()) - 1;
+        mapping_template.is_ready = true;
+    }
+    return mapping_template;
+}
+
 PageDirectory::PageDirectory(const RangeAllocator* parent_range_allocator)
 {
     constexpr FlatPtr userspace_range_base = 0x00800000;
@@ -69,22 +94,24 @@ PageDirectory::PageDirectory(const RangeAllocator* parent_range_allocator)
     }
 
 #if ARCH(X86_64)
-    m_pml4t = MM.allocate_user_physical_page();
+    m_pml4t = MM.take_page_directory_page();
     if (!m_pml4t)
         return;
 #endif
-    m_directory_table = MM.allocate_user_physical_page();
+    m_directory_table = MM.take_page_directory_page();
     if (!m_directory_table)
         return;
     auto kernel_pd_index = (kernel_base >> 30) & 0x1ffu;
     for (size_t i = 0; i < kernel_pd_index; i++) {
-        m_directory_pages[i] = MM.allocate_user_physical_page();
+        m_directory_pages[i] = MM.take_page_directory_page();
         if (!m_directory_pages[i])
             return;
     }
 
     m_directory_pages[kernel_pd_index] = MM.kernel_page_directory().m_directory_pages[kernel_pd_index];
 
+    auto& mapping_template = kernel_mapping_template();
+
 #if ARCH(X86_64)
     {
         auto& table = *(PageDirectoryPointerTable*)MM.quickmap_page(*m_pml4t);
@@ -94,33 +121,22 @@ PageDirectory::PageDirectory(const RangeAllocator* parent_range_allocator)
 #endif
 
     {
+        // The pages come zeroed, only the entries in use are written.
         auto& table = *(PageDirectoryPointerTable*)MM.quickmap_page(*m_directory_table);
-        for (size_t i = 0; i < sizeof(m_directory_pages) / sizeof(m_directory_pages[0]); i++) {
-            if (m_directory_pages[i]) {
+        constexpr u64 pdpte_bit_flags = 0x80000000000000BF;
+        for (size_t i = 0; i <= kernel_pd_index; i++) {
 #if ARCH(I386)
-                table.raw[i] = (FlatPtr)m_directory_pages[i]->paddr().as_ptr() | 1;
+            table.raw[i] = (FlatPtr)m_directory_pages[i]->paddr().as_ptr() | 1;
 #else
-                table.raw[i] = (FlatPtr)m_directory_pages[i]->paddr().as_ptr() | 7;
+            table.raw[i] = (FlatPtr)m_directory_pages[i]->paddr().as_ptr() | 7;
 #endif
-            }
+            VERIFY((table.raw[i] & ~pdpte_bit_flags) <= mapping_template.max_physical_address);
         }
-
-        u64 max_physical_address = (1ULL << Processor::current().physical_address_bit_width()) - 1;
-
-
-        constexpr u64 pdpte_bit_flags = 0x80000000000000BF;
-
-        for (auto table_entry : table.raw)
-            VERIFY((table_entry & ~pdpte_bit_flags) <= max_physical_address);
-
         MM.unquickmap_page();
     }
 
-    PageDirectoryEntry buffer;
-    auto* kernel_pd = MM.quickmap_pd(MM.kernel_page_directory(), 0);
-    memcpy(&buffer, kernel_pd, sizeof(PageDirectoryEntry));
     auto* new_pd = MM.quickmap_pd(*this, 0);
-    memcpy(new_pd, &buffer, sizeof(PageDirectoryEntry));
+    memcpy(new_pd, &mapping_template.low_memory_entry, sizeof(PageDirectoryEntry));
 
     m_valid = true;
 
@@ -132,6 +148,15 @@ PageDirectory::~PageDirectory()
     ScopedSpinLock lock(s_mm_lock);
     if (m_space)
         cr3_map().remove(cr3());
+
+    // The kernel's own directory never goes away, these are all ours.
+    auto kernel_pd_index = (kernel_base >> 30) & 0x1ffu;
+    for (size_t i = 0; i < kernel_pd_index; i++)
+        MM.recycle_page_directory_page(move(m_directory_pages[i]));
+    MM.recycle_page_directory_page(move(m_directory_table));
+#if ARCH(X86_64)
+    MM.recycle_page_directory_page(move(m_pml4t));
+#endif
 }
 
 }
\ No newline at end of file
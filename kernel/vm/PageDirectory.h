@@ -7,6 +7,7 @@
 #pragma once
 
 // includes
+#include <base/Atomic.h>
 #include <base/HashMap.h>
 #include <base/RefCounted.h>
 #include <base/RefPtr.h>
@@ -43,6 +44,9 @@ public:
 #endif
     }
 
+    // With PCIDs enabled the low bits of CR3 hold the PCID.
+    static constexpr FlatPtr cr3_pcid_mask = 0xfff;
+
     RangeAllocator& range_allocator() { return m_range_allocator; }
     const RangeAllocator& range_allocator() const { return m_range_allocator; }
 
@@ -74,8 +78,17 @@ private:
     RefPtr<PhysicalPage> m_directory_pages[4];
 #endif
     HashMap<FlatPtr, RefPtr<PhysicalPage>> m_page_tables;
+    // The page tables in m_page_tables that belong to a SharedInodeVMObject,
+    // with their key in it.
+    HashMap<FlatPtr, size_t> m_shared_page_table_keys;
     RecursiveSpinLock m_lock;
     bool m_valid { false };
+
+    // Only meaningful while m_pcid_generation matches the MemoryManager's.
+    u16 m_pcid { 0 };
+    u32 m_pcid_generation { 0 };
+    // Bumped by every TLB flush, see MemoryManager::cr3_for_entering().
+    Atomic<u32> m_tlb_generation { 1 };
 };
 
 }
\ No newline at end of file
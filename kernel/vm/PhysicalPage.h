@@ -43,6 +43,10 @@ public:
 
     bool is_shared_zero_page() const;
     bool is_lazy_committed_page() const;
+    bool may_return_to_freelist() const { return m_may_return_to_freelist == MayReturnToFreeList::Yes; }
+
+    // Set once the MemoryManager made identical pages share this one.
+    bool is_merged() const { return m_merged; }
 
 private:
     explicit PhysicalPage(MayReturnToFreeList may_return_to_freelist);
@@ -52,6 +56,7 @@ private:
 
     Atomic<u32> m_ref_count { 1 };
     MayReturnToFreeList m_may_return_to_freelist { MayReturnToFreeList::Yes };
+    bool m_merged { false };
 };
 
 struct PhysicalPageEntry {
@@ -61,8 +66,8 @@ struct PhysicalPageEntry {
         } allocated;
 
         struct {
-            i16 next_index;
-            i16 prev_index;
+            i32 next_index;
+            i32 prev_index;
         } freelist;
     };
 };
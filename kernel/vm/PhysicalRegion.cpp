@@ -49,17 +49,18 @@ void PhysicalRegion::initialize_zones()
         while (remaining_pages >= pages_per_zone) {
             m_zones.append(make<PhysicalZone>(base_address, pages_per_zone));
             base_address = base_address.offset(pages_per_zone * PAGE_SIZE);
-            m_usable_zones.append(m_zones.last());
+            m_usable_zones[0].append(m_zones.last());
             remaining_pages -= pages_per_zone;
             ++zone_count;
         }
         if (zone_count)
-            dmesgln(" * {}x PhysicalZone ({} MiB) @ {:016x}-{:016x}", zone_count, pages_per_zone / 256, first_address.get(), base_address.get() - pages_per_zone * PAGE_SIZE - 1);
+            dmesgln(" * {}x PhysicalZone ({} KiB) @ {:016x}-{:016x}", zone_count, pages_per_zone * PAGE_SIZE / KiB, first_address.get(), base_address.get() - 1);
     };
 
-    make_zones(4096);
-
-    make_zones(256);
+    // As few zones as possible, so large blocks can be found, and whatever
+    // doesn't fill a big one is split into smaller ones instead of being lost.
+    for (size_t pages_per_zone = 1u << PhysicalZone::max_order; pages_per_zone; pages_per_zone >>= 1)
+        make_zones(pages_per_zone);
 }
 
 OwnPtr<PhysicalRegion> PhysicalRegion::try_take_pages_from_beginning(unsigned page_count)
@@ -77,22 +78,45 @@ OwnPtr<PhysicalRegion> PhysicalRegion::try_take_pages_from_beginning(unsigned pa
 NonnullRefPtrVector<PhysicalPage> PhysicalRegion::take_contiguous_free_pages(size_t count)
 {
     auto rounded_page_count = next_power_of_two(count);
-    auto order = __builtin_ctz(rounded_page_count);
+    size_t order = __builtin_ctz(rounded_page_count);
+    if (order > PhysicalZone::max_order)
+        return {};
 
-    Optional<PhysicalAddress> page_base;
-    for (auto& zone : m_usable_zones) {
-        page_base = zone.allocate_block(order);
-        if (page_base.has_value()) {
-            if (zone.is_empty()) {
-                m_full_zones.append(zone);
+    // Take the block from the zone that has to split the smallest one,
+    // so one zone's large blocks aren't broken up while another zone has
+    // one of the right size.
+    PhysicalZone* best_zone = nullptr;
+    size_t best_order = PhysicalZone::max_order + 1;
+    for (auto& usable_zones : m_usable_zones) {
+        for (auto& zone : usable_zones) {
+            auto fit = zone.best_fit_order(order);
+            if (fit.has_value() && fit.value() < best_order) {
+                best_zone = &zone;
+                best_order = fit.value();
+                if (best_order == order)
+                    break;
             }
-            break;
         }
+        if (best_order == order)
+            break;
     }
-
-    if (!page_base.has_value())
+    if (!best_zone)
         return {};
 
+    auto page_base = best_zone->allocate_block(order);
+    VERIFY(page_base.has_value());
+
+    // The pages past count go back to the zone, in the largest aligned
+    // blocks they can.
+    for (size_t page = count; page < rounded_page_count;) {
+        size_t tail_order = __builtin_ctz(page);
+        best_zone->deallocate_block(page_base.value().offset(page * PAGE_SIZE), tail_order);
+        page += 1u << tail_order;
+    }
+
+    if (best_zone->is_empty())
+        m_full_zones.append(*best_zone);
+
     NonnullRefPtrVector<PhysicalPage> physical_pages;
     physical_pages.ensure_capacity(count);
 
@@ -101,12 +125,24 @@ NonnullRefPtrVector<PhysicalPage> PhysicalRegion::take_contiguous_free_pages(siz
     return physical_pages;
 }
 
-RefPtr<PhysicalPage> PhysicalRegion::take_free_page()
+PhysicalZone* PhysicalRegion::first_usable_zone(Optional<u32> numa_node)
+{
+    if (numa_node.has_value())
+        return m_usable_zones[numa_node.value()].first();
+    for (auto& usable_zones : m_usable_zones) {
+        if (!usable_zones.is_empty())
+            return usable_zones.first();
+    }
+    return nullptr;
+}
+
+RefPtr<PhysicalPage> PhysicalRegion::take_free_page(Optional<u32> numa_node)
 {
-    if (m_usable_zones.is_empty())
+    auto* usable_zone = first_usable_zone(numa_node);
+    if (!usable_zone)
         return nullptr;
 
-    auto& zone = *m_usable_zones.first();
+    auto& zone = *usable_zone;
     auto page = zone.allocate_block(0);
     VERIFY(page.has_value());
 
@@ -118,13 +154,65 @@ RefPtr<PhysicalPage> PhysicalRegion::take_free_page()
     return PhysicalPage::create(page.value());
 }
 
+size_t PhysicalRegion::take_free_pages(PhysicalAddress* pages, size_t count, Optional<u32> numa_node)
+{
+    size_t taken = 0;
+    PhysicalZone* usable_zone;
+    while (taken < count && (usable_zone = first_usable_zone(numa_node))) {
+        auto& zone = *usable_zone;
+        auto page = zone.allocate_block(0);
+        VERIFY(page.has_value());
+        pages[taken++] = page.value();
+
+        if (zone.is_empty())
+            m_full_zones.append(zone);
+    }
+    return taken;
+}
+
+// A run of pages that is 2 MiB in size and alignment, so it can be mapped
+// with a single large page. Buddy blocks are only aligned relative to their
+// zone, so zones that don't start on a 2 MiB boundary are skipped.
+Optional<PhysicalAddress> PhysicalRegion::take_free_large_page()
+{
+    constexpr size_t large_page_size = 2 * MiB;
+    constexpr size_t large_page_order = 9;
+
+    for (auto& usable_zones : m_usable_zones) {
+        for (auto& zone : usable_zones) {
+            if (zone.base().get() % large_page_size)
+                continue;
+            auto page_base = zone.allocate_block(large_page_order);
+            if (!page_base.has_value())
+                continue;
+            if (zone.is_empty())
+                m_full_zones.append(zone);
+            return page_base;
+        }
+    }
+    return {};
+}
+
+Optional<size_t> PhysicalRegion::free_pages_in_block(PhysicalAddress base, size_t order) const
+{
+    size_t block_size = PAGE_SIZE << order;
+    for (auto& zone : m_zones) {
+        if (!zone.contains(base))
+            continue;
+        if (zone.base().get() % block_size || !zone.contains(base.offset(block_size - 1)))
+            return {};
+        return zone.free_pages_in_block(base, order);
+    }
+    return {};
+}
+
 void PhysicalRegion::return_page(PhysicalAddress paddr)
 {
     for (auto& zone : m_zones) {
         if (zone.contains(paddr)) {
             zone.deallocate_block(paddr, 0);
             if (m_full_zones.contains(zone))
-                m_usable_zones.append(zone);
+                m_usable_zones[zone.numa_node()].append(zone);
             return;
         }
     }
@@ -132,4 +220,36 @@ void PhysicalRegion::return_page(PhysicalAddress paddr)
     VERIFY_NOT_REACHED();
 }
 
+void PhysicalRegion::set_numa_node(PhysicalAddress base, u64 length, u32 numa_node)
+{
+    VERIFY(numa_node < max_numa_nodes);
+    for (auto& zone : m_zones) {
+        if (zone.base() < base || zone.base().get() - base.get() >= length)
+            continue;
+        zone.set_numa_node(numa_node);
+        if (!zone.is_empty())
+            m_usable_zones[numa_node].append(zone);
+    }
+}
+
+size_t PhysicalRegion::page_count_in_numa_node(u32 numa_node) const
+{
+    size_t count = 0;
+    for (auto& zone : m_zones) {
+        if (zone.numa_node() == numa_node)
+            count += zone.page_count();
+    }
+    return count;
+}
+
+size_t PhysicalRegion::free_pages_in_numa_node(u32 numa_node) const
+{
+    size_t count = 0;
+    for (auto& zone : m_zones) {
+        if (zone.numa_node() == numa_node)
+            count += zone.available();
+    }
+    return count;
+}
+
 }
\ No newline at end of file
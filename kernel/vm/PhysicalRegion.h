@@ -19,6 +19,10 @@ class PhysicalRegion {
     BASE_MAKE_NONMOVABLE(PhysicalRegion);
 
 public:
+    // Memory and processors are grouped into nodes by the ACPI SRAT, zones
+    // that it doesn't mention are in node 0.
+    static constexpr u32 max_numa_nodes = 8;
+
     static OwnPtr<PhysicalRegion> try_create(PhysicalAddress lower, PhysicalAddress upper)
     {
         return adopt_own_if_nonnull(new PhysicalRegion { lower, upper });
@@ -35,16 +39,31 @@ public:
 
     OwnPtr<PhysicalRegion> try_take_pages_from_beginning(unsigned);
 
-    RefPtr<PhysicalPage> take_free_page();
+    // Without a node, the pages may come from any of them.
+    RefPtr<PhysicalPage> take_free_page(Optional<u32> numa_node = {});
+    size_t take_free_pages(PhysicalAddress*, size_t count, Optional<u32> numa_node = {});
+    Optional<PhysicalAddress> take_free_large_page();
     NonnullRefPtrVector<PhysicalPage> take_contiguous_free_pages(size_t count);
+
+    // Empty if the block isn't one the buddy allocator could hand out, i.e.
+    // it doesn't lie within a zone whose base is aligned to the block size.
+    Optional<size_t> free_pages_in_block(PhysicalAddress base, size_t order) const;
     void return_page(PhysicalAddress);
 
+    // Puts the zones that start within the range into the given node.
+    void set_numa_node(PhysicalAddress base, u64 length, u32 numa_node);
+    size_t page_count_in_numa_node(u32 numa_node) const;
+    size_t free_pages_in_numa_node(u32 numa_node) const;
+
 private:
     PhysicalRegion(PhysicalAddress lower, PhysicalAddress upper);
 
     NonnullOwnPtrVector<PhysicalZone> m_zones;
 
-    PhysicalZone::List m_usable_zones;
+    PhysicalZone* first_usable_zone(Optional<u32> numa_node);
+
+    // The zones with free pages, by node.
+    PhysicalZone::List m_usable_zones[max_numa_nodes];
     PhysicalZone::List m_full_zones;
 
     PhysicalAddress m_lower;
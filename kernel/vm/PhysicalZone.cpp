@@ -105,6 +105,34 @@ Optional<PhysicalZone::ChunkIndex> PhysicalZone::allocate_block_impl(size_t orde
     return index;
 }
 
+Optional<size_t> PhysicalZone::best_fit_order(size_t order) const
+{
+    for (size_t i = order; i <= max_order; ++i) {
+        if (m_buckets[i].freelist != -1)
+            return i;
+    }
+    return {};
+}
+
+size_t PhysicalZone::free_pages_in_block(PhysicalAddress base, size_t order) const
+{
+    VERIFY(contains(base));
+    ChunkIndex first = (base.get() - m_base_address.get()) / ZONE_CHUNK_SIZE;
+    ChunkIndex last = first + (2u << order);
+
+    size_t free_chunks = 0;
+    for (size_t i = 0; i <= max_order; ++i) {
+        ChunkIndex block_size = 2u << i;
+        for (auto index = m_buckets[i].freelist; index != -1; index = get_freelist_entry(index).freelist.next_index) {
+            auto overlap_first = max(index, first);
+            auto overlap_last = min(index + block_size, last);
+            if (overlap_first < overlap_last)
+                free_chunks += overlap_last - overlap_first;
+        }
+    }
+    return free_chunks / 2;
+}
+
 void PhysicalZone::deallocate_block(PhysicalAddress address, size_t order)
 {
     size_t block_size = 2u << order;
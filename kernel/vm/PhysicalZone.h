@@ -19,19 +19,33 @@ class PhysicalZone {
 
 public:
     static constexpr size_t ZONE_CHUNK_SIZE = PAGE_SIZE / 2;
-    using ChunkIndex = i16;
+    using ChunkIndex = i32;
+
+    // The largest block, and with that the largest zone, is 2^max_order pages.
+    static constexpr size_t max_order = 14;
 
     PhysicalZone(PhysicalAddress base, size_t page_count);
 
     Optional<PhysicalAddress> allocate_block(size_t order);
     void deallocate_block(PhysicalAddress, size_t order);
 
+    // The order of the smallest free block that a block of the given order
+    // can be carved out of, if there is one.
+    Optional<size_t> best_fit_order(size_t order) const;
+
+    // How many pages of the 2^order pages at base are free.
+    size_t free_pages_in_block(PhysicalAddress base, size_t order) const;
+
     void dump() const;
     size_t available() const { return m_page_count - (m_used_chunks / 2); }
 
     bool is_empty() const { return !available(); }
 
     PhysicalAddress base() const { return m_base_address; }
+    size_t page_count() const { return m_page_count; }
+
+    u32 numa_node() const { return m_numa_node; }
+    void set_numa_node(u32 numa_node) { m_numa_node = numa_node; }
     bool contains(PhysicalAddress paddr) const
     {
         return paddr >= m_base_address && paddr < m_base_address.offset(m_page_count * PAGE_SIZE);
@@ -64,7 +78,6 @@ private:
         Bitmap bitmap;
     };
 
-    static constexpr size_t max_order = 12;
     BuddyBucket m_buckets[max_order + 1];
 
     PhysicalPageEntry& get_freelist_entry(ChunkIndex) const;
@@ -73,6 +86,7 @@ private:
     PhysicalAddress m_base_address { 0 };
     size_t m_page_count { 0 };
     size_t m_used_chunks { 0 };
+    u32 m_numa_node { 0 };
 
     IntrusiveListNode<PhysicalZone> m_list_node;
 
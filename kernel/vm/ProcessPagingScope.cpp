@@ -7,6 +7,7 @@
 // includes
 #include <kernel/arch/x86/InterruptDisabler.h>
 #include <kernel/vm/MemoryManager.h>
+#include <kernel/vm/PageDirectory.h>
 #include <kernel/vm/ProcessPagingScope.h>
 
 namespace Kernel {
@@ -14,7 +15,9 @@ namespace Kernel {
 ProcessPagingScope::ProcessPagingScope(Process& process)
 {
     VERIFY(Thread::current() != nullptr);
-    m_previous_cr3 = read_cr3();
+    // Restored without going through MemoryManager::cr3_for_entering(),
+    // so it must not keep a PCID that may be handed out again.
+    m_previous_cr3 = read_cr3() & ~PageDirectory::cr3_pcid_mask;
     MM.enter_process_paging_scoped(process);
 }
 
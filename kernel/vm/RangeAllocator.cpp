@@ -6,7 +6,8 @@
 
 // includes
 #include <base/Checked.h>
-#include <kernel/Random.h>
+#include <base/NumericLimits.h>
+#include <kernel/ProcessorRandom.h>
 #include <kernel/vm/RangeAllocator.h>
 
 #define VM_GUARD_PAGES
@@ -20,18 +21,35 @@ RangeAllocator::RangeAllocator()
 
 void RangeAllocator::initialize_with_range(VirtualAddress base, size_t size)
 {
+    // The size index packs the size and the base of a range in pages into
+    // one key, half of it each.
+    VERIFY(size / PAGE_SIZE <= NumericLimits<u32>::max());
     m_total_range = { base, size };
-    m_available_ranges.insert(base.get(), Range { base, size });
+    insert_available_range(Range { base, size });
 }
 
 void RangeAllocator::initialize_from_parent(RangeAllocator const& parent_allocator)
 {
     ScopedSpinLock lock(parent_allocator.m_lock);
     m_total_range = parent_allocator.m_total_range;
-    m_available_ranges.clear();
-    for (auto it = parent_allocator.m_available_ranges.begin(); !it.is_end(); ++it) {
-        m_available_ranges.insert(it.key(), *it);
-    }
+    // Both trees come out of the parent in key order, so build them
+    // directly instead of inserting and rebalancing range by range.
+    auto by_base = parent_allocator.m_available_ranges.begin();
+    auto built = m_available_ranges.try_build_from_sorted(parent_allocator.m_available_ranges.size(), [&](FlatPtr& key) {
+        key = by_base.key();
+        Range range = *by_base;
+        ++by_base;
+        return range;
+    });
+    VERIFY(built);
+    auto by_size = parent_allocator.m_available_ranges_by_size.begin();
+    built = m_available_ranges_by_size.try_build_from_sorted(parent_allocator.m_available_ranges_by_size.size(), [&](u64& key) {
+        key = by_size.key();
+        Range range = *by_size;
+        ++by_size;
+        return range;
+    });
+    VERIFY(built);
 }
 
 void RangeAllocator::dump() const
@@ -43,17 +61,31 @@ void RangeAllocator::dump() const
     }
 }
 
-void RangeAllocator::carve_at_iterator(auto& it, Range const& range)
+u64 RangeAllocator::size_key(size_t size, VirtualAddress base) const
+{
+    u64 page_offset = (base.get() - m_total_range.base().get()) / PAGE_SIZE;
+    return ((u64)(size / PAGE_SIZE) << 32) | page_offset;
+}
+
+void RangeAllocator::insert_available_range(Range const& range)
+{
+    m_available_ranges.insert(range.base().get(), range);
+    m_available_ranges_by_size.insert(size_key(range), range);
+}
+
+void RangeAllocator::remove_available_range(Range range)
+{
+    m_available_ranges.remove(range.base().get());
+    m_available_ranges_by_size.remove(size_key(range));
+}
+
+void RangeAllocator::carve(Range available_range, Range const& range)
 {
     VERIFY(m_lock.is_locked());
-    auto remaining_parts = (*it).carve(range);
-    VERIFY(remaining_parts.size() >= 1);
-    VERIFY(m_total_range.contains(remaining_parts[0]));
-    m_available_ranges.remove(it.key());
-    m_available_ranges.insert(remaining_parts[0].base().get(), remaining_parts[0]);
-    if (remaining_parts.size() == 2) {
-        VERIFY(m_total_range.contains(remaining_parts[1]));
-        m_available_ranges.insert(remaining_parts[1].base().get(), remaining_parts[1]);
+    remove_available_range(available_range);
+    for (auto& part : available_range.carve(range)) {
+        VERIFY(m_total_range.contains(part));
+        insert_available_range(part);
     }
 }
 
@@ -65,19 +97,38 @@ Optional<Range> RangeAllocator::allocate_randomized(size_t size, size_t alignmen
     VERIFY((size % PAGE_SIZE) == 0);
     VERIFY((alignment % PAGE_SIZE) == 0);
 
-    static constexpr size_t maximum_randomization_attempts = 1000;
-    for (size_t i = 0; i < maximum_randomization_attempts; ++i) {
-        VirtualAddress random_address { round_up_to_power_of_two(get_fast_random<FlatPtr>() % m_total_range.end().get(), alignment) };
+    ScopedSpinLock lock(m_lock);
 
-        if (!m_total_range.contains(random_address, size))
+    // Every aligned base with room behind it is equally likely. Each range
+    // large enough is picked with a weight of how many of those it has.
+    Optional<Range> chosen_range;
+    FlatPtr chosen_first_base = 0;
+    size_t chosen_base_count = 0;
+    size_t total_base_count = 0;
+    for (auto it = m_available_ranges_by_size.find_smallest_not_below_iterator(size_key(size, m_total_range.base())); !it.is_end(); ++it) {
+        auto& available_range = *it;
+        FlatPtr first_base = round_up_to_power_of_two(available_range.base().get(), alignment);
+        if (first_base < available_range.base().get() || first_base > available_range.end().get() - size)
             continue;
 
-        auto range = allocate_specific(random_address, size);
-        if (range.has_value())
-            return range;
+        size_t base_count = (available_range.end().get() - size - first_base) / alignment + 1;
+        total_base_count += base_count;
+        if (get_processor_random<size_t>() % total_base_count < base_count) {
+            chosen_range = available_range;
+            chosen_first_base = first_base;
+            chosen_base_count = base_count;
+        }
     }
 
-    return allocate_anywhere(size, alignment);
+    if (!chosen_range.has_value()) {
+        dmesgln("RangeAllocator: Failed to allocate randomized: size={}, alignment={}", size, alignment);
+        return {};
+    }
+
+    Range const allocated_range(VirtualAddress(chosen_first_base + (get_processor_random<size_t>() % chosen_base_count) * alignment), size);
+    VERIFY(chosen_range->contains(allocated_range));
+    carve(chosen_range.value(), allocated_range);
+    return allocated_range;
 }
 
 Optional<Range> RangeAllocator::allocate_anywhere(size_t size, size_t alignment)
@@ -104,25 +155,36 @@ Optional<Range> RangeAllocator::allocate_anywhere(size_t size, size_t alignment)
 
     ScopedSpinLock lock(m_lock);
 
-    for (auto it = m_available_ranges.begin(); !it.is_end(); ++it) {
-        auto& available_range = *it;
-        if (available_range.size() < (effective_size + alignment))
-            continue;
-
+    auto allocate_from = [&](Range available_range) -> Optional<Range> {
         FlatPtr initial_base = available_range.base().offset(offset_from_effective_base).get();
         FlatPtr aligned_base = round_up_to_power_of_two(initial_base, alignment);
+        if (aligned_base + size + offset_from_effective_base > available_range.end().get())
+            return {};
 
         Range const allocated_range(VirtualAddress(aligned_base), size);
-
         VERIFY(m_total_range.contains(allocated_range));
-
-        if (available_range == allocated_range) {
-            m_available_ranges.remove(it.key());
+        carve(available_range, allocated_range);
+        return allocated_range;
+    };
+
+    // Best fit: the smallest range with room. Whether a range barely larger
+    // than the effective size has room depends on how its base is aligned,
+    // only the first few of those are tried before going for the smallest
+    // range that has room wherever it starts.
+    static constexpr size_t maximum_unaligned_candidates = 8;
+    size_t candidate_count = 0;
+    for (auto it = m_available_ranges_by_size.find_smallest_not_below_iterator(size_key(effective_size, m_total_range.base()));
+         !it.is_end() && candidate_count < maximum_unaligned_candidates; ++it, ++candidate_count) {
+        if (auto allocated_range = allocate_from(*it); allocated_range.has_value())
             return allocated_range;
-        }
-        carve_at_iterator(it, allocated_range);
+    }
+
+    if (auto* available_range = m_available_ranges_by_size.find_smallest_not_below(size_key(effective_size + alignment - PAGE_SIZE, m_total_range.base()))) {
+        auto allocated_range = allocate_from(*available_range);
+        VERIFY(allocated_range.has_value());
         return allocated_range;
     }
+
     dmesgln("RangeAllocator: Failed to allocate anywhere: size={}, alignment={}", size, alignment);
     return {};
 }
@@ -141,18 +203,11 @@ Optional<Range> RangeAllocator::allocate_specific(VirtualAddress base, size_t si
     }
 
     ScopedSpinLock lock(m_lock);
-    for (auto it = m_available_ranges.begin(); !it.is_end(); ++it) {
-        auto& available_range = *it;
-        if (!available_range.contains(base, size))
-            continue;
-        if (available_range == allocated_range) {
-            m_available_ranges.remove(it.key());
-            return allocated_range;
-        }
-        carve_at_iterator(it, allocated_range);
-        return allocated_range;
-    }
-    return {};
+    auto* available_range = m_available_ranges.find_largest_not_above(base.get());
+    if (!available_range || !available_range->contains(base, size))
+        return {};
+    carve(*available_range, allocated_range);
+    return allocated_range;
 }
 
 void RangeAllocator::deallocate(Range const& range)
@@ -166,25 +221,17 @@ void RangeAllocator::deallocate(Range const& range)
 
     Range merged_range = range;
 
-    {
-        auto* preceding_range = m_available_ranges.find_largest_not_above(range.base().get());
-        if (preceding_range && preceding_range->end() == range.base()) {
-            preceding_range->m_size += range.size();
-            merged_range = *preceding_range;
-        } else {
-            m_available_ranges.insert(range.base().get(), range);
-        }
+    if (auto* preceding_range = m_available_ranges.find_largest_not_above(range.base().get()); preceding_range && preceding_range->end() == range.base()) {
+        merged_range = { preceding_range->base(), preceding_range->size() + range.size() };
+        remove_available_range(*preceding_range);
     }
 
-    {
-        auto* following_range = m_available_ranges.find_largest_not_above(range.end().get());
-        if (following_range && merged_range.end() == following_range->base()) {
-            auto* existing_range = m_available_ranges.find_largest_not_above(range.base().get());
-            VERIFY(existing_range->base() == merged_range.base());
-            existing_range->m_size += following_range->size();
-            m_available_ranges.remove(following_range->base().get());
-        }
+    if (auto* following_range = m_available_ranges.find(range.end().get())) {
+        merged_range.m_size += following_range->size();
+        remove_available_range(*following_range);
     }
+
+    insert_available_range(merged_range);
 }
 
-}
\ No newline at end of file
+}
@@ -32,9 +32,16 @@ public:
     bool contains(Range const& range) const { return m_total_range.contains(range); }
 
 private:
-    void carve_at_iterator(auto&, Range const&);
-
+    u64 size_key(size_t size, VirtualAddress base) const;
+    u64 size_key(Range const& range) const { return size_key(range.size(), range.base()); }
+    void insert_available_range(Range const&);
+    void remove_available_range(Range);
+    void carve(Range available_range, Range const&);
+
+    // The free ranges by base, and again by size with ties broken by base,
+    // so allocations can look for the smallest range they fit in.
     RedBlackTree<FlatPtr, Range> m_available_ranges;
+    RedBlackTree<u64, Range> m_available_ranges_by_size;
     Range m_total_range;
     mutable SpinLock<u8> m_lock;
 };
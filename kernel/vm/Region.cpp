@@ -6,7 +6,10 @@
 
 // includes
 #include <base/Memory.h>
+#include <base/ScopeGuard.h>
 #include <base/StringView.h>
+#include <kernel/arch/x86/InterruptDisabler.h>
+#include <kernel/arch/x86/PageOperations.h>
 #include <kernel/Debug.h>
 #include <kernel/FileSystem/Inode.h>
 #include <kernel/Panic.h>
@@ -17,9 +20,13 @@
 #include <kernel/vm/PageDirectory.h>
 #include <kernel/vm/Region.h>
 #include <kernel/vm/SharedInodeVMObject.h>
+#include <kernel/vm/Space.h>
+#include <kernel/vm/TLBFlushBatch.h>
 
 namespace Kernel {
 
+SlabCache Region::s_slab_cache { "Region", sizeof(Region) };
+
 Region::Region(Range const& range, NonnullRefPtr<VMObject> vmobject, size_t offset_in_vmobject, OwnPtr<KString> name, Region::Access access, Cacheable cacheable, bool shared)
     : m_range(range)
     , m_offset_in_vmobject(offset_in_vmobject)
@@ -27,7 +34,7 @@ Region::Region(Range const& range, NonnullRefPtr<VMObject> vmobject, size_t offs
     , m_name(move(name))
     , m_access(access | ((access & 0x7) << 4))
     , m_shared(shared)
-    , m_cacheable(cacheable == Cacheable::Yes)
+    , m_memory_type(cacheable == Cacheable::Yes ? MemoryType::WriteBack : MemoryType::Uncacheable)
 {
     VERIFY(m_range.base().is_page_aligned());
     VERIFY(m_range.size());
@@ -39,6 +46,8 @@ Region::Region(Range const& range, NonnullRefPtr<VMObject> vmobject, size_t offs
 
 Region::~Region()
 {
+    if (m_accounting_space)
+        set_accounting_space(nullptr);
     m_vmobject->remove_region(*this);
 
     ScopedSpinLock lock(s_mm_lock);
@@ -62,7 +71,7 @@ OwnPtr<Region> Region::clone()
             VERIFY(vmobject().is_shared_inode());
 
         auto region = Region::try_create_user_accessible(
-            m_range, m_vmobject, m_offset_in_vmobject, m_name ? m_name->try_clone() : OwnPtr<KString> {}, access(), m_cacheable ? Cacheable::Yes : Cacheable::No, m_shared);
+            m_range, m_vmobject, m_offset_in_vmobject, m_name ? m_name->try_clone() : OwnPtr<KString> {}, access(), is_cacheable() ? Cacheable::Yes : Cacheable::No, m_shared);
         if (!region) {
             dbgln("Region::clone: Unable to allocate new Region");
             return nullptr;
@@ -70,6 +79,9 @@ OwnPtr<Region> Region::clone()
         region->set_mmap(m_mmap);
         region->set_shared(m_shared);
         region->set_syscall_region(is_syscall_region());
+        region->set_access_hint(m_access_hint);
+        region->set_mergeable(m_mergeable);
+        region->m_memory_type = m_memory_type;
         return region;
     }
 
@@ -80,9 +92,11 @@ OwnPtr<Region> Region::clone()
     if (!vmobject_clone)
         return {};
 
-    remap();
+    // Every page of ours is copy-on-write now, which only takes taking
+    // away write access from the mappings that are already there.
+    write_protect();
     auto clone_region = Region::try_create_user_accessible(
-        m_range, vmobject_clone.release_nonnull(), m_offset_in_vmobject, m_name ? m_name->try_clone() : OwnPtr<KString> {}, access(), m_cacheable ? Cacheable::Yes : Cacheable::No, m_shared);
+        m_range, vmobject_clone.release_nonnull(), m_offset_in_vmobject, m_name ? m_name->try_clone() : OwnPtr<KString> {}, access(), is_cacheable() ? Cacheable::Yes : Cacheable::No, m_shared);
     if (!clone_region) {
         dbgln("Region::clone: Unable to allocate new Region for COW");
         return nullptr;
@@ -95,6 +109,9 @@ OwnPtr<Region> Region::clone()
     }
     clone_region->set_syscall_region(is_syscall_region());
     clone_region->set_mmap(m_mmap);
+    clone_region->set_access_hint(m_access_hint);
+    clone_region->set_mergeable(m_mergeable);
+    clone_region->m_memory_type = m_memory_type;
     return clone_region;
 }
 
@@ -102,9 +119,14 @@ void Region::set_vmobject(NonnullRefPtr<VMObject>&& obj)
 {
     if (m_vmobject.ptr() == obj.ptr())
         return;
+    auto* space = m_accounting_space;
+    if (space)
+        set_accounting_space(nullptr);
     m_vmobject->remove_region(*this);
     m_vmobject = move(obj);
     m_vmobject->add_region(*this);
+    if (space)
+        set_accounting_space(space);
 }
 
 size_t Region::cow_pages() const
@@ -123,24 +145,56 @@ size_t Region::amount_dirty() const
 
 size_t Region::amount_resident() const
 {
-    size_t bytes = 0;
-    for (size_t i = 0; i < page_count(); ++i) {
-        auto* page = physical_page(i);
-        if (page && !page->is_shared_zero_page() && !page->is_lazy_committed_page())
-            bytes += PAGE_SIZE;
-    }
-    return bytes;
+    return m_resident_pages * PAGE_SIZE;
 }
 
 size_t Region::amount_shared() const
 {
-    size_t bytes = 0;
+    return m_shared_pages * PAGE_SIZE;
+}
+
+void Region::recount_pages()
+{
+    VERIFY(m_vmobject->m_lock.is_locked());
+    size_t resident_pages = 0;
+    size_t shared_pages = 0;
     for (size_t i = 0; i < page_count(); ++i) {
-        auto* page = physical_page(i);
-        if (page && page->ref_count() > 1 && !page->is_shared_zero_page() && !page->is_lazy_committed_page())
-            bytes += PAGE_SIZE;
+        auto page_index = translate_to_vmobject_page(i);
+        if (m_vmobject->is_page_resident(page_index))
+            ++resident_pages;
+        if (m_vmobject->is_page_shared(page_index))
+            ++shared_pages;
     }
-    return bytes;
+    account_pages((ssize_t)resident_pages - (ssize_t)m_resident_pages, (ssize_t)shared_pages - (ssize_t)m_shared_pages);
+}
+
+void Region::account_pages(ssize_t resident_delta, ssize_t shared_delta)
+{
+    m_resident_pages += resident_delta;
+    m_shared_pages += shared_delta;
+    if (!m_accounting_space)
+        return;
+    ssize_t dirty_private_delta = !m_shared && !m_vmobject->is_inode() ? resident_delta : 0;
+    m_accounting_space->account({}, 0, resident_delta * PAGE_SIZE, shared_delta * PAGE_SIZE, dirty_private_delta * PAGE_SIZE);
+}
+
+void Region::set_accounting_space(Space* space)
+{
+    ScopedSpinLock locker(m_vmobject->m_lock);
+    if (m_accounting_space) {
+        ssize_t dirty_private = m_shared ? 0 : (m_vmobject->is_inode() ? m_accounted_inode_dirty : amount_resident());
+        m_accounting_space->account({}, -(ssize_t)size(), -(ssize_t)amount_resident(), -(ssize_t)amount_shared(), -dirty_private);
+    }
+
+    m_accounting_space = space;
+    if (!space)
+        return;
+
+    // The dirty bits of inode pages only come in with a clone, so what a
+    // private file mapping adds is counted once here.
+    m_accounted_inode_dirty = !m_shared && m_vmobject->is_inode() ? amount_dirty() : 0;
+    ssize_t dirty_private = m_shared ? 0 : (m_vmobject->is_inode() ? m_accounted_inode_dirty : amount_resident());
+    space->account({}, size(), amount_resident(), amount_shared(), dirty_private);
 }
 
 OwnPtr<Region> Region::try_create_user_accessible(Range const& range, NonnullRefPtr<VMObject> vmobject, size_t offset_in_vmobject, OwnPtr<KString> name, Region::Access access, Cacheable cacheable, bool shared)
@@ -185,24 +239,141 @@ bool Region::map_individual_page_impl(size_t page_index)
     auto* pte = MM.ensure_pte(*m_page_directory, page_vaddr);
     if (!pte)
         return false;
+    update_pte(*pte, page_index, user_allowed);
+    return true;
+}
+
+// Like map_individual_page_impl(), but for every page from page_index to
+// the end of its page table, with a single walk of the page tables.
+// Returns how many pages were mapped.
+size_t Region::map_page_table_impl(size_t page_index)
+{
+    VERIFY(m_page_directory->get_lock().own_lock());
+    auto page_vaddr = vaddr_from_page_index(page_index);
+    size_t count = min(page_count() - page_index, 512 - ((page_vaddr.get() >> 12) & 0x1ff));
+
+    ScopedSpinLock mm_locker(s_mm_lock);
+
+    auto* pte = MM.ensure_pte(*m_page_directory, page_vaddr);
+    if (!pte)
+        return 0;
+    for (size_t i = 0; i < count; ++i) {
+        auto vaddr = page_vaddr.offset(i * PAGE_SIZE);
+        bool user_allowed = vaddr.get() >= 0x00800000 && is_user_address(vaddr);
+        if (is_mmap() && !user_allowed) {
+            PANIC("About to map mmap'ed page at a kernel address");
+        }
+        update_pte(pte[i], page_index + i, user_allowed);
+    }
+    return count;
+}
+
+void Region::update_pte(PageTableEntry& pte, size_t page_index, bool user_allowed)
+{
     auto* page = physical_page(page_index);
     if (!page || (!is_readable() && !is_writable())) {
-        pte->clear();
+        pte.clear();
     } else {
-        pte->set_cache_disabled(!m_cacheable);
-        pte->set_physical_page_base(page->paddr().get());
-        pte->set_present(true);
+        pte.set_memory_type(m_memory_type);
+        pte.set_physical_page_base(page->paddr().get());
+        pte.set_present(true);
         if (page->is_shared_zero_page() || page->is_lazy_committed_page() || should_cow(page_index))
-            pte->set_writable(false);
+            pte.set_writable(false);
         else
-            pte->set_writable(is_writable());
+            pte.set_writable(is_writable());
         if (Processor::current().has_feature(CPUFeature::NX))
-            pte->set_execute_disabled(!is_executable());
-        pte->set_user_allowed(user_allowed);
+            pte.set_execute_disabled(!is_executable());
+        pte.set_user_allowed(user_allowed);
     }
+}
+
+// Maps the 2 MiB starting at page_index with one large page if it can be,
+// i.e. everything in it is backed by one aligned run of physical memory
+// with the same permissions. Returns false to leave it to 4 KiB pages.
+bool Region::map_large_page_impl(size_t page_index)
+{
+    VERIFY(m_page_directory->get_lock().own_lock());
+    constexpr size_t large_page_size = 2 * MiB;
+    constexpr size_t large_page_count = large_page_size / PAGE_SIZE;
+
+    auto page_vaddr = vaddr_from_page_index(page_index);
+    if (page_vaddr.get() % large_page_size || page_index + large_page_count > page_count())
+        return false;
+    if (!is_readable() && !is_writable())
+        return false;
+
+    auto* first_page = physical_page(page_index);
+    if (!first_page || first_page->paddr().get() % large_page_size)
+        return false;
+    for (size_t i = 0; i < large_page_count; ++i) {
+        auto* page = physical_page(page_index + i);
+        if (!page || page->paddr() != first_page->paddr().offset(i * PAGE_SIZE))
+            return false;
+        if (page->is_shared_zero_page() || page->is_lazy_committed_page() || should_cow(page_index + i))
+            return false;
+    }
+
+    bool user_allowed = page_vaddr.get() >= 0x00800000 && is_user_address(page_vaddr);
+    if (is_mmap() && !user_allowed) {
+        PANIC("About to map mmap'ed page at a kernel address");
+    }
+
+    ScopedSpinLock mm_locker(s_mm_lock);
+
+    auto* pde = MM.ensure_large_pde(*m_page_directory, page_vaddr);
+    if (!pde)
+        return false;
+    pde->clear();
+    pde->set_large_page_base(first_page->paddr().get());
+    pde->set_huge(true);
+    pde->set_memory_type(m_memory_type);
+    pde->set_writable(is_writable());
+    if (Processor::current().has_feature(CPUFeature::NX))
+        pde->set_execute_disabled(!is_executable());
+    pde->set_user_allowed(user_allowed);
+    pde->set_global(m_page_directory == &MM.kernel_page_directory());
+    pde->set_present(true);
     return true;
 }
 
+// Maps the 2 MiB starting at page_index through the page table everyone
+// mapping that part of a shared inode read-only uses. Returns how many
+// pages were mapped, 0 to leave it to a page table of our own.
+size_t Region::map_shared_page_table_impl(size_t page_index)
+{
+    VERIFY(m_page_directory->get_lock().own_lock());
+    constexpr size_t page_table_size = 2 * MiB;
+    constexpr size_t page_table_page_count = page_table_size / PAGE_SIZE;
+
+    if (!vmobject().is_shared_inode())
+        return 0;
+    auto page_vaddr = vaddr_from_page_index(page_index);
+    if (page_vaddr.get() % page_table_size || page_index + page_table_page_count > page_count())
+        return 0;
+
+    ScopedSpinLock mm_locker(s_mm_lock);
+
+    // A table shared before the region was made writable has to be
+    // given back, the others using it must not see the change.
+    auto& vmobject = static_cast<SharedInodeVMObject&>(this->vmobject());
+    bool user_allowed = page_vaddr.get() >= 0x00800000 && is_user_address(page_vaddr.offset(page_table_size - 1));
+    if (!is_user() || !user_allowed || !is_readable() || is_writable() || !is_cacheable()) {
+        MM.release_shared_page_table(*m_page_directory, page_vaddr, vmobject);
+        return 0;
+    }
+
+    bool is_new = false;
+    auto key = SharedInodeVMObject::shared_page_table_key(first_page_index() + page_index, is_executable());
+    auto* pte = MM.ensure_shared_page_table(*m_page_directory, page_vaddr, vmobject, key, is_new);
+    if (!pte)
+        return 0;
+    if (is_new) {
+        for (size_t i = 0; i < page_table_page_count; ++i)
+            update_pte(pte[i], page_index + i, true);
+    }
+    return page_table_page_count;
+}
+
 bool Region::do_remap_vmobject_page(size_t page_index, bool with_flush)
 {
     ScopedSpinLock lock(vmobject().m_lock);
@@ -229,7 +400,28 @@ bool Region::remap_vmobject_page(size_t page_index, bool with_flush)
     return success;
 }
 
-void Region::unmap(ShouldDeallocateVirtualMemoryRange deallocate_range)
+bool Region::remap_vmobject_page_range(size_t page_index, size_t page_count)
+{
+    if (!m_page_directory)
+        return true;
+    if (!translate_vmobject_page_range(page_index, page_count))
+        return true;
+    ScopedSpinLock page_lock(m_page_directory->get_lock());
+    size_t index = page_index;
+    bool success = true;
+    while (index < page_index + page_count) {
+        if (!map_individual_page_impl(index)) {
+            success = false;
+            break;
+        }
+        ++index;
+    }
+    if (index > page_index)
+        MM.flush_tlb(m_page_directory, vaddr_from_page_index(page_index), index - page_index);
+    return success;
+}
+
+void Region::unmap(ShouldDeallocateVirtualMemoryRange deallocate_range, TLBFlushBatch* flush_batch)
 {
     ScopedSpinLock lock(s_mm_lock);
     if (!m_page_directory)
@@ -238,9 +430,18 @@ void Region::unmap(ShouldDeallocateVirtualMemoryRange deallocate_range)
     size_t count = page_count();
     for (size_t i = 0; i < count; ++i) {
         auto vaddr = vaddr_from_page_index(i);
+        if (vmobject().is_shared_inode() && MM.release_shared_page_table(*m_page_directory, vaddr, static_cast<SharedInodeVMObject&>(vmobject()))) {
+            i += (2 * MiB) / PAGE_SIZE - 1;
+            continue;
+        }
         MM.release_pte(*m_page_directory, vaddr, i == count - 1);
     }
-    MM.flush_tlb(m_page_directory, vaddr(), page_count());
+    if (flush_batch) {
+        VERIFY(&flush_batch->page_directory() == m_page_directory.ptr());
+        flush_batch->add(vaddr(), page_count());
+    } else {
+        MM.flush_tlb(m_page_directory, vaddr(), page_count());
+    }
     if (deallocate_range == ShouldDeallocateVirtualMemoryRange::Yes) {
         if (m_page_directory->range_allocator().contains(range()))
             m_page_directory->range_allocator().deallocate(range());
@@ -269,9 +470,18 @@ bool Region::map(PageDirectory& page_directory, ShouldFlushTLB should_flush_tlb)
     set_page_directory(page_directory);
     size_t page_index = 0;
     while (page_index < page_count()) {
-        if (!map_individual_page_impl(page_index))
+        if (map_large_page_impl(page_index)) {
+            page_index += (2 * MiB) / PAGE_SIZE;
+            continue;
+        }
+        if (auto shared_count = map_shared_page_table_impl(page_index)) {
+            page_index += shared_count;
+            continue;
+        }
+        auto mapped_count = map_page_table_impl(page_index);
+        if (!mapped_count)
             break;
-        ++page_index;
+        page_index += mapped_count;
     }
     if (page_index > 0) {
         if (should_flush_tlb == ShouldFlushTLB::Yes)
@@ -281,12 +491,38 @@ bool Region::map(PageDirectory& page_directory, ShouldFlushTLB should_flush_tlb)
     return false;
 }
 
+void Region::write_protect()
+{
+    VERIFY(m_page_directory);
+    ScopedSpinLock lock(s_mm_lock);
+    ScopedSpinLock page_lock(m_page_directory->get_lock());
+    MM.write_protect_range(*m_page_directory, vaddr(), page_count());
+}
+
+size_t Region::collect_accessed_pages(Bitmap* accessed)
+{
+    if (!m_page_directory)
+        return 0;
+    ScopedSpinLock lock(s_mm_lock);
+    ScopedSpinLock page_lock(m_page_directory->get_lock());
+    return MM.clear_accessed_range(*m_page_directory, vaddr(), page_count(), accessed, first_page_index());
+}
+
 void Region::remap()
 {
     VERIFY(m_page_directory);
     map(*m_page_directory);
 }
 
+void Region::set_memory_type(MemoryType type)
+{
+    if (m_memory_type == type)
+        return;
+    m_memory_type = type;
+    if (m_page_directory)
+        remap();
+}
+
 PageFaultResponse Region::handle_fault(PageFault const& fault)
 {
     auto page_index_in_region = page_index_from_address(fault.vaddr());
@@ -305,13 +541,42 @@ PageFaultResponse Region::handle_fault(PageFault const& fault)
         }
 
         auto& page_slot = physical_page_slot(page_index_in_region);
-        if (page_slot->is_lazy_committed_page()) {
+        if (page_slot && page_slot->is_lazy_committed_page()) {
             auto page_index_in_vmobject = translate_to_vmobject_page(page_index_in_region);
             VERIFY(m_vmobject->is_anonymous());
-            page_slot = static_cast<AnonymousVMObject&>(*m_vmobject).allocate_committed_page({});
+            ScopedSpinLock locker(vmobject().m_lock);
+            m_vmobject->set_physical_page(page_index_in_vmobject, static_cast<AnonymousVMObject&>(*m_vmobject).allocate_committed_page({}));
             remap_vmobject_page(page_index_in_vmobject);
             return PageFaultResponse::Continue;
         }
+        if (m_vmobject->is_anonymous()) {
+            // The page was unmapped to be moved to another physical page,
+            // see AnonymousVMObject::migrate_page(). It's back in place once
+            // the VMObject lock is ours.
+            ScopedSpinLock locker(vmobject().m_lock);
+            if (!page_slot.is_null()) {
+                if (!remap_vmobject_page(translate_to_vmobject_page(page_index_in_region)))
+                    return PageFaultResponse::OutOfMemory;
+                return PageFaultResponse::Continue;
+            }
+            auto& anonymous_vmobject = static_cast<AnonymousVMObject&>(*m_vmobject);
+            auto page_index_in_vmobject = translate_to_vmobject_page(page_index_in_region);
+            if (anonymous_vmobject.is_page_compressed(page_index_in_vmobject)) {
+                dbgln_if(PAGE_FAULT_DEBUG, "NP(compressed) fault in Region({})[{}] at {}", this, page_index_in_region, fault.vaddr());
+                if (!anonymous_vmobject.decompress_page(page_index_in_vmobject)) {
+                    dmesgln("MM: handle_fault was unable to allocate a physical page for a compressed page");
+                    return PageFaultResponse::OutOfMemory;
+                }
+                if (!remap_vmobject_page(page_index_in_vmobject))
+                    return PageFaultResponse::OutOfMemory;
+                return PageFaultResponse::Continue;
+            }
+            if (anonymous_vmobject.is_page_swapped(page_index_in_vmobject)) {
+                locker.unlock();
+                dbgln_if(PAGE_FAULT_DEBUG, "NP(swap) fault in Region({})[{}] at {}", this, page_index_in_region, fault.vaddr());
+                return handle_swap_fault(page_index_in_region);
+            }
+        }
         dbgln("BUG! Unexpected NP fault at {}", fault.vaddr());
         return PageFaultResponse::ShouldCrash;
     }
@@ -329,6 +594,83 @@ PageFaultResponse Region::handle_fault(PageFault const& fault)
     return PageFaultResponse::ShouldCrash;
 }
 
+PageFaultResponse Region::populate(size_t page_index, size_t count)
+{
+    VERIFY(page_index + count <= page_count());
+
+    // The fault handlers run with interrupts disabled.
+    InterruptDisabler disabler;
+    for (size_t i = page_index; i < page_index + count; ++i) {
+        auto response = PageFaultResponse::Continue;
+        if (vmobject().is_inode()) {
+            bool is_present;
+            {
+                ScopedSpinLock locker(vmobject().m_lock);
+                is_present = !physical_page_slot(i).is_null();
+            }
+            if (!is_present)
+                response = handle_inode_fault(i);
+        } else if (vmobject().is_anonymous()) {
+            // Lazily committed pages are already paid for, everything else
+            // can stay shared with the zero page until it's written to.
+            auto* page = physical_page(i);
+            if (page && page->is_lazy_committed_page())
+                response = handle_zero_fault(i);
+        }
+        if (response != PageFaultResponse::Continue)
+            return response;
+    }
+    return PageFaultResponse::Continue;
+}
+
+KResultOr<NonnullRefPtr<PhysicalPage>> Region::pin_page(size_t page_index, bool for_write)
+{
+    VERIFY_INTERRUPTS_DISABLED();
+    VERIFY(page_index < page_count());
+    if (for_write ? !is_writable() : !is_readable())
+        return EFAULT;
+
+    auto page_vaddr = vaddr_from_page_index(page_index);
+    for (;;) {
+        u16 fault_code = PageFaultFlags::UserMode | (for_write ? PageFaultFlags::Write : PageFaultFlags::Read);
+        {
+            ScopedSpinLock locker(vmobject().m_lock);
+            auto& page_slot = physical_page_slot(page_index);
+            if (page_slot) {
+                if (!for_write && !page_slot->is_lazy_committed_page())
+                    return NonnullRefPtr<PhysicalPage>(*page_slot);
+                if (for_write && !should_cow(page_index))
+                    return NonnullRefPtr<PhysicalPage>(*page_slot);
+                if (for_write)
+                    fault_code |= PageFaultFlags::ProtectionViolation;
+            }
+        }
+
+        // The page may be gone again by the time we look, so go around
+        // until it's there as wanted.
+        auto response = handle_fault(PageFault(fault_code, page_vaddr));
+        if (response == PageFaultResponse::OutOfMemory)
+            return ENOMEM;
+        if (response != PageFaultResponse::Continue)
+            return EFAULT;
+    }
+}
+
+void Region::discard(size_t page_index, size_t count)
+{
+    VERIFY(page_index + count <= page_count());
+    auto page_index_in_vmobject = translate_to_vmobject_page(page_index);
+
+    if (vmobject().is_inode()) {
+        static_cast<InodeVMObject&>(vmobject()).release_clean_pages(page_index_in_vmobject, count);
+        return;
+    }
+
+    // Other mappings of shared memory still expect to find their data.
+    if (vmobject().is_anonymous() && !m_shared)
+        static_cast<AnonymousVMObject&>(vmobject()).discard_pages(page_index_in_vmobject, count);
+}
+
 PageFaultResponse Region::handle_zero_fault(size_t page_index_in_region)
 {
     VERIFY_INTERRUPTS_DISABLED();
@@ -350,18 +692,21 @@ PageFaultResponse Region::handle_zero_fault(size_t page_index_in_region)
     if (current_thread != nullptr)
         current_thread->did_zero_fault();
 
+    auto& anonymous_vmobject = static_cast<AnonymousVMObject&>(*m_vmobject);
     if (page_slot->is_lazy_committed_page()) {
-        VERIFY(m_vmobject->is_anonymous());
-        page_slot = static_cast<AnonymousVMObject&>(*m_vmobject).allocate_committed_page({});
+        anonymous_vmobject.set_physical_page(page_index_in_vmobject, anonymous_vmobject.allocate_committed_page({}));
         dbgln_if(PAGE_FAULT_DEBUG, "      >> ALLOCATED COMMITTED {}", page_slot->paddr());
     } else {
-        page_slot = MM.allocate_user_physical_page(MemoryManager::ShouldZeroFill::Yes);
-        if (page_slot.is_null()) {
+        auto page = MM.allocate_user_physical_page(MemoryManager::ShouldZeroFill::Yes);
+        if (page.is_null()) {
             dmesgln("MM: handle_zero_fault was unable to allocate a physical page");
             return PageFaultResponse::OutOfMemory;
         }
+        anonymous_vmobject.set_physical_page(page_index_in_vmobject, move(page));
         dbgln_if(PAGE_FAULT_DEBUG, "      >> ALLOCATED {}", page_slot->paddr());
     }
+    // The page is ours alone, whatever the zero page it replaced was.
+    anonymous_vmobject.set_should_cow(page_index_in_vmobject, false);
 
     if (!remap_vmobject_page(page_index_in_vmobject)) {
         dmesgln("MM: handle_zero_fault was unable to allocate a page table to map {}", page_slot);
@@ -370,6 +715,35 @@ PageFaultResponse Region::handle_zero_fault(size_t page_index_in_region)
     return PageFaultResponse::Continue;
 }
 
+PageFaultResponse Region::handle_swap_fault(size_t page_index_in_region)
+{
+    VERIFY_INTERRUPTS_DISABLED();
+    VERIFY(vmobject().is_anonymous());
+
+    auto& anonymous_vmobject = static_cast<AnonymousVMObject&>(vmobject());
+    auto page_index_in_vmobject = translate_to_vmobject_page(page_index_in_region);
+
+    // Pages swapped out together were inactive together and tend to be
+    // needed together, so the ones right after ours come along if they
+    // sit in the slots right after its own.
+    size_t window = 1;
+    if (m_access_hint != AccessHint::Random)
+        window = min(AnonymousVMObject::max_swap_read_ahead_pages, page_count() - page_index_in_region);
+
+    size_t swapped_in_count = 0;
+    auto response = anonymous_vmobject.swap_in_pages(page_index_in_vmobject, window, swapped_in_count);
+    if (response != PageFaultResponse::Continue)
+        return response;
+
+    // Whoever brought the page back, if not us, may not have mapped it here.
+    ScopedSpinLock locker(anonymous_vmobject.m_lock);
+    if (!remap_vmobject_page(page_index_in_vmobject))
+        return PageFaultResponse::OutOfMemory;
+    for (size_t i = 1; i < swapped_in_count; ++i)
+        remap_vmobject_page(page_index_in_vmobject + i);
+    return PageFaultResponse::Continue;
+}
+
 PageFaultResponse Region::handle_cow_fault(size_t page_index_in_region)
 {
     VERIFY_INTERRUPTS_DISABLED();
@@ -397,8 +771,6 @@ PageFaultResponse Region::handle_inode_fault(size_t page_index_in_region)
     auto& inode_vmobject = static_cast<InodeVMObject&>(vmobject());
 
     auto page_index_in_vmobject = translate_to_vmobject_page(page_index_in_region);
-    auto& vmobject_physical_page_entry = inode_vmobject.physical_pages()[page_index_in_vmobject];
-    VERIFY(vmobject_physical_page_entry.is_null());
 
     dbgln_if(PAGE_FAULT_DEBUG, "Inode fault in {} page index: {}", name(), page_index_in_region);
 
@@ -406,11 +778,53 @@ PageFaultResponse Region::handle_inode_fault(size_t page_index_in_region)
     if (current_thread)
         current_thread->did_inode_fault();
 
+    size_t window = 1;
+    if (m_access_hint == AccessHint::Sequential)
+        window = InodeVMObject::max_read_ahead_pages;
+    else if (m_access_hint == AccessHint::Normal)
+        window = inode_vmobject.read_ahead_pages_for_fault(page_index_in_vmobject);
+    window = min(window, page_count() - page_index_in_region);
+
+    // Along with the faulting page, read the pages after it that nobody
+    // has or is reading in yet, as far as the read-ahead window and the
+    // region go. If another fault is reading our page already, wait for it.
+    size_t page_count_to_read = 1;
+    for (;;) {
+        ScopedSpinLock locker(inode_vmobject.m_lock);
+        auto pages = inode_vmobject.physical_pages();
+        if (!pages[page_index_in_vmobject].is_null()) {
+            dbgln_if(PAGE_FAULT_DEBUG, "handle_inode_fault: Page faulted in by someone else, remapping.");
+            if (!remap_vmobject_page(page_index_in_vmobject))
+                return PageFaultResponse::OutOfMemory;
+            return PageFaultResponse::Continue;
+        }
+        if (!inode_vmobject.is_page_in_flight(page_index_in_vmobject)) {
+            while (page_count_to_read < window && pages[page_index_in_vmobject + page_count_to_read].is_null()
+                && !inode_vmobject.is_page_in_flight(page_index_in_vmobject + page_count_to_read))
+                ++page_count_to_read;
+            inode_vmobject.start_page_in(page_index_in_vmobject, page_count_to_read);
+            break;
+        }
+        locker.unlock();
+        inode_vmobject.wait_for_page_in();
+    }
+    ScopeGuard finish_page_in([&] {
+        inode_vmobject.finish_page_in(page_index_in_vmobject, page_count_to_read);
+    });
+
     u8 page_buffer[PAGE_SIZE];
+    u8* read_buffer = page_buffer;
+    if (page_count_to_read > 1)
+        read_buffer = (u8*)kmalloc(page_count_to_read * PAGE_SIZE);
+    ScopeGuard free_read_buffer([&] {
+        if (read_buffer != page_buffer)
+            kfree(read_buffer);
+    });
+
     auto& inode = inode_vmobject.inode();
 
-    auto buffer = UserOrKernelBuffer::for_kernel_buffer(page_buffer);
-    auto result = inode.read_bytes(page_index_in_vmobject * PAGE_SIZE, PAGE_SIZE, buffer, nullptr);
+    auto buffer = UserOrKernelBuffer::for_kernel_buffer(read_buffer);
+    auto result = inode.read_bytes(page_index_in_vmobject * PAGE_SIZE, page_count_to_read * PAGE_SIZE, buffer, nullptr);
 
     if (result.is_error()) {
         dmesgln("handle_inode_fault: Error ({}) while reading from inode", result.error());
@@ -418,31 +832,41 @@ PageFaultResponse Region::handle_inode_fault(size_t page_index_in_region)
     }
 
     auto nread = result.value();
-    if (nread < PAGE_SIZE) {
-        memset(page_buffer + nread, 0, PAGE_SIZE - nread);
+    if (nread < page_count_to_read * PAGE_SIZE) {
+        memset(read_buffer + nread, 0, page_count_to_read * PAGE_SIZE - nread);
+    }
+
+    // A sequential reader won't come back for what it has already read.
+    // Keep one window behind it in case it backs up a little.
+    if (m_access_hint == AccessHint::Sequential && page_index_in_region >= 2 * InodeVMObject::max_read_ahead_pages) {
+        size_t behind = InodeVMObject::max_read_ahead_pages;
+        inode_vmobject.release_clean_pages(page_index_in_vmobject - 2 * behind, behind);
     }
 
     ScopedSpinLock locker(inode_vmobject.m_lock);
 
-    if (!vmobject_physical_page_entry.is_null()) {
-        dbgln_if(PAGE_FAULT_DEBUG, "handle_inode_fault: Page faulted in by someone else, remapping.");
-        if (!remap_vmobject_page(page_index_in_vmobject))
+    for (size_t i = 0; i < page_count_to_read; ++i) {
+        // Nobody else fills in a page while it's in flight.
+        auto& physical_page_entry = inode_vmobject.physical_pages()[page_index_in_vmobject + i];
+        VERIFY(physical_page_entry.is_null());
+
+        auto page = MM.allocate_user_physical_page(MemoryManager::ShouldZeroFill::No);
+        if (page.is_null()) {
+            // The pages read ahead are only a bonus.
+            if (i != 0)
+                break;
+            dmesgln("MM: handle_inode_fault was unable to allocate a physical page");
             return PageFaultResponse::OutOfMemory;
-        return PageFaultResponse::Continue;
-    }
+        }
+        inode_vmobject.set_physical_page(page_index_in_vmobject + i, move(page));
 
-    vmobject_physical_page_entry = MM.allocate_user_physical_page(MemoryManager::ShouldZeroFill::No);
+        // Only the faulting page is needed right away.
+        u8* dest_ptr = MM.quickmap_page(*physical_page_entry);
+        copy_page(dest_ptr, read_buffer + i * PAGE_SIZE, i ? PageTemporality::Cold : PageTemporality::Hot);
+        MM.unquickmap_page();
 
-    if (vmobject_physical_page_entry.is_null()) {
-        dmesgln("MM: handle_inode_fault was unable to allocate a physical page");
-        return PageFaultResponse::OutOfMemory;
+        remap_vmobject_page(page_index_in_vmobject + i);
     }
-
-    u8* dest_ptr = MM.quickmap_page(*vmobject_physical_page_entry);
-    memcpy(dest_ptr, page_buffer, PAGE_SIZE);
-    MM.unquickmap_page();
-
-    remap_vmobject_page(page_index_in_vmobject);
     return PageFaultResponse::Continue;
 }
 
@@ -10,9 +10,11 @@
 #include <base/EnumBits.h>
 #include <base/IntrusiveList.h>
 #include <base/Weakable.h>
+#include <kernel/arch/x86/PAT.h>
 #include <kernel/arch/x86/PageFault.h>
 #include <kernel/Forward.h>
 #include <kernel/Heap/SlabAllocator.h>
+#include <kernel/KResult.h>
 #include <kernel/KString.h>
 #include <kernel/Sections.h>
 #include <kernel/UnixTypes.h>
@@ -21,6 +23,8 @@
 
 namespace Kernel {
 
+class TLBFlushBatch;
+
 enum class ShouldFlushTLB {
     No,
     Yes,
@@ -29,8 +33,9 @@ enum class ShouldFlushTLB {
 class Region final
     : public Weakable<Region> {
     friend class MemoryManager;
+    friend class VMObject;
 
-    MAKE_SLAB_ALLOCATED(Region)
+    MAKE_SLAB_CACHE_ALLOCATED(Region)
 public:
     enum Access : u8 {
         None = 0,
@@ -47,6 +52,16 @@ public:
         Yes,
     };
 
+    // How the region is going to be accessed, as told by madvise(). File
+    // mappings make use of it: it decides how far a fault reads ahead and
+    // whether pages behind a sequential reader are kept. Random access
+    // also keeps swap-ins from reading ahead.
+    enum class AccessHint : u8 {
+        Normal,
+        Random,
+        Sequential,
+    };
+
     static OwnPtr<Region> try_create_user_accessible(Range const&, NonnullRefPtr<VMObject>, size_t offset_in_vmobject, OwnPtr<KString> name, Region::Access access, Cacheable, bool shared);
     static OwnPtr<Region> try_create_kernel_only(Range const&, NonnullRefPtr<VMObject>, size_t offset_in_vmobject, OwnPtr<KString> name, Region::Access access, Cacheable = Cacheable::Yes);
 
@@ -63,7 +78,11 @@ public:
     bool has_been_writable() const { return m_access & Access::HasBeenWritable; }
     bool has_been_executable() const { return m_access & Access::HasBeenExecutable; }
 
-    bool is_cacheable() const { return m_cacheable; }
+    bool is_cacheable() const { return m_memory_type == MemoryType::WriteBack; }
+    MemoryType memory_type() const { return m_memory_type; }
+    // Cacheable::No is strictly uncacheable, framebuffers want write
+    // combining instead. Remaps the region if it is mapped.
+    void set_memory_type(MemoryType);
     StringView name() const { return m_name ? m_name->view() : StringView {}; }
     OwnPtr<KString> take_name() { return move(m_name); }
     Region::Access access() const { return static_cast<Region::Access>(m_access); }
@@ -180,6 +199,10 @@ public:
     size_t amount_shared() const;
     size_t amount_dirty() const;
 
+    // Adds our amounts to the Space's, and takes them away from the one
+    // we were in. Our VMObject keeps them up to date from then on.
+    void set_accounting_space(Space*);
+
     bool should_cow(size_t page_index) const;
     void set_should_cow(size_t page_index, bool);
 
@@ -195,13 +218,46 @@ public:
         No,
         Yes,
     };
-    void unmap(ShouldDeallocateVirtualMemoryRange = ShouldDeallocateVirtualMemoryRange::Yes);
+    // With a batch the TLB flush is left to it, see TLBFlushBatch.
+    void unmap(ShouldDeallocateVirtualMemoryRange = ShouldDeallocateVirtualMemoryRange::Yes, TLBFlushBatch* = nullptr);
 
     void remap();
 
+    // Makes all present pages read-only in one pass over the page tables.
+    void write_protect();
+
+    // Maps the given pages of the VMObject again in this region, for the
+    // VMObject to call on each of its regions after it replaced them.
+    bool remap_vmobject_page_range(size_t page_index, size_t page_count);
+
+    // Clears the accessed bits of our pages, marking the ones that had it
+    // set in accessed (indexed by VMObject page), and returns how many did.
+    size_t collect_accessed_pages(Bitmap* accessed);
+
     bool is_syscall_region() const { return m_syscall_region; }
     void set_syscall_region(bool b) { m_syscall_region = b; }
 
+    AccessHint access_hint() const { return m_access_hint; }
+    void set_access_hint(AccessHint hint) { m_access_hint = hint; }
+
+    // Whether the MemoryManager may share pages of ours with identical
+    // pages elsewhere, for MADV_MERGEABLE.
+    bool is_mergeable() const { return m_mergeable; }
+    void set_mergeable(bool b) { m_mergeable = b; }
+
+    // Brings in the pages that would otherwise fault on their first touch,
+    // for MADV_WILLNEED.
+    PageFaultResponse populate(size_t page_index, size_t page_count);
+
+    // Faults the page in as an access would, copying it first if it's
+    // copy-on-write and for_write is set, and returns a reference to it.
+    // The reference keeps the page from being freed, migrated or merged.
+    KResultOr<NonnullRefPtr<PhysicalPage>> pin_page(size_t page_index, bool for_write);
+
+    // Drops the pages so they are faulted in again: zero filled for private
+    // anonymous memory, read back in for file mappings. For MADV_DONTNEED.
+    void discard(size_t page_index, size_t page_count);
+
 private:
     Region(Range const&, NonnullRefPtr<VMObject>, size_t offset_in_vmobject, OwnPtr<KString>, Region::Access access, Cacheable, bool shared);
 
@@ -218,9 +274,18 @@ private:
 
     PageFaultResponse handle_cow_fault(size_t page_index);
     PageFaultResponse handle_inode_fault(size_t page_index);
+    PageFaultResponse handle_swap_fault(size_t page_index);
     PageFaultResponse handle_zero_fault(size_t page_index);
 
     bool map_individual_page_impl(size_t page_index);
+    size_t map_page_table_impl(size_t page_index);
+    void update_pte(PageTableEntry&, size_t page_index, bool user_allowed);
+    bool map_large_page_impl(size_t page_index);
+    size_t map_shared_page_table_impl(size_t page_index);
+
+    // Called by our VMObject under its lock, see VMObject::is_page_resident().
+    void recount_pages();
+    void account_pages(ssize_t resident_delta, ssize_t shared_delta);
 
     RefPtr<PageDirectory> m_page_directory;
     Range m_range;
@@ -229,13 +294,20 @@ private:
     OwnPtr<KString> m_name;
     u8 m_access { Region::None };
     bool m_shared : 1 { false };
-    bool m_cacheable : 1 { false };
     bool m_stack : 1 { false };
     bool m_mmap : 1 { false };
     bool m_syscall_region : 1 { false };
+    bool m_mergeable : 1 { false };
+    AccessHint m_access_hint { AccessHint::Normal };
+    MemoryType m_memory_type { MemoryType::Uncacheable };
     IntrusiveListNode<Region> m_memory_manager_list_node;
     IntrusiveListNode<Region> m_vmobject_list_node;
 
+    size_t m_resident_pages { 0 };
+    size_t m_shared_pages { 0 };
+    size_t m_accounted_inode_dirty { 0 };
+    Space* m_accounting_space { nullptr };
+
 public:
     using ListInMemoryManager = IntrusiveList<Region, RawPtr<Region>, &Region::m_memory_manager_list_node>;
     using ListInVMObject = IntrusiveList<Region, RawPtr<Region>, &Region::m_vmobject_list_node>;
@@ -5,6 +5,7 @@
 */
 
 // includes
+#include <kernel/Process.h>
 #include <kernel/UserOrKernelBuffer.h>
 #include <kernel/VM/MemoryManager.h>
 #include <kernel/VM/RingBuffer.h>
@@ -31,6 +32,40 @@ bool RingBuffer::copy_data_in(const UserOrKernelBuffer& buffer, size_t offset, s
     return false;
 }
 
+KResultOr<RingBuffer::Transfer> RingBuffer::prepare_transfer(const UserOrKernelBuffer& buffer, size_t offset, size_t length, DMALimits const& limits)
+{
+    if (!length)
+        return EINVAL;
+
+    auto vaddr = VirtualAddress(buffer.user_or_kernel_ptr()).offset(offset);
+    auto list_or_error = buffer.is_kernel_buffer()
+        ? ScatterGatherList::try_create_for_kernel_range(vaddr, length)
+        : ScatterGatherList::try_create_for_user_range(Process::current()->space(), vaddr, length, false);
+    if (!list_or_error.is_error()) {
+        auto segments_or_error = list_or_error.value()->dma_segments(limits);
+        if (!segments_or_error.is_error())
+            return Transfer { list_or_error.release_value(), segments_or_error.release_value(), length };
+    }
+
+    Transfer transfer;
+    PhysicalAddress start;
+    if (!copy_data_in(buffer, offset, length, start, transfer.size))
+        return has_space() ? EFAULT : ENOSPC;
+    auto result = append_dma_segments(transfer.segments, start, transfer.size, limits);
+    if (result.is_error()) {
+        // The ring itself is out of reach of the device.
+        reclaim_last(transfer.size);
+        return result;
+    }
+    return transfer;
+}
+
+void RingBuffer::reclaim_last(size_t size)
+{
+    VERIFY(m_num_used_bytes >= size);
+    m_num_used_bytes -= size;
+}
+
 KResultOr<size_t> RingBuffer::copy_data_out(size_t size, UserOrKernelBuffer& buffer) const
 {
     auto start = m_start_of_used % m_capacity_in_bytes;
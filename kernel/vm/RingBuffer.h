@@ -10,13 +10,31 @@
 #include <base/String.h>
 #include <kernel/PhysicalAddress.h>
 #include <kernel/UserOrKernelBuffer.h>
+#include <kernel/vm/ScatterGatherList.h>
 
 namespace Kernel {
 
 class RingBuffer {
 public:
+    // The data of one transfer to a device. Without a list, it was copied
+    // into the ring and its space has to be reclaimed once the device is
+    // done with it.
+    struct Transfer {
+        RefPtr<ScatterGatherList> list;
+        Vector<DMASegment> segments;
+        size_t size { 0 };
+
+        bool is_bounced() const { return !list; }
+    };
+
     RingBuffer(String region_name, size_t capacity);
 
+    // Lets the device read the buffer where it is when its pages suit the
+    // limits, which spares a copy per transfer. Only the rest goes through
+    // copy_data_in(), which may take less than length when the ring is
+    // about full or wraps around.
+    KResultOr<Transfer> prepare_transfer(const UserOrKernelBuffer& buffer, size_t offset, size_t length, DMALimits const&);
+
     bool has_space() const { return m_num_used_bytes < m_capacity_in_bytes; }
     bool copy_data_in(const UserOrKernelBuffer& buffer, size_t offset, size_t length, PhysicalAddress& start_of_copied_data, size_t& bytes_copied);
     KResultOr<size_t> copy_data_out(size_t size, UserOrKernelBuffer& buffer) const;
@@ -31,6 +49,8 @@ public:
     size_t bytes_till_end() const { return (m_capacity_in_bytes - ((m_start_of_used + m_num_used_bytes) % m_capacity_in_bytes)) % m_capacity_in_bytes; };
 
 private:
+    void reclaim_last(size_t size);
+
     OwnPtr<Region> m_region;
     SpinLock<u8> m_lock;
     size_t m_start_of_used {};
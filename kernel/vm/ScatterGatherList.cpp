@@ -5,10 +5,50 @@
 */
 
 // includes
+#include <kernel/arch/x86/InterruptDisabler.h>
 #include <kernel/vm/ScatterGatherList.h>
 
 namespace Kernel {
 
+KResult append_dma_segments(Vector<DMASegment>& segments, PhysicalAddress address, size_t size, DMALimits const& limits)
+{
+    if (!size)
+        return KSuccess;
+    if (address.get() > limits.max_address || size - 1 > limits.max_address - address.get())
+        return EOVERFLOW;
+
+    while (size) {
+        PhysicalPtr start = address.get();
+        size_t chunk = size;
+        if (limits.boundary)
+            chunk = min(chunk, (size_t)(limits.boundary - start % limits.boundary));
+
+        if (!segments.is_empty()) {
+            auto& last = segments.last();
+            bool continues = last.address.get() + last.size == start;
+            bool same_window = !limits.boundary || last.address.get() / limits.boundary == start / limits.boundary;
+            if (continues && same_window && last.size < limits.max_segment_size) {
+                size_t extension = min(chunk, limits.max_segment_size - last.size);
+                last.size += extension;
+                address = address.offset(extension);
+                size -= extension;
+                continue;
+            }
+        }
+
+        if (start % limits.address_alignment)
+            return ENOTSUP;
+        if (segments.size() >= limits.max_segment_count)
+            return E2BIG;
+        chunk = min(chunk, limits.max_segment_size);
+        if (!segments.try_append({ address, chunk }))
+            return ENOMEM;
+        address = address.offset(chunk);
+        size -= chunk;
+    }
+    return KSuccess;
+}
+
 RefPtr<ScatterGatherList> ScatterGatherList::try_create(AsyncBlockDeviceRequest& request, Span<NonnullRefPtr<PhysicalPage>> allocated_pages, size_t device_block_size)
 {
     auto vm_object = AnonymousVMObject::try_create_with_physical_pages(allocated_pages);
@@ -17,10 +57,114 @@ RefPtr<ScatterGatherList> ScatterGatherList::try_create(AsyncBlockDeviceRequest&
     return adopt_ref_if_nonnull(new (nothrow) ScatterGatherList(vm_object.release_nonnull(), request, device_block_size));
 }
 
+KResultOr<NonnullRefPtr<ScatterGatherList>> ScatterGatherList::try_create_for_user_range(Space& space, VirtualAddress vaddr, size_t size, bool for_write)
+{
+    if (!size)
+        return EINVAL;
+    auto range_or_error = Range::expand_to_page_boundaries(vaddr.get(), size);
+    if (range_or_error.is_error())
+        return range_or_error.error();
+    auto range = range_or_error.value();
+    if (!is_user_range(range))
+        return EFAULT;
+
+    Vector<NonnullRefPtr<PhysicalPage>> pages;
+    if (!pages.try_ensure_capacity(range.size() / PAGE_SIZE))
+        return ENOMEM;
+    for (size_t i = 0; i < range.size() / PAGE_SIZE; ++i) {
+        auto page_vaddr = range.base().offset(i * PAGE_SIZE);
+        // The fault handlers run with interrupts disabled.
+        InterruptDisabler disabler;
+        auto* region = MM.find_user_region_from_vaddr(space, page_vaddr);
+        if (!region)
+            return EFAULT;
+        auto page_or_error = region->pin_page(region->page_index_from_address(page_vaddr), for_write);
+        if (page_or_error.is_error())
+            return page_or_error.error();
+        pages.unchecked_append(page_or_error.release_value());
+    }
+
+    auto vm_object = AnonymousVMObject::try_create_with_physical_pages(pages.span());
+    if (!vm_object)
+        return ENOMEM;
+    auto list = adopt_ref_if_nonnull(new (nothrow) ScatterGatherList(vm_object.release_nonnull(), vaddr.get() - range.base().get(), size));
+    if (!list || !list->m_dma_region)
+        return ENOMEM;
+    return list.release_nonnull();
+}
+
+KResultOr<NonnullRefPtr<ScatterGatherList>> ScatterGatherList::try_create_for_kernel_range(VirtualAddress vaddr, size_t size)
+{
+    if (!size)
+        return EINVAL;
+    auto range_or_error = Range::expand_to_page_boundaries(vaddr.get(), size);
+    if (range_or_error.is_error())
+        return range_or_error.error();
+    auto range = range_or_error.value();
+
+    auto* region = MM.kernel_region_from_vaddr(vaddr);
+    if (!region || !region->contains(range))
+        return EFAULT;
+
+    Vector<NonnullRefPtr<PhysicalPage>> pages;
+    if (!pages.try_ensure_capacity(range.size() / PAGE_SIZE))
+        return ENOMEM;
+    for (size_t i = 0; i < range.size() / PAGE_SIZE; ++i) {
+        auto* page = region->physical_page(region->page_index_from_address(range.base().offset(i * PAGE_SIZE)));
+        // A lazily committed page that isn't there yet has no address to
+        // give the device.
+        if (!page || page->is_shared_zero_page() || page->is_lazy_committed_page())
+            return EFAULT;
+        pages.unchecked_append(*page);
+    }
+
+    auto vm_object = AnonymousVMObject::try_create_with_physical_pages(pages.span());
+    if (!vm_object)
+        return ENOMEM;
+    auto list = adopt_ref_if_nonnull(new (nothrow) ScatterGatherList(vm_object.release_nonnull(), vaddr, size));
+    if (!list)
+        return ENOMEM;
+    list->m_offset_in_first_page = vaddr.get() - range.base().get();
+    return list.release_nonnull();
+}
+
+KResultOr<Vector<DMASegment>> ScatterGatherList::dma_segments(DMALimits const& limits) const
+{
+    Vector<DMASegment> segments;
+    auto pages = m_vm_object->physical_pages();
+    size_t remaining = m_size;
+    size_t offset = m_offset_in_first_page;
+    for (size_t i = 0; i < pages.size() && remaining; ++i) {
+        size_t chunk = min((size_t)PAGE_SIZE - offset, remaining);
+        auto result = append_dma_segments(segments, pages[i]->paddr().offset(offset), chunk, limits);
+        if (result.is_error())
+            return result;
+        remaining -= chunk;
+        offset = 0;
+    }
+    return segments;
+}
+
 ScatterGatherList::ScatterGatherList(NonnullRefPtr<AnonymousVMObject> vm_object, AsyncBlockDeviceRequest& request, size_t device_block_size)
     : m_vm_object(move(vm_object))
+    , m_size(request.block_count() * device_block_size)
 {
     m_dma_region = MM.allocate_kernel_region_with_vmobject(m_vm_object, page_round_up((request.block_count() * device_block_size)), "AHCI Scattered DMA", Region::Access::Read | Region::Access::Write, Region::Cacheable::Yes);
 }
 
-}
\ No newline at end of file
+ScatterGatherList::ScatterGatherList(NonnullRefPtr<AnonymousVMObject> vm_object, size_t offset_in_first_page, size_t size)
+    : m_vm_object(move(vm_object))
+    , m_offset_in_first_page(offset_in_first_page)
+    , m_size(size)
+{
+    m_dma_region = MM.allocate_kernel_region_with_vmobject(m_vm_object, page_round_up(offset_in_first_page + size), "User Scattered DMA", Region::Access::Read | Region::Access::Write, Region::Cacheable::Yes);
+}
+
+ScatterGatherList::ScatterGatherList(NonnullRefPtr<AnonymousVMObject> vm_object, VirtualAddress kernel_vaddr, size_t size)
+    : m_vm_object(move(vm_object))
+    , m_kernel_vaddr(kernel_vaddr)
+    , m_size(size)
+{
+}
+
+}
@@ -6,6 +6,8 @@
 
 #pragma once
 
+// includes
+#include <base/NumericLimits.h>
 #include <base/Vector.h>
 #include <kernel/devices/BlockDevice.h>
 #include <kernel/PhysicalAddress.h>
@@ -14,17 +16,64 @@
 
 namespace Kernel {
 
+// What the DMA engine of a device can take in a single transfer. The
+// defaults are a device with no limits at all.
+struct DMALimits {
+    size_t max_segment_count { NumericLimits<size_t>::max() };
+    size_t max_segment_size { NumericLimits<size_t>::max() };
+    // No segment may cross a multiple of this, zero for none. Controllers
+    // that keep the upper address bits per segment need 4 GiB here.
+    PhysicalPtr boundary { 0 };
+    // The last byte the device can address, 4 GiB - 1 for 32-bit DMA.
+    PhysicalPtr max_address { NumericLimits<PhysicalPtr>::max() };
+    // Every segment has to start at a multiple of this.
+    size_t address_alignment { 1 };
+};
+
+struct DMASegment {
+    PhysicalAddress address;
+    size_t size { 0 };
+};
+
+// Appends the physically contiguous range at address to segments, merged
+// with the last one when it continues it, split where the limits need it.
+// Fails with E2BIG for too many segments, EOVERFLOW for memory the device
+// can't reach and ENOTSUP for a misaligned start: the data then has to go
+// through a bounce buffer.
+KResult append_dma_segments(Vector<DMASegment>& segments, PhysicalAddress, size_t size, DMALimits const&);
+
 class ScatterGatherList : public RefCounted<ScatterGatherList> {
 public:
     static RefPtr<ScatterGatherList> try_create(AsyncBlockDeviceRequest&, Span<NonnullRefPtr<PhysicalPage>> allocated_pages, size_t device_block_size);
+    // Pins the user memory from vaddr on, so a device can transfer to or
+    // from it directly instead of through a kernel buffer. The pages are
+    // faulted in first, and the ones a transfer will write to are made
+    // private to the process if they were copy-on-write. They stay pinned
+    // for as long as the list is around.
+    static KResultOr<NonnullRefPtr<ScatterGatherList>> try_create_for_user_range(Space&, VirtualAddress, size_t size, bool for_write);
+    // The pages of a kernel buffer, which stays mapped where it is. Only
+    // buffers in a single region with physical pages of its own work.
+    static KResultOr<NonnullRefPtr<ScatterGatherList>> try_create_for_kernel_range(VirtualAddress, size_t size);
+
     const VMObject& vmobject() const { return m_vm_object; }
-    VirtualAddress dma_region() const { return m_dma_region->vaddr(); }
+    VirtualAddress dma_region() const { return m_dma_region ? m_dma_region->vaddr().offset(m_offset_in_first_page) : m_kernel_vaddr; }
     size_t scatters_count() const { return m_vm_object->physical_pages().size(); }
+    // The pages as segments for a device to transfer to or from directly,
+    // adjacent ones merged. Errors are those of append_dma_segments().
+    KResultOr<Vector<DMASegment>> dma_segments(DMALimits const&) const;
+    // Where the data starts in the first page, only user ranges have one.
+    size_t offset_in_first_page() const { return m_offset_in_first_page; }
+    size_t size() const { return m_size; }
 
 private:
     ScatterGatherList(NonnullRefPtr<AnonymousVMObject>, AsyncBlockDeviceRequest&, size_t device_block_size);
+    ScatterGatherList(NonnullRefPtr<AnonymousVMObject>, size_t offset_in_first_page, size_t size);
+    ScatterGatherList(NonnullRefPtr<AnonymousVMObject>, VirtualAddress kernel_vaddr, size_t size);
     NonnullRefPtr<AnonymousVMObject> m_vm_object;
     OwnPtr<Region> m_dma_region;
+    VirtualAddress m_kernel_vaddr;
+    size_t m_offset_in_first_page { 0 };
+    size_t m_size { 0 };
 };
 
 }
\ No newline at end of file
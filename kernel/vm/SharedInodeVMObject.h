@@ -8,6 +8,7 @@
 
 // includes
 #include <base/Bitmap.h>
+#include <base/HashMap.h>
 #include <kernel/UnixTypes.h>
 #include <kernel/vm/InodeVMObject.h>
 
@@ -20,7 +21,13 @@ public:
     static RefPtr<SharedInodeVMObject> try_create_with_inode(Inode&);
     virtual RefPtr<VMObject> try_clone() override;
 
+    // Read-only mappings of the same 512 pages share their page table,
+    // found by the first page and whether the mapping is executable.
+    static size_t shared_page_table_key(size_t first_page_index, bool executable) { return first_page_index * 2 + executable; }
+
 private:
+    friend class MemoryManager;
+
     virtual bool is_shared_inode() const override { return true; }
 
     explicit SharedInodeVMObject(Inode&, size_t);
@@ -29,6 +36,10 @@ private:
     virtual StringView class_name() const override { return "SharedInodeVMObject"sv; }
 
     SharedInodeVMObject& operator=(SharedInodeVMObject const&) = delete;
+
+    // Guarded by s_mm_lock. A table is dropped from here when the last
+    // page directory using it lets go.
+    HashMap<size_t, NonnullRefPtr<PhysicalPage>> m_shared_page_tables;
 };
 
 }
\ No newline at end of file
@@ -8,10 +8,12 @@
 #include <kernel/PerformanceManager.h>
 #include <kernel/Process.h>
 #include <kernel/SpinLock.h>
+#include <kernel/time/TimePage.h>
 #include <kernel/vm/AnonymousVMObject.h>
 #include <kernel/vm/InodeVMObject.h>
 #include <kernel/vm/MemoryManager.h>
 #include <kernel/vm/Space.h>
+#include <kernel/vm/TLBFlushBatch.h>
 
 namespace Kernel {
 
@@ -24,6 +26,12 @@ OwnPtr<Space> Space::create(Process& process, const Space* parent)
     if (!space)
         return {};
     space->page_directory().set_space({}, *space);
+
+    // A forked space gets the time page along with its parent's regions.
+    if (!parent && KernelTimePage::is_initialized()) {
+        if (KernelTimePage::the().map_into(*space).is_error())
+            return {};
+    }
     return space;
 }
 
@@ -67,7 +75,9 @@ KResult Space::unmap_mmap_range(VirtualAddress addr, size_t size)
 
         auto region = take_region(*old_region);
 
-        region->unmap(Region::ShouldDeallocateVirtualMemoryRange::No);
+        // The old region's flush covers the pieces mapped again below.
+        TLBFlushBatch flush_batch(page_directory());
+        region->unmap(Region::ShouldDeallocateVirtualMemoryRange::No, &flush_batch);
 
         auto new_regions_or_error = try_split_region_around_range(*region, range_to_unmap);
         if (new_regions_or_error.is_error())
@@ -77,7 +87,7 @@ KResult Space::unmap_mmap_range(VirtualAddress addr, size_t size)
         page_directory().range_allocator().deallocate(range_to_unmap);
 
         for (auto* new_region : new_regions) {
-            new_region->map(page_directory());
+            new_region->map(page_directory(), ShouldFlushTLB::No);
         }
 
         PerformanceManager::add_unmap_perf_event(*Process::current(), range_to_unmap);
@@ -94,15 +104,24 @@ KResult Space::unmap_mmap_range(VirtualAddress addr, size_t size)
 
     Vector<Region*, 2> new_regions;
 
+    // All the regions are flushed together at the end. The ones that go
+    // away entirely are only destroyed after that, their pages must not be
+    // reused while another processor may still have them in its TLB.
+    NonnullOwnPtrVector<Region> unmapped_regions;
+    TLBFlushBatch flush_batch(page_directory());
+
     for (auto* old_region : regions) {
         if (old_region->range().intersect(range_to_unmap).size() == old_region->size()) {
-            deallocate_region(*old_region);
+            auto region = take_region(*old_region);
+            region->unmap(Region::ShouldDeallocateVirtualMemoryRange::Yes, &flush_batch);
+            if (!unmapped_regions.try_append(move(region)))
+                flush_batch.flush();
             continue;
         }
 
         auto region = take_region(*old_region);
 
-        region->unmap(Region::ShouldDeallocateVirtualMemoryRange::No);
+        region->unmap(Region::ShouldDeallocateVirtualMemoryRange::No, &flush_batch);
         auto split_regions_or_error = try_split_region_around_range(*region, range_to_unmap);
         if (split_regions_or_error.is_error())
             return split_regions_or_error.error();
@@ -114,9 +133,11 @@ KResult Space::unmap_mmap_range(VirtualAddress addr, size_t size)
     page_directory().range_allocator().deallocate(range_to_unmap);
 
     for (auto* new_region : new_regions) {
-        new_region->map(page_directory());
+        new_region->map(page_directory(), ShouldFlushTLB::No);
     }
 
+    flush_batch.flush();
+
     PerformanceManager::add_unmap_perf_event(*Process::current(), range_to_unmap);
 
     return KSuccess;
@@ -137,12 +158,15 @@ KResultOr<Region*> Space::try_allocate_split_region(Region const& source_region,
         range, source_region.vmobject(), offset_in_vmobject, KString::try_create(source_region.name()), source_region.access(), source_region.is_cacheable() ? Region::Cacheable::Yes : Region::Cacheable::No, source_region.is_shared());
     if (!new_region)
         return ENOMEM;
+    new_region->set_memory_type(source_region.memory_type());
     auto* region = add_region(new_region.release_nonnull());
     if (!region)
         return ENOMEM;
     region->set_syscall_region(source_region.is_syscall_region());
     region->set_mmap(source_region.is_mmap());
     region->set_stack(source_region.is_stack());
+    region->set_access_hint(source_region.access_hint());
+    region->set_mergeable(source_region.is_mergeable());
     size_t page_offset_in_source_region = (offset_in_vmobject - source_region.offset_in_vmobject()) / PAGE_SIZE;
     for (size_t i = 0; i < region->page_count(); ++i) {
         if (source_region.should_cow(page_offset_in_source_region + i))
@@ -210,9 +234,14 @@ NonnullOwnPtr<Region> Space::take_region(Region& region)
 
     if (m_region_lookup_cache.region.unsafe_ptr() == &region)
         m_region_lookup_cache.region = nullptr;
+    begin_region_tree_write();
+    if (m_last_containing_region.load() == &region)
+        m_last_containing_region = nullptr;
 
     auto found_region = m_regions.unsafe_remove(region.vaddr().get());
     VERIFY(found_region.ptr() == &region);
+    end_region_tree_write();
+    region.set_accounting_space(nullptr);
     return found_region;
 }
 
@@ -237,30 +266,58 @@ Region* Space::find_region_from_range(const Range& range)
 Region* Space::find_region_containing(const Range& range)
 {
     ScopedSpinLock lock(m_lock);
+    if (auto* region = m_last_containing_region.load(); region && region->range().contains(range))
+        return region;
+
     auto candidate = m_regions.find_largest_not_above(range.base().get());
-    if (!candidate)
+    if (!candidate || !(*candidate)->range().contains(range))
         return nullptr;
-    return (*candidate)->range().contains(range) ? candidate->ptr() : nullptr;
+    set_last_containing_region(candidate->ptr());
+    return candidate->ptr();
+}
+
+void Space::set_last_containing_region(Region* region)
+{
+    VERIFY(m_lock.own_lock());
+    begin_region_tree_write();
+    m_last_containing_region = region;
+    m_last_containing_base = region->vaddr().get();
+    m_last_containing_end = region->range().end().get();
+    end_region_tree_write();
+}
+
+Region* Space::find_cached_region_containing(const Range& range) const
+{
+    auto sequence = m_region_tree_sequence.load(Base::memory_order_acquire);
+    if (sequence & 1)
+        return nullptr;
+
+    auto* region = m_last_containing_region.load();
+    bool contains = region && range.base().get() >= m_last_containing_base && range.end().get() <= m_last_containing_end;
+
+    Base::atomic_thread_fence(Base::memory_order_acquire);
+    if (m_region_tree_sequence.load(Base::memory_order_relaxed) != sequence)
+        return nullptr;
+    return contains ? region : nullptr;
 }
 
 Vector<Region*> Space::find_regions_intersecting(const Range& range)
 {
     Vector<Region*> regions = {};
-    size_t total_size_collected = 0;
 
     ScopedSpinLock lock(m_lock);
 
-    auto found_region = m_regions.find_largest_not_above(range.base().get());
-    if (!found_region)
-        return regions;
-    for (auto iter = m_regions.begin_from((*found_region)->vaddr().get()); !iter.is_end(); ++iter) {
-        if ((*iter)->range().base() < range.end() && (*iter)->range().end() > range.base()) {
+    // Regions don't overlap, so only the one below the range's base can
+    // reach into it from the left. Everything else that intersects starts
+    // inside the range.
+    auto iter = m_regions.find_largest_not_above_iterator(range.base().get());
+    if (iter.is_end())
+        iter = m_regions.begin();
+    for (; !iter.is_end(); ++iter) {
+        if ((*iter)->range().base() >= range.end())
+            break;
+        if ((*iter)->range().end() > range.base())
             regions.append(*iter);
-
-            total_size_collected += (*iter)->size() - (*iter)->range().intersect(range).size();
-            if (total_size_collected == range.size())
-                break;
-        }
     }
 
     return regions;
@@ -271,7 +328,10 @@ Region* Space::add_region(NonnullOwnPtr<Region> region)
     auto* ptr = region.ptr();
     ScopedSpinLock lock(m_lock);
     auto success = m_regions.try_insert(region->vaddr().get(), move(region));
-    return success ? ptr : nullptr;
+    if (!success)
+        return nullptr;
+    ptr->set_accounting_space(this);
+    return ptr;
 }
 
 KResultOr<Vector<Region*, 2>> Space::try_split_region_around_range(const Region& source_region, const Range& desired_range)
@@ -325,19 +385,10 @@ void Space::dump_regions()
 void Space::remove_all_regions(Badge<Process>)
 {
     ScopedSpinLock lock(m_lock);
+    begin_region_tree_write();
+    m_last_containing_region = nullptr;
     m_regions.clear();
-}
-
-size_t Space::amount_dirty_private() const
-{
-    ScopedSpinLock lock(m_lock);
-
-    size_t amount = 0;
-    for (auto& region : m_regions) {
-        if (!region->is_shared())
-            amount += region->amount_dirty();
-    }
-    return amount;
+    end_region_tree_write();
 }
 
 size_t Space::amount_clean_inode() const
@@ -354,37 +405,6 @@ size_t Space::amount_clean_inode() const
     return amount;
 }
 
-size_t Space::amount_virtual() const
-{
-    ScopedSpinLock lock(m_lock);
-    size_t amount = 0;
-    for (auto& region : m_regions) {
-        amount += region->size();
-    }
-    return amount;
-}
-
-size_t Space::amount_resident() const
-{
-    ScopedSpinLock lock(m_lock);
-    size_t amount = 0;
-    for (auto& region : m_regions) {
-        amount += region->amount_resident();
-    }
-    return amount;
-}
-
-size_t Space::amount_shared() const
-{
-    ScopedSpinLock lock(m_lock);
-
-    size_t amount = 0;
-    for (auto& region : m_regions) {
-        amount += region->amount_shared();
-    }
-    return amount;
-}
-
 size_t Space::amount_purgeable_volatile() const
 {
     ScopedSpinLock lock(m_lock);
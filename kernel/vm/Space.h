@@ -7,6 +7,8 @@
 #pragma once
 
 // includes 
+#include <base/Atomic.h>
+#include <base/Badge.h>
 #include <base/RedBlackTree.h>
 #include <base/Vector.h>
 #include <base/WeakPtr.h>
@@ -47,6 +49,9 @@ public:
 
     Region* find_region_from_range(const Range&);
     Region* find_region_containing(const Range&);
+    // Only looks at the last region found by find_region_containing(), but
+    // doesn't take the lock. Returns nullptr on a miss or a racing update.
+    Region* find_cached_region_containing(const Range&) const;
 
     Vector<Region*> find_regions_intersecting(const Range&);
 
@@ -58,13 +63,24 @@ public:
     RecursiveSpinLock& get_lock() const { return m_lock; }
 
     size_t amount_clean_inode() const;
-    size_t amount_dirty_private() const;
-    size_t amount_virtual() const;
-    size_t amount_resident() const;
-    size_t amount_shared() const;
     size_t amount_purgeable_volatile() const;
     size_t amount_purgeable_nonvolatile() const;
 
+    // Kept up to date by the regions as they come and go and as their
+    // VMObjects' pages do, so reading them doesn't walk anything.
+    size_t amount_dirty_private() const { return m_amount_dirty_private.load(); }
+    size_t amount_virtual() const { return m_amount_virtual.load(); }
+    size_t amount_resident() const { return m_amount_resident.load(); }
+    size_t amount_shared() const { return m_amount_shared.load(); }
+
+    void account(Badge<Region>, ssize_t virtual_delta, ssize_t resident_delta, ssize_t shared_delta, ssize_t dirty_private_delta)
+    {
+        m_amount_virtual.fetch_add(static_cast<size_t>(virtual_delta));
+        m_amount_resident.fetch_add(static_cast<size_t>(resident_delta));
+        m_amount_shared.fetch_add(static_cast<size_t>(shared_delta));
+        m_amount_dirty_private.fetch_add(static_cast<size_t>(dirty_private_delta));
+    }
+
 private:
     Space(Process&, NonnullRefPtr<PageDirectory>);
 
@@ -81,7 +97,29 @@ private:
     };
     RegionLookupCache m_region_lookup_cache;
 
+    // The region the last containing lookup landed in. Page faults and
+    // syscall validation tend to hit the same region over and over.
+    //
+    // It is written under m_lock, but read without it: writers make the
+    // sequence odd while they update the cache or remove a region, and a
+    // reader only trusts what it read if the sequence was even and didn't
+    // change meanwhile. The range is copied in so a reader never touches
+    // a region that may already be gone.
+    void set_last_containing_region(Region*);
+    void begin_region_tree_write() { m_region_tree_sequence.fetch_add(1, Base::memory_order_acq_rel); }
+    void end_region_tree_write() { m_region_tree_sequence.fetch_add(1, Base::memory_order_release); }
+
+    Atomic<u32> m_region_tree_sequence { 0 };
+    Atomic<Region*, Base::MemoryOrder::memory_order_relaxed> m_last_containing_region { nullptr };
+    Atomic<FlatPtr, Base::MemoryOrder::memory_order_relaxed> m_last_containing_base { 0 };
+    Atomic<FlatPtr, Base::MemoryOrder::memory_order_relaxed> m_last_containing_end { 0 };
+
     bool m_enforces_syscall_regions { false };
+
+    Atomic<size_t, Base::MemoryOrder::memory_order_relaxed> m_amount_virtual { 0 };
+    Atomic<size_t, Base::MemoryOrder::memory_order_relaxed> m_amount_resident { 0 };
+    Atomic<size_t, Base::MemoryOrder::memory_order_relaxed> m_amount_shared { 0 };
+    Atomic<size_t, Base::MemoryOrder::memory_order_relaxed> m_amount_dirty_private { 0 };
 };
 
 }
\ No newline at end of file
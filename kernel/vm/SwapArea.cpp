@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Atomic.h>
+#include <kernel/Debug.h>
+#include <kernel/UserOrKernelBuffer.h>
+#include <kernel/vm/SwapArea.h>
+
+namespace Kernel {
+
+static Atomic<SwapArea*> s_active;
+
+KResult SwapArea::activate(FileDescription& description, u64 size)
+{
+    if (!description.is_readable() || !description.is_writable())
+        return EBADF;
+    if (!description.file().is_seekable())
+        return ESPIPE;
+
+    size_t slot_count = min(size / PAGE_SIZE, static_cast<u64>(NumericLimits<u32>::max()));
+    if (!slot_count)
+        return EINVAL;
+
+    auto* swap_area = new (nothrow) SwapArea(description, slot_count);
+    if (!swap_area || swap_area->slot_count() != slot_count) {
+        delete swap_area;
+        return ENOMEM;
+    }
+
+    SwapArea* expected = nullptr;
+    if (!s_active.compare_exchange_strong(expected, swap_area, Base::MemoryOrder::memory_order_acq_rel)) {
+        delete swap_area;
+        return EBUSY;
+    }
+    dmesgln("Swap: {} pages on {}", slot_count, description.absolute_path());
+    return KSuccess;
+}
+
+SwapArea* SwapArea::active()
+{
+    return s_active.load(Base::MemoryOrder::memory_order_acquire);
+}
+
+SwapArea::SwapArea(NonnullRefPtr<FileDescription> description, size_t slot_count)
+    : m_description(move(description))
+{
+    if (!m_slot_refs.try_resize(slot_count))
+        return;
+    m_free_slot_count = slot_count;
+}
+
+size_t SwapArea::free_slot_count() const
+{
+    ScopedSpinLock lock(m_lock);
+    return m_free_slot_count;
+}
+
+Optional<u32> SwapArea::allocate_slots(size_t count, size_t& allocated_count)
+{
+    VERIFY(count);
+    ScopedSpinLock lock(m_lock);
+    allocated_count = 0;
+    if (!m_free_slot_count)
+        return {};
+
+    // Once around from the cursor for the first free slot, then as many
+    // after it as are free too.
+    size_t slot = m_next_slot;
+    while (m_slot_refs[slot]) {
+        if (++slot == slot_count())
+            slot = 0;
+    }
+    size_t end = slot;
+    while (end < slot_count() && end - slot < count && !m_slot_refs[end])
+        m_slot_refs[end++] = 1;
+
+    allocated_count = end - slot;
+    m_free_slot_count -= allocated_count;
+    m_next_slot = end == slot_count() ? 0 : end;
+    return slot;
+}
+
+void SwapArea::ref_slot(u32 slot)
+{
+    ScopedSpinLock lock(m_lock);
+    VERIFY(m_slot_refs[slot]);
+    VERIFY(m_slot_refs[slot] < NumericLimits<u32>::max());
+    ++m_slot_refs[slot];
+}
+
+void SwapArea::free_slot(u32 slot)
+{
+    ScopedSpinLock lock(m_lock);
+    VERIFY(m_slot_refs[slot]);
+    if (!--m_slot_refs[slot])
+        ++m_free_slot_count;
+}
+
+KResult SwapArea::write_pages(u32 first_slot, u8 const* data, size_t count)
+{
+    VERIFY(first_slot + count <= slot_count());
+    auto buffer = UserOrKernelBuffer::for_kernel_buffer(const_cast<u8*>(data));
+    auto result = m_description->file().write(*m_description, static_cast<u64>(first_slot) * PAGE_SIZE, buffer, count * PAGE_SIZE);
+    if (result.is_error())
+        return result.error();
+    if (result.value() != count * PAGE_SIZE)
+        return EIO;
+    return KSuccess;
+}
+
+KResult SwapArea::read_pages(u32 first_slot, u8* data, size_t count)
+{
+    VERIFY(first_slot + count <= slot_count());
+    auto buffer = UserOrKernelBuffer::for_kernel_buffer(data);
+    auto result = m_description->file().read(*m_description, static_cast<u64>(first_slot) * PAGE_SIZE, buffer, count * PAGE_SIZE);
+    if (result.is_error())
+        return result.error();
+    if (result.value() != count * PAGE_SIZE)
+        return EIO;
+    return KSuccess;
+}
+
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/NonnullRefPtr.h>
+#include <base/Noncopyable.h>
+#include <base/Optional.h>
+#include <base/Vector.h>
+#include <kernel/filesystem/FileDescription.h>
+#include <kernel/KResult.h>
+#include <kernel/SpinLock.h>
+
+namespace Kernel {
+
+// A swap file or block device that anonymous pages are written out to once
+// memory runs out even after purging and compressing. Slots are a page
+// each, handed out next-fit so pages written out together end up next to
+// each other and can be read back with a single request.
+//
+// Slots are reference counted, so a clone of a VMObject shares the pages
+// it had swapped out instead of reading them all back in first.
+class SwapArea {
+    BASE_MAKE_NONCOPYABLE(SwapArea);
+    BASE_MAKE_NONMOVABLE(SwapArea);
+
+public:
+    // Pages go to the first size bytes of the description. There is one
+    // swap area at a time, and it stays active once activated.
+    static KResult activate(FileDescription&, u64 size);
+    static SwapArea* active();
+
+    size_t slot_count() const { return m_slot_refs.size(); }
+    size_t free_slot_count() const;
+
+    // Up to count free slots in a row, starting from where the last ones
+    // were handed out. Returns the first, and sets how many there are.
+    Optional<u32> allocate_slots(size_t count, size_t& allocated_count);
+    void ref_slot(u32);
+    void free_slot(u32);
+
+    // Pages to or from count slots in a row, in one request. They block, so
+    // they must not be called with a spinlock held.
+    KResult write_pages(u32 first_slot, u8 const* data, size_t count);
+    KResult read_pages(u32 first_slot, u8* data, size_t count);
+
+private:
+    SwapArea(NonnullRefPtr<FileDescription>, size_t slot_count);
+
+    NonnullRefPtr<FileDescription> m_description;
+
+    mutable SpinLock<u8> m_lock;
+    Vector<u32> m_slot_refs;
+    size_t m_free_slot_count { 0 };
+    size_t m_next_slot { 0 };
+};
+
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <kernel/vm/MemoryManager.h>
+#include <kernel/vm/PageDirectory.h>
+
+namespace Kernel {
+
+// Collects the TLB flushes for several regions of one page directory, so
+// unmapping or remapping many regions costs a single flush (and a single
+// round of IPIs) instead of one per region. The ranges are merged into the
+// span covering all of them, flushing the gaps in between is harmless.
+//
+// Anything that must not be reused while stale translations may still be
+// around, like the physical pages of an unmapped region, has to be kept
+// alive until flush() has run.
+class TLBFlushBatch {
+    BASE_MAKE_NONCOPYABLE(TLBFlushBatch);
+    BASE_MAKE_NONMOVABLE(TLBFlushBatch);
+
+public:
+    explicit TLBFlushBatch(PageDirectory const& page_directory)
+        : m_page_directory(&page_directory)
+    {
+    }
+
+    ~TLBFlushBatch() { flush(); }
+
+    PageDirectory const& page_directory() const { return *m_page_directory; }
+
+    void add(VirtualAddress vaddr, size_t page_count)
+    {
+        if (!page_count)
+            return;
+        FlatPtr end = vaddr.get() + page_count * PAGE_SIZE;
+        if (is_empty()) {
+            m_start = vaddr.get();
+            m_end = end;
+            return;
+        }
+        m_start = min(m_start, vaddr.get());
+        m_end = max(m_end, end);
+    }
+
+    void flush()
+    {
+        if (is_empty())
+            return;
+        MemoryManager::flush_tlb(m_page_directory, VirtualAddress(m_start), (m_end - m_start) / PAGE_SIZE);
+        m_start = 0;
+        m_end = 0;
+    }
+
+    bool is_empty() const { return m_start == m_end; }
+
+private:
+    PageDirectory const* m_page_directory { nullptr };
+    FlatPtr m_start { 0 };
+    FlatPtr m_end { 0 };
+};
+
+}
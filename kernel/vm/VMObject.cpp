@@ -7,9 +7,14 @@
 // includes
 #include <kernel/vm/MemoryManager.h>
 #include <kernel/vm/VMObject.h>
+#include <kernel/WorkQueue.h>
 
 namespace Kernel {
 
+SpinLock<u8> VMObject::s_reclaimed_lock;
+VMObject* VMObject::s_reclaimed;
+WorkItem VMObject::s_reclaim_work { [] { destroy_reclaimed(); } };
+
 VMObject::VMObject(VMObject const& other)
     : m_physical_pages(other.m_physical_pages)
 {
@@ -31,8 +36,69 @@ VMObject::~VMObject()
         m_on_deleted.clear();
     }
 
-    MM.unregister_vmobject(*this);
+    if (m_list_node.is_in_list())
+        MM.unregister_vmobject(*this);
     VERIFY(m_regions.is_empty());
 }
 
+bool VMObject::is_page_resident(size_t page_index) const
+{
+    auto& page = m_physical_pages[page_index];
+    return page && !page->is_shared_zero_page() && !page->is_lazy_committed_page();
+}
+
+void VMObject::set_physical_page(size_t page_index, RefPtr<PhysicalPage> page)
+{
+    bool was_resident = is_page_resident(page_index);
+    bool was_shared = is_page_shared(page_index);
+    m_physical_pages[page_index] = move(page);
+    account_page_change(page_index, was_resident, was_shared);
+}
+
+void VMObject::account_page_change(size_t page_index, bool was_resident, bool was_shared)
+{
+    VERIFY(m_lock.is_locked());
+    ssize_t resident_delta = (ssize_t)is_page_resident(page_index) - (ssize_t)was_resident;
+    ssize_t shared_delta = (ssize_t)is_page_shared(page_index) - (ssize_t)was_shared;
+    if (!resident_delta && !shared_delta)
+        return;
+
+    for (auto& region : m_regions) {
+        if (page_index >= region.first_page_index() && page_index < region.first_page_index() + region.page_count())
+            region.account_pages(resident_delta, shared_delta);
+    }
+}
+
+void VMObject::destroy_after_grace_period()
+{
+    MM.unregister_vmobject(*this);
+
+    call_rcu(m_rcu_head, [](RCUHead& head) {
+        auto* vmobject = reinterpret_cast<VMObject*>(reinterpret_cast<u8*>(&head) - __builtin_offsetof(VMObject, m_rcu_head));
+
+        // This runs with interrupts disabled, and destroying an inode's
+        // VMObject may drop the last reference to the inode.
+        ScopedSpinLock lock(s_reclaimed_lock);
+        vmobject->m_next_reclaimed = s_reclaimed;
+        s_reclaimed = vmobject;
+        if (WorkQueue::is_initialized())
+            WorkQueue::system_unbound().queue(s_reclaim_work);
+    });
+}
+
+void VMObject::destroy_reclaimed()
+{
+    VMObject* list;
+    {
+        ScopedSpinLock lock(s_reclaimed_lock);
+        list = exchange(s_reclaimed, nullptr);
+    }
+
+    while (list) {
+        auto* next = list->m_next_reclaimed;
+        delete list;
+        list = next;
+    }
+}
+
 }
\ No newline at end of file
@@ -16,10 +16,14 @@
 #include <base/Weakable.h>
 #include <kernel/Forward.h>
 #include <kernel/Mutex.h>
+#include <kernel/RCU.h>
+#include <kernel/RCUList.h>
 #include <kernel/vm/Region.h>
 
 namespace Kernel {
 
+class WorkItem;
+
 class VMObjectDeletedHandler {
 public:
     virtual ~VMObjectDeletedHandler() = default;
@@ -34,6 +38,18 @@ class VMObject : public RefCounted<VMObject>
 public:
     virtual ~VMObject();
 
+    // Hides RefCounted::unref(). The last reference unlinks it from the
+    // MemoryManager's list right away, but it is only destroyed once a grace
+    // period has passed, so for_each_vmobject() can walk the list without
+    // s_mm_lock.
+    bool unref() const
+    {
+        if (deref_base())
+            return false;
+        const_cast<VMObject&>(*this).destroy_after_grace_period();
+        return true;
+    }
+
     virtual RefPtr<VMObject> try_clone() = 0;
 
     virtual bool is_anonymous() const { return false; }
@@ -54,6 +70,7 @@ public:
     {
         ScopedSpinLock locker(m_lock);
         m_regions.append(region);
+        region.recount_pages();
     }
 
     ALWAYS_INLINE void remove_region(Region& region)
@@ -62,6 +79,12 @@ public:
         m_regions.remove(region);
     }
 
+    // What a page counts as in the memory accounting of the regions that
+    // map it and of their Spaces: resident unless it is missing or stands in
+    // for one, and shared if it is also copy-on-write.
+    bool is_page_resident(size_t page_index) const;
+    bool is_page_shared(size_t page_index) const { return is_page_resident(page_index) && is_page_cow(page_index); }
+
     void register_on_deleted_handler(VMObjectDeletedHandler& handler)
     {
         ScopedSpinLock locker(m_on_deleted_lock);
@@ -80,7 +103,14 @@ protected:
     template<typename Callback>
     void for_each_region(Callback);
 
-    IntrusiveListNode<VMObject> m_list_node;
+    virtual bool is_page_cow(size_t) const { return false; }
+
+    // Page slots change through these after construction, under m_lock, so
+    // that the regions keep their counts without walking their pages.
+    void set_physical_page(size_t page_index, RefPtr<PhysicalPage>);
+    void account_page_change(size_t page_index, bool was_resident, bool was_shared);
+
+    RCUListNode<VMObject> m_list_node;
     FixedArray<RefPtr<PhysicalPage>> m_physical_pages;
 
     mutable RecursiveSpinLock m_lock;
@@ -90,13 +120,23 @@ private:
     VMObject& operator=(VMObject&&) = delete;
     VMObject(VMObject&&) = delete;
 
+    void destroy_after_grace_period();
+    static void destroy_reclaimed();
+
+    RCUHead m_rcu_head;
+    VMObject* m_next_reclaimed { nullptr };
+
+    static SpinLock<u8> s_reclaimed_lock;
+    static VMObject* s_reclaimed;
+    static WorkItem s_reclaim_work;
+
     HashTable<VMObjectDeletedHandler*> m_on_deleted;
     SpinLock<u8> m_on_deleted_lock;
 
     Region::ListInVMObject m_regions;
 
 public:
-    using List = IntrusiveList<VMObject, RawPtr<VMObject>, &VMObject::m_list_node>;
+    using List = RCUList<VMObject, &VMObject::m_list_node>;
 };
 
 template<typename Callback>
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/StringView.h>
+#include <base/Types.h>
+
+namespace Benchmark {
+
+// What a benchmark is given: it runs its operation iterations() times,
+// setting up outside of the loop or between pause() and resume().
+class State {
+public:
+    explicit State(u64 iterations)
+        : m_iterations(iterations)
+    {
+    }
+
+    u64 iterations() const { return m_iterations; }
+
+    void pause();
+    void resume();
+
+    // Bytes or items handled by each iteration, to report a throughput.
+    void set_bytes_per_iteration(u64 bytes) { m_bytes_per_iteration = bytes; }
+    void set_items_per_iteration(u64 items) { m_items_per_iteration = items; }
+
+    u64 bytes_per_iteration() const { return m_bytes_per_iteration; }
+    u64 items_per_iteration() const { return m_items_per_iteration; }
+
+    // Time and cycles spent paused, subtracted from the measurement.
+    u64 paused_ns() const { return m_paused_ns; }
+    u64 paused_cycles() const { return m_paused_cycles; }
+
+private:
+    u64 m_iterations { 0 };
+    u64 m_bytes_per_iteration { 0 };
+    u64 m_items_per_iteration { 0 };
+    u64 m_paused_ns { 0 };
+    u64 m_paused_cycles { 0 };
+    u64 m_pause_started_ns { 0 };
+    u64 m_pause_started_cycles { 0 };
+};
+
+using Function = void (*)(State&);
+
+struct Registration {
+    Registration(StringView suite, StringView name, Function);
+};
+
+u64 now_ns();
+
+// Zero where the CPU has no cycle counter that userland can read.
+u64 now_cycles();
+
+// Keeps the compiler from proving value unused and dropping the work that
+// produced it.
+template<typename T>
+ALWAYS_INLINE void do_not_optimize(T const& value)
+{
+    asm volatile(""
+                 :
+                 : "r,m"(value)
+                 : "memory");
+}
+
+// Makes every write so far count as observed.
+ALWAYS_INLINE void clobber_memory()
+{
+    asm volatile(""
+                 :
+                 :
+                 : "memory");
+}
+
+}
+
+#define BENCHMARK(suite, name)                                                                           \
+    static void __benchmark_##suite##_##name(::Benchmark::State&);                                        \
+    static ::Benchmark::Registration __benchmark_registration_##suite##_##name(#suite, #name,             \
+        __benchmark_##suite##_##name);                                                                    \
+    static void __benchmark_##suite##_##name([[maybe_unused]] ::Benchmark::State& state)
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include "Benchmark.h"
+#include <base/Base64.h>
+#include <base/ByteBuffer.h>
+
+static constexpr size_t input_size = 64 * 1024;
+
+static ByteBuffer make_input()
+{
+    auto input = ByteBuffer::create_uninitialized(input_size);
+    u32 value = 0x12345678;
+    for (size_t i = 0; i < input_size; ++i) {
+        value = value * 1103515245 + 12345;
+        input[i] = value >> 24;
+    }
+    return input;
+}
+
+BENCHMARK(Base64, encode)
+{
+    auto input = make_input();
+
+    state.set_bytes_per_iteration(input_size);
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration)
+        Benchmark::do_not_optimize(encode_base64(input));
+}
+
+BENCHMARK(Base64, decode)
+{
+    auto encoded = encode_base64(make_input());
+
+    state.set_bytes_per_iteration(encoded.length());
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration)
+        Benchmark::do_not_optimize(decode_base64(encoded));
+}
+
+BENCHMARK(Base64, decode_into)
+{
+    auto encoded = encode_base64(make_input());
+    auto output = ByteBuffer::create_uninitialized(calculate_base64_decoded_length(encoded));
+
+    state.set_bytes_per_iteration(encoded.length());
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration)
+        Benchmark::do_not_optimize(decode_base64_into(encoded, output.bytes()));
+}
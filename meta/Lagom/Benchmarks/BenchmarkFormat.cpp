@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include "Benchmark.h"
+#include <base/Format.h>
+#include <base/String.h>
+#include <base/StringBuilder.h>
+
+BENCHMARK(Format, integers)
+{
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration)
+        Benchmark::do_not_optimize(String::formatted("{} {} {}", iteration, -(i64)iteration, (u8)iteration));
+}
+
+BENCHMARK(Format, hex_and_padding)
+{
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration)
+        Benchmark::do_not_optimize(String::formatted("{:08x} {:>10} {:<6}|", iteration, iteration, "left"));
+}
+
+BENCHMARK(Format, strings)
+{
+    static constexpr auto name = "pranaOS"sv;
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration)
+        Benchmark::do_not_optimize(String::formatted("Hello, {}! Welcome to {}.", name, name));
+}
+
+BENCHMARK(Format, floating_point)
+{
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration)
+        Benchmark::do_not_optimize(String::formatted("{:.3}", (double)iteration / 7.0));
+}
+
+BENCHMARK(Format, appendff_many)
+{
+    static constexpr size_t line_count = 1'000;
+
+    state.set_items_per_iteration(line_count);
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration) {
+        StringBuilder builder;
+        for (size_t i = 0; i < line_count; ++i)
+            builder.appendff("{}: {}\n", i, "value"sv);
+        Benchmark::do_not_optimize(builder.length());
+    }
+}
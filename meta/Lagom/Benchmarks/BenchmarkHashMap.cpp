@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include "Benchmark.h"
+#include <base/HashMap.h>
+#include <base/HashTable.h>
+#include <base/String.h>
+#include <base/Vector.h>
+
+static constexpr size_t key_count = 10'000;
+
+// Spreads consecutive numbers over the whole range, like real keys.
+static u32 scrambled(u32 value)
+{
+    return value * 2654435761u;
+}
+
+static Vector<String> make_string_keys()
+{
+    Vector<String> keys;
+    keys.ensure_capacity(key_count);
+    for (size_t i = 0; i < key_count; ++i)
+        keys.append(String::formatted("key-{}", scrambled(i)));
+    return keys;
+}
+
+BENCHMARK(HashMap, set_int)
+{
+    state.set_items_per_iteration(key_count);
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration) {
+        HashMap<u32, u32> map;
+        for (u32 i = 0; i < key_count; ++i)
+            map.set(scrambled(i), i);
+        Benchmark::do_not_optimize(map.size());
+    }
+}
+
+BENCHMARK(HashMap, get_int)
+{
+    HashMap<u32, u32> map;
+    for (u32 i = 0; i < key_count; ++i)
+        map.set(scrambled(i), i);
+
+    state.set_items_per_iteration(key_count);
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration) {
+        for (u32 i = 0; i < key_count; ++i)
+            Benchmark::do_not_optimize(map.get(scrambled(i)));
+    }
+}
+
+BENCHMARK(HashMap, get_missing_int)
+{
+    HashMap<u32, u32> map;
+    for (u32 i = 0; i < key_count; ++i)
+        map.set(scrambled(i), i);
+
+    state.set_items_per_iteration(key_count);
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration) {
+        for (u32 i = 0; i < key_count; ++i)
+            Benchmark::do_not_optimize(map.get(scrambled(i + key_count)));
+    }
+}
+
+BENCHMARK(HashMap, set_string)
+{
+    auto keys = make_string_keys();
+
+    state.set_items_per_iteration(key_count);
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration) {
+        HashMap<String, u32> map;
+        for (u32 i = 0; i < key_count; ++i)
+            map.set(keys[i], i);
+        Benchmark::do_not_optimize(map.size());
+    }
+}
+
+BENCHMARK(HashMap, get_string)
+{
+    auto keys = make_string_keys();
+    HashMap<String, u32> map;
+    for (u32 i = 0; i < key_count; ++i)
+        map.set(keys[i], i);
+
+    state.set_items_per_iteration(key_count);
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration) {
+        for (u32 i = 0; i < key_count; ++i)
+            Benchmark::do_not_optimize(map.get(keys[i]));
+    }
+}
+
+BENCHMARK(HashMap, remove_and_set)
+{
+    HashMap<u32, u32> map;
+    for (u32 i = 0; i < key_count; ++i)
+        map.set(scrambled(i), i);
+
+    state.set_items_per_iteration(key_count);
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration) {
+        for (u32 i = 0; i < key_count; ++i) {
+            map.remove(scrambled(i));
+            map.set(scrambled(i), i);
+        }
+    }
+    Benchmark::do_not_optimize(map.size());
+}
+
+BENCHMARK(HashTable, set_and_contains)
+{
+    state.set_items_per_iteration(key_count);
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration) {
+        HashTable<u32> table;
+        for (u32 i = 0; i < key_count; ++i)
+            table.set(scrambled(i));
+        for (u32 i = 0; i < key_count; ++i)
+            Benchmark::do_not_optimize(table.contains(scrambled(i)));
+    }
+}
+
+BENCHMARK(HashTable, iterate)
+{
+    HashTable<u32> table;
+    for (u32 i = 0; i < key_count; ++i)
+        table.set(scrambled(i));
+
+    state.set_items_per_iteration(key_count);
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration) {
+        u32 sum = 0;
+        for (auto value : table)
+            sum += value;
+        Benchmark::do_not_optimize(sum);
+    }
+}
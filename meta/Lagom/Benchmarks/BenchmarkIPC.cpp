@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include "Benchmark.h"
+#include <base/Atomic.h>
+#include <base/Vector.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#    include <sys/mman.h>
+#endif
+
+// Messages one way over a pipe or a socket pair, each client with its own
+// connection and a thread on the other end reading. The copying transports
+// are the baseline of IO::Connection. On Linux, shared_memory does what
+// its shared messages do, one memfd per message passed along the socket
+// and mapped by the reader, which puts a number on what the mapping costs
+// against the copies it saves. userland/benchmarks/IPCBenchmark.cpp is
+// the same in-system, over Connection itself.
+
+enum class Transport {
+    Pipe,
+    Socket,
+    SharedMemory,
+};
+
+static constexpr size_t max_clients = 8;
+
+static bool write_all(int fd, void const* data, size_t size)
+{
+    auto* bytes = static_cast<u8 const*>(data);
+    while (size) {
+        ssize_t written = write(fd, bytes, size);
+        if (written <= 0)
+            return false;
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void* data, size_t size)
+{
+    auto* bytes = static_cast<u8*>(data);
+    while (size) {
+        ssize_t nread = read(fd, bytes, size);
+        if (nread <= 0)
+            return false;
+        bytes += nread;
+        size -= nread;
+    }
+    return true;
+}
+
+#ifdef __linux__
+
+static bool send_shared(int socket, void const* data, size_t size)
+{
+    int memory = memfd_create("BenchmarkIPC", 0);
+    if (memory < 0)
+        return false;
+
+    bool sent = false;
+    if (ftruncate(memory, size) == 0) {
+        void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+        if (mapping != MAP_FAILED) {
+            memcpy(mapping, data, size);
+            munmap(mapping, size);
+
+            char control[CMSG_SPACE(sizeof(int))] {};
+            u8 kind = 0;
+            iovec vec { &kind, sizeof(kind) };
+            msghdr message {};
+            message.msg_iov = &vec;
+            message.msg_iovlen = 1;
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+
+            auto* header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(header), &memory, sizeof(int));
+
+            sent = sendmsg(socket, &message, 0) == sizeof(kind);
+        }
+    }
+
+    close(memory);
+    return sent;
+}
+
+static bool receive_shared(int socket, size_t size)
+{
+    char control[CMSG_SPACE(sizeof(int))] {};
+    u8 kind = 0;
+    iovec vec { &kind, sizeof(kind) };
+    msghdr message {};
+    message.msg_iov = &vec;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    if (recvmsg(socket, &message, 0) != sizeof(kind))
+        return false;
+
+    auto* header = CMSG_FIRSTHDR(&message);
+    if (!header || header->cmsg_type != SCM_RIGHTS)
+        return false;
+
+    int memory;
+    memcpy(&memory, CMSG_DATA(header), sizeof(int));
+
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, memory, 0);
+    close(memory);
+    if (mapping == MAP_FAILED)
+        return false;
+
+    // Read in place, a byte a page is enough to fault them in.
+    u8 sum = 0;
+    for (size_t offset = 0; offset < size; offset += 4096)
+        sum += static_cast<u8 const*>(mapping)[offset];
+    Benchmark::do_not_optimize(sum);
+
+    munmap(mapping, size);
+    return true;
+}
+
+#endif
+
+struct Client {
+    Transport transport { Transport::Socket };
+    size_t payload_size { 0 };
+    u64 messages { 0 };
+    int writer { -1 };
+    int reader { -1 };
+    Atomic<bool>* start { nullptr };
+    Vector<u8> payload;
+    Vector<u8> received;
+};
+
+static void wait_for_start(Client& client)
+{
+    while (!client.start->load(Base::memory_order_acquire))
+        sched_yield();
+}
+
+static void* run_sender(void* argument)
+{
+    auto& client = *static_cast<Client*>(argument);
+    wait_for_start(client);
+    for (u64 i = 0; i < client.messages; ++i) {
+#ifdef __linux__
+        if (client.transport == Transport::SharedMemory) {
+            if (!send_shared(client.writer, client.payload.data(), client.payload_size))
+                break;
+            continue;
+        }
+#endif
+        if (!write_all(client.writer, client.payload.data(), client.payload_size))
+            break;
+    }
+    return nullptr;
+}
+
+static void* run_receiver(void* argument)
+{
+    auto& client = *static_cast<Client*>(argument);
+    wait_for_start(client);
+    for (u64 i = 0; i < client.messages; ++i) {
+#ifdef __linux__
+        if (client.transport == Transport::SharedMemory) {
+            if (!receive_shared(client.reader, client.payload_size))
+                break;
+            continue;
+        }
+#endif
+        if (!read_all(client.reader, client.received.data(), client.payload_size))
+            break;
+    }
+    return nullptr;
+}
+
+static bool open_channel(Transport transport, Client& client)
+{
+    int fds[2];
+    if (transport == Transport::Pipe) {
+        if (pipe(fds) < 0)
+            return false;
+        client.reader = fds[0];
+        client.writer = fds[1];
+        return true;
+    }
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+        return false;
+    client.reader = fds[0];
+    client.writer = fds[1];
+    return true;
+}
+
+static void run(Benchmark::State& state, Transport transport, size_t payload_size, size_t client_count)
+{
+    VERIFY(client_count <= max_clients);
+    state.set_bytes_per_iteration(payload_size * client_count);
+    state.set_items_per_iteration(client_count);
+
+    state.pause();
+    Atomic<bool> start { false };
+    Client clients[max_clients];
+    pthread_t threads[max_clients * 2];
+    size_t thread_count = 0;
+
+    for (size_t i = 0; i < client_count; ++i) {
+        auto& client = clients[i];
+        client.transport = transport;
+        client.payload_size = payload_size;
+        client.messages = state.iterations();
+        client.start = &start;
+        client.payload.resize(payload_size);
+        memset(client.payload.data(), 'A' + i, payload_size);
+        if (transport != Transport::SharedMemory)
+            client.received.resize(payload_size);
+
+        VERIFY(open_channel(transport, client));
+        VERIFY(pthread_create(&threads[thread_count++], nullptr, run_sender, &client) == 0);
+        VERIFY(pthread_create(&threads[thread_count++], nullptr, run_receiver, &client) == 0);
+    }
+    state.resume();
+
+    start.store(true, Base::memory_order_release);
+    for (size_t i = 0; i < thread_count; ++i)
+        pthread_join(threads[i], nullptr);
+
+    state.pause();
+    for (size_t i = 0; i < client_count; ++i) {
+        close(clients[i].reader);
+        close(clients[i].writer);
+    }
+    state.resume();
+}
+
+BENCHMARK(IPC, pipe_64)
+{
+    run(state, Transport::Pipe, 64, 1);
+}
+
+BENCHMARK(IPC, pipe_4k)
+{
+    run(state, Transport::Pipe, 4 * KiB, 1);
+}
+
+BENCHMARK(IPC, pipe_64k)
+{
+    run(state, Transport::Pipe, 64 * KiB, 1);
+}
+
+BENCHMARK(IPC, pipe_1m)
+{
+    run(state, Transport::Pipe, 1 * MiB, 1);
+}
+
+BENCHMARK(IPC, socket_64)
+{
+    run(state, Transport::Socket, 64, 1);
+}
+
+BENCHMARK(IPC, socket_4k)
+{
+    run(state, Transport::Socket, 4 * KiB, 1);
+}
+
+BENCHMARK(IPC, socket_64k)
+{
+    run(state, Transport::Socket, 64 * KiB, 1);
+}
+
+BENCHMARK(IPC, socket_1m)
+{
+    run(state, Transport::Socket, 1 * MiB, 1);
+}
+
+BENCHMARK(IPC, socket_64_4_clients)
+{
+    run(state, Transport::Socket, 64, 4);
+}
+
+BENCHMARK(IPC, socket_64k_4_clients)
+{
+    run(state, Transport::Socket, 64 * KiB, 4);
+}
+
+BENCHMARK(IPC, socket_1m_4_clients)
+{
+    run(state, Transport::Socket, 1 * MiB, 4);
+}
+
+#ifdef __linux__
+
+BENCHMARK(IPC, shared_memory_4k)
+{
+    run(state, Transport::SharedMemory, 4 * KiB, 1);
+}
+
+BENCHMARK(IPC, shared_memory_64k)
+{
+    run(state, Transport::SharedMemory, 64 * KiB, 1);
+}
+
+BENCHMARK(IPC, shared_memory_1m)
+{
+    run(state, Transport::SharedMemory, 1 * MiB, 1);
+}
+
+BENCHMARK(IPC, shared_memory_1m_4_clients)
+{
+    run(state, Transport::SharedMemory, 1 * MiB, 4);
+}
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include "Benchmark.h"
+#include <base/JsonDocument.h>
+#include <base/JsonParser.h>
+#include <base/JsonPathQuery.h>
+#include <base/JsonPullParser.h>
+#include <base/JsonValue.h>
+#include <base/StringBuilder.h>
+
+// An array of records with strings, numbers, booleans and nested objects,
+// about 100 KiB of it.
+static String make_document()
+{
+    StringBuilder builder;
+    builder.append('[');
+    for (size_t i = 0; i < 1'000; ++i) {
+        if (i)
+            builder.append(',');
+        builder.appendff("{{\"id\":{},\"name\":\"item number {}\",\"price\":{}.{},\"available\":{},"
+                         "\"tags\":[\"alpha\",\"beta\",\"gamma\"],\"dimensions\":{{\"width\":{},\"height\":{}}},"
+                         "\"note\":\"line\\nbreak \\\"quoted\\\"\"}}",
+            i, i, i % 100, i % 10, i % 2 ? "true" : "false", i * 3, i * 7);
+    }
+    builder.append(']');
+    return builder.to_string();
+}
+
+BENCHMARK(JsonParser, parse)
+{
+    auto document = make_document();
+
+    state.set_bytes_per_iteration(document.length());
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration)
+        Benchmark::do_not_optimize(JsonParser(document).parse().has_value());
+}
+
+BENCHMARK(JsonParser, parse_and_serialize)
+{
+    auto document = make_document();
+    auto value = JsonValue::from_string(document);
+    VERIFY(value.has_value());
+
+    state.set_bytes_per_iteration(document.length());
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration)
+        Benchmark::do_not_optimize(value.value().to_string());
+}
+
+BENCHMARK(JsonDocument, parse)
+{
+    auto document = make_document();
+
+    state.set_bytes_per_iteration(document.length());
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration)
+        Benchmark::do_not_optimize(JsonDocument::parse(document));
+}
+
+BENCHMARK(JsonPullParser, tokens)
+{
+    auto document = make_document();
+
+    state.set_bytes_per_iteration(document.length());
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration) {
+        JsonPullParser parser(document);
+        size_t tokens = 0;
+        for (;;) {
+            auto token = parser.next();
+            if (token.type == JsonPullParser::TokenType::End || token.type == JsonPullParser::TokenType::Error)
+                break;
+            ++tokens;
+        }
+        Benchmark::do_not_optimize(tokens);
+    }
+}
+
+BENCHMARK(JsonPathQuery, every_price)
+{
+    auto document = make_document();
+    JsonPath path;
+    path.append(JsonPathElement::any_array_element);
+    path.append("price");
+    JsonPathQuery query(path);
+
+    state.set_bytes_per_iteration(document.length());
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration) {
+        size_t matches = 0;
+        query.run(document, [&](auto&) {
+            ++matches;
+            return IterationDecision::Continue;
+        });
+        Benchmark::do_not_optimize(matches);
+    }
+}
+
+BENCHMARK(JsonPathQuery, first_fields)
+{
+    auto document = make_document();
+    Vector<JsonPath> paths;
+    for (auto* key : { "id", "name" }) {
+        JsonPath path;
+        path.append(0);
+        path.append(StringView(key));
+        paths.append(move(path));
+    }
+    JsonPathQuery query(paths);
+
+    state.set_bytes_per_iteration(document.length());
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration) {
+        size_t matches = 0;
+        query.run(document, [&](auto&) {
+            ++matches;
+            return IterationDecision::Continue;
+        });
+        Benchmark::do_not_optimize(matches);
+    }
+}
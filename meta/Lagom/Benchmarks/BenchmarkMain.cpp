@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include "Benchmark.h"
+#include <base/Format.h>
+#include <base/String.h>
+#include <base/StringBuilder.h>
+#include <base/Vector.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+namespace Benchmark {
+
+struct Entry {
+    StringView suite;
+    StringView name;
+    Function function;
+};
+
+// Registrations run from static constructors in any order, so the list
+// is created by the first of them.
+static Vector<Entry>& entries()
+{
+    static Vector<Entry> s_entries;
+    return s_entries;
+}
+
+Registration::Registration(StringView suite, StringView name, Function function)
+{
+    entries().append({ suite, name, function });
+}
+
+u64 now_ns()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1'000'000'000 + now.tv_nsec;
+}
+
+u64 now_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+void State::pause()
+{
+    m_pause_started_ns = now_ns();
+    m_pause_started_cycles = now_cycles();
+}
+
+void State::resume()
+{
+    m_paused_ns += now_ns() - m_pause_started_ns;
+    m_paused_cycles += now_cycles() - m_pause_started_cycles;
+}
+
+struct Options {
+    StringView filter;
+    u64 min_time_ns { 200'000'000 };
+    u64 warmup_ns { 20'000'000 };
+    bool json { false };
+};
+
+struct Measurement {
+    u64 iterations { 0 };
+    u64 ns { 0 };
+    u64 cycles { 0 };
+    u64 bytes_per_iteration { 0 };
+    u64 items_per_iteration { 0 };
+};
+
+static Measurement measure(Function function, u64 iterations)
+{
+    State state(iterations);
+
+    u64 start_ns = now_ns();
+    u64 start_cycles = now_cycles();
+    function(state);
+    u64 ns = now_ns() - start_ns;
+    u64 cycles = now_cycles() - start_cycles;
+
+    return {
+        iterations,
+        ns > state.paused_ns() ? ns - state.paused_ns() : 0,
+        cycles > state.paused_cycles() ? cycles - state.paused_cycles() : 0,
+        state.bytes_per_iteration(),
+        state.items_per_iteration(),
+    };
+}
+
+// Warms up caches and branch predictors first, then grows the iteration
+// count from what the last run took until one run lasts at least
+// min_time_ns, and reports that run.
+static Measurement run(Function function, Options const& options)
+{
+    u64 warmup_start = now_ns();
+    do {
+        measure(function, 1);
+    } while (now_ns() - warmup_start < options.warmup_ns);
+
+    static constexpr u64 max_iterations = 1'000'000'000;
+
+    u64 iterations = 1;
+    for (;;) {
+        auto measurement = measure(function, iterations);
+        if (measurement.ns >= options.min_time_ns || iterations >= max_iterations)
+            return measurement;
+
+        // Aims a bit past the minimum so the next run is most likely the
+        // last, without growing more than tenfold on a run too short to
+        // say much.
+        u64 next = measurement.ns > 0
+            ? (u64)((double)iterations * options.min_time_ns * 1.4 / measurement.ns)
+            : iterations * 10;
+        iterations = min(max(next, iterations + 1), min(iterations * 10, max_iterations));
+    }
+}
+
+static void print_human(StringView suite, StringView name, Measurement const& measurement)
+{
+    double ns_per_op = (double)measurement.ns / measurement.iterations;
+    double cycles_per_op = (double)measurement.cycles / measurement.iterations;
+
+    StringBuilder builder;
+    builder.appendff("{}/{}", suite, name);
+    while (builder.length() < 40)
+        builder.append(' ');
+    builder.appendff("{:12.2} ns/op {:12.2} cycles/op {:12} iterations", ns_per_op, cycles_per_op, measurement.iterations);
+
+    if (measurement.bytes_per_iteration && measurement.ns) {
+        double megabytes_per_second = (double)measurement.bytes_per_iteration * measurement.iterations * 1000.0 / measurement.ns;
+        builder.appendff(" {:10.2} MB/s", megabytes_per_second);
+    }
+    if (measurement.items_per_iteration && measurement.ns) {
+        double items_per_second = (double)measurement.items_per_iteration * measurement.iterations * 1'000'000'000.0 / measurement.ns;
+        builder.appendff(" {:12.0} items/s", items_per_second);
+    }
+
+    outln("{}", builder.string_view());
+}
+
+static void append_json(StringBuilder& builder, StringView suite, StringView name, Measurement const& measurement)
+{
+    builder.append("{\"suite\":\"");
+    builder.append_escaped_for_json(suite);
+    builder.append("\",\"name\":\"");
+    builder.append_escaped_for_json(name);
+    builder.appendff("\",\"iterations\":{},\"ns\":{},\"cycles\":{}", measurement.iterations, measurement.ns, measurement.cycles);
+    builder.appendff(",\"ns_per_op\":{:.3},\"cycles_per_op\":{:.3}", (double)measurement.ns / measurement.iterations, (double)measurement.cycles / measurement.iterations);
+    if (measurement.bytes_per_iteration)
+        builder.appendff(",\"bytes_per_op\":{}", measurement.bytes_per_iteration);
+    if (measurement.items_per_iteration)
+        builder.appendff(",\"items_per_op\":{}", measurement.items_per_iteration);
+    builder.append('}');
+}
+
+static void print_usage(char const* program)
+{
+    warnln("Usage: {} [--filter SUBSTRING] [--min-time-ms N] [--json] [--list]", program);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    using namespace Benchmark;
+
+    Options options;
+    bool list = false;
+
+    for (int i = 1; i < argc; ++i) {
+        StringView argument = argv[i];
+        if (argument == "--filter"sv && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (argument == "--min-time-ms"sv && i + 1 < argc) {
+            auto milliseconds = StringView(argv[++i]).to_uint();
+            if (!milliseconds.has_value()) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            options.min_time_ns = (u64)milliseconds.value() * 1'000'000;
+        } else if (argument == "--json"sv) {
+            options.json = true;
+        } else if (argument == "--list"sv) {
+            list = true;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    StringBuilder json;
+    json.append('[');
+    bool first = true;
+
+    for (auto& entry : entries()) {
+        auto full_name = String::formatted("{}/{}", entry.suite, entry.name);
+        if (!options.filter.is_empty() && !full_name.contains(options.filter))
+            continue;
+
+        if (list) {
+            outln("{}", full_name);
+            continue;
+        }
+
+        auto measurement = run(entry.function, options);
+
+        if (options.json) {
+            if (!first)
+                json.append(',');
+            append_json(json, entry.suite, entry.name, measurement);
+            first = false;
+        } else {
+            print_human(entry.suite, entry.name, measurement);
+        }
+    }
+
+    json.append(']');
+    if (options.json && !list)
+        outln("{}", json.string_view());
+
+    return 0;
+}
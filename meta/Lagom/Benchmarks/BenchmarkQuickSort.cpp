@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include "Benchmark.h"
+#include <base/QuickSort.h>
+#include <base/String.h>
+#include <base/Vector.h>
+
+static constexpr size_t element_count = 10'000;
+
+static Vector<u32> make_random()
+{
+    Vector<u32> values;
+    values.ensure_capacity(element_count);
+    u32 value = 0x9e3779b9;
+    for (size_t i = 0; i < element_count; ++i) {
+        value ^= value << 13;
+        value ^= value >> 17;
+        value ^= value << 5;
+        values.append(value);
+    }
+    return values;
+}
+
+// Sorts a fresh copy of input each iteration, the copy isn't measured.
+template<typename T>
+static void sort_copies(Benchmark::State& state, Vector<T> const& input)
+{
+    state.set_items_per_iteration(input.size());
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration) {
+        state.pause();
+        auto values = input;
+        state.resume();
+        quick_sort(values);
+        Benchmark::do_not_optimize(values.data());
+    }
+}
+
+BENCHMARK(QuickSort, random)
+{
+    sort_copies(state, make_random());
+}
+
+BENCHMARK(QuickSort, sorted)
+{
+    auto values = make_random();
+    quick_sort(values);
+    sort_copies(state, values);
+}
+
+BENCHMARK(QuickSort, reversed)
+{
+    auto values = make_random();
+    quick_sort(values, [](u32 a, u32 b) { return a > b; });
+    sort_copies(state, values);
+}
+
+BENCHMARK(QuickSort, few_unique)
+{
+    auto values = make_random();
+    for (auto& value : values)
+        value %= 8;
+    sort_copies(state, values);
+}
+
+BENCHMARK(QuickSort, strings)
+{
+    Vector<String> values;
+    for (auto value : make_random())
+        values.append(String::number(value));
+    sort_copies(state, values);
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include "Benchmark.h"
+#include <base/String.h>
+#include <base/StringBuilder.h>
+#include <base/Vector.h>
+
+static constexpr size_t word_count = 1'000;
+
+static String make_sentence()
+{
+    StringBuilder builder;
+    for (size_t i = 0; i < word_count; ++i) {
+        if (i)
+            builder.append(' ');
+        builder.append("word");
+        builder.append((char)('a' + i % 26));
+    }
+    return builder.to_string();
+}
+
+BENCHMARK(StringBuilder, append_words)
+{
+    state.set_items_per_iteration(word_count);
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration) {
+        StringBuilder builder;
+        for (size_t i = 0; i < word_count; ++i) {
+            builder.append("word"sv);
+            builder.append(' ');
+        }
+        Benchmark::do_not_optimize(builder.to_string());
+    }
+}
+
+BENCHMARK(StringBuilder, append_characters)
+{
+    static constexpr size_t character_count = 64 * 1024;
+
+    state.set_bytes_per_iteration(character_count);
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration) {
+        StringBuilder builder;
+        for (size_t i = 0; i < character_count; ++i)
+            builder.append((char)('a' + i % 26));
+        Benchmark::do_not_optimize(builder.length());
+    }
+}
+
+BENCHMARK(String, copy_and_compare)
+{
+    auto sentence = make_sentence();
+
+    state.set_bytes_per_iteration(sentence.length());
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration) {
+        String copy { sentence.characters(), sentence.length() };
+        Benchmark::do_not_optimize(copy == sentence);
+    }
+}
+
+BENCHMARK(String, split)
+{
+    auto sentence = make_sentence();
+
+    state.set_items_per_iteration(word_count);
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration)
+        Benchmark::do_not_optimize(sentence.split(' ').size());
+}
+
+BENCHMARK(String, split_view)
+{
+    auto sentence = make_sentence();
+
+    state.set_items_per_iteration(word_count);
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration)
+        Benchmark::do_not_optimize(sentence.split_view(' ').size());
+}
+
+BENCHMARK(String, hash)
+{
+    auto sentence = make_sentence();
+
+    state.set_bytes_per_iteration(sentence.length());
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration) {
+        // A new string each time, the hash of one is cached.
+        state.pause();
+        String copy { sentence.characters(), sentence.length() };
+        state.resume();
+        Benchmark::do_not_optimize(copy.hash());
+    }
+}
+
+BENCHMARK(String, number)
+{
+    static constexpr size_t number_count = 1'000;
+
+    state.set_items_per_iteration(number_count);
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration) {
+        for (size_t i = 0; i < number_count; ++i)
+            Benchmark::do_not_optimize(String::number(i * 7919));
+    }
+}
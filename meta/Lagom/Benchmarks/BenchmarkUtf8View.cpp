@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include "Benchmark.h"
+#include <base/StringBuilder.h>
+#include <base/Utf8View.h>
+
+static String make_text(bool ascii_only)
+{
+    StringBuilder builder;
+    for (size_t i = 0; i < 4'096; ++i) {
+        builder.append("plain text "sv);
+        if (!ascii_only)
+            builder.append("äöü ελληνικά 日本語 🎉 "sv);
+    }
+    return builder.to_string();
+}
+
+BENCHMARK(Utf8View, validate_ascii)
+{
+    auto text = make_text(true);
+
+    state.set_bytes_per_iteration(text.length());
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration)
+        Benchmark::do_not_optimize(Utf8View(text).validate());
+}
+
+BENCHMARK(Utf8View, validate_mixed)
+{
+    auto text = make_text(false);
+
+    state.set_bytes_per_iteration(text.length());
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration)
+        Benchmark::do_not_optimize(Utf8View(text).validate());
+}
+
+BENCHMARK(Utf8View, length_mixed)
+{
+    auto text = make_text(false);
+
+    state.set_bytes_per_iteration(text.length());
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration)
+        Benchmark::do_not_optimize(Utf8View(text).length());
+}
+
+BENCHMARK(Utf8View, iterate_mixed)
+{
+    auto text = make_text(false);
+
+    state.set_bytes_per_iteration(text.length());
+    for (u64 iteration = 0; iteration < state.iterations(); ++iteration) {
+        u32 sum = 0;
+        for (auto code_point : Utf8View(text))
+            sum += code_point;
+        Benchmark::do_not_optimize(sum);
+    }
+}
@@ -0,0 +1,365 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Format.h>
+#include <base/NumericLimits.h>
+#include <base/QuickSort.h>
+#include <base/String.h>
+#include <base/StringBuilder.h>
+#include <base/StringHash.h>
+#include <base/StringView.h>
+#include <base/Vector.h>
+#include <dirent.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#    include <linux/perf_event.h>
+#    include <sys/syscall.h>
+#endif
+
+// Runs a fuzzer's LLVMFuzzerTestOneInput() on inputs at growing sizes to
+// find the ones whose cost grows faster than their size: a parser that
+// rescans what it already read, a decoder that searches linearly for
+// every symbol. libFuzzer only stops on those when they hit -timeout.
+//
+// Each input is measured as prefixes of itself, from an eighth to all of
+// it, and repeated up to eight times. The slope of log(cost) over
+// log(size) is about 1 for linear work and 2 for quadratic; an input
+// above --max-exponent on either is reported as superlinear, and copied
+// to --save-to if given. Saved inputs make up SlowInputs/<fuzzer>, which
+// ctest runs with --check so the slowdowns stay fixed.
+//
+// Cost is counted in instructions where perf events are readable, the
+// steadiest measure, in heap allocations under a sanitizer, or in CPU
+// time, taking the fastest of a few runs.
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+// Part of every sanitizer runtime, and missing without one.
+extern "C" int __sanitizer_install_malloc_and_free_hooks(void (*)(const volatile void*, size_t), void (*)(const volatile void*)) __attribute__((weak));
+
+namespace Complexity {
+
+enum class Metric {
+    Instructions,
+    Allocations,
+    Time,
+};
+
+enum class Scaling {
+    Prefix,
+    Repeat,
+};
+
+struct Options {
+    Metric metric { Metric::Instructions };
+    double max_exponent { 1.5 };
+    // Below this, fixed costs like setting up a decoder outweigh the part
+    // that grows with the input.
+    size_t min_size { 64 };
+    size_t max_size { 1 * MiB };
+    String save_to;
+    bool check { false };
+};
+
+static int s_instruction_counter_fd = -1;
+static u64 s_allocations = 0;
+
+static void count_allocation(const volatile void*, size_t)
+{
+    __atomic_fetch_add(&s_allocations, 1, __ATOMIC_RELAXED);
+}
+
+static void ignore_free(const volatile void*)
+{
+}
+
+static bool open_instruction_counter()
+{
+#ifdef __linux__
+    perf_event_attr attributes {};
+    attributes.type = PERF_TYPE_HARDWARE;
+    attributes.size = sizeof(attributes);
+    attributes.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    s_instruction_counter_fd = syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+    return s_instruction_counter_fd >= 0;
+#else
+    return false;
+#endif
+}
+
+static bool set_up_metric(Metric metric)
+{
+    switch (metric) {
+    case Metric::Instructions:
+        return open_instruction_counter();
+    case Metric::Allocations:
+        return __sanitizer_install_malloc_and_free_hooks && __sanitizer_install_malloc_and_free_hooks(count_allocation, ignore_free);
+    case Metric::Time:
+        return true;
+    }
+    VERIFY_NOT_REACHED();
+}
+
+static StringView unit_of(Metric metric)
+{
+    switch (metric) {
+    case Metric::Instructions:
+        return "instructions";
+    case Metric::Allocations:
+        return "allocations";
+    case Metric::Time:
+        return "ns";
+    }
+    VERIFY_NOT_REACHED();
+}
+
+static u64 read_metric(Metric metric)
+{
+    switch (metric) {
+    case Metric::Instructions: {
+        u64 count = 0;
+        auto nread = read(s_instruction_counter_fd, &count, sizeof(count));
+        VERIFY(nread == sizeof(count));
+        return count;
+    }
+    case Metric::Allocations:
+        return __atomic_load_n(&s_allocations, __ATOMIC_RELAXED);
+    case Metric::Time: {
+        timespec now;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+        return (u64)now.tv_sec * 1'000'000'000 + now.tv_nsec;
+    }
+    }
+    VERIFY_NOT_REACHED();
+}
+
+static u64 measure(Vector<u8> const& input, Options const& options)
+{
+    // The first run pays for statics set up on first use and cold caches.
+    LLVMFuzzerTestOneInput(input.data(), input.size());
+
+    int runs = options.metric == Metric::Time ? 5 : 1;
+    u64 best = NumericLimits<u64>::max();
+    for (int i = 0; i < runs; ++i) {
+        u64 start = read_metric(options.metric);
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+        best = min(best, read_metric(options.metric) - start);
+    }
+    // Keeps the logarithms finite for inputs that allocate nothing.
+    return max<u64>(best, 1);
+}
+
+static Vector<u8> scaled(Vector<u8> const& input, Scaling scaling, size_t step)
+{
+    Vector<u8> result;
+    switch (scaling) {
+    case Scaling::Prefix:
+        result.append(input.data(), input.size() >> (3 - step));
+        break;
+    case Scaling::Repeat:
+        for (size_t i = 0; i < (1u << step); ++i)
+            result.append(input.data(), input.size());
+        break;
+    }
+    return result;
+}
+
+struct Growth {
+    double exponent { 0 };
+    size_t samples { 0 };
+};
+
+// The least squares slope of log(cost) over log(size), from an eighth of
+// the input to all of it, or from one copy to eight.
+static Growth measure_growth(Vector<u8> const& input, Scaling scaling, Options const& options)
+{
+    double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+    size_t samples = 0;
+    for (size_t step = 0; step <= 3; ++step) {
+        auto variant = scaled(input, scaling, step);
+        if (variant.size() < options.min_size || variant.size() > options.max_size)
+            continue;
+        double x = ::log((double)variant.size());
+        double y = ::log((double)measure(variant, options));
+        sum_x += x;
+        sum_y += y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+        ++samples;
+    }
+
+    // Two sizes are too few to tell a trend from noise.
+    if (samples < 3)
+        return {};
+    double denominator = samples * sum_xx - sum_x * sum_x;
+    return { (samples * sum_xy - sum_x * sum_y) / denominator, samples };
+}
+
+static bool read_file(String const& path, Vector<u8>& contents)
+{
+    auto* file = fopen(path.characters(), "rb");
+    if (!file)
+        return false;
+    u8 buffer[4096];
+    size_t nread;
+    while ((nread = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        contents.append(buffer, nread);
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+static bool write_file(String const& path, Vector<u8> const& contents)
+{
+    auto* file = fopen(path.characters(), "wb");
+    if (!file)
+        return false;
+    bool ok = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+    return fclose(file) == 0 && ok;
+}
+
+// libFuzzer corpora are flat directories, so one level is enough.
+static void collect_inputs(String const& path, Vector<String>& inputs)
+{
+    struct stat st;
+    if (stat(path.characters(), &st) < 0) {
+        warnln("{}: {}", path, strerror(errno));
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        inputs.append(path);
+        return;
+    }
+
+    auto* directory = opendir(path.characters());
+    if (!directory) {
+        warnln("{}: {}", path, strerror(errno));
+        return;
+    }
+    while (auto* entry = readdir(directory)) {
+        if (entry->d_name[0] == '.')
+            continue;
+        auto entry_path = String::formatted("{}/{}", path, entry->d_name);
+        if (stat(entry_path.characters(), &st) == 0 && S_ISREG(st.st_mode))
+            inputs.append(move(entry_path));
+    }
+    closedir(directory);
+    quick_sort(inputs);
+}
+
+// Whether the input grows superlinearly.
+static bool analyze(String const& path, Options const& options)
+{
+    Vector<u8> input;
+    if (!read_file(path, input)) {
+        warnln("{}: {}", path, strerror(errno));
+        return false;
+    }
+
+    u64 cost = measure(input, options);
+    auto by_prefix = measure_growth(input, Scaling::Prefix, options);
+    auto by_repetition = measure_growth(input, Scaling::Repeat, options);
+    bool is_superlinear = (by_prefix.samples && by_prefix.exponent > options.max_exponent)
+        || (by_repetition.samples && by_repetition.exponent > options.max_exponent);
+
+    StringBuilder builder;
+    builder.appendff("{}: {} bytes, {:.1} {}/byte", path, input.size(), (double)cost / max<size_t>(input.size(), 1), unit_of(options.metric));
+    if (by_prefix.samples)
+        builder.appendff(", exponent {:.2} by prefix", by_prefix.exponent);
+    if (by_repetition.samples)
+        builder.appendff(", {:.2} by repetition", by_repetition.exponent);
+    if (is_superlinear)
+        builder.append(", SUPERLINEAR");
+    outln("{}", builder.string_view());
+
+    if (is_superlinear && !options.save_to.is_empty()) {
+        auto hash = string_hash(reinterpret_cast<char const*>(input.data()), input.size());
+        auto saved_path = String::formatted("{}/slow-{:08x}", options.save_to, hash);
+        if (!write_file(saved_path, input))
+            warnln("{}: {}", saved_path, strerror(errno));
+    }
+    return is_superlinear;
+}
+
+static void print_usage(char const* program)
+{
+    warnln("Usage: {} [--metric instructions|allocations|time] [--max-exponent X] [--min-size N] [--max-size N] [--save-to DIRECTORY] [--check] INPUT...", program);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    using namespace Complexity;
+
+    Options options;
+    Vector<String> inputs;
+
+    for (int i = 1; i < argc; ++i) {
+        StringView argument = argv[i];
+        if (argument == "--metric"sv && i + 1 < argc) {
+            StringView metric = argv[++i];
+            if (metric == "instructions"sv) {
+                options.metric = Metric::Instructions;
+            } else if (metric == "allocations"sv) {
+                options.metric = Metric::Allocations;
+            } else if (metric == "time"sv) {
+                options.metric = Metric::Time;
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (argument == "--max-exponent"sv && i + 1 < argc) {
+            options.max_exponent = strtod(argv[++i], nullptr);
+        } else if ((argument == "--min-size"sv || argument == "--max-size"sv) && i + 1 < argc) {
+            auto size = StringView(argv[++i]).to_uint();
+            if (!size.has_value()) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            (argument == "--min-size"sv ? options.min_size : options.max_size) = size.value();
+        } else if (argument == "--save-to"sv && i + 1 < argc) {
+            options.save_to = argv[++i];
+        } else if (argument == "--check"sv) {
+            options.check = true;
+        } else if (argument.starts_with('-')) {
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            collect_inputs(argument, inputs);
+        }
+    }
+
+    if (inputs.is_empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (!set_up_metric(options.metric)) {
+        warnln("Can't count {}, measuring CPU time instead", unit_of(options.metric));
+        options.metric = Metric::Time;
+    }
+
+    size_t superlinear_count = 0;
+    for (auto& input : inputs) {
+        if (analyze(input, options))
+            ++superlinear_count;
+    }
+
+    outln("{} of {} inputs grow superlinearly", superlinear_count, inputs.size());
+    return options.check && superlinear_count ? 1 : 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/IDAllocator.h>
+
+#include "TestRandom.h"
+
+// IDAllocator in both modes against a plain array of what is allocated,
+// with max_id on either side of the 64 bit words and the 64 word summary,
+// filling it up, emptying it out and everything in between.
+
+static TestRandom s_random { 1 };
+
+static constexpr int s_largest_max_id = 64 * 64 * 2 + 1;
+static bool s_allocated[s_largest_max_id + 1];
+
+static void check_allocator(IDAllocator::Mode mode, int max_id)
+{
+    IDAllocator allocator { mode, max_id };
+    __builtin_memset(s_allocated, 0, sizeof(s_allocated));
+    size_t count = 0;
+
+    auto allocate = [&] {
+        auto id = allocator.try_allocate();
+        if (count == (size_t)max_id) {
+            VERIFY(!id.has_value());
+            return;
+        }
+        VERIFY(id.has_value());
+        VERIFY(id.value() >= 1 && id.value() <= max_id);
+        VERIFY(!s_allocated[id.value()]);
+        if (mode == IDAllocator::Mode::LowestFree) {
+            for (int lower = 1; lower < id.value(); lower++)
+                VERIFY(s_allocated[lower]);
+        }
+        s_allocated[id.value()] = true;
+        count++;
+    };
+
+    auto deallocate = [&] {
+        if (count == 0)
+            return;
+        int id;
+        do {
+            id = 1 + s_random.next() % max_id;
+        } while (!s_allocated[id]);
+        allocator.deallocate(id);
+        s_allocated[id] = false;
+        count--;
+    };
+
+    // All the way up, a bit past it, and back down; then around the middle.
+    for (int i = 0; i < max_id + 3; i++)
+        allocate();
+    VERIFY(count == (size_t)max_id);
+    for (int i = 0; i < max_id; i++)
+        deallocate();
+    VERIFY(count == 0);
+    for (int i = 0; i < max_id * 4; i++) {
+        if (s_random.next() % 8 < (count < (size_t)max_id / 2 ? 5u : 3u))
+            allocate();
+        else
+            deallocate();
+    }
+
+    VERIFY(allocator.allocated_count() == count);
+    for (int id = 0; id <= max_id + 64; id++)
+        VERIFY(allocator.is_allocated(id) == (id <= max_id && s_allocated[id]));
+}
+
+int main(int, char**)
+{
+    static constexpr int max_ids[] = { 1, 2, 63, 64, 65, 127, 128, 1000, 64 * 64 - 1, 64 * 64, 64 * 64 + 1, s_largest_max_id };
+
+    for (int round = 0; round < 4; round++) {
+        for (int max_id : max_ids) {
+            check_allocator(IDAllocator::Mode::LowestFree, max_id);
+            check_allocator(IDAllocator::Mode::Randomized, max_id);
+        }
+    }
+
+    // The default is the whole positive range, grown only as needed.
+    IDAllocator allocator;
+    for (int id = 1; id <= 10000; id++)
+        VERIFY(allocator.allocate() == id);
+    allocator.deallocate(5000);
+    allocator.deallocate(17);
+    VERIFY(allocator.allocate() == 17);
+    VERIFY(allocator.allocate() == 5000);
+    VERIFY(allocator.allocate() == 10001);
+
+    return report_all_agree("%zu allocators", 4 * 2 * sizeof(max_ids) / sizeof(max_ids[0]) + 1);
+}
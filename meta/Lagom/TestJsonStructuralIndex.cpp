@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/JsonStructuralIndex.h>
+
+#include "TestRandom.h"
+
+// JsonStructuralIndex against a scanner that goes a byte at a time, over
+// random JSON-ish inputs with strings, escapes and backslash runs that
+// cross the 64 byte blocks. AVX2 is used when the CPU has it; build it
+// without SSE2 too to check the other classifier.
+
+static TestRandom s_random { 1 };
+
+static bool is_op(u8 byte)
+{
+    return byte == '{' || byte == '}' || byte == '[' || byte == ']' || byte == ':' || byte == ',';
+}
+
+static bool is_whitespace(u8 byte)
+{
+    return byte == ' ' || byte == '\t' || byte == '\n' || byte == '\r';
+}
+
+// The entries the index should have, or false if it should fail.
+static bool reference_index(u8 const* input, size_t length, u32* entries, size_t& entry_count)
+{
+    entry_count = 0;
+    bool in_string = false;
+    bool escaped = false;
+    bool string_has_escapes = false;
+    bool after_separator = true;
+
+    for (size_t i = 0; i < length; i++) {
+        u8 byte = input[i];
+        bool is_escaped = escaped;
+        escaped = !is_escaped && byte == '\\';
+
+        if (in_string) {
+            if (byte < 0x20)
+                return false;
+            if (byte == '\\')
+                string_has_escapes = true;
+            if (byte == '"' && !is_escaped) {
+                entries[entry_count++] = i | (string_has_escapes ? JsonStructuralIndex::has_escapes_flag : 0);
+                in_string = false;
+                after_separator = true;
+            }
+            continue;
+        }
+
+        if (byte == '"' && !is_escaped) {
+            entries[entry_count++] = i;
+            in_string = true;
+            string_has_escapes = false;
+            continue;
+        }
+        if (is_op(byte)) {
+            entries[entry_count++] = i;
+            after_separator = true;
+            continue;
+        }
+        if (is_whitespace(byte)) {
+            after_separator = true;
+            continue;
+        }
+        if (after_separator)
+            entries[entry_count++] = i;
+        after_separator = false;
+    }
+    return !in_string;
+}
+
+static size_t random_input(u8* out, size_t capacity)
+{
+    size_t length = 0;
+    size_t target = s_random.next() % capacity;
+    while (length + 8 <= target) {
+        switch (s_random.next() % 8) {
+        case 0:
+        case 1: {
+            // A string, sometimes with escapes and long backslash runs.
+            out[length++] = '"';
+            size_t string_length = s_random.next() % 80;
+            for (size_t i = 0; i < string_length && length + 3 < target; i++) {
+                u32 kind = s_random.next() % 16;
+                if (kind == 0) {
+                    out[length++] = '\\';
+                    out[length++] = '"';
+                } else if (kind == 1) {
+                    size_t run = 1 + s_random.next() % 6;
+                    for (size_t j = 0; j < run && length + 2 < target; j++)
+                        out[length++] = '\\';
+                } else if (kind == 2) {
+                    out[length++] = "{}[]:, "[s_random.next() % 7];
+                } else {
+                    out[length++] = 'a' + s_random.next() % 26;
+                }
+            }
+            if (s_random.next() % 16)
+                out[length++] = '"';
+            break;
+        }
+        case 2:
+        case 3:
+            out[length++] = "{}[]:,"[s_random.next() % 6];
+            break;
+        case 4:
+            out[length++] = " \t\n\r"[s_random.next() % 4];
+            break;
+        case 5: {
+            size_t scalar_length = 1 + s_random.next() % 6;
+            for (size_t i = 0; i < scalar_length; i++)
+                out[length++] = "0123456789-.etrufnl"[s_random.next() % 19];
+            break;
+        }
+        case 6:
+            out[length++] = "\"\\"[s_random.next() % 2];
+            break;
+        default:
+            // Rarely, anything at all.
+            out[length++] = s_random.next() % 8 ? ' ' : s_random.next();
+            break;
+        }
+    }
+    return length;
+}
+
+int main(int, char**)
+{
+    static constexpr size_t capacity = 400;
+    u8 input[capacity];
+    u32 expected[capacity];
+
+    size_t failed = 0;
+    for (size_t round = 0; round < 200000; round++) {
+        size_t length = random_input(input, capacity);
+        size_t expected_count;
+        bool expected_valid = reference_index(input, length, expected, expected_count);
+
+        auto index = JsonStructuralIndex::create(StringView { reinterpret_cast<char const*>(input), length });
+        VERIFY(index.has_value() == expected_valid);
+        if (!expected_valid) {
+            failed++;
+            continue;
+        }
+
+        VERIFY(index->size() == expected_count);
+        size_t cursor = 0;
+        for (size_t i = 0; i < expected_count; i++) {
+            VERIFY(index->offset(i) == (expected[i] & ~JsonStructuralIndex::has_escapes_flag));
+            VERIFY(index->has_escapes(i) == ((expected[i] & JsonStructuralIndex::has_escapes_flag) != 0));
+
+            // The opening quotes lead to their closing ones.
+            size_t offset = index->offset(i);
+            if (input[offset] != '"' || cursor > i)
+                continue;
+            auto string = index->find_string(offset, cursor);
+            VERIFY(string.has_value());
+            VERIFY(string->closing_quote == index->offset(i + 1));
+            VERIFY(string->has_escapes == index->has_escapes(i + 1));
+        }
+    }
+
+    return report_all_agree("200000 inputs, %zu rejected", failed);
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/MemMem.h>
+
+#include "TestRandom.h"
+
+// The byte and substring searches of MemMem.h against the obvious loops,
+// over random haystacks of a small alphabet so that there are plenty of
+// near misses. Needles go from one byte to past the Two-Way cut off, and
+// haystacks start anywhere in a word. Build it with and without SSE2 to
+// check both sets of paths.
+
+static TestRandom s_random { 1 };
+
+static Optional<size_t> naive_memmem(u8 const* haystack, size_t haystack_length, u8 const* needle, size_t needle_length)
+{
+    if (needle_length > haystack_length)
+        return {};
+    for (size_t i = 0; i + needle_length <= haystack_length; i++) {
+        if (__builtin_memcmp(haystack + i, needle, needle_length) == 0)
+            return i;
+    }
+    return {};
+}
+
+static bool is_one_of(u8 byte, u8 const* needles, size_t needle_count)
+{
+    for (size_t i = 0; i < needle_count; i++) {
+        if (byte == needles[i])
+            return true;
+    }
+    return false;
+}
+
+int main(int, char**)
+{
+    static constexpr size_t capacity = 600;
+    u8 buffer[capacity + 8];
+    u8 needle[capacity];
+
+    size_t found = 0;
+    for (size_t round = 0; round < 300000; round++) {
+        u8* haystack = buffer + s_random.next() % 8;
+        size_t haystack_length = s_random.next() % capacity;
+        u8 alphabet = 2 + s_random.next() % 3;
+        for (size_t i = 0; i < haystack_length; i++)
+            haystack[i] = 'a' + s_random.next() % alphabet;
+
+        // Needles of up to 80 bytes, as often taken from the haystack as
+        // not, sometimes with a byte changed.
+        size_t needle_length = s_random.next() % 81;
+        if (haystack_length >= needle_length && s_random.next() % 2) {
+            size_t at = s_random.next() % (haystack_length - needle_length + 1);
+            __builtin_memcpy(needle, haystack + at, needle_length);
+            if (needle_length && s_random.next() % 4 == 0)
+                needle[s_random.next() % needle_length] = 'a' + s_random.next() % alphabet;
+        } else {
+            for (size_t i = 0; i < needle_length; i++)
+                needle[i] = 'a' + s_random.next() % alphabet;
+        }
+
+        auto expected = naive_memmem(haystack, haystack_length, needle, needle_length);
+        auto result = Base::memmem_optional(haystack, haystack_length, needle, needle_length);
+        VERIFY(result == expected);
+        found += expected.has_value() ? 1 : 0;
+
+        auto* pointer = (u8 const*)Base::memmem(haystack, haystack_length, needle, needle_length);
+        VERIFY(expected.has_value() ? pointer == haystack + expected.value() : pointer == nullptr);
+
+        // Up to five needles, one past what find_any_byte_of compares directly.
+        u8 byte = 'a' + s_random.next() % (alphabet + 1);
+        size_t needle_count = s_random.next() % 6;
+        u8 needles[5];
+        for (size_t i = 0; i < needle_count; i++)
+            needles[i] = 'a' + s_random.next() % (alphabet + 2);
+
+        Optional<size_t> first_byte, last_byte, first_any, last_any;
+        for (size_t i = 0; i < haystack_length; i++) {
+            if (haystack[i] == byte) {
+                if (!first_byte.has_value())
+                    first_byte = i;
+                last_byte = i;
+            }
+            if (is_one_of(haystack[i], needles, needle_count)) {
+                if (!first_any.has_value())
+                    first_any = i;
+                last_any = i;
+            }
+        }
+
+        VERIFY(Base::find_byte(haystack, haystack_length, byte) == first_byte);
+        VERIFY(Base::find_last_byte(haystack, haystack_length, byte) == last_byte);
+        VERIFY(Base::find_any_byte_of(haystack, haystack_length, needles, needle_count) == first_any);
+        VERIFY(Base::find_last_any_byte_of(haystack, haystack_length, needles, needle_count) == last_any);
+    }
+
+    return report_all_agree("300000 searches, %zu found", found);
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Assertions.h>
+#include <base/Types.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+// Xorshift32, for the inputs of the tests against a reference model. Each
+// test names its seed, so they come out the same on every run and every
+// platform and a failure always happens again.
+class TestRandom {
+public:
+    explicit TestRandom(u32 seed)
+        : m_state(seed)
+    {
+        // The one state xorshift never leaves.
+        VERIFY(seed != 0);
+    }
+
+    u32 next()
+    {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+    // Uniform in [low, high).
+    float next_float(float low, float high)
+    {
+        return low + (high - low) * ((next() >> 8) * (1.0f / 16777216));
+    }
+
+private:
+    u32 m_state { 0 };
+};
+
+// The last line of a test against a reference model, once nothing
+// disagreed: what was checked, then ", all agree". Returns what main()
+// returns.
+inline int report_all_agree(char const* format, ...) __attribute__((format(printf, 1, 2)));
+
+inline int report_all_agree(char const* format, ...)
+{
+    va_list arguments;
+    va_start(arguments, format);
+    vprintf(format, arguments);
+    va_end(arguments);
+
+    printf(", all agree\n");
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/SIMDMath.h>
+#include <float.h>
+#include <math.h>
+
+#include "TestRandom.h"
+
+// The SIMD math functions against libm in double precision, the special
+// values they promise, and the array versions against the vector ones for
+// every length of tail. The FFT against a direct DFT in double precision,
+// within the usual eps * log2(n) * |x| error bound, and back again.
+
+static TestRandom s_random { 1 };
+
+static constexpr size_t input_count = 100003;
+static float s_input[input_count];
+static float s_output[input_count];
+
+// Largest error over random inputs in [low, high), relative to the exact
+// result, or to 1 where it is smaller, for functions with zeroes in range.
+template<typename Function>
+static double worst_error(float low, float high, Function function, double (*reference)(double), bool relative_to_at_least_one)
+{
+    for (auto& value : s_input)
+        value = s_random.next_float(low, high);
+    function(Span<const float> { s_input, input_count }, Span<float> { s_output, input_count });
+
+    double worst = 0;
+    for (size_t i = 0; i < input_count; i++) {
+        double expected = reference(s_input[i]);
+        double scale = relative_to_at_least_one ? fmax(fabs(expected), 1.0) : fabs(expected);
+        worst = fmax(worst, fabs(s_output[i] - expected) / scale);
+    }
+    return worst;
+}
+
+static void check_accuracy()
+{
+    auto exp = [](auto input, auto output) { Base::SIMD::exp(input, output); };
+    auto log = [](auto input, auto output) { Base::SIMD::log(input, output); };
+    auto sin = [](auto input, auto output) { Base::SIMD::sin(input, output); };
+    auto cos = [](auto input, auto output) { Base::SIMD::cos(input, output); };
+    auto sqrt = [](auto input, auto output) { Base::SIMD::sqrt(input, output); };
+
+    // Two ulps, one for sqrtps which rounds correctly.
+    constexpr double two_ulps = 2 * FLT_EPSILON;
+    VERIFY(worst_error(-87, 88, exp, ::exp, false) < two_ulps);
+    VERIFY(worst_error(0.5, 2, log, ::log, true) < two_ulps);
+    VERIFY(worst_error(1e-30, 1e30, log, ::log, true) < two_ulps);
+    VERIFY(worst_error(-100, 100, sin, ::sin, true) < two_ulps);
+    VERIFY(worst_error(-100, 100, cos, ::cos, true) < two_ulps);
+    VERIFY(worst_error(0, 1e6, sqrt, ::sqrt, false) < FLT_EPSILON);
+}
+
+static void check_special_values()
+{
+    auto infinity = __builtin_huge_valf();
+    auto nan = __builtin_nanf("");
+
+    auto exp = Base::SIMD::exp(Base::SIMD::f32x4 { 0, infinity, -infinity, nan });
+    VERIFY(exp[0] == 1 && exp[1] == infinity && exp[2] == 0 && isnan(exp[3]));
+    exp = Base::SIMD::exp(Base::SIMD::f32x4 { 89, -88, 1, -1 });
+    VERIFY(exp[0] == infinity && exp[1] == 0);
+
+    auto log = Base::SIMD::log(Base::SIMD::f32x4 { 0, 1, infinity, -1 });
+    VERIFY(log[0] == -infinity && log[1] == 0 && log[2] == infinity && isnan(log[3]));
+    log = Base::SIMD::log(Base::SIMD::f32x4 { -0.0f, nan, -infinity, 1e-40f });
+    VERIFY(log[0] == -infinity && isnan(log[1]) && isnan(log[2]) && log[3] == -infinity);
+
+    auto sin = Base::SIMD::sin(Base::SIMD::f32x4 { 0, -0.0f, 1, -1 });
+    VERIFY(sin[0] == 0 && sin[1] == 0 && signbit(sin[1]) && sin[2] == -sin[3]);
+    auto cos = Base::SIMD::cos(Base::SIMD::f32x4 { 0, -0.0f, 1, -1 });
+    VERIFY(cos[0] == 1 && cos[1] == 1 && cos[2] == cos[3]);
+}
+
+// Every element comes out of the array versions as it does out of the
+// vector ones, wherever it is in the array and whatever its length.
+static void check_spans()
+{
+    float input[16];
+    float output[16];
+    for (size_t length = 0; length <= 13; length++) {
+        for (size_t offset = 0; offset < 3; offset++) {
+            for (size_t i = 0; i < 16; i++)
+                input[i] = s_random.next_float(-10, 10);
+            float before_end = output[offset + length] = 12345;
+
+            auto check = [&](auto array_function, auto vector_function) {
+                array_function(Span<const float> { input + offset, length }, Span<float> { output + offset, length });
+                VERIFY(output[offset + length] == before_end);
+                for (size_t i = 0; i < length; i++) {
+                    float expected = vector_function(Base::SIMD::f32x4 { input[offset + i], 0, 0, 0 })[0];
+                    VERIFY(__builtin_memcmp(&output[offset + i], &expected, sizeof(float)) == 0);
+                }
+            };
+            check([](auto in, auto out) { Base::SIMD::exp(in, out); }, [](Base::SIMD::f32x4 x) { return Base::SIMD::exp(x); });
+            check([](auto in, auto out) { Base::SIMD::sin(in, out); }, [](Base::SIMD::f32x4 x) { return Base::SIMD::sin(x); });
+            check([](auto in, auto out) { Base::SIMD::cos(in, out); }, [](Base::SIMD::f32x4 x) { return Base::SIMD::cos(x); });
+
+            for (size_t i = 0; i < 16; i++)
+                input[i] = fabsf(input[i]);
+            check([](auto in, auto out) { Base::SIMD::log(in, out); }, [](Base::SIMD::f32x4 x) { return Base::SIMD::log(x); });
+            check([](auto in, auto out) { Base::SIMD::sqrt(in, out); }, [](Base::SIMD::f32x4 x) { return Base::SIMD::sqrt(x); });
+
+            // In place.
+            __builtin_memcpy(output, input, sizeof(output));
+            Base::SIMD::sqrt(Span<const float> { output + offset, length }, Span<float> { output + offset, length });
+            for (size_t i = 0; i < length; i++)
+                VERIFY(output[offset + i] == sqrtf(input[offset + i]));
+        }
+    }
+}
+
+static void check_complex_multiply_accumulate()
+{
+    Complex<float> accumulator[11], a[11], b[11];
+    for (size_t length = 0; length <= 11; length++) {
+        double expected[11][2];
+        for (size_t i = 0; i < length; i++) {
+            // Sequenced one at a time, for the same values on every compiler.
+            float values[6];
+            for (auto& value : values)
+                value = s_random.next_float(-4, 4);
+            accumulator[i] = { values[0], values[1] };
+            a[i] = { values[2], values[3] };
+            b[i] = { values[4], values[5] };
+            expected[i][0] = (double)values[0] + (double)values[2] * values[4] - (double)values[3] * values[5];
+            expected[i][1] = (double)values[1] + (double)values[2] * values[5] + (double)values[3] * values[4];
+        }
+
+        Base::SIMD::complex_multiply_accumulate(Span<Complex<float>> { accumulator, length }, Span<const Complex<float>> { a, length }, Span<const Complex<float>> { b, length });
+        for (size_t i = 0; i < length; i++) {
+            VERIFY(fabs(accumulator[i].real() - expected[i][0]) < 32 * FLT_EPSILON);
+            VERIFY(fabs(accumulator[i].imag() - expected[i][1]) < 32 * FLT_EPSILON);
+        }
+    }
+}
+
+static void check_fft()
+{
+    static constexpr size_t max_size = 1024;
+    static Complex<float> data[max_size];
+    static Complex<float> original[max_size];
+
+    for (size_t size = 1, log2_size = 0; size <= max_size; size *= 2, log2_size++) {
+        double norm = 0;
+        for (size_t i = 0; i < size; i++) {
+            float real = s_random.next_float(-1, 1);
+            float imaginary = s_random.next_float(-1, 1);
+            data[i] = original[i] = { real, imaginary };
+            norm += (double)real * real + (double)imaginary * imaginary;
+        }
+        double bound = 2 * FLT_EPSILON * (log2_size + 1) * sqrt(norm);
+
+        Base::SIMD::fft(Span<Complex<float>> { data, size });
+        for (size_t k = 0; k < size; k++) {
+            double real = 0;
+            double imaginary = 0;
+            for (size_t j = 0; j < size; j++) {
+                double angle = -2 * M_PI * (double)((j * k) % size) / size;
+                real += original[j].real() * ::cos(angle) - original[j].imag() * ::sin(angle);
+                imaginary += original[j].real() * ::sin(angle) + original[j].imag() * ::cos(angle);
+            }
+            VERIFY(hypot(data[k].real() - real, data[k].imag() - imaginary) <= bound);
+        }
+
+        Base::SIMD::inverse_fft(Span<Complex<float>> { data, size });
+        for (size_t i = 0; i < size; i++) {
+            VERIFY(fabs(data[i].real() - original[i].real()) <= 4 * FLT_EPSILON * (log2_size + 1));
+            VERIFY(fabs(data[i].imag() - original[i].imag()) <= 4 * FLT_EPSILON * (log2_size + 1));
+        }
+    }
+}
+
+int main(int, char**)
+{
+    check_accuracy();
+    check_special_values();
+    check_spans();
+    check_complex_multiply_accumulate();
+    check_fft();
+
+    return report_all_agree("exp, log, sin, cos, sqrt and the FFT against libm and a direct DFT");
+}
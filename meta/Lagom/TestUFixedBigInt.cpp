@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/UFixedBigInt.h>
+
+#include "TestRandom.h"
+
+// Products, divisions and Montgomery arithmetic of UFixedBigInt against
+// schoolbook arithmetic on 32 bit digits, which has nothing in common with
+// the 64 bit limbs, halves and Karatsuba of the real thing. The numbers
+// are random with plenty of all-zero and all-one digits, to get the carries
+// through the middle products. Build it with and without __int128.
+
+static TestRandom s_random { 1 };
+
+static constexpr size_t max_digits = sizeof(u2048) / sizeof(u32);
+
+static void reference_multiply(u32 const* a, u32 const* b, size_t n, u32* product)
+{
+    for (size_t i = 0; i < n * 2; i++)
+        product[i] = 0;
+    for (size_t i = 0; i < n; i++) {
+        u64 carry = 0;
+        for (size_t j = 0; j < n; j++) {
+            u64 sum = (u64)a[i] * b[j] + product[i + j] + carry;
+            product[i + j] = (u32)sum;
+            carry = sum >> 32;
+        }
+        product[i + n] = (u32)carry;
+    }
+}
+
+static bool reference_add(u32* a, u32 const* b, size_t n)
+{
+    u64 carry = 0;
+    for (size_t i = 0; i < n; i++) {
+        u64 sum = (u64)a[i] + b[i] + carry;
+        a[i] = (u32)sum;
+        carry = sum >> 32;
+    }
+    return carry;
+}
+
+static void reference_subtract(u32* a, u32 const* b, size_t n)
+{
+    u64 borrow = 0;
+    for (size_t i = 0; i < n; i++) {
+        u64 difference = (u64)a[i] - b[i] - borrow;
+        a[i] = (u32)difference;
+        borrow = difference >> 63;
+    }
+}
+
+static bool reference_at_least(u32 const* a, u32 const* b, size_t n)
+{
+    for (size_t i = n; i-- > 0;) {
+        if (a[i] != b[i])
+            return a[i] > b[i];
+    }
+    return true;
+}
+
+static bool is_zero(u32 const* a, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (a[i])
+            return false;
+    }
+    return true;
+}
+
+// r = 2r + bit mod m, for r below m.
+static void double_add_mod(u32* r, bool bit, u32 const* m, size_t n)
+{
+    u64 carry = bit;
+    for (size_t i = 0; i < n; i++) {
+        u64 sum = ((u64)r[i] << 1) + carry;
+        r[i] = (u32)sum;
+        carry = sum >> 32;
+    }
+    if (carry || reference_at_least(r, m, n))
+        reference_subtract(r, m, n);
+}
+
+static void reference_mod(u32 const* x, u32 const* m, size_t n, u32* result)
+{
+    for (size_t i = 0; i < n; i++)
+        result[i] = 0;
+    for (size_t bit = n * 32; bit-- > 0;)
+        double_add_mod(result, (x[bit / 32] >> (bit % 32)) & 1, m, n);
+}
+
+// a * b mod m by doubling and adding, for a below m.
+static void reference_multiply_mod(u32 const* a, u32 const* b, u32 const* m, size_t n, u32* result)
+{
+    u32 r[max_digits] = {};
+    for (size_t bit = n * 32; bit-- > 0;) {
+        double_add_mod(r, false, m, n);
+        if ((b[bit / 32] >> (bit % 32)) & 1) {
+            bool carry = reference_add(r, a, n);
+            if (carry || reference_at_least(r, m, n))
+                reference_subtract(r, m, n);
+        }
+    }
+    __builtin_memcpy(result, r, n * sizeof(u32));
+}
+
+static void reference_pow_mod(u32 const* base, u32 const* exponent, size_t exponent_bits, u32 const* m, size_t n, u32* result)
+{
+    u32 reduced_base[max_digits];
+    reference_mod(base, m, n, reduced_base);
+    u32 one[max_digits] = {};
+    one[0] = 1;
+    reference_mod(one, m, n, result);
+    for (size_t bit = exponent_bits; bit-- > 0;) {
+        reference_multiply_mod(result, result, m, n, result);
+        if ((exponent[bit / 32] >> (bit % 32)) & 1)
+            reference_multiply_mod(result, reduced_base, m, n, result);
+    }
+}
+
+template<typename Int>
+static Int random_int(size_t max_bits = sizeof(Int) * 8)
+{
+    constexpr size_t n = sizeof(Int) / sizeof(u32);
+    u32 digits[n] = {};
+    size_t used = 1 + s_random.next() % (max_bits / 32);
+    for (size_t i = 0; i < used; i++) {
+        u32 kind = s_random.next() % 8;
+        digits[i] = kind == 0 ? 0 : kind == 1 ? 0xffffffff : s_random.next();
+    }
+    Int value;
+    __builtin_memcpy(&value, digits, sizeof(value));
+    return value;
+}
+
+template<typename Int>
+static void to_digits(Int const& value, u32* digits)
+{
+    __builtin_memcpy(digits, &value, sizeof(value));
+}
+
+// quotient * divisor + remainder == dividend, with the remainder below the
+// divisor.
+template<typename Int>
+static void check_division(Int const& dividend, Int const& divisor, Int const& quotient, Int const& remainder)
+{
+    constexpr size_t n = sizeof(Int) / sizeof(u32);
+    u32 q[n], d[n], r[n], x[n], product[n * 2];
+    to_digits(quotient, q);
+    to_digits(divisor, d);
+    to_digits(remainder, r);
+    to_digits(dividend, x);
+
+    VERIFY(!reference_at_least(r, d, n));
+    reference_multiply(q, d, n, product);
+    VERIFY(is_zero(product + n, n));
+    VERIFY(!reference_add(product, r, n));
+    VERIFY(__builtin_memcmp(product, x, sizeof(x)) == 0);
+}
+
+template<typename Int>
+static void check_arithmetic(size_t rounds)
+{
+    constexpr size_t n = sizeof(Int) / sizeof(u32);
+    u32 a_digits[n], b_digits[n], expected[n * 2], result[n * 2];
+
+    for (size_t round = 0; round < rounds; round++) {
+        Int a = random_int<Int>();
+        Int b = random_int<Int>();
+        to_digits(a, a_digits);
+        to_digits(b, b_digits);
+        reference_multiply(a_digits, b_digits, n, expected);
+
+        auto wide = a.wide_multiply(b);
+        static_assert(sizeof(wide) == sizeof(result));
+        __builtin_memcpy(result, &wide, sizeof(result));
+        VERIFY(__builtin_memcmp(result, expected, sizeof(result)) == 0);
+
+        Int low = a * b;
+        VERIFY(__builtin_memcmp(&low, expected, sizeof(low)) == 0);
+
+        u64 small = (u64)s_random.next() << 32 | s_random.next();
+        Int small_product = a * small;
+        VERIFY(small_product == a * Int(small));
+
+        // By a u64, by one that fits in 64 bits and by one that doesn't.
+        u64 small_divisor = small >> (s_random.next() % 64);
+        if (!small_divisor)
+            small_divisor = 1;
+        u64 small_remainder;
+        Int quotient = a.div_mod(small_divisor, small_remainder);
+        check_division(a, Int(small_divisor), quotient, Int(small_remainder));
+
+        Int remainder;
+        quotient = a.div_mod(Int(small_divisor), remainder);
+        check_division(a, Int(small_divisor), quotient, remainder);
+
+        Int divisor = b ? b : Int(1u);
+        quotient = a.div_mod(divisor, remainder);
+        check_division(a, divisor, quotient, remainder);
+    }
+}
+
+template<typename Int>
+static void check_montgomery(size_t rounds, size_t exponent_bits)
+{
+    constexpr size_t n = sizeof(Int) / sizeof(u32);
+    u32 m_digits[n], a_digits[n], b_digits[n], e_digits[n], expected[n];
+
+    for (size_t round = 0; round < rounds; round++) {
+        Int modulus = random_int<Int>() | Int(1u);
+        MontgomeryModulus<Int> montgomery { modulus };
+        to_digits(modulus, m_digits);
+
+        Int a = random_int<Int>() % modulus;
+        Int b = random_int<Int>() % modulus;
+        to_digits(a, a_digits);
+        to_digits(b, b_digits);
+
+        reference_multiply_mod(a_digits, b_digits, m_digits, n, expected);
+        Int product = montgomery.from_montgomery(montgomery.multiply(montgomery.to_montgomery(a), montgomery.to_montgomery(b)));
+        VERIFY(__builtin_memcmp(&product, expected, sizeof(product)) == 0);
+
+        // The base may be past the modulus, pow() reduces it first.
+        Int base = random_int<Int>();
+        Int exponent = random_int<Int>(exponent_bits);
+        to_digits(base, a_digits);
+        to_digits(exponent, e_digits);
+        reference_pow_mod(a_digits, e_digits, exponent_bits, m_digits, n, expected);
+        Int power = montgomery.pow(base, exponent);
+        VERIFY(__builtin_memcmp(&power, expected, sizeof(power)) == 0);
+    }
+
+    // Nothing but ones up to the top bit.
+    Int modulus = NumericLimits<Int>::max();
+    MontgomeryModulus<Int> montgomery { modulus };
+    VERIFY(montgomery.pow(Int(2u), Int(sizeof(Int) * 8)) == Int(1u));
+    VERIFY(montgomery.pow(modulus - Int(1u), Int(2u)) == Int(1u));
+    VERIFY(montgomery.pow(Int(12345u), Int(0u)) == Int(1u));
+}
+
+int main(int, char**)
+{
+    check_arithmetic<u128>(20000);
+    check_arithmetic<u256>(10000);
+    check_arithmetic<u512>(5000);
+    check_arithmetic<u1024>(2000);
+    check_arithmetic<u2048>(500);
+
+    check_montgomery<u128>(1000, 128);
+    check_montgomery<u256>(200, 256);
+    check_montgomery<u512>(40, 512);
+    check_montgomery<u1024>(20, 64);
+    check_montgomery<u1024>(2, 1024);
+
+    return report_all_agree("u128 to u2048%s",
+#ifdef __SIZEOF_INT128__
+        ""
+#else
+        " without __int128"
+#endif
+    );
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Utf8View.h>
+
+#include "TestRandom.h"
+
+// Utf8View::validate() against a byte at a time decoder that follows the
+// table of well-formed sequences in the Unicode standard, and to_utf32()
+// and to_utf16() against each other, over random inputs. The inputs are
+// long runs of ASCII with a few sequences in them, so the SSSE3 path gets
+// whole blocks to check and the ones to skip.
+
+static TestRandom s_random { 1 };
+
+// Length of the valid prefix, as the well-formed sequences table has it.
+static size_t reference_valid_prefix(u8 const* bytes, size_t length, u32* code_points, size_t& code_point_count)
+{
+    size_t offset = 0;
+    code_point_count = 0;
+    while (offset < length) {
+        u8 first = bytes[offset];
+        size_t size;
+        u8 low = 0x80;
+        u8 high = 0xbf;
+        u32 value;
+        if (first < 0x80) {
+            size = 1;
+            value = first;
+        } else if (first >= 0xc2 && first <= 0xdf) {
+            size = 2;
+            value = first & 0x1f;
+        } else if (first >= 0xe0 && first <= 0xef) {
+            size = 3;
+            value = first & 0x0f;
+            if (first == 0xe0)
+                low = 0xa0;
+            if (first == 0xed)
+                high = 0x9f;
+        } else if (first >= 0xf0 && first <= 0xf4) {
+            size = 4;
+            value = first & 0x07;
+            if (first == 0xf0)
+                low = 0x90;
+            if (first == 0xf4)
+                high = 0x8f;
+        } else {
+            return offset;
+        }
+
+        if (offset + size > length)
+            return offset;
+        for (size_t i = 1; i < size; i++) {
+            u8 byte = bytes[offset + i];
+            if (byte < (i == 1 ? low : 0x80) || byte > (i == 1 ? high : 0xbf))
+                return offset;
+            value = (value << 6) | (byte & 0x3f);
+        }
+
+        code_points[code_point_count++] = value;
+        offset += size;
+    }
+    return offset;
+}
+
+static size_t encode(u32 code_point, u8* out)
+{
+    if (code_point < 0x80) {
+        out[0] = code_point;
+        return 1;
+    }
+    if (code_point < 0x800) {
+        out[0] = 0xc0 | (code_point >> 6);
+        out[1] = 0x80 | (code_point & 0x3f);
+        return 2;
+    }
+    if (code_point < 0x10000) {
+        out[0] = 0xe0 | (code_point >> 12);
+        out[1] = 0x80 | ((code_point >> 6) & 0x3f);
+        out[2] = 0x80 | (code_point & 0x3f);
+        return 3;
+    }
+    out[0] = 0xf0 | (code_point >> 18);
+    out[1] = 0x80 | ((code_point >> 12) & 0x3f);
+    out[2] = 0x80 | ((code_point >> 6) & 0x3f);
+    out[3] = 0x80 | (code_point & 0x3f);
+    return 4;
+}
+
+static size_t random_input(u8* out, size_t capacity)
+{
+    size_t length = 0;
+    size_t target = s_random.next() % capacity;
+    while (length + 4 <= target) {
+        u32 kind = s_random.next() % 16;
+        if (kind < 10) {
+            out[length++] = 'a' + s_random.next() % 26;
+        } else if (kind < 14) {
+            // Valid, with surrogates left out.
+            static u32 const limits[] = { 0x80, 0x800, 0x10000, 0x110000 };
+            u32 limit = limits[s_random.next() % 4];
+            u32 code_point = s_random.next() % limit;
+            if (code_point >= 0xd800 && code_point < 0xe000)
+                code_point = 0xfffd;
+            length += encode(code_point, out + length);
+        } else if (kind == 14) {
+            // Overlong forms, surrogates, points past U+10FFFF and stray bytes.
+            static u8 const bad[][4] = {
+                { 0xc0, 0xaf }, { 0xc1, 0xbf }, { 0xe0, 0x80, 0xaf }, { 0xed, 0xa0, 0x80 },
+                { 0xf0, 0x80, 0x80, 0xaf }, { 0xf4, 0x90, 0x80, 0x80 }, { 0xf5, 0x80, 0x80, 0x80 },
+                { 0x80 }, { 0xbf }, { 0xff }, { 0xe2, 0x82 }, { 0xf0, 0x9f, 0x98 },
+            };
+            auto& sequence = bad[s_random.next() % 12];
+            for (size_t i = 0; i < 4 && (i == 0 || sequence[i]); i++)
+                out[length++] = sequence[i];
+        } else {
+            out[length++] = s_random.next();
+        }
+    }
+    return length;
+}
+
+int main(int, char**)
+{
+    static constexpr size_t capacity = 512;
+    u8 input[capacity];
+    u32 expected[capacity];
+    u32 utf32[capacity];
+    u16 utf16[capacity * 2];
+
+    size_t invalid = 0;
+    for (size_t round = 0; round < 200000; round++) {
+        size_t length = random_input(input, capacity);
+        size_t expected_count;
+        // Half of them cut down to what's valid, or the first error would
+        // always be early on.
+        if (round % 2)
+            length = reference_valid_prefix(input, length, expected, expected_count);
+
+        size_t expected_valid = reference_valid_prefix(input, length, expected, expected_count);
+
+        Utf8View view { StringView { reinterpret_cast<char const*>(input), length } };
+        size_t valid_bytes;
+        bool valid = view.validate(valid_bytes);
+        VERIFY(valid == (expected_valid == length));
+        VERIFY(valid_bytes == expected_valid);
+        invalid += valid ? 0 : 1;
+
+        size_t utf32_length = view.to_utf32(utf32);
+        VERIFY(utf32_length == view.length());
+        if (valid) {
+            VERIFY(utf32_length == expected_count);
+            VERIFY(__builtin_memcmp(utf32, expected, expected_count * sizeof(u32)) == 0);
+        }
+
+        size_t utf16_length = view.to_utf16(utf16);
+        size_t j = 0;
+        for (size_t i = 0; i < utf32_length; i++) {
+            // UTF-16 has no room for what invalid input can decode to.
+            u32 code_point = utf32[i] > 0x10ffff ? 0xfffd : utf32[i];
+            if (code_point < 0x10000) {
+                VERIFY(utf16[j++] == code_point);
+                continue;
+            }
+            u32 high = utf16[j++];
+            u32 low = utf16[j++];
+            VERIFY(high >= 0xd800 && high < 0xdc00 && low >= 0xdc00 && low < 0xe000);
+            VERIFY(0x10000 + ((high - 0xd800) << 10) + (low - 0xdc00) == code_point);
+        }
+        VERIFY(j == utf16_length);
+    }
+
+    return report_all_agree("200000 inputs, %zu invalid", invalid);
+}
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+
+# Generates base/UnicodeTables.h from UnicodeData.txt and PropList.txt of
+# the Unicode Character Database: the general category, simple case
+# mappings and White_Space property of every code point, as two-stage
+# lookup tables.
+#
+# usage: generate-unicode-tables.py UnicodeData.txt PropList.txt > UnicodeTables.h
+
+# imports
+from sys import argv, stderr, exit
+
+CODE_POINT_COUNT = 0x110000
+
+# In the order of Base::UnicodeUtils::GeneralCategory.
+CATEGORIES = [
+    'Cn', 'Lu', 'Ll', 'Lt', 'Lm', 'Lo', 'Mn', 'Mc', 'Me', 'Nd', 'Nl', 'No',
+    'Pc', 'Pd', 'Ps', 'Pe', 'Pi', 'Pf', 'Po', 'Sm', 'Sc', 'Sk', 'So',
+    'Zs', 'Zl', 'Zp', 'Cc', 'Cf', 'Cs', 'Co',
+]
+
+FLAG_WHITESPACE = 1
+
+
+def parse_unicode_data(path):
+    categories = [0] * CODE_POINT_COUNT
+    uppercase = [0] * CODE_POINT_COUNT
+    lowercase = [0] * CODE_POINT_COUNT
+    range_start = None
+    with open(path, encoding='utf-8') as file:
+        for line in file:
+            fields = line.strip().split(';')
+            if len(fields) < 14:
+                continue
+            code_point = int(fields[0], 16)
+            category = CATEGORIES.index(fields[2])
+
+            # Ranges such as the CJK ideographs come as a First and a Last line.
+            if fields[1].endswith(', First>'):
+                range_start = code_point
+                continue
+            first = code_point
+            if fields[1].endswith(', Last>'):
+                first = range_start
+                range_start = None
+            for c in range(first, code_point + 1):
+                categories[c] = category
+
+            if fields[12]:
+                uppercase[code_point] = int(fields[12], 16) - code_point
+            if fields[13]:
+                lowercase[code_point] = int(fields[13], 16) - code_point
+    return categories, uppercase, lowercase
+
+
+def parse_whitespace(path):
+    whitespace = set()
+    with open(path, encoding='utf-8') as file:
+        for line in file:
+            line = line.split('#')[0].strip()
+            if not line:
+                continue
+            code_points, prop = [part.strip() for part in line.split(';')]
+            if prop != 'White_Space':
+                continue
+            bounds = code_points.split('..')
+            first = int(bounds[0], 16)
+            last = int(bounds[-1], 16)
+            whitespace.update(range(first, last + 1))
+    return whitespace
+
+
+def build_stages(values, block_shift):
+    block_size = 1 << block_shift
+    blocks = {}
+    stage1 = []
+    stage2 = []
+    for start in range(0, CODE_POINT_COUNT, block_size):
+        block = tuple(values[start:start + block_size])
+        if block not in blocks:
+            blocks[block] = len(blocks)
+            stage2.extend(block)
+        stage1.append(blocks[block])
+    return stage1, stage2
+
+
+def element_type(values):
+    largest = max(values)
+    if largest < 1 << 8:
+        return 'u8', 1
+    if largest < 1 << 16:
+        return 'u16', 2
+    return 'u32', 4
+
+
+def write_array(name, type, values):
+    print(f'static constexpr {type} {name}[{len(values)}] = {{')
+    for start in range(0, len(values), 16):
+        print('    ' + ', '.join(str(value) for value in values[start:start + 16]) + ',')
+    print('};')
+    print()
+
+
+def main():
+    if len(argv) != 3:
+        print(f'usage: {argv[0]} UnicodeData.txt PropList.txt', file=stderr)
+        exit(1)
+
+    categories, uppercase, lowercase = parse_unicode_data(argv[1])
+    whitespace = parse_whitespace(argv[2])
+
+    properties = {}
+    property_indices = []
+    for code_point in range(CODE_POINT_COUNT):
+        flags = FLAG_WHITESPACE if code_point in whitespace else 0
+        key = (categories[code_point], flags, uppercase[code_point], lowercase[code_point])
+        if key not in properties:
+            properties[key] = len(properties)
+        property_indices.append(properties[key])
+
+    # Whichever block size makes for the smallest tables.
+    best = None
+    for block_shift in range(4, 11):
+        stage1, stage2 = build_stages(property_indices, block_shift)
+        stage1_type, stage1_size = element_type(stage1)
+        stage2_type, stage2_size = element_type(stage2)
+        size = len(stage1) * stage1_size + len(stage2) * stage2_size
+        if best is None or size < best[0]:
+            best = (size, block_shift, stage1, stage1_type, stage2, stage2_type)
+    _, block_shift, stage1, stage1_type, stage2, stage2_type = best
+
+    print('/*')
+    print(' * Generated by meta/generate-unicode-tables.py from the Unicode Character')
+    print(' * Database. Do not edit.')
+    print('*/')
+    print()
+    print('#pragma once')
+    print()
+    print('// includes')
+    print('#include <base/Types.h>')
+    print()
+    print('namespace Base::UnicodeUtils::Detail {')
+    print()
+    print('struct CodePointProperties {')
+    print('    u8 category;')
+    print('    u8 flags;')
+    print('    i32 uppercase_offset;')
+    print('    i32 lowercase_offset;')
+    print('};')
+    print()
+    print(f'static constexpr u8 code_point_flag_whitespace = {FLAG_WHITESPACE};')
+    print(f'static constexpr size_t code_point_block_shift = {block_shift};')
+    print()
+    print(f'static constexpr CodePointProperties code_point_properties[{len(properties)}] = {{')
+    for (category, flags, upper, lower) in properties:
+        print(f'    {{ {category}, {flags}, {upper}, {lower} }},')
+    print('};')
+    print()
+    write_array('code_point_blocks', stage1_type, stage1)
+    write_array('code_point_property_indices', stage2_type, stage2)
+    print('}')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,423 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <string.h>
+#include <libcompression/CRC.h>
+#include <libcompression/Deflate.h>
+#include <libcompression/Inflate.h>
+#include <libcompression/ParallelDeflate.h>
+#include <libio/MemoryReader.h>
+#include <libio/MemoryWriter.h>
+#include <libio/Sink.h>
+#include <libio/Streams.h>
+#include <libutils/String.h>
+#include <libutils/Vector.h>
+
+#ifdef __pranaos__
+#    include <libfile/Archive.h>
+#    include <libio/File.h>
+#    include <libsystem/system/System.h>
+#else
+#    include <time.h>
+#endif
+
+// Throughput of Deflate at every level, parallel Deflate, Inflate and CRC
+// over a generated corpus, plus any files given on the command line, the
+// Silesia corpus for example. In-system, .zip and .tar arguments are
+// listed and extracted too. Pass --json for one line of results per
+// measurement.
+
+static constexpr size_t CORPUS_ENTRY_SIZE = 4 * 1024 * 1024;
+
+// Each measurement repeats until it took at least this long.
+static constexpr double MIN_SECONDS = 0.5;
+
+static double now_seconds()
+{
+#ifdef __pranaos__
+    // Ticks are milliseconds.
+    return system_get_ticks() / 1000.0;
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+}
+
+struct CorpusEntry
+{
+    String name;
+    Vector<uint8_t> data;
+};
+
+// xorshift, the same data on every run and every system.
+struct Random
+{
+    uint32_t state = 0x9e3779b9;
+
+    uint32_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+};
+
+// Words picked with a skewed distribution, with punctuation and line
+// breaks, which compresses about like English prose.
+static CorpusEntry generate_text()
+{
+    static const char *WORDS[] = {
+        "the", "of", "and", "to", "in", "a", "is", "that", "for", "it",
+        "as", "was", "with", "be", "by", "on", "not", "he", "this", "are",
+        "or", "his", "from", "at", "which", "but", "have", "an", "had", "they",
+        "compression", "archive", "system", "kernel", "window", "process", "memory", "buffer",
+    };
+
+    CorpusEntry entry{"text", {}};
+    Random random;
+    size_t line = 0;
+
+    while (entry.data.count() < CORPUS_ENTRY_SIZE)
+    {
+        uint32_t pick = random.next();
+        const char *word = WORDS[(pick % 40) * (pick % 40) / 40];
+
+        for (const char *c = word; *c; c++)
+        {
+            entry.data.push_back(*c);
+        }
+
+        line += strlen(word) + 1;
+
+        if (line > 72)
+        {
+            entry.data.push_back('.');
+            entry.data.push_back('\n');
+            line = 0;
+        }
+        else
+        {
+            entry.data.push_back(' ');
+        }
+    }
+
+    return entry;
+}
+
+// Fixed size records with counters, small enums and a few random bytes,
+// like tables and executables.
+static CorpusEntry generate_records()
+{
+    CorpusEntry entry{"records", {}};
+    Random random;
+
+    for (uint32_t id = 0; entry.data.count() < CORPUS_ENTRY_SIZE; id++)
+    {
+        uint32_t fields[4] = {id, id * 3 + 17, random.next() % 16, random.next()};
+
+        for (auto field : fields)
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                entry.data.push_back(field >> (i * 8));
+            }
+        }
+    }
+
+    return entry;
+}
+
+static CorpusEntry generate_random()
+{
+    CorpusEntry entry{"random", {}};
+    Random random;
+
+    while (entry.data.count() < CORPUS_ENTRY_SIZE)
+    {
+        entry.data.push_back(random.next() >> 24);
+    }
+
+    return entry;
+}
+
+// Long runs, the best case for the match finder.
+static CorpusEntry generate_runs()
+{
+    CorpusEntry entry{"runs", {}};
+    Random random;
+
+    while (entry.data.count() < CORPUS_ENTRY_SIZE)
+    {
+        uint8_t value = random.next() % 4;
+        size_t length = 64 + random.next() % 4096;
+
+        for (size_t i = 0; i < length; i++)
+        {
+            entry.data.push_back(value);
+        }
+    }
+
+    return entry;
+}
+
+static bool json = false;
+
+static void report(const char *operation, const String &name, size_t bytes, double seconds, size_t runs, const char *unit = "MB/s", double scale = 1e6)
+{
+    double throughput = bytes * (double)runs / seconds / scale;
+
+    if (json)
+    {
+        IO::outln("{{\"operation\":\"{}\",\"input\":\"{}\",\"bytes\":{},\"runs\":{},\"seconds\":{},\"{}\":{}}}", operation, name, bytes, runs, seconds, unit, throughput);
+    }
+    else
+    {
+        IO::outln("{} {} {} {}", operation, name, throughput, unit);
+    }
+}
+
+// Calls operation until MIN_SECONDS went by, and returns how many times.
+template <typename Operation>
+static size_t repeat(double &seconds, Operation operation)
+{
+    size_t runs = 0;
+    double start = now_seconds();
+
+    do
+    {
+        operation();
+        runs++;
+        seconds = now_seconds() - start;
+    } while (seconds < MIN_SECONDS);
+
+    return runs;
+}
+
+static void benchmark_crc(const CorpusEntry &entry)
+{
+    // Volatile so the checksums count as used.
+    volatile uint32_t checksum = 0;
+    double seconds = 0;
+
+    size_t runs = repeat(seconds, [&]() {
+        Compression::CRC crc;
+        crc.add(entry.data.raw_storage(), entry.data.count());
+        checksum = checksum ^ crc.checksum();
+    });
+
+    report("crc", entry.name, entry.data.count(), seconds, runs, "GB/s", 1e9);
+}
+
+static void benchmark_level(const CorpusEntry &entry, unsigned int level)
+{
+    double seconds = 0;
+
+    size_t runs = repeat(seconds, [&]() {
+        IO::MemoryWriter compressed{entry.data.count() + 1024};
+        IO::MemoryReader uncompressed{entry.data.raw_storage(), entry.data.count()};
+
+        Compression::Deflate deflate{level};
+        deflate.perform(uncompressed, compressed);
+    });
+
+    auto name = IO::format("{}/level-{}", entry.name, level);
+    report("deflate", name, entry.data.count(), seconds, runs);
+
+    // Once more outside of the timing, to keep what inflate works on.
+    IO::MemoryWriter compressed{entry.data.count() + 1024};
+    IO::MemoryReader uncompressed{entry.data.raw_storage(), entry.data.count()};
+    Compression::Deflate deflate{level};
+    deflate.perform(uncompressed, compressed);
+
+    size_t compressed_size = compressed.length().unwrap();
+    Slice compressed_data{compressed.buffer(), compressed_size};
+
+    if (json)
+    {
+        IO::outln("{{\"operation\":\"ratio\",\"input\":\"{}\",\"bytes\":{},\"compressed\":{}}}", name, entry.data.count(), compressed_size);
+    }
+    else
+    {
+        IO::outln("ratio {} {} -> {}", name, entry.data.count(), compressed_size);
+    }
+
+    // Decompression speed is given in uncompressed bytes, like the other
+    // tools report it.
+    runs = repeat(seconds, [&]() {
+        IO::Sink sink;
+        Compression::Inflate inflate;
+        inflate.perform(compressed_data, sink);
+    });
+
+    report("inflate", name, entry.data.count(), seconds, runs);
+}
+
+// One thread against one per processor, the difference is the speedup.
+static void benchmark_parallel(const CorpusEntry &entry, unsigned int level)
+{
+    for (size_t threads : {(size_t)1, (size_t)0})
+    {
+        double seconds = 0;
+        size_t compressed_size = 0;
+
+        size_t runs = repeat(seconds, [&]() {
+            IO::MemoryWriter compressed{entry.data.count() + 1024};
+            IO::MemoryReader uncompressed{entry.data.raw_storage(), entry.data.count()};
+
+            Compression::ParallelDeflate deflate{level, threads};
+            deflate.perform(uncompressed, compressed);
+            compressed_size = compressed.length().unwrap();
+        });
+
+        auto name = IO::format("{}/level-{}/{}", entry.name, level, threads ? "one-thread" : "all-threads");
+        report("parallel-deflate", name, entry.data.count(), seconds, runs);
+
+        if (json)
+        {
+            IO::outln("{{\"operation\":\"ratio\",\"input\":\"{}\",\"bytes\":{},\"compressed\":{}}}", name, entry.data.count(), compressed_size);
+        }
+        else
+        {
+            IO::outln("ratio {} {} -> {}", name, entry.data.count(), compressed_size);
+        }
+    }
+}
+
+#ifdef __pranaos__
+
+static void benchmark_archive(const char *path)
+{
+    double start = now_seconds();
+    auto archive = Archive::open(IO::Path::parse(path));
+
+    if (!archive || !archive->valid())
+    {
+        IO::errln("{}: not a readable archive", path);
+        return;
+    }
+
+    size_t entry_count = archive->entries().count();
+    double seconds = now_seconds() - start;
+    report("list", path, entry_count, seconds, 1, "entries/s", 1);
+
+    size_t total = 0;
+    start = now_seconds();
+
+    for (size_t i = 0; i < entry_count; i++)
+    {
+        IO::Sink sink;
+        archive->extract(i, sink);
+        total += archive->entries()[i].uncompressed_size;
+    }
+
+    seconds = now_seconds() - start;
+    report("extract", path, entry_count, seconds, 1, "entries/s", 1);
+    report("extract", path, total, seconds, 1);
+}
+
+static bool is_archive(const char *path)
+{
+    size_t length = strlen(path);
+    return (length > 4 && strcmp(path + length - 4, ".zip") == 0) ||
+           (length > 4 && strcmp(path + length - 4, ".tar") == 0);
+}
+
+static bool read_file(const char *path, CorpusEntry &entry)
+{
+    IO::File file{path, J_OPEN_READ};
+    auto length = file.length();
+
+    if (!file.exist() || !length.success())
+    {
+        return false;
+    }
+
+    entry.name = path;
+    entry.data.resize(length.unwrap());
+
+    size_t done = 0;
+
+    while (done < entry.data.count())
+    {
+        auto read = file.read(entry.data.raw_storage() + done, entry.data.count() - done);
+
+        if (!read.success() || read.unwrap() == 0)
+        {
+            return false;
+        }
+
+        done += read.unwrap();
+    }
+
+    return true;
+}
+
+#endif
+
+int main(int argc, char const *argv[])
+{
+    Vector<CorpusEntry> corpus{};
+    Vector<const char *> archives{};
+
+    corpus.push_back(generate_text());
+    corpus.push_back(generate_records());
+    corpus.push_back(generate_random());
+    corpus.push_back(generate_runs());
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--json") == 0)
+        {
+            json = true;
+            continue;
+        }
+
+#ifdef __pranaos__
+        if (is_archive(argv[i]))
+        {
+            archives.push_back(argv[i]);
+            continue;
+        }
+
+        CorpusEntry entry;
+
+        if (!read_file(argv[i], entry))
+        {
+            IO::errln("{}: can't read it", argv[i]);
+            return PROCESS_FAILURE;
+        }
+
+        corpus.push_back(std::move(entry));
+#else
+        IO::errln("{}: only the generated corpus is available here", argv[i]);
+        return 1;
+#endif
+    }
+
+    for (auto &entry : corpus)
+    {
+        benchmark_crc(entry);
+
+        for (unsigned int level = 0; level <= 9; level++)
+        {
+            benchmark_level(entry, level);
+        }
+
+        benchmark_parallel(entry, 6);
+    }
+
+#ifdef __pranaos__
+    for (auto *path : archives)
+    {
+        benchmark_archive(path);
+    }
+#endif
+
+    return 0;
+}
@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <pthread.h>
+#include <string.h>
+#include <libio/Connection.h>
+#include <libio/Pipe.h>
+#include <libio/Socket.h>
+#include <libio/Streams.h>
+#include <libsystem/system/System.h>
+#include <libutils/Vector.h>
+
+// Messages/s and MB/s through IO::Connection at several payload sizes,
+// with one and several clients at the same time, each on a connection of
+// its own:
+//
+//  - pipe and socket write the payloads one way, straight through the
+//    handles, which is two copies through the kernel per message.
+//  - messages sends them with send_message() and waits for a one byte
+//    reply to each, like a request to a service.
+//  - shared does the same with enable_shared_messages(), so payloads from
+//    CONNECTION_SHARED_THRESHOLD up go as shared memory.
+//
+// Pass --json for one line of results per measurement.
+
+static constexpr const char *SOCKET_PATH = "/Session/ipc-benchmark.ipc";
+
+static constexpr size_t MAX_CLIENTS = 8;
+
+// Each client sends about this much, within MIN_MESSAGES and
+// MAX_MESSAGES.
+static constexpr size_t BYTES_PER_CLIENT = 16 * 1024 * 1024;
+static constexpr size_t MIN_MESSAGES = 64;
+static constexpr size_t MAX_MESSAGES = 65536;
+
+enum class Transport
+{
+    PIPE,
+    SOCKET,
+    MESSAGES,
+    SHARED,
+};
+
+static const char *transport_name(Transport transport)
+{
+    switch (transport)
+    {
+    case Transport::PIPE:
+        return "pipe";
+
+    case Transport::SOCKET:
+        return "socket";
+
+    case Transport::MESSAGES:
+        return "messages";
+
+    case Transport::SHARED:
+        return "shared";
+    }
+
+    return "unknown";
+}
+
+static double now_seconds()
+{
+    // Ticks are milliseconds.
+    return system_get_ticks() / 1000.0;
+}
+
+// Both ends of one client's connection, and what went wrong on them.
+struct Client
+{
+    Transport transport;
+    size_t payload_size;
+    size_t messages;
+
+    IO::Connection sender;
+    IO::Connection receiver;
+    Vector<uint8_t> payload;
+
+    JResult sender_result = SUCCESS;
+    JResult receiver_result = SUCCESS;
+};
+
+static JResult write_exactly(IO::Connection &connection, const void *buffer, size_t size)
+{
+    auto *bytes = static_cast<const uint8_t *>(buffer);
+    size_t done = 0;
+
+    while (done < size)
+    {
+        size_t written = TRY(connection.write(bytes + done, size - done));
+
+        if (written == 0)
+        {
+            return ERR_STREAM_CLOSED;
+        }
+
+        done += written;
+    }
+
+    return SUCCESS;
+}
+
+static JResult read_exactly(IO::Connection &connection, void *buffer, size_t size)
+{
+    auto *bytes = static_cast<uint8_t *>(buffer);
+    size_t done = 0;
+
+    while (done < size)
+    {
+        size_t last_read = TRY(connection.read(bytes + done, size - done));
+
+        if (last_read == 0)
+        {
+            return ERR_STREAM_CLOSED;
+        }
+
+        done += last_read;
+    }
+
+    return SUCCESS;
+}
+
+static JResult send_all(Client &client)
+{
+    for (size_t i = 0; i < client.messages; i++)
+    {
+        if (client.transport == Transport::PIPE || client.transport == Transport::SOCKET)
+        {
+            TRY(write_exactly(client.sender, client.payload.raw_storage(), client.payload_size));
+            continue;
+        }
+
+        TRY(client.sender.send_message(client.payload.raw_storage(), client.payload_size));
+
+        IO::ConnectionMessage reply;
+        TRY(client.sender.receive_message(reply));
+    }
+
+    return SUCCESS;
+}
+
+static JResult receive_all(Client &client)
+{
+    Vector<uint8_t> buffer(client.payload_size);
+    buffer.resize(client.payload_size);
+
+    for (size_t i = 0; i < client.messages; i++)
+    {
+        if (client.transport == Transport::PIPE || client.transport == Transport::SOCKET)
+        {
+            TRY(read_exactly(client.receiver, buffer.raw_storage(), client.payload_size));
+            continue;
+        }
+
+        IO::ConnectionMessage message;
+        TRY(client.receiver.receive_message(message));
+
+        if (message.size() != client.payload_size)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        uint8_t reply = 1;
+        TRY(client.receiver.send_message(&reply, sizeof(reply)));
+    }
+
+    return SUCCESS;
+}
+
+static void *run_sender(void *argument)
+{
+    auto &client = *static_cast<Client *>(argument);
+    client.sender_result = send_all(client);
+
+    // So that the other end doesn't wait for what will not come.
+    if (client.sender_result != SUCCESS)
+    {
+        client.sender.close();
+    }
+
+    return nullptr;
+}
+
+static void *run_receiver(void *argument)
+{
+    auto &client = *static_cast<Client *>(argument);
+    client.receiver_result = receive_all(client);
+
+    if (client.receiver_result != SUCCESS)
+    {
+        client.receiver.close();
+    }
+
+    return nullptr;
+}
+
+static JResult open_connections(Transport transport, IO::Socket &server, Client &client)
+{
+    if (transport == Transport::PIPE)
+    {
+        auto pipe = TRY(IO::Pipe::create());
+        client.sender = IO::Connection{pipe.writer};
+        client.receiver = IO::Connection{pipe.reader};
+        return SUCCESS;
+    }
+
+    client.sender = TRY(IO::Socket::connect(SOCKET_PATH));
+    client.receiver = TRY(server.accept());
+
+    if (transport == Transport::SHARED)
+    {
+        client.sender.enable_shared_messages();
+        client.receiver.enable_shared_messages();
+    }
+
+    return SUCCESS;
+}
+
+static bool json = false;
+
+static JResult benchmark(IO::Socket &server, Transport transport, size_t payload_size, size_t client_count)
+{
+    size_t messages = BYTES_PER_CLIENT / payload_size;
+    messages = messages < MIN_MESSAGES ? MIN_MESSAGES : messages;
+    messages = messages > MAX_MESSAGES ? MAX_MESSAGES : messages;
+
+    Client clients[MAX_CLIENTS];
+
+    for (size_t i = 0; i < client_count; i++)
+    {
+        auto &client = clients[i];
+        client.transport = transport;
+        client.payload_size = payload_size;
+        client.messages = messages;
+        client.payload = Vector<uint8_t>(payload_size);
+        client.payload.resize(payload_size);
+        memset(client.payload.raw_storage(), 'A' + i, payload_size);
+
+        TRY(open_connections(transport, server, client));
+    }
+
+    pthread_t threads[MAX_CLIENTS * 2];
+    size_t thread_count = 0;
+    bool started = true;
+    double start = now_seconds();
+
+    for (size_t i = 0; i < client_count; i++)
+    {
+        if (pthread_create(&threads[thread_count], nullptr, run_receiver, &clients[i]) != 0)
+        {
+            started = false;
+            break;
+        }
+
+        thread_count++;
+
+        if (pthread_create(&threads[thread_count], nullptr, run_sender, &clients[i]) != 0)
+        {
+            // Its receiver sees the connection close and gives up.
+            clients[i].sender.close();
+            started = false;
+            break;
+        }
+
+        thread_count++;
+    }
+
+    for (size_t i = 0; i < thread_count; i++)
+    {
+        pthread_join(threads[i], nullptr);
+    }
+
+    double seconds = now_seconds() - start;
+
+    if (!started)
+    {
+        IO::errln("ipc-benchmark: can't start the client threads");
+        return ERR_NOT_IMPLEMENTED;
+    }
+
+    for (size_t i = 0; i < client_count; i++)
+    {
+        TRY(clients[i].sender_result);
+        TRY(clients[i].receiver_result);
+    }
+
+    // A run faster than a tick still has a rate.
+    seconds = seconds > 0 ? seconds : 0.001;
+
+    size_t total_messages = messages * client_count;
+    double messages_per_second = total_messages / seconds;
+    double megabytes_per_second = total_messages * (double)payload_size / seconds / 1e6;
+
+    if (json)
+    {
+        IO::outln("{{\"transport\":\"{}\",\"payload\":{},\"clients\":{},\"messages\":{},\"seconds\":{},\"messages/s\":{},\"MB/s\":{}}}",
+                  transport_name(transport), payload_size, client_count, total_messages, seconds, messages_per_second, megabytes_per_second);
+    }
+    else
+    {
+        IO::outln("{} {}B x{} {} messages/s {} MB/s",
+                  transport_name(transport), payload_size, client_count, messages_per_second, megabytes_per_second);
+    }
+
+    return SUCCESS;
+}
+
+int main(int argc, char const *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--json") == 0)
+        {
+            json = true;
+            continue;
+        }
+
+        IO::errln("ipc-benchmark: unknown option {}", argv[i]);
+        return PROCESS_FAILURE;
+    }
+
+    IO::Socket server{SOCKET_PATH, J_OPEN_CREATE};
+
+    for (auto transport : {Transport::PIPE, Transport::SOCKET, Transport::MESSAGES, Transport::SHARED})
+    {
+        for (size_t payload_size : {(size_t)64, (size_t)4096, (size_t)65536, (size_t)1048576})
+        {
+            for (size_t client_count : {(size_t)1, (size_t)4})
+            {
+                auto result = benchmark(server, transport, payload_size, client_count);
+
+                if (result != SUCCESS)
+                {
+                    IO::errln("ipc-benchmark: {} {}B x{}: {}", transport_name(transport), payload_size, client_count, get_result_description(result));
+                    return PROCESS_FAILURE;
+                }
+            }
+        }
+    }
+
+    return PROCESS_SUCCESS;
+}
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/CPUFeatures.h>
+#include <sys/cpu_features.h>
+
+static_assert(CPU_FEATURE_SSE2 == static_cast<u32>(CPUFeatures::SSE2));
+static_assert(CPU_FEATURE_SSE4_2 == static_cast<u32>(CPUFeatures::SSE4_2));
+static_assert(CPU_FEATURE_PCLMUL == static_cast<u32>(CPUFeatures::PCLMUL));
+static_assert(CPU_FEATURE_AVX2 == static_cast<u32>(CPUFeatures::AVX2));
+static_assert(CPU_FEATURE_FSRM == static_cast<u32>(CPUFeatures::FSRM));
+
+extern "C" {
+
+uint32_t __cpu_features()
+{
+    return static_cast<u32>(cpu_features());
+}
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+// The bits of Base::CPUFeatures, for code that doesn't build against base.
+#define CPU_FEATURE_SSE2 (1u << 0)
+#define CPU_FEATURE_SSE3 (1u << 1)
+#define CPU_FEATURE_SSSE3 (1u << 2)
+#define CPU_FEATURE_SSE4_1 (1u << 3)
+#define CPU_FEATURE_SSE4_2 (1u << 4)
+#define CPU_FEATURE_POPCNT (1u << 5)
+#define CPU_FEATURE_PCLMUL (1u << 6)
+#define CPU_FEATURE_AVX (1u << 7)
+#define CPU_FEATURE_AVX2 (1u << 8)
+#define CPU_FEATURE_BMI1 (1u << 9)
+#define CPU_FEATURE_BMI2 (1u << 10)
+#define CPU_FEATURE_ERMS (1u << 11)
+#define CPU_FEATURE_FSRM (1u << 12)
+
+// What the kernel published in the time page, see Base::cpu_features().
+uint32_t __cpu_features(void);
+
+__END_DECLS
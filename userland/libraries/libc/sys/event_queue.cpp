@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <errno.h>
+#include <sys/event_queue.h>
+#include <syscall.h>
+
+extern "C" {
+
+int event_queue_create(unsigned flags)
+{
+    int rc = syscall(SC_event_queue_create, flags);
+    __RETURN_WITH_ERRNO(rc, rc, -1);
+}
+
+int event_queue_ctl(int queue_fd, EventQueueControl control, int fd, const EventQueueEvent* event)
+{
+    Syscall::SC_event_queue_ctl_params params { queue_fd, static_cast<u32>(control), fd, event };
+    int rc = syscall(SC_event_queue_ctl, &params);
+    __RETURN_WITH_ERRNO(rc, rc, -1);
+}
+
+int event_queue_wait(int queue_fd, EventQueueEvent* events, unsigned max_events, const struct timespec* timeout)
+{
+    Syscall::SC_event_queue_wait_params params { queue_fd, events, max_events, timeout };
+    int rc = syscall(SC_event_queue_wait, &params);
+    __RETURN_WITH_ERRNO(rc, rc, -1);
+}
+}
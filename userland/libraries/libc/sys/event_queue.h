@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <kernel/api/EventQueue.h>
+#include <sys/cdefs.h>
+#include <time.h>
+
+__BEGIN_DECLS
+
+// Returns a file descriptor to register interest in other file
+// descriptors with. Takes O_CLOEXEC.
+int event_queue_create(unsigned flags);
+
+// Adds, modifies or removes the interest in fd. event is ignored for
+// EventQueueControl::Remove.
+int event_queue_ctl(int queue_fd, EventQueueControl, int fd, const EventQueueEvent* event);
+
+// Waits for at most timeout (forever if null) until a registered file
+// descriptor is ready, and returns up to max_events of them.
+int event_queue_wait(int queue_fd, EventQueueEvent* events, unsigned max_events, const struct timespec* timeout);
+
+__END_DECLS
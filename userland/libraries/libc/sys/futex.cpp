@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <errno.h>
+#include <sys/futex.h>
+#include <syscall.h>
+
+extern "C" {
+
+int futex(uint32_t* userspace_address, int futex_op, uint32_t value, const struct timespec* timeout, uint32_t* userspace_address2, uint32_t value3)
+{
+    Syscall::SC_futex_params params { userspace_address, futex_op, value, { timeout }, userspace_address2, value3 };
+    int rc = syscall(SC_futex, &params);
+    __RETURN_WITH_ERRNO(rc, rc, -1);
+}
+}
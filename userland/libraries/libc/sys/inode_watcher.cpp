@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <errno.h>
+#include <sys/inode_watcher.h>
+#include <syscall.h>
+
+extern "C" {
+
+int create_inode_watcher(unsigned flags)
+{
+    int rc = syscall(SC_create_inode_watcher, flags);
+    __RETURN_WITH_ERRNO(rc, rc, -1);
+}
+
+int inode_watcher_add_watch(int fd, const char* path, size_t path_length, unsigned event_mask)
+{
+    Syscall::SC_inode_watcher_add_watch_params params { fd, { path, path_length }, event_mask };
+    int rc = syscall(SC_inode_watcher_add_watch, &params);
+    __RETURN_WITH_ERRNO(rc, rc, -1);
+}
+
+int inode_watcher_remove_watch(int fd, int watch_descriptor)
+{
+    int rc = syscall(SC_inode_watcher_remove_watch, fd, watch_descriptor);
+    __RETURN_WITH_ERRNO(rc, rc, -1);
+}
+}
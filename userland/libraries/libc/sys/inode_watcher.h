@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <kernel/api/InodeWatcherEvent.h>
+#include <kernel/api/InodeWatcherFlags.h>
+#include <stddef.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+// Returns a file descriptor that reads out InodeWatcherEvents for every
+// watch added to it. Takes InodeWatcherFlags.
+int create_inode_watcher(unsigned flags);
+
+// Returns the watch descriptor the events about path will carry.
+// event_mask is made of InodeWatcherEvent::Type.
+int inode_watcher_add_watch(int fd, const char* path, size_t path_length, unsigned event_mask);
+
+int inode_watcher_remove_watch(int fd, int watch_descriptor);
+
+__END_DECLS
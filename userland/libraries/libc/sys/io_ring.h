@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <kernel/api/IORing.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+// Returns a file descriptor for a ring with room for at least entries
+// submissions, mmap() it MAP_SHARED for the IORingHeader. Takes O_CLOEXEC.
+int io_ring_setup(unsigned entries, unsigned flags);
+
+// Hands up to to_submit new submissions to the kernel and waits until at
+// least min_complete completions are waiting. Returns how many
+// submissions the kernel took.
+int io_ring_enter(int fd, unsigned to_submit, unsigned min_complete);
+
+__END_DECLS
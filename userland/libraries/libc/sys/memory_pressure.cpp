@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2021, krishpranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+// includes
+#include <errno.h>
+#include <sys/memory_pressure.h>
+#include <syscall.h>
+
+extern "C" {
+
+int create_memory_pressure_watcher(unsigned flags)
+{
+    int rc = syscall(SC_create_memory_pressure_watcher, flags);
+    __RETURN_WITH_ERRNO(rc, rc, -1);
+}
+}
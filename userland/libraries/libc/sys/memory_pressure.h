@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2021, krishpranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <kernel/api/MemoryPressureEvent.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+// Returns a file descriptor that reads a MemoryPressureEvent whenever the
+// system's memory pressure level changes. Takes MemoryPressureWatcherFlags.
+int create_memory_pressure_watcher(unsigned flags);
+
+__END_DECLS
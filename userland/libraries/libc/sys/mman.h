@@ -19,6 +19,7 @@
 #define MAP_STACK 0x40
 #define MAP_NORESERVE 0x80
 #define MAP_RANDOMIZED 0x100
+#define MAP_POPULATE 0x200
 
 #define PROT_READ 0x1
 #define PROT_WRITE 0x2
@@ -27,6 +28,13 @@
 
 #define MAP_FAILED ((void*)-1)
 
+#define MADV_NORMAL 0x0
+#define MADV_RANDOM 0x1
+#define MADV_SEQUENTIAL 0x2
+#define MADV_WILLNEED 0x3
+#define MADV_DONTNEED 0x4
+#define MADV_MERGEABLE 0x5
+#define MADV_UNMERGEABLE 0x6
 #define MADV_SET_VOLATILE 0x100
 #define MADV_SET_NONVOLATILE 0x200
 #define MADV_GET_VOLATILE 0x400
@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <errno.h>
+#include <sys/perf_counters.h>
+#include <syscall.h>
+
+extern "C" {
+
+int perf_counters_read(PerformanceCounterScope scope, PerformanceCounterValues* values)
+{
+    int rc = syscall(SC_perf_counters_read, static_cast<u32>(scope), values);
+    __RETURN_WITH_ERRNO(rc, rc, -1);
+}
+}
@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <kernel/api/PerformanceCounters.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+// Reads the hardware performance counters of the calling thread or of the
+// whole system. Fails with ENOTSUP if the CPU has none the kernel knows.
+int perf_counters_read(PerformanceCounterScope, PerformanceCounterValues*);
+
+__END_DECLS
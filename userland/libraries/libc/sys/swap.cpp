@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <errno.h>
+#include <sys/swap.h>
+#include <syscall.h>
+
+extern "C" {
+
+int swapon(int fd, size_t size)
+{
+    int rc = syscall(SC_swapon, fd, size);
+    __RETURN_WITH_ERRNO(rc, rc, -1);
+}
+}
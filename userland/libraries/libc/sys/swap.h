@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <stddef.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+// Lets the kernel write memory out to the first size bytes of fd, a file or
+// block device open for reading and writing, once it runs out. Only the
+// superuser may, and only once: the swap area stays until shutdown.
+int swapon(int fd, size_t size);
+
+__END_DECLS
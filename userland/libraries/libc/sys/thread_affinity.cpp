@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <errno.h>
+#include <sys/thread_affinity.h>
+#include <syscall.h>
+
+extern "C" {
+
+int set_thread_affinity(pid_t tid, uint32_t mask)
+{
+    int rc = syscall(SC_set_thread_affinity, tid, mask);
+    __RETURN_WITH_ERRNO(rc, rc, -1);
+}
+
+int get_thread_affinity(pid_t tid, uint32_t* mask)
+{
+    int rc = syscall(SC_get_thread_affinity, tid, mask);
+    __RETURN_WITH_ERRNO(rc, rc, -1);
+}
+}
@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+__BEGIN_DECLS
+
+// Which CPUs a thread of the calling process may run on, one bit per CPU.
+// tid 0 is the calling thread. Bits for CPUs that aren't there are kept,
+// but at least one CPU that is has to be in the mask.
+int set_thread_affinity(pid_t tid, uint32_t mask);
+int get_thread_affinity(pid_t tid, uint32_t* mask);
+
+__END_DECLS
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/api/TimePage.h>
+#include <sys/time_page.h>
+
+extern "C" {
+
+bool __clock_gettime_from_time_page(clockid_t clock_id, struct timespec* ts)
+{
+    bool coarse;
+    bool realtime;
+    switch (clock_id) {
+    case CLOCK_REALTIME:
+        coarse = false;
+        realtime = true;
+        break;
+    case CLOCK_REALTIME_COARSE:
+        coarse = true;
+        realtime = true;
+        break;
+    case CLOCK_MONOTONIC:
+        coarse = false;
+        realtime = false;
+        break;
+    case CLOCK_MONOTONIC_COARSE:
+        coarse = true;
+        realtime = false;
+        break;
+    default:
+        return false;
+    }
+
+    auto const& page = *reinterpret_cast<TimePage const*>(time_page_address);
+
+    // Without the TSC the page only advances once per tick, the kernel can
+    // do better for the precise clocks.
+    if (!coarse && !page.tsc_usable)
+        return false;
+
+    u64 ns;
+    i64 realtime_offset_ns;
+    time_page_read(page, !coarse, ns, realtime_offset_ns);
+    if (realtime)
+        ns += realtime_offset_ns;
+
+    ts->tv_sec = ns / 1'000'000'000;
+    ts->tv_nsec = ns % 1'000'000'000;
+    return true;
+}
+}
@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <sys/cdefs.h>
+#include <time.h>
+
+__BEGIN_DECLS
+
+// Reads clock_id from the kernel's time page, without a syscall. Returns
+// false for clocks the page doesn't carry, clock_gettime() then asks the
+// kernel.
+bool __clock_gettime_from_time_page(clockid_t clock_id, struct timespec* ts);
+
+__END_DECLS
@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <errno.h>
+#include <sys/trace_buffer.h>
+#include <syscall.h>
+
+extern "C" {
+
+int trace_buffer_open(unsigned events)
+{
+    int rc = syscall(SC_trace_buffer_open, events);
+    __RETURN_WITH_ERRNO(rc, rc, -1);
+}
+}
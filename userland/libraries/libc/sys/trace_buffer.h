@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <kernel/api/Trace.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+// Starts writing the events whose bits are set in events to the kernel's
+// trace buffer and returns a file descriptor to mmap() it with. Tracing
+// stops when the descriptor is closed, only one can be open at a time.
+int trace_buffer_open(unsigned events);
+
+__END_DECLS
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#include <sys/cpu_features.h>
+#include <libcompression/CRC.h>
+
+namespace Compression
+{
+
+bool crc_has_pclmul()
+{
+    return (__cpu_features() & (CPU_FEATURE_PCLMUL | CPU_FEATURE_SSE2)) == (CPU_FEATURE_PCLMUL | CPU_FEATURE_SSE2);
+}
+
+#define PCLMUL_TARGET __attribute__((target("pclmul,sse2")))
+
+PCLMUL_TARGET ALWAYS_INLINE static inline __m128i load(const uint8_t *data)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+}
+
+// Multiplies both halves of value by the fold constants and adds the next 128 bits.
+PCLMUL_TARGET ALWAYS_INLINE static inline __m128i fold(__m128i value, __m128i constants, __m128i next)
+{
+    __m128i low = _mm_clmulepi64_si128(value, constants, 0x00);
+    __m128i high = _mm_clmulepi64_si128(value, constants, 0x11);
+    return _mm_xor_si128(_mm_xor_si128(low, high), next);
+}
+
+// Folds the input 64 bytes at a time into four 128-bit lanes, then into a
+// single one, using the constants from Intel's "Fast CRC Computation for
+// Generic Polynomials Using PCLMULQDQ Instruction". The last 128 bits are
+// reduced with the bytewise table instead of a Barrett reduction, the
+// folded remainder has the same crc as the data it replaces.
+PCLMUL_TARGET uint32_t crc_update_pclmul(uint32_t crc, const uint8_t *data, size_t size)
+{
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+
+    __m128i x1;
+
+    if (size >= 64)
+    {
+        x1 = _mm_xor_si128(load(data), _mm_cvtsi32_si128(crc));
+        __m128i x2 = load(data + 16);
+        __m128i x3 = load(data + 32);
+        __m128i x4 = load(data + 48);
+
+        data += 64;
+        size -= 64;
+
+        while (size >= 64)
+        {
+            x1 = fold(x1, k1k2, load(data));
+            x2 = fold(x2, k1k2, load(data + 16));
+            x3 = fold(x3, k1k2, load(data + 32));
+            x4 = fold(x4, k1k2, load(data + 48));
+
+            data += 64;
+            size -= 64;
+        }
+
+        x1 = fold(x1, k3k4, x2);
+        x1 = fold(x1, k3k4, x3);
+        x1 = fold(x1, k3k4, x4);
+    }
+    else
+    {
+        x1 = _mm_xor_si128(load(data), _mm_cvtsi32_si128(crc));
+        data += 16;
+        size -= 16;
+    }
+
+    while (size >= 16)
+    {
+        x1 = fold(x1, k3k4, load(data));
+
+        data += 16;
+        size -= 16;
+    }
+
+    uint8_t remainder[16];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(remainder), x1);
+
+    uint32_t result = 0;
+
+    for (size_t i = 0; i < 16; i++)
+    {
+        result = CRC_TABLE.slices[0][remainder[i] ^ (uint8_t)result] ^ (result >> 8);
+    }
+
+    return result;
+}
+
+}
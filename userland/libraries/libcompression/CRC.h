@@ -7,25 +7,27 @@
 #pragma once
 
 // includes
+#include <string.h>
 #include <libabi/Result.h>
-#include <libutils/Array.h>
 #include <libutils/Prelude.h>
 
 namespace Compression
 {
 
-struct CRCTable : public Array<uint32_t, 256>
+// Slice-by-8 tables, slices[0] is the classic bytewise table and
+// slices[k][b] is the crc of byte b followed by k zero bytes.
+struct CRCTable
 {
     static constexpr uint32_t POLYNOMIAL = 0xEDB88320;
+    static constexpr size_t SLICES = 8;
+
+    uint32_t slices[SLICES][256] = {};
 
     constexpr CRCTable()
     {
-        uint32_t remainder = 0;
-        uint8_t b = 0;
-
-        do
+        for (uint32_t b = 0; b < 256; b++)
         {
-            remainder = b;
+            uint32_t remainder = b;
 
             for (uint8_t bit = 8; bit > 0; --bit)
             {
@@ -39,18 +41,134 @@ struct CRCTable : public Array<uint32_t, 256>
                 }
             }
 
-            at(b) = remainder;
-        } while (0 != ++b);
+            slices[0][b] = remainder;
+        }
+
+        for (size_t slice = 1; slice < SLICES; slice++)
+        {
+            for (uint32_t b = 0; b < 256; b++)
+            {
+                uint32_t previous = slices[slice - 1][b];
+                slices[slice][b] = (previous >> 8) ^ slices[0][previous & 0xff];
+            }
+        }
+    }
+};
+
+static constexpr CRCTable CRC_TABLE{};
+
+// Multiplies two polynomials modulo the crc polynomial, bit 31 is x^0.
+static constexpr uint32_t crc_multiply_modulo(uint32_t a, uint32_t b)
+{
+    uint32_t m = 1u << 31;
+    uint32_t p = 0;
+
+    while (true)
+    {
+        if (a & m)
+        {
+            p ^= b;
+
+            if ((a & (m - 1)) == 0)
+            {
+                break;
+            }
+        }
+
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ CRCTable::POLYNOMIAL : b >> 1;
+    }
+
+    return p;
+}
+
+// x^(2^n) modulo the crc polynomial.
+struct CRCPowerTable
+{
+    uint32_t powers[32] = {};
+
+    constexpr CRCPowerTable()
+    {
+        uint32_t p = 1u << 30; // x^1
+
+        powers[0] = p;
+
+        for (size_t n = 1; n < 32; n++)
+        {
+            p = crc_multiply_modulo(p, p);
+            powers[n] = p;
+        }
     }
 };
 
+static constexpr CRCPowerTable CRC_POWERS{};
+
+// Carry-less multiplication kernel, see CRC.cpp. Only valid when
+// crc_has_pclmul() returned true, works on the pre-inverted crc.
+bool crc_has_pclmul();
+uint32_t crc_update_pclmul(uint32_t crc, const uint8_t *data, size_t size);
+
 struct CRC
 {
 private:
-    CRCTable _table;
     uint32_t _crc = 0;
 
+    // x^(n * 2^k) modulo the crc polynomial.
+    static uint32_t power_modulo(uint64_t n, size_t k)
+    {
+        uint32_t p = 1u << 31; // x^0
+
+        while (n)
+        {
+            if (n & 1)
+            {
+                p = crc_multiply_modulo(CRC_POWERS.powers[k & 31], p);
+            }
+
+            n >>= 1;
+            k++;
+        }
+
+        return p;
+    }
+
+    static uint32_t update_bytewise(uint32_t crc, const uint8_t *data, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            crc = CRC_TABLE.slices[0][data[i] ^ (uint8_t)crc] ^ (crc >> 8);
+        }
+
+        return crc;
+    }
+
+    static uint32_t update_sliced(uint32_t crc, const uint8_t *data, size_t size)
+    {
+        auto &t = CRC_TABLE.slices;
+
+        while (size >= 8)
+        {
+            uint32_t low, high;
+            memcpy(&low, data, sizeof(low)); // x86 is little endian
+            memcpy(&high, data + 4, sizeof(high));
+            low ^= crc;
+
+            crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^
+                  t[5][(low >> 16) & 0xff] ^ t[4][low >> 24] ^
+                  t[3][high & 0xff] ^ t[2][(high >> 8) & 0xff] ^
+                  t[1][(high >> 16) & 0xff] ^ t[0][high >> 24];
+
+            data += 8;
+            size -= 8;
+        }
+
+        return update_bytewise(crc, data, size);
+    }
+
 public:
+    // Below this the setup cost of the pclmul kernel isn't worth it.
+    static constexpr size_t PCLMUL_THRESHOLD = 64;
+
     uint32_t checksum() const { return _crc; }
 
     CRC(uint32_t crc = 0) : _crc{crc}
@@ -59,15 +177,25 @@ public:
 
     void add(const uint8_t *data, size_t size)
     {
-        _crc = ~_crc;
+        uint32_t crc = ~_crc;
 
-        for (size_t i = 0; i < size; ++i)
+        if (size >= PCLMUL_THRESHOLD && crc_has_pclmul())
         {
-            _crc = _table[data[i] ^ (uint8_t)_crc] ^ (_crc >> 8);
+            // The kernel works on multiples of 16 bytes.
+            size_t bulk = size & ~(size_t)15;
+            crc = crc_update_pclmul(crc, data, bulk);
+            data += bulk;
+            size -= bulk;
         }
 
-        _crc = ~_crc;
+        _crc = ~update_sliced(crc, data, size);
+    }
+
+    // Checksum of A followed by B, given the checksums of A and B and the length of B.
+    static uint32_t combine(uint32_t crc1, uint32_t crc2, uint64_t len2)
+    {
+        return crc_multiply_modulo(power_modulo(len2, 3), crc1) ^ crc2;
     }
 };
 
-}
\ No newline at end of file
+}
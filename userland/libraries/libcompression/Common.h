@@ -6,6 +6,9 @@
 
 #pragma once
 
+// includes
+#include <libutils/Prelude.h>
+
 namespace Compression
 {
 
@@ -16,4 +19,92 @@ enum BlockType
     BT_DYNAMIC_HUFFMAN = 2,
 };
 
-}
\ No newline at end of file
+static constexpr unsigned int END_OF_BLOCK = 256;
+static constexpr unsigned int NUM_LITERAL_LENGTH_CODES = 286;
+static constexpr unsigned int NUM_DISTANCE_CODES = 30;
+static constexpr unsigned int NUM_CODE_LENGTH_CODES = 19;
+
+static constexpr unsigned int MIN_MATCH_LENGTH = 3;
+static constexpr unsigned int MAX_MATCH_LENGTH = 258;
+
+static constexpr uint8_t CODE_LENGTH_ORDER[NUM_CODE_LENGTH_CODES] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static constexpr uint8_t BASE_LENGTH_EXTRA_BITS[] = {
+    0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1,
+    2, 2, 2, 2,
+    3, 3, 3, 3,
+    4, 4, 4, 4,
+    5, 5, 5, 5,
+    0,
+};
+
+static constexpr uint16_t BASE_LENGTHS[] = {
+    3, 4, 5, 6, 7, 8, 9, 10,
+    11, 13, 15, 17,
+    19, 23, 27, 31,
+    35, 43, 51, 59,
+    67, 83, 99, 115,
+    131, 163, 195, 227,
+    258,
+};
+
+static constexpr uint16_t BASE_DISTANCE[] = {
+    1, 2, 3, 4,
+    5, 7,
+    9, 13,
+    17, 25,
+    33, 49,
+    65, 97,
+    129, 193,
+    257, 385,
+    513, 769,
+    1025, 1537,
+    2049, 3073,
+    4097, 6145,
+    8193, 12289,
+    16385, 24577,
+};
+
+static constexpr uint8_t BASE_DISTANCE_EXTRA_BITS[] = {
+    0, 0, 0, 0,
+    1, 1,
+    2, 2,
+    3, 3,
+    4, 4,
+    5, 5,
+    6, 6,
+    7, 7,
+    8, 8,
+    9, 9,
+    10, 10,
+    11, 11,
+    12, 12,
+    13, 13,
+};
+
+// Code lengths of the fixed huffman alphabets (RFC 1951, 3.2.6).
+static inline unsigned int fixed_literal_length_code_length(unsigned int symbol)
+{
+    if (symbol <= 143)
+    {
+        return 8;
+    }
+    else if (symbol <= 255)
+    {
+        return 9;
+    }
+    else if (symbol <= 279)
+    {
+        return 7;
+    }
+    else
+    {
+        return 8;
+    }
+}
+
+static constexpr unsigned int FIXED_DISTANCE_CODE_LENGTH = 5;
+
+}
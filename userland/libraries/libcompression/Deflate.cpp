@@ -5,17 +5,200 @@
 */
 
 // includes
+#include <string.h>
 #include <libcompression/Common.h>
 #include <libcompression/Deflate.h>
 #include <libcompression/Huffman.h>
-#include <libio/BufReader.h>
-#include <libutils/Array.h>
+#include <libmath/MinMax.h>
+
 namespace Compression
 {
 
-Deflate::Deflate(unsigned int compression_level) : _compression_level(compression_level)
+static constexpr Deflate::Parameters PARAMETERS[] = {
+    {0, 0, 0, 0},        // 0: store only
+    {4, 4, 0, 8},        // 1: greedy
+    {8, 4, 0, 16},       // 2
+    {32, 4, 0, 32},      // 3
+    {16, 4, 4, 16},      // 4: lazy
+    {32, 8, 16, 32},     // 5
+    {128, 8, 16, 128},   // 6
+    {256, 8, 32, 128},   // 7
+    {1024, 32, 128, 258}, // 8
+    {4096, 32, 258, 258}, // 9: best
+};
+
+static constexpr unsigned int MAX_COMPRESSION_LEVEL = 9;
+
+// Maps a match length to its index in BASE_LENGTHS.
+struct LengthCodeTable
+{
+    uint8_t codes[MAX_MATCH_LENGTH + 1] = {};
+
+    constexpr LengthCodeTable()
+    {
+        unsigned int code = 0;
+
+        for (unsigned int length = MIN_MATCH_LENGTH; length <= MAX_MATCH_LENGTH; length++)
+        {
+            while (code + 1 < ARRAY_LENGTH(BASE_LENGTHS) && BASE_LENGTHS[code + 1] <= length)
+            {
+                code++;
+            }
+
+            codes[length] = code;
+        }
+    }
+};
+
+// Maps a distance to its index in BASE_DISTANCE. Distances up to 256 are
+// looked up directly, above that every code covers a multiple of 128.
+struct DistanceCodeTable
+{
+    uint8_t codes[512] = {};
+
+    static constexpr unsigned int code_for(unsigned int distance)
+    {
+        unsigned int code = 0;
+
+        while (code + 1 < ARRAY_LENGTH(BASE_DISTANCE) && BASE_DISTANCE[code + 1] <= distance)
+        {
+            code++;
+        }
+
+        return code;
+    }
+
+    constexpr DistanceCodeTable()
+    {
+        for (unsigned int i = 0; i < 256; i++)
+        {
+            codes[i] = code_for(i + 1);
+            codes[256 + i] = code_for((i << 7) + 1);
+        }
+    }
+
+    unsigned int operator[](unsigned int distance) const
+    {
+        return distance <= 256 ? codes[distance - 1] : codes[256 + ((distance - 1) >> 7)];
+    }
+};
+
+static constexpr LengthCodeTable LENGTH_CODES{};
+static constexpr DistanceCodeTable DISTANCE_CODES{};
+
+// Code lengths run-length encoded with the 16, 17 and 18 code length codes.
+struct CodeLengthEncoding
+{
+    uint8_t symbols[NUM_LITERAL_LENGTH_CODES + NUM_DISTANCE_CODES];
+    uint8_t extras[NUM_LITERAL_LENGTH_CODES + NUM_DISTANCE_CODES];
+    size_t count = 0;
+
+    void push(uint8_t symbol, uint8_t extra = 0)
+    {
+        symbols[count] = symbol;
+        extras[count] = extra;
+        count++;
+    }
+
+    void encode(const uint8_t *lengths, size_t length_count)
+    {
+        size_t i = 0;
+
+        while (i < length_count)
+        {
+            uint8_t length = lengths[i];
+            size_t run = 1;
+
+            while (i + run < length_count && lengths[i + run] == length)
+            {
+                run++;
+            }
+
+            i += run;
+
+            if (length == 0)
+            {
+                while (run >= 11)
+                {
+                    size_t repeat = MIN(run, 138);
+                    push(18, repeat - 11);
+                    run -= repeat;
+                }
+
+                if (run >= 3)
+                {
+                    push(17, run - 3);
+                    run = 0;
+                }
+            }
+            else
+            {
+                push(length);
+                run--;
+
+                while (run >= 3)
+                {
+                    size_t repeat = MIN(run, 6);
+                    push(16, repeat - 3);
+                    run -= repeat;
+                }
+            }
+
+            while (run > 0)
+            {
+                push(length);
+                run--;
+            }
+        }
+    }
+};
+
+static constexpr uint8_t CODE_LENGTH_EXTRA_BITS[NUM_CODE_LENGTH_CODES] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    2, 3, 7};
+
+static size_t count_used_codes(const uint8_t *lengths, size_t count, size_t minimum)
+{
+    size_t used = count;
+
+    while (used > minimum && lengths[used - 1] == 0)
+    {
+        used--;
+    }
+
+    return used;
+}
+
+// Inflaters expect complete trees, give lone codes a sibling.
+static void ensure_two_codes(uint8_t *lengths, size_t count)
+{
+    size_t used = 0;
+    size_t last = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (lengths[i] != 0)
+        {
+            used++;
+            last = i;
+        }
+    }
+
+    if (used == 0)
+    {
+        lengths[0] = 1;
+        lengths[1] = 1;
+    }
+    else if (used == 1)
+    {
+        lengths[last == 0 ? 1 : 0] = 1;
+    }
+}
+
+Deflate::Deflate(unsigned int compression_level) : _compression_level(MIN(compression_level, MAX_COMPRESSION_LEVEL))
 {
     _min_size_to_compress = 56 - (_compression_level * 4);
+    _parameters = PARAMETERS[_compression_level];
 }
 
 void Deflate::write_block_header(IO::BitWriter &out_writer, BlockType block_type, bool final)
@@ -33,44 +216,592 @@ void Deflate::write_uncompressed_block(const uint8_t *block_data, size_t block_l
     out_writer.put_data(block_data, block_len);
 }
 
-JResult Deflate::write_uncompressed_blocks(IO::Reader &in_data, IO::BitWriter &out_writer, bool write_final)
+void Deflate::slide_window()
 {
-    Vector<uint8_t> block_data;
-    block_data.resize(UINT16_MAX);
-    bool final_block = false;
+    uint8_t *window = _window.raw_storage();
+    memcpy(window, window + WINDOW_SIZE, _end - WINDOW_SIZE);
+
+    _position -= WINDOW_SIZE;
+    _end -= WINDOW_SIZE;
+    _block_start -= WINDOW_SIZE;
+    _match_start = _match_start >= WINDOW_SIZE ? _match_start - WINDOW_SIZE : 0;
 
-    do
+    uint32_t *head = _hash_head.raw_storage();
+    for (size_t i = 0; i < HASH_SIZE; i++)
     {
-        size_t len = TRY(in_data.read(block_data.raw_storage(), block_data.count()));
+        head[i] = head[i] > WINDOW_SIZE ? head[i] - WINDOW_SIZE : 0;
+    }
 
-        final_block = len < block_data.count();
-        write_uncompressed_block(block_data.raw_storage(), len, out_writer, write_final && final_block);
-    } while (!final_block);
+    uint32_t *prev = _hash_prev.raw_storage();
+    for (size_t i = 0; i < WINDOW_SIZE; i++)
+    {
+        prev[i] = prev[i] > WINDOW_SIZE ? prev[i] - WINDOW_SIZE : 0;
+    }
+}
+
+// Returns the previous head of the chain, the caller must make sure
+// there are at least MIN_MATCH_LENGTH bytes at position.
+ALWAYS_INLINE uint32_t Deflate::insert_hash(size_t position)
+{
+    const uint8_t *bytes = _window.raw_storage() + position;
+    uint32_t key = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16);
+    uint32_t hash = (key * 2654435761u) >> (32 - HASH_BITS);
+
+    uint32_t *head = _hash_head.raw_storage();
+    uint32_t previous = head[hash];
 
-    return JResult::SUCCESS;
+    _hash_prev.raw_storage()[position & WINDOW_MASK] = previous;
+    head[hash] = position + 1;
+
+    return previous;
 }
 
-JResult Deflate::compress_none(IO::Reader &uncompressed, IO::Writer &compressed)
+unsigned int Deflate::longest_match(uint32_t chain, unsigned int previous_length)
 {
-    IO::BitWriter bit_writer(compressed);
-    return write_uncompressed_blocks(uncompressed, bit_writer, true);
+    unsigned int chain_length = _parameters.max_chain;
+
+    if (previous_length >= _parameters.good_length)
+    {
+        chain_length >>= 2;
+    }
+
+    unsigned int max_length = MIN(MAX_MATCH_LENGTH, _end - _position);
+    unsigned int nice_length = MIN(_parameters.nice_length, max_length);
+    unsigned int best_length = previous_length;
+
+    if (best_length >= max_length)
+    {
+        return best_length;
+    }
+
+    size_t limit = _position > MAX_DISTANCE ? _position - MAX_DISTANCE : 0;
+    const uint8_t *window = _window.raw_storage();
+    const uint8_t *scan = window + _position;
+    const uint32_t *prev = _hash_prev.raw_storage();
+
+    while (chain != 0 && chain_length > 0)
+    {
+        size_t candidate = chain - 1;
+
+        if (candidate < limit)
+        {
+            break;
+        }
+
+        const uint8_t *match = window + candidate;
+
+        if (match[best_length] == scan[best_length] && match[0] == scan[0] && match[1] == scan[1])
+        {
+            unsigned int length = 2;
+
+            while (length < max_length && match[length] == scan[length])
+            {
+                length++;
+            }
+
+            if (length > best_length)
+            {
+                best_length = length;
+                _match_start = candidate;
+
+                if (length >= nice_length)
+                {
+                    break;
+                }
+            }
+        }
+
+        uint32_t next = prev[candidate & WINDOW_MASK];
+
+        // Entries that went around the window point forward, the chain ends here.
+        if (next >= chain)
+        {
+            break;
+        }
+
+        chain = next;
+        chain_length--;
+    }
+
+    return best_length;
 }
 
-JResult Deflate::perform(IO::Reader &uncompressed, IO::Writer &compressed)
+ALWAYS_INLINE void Deflate::emit_literal(uint8_t literal)
 {
-    IO::BufReader buf_reader(uncompressed, 4096);
+    _symbols.push_back({literal, 0});
+    _block_length++;
+}
+
+ALWAYS_INLINE void Deflate::emit_match(unsigned int length, unsigned int distance)
+{
+    _symbols.push_back({(uint16_t)length, (uint16_t)distance});
+    _block_length += length;
+}
+
+void Deflate::write_symbols(IO::BitWriter &out_writer, const uint8_t *lit_len_lengths, size_t lit_len_count, const uint8_t *dist_lengths)
+{
+    uint16_t lit_len_codes[HuffmanEncoder::MAX_SYMBOLS];
+    uint16_t dist_codes[NUM_DISTANCE_CODES];
+
+    HuffmanEncoder::build_codes(lit_len_lengths, lit_len_count, lit_len_codes);
+    HuffmanEncoder::build_codes(dist_lengths, NUM_DISTANCE_CODES, dist_codes);
+
+    for (const auto &symbol : _symbols)
+    {
+        if (symbol.distance == 0)
+        {
+            out_writer.put_bits(lit_len_codes[symbol.length_or_literal], lit_len_lengths[symbol.length_or_literal]);
+            continue;
+        }
+
+        unsigned int length_code = LENGTH_CODES.codes[symbol.length_or_literal];
+        unsigned int length_symbol = END_OF_BLOCK + 1 + length_code;
+        out_writer.put_bits(lit_len_codes[length_symbol], lit_len_lengths[length_symbol]);
+        out_writer.put_bits(symbol.length_or_literal - BASE_LENGTHS[length_code], BASE_LENGTH_EXTRA_BITS[length_code]);
+
+        unsigned int dist_code = DISTANCE_CODES[symbol.distance];
+        out_writer.put_bits(dist_codes[dist_code], dist_lengths[dist_code]);
+        out_writer.put_bits(symbol.distance - BASE_DISTANCE[dist_code], BASE_DISTANCE_EXTRA_BITS[dist_code]);
+    }
+
+    out_writer.put_bits(lit_len_codes[END_OF_BLOCK], lit_len_lengths[END_OF_BLOCK]);
+}
+
+void Deflate::write_block(IO::BitWriter &out_writer, bool final)
+{
+    if (_symbols.empty() && !final)
+    {
+        return;
+    }
+
+    uint32_t lit_len_frequencies[NUM_LITERAL_LENGTH_CODES] = {};
+    uint32_t dist_frequencies[NUM_DISTANCE_CODES] = {};
+    size_t extra_bits = 0;
+
+    for (const auto &symbol : _symbols)
+    {
+        if (symbol.distance == 0)
+        {
+            lit_len_frequencies[symbol.length_or_literal]++;
+            continue;
+        }
+
+        unsigned int length_code = LENGTH_CODES.codes[symbol.length_or_literal];
+        unsigned int dist_code = DISTANCE_CODES[symbol.distance];
+
+        lit_len_frequencies[END_OF_BLOCK + 1 + length_code]++;
+        dist_frequencies[dist_code]++;
+        extra_bits += BASE_LENGTH_EXTRA_BITS[length_code] + BASE_DISTANCE_EXTRA_BITS[dist_code];
+    }
+
+    lit_len_frequencies[END_OF_BLOCK] = 1;
+
+    // Dynamic huffman
+    uint8_t lit_len_lengths[NUM_LITERAL_LENGTH_CODES];
+    uint8_t dist_lengths[NUM_DISTANCE_CODES];
+
+    HuffmanEncoder::build_lengths(lit_len_frequencies, NUM_LITERAL_LENGTH_CODES, HuffmanEncoder::MAX_CODE_BITS, lit_len_lengths);
+    HuffmanEncoder::build_lengths(dist_frequencies, NUM_DISTANCE_CODES, HuffmanEncoder::MAX_CODE_BITS, dist_lengths);
+    ensure_two_codes(lit_len_lengths, NUM_LITERAL_LENGTH_CODES);
+    ensure_two_codes(dist_lengths, NUM_DISTANCE_CODES);
+
+    size_t hlit = count_used_codes(lit_len_lengths, NUM_LITERAL_LENGTH_CODES, END_OF_BLOCK + 1);
+    size_t hdist = count_used_codes(dist_lengths, NUM_DISTANCE_CODES, 1);
+
+    uint8_t all_lengths[NUM_LITERAL_LENGTH_CODES + NUM_DISTANCE_CODES];
+    memcpy(all_lengths, lit_len_lengths, hlit);
+    memcpy(all_lengths + hlit, dist_lengths, hdist);
+
+    CodeLengthEncoding encoding;
+    encoding.encode(all_lengths, hlit + hdist);
+
+    uint32_t code_length_frequencies[NUM_CODE_LENGTH_CODES] = {};
+    for (size_t i = 0; i < encoding.count; i++)
+    {
+        code_length_frequencies[encoding.symbols[i]]++;
+    }
+
+    uint8_t code_length_lengths[NUM_CODE_LENGTH_CODES];
+    HuffmanEncoder::build_lengths(code_length_frequencies, NUM_CODE_LENGTH_CODES, 7, code_length_lengths);
+    ensure_two_codes(code_length_lengths, NUM_CODE_LENGTH_CODES);
 
-    if (buf_reader.buffered().unwrap() < _min_size_to_compress)
-        [[unlikely]]
+    size_t hclen = NUM_CODE_LENGTH_CODES;
+    while (hclen > 4 && code_length_lengths[CODE_LENGTH_ORDER[hclen - 1]] == 0)
     {
-        return compress_none(buf_reader, compressed);
+        hclen--;
     }
 
-    switch (_compression_level)
+    size_t dynamic_bits = 3 + 5 + 5 + 4 + hclen * 3 + extra_bits;
+    for (size_t i = 0; i < encoding.count; i++)
     {
-    default:
-        return compress_none(buf_reader, compressed);
+        dynamic_bits += code_length_lengths[encoding.symbols[i]] + CODE_LENGTH_EXTRA_BITS[encoding.symbols[i]];
     }
+
+    // Fixed huffman
+    uint8_t fixed_lit_len_lengths[HuffmanEncoder::MAX_SYMBOLS];
+    uint8_t fixed_dist_lengths[NUM_DISTANCE_CODES];
+
+    for (size_t i = 0; i < HuffmanEncoder::MAX_SYMBOLS; i++)
+    {
+        fixed_lit_len_lengths[i] = fixed_literal_length_code_length(i);
+    }
+
+    for (size_t i = 0; i < NUM_DISTANCE_CODES; i++)
+    {
+        fixed_dist_lengths[i] = FIXED_DISTANCE_CODE_LENGTH;
+    }
+
+    size_t fixed_bits = 3 + extra_bits;
+
+    for (size_t i = 0; i < NUM_LITERAL_LENGTH_CODES; i++)
+    {
+        dynamic_bits += lit_len_frequencies[i] * lit_len_lengths[i];
+        fixed_bits += lit_len_frequencies[i] * fixed_lit_len_lengths[i];
+    }
+
+    for (size_t i = 0; i < NUM_DISTANCE_CODES; i++)
+    {
+        dynamic_bits += dist_frequencies[i] * dist_lengths[i];
+        fixed_bits += dist_frequencies[i] * fixed_dist_lengths[i];
+    }
+
+    // Stored, one header per 64KiB and the worst case alignment.
+    size_t stored_blocks = MAX((_block_length + UINT16_MAX - 1) / UINT16_MAX, 1);
+    size_t stored_bits = _block_length * 8 + stored_blocks * (3 + 7 + 32);
+
+    if (stored_bits <= fixed_bits && stored_bits <= dynamic_bits)
+    {
+        const uint8_t *data = _window.raw_storage() + _block_start;
+        size_t remaining = _block_length;
+
+        do
+        {
+            size_t chunk = MIN(remaining, UINT16_MAX);
+            remaining -= chunk;
+
+            write_uncompressed_block(data, chunk, out_writer, final && remaining == 0);
+            data += chunk;
+        } while (remaining > 0);
+    }
+    else if (fixed_bits <= dynamic_bits)
+    {
+        write_block_header(out_writer, BlockType::BT_FIXED_HUFFMAN, final);
+        write_symbols(out_writer, fixed_lit_len_lengths, HuffmanEncoder::MAX_SYMBOLS, fixed_dist_lengths);
+    }
+    else
+    {
+        write_block_header(out_writer, BlockType::BT_DYNAMIC_HUFFMAN, final);
+
+        out_writer.put_bits(hlit - 257, 5);
+        out_writer.put_bits(hdist - 1, 5);
+        out_writer.put_bits(hclen - 4, 4);
+
+        for (size_t i = 0; i < hclen; i++)
+        {
+            out_writer.put_bits(code_length_lengths[CODE_LENGTH_ORDER[i]], 3);
+        }
+
+        uint16_t code_length_codes[NUM_CODE_LENGTH_CODES];
+        HuffmanEncoder::build_codes(code_length_lengths, NUM_CODE_LENGTH_CODES, code_length_codes);
+
+        for (size_t i = 0; i < encoding.count; i++)
+        {
+            uint8_t symbol = encoding.symbols[i];
+            out_writer.put_bits(code_length_codes[symbol], code_length_lengths[symbol]);
+            out_writer.put_bits(encoding.extras[i], CODE_LENGTH_EXTRA_BITS[symbol]);
+        }
+
+        write_symbols(out_writer, lit_len_lengths, NUM_LITERAL_LENGTH_CODES, dist_lengths);
+    }
+
+    _symbols.clear();
+    _block_start += _block_length;
+    _block_length = 0;
+}
+
+void Deflate::begin(IO::BitWriter &out)
+{
+    _out = &out;
+
+    _window.resize(WINDOW_SIZE * 2);
+
+    if (_compression_level > 0)
+    {
+        _hash_head.resize(HASH_SIZE);
+        _hash_prev.resize(WINDOW_SIZE);
+        memset(_hash_head.raw_storage(), 0, HASH_SIZE * sizeof(uint32_t));
+        memset(_hash_prev.raw_storage(), 0, WINDOW_SIZE * sizeof(uint32_t));
+
+        _symbols.clear();
+        _symbols.ensure_capacity(BLOCK_SYMBOLS);
+    }
+
+    _position = 0;
+    _end = 0;
+    _match_start = 0;
+    _match_available = false;
+    _match_length = MIN_MATCH_LENGTH - 1;
+    _block_start = 0;
+    _block_length = 0;
+}
+
+void Deflate::write(const uint8_t *data, size_t size)
+{
+    while (size > 0)
+    {
+        if (_compression_level == 0)
+        {
+            // Storing only, the window is just a buffer for one full block.
+            if (_end == UINT16_MAX)
+            {
+                write_uncompressed_block(_window.raw_storage(), _end, *_out, false);
+                _end = 0;
+            }
+
+            size_t chunk = MIN(size, UINT16_MAX - _end);
+            memcpy(_window.raw_storage() + _end, data, chunk);
+
+            _end += chunk;
+            data += chunk;
+            size -= chunk;
+
+            continue;
+        }
+
+        if (_end == WINDOW_SIZE * 2)
+        {
+            // process() left less than MIN_LOOKAHEAD bytes, so the position is
+            // in the upper half and the pending block covers bytes about to
+            // be dropped.
+            write_block(*_out, false);
+            slide_window();
+        }
+
+        size_t chunk = MIN(size, WINDOW_SIZE * 2 - _end);
+        memcpy(_window.raw_storage() + _end, data, chunk);
+
+        _end += chunk;
+        data += chunk;
+        size -= chunk;
+
+        process(false);
+    }
+}
+
+void Deflate::set_dictionary(const uint8_t *data, size_t size)
+{
+    if (_compression_level == 0)
+    {
+        return;
+    }
+
+    if (size > WINDOW_SIZE)
+    {
+        data += size - WINDOW_SIZE;
+        size = WINDOW_SIZE;
+    }
+
+    memcpy(_window.raw_storage(), data, size);
+
+    for (size_t i = 0; i + MIN_MATCH_LENGTH <= size; i++)
+    {
+        insert_hash(i);
+    }
+
+    _position = size;
+    _end = size;
+    _block_start = size;
+}
+
+void Deflate::sync_flush()
+{
+    if (_compression_level == 0)
+    {
+        if (_end > 0)
+        {
+            write_uncompressed_block(_window.raw_storage(), _end, *_out, false);
+            _end = 0;
+        }
+    }
+    else
+    {
+        process(true);
+
+        if (_match_available)
+        {
+            emit_literal(_window[_position - 1]);
+            _match_available = false;
+        }
+
+        _match_length = MIN_MATCH_LENGTH - 1;
+
+        if (_block_length > 0)
+        {
+            write_block(*_out, false);
+        }
+    }
+
+    write_uncompressed_block(nullptr, 0, *_out, false);
+    _out->flush();
 }
 
-}
\ No newline at end of file
+void Deflate::process(bool finishing)
+{
+    const uint8_t *window = _window.raw_storage();
+    bool lazy = _parameters.lazy_length != 0;
+
+    while (true)
+    {
+        size_t lookahead = _end - _position;
+
+        // Wait for more input unless this is the end of the stream, matches
+        // must be able to reach MAX_MATCH_LENGTH.
+        if (lookahead == 0 || (!finishing && lookahead < MIN_LOOKAHEAD))
+        {
+            break;
+        }
+
+        uint32_t chain = 0;
+
+        if (lookahead >= MIN_MATCH_LENGTH)
+        {
+            chain = insert_hash(_position);
+        }
+
+        bool chain_in_reach = chain != 0 && _position - (chain - 1) <= MAX_DISTANCE;
+
+        if (!lazy)
+        {
+            unsigned int match_length = 0;
+
+            if (chain_in_reach)
+            {
+                match_length = longest_match(chain, MIN_MATCH_LENGTH - 1);
+            }
+
+            if (match_length >= MIN_MATCH_LENGTH)
+            {
+                emit_match(match_length, _position - _match_start);
+
+                for (size_t i = 1; i < match_length; i++)
+                {
+                    if (_position + i + MIN_MATCH_LENGTH <= _end)
+                    {
+                        insert_hash(_position + i);
+                    }
+                }
+
+                _position += match_length;
+            }
+            else
+            {
+                emit_literal(window[_position]);
+                _position++;
+            }
+        }
+        else
+        {
+            unsigned int previous_length = _match_length;
+            size_t previous_start = _match_start;
+            _match_length = MIN_MATCH_LENGTH - 1;
+
+            if (chain_in_reach && previous_length < _parameters.lazy_length)
+            {
+                _match_length = longest_match(chain, previous_length);
+
+                if (_match_length == MIN_MATCH_LENGTH && _position - _match_start > TOO_FAR)
+                {
+                    _match_length = MIN_MATCH_LENGTH - 1;
+                }
+            }
+
+            if (previous_length >= MIN_MATCH_LENGTH && _match_length <= previous_length)
+            {
+                // The match starting at the previous byte is at least as good, take it.
+                emit_match(previous_length, _position - 1 - previous_start);
+
+                size_t match_end = _position - 1 + previous_length;
+
+                for (size_t i = _position + 1; i < match_end; i++)
+                {
+                    if (i + MIN_MATCH_LENGTH <= _end)
+                    {
+                        insert_hash(i);
+                    }
+                }
+
+                _position = match_end;
+                _match_available = false;
+                _match_length = MIN_MATCH_LENGTH - 1;
+            }
+            else if (_match_available)
+            {
+                emit_literal(window[_position - 1]);
+                _position++;
+            }
+            else
+            {
+                _match_available = true;
+                _position++;
+            }
+        }
+
+        if (block_full())
+        {
+            write_block(*_out, false);
+        }
+    }
+}
+
+void Deflate::finish()
+{
+    if (_compression_level == 0)
+    {
+        write_uncompressed_block(_window.raw_storage(), _end, *_out, true);
+    }
+    else if (_position == 0 && _end < _min_size_to_compress)
+    {
+        write_uncompressed_block(_window.raw_storage(), _end, *_out, true);
+    }
+    else
+    {
+        process(true);
+
+        if (_match_available)
+        {
+            emit_literal(_window[_position - 1]);
+            _match_available = false;
+        }
+
+        write_block(*_out, true);
+    }
+
+    _out->align();
+    _out->flush();
+}
+
+JResult Deflate::perform(IO::Reader &uncompressed, IO::Writer &compressed)
+{
+    IO::BitWriter out_writer(compressed);
+    uint8_t buffer[16384];
+
+    begin(out_writer);
+
+    while (true)
+    {
+        size_t read = TRY(uncompressed.read(buffer, sizeof(buffer)));
+
+        if (read == 0)
+        {
+            break;
+        }
+
+        write(buffer, read);
+    }
+
+    finish();
+
+    return SUCCESS;
+}
+
+}
@@ -11,26 +11,114 @@
 #include <libcompression/Common.h>
 #include <libio/BitWriter.h>
 #include <libio/Reader.h>
+#include <libutils/Vector.h>
 
 namespace Compression
 {
 
 struct Deflate
 {
+public:
+    static constexpr unsigned int WINDOW_SIZE = 32768;
+    static constexpr unsigned int WINDOW_MASK = WINDOW_SIZE - 1;
+    static constexpr unsigned int MIN_LOOKAHEAD = MAX_MATCH_LENGTH + MIN_MATCH_LENGTH + 1;
+
+    // One less than the lookahead so a pending lazy match never points
+    // below the part of the window that survives a slide.
+    static constexpr unsigned int MAX_DISTANCE = WINDOW_SIZE - MIN_LOOKAHEAD - 1;
+
+    // Matches of the minimum length further away than this cost more than literals.
+    static constexpr unsigned int TOO_FAR = 4096;
+
+    static constexpr unsigned int HASH_BITS = 15;
+    static constexpr unsigned int HASH_SIZE = 1 << HASH_BITS;
+    static constexpr unsigned int HASH_MASK = HASH_SIZE - 1;
+
+    static constexpr unsigned int BLOCK_SYMBOLS = 16384;
+
+    // How hard the match finder tries at a given compression level.
+    struct Parameters
+    {
+        // Maximum number of hash chain links to follow per match.
+        unsigned int max_chain;
+
+        // Follow only a quarter of the chain once we already have a match this long.
+        unsigned int good_length;
+
+        // Don't look for a better (lazy) match once we have one this long, 0 means greedy.
+        unsigned int lazy_length;
+
+        // Stop searching as soon as we find a match this long.
+        unsigned int nice_length;
+    };
+
 private:
+    // A literal when distance is 0, a length/distance pair otherwise.
+    struct Symbol
+    {
+        uint16_t length_or_literal;
+        uint16_t distance;
+    };
+
     unsigned int _compression_level;
     unsigned int _min_size_to_compress;
+    Parameters _parameters;
+
+    IO::BitWriter *_out = nullptr;
+
+    // Sliding window, twice the size of the history so it can be refilled
+    // without wrapping, and the hash chains pointing into it. Chain entries
+    // are position + 1 so 0 can mean empty.
+    Vector<uint8_t> _window;
+    Vector<uint32_t> _hash_head;
+    Vector<uint32_t> _hash_prev;
+    size_t _position = 0;
+    size_t _end = 0;
+    size_t _match_start = 0;
 
-    static JResult compress_none(IO::Reader &uncompressed, IO::Writer &compressed);
+    // Lazy matching state, carried over between calls to process().
+    bool _match_available = false;
+    unsigned int _match_length = 0;
+
+    // Symbols of the block being built and the bytes they cover.
+    Vector<Symbol> _symbols;
+    size_t _block_start = 0;
+    size_t _block_length = 0;
 
-    static JResult write_uncompressed_blocks(IO::Reader &in_data, IO::BitWriter &out_writer, bool final);
     static void write_block_header(IO::BitWriter &out_writer, BlockType block_type, bool final);
     static void write_uncompressed_block(const uint8_t *block_data, size_t block_len, IO::BitWriter &out_writer, bool final);
 
+    void process(bool finishing);
+    void slide_window();
+    uint32_t insert_hash(size_t position);
+    unsigned int longest_match(uint32_t chain, unsigned int previous_length);
+
+    void emit_literal(uint8_t literal);
+    void emit_match(unsigned int length, unsigned int distance);
+    bool block_full() const { return _symbols.count() >= BLOCK_SYMBOLS; }
+
+    void write_block(IO::BitWriter &out_writer, bool final);
+    void write_symbols(IO::BitWriter &out_writer, const uint8_t *lit_len_lengths, size_t lit_len_count, const uint8_t *dist_lengths);
+
 public:
     Deflate(unsigned int compression_level);
 
+    // Streaming interface: begin() a stream, push data through write() as
+    // it comes and finish() it, which leaves out byte aligned and flushed.
+    void begin(IO::BitWriter &out);
+    void write(const uint8_t *data, size_t size);
+    void finish();
+
+    // Lets matches reach back into data, the end of what came before in
+    // the stream, without compressing it. Only right after begin().
+    void set_dictionary(const uint8_t *data, size_t size);
+
+    // Compresses everything written so far and ends it with an empty
+    // stored block, so out is byte aligned and what follows can be
+    // compressed by a different Deflate.
+    void sync_flush();
+
     JResult perform(IO::Reader &uncompressed, IO::Writer &compressed);
 };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <libcompression/Gzip.h>
+#include <libio/Streams.h>
+
+namespace Compression
+{
+
+GzipReader::GzipReader(IO::Reader &reader)
+    : _input{reader, BUFFER_SIZE}, _bits{_input}
+{
+}
+
+JResult GzipReader::read_header()
+{
+    uint8_t magic1 = _bits.grab_bits(8);
+    uint8_t magic2 = _bits.grab_bits(8);
+    uint8_t method = _bits.grab_bits(8);
+    uint8_t flags = _bits.grab_bits(8);
+
+    // Modification time, extra flags and operating system.
+    TRY(_bits.skip_bits(6 * 8));
+
+    if (_bits.overrun() || magic1 != GZIP_MAGIC1 || magic2 != GZIP_MAGIC2)
+    {
+        IO::logln("Not a gzip member");
+        return ERR_INVALID_DATA;
+    }
+
+    if (method != GZIP_METHOD_DEFLATE)
+    {
+        IO::logln("Unsupported gzip compression method: {}", method);
+        return ERR_NOT_IMPLEMENTED;
+    }
+
+    if (flags & GZIP_FLAG_EXTRA)
+    {
+        uint16_t extra_length = _bits.grab_bits(16);
+        TRY(_bits.skip_bits(extra_length * 8));
+    }
+
+    // The file name and the comment are zero terminated.
+    for (uint8_t flag : {GZIP_FLAG_NAME, GZIP_FLAG_COMMENT})
+    {
+        if (!(flags & flag))
+        {
+            continue;
+        }
+
+        while (_bits.grab_bits(8) != 0)
+        {
+            if (_bits.overrun())
+            {
+                return ERR_INVALID_DATA;
+            }
+        }
+    }
+
+    if (flags & GZIP_FLAG_HEADER_CRC)
+    {
+        TRY(_bits.skip_bits(16));
+    }
+
+    if (_bits.overrun())
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    _inflate.reset();
+    _crc = CRC{};
+    _member_size = 0;
+
+    return SUCCESS;
+}
+
+JResult GzipReader::read_trailer()
+{
+    _bits.align();
+
+    uint32_t crc = _bits.grab_bits(16);
+    crc |= _bits.grab_bits(16) << 16;
+
+    uint32_t size = _bits.grab_bits(16);
+    size |= _bits.grab_bits(16) << 16;
+
+    if (_bits.overrun())
+    {
+        IO::logln("Unexpected end of gzip member");
+        return ERR_INVALID_DATA;
+    }
+
+    if (crc != _crc.checksum() || size != _member_size)
+    {
+        IO::logln("Gzip member is corrupted: crc {} != {}, size {} != {}", crc, _crc.checksum(), size, _member_size);
+        return ERR_INVALID_DATA;
+    }
+
+    return SUCCESS;
+}
+
+ResultOr<size_t> GzipReader::read(void *buffer, size_t size)
+{
+    while (_state != STATE_END)
+    {
+        if (_state == STATE_HEADER)
+        {
+            TRY(read_header());
+            _state = STATE_BODY;
+        }
+
+        size_t read = TRY(_inflate.read(_bits, buffer, size));
+
+        _crc.add(reinterpret_cast<uint8_t *>(buffer), read);
+        _member_size += read;
+
+        if (_inflate.ended())
+        {
+            TRY(read_trailer());
+
+            // Another member may follow.
+            TRY(_bits.hint(8));
+            _state = _bits.ended() ? STATE_END : STATE_HEADER;
+        }
+
+        if (read > 0 || size == 0)
+        {
+            return read;
+        }
+    }
+
+    return 0;
+}
+
+GzipWriter::GzipWriter(IO::Writer &writer, unsigned int compression_level)
+    : _bits{writer}, _deflate{compression_level}
+{
+}
+
+GzipWriter::~GzipWriter()
+{
+    finish();
+}
+
+void GzipWriter::write_header()
+{
+    _bits.put_bits(GZIP_MAGIC1, 8);
+    _bits.put_bits(GZIP_MAGIC2, 8);
+    _bits.put_bits(GZIP_METHOD_DEFLATE, 8);
+    _bits.put_bits(0, 8); // flags
+    _bits.put_bits(0, 32); // modification time
+    _bits.put_bits(0, 8); // extra flags
+    _bits.put_bits(255, 8); // unknown operating system
+
+    _deflate.begin(_bits);
+    _crc = CRC{};
+    _member_size = 0;
+    _in_member = true;
+}
+
+ResultOr<size_t> GzipWriter::write(const void *buffer, size_t size)
+{
+    if (!_in_member)
+    {
+        write_header();
+    }
+
+    _deflate.write(reinterpret_cast<const uint8_t *>(buffer), size);
+    _crc.add(reinterpret_cast<const uint8_t *>(buffer), size);
+    _member_size += size;
+
+    return size;
+}
+
+JResult GzipWriter::finish()
+{
+    if (!_in_member)
+    {
+        if (_finished_member)
+        {
+            return SUCCESS;
+        }
+
+        // Nothing was written, which is still one member, with an empty
+        // deflate block, as gzip makes of an empty file.
+        write_header();
+    }
+
+    _deflate.finish();
+
+    _bits.put_bits(_crc.checksum(), 32);
+    _bits.put_bits(_member_size, 32);
+    _bits.flush();
+
+    _in_member = false;
+    _finished_member = true;
+
+    return SUCCESS;
+}
+
+JResult GzipWriter::flush()
+{
+    // A deflate stream can't be flushed halfway without ending the block,
+    // anything already compressed is handed to the writer though.
+    _bits.flush();
+    return SUCCESS;
+}
+
+JResult gzip_parallel(IO::Reader &uncompressed, IO::Writer &compressed, unsigned int compression_level, size_t thread_count)
+{
+    IO::BitWriter bits{compressed};
+
+    bits.put_bits(GZIP_MAGIC1, 8);
+    bits.put_bits(GZIP_MAGIC2, 8);
+    bits.put_bits(GZIP_METHOD_DEFLATE, 8);
+    bits.put_bits(0, 8); // flags
+    bits.put_bits(0, 32); // modification time
+    bits.put_bits(0, 8); // extra flags
+    bits.put_bits(255, 8); // unknown operating system
+    bits.flush();
+
+    ParallelDeflate deflate{compression_level, thread_count};
+    TRY(deflate.perform(uncompressed, compressed));
+
+    bits.put_bits(deflate.crc(), 32);
+    bits.put_bits(deflate.size(), 32);
+    bits.flush();
+
+    return SUCCESS;
+}
+
+}
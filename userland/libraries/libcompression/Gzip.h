@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <libcompression/CRC.h>
+#include <libcompression/Deflate.h>
+#include <libcompression/Inflate.h>
+#include <libcompression/ParallelDeflate.h>
+#include <libio/BitReader.h>
+#include <libio/BitWriter.h>
+#include <libio/BufReader.h>
+
+namespace Compression
+{
+
+// Gzip containers (RFC 1952) around the deflate streams.
+//
+// Both sides stream, memory use is bounded by the deflate window and a
+// few small buffers no matter how large the data is.
+
+static constexpr uint8_t GZIP_MAGIC1 = 0x1f;
+static constexpr uint8_t GZIP_MAGIC2 = 0x8b;
+static constexpr uint8_t GZIP_METHOD_DEFLATE = 8;
+
+enum GzipFlags : uint8_t
+{
+    GZIP_FLAG_TEXT = 1 << 0,
+    GZIP_FLAG_HEADER_CRC = 1 << 1,
+    GZIP_FLAG_EXTRA = 1 << 2,
+    GZIP_FLAG_NAME = 1 << 3,
+    GZIP_FLAG_COMMENT = 1 << 4,
+};
+
+// Reads the decompressed content of a gzip file. Concatenated members
+// read back as one stream, as gunzip does.
+struct GzipReader : public IO::Reader
+{
+private:
+    static constexpr size_t BUFFER_SIZE = 16384;
+
+    enum State
+    {
+        STATE_HEADER,
+        STATE_BODY,
+        STATE_END,
+    };
+
+    IO::BufReader _input;
+    IO::BitReader _bits;
+    Inflate _inflate;
+
+    State _state = STATE_HEADER;
+    CRC _crc;
+    uint32_t _member_size = 0;
+
+    JResult read_header();
+    JResult read_trailer();
+
+    NONCOPYABLE(GzipReader);
+    NONMOVABLE(GzipReader);
+
+public:
+    GzipReader(IO::Reader &reader);
+
+    ResultOr<size_t> read(void *buffer, size_t size) override;
+};
+
+// Compresses everything written to it into a gzip member. finish() ends
+// the member, writing more afterward starts a new one. A writer that never
+// got any data still finishes with an empty member.
+struct GzipWriter : public IO::Writer
+{
+private:
+    IO::BitWriter _bits;
+    Deflate _deflate;
+
+    bool _in_member = false;
+    bool _finished_member = false;
+    CRC _crc;
+    uint32_t _member_size = 0;
+
+    void write_header();
+
+    NONCOPYABLE(GzipWriter);
+    NONMOVABLE(GzipWriter);
+
+public:
+    GzipWriter(IO::Writer &writer, unsigned int compression_level = 6);
+
+    ~GzipWriter();
+
+    ResultOr<size_t> write(const void *buffer, size_t size) override;
+
+    JResult finish();
+
+    JResult flush() override;
+};
+
+// Compresses all of uncompressed into one gzip member on several threads,
+// see ParallelDeflate. A thread count of 0 uses one per processor.
+JResult gzip_parallel(IO::Reader &uncompressed, IO::Writer &compressed, unsigned int compression_level = 6, size_t thread_count = 0);
+
+}
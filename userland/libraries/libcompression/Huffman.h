@@ -7,44 +7,369 @@
 #pragma once
 
 // includes
+#include <libabi/Result.h>
 #include <libio/BitReader.h>
+#include <libutils/ResultOr.h>
+#include <libutils/Vector.h>
 
 namespace Compression
 {
 
+// Huffman codes are defined MSB first, but deflate packs everything else LSB first.
+static inline unsigned int reverse_bits(unsigned int code, unsigned int length)
+{
+    unsigned int result = 0;
+
+    for (unsigned int i = 0; i < length; i++)
+    {
+        result = (result << 1) | (code & 1);
+        code >>= 1;
+    }
+
+    return result;
+}
+
 struct HuffmanDecoder
 {
+public:
+    // Number of bits used to index the primary table, codes longer than this
+    // are resolved through a secondary table linked from the primary entry.
+    static constexpr unsigned int PRIMARY_BITS = 9;
+    static constexpr unsigned int PRIMARY_SIZE = 1 << PRIMARY_BITS;
+    static constexpr unsigned int MAX_CODE_BITS = 15;
+    static constexpr size_t MAX_SYMBOLS = 288;
+
 private:
-    const Vector<unsigned int> &_alphabet;
-    const Vector<unsigned int> &_code_bit_lengths;
+    enum EntryKind : uint8_t
+    {
+        ENTRY_INVALID,
+        ENTRY_SYMBOL,
+        ENTRY_LINK,
+    };
 
-public:
-    inline HuffmanDecoder(Vector<unsigned int> &alphabet, Vector<unsigned int> &code_bit_lengths) : _alphabet(alphabet), _code_bit_lengths(code_bit_lengths)
+    struct Entry
     {
-    }
+        // The symbol for ENTRY_SYMBOL, the offset of the secondary table for ENTRY_LINK.
+        uint16_t value;
+
+        // The length of the code for ENTRY_SYMBOL, the index width of the secondary table for ENTRY_LINK.
+        uint8_t bits;
+
+        EntryKind kind;
+    };
+
+    Vector<Entry> _table;
+
+public:
+    HuffmanDecoder() {}
 
-    unsigned int decode(IO::BitReader &input)
+    // Build the lookup tables from the code bit lengths, indexed by symbol.
+    // Works on the stack only, the table itself keeps its storage between
+    // builds. Returns false if the lengths don't describe a valid code.
+    bool build(const uint8_t *code_bit_lengths, size_t count)
     {
-        for (unsigned int i = 0; i < (unsigned int)_code_bit_lengths.count(); i++)
+        Assert::lower_equal(count, MAX_SYMBOLS);
+
+        // Canonical codes (RFC 1951, 3.2.2).
+        uint16_t length_count[MAX_CODE_BITS + 1] = {};
+
+        for (size_t i = 0; i < count; i++)
         {
-            const auto cbl = _code_bit_lengths[i];
-            if (cbl == 0)
+            length_count[code_bit_lengths[i]]++;
+        }
+
+        length_count[0] = 0;
+
+        uint16_t next_code[MAX_CODE_BITS + 1] = {};
+        int available = 1;
+
+        for (unsigned int bits = 1; bits <= MAX_CODE_BITS; bits++)
+        {
+            available = (available << 1) - length_count[bits];
+
+            // More codes of this length than the shorter ones left room for.
+            if (available < 0)
+            {
+                return false;
+            }
+
+            next_code[bits] = (next_code[bits - 1] + length_count[bits - 1]) << 1;
+        }
+
+        uint16_t alphabet[MAX_SYMBOLS];
+
+        for (size_t i = 0; i < count; i++)
+        {
+            alphabet[i] = code_bit_lengths[i] ? next_code[code_bit_lengths[i]]++ : 0;
+        }
+
+        _table.clear();
+        _table.resize(PRIMARY_SIZE);
+
+        for (unsigned int i = 0; i < PRIMARY_SIZE; i++)
+        {
+            _table[i] = {0, 0, ENTRY_INVALID};
+        }
+
+        // First pass: find how wide each secondary table needs to be.
+        uint8_t secondary_bits[PRIMARY_SIZE] = {};
+
+        for (size_t i = 0; i < count; i++)
+        {
+            unsigned int length = code_bit_lengths[i];
+
+            if (length <= PRIMARY_BITS)
+            {
+                continue;
+            }
+
+            unsigned int prefix = reverse_bits(alphabet[i], length) & (PRIMARY_SIZE - 1);
+            secondary_bits[prefix] = MAX(secondary_bits[prefix], length - PRIMARY_BITS);
+        }
+
+        for (unsigned int prefix = 0; prefix < PRIMARY_SIZE; prefix++)
+        {
+            if (secondary_bits[prefix] == 0)
+            {
+                continue;
+            }
+
+            size_t offset = _table.count();
+            size_t size = 1 << secondary_bits[prefix];
+
+            _table[prefix] = {(uint16_t)offset, secondary_bits[prefix], ENTRY_LINK};
+            _table.resize(offset + size);
+
+            for (size_t j = offset; j < offset + size; j++)
+            {
+                _table[j] = {0, 0, ENTRY_INVALID};
+            }
+        }
+
+        // Second pass: replicate every code over all the slots it is a prefix of.
+        for (size_t i = 0; i < count; i++)
+        {
+            unsigned int length = code_bit_lengths[i];
+
+            if (length == 0)
             {
                 continue;
             }
 
-            unsigned int code = input.peek_bits_reverse(cbl);
+            Assert::lower_equal(length, MAX_CODE_BITS);
+
+            unsigned int reversed = reverse_bits(alphabet[i], length);
+            Entry entry = {(uint16_t)i, (uint8_t)length, ENTRY_SYMBOL};
 
-            if (_alphabet[i] == code)
+            if (length <= PRIMARY_BITS)
             {
-                input.grab_bits(cbl);
-                return i;
+                for (unsigned int slot = reversed; slot < PRIMARY_SIZE; slot += 1 << length)
+                {
+                    _table[slot] = entry;
+                }
+            }
+            else
+            {
+                auto &link = _table[reversed & (PRIMARY_SIZE - 1)];
+                unsigned int secondary_length = length - PRIMARY_BITS;
+
+                for (unsigned int slot = reversed >> PRIMARY_BITS; slot < (1u << link.bits); slot += 1 << secondary_length)
+                {
+                    _table[link.value + slot] = entry;
+                }
             }
         }
 
-        return 0;
+        return true;
+    }
+
+    ALWAYS_INLINE ResultOr<unsigned int> decode(IO::BitReader &input)
+    {
+        Entry entry = _table[input.peek_bits(PRIMARY_BITS)];
+
+        if (entry.kind == ENTRY_LINK)
+        {
+            unsigned int slot = input.peek_bits(PRIMARY_BITS + entry.bits) >> PRIMARY_BITS;
+            entry = _table[entry.value + slot];
+        }
+
+        if (entry.kind != ENTRY_SYMBOL)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        input.grab_bits(entry.bits);
+        return (unsigned int)entry.value;
     }
 };
 
+struct HuffmanEncoder
+{
+public:
+    static constexpr size_t MAX_SYMBOLS = 288;
+    static constexpr unsigned int MAX_CODE_BITS = 15;
+
+private:
+    // Build a huffman tree with the two-queue method and read the code
+    // lengths off it, fails if a code ends up longer than max_bits.
+    static bool try_build_lengths(const uint32_t *frequencies, size_t count, unsigned int max_bits, uint8_t *lengths)
+    {
+        uint16_t leaves[MAX_SYMBOLS];
+        size_t leaf_count = 0;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            lengths[i] = 0;
+
+            if (frequencies[i] != 0)
+            {
+                leaves[leaf_count] = i;
+                leaf_count++;
+            }
+        }
+
+        if (leaf_count == 0)
+        {
+            return true;
+        }
+
+        if (leaf_count == 1)
+        {
+            lengths[leaves[0]] = 1;
+            return true;
+        }
+
+        for (size_t i = 1; i < leaf_count; i++)
+        {
+            uint16_t leaf = leaves[i];
+            size_t j = i;
+
+            while (j > 0 && frequencies[leaves[j - 1]] > frequencies[leaf])
+            {
+                leaves[j] = leaves[j - 1];
+                j--;
+            }
+
+            leaves[j] = leaf;
+        }
+
+        uint32_t node_frequencies[MAX_SYMBOLS * 2];
+        uint16_t parents[MAX_SYMBOLS * 2];
+        uint8_t depths[MAX_SYMBOLS * 2];
+
+        for (size_t i = 0; i < leaf_count; i++)
+        {
+            node_frequencies[i] = frequencies[leaves[i]];
+        }
+
+        // Leaves come out of the first queue and internal nodes, which are
+        // created in non-decreasing order, out of the second one.
+        size_t next_leaf = 0;
+        size_t next_node = leaf_count;
+        size_t node_count = leaf_count;
+
+        auto take_smallest = [&]() {
+            if (next_leaf < leaf_count &&
+                (next_node >= node_count || node_frequencies[next_leaf] <= node_frequencies[next_node]))
+            {
+                return next_leaf++;
+            }
+
+            return next_node++;
+        };
+
+        for (size_t i = 0; i + 1 < leaf_count; i++)
+        {
+            size_t a = take_smallest();
+            size_t b = take_smallest();
+
+            node_frequencies[node_count] = node_frequencies[a] + node_frequencies[b];
+            parents[a] = node_count;
+            parents[b] = node_count;
+            node_count++;
+        }
+
+        // Parents are always created after their children.
+        depths[node_count - 1] = 0;
+
+        for (size_t i = node_count - 1; i > 0; i--)
+        {
+            depths[i - 1] = depths[parents[i - 1]] + 1;
+        }
+
+        for (size_t i = 0; i < leaf_count; i++)
+        {
+            if (depths[i] > max_bits)
+            {
+                return false;
+            }
+
+            lengths[leaves[i]] = depths[i];
+        }
+
+        return true;
+    }
+
+public:
+    // Compute code lengths no longer than max_bits. When the optimal tree is
+    // too deep the frequencies are flattened and the tree is rebuilt, which
+    // is rare and only costs a little compression.
+    static void build_lengths(const uint32_t *frequencies, size_t count, unsigned int max_bits, uint8_t *lengths)
+    {
+        Assert::lower_equal(count, MAX_SYMBOLS);
+
+        uint32_t scaled[MAX_SYMBOLS];
+
+        for (size_t i = 0; i < count; i++)
+        {
+            scaled[i] = frequencies[i];
+        }
+
+        while (!try_build_lengths(scaled, count, max_bits, lengths))
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                if (scaled[i] != 0)
+                {
+                    scaled[i] = (scaled[i] >> 1) | 1;
+                }
+            }
+        }
+    }
+
+    // Assign canonical codes (RFC 1951, 3.2.2), already bit reversed so they
+    // can be handed straight to an IO::BitWriter.
+    static void build_codes(const uint8_t *lengths, size_t count, uint16_t *codes)
+    {
+        uint16_t bit_length_count[MAX_CODE_BITS + 1] = {};
+        uint16_t next_code[MAX_CODE_BITS + 1] = {};
+
+        for (size_t i = 0; i < count; i++)
+        {
+            bit_length_count[lengths[i]]++;
+        }
+
+        bit_length_count[0] = 0;
+
+        uint16_t code = 0;
+        for (size_t bits = 1; bits <= MAX_CODE_BITS; bits++)
+        {
+            code = (code + bit_length_count[bits - 1]) << 1;
+            next_code[bits] = code;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            if (lengths[i] != 0)
+            {
+                codes[i] = reverse_bits(next_code[lengths[i]]++, lengths[i]);
+            }
+            else
+            {
+                codes[i] = 0;
+            }
+        }
+    }
+};
 
-}
\ No newline at end of file
+}
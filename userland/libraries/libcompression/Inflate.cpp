@@ -5,9 +5,11 @@
 */
 
 // includes
+#include <string.h>
 #include <libcompression/Common.h>
 #include <libcompression/Huffman.h>
 #include <libcompression/Inflate.h>
+#include <libcompression/InflateMetrics.h>
 #include <libio/BitReader.h>
 #include <libio/BufReader.h>
 #include <libio/Copy.h>
@@ -19,157 +21,34 @@
 namespace Compression
 {
 
-static constexpr uint8_t BASE_LENGTH_EXTRA_BITS[] = {
-    0, 0, 0, 0, 0, 0, 0, 0, 
-    1, 1, 1, 1,             
-    2, 2, 2, 2,             
-    3, 3, 3, 3,             
-    4, 4, 4, 4,             
-    5, 5, 5, 5,            
-    0                      
-};
-
-static constexpr uint16_t BASE_LENGTHS[] = {
-    3, 4, 5, 6, 7, 8, 9, 10, 
-    11, 13, 15, 17,          
-    19, 23, 27, 31,          
-    35, 43, 51, 59,          
-    67, 83, 99, 115,         
-    131, 163, 195, 227,      
-    258                      
-};
-
-static constexpr uint16_t BASE_DISTANCE[] = {
-    1, 2, 3, 4,    
-    5, 7,         
-    9, 13,         
-    17, 25,        
-    33, 49,        
-    65, 97,        
-    129, 193,      
-    257, 385,     
-    513, 769,      
-    1025, 1537,    
-    2049, 3073,    
-    4097, 6145,    
-    8193, 12289,   
-    16385, 24577,  
-};
-
-static constexpr uint8_t BASE_DISTANCE_EXTRA_BITS[] = {
-    0, 0, 0, 0,  
-    1, 1,        
-    2, 2,        
-    3, 3,       
-    4, 4,       
-    5, 5,      
-    6, 6,      
-    7, 7,        
-    8, 8,      
-    9, 9,        
-    10, 10,      
-    11, 11,      
-    12, 12,     
-    13, 13,      
-};
-
-void Inflate::get_bit_length_count(HashMap<unsigned int, unsigned int> &bit_length_count, const Vector<unsigned int> &code_bit_lengths)
-{
-    for (unsigned int i = 0; i != code_bit_lengths.count(); i++)
-    {
-        bit_length_count[code_bit_lengths[i]] = 0;
-    }
-
-    for (unsigned int i = 0; i != code_bit_lengths.count(); i++)
-    {
-        bit_length_count[code_bit_lengths[i]]++;
-    }
-}
-
-void Inflate::get_first_code(HashMap<unsigned int, unsigned int> &first_codes, HashMap<unsigned int, unsigned int> &bit_length_count)
-{
-    unsigned int code = 0;
-    unsigned int prev_bl_count = 0;
-    for (unsigned int i = 1; i <= (unsigned int)bit_length_count.count(); i++)
-    {
-        if (i >= 2)
-        {
-            prev_bl_count = bit_length_count[i - 1];
-        }
-        code = (code + prev_bl_count) << 1;
-        first_codes[i] = code;
-    }
-}
-
-void Inflate::assign_huffman_codes(Vector<unsigned int> &assigned_codes, const Vector<unsigned int> &code_bit_lengths, HashMap<unsigned int, unsigned int> &first_codes)
-{
-    assigned_codes.resize(code_bit_lengths.count());
-
-    for (unsigned int i = 0; i < (unsigned int)code_bit_lengths.count(); i++)
-    {
-        if (code_bit_lengths[i])
-        {
-            assigned_codes[i] = first_codes[code_bit_lengths[i]]++;
-        }
-        else
-        {
-            assigned_codes[i] = 0;
-        }
-    }
-}
-
-void Inflate::build_huffman_alphabet(Vector<unsigned int> &alphabet, const Vector<unsigned int> &code_bit_lengths)
-{
-    HashMap<unsigned int, unsigned int> bit_length_count, first_codes;
-
-    get_bit_length_count(bit_length_count, code_bit_lengths);
-    get_first_code(first_codes, bit_length_count);
-    assign_huffman_codes(alphabet, code_bit_lengths, first_codes);
-}
-
 void Inflate::build_fixed_huffman_alphabet()
 {
-    if (_fixed_code_bit_lengths.count())
+    if (_fixed_built)
     {
         return;
     }
 
-    _fixed_code_bit_lengths.resize(288);
-    _fixed_dist_code_bit_lengths.resize(32);
+    uint8_t fixed_code_bit_lengths[HuffmanDecoder::MAX_SYMBOLS];
+    uint8_t fixed_dist_code_bit_lengths[32];
 
-    for (int i = 0; i <= 287; i++)
+    for (unsigned int i = 0; i < 288; i++)
     {
-        if (i >= 0 && i <= 143)
-        {
-            _fixed_code_bit_lengths[i] = 8;
-        }
-        else if (i >= 144 && i <= 255)
-        {
-            _fixed_code_bit_lengths[i] = 9;
-        }
-        else if (i >= 256 && i <= 279)
-        {
-            _fixed_code_bit_lengths[i] = 7;
-        }
-        else if (i >= 280 && i <= 287)
-        {
-            _fixed_code_bit_lengths[i] = 8;
-        }
+        fixed_code_bit_lengths[i] = fixed_literal_length_code_length(i);
     }
 
-    for (int i = 0; i != 32; i++)
+    for (unsigned int i = 0; i < 32; i++)
     {
-        _fixed_dist_code_bit_lengths[i] = 5;
+        fixed_dist_code_bit_lengths[i] = FIXED_DISTANCE_CODE_LENGTH;
     }
 
-    build_huffman_alphabet(_fixed_alphabet, _fixed_code_bit_lengths);
-    build_huffman_alphabet(_fixed_dist_alphabet, _fixed_dist_code_bit_lengths);
+    _fixed_decoder.build(fixed_code_bit_lengths, 288);
+    _fixed_dist_decoder.build(fixed_dist_code_bit_lengths, 32);
+    _fixed_built = true;
 }
 
 HjResult Inflate::build_dynamic_huffman_alphabet(IO::BitReader &input)
 {
-    Vector<unsigned int> code_length_of_code_length_order = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
-    Vector<unsigned int> code_length_of_code_length = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    uint8_t code_length_of_code_length[NUM_CODE_LENGTH_CODES] = {};
 
     unsigned int hlit = input.grab_bits(5) + 257;
     unsigned int hdist = input.grab_bits(5) + 1;
@@ -182,21 +61,27 @@ HjResult Inflate::build_dynamic_huffman_alphabet(IO::BitReader &input)
 
     for (unsigned int i = 0; i < hclen; i++)
     {
-        code_length_of_code_length[code_length_of_code_length_order[i]] = input.grab_bits(3);
+        code_length_of_code_length[CODE_LENGTH_ORDER[i]] = input.grab_bits(3);
     }
 
-    Vector<unsigned int> lit_len_and_dist_alphabets;
-    build_huffman_alphabet(lit_len_and_dist_alphabets, code_length_of_code_length);
+    if (!_code_length_decoder.build(code_length_of_code_length, NUM_CODE_LENGTH_CODES))
+    {
+        IO::logln("Invalid code length code");
+        return ERR_INVALID_DATA;
+    }
 
-    Vector<unsigned int> lit_len_and_dist_trees_unpacked;
-    HuffmanDecoder huffman(lit_len_and_dist_alphabets, code_length_of_code_length);
-    while (lit_len_and_dist_trees_unpacked.count() < (hdist + hlit))
+    // Literal/length and distance code lengths are one sequence, repeats
+    // can cross from one to the other.
+    uint8_t code_bit_lengths[NUM_LITERAL_LENGTH_CODES + NUM_DISTANCE_CODES];
+    unsigned int count = 0;
+
+    while (count < hlit + hdist)
     {
-        unsigned int decoded_value = huffman.decode(input);
+        unsigned int decoded_value = TRY(_code_length_decoder.decode(input));
 
         if (decoded_value < 16)
         {
-            lit_len_and_dist_trees_unpacked.push_back(decoded_value);
+            code_bit_lengths[count++] = decoded_value;
             continue;
         }
 
@@ -206,8 +91,13 @@ HjResult Inflate::build_dynamic_huffman_alphabet(IO::BitReader &input)
         switch (decoded_value)
         {
         case 16:
+            if (count == 0)
+            {
+                return ERR_INVALID_DATA;
+            }
+
             repeat_count = input.grab_bits(2) + 3;
-            code_length_to_repeat = lit_len_and_dist_trees_unpacked.peek_back();
+            code_length_to_repeat = code_bit_lengths[count - 1];
             break;
         case 17:
             repeat_count = input.grab_bits(3) + 3;
@@ -217,118 +107,337 @@ HjResult Inflate::build_dynamic_huffman_alphabet(IO::BitReader &input)
             break;
         }
 
+        if (count + repeat_count > hlit + hdist || input.overrun())
+        {
+            return ERR_INVALID_DATA;
+        }
+
         for (unsigned int i = 0; i != repeat_count; i++)
         {
-            lit_len_and_dist_trees_unpacked.push_back(code_length_to_repeat);
+            code_bit_lengths[count++] = code_length_to_repeat;
         }
     }
 
-    _lit_len_code_bit_length.resize(hlit);
-    for (unsigned int i = 0; i < _lit_len_code_bit_length.count(); i++)
+    if (!_lit_len_decoder.build(code_bit_lengths, hlit) ||
+        !_dist_decoder.build(code_bit_lengths + hlit, hdist))
     {
-        _lit_len_code_bit_length[i] = lit_len_and_dist_trees_unpacked[i];
+        IO::logln("Invalid literal/length or distance code");
+        return ERR_INVALID_DATA;
     }
 
-    _dist_code_bit_length.resize(lit_len_and_dist_trees_unpacked.count() - hlit);
-    for (unsigned int i = 0; i < _dist_code_bit_length.count(); i++)
+    return HjResult::SUCCESS;
+}
+
+void Inflate::reset()
+{
+    _state = STATE_BLOCK_HEADER;
+    _final_block = false;
+    _stored_remaining = 0;
+    _total_out = 0;
+    _copy_length = 0;
+    _copy_distance = 0;
+
+    _window.resize(WINDOW_SIZE);
+}
+
+size_t Inflate::copy_window(uint8_t *out) const
+{
+    size_t size = MIN(_total_out, (size64_t)WINDOW_SIZE);
+    size_t start = (_total_out - size) & WINDOW_MASK;
+    size_t first = MIN(size, WINDOW_SIZE - start);
+
+    memcpy(out, _window.raw_storage() + start, first);
+    memcpy(out + first, _window.raw_storage(), size - first);
+
+    return size;
+}
+
+void Inflate::resume(const uint8_t *window, size_t size, size64_t total_out)
+{
+    reset();
+
+    // The window is a ring indexed by the output position, so the bytes go
+    // where they were when the output was that long.
+    _total_out = total_out - size;
+    update_window(window, size);
+}
+
+JResult Inflate::read_block_header(IO::BitReader &bits)
+{
+    _final_block = bits.grab_bits(1);
+    uint8_t btype = bits.grab_bits(2);
+
+    if (bits.overrun())
     {
-        _dist_code_bit_length[i] = lit_len_and_dist_trees_unpacked[hlit + i];
+        IO::logln("Unexpected end of compressed data");
+        return ERR_INVALID_DATA;
     }
 
-    build_huffman_alphabet(_lit_len_alphabet, _lit_len_code_bit_length);
-    build_huffman_alphabet(_dist_alphabet, _dist_code_bit_length);
-    return HjResult::SUCCESS;
+    if (btype == BT_UNCOMPRESSED)
+    {
+        bits.align();
+
+        uint16_t len = bits.grab_bits(16);
+        uint16_t nlen = bits.grab_bits(16);
+
+        if (bits.overrun())
+        {
+            IO::logln("Unexpected end of compressed data");
+            return ERR_INVALID_DATA;
+        }
+
+        if ((uint16_t)~nlen != len)
+        {
+            IO::logln("Invalid uncompressed block length: {} {}", len, nlen);
+            return ERR_INVALID_DATA;
+        }
+
+        _stored_remaining = len;
+        _state = STATE_STORED;
+
+        if (len == 0)
+        {
+            end_block();
+        }
+    }
+    else if (btype == BT_FIXED_HUFFMAN)
+    {
+        build_fixed_huffman_alphabet();
+
+        _symbol_decoder = &_fixed_decoder;
+        _distance_decoder = &_fixed_dist_decoder;
+        _state = STATE_HUFFMAN;
+    }
+    else if (btype == BT_DYNAMIC_HUFFMAN)
+    {
+        TRY(build_dynamic_huffman_alphabet(bits));
+
+        _symbol_decoder = &_lit_len_decoder;
+        _distance_decoder = &_dist_decoder;
+        _state = STATE_HUFFMAN;
+    }
+    else
+    {
+        IO::logln("Invalid block type: {}", btype);
+        return ERR_INVALID_DATA;
+    }
+
+    return SUCCESS;
 }
 
-FLATTEN HjResult Inflate::read_blocks(IO::Reader &reader, IO::Writer &uncompressed)
+// Copies a back reference to buffer + done. The part of it that lies
+// before this read() comes from the window, the rest from the buffer.
+ALWAYS_INLINE void Inflate::copy_match(uint8_t *buffer, size_t done, size_t length, size_t distance)
 {
-    IO::MemoryWriter dest_writer{32768};
+    uint8_t *out = buffer + done;
 
-    uint8_t bfinal;
-    IO::BitReader bits{reader};
-    do
+    if (distance > done)
     {
-        bfinal = bits.grab_bits(1);
-        uint8_t btype = bits.grab_bits(2);
+        size_t from_window = MIN(length, distance - done);
+        size_t start = (_total_out + done - distance) & WINDOW_MASK;
+        size_t first = MIN(from_window, WINDOW_SIZE - start);
+
+        memcpy(out, _window.raw_storage() + start, first);
+        memcpy(out + first, _window.raw_storage(), from_window - first);
+
+        out += from_window;
+        length -= from_window;
+    }
 
-        if (btype == BT_UNCOMPRESSED)
+    const uint8_t *source = out - distance;
+
+    if (distance >= 16)
+    {
+        // Chunks never overlap their own source.
+        while (length >= 16)
         {
-            bits.skip_bits(5);
+            memcpy(out, source, 16);
+            out += 16;
+            source += 16;
+            length -= 16;
+        }
 
-            uint16_t len = TRY(IO::read<uint16_t>(reader));
+        memcpy(out, source, length);
+    }
+    else if (distance == 1)
+    {
+        memset(out, *source, length);
+    }
+    else
+    {
+        // Short periods: every copy doubles the length of the pattern
+        // that is already there.
+        while (length > 0)
+        {
+            size_t chunk = MIN(length, (size_t)(out - source));
+            memcpy(out, source, chunk);
+            out += chunk;
+            length -= chunk;
+        }
+    }
+}
 
-            TRY(IO::skip(reader, 2));
+void Inflate::update_window(const uint8_t *buffer, size_t size)
+{
+    if (size >= WINDOW_SIZE)
+    {
+        buffer += size - WINDOW_SIZE;
+        _total_out += size - WINDOW_SIZE;
+        size = WINDOW_SIZE;
+    }
+
+    size_t start = _total_out & WINDOW_MASK;
+    size_t first = MIN(size, WINDOW_SIZE - start);
+
+    memcpy(_window.raw_storage() + start, buffer, first);
+    memcpy(_window.raw_storage(), buffer + first, size - first);
+
+    _total_out += size;
+}
+
+ResultOr<size_t> Inflate::read_huffman(IO::BitReader &bits, uint8_t *buffer, size_t done, size_t size)
+{
+    while (done < size)
+    {
+        if (_copy_length > 0)
+        {
+            size_t length = MIN(_copy_length, size - done);
 
-            TRY(IO::copy(reader, dest_writer, len));
+            copy_match(buffer, done, length, _copy_distance);
+
+            _copy_length -= length;
+            done += length;
+            continue;
+        }
+
+        unsigned int decoded_symbol = TRY(_symbol_decoder->decode(bits));
+
+        if (bits.overrun())
+        {
+            IO::logln("Unexpected end of compressed data");
+            return ERR_INVALID_DATA;
+        }
+
+        if (decoded_symbol <= 255)
+        {
+            buffer[done] = decoded_symbol;
+            done++;
         }
-        else if (btype == BT_FIXED_HUFFMAN || btype == BT_DYNAMIC_HUFFMAN)
+        else if (decoded_symbol >= 257 && decoded_symbol <= 285)
         {
-            if (btype == BT_FIXED_HUFFMAN)
+            unsigned int length_index = decoded_symbol - 257;
+            unsigned int total_length = BASE_LENGTHS[length_index] + bits.grab_bits(BASE_LENGTH_EXTRA_BITS[length_index]);
+            unsigned int dist_code = TRY(_distance_decoder->decode(bits));
+
+            if (dist_code >= NUM_DISTANCE_CODES)
             {
-                build_fixed_huffman_alphabet();
-            }         
-            else
+                IO::logln("Invalid distance code: {}", dist_code);
+                return ERR_INVALID_DATA;
+            }
+
+            unsigned int total_dist = BASE_DISTANCE[dist_code] + bits.grab_bits(BASE_DISTANCE_EXTRA_BITS[dist_code]);
+
+            if (total_dist > _total_out + done || total_dist > WINDOW_SIZE)
             {
-                TRY(build_dynamic_huffman_alphabet(bits));
+                IO::logln("Back reference before the start of the output: {}", total_dist);
+                return ERR_INVALID_DATA;
             }
 
-            HuffmanDecoder symbol_decoder(btype == BT_FIXED_HUFFMAN ? _fixed_alphabet : _lit_len_alphabet,
-                                          btype == BT_FIXED_HUFFMAN ? _fixed_code_bit_lengths : _lit_len_code_bit_length);
+            _copy_length = total_length;
+            _copy_distance = total_dist;
+        }
+        else if (decoded_symbol == 256)
+        {
+            end_block();
+            break;
+        }
+        else
+        {
+            IO::logln("Invalid decoded symbol: {}", decoded_symbol);
+            return ERR_INVALID_DATA;
+        }
+    }
+
+    return done;
+}
 
-            HuffmanDecoder dist_decoder(btype == BT_FIXED_HUFFMAN ? _fixed_dist_alphabet : _dist_alphabet,
-                                        btype == BT_FIXED_HUFFMAN ? _fixed_dist_code_bit_lengths : _dist_code_bit_length);
+ResultOr<size_t> Inflate::read(IO::BitReader &bits, void *buffer, size_t size, bool stop_at_block_end)
+{
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(buffer);
+    size_t done = 0;
 
-            while (true)
+    while (done < size && _state != STATE_DONE)
+    {
+        if (_state == STATE_BLOCK_HEADER)
+        {
+            if (stop_at_block_end && done > 0)
             {
-                unsigned int decoded_symbol = symbol_decoder.decode(bits);
-                if (decoded_symbol <= 255)
-                {
-                    IO::write(dest_writer, decoded_symbol);
-                }
-                else if (decoded_symbol >= 257 && decoded_symbol <= 285)
-                {
-                    unsigned int length_index = decoded_symbol - 257;
-                    unsigned int total_length = BASE_LENGTHS[length_index] + bits.grab_bits(BASE_LENGTH_EXTRA_BITS[length_index]);
-                    unsigned int dist_code = dist_decoder.decode(bits);
-
-                    Assert::lower_than(dist_code, 30);
-
-                    unsigned int total_dist = BASE_DISTANCE[dist_code] + bits.grab_bits(BASE_DISTANCE_EXTRA_BITS[dist_code]);
-
-                    for (unsigned int i = 0; i != total_length; i++)
-                    {
-                        size_t offset = TRY(dest_writer.length()) - total_dist;
-                        uint8_t val = dest_writer.buffer()[offset];
-                        IO::write(dest_writer, val);
-                    }
-                }
-                else if (decoded_symbol == 256)
-                {
-                    break;
-                }
-                else
-                {
-                    IO::logln("Invalid decoded symbol: {}", decoded_symbol);
-                    return ERR_INVALID_DATA;
-                }
+                break;
+            }
+
+            TRY(read_block_header(bits));
+        }
+        else if (_state == STATE_STORED)
+        {
+            size_t read = TRY(bits.read(bytes + done, MIN(_stored_remaining, size - done)));
+
+            if (read == 0)
+            {
+                IO::logln("Unexpected end of compressed data");
+                return ERR_INVALID_DATA;
+            }
+
+            _stored_remaining -= read;
+            done += read;
+
+            if (_stored_remaining == 0)
+            {
+                end_block();
             }
         }
         else
         {
-            IO::logln("Invalid block type: {}", btype);
-            return ERR_INVALID_DATA;
+            done = TRY(read_huffman(bits, bytes, done, size));
         }
-    } while (!bfinal);
+    }
+
+    update_window(bytes, done);
 
-    auto final_reader = IO::MemoryReader(Slice(dest_writer.slice()));
-    return IO::copy(final_reader, uncompressed);
+    return done;
 }
 
-FLATTEN ResultOr<size_t> Inflate::perform(IO::Reader &compressed, IO::Writer &uncompressed)
+HjResult Inflate::read_blocks(IO::BitReader &bits, IO::Writer &uncompressed)
 {
+    uint8_t buffer[16384];
+
+    reset();
+
+    while (!ended())
+    {
+        size_t read = TRY(this->read(bits, buffer, sizeof(buffer)));
+        TRY(IO::write_all(uncompressed, Slice{buffer, read}));
+    }
+
+    return HjResult::SUCCESS;
+}
+
+ResultOr<size_t> Inflate::perform(IO::Reader &compressed, IO::Writer &uncompressed)
+{
+    uint64_t start_ns = inflate_clock_ns();
     IO::ReadCounter counter{compressed};
-    TRY(read_blocks(counter, uncompressed));
+    IO::BitReader bits{counter};
+    TRY(read_blocks(bits, uncompressed));
+    inflate_did_perform(start_ns, counter.count());
     return counter.count();
 }
 
+ResultOr<size_t> Inflate::perform(Slice compressed, IO::Writer &uncompressed)
+{
+    uint64_t start_ns = inflate_clock_ns();
+    IO::BitReader bits{compressed};
+    TRY(read_blocks(bits, uncompressed));
+    inflate_did_perform(start_ns, bits.consumed());
+    return bits.consumed();
+}
+
 } 
\ No newline at end of file
@@ -8,12 +8,12 @@
 
 // includes
 #include <libabi/Result.h>
+#include <libcompression/Huffman.h>
 #include <libio/BitReader.h>
 #include <libio/Read.h>
 #include <libio/ReadCounter.h>
 #include <libio/Writer.h>
 #include <libutils/Assert.h>
-#include <libutils/HashMap.h>
 #include <libutils/Prelude.h>
 #include <libutils/Vector.h>
 
@@ -22,31 +22,85 @@ namespace Compression
 
 struct Inflate
 {
+public:
+    static constexpr size_t WINDOW_SIZE = 32768;
+    static constexpr size_t WINDOW_MASK = WINDOW_SIZE - 1;
+
 private:
     // Fixed huffmann
-    Vector<unsigned int> _fixed_alphabet;
-    Vector<unsigned int> _fixed_code_bit_lengths;
-    Vector<unsigned int> _fixed_dist_alphabet;
-    Vector<unsigned int> _fixed_dist_code_bit_lengths;
+    bool _fixed_built = false;
+    HuffmanDecoder _fixed_decoder;
+    HuffmanDecoder _fixed_dist_decoder;
 
-    // Dynamic huffmann
-    Vector<unsigned int> _lit_len_alphabet;
-    Vector<unsigned int> _lit_len_code_bit_length;
-    Vector<unsigned int> _dist_code_bit_length;
-    Vector<unsigned int> _dist_alphabet;
+    // Dynamic huffmann, the decoders keep their table storage from one
+    // block to the next.
+    HuffmanDecoder _code_length_decoder;
+    HuffmanDecoder _lit_len_decoder;
+    HuffmanDecoder _dist_decoder;
 
     void build_fixed_huffman_alphabet();
     JResult build_dynamic_huffman_alphabet(IO::BitReader &input);
-    void build_huffman_alphabet(Vector<unsigned int> &alphabet, const Vector<unsigned int> &code_bit_lengths);
 
-    void get_bit_length_count(HashMap<unsigned int, unsigned int> &bit_length_count, const Vector<unsigned int> &code_bit_lengths);
-    void get_first_code(HashMap<unsigned int, unsigned int> &firstCodes, HashMap<unsigned int, unsigned int> &bit_length_count);
-    void assign_huffman_codes(Vector<unsigned int> &assigned_codes, const Vector<unsigned int> &code_bit_lengths, HashMap<unsigned int, unsigned int> &first_codes);
+    enum State
+    {
+        STATE_BLOCK_HEADER,
+        STATE_STORED,
+        STATE_HUFFMAN,
+        STATE_DONE,
+    };
+
+    State _state = STATE_BLOCK_HEADER;
+    bool _final_block = false;
+    size_t _stored_remaining = 0;
+    HuffmanDecoder *_symbol_decoder = nullptr;
+    HuffmanDecoder *_distance_decoder = nullptr;
+
+    // The last WINDOW_SIZE bytes of output, back references point in there.
+    // Output is decoded straight into the caller's buffer and appended to
+    // the window once per read(). A match that didn't fit in the caller's
+    // buffer is resumed on the next read().
+    Vector<uint8_t> _window;
+    size64_t _total_out = 0;
+    unsigned int _copy_length = 0;
+    unsigned int _copy_distance = 0;
 
-    JResult read_blocks(IO::Reader &reader, IO::Writer &uncompressed);
+    JResult read_block_header(IO::BitReader &bits);
+    ResultOr<size_t> read_huffman(IO::BitReader &bits, uint8_t *buffer, size_t done, size_t size);
+    void copy_match(uint8_t *buffer, size_t done, size_t length, size_t distance);
+    void update_window(const uint8_t *buffer, size_t size);
+    void end_block() { _state = _final_block ? STATE_DONE : STATE_BLOCK_HEADER; }
+
+    JResult read_blocks(IO::BitReader &bits, IO::Writer &uncompressed);
 
 public:
+    // Starts over with a new deflate stream.
+    void reset();
+
+    // Decompresses up to size bytes, returns 0 only once the final block was
+    // read. With stop_at_block_end it also returns as soon as a block that
+    // produced some of the output ended.
+    ResultOr<size_t> read(IO::BitReader &bits, void *buffer, size_t size, bool stop_at_block_end = false);
+
+    bool ended() const { return _state == STATE_DONE; }
+
+    // Between two blocks nothing but the window carries over, decompression
+    // can start again from here given the window and the bit offset.
+    bool at_block_boundary() const { return _state == STATE_BLOCK_HEADER; }
+
+    size64_t total_out() const { return _total_out; }
+
+    // Copies the last min(total_out, 32KB) bytes of output, oldest first,
+    // and returns how many there were.
+    size_t copy_window(uint8_t *out) const;
+
+    // Starts over at a block boundary, with window as the output so far.
+    void resume(const uint8_t *window, size_t size, size64_t total_out);
+
+    // Both return the number of compressed bytes consumed.
     ResultOr<size_t> perform(IO::Reader &compressed, IO::Writer &uncompressed);
+
+    // Faster, the bit reader refills straight from memory.
+    ResultOr<size_t> perform(Slice compressed, IO::Writer &uncompressed);
 };
 
 }
\ No newline at end of file
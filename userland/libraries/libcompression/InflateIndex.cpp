@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <libcompression/InflateIndex.h>
+#include <libio/Streams.h>
+#include <libio/Write.h>
+#include <libmath/MinMax.h>
+
+namespace Compression
+{
+
+static JResult read_exactly(IO::Reader &reader, void *buffer, size_t size)
+{
+    size_t done = 0;
+
+    while (done < size)
+    {
+        size_t read = TRY(reader.read((uint8_t *)buffer + done, size - done));
+
+        if (read == 0)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        done += read;
+    }
+
+    return SUCCESS;
+}
+
+JResult InflateIndex::build(Slice compressed, size_t span)
+{
+    _points.clear();
+
+    IO::BitReader bits{compressed};
+    Inflate inflate;
+    inflate.reset();
+
+    uint8_t buffer[16384];
+    size64_t next_point = 0;
+
+    while (!inflate.ended())
+    {
+        if (inflate.at_block_boundary() && inflate.total_out() >= next_point)
+        {
+            auto &point = _points.emplace_back();
+            point.output_offset = inflate.total_out();
+            point.input_bit_offset = bits.consumed_bits();
+            point.window.resize(MIN(inflate.total_out(), (size64_t)Inflate::WINDOW_SIZE));
+            inflate.copy_window(point.window.raw_storage());
+
+            next_point = point.output_offset + span;
+        }
+
+        TRY(inflate.read(bits, buffer, sizeof(buffer), true));
+    }
+
+    _compressed_size = compressed.size();
+    _uncompressed_size = inflate.total_out();
+
+    return SUCCESS;
+}
+
+JResult InflateIndex::save(IO::Writer &writer) const
+{
+    TRY(IO::write_struct(writer, MAGIC));
+    TRY(IO::write_struct(writer, VERSION));
+    TRY(IO::write_struct(writer, (uint32_t)_points.count()));
+    TRY(IO::write_struct(writer, _compressed_size));
+    TRY(IO::write_struct(writer, _uncompressed_size));
+
+    for (size_t i = 0; i < _points.count(); i++)
+    {
+        const auto &point = _points[i];
+
+        TRY(IO::write_struct(writer, point.output_offset));
+        TRY(IO::write_struct(writer, point.input_bit_offset));
+        TRY(IO::write_struct(writer, (uint32_t)point.window.count()));
+        TRY(writer.write(point.window.raw_storage(), point.window.count()));
+    }
+
+    return SUCCESS;
+}
+
+JResult InflateIndex::load(IO::Reader &reader, size64_t compressed_size)
+{
+    _points.clear();
+
+    uint32_t magic, version, count;
+    TRY(read_exactly(reader, &magic, sizeof(magic)));
+    TRY(read_exactly(reader, &version, sizeof(version)));
+    TRY(read_exactly(reader, &count, sizeof(count)));
+    TRY(read_exactly(reader, &_compressed_size, sizeof(_compressed_size)));
+    TRY(read_exactly(reader, &_uncompressed_size, sizeof(_uncompressed_size)));
+
+    if (magic != MAGIC || version != VERSION || count == 0)
+    {
+        IO::logln("Not an inflate index");
+        return ERR_INVALID_DATA;
+    }
+
+    if (_compressed_size != compressed_size)
+    {
+        IO::logln("Inflate index is for another stream: {} != {} bytes", _compressed_size, compressed_size);
+        return ERR_INVALID_DATA;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        auto &point = _points.emplace_back();
+
+        uint32_t window_size;
+        TRY(read_exactly(reader, &point.output_offset, sizeof(point.output_offset)));
+        TRY(read_exactly(reader, &point.input_bit_offset, sizeof(point.input_bit_offset)));
+        TRY(read_exactly(reader, &window_size, sizeof(window_size)));
+
+        // Offsets only go forward, and a window is the output so far, up
+        // to 32KB of it.
+        bool in_order = i == 0 ? point.output_offset == 0 : point.output_offset > _points[i - 1].output_offset;
+
+        if (!in_order ||
+            point.output_offset > _uncompressed_size ||
+            point.input_bit_offset > _compressed_size * 8 ||
+            window_size != MIN(point.output_offset, (size64_t)Inflate::WINDOW_SIZE))
+        {
+            IO::logln("Inflate index is corrupted at access point {}", i);
+            return ERR_INVALID_DATA;
+        }
+
+        point.window.resize(window_size);
+        TRY(read_exactly(reader, point.window.raw_storage(), window_size));
+    }
+
+    return SUCCESS;
+}
+
+const InflateIndex::AccessPoint &InflateIndex::find(size64_t offset) const
+{
+    size_t low = 0;
+    size_t high = _points.count();
+
+    while (high - low > 1)
+    {
+        size_t middle = low + (high - low) / 2;
+
+        if (_points[middle].output_offset <= offset)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return _points[low];
+}
+
+IndexedInflateReader::IndexedInflateReader(Slice compressed, const InflateIndex &index)
+    : _compressed{compressed}, _index{index}, _bits{compressed}
+{
+    _inflate.reset();
+}
+
+JResult IndexedInflateReader::resume_at(size64_t offset)
+{
+    const auto &point = _index.find(offset);
+
+    // Starting over from where we are is cheaper when the access point is
+    // behind us anyway.
+    if (offset < _position || point.output_offset > _position)
+    {
+        size_t start = point.input_bit_offset / 8;
+        _bits = IO::BitReader{_compressed.slice(start, _compressed.size() - start)};
+        TRY(_bits.skip_bits(point.input_bit_offset % 8));
+
+        _inflate.resume(point.window.raw_storage(), point.window.count(), point.output_offset);
+        _position = point.output_offset;
+    }
+
+    uint8_t buffer[16384];
+
+    while (_position < offset && !_inflate.ended())
+    {
+        size_t read = TRY(_inflate.read(_bits, buffer, MIN(sizeof(buffer), offset - _position)));
+        _position += read;
+    }
+
+    return SUCCESS;
+}
+
+ResultOr<size_t> IndexedInflateReader::read(void *buffer, size_t size)
+{
+    if (_inflate.ended())
+    {
+        return 0;
+    }
+
+    size_t read = TRY(_inflate.read(_bits, buffer, size));
+    _position += read;
+
+    return read;
+}
+
+ResultOr<size64_t> IndexedInflateReader::seek(IO::SeekFrom from)
+{
+    ssize64_t target = 0;
+
+    switch (from.whence)
+    {
+    case IO::Whence::START:
+        target = from.position;
+        break;
+
+    case IO::Whence::CURRENT:
+        target = _position + from.position;
+        break;
+
+    case IO::Whence::END:
+        target = _index.uncompressed_size() + from.position;
+        break;
+
+    default:
+        ASSERT_NOT_REACHED();
+    }
+
+    target = MAX(MIN(target, (ssize64_t)_index.uncompressed_size()), (ssize64_t)0);
+
+    TRY(resume_at(target));
+
+    return _position;
+}
+
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <libabi/Result.h>
+#include <libcompression/Inflate.h>
+#include <libio/BitReader.h>
+#include <libio/Reader.h>
+#include <libio/Seek.h>
+#include <libio/Writer.h>
+#include <libutils/Slice.h>
+#include <libutils/Vector.h>
+
+namespace Compression
+{
+
+// Access points into a deflate stream, the way zran does it: every span
+// bytes of output, at the next block boundary, the bit offset of that
+// block and the 32KB of output before it. Decompression can start at any
+// of them, so reaching an offset costs at most a span of inflating rather
+// than everything before it.
+//
+// The index can be saved next to the archive and loaded back, it's about
+// 32KB per access point.
+struct InflateIndex
+{
+public:
+    static constexpr size_t DEFAULT_SPAN = 1024 * 1024;
+
+    static constexpr uint32_t MAGIC = 0x58444E49; // "INDX"
+    static constexpr uint32_t VERSION = 1;
+
+    struct AccessPoint
+    {
+        size64_t output_offset;
+        size64_t input_bit_offset;
+        Vector<uint8_t> window;
+    };
+
+private:
+    Vector<AccessPoint> _points;
+    size64_t _compressed_size = 0;
+    size64_t _uncompressed_size = 0;
+
+public:
+    // Inflates all of compressed once, recording an access point roughly
+    // every span bytes of output.
+    JResult build(Slice compressed, size_t span = DEFAULT_SPAN);
+
+    JResult save(IO::Writer &writer) const;
+
+    // Loads a saved index, which must have been built from a stream of
+    // compressed_size bytes, so a stale one isn't used by mistake.
+    JResult load(IO::Reader &reader, size64_t compressed_size);
+
+    // The last access point at or before offset, there is always one at 0.
+    const AccessPoint &find(size64_t offset) const;
+
+    size_t count() const { return _points.count(); }
+    size64_t compressed_size() const { return _compressed_size; }
+    size64_t uncompressed_size() const { return _uncompressed_size; }
+};
+
+// Reads the output of a deflate stream from anywhere, using an index of it.
+struct IndexedInflateReader :
+    public IO::Reader,
+    public IO::Seek
+{
+private:
+    Slice _compressed;
+    const InflateIndex &_index;
+
+    IO::BitReader _bits;
+    Inflate _inflate;
+    size64_t _position = 0;
+
+    JResult resume_at(size64_t offset);
+
+public:
+    IndexedInflateReader(Slice compressed, const InflateIndex &index);
+
+    ResultOr<size_t> read(void *buffer, size_t size) override;
+
+    ResultOr<size64_t> seek(IO::SeekFrom from) override;
+
+    ResultOr<size64_t> tell() override { return _position; }
+
+    ResultOr<size64_t> length() override { return _index.uncompressed_size(); }
+};
+
+}
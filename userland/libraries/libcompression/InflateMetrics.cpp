@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Metrics.h>
+#include <base/MonotonicClock.h>
+#include <libcompression/InflateMetrics.h>
+
+namespace Compression
+{
+
+static LatencyMetric _inflate_latency{"inflate_ns"};
+static ShardedCounter _inflate_bytes{"inflate_compressed_bytes"};
+
+uint64_t inflate_clock_ns()
+{
+    return MonotonicClock::now_ns();
+}
+
+void inflate_did_perform(uint64_t start_ns, size_t compressed_bytes)
+{
+    _inflate_latency.record(MonotonicClock::now_ns() - start_ns);
+    _inflate_bytes.add(compressed_bytes);
+}
+
+}
@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Compression
+{
+
+// Exports how long inflating takes and how much it reads through the base
+// MetricsRegistry. Base headers don't mix with libutils ones, so only
+// InflateMetrics.cpp sees them.
+
+uint64_t inflate_clock_ns();
+
+void inflate_did_perform(uint64_t start_ns, size_t compressed_bytes);
+
+}
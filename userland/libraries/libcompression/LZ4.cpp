@@ -0,0 +1,533 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <string.h>
+#include <libcompression/LZ4.h>
+#include <libio/Copy.h>
+#include <libio/MemoryReader.h>
+#include <libio/ReadCounter.h>
+#include <libio/Streams.h>
+
+namespace Compression
+{
+
+static uint32_t read32(const uint8_t *data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static void write32(uint8_t *data, uint32_t value)
+{
+    memcpy(data, &value, sizeof(value));
+}
+
+// Fills the whole buffer, running out of input before that is an error.
+static JResult read_exactly(IO::Reader &reader, void *buffer, size_t size)
+{
+    size_t done = 0;
+
+    while (done < size)
+    {
+        size_t read = TRY(reader.read((uint8_t *)buffer + done, size - done));
+
+        if (read == 0)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        done += read;
+    }
+
+    return SUCCESS;
+}
+
+// Fills as much of the buffer as there is input for.
+static ResultOr<size_t> read_upto(IO::Reader &reader, void *buffer, size_t size)
+{
+    size_t done = 0;
+
+    while (done < size)
+    {
+        size_t read = TRY(reader.read((uint8_t *)buffer + done, size - done));
+
+        if (read == 0)
+        {
+            break;
+        }
+
+        done += read;
+    }
+
+    return done;
+}
+
+LZ4Encoder::LZ4Encoder()
+{
+    _window.resize(LZ4::MAX_DISTANCE + 1 + BLOCK_SIZE);
+    _hash_table.resize(HASH_SIZE);
+    _compressed.resize(LZ4::compressed_bound(BLOCK_SIZE));
+}
+
+static inline uint32_t lz4_hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - LZ4Encoder::HASH_BITS);
+}
+
+static uint8_t *write_length(uint8_t *out, size_t length)
+{
+    while (length >= 255)
+    {
+        *out++ = 255;
+        length -= 255;
+    }
+
+    *out++ = length;
+    return out;
+}
+
+static uint8_t *write_sequence(uint8_t *out, const uint8_t *literals, size_t literal_length, size_t offset, size_t match_length)
+{
+    uint8_t *token = out++;
+    *token = MIN(literal_length, 15) << 4;
+
+    if (literal_length >= 15)
+    {
+        out = write_length(out, literal_length - 15);
+    }
+
+    memcpy(out, literals, literal_length);
+    out += literal_length;
+
+    // The last sequence has no match.
+    if (match_length == 0)
+    {
+        return out;
+    }
+
+    *out++ = offset & 0xff;
+    *out++ = offset >> 8;
+
+    match_length -= LZ4::MIN_MATCH;
+    *token |= MIN(match_length, 15);
+
+    if (match_length >= 15)
+    {
+        out = write_length(out, match_length - 15);
+    }
+
+    return out;
+}
+
+size_t LZ4Encoder::compress_block(const uint8_t *data, size_t start, size_t end, uint64_t position, uint8_t *out)
+{
+    uint64_t *table = _hash_table.raw_storage();
+    uint8_t *out_start = out;
+
+    size_t anchor = start;
+    size_t ip = start;
+
+    if (end - start > LZ4::MATCH_FIND_LIMIT)
+    {
+        size_t find_limit = end - LZ4::MATCH_FIND_LIMIT;
+        size_t match_limit = end - LZ4::LAST_LITERALS;
+
+        // Every 64 misses in a row the step grows, so incompressible data
+        // goes by quickly.
+        unsigned int misses = 0;
+
+        while (ip <= find_limit)
+        {
+            uint32_t sequence = read32(data + ip);
+            uint32_t hash = lz4_hash(sequence);
+            uint64_t candidate = table[hash];
+            table[hash] = position + ip + 1;
+
+            if (candidate == 0 ||
+                candidate - 1 < position ||
+                position + ip - (candidate - 1) > LZ4::MAX_DISTANCE ||
+                read32(data + (candidate - 1 - position)) != sequence)
+            {
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+
+            misses = 0;
+
+            size_t match = candidate - 1 - position;
+
+            while (ip > anchor && match > 0 && data[ip - 1] == data[match - 1])
+            {
+                ip--;
+                match--;
+            }
+
+            size_t length = LZ4::MIN_MATCH;
+
+            while (ip + length < match_limit && data[ip + length] == data[match + length])
+            {
+                length++;
+            }
+
+            out = write_sequence(out, data + anchor, ip - anchor, ip - match, length);
+
+            ip += length;
+            anchor = ip;
+
+            // The middle of the match would never be looked up otherwise.
+            if (ip - 2 <= find_limit)
+            {
+                table[lz4_hash(read32(data + ip - 2))] = position + ip - 2 + 1;
+            }
+        }
+    }
+
+    out = write_sequence(out, data + anchor, end - anchor, 0, 0);
+
+    return out - out_start;
+}
+
+void LZ4Encoder::slide_window()
+{
+    if (_window_used <= LZ4::MAX_DISTANCE)
+    {
+        return;
+    }
+
+    size_t shift = _window_used - LZ4::MAX_DISTANCE;
+    memmove(_window.raw_storage(), _window.raw_storage() + shift, LZ4::MAX_DISTANCE);
+    _window_used = LZ4::MAX_DISTANCE;
+    _window_position += shift;
+}
+
+JResult LZ4Encoder::perform(IO::Reader &uncompressed, IO::Writer &compressed)
+{
+    memset(_hash_table.raw_storage(), 0, HASH_SIZE * sizeof(uint64_t));
+
+    _window_used = 0;
+    _window_position = 0;
+
+    uint8_t header[7];
+    write32(header, LZ4::FRAME_MAGIC);
+    header[4] = LZ4::FLAG_VERSION | LZ4::FLAG_CONTENT_CHECKSUM;
+    header[5] = BLOCK_SIZE_ID << 4;
+    header[6] = (XXHash32::hash(header + 4, 2) >> 8) & 0xff;
+    TRY(IO::write_all(compressed, Slice{header, sizeof(header)}));
+
+    XXHash32 checksum;
+
+    while (true)
+    {
+        slide_window();
+
+        uint8_t *block = _window.raw_storage() + _window_used;
+        size_t size = TRY(read_upto(uncompressed, block, BLOCK_SIZE));
+
+        if (size == 0)
+        {
+            break;
+        }
+
+        checksum.add(block, size);
+
+        size_t compressed_size = compress_block(_window.raw_storage(), _window_used, _window_used + size, _window_position, _compressed.raw_storage());
+
+        uint8_t block_header[4];
+
+        if (compressed_size < size)
+        {
+            write32(block_header, compressed_size);
+            TRY(IO::write_all(compressed, Slice{block_header, 4}));
+            TRY(IO::write_all(compressed, Slice{_compressed.raw_storage(), compressed_size}));
+        }
+        else
+        {
+            write32(block_header, size | LZ4::BLOCK_UNCOMPRESSED);
+            TRY(IO::write_all(compressed, Slice{block_header, 4}));
+            TRY(IO::write_all(compressed, Slice{block, size}));
+        }
+
+        _window_used += size;
+    }
+
+    uint8_t trailer[8];
+    write32(trailer, 0);
+    write32(trailer + 4, checksum.digest());
+    TRY(IO::write_all(compressed, Slice{trailer, sizeof(trailer)}));
+
+    return SUCCESS;
+}
+
+ResultOr<size_t> LZ4Decoder::decompress_block(const uint8_t *block, size_t size, uint8_t *out, size_t start, size_t capacity)
+{
+    const uint8_t *ip = block;
+    const uint8_t *end = block + size;
+    size_t op = start;
+
+    auto read_length = [&](size_t length) -> ResultOr<size_t> {
+        if (length != 15)
+        {
+            return length;
+        }
+
+        uint8_t byte;
+
+        do
+        {
+            if (ip >= end)
+            {
+                return ERR_INVALID_DATA;
+            }
+
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+
+        return length;
+    };
+
+    while (ip < end)
+    {
+        uint8_t token = *ip++;
+
+        size_t literal_length = TRY(read_length(token >> 4));
+
+        if (literal_length > (size_t)(end - ip) || literal_length > capacity - op)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        memcpy(out + op, ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+
+        // The last sequence ends with its literals.
+        if (ip == end)
+        {
+            break;
+        }
+
+        if (end - ip < 2)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        size_t match_length = TRY(read_length(token & 15)) + LZ4::MIN_MATCH;
+
+        if (offset == 0 || offset > op || match_length > capacity - op)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        uint8_t *dest = out + op;
+        const uint8_t *source = dest - offset;
+
+        if (offset >= match_length)
+        {
+            memcpy(dest, source, match_length);
+        }
+        else
+        {
+            // Overlapping, repeats the last offset bytes.
+            for (size_t i = 0; i < match_length; i++)
+            {
+                dest[i] = source[i];
+            }
+        }
+
+        op += match_length;
+    }
+
+    return op - start;
+}
+
+ResultOr<size_t> LZ4Decoder::read_frame(IO::Reader &compressed, IO::Writer &uncompressed, uint32_t magic)
+{
+    if ((magic & LZ4::SKIPPABLE_MASK) == LZ4::SKIPPABLE_MAGIC)
+    {
+        uint8_t size_bytes[4];
+        TRY(read_exactly(compressed, size_bytes, 4));
+
+        uint8_t discard[512];
+        size_t remaining = read32(size_bytes);
+
+        while (remaining > 0)
+        {
+            size_t chunk = MIN(remaining, sizeof(discard));
+            TRY(read_exactly(compressed, discard, chunk));
+            remaining -= chunk;
+        }
+
+        return 0;
+    }
+
+    if (magic != LZ4::FRAME_MAGIC)
+    {
+        IO::logln("Not an LZ4 frame: {08x}", magic);
+        return ERR_INVALID_DATA;
+    }
+
+    uint8_t descriptor[15];
+    TRY(read_exactly(compressed, descriptor, 2));
+
+    uint8_t flags = descriptor[0];
+    uint8_t block_size_id = (descriptor[1] >> 4) & 7;
+
+    if ((flags & LZ4::FLAG_VERSION_MASK) != LZ4::FLAG_VERSION ||
+        (flags & LZ4::FLAG_RESERVED) ||
+        (descriptor[1] & 0x8f) ||
+        block_size_id < 4)
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    if (flags & LZ4::FLAG_DICTIONARY_ID)
+    {
+        IO::logln("LZ4 frames with a dictionary are not supported");
+        return ERR_NOT_IMPLEMENTED;
+    }
+
+    size_t descriptor_size = 2;
+
+    if (flags & LZ4::FLAG_CONTENT_SIZE)
+    {
+        TRY(read_exactly(compressed, descriptor + descriptor_size, 8));
+        descriptor_size += 8;
+    }
+
+    uint8_t header_checksum;
+    TRY(read_exactly(compressed, &header_checksum, 1));
+
+    if (header_checksum != ((XXHash32::hash(descriptor, descriptor_size) >> 8) & 0xff))
+    {
+        IO::logln("LZ4 frame descriptor checksum mismatch");
+        return ERR_INVALID_DATA;
+    }
+
+    size_t block_size = LZ4::block_size_for_id(block_size_id);
+    bool linked = !(flags & LZ4::FLAG_BLOCK_INDEPENDENCE);
+    size_t history_size = linked ? LZ4::MAX_DISTANCE : 0;
+
+    _window.resize(history_size + block_size);
+    _block.resize(block_size);
+
+    size_t history = 0;
+    size_t written = 0;
+    XXHash32 checksum;
+
+    while (true)
+    {
+        uint8_t size_bytes[4];
+        TRY(read_exactly(compressed, size_bytes, 4));
+
+        uint32_t size = read32(size_bytes);
+
+        if (size == 0)
+        {
+            break;
+        }
+
+        bool stored = size & LZ4::BLOCK_UNCOMPRESSED;
+        size &= ~LZ4::BLOCK_UNCOMPRESSED;
+
+        if (size > block_size)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        TRY(read_exactly(compressed, _block.raw_storage(), size));
+
+        if (flags & LZ4::FLAG_BLOCK_CHECKSUM)
+        {
+            uint8_t block_checksum[4];
+            TRY(read_exactly(compressed, block_checksum, 4));
+
+            if (read32(block_checksum) != XXHash32::hash(_block.raw_storage(), size))
+            {
+                IO::logln("LZ4 block checksum mismatch");
+                return ERR_INVALID_DATA;
+            }
+        }
+
+        uint8_t *output = _window.raw_storage() + history;
+        size_t decoded;
+
+        if (stored)
+        {
+            memcpy(output, _block.raw_storage(), size);
+            decoded = size;
+        }
+        else
+        {
+            decoded = TRY(decompress_block(_block.raw_storage(), size, _window.raw_storage(), history, history + block_size));
+        }
+
+        checksum.add(output, decoded);
+        TRY(IO::write_all(uncompressed, Slice{output, decoded}));
+        written += decoded;
+
+        // Keep the last 64KB for the matches of the next block.
+        history += decoded;
+
+        if (history > history_size)
+        {
+            memmove(_window.raw_storage(), _window.raw_storage() + history - history_size, history_size);
+            history = history_size;
+        }
+    }
+
+    if (flags & LZ4::FLAG_CONTENT_CHECKSUM)
+    {
+        uint8_t content_checksum[4];
+        TRY(read_exactly(compressed, content_checksum, 4));
+
+        if (read32(content_checksum) != checksum.digest())
+        {
+            IO::logln("LZ4 content checksum mismatch");
+            return ERR_INVALID_DATA;
+        }
+    }
+
+    return written;
+}
+
+ResultOr<size_t> LZ4Decoder::perform(IO::Reader &compressed, IO::Writer &uncompressed)
+{
+    IO::ReadCounter counter{compressed};
+
+    while (true)
+    {
+        uint8_t magic[4];
+        size_t read = TRY(read_upto(counter, magic, 4));
+
+        if (read == 0)
+        {
+            break;
+        }
+
+        if (read < 4)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        TRY(read_frame(counter, uncompressed, read32(magic)));
+    }
+
+    return counter.count();
+}
+
+ResultOr<size_t> LZ4Decoder::perform(Slice compressed, IO::Writer &uncompressed)
+{
+    IO::MemoryReader reader{compressed};
+    return perform(reader, uncompressed);
+}
+
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <libabi/Result.h>
+#include <libcompression/XXHash.h>
+#include <libio/Reader.h>
+#include <libio/Writer.h>
+#include <libutils/Prelude.h>
+#include <libutils/Slice.h>
+#include <libutils/Vector.h>
+
+namespace Compression
+{
+
+// LZ4 blocks and frames, as the lz4 tool writes them. A block is a run of
+// sequences of literals and a match (offset, length) and no entropy coding
+// at all, which makes it about as fast to decode as memcpy.
+
+namespace LZ4
+{
+
+static constexpr uint32_t FRAME_MAGIC = 0x184D2204;
+static constexpr uint32_t SKIPPABLE_MAGIC = 0x184D2A50;
+static constexpr uint32_t SKIPPABLE_MASK = 0xFFFFFFF0;
+
+static constexpr uint8_t FLAG_VERSION = 0x40;
+static constexpr uint8_t FLAG_VERSION_MASK = 0xC0;
+static constexpr uint8_t FLAG_BLOCK_INDEPENDENCE = 0x20;
+static constexpr uint8_t FLAG_BLOCK_CHECKSUM = 0x10;
+static constexpr uint8_t FLAG_CONTENT_SIZE = 0x08;
+static constexpr uint8_t FLAG_CONTENT_CHECKSUM = 0x04;
+static constexpr uint8_t FLAG_RESERVED = 0x02;
+static constexpr uint8_t FLAG_DICTIONARY_ID = 0x01;
+
+// The high bit of a block size says the block is stored as is.
+static constexpr uint32_t BLOCK_UNCOMPRESSED = 0x80000000;
+
+static constexpr size_t MIN_MATCH = 4;
+static constexpr size_t MAX_DISTANCE = 65535;
+
+// The last match has to start 12 bytes before the end of a block and
+// leave at least 5 bytes of literals after it.
+static constexpr size_t MATCH_FIND_LIMIT = 12;
+static constexpr size_t LAST_LITERALS = 5;
+
+static inline size_t block_size_for_id(uint8_t id) { return (size_t)1 << (8 + 2 * id); }
+
+// The worst case size of a compressed block, for incompressible data.
+static inline size_t compressed_bound(size_t size) { return size + size / 255 + 16; }
+
+}
+
+struct LZ4Encoder
+{
+public:
+    // Block maximum size id 5, 256KB. Blocks are linked, so matches reach
+    // back into the previous one.
+    static constexpr uint8_t BLOCK_SIZE_ID = 5;
+    static constexpr size_t BLOCK_SIZE = 256 * 1024;
+
+    static constexpr unsigned int HASH_BITS = 14;
+    static constexpr size_t HASH_SIZE = 1 << HASH_BITS;
+
+private:
+    // Previous 64KB and the block being compressed, one after the other.
+    Vector<uint8_t> _window;
+    size_t _window_used = 0;
+
+    // Stream position + 1 of the last 4 bytes with a given hash, 0 is empty.
+    Vector<uint64_t> _hash_table;
+    uint64_t _window_position = 0;
+
+    Vector<uint8_t> _compressed;
+
+    void slide_window();
+
+public:
+    LZ4Encoder();
+
+    // Compresses data[start, end) into out, which has room for
+    // LZ4::compressed_bound(end - start) bytes. Matches may point back to
+    // data[start - MAX_DISTANCE] when the hash table remembers them,
+    // position is where data[0] sits in the stream.
+    size_t compress_block(const uint8_t *data, size_t start, size_t end, uint64_t position, uint8_t *out);
+
+    JResult perform(IO::Reader &uncompressed, IO::Writer &compressed);
+};
+
+struct LZ4Decoder
+{
+private:
+    // The previous 64KB when blocks are linked, then the current block.
+    Vector<uint8_t> _window;
+    Vector<uint8_t> _block;
+
+    ResultOr<size_t> read_frame(IO::Reader &compressed, IO::Writer &uncompressed, uint32_t magic);
+
+public:
+    // Decodes a block into out[start, capacity), matches may point back
+    // into out[0, start). Returns the number of bytes decoded.
+    static ResultOr<size_t> decompress_block(const uint8_t *block, size_t size, uint8_t *out, size_t start, size_t capacity);
+
+    // Decodes every frame up to the end of the input, skipping skippable
+    // frames. Both return the number of compressed bytes consumed.
+    ResultOr<size_t> perform(IO::Reader &compressed, IO::Writer &uncompressed);
+
+    ResultOr<size_t> perform(Slice compressed, IO::Writer &uncompressed);
+};
+
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <string.h>
+#include <libcompression/ParallelDeflate.h>
+#include <libio/BitWriter.h>
+#include <libio/Copy.h>
+#include <libmath/MinMax.h>
+#include <libutils/Threads.h>
+
+namespace Compression
+{
+
+// Fills as much of the buffer as there is input for.
+static ResultOr<size_t> read_upto(IO::Reader &reader, void *buffer, size_t size)
+{
+    size_t done = 0;
+
+    while (done < size)
+    {
+        size_t read = TRY(reader.read((uint8_t *)buffer + done, size - done));
+
+        if (read == 0)
+        {
+            break;
+        }
+
+        done += read;
+    }
+
+    return done;
+}
+
+ParallelDeflate::ParallelDeflate(unsigned int compression_level, size_t thread_count, size_t block_size)
+    : _compression_level{compression_level}
+{
+    if (thread_count == 0)
+    {
+        thread_count = Utils::processor_count();
+    }
+
+    _thread_count = MIN(thread_count, MAX_THREADS);
+    _block_size = MIN(MAX(block_size, MIN_BLOCK_SIZE), MAX_BLOCK_SIZE);
+}
+
+void ParallelDeflate::compress(Job &job)
+{
+    IO::BitWriter bits{job.output};
+    Deflate deflate{_compression_level};
+
+    deflate.begin(bits);
+    deflate.set_dictionary(job.data - job.dictionary_size, job.dictionary_size);
+    deflate.write(job.data, job.size);
+
+    if (job.final)
+    {
+        deflate.finish();
+    }
+    else
+    {
+        deflate.sync_flush();
+    }
+
+    CRC crc;
+    crc.add(job.data, job.size);
+    job.crc = crc.checksum();
+}
+
+void ParallelDeflate::take_jobs()
+{
+    while (true)
+    {
+        size_t index = __atomic_fetch_add(&_next_job, 1, __ATOMIC_RELAXED);
+
+        if (index >= _job_count)
+        {
+            return;
+        }
+
+        compress(*_jobs[index]);
+    }
+}
+
+void ParallelDeflate::run_jobs()
+{
+    _next_job = 0;
+
+    // The calling thread takes jobs too, so one job needs no thread at all.
+    Utils::run_on_threads(MIN(_thread_count, _job_count), [this]() {
+        take_jobs();
+    });
+}
+
+JResult ParallelDeflate::perform(IO::Reader &uncompressed, IO::Writer &compressed)
+{
+    _buffer.resize(Deflate::WINDOW_SIZE + _thread_count * _block_size);
+    _jobs.resize(_thread_count);
+
+    _crc = 0;
+    _size = 0;
+
+    uint8_t *blocks = _buffer.raw_storage() + Deflate::WINDOW_SIZE;
+    size_t history = 0;
+    bool ended = false;
+
+    while (!ended)
+    {
+        _job_count = 0;
+
+        for (size_t i = 0; i < _thread_count && !ended; i++)
+        {
+            uint8_t *data = blocks + i * _block_size;
+            size_t read = TRY(read_upto(uncompressed, data, _block_size));
+
+            // Don't end the stream with an empty block of its own if the
+            // previous one can be the final one instead. Input that ends
+            // right on a batch boundary still gets one.
+            if (read == 0 && _job_count > 0)
+            {
+                _jobs[_job_count - 1]->final = true;
+                ended = true;
+                break;
+            }
+
+            ended = read < _block_size;
+
+            auto &job = _jobs[_job_count++];
+            job = own<Job>();
+            job->data = data;
+            job->size = read;
+            job->dictionary_size = MIN(history + i * _block_size, (size_t)Deflate::WINDOW_SIZE);
+            job->final = ended;
+        }
+
+        run_jobs();
+
+        for (size_t i = 0; i < _job_count; i++)
+        {
+            auto &job = *_jobs[i];
+
+            TRY(IO::write_all(compressed, Slice{job.output.buffer(), TRY(job.output.length())}));
+
+            _crc = CRC::combine(_crc, job.crc, job.size);
+            _size += job.size;
+        }
+
+        // Keep the end of this batch as the history of the next one.
+        auto &last = *_jobs[_job_count - 1];
+        size_t total = last.data + last.size - blocks;
+        history = MIN(total + history, (size_t)Deflate::WINDOW_SIZE);
+        memmove(blocks - history, blocks + total - history, history);
+    }
+
+    return SUCCESS;
+}
+
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <libabi/Result.h>
+#include <libcompression/CRC.h>
+#include <libcompression/Deflate.h>
+#include <libio/MemoryWriter.h>
+#include <libio/Reader.h>
+#include <libio/Writer.h>
+#include <libutils/OwnPtr.h>
+#include <libutils/Threads.h>
+#include <libutils/Vector.h>
+
+namespace Compression
+{
+
+// Compresses a raw deflate stream on several threads, the way pigz does.
+//
+// The input is cut into blocks, each compressed by its own Deflate primed
+// with the 32KB before it, so matches still cross block boundaries. A block
+// ends with a sync flush, which leaves the output byte aligned and lets the
+// blocks simply be written one after the other. Costs well under a percent
+// of ratio, the matches lost are the ones that would straddle a boundary.
+struct ParallelDeflate
+{
+public:
+    static constexpr size_t MIN_BLOCK_SIZE = 128 * 1024;
+    static constexpr size_t MAX_BLOCK_SIZE = 1024 * 1024;
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 256 * 1024;
+
+    static constexpr size_t MAX_THREADS = Utils::MAX_WORKER_THREADS;
+
+private:
+    struct Job
+    {
+        const uint8_t *data;
+        size_t size;
+        size_t dictionary_size;
+        bool final;
+
+        IO::MemoryWriter output;
+        uint32_t crc;
+    };
+
+    unsigned int _compression_level;
+    size_t _thread_count;
+    size_t _block_size;
+
+    // The 32KB kept from the previous batch, then one block per thread.
+    Vector<uint8_t> _buffer;
+    Vector<OwnPtr<Job>> _jobs;
+    size_t _job_count = 0;
+    size_t _next_job = 0;
+
+    uint32_t _crc = 0;
+    uint64_t _size = 0;
+
+    void compress(Job &job);
+    void take_jobs();
+    void run_jobs();
+
+public:
+    // A thread count of 0 uses one per processor.
+    ParallelDeflate(unsigned int compression_level, size_t thread_count = 0, size_t block_size = DEFAULT_BLOCK_SIZE);
+
+    // Checksum and size of the uncompressed data, once perform() is done.
+    uint32_t crc() const { return _crc; }
+    uint64_t size() const { return _size; }
+
+    JResult perform(IO::Reader &uncompressed, IO::Writer &compressed);
+};
+
+}
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <string.h>
+#include <libutils/Prelude.h>
+
+namespace Compression
+{
+
+// xxHash, the checksums of the LZ4 and Zstandard frame formats. Both take
+// the data in pieces of any size, add() buffers what doesn't make up a
+// whole stripe yet.
+
+struct XXHash32
+{
+private:
+    static constexpr uint32_t PRIME1 = 0x9E3779B1u;
+    static constexpr uint32_t PRIME2 = 0x85EBCA77u;
+    static constexpr uint32_t PRIME3 = 0xC2B2AE3Du;
+    static constexpr uint32_t PRIME4 = 0x27D4EB2Fu;
+    static constexpr uint32_t PRIME5 = 0x165667B1u;
+
+    uint32_t _lanes[4];
+    uint8_t _buffer[16];
+    size_t _buffered = 0;
+    uint64_t _total = 0;
+    uint32_t _seed;
+
+    static uint32_t rotate(uint32_t value, int bits) { return (value << bits) | (value >> (32 - bits)); }
+
+    static uint32_t read32(const uint8_t *data)
+    {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value)); // x86 is little endian
+        return value;
+    }
+
+    static uint32_t round(uint32_t lane, uint32_t input)
+    {
+        return rotate(lane + input * PRIME2, 13) * PRIME1;
+    }
+
+    void stripe(const uint8_t *data)
+    {
+        _lanes[0] = round(_lanes[0], read32(data));
+        _lanes[1] = round(_lanes[1], read32(data + 4));
+        _lanes[2] = round(_lanes[2], read32(data + 8));
+        _lanes[3] = round(_lanes[3], read32(data + 12));
+    }
+
+public:
+    XXHash32(uint32_t seed = 0) : _seed{seed}
+    {
+        _lanes[0] = seed + PRIME1 + PRIME2;
+        _lanes[1] = seed + PRIME2;
+        _lanes[2] = seed;
+        _lanes[3] = seed - PRIME1;
+    }
+
+    void add(const uint8_t *data, size_t size)
+    {
+        _total += size;
+
+        if (_buffered + size < sizeof(_buffer))
+        {
+            memcpy(_buffer + _buffered, data, size);
+            _buffered += size;
+            return;
+        }
+
+        if (_buffered)
+        {
+            size_t fill = sizeof(_buffer) - _buffered;
+            memcpy(_buffer + _buffered, data, fill);
+            stripe(_buffer);
+            data += fill;
+            size -= fill;
+            _buffered = 0;
+        }
+
+        while (size >= sizeof(_buffer))
+        {
+            stripe(data);
+            data += sizeof(_buffer);
+            size -= sizeof(_buffer);
+        }
+
+        memcpy(_buffer, data, size);
+        _buffered = size;
+    }
+
+    uint32_t digest() const
+    {
+        uint32_t hash;
+
+        if (_total >= sizeof(_buffer))
+        {
+            hash = rotate(_lanes[0], 1) + rotate(_lanes[1], 7) + rotate(_lanes[2], 12) + rotate(_lanes[3], 18);
+        }
+        else
+        {
+            hash = _seed + PRIME5;
+        }
+
+        hash += (uint32_t)_total;
+
+        size_t i = 0;
+
+        for (; i + 4 <= _buffered; i += 4)
+        {
+            hash = rotate(hash + read32(_buffer + i) * PRIME3, 17) * PRIME4;
+        }
+
+        for (; i < _buffered; i++)
+        {
+            hash = rotate(hash + _buffer[i] * PRIME5, 11) * PRIME1;
+        }
+
+        hash ^= hash >> 15;
+        hash *= PRIME2;
+        hash ^= hash >> 13;
+        hash *= PRIME3;
+        hash ^= hash >> 16;
+        return hash;
+    }
+
+    static uint32_t hash(const uint8_t *data, size_t size, uint32_t seed = 0)
+    {
+        XXHash32 hasher{seed};
+        hasher.add(data, size);
+        return hasher.digest();
+    }
+};
+
+struct XXHash64
+{
+private:
+    static constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+    static constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+    static constexpr uint64_t PRIME3 = 0x165667B19E3779F9ull;
+    static constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+    static constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+    uint64_t _lanes[4];
+    uint8_t _buffer[32];
+    size_t _buffered = 0;
+    uint64_t _total = 0;
+    uint64_t _seed;
+
+    static uint64_t rotate(uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); }
+
+    static uint64_t read64(const uint8_t *data)
+    {
+        uint64_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    static uint32_t read32(const uint8_t *data)
+    {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    static uint64_t round(uint64_t lane, uint64_t input)
+    {
+        return rotate(lane + input * PRIME2, 31) * PRIME1;
+    }
+
+    static uint64_t merge(uint64_t hash, uint64_t lane)
+    {
+        return (hash ^ round(0, lane)) * PRIME1 + PRIME4;
+    }
+
+    void stripe(const uint8_t *data)
+    {
+        _lanes[0] = round(_lanes[0], read64(data));
+        _lanes[1] = round(_lanes[1], read64(data + 8));
+        _lanes[2] = round(_lanes[2], read64(data + 16));
+        _lanes[3] = round(_lanes[3], read64(data + 24));
+    }
+
+public:
+    XXHash64(uint64_t seed = 0) : _seed{seed}
+    {
+        _lanes[0] = seed + PRIME1 + PRIME2;
+        _lanes[1] = seed + PRIME2;
+        _lanes[2] = seed;
+        _lanes[3] = seed - PRIME1;
+    }
+
+    void add(const uint8_t *data, size_t size)
+    {
+        _total += size;
+
+        if (_buffered + size < sizeof(_buffer))
+        {
+            memcpy(_buffer + _buffered, data, size);
+            _buffered += size;
+            return;
+        }
+
+        if (_buffered)
+        {
+            size_t fill = sizeof(_buffer) - _buffered;
+            memcpy(_buffer + _buffered, data, fill);
+            stripe(_buffer);
+            data += fill;
+            size -= fill;
+            _buffered = 0;
+        }
+
+        while (size >= sizeof(_buffer))
+        {
+            stripe(data);
+            data += sizeof(_buffer);
+            size -= sizeof(_buffer);
+        }
+
+        memcpy(_buffer, data, size);
+        _buffered = size;
+    }
+
+    uint64_t digest() const
+    {
+        uint64_t hash;
+
+        if (_total >= sizeof(_buffer))
+        {
+            hash = rotate(_lanes[0], 1) + rotate(_lanes[1], 7) + rotate(_lanes[2], 12) + rotate(_lanes[3], 18);
+            hash = merge(hash, _lanes[0]);
+            hash = merge(hash, _lanes[1]);
+            hash = merge(hash, _lanes[2]);
+            hash = merge(hash, _lanes[3]);
+        }
+        else
+        {
+            hash = _seed + PRIME5;
+        }
+
+        hash += _total;
+
+        size_t i = 0;
+
+        for (; i + 8 <= _buffered; i += 8)
+        {
+            hash ^= round(0, read64(_buffer + i));
+            hash = rotate(hash, 27) * PRIME1 + PRIME4;
+        }
+
+        if (i + 4 <= _buffered)
+        {
+            hash ^= (uint64_t)read32(_buffer + i) * PRIME1;
+            hash = rotate(hash, 23) * PRIME2 + PRIME3;
+            i += 4;
+        }
+
+        for (; i < _buffered; i++)
+        {
+            hash ^= _buffer[i] * PRIME5;
+            hash = rotate(hash, 11) * PRIME1;
+        }
+
+        hash ^= hash >> 33;
+        hash *= PRIME2;
+        hash ^= hash >> 29;
+        hash *= PRIME3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+};
+
+}
@@ -0,0 +1,1619 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <string.h>
+#include <libcompression/Zstd.h>
+#include <libio/Copy.h>
+#include <libio/MemoryReader.h>
+#include <libio/ReadCounter.h>
+#include <libio/Streams.h>
+
+namespace Compression
+{
+
+static uint32_t read32(const uint8_t *data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static void write32(uint8_t *data, uint32_t value)
+{
+    memcpy(data, &value, sizeof(value));
+}
+
+static uint64_t read_le(const uint8_t *data, size_t size)
+{
+    uint64_t value = 0;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        value |= (uint64_t)data[i] << (i * 8);
+    }
+
+    return value;
+}
+
+static inline unsigned int highest_bit(uint32_t value)
+{
+    return 31 - __builtin_clz(value);
+}
+
+// Fills the whole buffer, running out of input before that is an error.
+static JResult read_exactly(IO::Reader &reader, void *buffer, size_t size)
+{
+    size_t done = 0;
+
+    while (done < size)
+    {
+        size_t read = TRY(reader.read((uint8_t *)buffer + done, size - done));
+
+        if (read == 0)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        done += read;
+    }
+
+    return SUCCESS;
+}
+
+// Fills as much of the buffer as there is input for.
+static ResultOr<size_t> read_upto(IO::Reader &reader, void *buffer, size_t size)
+{
+    size_t done = 0;
+
+    while (done < size)
+    {
+        size_t read = TRY(reader.read((uint8_t *)buffer + done, size - done));
+
+        if (read == 0)
+        {
+            break;
+        }
+
+        done += read;
+    }
+
+    return done;
+}
+
+// Table descriptions are read from the first bit of the first byte on.
+struct ForwardBits
+{
+    const uint8_t *data;
+    size_t size;
+    size_t position = 0;
+
+    ForwardBits(const uint8_t *data, size_t size) : data{data}, size{size} {}
+
+    bool overrun() const { return position > size * 8; }
+
+    uint32_t peek(unsigned int count) const
+    {
+        uint32_t value = 0;
+
+        for (unsigned int i = 0; i < count; i++)
+        {
+            size_t bit = position + i;
+
+            if (bit < size * 8)
+            {
+                value |= ((data[bit / 8] >> (bit % 8)) & 1) << i;
+            }
+        }
+
+        return value;
+    }
+
+    void consume(unsigned int count) { position += count; }
+
+    uint32_t read(unsigned int count)
+    {
+        uint32_t value = peek(count);
+        consume(count);
+        return value;
+    }
+
+    size_t consumed_bytes() const { return (position + 7) / 8; }
+};
+
+// Entropy coded streams are written forward and read from the end back,
+// starting below the highest set bit of the last byte. Past the start of
+// the stream they read zeroes, offset going negative says by how much.
+struct BackwardBits
+{
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    int64_t offset = 0;
+
+    bool begin(const uint8_t *stream, size_t stream_size)
+    {
+        if (stream_size == 0 || stream[stream_size - 1] == 0)
+        {
+            return false;
+        }
+
+        data = stream;
+        size = stream_size;
+        offset = stream_size * 8 - 8 + highest_bit(stream[stream_size - 1]);
+        return true;
+    }
+
+    uint64_t bits_at(size_t position, unsigned int count) const
+    {
+        size_t byte = position / 8;
+        uint64_t word = 0;
+
+        if (byte + 8 <= size)
+        {
+            memcpy(&word, data + byte, 8);
+        }
+        else
+        {
+            memcpy(&word, data + byte, size - byte);
+        }
+
+        return (word >> (position % 8)) & ((1ull << count) - 1);
+    }
+
+    ALWAYS_INLINE uint64_t read(unsigned int count)
+    {
+        if (count == 0)
+        {
+            return 0;
+        }
+
+        offset -= count;
+
+        if (offset >= 0)
+        {
+            return bits_at(offset, count);
+        }
+
+        int64_t available = offset + count;
+
+        if (available <= 0)
+        {
+            return 0;
+        }
+
+        return bits_at(0, available) << -offset;
+    }
+};
+
+struct FSEState
+{
+    const ZstdDecoder::FSETable &table;
+    uint32_t state;
+
+    FSEState(const ZstdDecoder::FSETable &table, BackwardBits &bits)
+        : table{table}, state(bits.read(table.log))
+    {
+    }
+
+    uint8_t symbol() const { return table.entries[state].symbol; }
+
+    ALWAYS_INLINE void update(BackwardBits &bits)
+    {
+        auto &entry = table.entries[state];
+        state = entry.base + bits.read(entry.bits);
+    }
+};
+
+// Reads the normalized distribution of an FSE table, returns how many
+// bytes it took.
+static ResultOr<size_t> read_distribution(const uint8_t *data, size_t size, int16_t *distribution, size_t max_count, size_t &count, unsigned int &log, unsigned int max_log)
+{
+    ForwardBits bits{data, size};
+
+    log = bits.read(4) + 5;
+
+    if (log > max_log)
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    int32_t remaining = 1 << log;
+    count = 0;
+
+    while (remaining > 0)
+    {
+        if (count >= max_count)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        // Values below threshold take one bit less.
+        unsigned int bit_count = highest_bit(remaining + 1) + 1;
+        uint32_t value = bits.peek(bit_count);
+        uint32_t lower_mask = (1u << (bit_count - 1)) - 1;
+        uint32_t threshold = (1u << bit_count) - 1 - (remaining + 1);
+
+        if ((value & lower_mask) < threshold)
+        {
+            value &= lower_mask;
+            bits.consume(bit_count - 1);
+        }
+        else
+        {
+            if (value > lower_mask)
+            {
+                value -= threshold;
+            }
+
+            bits.consume(bit_count);
+        }
+
+        int16_t probability = (int16_t)value - 1;
+        remaining -= probability < 0 ? -probability : probability;
+        distribution[count++] = probability;
+
+        // Zeroes are followed by how many more zeroes there are, 2 bits at
+        // a time.
+        if (probability == 0)
+        {
+            uint32_t repeat;
+
+            do
+            {
+                repeat = bits.read(2);
+
+                if (count + repeat > max_count)
+                {
+                    return ERR_INVALID_DATA;
+                }
+
+                for (uint32_t i = 0; i < repeat; i++)
+                {
+                    distribution[count++] = 0;
+                }
+            } while (repeat == 3 && !bits.overrun());
+        }
+
+        if (bits.overrun())
+        {
+            return ERR_INVALID_DATA;
+        }
+    }
+
+    if (remaining != 0)
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    return bits.consumed_bytes();
+}
+
+bool ZstdDecoder::FSETable::build(const int16_t *distribution, size_t count, unsigned int table_log)
+{
+    size_t size = 1 << table_log;
+    size_t mask = size - 1;
+    uint16_t next_state[256];
+
+    // "Less than 1" symbols get one state each at the end of the table.
+    size_t high = size;
+
+    for (size_t symbol = 0; symbol < count; symbol++)
+    {
+        if (distribution[symbol] == -1)
+        {
+            entries[--high].symbol = symbol;
+            next_state[symbol] = 1;
+        }
+    }
+
+    size_t step = (size >> 1) + (size >> 3) + 3;
+    size_t position = 0;
+
+    for (size_t symbol = 0; symbol < count; symbol++)
+    {
+        if (distribution[symbol] <= 0)
+        {
+            continue;
+        }
+
+        next_state[symbol] = distribution[symbol];
+
+        for (int16_t i = 0; i < distribution[symbol]; i++)
+        {
+            entries[position].symbol = symbol;
+
+            do
+            {
+                position = (position + step) & mask;
+            } while (position >= high);
+        }
+    }
+
+    if (position != 0)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < size; i++)
+    {
+        uint16_t state = next_state[entries[i].symbol]++;
+        entries[i].bits = table_log - highest_bit(state);
+        entries[i].base = (state << entries[i].bits) - size;
+    }
+
+    log = table_log;
+    built = true;
+    return true;
+}
+
+void ZstdDecoder::FSETable::build_rle(uint8_t symbol)
+{
+    entries[0] = {0, symbol, 0};
+    log = 0;
+    built = true;
+}
+
+bool ZstdDecoder::HuffmanTable::build(const uint8_t *weights, size_t count)
+{
+    uint32_t weight_sum = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (weights[i] > MAX_BITS)
+        {
+            return false;
+        }
+
+        weight_sum += weights[i] ? 1 << (weights[i] - 1) : 0;
+    }
+
+    if (weight_sum == 0)
+    {
+        return false;
+    }
+
+    // The weight of the last symbol is implied, it makes the sum the next
+    // power of two.
+    unsigned int table_bits = highest_bit(weight_sum) + 1;
+    uint32_t left = (1 << table_bits) - weight_sum;
+
+    if (table_bits > MAX_BITS || (left & (left - 1)) != 0)
+    {
+        return false;
+    }
+
+    uint8_t bits[256];
+
+    for (size_t i = 0; i < count; i++)
+    {
+        bits[i] = weights[i] ? table_bits + 1 - weights[i] : 0;
+    }
+
+    bits[count] = table_bits + 1 - (highest_bit(left) + 1);
+    count++;
+
+    // Longest codes first, each taking the range of table entries that
+    // start with it.
+    uint32_t rank_count[MAX_BITS + 2] = {};
+
+    for (size_t i = 0; i < count; i++)
+    {
+        rank_count[bits[i]]++;
+    }
+
+    uint32_t rank_start[MAX_BITS + 2];
+    rank_start[table_bits] = 0;
+
+    for (unsigned int length = table_bits; length >= 1; length--)
+    {
+        rank_start[length - 1] = rank_start[length] + rank_count[length] * (1 << (table_bits - length));
+    }
+
+    if (rank_start[0] != (1u << table_bits))
+    {
+        return false;
+    }
+
+    for (size_t symbol = 0; symbol < count; symbol++)
+    {
+        if (bits[symbol] == 0)
+        {
+            continue;
+        }
+
+        uint32_t code = rank_start[bits[symbol]];
+        uint32_t length = 1 << (table_bits - bits[symbol]);
+
+        for (uint32_t i = 0; i < length; i++)
+        {
+            entries[code + i] = {(uint8_t)symbol, bits[symbol]};
+        }
+
+        rank_start[bits[symbol]] += length;
+    }
+
+    max_bits = table_bits;
+    return true;
+}
+
+static JResult decode_huffman_stream(const ZstdDecoder::HuffmanTable &table, const uint8_t *data, size_t size, uint8_t *out, size_t count)
+{
+    BackwardBits bits;
+
+    if (!bits.begin(data, size))
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    uint32_t mask = (1 << table.max_bits) - 1;
+    uint32_t state = bits.read(table.max_bits);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        auto entry = table.entries[state];
+        out[i] = entry.symbol;
+        state = ((state << entry.bits) | bits.read(entry.bits)) & mask;
+    }
+
+    // The state always holds max_bits bits ahead.
+    if (bits.offset != -(int64_t)table.max_bits)
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    return SUCCESS;
+}
+
+ResultOr<size_t> ZstdDecoder::read_huffman_table(const uint8_t *data, size_t size)
+{
+    if (size < 1)
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    uint8_t header = data[0];
+    uint8_t weights[256];
+    size_t weight_count = 0;
+
+    if (header >= 128)
+    {
+        // Four bits per weight.
+        weight_count = header - 127;
+        size_t bytes = (weight_count + 1) / 2;
+
+        if (1 + bytes > size)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        for (size_t i = 0; i < weight_count; i++)
+        {
+            uint8_t byte = data[1 + i / 2];
+            weights[i] = i % 2 ? byte & 15 : byte >> 4;
+        }
+
+        if (!_huffman.build(weights, weight_count))
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        return 1 + bytes;
+    }
+
+    // FSE compressed weights, two interleaved states over one stream.
+    size_t compressed_size = header;
+
+    if (1 + compressed_size > size)
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    int16_t distribution[16];
+    size_t count;
+    unsigned int log;
+    size_t description_size = TRY(read_distribution(data + 1, compressed_size, distribution, 16, count, log, 6));
+
+    FSETable table;
+
+    if (!table.build(distribution, count, log))
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    BackwardBits bits;
+
+    if (!bits.begin(data + 1 + description_size, compressed_size - description_size))
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    FSEState first{table, bits};
+    FSEState second{table, bits};
+
+    while (true)
+    {
+        if (weight_count + 2 > 255)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        weights[weight_count++] = first.symbol();
+        first.update(bits);
+
+        if (bits.offset < 0)
+        {
+            weights[weight_count++] = second.symbol();
+            break;
+        }
+
+        weights[weight_count++] = second.symbol();
+        second.update(bits);
+
+        if (bits.offset < 0)
+        {
+            weights[weight_count++] = first.symbol();
+            break;
+        }
+    }
+
+    if (!_huffman.build(weights, weight_count))
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    return 1 + compressed_size;
+}
+
+ResultOr<size_t> ZstdDecoder::read_literals(const uint8_t *data, size_t size, const uint8_t *&literals, size_t &literals_size)
+{
+    if (size < 1)
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    auto type = (Zstd::LiteralsType)(data[0] & 3);
+    unsigned int size_format = (data[0] >> 2) & 3;
+
+    if (type == Zstd::LITERALS_RAW || type == Zstd::LITERALS_RLE)
+    {
+        size_t header_size = size_format == 1 ? 2 : (size_format == 3 ? 3 : 1);
+
+        if (header_size > size)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        uint64_t header = read_le(data, header_size);
+        literals_size = header_size == 1 ? header >> 3 : header >> 4;
+
+        if (type == Zstd::LITERALS_RAW)
+        {
+            if (header_size + literals_size > size)
+            {
+                return ERR_INVALID_DATA;
+            }
+
+            literals = data + header_size;
+            return header_size + literals_size;
+        }
+
+        if (header_size + 1 > size || literals_size > Zstd::MAX_BLOCK_SIZE)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        memset(_literals.raw_storage(), data[header_size], literals_size);
+        literals = _literals.raw_storage();
+        return header_size + 1;
+    }
+
+    static constexpr uint8_t HEADER_SIZES[] = {3, 3, 4, 5};
+    static constexpr uint8_t SIZE_BITS[] = {10, 10, 14, 18};
+
+    size_t header_size = HEADER_SIZES[size_format];
+    unsigned int size_bits = SIZE_BITS[size_format];
+    bool single_stream = size_format == 0;
+
+    if (header_size > size)
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    uint64_t header = read_le(data, header_size);
+    literals_size = (header >> 4) & ((1 << size_bits) - 1);
+    size_t compressed_size = (header >> (4 + size_bits)) & ((1 << size_bits) - 1);
+
+    if (header_size + compressed_size > size || literals_size > Zstd::MAX_BLOCK_SIZE)
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    const uint8_t *streams = data + header_size;
+    size_t streams_size = compressed_size;
+
+    if (type == Zstd::LITERALS_COMPRESSED)
+    {
+        size_t table_size = TRY(read_huffman_table(streams, streams_size));
+        streams += table_size;
+        streams_size -= table_size;
+        _has_huffman = true;
+    }
+    else if (!_has_huffman)
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    uint8_t *out = _literals.raw_storage();
+
+    if (single_stream)
+    {
+        TRY(decode_huffman_stream(_huffman, streams, streams_size, out, literals_size));
+    }
+    else
+    {
+        // A jump table with the sizes of the first three streams.
+        if (streams_size < 6)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        size_t sizes[4];
+        sizes[0] = streams[0] | (streams[1] << 8);
+        sizes[1] = streams[2] | (streams[3] << 8);
+        sizes[2] = streams[4] | (streams[5] << 8);
+
+        streams += 6;
+        streams_size -= 6;
+
+        if (sizes[0] + sizes[1] + sizes[2] > streams_size)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        sizes[3] = streams_size - sizes[0] - sizes[1] - sizes[2];
+
+        size_t segment = (literals_size + 3) / 4;
+
+        if (segment * 3 > literals_size)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        for (size_t i = 0; i < 4; i++)
+        {
+            size_t count = i < 3 ? segment : literals_size - segment * 3;
+            TRY(decode_huffman_stream(_huffman, streams, sizes[i], out + segment * i, count));
+            streams += sizes[i];
+        }
+    }
+
+    literals = out;
+    return header_size + compressed_size;
+}
+
+JResult ZstdDecoder::read_sequence_table(const uint8_t *&data, const uint8_t *end, Zstd::SymbolMode mode, FSETable &table, const int16_t *default_distribution, size_t default_count, unsigned int default_log, size_t max_count, unsigned int max_log)
+{
+    switch (mode)
+    {
+    case Zstd::MODE_PREDEFINED:
+        table.build(default_distribution, default_count, default_log);
+        return SUCCESS;
+
+    case Zstd::MODE_RLE:
+        if (data >= end || *data >= max_count)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        table.build_rle(*data++);
+        return SUCCESS;
+
+    case Zstd::MODE_COMPRESSED:
+    {
+        int16_t distribution[Zstd::MATCH_LENGTH_CODES];
+        size_t count;
+        unsigned int log;
+        data += TRY(read_distribution(data, end - data, distribution, max_count, count, log, max_log));
+
+        if (!table.build(distribution, count, log))
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        return SUCCESS;
+    }
+
+    case Zstd::MODE_REPEAT:
+        return table.built ? SUCCESS : ERR_INVALID_DATA;
+    }
+
+    return ERR_INVALID_DATA;
+}
+
+JResult ZstdDecoder::decode_compressed_block(const uint8_t *data, size_t size)
+{
+    const uint8_t *literals;
+    size_t literals_size;
+    size_t literals_section_size = TRY(read_literals(data, size, literals, literals_size));
+
+    const uint8_t *position = data + literals_section_size;
+    const uint8_t *end = data + size;
+
+    if (position >= end)
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    size_t sequence_count = *position++;
+
+    if (sequence_count >= 128)
+    {
+        if (sequence_count < 255)
+        {
+            if (position + 1 > end)
+            {
+                return ERR_INVALID_DATA;
+            }
+
+            sequence_count = ((sequence_count - 128) << 8) + *position++;
+        }
+        else
+        {
+            if (position + 2 > end)
+            {
+                return ERR_INVALID_DATA;
+            }
+
+            sequence_count = position[0] + (position[1] << 8) + 0x7F00;
+            position += 2;
+        }
+    }
+
+    uint8_t *window = _window.raw_storage();
+    size_t capacity = _window.count();
+
+    if (sequence_count > 0)
+    {
+        if (position >= end || (*position & 3))
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        uint8_t modes = *position++;
+
+        TRY(read_sequence_table(position, end, (Zstd::SymbolMode)(modes >> 6), _literal_lengths,
+                                Zstd::DEFAULT_LITERAL_LENGTH_DISTRIBUTION, Zstd::LITERAL_LENGTH_CODES, Zstd::DEFAULT_LITERAL_LENGTH_LOG,
+                                Zstd::LITERAL_LENGTH_CODES, Zstd::MAX_LITERAL_LENGTH_LOG));
+
+        TRY(read_sequence_table(position, end, (Zstd::SymbolMode)((modes >> 4) & 3), _offsets,
+                                Zstd::DEFAULT_OFFSET_DISTRIBUTION, Zstd::DEFAULT_OFFSET_CODES, Zstd::DEFAULT_OFFSET_LOG,
+                                Zstd::OFFSET_CODES, Zstd::MAX_OFFSET_LOG));
+
+        TRY(read_sequence_table(position, end, (Zstd::SymbolMode)((modes >> 2) & 3), _match_lengths,
+                                Zstd::DEFAULT_MATCH_LENGTH_DISTRIBUTION, Zstd::MATCH_LENGTH_CODES, Zstd::DEFAULT_MATCH_LENGTH_LOG,
+                                Zstd::MATCH_LENGTH_CODES, Zstd::MAX_MATCH_LENGTH_LOG));
+
+        BackwardBits bits;
+
+        if (!bits.begin(position, end - position))
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        FSEState literal_length_state{_literal_lengths, bits};
+        FSEState offset_state{_offsets, bits};
+        FSEState match_length_state{_match_lengths, bits};
+
+        for (size_t i = 0; i < sequence_count; i++)
+        {
+            uint8_t offset_code = offset_state.symbol();
+            uint8_t match_length_code = match_length_state.symbol();
+            uint8_t literal_length_code = literal_length_state.symbol();
+
+            if (offset_code >= Zstd::OFFSET_CODES ||
+                match_length_code >= Zstd::MATCH_LENGTH_CODES ||
+                literal_length_code >= Zstd::LITERAL_LENGTH_CODES)
+            {
+                return ERR_INVALID_DATA;
+            }
+
+            uint32_t offset_value = (1u << offset_code) + bits.read(offset_code);
+            size_t match_length = Zstd::MATCH_LENGTH_BASE[match_length_code] + bits.read(Zstd::MATCH_LENGTH_BITS[match_length_code]);
+            size_t literal_length = Zstd::LITERAL_LENGTH_BASE[literal_length_code] + bits.read(Zstd::LITERAL_LENGTH_BITS[literal_length_code]);
+
+            // 1 to 3 are the recent offsets, shifted by one after a
+            // sequence without literals.
+            size_t offset;
+
+            if (offset_value > 3)
+            {
+                offset = offset_value - 3;
+                _repeat_offsets[2] = _repeat_offsets[1];
+                _repeat_offsets[1] = _repeat_offsets[0];
+                _repeat_offsets[0] = offset;
+            }
+            else
+            {
+                size_t index = offset_value - 1 + (literal_length == 0);
+
+                if (index == 0)
+                {
+                    offset = _repeat_offsets[0];
+                }
+                else
+                {
+                    offset = index == 3 ? _repeat_offsets[0] - 1 : _repeat_offsets[index];
+
+                    if (index != 1)
+                    {
+                        _repeat_offsets[2] = _repeat_offsets[1];
+                    }
+
+                    _repeat_offsets[1] = _repeat_offsets[0];
+                    _repeat_offsets[0] = offset;
+                }
+            }
+
+            if (i + 1 < sequence_count)
+            {
+                literal_length_state.update(bits);
+                match_length_state.update(bits);
+                offset_state.update(bits);
+            }
+
+            if (literal_length > literals_size || literal_length + match_length > capacity - _used)
+            {
+                return ERR_INVALID_DATA;
+            }
+
+            memcpy(window + _used, literals, literal_length);
+            literals += literal_length;
+            literals_size -= literal_length;
+            _used += literal_length;
+
+            if (offset == 0 || offset > _used)
+            {
+                return ERR_INVALID_DATA;
+            }
+
+            uint8_t *dest = window + _used;
+            const uint8_t *source = dest - offset;
+
+            if (offset >= match_length)
+            {
+                memcpy(dest, source, match_length);
+            }
+            else
+            {
+                for (size_t j = 0; j < match_length; j++)
+                {
+                    dest[j] = source[j];
+                }
+            }
+
+            _used += match_length;
+        }
+
+        if (bits.offset != 0)
+        {
+            return ERR_INVALID_DATA;
+        }
+    }
+
+    if (literals_size > capacity - _used)
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    memcpy(window + _used, literals, literals_size);
+    _used += literals_size;
+
+    return SUCCESS;
+}
+
+void ZstdDecoder::slide_window()
+{
+    if (_used + _block_max <= _window.count())
+    {
+        return;
+    }
+
+    size_t keep = MIN(_used, _window_size);
+    memmove(_window.raw_storage(), _window.raw_storage() + _used - keep, keep);
+    _used = keep;
+}
+
+ResultOr<size_t> ZstdDecoder::read_frame(IO::Reader &compressed, IO::Writer &uncompressed, uint32_t magic)
+{
+    if ((magic & Zstd::SKIPPABLE_MASK) == Zstd::SKIPPABLE_MAGIC)
+    {
+        uint8_t size_bytes[4];
+        TRY(read_exactly(compressed, size_bytes, 4));
+
+        uint8_t discard[512];
+        size_t remaining = read32(size_bytes);
+
+        while (remaining > 0)
+        {
+            size_t chunk = MIN(remaining, sizeof(discard));
+            TRY(read_exactly(compressed, discard, chunk));
+            remaining -= chunk;
+        }
+
+        return 0;
+    }
+
+    if (magic != Zstd::FRAME_MAGIC)
+    {
+        IO::logln("Not a zstd frame: {08x}", magic);
+        return ERR_INVALID_DATA;
+    }
+
+    uint8_t descriptor;
+    TRY(read_exactly(compressed, &descriptor, 1));
+
+    unsigned int content_size_flag = descriptor >> 6;
+    bool single_segment = descriptor & 0x20;
+    bool has_checksum = descriptor & 0x04;
+    unsigned int dictionary_flag = descriptor & 3;
+
+    if (descriptor & 0x08)
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    uint8_t header[14];
+    size_t header_size = 0;
+
+    static constexpr uint8_t DICTIONARY_ID_SIZES[] = {0, 1, 2, 4};
+    static constexpr uint8_t CONTENT_SIZE_SIZES[] = {0, 2, 4, 8};
+
+    size_t window_descriptor_size = single_segment ? 0 : 1;
+    size_t dictionary_id_size = DICTIONARY_ID_SIZES[dictionary_flag];
+    size_t content_size_size = content_size_flag == 0 && single_segment ? 1 : CONTENT_SIZE_SIZES[content_size_flag];
+
+    header_size = window_descriptor_size + dictionary_id_size + content_size_size;
+    TRY(read_exactly(compressed, header, header_size));
+
+    uint64_t window_size = 0;
+
+    if (!single_segment)
+    {
+        unsigned int exponent = header[0] >> 3;
+        unsigned int mantissa = header[0] & 7;
+        uint64_t base = 1ull << (10 + exponent);
+        window_size = base + (base / 8) * mantissa;
+    }
+
+    if (dictionary_id_size && read_le(header + window_descriptor_size, dictionary_id_size) != 0)
+    {
+        IO::logln("zstd frames with a dictionary are not supported");
+        return ERR_NOT_IMPLEMENTED;
+    }
+
+    bool has_content_size = content_size_size != 0;
+    uint64_t content_size = read_le(header + window_descriptor_size + dictionary_id_size, content_size_size);
+
+    if (content_size_size == 2)
+    {
+        content_size += 256;
+    }
+
+    if (single_segment)
+    {
+        window_size = content_size;
+    }
+
+    if (window_size > Zstd::MAX_WINDOW_SIZE)
+    {
+        IO::logln("zstd window of {} bytes is too large", window_size);
+        return ERR_NOT_IMPLEMENTED;
+    }
+
+    _window_size = window_size;
+    _block_max = MIN(_window_size, Zstd::MAX_BLOCK_SIZE);
+    _used = 0;
+
+    // A single segment never slides, the whole content is the window.
+    size_t capacity = single_segment ? _window_size : _window_size * 2 + _block_max;
+
+    if (_window.count() < capacity)
+    {
+        _window.resize(capacity);
+    }
+
+    _block.resize(Zstd::MAX_BLOCK_SIZE);
+    _literals.resize(Zstd::MAX_BLOCK_SIZE);
+
+    _has_huffman = false;
+    _literal_lengths.built = false;
+    _match_lengths.built = false;
+    _offsets.built = false;
+
+    _repeat_offsets[0] = 1;
+    _repeat_offsets[1] = 4;
+    _repeat_offsets[2] = 8;
+
+    XXHash64 checksum;
+    uint64_t written = 0;
+    bool last = false;
+
+    while (!last)
+    {
+        uint8_t block_header_bytes[3];
+        TRY(read_exactly(compressed, block_header_bytes, 3));
+
+        uint32_t block_header = read_le(block_header_bytes, 3);
+        last = block_header & 1;
+        auto type = (Zstd::BlockType)((block_header >> 1) & 3);
+        size_t size = block_header >> 3;
+
+        if (size > _block_max)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        slide_window();
+
+        size_t start = _used;
+        uint8_t *window = _window.raw_storage();
+
+        if (type == Zstd::BLOCK_RAW)
+        {
+            if (size > _window.count() - _used)
+            {
+                return ERR_INVALID_DATA;
+            }
+
+            TRY(read_exactly(compressed, window + _used, size));
+            _used += size;
+        }
+        else if (type == Zstd::BLOCK_RLE)
+        {
+            if (size > _window.count() - _used)
+            {
+                return ERR_INVALID_DATA;
+            }
+
+            uint8_t byte;
+            TRY(read_exactly(compressed, &byte, 1));
+            memset(window + _used, byte, size);
+            _used += size;
+        }
+        else if (type == Zstd::BLOCK_COMPRESSED)
+        {
+            TRY(read_exactly(compressed, _block.raw_storage(), size));
+            TRY(decode_compressed_block(_block.raw_storage(), size));
+        }
+        else
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        checksum.add(window + start, _used - start);
+        TRY(IO::write_all(uncompressed, Slice{window + start, _used - start}));
+        written += _used - start;
+    }
+
+    if (has_content_size && written != content_size)
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    if (has_checksum)
+    {
+        uint8_t checksum_bytes[4];
+        TRY(read_exactly(compressed, checksum_bytes, 4));
+
+        if (read32(checksum_bytes) != (uint32_t)checksum.digest())
+        {
+            IO::logln("zstd content checksum mismatch");
+            return ERR_INVALID_DATA;
+        }
+    }
+
+    return written;
+}
+
+ResultOr<size_t> ZstdDecoder::perform(IO::Reader &compressed, IO::Writer &uncompressed)
+{
+    IO::ReadCounter counter{compressed};
+
+    while (true)
+    {
+        uint8_t magic[4];
+        size_t read = TRY(read_upto(counter, magic, 4));
+
+        if (read == 0)
+        {
+            break;
+        }
+
+        if (read < 4)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        TRY(read_frame(counter, uncompressed, read32(magic)));
+    }
+
+    return counter.count();
+}
+
+ResultOr<size_t> ZstdDecoder::perform(Slice compressed, IO::Writer &uncompressed)
+{
+    IO::MemoryReader reader{compressed};
+    return perform(reader, uncompressed);
+}
+
+void ZstdEncoder::FSETable::build(const int16_t *distribution, size_t count, unsigned int table_log)
+{
+    size_t size = 1 << table_log;
+    size_t mask = size - 1;
+    size_t step = (size >> 1) + (size >> 3) + 3;
+
+    // The same spread as the decoder's table.
+    uint8_t table_symbols[1 << Zstd::MAX_LITERAL_LENGTH_LOG];
+    uint32_t cumulative[Zstd::MATCH_LENGTH_CODES + 1];
+    size_t high = size - 1;
+
+    cumulative[0] = 0;
+
+    for (size_t symbol = 0; symbol < count; symbol++)
+    {
+        if (distribution[symbol] == -1)
+        {
+            cumulative[symbol + 1] = cumulative[symbol] + 1;
+            table_symbols[high--] = symbol;
+        }
+        else
+        {
+            cumulative[symbol + 1] = cumulative[symbol] + distribution[symbol];
+        }
+    }
+
+    size_t position = 0;
+
+    for (size_t symbol = 0; symbol < count; symbol++)
+    {
+        for (int16_t i = 0; i < distribution[symbol]; i++)
+        {
+            table_symbols[position] = symbol;
+
+            do
+            {
+                position = (position + step) & mask;
+            } while (position > high);
+        }
+    }
+
+    for (size_t i = 0; i < size; i++)
+    {
+        states[cumulative[table_symbols[i]]++] = size + i;
+    }
+
+    // How many bits a symbol takes from a state, and where its states are.
+    int32_t total = 0;
+
+    for (size_t symbol = 0; symbol < count; symbol++)
+    {
+        int16_t probability = distribution[symbol];
+
+        if (probability == 0)
+        {
+            symbols[symbol] = {0, ((table_log + 1) << 16) - (uint32_t)size};
+        }
+        else if (probability == -1 || probability == 1)
+        {
+            symbols[symbol] = {total - 1, (table_log << 16) - (uint32_t)size};
+            total++;
+        }
+        else
+        {
+            uint32_t max_bits = table_log - highest_bit(probability - 1);
+            uint32_t min_state = probability << max_bits;
+            symbols[symbol] = {total - probability, (max_bits << 16) - min_state};
+            total += probability;
+        }
+    }
+
+    log = table_log;
+}
+
+static inline uint8_t literal_length_code(uint32_t length)
+{
+    if (length < 16)
+    {
+        return length;
+    }
+
+    if (length >= 64)
+    {
+        return highest_bit(length) + 19;
+    }
+
+    uint8_t code = 24;
+
+    while (Zstd::LITERAL_LENGTH_BASE[code] > length)
+    {
+        code--;
+    }
+
+    return code;
+}
+
+static inline uint8_t match_length_code(uint32_t length)
+{
+    uint32_t value = length - 3;
+
+    if (value < 32)
+    {
+        return value;
+    }
+
+    if (value >= 128)
+    {
+        return highest_bit(value) + 36;
+    }
+
+    uint8_t code = 42;
+
+    while (Zstd::MATCH_LENGTH_BASE[code] > length)
+    {
+        code--;
+    }
+
+    return code;
+}
+
+// Writes forward, from the first bit of the first byte. Stops writing once
+// out is full, the block is then stored as is instead.
+struct ForwardBitWriter
+{
+    uint8_t *out;
+    size_t capacity;
+    size_t position = 0;
+    uint64_t container = 0;
+    unsigned int count = 0;
+
+    ForwardBitWriter(uint8_t *out, size_t capacity) : out{out}, capacity{capacity} {}
+
+    bool overflow() const { return position > capacity; }
+
+    ALWAYS_INLINE void add(uint64_t value, unsigned int bits)
+    {
+        container |= (value & ((1ull << bits) - 1)) << count;
+        count += bits;
+
+        while (count >= 8)
+        {
+            if (position < capacity)
+            {
+                out[position] = container;
+            }
+
+            position++;
+            container >>= 8;
+            count -= 8;
+        }
+    }
+
+    // A closing bit marks where the stream starts for the reader.
+    void close()
+    {
+        add(1, 1);
+
+        if (count > 0)
+        {
+            add(0, 8 - count);
+        }
+    }
+};
+
+struct FSEEncoderState
+{
+    const ZstdEncoder::FSETable &table;
+    uint32_t value;
+
+    FSEEncoderState(const ZstdEncoder::FSETable &table, uint8_t symbol) : table{table}
+    {
+        auto &transform = table.symbols[symbol];
+        uint32_t bits = (transform.delta_bits + (1 << 15)) >> 16;
+        value = (bits << 16) - transform.delta_bits;
+        value = table.states[(value >> bits) + transform.find_state];
+    }
+
+    ALWAYS_INLINE void encode(ForwardBitWriter &bits, uint8_t symbol)
+    {
+        auto &transform = table.symbols[symbol];
+        uint32_t count = (value + transform.delta_bits) >> 16;
+        bits.add(value, count);
+        value = table.states[(value >> count) + transform.find_state];
+    }
+
+    void flush(ForwardBitWriter &bits)
+    {
+        bits.add(value, table.log);
+    }
+};
+
+ZstdEncoder::ZstdEncoder()
+{
+    _window.resize(WINDOW_SIZE * 2 + BLOCK_SIZE);
+    _hash_table.resize(HASH_SIZE);
+    _compressed.resize(BLOCK_SIZE);
+    _literals.ensure_capacity(BLOCK_SIZE);
+
+    _literal_lengths.build(Zstd::DEFAULT_LITERAL_LENGTH_DISTRIBUTION, Zstd::LITERAL_LENGTH_CODES, Zstd::DEFAULT_LITERAL_LENGTH_LOG);
+    _match_lengths.build(Zstd::DEFAULT_MATCH_LENGTH_DISTRIBUTION, Zstd::MATCH_LENGTH_CODES, Zstd::DEFAULT_MATCH_LENGTH_LOG);
+    _offsets.build(Zstd::DEFAULT_OFFSET_DISTRIBUTION, Zstd::DEFAULT_OFFSET_CODES, Zstd::DEFAULT_OFFSET_LOG);
+}
+
+static inline uint32_t zstd_hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - ZstdEncoder::HASH_BITS);
+}
+
+void ZstdEncoder::find_sequences(size_t start, size_t end)
+{
+    const uint8_t *data = _window.raw_storage();
+    uint64_t *table = _hash_table.raw_storage();
+
+    _sequences.clear();
+    _literals.clear();
+
+    size_t anchor = start;
+    size_t ip = start;
+
+    // Leaves room for the 4 byte reads.
+    if (end - start > 8 + MIN_MATCH)
+    {
+        size_t limit = end - 8;
+
+        while (ip < limit)
+        {
+            uint32_t sequence = read32(data + ip);
+            uint32_t hash = zstd_hash(sequence);
+            uint64_t candidate = table[hash];
+            table[hash] = _window_position + ip + 1;
+
+            if (candidate == 0 ||
+                candidate - 1 < _window_position ||
+                _window_position + ip - (candidate - 1) >= WINDOW_SIZE ||
+                read32(data + (candidate - 1 - _window_position)) != sequence)
+            {
+                // Skips ahead faster the longer nothing matched.
+                ip += 1 + ((ip - anchor) >> 8);
+                continue;
+            }
+
+            size_t match = candidate - 1 - _window_position;
+
+            while (ip > anchor && match > 0 && data[ip - 1] == data[match - 1])
+            {
+                ip--;
+                match--;
+            }
+
+            size_t length = MIN_MATCH;
+
+            while (ip + length < end && data[ip + length] == data[match + length])
+            {
+                length++;
+            }
+
+            _sequences.push_back({(uint32_t)(ip - anchor), (uint32_t)length, (uint32_t)(ip - match)});
+            _literals.push_back_many(data + anchor, ip - anchor);
+
+            ip += length;
+            anchor = ip;
+
+            if (ip < limit)
+            {
+                table[zstd_hash(read32(data + ip - 2))] = _window_position + ip - 2 + 1;
+            }
+        }
+    }
+
+    _literals.push_back_many(data + anchor, end - anchor);
+}
+
+// Raw literals and the sequences coded with the predefined tables, which
+// need no table descriptions. Returns 0 when it doesn't fit in a block.
+size_t ZstdEncoder::write_compressed_block(uint8_t *out)
+{
+    size_t capacity = _compressed.count();
+    size_t position = 0;
+
+    size_t literals_size = _literals.count();
+
+    if (literals_size + 8 > capacity)
+    {
+        return 0;
+    }
+
+    if (literals_size < 32)
+    {
+        out[position++] = Zstd::LITERALS_RAW | (literals_size << 3);
+    }
+    else if (literals_size < 4096)
+    {
+        out[position++] = Zstd::LITERALS_RAW | (1 << 2) | ((literals_size & 15) << 4);
+        out[position++] = literals_size >> 4;
+    }
+    else
+    {
+        out[position++] = Zstd::LITERALS_RAW | (3 << 2) | ((literals_size & 15) << 4);
+        out[position++] = literals_size >> 4;
+        out[position++] = literals_size >> 12;
+    }
+
+    memcpy(out + position, _literals.raw_storage(), literals_size);
+    position += literals_size;
+
+    size_t sequence_count = _sequences.count();
+
+    if (sequence_count < 128)
+    {
+        out[position++] = sequence_count;
+    }
+    else if (sequence_count < 0x7F00)
+    {
+        out[position++] = (sequence_count >> 8) + 128;
+        out[position++] = sequence_count;
+    }
+    else
+    {
+        out[position++] = 255;
+        out[position++] = (sequence_count - 0x7F00);
+        out[position++] = (sequence_count - 0x7F00) >> 8;
+    }
+
+    if (sequence_count == 0)
+    {
+        return position;
+    }
+
+    out[position++] = (Zstd::MODE_PREDEFINED << 6) | (Zstd::MODE_PREDEFINED << 4) | (Zstd::MODE_PREDEFINED << 2);
+
+    ForwardBitWriter bits{out + position, capacity - position};
+
+    // Sequences go in backward, the decoder reads them front to back.
+    auto codes = [](const Sequence &sequence, uint8_t &literal_length, uint8_t &match_length, uint8_t &offset, uint32_t &offset_value) {
+        literal_length = literal_length_code(sequence.literal_length);
+        match_length = match_length_code(sequence.match_length);
+        offset_value = sequence.offset + 3;
+        offset = highest_bit(offset_value);
+    };
+
+    auto add_extra_bits = [&](const Sequence &sequence, uint8_t literal_length, uint8_t match_length, uint8_t offset, uint32_t offset_value) {
+        bits.add(sequence.literal_length - Zstd::LITERAL_LENGTH_BASE[literal_length], Zstd::LITERAL_LENGTH_BITS[literal_length]);
+        bits.add(sequence.match_length - Zstd::MATCH_LENGTH_BASE[match_length], Zstd::MATCH_LENGTH_BITS[match_length]);
+        bits.add(offset_value, offset);
+    };
+
+    uint8_t literal_length, match_length, offset;
+    uint32_t offset_value;
+
+    auto &last = _sequences[sequence_count - 1];
+    codes(last, literal_length, match_length, offset, offset_value);
+
+    FSEEncoderState match_length_state{_match_lengths, match_length};
+    FSEEncoderState offset_state{_offsets, offset};
+    FSEEncoderState literal_length_state{_literal_lengths, literal_length};
+
+    add_extra_bits(last, literal_length, match_length, offset, offset_value);
+
+    for (size_t i = sequence_count - 1; i-- > 0;)
+    {
+        auto &sequence = _sequences[i];
+        codes(sequence, literal_length, match_length, offset, offset_value);
+
+        offset_state.encode(bits, offset);
+        match_length_state.encode(bits, match_length);
+        literal_length_state.encode(bits, literal_length);
+
+        add_extra_bits(sequence, literal_length, match_length, offset, offset_value);
+
+        if (bits.overflow())
+        {
+            return 0;
+        }
+    }
+
+    match_length_state.flush(bits);
+    offset_state.flush(bits);
+    literal_length_state.flush(bits);
+    bits.close();
+
+    if (bits.overflow())
+    {
+        return 0;
+    }
+
+    return position + bits.position;
+}
+
+void ZstdEncoder::slide_window()
+{
+    if (_used + BLOCK_SIZE <= _window.count())
+    {
+        return;
+    }
+
+    size_t keep = MIN(_used, WINDOW_SIZE);
+    memmove(_window.raw_storage(), _window.raw_storage() + _used - keep, keep);
+    _window_position += _used - keep;
+    _used = keep;
+}
+
+JResult ZstdEncoder::perform(IO::Reader &uncompressed, IO::Writer &compressed)
+{
+    memset(_hash_table.raw_storage(), 0, HASH_SIZE * sizeof(uint64_t));
+
+    _used = 0;
+    _window_position = 0;
+
+    // A content checksum, no content size since it isn't known up front.
+    uint8_t header[6];
+    write32(header, Zstd::FRAME_MAGIC);
+    header[4] = 0x04;
+    header[5] = (WINDOW_LOG - 10) << 3;
+    TRY(IO::write_all(compressed, Slice{header, sizeof(header)}));
+
+    XXHash64 checksum;
+    bool last = false;
+
+    while (!last)
+    {
+        slide_window();
+
+        uint8_t *block = _window.raw_storage() + _used;
+        size_t size = TRY(read_upto(uncompressed, block, BLOCK_SIZE));
+        last = size < BLOCK_SIZE;
+
+        checksum.add(block, size);
+
+        size_t compressed_size = 0;
+
+        if (size > 0)
+        {
+            find_sequences(_used, _used + size);
+            compressed_size = write_compressed_block(_compressed.raw_storage());
+        }
+
+        uint8_t block_header[3];
+        auto write_block_header = [&](Zstd::BlockType type, size_t block_size) {
+            uint32_t value = last | (type << 1) | (block_size << 3);
+            block_header[0] = value;
+            block_header[1] = value >> 8;
+            block_header[2] = value >> 16;
+        };
+
+        if (compressed_size > 0 && compressed_size < size)
+        {
+            write_block_header(Zstd::BLOCK_COMPRESSED, compressed_size);
+            TRY(IO::write_all(compressed, Slice{block_header, 3}));
+            TRY(IO::write_all(compressed, Slice{_compressed.raw_storage(), compressed_size}));
+        }
+        else
+        {
+            write_block_header(Zstd::BLOCK_RAW, size);
+            TRY(IO::write_all(compressed, Slice{block_header, 3}));
+            TRY(IO::write_all(compressed, Slice{block, size}));
+        }
+
+        _used += size;
+    }
+
+    uint8_t trailer[4];
+    write32(trailer, (uint32_t)checksum.digest());
+    TRY(IO::write_all(compressed, Slice{trailer, sizeof(trailer)}));
+
+    return SUCCESS;
+}
+
+}
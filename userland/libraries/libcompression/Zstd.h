@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <libabi/Result.h>
+#include <libcompression/XXHash.h>
+#include <libio/Reader.h>
+#include <libio/Writer.h>
+#include <libutils/Prelude.h>
+#include <libutils/Slice.h>
+#include <libutils/Vector.h>
+
+namespace Compression
+{
+
+// Zstandard frames (RFC 8878). A block is literals, Huffman coded or not,
+// and sequences of (literal length, match length, offset) coded with
+// tANS (FSE) tables, which decode at several times the speed of Inflate.
+
+namespace Zstd
+{
+
+static constexpr uint32_t FRAME_MAGIC = 0xFD2FB528;
+static constexpr uint32_t SKIPPABLE_MAGIC = 0x184D2A50;
+static constexpr uint32_t SKIPPABLE_MASK = 0xFFFFFFF0;
+
+static constexpr size_t MAX_BLOCK_SIZE = 128 * 1024;
+
+// Frames may ask for up to 3.75TB of window, which nobody uses. zstd
+// itself refuses more than 128MB without --long.
+static constexpr size_t MAX_WINDOW_SIZE = 128 * 1024 * 1024;
+
+enum BlockType
+{
+    BLOCK_RAW = 0,
+    BLOCK_RLE = 1,
+    BLOCK_COMPRESSED = 2,
+};
+
+enum LiteralsType
+{
+    LITERALS_RAW = 0,
+    LITERALS_RLE = 1,
+    LITERALS_COMPRESSED = 2,
+    LITERALS_TREELESS = 3,
+};
+
+enum SymbolMode
+{
+    MODE_PREDEFINED = 0,
+    MODE_RLE = 1,
+    MODE_COMPRESSED = 2,
+    MODE_REPEAT = 3,
+};
+
+static constexpr size_t LITERAL_LENGTH_CODES = 36;
+static constexpr size_t MATCH_LENGTH_CODES = 53;
+static constexpr size_t OFFSET_CODES = 32;
+
+static constexpr unsigned int MAX_LITERAL_LENGTH_LOG = 9;
+static constexpr unsigned int MAX_MATCH_LENGTH_LOG = 9;
+static constexpr unsigned int MAX_OFFSET_LOG = 8;
+
+static constexpr uint32_t LITERAL_LENGTH_BASE[LITERAL_LENGTH_CODES] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048, 4096,
+    8192, 16384, 32768, 65536};
+
+static constexpr uint8_t LITERAL_LENGTH_BITS[LITERAL_LENGTH_CODES] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+    13, 14, 15, 16};
+
+static constexpr uint32_t MATCH_LENGTH_BASE[MATCH_LENGTH_CODES] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+    19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+    35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051,
+    4099, 8195, 16387, 32771, 65539};
+
+static constexpr uint8_t MATCH_LENGTH_BITS[MATCH_LENGTH_CODES] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+    12, 13, 14, 15, 16};
+
+// The distributions of the predefined tables, -1 is "less than 1".
+static constexpr unsigned int DEFAULT_LITERAL_LENGTH_LOG = 6;
+static constexpr int16_t DEFAULT_LITERAL_LENGTH_DISTRIBUTION[LITERAL_LENGTH_CODES] = {
+    4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+    -1, -1, -1, -1};
+
+static constexpr unsigned int DEFAULT_MATCH_LENGTH_LOG = 6;
+static constexpr int16_t DEFAULT_MATCH_LENGTH_DISTRIBUTION[MATCH_LENGTH_CODES] = {
+    1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+    -1, -1, -1, -1, -1};
+
+static constexpr unsigned int DEFAULT_OFFSET_LOG = 5;
+static constexpr size_t DEFAULT_OFFSET_CODES = 29;
+static constexpr int16_t DEFAULT_OFFSET_DISTRIBUTION[DEFAULT_OFFSET_CODES] = {
+    1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1};
+
+}
+
+struct ZstdDecoder
+{
+public:
+    // An FSE decoding table of 1 << log states.
+    struct FSETable
+    {
+        struct Entry
+        {
+            uint16_t base;
+            uint8_t symbol;
+            uint8_t bits;
+        };
+
+        // Repeat mode uses whatever a block of the frame built last.
+        bool built = false;
+        unsigned int log = 0;
+        Entry entries[1 << Zstd::MAX_LITERAL_LENGTH_LOG];
+
+        bool build(const int16_t *distribution, size_t count, unsigned int log);
+        void build_rle(uint8_t symbol);
+    };
+
+    // A Huffman decoding table indexed by the next max_bits bits.
+    struct HuffmanTable
+    {
+        static constexpr unsigned int MAX_BITS = 11;
+
+        struct Entry
+        {
+            uint8_t symbol;
+            uint8_t bits;
+        };
+
+        unsigned int max_bits = 0;
+        Entry entries[1 << MAX_BITS];
+
+        bool build(const uint8_t *weights, size_t count);
+    };
+
+private:
+    Vector<uint8_t> _block;
+    Vector<uint8_t> _literals;
+
+    // The window and the block being decoded after it. It only slides when
+    // full, so every byte moves about once.
+    Vector<uint8_t> _window;
+    size_t _window_size = 0;
+    size_t _block_max = 0;
+    size_t _used = 0;
+
+    // Tables stay around for the blocks that repeat them.
+    HuffmanTable _huffman;
+    bool _has_huffman = false;
+
+    FSETable _literal_lengths;
+    FSETable _match_lengths;
+    FSETable _offsets;
+
+    uint32_t _repeat_offsets[3];
+
+    ResultOr<size_t> read_literals(const uint8_t *data, size_t size, const uint8_t *&literals, size_t &literals_size);
+    ResultOr<size_t> read_huffman_table(const uint8_t *data, size_t size);
+    JResult read_sequence_table(const uint8_t *&data, const uint8_t *end, Zstd::SymbolMode mode, FSETable &table, const int16_t *default_distribution, size_t default_count, unsigned int default_log, size_t max_count, unsigned int max_log);
+    JResult decode_compressed_block(const uint8_t *data, size_t size);
+
+    void slide_window();
+    ResultOr<size_t> read_frame(IO::Reader &compressed, IO::Writer &uncompressed, uint32_t magic);
+
+public:
+    // Decodes every frame up to the end of the input, skipping skippable
+    // frames. Both return the number of compressed bytes consumed.
+    ResultOr<size_t> perform(IO::Reader &compressed, IO::Writer &uncompressed);
+
+    ResultOr<size_t> perform(Slice compressed, IO::Writer &uncompressed);
+};
+
+struct ZstdEncoder
+{
+public:
+    static constexpr unsigned int WINDOW_LOG = 20;
+    static constexpr size_t WINDOW_SIZE = 1 << WINDOW_LOG;
+    static constexpr size_t BLOCK_SIZE = Zstd::MAX_BLOCK_SIZE;
+
+    static constexpr unsigned int HASH_BITS = 16;
+    static constexpr size_t HASH_SIZE = 1 << HASH_BITS;
+
+    static constexpr size_t MIN_MATCH = 4;
+
+    // An FSE encoding table, built from the same distribution as the
+    // decoder's one.
+    struct FSETable
+    {
+        struct Symbol
+        {
+            int32_t find_state;
+            uint32_t delta_bits;
+        };
+
+        unsigned int log = 0;
+        uint16_t states[1 << Zstd::MAX_LITERAL_LENGTH_LOG];
+        Symbol symbols[Zstd::MATCH_LENGTH_CODES];
+
+        void build(const int16_t *distribution, size_t count, unsigned int log);
+    };
+
+    struct Sequence
+    {
+        uint32_t literal_length;
+        uint32_t match_length;
+        uint32_t offset;
+    };
+
+private:
+    // The window and the block being compressed after it, like the
+    // decoder's.
+    Vector<uint8_t> _window;
+    size_t _used = 0;
+    uint64_t _window_position = 0;
+
+    // Stream position + 1 of the last 4 bytes with a given hash.
+    Vector<uint64_t> _hash_table;
+
+    Vector<Sequence> _sequences;
+    Vector<uint8_t> _literals;
+    Vector<uint8_t> _compressed;
+
+    FSETable _literal_lengths;
+    FSETable _match_lengths;
+    FSETable _offsets;
+
+    void find_sequences(size_t start, size_t end);
+    size_t write_compressed_block(uint8_t *out);
+    void slide_window();
+
+public:
+    ZstdEncoder();
+
+    JResult perform(IO::Reader &uncompressed, IO::Writer &compressed);
+};
+
+}
@@ -5,9 +5,15 @@
 */
 
 // includes
+#include <string.h>
 #include <libfile/Archive.h>
 #include <libfile/TARArchive.h>
 #include <libfile/ZipArchive.h>
+#include <libio/File.h>
+#include <libio/Streams.h>
+#include <libsystem/io/FileSystem.h>
+#include <libsystem/system/System.h>
+#include <libutils/Threads.h>
 
 RefPtr<Archive> Archive::open(IO::Path path, bool read)
 {
@@ -15,7 +21,7 @@ RefPtr<Archive> Archive::open(IO::Path path, bool read)
     {
         return make<ZipArchive>(path, read);
     }
-    else if (path.extension() == ".tar")
+    else if (path.extension() == ".tar" || path.extension() == ".tar.gz" || path.extension() == ".tgz")
     {
         return make<TARArchive>(path, read);
     }
@@ -23,4 +29,310 @@ RefPtr<Archive> Archive::open(IO::Path path, bool read)
     {
         return nullptr;
     }
-}
\ No newline at end of file
+}
+
+void Archive::create_parent_directories(const IO::Path &path)
+{
+    // Existing directories make mkdir fail, which is fine here: a real
+    // problem shows up when the file itself gets opened.
+    for (size_t i = 0; i + 1 < path.length(); i++)
+    {
+        filesystem_mkdir(path.parent(i).string().cstring());
+    }
+}
+
+ResultOr<IO::Path> Archive::entry_destination(const IO::Path &destination, const String &name)
+{
+    auto path = IO::Path::parse(name);
+    auto normalized = path.normalized();
+
+    if (path.absolute() || (normalized.length() > 0 && normalized[0] == ".."))
+    {
+        IO::logln("Archive: Entry {} would be extracted outside of the destination", name);
+        return ERR_INVALID_DATA;
+    }
+
+    return IO::Path::join(destination, normalized);
+}
+
+static bool is_directory_entry(const Archive::Entry &entry)
+{
+    return entry.name.length() > 0 && entry.name[entry.name.length() - 1] == '/';
+}
+
+JResult Archive::extract_entry_to(unsigned int entry_index, const IO::Path &path)
+{
+    IO::File file{path, J_OPEN_WRITE | J_OPEN_CREATE};
+    TRY(file.result());
+    return extract(entry_index, file);
+}
+
+JResult Archive::extract_all(IO::Path destination, size_t thread_count)
+{
+    Tick start = system_get_ticks();
+
+    // All of them before anything is written, so that a bad archive leaves
+    // nothing behind.
+    Vector<IO::Path> entry_paths(_entries.count());
+
+    for (const auto &entry : _entries)
+    {
+        entry_paths.push_back(TRY(entry_destination(destination, entry.name)));
+    }
+
+    // The directories on this thread first, the workers then only create
+    // files in them.
+    size_t file_count = 0;
+
+    for (size_t i = 0; i < _entries.count(); i++)
+    {
+        create_parent_directories(entry_paths[i]);
+
+        if (is_directory_entry(_entries[i]))
+        {
+            filesystem_mkdir(entry_paths[i].string().cstring());
+        }
+        else
+        {
+            file_count++;
+        }
+    }
+
+    if (thread_count == 0)
+    {
+        thread_count = Utils::processor_count();
+    }
+
+    thread_count = MIN(thread_count, MAX(file_count, (size_t)1));
+
+    size_t next_entry = 0;
+    size64_t total_size = 0;
+    int first_error = SUCCESS;
+
+    // Workers take the next entry as they are done with the last one, so
+    // a few big ones don't hold back the rest.
+    Utils::run_on_threads(thread_count, [&]() {
+        while (__atomic_load_n(&first_error, __ATOMIC_RELAXED) == SUCCESS)
+        {
+            size_t index = __atomic_fetch_add(&next_entry, 1, __ATOMIC_RELAXED);
+
+            if (index >= _entries.count())
+            {
+                return;
+            }
+
+            const auto &entry = _entries[index];
+
+            if (is_directory_entry(entry))
+            {
+                continue;
+            }
+
+            JResult result = extract_entry_to(index, entry_paths[index]);
+
+            if (result != SUCCESS)
+            {
+                int expected = SUCCESS;
+                __atomic_compare_exchange_n(&first_error, &expected, (int)result, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+                return;
+            }
+
+            __atomic_fetch_add(&total_size, entry.uncompressed_size, __ATOMIC_RELAXED);
+        }
+    });
+
+    if (first_error != SUCCESS)
+    {
+        return (JResult)first_error;
+    }
+
+    Tick elapsed = system_get_ticks() - start;
+    IO::logln("Extracted {} entries ({} bytes) in {} ticks on {} threads", _entries.count(), total_size, elapsed, thread_count);
+
+    return SUCCESS;
+}
+
+static size_t index_capacity(size_t count)
+{
+    size_t capacity = 16;
+
+    // Keep the table at most half full so probe sequences stay short.
+    while (capacity < count * 2)
+    {
+        capacity *= 2;
+    }
+
+    return capacity;
+}
+
+static bool name_equals(const String &name, const char *other, size_t length)
+{
+    return name.length() == length && memcmp(name.cstring(), other, length) == 0;
+}
+
+static size_t without_trailing_slash(const String &name)
+{
+    size_t length = name.length();
+
+    while (length > 0 && name.cstring()[length - 1] == '/')
+    {
+        length--;
+    }
+
+    return length;
+}
+
+static size_t parent_length(const char *path, size_t length)
+{
+    while (length > 0 && path[length - 1] != '/')
+    {
+        length--;
+    }
+
+    return length > 0 ? length - 1 : 0;
+}
+
+void Archive::build_name_index()
+{
+    _name_index.clear();
+    _name_index.resize(index_capacity(_entries.count()));
+
+    size_t mask = _name_index.count() - 1;
+
+    for (size_t i = 0; i < _entries.count(); i++)
+    {
+        const auto &name = _entries[i].name;
+        size_t slot = hash(name.cstring(), name.length()) & mask;
+
+        while (_name_index[slot] != 0)
+        {
+            slot = (slot + 1) & mask;
+        }
+
+        _name_index[slot] = i + 1;
+    }
+}
+
+Optional<unsigned int> Archive::lookup(const String &name)
+{
+    if (_name_index.empty())
+    {
+        build_name_index();
+    }
+
+    size_t mask = _name_index.count() - 1;
+    size_t slot = hash(name.cstring(), name.length()) & mask;
+
+    while (_name_index[slot] != 0)
+    {
+        unsigned int index = _name_index[slot] - 1;
+
+        if (_entries[index].name == name)
+        {
+            return index;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    return NONE;
+}
+
+unsigned int Archive::find_or_add_directory(const char *path, size_t length)
+{
+    size_t mask = _directory_index.count() - 1;
+    size_t slot = hash(path, length) & mask;
+
+    while (_directory_index[slot] != 0)
+    {
+        unsigned int index = _directory_index[slot] - 1;
+
+        if (name_equals(_directories[index].path, path, length))
+        {
+            return index;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    unsigned int index = _directories.count();
+    _directories.push_back({String{path, length}, {}, {}});
+    _directory_index[slot] = index + 1;
+
+    // Zip and tar only list directories implicitly through the paths of
+    // their content, so create the parents on the way up.
+    if (length > 0)
+    {
+        unsigned int parent = find_or_add_directory(path, parent_length(path, length));
+        _directories[parent].directories.push_back(index);
+    }
+
+    return index;
+}
+
+void Archive::build_directories()
+{
+    _directories.clear();
+    _directory_index.clear();
+
+    // Every entry adds at most one directory of its own plus its parents,
+    // grow the table ahead of time so find_or_add_directory never has to.
+    size_t max_directories = 1;
+
+    for (const auto &entry : _entries)
+    {
+        const char *name = entry.name.cstring();
+
+        for (size_t i = 0; i < entry.name.length(); i++)
+        {
+            max_directories += name[i] == '/';
+        }
+
+        max_directories++;
+    }
+
+    _directory_index.resize(index_capacity(max_directories));
+
+    find_or_add_directory("", 0);
+
+    for (size_t i = 0; i < _entries.count(); i++)
+    {
+        const auto &name = _entries[i].name;
+        size_t length = without_trailing_slash(name);
+
+        if (length != name.length())
+        {
+            find_or_add_directory(name.cstring(), length);
+            continue;
+        }
+
+        unsigned int parent = find_or_add_directory(name.cstring(), parent_length(name.cstring(), length));
+        _directories[parent].entries.push_back(i);
+    }
+}
+
+const Archive::Directory *Archive::directory(const String &path)
+{
+    if (_directories.empty())
+    {
+        build_directories();
+    }
+
+    size_t length = without_trailing_slash(path);
+    size_t mask = _directory_index.count() - 1;
+    size_t slot = hash(path.cstring(), length) & mask;
+
+    while (_directory_index[slot] != 0)
+    {
+        unsigned int index = _directory_index[slot] - 1;
+
+        if (name_equals(_directories[index].path, path.cstring(), length))
+        {
+            return &_directories[index];
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    return nullptr;
+}
@@ -11,23 +11,63 @@
 #include <libio/Path.h>
 #include <libio/Reader.h>
 #include <libio/Writer.h>
+#include <libutils/Optional.h>
 struct Archive : public RefCounted<Archive>
 {
 public:
     struct Entry
     {
         String name;
-        size_t uncompressed_size;
-        size_t compressed_size;
-        size_t archive_offset;
+        size64_t uncompressed_size;
+        size64_t compressed_size;
+        size64_t archive_offset;
         unsigned int compression;
     };
 
+    // Entries and subdirectories directly inside a directory of the archive,
+    // the root is the empty path. Paths have no trailing slash.
+    struct Directory
+    {
+        String path;
+        Vector<unsigned int> entries;
+        Vector<unsigned int> directories;
+    };
+
+private:
+    // Open addressing tables, slots hold an index into _entries or
+    // _directories plus one, 0 is an empty slot. Both are built on first
+    // use and thrown away whenever the entry list changes.
+    Vector<unsigned int> _name_index;
+    Vector<unsigned int> _directory_index;
+    Vector<Directory> _directories;
+
+    void build_name_index();
+    void build_directories();
+    unsigned int find_or_add_directory(const char *path, size_t length);
+
 protected:
     Vector<Entry> _entries;
     IO::Path _path;
     bool _valid = true;
 
+    // Must be called after _entries was modified.
+    void invalidate_index()
+    {
+        _name_index.clear();
+        _directory_index.clear();
+        _directories.clear();
+    }
+
+    // Creates every directory above path, for the extraction of an entry.
+    static void create_parent_directories(const IO::Path &path);
+
+    // Where the entry called name goes below destination. Names come from
+    // the archive, ERR_INVALID_DATA for those that would land outside of
+    // it: absolute ones and those that climb out with "..".
+    static ResultOr<IO::Path> entry_destination(const IO::Path &destination, const String &name);
+
+    JResult extract_entry_to(unsigned int entry_index, const IO::Path &path);
+
 public:
     static RefPtr<Archive> open(IO::Path path, bool read = true);
 
@@ -40,9 +80,26 @@ public:
         return _entries;
     }
 
+    // Index of the entry with exactly this name.
+    Optional<unsigned int> lookup(const String &name);
+
+    const Directory *directory(const String &path);
+
+    // Only valid after a call to directory().
+    inline const Vector<Directory> &directories()
+    {
+        return _directories;
+    }
+
     virtual JResult extract(unsigned int entry_index, IO::Writer &writer) = 0;
     virtual JResult insert(const char *entry_name, IO::Reader &reader) = 0;
 
+    // Extract every entry below destination, recreating the archive's
+    // directory layout. Entries are independent: they are shared out to
+    // thread_count workers, 0 for one per processor, and each one gets its
+    // own decompressor state and output file.
+    virtual JResult extract_all(IO::Path destination, size_t thread_count = 0);
+
     inline const IO::Path &get_path()
     {
         return _path;
@@ -59,6 +59,15 @@
 #define ELF_FLAG_SPARCV9_PSO 0x1
 #define ELF_FLAG_SPARCV9_RMO 0x2
 
+#define ELF_PROGRAM_TYPE_NULL 0
+#define ELF_PROGRAM_TYPE_LOAD 1
+#define ELF_PROGRAM_TYPE_DYNAMIC 2
+#define ELF_PROGRAM_TYPE_INTERP 3
+#define ELF_PROGRAM_TYPE_NOTE 4
+#define ELF_PROGRAM_TYPE_PHDR 6
+#define ELF_PROGRAM_TYPE_TLS 7
+#define ELF_PROGRAM_TYPE_GNU_RELRO 0x6474e552
+
 #define ELF_PROGRAM_X 0x1
 #define ELF_PROGRAM_W 0x2
 #define ELF_PROGRAM_R 0x4
@@ -95,7 +104,7 @@ struct PACKED ELF32Header
     uint16_t shnum;
     uint16_t shstrndx;
 
-    bool valid()
+    bool valid() const
     {
         char *magic = (char *)&ident;
 
@@ -173,7 +182,7 @@ struct PACKED ELF64Header
     uint16_t shnum;
     uint16_t shstrndx;
 
-    bool valid()
+    bool valid() const
     {
         char *magic = (char *)&ident;
 
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <libfile/ELF.h>
+#include <libutils/Slice.h>
+#include <libutils/Vector.h>
+
+#define ELF_SYMBOL_TYPE_OBJECT 1
+#define ELF_SYMBOL_TYPE_FUNC 2
+
+// The functions and objects of an ELF image, sorted by address, to turn
+// many addresses into names without going through the symbol table every
+// time. Uses .symtab and falls back to .dynsym for stripped objects.
+//
+// Names point into the image, which has to outlive the index, as a
+// mapping of the file usually does.
+template <typename ELFFormat>
+struct ELFSymbolIndex
+{
+    struct Symbol
+    {
+        uintptr_t address;
+        size_t size;
+        const char *name;
+    };
+
+private:
+    Slice _image;
+    Vector<Symbol> _symbols{};
+
+    template <typename T>
+    const T *at(size_t offset, size_t count = 1) const
+    {
+        if (offset > _image.size() || count > (_image.size() - offset) / sizeof(T))
+        {
+            return nullptr;
+        }
+
+        return reinterpret_cast<const T *>(static_cast<const char *>(_image.start()) + offset);
+    }
+
+    bool index_section(const typename ELFFormat::Section *sections, size_t section_count, uint32_t type)
+    {
+        for (size_t i = 0; i < section_count; i++)
+        {
+            auto &section = sections[i];
+
+            if (section.type != type || section.link >= section_count || section.entsize != sizeof(typename ELFFormat::Symbole))
+            {
+                continue;
+            }
+
+            auto &strings = sections[section.link];
+            auto *string_data = at<char>(strings.offset, strings.size);
+            auto *symbols = at<typename ELFFormat::Symbole>(section.offset, section.size / sizeof(typename ELFFormat::Symbole));
+
+            if (!string_data || !symbols)
+            {
+                continue;
+            }
+
+            for (size_t j = 0; j < section.size / sizeof(typename ELFFormat::Symbole); j++)
+            {
+                auto &symbol = symbols[j];
+                uint8_t symbol_type = symbol.info & 0xf;
+
+                if ((symbol_type != ELF_SYMBOL_TYPE_FUNC && symbol_type != ELF_SYMBOL_TYPE_OBJECT) ||
+                    symbol.shndx == 0 || symbol.value == 0 || symbol.name >= strings.size)
+                {
+                    continue;
+                }
+
+                // Names that aren't terminated within the table are garbage.
+                if (!memchr(string_data + symbol.name, '\0', strings.size - symbol.name))
+                {
+                    continue;
+                }
+
+                _symbols.push_back({(uintptr_t)symbol.value, (size_t)symbol.size, string_data + symbol.name});
+            }
+        }
+
+        return _symbols.count() > 0;
+    }
+
+public:
+    size_t count() const { return _symbols.count(); }
+
+    ELFSymbolIndex(Slice image) : _image(image)
+    {
+        auto *header = at<typename ELFFormat::Header>(0);
+
+        if (!header || !header->valid() || header->shentsize != sizeof(typename ELFFormat::Section))
+        {
+            return;
+        }
+
+        auto *sections = at<typename ELFFormat::Section>(header->shoff, header->shnum);
+
+        if (!sections)
+        {
+            return;
+        }
+
+        if (!index_section(sections, header->shnum, ELF_SECTION_TYPE_SYMTAB))
+        {
+            index_section(sections, header->shnum, ELF_SECTION_TYPE_DYNSYM);
+        }
+
+        _symbols.sort([](auto &left, auto &right) -> int {
+            if (left.address != right.address)
+            {
+                return left.address > right.address ? 1 : -1;
+            }
+
+            // Of aliases, the sized one goes last, where lookups land.
+            return left.size > right.size ? 1 : (left.size < right.size ? -1 : 0);
+        });
+    }
+
+    // The symbol with the highest address at or below address, provided
+    // address is within its size when it has one.
+    const Symbol *lookup(uintptr_t address) const
+    {
+        if (_symbols.count() == 0 || address < _symbols[0].address)
+        {
+            return nullptr;
+        }
+
+        size_t base = 0;
+        size_t count = _symbols.count();
+
+        while (count > 1)
+        {
+            size_t half = count / 2;
+            base = _symbols[base + half].address <= address ? base + half : base;
+            count -= half;
+        }
+
+        auto &symbol = _symbols[base];
+
+        if (symbol.size != 0 && address - symbol.address >= symbol.size)
+        {
+            return nullptr;
+        }
+
+        return &symbol;
+    }
+
+    // Calls callback(address, symbol or nullptr) for each of the addresses,
+    // which is cheaper sorted, since neighbouring lookups then go down the
+    // same path.
+    template <typename TCallback>
+    void symbolize(const uintptr_t *addresses, size_t count, TCallback callback) const
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            callback(addresses[i], lookup(addresses[i]));
+        }
+    }
+};
@@ -7,85 +7,345 @@
 
 // includes
 #include <libfile/TARArchive.h>
+#include <libio/Copy.h>
 #include <libio/File.h>
 #include <libio/Streams.h>
 
+static constexpr size_t TAR_BLOCK_SIZE = 512;
+
+// Numbers are octal text, padded with spaces or NULs. Values too large for
+// that are big endian binary after a byte with the high bit set, which is
+// how GNU tar stores sizes of 8G and more.
+static size_t tar_number(const char *field, size_t size)
+{
+    size_t value = 0;
+
+    if (size > 0 && (field[0] & 0x80))
+    {
+        value = field[0] & 0x7f;
+
+        for (size_t i = 1; i < size; i++)
+        {
+            value = (value << 8) | (uint8_t)field[i];
+        }
+
+        return value;
+    }
+
+    size_t i = 0;
+
+    while (i < size && field[i] == ' ')
+    {
+        i++;
+    }
+
+    for (; i < size && field[i] >= '0' && field[i] <= '7'; i++)
+    {
+        value = value * 8 + (field[i] - '0');
+    }
+
+    return value;
+}
+
+// Text fields fill their whole size when they are long enough, without a
+// terminator.
+static size_t tar_field_length(const char *field, size_t size)
+{
+    size_t length = 0;
+
+    while (length < size && field[length] != '\0')
+    {
+        length++;
+    }
+
+    return length;
+}
+
 struct PACKED TARRawBlock
 {
-    char name[100];     
-    char mode[8];      
-    char uid[8];       
-    char gid[8];       
-    char size[12];     
-    char mtime[12];    
-    char chksum[8];    
-    char typeflag;     
-    char linkname[100]; 
-    char magic[6];      
-    char version[2];    
-    char uname[32];     
-    char gname[32];     
-    char devmajor[8];   
-    char devminor[8];   
-    char prefix[155];   
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char chksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
 
     char __padding[12];
 
     size_t file_size()
     {
-        size_t size = 0;
-        size_t count = 1;
+        return tar_number(size, sizeof(size));
+    }
 
-        for (size_t j = 11; j > 0; j--, count *= 8)
-        {
-            size += ((this->size[j - 1] - '0') * count);
-        }
+    bool is_end()
+    {
+        return name[0] == '\0';
+    }
+
+    bool is_ustar()
+    {
+        return memcmp(magic, "ustar", 5) == 0;
+    }
 
-        return size;
+    // The header and the content, padded to whole blocks.
+    size_t record_size()
+    {
+        return TAR_BLOCK_SIZE + ALIGN_UP(file_size(), TAR_BLOCK_SIZE);
     }
 };
 
+static_assert(sizeof(TARRawBlock) == TAR_BLOCK_SIZE);
+
+bool tar_read_at(void *tarfile, size_t &offset, TARBlock *block)
+{
+    TARRawBlock *header = (TARRawBlock *)((char *)tarfile + offset);
+
+    if (header->is_end())
+    {
+        return false;
+    }
+
+    memcpy(block->name, header->name, 100);
+    block->size = header->file_size();
+    block->typeflag = header->typeflag;
+    memcpy(block->linkname, header->linkname, 100);
+    block->data = (char *)header + TAR_BLOCK_SIZE;
+
+    offset += header->record_size();
+
+    return true;
+}
+
 bool tar_read(void *tarfile, TARBlock *block, size_t index)
 {
-    TARRawBlock *header = (TARRawBlock *)tarfile;
+    size_t offset = 0;
 
-    for (size_t i = 0; i < index; i++)
+    for (size_t i = 0; i <= index; i++)
     {
-        if (header->name[0] == '\0')
+        if (!tar_read_at(tarfile, offset, block))
         {
             return false;
         }
+    }
+
+    return true;
+}
+
+#ifndef __KERNEL__
+
+#    include <libcompression/Gzip.h>
+#    include <libfile/TARArchive.h>
+#    include <libio/MappedFile.h>
+#    include <libio/MemoryReader.h>
+#    include <libio/Read.h>
+#    include <libio/ReadCounter.h>
+#    include <libio/ScopedReader.h>
+#    include <libio/Skip.h>
+#    include <libsystem/io/FileSystem.h>
+
+// GNU long names and pax headers describe the entry after them, they are
+// read whole, so they are kept to a sane size.
+static constexpr size_t TAR_MAX_EXTENDED_HEADER_SIZE = 64 * 1024;
+
+template <typename TReader>
+static JResult tar_skip(TReader &reader, size_t size)
+{
+    if constexpr (IO::SeekableReader<TReader>)
+    {
+        TRY(reader.seek(IO::SeekFrom::current(size)));
+        return SUCCESS;
+    }
+    else
+    {
+        return IO::skip(reader, size);
+    }
+}
 
-        size_t size = header->file_size();
+template <typename TReader>
+static JResult tar_read_block(TReader &reader, TARRawBlock &block)
+{
+    size_t done = 0;
 
-        header = (TARRawBlock *)((char *)header + ((size / 512) + 1) * 512);
+    while (done < sizeof(TARRawBlock))
+    {
+        size_t read = TRY(reader.read(reinterpret_cast<char *>(&block) + done, sizeof(TARRawBlock) - done));
 
-        if (size % 512)
+        if (read == 0)
         {
-            header = (TARRawBlock *)((char *)header + 512);
+            return ERR_STREAM_CLOSED;
         }
+
+        done += read;
     }
 
-    if (header->name[0] == '\0')
+    return SUCCESS;
+}
+
+// Pax headers are records of "<length> <keyword>=<value>\n", only the path
+// matters here.
+static String tar_pax_path(const String &records)
+{
+    const char *data = records.cstring();
+    size_t size = records.length();
+    size_t position = 0;
+
+    while (position < size)
     {
-        return false;
+        size_t length = 0;
+        size_t i = position;
+
+        while (i < size && data[i] >= '0' && data[i] <= '9')
+        {
+            length = length * 10 + (data[i] - '0');
+            i++;
+        }
+
+        if (length == 0 || length > size - position || i >= size || data[i] != ' ')
+        {
+            break;
+        }
+
+        const char *keyword = data + i + 1;
+        size_t keyword_size = position + length - (i + 1);
+
+        if (keyword_size > 5 && memcmp(keyword, "path=", 5) == 0)
+        {
+            size_t value_size = keyword_size - 5;
+
+            // Without the newline ending the record.
+            if (keyword[keyword_size - 1] == '\n')
+            {
+                value_size--;
+            }
+
+            return String{keyword + 5, value_size};
+        }
+
+        position += length;
     }
 
-    memcpy(block->name, header->name, 100);
-    block->size = header->file_size();
-    block->typeflag = header->typeflag;
-    memcpy(block->linkname, header->linkname, 100);
-    block->data = (char *)header + 512;
+    return "";
+}
 
-    return true;
+static String tar_entry_name(TARRawBlock &block)
+{
+    size_t name_length = tar_field_length(block.name, sizeof(block.name));
+    size_t prefix_length = block.is_ustar() ? tar_field_length(block.prefix, sizeof(block.prefix)) : 0;
+
+    if (prefix_length == 0)
+    {
+        return String{block.name, name_length};
+    }
+
+    IO::MemoryWriter builder{prefix_length + 1 + name_length};
+    builder.write(block.prefix, prefix_length);
+    builder.write('/');
+    builder.write(block.name, name_length);
+
+    return String{builder.string()};
 }
 
-#ifndef __KERNEL__
+// Goes through the archive in one pass, calling callback with the header,
+// full name, offset and size of every entry and a reader over its content.
+// Whatever callback leaves unread is skipped.
+template <typename TReader, typename TCallback>
+static JResult tar_walk(TReader &reader, TCallback callback)
+{
+    size_t offset = 0;
+    String pending_name = "";
 
-#    include <libfile/TARArchive.h>
+    while (true)
+    {
+        TARRawBlock block;
+        auto result = tar_read_block(reader, block);
+
+        // Some writers leave out the two empty blocks at the end.
+        if (result == ERR_STREAM_CLOSED)
+        {
+            return SUCCESS;
+        }
+
+        TRY(result);
+
+        if (block.is_end())
+        {
+            return SUCCESS;
+        }
+
+        size_t size = block.file_size();
+        size_t padded_size = ALIGN_UP(size, TAR_BLOCK_SIZE);
+        offset += TAR_BLOCK_SIZE;
+
+        if constexpr (IO::SeekableReader<TReader>)
+        {
+            size_t length = TRY(reader.length());
+
+            if (offset > length || size > length - offset)
+            {
+                IO::logln("TARArchive: Entry goes past the end of the archive");
+                return ERR_INVALID_DATA;
+            }
+        }
+
+        IO::ScopedReader scoped{reader, size};
+        IO::ReadCounter content{scoped};
+
+        if (block.typeflag == 'L' || block.typeflag == 'x')
+        {
+            if (size > TAR_MAX_EXTENDED_HEADER_SIZE)
+            {
+                return ERR_INVALID_DATA;
+            }
+
+            auto data = TRY(IO::read_string(content, size));
+
+            if (block.typeflag == 'L')
+            {
+                pending_name = String{data.cstring(), tar_field_length(data.cstring(), data.length())};
+            }
+            else
+            {
+                auto path = tar_pax_path(data);
+
+                if (path.length() > 0)
+                {
+                    pending_name = path;
+                }
+            }
+        }
+        else if (block.typeflag != 'K' && block.typeflag != 'g')
+        {
+            auto name = pending_name.length() > 0 ? pending_name : tar_entry_name(block);
+            pending_name = "";
+
+            // Archive tells directories apart by their trailing slash.
+            if (block.typeflag == '5' && (name.length() == 0 || name[name.length() - 1] != '/'))
+            {
+                name = IO::format("{}/", name);
+            }
+
+            TRY(callback(block, name, offset, size, content));
+        }
+
+        TRY(tar_skip(reader, padded_size - content.count()));
+        offset += padded_size;
+    }
+}
 
 TARArchive::TARArchive(IO::Path path, bool read) : Archive(path)
 {
+    _compressed = path.extension() == ".tar.gz" || path.extension() == ".tgz";
+
     if (read)
     {
         read_archive();
@@ -94,10 +354,68 @@ TARArchive::TARArchive(IO::Path path, bool read) : Archive(path)
 
 JResult TARArchive::extract(unsigned int entry_index, IO::Writer &writer)
 {
-    UNUSED(entry_index);
-    UNUSED(writer);
+    const auto &entry = _entries[entry_index];
 
-    return ERR_NOT_IMPLEMENTED;
+    if (mapped())
+    {
+        return IO::write_all(writer, _mapping.slice(entry.archive_offset, entry.uncompressed_size));
+    }
+
+    IO::File file_reader(_path, J_OPEN_READ);
+    TRY(file_reader.result());
+
+    if (_compressed)
+    {
+        Compression::GzipReader gzip{file_reader};
+        TRY(IO::skip(gzip, entry.archive_offset));
+        return IO::copy(gzip, writer, entry.uncompressed_size);
+    }
+
+    TRY(file_reader.seek(IO::SeekFrom::start(entry.archive_offset)));
+
+    return IO::copy(file_reader, writer, entry.uncompressed_size);
+}
+
+JResult TARArchive::extract_all(IO::Path destination, size_t thread_count)
+{
+    // Every entry can be read on its own there.
+    if (!_compressed)
+    {
+        return Archive::extract_all(destination, thread_count);
+    }
+
+    // A gzip stream only decompresses in order.
+
+    IO::File archive_file{_path, J_OPEN_READ};
+    TRY(archive_file.result());
+
+    Compression::GzipReader gzip{archive_file};
+    size_t total_size = 0;
+
+    TRY(tar_walk(gzip, [&](TARRawBlock &, const String &name, size_t, size_t size, IO::Reader &content) -> JResult {
+        // Checked as each one comes by, there is no list ahead of time in
+        // one pass.
+        auto entry_path = TRY(entry_destination(destination, name));
+
+        create_parent_directories(entry_path);
+
+        if (name.length() > 0 && name[name.length() - 1] == '/')
+        {
+            filesystem_mkdir(entry_path.string().cstring());
+            return SUCCESS;
+        }
+
+        IO::File file{entry_path, J_OPEN_WRITE | J_OPEN_CREATE};
+        TRY(file.result());
+        TRY(IO::copy(content, file));
+
+        total_size += size;
+        return SUCCESS;
+    }));
+
+    IO::logln("Extracted {} entries ({} bytes)", _entries.count(), total_size);
+
+    return SUCCESS;
 }
 
 JResult TARArchive::insert(const char *entry_name, IO::Reader &reader)
@@ -122,27 +440,42 @@ JResult TARArchive::read_archive()
 
     IO::logln("Opening file: '{}'", _path.string().cstring());
 
-    TARRawBlock block;
-    while (TRY(archive_file.read(&block, sizeof(TARRawBlock))) == sizeof(TARRawBlock))
+    auto add_entry = [&](TARRawBlock &, const String &name, size_t offset, size_t size, IO::Reader &) -> JResult {
+        _entries.push_back({name, size, size, offset, 0});
+        return SUCCESS;
+    };
+
+    if (_compressed)
     {
-        if (block.name[0] == '\0')
+        Compression::GzipReader gzip{archive_file};
+        TRY(tar_walk(gzip, add_entry));
+        _valid = true;
+        return SUCCESS;
+    }
+
+    auto mapping = IO::MappedFile::map(archive_file);
+
+    if (mapping.success())
+    {
+        _mapping = Slice{mapping.unwrap()};
+
+        IO::MemoryReader memory{_mapping};
+
+        if (tar_walk(memory, add_entry) == SUCCESS)
         {
             _valid = true;
             return SUCCESS;
         }
 
-        _entries.push_back({
-            String{block.name},
-            block.file_size(),
-            block.file_size(),
-            TRY(archive_file.tell()),
-            0,
-        });
-
-        TRY(archive_file.seek(IO::SeekFrom::current(ALIGN_UP(block.file_size(), 512))));
+        IO::logln("Failed to parse the mapped archive, falling back to reading it");
+        _mapping = {};
+        _entries.clear();
     }
 
+    TRY(tar_walk(archive_file, add_entry));
+
+    _valid = true;
     return SUCCESS;
 }
 
-#endif
\ No newline at end of file
+#endif
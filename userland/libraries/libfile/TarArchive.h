@@ -8,6 +8,7 @@
 
 // includes
 #include <libfile/Archive.h>
+#include <libutils/Slice.h>
 
 struct TARBlock
 {
@@ -18,16 +19,36 @@ struct TARBlock
     char *data;
 };
 
+// Reads the header at offset and moves offset to the next one. Walking
+// the whole archive with it costs one header parse per entry.
+bool tar_read_at(void *tarfile, size_t &offset, TARBlock *block);
+
+// Walks from the start for every call, use tar_read_at() to go through
+// more than one entry.
 bool tar_read(void *tarfile, TARBlock *block, size_t index);
 
+// Plain archives are mapped when they can be, their headers are parsed in
+// one pass and entries are extracted straight out of the mapping.
+// Gzip compressed ones (.tar.gz and .tgz) are decompressed as a stream:
+// extract_all() takes one pass over the whole file, on one thread whatever
+// it is asked for, extract() decompresses up to the end of the entry it was
+// asked for.
 struct TARArchive final : public Archive
 {
 private:
+    Slice _mapping;
+    bool _compressed = false;
+
     JResult read_archive();
 
 public:
     TARArchive(IO::Path path, bool read = true);
 
+    bool mapped() const { return _mapping.any(); }
+
+    bool compressed() const { return _compressed; }
+
     JResult extract(unsigned int entry_index, IO::Writer &writer) override;
+    JResult extract_all(IO::Path destination, size_t thread_count = 0) override;
     JResult insert(const char *entry_name, IO::Reader &reader) override;
 };
\ No newline at end of file
@@ -5,15 +5,16 @@
 */
 
 // includes
-#include <libcompression/Deflate.h>
 #include <libcompression/Inflate.h>
+#include <libcompression/ParallelDeflate.h>
+#include <libcompression/Zstd.h>
 #include <libfile/ZipArchive.h>
 #include <libio/Copy.h>
+#include <libio/BufReader.h>
 #include <libio/File.h>
-#include <libio/MemoryReader.h>
-#include <libio/MemoryWriter.h>
+#include <libio/MappedFile.h>
+#include <libio/Pipeline.h>
 #include <libio/Read.h>
-#include <libio/ScopedReader.h>
 #include <libio/Skip.h>
 #include <libio/Streams.h>
 #include <libio/Write.h>
@@ -23,10 +24,36 @@
 constexpr uint32_t ZIP_END_OF_CENTRAL_DIR_HEADER_SIG = 0x06054b50;
 constexpr uint32_t ZIP_CENTRAL_DIR_HEADER_SIG = 0x02014b50;
 
+constexpr uint32_t ZIP64_END_OF_CENTRAL_DIR_HEADER_SIG = 0x06064b50;
+constexpr uint32_t ZIP64_END_OF_CENTRAL_DIR_LOCATOR_SIG = 0x07064b50;
+
 constexpr uint32_t ZIP_LOCAL_DIR_HEADER_SIG = 0x04034b50;
 
 constexpr uint32_t ZIP_CRC_MAGIC_NUMBER = 0xdebb20e3;
 
+// 2.0, deflate.
+constexpr uint16_t ZIP_VERSION = 20;
+
+// 4.5, zip64.
+constexpr uint16_t ZIP_VERSION_ZIP64 = 45;
+
+// 6.3, which is where zstd came in.
+constexpr uint16_t ZIP_VERSION_ZSTD = 63;
+
+// A field that doesn't fit has all its bits set, the value is in the zip64
+// extra field or the zip64 end record instead.
+constexpr uint32_t ZIP64_MARKER = 0xffffffff;
+constexpr uint16_t ZIP64_ENTRIES_MARKER = 0xffff;
+
+// Entries whose size isn't known up front, or that could end up near 4GB
+// once compressed, get a zip64 extra field in their local header. Neither
+// deflate nor zstd grow data by anywhere near 1/16.
+constexpr size64_t ZIP64_LOCAL_THRESHOLD = ZIP64_MARKER - ZIP64_MARKER / 16;
+
+// Bigger deflated entries of unmapped archives are inflated as a stream
+// rather than loaded first.
+constexpr size64_t ZIP_LOAD_LIMIT = 64 * 1024 * 1024;
+
 enum ExtraFieldType : uint16_t
 {
     EFT_ZIP64 = 0x0001,
@@ -47,13 +74,6 @@ enum EntryFlags : uint16_t
 
 using le_flags = LittleEndian<EntryFlags>;
 
-enum CompressionMethod : uint16_t
-{
-    CM_UNCOMPRESSED = 0,
-    CM_SHRUNK = 1,
-    CM_DEFLATED = 8,
-};
-
 using le_compression = LittleEndian<CompressionMethod>;
 
 struct PACKED CentralDirectoryFileHeader
@@ -115,6 +135,118 @@ struct PACKED DataDescriptor
 
 static_assert(sizeof(DataDescriptor) == 12, "DataDescriptor has invalid size!");
 
+struct PACKED Zip64DataDescriptor
+{
+    le_uint32_t crc;
+    le_uint64_t compressed_size;
+    le_uint64_t uncompressed_size;
+};
+
+static_assert(sizeof(Zip64DataDescriptor) == 20, "Zip64DataDescriptor has invalid size!");
+
+struct PACKED ExtraFieldHeader
+{
+    le_eft type;
+    le_uint16_t size;
+};
+
+// What we put in local headers, which always have both sizes.
+struct PACKED Zip64LocalExtraField
+{
+    ExtraFieldHeader header;
+    le_uint64_t uncompressed_size;
+    le_uint64_t compressed_size;
+};
+
+static_assert(sizeof(Zip64LocalExtraField) == 20, "Zip64LocalExtraField has invalid size!");
+
+struct PACKED Zip64CentralDirectoryEndRecord
+{
+    le_uint32_t signature;
+    le_uint64_t record_size; // Without the signature and this field.
+    le_uint16_t version;
+    le_uint16_t version_required;
+    le_uint32_t disk1;
+    le_uint32_t disk2;
+    le_uint64_t disk_entries;
+    le_uint64_t total_entries;
+    le_uint64_t central_dir_size;
+    le_uint64_t central_dir_offset;
+};
+
+static_assert(sizeof(Zip64CentralDirectoryEndRecord) == 56, "Zip64CentralDirectoryEndRecord has invalid size!");
+
+// Right before the end record.
+struct PACKED Zip64CentralDirectoryEndLocator
+{
+    le_uint32_t signature;
+    le_uint32_t disk;
+    le_uint64_t end_record_offset;
+    le_uint32_t total_disks;
+};
+
+static_assert(sizeof(Zip64CentralDirectoryEndLocator) == 20, "Zip64CentralDirectoryEndLocator has invalid size!");
+
+// The zip64 extra field holds the values whose header field is all ones,
+// in this order, and only those.
+static JResult read_zip64_extra_field(const uint8_t *extra, size_t length, size64_t &uncompressed_size, size64_t &compressed_size, size64_t &local_header_offset)
+{
+    size64_t *fields[] = {&uncompressed_size, &compressed_size, &local_header_offset};
+    bool wanted = false;
+
+    for (auto *field : fields)
+    {
+        wanted |= *field == ZIP64_MARKER;
+    }
+
+    size_t offset = 0;
+
+    while (wanted && offset + sizeof(ExtraFieldHeader) <= length)
+    {
+        ExtraFieldHeader header;
+        memcpy(&header, extra + offset, sizeof(header));
+        offset += sizeof(header);
+
+        size_t end = offset + header.size();
+
+        if (end > length)
+        {
+            break;
+        }
+
+        if (header.type() == EFT_ZIP64)
+        {
+            for (auto *field : fields)
+            {
+                if (*field != ZIP64_MARKER || offset + sizeof(uint64_t) > end)
+                {
+                    continue;
+                }
+
+                le_uint64_t value;
+                memcpy(&value, extra + offset, sizeof(value));
+                *field = value();
+                offset += sizeof(value);
+            }
+
+            break;
+        }
+
+        offset = end;
+    }
+
+    for (auto *field : fields)
+    {
+        if (*field == ZIP64_MARKER)
+        {
+            IO::logln("ZipArchive: zip64 extra field is missing");
+            return ERR_INVALID_DATA;
+        }
+    }
+
+    return SUCCESS;
+}
+
 ZipArchive::ZipArchive(IO::Path path, bool read) : Archive(path)
 {
     if (read)
@@ -143,32 +275,44 @@ JResult read_local_headers(IO::SeekableReader auto &reader, Vector<Archive::Entr
 
         entry.name = TRY(IO::read_string(reader, local_header.len_filename()));
 
-        auto end_position = TRY(reader.tell()) + local_header.len_extrafield();
-        while (TRY(reader.tell()) < end_position)
-        {
-            le_eft extra_field_type = TRY(IO::read<ExtraFieldType>(reader));
-            le_uint16_t extra_field_size = TRY(IO::read<uint16_t>(reader));
+        Vector<uint8_t> extra;
+        extra.resize(local_header.len_extrafield());
 
-            UNUSED(extra_field_type);
-            TRY(IO::skip(reader, extra_field_size()));
+        if (TRY(reader.read(extra.raw_storage(), extra.count())) != extra.count())
+        {
+            return ERR_INVALID_DATA;
         }
 
+        size64_t local_header_offset = 0;
+        TRY(read_zip64_extra_field(extra.raw_storage(), extra.count(), entry.uncompressed_size, entry.compressed_size, local_header_offset));
+        bool zip64 = local_header.compressed_size() == ZIP64_MARKER || local_header.uncompressed_size() == ZIP64_MARKER;
+
         entry.archive_offset = TRY(reader.tell());
-        TRY(IO::skip(reader, entry.compressed_size));
+        TRY(reader.seek(IO::SeekFrom::current(entry.compressed_size)));
 
         if (local_header.flags() & EF_DATA_DESCRIPTOR)
         {
-            auto data_descriptor = TRY(IO::read<DataDescriptor>(reader));
-            entry.uncompressed_size = data_descriptor.uncompressed_size();
-            entry.compressed_size = data_descriptor.compressed_size();
+            if (zip64)
+            {
+                auto data_descriptor = TRY(IO::read<Zip64DataDescriptor>(reader));
+                entry.uncompressed_size = data_descriptor.uncompressed_size();
+                entry.compressed_size = data_descriptor.compressed_size();
+            }
+            else
+            {
+                auto data_descriptor = TRY(IO::read<DataDescriptor>(reader));
+                entry.uncompressed_size = data_descriptor.uncompressed_size();
+                entry.compressed_size = data_descriptor.compressed_size();
+            }
         }
     }
 
     return JResult::SUCCESS;
 }
 
-JResult read_central_directory(IO::SeekableReader auto &reader)
+ResultOr<size_t> read_central_directory(IO::SeekableReader auto &reader)
 {
+    auto start = TRY(reader.tell());
 
     while (TRY(reader.tell()) < (TRY(reader.length()) - sizeof(CentralDirectoryFileHeader)))
     {
@@ -191,13 +335,162 @@ JResult read_central_directory(IO::SeekableReader auto &reader)
     }
 
 
+    auto size = TRY(reader.tell()) - start;
+
+    // Zip64 archives have their own end record first.
     le_uint32_t central_dir_end_sig = TRY(IO::read<uint32_t>(reader));
-    if (central_dir_end_sig() != ZIP_END_OF_CENTRAL_DIR_HEADER_SIG)
+    if (central_dir_end_sig() != ZIP_END_OF_CENTRAL_DIR_HEADER_SIG &&
+        central_dir_end_sig() != ZIP64_END_OF_CENTRAL_DIR_HEADER_SIG)
     {
         IO::logln("Missing 'central directory end record' signature!");
         return ERR_INVALID_DATA;
     }
 
+    return size;
+}
+
+JResult ZipArchive::read_archive_mapped()
+{
+    auto *data = reinterpret_cast<const uint8_t *>(_mapping.start());
+    size_t size = _mapping.size();
+
+    // The end record is followed by a comment of at most 64KiB.
+    const CentralDirectoryEndRecord *end_record = nullptr;
+    size_t last = size - sizeof(CentralDirectoryEndRecord);
+    size_t first = last > UINT16_MAX ? last - UINT16_MAX : 0;
+    size_t end_record_offset = 0;
+
+    for (size_t offset = last + 1; offset-- > first;)
+    {
+        auto *record = reinterpret_cast<const CentralDirectoryEndRecord *>(data + offset);
+
+        if (record->signature() == ZIP_END_OF_CENTRAL_DIR_HEADER_SIG)
+        {
+            end_record = record;
+            end_record_offset = offset;
+            break;
+        }
+    }
+
+    if (!end_record)
+    {
+        IO::logln("Missing 'central directory end record' signature!");
+        return ERR_INVALID_DATA;
+    }
+
+    size64_t total_entries = end_record->total_entries();
+    size64_t directory_size = end_record->central_dir_size();
+    size64_t offset = end_record->central_dir_offset();
+
+    // The zip64 end record has the values that don't fit, its locator sits
+    // right before the end record.
+    if (end_record_offset >= sizeof(Zip64CentralDirectoryEndLocator))
+    {
+        auto *locator = reinterpret_cast<const Zip64CentralDirectoryEndLocator *>(data + end_record_offset - sizeof(Zip64CentralDirectoryEndLocator));
+
+        if (locator->signature() == ZIP64_END_OF_CENTRAL_DIR_LOCATOR_SIG)
+        {
+            size64_t zip64_offset = locator->end_record_offset();
+
+            if (zip64_offset + sizeof(Zip64CentralDirectoryEndRecord) > size)
+            {
+                return ERR_INVALID_DATA;
+            }
+
+            auto *zip64_record = reinterpret_cast<const Zip64CentralDirectoryEndRecord *>(data + zip64_offset);
+
+            if (zip64_record->signature() != ZIP64_END_OF_CENTRAL_DIR_HEADER_SIG)
+            {
+                IO::logln("Missing 'zip64 central directory end record' signature!");
+                return ERR_INVALID_DATA;
+            }
+
+            total_entries = zip64_record->total_entries();
+            directory_size = zip64_record->central_dir_size();
+            offset = zip64_record->central_dir_offset();
+        }
+    }
+
+    size64_t directory_end = offset + directory_size;
+
+    if (offset > size || directory_end > size)
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    // Each record takes at least a header, don't trust the count further.
+    if (total_entries > directory_size / sizeof(CentralDirectoryFileHeader))
+    {
+        return ERR_INVALID_DATA;
+    }
+
+    _central_directory_offset = offset;
+    _central_directory_size = directory_size;
+
+    _entries.ensure_capacity(total_entries);
+
+    for (size64_t i = 0; i < total_entries; i++)
+    {
+        if (offset + sizeof(CentralDirectoryFileHeader) > directory_end)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        auto *cd_file_header = reinterpret_cast<const CentralDirectoryFileHeader *>(data + offset);
+
+        if (cd_file_header->signature() != ZIP_CENTRAL_DIR_HEADER_SIG)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        size64_t next_offset = offset + sizeof(CentralDirectoryFileHeader) +
+                               cd_file_header->len_filename() +
+                               cd_file_header->len_extrafield() +
+                               cd_file_header->len_comment();
+
+        if (next_offset > directory_end)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        size64_t compressed_size = cd_file_header->compressed_size();
+        size64_t uncompressed_size = cd_file_header->uncompressed_size();
+        size64_t local_header_offset = cd_file_header->local_header_offset();
+
+        auto *extra = reinterpret_cast<const uint8_t *>(cd_file_header + 1) + cd_file_header->len_filename();
+        TRY(read_zip64_extra_field(extra, cd_file_header->len_extrafield(), uncompressed_size, compressed_size, local_header_offset));
+
+        if (local_header_offset + sizeof(LocalHeader) > size)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        auto *local_header = reinterpret_cast<const LocalHeader *>(data + local_header_offset);
+
+        if (local_header->signature() != ZIP_LOCAL_DIR_HEADER_SIG)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        // The central directory has the real sizes even when the local
+        // header defers them to a data descriptor.
+        auto &entry = _entries.emplace_back();
+        entry.name = String{reinterpret_cast<const char *>(cd_file_header + 1), cd_file_header->len_filename()};
+        entry.compressed_size = compressed_size;
+        entry.uncompressed_size = uncompressed_size;
+        entry.compression = cd_file_header->compression();
+        entry.archive_offset = local_header_offset + sizeof(LocalHeader) +
+                               local_header->len_filename() +
+                               local_header->len_extrafield();
+
+        if (entry.archive_offset + entry.compressed_size > size)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        offset = next_offset;
+    }
+
     return JResult::SUCCESS;
 }
 
@@ -205,7 +498,8 @@ JResult ZipArchive::read_archive()
 {
     _valid = false;
 
-    IO::File archive_file(_path, J_OPEN_READ);
+    _file = IO::File(_path, J_OPEN_READ);
+    auto &archive_file = _file;
 
     if (!archive_file.exist())
     {
@@ -221,114 +515,523 @@ JResult ZipArchive::read_archive()
         return ERR_INVALID_DATA;
     }
 
+    auto mapping = IO::MappedFile::map(archive_file);
+
+    if (mapping.success())
+    {
+        _mapping = Slice{mapping.unwrap()};
+
+        if (read_archive_mapped() == SUCCESS)
+        {
+            _valid = true;
+            return JResult::SUCCESS;
+        }
+
+        IO::logln("Failed to parse the mapped archive, falling back to reading it");
+        _mapping = {};
+        _entries.clear();
+    }
+
     TRY(read_local_headers(archive_file, _entries));
-    TRY(read_central_directory(archive_file));
+    _central_directory_offset = TRY(archive_file.tell());
+    _central_directory_size = TRY(read_central_directory(archive_file));
 
     _valid = true;
     return JResult::SUCCESS;
 }
 
-JResult write_entry(const Archive::Entry &entry, IO::Writer &writer, IO::Reader &compressed, size_t compressed_size)
+ResultOr<size_t> ZipArchive::read_at(size64_t offset, void *buffer, size_t size)
 {
-    LocalHeader header;
-    header.flags = EF_NONE;
-    header.compressed_size = compressed_size;
-    header.compression = CM_DEFLATED;
-    header.uncompressed_size = entry.uncompressed_size;
-    header.len_filename = entry.name.length();
-    header.len_extrafield = 0;
-    header.signature = ZIP_LOCAL_DIR_HEADER_SIG;
+    LockHolder holder(_read_ahead_lock);
+
+    if (!_file.handle())
+    {
+        return ERR_BAD_HANDLE;
+    }
+
+    size64_t end = _read_ahead_offset + _read_ahead_used;
+
+    if (offset >= _read_ahead_offset && offset < end)
+    {
+        size_t available = MIN(size, end - offset);
+        memcpy(buffer, reinterpret_cast<const uint8_t *>(_read_ahead->start()) + (offset - _read_ahead_offset), available);
+        return available;
+    }
 
-    TRY(IO::write_struct(writer, header));
-    TRY(IO::write(writer, entry.name));
-    return IO::copy(compressed, writer);
+    // Entries one after the other skip their local headers, close enough
+    // to count as sequential.
+    bool sequential = offset >= end && offset - end < READ_AHEAD_MIN;
+    _read_ahead_window = sequential ? MIN(_read_ahead_window * 2, READ_AHEAD_MAX) : READ_AHEAD_MIN;
+
+    if (size >= _read_ahead_window)
+    {
+        // Nothing to gain from the copy.
+        size_t read = TRY(_file.read_at(offset, buffer, size));
+        _read_ahead_offset = offset + read;
+        _read_ahead_used = 0;
+        return read;
+    }
+
+    if (!_read_ahead)
+    {
+        _read_ahead = make<SliceStorage>(READ_AHEAD_MAX);
+    }
+
+    _read_ahead_used = 0;
+    size_t read = TRY(_file.read_at(offset, _read_ahead->start(), _read_ahead_window));
+    _read_ahead_offset = offset;
+    _read_ahead_used = read;
+
+    size_t available = MIN(size, read);
+    memcpy(buffer, _read_ahead->start(), available);
+    return available;
 }
 
-JResult write_central_directory(IO::SeekableWriter auto &writer, Vector<Archive::Entry> &entries)
+// The data of one entry, read through the handle of the archive with a
+// position of its own.
+struct EntryReader : public IO::Reader
 {
-    auto start = TRY(writer.tell());
-    for (const auto &entry : entries)
-    {
-        IO::logln("Write central directory header: '{}'", entry.name);
-        CentralDirectoryFileHeader header;
-        header.flags = EF_NONE;
-        header.compressed_size = entry.compressed_size;
-        header.compression = CM_DEFLATED;
-        header.uncompressed_size = entry.uncompressed_size;
-        header.local_header_offset = entry.archive_offset - sizeof(LocalHeader) - entry.name.length();
-        header.len_filename = entry.name.length();
-        header.len_extrafield = 0;
-        header.len_comment = 0;
-        header.signature = ZIP_CENTRAL_DIR_HEADER_SIG;
-        TRY(IO::write_struct(writer, header));
-        TRY(IO::write(writer, entry.name));
-    }
-    auto end = TRY(writer.tell());
+private:
+    ZipArchive &_archive;
+    size64_t _position;
+    size64_t _end;
+
+public:
+    EntryReader(ZipArchive &archive, size64_t offset, size64_t size)
+        : _archive{archive}, _position{offset}, _end{offset + size}
+    {
+    }
 
-    CentralDirectoryEndRecord end_record;
-    end_record.signature = ZIP_END_OF_CENTRAL_DIR_HEADER_SIG;
-    end_record.central_dir_size = end - start;
-    end_record.central_dir_offset = start;
-    end_record.disk_entries = entries.count();
-    end_record.total_entries = entries.count();
-    end_record.len_comment = 0;
-    return IO::write_struct(writer, end_record).result();
+    ResultOr<size_t> read(void *buffer, size_t size) override
+    {
+        size = MIN((size64_t)size, _end - _position);
+
+        if (size == 0)
+        {
+            return 0;
+        }
+
+        size_t read = TRY(_archive.read_at(_position, buffer, size));
+        _position += read;
+        return read;
+    }
+
+    // Entries past what a size_t holds just don't say.
+    Optional<size_t> remaining() override
+    {
+        if (_end - _position > SIZE_MAX)
+        {
+            return NONE;
+        }
+
+        return _end - _position;
+    }
+};
+
+ResultOr<Slice> ZipArchive::entry_data(unsigned int entry_index)
+{
+    if (!mapped())
+    {
+        return ERR_NOT_IMPLEMENTED;
+    }
+
+    const auto &entry = _entries[entry_index];
+    return _mapping.slice(entry.archive_offset, entry.compressed_size);
 }
 
-JResult ZipArchive::extract(unsigned int entry_index, IO::Writer &writer)
+JResult ZipArchive::build_index(unsigned int entry_index, Compression::InflateIndex &index, size_t span)
 {
+    if (_entries[entry_index].compression != CM_DEFLATED)
+    {
+        return ERR_NOT_IMPLEMENTED;
+    }
 
+    auto data = TRY(entry_data(entry_index));
+    return index.build(data, span);
+}
+
+JResult ZipArchive::extract(unsigned int entry_index, const Compression::InflateIndex &index, size64_t offset, size_t size, IO::Writer &writer)
+{
     const auto &entry = _entries[entry_index];
+    auto data = TRY(entry_data(entry_index));
+
+    if (entry.compression == CM_UNCOMPRESSED)
+    {
+        offset = MIN(offset, (size64_t)data.size());
+        return IO::write_all(writer, data.slice(offset, MIN(size, data.size() - offset)));
+    }
 
     if (entry.compression != CM_DEFLATED)
+    {
+        return ERR_NOT_IMPLEMENTED;
+    }
+
+    Compression::IndexedInflateReader reader{data, index};
+    TRY(reader.seek(IO::SeekFrom::start(offset)));
+    return IO::copy(reader, writer, size);
+}
+
+JResult ZipArchive::extract(unsigned int entry_index, IO::Writer &writer)
+{
+    const auto &entry = _entries[entry_index];
+
+    if (entry.compression != CM_DEFLATED && entry.compression != CM_UNCOMPRESSED && entry.compression != CM_ZSTD)
     {
         IO::logln("ZipArchive: Unsupported compression: {}", entry.compression);
         return ERR_NOT_IMPLEMENTED;
     }
 
-    IO::File file_reader(_path, J_OPEN_READ);
-    file_reader.seek(IO::SeekFrom::start(entry.archive_offset));
-    IO::ScopedReader scoped_reader(file_reader, entry.compressed_size);
+    if (mapped())
+    {
+        auto data = TRY(entry_data(entry_index));
+
+        if (entry.compression == CM_UNCOMPRESSED)
+        {
+            return IO::write_all(writer, data);
+        }
+
+        if (entry.compression == CM_ZSTD)
+        {
+            Compression::ZstdDecoder zstd;
+            return zstd.perform(data, writer).result();
+        }
+
+        Compression::Inflate inf;
+        return inf.perform(data, writer).result();
+    }
+
+    EntryReader file_reader{*this, entry.archive_offset, entry.compressed_size};
+
+    // The reader ends with the entry.
+    if (entry.compression == CM_UNCOMPRESSED)
+    {
+        return IO::copy(file_reader, writer);
+    }
+
+    // zstd reads block by block, there is no need to load the entry.
+    if (entry.compression == CM_ZSTD)
+    {
+        Compression::ZstdDecoder zstd;
+        return zstd.perform(file_reader, writer).result();
+    }
+
+    if (entry.compressed_size > ZIP_LOAD_LIMIT)
+    {
+        IO::BufReader buffered{file_reader, READ_AHEAD_MAX};
+        Compression::Inflate inf;
+        return inf.perform(buffered, writer).result();
+    }
+
+    // Load the whole entry so Inflate can refill its bit reader from memory.
+    auto compressed_data = make<SliceStorage>(entry.compressed_size);
+    size_t compressed_read = 0;
+
+    while (compressed_read < entry.compressed_size)
+    {
+        auto *buffer = reinterpret_cast<uint8_t *>(compressed_data->start()) + compressed_read;
+        size_t read = TRY(file_reader.read(buffer, entry.compressed_size - compressed_read));
+
+        if (read == 0)
+        {
+            IO::logln("ZipArchive: Unexpected end of archive");
+            return ERR_INVALID_DATA;
+        }
+
+        compressed_read += read;
+    }
 
     Compression::Inflate inf;
-    return inf.perform(scoped_reader, writer).result();
+    return inf.perform(Slice{compressed_data}, writer).result();
+}
+
+JResult ZipArchive::append_entry(IO::File &file, IO::ChainWriter &directory, const Insertion &insertion)
+{
+    const char *name = insertion.name;
+    auto compression = insertion.compression;
+
+    if (compression != CM_DEFLATED && compression != CM_ZSTD)
+    {
+        return ERR_NOT_IMPLEMENTED;
+    }
+
+    uint16_t version = compression == CM_ZSTD ? ZIP_VERSION_ZSTD : ZIP_VERSION;
+    size64_t header_offset = TRY(file.tell());
+    size_t name_length = strlen(name);
+
+    auto remaining = insertion.reader->remaining();
+    bool local_zip64 = !remaining.present() || remaining.unwrap() >= ZIP64_LOCAL_THRESHOLD;
+
+    // The sizes and the checksum are patched in once the data is out, so
+    // there is no need for a data descriptor.
+    LocalHeader header;
+    header.signature = ZIP_LOCAL_DIR_HEADER_SIG;
+    header.version = local_zip64 ? MAX(version, ZIP_VERSION_ZIP64) : version;
+    header.flags = EF_NONE;
+    header.compression = compression;
+    header.len_filename = name_length;
+    header.len_extrafield = local_zip64 ? sizeof(Zip64LocalExtraField) : 0;
+
+    Zip64LocalExtraField local_extra;
+    local_extra.header.type = EFT_ZIP64;
+    local_extra.header.size = sizeof(Zip64LocalExtraField) - sizeof(ExtraFieldHeader);
+
+    TRY(IO::write_struct(file, header));
+    TRY(IO::write(file, name));
+
+    if (local_zip64)
+    {
+        TRY(IO::write_struct(file, local_extra));
+    }
+
+    size64_t data_offset = header_offset + sizeof(LocalHeader) + name_length + header.len_extrafield();
+
+    uint32_t crc;
+    uint64_t uncompressed_size;
+
+    if (compression == CM_ZSTD)
+    {
+        // Counted and checksummed in one pass as the encoder reads it.
+        IO::PipelineReader<IO::CountStage, IO::CRCStage> source{*insertion.reader};
+
+        Compression::ZstdEncoder zstd;
+        TRY(zstd.perform(source, file));
+
+        crc = source.stage<IO::CRCStage>().checksum();
+        uncompressed_size = source.stage<IO::CountStage>().count();
+    }
+    else
+    {
+        // The blocks are checksummed on the threads compressing them.
+        Compression::ParallelDeflate def(5);
+        TRY(def.perform(*insertion.reader, file));
+
+        crc = def.crc();
+        uncompressed_size = def.size();
+    }
+
+    size64_t data_end = TRY(file.tell());
+    size64_t compressed_size = data_end - data_offset;
+
+    header.crc = crc;
+
+    if (local_zip64)
+    {
+        header.compressed_size = ZIP64_MARKER;
+        header.uncompressed_size = ZIP64_MARKER;
+        local_extra.compressed_size = compressed_size;
+        local_extra.uncompressed_size = uncompressed_size;
+    }
+    else if (compressed_size >= ZIP64_MARKER || uncompressed_size >= ZIP64_MARKER)
+    {
+        // The reader said it had less than it did, there's no room left
+        // for the extra field.
+        IO::logln("ZipArchive: '{}' grew past 4GB while it was compressed", name);
+        return ERR_INVALID_DATA;
+    }
+    else
+    {
+        header.compressed_size = compressed_size;
+        header.uncompressed_size = uncompressed_size;
+    }
+
+    TRY(file.seek(IO::SeekFrom::start(header_offset)));
+    TRY(IO::write_struct(file, header));
+
+    if (local_zip64)
+    {
+        TRY(IO::write(file, name));
+        TRY(IO::write_struct(file, local_extra));
+    }
+
+    TRY(file.seek(IO::SeekFrom::start(data_end)));
+
+    // The central directory only has the zip64 extra field when something
+    // doesn't fit, with just the values that don't.
+    uint8_t central_extra[sizeof(ExtraFieldHeader) + 3 * sizeof(uint64_t)];
+    size_t central_extra_length = sizeof(ExtraFieldHeader);
+
+    auto add_zip64_field = [&](size64_t value) {
+        le_uint64_t field = value;
+        memcpy(central_extra + central_extra_length, &field, sizeof(field));
+        central_extra_length += sizeof(field);
+        return ZIP64_MARKER;
+    };
+
+    CentralDirectoryFileHeader record;
+    record.signature = ZIP_CENTRAL_DIR_HEADER_SIG;
+    record.flags = EF_NONE;
+    record.compression = compression;
+    record.crc = crc;
+    record.uncompressed_size = uncompressed_size >= ZIP64_MARKER ? add_zip64_field(uncompressed_size) : uncompressed_size;
+    record.compressed_size = compressed_size >= ZIP64_MARKER ? add_zip64_field(compressed_size) : compressed_size;
+    record.local_header_offset = header_offset >= ZIP64_MARKER ? add_zip64_field(header_offset) : header_offset;
+    record.len_filename = name_length;
+    record.len_comment = 0;
+
+    bool central_zip64 = central_extra_length > sizeof(ExtraFieldHeader);
+    uint16_t central_version = central_zip64 || local_zip64 ? MAX(version, ZIP_VERSION_ZIP64) : version;
+
+    record.version = central_version;
+    record.version_required = central_version;
+    record.len_extrafield = central_zip64 ? central_extra_length : 0;
+
+    TRY(IO::write_struct(directory, record));
+    TRY(IO::write(directory, name));
+
+    if (central_zip64)
+    {
+        ExtraFieldHeader extra_header;
+        extra_header.type = EFT_ZIP64;
+        extra_header.size = central_extra_length - sizeof(ExtraFieldHeader);
+        memcpy(central_extra, &extra_header, sizeof(extra_header));
+
+        TRY(directory.write(central_extra, central_extra_length));
+    }
+
+    auto &entry = _entries.emplace_back();
+    entry.name = String(name);
+    entry.compressed_size = compressed_size;
+    entry.uncompressed_size = uncompressed_size;
+    entry.compression = compression;
+    entry.archive_offset = data_offset;
+    invalidate_index();
+
+    return JResult::SUCCESS;
+}
+
+JResult ZipArchive::write_central_directory(IO::File &file, IO::ChainWriter &directory, size64_t old_length)
+{
+    size64_t offset = TRY(file.tell());
+    auto &records = directory.chain();
+    TRY(records.write_to(file));
+
+    size64_t entry_count = _entries.count();
+    size64_t directory_size = records.size();
+
+    bool zip64 = entry_count >= ZIP64_ENTRIES_MARKER ||
+                 directory_size >= ZIP64_MARKER ||
+                 offset >= ZIP64_MARKER;
+
+    size64_t end = offset + directory_size + sizeof(CentralDirectoryEndRecord);
+
+    if (zip64)
+    {
+        size64_t zip64_offset = offset + directory_size;
+
+        Zip64CentralDirectoryEndRecord zip64_record;
+        zip64_record.signature = ZIP64_END_OF_CENTRAL_DIR_HEADER_SIG;
+        zip64_record.record_size = sizeof(Zip64CentralDirectoryEndRecord) - 12;
+        zip64_record.version = ZIP_VERSION_ZIP64;
+        zip64_record.version_required = ZIP_VERSION_ZIP64;
+        zip64_record.disk1 = 0;
+        zip64_record.disk2 = 0;
+        zip64_record.disk_entries = entry_count;
+        zip64_record.total_entries = entry_count;
+        zip64_record.central_dir_size = directory_size;
+        zip64_record.central_dir_offset = offset;
+        TRY(IO::write_struct(file, zip64_record));
+
+        Zip64CentralDirectoryEndLocator locator;
+        locator.signature = ZIP64_END_OF_CENTRAL_DIR_LOCATOR_SIG;
+        locator.disk = 0;
+        locator.end_record_offset = zip64_offset;
+        locator.total_disks = 1;
+        TRY(IO::write_struct(file, locator));
+
+        end += sizeof(Zip64CentralDirectoryEndRecord) + sizeof(Zip64CentralDirectoryEndLocator);
+    }
+
+    // The file can't be truncated, whatever is left of the old end of the
+    // archive after the new one becomes the comment. It's zeroed, a stale
+    // end record in it would be found first.
+    size_t leftover = old_length > end ? MIN(old_length - end, (size64_t)UINT16_MAX) : 0;
+
+    CentralDirectoryEndRecord end_record;
+    end_record.signature = ZIP_END_OF_CENTRAL_DIR_HEADER_SIG;
+    end_record.central_dir_size = directory_size >= ZIP64_MARKER ? ZIP64_MARKER : directory_size;
+    end_record.central_dir_offset = offset >= ZIP64_MARKER ? ZIP64_MARKER : offset;
+    end_record.disk_entries = entry_count >= ZIP64_ENTRIES_MARKER ? ZIP64_ENTRIES_MARKER : entry_count;
+    end_record.total_entries = entry_count >= ZIP64_ENTRIES_MARKER ? ZIP64_ENTRIES_MARKER : entry_count;
+    end_record.len_comment = leftover;
+    TRY(IO::write_struct(file, end_record));
+
+    static const uint8_t zeroes[512] = {};
+
+    while (leftover > 0)
+    {
+        size_t written = TRY(file.write(zeroes, MIN(leftover, sizeof(zeroes))));
+        leftover -= written;
+    }
+
+    _central_directory_offset = offset;
+    _central_directory_size = directory_size;
+
+    return JResult::SUCCESS;
 }
 
 JResult ZipArchive::insert(const char *entry_name, IO::Reader &reader)
 {
-    IO::MemoryWriter memory_writer;
+    Vector<Insertion> insertions;
+    insertions.push_back({entry_name, &reader});
+    return insert(insertions);
+}
+
+JResult ZipArchive::insert(const Vector<Insertion> &insertions)
+{
+    // The new entries go where the records of the central directory are,
+    // which get kept as they are and written again after them. They are
+    // copied out, the mapping is about to be written over.
+    IO::ChainWriter directory;
+    size64_t old_length = 0;
 
-    for (const auto &entry : _entries)
+    if (mapped())
+    {
+        old_length = _mapping.size();
+        TRY(IO::write_all(directory, _mapping.slice(_central_directory_offset, _central_directory_size)));
+    }
+    else
     {
         IO::File file_reader(_path, J_OPEN_READ);
-        file_reader.seek(IO::SeekFrom::start(entry.archive_offset));
 
-        IO::ScopedReader scoped_reader(file_reader, entry.compressed_size);
-        IO::logln("Write existing local header: '{}'", entry.name);
-        TRY(write_entry(entry, memory_writer, scoped_reader, entry.compressed_size));
+        if (file_reader.exist())
+        {
+            old_length = TRY(file_reader.length());
+            TRY(file_reader.seek(IO::SeekFrom::start(_central_directory_offset)));
+            TRY(IO::copy(file_reader, directory, _central_directory_size));
+        }
     }
 
-    IO::MemoryWriter compressed_writer;
+    // The file is about to change under the mapping and the read-ahead.
+    _mapping = {};
 
-    Compression::Deflate def(5);
-    IO::ReadCounter counter{reader};
-    TRY(def.perform(counter, compressed_writer));
+    {
+        LockHolder holder(_read_ahead_lock);
+        _read_ahead_used = 0;
+    }
 
-    IO::logln("Write new local header: '{}'", entry_name);
+    IO::File file(_path, J_OPEN_WRITE | J_OPEN_CREATE);
+    TRY(file.seek(IO::SeekFrom::start(_central_directory_offset)));
 
-    auto &new_entry = _entries.emplace_back();
-    new_entry.name = String(entry_name);
-    new_entry.compressed_size = TRY(compressed_writer.length());
-    new_entry.compression = CM_DEFLATED;
-    new_entry.uncompressed_size = counter.count();
-    new_entry.archive_offset = TRY(memory_writer.length()) + sizeof(LocalHeader) + new_entry.name.length();
+    if (!_file.handle())
+    {
+        _file = IO::File(_path, J_OPEN_READ);
+    }
 
-    auto compressed_data = compressed_writer.slice();
-    IO::MemoryReader compressed_reader(compressed_data->start(), compressed_data->size());
-    TRY(write_entry(new_entry, memory_writer, compressed_reader, compressed_data->size()));
+    for (size_t i = 0; i < insertions.count(); i++)
+    {
+        IO::logln("Write new local header: '{}'", insertions[i].name);
 
-    TRY(write_central_directory(memory_writer, _entries));
+        size64_t entry_offset = TRY(file.tell());
+        auto result = append_entry(file, directory, insertions[i]);
 
-    IO::File file_writer(_path, J_OPEN_WRITE | J_OPEN_CREATE);
-    return IO::write_all(file_writer, Slice(memory_writer.slice()));
-}
\ No newline at end of file
+        if (result != SUCCESS)
+        {
+            // What made it in so far stays readable.
+            TRY(file.seek(IO::SeekFrom::start(entry_offset)));
+            TRY(write_central_directory(file, directory, old_length));
+            return result;
+        }
+    }
+
+    return write_central_directory(file, directory, old_length);
+}
@@ -7,17 +7,90 @@
 #pragma once
 
 // includes
+#include <libcompression/InflateIndex.h>
 #include <libfile/Archive.h>
+#include <libio/File.h>
+#include <libio/Chain.h>
+#include <libio/MemoryWriter.h>
+#include <libutils/Lock.h>
+#include <libutils/Slice.h>
+
+enum CompressionMethod : uint16_t
+{
+    CM_UNCOMPRESSED = 0,
+    CM_SHRUNK = 1,
+    CM_DEFLATED = 8,
+    CM_ZSTD = 93,
+};
 
 struct ZipArchive : public Archive
 {
 public:
     ZipArchive(IO::Path path, bool read = true);
 
+    struct Insertion
+    {
+        const char *name;
+        IO::Reader *reader;
+
+        // Deflate or zstd, which takes more space but decompresses several
+        // times faster.
+        CompressionMethod compression = CM_DEFLATED;
+    };
+
     JResult extract(unsigned int entry_index, IO::Writer &writer) override;
     JResult insert(const char *entry_name, IO::Reader &reader) override;
 
+    // Appends the entries where the central directory was and writes it
+    // anew after them, the existing entries are neither read nor moved.
+    // Inserting many entries at once writes the directory only once.
+    JResult insert(const Vector<Insertion> &insertions);
+
+    // The archive is mapped and its central directory was parsed in place.
+    bool mapped() const { return _mapping.any(); }
+
+    // Compressed bytes of an entry, straight out of the mapping. For
+    // uncompressed entries this is the file content itself.
+    ResultOr<Slice> entry_data(unsigned int entry_index);
+
+    // Indexes a deflated entry of a mapped archive for random access, the
+    // index can be saved next to the archive and loaded instead next time.
+    JResult build_index(unsigned int entry_index, Compression::InflateIndex &index, size_t span = Compression::InflateIndex::DEFAULT_SPAN);
+
+    // Extracts up to size bytes of an entry of a mapped archive from offset
+    // on. Deflated entries only inflate from the access point before offset.
+    JResult extract(unsigned int entry_index, const Compression::InflateIndex &index, size64_t offset, size_t size, IO::Writer &writer);
+
+    // Reads the archive at offset through its one handle, for entries of an
+    // archive that isn't mapped. Safe from several threads at once.
+    ResultOr<size_t> read_at(size64_t offset, void *buffer, size_t size);
+
 private:
+    Slice _mapping;
+
+    // Opened once, instead of once per extracted entry.
+    IO::File _file;
+
+    // Extracting entries in archive order reads mostly small pieces one
+    // after the other. They come from a window that grows as long as the
+    // reads stay sequential.
+    static constexpr size_t READ_AHEAD_MIN = 16 * 1024;
+    static constexpr size_t READ_AHEAD_MAX = 256 * 1024;
+
+    Lock _read_ahead_lock{"ZipArchive"};
+    RefPtr<SliceStorage> _read_ahead;
+    size64_t _read_ahead_offset = 0;
+    size_t _read_ahead_used = 0;
+    size_t _read_ahead_window = READ_AHEAD_MIN;
+
+    // Where the records of the central directory are, without the end
+    // records. Everything before is entries.
+    size64_t _central_directory_offset = 0;
+    size64_t _central_directory_size = 0;
+
     JResult read_archive();
-    void write_archive();
-};
\ No newline at end of file
+    JResult read_archive_mapped();
+
+    JResult append_entry(IO::File &file, IO::ChainWriter &directory, const Insertion &insertion);
+    JResult write_central_directory(IO::File &file, IO::ChainWriter &directory, size64_t old_length);
+};
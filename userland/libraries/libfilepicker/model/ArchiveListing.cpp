@@ -65,7 +65,7 @@ String ArchiveListing::header(int column)
 
 Widget::Variant ArchiveListing::data(int row, int column)
 {
-    auto &entry = _entries[row];
+    auto &entry = _entries[_order[row]];
 
     switch (column)
     {
@@ -100,10 +100,27 @@ void ArchiveListing::update()
 {
     _entries.clear();
 
-    auto current = _navigation->current();
+    auto *directory = _archive->directory(_navigation->current().string());
 
-    for (const auto &entry : _archive->entries())
+    if (!directory)
     {
+        sort(_order.column(), _order.ascending());
+        return;
+    }
+
+    for (auto index : directory->directories)
+    {
+        auto &entry_info = _entries.emplace_back();
+        entry_info.compressed_size = 0;
+        entry_info.uncompressed_size = 0;
+        entry_info.type = HJ_FILE_TYPE_DIRECTORY;
+        entry_info.name = _archive->directories()[index].path;
+        entry_info.icon = Graphic::Icon::get("folder");
+    }
+
+    for (auto index : directory->entries)
+    {
+        auto &entry = _archive->entries()[index];
         auto &entry_info = _entries.emplace_back();
         entry_info.compressed_size = entry.compressed_size;
         entry_info.uncompressed_size = entry.uncompressed_size;
@@ -112,12 +129,59 @@ void ArchiveListing::update()
         entry_info.icon = Graphic::Icon::get("file");
     }
 
-    did_update();
+    sort(_order.column(), _order.ascending());
 }
 
 const ArchiveEntryInfo &ArchiveListing::info(int index) const
 {
-    return _entries[index];
+    return _entries[_order[index]];
+}
+
+int ArchiveListing::compare(int column, size_t left, size_t right) const
+{
+    auto &left_entry = _entries[left];
+    auto &right_entry = _entries[right];
+
+    switch (column)
+    {
+    case COLUMN_TYPE:
+        if (left_entry.type != right_entry.type)
+        {
+            return (int)left_entry.type - (int)right_entry.type;
+        }
+
+        break;
+
+    case COLUMN_COMPRESSED_SIZE:
+        if (left_entry.compressed_size != right_entry.compressed_size)
+        {
+            return left_entry.compressed_size < right_entry.compressed_size ? -1 : 1;
+        }
+
+        break;
+
+    case COLUMN_UNCOMPRESSED_SIZE:
+        if (left_entry.uncompressed_size != right_entry.uncompressed_size)
+        {
+            return left_entry.uncompressed_size < right_entry.uncompressed_size ? -1 : 1;
+        }
+
+        break;
+
+    default:
+        break;
+    }
+
+    return strcmp(left_entry.name.cstring(), right_entry.name.cstring());
+}
+
+void ArchiveListing::sort(int column, bool ascending)
+{
+    _order.sort(_entries.count(), column, ascending, [&](size_t left, size_t right) {
+        return compare(column, left, right);
+    });
+
+    did_update();
 }
 
 }
\ No newline at end of file
@@ -13,6 +13,7 @@
 #include <libwidget/model/TableModel.h>
 #include <libfilepicker/model/ArchiveEntryInfo.h>
 #include <libfilepicker/model/Navigation.h>
+#include <libfilepicker/model/SortIndex.h>
 #include <libfile/Archive.h>
 
 namespace FilePicker
@@ -25,6 +26,9 @@ private:
     RefPtr<Archive> _archive;
     Vector<ArchiveEntryInfo> _entries{};
     OwnPtr<Async::Observer<Navigation>> _observer;
+    SortIndex _order{};
+
+    int compare(int column, size_t left, size_t right) const;
 
 public:
     ArchiveListing(RefPtr<Navigation> navigation, RefPtr<Archive> archive);
@@ -40,6 +44,8 @@ public:
     void update() override;
 
     const ArchiveEntryInfo &info(int index) const;
+
+    void sort(int column, bool ascending);
 };
 
 }
\ No newline at end of file
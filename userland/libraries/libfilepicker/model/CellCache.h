@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <libutils/Optional.h>
+#include <libutils/String.h>
+
+namespace FilePicker
+{
+
+// Formatted cells of the rows drawn last. Rows are kept in the slot their
+// number picks, so a window of consecutive rows smaller than the cache
+// never evicts itself while it is scrolled through.
+template <int COLUMNS, int ROWS = 128>
+struct CellCache
+{
+private:
+    struct Slot
+    {
+        int row = -1;
+        Optional<String> cells[COLUMNS];
+    };
+
+    Slot _slots[ROWS];
+
+public:
+    template <typename Format>
+    String get(int row, int column, Format format)
+    {
+        auto &slot = _slots[row % ROWS];
+
+        if (slot.row != row)
+        {
+            slot.row = row;
+
+            for (auto &cell : slot.cells)
+            {
+                cell.clear();
+            }
+        }
+
+        if (!slot.cells[column].present())
+        {
+            slot.cells[column] = format();
+        }
+
+        return slot.cells[column].unwrap();
+    }
+
+    void clear()
+    {
+        for (auto &slot : _slots)
+        {
+            slot.row = -1;
+        }
+    }
+};
+
+}
@@ -6,47 +6,103 @@
 
 // includes
 #include <string.h>
+#include <sys/inode_watcher.h>
 
 #include <libfilepicker/model/FilesystemModel.h>
 #include <libio/File.h>
 #include <libio/Format.h>
+#include <libio/Pipe.h>
 #include <libjson/Json.h>
 
 namespace FilePicker
 {
 
-static auto get_icon_for_node(String current_directory, IO::Directory::Entry &entry)
+static RefPtr<Graphic::Icon> load_directory_icon(String manifest_path)
 {
-    if (entry.stat.type == HJ_FILE_TYPE_DIRECTORY)
-    {
-        auto manifest_path = IO::format("{}/{}/manifest.json", current_directory, entry.name);
+    IO::File manifest_file{manifest_path, HJ_OPEN_READ};
 
-        IO::File manifest_file{manifest_path, HJ_OPEN_READ};
+    if (manifest_file.exist())
+    {
+        auto root = Json::parse(manifest_file);
 
-        if (manifest_file.exist())
+        if (root.is(Json::OBJECT))
         {
-            auto root = Json::parse(manifest_file);
+            auto icon_name = root.get("icon");
 
-            if (root.is(Json::OBJECT))
+            if (icon_name.is(Json::STRING))
             {
-                auto icon_name = root.get("icon");
-
-                if (icon_name.is(Json::STRING))
-                {
-                    return Graphic::Icon::get(icon_name.as_string());
-                }
+                return Graphic::Icon::get(icon_name.as_string());
             }
         }
+    }
+
+    return Graphic::Icon::get("folder");
+}
+
+// Directory icons come from their manifest, which is too slow to open
+// again every time a directory is listed. The least recently used is
+// dropped first.
+static constexpr size_t ICON_CACHE_SIZE = 256;
+
+struct CachedIcon
+{
+    String manifest_path;
+    RefPtr<Graphic::Icon> icon;
+    size_t last_used;
+};
+
+static Vector<CachedIcon> _icon_cache{};
+static size_t _icon_cache_clock = 0;
+
+static RefPtr<Graphic::Icon> get_directory_icon(String manifest_path)
+{
+    _icon_cache_clock++;
+
+    size_t least_recently_used = 0;
+
+    for (size_t i = 0; i < _icon_cache.count(); i++)
+    {
+        auto &cached = _icon_cache[i];
+
+        if (cached.manifest_path == manifest_path)
+        {
+            cached.last_used = _icon_cache_clock;
+            return cached.icon;
+        }
+
+        if (cached.last_used < _icon_cache[least_recently_used].last_used)
+        {
+            least_recently_used = i;
+        }
+    }
+
+    auto icon = load_directory_icon(manifest_path);
 
-        return Graphic::Icon::get("folder");
+    if (_icon_cache.count() < ICON_CACHE_SIZE)
+    {
+        _icon_cache.push_back({manifest_path, icon, _icon_cache_clock});
+    }
+    else
+    {
+        _icon_cache[least_recently_used] = {manifest_path, icon, _icon_cache_clock};
     }
-    else if (entry.stat.type == HJ_FILE_TYPE_PIPE ||
-             entry.stat.type == HJ_FILE_TYPE_DEVICE ||
-             entry.stat.type == HJ_FILE_TYPE_SOCKET)
+
+    return icon;
+}
+
+static RefPtr<Graphic::Icon> get_icon_for_node(String current_directory, const FileInfo &entry)
+{
+    if (entry.type == HJ_FILE_TYPE_DIRECTORY)
+    {
+        return get_directory_icon(IO::format("{}/{}/manifest.json", current_directory, entry.name));
+    }
+    else if (entry.type == HJ_FILE_TYPE_PIPE ||
+             entry.type == HJ_FILE_TYPE_DEVICE ||
+             entry.type == HJ_FILE_TYPE_SOCKET)
     {
         return Graphic::Icon::get("pipe");
     }
-    else if (entry.stat.type == HJ_FILE_TYPE_TERMINAL)
+    else if (entry.type == HJ_FILE_TYPE_TERMINAL)
     {
         return Graphic::Icon::get("console-network");
     }
@@ -66,15 +122,44 @@ enum Column
 };
 
 FilesystemModel::FilesystemModel(RefPtr<Navigation> navigation, Func<bool(IO::Directory::Entry &)> filter)
-    : _navigation(navigation), _filter(filter)
+    : _navigation(navigation), _filter(std::move(filter))
 {
     _observer = navigation->observe([this](auto &) {
         update();
     });
 
+    int watcher = create_inode_watcher((unsigned)InodeWatcherFlags::Nonblock);
+
+    if (watcher >= 0)
+    {
+        _watcher = make<IO::Handle>(watcher);
+        _watcher_notifier = own<IO::Notifier>(_watcher, POLL_READ, [this]() {
+            read_watch_events();
+        });
+    }
+
+    auto pipe = IO::Pipe::create();
+
+    if (pipe.success())
+    {
+        _loader_wakeup = pipe.unwrap().reader;
+        _loader_wakeup_writer = pipe.unwrap().writer;
+        _loader_notifier = own<IO::Notifier>(_loader_wakeup, POLL_READ, [this]() {
+            uint8_t wakeups[16];
+            _loader_wakeup->read(wakeups, sizeof(wakeups));
+
+            take_loaded();
+        });
+    }
+
     update();
 }
 
+FilesystemModel::~FilesystemModel()
+{
+    stop_loading();
+}
+
 int FilesystemModel::rows()
 {
     return _files.count();
@@ -105,7 +190,7 @@ String FilesystemModel::header(int column)
 
 Widget::Variant FilesystemModel::data(int row, int column)
 {
-    auto &entry = _files[row];
+    auto &entry = resolve(_order[row]);
 
     switch (column)
     {
@@ -129,14 +214,16 @@ Widget::Variant FilesystemModel::data(int row, int column)
         }
 
     case COLUMN_SIZE:
-        if (entry.type == HJ_FILE_TYPE_DIRECTORY)
-        {
-            return Widget::Variant(IO::format("{} Items", entry.size));
-        }
-        else
-        {
-            return Widget::Variant(IO::format("{} Bytes", entry.size));
-        }
+        return Widget::Variant(_cells.get(row, column, [&]() {
+            if (entry.type == HJ_FILE_TYPE_DIRECTORY)
+            {
+                return IO::format("{} Items", entry.size);
+            }
+            else
+            {
+                return IO::format("{} Bytes", entry.size);
+            }
+        }));
 
     default:
         ASSERT_NOT_REACHED();
@@ -145,47 +232,408 @@ Widget::Variant FilesystemModel::data(int row, int column)
 
 void FilesystemModel::update()
 {
+    stop_loading();
+
     _files.clear();
+    _changed_while_loading = false;
+
+    watch_current();
 
-    IO::Directory directory{_navigation->current()};
+    _loader_path = _navigation->current();
+    _loader_cancelled = false;
+    _loading = true;
 
-    if (!directory.exist())
+    if (!_loader_wakeup ||
+        pthread_create(&_loader, nullptr, loader_thread, this) != 0)
     {
-        return;
+        _loading = false;
+        load();
     }
 
-    for (auto entry : directory.entries())
+    // Shows the directory empty until the first batch, rather than what
+    // was there before.
+    take_loaded();
+}
+
+void *FilesystemModel::loader_thread(void *model)
+{
+    static_cast<FilesystemModel *>(model)->load();
+    return nullptr;
+}
+
+void FilesystemModel::load()
+{
+    IO::Directory directory{_loader_path};
+    Vector<FileInfo> batch{LOADER_BATCH_SIZE};
+
+    if (directory.exist())
+    {
+        // Icons and directory sizes are left for resolve(), so only the
+        // rows that get looked at pay for them.
+        for (auto &entry : directory.entries())
+        {
+            if (__atomic_load_n(&_loader_cancelled, __ATOMIC_RELAXED))
+            {
+                return;
+            }
+
+            batch.push_back({
+                .name = entry.name,
+                .type = entry.stat.type,
+                .icon = nullptr,
+                .size = entry.stat.size,
+            });
+
+            if (batch.count() == LOADER_BATCH_SIZE)
+            {
+                hand_over(batch, false);
+            }
+        }
+    }
+
+    hand_over(batch, true);
+}
+
+void FilesystemModel::hand_over(Vector<FileInfo> &batch, bool last)
+{
+    bool waiting;
+
+    {
+        Utils::LockHolder holder{_loaded_lock};
+
+        waiting = _loaded.any() || _loaded_all;
+
+        for (auto &file : batch)
+        {
+            _loaded.push_back(std::move(file));
+        }
+
+        _loaded_all = last;
+    }
+
+    batch.clear();
+
+    // The model hasn't taken the last ones yet, it will take these too.
+    if (!waiting && _loading)
+    {
+        uint8_t wakeup = 1;
+        _loader_wakeup_writer->write(&wakeup, sizeof(wakeup));
+    }
+}
+
+void FilesystemModel::take_loaded()
+{
+    Vector<FileInfo> loaded{};
+    bool loaded_all;
+
     {
+        Utils::LockHolder holder{_loaded_lock};
+        std::swap(loaded, _loaded);
+        loaded_all = _loaded_all;
+    }
+
+    // Batches come in the order Directory sorts entries, so _files stays
+    // sorted by name.
+    for (auto &file : loaded)
+    {
+        IO::Directory::Entry entry{file.name, {}};
+        entry.stat.type = file.type;
+        entry.stat.size = file.size;
+
         if (_filter && !_filter(entry))
         {
             continue;
         }
 
-        size_t size = entry.stat.size;
+        _files.push_back(std::move(file));
+    }
+
+    if (loaded_all && _loading)
+    {
+        pthread_join(_loader, nullptr);
+        _loading = false;
+    }
+
+    publish();
+
+    // What the watcher told about while loading may or may not be in the
+    // listing already, so it's listed again.
+    if (loaded_all && _changed_while_loading)
+    {
+        update();
+    }
+}
+
+void FilesystemModel::stop_loading()
+{
+    if (_loading)
+    {
+        __atomic_store_n(&_loader_cancelled, true, __ATOMIC_RELAXED);
+        pthread_join(_loader, nullptr);
+        _loading = false;
+    }
+
+    // A wakeup it left in the pipe only gets the next loader's batches, or
+    // nothing, taken early.
+    Utils::LockHolder holder{_loaded_lock};
+    _loaded.clear();
+    _loaded_all = false;
+}
+
+void FilesystemModel::watch_current()
+{
+    if (!_watcher)
+    {
+        return;
+    }
+
+    if (_watch_descriptor >= 0)
+    {
+        inode_watcher_remove_watch(_watcher->id(), _watch_descriptor);
+    }
+
+    auto path = _navigation->current().string();
+    auto mask = InodeWatcherEvent::Type::ChildCreated |
+                InodeWatcherEvent::Type::ChildDeleted |
+                InodeWatcherEvent::Type::ContentModified |
+                InodeWatcherEvent::Type::MetadataModified;
+
+    _watch_descriptor = inode_watcher_add_watch(_watcher->id(), path.cstring(), path.length(), (unsigned)mask);
+}
 
-        if (entry.stat.type == HJ_FILE_TYPE_DIRECTORY)
+void FilesystemModel::read_watch_events()
+{
+    alignas(InodeWatcherEvent) uint8_t buffer[MAXIMUM_EVENT_SIZE * 16];
+
+    size_t read = _watcher->read(buffer, sizeof(buffer)).unwrap_or(0);
+    size_t offset = 0;
+
+    while (offset + sizeof(InodeWatcherEvent) <= read)
+    {
+        auto &event = *(InodeWatcherEvent *)(buffer + offset);
+        offset += sizeof(InodeWatcherEvent) + event.name_length;
+
+        // Events still queued for a directory left behind are stale.
+        if (event.watch_descriptor != _watch_descriptor)
+        {
+            continue;
+        }
+
+        if (_loading)
+        {
+            _changed_while_loading = true;
+            continue;
+        }
+
+        if (has_flag(event.type, InodeWatcherEvent::Type::Deleted))
+        {
+            update();
+            return;
+        }
+
+        // Events about the directory itself come without a name.
+        if (event.name_length == 0)
+        {
+            continue;
+        }
+
+        // The length counts the null terminator.
+        String name{event.name, event.name_length - 1};
+
+        if (has_flag(event.type, InodeWatcherEvent::Type::ChildCreated))
+        {
+            entry_created(name);
+        }
+        else if (has_flag(event.type, InodeWatcherEvent::Type::ChildDeleted))
+        {
+            entry_deleted(name);
+        }
+        else
+        {
+            entry_modified(name);
+        }
+    }
+
+    publish();
+}
+
+static Optional<JStat> stat_entry(const IO::Path &directory, const String &name)
+{
+    auto path = IO::Path::join(directory, name).string();
+
+    // Directories only open as such.
+    IO::Handle handle{path, HJ_OPEN_READ};
+
+    if (!handle.valid())
+    {
+        handle = IO::Handle{path, HJ_OPEN_READ | HJ_OPEN_DIRECTORY};
+    }
+
+    auto stat = handle.stat();
+
+    if (!stat.success())
+    {
+        return NONE;
+    }
+
+    return stat.unwrap();
+}
+
+size_t FilesystemModel::lower_bound(const String &name)
+{
+    size_t low = 0;
+    size_t high = _files.count();
+
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+
+        if (strcmp(_files[middle].name.cstring(), name.cstring()) < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+void FilesystemModel::entry_created(const String &name)
+{
+    size_t index = lower_bound(name);
+
+    if (index < _files.count() && _files[index].name == name)
+    {
+        entry_modified(name);
+        return;
+    }
+
+    auto stat = stat_entry(_navigation->current(), name);
+
+    if (!stat.present())
+    {
+        return;
+    }
+
+    IO::Directory::Entry entry{name, stat.unwrap()};
+
+    if (_filter && !_filter(entry))
+    {
+        return;
+    }
+
+    _files.insert(index, FileInfo{
+                             .name = name,
+                             .type = entry.stat.type,
+                             .icon = nullptr,
+                             .size = entry.stat.size,
+                         });
+}
+
+void FilesystemModel::entry_deleted(const String &name)
+{
+    size_t index = lower_bound(name);
+
+    if (index < _files.count() && _files[index].name == name)
+    {
+        _files.remove_index(index);
+    }
+}
+
+void FilesystemModel::entry_modified(const String &name)
+{
+    size_t index = lower_bound(name);
+
+    if (index >= _files.count() || _files[index].name != name)
+    {
+        return;
+    }
+
+    auto stat = stat_entry(_navigation->current(), name);
+
+    if (!stat.present())
+    {
+        _files.remove_index(index);
+        return;
+    }
+
+    // Resolved again when next looked at.
+    _files[index].type = stat.unwrap().type;
+    _files[index].size = stat.unwrap().size;
+    _files[index].icon = nullptr;
+}
+
+FileInfo &FilesystemModel::resolve(int index)
+{
+    auto &entry = _files[index];
+
+    if (entry.icon)
+    {
+        return entry;
+    }
+
+    if (entry.type == HJ_FILE_TYPE_DIRECTORY)
+    {
+        auto path = IO::Path::join(_navigation->current(), entry.name);
+        entry.size = IO::Directory::count(path).unwrap_or(0);
+    }
+
+    entry.icon = get_icon_for_node(_navigation->current().string(), entry);
+
+    return entry;
+}
+
+const FileInfo &FilesystemModel::info(int index)
+{
+    return resolve(_order[index]);
+}
+
+int FilesystemModel::compare(int column, size_t left, size_t right)
+{
+    auto &left_file = _files[left];
+    auto &right_file = _files[right];
+
+    switch (column)
+    {
+    case COLUMN_TYPE:
+        if (left_file.type != right_file.type)
         {
-            auto path = IO::Path::join(_navigation->current(), entry.name);
-            IO::Directory subdirectory{path};
-            size = subdirectory.entries().count();
+            return (int)left_file.type - (int)right_file.type;
         }
 
-        FileInfo node{
-            .name = entry.name,
-            .type = entry.stat.type,
-            .icon = get_icon_for_node(_navigation->current().string(), entry),
-            .size = size,
-        };
+        break;
+
+    case COLUMN_SIZE:
+        if (left_file.size != right_file.size)
+        {
+            return left_file.size < right_file.size ? -1 : 1;
+        }
 
-        _files.push_back(node);
+        break;
+
+    default:
+        break;
     }
 
+    return strcmp(left_file.name.cstring(), right_file.name.cstring());
+}
+
+void FilesystemModel::sort(int column, bool ascending)
+{
+    _order.sort(_files.count(), column, ascending, [&](size_t left, size_t right) {
+        return compare(column, left, right);
+    });
+
+    _cells.clear();
     did_update();
 }
 
-const FileInfo &FilesystemModel::info(int index) const
+void FilesystemModel::publish()
 {
-    return _files[index];
+    sort(_order.column(), _order.ascending());
 }
 
 }
\ No newline at end of file
@@ -7,12 +7,17 @@
 #pragma once
 
 // includes
+#include <pthread.h>
 #include <libio/Directory.h>
+#include <libio/Loop.h>
 #include <libio/Path.h>
+#include <libutils/Lock.h>
 #include <libutils/Vector.h>
 #include <libwidget/model/TableModel.h>
+#include <libfilepicker/model/CellCache.h>
 #include <libfilepicker/model/FileInfo.h>
 #include <libfilepicker/model/Navigation.h>
+#include <libfilepicker/model/SortIndex.h>
 
 namespace FilePicker
 {
@@ -25,9 +30,75 @@ private:
     OwnPtr<Async::Observer<Navigation>> _observer;
     Func<bool(IO::Directory::Entry &)> _filter;
 
+    // Tells about entries coming and going in the current directory, so
+    // they can be applied to _files instead of listing it again.
+    RefPtr<IO::Handle> _watcher;
+    OwnPtr<IO::Notifier> _watcher_notifier;
+    int _watch_descriptor = -1;
+
+    // Rows are looked up through _order, _files stays sorted by name.
+    SortIndex _order{};
+    CellCache<3> _cells{};
+
+    // Directories are listed on a thread of their own, which hands the
+    // rows over in batches of LOADER_BATCH_SIZE through _loaded, with a
+    // byte down _loader_wakeup when there were none waiting. The model
+    // takes them on its own thread and shows them as they come.
+    static constexpr size_t LOADER_BATCH_SIZE = 256;
+
+    pthread_t _loader{};
+    bool _loading = false;
+    bool _loader_cancelled = false;
+    bool _changed_while_loading = false;
+    IO::Path _loader_path{};
+
+    RefPtr<IO::Handle> _loader_wakeup;
+    RefPtr<IO::Handle> _loader_wakeup_writer;
+    OwnPtr<IO::Notifier> _loader_notifier;
+
+    Utils::Lock _loaded_lock{"filesystem-model-loaded"};
+    Vector<FileInfo> _loaded{};
+    bool _loaded_all = false;
+
+    static void *loader_thread(void *model);
+
+    // What the loader thread does, or update() itself when the thread
+    // can't be started.
+    void load();
+
+    void hand_over(Vector<FileInfo> &batch, bool last);
+
+    void take_loaded();
+
+    // Cancels the loader, waits for it, and drops what it left behind.
+    void stop_loading();
+
+    // Fills in what update() left out of a row.
+    FileInfo &resolve(int index);
+
+    void watch_current();
+
+    void read_watch_events();
+
+    // Where name is, or would go, in the order Directory sorts entries.
+    size_t lower_bound(const String &name);
+
+    void entry_created(const String &name);
+
+    void entry_deleted(const String &name);
+
+    void entry_modified(const String &name);
+
+    int compare(int column, size_t left, size_t right);
+
+    // Sorts again and tells the view, after _files changed.
+    void publish();
+
 public:
     FilesystemModel(RefPtr<Navigation> navigation, Func<bool(IO::Directory::Entry &)> filter = nullptr);
 
+    ~FilesystemModel();
+
     int rows() override;
 
     int columns() override;
@@ -38,7 +109,12 @@ public:
 
     void update() override;
 
-    const FileInfo &info(int index) const;
+    const FileInfo &info(int index);
+
+    // Sorts the rows by column, or back to by name with
+    // SortIndex::UNSORTED. Sizes of directories not looked at yet are
+    // their own, not how many items they have.
+    void sort(int column, bool ascending);
 };
 
 }
\ No newline at end of file
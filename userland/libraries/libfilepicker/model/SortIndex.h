@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <libutils/Vector.h>
+
+namespace FilePicker
+{
+
+// Maps the rows of a view onto the entries of a model. Sorting by a
+// column only moves indices around, and the entries stay in the order the
+// model finds them by.
+struct SortIndex
+{
+private:
+    Vector<size_t> _order{};
+    int _column = -1;
+    bool _ascending = true;
+
+public:
+    static constexpr int UNSORTED = -1;
+
+    int column() const { return _column; }
+
+    bool ascending() const { return _ascending; }
+
+    size_t operator[](int row) const
+    {
+        return _column == UNSORTED ? row : _order[row];
+    }
+
+    // compare(left, right) is given entry indices, and tells like the
+    // comparators of Vector::sort when left goes after right.
+    template <typename Compare>
+    void sort(size_t count, int column, bool ascending, Compare compare)
+    {
+        _column = column;
+        _ascending = ascending;
+
+        _order.clear();
+
+        if (column == UNSORTED)
+        {
+            return;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            _order.push_back(i);
+        }
+
+        // Ties keep the model's order, whichever way the column goes.
+        _order.sort([&](size_t left, size_t right) {
+            int result = compare(left, right);
+
+            if (result == 0)
+            {
+                return left < right ? -1 : 1;
+            }
+
+            return ascending ? result : -result;
+        });
+    }
+};
+
+}
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <assert.h>
+#include <libio/Connection.h>
+#include <libio/Loop.h>
+#include <libutils/Coroutine.h>
+#include <libutils/Optional.h>
+#include <libutils/String.h>
+
+namespace IO
+{
+
+template <typename T>
+struct Task;
+
+struct TaskPromiseBase
+{
+    std::coroutine_handle<> continuation{};
+    bool detached = false;
+
+    // Tasks only start once awaited or spawned.
+    std::suspend_always initial_suspend() { return {}; }
+
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+
+        // The awaiting coroutine is free to destroy this one once resumed,
+        // so nothing here is touched after that.
+        template <typename Promise>
+        bool await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            auto &promise = handle.promise();
+
+            if (promise.continuation)
+            {
+                promise.continuation.resume();
+                return true;
+            }
+
+            // Nobody waits on a spawned task, so it runs to the end, which
+            // frees it.
+            return !promise.detached;
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { ASSERT_NOT_REACHED(); }
+};
+
+template <typename T>
+struct TaskPromise : public TaskPromiseBase
+{
+    Optional<T> value{};
+
+    Task<T> get_return_object();
+
+    void return_value(T result) { value = std::move(result); }
+
+    T take() { return std::move(value.unwrap()); }
+};
+
+template <>
+struct TaskPromise<void> : public TaskPromiseBase
+{
+    Task<void> get_return_object();
+
+    void return_void() {}
+
+    void take() {}
+};
+
+// A coroutine that co_returns a T, awaited with co_await from another
+// one, or started on its own with spawn().
+template <typename T>
+struct Task
+{
+    using promise_type = TaskPromise<T>;
+
+private:
+    std::coroutine_handle<promise_type> _handle;
+
+    NONCOPYABLE(Task);
+
+    friend void spawn(Task<void> task);
+
+public:
+    Task(std::coroutine_handle<promise_type> handle) : _handle{handle} {}
+
+    Task(Task &&other) : _handle{other._handle}
+    {
+        other._handle = nullptr;
+    }
+
+    ~Task()
+    {
+        if (_handle)
+        {
+            _handle.destroy();
+        }
+    }
+
+    bool await_ready() { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> waiting)
+    {
+        _handle.promise().continuation = waiting;
+        return _handle;
+    }
+
+    T await_resume() { return _handle.promise().take(); }
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object()
+{
+    return Task<T>{std::coroutine_handle<TaskPromise<T>>::from_promise(*this)};
+}
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+    return Task<void>{std::coroutine_handle<TaskPromise<void>>::from_promise(*this)};
+}
+
+// Runs task until its first wait, and leaves the rest to the loop.
+inline void spawn(Task<void> task)
+{
+    auto handle = task._handle;
+    task._handle = nullptr;
+
+    handle.promise().detached = true;
+    handle.resume();
+}
+
+// Resumes the awaiting coroutine from the loop once handle is ready for
+// events.
+struct HandleReady
+{
+    RefPtr<Handle> handle;
+    PollEvent events;
+
+    bool await_ready() { return false; }
+
+    void await_suspend(std::coroutine_handle<> waiting)
+    {
+        Loop::the().wait(handle, events, [waiting]() { waiting.resume(); });
+    }
+
+    void await_resume() {}
+};
+
+static inline HandleReady ready(RefPtr<Handle> handle, PollEvent events)
+{
+    return {handle, events};
+}
+
+// TRY returns rather than co_returns, so these check results by hand.
+
+static inline Task<ResultOr<size_t>> async_read(RefPtr<Handle> handle, void *buffer, size_t size)
+{
+    if (!handle)
+    {
+        co_return ERR_STREAM_CLOSED;
+    }
+
+    co_await ready(handle, POLL_READ);
+    co_return handle->read(buffer, size);
+}
+
+static inline Task<ResultOr<size_t>> async_write(RefPtr<Handle> handle, const void *buffer, size_t size)
+{
+    if (!handle)
+    {
+        co_return ERR_STREAM_CLOSED;
+    }
+
+    co_await ready(handle, POLL_WRITE);
+    co_return handle->write(buffer, size);
+}
+
+static inline Task<ResultOr<Connection>> async_accept(RefPtr<Handle> handle)
+{
+    if (!handle)
+    {
+        co_return ERR_BAD_HANDLE;
+    }
+
+    co_await ready(handle, POLL_ACCEPT);
+
+    auto accepted = handle->accept();
+
+    if (!accepted.success())
+    {
+        co_return accepted.result();
+    }
+
+    co_return Connection{accepted.unwrap()};
+}
+
+static inline Task<ResultOr<Connection>> async_connect(String path)
+{
+    int connection_handle;
+    JResult result = J_handle_connect(&connection_handle, path.cstring(), path.length());
+
+    if (result != SUCCESS)
+    {
+        co_return result;
+    }
+
+    auto handle = make<Handle>(connection_handle);
+    co_await ready(handle, POLL_CONNECT);
+    co_return Connection{handle};
+}
+
+// The handle is taken when called rather than when the task starts, so
+// the object only has to live that long.
+
+static inline Task<ResultOr<size_t>> async_read(RawHandle &raw, void *buffer, size_t size)
+{
+    return async_read(raw.handle(), buffer, size);
+}
+
+static inline Task<ResultOr<size_t>> async_write(RawHandle &raw, const void *buffer, size_t size)
+{
+    return async_write(raw.handle(), buffer, size);
+}
+
+static inline Task<ResultOr<Connection>> async_accept(RawHandle &raw)
+{
+    return async_accept(raw.handle());
+}
+
+}
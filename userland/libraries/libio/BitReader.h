@@ -7,222 +7,323 @@
 #pragma once
 
 // includes
+#include <string.h>
 #include <libio/Read.h>
+#include <libmath/MinMax.h>
 #include <libutils/Assert.h>
-#include <libutils/InlineRingBuffer.h>
+#include <libutils/Slice.h>
 
 namespace IO
 {
-struct BitReader
+
+// Reads a little-endian bit stream (LSB first, as used by deflate).
+//
+// Bits are kept in a 64-bit accumulator. When constructed from a Slice the
+// accumulator is refilled a whole word at a time straight from memory. When
+// constructed from a Reader it only ever fetches the bytes it needs, so the
+// underlying reader can be shared with other consumers, but it does so with
+// a single read() per refill.
+struct BitReader : public Reader
 {
 private:
-    IO::Reader &_reader;
-    InlineRingBuffer<uint8_t, 16> _buffer;
-    size_t _head = 0;
-    bool _end_of_file;
+    static constexpr size_t ACCUMULATOR_BITS = 64;
+    static constexpr size_t MAX_REFILL_BITS = ACCUMULATOR_BITS - 8;
 
-public:
-    inline BitReader(IO::Reader &reader) : _reader(reader) {}
+    IO::Reader *_reader = nullptr;
+
+    const uint8_t *_memory_start = nullptr;
+    const uint8_t *_memory = nullptr;
+    const uint8_t *_memory_end = nullptr;
 
-    inline JResult hint(size_t num_bits)
+    // Past the end of the input the stream reads as zeros and _bit_count
+    // goes negative, which is how overruns are detected.
+    uint64_t _bits = 0;
+    int _bit_count = 0;
+    bool _end_of_file = false;
+
+    ALWAYS_INLINE inline void refill_from_memory(size_t num_bits)
     {
-        size_t num_bytes = ALIGN_UP(_head + num_bits, 8) / 8;
+        // Bits above _bit_count always mirror the bytes at _memory, so
+        // or-ing a whole word in is safe even if some of it is already there.
+        if (_memory_end - _memory >= 8) [[likely]]
+        {
+            uint64_t word;
+            memcpy(&word, _memory, sizeof(word)); // x86 is little endian
 
-        while (_buffer.used() < num_bytes)
+            _bits |= word << _bit_count;
+            _memory += (ACCUMULATOR_BITS - 1 - _bit_count) >> 3;
+            _bit_count |= MAX_REFILL_BITS;
+
+            return;
+        }
+
+        while (_bit_count <= (int)MAX_REFILL_BITS && _memory < _memory_end)
         {
-            uint8_t byte;
+            _bits |= (uint64_t)(*_memory) << _bit_count;
+            _memory++;
+            _bit_count += 8;
+        }
 
-            if (TRY(_reader.read(&byte, sizeof(byte))) == 0)
-            {
-                _end_of_file = true;
-                return SUCCESS;
-            }
-            else
+        if (_bit_count < (int)num_bits)
+        {
+            _end_of_file = true;
+        }
+    }
+
+    inline JResult refill_from_reader(size_t num_bits)
+    {
+        uint8_t bytes[8];
+        size_t num_bytes = ALIGN_UP(num_bits - _bit_count, 8) / 8;
+        size_t num_read = 0;
+
+        while (num_read < num_bytes)
+        {
+            size_t read = TRY(_reader->read(bytes + num_read, num_bytes - num_read));
+
+            if (read == 0)
             {
-                _buffer.put(byte);
+                break;
             }
+
+            num_read += read;
+        }
+
+        for (size_t i = 0; i < num_read; i++)
+        {
+            _bits |= (uint64_t)bytes[i] << _bit_count;
+            _bit_count += 8;
+        }
+
+        if (_bit_count < (int)num_bits)
+        {
+            _end_of_file = true;
         }
 
         return SUCCESS;
     }
 
-    inline void flush()
+    ALWAYS_INLINE inline void consume(size_t num_bits)
     {
-        _head = 0;
-        _buffer.flush();
+        _bits >>= num_bits;
+        _bit_count -= num_bits;
     }
 
-    template <typename T>
-    inline T grab()
+    static inline uint32_t reverse(uint32_t value, size_t num_bits)
     {
-        hint(sizeof(T) * 8);
-
-        T value;
+        uint32_t result = 0;
 
-        for (size_t i = 0; i < sizeof(T); i++)
+        for (size_t i = 0; i < num_bits; i++)
         {
-            (reinterpret_cast<uint8_t *>(&value))[i] = grab_bits(8);
+            result = (result << 1) | (value & 1);
+            value >>= 1;
         }
 
-        return value;
+        return result;
     }
 
-    template <typename T>
-    inline T grab_aligned()
+public:
+    inline BitReader(IO::Reader &reader) : _reader(&reader) {}
+
+    inline BitReader(Slice memory)
+        : _memory_start{(const uint8_t *)memory.start()},
+          _memory{(const uint8_t *)memory.start()},
+          _memory_end{(const uint8_t *)memory.end()}
     {
-        flush();
-        return grab<T>();
     }
 
-    template <typename T>
-    inline T peek()
+    inline bool ended() const
     {
-        hint(sizeof(T) * 8);
+        bool no_more_input = _end_of_file || (!_reader && _memory == _memory_end);
+        return no_more_input && _bit_count <= 0;
+    }
 
-        T value;
+    // More bits have been consumed than the input had.
+    inline bool overrun() const
+    {
+        return _bit_count < 0;
+    }
 
-        for (size_t i = 0; i < sizeof(T); i++)
-        {
-            (reinterpret_cast<uint8_t *>(&value))[i] = peek_bits(i * 8, 8);
-        }
+    // Number of whole bytes taken from a Slice, this doesn't count the
+    // bytes still sitting in the accumulator.
+    inline size_t consumed() const
+    {
+        return (_memory - _memory_start) - MAX(_bit_count, 0) / 8;
+    }
 
-        return value;
+    // Same, in bits, counting the part of a byte already taken too.
+    inline size64_t consumed_bits() const
+    {
+        return (size64_t)(_memory - _memory_start) * 8 - MAX(_bit_count, 0);
     }
 
-    inline JResult skip_bits(size_t num_bits)
+    ALWAYS_INLINE inline JResult hint(size_t num_bits)
     {
-        if (num_bits == 0)
+        if (_bit_count >= (int)num_bits || _end_of_file) [[likely]]
         {
             return SUCCESS;
         }
 
-        TRY(hint(num_bits));
+        Assert::lower_equal(num_bits, MAX_REFILL_BITS);
 
-        for (size_t i = 0; i < num_bits; i++)
+        if (_reader)
         {
-            grab_bit();
+            return refill_from_reader(num_bits);
         }
 
+        refill_from_memory(num_bits);
         return SUCCESS;
     }
 
-    inline uint8_t grab_bit()
+    inline void flush()
     {
-        uint8_t bit = peek_bit(0);
-
-        _head++;
-        if (_head == 8)
-        {
-            _head -= 8;
-            _buffer.get(); // grab the byte
-        }
+        _bits = 0;
+        _bit_count = 0;
+    }
 
-        return bit;
+    // Drop the bits left in the current byte.
+    inline void align()
+    {
+        consume(_bit_count & 7);
     }
 
-    inline uint32_t grab_bits(size_t num_bits)
+    // Read whole bytes, the reader must be byte aligned.
+    ResultOr<size_t> read(void *buffer, size_t size) override
     {
-        if (num_bits == 0)
+        Assert::equal(_bit_count & 7, 0);
+
+        uint8_t *bytes = reinterpret_cast<uint8_t *>(buffer);
+        size_t done = 0;
+
+        while (_bit_count >= 8 && done < size)
         {
-            return 0;
+            bytes[done] = _bits & 0xff;
+            consume(8);
+            done++;
         }
 
-        hint(num_bits);
-
-        Assert::lower_equal(num_bits, 32);
+        if (done == size)
+        {
+            return done;
+        }
 
-        uint32_t result = 0;
+        flush();
 
-        for (size_t i = 0; i < num_bits; i++)
+        if (_reader)
         {
-            uint8_t bit = grab_bit();
-            result |= bit << (i);
+            return done + TRY(_reader->read(bytes + done, size - done));
         }
 
-        return result;
+        size_t remaining = MIN((size_t)(_memory_end - _memory), size - done);
+        memcpy(bytes + done, _memory, remaining);
+        _memory += remaining;
+
+        return done + remaining;
     }
 
-    inline uint8_t peek_bit(size_t index)
+    template <typename T>
+    inline T grab()
     {
-        size_t num_bit = _head + index;
-        size_t num_byte = num_bit / 8;
-        size_t bit_within_the_byte = num_bit - (num_byte * 8);
+        T value;
 
-        uint8_t byte = _buffer.peek(num_byte);
+        for (size_t i = 0; i < sizeof(T); i++)
+        {
+            (reinterpret_cast<uint8_t *>(&value))[i] = grab_bits(8);
+        }
 
-        return ((byte) >> (bit_within_the_byte)) & 1;
+        return value;
     }
 
-    inline uint32_t peek_bits(size_t num_bits)
+    template <typename T>
+    inline T grab_aligned()
     {
-        return peek_bits(0, num_bits);
+        flush();
+        return grab<T>();
     }
 
-    inline uint32_t peek_bits(size_t offset, size_t num_bits)
+    template <typename T>
+    inline T peek()
     {
-        if (num_bits == 0)
+        T value;
+
+        for (size_t i = 0; i < sizeof(T); i++)
         {
-            return 0;
+            (reinterpret_cast<uint8_t *>(&value))[i] = peek_bits(i * 8, 8);
         }
 
-        hint(offset + num_bits);
+        return value;
+    }
 
-        Assert::lower_equal(num_bits, 32);
+    inline JResult skip_bits(size_t num_bits)
+    {
+        while (num_bits > 0)
+        {
+            size_t chunk = MIN(num_bits, 32);
 
-        uint32_t result = 0;
+            TRY(hint(chunk));
+            consume(chunk);
 
-        for (size_t i = 0; i < num_bits; i++)
-        {
-            uint8_t bit = peek_bit(offset + i);
-            result |= bit << (i);
+            num_bits -= chunk;
         }
 
-        return result;
+        return SUCCESS;
     }
 
-    inline uint32_t grab_bits_reverse(size_t num_bits)
+    ALWAYS_INLINE inline uint8_t grab_bit()
     {
-        if (num_bits == 0)
-        {
-            return 0;
-        }
+        hint(1);
 
-        hint(num_bits);
+        uint8_t bit = _bits & 1;
+        consume(1);
+
+        return bit;
+    }
 
+    ALWAYS_INLINE inline uint32_t grab_bits(size_t num_bits)
+    {
         Assert::lower_equal(num_bits, 32);
 
-        uint32_t result = 0;
+        hint(num_bits);
 
-        for (size_t i = 0; i < num_bits; i++)
-        {
-            uint8_t bit = grab_bit();
-            result |= bit << ((num_bits - 1) - i);
-        }
+        uint32_t result = _bits & ((1ull << num_bits) - 1);
+        consume(num_bits);
 
         return result;
     }
 
-    inline uint32_t peek_bits_reverse(size_t num_bits)
+    inline uint8_t peek_bit(size_t index)
     {
-        if (num_bits == 0)
-        {
-            return 0;
-        }
+        hint(index + 1);
+
+        return (_bits >> index) & 1;
+    }
+
+    ALWAYS_INLINE inline uint32_t peek_bits(size_t num_bits)
+    {
+        Assert::lower_equal(num_bits, 32);
 
         hint(num_bits);
 
+        return _bits & ((1ull << num_bits) - 1);
+    }
+
+    ALWAYS_INLINE inline uint32_t peek_bits(size_t offset, size_t num_bits)
+    {
         Assert::lower_equal(num_bits, 32);
 
-        uint32_t result = 0;
+        hint(offset + num_bits);
 
-        for (size_t i = 0; i < num_bits; i++)
-        {
-            uint8_t bit = peek_bit(i);
-            result |= bit << ((num_bits - 1) - i);
-        }
+        return (_bits >> offset) & ((1ull << num_bits) - 1);
+    }
 
-        return result;
+    inline uint32_t grab_bits_reverse(size_t num_bits)
+    {
+        return reverse(grab_bits(num_bits), num_bits);
+    }
+
+    inline uint32_t peek_bits_reverse(size_t num_bits)
+    {
+        return reverse(peek_bits(num_bits), num_bits);
     }
 };
 
-}
\ No newline at end of file
+}
@@ -13,13 +13,57 @@
 namespace IO
 {
 
+// Writes a little-endian bit stream (LSB first, as used by deflate).
+//
+// Whole bytes are staged in a small buffer and handed to the underlying
+// writer in chunks, call align() before the last flush() to pad the final
+// partial byte.
 struct BitWriter
 {
 private:
-    uint_fast32_t _bit_buffer;
-    uint8_t _bit_count;
+    static constexpr size_t BUFFER_SIZE = 4096;
+
+    uint64_t _bit_buffer = 0;
+    size_t _bit_count = 0;
+
+    uint8_t _buffer[BUFFER_SIZE];
+    size_t _used = 0;
+
     Writer &_writer;
 
+    inline void put_byte(uint8_t byte)
+    {
+        if (_used == BUFFER_SIZE)
+        {
+            flush_buffer();
+        }
+
+        _buffer[_used] = byte;
+        _used++;
+    }
+
+    inline void flush_bits()
+    {
+        while (_bit_count >= 8)
+        {
+            put_byte(_bit_buffer & 0xff);
+            _bit_buffer >>= 8;
+            _bit_count -= 8;
+        }
+    }
+
+    inline void flush_buffer()
+    {
+        if (_used > 0)
+        {
+            _writer.write(_buffer, _used);
+            _used = 0;
+        }
+    }
+
+    NONCOPYABLE(BitWriter);
+    NONMOVABLE(BitWriter);
+
 public:
     BitWriter(Writer &writer) : _writer(writer)
     {
@@ -32,36 +76,39 @@ public:
 
     inline void put_bits(unsigned int v, const size_t num_bits)
     {
-        _bit_buffer |= v << _bit_count;
+        _bit_buffer |= (uint64_t)v << _bit_count;
         _bit_count += num_bits;
+
+        if (_bit_count >= 32)
+        {
+            flush_bits();
+        }
     }
 
+    // The writer must be byte aligned.
     inline void put_data(const uint8_t *data, size_t len)
     {
+        flush();
         _writer.write(data, len);
     }
 
+    // The writer must be byte aligned.
     inline void put_uint16(uint16_t v)
     {
-        IO::write(_writer, v);
+        put_bits(v, 16);
     }
 
     inline void align()
     {
         _bit_count += -_bit_count & 7;
-        flush();
+        flush_bits();
     }
 
     inline void flush()
     {
-
-        while (_bit_count >= 8)
-        {
-            IO::write(_writer, (uint8_t)_bit_buffer);
-            _bit_count -= 8;
-            _bit_buffer >>= 8;
-        }
+        flush_bits();
+        flush_buffer();
     }
 };
 
-}
\ No newline at end of file
+}
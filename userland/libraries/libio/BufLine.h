@@ -7,7 +7,9 @@
 #pragma once
 
 // includes
+#include <string.h>
 #include <libio/Writer.h>
+#include <libmath/MinMax.h>
 #include <libutils/Array.h>
 
 namespace IO
@@ -27,14 +29,26 @@ public:
 
     ResultOr<size_t> write(const void *buffer, size_t size) override
     {
-        for (size_t i = 0; i < size; i++)
+        const uint8_t *data = static_cast<const uint8_t *>(buffer);
+        size_t left = size;
+
+        // Copies up to and including the next newline, or as much as fits.
+        while (left > 0)
         {
-            uint8_t byte = static_cast<const uint8_t *>(buffer)[i];
+            size_t count = MIN(left, _buffer.count() - _used);
+            auto newline = (const uint8_t *)memchr(data, '\n', count);
+
+            if (newline)
+            {
+                count = newline - data + 1;
+            }
 
-            _buffer[_used] = byte;
-            _used++;
+            memcpy(_buffer.raw_storage() + _used, data, count);
+            _used += count;
+            data += count;
+            left -= count;
 
-            if (byte == '\n' || _used == _buffer.count())
+            if (newline || _used == _buffer.count())
             {
                 TRY(flush());
             }
@@ -8,8 +8,10 @@
 
 // includes
 #include <string.h>
+#include <libio/BufferPool.h>
 #include <libio/Reader.h>
 #include <libmath/MinMax.h>
+#include <libutils/Slice.h>
 
 namespace IO
 {
@@ -19,14 +21,13 @@ struct BufReader : public Reader
 private:
     Reader &_reader;
 
-    uint8_t *_buffer;
+    Buffer _buffer;
     size_t _used = 0;
     size_t _head = 0;
-    size_t _size = 0;
 
     ResultOr<size_t> fill()
     {
-        _used = TRY(_reader.read(_buffer, _size));
+        _used = TRY(_reader.read(_buffer.data(), _buffer.size()));
         _head = 0;
 
         return _used;
@@ -36,15 +37,16 @@ private:
     NONMOVABLE(BufReader);
 
 public:
+    // Borrows a buffer of at least size bytes from the pool.
     BufReader(Reader &reader, size_t size)
-        : _reader{reader}, _size{size}
+        : _reader{reader}, _buffer{Buffer::borrow(size)}
     {
-        _buffer = new uint8_t[_size];
     }
 
-    ~BufReader()
+    // Reads through the caller's buffer, which has to outlive the reader.
+    BufReader(Reader &reader, void *buffer, size_t size)
+        : _reader{reader}, _buffer{buffer, size}
     {
-        delete _buffer;
     }
 
     ResultOr<size_t> buffered()
@@ -52,6 +54,24 @@ public:
         return _used;
     }
 
+    // What is buffered and not read yet, refilled first if that is nothing.
+    // Only empty at the end. Stays valid until the next read or fill.
+    ResultOr<Slice> window()
+    {
+        if (_head == _used)
+        {
+            TRY(fill());
+        }
+
+        return Slice{_buffer.data() + _head, _used - _head};
+    }
+
+    // Marks the first count bytes of the window as read.
+    void consume(size_t count)
+    {
+        _head += MIN(count, _used - _head);
+    }
+
     ResultOr<size_t> read(void *buffer, size_t size) override
     {
         size_t data_left = size;
@@ -73,7 +93,7 @@ public:
 
             memcpy(
                 data_to_read,
-                ((uint8_t *)_buffer) + _head,
+                _buffer.data() + _head,
                 data_added);
 
             data_left -= data_added;
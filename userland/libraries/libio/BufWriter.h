@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <string.h>
+#include <libio/Writer.h>
+#include <libmath/MinMax.h>
+#include <libutils/Array.h>
+
+namespace IO
+{
+
+// Gathers small writes in a buffer on the stack and hands them to the
+// writer beneath once it fills up, or on flush(). Writes too big for the
+// buffer go straight through.
+struct BufWriter : public IO::Writer
+{
+private:
+    IO::Writer &_writer;
+    Array<uint8_t, 512> _buffer;
+    size_t _used = 0;
+
+public:
+    BufWriter(IO::Writer &writer) : _writer{writer} {}
+
+    ~BufWriter() { flush(); }
+
+    ResultOr<size_t> write(const void *buffer, size_t size) override
+    {
+        if (size > _buffer.count() - _used)
+        {
+            TRY(flush());
+        }
+
+        if (size >= _buffer.count())
+        {
+            return _writer.write(buffer, size);
+        }
+
+        memcpy(_buffer.raw_storage() + _used, buffer, size);
+        _used += size;
+
+        return size;
+    }
+
+    JResult flush() override
+    {
+        if (_used == 0)
+        {
+            return SUCCESS;
+        }
+
+        auto result = _writer.write(_buffer.raw_storage(), _used).result();
+        _used = 0;
+        return result;
+    }
+};
+
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <stdlib.h>
+#include <libio/BufferPool.h>
+
+namespace IO
+{
+
+// 4K, 16K, 64K, 256K and 1M.
+static constexpr size_t SIZE_CLASS_COUNT = 5;
+
+// Free buffers are chained through their first bytes.
+struct FreeBuffer
+{
+    FreeBuffer *next;
+};
+
+static size_t size_class_of(size_t size)
+{
+    size_t size_class = 0;
+
+    while ((BUFFER_POOL_MIN_SIZE << (size_class * 2)) < size)
+    {
+        size_class++;
+    }
+
+    return size_class;
+}
+
+// malloc doesn't align to more than 16 bytes, so what it returns is kept
+// just in front of the aligned buffer to be freed later.
+static uint8_t *allocate(size_t size)
+{
+    uint8_t *raw = (uint8_t *)malloc(size + sizeof(void *) + BUFFER_POOL_ALIGNMENT);
+
+    if (!raw)
+    {
+        return nullptr;
+    }
+
+    uint8_t *buffer = (uint8_t *)ALIGN_UP((uintptr_t)raw + sizeof(void *), BUFFER_POOL_ALIGNMENT);
+    ((void **)buffer)[-1] = raw;
+
+    return buffer;
+}
+
+static void deallocate(uint8_t *buffer)
+{
+    free(((void **)buffer)[-1]);
+}
+
+// Each thread keeps its own free buffers, so borrowing takes no lock. A
+// buffer given back on another thread than it was borrowed on simply joins
+// that thread's, and what a thread kept goes when it exits.
+struct FreeBuffers
+{
+    FreeBuffer *first[SIZE_CLASS_COUNT] = {};
+    size_t count[SIZE_CLASS_COUNT] = {};
+
+    ~FreeBuffers()
+    {
+        for (size_t i = 0; i < SIZE_CLASS_COUNT; i++)
+        {
+            while (first[i])
+            {
+                FreeBuffer *buffer = first[i];
+                first[i] = buffer->next;
+                deallocate((uint8_t *)buffer);
+            }
+        }
+    }
+};
+
+static thread_local FreeBuffers _free;
+
+uint8_t *buffer_pool_acquire(size_t &size)
+{
+    if (size > BUFFER_POOL_MAX_SIZE)
+    {
+        return allocate(size);
+    }
+
+    size_t size_class = size_class_of(size);
+    size = BUFFER_POOL_MIN_SIZE << (size_class * 2);
+
+    if (_free.first[size_class])
+    {
+        FreeBuffer *buffer = _free.first[size_class];
+        _free.first[size_class] = buffer->next;
+        _free.count[size_class]--;
+
+        return (uint8_t *)buffer;
+    }
+
+    return allocate(size);
+}
+
+void buffer_pool_release(uint8_t *buffer, size_t size)
+{
+    if (!buffer)
+    {
+        return;
+    }
+
+    if (size > BUFFER_POOL_MAX_SIZE)
+    {
+        deallocate(buffer);
+        return;
+    }
+
+    size_t size_class = size_class_of(size);
+
+    if (_free.count[size_class] == BUFFER_POOL_KEPT_PER_SIZE)
+    {
+        deallocate(buffer);
+        return;
+    }
+
+    FreeBuffer *free_buffer = (FreeBuffer *)buffer;
+    free_buffer->next = _free.first[size_class];
+    _free.first[size_class] = free_buffer;
+    _free.count[size_class]++;
+}
+
+}
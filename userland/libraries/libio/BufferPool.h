@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <libutils/Prelude.h>
+#include <libutils/Std.h>
+
+namespace IO
+{
+
+// Buffers are handed out in sizes that are a power of four between these,
+// and aligned for the block copies that fill and drain them.
+constexpr size_t BUFFER_POOL_MIN_SIZE = 4096;
+constexpr size_t BUFFER_POOL_MAX_SIZE = 1024 * 1024;
+constexpr size_t BUFFER_POOL_ALIGNMENT = 64;
+
+// How many free buffers of each size each thread keeps around for its next
+// borrower.
+constexpr size_t BUFFER_POOL_KEPT_PER_SIZE = 4;
+
+// Returns at least size bytes, and how many there really are in size.
+uint8_t *buffer_pool_acquire(size_t &size);
+
+void buffer_pool_release(uint8_t *buffer, size_t size);
+
+// Either borrowed from the pool, and given back to it when dropped, or
+// owned by the caller, and left alone.
+struct Buffer
+{
+private:
+    uint8_t *_data = nullptr;
+    size_t _size = 0;
+    bool _borrowed = false;
+
+    NONCOPYABLE(Buffer);
+
+public:
+    static Buffer borrow(size_t size)
+    {
+        Buffer buffer{};
+        buffer._data = buffer_pool_acquire(size);
+        buffer._size = size;
+        buffer._borrowed = true;
+        return buffer;
+    }
+
+    uint8_t *data() { return _data; }
+
+    size_t size() const { return _size; }
+
+    Buffer() {}
+
+    Buffer(void *data, size_t size)
+        : _data{(uint8_t *)data}, _size{size}
+    {
+    }
+
+    Buffer(Buffer &&other)
+    {
+        std::swap(_data, other._data);
+        std::swap(_size, other._size);
+        std::swap(_borrowed, other._borrowed);
+    }
+
+    Buffer &operator=(Buffer &&other)
+    {
+        std::swap(_data, other._data);
+        std::swap(_size, other._size);
+        std::swap(_borrowed, other._borrowed);
+        return *this;
+    }
+
+    ~Buffer()
+    {
+        if (_borrowed)
+        {
+            buffer_pool_release(_data, _size);
+        }
+    }
+};
+
+}
@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <libio/BufferPool.h>
+#include <libio/Reader.h>
+#include <libio/Writer.h>
+#include <libmath/MinMax.h>
+#include <libutils/Slice.h>
+#include <libutils/Vector.h>
+
+namespace IO
+{
+
+constexpr size_t CHAIN_SEGMENT_SIZE = 16 * 1024;
+
+// A fixed-size block from the buffer pool that is only ever appended to,
+// so the bytes a piece of a chain points at never change once written.
+struct ChainSegment final :
+    public Storage
+{
+private:
+    Buffer _buffer;
+    size_t _used = 0;
+
+public:
+    using Storage::end;
+    using Storage::start;
+
+    size_t used() const { return _used; }
+
+    size_t left() const { return _buffer.size() - _used; }
+
+    void *start() override { return _buffer.data(); }
+
+    void *end() override { return _buffer.data() + _used; }
+
+    ChainSegment() : _buffer{Buffer::borrow(CHAIN_SEGMENT_SIZE)}
+    {
+    }
+
+    size_t append(const void *data, size_t size)
+    {
+        size = MIN(size, left());
+        memcpy(_buffer.data() + _used, data, size);
+        _used += size;
+        return size;
+    }
+};
+
+// Bytes spread over refcounted pieces: appending never moves what is already
+// there, and slices share the pieces they cover instead of copying them.
+struct Chain
+{
+private:
+    Vector<Slice> _pieces;
+    RefPtr<ChainSegment> _tail;
+    size_t _size = 0;
+
+    static Slice subslice(Slice piece, size_t offset, size_t size)
+    {
+        auto storage = piece.storage();
+
+        if (storage == nullptr)
+        {
+            return {(const uint8_t *)piece.start() + offset, size};
+        }
+
+        size_t base = (const uint8_t *)piece.start() - (const uint8_t *)storage->start();
+        return {storage, base + offset, size};
+    }
+
+    // Whether the last piece ends where the tail segment does, and can grow
+    // in place without anyone else seeing it.
+    bool tail_is_open()
+    {
+        if (_tail == nullptr || _pieces.empty())
+        {
+            return false;
+        }
+
+        auto &last = _pieces.peek_back();
+        return last.end() == _tail->end() && _tail->left() > 0;
+    }
+
+public:
+    size_t size() const { return _size; }
+
+    bool any() const { return _size > 0; }
+
+    size_t piece_count() const { return _pieces.count(); }
+
+    const Slice &piece(size_t index) const { return _pieces[index]; }
+
+    Chain() {}
+
+    Chain(Slice slice)
+    {
+        append(slice);
+    }
+
+    // Copies into pool segments, filling the last one before taking another.
+    void append(const void *data, size_t size)
+    {
+        auto bytes = (const uint8_t *)data;
+
+        while (size > 0)
+        {
+            if (!tail_is_open())
+            {
+                _tail = make<ChainSegment>();
+                _pieces.push_back(Slice{_tail, 0, 0});
+            }
+
+            auto &last = _pieces.peek_back();
+            size_t appended = _tail->append(bytes, size);
+            last = subslice(last, 0, last.size() + appended);
+
+            bytes += appended;
+            size -= appended;
+            _size += appended;
+        }
+    }
+
+    // Takes a reference on the slice's storage, the bytes aren't copied.
+    void append(Slice slice)
+    {
+        if (!slice.any())
+        {
+            return;
+        }
+
+        _pieces.push_back(slice);
+        _size += slice.size();
+    }
+
+    void append(const Chain &other)
+    {
+        for (size_t i = 0; i < other._pieces.count(); i++)
+        {
+            append(other._pieces[i]);
+        }
+    }
+
+    // Shares the pieces between offset and offset + size.
+    Chain slice(size_t offset, size_t size) const
+    {
+        assert(offset + size <= _size);
+
+        Chain result;
+
+        for (size_t i = 0; i < _pieces.count() && size > 0; i++)
+        {
+            auto &piece = _pieces[i];
+
+            if (offset >= piece.size())
+            {
+                offset -= piece.size();
+                continue;
+            }
+
+            size_t taken = MIN(piece.size() - offset, size);
+            result.append(subslice(piece, offset, taken));
+
+            offset = 0;
+            size -= taken;
+        }
+
+        return result;
+    }
+
+    // Only copies when there is more than one piece.
+    Slice linear() const
+    {
+        if (_pieces.count() == 0)
+        {
+            return {};
+        }
+
+        if (_pieces.count() == 1)
+        {
+            return _pieces[0];
+        }
+
+        auto storage = make<SliceStorage>(_size);
+        auto destination = (uint8_t *)storage->start();
+
+        for (size_t i = 0; i < _pieces.count(); i++)
+        {
+            memcpy(destination, _pieces[i].start(), _pieces[i].size());
+            destination += _pieces[i].size();
+        }
+
+        return Slice{storage};
+    }
+
+    void clear()
+    {
+        _pieces.clear();
+        _tail = nullptr;
+        _size = 0;
+    }
+
+    // Every piece in one gathered write, or more than one if the writer
+    // takes less than it is given.
+    JResult write_to(Writer &writer) const
+    {
+        Vector<IOVec> vecs(_pieces.count());
+
+        for (size_t i = 0; i < _pieces.count(); i++)
+        {
+            vecs.push_back({const_cast<void *>(_pieces[i].start()), _pieces[i].size()});
+        }
+
+        size_t index = 0;
+
+        while (index < vecs.count())
+        {
+            size_t written = TRY(writer.writev(&vecs[index], vecs.count() - index));
+
+            if (written == 0)
+            {
+                return ERR_STREAM_CLOSED;
+            }
+
+            while (index < vecs.count() && written >= vecs[index].size)
+            {
+                written -= vecs[index].size;
+                index++;
+            }
+
+            if (written > 0)
+            {
+                vecs[index].data = (uint8_t *)vecs[index].data + written;
+                vecs[index].size -= written;
+            }
+        }
+
+        return SUCCESS;
+    }
+};
+
+struct ChainWriter :
+    public Writer
+{
+private:
+    Chain _chain;
+
+public:
+    using Writer::flush;
+
+    Chain &chain() { return _chain; }
+
+    ResultOr<size_t> write(const void *buffer, size_t size) override
+    {
+        _chain.append(buffer, size);
+        return size;
+    }
+
+    ResultOr<size_t> writev(const IOVec *vecs, size_t count) override
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            _chain.append(vecs[i].data, vecs[i].size);
+        }
+
+        return iovec_total_size(vecs, count);
+    }
+};
+
+struct ChainReader final :
+    public Reader,
+    public Seek
+{
+private:
+    Chain _chain;
+    size_t _position = 0;
+
+    // Where _position is, found again from the start after a seek.
+    size_t _piece = 0;
+    size_t _piece_offset = 0;
+
+    void locate()
+    {
+        _piece = 0;
+        _piece_offset = _position;
+
+        while (_piece < _chain.piece_count() && _piece_offset >= _chain.piece(_piece).size())
+        {
+            _piece_offset -= _chain.piece(_piece).size();
+            _piece++;
+        }
+    }
+
+public:
+    ChainReader(Chain chain) : _chain{chain}
+    {
+    }
+
+    ResultOr<size_t> read(void *buffer, size_t size) override
+    {
+        auto destination = (uint8_t *)buffer;
+        size_t done = 0;
+
+        while (done < size && _piece < _chain.piece_count())
+        {
+            auto &piece = _chain.piece(_piece);
+            size_t taken = MIN(piece.size() - _piece_offset, size - done);
+
+            memcpy(destination + done, (const uint8_t *)piece.start() + _piece_offset, taken);
+            done += taken;
+            _piece_offset += taken;
+
+            if (_piece_offset == piece.size())
+            {
+                _piece++;
+                _piece_offset = 0;
+            }
+        }
+
+        _position += done;
+        return done;
+    }
+
+    ResultOr<size64_t> seek(SeekFrom from) override
+    {
+        switch (from.whence)
+        {
+        case Whence::START:
+            _position = from.position;
+            break;
+
+        case Whence::CURRENT:
+            _position += from.position;
+            break;
+
+        case Whence::END:
+            _position = _chain.size() + from.position;
+            break;
+
+        default:
+            ASSERT_NOT_REACHED();
+        }
+
+        locate();
+        return _position;
+    }
+
+    ResultOr<size64_t> length() override
+    {
+        return _chain.size();
+    }
+
+    Optional<size_t> remaining() override
+    {
+        return _position < _chain.size() ? _chain.size() - _position : 0;
+    }
+
+    ResultOr<size64_t> tell() override
+    {
+        return _position;
+    }
+};
+
+}
@@ -7,14 +7,198 @@
 #pragma once
 
 // includes
+#include <string.h>
 #include <libio/Handle.h>
+#include <libio/Loop.h>
 #include <libio/Path.h>
 #include <libio/Reader.h>
 #include <libio/Writer.h>
+#include <libsystem/system/Memory.h>
+#include <libutils/Array.h>
+#include <libutils/Vector.h>
 
 namespace IO
 {
 
+// Messages from this size up are sent as shared memory once a Connection
+// enables it, below it the copies through the kernel cost less than
+// mapping the pages.
+constexpr size_t CONNECTION_SHARED_THRESHOLD = 64 * 1024;
+
+// How many shared messages a sender keeps waiting for the other side to
+// map. Past that they go through the connection, copied.
+constexpr size_t CONNECTION_MAX_PENDING_SHARED = 16;
+
+// A message of Connection::send_message() and receive_message(): bytes of
+// its own, or shared memory that is mapped on both sides and read in
+// place.
+struct ConnectionMessage
+{
+private:
+    Vector<uint8_t> _bytes{};
+    uintptr_t _shared_address = 0;
+    size_t _size = 0;
+
+    NONCOPYABLE(ConnectionMessage);
+
+public:
+    ConnectionMessage() {}
+
+    ConnectionMessage(size_t size) : _bytes(size), _size{size}
+    {
+        _bytes.resize(size);
+    }
+
+    ConnectionMessage(uintptr_t shared_address, size_t size)
+        : _shared_address{shared_address}, _size{size}
+    {
+    }
+
+    ConnectionMessage(ConnectionMessage &&other)
+        : _bytes{std::move(other._bytes)},
+          _shared_address{std::exchange(other._shared_address, 0)},
+          _size{std::exchange(other._size, 0)}
+    {
+    }
+
+    ConnectionMessage &operator=(ConnectionMessage &&other)
+    {
+        std::swap(_bytes, other._bytes);
+        std::swap(_shared_address, other._shared_address);
+        std::swap(_size, other._size);
+
+        return *this;
+    }
+
+    ~ConnectionMessage()
+    {
+        if (_shared_address)
+        {
+            memory_free(_shared_address);
+        }
+    }
+
+    void *data()
+    {
+        return _shared_address ? reinterpret_cast<void *>(_shared_address) : _bytes.raw_storage();
+    }
+
+    const void *data() const
+    {
+        return _shared_address ? reinterpret_cast<const void *>(_shared_address) : _bytes.raw_storage();
+    }
+
+    size_t size() const { return _size; }
+
+    bool shared() const { return _shared_address != 0; }
+
+    // Gives up the shared memory without unmapping it.
+    uintptr_t leak_shared_address()
+    {
+        _size = 0;
+        return std::exchange(_shared_address, 0);
+    }
+};
+
+// What goes on the connection in front of each message.
+struct ConnectionFrame
+{
+    enum Kind : uint32_t
+    {
+        // size bytes follow.
+        INLINE,
+        // The message is the memory of handle.
+        SHARED,
+        // The other side mapped the memory of handle, the sender can let go
+        // of it.
+        RELEASE,
+    };
+
+    uint32_t kind;
+    int32_t handle;
+    uint64_t size;
+};
+
+// The shared messages a sender still maps, until the other side says it
+// mapped them too. Shared by the copies of a Connection.
+struct ConnectionPendingShared :
+    public RefCounted<ConnectionPendingShared>
+{
+private:
+    struct Pending
+    {
+        int handle = HANDLE_INVALID_ID;
+        uintptr_t address = 0;
+    };
+
+    Array<Pending, CONNECTION_MAX_PENDING_SHARED> _pending;
+
+    NONCOPYABLE(ConnectionPendingShared);
+    NONMOVABLE(ConnectionPendingShared);
+
+public:
+    ConnectionPendingShared() {}
+
+    ~ConnectionPendingShared()
+    {
+        for (size_t i = 0; i < _pending.count(); i++)
+        {
+            auto &pending = _pending[i];
+
+            if (pending.address)
+            {
+                memory_free(pending.address);
+            }
+        }
+    }
+
+    bool add(int handle, uintptr_t address)
+    {
+        for (size_t i = 0; i < _pending.count(); i++)
+        {
+            auto &pending = _pending[i];
+
+            if (!pending.address)
+            {
+                pending = {handle, address};
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool full()
+    {
+        for (size_t i = 0; i < _pending.count(); i++)
+        {
+            auto &pending = _pending[i];
+
+            if (!pending.address)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void release(int handle)
+    {
+        for (size_t i = 0; i < _pending.count(); i++)
+        {
+            auto &pending = _pending[i];
+
+            if (pending.address && pending.handle == handle)
+            {
+                memory_free(pending.address);
+                pending = {};
+                return;
+            }
+        }
+    }
+};
+
 struct Connection final :
     public Reader,
     public Writer,
@@ -22,6 +206,78 @@ struct Connection final :
 {
 private:
     RefPtr<Handle> _handle;
+    size_t _shared_threshold = 0;
+    RefPtr<ConnectionPendingShared> _pending_shared;
+
+    JResult read_exactly(void *buffer, size_t size)
+    {
+        auto *bytes = static_cast<uint8_t *>(buffer);
+        size_t done = 0;
+
+        while (done < size)
+        {
+            size_t last_read = TRY(read(bytes + done, size - done));
+
+            if (last_read == 0)
+            {
+                return ERR_STREAM_CLOSED;
+            }
+
+            done += last_read;
+        }
+
+        return SUCCESS;
+    }
+
+    JResult write_exactly(const void *buffer, size_t size)
+    {
+        auto *bytes = static_cast<const uint8_t *>(buffer);
+        size_t done = 0;
+
+        while (done < size)
+        {
+            size_t written = TRY(write(bytes + done, size - done));
+
+            if (written == 0)
+            {
+                return ERR_STREAM_CLOSED;
+            }
+
+            done += written;
+        }
+
+        return SUCCESS;
+    }
+
+    // The frame and a small payload go out in one write.
+    JResult write_frame(const ConnectionFrame &frame, const void *payload = nullptr, size_t size = 0)
+    {
+        IOVec vecs[2] = {
+            {const_cast<ConnectionFrame *>(&frame), sizeof(frame)},
+            {const_cast<void *>(payload), size},
+        };
+
+        size_t total = sizeof(frame) + size;
+        size_t written = TRY(writev(vecs, size ? 2 : 1));
+
+        if (written < sizeof(frame))
+        {
+            TRY(write_exactly(reinterpret_cast<const uint8_t *>(&frame) + written, sizeof(frame) - written));
+            written = sizeof(frame);
+        }
+
+        if (written < total)
+        {
+            TRY(write_exactly(static_cast<const uint8_t *>(payload) + (written - sizeof(frame)), total - written));
+        }
+
+        return SUCCESS;
+    }
+
+    bool should_share(size_t size)
+    {
+        return _shared_threshold && size >= _shared_threshold && !_pending_shared->full();
+    }
 
 public:
     RefPtr<Handle> handle() override { return _handle; }
@@ -45,6 +301,47 @@ public:
         return _handle->write(buffer, size);
     }
 
+    ResultOr<size_t> writev(const IOVec *vecs, size_t count) override
+    {
+        if (!_handle)
+            return ERR_STREAM_CLOSED;
+
+        return _handle->writev(vecs, count);
+    }
+
+    // Reads or writes once the handle is ready to without blocking, and
+    // calls callback from the loop with the result. The buffer has to stay
+    // alive until then.
+    void read_async(void *buffer, size_t size, Func<void(ResultOr<size_t>)> callback)
+    {
+        if (!_handle)
+        {
+            Loop::the().defer([callback = std::move(callback)]() { callback(ERR_STREAM_CLOSED); });
+            return;
+        }
+
+        auto handle = _handle;
+
+        Loop::the().wait(_handle, POLL_READ, [handle, buffer, size, callback = std::move(callback)]() {
+            callback(handle->read(buffer, size));
+        });
+    }
+
+    void write_async(const void *buffer, size_t size, Func<void(ResultOr<size_t>)> callback)
+    {
+        if (!_handle)
+        {
+            Loop::the().defer([callback = std::move(callback)]() { callback(ERR_STREAM_CLOSED); });
+            return;
+        }
+
+        auto handle = _handle;
+
+        Loop::the().wait(_handle, POLL_WRITE, [handle, buffer, size, callback = std::move(callback)]() {
+            callback(handle->write(buffer, size));
+        });
+    }
+
     bool closed()
     {
         return _handle == nullptr;
@@ -53,6 +350,146 @@ public:
     void close()
     {
         _handle = nullptr;
+        _shared_threshold = 0;
+        _pending_shared = nullptr;
+    }
+
+    // From here on, send_message() passes messages of threshold bytes and
+    // more as shared memory: the sender writes them once and the receiver
+    // reads them where they are, instead of two copies through the kernel.
+    // Either side can receive them, enabled or not.
+    //
+    // Each one stays mapped on the sending side until the other answers
+    // that it mapped it too, which it does as it receives it. Those answers
+    // are read by receive_message(), so this pays off for requests and
+    // replies; a side that only ever sends falls back to copies after
+    // CONNECTION_MAX_PENDING_SHARED messages. SharedChannel is the one for
+    // streams going one way.
+    void enable_shared_messages(size_t threshold = CONNECTION_SHARED_THRESHOLD)
+    {
+        _shared_threshold = threshold;
+
+        if (!_pending_shared)
+        {
+            _pending_shared = make<ConnectionPendingShared>();
+        }
+    }
+
+    // A message of size bytes to fill and pass to send_message(), in shared
+    // memory if it is going to be sent that way.
+    JResult prepare_message(size_t size, ConnectionMessage &message)
+    {
+        if (!should_share(size))
+        {
+            message = ConnectionMessage{size};
+            return SUCCESS;
+        }
+
+        uintptr_t address = 0;
+        TRY(memory_alloc(size, &address));
+        message = ConnectionMessage{address, size};
+
+        return SUCCESS;
+    }
+
+    // Sends and empties message.
+    JResult send_message(ConnectionMessage &message)
+    {
+        if (!_handle)
+        {
+            return ERR_STREAM_CLOSED;
+        }
+
+        if (!message.shared() || !_shared_threshold || _pending_shared->full())
+        {
+            auto result = write_frame({ConnectionFrame::INLINE, HANDLE_INVALID_ID, message.size()}, message.data(), message.size());
+            message = ConnectionMessage{};
+            return result;
+        }
+
+        int handle = HANDLE_INVALID_ID;
+        TRY(memory_get_handle(reinterpret_cast<uintptr_t>(message.data()), &handle));
+        TRY(write_frame({ConnectionFrame::SHARED, handle, message.size()}));
+
+        _pending_shared->add(handle, message.leak_shared_address());
+
+        return SUCCESS;
+    }
+
+    JResult send_message(const void *buffer, size_t size)
+    {
+        if (!should_share(size))
+        {
+            if (!_handle)
+            {
+                return ERR_STREAM_CLOSED;
+            }
+
+            return write_frame({ConnectionFrame::INLINE, HANDLE_INVALID_ID, size}, buffer, size);
+        }
+
+        ConnectionMessage message;
+        TRY(prepare_message(size, message));
+        memcpy(message.data(), buffer, size);
+
+        return send_message(message);
+    }
+
+    // Waits for the next message from send_message() on the other side.
+    JResult receive_message(ConnectionMessage &message)
+    {
+        if (!_handle)
+        {
+            return ERR_STREAM_CLOSED;
+        }
+
+        while (true)
+        {
+            ConnectionFrame frame;
+            TRY(read_exactly(&frame, sizeof(frame)));
+
+            if (frame.kind == ConnectionFrame::RELEASE)
+            {
+                if (_pending_shared)
+                {
+                    _pending_shared->release(frame.handle);
+                }
+
+                continue;
+            }
+
+            if (frame.kind == ConnectionFrame::INLINE)
+            {
+                if (frame.size > (1u << 30))
+                {
+                    return ERR_INVALID_DATA;
+                }
+
+                message = ConnectionMessage{(size_t)frame.size};
+                return read_exactly(message.data(), message.size());
+            }
+
+            if (frame.kind != ConnectionFrame::SHARED)
+            {
+                return ERR_INVALID_DATA;
+            }
+
+            uintptr_t address = 0;
+            size_t mapped_size = 0;
+            TRY(memory_include(frame.handle, &address, &mapped_size));
+
+            // The size comes from the other process, the mapping is what
+            // can be read.
+            if (frame.size > mapped_size)
+            {
+                memory_free(address);
+                return ERR_INVALID_DATA;
+            }
+
+            message = ConnectionMessage{address, (size_t)frame.size};
+
+            return write_frame({ConnectionFrame::RELEASE, frame.handle, 0});
+        }
     }
 };
 
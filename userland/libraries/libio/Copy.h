@@ -10,64 +10,121 @@
 #include <libutils/Array.h>
 #include <libutils/Slice.h>
 #include <libutils/Vector.h>
+#include <libio/BufReader.h>
+#include <libio/BufferPool.h>
+#include <libio/File.h>
 #include <libio/MemoryReader.h>
 #include <libio/MemoryWriter.h>
 
 namespace IO
 {
 
-constexpr int COPY_CHUNK_SIZE = 4096;
+constexpr size_t COPY_CHUNK_SIZE = 4096;
 
-static inline JResult copy(Reader &from, Writer &to, size_t n)
+// Readers that don't know how much is left are mostly pipes and sockets.
+constexpr size_t COPY_UNKNOWN_CHUNK_SIZE = 64 * 1024;
+
+constexpr size_t COPY_MAX_CHUNK_SIZE = 1024 * 1024;
+
+// Big enough for what is left to read, or for n if that is less, in a
+// power of two between COPY_CHUNK_SIZE and COPY_MAX_CHUNK_SIZE.
+static inline size_t copy_chunk_size(Reader &from, size_t n)
 {
-    size_t remaining = n;
+    size_t wanted = MIN(from.remaining().unwrap_or(COPY_UNKNOWN_CHUNK_SIZE), n);
+
+    size_t chunk_size = COPY_CHUNK_SIZE;
 
-    do
+    while (chunk_size < wanted && chunk_size < COPY_MAX_CHUNK_SIZE)
     {
-        Array<uint8_t, COPY_CHUNK_SIZE> copy_chunk;
+        chunk_size *= 2;
+    }
+
+    return chunk_size;
+}
+
+static inline JResult copy_through(Reader &from, Writer &to, size_t n, uint8_t *chunk, size_t chunk_size)
+{
+    size_t remaining = n;
 
-        size_t read = TRY(from.read(copy_chunk.raw_storage(), MIN(COPY_CHUNK_SIZE, remaining)));
+    while (remaining > 0)
+    {
+        size_t read = TRY(from.read(chunk, MIN(chunk_size, remaining)));
 
         if (read == 0)
         {
-            to.flush();
-            return SUCCESS;
+            break;
         }
 
-        size_t written = TRY(to.write(copy_chunk.raw_storage(), read));
-
-        remaining -= read;
+        // Writers may take less than they are given.
+        size_t written = 0;
 
-        if (written == 0 || remaining == 0)
+        while (written < read)
         {
-            to.flush();
-            return SUCCESS;
+            size_t result = TRY(to.write(chunk + written, read - written));
+
+            if (result == 0)
+            {
+                to.flush();
+                return SUCCESS;
+            }
+
+            written += result;
         }
-    } while (1);
+
+        remaining -= read;
+    }
+
+    to.flush();
+    return SUCCESS;
 }
 
-static inline JResult copy(Reader &from, Writer &to)
+static inline JResult copy(Reader &from, Writer &to, size_t n)
 {
-    do
+    size_t chunk_size = copy_chunk_size(from, n);
+
+    if (chunk_size == COPY_CHUNK_SIZE)
     {
-        Array<uint8_t, COPY_CHUNK_SIZE> copy_chunk;
+        Array<uint8_t, COPY_CHUNK_SIZE> chunk;
+        return copy_through(from, to, n, chunk.raw_storage(), chunk.count());
+    }
 
-        auto read = TRY(from.read(copy_chunk.raw_storage(), copy_chunk.count()));
+    auto chunk = Buffer::borrow(chunk_size);
+    return copy_through(from, to, n, chunk.data(), chunk.size());
+}
 
-        if (read == 0)
-        {
-            to.flush();
-            return SUCCESS;
-        }
+static inline JResult copy(Reader &from, Writer &to)
+{
+    return copy(from, to, SIZE_MAX);
+}
 
-        auto written = TRY(to.write(copy_chunk.raw_storage(), read));
+// Memory needs no chunks, all of it is handed to the writer as it is.
+static inline JResult copy(MemoryReader &from, Writer &to, size_t n)
+{
+    auto memory = from.memory();
+    size_t position = TRY(from.tell());
+    size_t remaining = (position < memory.size()) ? MIN(memory.size() - position, n) : 0;
+
+    while (remaining > 0)
+    {
+        size_t written = TRY(to.write((const uint8_t *)memory.start() + position, remaining));
 
         if (written == 0)
         {
-            to.flush();
-            return SUCCESS;
+            break;
         }
-    } while (1);
+
+        TRY(from.seek(SeekFrom::current(written)));
+        position += written;
+        remaining -= written;
+    }
+
+    to.flush();
+    return SUCCESS;
+}
+
+static inline JResult copy(MemoryReader &from, Writer &to)
+{
+    return copy(from, to, SIZE_MAX);
 }
 
 static inline ResultOr<Slice> read_all(Reader &reader)
@@ -97,6 +154,75 @@ static inline JResult write_all(Writer &writer, Slice data)
     return copy(memory, writer);
 }
 
+static constexpr uint64_t DELIMITER_LOW_BITS = 0x0101010101010101ull;
+static constexpr uint64_t DELIMITER_HIGH_BITS = 0x8080808080808080ull;
+
+// Flags every byte of the word that equals the delimiter, with no false
+// positives before the first one.
+static inline bool has_delimiter(uint64_t word, char delimiter)
+{
+    word ^= DELIMITER_LOW_BITS * (uint8_t)delimiter;
+    return (word - DELIMITER_LOW_BITS) & ~word & DELIMITER_HIGH_BITS;
+}
+
+// Like memchr, eight bytes at a time.
+static inline Optional<size_t> find_delimiter(const void *data, size_t size, char delimiter)
+{
+    auto bytes = (const uint8_t *)data;
+    size_t offset = 0;
+
+    for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, bytes + offset, sizeof(word));
+
+        if (has_delimiter(word, delimiter))
+        {
+            break;
+        }
+    }
+
+    for (; offset < size; offset++)
+    {
+        if (bytes[offset] == (uint8_t)delimiter)
+        {
+            return offset;
+        }
+    }
+
+    return NONE;
+}
+
+// Like memrchr, eight bytes at a time.
+static inline Optional<size_t> find_last_delimiter(const void *data, size_t size, char delimiter)
+{
+    auto bytes = (const uint8_t *)data;
+    size_t end = size;
+
+    for (; end >= sizeof(uint64_t); end -= sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, bytes + end - sizeof(uint64_t), sizeof(word));
+
+        if (has_delimiter(word, delimiter))
+        {
+            break;
+        }
+    }
+
+    for (; end > 0; end--)
+    {
+        if (bytes[end - 1] == (uint8_t)delimiter)
+        {
+            return end - 1;
+        }
+    }
+
+    return NONE;
+}
+
+// Plain readers can't be read past the delimiter, so this goes one byte at
+// a time. Reading through a BufReader can scan whole blocks.
 static inline ResultOr<size_t> copy_line(Reader &from, Writer &to, char delimiter = '\n')
 {
     size_t written = 0;
@@ -107,10 +233,10 @@ static inline ResultOr<size_t> copy_line(Reader &from, Writer &to, char delimite
     while (read > 0 && c != delimiter)
     {
         written += TRY(to.write(&c, sizeof(c)));
-        TRY(from.read(&c, sizeof(c)));
+        read = TRY(from.read(&c, sizeof(c)));
     }
 
-    if (c == delimiter)
+    if (read > 0)
     {
         written += TRY(to.write(&c, sizeof(c)));
     }
@@ -118,6 +244,32 @@ static inline ResultOr<size_t> copy_line(Reader &from, Writer &to, char delimite
     return written;
 }
 
+static inline ResultOr<size_t> copy_line(BufReader &from, Writer &to, char delimiter = '\n')
+{
+    size_t written = 0;
+
+    while (true)
+    {
+        auto window = TRY(from.window());
+
+        if (!window.any())
+        {
+            return written;
+        }
+
+        auto found = find_delimiter(window.start(), window.size(), delimiter);
+        size_t line_size = found.present() ? found.unwrap() + 1 : window.size();
+
+        written += TRY(to.write(window.start(), line_size));
+        from.consume(line_size);
+
+        if (found.present())
+        {
+            return written;
+        }
+    }
+}
+
 static inline ResultOr<size_t> copy_line(Scanner &scan, Writer &to, String delimiter = "\n", bool write_delim = true)
 {
     size_t written = 0;
@@ -146,26 +298,39 @@ static inline JResult head(Reader &from, Writer &to, char delimiter = '\n', size
     return SUCCESS;
 }
 
+static inline JResult head(BufReader &from, Writer &to, char delimiter = '\n', size_t n = 10)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        TRY(copy_line(from, to, delimiter));
+    }
+
+    return SUCCESS;
+}
+
+// Everything has to be read to find the end, so it is read through a
+// buffer, whatever is read past the last line isn't there anyway.
 static inline JResult tail(Reader &from, Writer &to, char delimiter = '\n', size_t n = 10)
 {
+    BufReader buffered{from, COPY_UNKNOWN_CHUNK_SIZE};
     Vector<Slice> tail;
 
-    auto append_line = [&](Slice line) {
-        tail.push_back(line);
-        if (tail.count() > n)
+    while (true)
+    {
+        MemoryWriter line;
+
+        if (TRY(copy_line(buffered, line, delimiter)) == 0)
         {
-            tail.pop();
+            break;
         }
-    };
 
-    size_t copied = 0;
-    MemoryWriter memory;
+        tail.push_back(Slice{line.slice()});
 
-    do
-    {
-        copied = TRY(copy_line(from, memory, delimiter));
-        append_line(Slice{memory.slice()});
-    } while (copied > 0);
+        if (tail.count() > n)
+        {
+            tail.pop();
+        }
+    }
 
     for (auto line : tail)
     {
@@ -175,4 +340,77 @@ static inline JResult tail(Reader &from, Writer &to, char delimiter = '\n', size
     return SUCCESS;
 }
 
+// Regular files are scanned backward from their end for the delimiter in
+// front of the n-th last line, and only the lines after it are read.
+static inline JResult tail(File &from, Writer &to, char delimiter = '\n', size_t n = 10)
+{
+    auto remaining = from.remaining();
+
+    if (!remaining.present())
+    {
+        return tail((Reader &)from, to, delimiter, n);
+    }
+
+    if (n == 0)
+    {
+        return SUCCESS;
+    }
+
+    size_t start = TRY(from.tell());
+    size_t end = start + remaining.unwrap();
+    size_t tail_start = start;
+    bool found_tail_start = false;
+
+    Array<uint8_t, COPY_CHUNK_SIZE> block;
+    size_t position = end;
+    size_t lines = 0;
+
+    while (position > start && !found_tail_start)
+    {
+        size_t block_size = MIN(block.count(), position - start);
+        position -= block_size;
+
+        TRY(from.seek(SeekFrom::start(position)));
+
+        size_t read = 0;
+
+        while (read < block_size)
+        {
+            size_t result = TRY(from.read(block.raw_storage() + read, block_size - read));
+
+            if (result == 0)
+            {
+                return ERR_STREAM_CLOSED;
+            }
+
+            read += result;
+        }
+
+        size_t block_end = block_size;
+
+        while (!found_tail_start)
+        {
+            auto found = find_last_delimiter(block.raw_storage(), block_end, delimiter);
+
+            if (!found.present())
+            {
+                break;
+            }
+
+            block_end = found.unwrap();
+
+            // The delimiter ending the last line doesn't start another one.
+            if (position + block_end != end - 1 && ++lines == n)
+            {
+                tail_start = position + block_end + 1;
+                found_tail_start = true;
+            }
+        }
+    }
+
+    TRY(from.seek(SeekFrom::start(tail_start)));
+
+    return copy(from, to, end - tail_start);
+}
+
 }
\ No newline at end of file
@@ -10,18 +10,29 @@
 namespace IO
 {
 
-JResult Directory::read_entries()
+// Directory handles give out one entry per read.
+template <typename Callback>
+static JResult for_each_entry(Handle &handle, Callback callback)
 {
     JDirEntry entry;
 
-    auto read = TRY(_handle->read(&entry, sizeof(entry)));
+    auto read = TRY(handle.read(&entry, sizeof(entry)));
 
     while (read > 0)
     {
-        _entries.push_back({entry.name, entry.stat});
-        read = TRY(_handle->read(&entry, sizeof(entry)));
+        callback(entry);
+        read = TRY(handle.read(&entry, sizeof(entry)));
     }
 
+    return SUCCESS;
+}
+
+JResult Directory::read_entries()
+{
+    TRY(for_each_entry(*_handle, [&](JDirEntry &entry) {
+        _entries.push_back({entry.name, entry.stat});
+    }));
+
     _entries.sort([](auto &left, auto &right) {
         return strcmp(left.name.cstring(), right.name.cstring());
     });
@@ -56,6 +67,21 @@ Directory::Directory(RefPtr<Handle> handle)
     read_entries();
 }
 
+ResultOr<size_t> Directory::count(const IO::Path &path)
+{
+    Handle handle{path.string(), J_OPEN_READ | J_OPEN_DIRECTORY};
+
+    if (!handle.valid())
+    {
+        return handle.result();
+    }
+
+    size_t count = 0;
+    TRY(for_each_entry(handle, [&](JDirEntry &) { count++; }));
+
+    return count;
+}
+
 bool Directory::exist()
 {
     return _handle->valid();
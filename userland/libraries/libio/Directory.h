@@ -42,6 +42,9 @@ public:
 
     RefPtr<Handle> handle() override { return _handle; }
 
+    // How many entries there are, without keeping or sorting them.
+    static ResultOr<size_t> count(const IO::Path &path);
+
     bool exist();
 };
 
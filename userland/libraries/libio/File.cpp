@@ -38,23 +38,33 @@ ResultOr<size_t> File::read(void *buffer, size_t size)
     return _handle->read(buffer, size);
 }
 
+ResultOr<size_t> File::read_at(size64_t offset, void *buffer, size_t size)
+{
+    return _handle->read_at(offset, buffer, size);
+}
+
 ResultOr<size_t> File::write(const void *buffer, size_t size)
 {
     return _handle->write(buffer, size);
 }
 
+ResultOr<size_t> File::writev(const IOVec *vecs, size_t count)
+{
+    return _handle->writev(vecs, count);
+}
+
 ResultOr<size_t> File::call(IOCall call, void *args)
 {
     return _handle->call(call, args);
 }
 
-ResultOr<size_t> File::seek(SeekFrom from)
+ResultOr<size64_t> File::seek(SeekFrom from)
 {
     auto seek_result = _handle->seek(from);
 
     if (seek_result.success())
     {
-        return (size_t)seek_result.unwrap();
+        return (size64_t)seek_result.unwrap();
     }
     else
     {
@@ -62,17 +72,33 @@ ResultOr<size_t> File::seek(SeekFrom from)
     }
 }
 
-ResultOr<size_t> File::tell()
+ResultOr<size64_t> File::tell()
 {
-    return (size_t)_handle->tell().unwrap();
+    return (size64_t)_handle->tell().unwrap();
 }
 
-ResultOr<size_t> File::length()
+ResultOr<size64_t> File::length()
 {
     auto stat = TRY(_handle->stat());
     return stat.size;
 }
 
+Optional<size_t> File::remaining()
+{
+    // Pipes, sockets and devices have no length to go by.
+    auto stat = _handle->stat();
+    auto position = _handle->tell();
+
+    if (!stat.success() || !position.success() || stat.unwrap().type != J_FILE_TYPE_REGULAR)
+    {
+        return NONE;
+    }
+
+    size_t size = stat.unwrap().size;
+    size_t offset = position.unwrap();
+    return size > offset ? size - offset : 0;
+}
+
 ResultOr<JFileType> File::type()
 {
     auto stat = TRY(_handle->stat());
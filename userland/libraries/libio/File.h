@@ -40,15 +40,23 @@ public:
 
     ResultOr<size_t> read(void *buffer, size_t size) override;
 
+    // Reads at offset without a seek of its own, for readers sharing the
+    // file from several threads.
+    ResultOr<size_t> read_at(size64_t offset, void *buffer, size_t size);
+
     ResultOr<size_t> write(const void *buffer, size_t size) override;
 
+    ResultOr<size_t> writev(const IOVec *vecs, size_t count) override;
+
     ResultOr<size_t> call(IOCall call, void *args);
 
-    ResultOr<size_t> seek(SeekFrom from) override;
+    ResultOr<size64_t> seek(SeekFrom from) override;
+
+    ResultOr<size64_t> tell() override;
 
-    ResultOr<size_t> tell() override;
+    ResultOr<size64_t> length() override;
 
-    ResultOr<size_t> length() override;
+    Optional<size_t> remaining() override;
 
     ResultOr<JFileType> type();
 
@@ -7,6 +7,7 @@
 #pragma once
 
 // includes
+#include <libio/BufWriter.h>
 #include <libio/Formatter.h>
 #include <libio/MemoryReader.h>
 #include <libio/MemoryWriter.h>
@@ -54,12 +55,17 @@ static inline ResultOr<size_t> format(Writer &writer, Scanner &scan, First first
     return written;
 }
 
+// Formatters write a character or a number at a time, so they write into
+// a BufWriter instead of going to the writer for every one of them.
 template <typename... Args>
 static inline ResultOr<size_t> format(Writer &writer, const char *fmt, Args... args)
 {
     MemoryReader memory{fmt};
     Scanner scan{memory};
-    return format(writer, scan, std::forward<Args>(args)...);
+    BufWriter buffered{writer};
+    auto written = TRY(format(buffered, scan, std::forward<Args>(args)...));
+    TRY(buffered.flush());
+    return written;
 }
 
 static inline ResultOr<size_t> format(Writer &writer, const char *fmt)
@@ -70,8 +76,11 @@ static inline ResultOr<size_t> format(Writer &writer, const char *fmt)
 template <typename... Args>
 static inline String format(const char *fmt, Args... args)
 {
+    // Memory takes small writes just fine, no need to buffer them.
     MemoryWriter memory{};
-    format(memory, fmt, std::forward<Args>(args)...);
+    MemoryReader reader{fmt};
+    Scanner scan{reader};
+    format(memory, scan, std::forward<Args>(args)...);
     return memory.string();
 }
 
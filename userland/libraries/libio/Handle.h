@@ -7,23 +7,39 @@
 #pragma once
 
 // includes
+#include <string.h>
 #include <libabi/Syscalls.h>
+#include <libio/IOVec.h>
 #include <libio/Seek.h>
 #include <libsystem/process/Process.h>
+#include <libutils/Lock.h>
 #include <libutils/String.h>
 
 namespace IO
 {
 
+// Pieces of a gathered write smaller than this are copied together and
+// written with one call.
+constexpr size_t HANDLE_GATHER_SIZE = 4096;
+
 struct Handle :
     public RefCounted<Handle>
 {
 private:
     int _handle = HANDLE_INVALID_ID;
     JResult _result = ERR_BAD_HANDLE;
+    Lock _position_lock{"IO::Handle"};
 
     NONCOPYABLE(Handle);
 
+    // Adds what was written to total, and tells if it was all of it.
+    ResultOr<bool> write_whole(const void *buffer, size_t size, size_t &total)
+    {
+        size_t written = TRY(write(buffer, size));
+        total += written;
+        return written == size;
+    }
+
 public:
     int id() const { return _handle; }
 
@@ -67,6 +83,17 @@ public:
         return data_read;
     }
 
+    // There is no positional read among the handle calls, so this seeks
+    // and reads under a lock: readers sharing the handle through read_at()
+    // don't move the offset under each other. Plain reads and seeks still
+    // can.
+    ResultOr<size_t> read_at(size64_t offset, void *buffer, size_t size)
+    {
+        LockHolder holder(_position_lock);
+        TRY(seek(IO::SeekFrom::start(offset)));
+        return read(buffer, size);
+    }
+
     ResultOr<size_t> write(const void *buffer, size_t size)
     {
         size_t data_written = 0;
@@ -74,6 +101,51 @@ public:
         return data_written;
     }
 
+    // The kernel has no gathering write, so this saves the calls rather
+    // than the copies: small pieces go out together, big ones on their own.
+    ResultOr<size_t> writev(const IOVec *vecs, size_t count)
+    {
+        uint8_t gathered[HANDLE_GATHER_SIZE];
+        size_t gathered_size = 0;
+        size_t total = 0;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const IOVec &vec = vecs[i];
+
+            if (gathered_size + vec.size <= HANDLE_GATHER_SIZE)
+            {
+                memcpy(gathered + gathered_size, vec.data, vec.size);
+                gathered_size += vec.size;
+                continue;
+            }
+
+            if (gathered_size > 0 && !TRY(write_whole(gathered, gathered_size, total)))
+            {
+                return total;
+            }
+
+            gathered_size = 0;
+
+            if (vec.size < HANDLE_GATHER_SIZE)
+            {
+                memcpy(gathered, vec.data, vec.size);
+                gathered_size = vec.size;
+            }
+            else if (!TRY(write_whole(vec.data, vec.size, total)))
+            {
+                return total;
+            }
+        }
+
+        if (gathered_size > 0)
+        {
+            TRY(write_whole(gathered, gathered_size, total));
+        }
+
+        return total;
+    }
+
     JResult call(IOCall request, void *args)
     {
         _result = J_handle_call(_handle, request, args);
@@ -14,8 +14,10 @@
 namespace IO
 {
 
-static inline ResultOr<size_t> hexdump(Reader &in, Writer &out)
+static inline ResultOr<size_t> hexdump(Reader &in, Writer &writer)
 {
+    // A line of output is a few dozen writes, the writer gets them whole.
+    BufWriter out{writer};
     uint8_t buf[16];
     size_t buflen = 0;
     size_t offset = 0;
@@ -52,6 +54,7 @@ static inline ResultOr<size_t> hexdump(Reader &in, Writer &out)
         written += TRY(IO::write(out, '\n'));
     }
 
+    TRY(out.flush());
     return written;
 }
 
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <libutils/Prelude.h>
+
+namespace IO
+{
+
+// One piece of a scattered read or a gathered write.
+struct IOVec
+{
+    void *data;
+    size_t size;
+};
+
+static inline size_t iovec_total_size(const IOVec *vecs, size_t count)
+{
+    size_t total = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        total += vecs[i].size;
+    }
+
+    return total;
+}
+
+}
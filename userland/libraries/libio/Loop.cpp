@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <libio/Loop.h>
+#include <libmath/MinMax.h>
+#include <libsystem/process/Process.h>
+#include <libsystem/system/System.h>
+
+namespace IO
+{
+
+Loop &Loop::the()
+{
+    thread_local Loop loop{};
+    return loop;
+}
+
+Loop::Watch *Loop::add_watch(RefPtr<Handle> handle, PollEvent events, Func<void()> callback, bool once)
+{
+    auto watch = new Watch{handle, events, std::move(callback), once, false};
+    _watches.push_back(OwnPtr<Watch>{watch});
+    return watch;
+}
+
+Loop::Alarm *Loop::add_alarm(Tick interval, Func<void()> callback)
+{
+    auto alarm = new Alarm{interval, 0, true, false, std::move(callback), false};
+    _alarms.push_back(OwnPtr<Alarm>{alarm});
+    return alarm;
+}
+
+void Timer::start()
+{
+    _alarm->due = system_get_ticks() + _alarm->interval;
+    _alarm->running = true;
+}
+
+void Loop::wait(RefPtr<Handle> handle, PollEvent events, Func<void()> callback)
+{
+    add_watch(handle, events, std::move(callback), true);
+}
+
+void Loop::defer(Func<void()> callback)
+{
+    _deferred.push_back(std::move(callback));
+}
+
+void Loop::collect()
+{
+    _watches.remove_all_match([](auto &watch) { return watch->removed; });
+    _alarms.remove_all_match([](auto &alarm) { return alarm->removed; });
+}
+
+bool Loop::idle()
+{
+    if (_watches.any() || _deferred.any())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < _alarms.count(); i++)
+    {
+        if (_alarms[i]->running)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+Timeout Loop::timeout()
+{
+    if (_deferred.any())
+    {
+        return 0;
+    }
+
+    Tick now = system_get_ticks();
+    Timeout timeout = TIMEOUT_INFINITY;
+
+    for (size_t i = 0; i < _alarms.count(); i++)
+    {
+        auto &alarm = *_alarms[i];
+
+        if (!alarm.running)
+        {
+            continue;
+        }
+
+        if (alarm.due <= now)
+        {
+            return 0;
+        }
+
+        timeout = MIN(timeout, (Timeout)(alarm.due - now));
+    }
+
+    return timeout;
+}
+
+void Loop::poll(Timeout timeout)
+{
+    // Callbacks may add watches, those are polled from the next turn on.
+    size_t count = _watches.count();
+
+    if (count == 0)
+    {
+        if (timeout > 0 && timeout != TIMEOUT_INFINITY)
+        {
+            process_sleep(timeout);
+        }
+
+        return;
+    }
+
+    _polls.clear();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        HandlePoll poll{};
+        poll.handle = _watches[i]->handle->id();
+        poll.events = _watches[i]->events;
+        _polls.push_back(poll);
+    }
+
+    if (J_handle_poll(_polls.raw_storage(), count, timeout) != SUCCESS)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        auto &watch = *_watches[i];
+
+        if (!_polls[i].result || watch.removed)
+        {
+            continue;
+        }
+
+        if (watch.once)
+        {
+            watch.removed = true;
+        }
+
+        watch.callback();
+    }
+}
+
+void Loop::run_alarms()
+{
+    Tick now = system_get_ticks();
+    size_t count = _alarms.count();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        auto &alarm = *_alarms[i];
+
+        if (!alarm.running || alarm.removed || alarm.due > now)
+        {
+            continue;
+        }
+
+        if (alarm.repeat)
+        {
+            alarm.due = now + alarm.interval;
+        }
+        else
+        {
+            alarm.running = false;
+        }
+
+        alarm.callback();
+    }
+}
+
+void Loop::run_deferred()
+{
+    // What these defer again waits for the next turn.
+    Vector<Func<void()>> deferred{};
+    deferred = std::move(_deferred);
+
+    for (size_t i = 0; i < deferred.count(); i++)
+    {
+        deferred[i]();
+    }
+}
+
+void Loop::pump(bool blocking)
+{
+    collect();
+    poll(blocking ? timeout() : 0);
+    run_alarms();
+    run_deferred();
+}
+
+int Loop::run()
+{
+    _running = true;
+
+    while (_running && !idle())
+    {
+        pump(true);
+    }
+
+    _running = false;
+
+    return _exit_value;
+}
+
+void Loop::exit(int exit_value)
+{
+    _exit_value = exit_value;
+    _running = false;
+}
+
+}
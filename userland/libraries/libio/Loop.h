@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <libabi/Syscalls.h>
+#include <libio/Handle.h>
+#include <libutils/Func.h>
+#include <libutils/OwnPtr.h>
+#include <libutils/Vector.h>
+
+namespace IO
+{
+
+// Runs everything a thread waits on: handles becoming ready, timers, and
+// calls deferred until the current callback is done. Each turn waits on
+// every handle at once, with a single poll.
+struct Loop
+{
+private:
+    struct Watch
+    {
+        RefPtr<Handle> handle;
+        PollEvent events;
+        Func<void()> callback;
+        bool once;
+        bool removed;
+    };
+
+    struct Alarm
+    {
+        Tick interval;
+        Tick due;
+        bool repeat;
+        bool running;
+        Func<void()> callback;
+        bool removed;
+    };
+
+    // Removed entries are only freed at the start of the next turn, so a
+    // callback can remove the one it was called for.
+    Vector<OwnPtr<Watch>> _watches{};
+    Vector<OwnPtr<Alarm>> _alarms{};
+    Vector<Func<void()>> _deferred{};
+    Vector<HandlePoll> _polls{};
+
+    bool _running = false;
+    int _exit_value = 0;
+
+    Watch *add_watch(RefPtr<Handle> handle, PollEvent events, Func<void()> callback, bool once);
+
+    Alarm *add_alarm(Tick interval, Func<void()> callback);
+
+    void collect();
+
+    bool idle();
+
+    Timeout timeout();
+
+    void poll(Timeout timeout);
+
+    void run_alarms();
+
+    void run_deferred();
+
+    friend struct Notifier;
+    friend struct Timer;
+
+    NONCOPYABLE(Loop);
+    NONMOVABLE(Loop);
+
+public:
+    // The calling thread's own loop. Notifiers and timers belong to the
+    // loop of the thread that created them and only run when it runs.
+    static Loop &the();
+
+    Loop() {}
+
+    // Calls callback once, the first time handle is ready for events.
+    void wait(RefPtr<Handle> handle, PollEvent events, Func<void()> callback);
+
+    // Calls callback once the current turn is done.
+    void defer(Func<void()> callback);
+
+    // Runs one turn, and only waits for something to happen if blocking.
+    void pump(bool blocking);
+
+    // Runs turns until exit() is called or there is nothing left to wait on.
+    int run();
+
+    void exit(int exit_value);
+};
+
+// Calls callback every time handle is ready for events, for as long as it
+// lives.
+struct Notifier
+{
+private:
+    Loop::Watch *_watch;
+
+    NONCOPYABLE(Notifier);
+    NONMOVABLE(Notifier);
+
+public:
+    Notifier(RefPtr<Handle> handle, PollEvent events, Func<void()> callback)
+        : _watch{Loop::the().add_watch(handle, events, std::move(callback), false)}
+    {
+    }
+
+    ~Notifier()
+    {
+        _watch->removed = true;
+    }
+};
+
+// Calls callback every interval ticks once started, or only once if single
+// shot, for as long as it lives.
+struct Timer
+{
+private:
+    Loop::Alarm *_alarm;
+
+    NONCOPYABLE(Timer);
+    NONMOVABLE(Timer);
+
+public:
+    bool running() const { return _alarm->running; }
+
+    Tick interval() const { return _alarm->interval; }
+
+    void interval(Tick interval) { _alarm->interval = interval; }
+
+    void single_shot(bool single_shot) { _alarm->repeat = !single_shot; }
+
+    Timer(Tick interval, Func<void()> callback)
+        : _alarm{Loop::the().add_alarm(interval, std::move(callback))}
+    {
+    }
+
+    ~Timer()
+    {
+        _alarm->removed = true;
+    }
+
+    void start();
+
+    void stop() { _alarm->running = false; }
+};
+
+}
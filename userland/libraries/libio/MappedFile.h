@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <sys/mman.h>
+#include <libio/File.h>
+#include <libutils/Storage.h>
+
+namespace IO
+{
+
+// A read-only private mapping of a whole file. Wrap it in a Slice to hand
+// out views that keep the mapping alive.
+struct MappedFile final :
+    public Storage
+{
+private:
+    void *_data = nullptr;
+    size_t _size = 0;
+
+    NONCOPYABLE(MappedFile);
+    NONMOVABLE(MappedFile);
+
+public:
+    using Storage::end;
+    using Storage::start;
+
+    void *start() override { return _data; }
+
+    void *end() override { return reinterpret_cast<char *>(_data) + _size; }
+
+    MappedFile(void *data, size_t size) : _data(data), _size(size)
+    {
+    }
+
+    ~MappedFile() override
+    {
+        if (_data)
+        {
+            munmap(_data, _size);
+            _data = nullptr;
+        }
+    }
+
+    static ResultOr<RefPtr<MappedFile>> map(IO::File &file)
+    {
+        if (!file.handle())
+        {
+            return ERR_BAD_HANDLE;
+        }
+
+        size64_t length = TRY(file.length());
+
+        // Doesn't fit in the address space, callers read it instead.
+        if (length > SIZE_MAX)
+        {
+            return ERR_NOT_IMPLEMENTED;
+        }
+
+        size_t size = length;
+
+        if (size == 0)
+        {
+            return make<MappedFile>(nullptr, 0);
+        }
+
+        void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file.handle()->id(), 0);
+
+        // Not every handle can be mapped, let callers fall back to reading.
+        if (data == MAP_FAILED)
+        {
+            return ERR_NOT_IMPLEMENTED;
+        }
+
+        return make<MappedFile>(data, size);
+    }
+};
+
+}
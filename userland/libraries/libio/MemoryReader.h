@@ -60,7 +60,7 @@ public:
         return remaining;
     }
 
-    ResultOr<size_t> seek(SeekFrom from) override
+    ResultOr<size64_t> seek(SeekFrom from) override
     {
         switch (from.whence)
         {
@@ -78,12 +78,17 @@ public:
         }
     }
 
-    ResultOr<size_t> length() override
+    ResultOr<size64_t> length() override
     {
         return _memory.size();
     }
 
-    ResultOr<size_t> tell() override
+    Optional<size_t> remaining() override
+    {
+        return _position < _memory.size() ? _memory.size() - _position : 0;
+    }
+
+    ResultOr<size64_t> tell() override
     {
         return _position;
     }
@@ -8,6 +8,7 @@
 #pragma once
 
 // includes
+#include <libio/Chain.h>
 #include <libio/Writer.h>
 #include <libmath/MinMax.h>
 #include <libutils/SliceStorage.h>
@@ -26,6 +27,26 @@ private:
     size_t _position = 0;
     uint8_t *_buffer = nullptr;
 
+    void reserve(size_t size)
+    {
+        if (size <= _size)
+        {
+            return;
+        }
+
+        auto new_size = MAX(MAX(size, _size + _size / 4), 16);
+        auto new_buffer = new uint8_t[new_size];
+
+        if (_buffer)
+        {
+            memcpy(new_buffer, _buffer, _used);
+            delete[] _buffer;
+        }
+
+        _size = new_size;
+        _buffer = new_buffer;
+    }
+
 public:
     using Writer::flush;
 
@@ -52,17 +73,17 @@ public:
         }
     }
 
-    ResultOr<size_t> length()
+    ResultOr<size64_t> length() override
     {
         return _used;
     }
 
-    ResultOr<size_t> tell()
+    ResultOr<size64_t> tell() override
     {
         return _position;
     }
 
-    ResultOr<size_t> seek(SeekFrom from) override
+    ResultOr<size64_t> seek(SeekFrom from) override
     {
         switch (from.whence)
         {
@@ -117,6 +138,12 @@ public:
         return make<SliceStorage>(ADOPT, (void *)result, size);
     }
 
+    // Hands the buffer over as the only piece of a chain, without copying it.
+    Chain chain()
+    {
+        return Chain{Slice{slice()}};
+    }
+
     ResultOr<size_t> write(uint8_t v)
     {
         if (_size == 0)
@@ -152,13 +179,26 @@ public:
 
     ResultOr<size_t> write(const void *buffer, size_t size) override
     {
-        for (size_t i = 0; i < size; i++)
+        reserve(_position + size);
+
+        memcpy(_buffer + _position, buffer, size);
+        _position += size;
+
+        if (_position > _used)
         {
-            write(((uint8_t *)buffer)[i]);
+            _used = _position;
         }
 
         return size;
     }
+
+    // Grows once for all the pieces rather than once per piece.
+    ResultOr<size_t> writev(const IOVec *vecs, size_t count) override
+    {
+        reserve(_position + iovec_total_size(vecs, count));
+
+        return Writer::writev(vecs, count);
+    }
 };
 
 }
\ No newline at end of file
@@ -9,7 +9,6 @@
 // includes
 #include <math.h>
 #include <libio/Scanner.h>
-#include <libutils/Strings.h>
 
 namespace IO
 {
@@ -27,52 +26,58 @@ public:
 
     static NumberScanner hexadecimal() { return {16}; }
 
-    bool is_digit(Scanner &scan)
+    // The value of c as a digit in any base up to 16, or more than that.
+    static int digit_value(char c)
     {
-        char c = scan.peek();
+        if (c >= '0' && c <= '9')
+        {
+            return c - '0';
+        }
 
-        for (int i = 0; i < _base; i++)
+        char lower = c | 0x20;
+
+        if (lower >= 'a' && lower <= 'f')
         {
-            if ((Strings::LOWERCASE_XDIGITS[i] == c) ||
-                (Strings::UPPERCASE_XDIGITS[i] == c))
-            {
-                return true;
-            }
+            return lower - 'a' + 10;
         }
 
-        return false;
+        return 16;
+    }
+
+    bool is_digit(Scanner &scan)
+    {
+        return digit_value(scan.peek()) < _base;
     }
 
     Optional<uint8_t> scan_digit(Scanner &scan)
     {
-        char c = scan.peek();
+        int digit = digit_value(scan.peek());
 
-        for (int i = 0; i < _base; i++)
+        if (digit >= _base)
         {
-            if ((Strings::LOWERCASE_XDIGITS[i] == c) ||
-                (Strings::UPPERCASE_XDIGITS[i] == c))
-            {
-                scan.next();
-                return i;
-            }
+            return NONE;
         }
 
-        return NONE;
+        scan.next();
+        return digit;
     }
 
     Optional<uint64_t> scan_uint(Scanner &scan)
     {
-        if (!is_digit(scan))
+        int digit = digit_value(scan.peek());
+
+        if (digit >= _base)
         {
             return NONE;
         }
 
         uint64_t value = 0;
 
-        while (!scan.ended() && is_digit(scan))
+        while (digit < _base && !scan.ended())
         {
-            value = value * _base;
-            value += scan_digit(scan).unwrap();
+            value = value * _base + digit;
+            scan.next();
+            digit = digit_value(scan.peek());
         }
 
         return value;
@@ -115,10 +120,11 @@ public:
         {
             double multiplier = (1.0 / _base);
 
-            while (is_digit(scan))
+            for (int digit = digit_value(scan.peek()); digit < _base && !scan.ended(); digit = digit_value(scan.peek()))
             {
-                fpart += multiplier * scan_digit(scan).unwrap();
+                fpart += multiplier * digit;
                 multiplier *= (1.0 / _base);
+                scan.next();
             }
         }
 
@@ -38,6 +38,11 @@ public:
         return parse(string.cstring(), string.length(), flags);
     }
 
+    static Path parse(StringView string, int flags = 0)
+    {
+        return parse(string.chars(), string.length(), flags);
+    }
+
     static Path parse(const char *path, int flags = 0)
     {
         return parse(path, strlen(path), flags);
@@ -105,27 +110,27 @@ public:
         return {absolute, std::move(elements)};
     }
 
-    static Path join(String left, String right)
+    static Path join(StringView left, StringView right)
     {
         return join(parse(left), parse(right));
     }
 
-    static Path join(Path &&left, String right)
+    static Path join(Path &&left, StringView right)
     {
         return join(left, parse(right));
     }
 
-    static Path join(String left, Path &&right)
+    static Path join(StringView left, Path &&right)
     {
         return join(parse(left), right);
     }
 
-    static Path join(const Path &left, String right)
+    static Path join(const Path &left, StringView right)
     {
         return join(left, parse(right));
     }
 
-    static Path join(String left, Path &right)
+    static Path join(StringView left, Path &right)
     {
         return join(parse(left), right);
     }
@@ -163,7 +168,7 @@ public:
     {
     }
 
-    Path(bool absolute, Vector<String> &&elements) : _absolute(absolute), _elements(elements)
+    Path(bool absolute, Vector<String> &&elements) : _absolute(absolute), _elements(std::move(elements))
     {
     }
 
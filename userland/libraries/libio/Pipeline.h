@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <libcompression/CRC.h>
+#include <libio/Copy.h>
+#include <libio/Reader.h>
+#include <libio/Writer.h>
+#include <libutils/Traits.h>
+
+namespace IO
+{
+
+// A stage looks at every buffer going through a pipeline, it has a
+// process(const uint8_t *data, size_t size) and whatever getters it needs.
+
+struct CountStage
+{
+private:
+    size64_t _count = 0;
+
+public:
+    size64_t count() const { return _count; }
+
+    void reset() { _count = 0; }
+
+    void process(const uint8_t *, size_t size)
+    {
+        _count += size;
+    }
+};
+
+// CRC::add picks the pclmul kernel for buffers big enough to be worth it.
+struct CRCStage
+{
+private:
+    Compression::CRC _crc;
+
+public:
+    uint32_t checksum() const { return _crc.checksum(); }
+
+    CRCStage(uint32_t crc = 0) : _crc{crc}
+    {
+    }
+
+    void process(const uint8_t *data, size_t size)
+    {
+        _crc.add(data, size);
+    }
+};
+
+// The stages are composed at compile time, so a whole chain costs one
+// virtual call per read or write instead of one per layer.
+template <typename... Stages>
+struct Pipeline;
+
+template <>
+struct Pipeline<>
+{
+    void process(const uint8_t *, size_t) {}
+};
+
+template <typename Head, typename... Tail>
+struct Pipeline<Head, Tail...>
+{
+private:
+    Head _head;
+    Pipeline<Tail...> _tail;
+
+public:
+    template <typename Stage>
+    Stage &stage()
+    {
+        if constexpr (IsSame<Stage, Head>::value)
+        {
+            return _head;
+        }
+        else
+        {
+            return _tail.template stage<Stage>();
+        }
+    }
+
+    void process(const uint8_t *data, size_t size)
+    {
+        _head.process(data, size);
+        _tail.process(data, size);
+    }
+};
+
+// Runs what is read from the underlying reader through the stages.
+template <typename... Stages>
+struct PipelineReader :
+    public Reader,
+    public Pipeline<Stages...>
+{
+private:
+    Reader &_reader;
+
+public:
+    PipelineReader(Reader &reader) : _reader{reader}
+    {
+    }
+
+    ResultOr<size_t> read(void *buffer, size_t size) override
+    {
+        auto result = TRY(_reader.read(buffer, size));
+        this->process((const uint8_t *)buffer, result);
+        return result;
+    }
+
+    Optional<size_t> remaining() override
+    {
+        return _reader.remaining();
+    }
+};
+
+// Runs what is taken by the underlying writer through the stages, which
+// may be a compressor's input.
+template <typename... Stages>
+struct PipelineWriter :
+    public Writer,
+    public Pipeline<Stages...>
+{
+private:
+    Writer &_writer;
+
+public:
+    PipelineWriter(Writer &writer) : _writer{writer}
+    {
+    }
+
+    ResultOr<size_t> write(const void *buffer, size_t size) override
+    {
+        auto result = TRY(_writer.write(buffer, size));
+        this->process((const uint8_t *)buffer, result);
+        return result;
+    }
+
+    JResult flush() override
+    {
+        return _writer.flush();
+    }
+};
+
+// Like copy, with every chunk going through the stages between being read
+// and being handed to the writer, while it is still in the cache.
+template <typename... Stages>
+static inline JResult copy(Reader &from, Writer &to, Pipeline<Stages...> &pipeline, size_t n = SIZE_MAX)
+{
+    auto chunk = Buffer::borrow(copy_chunk_size(from, n));
+    size_t remaining = n;
+
+    while (remaining > 0)
+    {
+        size_t read = TRY(from.read(chunk.data(), MIN(chunk.size(), remaining)));
+
+        if (read == 0)
+        {
+            break;
+        }
+
+        pipeline.process(chunk.data(), read);
+
+        size_t written = 0;
+
+        while (written < read)
+        {
+            size_t result = TRY(to.write(chunk.data() + written, read - written));
+
+            if (result == 0)
+            {
+                // The stages saw bytes the writer didn't take.
+                to.flush();
+                return ERR_STREAM_CLOSED;
+            }
+
+            written += result;
+        }
+
+        remaining -= read;
+    }
+
+    to.flush();
+    return SUCCESS;
+}
+
+}
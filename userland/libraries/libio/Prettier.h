@@ -7,6 +7,7 @@
 #pragma once
 
 // includes
+#include <libio/TerminalWriter.h>
 #include <libio/Write.h>
 #include <libio/Writer.h>
 
@@ -17,7 +18,9 @@ struct Prettier :
     public IO::Writer
 {
 private:
-    IO::Writer &_writer;
+    // Pretty output is mostly tiny writes and colour changes, the writer
+    // beneath gets them in batches.
+    IO::TerminalWriter _writer;
     int _depth = 0;
     int _flags;
 
@@ -7,7 +7,9 @@
 #pragma once
 
 // includes
+#include <libio/IOVec.h>
 #include <libio/Seek.h>
+#include <libutils/Optional.h>
 
 namespace IO
 {
@@ -17,6 +19,29 @@ struct Reader
     virtual ~Reader() {}
 
     virtual ResultOr<size_t> read(void *buffer, size_t size) = 0;
+
+    // Fills each piece in turn, and stops at the first one that isn't filled.
+    virtual ResultOr<size_t> readv(const IOVec *vecs, size_t count)
+    {
+        size_t total = 0;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t read = TRY(this->read(vecs[i].data, vecs[i].size));
+            total += read;
+
+            if (read < vecs[i].size)
+            {
+                break;
+            }
+        }
+
+        return total;
+    }
+
+    // How many more bytes reads will return, for readers that know without
+    // reading them. Copies size their chunks from it.
+    virtual Optional<size_t> remaining() { return NONE; }
 };
 
 template <typename T>
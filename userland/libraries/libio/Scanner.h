@@ -8,14 +8,85 @@
 #pragma once
 
 // includes
+#include <libio/MemoryWriter.h>
 #include <libio/Reader.h>
+#include <libmath/MinMax.h>
 #include <libtext/Rune.h>
 #include <libutils/InlineRingBuffer.h>
+#include <libutils/String.h>
 #include <string.h>
 
 namespace IO
 {
 
+// A set of bytes, each tested with a single lookup.
+struct CharSet
+{
+private:
+    uint64_t _bits[4] = {};
+
+public:
+    constexpr CharSet() {}
+
+    constexpr CharSet(const char *chars) : CharSet(chars, strlen(chars)) {}
+
+    constexpr CharSet(const char *chars, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            add(chars[i]);
+        }
+    }
+
+    static constexpr CharSet range(char first, char last)
+    {
+        CharSet set{};
+
+        for (int c = (uint8_t)first; c <= (uint8_t)last; c++)
+        {
+            set.add(c);
+        }
+
+        return set;
+    }
+
+    constexpr void add(char c)
+    {
+        uint8_t byte = c;
+        _bits[byte >> 6] |= 1ull << (byte & 63);
+    }
+
+    constexpr bool contains(char c) const
+    {
+        uint8_t byte = c;
+        return (_bits[byte >> 6] >> (byte & 63)) & 1;
+    }
+
+    constexpr CharSet operator|(const CharSet &other) const
+    {
+        CharSet set{};
+
+        for (size_t i = 0; i < 4; i++)
+        {
+            set._bits[i] = _bits[i] | other._bits[i];
+        }
+
+        return set;
+    }
+
+    constexpr CharSet operator~() const
+    {
+        CharSet set{};
+
+        for (size_t i = 0; i < 4; i++)
+        {
+            set._bits[i] = ~_bits[i];
+        }
+
+        return set;
+    }
+};
+
 struct Scanner final
 {
 private:
@@ -32,16 +103,23 @@ private:
             return;
         }
 
-        char c = 0x69;
-        auto read_result = _reader.read(&c, 1);
+        assert(!_peek.full());
 
-        if (read_result.unwrap_or(0) == 0)
+        // Readers that know how much is left are read ahead. The others,
+        // like terminals, only give out one byte at a time, so nothing past
+        // what is scanned is taken from them.
+        size_t wanted = MIN(MAX_PEEK - _peek.used(), _reader.remaining().unwrap_or(1));
+        uint8_t chunk[MAX_PEEK];
+
+        auto read = _reader.read(chunk, MAX(wanted, 1)).unwrap_or(0);
+
+        if (read == 0)
         {
             _is_end_of_file = true;
         }
         else
         {
-            _peek.put(c);
+            _peek.write(chunk, read);
         }
     }
 
@@ -78,9 +156,9 @@ public:
 
     void next(size_t n)
     {
-        for (size_t i = 0; i < n; i++)
+        for (size_t i = 0; i < n && !ended(); i++)
         {
-            next();
+            _peek.get();
         }
     }
 
@@ -116,15 +194,13 @@ public:
 
     bool peek_is_any(size_t offset, const char *what, size_t size)
     {
-        for (size_t i = 0; i < size; i++)
-        {
-            if (peek(offset) == what[i])
-            {
-                return true;
-            }
-        }
+        return memchr(what, peek(offset), size) != nullptr;
+    }
 
-        return false;
+    bool peek_is_any(const CharSet &set, size_t offset = 0)
+    {
+        char c = peek(offset);
+        return !ended() && set.contains(c);
     }
 
     bool peek_is_word(const char *word)
@@ -216,10 +292,43 @@ public:
 
     void eat_any(const char *what, size_t size)
     {
-        while (peek_is_any(what, size) && !ended())
+        skip_while(CharSet{what, size});
+    }
+
+    // Skips everything in set, and tells how much that was.
+    size_t skip_while(const CharSet &set)
+    {
+        size_t skipped = 0;
+
+        while (!ended() && set.contains(_peek.peek(0)))
         {
-            next();
+            _peek.get();
+            skipped++;
         }
+
+        return skipped;
+    }
+
+    size_t skip_until(const CharSet &set)
+    {
+        return skip_while(~set);
+    }
+
+    String take_while(const CharSet &set)
+    {
+        MemoryWriter writer{};
+
+        while (!ended() && set.contains(_peek.peek(0)))
+        {
+            writer.write(_peek.get());
+        }
+
+        return String{writer.string()};
+    }
+
+    String take_until(const CharSet &set)
+    {
+        return take_while(~set);
     }
 
     bool skip_any(const char *chr)
@@ -246,7 +355,7 @@ public:
 
     bool skip_word(const char *word, size_t size)
     {
-        if (peek_is_word(word))
+        if (peek_is_word(word, size))
         {
             for (size_t i = 0; i < size; i++)
             {
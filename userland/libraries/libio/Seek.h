@@ -41,14 +41,15 @@ struct SeekFrom
     }
 };
 
+// Positions are 64-bit whatever size_t is, files and archives go past 4GB.
 struct Seek
 {
     virtual ~Seek() {}
 
-    virtual ResultOr<size_t> seek(SeekFrom from) = 0;
-    virtual ResultOr<size_t> tell() = 0;
+    virtual ResultOr<size64_t> seek(SeekFrom from) = 0;
+    virtual ResultOr<size64_t> tell() = 0;
 
-    virtual ResultOr<size_t> length()
+    virtual ResultOr<size64_t> length()
     {
         auto original_position = TRY(seek(SeekFrom::current(0)));
 
@@ -0,0 +1,373 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <assert.h>
+#include <string.h>
+#include <sys/futex.h>
+#include <libabi/Handle.h>
+#include <libsystem/system/Memory.h>
+#include <libutils/Macros.h>
+#include <libutils/Optional.h>
+#include <libutils/RefPtr.h>
+#include <libutils/ResultOr.h>
+
+namespace IO
+{
+
+struct SharedMessage
+{
+    const void *data;
+    size_t size;
+};
+
+// A ring of messages in memory shared by two processes, one writing and
+// one reading. One side creates it and sends handle() to the other, over a
+// Connection for example, which attaches to it. Messages are written and
+// read in place, nothing goes through the kernel but the wakeups, and
+// those only when the other side is waiting.
+//
+// Every message is contiguous in the ring, so one can be at most half of
+// the capacity. Use two channels to talk both ways.
+struct SharedChannel :
+    public RefCounted<SharedChannel>
+{
+private:
+    static constexpr uint32_t MAGIC = 0x4348414e;
+    static constexpr uint32_t WRAP = 0xffffffff;
+    static constexpr size_t RECORD_ALIGNMENT = 8;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t capacity;
+        uint32_t closed;
+
+        // Bytes written so far, only ever moved by the writer.
+        alignas(64) uint32_t head;
+        uint32_t reader_waiting;
+
+        // Bytes read so far, only ever moved by the reader.
+        alignas(64) uint32_t tail;
+        uint32_t writer_waiting;
+    };
+
+    // In front of each message; a size of WRAP means the rest of the ring
+    // is padding and the next message is at its start.
+    struct Record
+    {
+        uint32_t size;
+        uint32_t reserved;
+    };
+
+    static_assert(sizeof(Record) == RECORD_ALIGNMENT);
+
+    uintptr_t _address = 0;
+    Header *_header = nullptr;
+    char *_data = nullptr;
+    uint32_t _capacity = 0;
+
+    // The message being written until it is committed, and where the one
+    // being read ends until it is released.
+    uint32_t _write_start = 0;
+    uint32_t _write_end = 0;
+    bool _writing = false;
+
+    uint32_t _read_end = 0;
+    bool _reading = false;
+
+    NONCOPYABLE(SharedChannel);
+    NONMOVABLE(SharedChannel);
+
+    uint32_t mask() const { return _capacity - 1; }
+
+    static uint32_t record_size(size_t size)
+    {
+        return sizeof(Record) + ALIGN_UP(size, RECORD_ALIGNMENT);
+    }
+
+    Record *record_at(uint32_t position)
+    {
+        return reinterpret_cast<Record *>(_data + (position & mask()));
+    }
+
+    bool closed() const
+    {
+        return __atomic_load_n(&_header->closed, __ATOMIC_ACQUIRE);
+    }
+
+    // Sleeps until word is no longer seen, unless it already isn't. The
+    // other side checks waiting after it moved word, so one of the two
+    // always sees the other.
+    void wait(uint32_t *word, uint32_t *waiting, uint32_t seen)
+    {
+        __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(word, __ATOMIC_SEQ_CST) == seen && !closed())
+        {
+            futex(word, FUTEX_WAIT, seen, nullptr, nullptr, 0);
+        }
+
+        __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+    }
+
+    void wake(uint32_t *word, uint32_t *waiting)
+    {
+        if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST))
+        {
+            futex(word, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+        }
+    }
+
+public:
+    SharedChannel(uintptr_t address) : _address{address}
+    {
+        _header = reinterpret_cast<Header *>(address);
+        _data = reinterpret_cast<char *>(address) + ALIGN_UP(sizeof(Header), 64);
+    }
+
+    ~SharedChannel()
+    {
+        memory_free(_address);
+    }
+
+    // capacity is rounded up to a power of two.
+    static ResultOr<RefPtr<SharedChannel>> create(size_t capacity)
+    {
+        if (capacity > (1u << 30))
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        uint32_t rounded = 4096;
+
+        while (rounded < capacity)
+        {
+            rounded *= 2;
+        }
+
+        uintptr_t address = 0;
+        TRY(memory_alloc(ALIGN_UP(sizeof(Header), 64) + rounded, &address));
+
+        auto channel = make<SharedChannel>(address);
+
+        auto *header = channel->_header;
+        header->capacity = rounded;
+        channel->_capacity = rounded;
+        header->closed = 0;
+        header->head = 0;
+        header->reader_waiting = 0;
+        header->tail = 0;
+        header->writer_waiting = 0;
+        __atomic_store_n(&header->magic, MAGIC, __ATOMIC_RELEASE);
+
+        return channel;
+    }
+
+    static ResultOr<RefPtr<SharedChannel>> attach(int handle)
+    {
+        uintptr_t address = 0;
+        size_t size = 0;
+        TRY(memory_include(handle, &address, &size));
+
+        auto channel = make<SharedChannel>(address);
+
+        if (size < sizeof(Header))
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        auto *header = channel->_header;
+        uint32_t capacity = header->capacity;
+
+        if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != MAGIC ||
+            capacity < 4096 || (capacity & (capacity - 1)) != 0 ||
+            ALIGN_UP(sizeof(Header), 64) + capacity > size)
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        // Kept on this side, where the other process can't change it.
+        channel->_capacity = capacity;
+
+        return channel;
+    }
+
+    ResultOr<int> handle()
+    {
+        int handle = HANDLE_INVALID_ID;
+        TRY(memory_get_handle(_address, &handle));
+        return handle;
+    }
+
+    size_t capacity() const { return _capacity; }
+
+    size_t max_message_size() const
+    {
+        return _capacity / 2 - sizeof(Record);
+    }
+
+    // Wakes up the other side, which sees no more messages once it read
+    // those already sent.
+    void close()
+    {
+        __atomic_store_n(&_header->closed, 1, __ATOMIC_RELEASE);
+
+        futex(&_header->head, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+        futex(&_header->tail, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+    }
+
+    // Room in the ring for a message of size bytes, to be written in place
+    // and sent with commit(). Waits for the reader to make room when block
+    // is true, or returns nullptr right away.
+    ResultOr<void *> reserve(size_t size, bool block = true)
+    {
+        assert(!_writing);
+
+        if (size > max_message_size())
+        {
+            return ERR_INVALID_DATA;
+        }
+
+        uint32_t head = __atomic_load_n(&_header->head, __ATOMIC_RELAXED);
+        uint32_t offset = head & mask();
+        uint32_t needed = record_size(size);
+        uint32_t padding = offset + needed > _capacity ? _capacity - offset : 0;
+
+        while (true)
+        {
+            if (closed())
+            {
+                return ERR_STREAM_CLOSED;
+            }
+
+            uint32_t tail = __atomic_load_n(&_header->tail, __ATOMIC_ACQUIRE);
+
+            if (_capacity - (head - tail) >= padding + needed)
+            {
+                break;
+            }
+
+            if (!block)
+            {
+                return (void *)nullptr;
+            }
+
+            wait(&_header->tail, &_header->writer_waiting, tail);
+        }
+
+        if (padding)
+        {
+            record_at(head)->size = WRAP;
+            head += padding;
+        }
+
+        _write_start = head;
+        _write_end = head + needed;
+        _writing = true;
+
+        return (void *)(record_at(head) + 1);
+    }
+
+    // Sends what was written at reserve(), size can be less than what was
+    // reserved.
+    void commit(size_t size)
+    {
+        assert(_writing);
+        assert(record_size(size) <= _write_end - _write_start);
+
+        record_at(_write_start)->size = size;
+        _writing = false;
+
+        __atomic_store_n(&_header->head, _write_start + record_size(size), __ATOMIC_SEQ_CST);
+        wake(&_header->head, &_header->reader_waiting);
+    }
+
+    ResultOr<size_t> send(const void *buffer, size_t size)
+    {
+        void *destination = TRY(reserve(size));
+        memcpy(destination, buffer, size);
+        commit(size);
+
+        return size;
+    }
+
+    // The next message, read in place. It stays valid and in the ring until
+    // release(). Waits for one when block is true, or returns an empty
+    // optional right away.
+    ResultOr<Optional<SharedMessage>> receive(bool block = true)
+    {
+        assert(!_reading);
+
+        uint32_t tail = __atomic_load_n(&_header->tail, __ATOMIC_RELAXED);
+
+        while (true)
+        {
+            uint32_t head = __atomic_load_n(&_header->head, __ATOMIC_ACQUIRE);
+
+            if (head == tail)
+            {
+                if (closed())
+                {
+                    return ERR_STREAM_CLOSED;
+                }
+
+                if (!block)
+                {
+                    return Optional<SharedMessage>{};
+                }
+
+                wait(&_header->head, &_header->reader_waiting, head);
+                continue;
+            }
+
+            auto *record = record_at(tail);
+
+            // The writer is on the other side of a process boundary, a
+            // record it got wrong must not send reads outside of the ring,
+            // so its size is only read once.
+            uint32_t size = __atomic_load_n(&record->size, __ATOMIC_RELAXED);
+
+            if (size == WRAP)
+            {
+                uint32_t padding = _capacity - (tail & mask());
+
+                if (padding > head - tail)
+                {
+                    return ERR_INVALID_DATA;
+                }
+
+                tail += padding;
+                continue;
+            }
+
+            if (size > max_message_size() || record_size(size) > head - tail)
+            {
+                return ERR_INVALID_DATA;
+            }
+
+            _read_end = tail + record_size(size);
+            _reading = true;
+
+            return Optional<SharedMessage>{SharedMessage{record + 1, size}};
+        }
+    }
+
+    // Gives the space of the message returned by receive() back to the
+    // writer.
+    void release()
+    {
+        assert(_reading);
+        _reading = false;
+
+        __atomic_store_n(&_header->tail, _read_end, __ATOMIC_SEQ_CST);
+        wake(&_header->tail, &_header->writer_waiting);
+    }
+};
+
+}
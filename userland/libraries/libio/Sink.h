@@ -18,7 +18,7 @@ struct Sink :
     ResultOr<size_t> write(const void *buffer, size_t size) override
     {
         UNUSED(buffer);
-        return size
+        return size;
     }
 };
 
@@ -13,6 +13,9 @@
 namespace IO
 {
 
+// A terminal's two ends: programs write to the client and the terminal
+// server reads them. Wrap the client in an IO::TerminalWriter when writing
+// many small pieces, so the server renders whole batches.
 struct Terminal
 {
     File client{};
@@ -0,0 +1,491 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <stdint.h>
+#include <string.h>
+#include <libio/Writer.h>
+#include <libutils/Array.h>
+
+namespace IO
+{
+
+// Batches output for a terminal: writes gather in a buffer that goes out
+// as one write once it fills up or on flush(), so the terminal renders a
+// batch at a time instead of after every character.
+//
+// Colour and attribute changes (SGR, "\e[...m") are held back until there
+// is text to apply them to. A run of them is merged into a single
+// sequence with only what changed, and those that change nothing are
+// dropped. Sequences it doesn't understand go through as they are.
+struct TerminalWriter : public IO::Writer
+{
+private:
+    struct Color
+    {
+        // 0 for the default, 1 for codes like 31 or 104, 5 for the
+        // 256-colour palette and 2 for direct colour, as in 38;5 and 38;2.
+        uint8_t kind = 0;
+        uint32_t value = 0;
+
+        bool operator==(const Color &other) const { return kind == other.kind && value == other.value; }
+        bool operator!=(const Color &other) const { return !(*this == other); }
+    };
+
+    struct Style
+    {
+        // Bold is bit 1 up to crossed out at bit 9, as the SGR numbers go.
+        uint16_t attributes = 0;
+        Color foreground;
+        Color background;
+
+        bool operator==(const Style &other) const
+        {
+            return attributes == other.attributes && foreground == other.foreground && background == other.background;
+        }
+
+        bool operator!=(const Style &other) const { return !(*this == other); }
+        bool is_default() const { return *this == Style{}; }
+    };
+
+    enum class State
+    {
+        TEXT,
+        ESCAPE,
+        CSI,
+    };
+
+    static constexpr size_t MAX_SEQUENCE = 64;
+
+    IO::Writer &_writer;
+    Array<uint8_t, 4096> _buffer;
+    size_t _used = 0;
+
+    State _state = State::TEXT;
+    Array<char, MAX_SEQUENCE> _sequence;
+    size_t _sequence_length = 0;
+
+    // What the terminal shows, and what the program asked for last.
+    Style _shown;
+    Style _wanted;
+    // False after a sequence we couldn't follow, until the next reset.
+    bool _shown_known = true;
+    bool _wanted_known = true;
+
+    JResult emit(const void *data, size_t size)
+    {
+        if (size > _buffer.count() - _used)
+        {
+            TRY(flush_buffer());
+        }
+
+        if (size >= _buffer.count())
+        {
+            TRY(_writer.write(data, size));
+            return SUCCESS;
+        }
+
+        memcpy(_buffer.raw_storage() + _used, data, size);
+        _used += size;
+        return SUCCESS;
+    }
+
+    JResult flush_buffer()
+    {
+        if (_used == 0)
+        {
+            return SUCCESS;
+        }
+
+        auto result = _writer.write(_buffer.raw_storage(), _used).result();
+        _used = 0;
+        return result;
+    }
+
+    static size_t append_number(char *out, uint32_t value)
+    {
+        char digits[10];
+        size_t count = 0;
+
+        do
+        {
+            digits[count++] = '0' + value % 10;
+            value /= 10;
+        } while (value);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            out[i] = digits[count - i - 1];
+        }
+
+        return count;
+    }
+
+    static size_t append_color(char *out, const Color &color, bool background)
+    {
+        size_t length = 0;
+
+        if (color.kind == 0)
+        {
+            return append_number(out, background ? 49 : 39);
+        }
+
+        if (color.kind == 1)
+        {
+            return append_number(out, color.value);
+        }
+
+        length += append_number(out, background ? 48 : 38);
+        out[length++] = ';';
+        length += append_number(out + length, color.kind);
+
+        if (color.kind == 5)
+        {
+            out[length++] = ';';
+            length += append_number(out + length, color.value);
+        }
+        else
+        {
+            for (int shift = 16; shift >= 0; shift -= 8)
+            {
+                out[length++] = ';';
+                length += append_number(out + length, (color.value >> shift) & 0xff);
+            }
+        }
+
+        return length;
+    }
+
+    // Brings the terminal to _wanted with as short a sequence as it can.
+    JResult sync_style()
+    {
+        if (!_wanted_known || (_shown_known && _shown == _wanted))
+        {
+            return SUCCESS;
+        }
+
+        char sequence[MAX_SEQUENCE] = "\e[";
+        size_t length = 2;
+        auto append_separator = [&] {
+            if (length > 2)
+            {
+                sequence[length++] = ';';
+            }
+        };
+
+        // Turning something off is shorter from a reset.
+        bool reset = !_shown_known ||
+                     _wanted.is_default() ||
+                     (_shown.attributes & ~_wanted.attributes) ||
+                     (_shown.foreground.kind && !_wanted.foreground.kind) ||
+                     (_shown.background.kind && !_wanted.background.kind);
+
+        Style from = reset ? Style{} : _shown;
+
+        // An empty "\e[m" is the reset.
+        if (reset && !_wanted.is_default())
+        {
+            sequence[length++] = '0';
+        }
+
+        for (uint32_t attribute = 1; attribute <= 9; attribute++)
+        {
+            uint16_t bit = 1 << attribute;
+
+            if ((_wanted.attributes & bit) && !(from.attributes & bit))
+            {
+                append_separator();
+                length += append_number(sequence + length, attribute);
+            }
+        }
+
+        if (_wanted.foreground != from.foreground)
+        {
+            append_separator();
+            length += append_color(sequence + length, _wanted.foreground, false);
+        }
+
+        if (_wanted.background != from.background)
+        {
+            append_separator();
+            length += append_color(sequence + length, _wanted.background, true);
+        }
+
+        sequence[length++] = 'm';
+
+        _shown = _wanted;
+        _shown_known = true;
+        return emit(sequence, length);
+    }
+
+    static bool parse_color(const uint32_t *params, size_t count, size_t &i, Color &color)
+    {
+        if (i + 1 < count && params[i + 1] == 5 && i + 2 < count && params[i + 2] <= 255)
+        {
+            color = {5, params[i + 2]};
+            i += 2;
+            return true;
+        }
+
+        if (i + 1 < count && params[i + 1] == 2 && i + 4 < count &&
+            params[i + 2] <= 255 && params[i + 3] <= 255 && params[i + 4] <= 255)
+        {
+            color = {2, (params[i + 2] << 16) | (params[i + 3] << 8) | params[i + 4]};
+            i += 4;
+            return true;
+        }
+
+        return false;
+    }
+
+    // Applies SGR parameters to style, false for ones it doesn't know.
+    static bool apply(const uint32_t *params, size_t count, Style &style)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t param = params[i];
+
+            if (param == 0)
+            {
+                style = {};
+            }
+            else if (param >= 1 && param <= 9)
+            {
+                style.attributes |= 1 << param;
+            }
+            else if (param == 22)
+            {
+                style.attributes &= ~((1 << 1) | (1 << 2));
+            }
+            else if (param >= 23 && param <= 29 && param != 26)
+            {
+                style.attributes &= ~(1 << (param - 20));
+            }
+            else if ((param >= 30 && param <= 37) || (param >= 90 && param <= 97))
+            {
+                style.foreground = {1, param};
+            }
+            else if ((param >= 40 && param <= 47) || (param >= 100 && param <= 107))
+            {
+                style.background = {1, param};
+            }
+            else if (param == 39)
+            {
+                style.foreground = {};
+            }
+            else if (param == 49)
+            {
+                style.background = {};
+            }
+            else if (param == 38)
+            {
+                if (!parse_color(params, count, i, style.foreground))
+                {
+                    return false;
+                }
+            }
+            else if (param == 48)
+            {
+                if (!parse_color(params, count, i, style.background))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    JResult pass_sequence_through()
+    {
+        TRY(sync_style());
+        TRY(emit(_sequence.raw_storage(), _sequence_length));
+        _sequence_length = 0;
+        _state = State::TEXT;
+        return SUCCESS;
+    }
+
+    // _sequence holds "\e[" then the parameters, without the final 'm'.
+    JResult handle_sgr()
+    {
+        uint32_t params[MAX_SEQUENCE / 2];
+        size_t count = 0;
+        uint32_t value = 0;
+        size_t last_reset = SIZE_MAX;
+
+        for (size_t i = 2; i <= _sequence_length; i++)
+        {
+            if (i == _sequence_length || _sequence[i] == ';')
+            {
+                if (value == 0)
+                {
+                    last_reset = count;
+                }
+
+                params[count++] = value;
+                value = 0;
+            }
+            else if (_sequence[i] >= '0' && _sequence[i] <= '9' && value < 100000)
+            {
+                value = value * 10 + (_sequence[i] - '0');
+            }
+            else
+            {
+                // Subparameters with ':' and the like.
+                return SUCCESS;
+            }
+        }
+
+        bool was_known = _wanted_known;
+        Style style = _wanted;
+
+        // Whatever came before, a reset puts us back on known ground.
+        if (!_wanted_known && last_reset != SIZE_MAX)
+        {
+            style = {};
+            _wanted_known = apply(params + last_reset, count - last_reset, style);
+        }
+        else if (_wanted_known)
+        {
+            _wanted_known = apply(params, count, style);
+        }
+
+        if (_wanted_known)
+        {
+            _wanted = style;
+            _sequence_length = 0;
+            _state = State::TEXT;
+            return SUCCESS;
+        }
+
+        // Not something we can follow: bring the terminal up to date, then
+        // let it see the sequence itself.
+        _wanted_known = was_known;
+        TRY(sync_style());
+
+        _sequence[_sequence_length++] = 'm';
+        TRY(emit(_sequence.raw_storage(), _sequence_length));
+        _sequence_length = 0;
+        _state = State::TEXT;
+        _shown_known = false;
+        _wanted_known = false;
+        return SUCCESS;
+    }
+
+    JResult handle(uint8_t byte)
+    {
+        switch (_state)
+        {
+        case State::TEXT:
+            _sequence[0] = byte;
+            _sequence_length = 1;
+            _state = State::ESCAPE;
+            return SUCCESS;
+
+        case State::ESCAPE:
+            _sequence[_sequence_length++] = byte;
+
+            if (byte == '[')
+            {
+                _state = State::CSI;
+                return SUCCESS;
+            }
+
+            return pass_sequence_through();
+
+        case State::CSI:
+            if (byte == 'm')
+            {
+                bool is_sgr = true;
+
+                for (size_t i = 2; i < _sequence_length; i++)
+                {
+                    if (!(_sequence[i] == ';' || (_sequence[i] >= '0' && _sequence[i] <= '9')))
+                    {
+                        is_sgr = false;
+                    }
+                }
+
+                if (is_sgr)
+                {
+                    size_t length_before = _sequence_length;
+                    TRY(handle_sgr());
+
+                    // handle_sgr() leaves sequences with subparameters alone.
+                    if (_sequence_length != length_before)
+                    {
+                        return SUCCESS;
+                    }
+                }
+            }
+
+            _sequence[_sequence_length++] = byte;
+
+            if ((byte >= 0x40 && byte <= 0x7e) || _sequence_length == _sequence.count())
+            {
+                return pass_sequence_through();
+            }
+
+            return SUCCESS;
+        }
+
+        return SUCCESS;
+    }
+
+public:
+    TerminalWriter(IO::Writer &writer) : _writer{writer} {}
+
+    ~TerminalWriter() { flush(); }
+
+    ResultOr<size_t> write(const void *buffer, size_t size) override
+    {
+        auto *bytes = static_cast<const uint8_t *>(buffer);
+        size_t offset = 0;
+
+        while (offset < size)
+        {
+            if (_state != State::TEXT)
+            {
+                TRY(handle(bytes[offset++]));
+                continue;
+            }
+
+            auto *escape = static_cast<const uint8_t *>(memchr(bytes + offset, '\e', size - offset));
+            size_t run = escape ? escape - (bytes + offset) : size - offset;
+
+            if (run)
+            {
+                TRY(sync_style());
+                TRY(emit(bytes + offset, run));
+                offset += run;
+            }
+
+            if (escape)
+            {
+                TRY(handle(bytes[offset++]));
+            }
+        }
+
+        return size;
+    }
+
+    // Sends the batch, with the style as it is now: a program that ends
+    // on a reset leaves the terminal reset.
+    JResult flush() override
+    {
+        TRY(sync_style());
+        TRY(flush_buffer());
+        return _writer.flush();
+    }
+};
+
+}
@@ -0,0 +1,352 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <libio/Directory.h>
+#include <libio/Path.h>
+#include <libutils/Lock.h>
+#include <libutils/Threads.h>
+#include <libutils/Vector.h>
+
+namespace IO
+{
+
+enum struct WalkDecision
+{
+    // Keep going, and go into this entry if it is a directory.
+    CONTINUE,
+
+    // Keep going, but leave out everything under this entry.
+    SKIP,
+
+    STOP,
+};
+
+struct WalkOptions
+{
+    // How many levels of directories are read, the root being the first.
+    size_t max_depth = SIZE_MAX;
+
+    // Unreadable directories are skipped instead of stopping the walk, the
+    // root excepted.
+    bool skip_errors = true;
+
+    // How many threads read directories, 0 for one per processor. With
+    // more than one, directories are read ahead while the visitor runs.
+    size_t thread_count = 1;
+};
+
+// How many directories read by the pool can wait for the visitor before
+// its threads stop reading more.
+static constexpr size_t WALK_QUEUE_CAPACITY = 64;
+
+template <typename Visitor>
+JResult __parallel_walk(const Path &root, Visitor &visitor, WalkOptions options);
+
+// Calls visitor(path, entry, depth) with every entry under root. All the
+// entries of a directory are visited before anything under them, so the
+// visitor can prune a subdirectory before it is read. Only the directories
+// still to be read are kept around, not what was already visited.
+template <typename Visitor>
+JResult walk(const Path &root, Visitor visitor, WalkOptions options = {})
+{
+    if (options.thread_count != 1)
+    {
+        return __parallel_walk(root, visitor, options);
+    }
+
+    struct Pending
+    {
+        Path path;
+        size_t depth;
+    };
+
+    Vector<Pending> pending{};
+    pending.push_back({root, 0});
+
+    while (pending.any())
+    {
+        auto current = pending.pop_back();
+        Directory directory{current.path};
+
+        if (!directory.exist())
+        {
+            if (current.depth == 0 || !options.skip_errors)
+            {
+                return directory.handle()->result();
+            }
+
+            continue;
+        }
+
+        size_t first_child = pending.count();
+
+        for (auto &entry : directory.entries())
+        {
+            auto path = Path::join(current.path, entry.name);
+            auto decision = visitor(path, entry, current.depth);
+
+            if (decision == WalkDecision::STOP)
+            {
+                return SUCCESS;
+            }
+
+            if (decision == WalkDecision::CONTINUE &&
+                entry.stat.type == J_FILE_TYPE_DIRECTORY &&
+                current.depth + 1 < options.max_depth)
+            {
+                pending.push_back({std::move(path), current.depth + 1});
+            }
+        }
+
+        // Pending directories are taken from the back, this makes them
+        // come out in the order they were listed.
+        for (size_t i = first_child, j = pending.count(); i + 1 < j; i++, j--)
+        {
+            std::swap(pending[i], pending[j - 1]);
+        }
+    }
+
+    return SUCCESS;
+}
+
+// The pool's side of a parallel walk. Each thread reads directories from
+// its own queue, taking the last one it was given, and steals the oldest
+// of another's when it runs out. What it read goes through a bounded queue
+// to the visitor, which always runs on the calling thread, one entry at a
+// time like a serial walk. Directories are only read once the visitor let
+// them be, so pruning works the same, but the order between directories
+// is whichever was read first.
+template <typename Visitor>
+JResult __parallel_walk(const Path &root, Visitor &visitor, WalkOptions options)
+{
+    struct Pending
+    {
+        Path path;
+        size_t depth;
+    };
+
+    struct Read
+    {
+        Pending directory;
+        JResult result;
+        Vector<Directory::Entry> entries;
+    };
+
+    struct Worker
+    {
+        Utils::Lock lock{"walk-worker"};
+        Vector<Pending> pending{};
+    };
+
+    size_t thread_count = options.thread_count ? options.thread_count : Utils::processor_count();
+    thread_count = MIN(thread_count, Utils::MAX_WORKER_THREADS);
+
+    // The calling thread visits, and only reads when it is waiting anyway.
+    size_t reader_count = MAX(thread_count - 1, (size_t)1);
+    Worker workers[Utils::MAX_WORKER_THREADS];
+
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t work_queued = PTHREAD_COND_INITIALIZER;
+    pthread_cond_t read_queued = PTHREAD_COND_INITIALIZER;
+    pthread_cond_t read_taken = PTHREAD_COND_INITIALIZER;
+
+    // Under mutex.
+    size_t queued = 0;
+    Vector<Read> reads{};
+    bool done = false;
+
+    size_t next_worker = 0;
+
+    auto give = [&](Pending directory) {
+        auto &worker = workers[next_worker];
+        next_worker = (next_worker + 1) % reader_count;
+
+        {
+            Utils::LockHolder holder{worker.lock};
+            worker.pending.push_back(std::move(directory));
+        }
+
+        pthread_mutex_lock(&mutex);
+        queued++;
+        pthread_cond_signal(&work_queued);
+        pthread_mutex_unlock(&mutex);
+    };
+
+    auto take = [&](size_t self, Pending &directory) {
+        for (size_t i = 0; i < reader_count; i++)
+        {
+            auto &worker = workers[(self + i) % reader_count];
+            Utils::LockHolder holder{worker.lock};
+
+            if (worker.pending.any())
+            {
+                directory = i == 0 ? worker.pending.pop_back() : worker.pending.pop();
+                return true;
+            }
+        }
+
+        return false;
+    };
+
+    auto list = [&](Pending directory) {
+        Directory listing{directory.path};
+        JResult result = listing.exist() ? SUCCESS : listing.handle()->result();
+        Read listed{std::move(directory), result, {}};
+
+        if (result == SUCCESS)
+        {
+            listed.entries = listing.entries();
+        }
+
+        return listed;
+    };
+
+    // Must be called with mutex held, after claiming one of the queued
+    // directories, which makes sure it is still there.
+    auto claimed = [&](size_t self) {
+        queued--;
+        pthread_mutex_unlock(&mutex);
+
+        Pending directory{root, 0};
+        while (!take(self, directory))
+        {
+            asm("pause");
+        }
+
+        return list(std::move(directory));
+    };
+
+    auto read = [&](size_t self) {
+        while (true)
+        {
+            pthread_mutex_lock(&mutex);
+
+            while (queued == 0 && !done)
+            {
+                pthread_cond_wait(&work_queued, &mutex);
+            }
+
+            if (done)
+            {
+                pthread_mutex_unlock(&mutex);
+                return;
+            }
+
+            auto listed = claimed(self);
+
+            pthread_mutex_lock(&mutex);
+
+            while (reads.count() >= WALK_QUEUE_CAPACITY && !done)
+            {
+                pthread_cond_wait(&read_taken, &mutex);
+            }
+
+            if (!done)
+            {
+                reads.push_back(std::move(listed));
+                pthread_cond_signal(&read_queued);
+            }
+
+            pthread_mutex_unlock(&mutex);
+        }
+    };
+
+    // Directories given to the pool and not visited yet.
+    size_t outstanding = 0;
+
+    auto next = [&]() {
+        pthread_mutex_lock(&mutex);
+
+        // Rather than waiting with nothing read yet, the calling thread
+        // reads one itself. This also keeps the walk going when none of
+        // the pool's threads could be started.
+        if (!reads.any() && queued > 0)
+        {
+            return claimed(0);
+        }
+
+        while (!reads.any())
+        {
+            pthread_cond_wait(&read_queued, &mutex);
+        }
+
+        auto current = reads.pop();
+        pthread_cond_signal(&read_taken);
+        pthread_mutex_unlock(&mutex);
+
+        return current;
+    };
+
+    auto visit = [&]() -> JResult {
+        give({root, 0});
+        outstanding++;
+
+        while (outstanding > 0)
+        {
+            auto current = next();
+            outstanding--;
+
+            if (current.result != SUCCESS)
+            {
+                if (current.directory.depth == 0 || !options.skip_errors)
+                {
+                    return current.result;
+                }
+
+                continue;
+            }
+
+            for (auto &entry : current.entries)
+            {
+                auto path = Path::join(current.directory.path, entry.name);
+                auto decision = visitor(path, entry, current.directory.depth);
+
+                if (decision == WalkDecision::STOP)
+                {
+                    return SUCCESS;
+                }
+
+                if (decision == WalkDecision::CONTINUE &&
+                    entry.stat.type == J_FILE_TYPE_DIRECTORY &&
+                    current.directory.depth + 1 < options.max_depth)
+                {
+                    give({std::move(path), current.directory.depth + 1});
+                    outstanding++;
+                }
+            }
+        }
+
+        return SUCCESS;
+    };
+
+    pthread_t caller = pthread_self();
+    size_t next_reader = 0;
+    JResult result = SUCCESS;
+
+    Utils::run_on_threads(reader_count + 1, [&]() {
+        if (pthread_equal(pthread_self(), caller))
+        {
+            result = visit();
+
+            pthread_mutex_lock(&mutex);
+            done = true;
+            pthread_cond_broadcast(&work_queued);
+            pthread_cond_broadcast(&read_taken);
+            pthread_mutex_unlock(&mutex);
+        }
+        else
+        {
+            read(__atomic_fetch_add(&next_reader, 1, __ATOMIC_RELAXED) % reader_count);
+        }
+    });
+
+    return result;
+}
+
+}
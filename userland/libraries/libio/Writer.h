@@ -7,6 +7,7 @@
 #pragma once
 
 // includes
+#include <libio/IOVec.h>
 #include <libio/Seek.h>
 
 namespace IO
@@ -18,6 +19,26 @@ struct Writer
 
     virtual ResultOr<size_t> write(const void *buffer, size_t size) = 0;
 
+    // Writes each piece in turn, and stops at the first one that isn't
+    // taken whole.
+    virtual ResultOr<size_t> writev(const IOVec *vecs, size_t count)
+    {
+        size_t total = 0;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t written = TRY(write(vecs[i].data, vecs[i].size));
+            total += written;
+
+            if (written < vecs[i].size)
+            {
+                break;
+            }
+        }
+
+        return total;
+    }
+
     virtual JResult flush() { return SUCCESS; }
 };
 
@@ -13,18 +13,38 @@
 #include <libsystem/core/Plugs.h>
 #include <libsystem/io/Stream.h>
 
-Stream *stream_open(const char *path, JOpenFlag flags)
+static Stream *_open_streams = nullptr;
+
+static Stream *stream_create(StreamBufferMode mode)
 {
     Stream *stream = CREATE(Stream);
 
+    stream->buffer_mode = mode;
+
+    stream->next = _open_streams;
+    if (_open_streams)
+    {
+        _open_streams->prev = stream;
+    }
+    _open_streams = stream;
+
+    return stream;
+}
+
+Stream *stream_open(const char *path, JOpenFlag flags)
+{
+    Stream *stream = stream_create(STREAM_BUFFERED_FULL);
+
     __plug_handle_open(HANDLE(stream), path, flags | J_OPEN_STREAM);
 
     return stream;
 }
 
+// Handles opened elsewhere are usually pipes and terminals, where the
+// other side expects to see every line as soon as it is written.
 Stream *stream_open_handle(int handle_id, JOpenFlag flags)
 {
-    Stream *stream = CREATE(Stream);
+    Stream *stream = stream_create(STREAM_BUFFERED_LINE);
 
     HANDLE(stream)->id = handle_id;
     HANDLE(stream)->flags = flags | J_OPEN_STREAM;
@@ -35,8 +55,26 @@ Stream *stream_open_handle(int handle_id, JOpenFlag flags)
 
 void stream_close(Stream *stream)
 {
+    stream_flush(stream);
+
     __plug_handle_close(HANDLE(stream));
 
+    if (stream->prev)
+    {
+        stream->prev->next = stream->next;
+    }
+    else
+    {
+        _open_streams = stream->next;
+    }
+
+    if (stream->next)
+    {
+        stream->next->prev = stream->prev;
+    }
+
+    free(stream->write_buffer);
+    free(stream->read_buffer);
     free(stream);
 }
 
@@ -49,6 +87,70 @@ void stream_cleanup(Stream **stream)
     }
 }
 
+void stream_set_buffer_mode(Stream *stream, StreamBufferMode mode)
+{
+    if (mode != stream->buffer_mode)
+    {
+        stream_flush(stream);
+        stream->buffer_mode = mode;
+    }
+}
+
+void stream_flush(Stream *stream)
+{
+    if (!stream)
+    {
+        return;
+    }
+
+    size_t written = 0;
+
+    while (written < stream->write_used)
+    {
+        size_t result = __plug_handle_write(HANDLE(stream), stream->write_buffer + written, stream->write_used - written);
+
+        if (result == 0)
+        {
+            break;
+        }
+
+        written += result;
+    }
+
+    // Whatever the handle refused is dropped, like an unbuffered write of
+    // it would have been.
+    stream->write_used = 0;
+}
+
+void stream_flush_all()
+{
+    for (Stream *stream = _open_streams; stream; stream = stream->next)
+    {
+        stream_flush(stream);
+    }
+}
+
+static size_t stream_read_from_buffer(Stream *stream, void *buffer, size_t size)
+{
+    size_t count = MIN(size, stream->read_used - stream->read_head);
+
+    memcpy(buffer, stream->read_buffer + stream->read_head, count);
+    stream->read_head += count;
+
+    return count;
+}
+
+static void stream_refill(Stream *stream)
+{
+    if (!stream->read_buffer)
+    {
+        stream->read_buffer = (char *)malloc(STREAM_BUFFER_SIZE);
+    }
+
+    stream->read_head = 0;
+    stream->read_used = __plug_handle_read(HANDLE(stream), stream->read_buffer, STREAM_BUFFER_SIZE);
+}
+
 size_t stream_read(Stream *stream, void *buffer, size_t size)
 {
     if (!stream)
@@ -68,7 +170,31 @@ size_t stream_read(Stream *stream, void *buffer, size_t size)
         result = 1;
     }
 
-    result = __plug_handle_read(HANDLE(stream), buffer, size);
+    // Don't wait on the handle for more when something is already there.
+    if (stream->read_head < stream->read_used)
+    {
+        return result + stream_read_from_buffer(stream, buffer, size);
+    }
+
+    if (result > 0 || size == 0)
+    {
+        return result;
+    }
+
+    // What is about to be read may depend on what was written.
+    stream_flush(stream);
+
+    // Large reads go straight into the caller's buffer, there is nothing to
+    // gain from copying them through ours.
+    if (stream->buffer_mode == STREAM_BUFFERED_NONE || size >= STREAM_BUFFER_SIZE)
+    {
+        result = __plug_handle_read(HANDLE(stream), buffer, size);
+    }
+    else
+    {
+        stream_refill(stream);
+        result = stream_read_from_buffer(stream, buffer, size);
+    }
 
     if (result == 0)
     {
@@ -78,6 +204,24 @@ size_t stream_read(Stream *stream, void *buffer, size_t size)
     return result;
 }
 
+static size_t stream_write_buffered(Stream *stream, const void *buffer, size_t size)
+{
+    if (!stream->write_buffer)
+    {
+        stream->write_buffer = (char *)malloc(STREAM_BUFFER_SIZE);
+    }
+
+    if (stream->write_used + size > STREAM_BUFFER_SIZE)
+    {
+        stream_flush(stream);
+    }
+
+    memcpy(stream->write_buffer + stream->write_used, buffer, size);
+    stream->write_used += size;
+
+    return size;
+}
+
 size_t stream_write(Stream *stream, const void *buffer, size_t size)
 {
     if (!stream)
@@ -85,16 +229,52 @@ size_t stream_write(Stream *stream, const void *buffer, size_t size)
         return 0;
     }
 
-    return __plug_handle_write(HANDLE(stream), buffer, size);
+    // Large writes would only be copied into the buffer to be written out
+    // right away, so they go straight to the handle after what is queued.
+    if (stream->buffer_mode == STREAM_BUFFERED_NONE || size >= STREAM_BUFFER_SIZE)
+    {
+        stream_flush(stream);
+        return __plug_handle_write(HANDLE(stream), buffer, size);
+    }
+
+    stream_write_buffered(stream, buffer, size);
+
+    if (stream->write_used == STREAM_BUFFER_SIZE ||
+        (stream->buffer_mode == STREAM_BUFFERED_LINE && memchr(buffer, '\n', size)))
+    {
+        stream_flush(stream);
+    }
+
+    return size;
 }
 
 JResult stream_call(Stream *stream, IOCall request, void *arg)
 {
+    stream_flush(stream);
+
     return __plug_handle_call(HANDLE(stream), request, arg);
 }
 
 int stream_seek(Stream *stream, IO::SeekFrom from)
 {
+    stream_flush(stream);
+
+    // The handle is ahead of the stream by whatever is still buffered.
+    if (from.whence == IO::Whence::CURRENT)
+    {
+        from.position -= stream->read_used - stream->read_head;
+
+        if (stream->has_unget)
+        {
+            from.position -= 1;
+        }
+    }
+
+    stream->read_used = 0;
+    stream->read_head = 0;
+    stream->has_unget = false;
+    stream->is_end_of_file = false;
+
     return __plug_handle_seek(HANDLE(stream), from);
 }
 
@@ -103,12 +283,17 @@ void stream_stat(Stream *stream, JStat *stat)
     stat->type = J_FILE_TYPE_UNKNOWN;
     stat->size = 0;
 
+    stream_flush(stream);
+
     __plug_handle_stat(HANDLE(stream), stat);
 }
 
+// Formatted output comes one character at a time, so it always goes
+// through the buffer, whatever the mode, and is flushed as the mode says
+// once it is all there.
 void stream_format_append(printf_info_t *info, char c)
 {
-    stream_write((Stream *)info->output, &c, 1);
+    stream_write_buffered((Stream *)info->output, &c, 1);
 }
 
 int stream_format(Stream *stream, const char *fmt, ...)
@@ -132,5 +317,14 @@ int stream_vprintf(Stream *stream, const char *fmt, va_list va)
     info.output = (void *)stream;
     info.allocated = -1;
 
-    return __printf(&info, va);
-}
\ No newline at end of file
+    int result = __printf(&info, va);
+
+    if (stream->write_used > 0 &&
+        (stream->buffer_mode == STREAM_BUFFERED_NONE ||
+         (stream->buffer_mode == STREAM_BUFFERED_LINE && memchr(stream->write_buffer, '\n', stream->write_used))))
+    {
+        stream_flush(stream);
+    }
+
+    return result;
+}
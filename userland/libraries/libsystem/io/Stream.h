@@ -13,16 +13,41 @@
 #include <libio/Handle.h>
 #include <libio/Seek.h>
 
-#define STREAM_BUFFER_SIZE 512
+#define STREAM_BUFFER_SIZE 4096
+
+enum StreamBufferMode
+{
+    // Every read and write goes straight to the handle.
+    STREAM_BUFFERED_NONE,
+    // Writes are flushed at the end of every line.
+    STREAM_BUFFERED_LINE,
+    // Writes are flushed when the buffer is full.
+    STREAM_BUFFERED_FULL,
+};
 
 struct Stream
 {
     Handle handle;
 
+    StreamBufferMode buffer_mode;
+
+    // Both allocated the first time they are needed, STREAM_BUFFER_SIZE
+    // bytes each.
+    char *write_buffer;
+    size_t write_used;
+
+    char *read_buffer;
+    size_t read_used;
+    size_t read_head;
+
     bool has_unget;
     int unget_char;
 
     bool is_end_of_file;
+
+    // Every open stream, so exiting can flush them all.
+    Stream *prev;
+    Stream *next;
 };
 
 Stream *stream_open(const char *path, JOpenFlag flags);
@@ -37,6 +62,13 @@ size_t stream_read(Stream *stream, void *buffer, size_t size);
 
 size_t stream_write(Stream *stream, const void *buffer, size_t size);
 
+void stream_set_buffer_mode(Stream *stream, StreamBufferMode mode);
+
+// Writes out whatever is in the write buffer.
+void stream_flush(Stream *stream);
+
+void stream_flush_all();
+
 JResult stream_call(Stream *stream, IOCall request, void *arg);
 
 int stream_seek(Stream *stream, IO::SeekFrom from);
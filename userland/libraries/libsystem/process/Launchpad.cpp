@@ -9,6 +9,7 @@
 #include <pranaos/Environment.h>
 #include <string.h>
 #include <libio/Path.h>
+#include <libmath/MinMax.h>
 #include <libsystem/core/Plugs.h>
 #include <libsystem/process/Launchpad.h>
 #include <libsystem/process/Process.h>
@@ -35,7 +36,7 @@ Launchpad *launchpad_create(const char *name, const char *executable)
 
 #ifndef __KERNEL__
     auto env_copy = environment_copy();
-    launchpad_environment(launchpad, strdup(env_copy.cstring()));
+    launchpad_environment(launchpad, env_copy.cstring());
 #endif
 
     return launchpad;
@@ -137,4 +138,148 @@ JResult launchpad_launch(Launchpad *launchpad, int *pid)
     launchpad_destroy(launchpad);
 
     return result;
-}
\ No newline at end of file
+}
+
+RefPtr<LaunchpadEnvironment> launchpad_environment_snapshot()
+{
+#ifndef __KERNEL__
+    return make<LaunchpadEnvironment>(environment_copy());
+#else
+    return make<LaunchpadEnvironment>("");
+#endif
+}
+
+static const char *launchpad_basename(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static void launchpad_copy_string(char *destination, const char *source, size_t size)
+{
+    size_t length = MIN(strlen(source), size - 1);
+
+    memcpy(destination, source, length);
+    destination[length] = '\0';
+}
+
+// Arguments of successive launches are packed into the same block, it is
+// only grown, never given back.
+static char *_arguments_block = nullptr;
+static size_t _arguments_block_size = 0;
+
+static char *launchpad_arguments_block(size_t size)
+{
+    if (size > _arguments_block_size)
+    {
+        free(_arguments_block);
+        _arguments_block = (char *)malloc(size);
+        _arguments_block_size = size;
+    }
+
+    return _arguments_block;
+}
+
+static void launchpad_pack_argument(Launchpad &launchpad, char *&block, const char *buffer, size_t size)
+{
+    memcpy(block, buffer, size);
+    block[size] = '\0';
+
+    launchpad.argv[launchpad.argc].buffer = block;
+    launchpad.argv[launchpad.argc].size = size;
+    launchpad.argc++;
+
+    block += size + 1;
+}
+
+static JResult launchpad_spawn_with(const LaunchpadSpawn &spawn, const LaunchpadEnvironment &environment, int *pid)
+{
+    assert(spawn.executable);
+    assert(spawn.arguments.count() < PROCESS_ARG_COUNT);
+
+    int discard;
+
+    if (pid == nullptr)
+    {
+        pid = &discard;
+    }
+
+    Launchpad launchpad = {};
+
+    auto executable = process_resolve(spawn.executable);
+    const char *basename = launchpad_basename(spawn.executable);
+    const char *name = spawn.name ? spawn.name : basename;
+
+    launchpad_copy_string(launchpad.name, name, ARRAY_LENGTH(launchpad.name));
+    launchpad_copy_string(launchpad.executable, executable.cstring(), ARRAY_LENGTH(launchpad.executable));
+
+    launchpad.flags = spawn.flags;
+
+    for (int i = 0; i < LAUNCHPAD_HANDLE_COUNT; i++)
+    {
+        launchpad.handles[i] = spawn.handles[i];
+    }
+
+    size_t basename_size = strlen(basename);
+    size_t block_size = basename_size + 1;
+
+    for (auto &argument : spawn.arguments)
+    {
+        block_size += argument.size() + 1;
+    }
+
+    char *block = launchpad_arguments_block(block_size);
+
+    launchpad_pack_argument(launchpad, block, basename, basename_size);
+
+    for (auto &argument : spawn.arguments)
+    {
+        launchpad_pack_argument(launchpad, block, (const char *)argument.start(), argument.size());
+    }
+
+    launchpad.argv[launchpad.argc].buffer = nullptr;
+
+    // The kernel only reads the environment, the snapshot stays as it is.
+    launchpad.env = const_cast<char *>(environment.buffer());
+    launchpad.env_size = environment.size();
+
+    return __plug_process_launch(&launchpad, pid);
+}
+
+JResult launchpad_spawn(const LaunchpadSpawn &spawn, int *pid)
+{
+    if (spawn.environment)
+    {
+        return launchpad_spawn_with(spawn, *spawn.environment, pid);
+    }
+
+    return launchpad_spawn_with(spawn, *launchpad_environment_snapshot(), pid);
+}
+
+JResult launchpad_spawn_all(const Vector<LaunchpadSpawn> &spawns, Vector<int> *pids)
+{
+    RefPtr<LaunchpadEnvironment> shared = nullptr;
+
+    for (auto &spawn : spawns)
+    {
+        if (!spawn.environment && !shared)
+        {
+            shared = launchpad_environment_snapshot();
+        }
+
+        int pid = -1;
+        JResult result = launchpad_spawn_with(spawn, spawn.environment ? *spawn.environment : *shared, &pid);
+
+        if (result != SUCCESS)
+        {
+            return result;
+        }
+
+        if (pids)
+        {
+            pids->push_back(pid);
+        }
+    }
+
+    return SUCCESS;
+}
@@ -10,6 +10,9 @@
 #include <libabi/Handle.h>
 #include <libabi/Launchpad.h>
 #include <libio/Handle.h>
+#include <libutils/Macros.h>
+#include <libutils/RefCounted.h>
+#include <libutils/Slice.h>
 #include <libutils/String.h>
 #include <libutils/Vector.h>
 
@@ -31,4 +34,60 @@ void launchpad_handle(Launchpad *launchpad, IO::Handle &handle, int destination)
 
 void launchpad_handle(Launchpad *launchpad, Handle *handle_to_pass, int destination);
 
-JResult launchpad_launch(Launchpad *launchpad, int *pid);
\ No newline at end of file
+JResult launchpad_launch(Launchpad *launchpad, int *pid);
+
+// The environment of this process serialized once, so any number of
+// launches can hand it to the kernel without copying it again. A snapshot
+// doesn't see changes made to the environment after it was taken.
+struct LaunchpadEnvironment :
+    public RefCounted<LaunchpadEnvironment>
+{
+private:
+    String _buffer;
+
+public:
+    LaunchpadEnvironment(String buffer) : _buffer{buffer} {}
+
+    const char *buffer() const { return _buffer.cstring(); }
+
+    size_t size() const { return _buffer.length(); }
+};
+
+RefPtr<LaunchpadEnvironment> launchpad_environment_snapshot();
+
+static constexpr int LAUNCHPAD_HANDLE_COUNT = ARRAY_LENGTH(Launchpad::handles);
+
+struct LaunchpadSpawn
+{
+    // Defaults to the basename of the executable, like argv[0].
+    const char *name = nullptr;
+    const char *executable = nullptr;
+
+    // What comes after argv[0], which is the basename of the executable.
+    // Only viewed, they have to outlive the call to launchpad_spawn().
+    Vector<Slice> arguments{};
+
+    // Takes a snapshot for the launch when there is none.
+    RefPtr<LaunchpadEnvironment> environment = nullptr;
+
+    TaskFlags flags = 0;
+
+    int handles[LAUNCHPAD_HANDLE_COUNT];
+
+    LaunchpadSpawn()
+    {
+        for (int i = 0; i < LAUNCHPAD_HANDLE_COUNT; i++)
+        {
+            handles[i] = i < 4 ? i : HANDLE_INVALID_ID;
+        }
+    }
+};
+
+// Packs the arguments of the launch into one block and passes the
+// environment snapshot as is, instead of copying each of them.
+JResult launchpad_spawn(const LaunchpadSpawn &spawn, int *pid);
+
+// Launches one process after the other, sharing one environment snapshot
+// between those without one, until one of them fails. The pids of those
+// launched are appended to pids when it isn't null.
+JResult launchpad_spawn_all(const Vector<LaunchpadSpawn> &spawns, Vector<int> *pids);
@@ -9,6 +9,7 @@
 #include <libabi/Syscalls.h>
 #include <assert.h>
 #include <libsystem/core/Plugs.h>
+#include <libsystem/io/Stream.h>
 #include <libsystem/process/Launchpad.h>
 
 int process_this()
@@ -34,6 +35,8 @@ JResult process_run(const char *command, int *pid, TaskFlags flags)
 
 void NO_RETURN process_exit(int code)
 {
+    stream_flush_all();
+
     __plug_process_exit(code);
     __builtin_unreachable();
 }
@@ -0,0 +1,882 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+#include <libmath/MinMax.h>
+#include <libsystem/system/Allocator.h>
+#include <libsystem/system/Memory.h>
+#include <libutils/Lock.h>
+
+// Small objects come from spans, runs of pages cut out of regions taken
+// from memory_alloc() a megabyte at a time. Each span holds objects of one
+// size class, and freed objects are first kept in a per-class cache of the
+// thread that freed them, so the next allocation of that class on that
+// thread takes no lock and doesn't have to look at any span. Spans and
+// regions are shared, behind _lock.
+//
+// The kernel can only take a region back whole, so an idle span stays in
+// its region until every span of the region is idle, and then the region
+// is returned, unless it is the only idle one.
+
+static constexpr size_t ALLOCATOR_PAGE_SIZE = 4096;
+static constexpr size_t ALLOCATOR_ALIGNMENT = 16;
+
+static constexpr size_t REGION_PAGES = 256;
+static constexpr size_t REGION_SIZE = REGION_PAGES * ALLOCATOR_PAGE_SIZE;
+static constexpr size_t MAX_REGIONS = 1024;
+static constexpr size_t KEPT_IDLE_REGIONS = 1;
+
+static constexpr size_t MAX_SMALL_SIZE = 32 * 1024;
+static constexpr size_t MAX_SPAN_SIZE = 256 * 1024;
+
+// 16 bytes apart up to 128, then four classes between powers of two.
+static constexpr int SIZE_CLASS_COUNT = 40;
+
+static constexpr int SPAN_FREE = -1;
+static constexpr int SPAN_LARGE = -2;
+
+struct Region;
+
+struct Span
+{
+    Region *region;
+    uint16_t first_page;
+    uint16_t page_count;
+    int size_class;
+
+    uint16_t used;
+    uint16_t capacity;
+
+    // Objects are carved one after the other on demand, and only those
+    // freed since go through the free list.
+    uint16_t carved;
+    void *free_list;
+
+    Span *prev;
+    Span *next;
+};
+
+// Lives in the first pages of the region it describes.
+struct Region
+{
+    uintptr_t base;
+    size_t used_pages;
+
+    // The first page of the span each page is in.
+    uint16_t owner[REGION_PAGES];
+
+    // Indexed by their first page.
+    Span spans[REGION_PAGES];
+};
+
+static constexpr size_t REGION_HEADER_PAGES = (sizeof(Region) + ALLOCATOR_PAGE_SIZE - 1) / ALLOCATOR_PAGE_SIZE;
+
+// In front of blocks too big for a span, which get a memory_alloc() each.
+struct alignas(ALLOCATOR_ALIGNMENT) HugeHeader
+{
+    size_t mapped;
+    size_t usable;
+};
+
+static_assert(sizeof(HugeHeader) == ALLOCATOR_ALIGNMENT);
+
+struct SizeClassCache
+{
+    void *head;
+    size_t count;
+};
+
+// Trivially destructible, so that a thread taking it for the first time
+// doesn't allocate. What is left in it goes back to the spans when the
+// thread exits, through _thread_cache_key.
+struct ThreadCache
+{
+    SizeClassCache caches[SIZE_CLASS_COUNT];
+    bool registered;
+};
+
+static thread_local ThreadCache _thread_cache = {};
+static pthread_key_t _thread_cache_key;
+static pthread_once_t _thread_cache_once = PTHREAD_ONCE_INIT;
+
+static Utils::Lock _lock{"allocator"};
+
+// Under _lock. Frees find their region without it: _region_bases is only
+// changed between two increments of _regions_version, and only ever read
+// through it, never through a region which may be gone already.
+static Region *_regions[MAX_REGIONS] = {};
+static uintptr_t _region_bases[MAX_REGIONS] = {};
+static size_t _region_count = 0;
+static size_t _regions_version = 0;
+static size_t _idle_regions = 0;
+
+static Span *_free_spans = nullptr;
+static Span *_partial_spans[SIZE_CLASS_COUNT] = {};
+
+// Counted from every thread, without _lock.
+static AllocatorStatistics _statistics = {};
+
+static void statistics_add(size_t AllocatorStatistics::*counter, size_t amount)
+{
+    __atomic_add_fetch(&(_statistics.*counter), amount, __ATOMIC_RELAXED);
+}
+
+static void statistics_sub(size_t AllocatorStatistics::*counter, size_t amount)
+{
+    __atomic_sub_fetch(&(_statistics.*counter), amount, __ATOMIC_RELAXED);
+}
+
+static int size_class_of(size_t size)
+{
+    if (size <= 128)
+    {
+        return size == 0 ? 0 : (size + 15) / 16 - 1;
+    }
+
+    int shift = 63 - __builtin_clzll(size - 1);
+    size_t step = (size_t)1 << (shift - 2);
+
+    return 8 + (shift - 7) * 4 + (int)((size - 1 - ((size_t)1 << shift)) / step);
+}
+
+static size_t size_class_size(int size_class)
+{
+    if (size_class < 8)
+    {
+        return (size_class + 1) * 16;
+    }
+
+    int shift = (size_class - 8) / 4 + 7;
+    int index = (size_class - 8) % 4;
+
+    return ((size_t)1 << shift) + (index + 1) * ((size_t)1 << (shift - 2));
+}
+
+// Enough pages for at least eight objects.
+static size_t size_class_pages(int size_class)
+{
+    return (size_class_size(size_class) * 8 + ALLOCATOR_PAGE_SIZE - 1) / ALLOCATOR_PAGE_SIZE;
+}
+
+// How many objects move between the cache and the spans at once.
+static size_t size_class_batch(int size_class)
+{
+    return MAX(2, MIN(32, 64 * 1024 / size_class_size(size_class)));
+}
+
+static void span_list_push(Span *&head, Span *span)
+{
+    span->prev = nullptr;
+    span->next = head;
+
+    if (head)
+    {
+        head->prev = span;
+    }
+
+    head = span;
+}
+
+static void span_list_remove(Span *&head, Span *span)
+{
+    if (span->prev)
+    {
+        span->prev->next = span->next;
+    }
+    else
+    {
+        head = span->next;
+    }
+
+    if (span->next)
+    {
+        span->next->prev = span->prev;
+    }
+
+    span->prev = nullptr;
+    span->next = nullptr;
+}
+
+static void *span_address(Span *span)
+{
+    return (void *)(span->region->base + span->first_page * ALLOCATOR_PAGE_SIZE);
+}
+
+static Span *region_define_span(Region *region, size_t first_page, size_t page_count, int size_class)
+{
+    Span *span = &region->spans[first_page];
+
+    span->region = region;
+    span->first_page = first_page;
+    span->page_count = page_count;
+    span->size_class = size_class;
+    span->used = 0;
+    span->capacity = 0;
+    span->carved = 0;
+    span->free_list = nullptr;
+    span->prev = nullptr;
+    span->next = nullptr;
+
+    for (size_t page = first_page; page < first_page + page_count; page++)
+    {
+        region->owner[page] = first_page;
+    }
+
+    return span;
+}
+
+static void regions_begin_change()
+{
+    __atomic_store_n(&_regions_version, _regions_version + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void regions_end_change()
+{
+    __atomic_store_n(&_regions_version, _regions_version + 1, __ATOMIC_RELEASE);
+}
+
+static Region *region_create()
+{
+    if (_region_count == MAX_REGIONS)
+    {
+        return nullptr;
+    }
+
+    uintptr_t address = 0;
+
+    if (memory_alloc(REGION_SIZE, &address) != SUCCESS)
+    {
+        return nullptr;
+    }
+
+    Region *region = (Region *)address;
+    region->base = address;
+    region->used_pages = 0;
+
+    Span *span = region_define_span(region, REGION_HEADER_PAGES, REGION_PAGES - REGION_HEADER_PAGES, SPAN_FREE);
+    span_list_push(_free_spans, span);
+
+    // Kept sorted by address, for region_find().
+    regions_begin_change();
+
+    size_t index = _region_count;
+
+    while (index > 0 && _region_bases[index - 1] > address)
+    {
+        _regions[index] = _regions[index - 1];
+        __atomic_store_n(&_region_bases[index], _region_bases[index - 1], __ATOMIC_RELAXED);
+        index--;
+    }
+
+    _regions[index] = region;
+    __atomic_store_n(&_region_bases[index], address, __ATOMIC_RELAXED);
+    __atomic_store_n(&_region_count, _region_count + 1, __ATOMIC_RELAXED);
+
+    regions_end_change();
+
+    _idle_regions++;
+
+    statistics_add(&AllocatorStatistics::bytes_mapped, REGION_SIZE);
+
+    return region;
+}
+
+static void region_destroy(Region *region)
+{
+    assert(region->used_pages == 0);
+
+    span_list_remove(_free_spans, &region->spans[REGION_HEADER_PAGES]);
+
+    size_t index = 0;
+
+    while (_regions[index] != region)
+    {
+        index++;
+    }
+
+    regions_begin_change();
+
+    for (; index + 1 < _region_count; index++)
+    {
+        _regions[index] = _regions[index + 1];
+        __atomic_store_n(&_region_bases[index], _region_bases[index + 1], __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&_region_count, _region_count - 1, __ATOMIC_RELAXED);
+
+    regions_end_change();
+
+    _idle_regions--;
+
+    statistics_sub(&AllocatorStatistics::bytes_mapped, REGION_SIZE);
+
+    memory_free(region->base);
+}
+
+// Doesn't need _lock. A region with live allocations in it stays put, so
+// the answer for one of them holds once found.
+static Region *region_find(void *address)
+{
+    uintptr_t value = (uintptr_t)address;
+
+    while (true)
+    {
+        size_t version = __atomic_load_n(&_regions_version, __ATOMIC_ACQUIRE);
+
+        if (version % 2)
+        {
+            asm("pause");
+            continue;
+        }
+
+        size_t low = 0;
+        size_t high = __atomic_load_n(&_region_count, __ATOMIC_RELAXED);
+
+        while (low < high)
+        {
+            size_t middle = low + (high - low) / 2;
+
+            if (__atomic_load_n(&_region_bases[middle], __ATOMIC_RELAXED) <= value)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+
+        uintptr_t base = low ? __atomic_load_n(&_region_bases[low - 1], __ATOMIC_RELAXED) : 0;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&_regions_version, __ATOMIC_RELAXED) != version)
+        {
+            continue;
+        }
+
+        if (low == 0 || value >= base + REGION_SIZE)
+        {
+            return nullptr;
+        }
+
+        // Regions live in their first pages.
+        return (Region *)base;
+    }
+}
+
+static Span *span_find(Region *region, void *address)
+{
+    size_t page = ((uintptr_t)address - region->base) / ALLOCATOR_PAGE_SIZE;
+    assert(page >= REGION_HEADER_PAGES);
+
+    Span *span = &region->spans[region->owner[page]];
+    assert(span->size_class != SPAN_FREE);
+
+    return span;
+}
+
+static Span *pages_take(size_t page_count, int size_class)
+{
+    Span *found = nullptr;
+
+    for (Span *span = _free_spans; span; span = span->next)
+    {
+        if (span->page_count >= page_count)
+        {
+            found = span;
+            break;
+        }
+    }
+
+    if (!found)
+    {
+        Region *region = region_create();
+
+        if (!region)
+        {
+            return nullptr;
+        }
+
+        found = &region->spans[REGION_HEADER_PAGES];
+    }
+
+    span_list_remove(_free_spans, found);
+
+    Region *region = found->region;
+    size_t first_page = found->first_page;
+    size_t remaining = found->page_count - page_count;
+
+    if (remaining > 0)
+    {
+        Span *rest = region_define_span(region, first_page + page_count, remaining, SPAN_FREE);
+        span_list_push(_free_spans, rest);
+    }
+
+    if (region->used_pages == 0)
+    {
+        _idle_regions--;
+    }
+
+    region->used_pages += page_count;
+
+    return region_define_span(region, first_page, page_count, size_class);
+}
+
+static void pages_release(Span *span)
+{
+    Region *region = span->region;
+    size_t first_page = span->first_page;
+    size_t page_count = span->page_count;
+
+    region->used_pages -= page_count;
+
+    // Merged with the free spans on either side.
+    size_t next_page = first_page + page_count;
+
+    if (next_page < REGION_PAGES && region->spans[next_page].size_class == SPAN_FREE)
+    {
+        Span *next = &region->spans[next_page];
+        page_count += next->page_count;
+        span_list_remove(_free_spans, next);
+    }
+
+    if (first_page > REGION_HEADER_PAGES)
+    {
+        Span *prev = &region->spans[region->owner[first_page - 1]];
+
+        if (prev->size_class == SPAN_FREE)
+        {
+            span_list_remove(_free_spans, prev);
+            page_count += prev->page_count;
+            first_page = prev->first_page;
+        }
+    }
+
+    span_list_push(_free_spans, region_define_span(region, first_page, page_count, SPAN_FREE));
+
+    if (region->used_pages == 0)
+    {
+        _idle_regions++;
+
+        if (_idle_regions > KEPT_IDLE_REGIONS)
+        {
+            region_destroy(region);
+        }
+    }
+}
+
+static void *central_take(int size_class)
+{
+    Span *span = _partial_spans[size_class];
+
+    if (!span)
+    {
+        span = pages_take(size_class_pages(size_class), size_class);
+
+        if (!span)
+        {
+            return nullptr;
+        }
+
+        span->capacity = span->page_count * ALLOCATOR_PAGE_SIZE / size_class_size(size_class);
+        span_list_push(_partial_spans[size_class], span);
+    }
+
+    void *object = nullptr;
+
+    if (span->free_list)
+    {
+        object = span->free_list;
+        span->free_list = *(void **)object;
+    }
+    else
+    {
+        object = (char *)span_address(span) + span->carved * size_class_size(size_class);
+        span->carved++;
+    }
+
+    span->used++;
+
+    if (span->used == span->capacity)
+    {
+        span_list_remove(_partial_spans[size_class], span);
+    }
+
+    return object;
+}
+
+static void central_give(Span *span, void *object)
+{
+    int size_class = span->size_class;
+
+    if (span->used == span->capacity)
+    {
+        span_list_push(_partial_spans[size_class], span);
+    }
+
+    *(void **)object = span->free_list;
+    span->free_list = object;
+    span->used--;
+
+    if (span->used == 0)
+    {
+        span_list_remove(_partial_spans[size_class], span);
+        pages_release(span);
+    }
+}
+
+static void cache_push(ThreadCache &thread_cache, int size_class, void *object)
+{
+    auto &cache = thread_cache.caches[size_class];
+
+    *(void **)object = cache.head;
+    cache.head = object;
+    cache.count++;
+
+    statistics_add(&AllocatorStatistics::bytes_cached, size_class_size(size_class));
+}
+
+static void *cache_pop(ThreadCache &thread_cache, int size_class)
+{
+    auto &cache = thread_cache.caches[size_class];
+
+    void *object = cache.head;
+
+    if (object)
+    {
+        cache.head = *(void **)object;
+        cache.count--;
+
+        statistics_sub(&AllocatorStatistics::bytes_cached, size_class_size(size_class));
+    }
+
+    return object;
+}
+
+// Must be called with _lock held.
+static void cache_flush(ThreadCache &thread_cache, int size_class, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        void *object = cache_pop(thread_cache, size_class);
+
+        if (!object)
+        {
+            return;
+        }
+
+        central_give(span_find(region_find(object), object), object);
+    }
+}
+
+static void thread_cache_release(void *thread_cache)
+{
+    Utils::LockHolder holder{_lock};
+
+    for (int size_class = 0; size_class < SIZE_CLASS_COUNT; size_class++)
+    {
+        auto &cache = *(ThreadCache *)thread_cache;
+        cache_flush(cache, size_class, cache.caches[size_class].count);
+    }
+}
+
+static ThreadCache &thread_cache()
+{
+    auto &cache = _thread_cache;
+
+    // Registered first, in case the key allocates and comes back here.
+    if (!cache.registered)
+    {
+        cache.registered = true;
+
+        pthread_once(&_thread_cache_once, []() {
+            pthread_key_create(&_thread_cache_key, thread_cache_release);
+        });
+
+        pthread_setspecific(_thread_cache_key, &cache);
+    }
+
+    return cache;
+}
+
+static void *small_alloc(int size_class)
+{
+    auto &cache = thread_cache();
+    void *object = cache_pop(cache, size_class);
+
+    if (object)
+    {
+        return object;
+    }
+
+    // Take a whole batch while the span and the lock are at hand, and hand
+    // out the last.
+    Utils::LockHolder holder{_lock};
+
+    size_t batch = size_class_batch(size_class);
+
+    for (size_t i = 0; i + 1 < batch; i++)
+    {
+        void *spare = central_take(size_class);
+
+        if (!spare)
+        {
+            break;
+        }
+
+        cache_push(cache, size_class, spare);
+    }
+
+    object = central_take(size_class);
+
+    if (!object)
+    {
+        object = cache_pop(cache, size_class);
+    }
+
+    return object;
+}
+
+static void small_free(int size_class, void *object)
+{
+    auto &cache = thread_cache();
+    cache_push(cache, size_class, object);
+
+    size_t batch = size_class_batch(size_class);
+
+    if (cache.caches[size_class].count > batch * 2)
+    {
+        Utils::LockHolder holder{_lock};
+        cache_flush(cache, size_class, batch);
+    }
+}
+
+static void *huge_alloc(size_t size)
+{
+    if (size > (size_t)-1 - ALLOCATOR_PAGE_SIZE - sizeof(HugeHeader))
+    {
+        return nullptr;
+    }
+
+    size_t mapped = (size + sizeof(HugeHeader) + ALLOCATOR_PAGE_SIZE - 1) & ~(ALLOCATOR_PAGE_SIZE - 1);
+    uintptr_t address = 0;
+
+    if (memory_alloc(mapped, &address) != SUCCESS)
+    {
+        return nullptr;
+    }
+
+    auto *header = (HugeHeader *)address;
+    header->mapped = mapped;
+    header->usable = mapped - sizeof(HugeHeader);
+
+    statistics_add(&AllocatorStatistics::bytes_mapped, mapped);
+    statistics_add(&AllocatorStatistics::huge_blocks, 1);
+
+    return header + 1;
+}
+
+static HugeHeader *huge_header(void *address)
+{
+    return (HugeHeader *)address - 1;
+}
+
+static void huge_free(void *address)
+{
+    auto *header = huge_header(address);
+
+    statistics_sub(&AllocatorStatistics::bytes_mapped, header->mapped);
+    statistics_sub(&AllocatorStatistics::huge_blocks, 1);
+
+    memory_free((uintptr_t)header);
+}
+
+void *allocator_alloc(size_t size)
+{
+    void *address = nullptr;
+
+    if (size <= MAX_SMALL_SIZE)
+    {
+        address = small_alloc(size_class_of(size));
+    }
+    else if (size <= MAX_SPAN_SIZE)
+    {
+        Utils::LockHolder holder{_lock};
+        Span *span = pages_take((size + ALLOCATOR_PAGE_SIZE - 1) / ALLOCATOR_PAGE_SIZE, SPAN_LARGE);
+
+        if (span)
+        {
+            address = span_address(span);
+        }
+    }
+
+    // Past the last region, or too big for a span.
+    if (!address)
+    {
+        address = huge_alloc(size);
+    }
+
+    if (address)
+    {
+        statistics_add(&AllocatorStatistics::allocations, 1);
+        statistics_add(&AllocatorStatistics::bytes_in_use, allocator_usable_size(address));
+    }
+
+    return address;
+}
+
+void *allocator_calloc(size_t count, size_t size)
+{
+    size_t total = 0;
+
+    if (__builtin_mul_overflow(count, size, &total))
+    {
+        return nullptr;
+    }
+
+    void *address = allocator_alloc(total);
+
+    if (address)
+    {
+        memset(address, 0, total);
+    }
+
+    return address;
+}
+
+void *allocator_realloc(void *address, size_t size)
+{
+    if (!address)
+    {
+        return allocator_alloc(size);
+    }
+
+    if (size == 0)
+    {
+        allocator_free(address);
+        return nullptr;
+    }
+
+    size_t usable = allocator_usable_size(address);
+
+    // Stays where it is unless it would waste more than half of it.
+    if (size <= usable && size >= usable / 2)
+    {
+        return address;
+    }
+
+    void *moved = allocator_alloc(size);
+
+    if (!moved)
+    {
+        return nullptr;
+    }
+
+    memcpy(moved, address, MIN(size, usable));
+    allocator_free(address);
+
+    return moved;
+}
+
+void allocator_free(void *address)
+{
+    if (!address)
+    {
+        return;
+    }
+
+    statistics_add(&AllocatorStatistics::frees, 1);
+    statistics_sub(&AllocatorStatistics::bytes_in_use, allocator_usable_size(address));
+
+    Region *region = region_find(address);
+
+    if (!region)
+    {
+        huge_free(address);
+        return;
+    }
+
+    Span *span = span_find(region, address);
+
+    if (span->size_class == SPAN_LARGE)
+    {
+        Utils::LockHolder holder{_lock};
+        pages_release(span);
+    }
+    else
+    {
+        small_free(span->size_class, address);
+    }
+}
+
+size_t allocator_usable_size(void *address)
+{
+    if (!address)
+    {
+        return 0;
+    }
+
+    Region *region = region_find(address);
+
+    if (!region)
+    {
+        return huge_header(address)->usable;
+    }
+
+    Span *span = span_find(region, address);
+
+    if (span->size_class == SPAN_LARGE)
+    {
+        return span->page_count * ALLOCATOR_PAGE_SIZE;
+    }
+
+    return size_class_size(span->size_class);
+}
+
+void allocator_trim()
+{
+    auto &cache = thread_cache();
+    Utils::LockHolder holder{_lock};
+
+    for (int size_class = 0; size_class < SIZE_CLASS_COUNT; size_class++)
+    {
+        cache_flush(cache, size_class, cache.caches[size_class].count);
+    }
+
+    for (size_t i = _region_count; i > 0; i--)
+    {
+        Region *region = _regions[i - 1];
+
+        if (region->used_pages == 0)
+        {
+            region_destroy(region);
+        }
+    }
+}
+
+AllocatorStatistics allocator_statistics()
+{
+    AllocatorStatistics statistics = {};
+
+    statistics.allocations = __atomic_load_n(&_statistics.allocations, __ATOMIC_RELAXED);
+    statistics.frees = __atomic_load_n(&_statistics.frees, __ATOMIC_RELAXED);
+    statistics.bytes_in_use = __atomic_load_n(&_statistics.bytes_in_use, __ATOMIC_RELAXED);
+    statistics.bytes_cached = __atomic_load_n(&_statistics.bytes_cached, __ATOMIC_RELAXED);
+    statistics.bytes_mapped = __atomic_load_n(&_statistics.bytes_mapped, __ATOMIC_RELAXED);
+    statistics.huge_blocks = __atomic_load_n(&_statistics.huge_blocks, __ATOMIC_RELAXED);
+
+    Utils::LockHolder holder{_lock};
+
+    statistics.regions = _region_count;
+    statistics.idle_regions = _idle_regions;
+
+    return statistics;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <libutils/Prelude.h>
+
+// Every size is rounded up to its size class, so two allocations of the
+// same class are interchangeable.
+struct AllocatorStatistics
+{
+    size_t allocations;
+    size_t frees;
+
+    // What is held by live allocations, rounded up to their size class.
+    size_t bytes_in_use;
+
+    // Freed small objects kept aside, by every thread, for the next
+    // allocations of their class.
+    size_t bytes_cached;
+
+    // Everything taken from memory_alloc(), regions and huge blocks alike.
+    size_t bytes_mapped;
+
+    size_t regions;
+    size_t idle_regions;
+    size_t huge_blocks;
+};
+
+// Allocations are 16 bytes aligned and return nullptr once memory_alloc()
+// has nothing left to give.
+void *allocator_alloc(size_t size);
+
+void *allocator_calloc(size_t count, size_t size);
+
+void *allocator_realloc(void *address, size_t size);
+
+void allocator_free(void *address);
+
+size_t allocator_usable_size(void *address);
+
+// Gives back the calling thread's cached objects of every class and every
+// region nothing is allocated in anymore. Other threads' go back when they
+// exit.
+void allocator_trim();
+
+AllocatorStatistics allocator_statistics();
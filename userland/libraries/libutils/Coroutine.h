@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <libutils/Std.h>
+
+#if __CONFIG_IS_HOSTED__ == 0
+
+// What the compiler looks up to build coroutines, on top of its builtins.
+namespace std
+{
+
+template <typename Result, typename... Args>
+struct coroutine_traits
+{
+    using promise_type = typename Result::promise_type;
+};
+
+template <typename Promise = void>
+struct coroutine_handle;
+
+template <>
+struct coroutine_handle<void>
+{
+protected:
+    void *_address = nullptr;
+
+public:
+    constexpr coroutine_handle() {}
+
+    constexpr coroutine_handle(nullptr_t) {}
+
+    static constexpr coroutine_handle from_address(void *address)
+    {
+        coroutine_handle handle;
+        handle._address = address;
+        return handle;
+    }
+
+    constexpr void *address() const { return _address; }
+
+    constexpr explicit operator bool() const { return _address != nullptr; }
+
+    bool done() const { return __builtin_coro_done(_address); }
+
+    void operator()() const { resume(); }
+
+    void resume() const { __builtin_coro_resume(_address); }
+
+    void destroy() const { __builtin_coro_destroy(_address); }
+};
+
+template <typename Promise>
+struct coroutine_handle : public coroutine_handle<>
+{
+    constexpr coroutine_handle() {}
+
+    constexpr coroutine_handle(nullptr_t) {}
+
+    static constexpr coroutine_handle from_address(void *address)
+    {
+        coroutine_handle handle;
+        handle._address = address;
+        return handle;
+    }
+
+    static coroutine_handle from_promise(Promise &promise)
+    {
+        coroutine_handle handle;
+        handle._address = __builtin_coro_promise((char *)&promise, __alignof(Promise), true);
+        return handle;
+    }
+
+    Promise &promise() const
+    {
+        return *static_cast<Promise *>(__builtin_coro_promise(_address, __alignof(Promise), false));
+    }
+};
+
+struct suspend_always
+{
+    constexpr bool await_ready() const noexcept { return false; }
+    constexpr void await_suspend(coroutine_handle<>) const noexcept {}
+    constexpr void await_resume() const noexcept {}
+};
+
+struct suspend_never
+{
+    constexpr bool await_ready() const noexcept { return true; }
+    constexpr void await_suspend(coroutine_handle<>) const noexcept {}
+    constexpr void await_resume() const noexcept {}
+};
+
+} // namespace std
+
+#else
+#    include <coroutine>
+#endif
@@ -8,30 +8,33 @@
 
 // includes
 #include <assert.h>
-#include <libutils/OwnPtr.h>
 #include <libutils/Std.h>
 #include <libutils/Traits.h>
 
 namespace Utils
 {
 
-template <typename>
+// Callables that fit in inline_capacity bytes are kept inside the Func, the
+// others on the heap. Captures only have to be movable, a Func is never
+// copied.
+template <typename, size_t inline_capacity = 4 * sizeof(void *)>
 struct Func;
 
-template <typename Out, typename... In>
-struct Func<Out(In...)>
+template <typename Out, typename... In, size_t inline_capacity>
+struct Func<Out(In...), inline_capacity>
 {
 private:
     struct CallableWrapperBase
     {
         virtual ~CallableWrapperBase() {}
         virtual Out call(In...) const = 0;
+        virtual void move_to(void *destination) = 0;
     };
 
     template <typename TCallable>
     struct CallableWrapper final : public CallableWrapperBase
     {
-        TCallable callable;
+        mutable TCallable callable;
 
         NONCOPYABLE(CallableWrapper);
 
@@ -44,9 +47,75 @@ private:
         {
             return callable(std::forward<In>(in)...);
         }
+
+        void move_to(void *destination) final override
+        {
+            new (destination) CallableWrapper{std::move(callable)};
+        }
     };
 
-    OwnPtr<CallableWrapperBase> _wrapper;
+    enum struct Kind : uint8_t
+    {
+        EMPTY,
+        INLINE,
+        OUTLINE,
+    };
+
+    template <typename TCallable>
+    static constexpr bool fits_inline = sizeof(CallableWrapper<TCallable>) <= inline_capacity &&
+                                        alignof(CallableWrapper<TCallable>) <= alignof(max_align_t);
+
+    alignas(max_align_t) unsigned char _inline[inline_capacity];
+    CallableWrapperBase *_wrapper = nullptr;
+    Kind _kind = Kind::EMPTY;
+
+    template <typename TCallable>
+    void store(TCallable &&callable)
+    {
+        if constexpr (fits_inline<TCallable>)
+        {
+            _wrapper = new (_inline) CallableWrapper<TCallable>{std::move(callable)};
+            _kind = Kind::INLINE;
+        }
+        else
+        {
+            _wrapper = new CallableWrapper<TCallable>{std::move(callable)};
+            _kind = Kind::OUTLINE;
+        }
+    }
+
+    void take_from(Func &other)
+    {
+        if (other._kind == Kind::INLINE)
+        {
+            other._wrapper->move_to(_inline);
+            _wrapper = reinterpret_cast<CallableWrapperBase *>(_inline);
+            other._wrapper->~CallableWrapperBase();
+        }
+        else
+        {
+            _wrapper = other._wrapper;
+        }
+
+        _kind = other._kind;
+        other._wrapper = nullptr;
+        other._kind = Kind::EMPTY;
+    }
+
+    void clear()
+    {
+        if (_kind == Kind::INLINE)
+        {
+            _wrapper->~CallableWrapperBase();
+        }
+        else if (_kind == Kind::OUTLINE)
+        {
+            delete _wrapper;
+        }
+
+        _wrapper = nullptr;
+        _kind = Kind::EMPTY;
+    }
 
 public:
     Func() = default;
@@ -56,16 +125,29 @@ public:
         typename TCallable,
         typename = typename EnableIf<!(IsPointer<TCallable>::value && IsFunction<typename RemovePointer<TCallable>::Type>::value) && IsRvalueReference<TCallable &&>::value>::Type>
     Func(TCallable &&callable)
-        : _wrapper{own<CallableWrapper<TCallable>>(std::move(callable))}
     {
+        store(std::move(callable));
     }
 
     template <
         typename TFunction,
         typename = typename EnableIf<IsPointer<TFunction>::value && IsFunction<typename RemovePointer<TFunction>::Type>::value>::Type>
     Func(TFunction function)
-        : _wrapper{own<CallableWrapper<TFunction>>(std::move(function))}
     {
+        store(std::move(function));
+    }
+
+    Func(const Func &) = delete;
+    Func &operator=(const Func &) = delete;
+
+    Func(Func &&other)
+    {
+        take_from(other);
+    }
+
+    ~Func()
+    {
+        clear();
     }
 
     Out operator()(In... in) const
@@ -81,7 +163,8 @@ public:
         typename = typename EnableIf<!(IsPointer<TCallable>::value && IsFunction<typename RemovePointer<TCallable>::Type>::value) && IsRvalueReference<TCallable &&>::value>::Type>
     Func &operator=(TCallable &&callable)
     {
-        _wrapper = own<CallableWrapper<TCallable>>(std::move(callable));
+        clear();
+        store(std::move(callable));
         return *this;
     }
 
@@ -90,15 +173,61 @@ public:
         typename = typename EnableIf<IsPointer<TFunction>::value && IsFunction<typename RemovePointer<TFunction>::Type>::value>::Type>
     Func &operator=(TFunction function)
     {
-        _wrapper = own<CallableWrapper<TFunction>>(std::move(function));
+        clear();
+        store(std::move(function));
+        return *this;
+    }
+
+    Func &operator=(Func &&other)
+    {
+        if (this != &other)
+        {
+            clear();
+            take_from(other);
+        }
+
         return *this;
     }
 
     Func &operator=(nullptr_t)
     {
-        _wrapper = nullptr;
+        clear();
         return *this;
     }
 };
 
-}
\ No newline at end of file
+template <typename>
+struct FuncRef;
+
+// Calls a callable it doesn't own, for callbacks that are done with before
+// the function they were passed to returns. Nothing is allocated or moved,
+// so the callable has to outlive the FuncRef.
+template <typename Out, typename... In>
+struct FuncRef<Out(In...)>
+{
+private:
+    void *_callable = nullptr;
+    Out (*_thunk)(void *, In...) = nullptr;
+
+public:
+    template <
+        typename TCallable,
+        typename = typename EnableIf<!IsSame<typename RemoveConstVolatile<typename RemoveReference<TCallable>::Type>::Type, FuncRef>::value>::Type>
+    FuncRef(TCallable &&callable)
+        : _callable{(void *)&callable},
+          _thunk{[](void *callable, In... in) -> Out {
+              return (*reinterpret_cast<typename RemoveReference<TCallable>::Type *>(callable))(std::forward<In>(in)...);
+          }}
+    {
+    }
+
+    FuncRef(const FuncRef &) = default;
+    FuncRef &operator=(const FuncRef &) = default;
+
+    Out operator()(In... in) const
+    {
+        return _thunk(_callable, std::forward<In>(in)...);
+    }
+};
+
+}
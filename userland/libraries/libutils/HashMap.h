@@ -13,6 +13,12 @@
 namespace Utils
 {
 
+// Items are stored one after the other, in the order they were added
+// except where removals moved the last one into their place. They are
+// found through an open addressing table of their index plus one, 0 being
+// an empty slot, probed linearly. The table is kept at most three quarters
+// full and doubles when it would go past that, removals shift the rest of
+// a probe sequence back so no tombstones are left behind.
 template <typename TKey, typename TValue>
 struct HashMap
 {
@@ -24,142 +30,288 @@ private:
         TValue value;
     };
 
-    static constexpr int BUCKET_COUNT = 256;
+    static constexpr size_t MIN_CAPACITY = 16;
 
-    Vector<Vector<Item>> _buckets{};
+    Vector<Item> _items{};
+    Vector<uint32_t> _slots{};
 
-    Vector<Item> &bucket(uint32_t hash)
+    // Hashes like the one of uint32_t differ mostly in their high bits,
+    // mix them down before masking.
+    static uint32_t spread(uint32_t hash)
     {
-        return _buckets[hash % BUCKET_COUNT];
+        hash ^= hash >> 16;
+        hash *= 0x45d9f3b;
+        hash ^= hash >> 16;
+        return hash;
     }
 
-    Item *item_by_key(const TKey &key)
+    size_t mask() const
     {
-        return item_by_key(key, hash<TKey>(key));
+        return _slots.count() - 1;
+    }
+
+    size_t home_slot(uint32_t hash) const
+    {
+        return spread(hash) & mask();
     }
 
-    Item *item_by_key(const TKey &key, uint32_t hash)
+    // Slot indexing the item with that key, or the empty slot it would go in.
+    size_t find_slot(const TKey &key, uint32_t hash) const
     {
-        Item *result = nullptr;
-        auto &b = bucket(hash);
+        size_t slot = home_slot(hash);
+
+        while (_slots[slot] != 0)
+        {
+            const Item &item = _items[_slots[slot] - 1];
 
-        b.foreach([&](Item &item) {
             if (item.hash == hash && item.key == key)
             {
-                result = &item;
-                return Iteration::STOP;
+                return slot;
             }
-            else
+
+            slot = (slot + 1) & mask();
+        }
+
+        return slot;
+    }
+
+    void rehash(size_t capacity)
+    {
+        _slots.clear();
+        _slots.resize(capacity);
+
+        for (size_t i = 0; i < _items.count(); i++)
+        {
+            size_t slot = home_slot(_items[i].hash);
+
+            while (_slots[slot] != 0)
             {
-                return Iteration::CONTINUE;
+                slot = (slot + 1) & mask();
             }
-        });
 
-        return result;
+            _slots[slot] = i + 1;
+        }
     }
 
-public:
-    size_t count() const
+    void reserve_one()
     {
-        size_t result = 0;
+        size_t capacity = _slots.count();
 
-        for (size_t i = 0; i < BUCKET_COUNT; i++)
+        if (capacity == 0)
         {
-            result += _buckets[i].count();
+            rehash(MIN_CAPACITY);
         }
+        else if ((_items.count() + 1) * 4 > capacity * 3)
+        {
+            rehash(capacity * 2);
+        }
+    }
 
-        return result;
+    Item *item_by_key(const TKey &key) const
+    {
+        return item_by_key(key, hash<TKey>(key));
     }
 
-    HashMap()
+    Item *item_by_key(const TKey &key, uint32_t hash) const
     {
-        for (size_t i = 0; i < BUCKET_COUNT; i++)
+        if (_items.count() == 0)
         {
-            _buckets.push_back({});
+            return nullptr;
         }
+
+        size_t slot = find_slot(key, hash);
+
+        if (_slots[slot] == 0)
+        {
+            return nullptr;
+        }
+
+        return const_cast<Item *>(&_items[_slots[slot] - 1]);
+    }
+
+    void remove_slot(size_t slot)
+    {
+        size_t index = _slots[slot] - 1;
+        _slots[slot] = 0;
+
+        // Pull later items of the probe sequence back into the hole, unless
+        // that would take them before their home slot.
+        size_t hole = slot;
+        size_t next = (slot + 1) & mask();
+
+        while (_slots[next] != 0)
+        {
+            size_t home = home_slot(_items[_slots[next] - 1].hash);
+
+            if (((next - home) & mask()) >= ((next - hole) & mask()))
+            {
+                _slots[hole] = _slots[next];
+                _slots[next] = 0;
+                hole = next;
+            }
+
+            next = (next + 1) & mask();
+        }
+
+        // Keep the items contiguous by moving the last one in the freed place.
+        size_t last = _items.count() - 1;
+
+        if (index != last)
+        {
+            size_t last_slot = find_slot(_items[last].key, _items[last].hash);
+            _items[index] = std::move(_items[last]);
+            _slots[last_slot] = index + 1;
+        }
+
+        _items.pop_back();
+    }
+
+public:
+    size_t count() const
+    {
+        return _items.count();
+    }
+
+    HashMap()
+    {
     }
 
     HashMap(const HashMap &other)
-        : _buckets(other._buckets)
+        : _items(other._items),
+          _slots(other._slots)
     {
     }
 
     HashMap(HashMap &&other)
-        : _buckets(std::move(other._buckets))
+        : _items(std::move(other._items)),
+          _slots(std::move(other._slots))
     {
     }
 
     void clear()
     {
-        _buckets.clear();
+        _items.clear();
+        _slots.clear();
+    }
+
+    // Makes room for count items without rehashing on the way.
+    void ensure_capacity(size_t count)
+    {
+        size_t capacity = MAX(_slots.count(), MIN_CAPACITY);
+
+        while (count * 4 > capacity * 3)
+        {
+            capacity *= 2;
+        }
+
+        if (capacity != _slots.count())
+        {
+            rehash(capacity);
+        }
+
+        _items.ensure_capacity(count);
     }
 
-    void remove_key(TKey &key)
+    void remove_key(const TKey &key)
     {
-        uint32_t h = hash<TKey>(key);
+        if (_items.count() == 0)
+        {
+            return;
+        }
 
-        bucket(h).remove_all_match([&](auto &item) {
-            return item.hash == h && item.key == key;
-        });
+        size_t slot = find_slot(key, hash<TKey>(key));
+
+        if (_slots[slot] != 0)
+        {
+            remove_slot(slot);
+        }
     }
 
-    void remove_value(TValue &value)
+    void remove_value(const TValue &value)
     {
-        _buckets.foreach([&](auto &bucket) {
-            bucket.remove_all_match([&](auto &item) {
-                return item.value == value;
-            });
+        size_t i = 0;
 
-            return Iteration::CONTINUE;
-        });
+        while (i < _items.count())
+        {
+            if (_items[i].value == value)
+            {
+                // The last item takes its place, look at this index again.
+                remove_slot(find_slot(_items[i].key, _items[i].hash));
+            }
+            else
+            {
+                i++;
+            }
+        }
     }
 
-    bool has_key(const TKey &key)
+    bool has_key(const TKey &key) const
     {
         return item_by_key(key) != nullptr;
     }
 
-    bool has_value(const TValue &value)
+    bool has_value(const TValue &value) const
     {
-        bool result = false;
-
-        this->foreach([&](auto &, auto &v) {
-            if (v == value)
+        for (size_t i = 0; i < _items.count(); i++)
+        {
+            if (_items[i].value == value)
             {
-                result = true;
-                return Iteration::STOP;
+                return true;
             }
-            else
+        }
+
+        return false;
+    }
+
+    // Items must not be added or removed from the callback.
+    template <typename TCallback>
+    Iteration foreach(TCallback callback)
+    {
+        for (size_t i = 0; i < _items.count(); i++)
+        {
+            if (callback(_items[i].key, _items[i].value) == Iteration::STOP)
             {
-                return Iteration::CONTINUE;
+                return Iteration::STOP;
             }
-        });
+        }
 
-        return result;
+        return Iteration::CONTINUE;
     }
 
     template <typename TCallback>
     Iteration foreach(TCallback callback) const
     {
-        return _buckets.foreach([&](auto &bucket) {
-            return bucket.foreach([&](auto &item) {
-                return callback(item.key, item.value);
-            });
-        });
+        for (size_t i = 0; i < _items.count(); i++)
+        {
+            if (callback(_items[i].key, _items[i].value) == Iteration::STOP)
+            {
+                return Iteration::STOP;
+            }
+        }
+
+        return Iteration::CONTINUE;
     }
 
     HashMap &operator=(const HashMap &other)
     {
-        _buckets = other._buckets;
+        _items = other._items;
+        _slots = other._slots;
         return *this;
     }
 
     HashMap &operator=(HashMap &&other)
     {
-        std::swap(_buckets, other._buckets);
+        std::swap(_items, other._items);
+        std::swap(_slots, other._slots);
         return *this;
     }
 
+    TValue *lookup(const TKey &key)
+    {
+        auto *item = item_by_key(key);
+        return item ? &item->value : nullptr;
+    }
+
     TValue &operator[](const TKey &key)
     {
         auto h = hash<TKey>(key);
@@ -169,12 +321,14 @@ public:
         {
             return i->value;
         }
-        else
-        {
-            auto &b = bucket(h);
-            return b.push_back({h, key, {}}).value;
-        }
+
+        reserve_one();
+
+        size_t slot = find_slot(key, h);
+        _slots[slot] = _items.count() + 1;
+
+        return _items.push_back({h, key, {}}).value;
     }
 };
 
-} // namespace Utils
\ No newline at end of file
+} // namespace Utils
@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <libutils/Assert.h>
+#include <libutils/Iteration.h>
+#include <libutils/Prelude.h>
+
+namespace Utils
+{
+
+template <typename T>
+struct IntrusiveListStorage;
+
+template <typename T>
+struct IntrusiveListNode
+{
+private:
+    template <typename T_, IntrusiveListNode<T_> T_::*member>
+    friend struct IntrusiveList;
+
+    IntrusiveListStorage<T> *_storage = nullptr;
+    T *_prev = nullptr;
+    T *_next = nullptr;
+
+public:
+    IntrusiveListNode() {}
+
+    IntrusiveListNode(const IntrusiveListNode &) = delete;
+    IntrusiveListNode &operator=(const IntrusiveListNode &) = delete;
+
+    ~IntrusiveListNode()
+    {
+        Assert::falsity(is_in_list());
+    }
+
+    bool is_in_list() const { return _storage != nullptr; }
+};
+
+template <typename T>
+struct IntrusiveListStorage
+{
+    T *_head = nullptr;
+    T *_tail = nullptr;
+    size_t _count = 0;
+};
+
+// A list whose values carry their own link, so adding and removing them
+// never allocates. A value is in one list per node member at a time, and
+// the list doesn't own it: it has to be removed before it goes away.
+template <typename T, IntrusiveListNode<T> T::*member>
+struct IntrusiveList
+{
+private:
+    IntrusiveListStorage<T> _storage;
+
+    static IntrusiveListNode<T> &node_of(T &value) { return value.*member; }
+
+public:
+    IntrusiveList() {}
+
+    IntrusiveList(const IntrusiveList &) = delete;
+    IntrusiveList &operator=(const IntrusiveList &) = delete;
+
+    ~IntrusiveList()
+    {
+        clear();
+    }
+
+    bool empty() const { return _storage._count == 0; }
+
+    bool any() const { return _storage._count > 0; }
+
+    size_t count() const { return _storage._count; }
+
+    T *first() const { return _storage._head; }
+
+    T *last() const { return _storage._tail; }
+
+    static T *next(T &value) { return node_of(value)._next; }
+
+    static T *prev(T &value) { return node_of(value)._prev; }
+
+    // Takes every value out, without destroying any.
+    void clear()
+    {
+        while (_storage._head)
+        {
+            remove(*_storage._head);
+        }
+    }
+
+    void push(T &value)
+    {
+        auto &node = node_of(value);
+        Assert::falsity(node.is_in_list());
+
+        node._storage = &_storage;
+        node._prev = nullptr;
+        node._next = _storage._head;
+
+        if (_storage._head)
+        {
+            node_of(*_storage._head)._prev = &value;
+        }
+        else
+        {
+            _storage._tail = &value;
+        }
+
+        _storage._head = &value;
+        _storage._count++;
+    }
+
+    void push_back(T &value)
+    {
+        auto &node = node_of(value);
+        Assert::falsity(node.is_in_list());
+
+        node._storage = &_storage;
+        node._prev = _storage._tail;
+        node._next = nullptr;
+
+        if (_storage._tail)
+        {
+            node_of(*_storage._tail)._next = &value;
+        }
+        else
+        {
+            _storage._head = &value;
+        }
+
+        _storage._tail = &value;
+        _storage._count++;
+    }
+
+    void insert_before(T &before, T &value)
+    {
+        auto &before_node = node_of(before);
+        Assert::truth(before_node._storage == &_storage);
+
+        if (!before_node._prev)
+        {
+            push(value);
+            return;
+        }
+
+        auto &node = node_of(value);
+        Assert::falsity(node.is_in_list());
+
+        node._storage = &_storage;
+        node._prev = before_node._prev;
+        node._next = &before;
+
+        node_of(*before_node._prev)._next = &value;
+        before_node._prev = &value;
+        _storage._count++;
+    }
+
+    void remove(T &value)
+    {
+        auto &node = node_of(value);
+        Assert::truth(node._storage == &_storage);
+
+        if (node._prev)
+        {
+            node_of(*node._prev)._next = node._next;
+        }
+        else
+        {
+            _storage._head = node._next;
+        }
+
+        if (node._next)
+        {
+            node_of(*node._next)._prev = node._prev;
+        }
+        else
+        {
+            _storage._tail = node._prev;
+        }
+
+        node._storage = nullptr;
+        node._prev = nullptr;
+        node._next = nullptr;
+        _storage._count--;
+    }
+
+    bool contains(const T &value) const
+    {
+        return node_of(const_cast<T &>(value))._storage == &_storage;
+    }
+
+    T *take_first()
+    {
+        T *value = _storage._head;
+
+        if (value)
+        {
+            remove(*value);
+        }
+
+        return value;
+    }
+
+    T *take_last()
+    {
+        T *value = _storage._tail;
+
+        if (value)
+        {
+            remove(*value);
+        }
+
+        return value;
+    }
+
+    // The callback may remove the value it is given.
+    template <typename TCallback>
+    Iteration foreach(TCallback callback) const
+    {
+        T *current = _storage._head;
+
+        while (current)
+        {
+            T *next = node_of(*current)._next;
+
+            if (callback(*current) == Iteration::STOP)
+            {
+                return Iteration::STOP;
+            }
+
+            current = next;
+        }
+
+        return Iteration::CONTINUE;
+    }
+
+    template <typename TCallback>
+    Iteration foreach_reversed(TCallback callback) const
+    {
+        T *current = _storage._tail;
+
+        while (current)
+        {
+            T *prev = node_of(*current)._prev;
+
+            if (callback(*current) == Iteration::STOP)
+            {
+                return Iteration::STOP;
+            }
+
+            current = prev;
+        }
+
+        return Iteration::CONTINUE;
+    }
+
+    struct Iterator
+    {
+    private:
+        T *_value;
+
+    public:
+        Iterator(T *value) : _value{value}
+        {
+        }
+
+        Iterator operator++()
+        {
+            _value = IntrusiveList::next(*_value);
+            return *this;
+        }
+
+        bool operator!=(const Iterator &other) const
+        {
+            return _value != other._value;
+        }
+
+        T &operator*() const
+        {
+            return *_value;
+        }
+    };
+
+    Iterator begin() const { return _storage._head; }
+    Iterator end() const { return nullptr; }
+};
+
+} // namespace Utils
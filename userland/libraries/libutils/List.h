@@ -7,6 +7,7 @@
 #pragma once
 
 // includes
+#include <libmath/MinMax.h>
 #include <libutils/Assert.h>
 #include <libutils/Iteration.h>
 #include <libutils/Optional.h>
@@ -29,10 +30,86 @@ private:
         Node(const T &v) : value{v} {}
     };
 
+    // Nodes are carved out of slabs the list allocates for itself, and go
+    // back on its freelist once their value is removed. The slabs are only
+    // freed with the list, so a list that keeps changing stops allocating
+    // once it has had the most values it will have.
+    struct alignas(Node) Slab
+    {
+        Slab *next;
+
+        Node *nodes() { return reinterpret_cast<Node *>(this + 1); }
+    };
+
+    struct FreeNode
+    {
+        FreeNode *next;
+    };
+
+    static constexpr size_t FIRST_SLAB_CAPACITY = 4;
+    static constexpr size_t MAX_SLAB_CAPACITY = 64;
+
     size_t _count = 0;
     Node *_head = nullptr;
     Node *_tail = nullptr;
 
+    Slab *_slabs = nullptr;
+    FreeNode *_free_nodes = nullptr;
+    size_t _next_slab_capacity = FIRST_SLAB_CAPACITY;
+
+    void allocate_slab()
+    {
+        Slab *slab = reinterpret_cast<Slab *>(malloc(sizeof(Slab) + _next_slab_capacity * sizeof(Node)));
+        Assert::not_null(slab);
+
+        slab->next = _slabs;
+        _slabs = slab;
+
+        for (size_t i = _next_slab_capacity; i > 0; i--)
+        {
+            FreeNode *free_node = reinterpret_cast<FreeNode *>(&slab->nodes()[i - 1]);
+            free_node->next = _free_nodes;
+            _free_nodes = free_node;
+        }
+
+        _next_slab_capacity = MIN(_next_slab_capacity * 2, MAX_SLAB_CAPACITY);
+    }
+
+    Node *create_node(const T &value)
+    {
+        if (!_free_nodes)
+        {
+            allocate_slab();
+        }
+
+        FreeNode *free_node = _free_nodes;
+        _free_nodes = free_node->next;
+
+        return new (free_node) Node{value};
+    }
+
+    void destroy_node(Node *node)
+    {
+        node->~Node();
+
+        FreeNode *free_node = reinterpret_cast<FreeNode *>(node);
+        free_node->next = _free_nodes;
+        _free_nodes = free_node;
+    }
+
+    void free_slabs()
+    {
+        while (_slabs)
+        {
+            Slab *next = _slabs->next;
+            free(_slabs);
+            _slabs = next;
+        }
+
+        _free_nodes = nullptr;
+        _next_slab_capacity = FIRST_SLAB_CAPACITY;
+    }
+
 public:
     bool empty() const
     {
@@ -54,12 +131,14 @@ public:
     ~List()
     {
         clear();
+        free_slabs();
     }
 
     List(const List &other)
     {
         other.foreach([this](const T &el) {
             push_back(el);
+            return Iteration::CONTINUE;
         });
     }
 
@@ -73,6 +152,7 @@ public:
 
             other.foreach([this](const T &el) {
                 push_back(el);
+                return Iteration::CONTINUE;
             });
         }
 
@@ -86,6 +166,9 @@ public:
             std::swap(_count, other._count);
             std::swap(_head, other._head);
             std::swap(_tail, other._tail);
+            std::swap(_slabs, other._slabs);
+            std::swap(_free_nodes, other._free_nodes);
+            std::swap(_next_slab_capacity, other._next_slab_capacity);
         }
 
         return *this;
@@ -98,7 +181,7 @@ public:
         while (current)
         {
             Node *next = current->next;
-            delete current;
+            destroy_node(current);
             current = next;
         }
 
@@ -136,7 +219,7 @@ public:
                 }
 
                 _count--;
-                delete current;
+                destroy_node(current);
                 return;
             }
 
@@ -170,7 +253,7 @@ public:
 
     void push(const T &value)
     {
-        Node *node = new Node{value};
+        Node *node = create_node(value);
 
         if (_head == nullptr)
         {
@@ -188,7 +271,7 @@ public:
 
     void push_back(const T &value)
     {
-        Node *node = new Node{value};
+        Node *node = create_node(value);
 
         if (_tail == nullptr)
         {
@@ -224,7 +307,7 @@ public:
         _count--;
 
         T value = std::move(node->value);
-        delete node;
+        destroy_node(node);
         return value;
     }
 
@@ -248,7 +331,7 @@ public:
         _count--;
 
         T value = std::move(node->value);
-        delete node;
+        destroy_node(node);
         return value;
     }
 
@@ -319,6 +402,8 @@ public:
 
             current = next;
         }
+
+        return Iteration::CONTINUE;
     }
 
     struct Iterator
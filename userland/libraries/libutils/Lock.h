@@ -18,14 +18,72 @@
 namespace Utils
 {
 
+// Contention counters, summed over every lock with the same name.
+struct LockStatistics
+{
+    const char *name;
+    size_t acquisitions;
+    size_t contentions;
+    size_t parks;
+};
+
+static constexpr size_t LOCK_STATISTICS_SIZE = 64;
+
+inline LockStatistics __lock_statistics[LOCK_STATISTICS_SIZE] = {};
+
+inline LockStatistics *lock_statistics_for(const char *name)
+{
+    for (size_t i = 0; i < LOCK_STATISTICS_SIZE; i++)
+    {
+        auto &statistics = __lock_statistics[i];
+        const char *current = __atomic_load_n(&statistics.name, __ATOMIC_ACQUIRE);
+
+        if (current == nullptr)
+        {
+            const char *expected = nullptr;
+            if (__atomic_compare_exchange_n(&statistics.name, &expected, name, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                return &statistics;
+            }
+            current = expected;
+        }
+
+        if (current == name || __builtin_strcmp(current, name) == 0)
+        {
+            return &statistics;
+        }
+    }
+
+    // Out of slots, these locks go uncounted.
+    return nullptr;
+}
+
+template <typename Callback>
+inline void lock_statistics_iterate(Callback callback)
+{
+    for (auto &statistics : __lock_statistics)
+    {
+        if (__atomic_load_n(&statistics.name, __ATOMIC_ACQUIRE) != nullptr)
+        {
+            callback(statistics);
+        }
+    }
+}
+
 struct Lock
 {
 private:
     static constexpr auto NO_HOLDER = 0xDEADDEAD;
 
+    // A holder is usually done within a few hundred cycles, past that
+    // it has most likely been preempted and spinning only delays it.
+    static constexpr int SPIN_LIMIT = 1000;
+    static constexpr int YIELD_LIMIT = 16;
+
     bool _locked = false;
     int _holder = NO_HOLDER;
     const char *_name = "lock-not-initialized";
+    LockStatistics *_statistics = nullptr;
 
     SourceLocation _last_acquire_location{};
     SourceLocation _last_release_location{};
@@ -80,23 +138,63 @@ public:
         acquire_for(process_this(), location);
     }
 
-    void acquire_for(int holder, SourceLocation location = SourceLocation::current())
+    LockStatistics *statistics()
     {
-        while (!__sync_bool_compare_and_swap(&_locked, 0, 1))
+        auto *statistics = __atomic_load_n(&_statistics, __ATOMIC_RELAXED);
+        if (statistics == nullptr)
         {
+            statistics = lock_statistics_for(_name);
+            __atomic_store_n(&_statistics, statistics, __ATOMIC_RELAXED);
+        }
+        return statistics;
+    }
 
-#ifdef __KERNEL__
-            ASSERT_INTERRUPTS_NOT_RETAINED();
-#endif
+    void count(size_t LockStatistics::*counter)
+    {
+        if (auto *statistics = this->statistics())
+        {
+            __atomic_add_fetch(&(statistics->*counter), 1, __ATOMIC_RELAXED);
+        }
+    }
 
-            asm("pause");
+    void acquire_for(int holder, SourceLocation location = SourceLocation::current())
+    {
+        if (!__sync_bool_compare_and_swap(&_locked, 0, 1))
+        {
+            count(&LockStatistics::contentions);
+            acquire_slow();
         }
 
+        count(&LockStatistics::acquisitions);
+
         __sync_synchronize();
         _last_acquire_location = location;
         _holder = holder;
     }
 
+    // Spin for a short while, then park: give up the CPU, and once
+    // yielding doesn't help either, sleep a tick at a time.
+    void acquire_slow()
+    {
+        for (int attempt = 0; !__sync_bool_compare_and_swap(&_locked, 0, 1); attempt++)
+        {
+
+#ifdef __KERNEL__
+            ASSERT_INTERRUPTS_NOT_RETAINED();
+            asm("pause");
+#else
+            if (attempt < SPIN_LIMIT || locked() == false)
+            {
+                asm("pause");
+                continue;
+            }
+
+            count(&LockStatistics::parks);
+            j_process_sleep(attempt < SPIN_LIMIT + YIELD_LIMIT ? 0 : 1);
+#endif
+        }
+    }
+
     bool try_acquire(SourceLocation location = SourceLocation::current())
     {
         return try_acquire_for(process_this(), location);
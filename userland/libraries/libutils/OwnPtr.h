@@ -162,4 +162,9 @@ inline OwnPtr<Type> own(Args &&...args)
     return OwnPtr<Type>(new Type(std::forward<Args>(args)...));
 }
 
+template <typename T>
+struct IsTriviallyRelocatable<OwnPtr<T>> : public TrueType
+{
+};
+
 }
\ No newline at end of file
@@ -217,4 +217,9 @@ struct IsRefPtr<RefPtr<T>> : public TrueType
 {
 };
 
+template <typename T>
+struct IsTriviallyRelocatable<RefPtr<T>> : public TrueType
+{
+};
+
 }
\ No newline at end of file
@@ -7,11 +7,13 @@
 #pragma once
 
 // includes
+#include <string.h>
 #include <libutils/Hash.h>
 #include <libutils/RefPtr.h>
 #include <libutils/Slice.h>
 #include <libutils/Std.h>
 #include <libutils/StringStorage.h>
+#include <libutils/StringView.h>
 
 namespace Utils
 {
@@ -20,12 +22,99 @@ struct String :
     public RawStorage
 {
 private:
-    RefPtr<StringStorage> _storage;
+    // Strings up to this long are kept inside the String, longer ones in a
+    // StringStorage that copies share. Nothing ever changes the characters
+    // of either, so sharing needs no copy on write.
+    static constexpr size_t INLINE_CAPACITY = 22;
+    static constexpr uint8_t ON_HEAP = 0xff;
+
+    union
+    {
+        StringStorage *_heap;
+        char _inline[INLINE_CAPACITY + 1];
+    };
+
+    uint8_t _inline_length = 0;
+
+    bool is_inline() const { return _inline_length != ON_HEAP; }
+
+    void assign(const char *cstring, size_t length)
+    {
+        if (length <= INLINE_CAPACITY)
+        {
+            memcpy(_inline, cstring, length);
+            _inline[length] = '\0';
+            _inline_length = length;
+        }
+        else
+        {
+            _heap = new StringStorage(COPY, cstring, length);
+            _inline_length = ON_HEAP;
+        }
+    }
+
+    void assign(const String &other)
+    {
+        if (other.is_inline())
+        {
+            memcpy(_inline, other._inline, other._inline_length + 1);
+        }
+        else
+        {
+            _heap = ref_if_not_null(other._heap);
+        }
+
+        _inline_length = other._inline_length;
+    }
+
+    void take(String &other)
+    {
+        if (other.is_inline())
+        {
+            memcpy(_inline, other._inline, other._inline_length + 1);
+        }
+        else
+        {
+            _heap = other._heap;
+        }
+
+        _inline_length = other._inline_length;
+
+        other._inline[0] = '\0';
+        other._inline_length = 0;
+    }
+
+    void release()
+    {
+        if (!is_inline())
+        {
+            _heap->deref();
+        }
+
+        _inline[0] = '\0';
+        _inline_length = 0;
+    }
+
+    // Slices and storage outlive the String they came from, so an inline
+    // string moves to a StringStorage the first time one is asked for.
+    StringStorage &shared_storage() const
+    {
+        if (is_inline())
+        {
+            auto self = const_cast<String *>(this);
+            auto storage = new StringStorage(COPY, _inline, _inline_length);
+
+            self->_heap = storage;
+            self->_inline_length = ON_HEAP;
+        }
+
+        return *_heap;
+    }
 
 public:
     size_t length() const
     {
-        return _storage->size();
+        return is_inline() ? _inline_length : _heap->size();
     }
 
     bool empty() const
@@ -35,27 +124,32 @@ public:
 
     const char *cstring() const
     {
-        if (!_storage)
-        {
-            return "";
-        }
+        return is_inline() ? _inline : _heap->cstring();
+    }
 
-        return _storage->cstring();
+    StringView view() const
+    {
+        return {cstring(), length()};
+    }
+
+    operator StringView() const
+    {
+        return view();
     }
 
     const char &at(int index) const
     {
-        return _storage->cstring()[index];
+        return cstring()[index];
     }
 
     bool null_or_empty() const
     {
-        return _storage == nullptr || _storage->size() == 0;
+        return empty();
     }
 
     Slice slice() const
     {
-        return Slice{_storage};
+        return Slice{RefPtr<Storage>{shared_storage()}};
     }
 
     Slice slice(size_t start, size_t length) const
@@ -63,46 +157,61 @@ public:
         assert(start < this->length());
         assert(start + length <= this->length());
 
-        return Slice{_storage, start, length};
+        return Slice{RefPtr<Storage>{shared_storage()}, start, length};
     }
 
     String(const char *cstring = "")
     {
-        _storage = make<StringStorage>(COPY, cstring);
+        assign(cstring, strlen(cstring));
     }
 
     String(const char *cstring, size_t length)
     {
-        _storage = make<StringStorage>(COPY, cstring, length);
+        assign(cstring, strnlen(cstring, length));
+    }
+
+    String(StringView view)
+    {
+        assign(view.chars(), strnlen(view.chars(), view.length()));
     }
 
     String(char c)
     {
-        char cstr[2];
-        cstr[0] = c;
-        _storage = make<StringStorage>(COPY, cstr, 1);
+        assign(&c, 1);
     }
 
     String(RefPtr<StringStorage> storage)
-        : _storage(storage)
     {
+        _inline[0] = '\0';
+
+        if (storage)
+        {
+            _heap = storage.give_ref();
+            _inline_length = ON_HEAP;
+        }
     }
 
     String(const String &other)
-        : _storage(const_cast<String &>(other)._storage)
     {
+        assign(other);
     }
 
     String(String &&other)
-        : _storage(std::move(other._storage))
     {
+        take(other);
+    }
+
+    ~String()
+    {
+        release();
     }
 
     String &operator=(const String &other)
     {
         if (this != &other)
         {
-            _storage = const_cast<String &>(other)._storage;
+            release();
+            assign(other);
         }
 
         return *this;
@@ -112,7 +221,8 @@ public:
     {
         if (this != &other)
         {
-            std::swap(_storage, other._storage);
+            release();
+            take(other);
         }
 
         return *this;
@@ -125,43 +235,22 @@ public:
 
     bool operator==(const String &other) const
     {
-        if (_storage == other._storage)
+        if (!is_inline() && !other.is_inline() && _heap == other._heap)
         {
             return true;
         }
 
-        if (length() != other.length())
-        {
-            return false;
-        }
-
-        for (size_t i = 0; i < length(); i++)
-        {
-            if (cstring()[i] != other.cstring()[i])
-            {
-                return false;
-            }
-        }
+        return view() == other.view();
+    }
 
-        return true;
+    bool operator==(StringView other) const
+    {
+        return view() == other;
     }
 
     bool operator==(const char *str) const
     {
-        if (length() != strlen(str))
-        {
-            return false;
-        }
-
-        for (size_t i = 0; i < length(); i++)
-        {
-            if (cstring()[i] != str[i])
-            {
-                return false;
-            }
-        }
-
-        return true;
+        return view() == StringView{str};
     }
 
     char operator[](int index) const
@@ -171,12 +260,12 @@ public:
 
     RefPtr<Storage> storage() override
     {
-        return _storage;
+        return shared_storage();
     }
 
     RefPtr<StringStorage> string_storage()
     {
-        return _storage;
+        return shared_storage();
     }
 };
 
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <assert.h>
+#include <string.h>
+#include <libutils/Prelude.h>
+
+namespace Utils
+{
+
+// Characters that somebody else owns, for functions that only look at a
+// string and would otherwise need a String made for the call. It is not
+// null terminated in general.
+struct StringView
+{
+private:
+    const char *_chars = "";
+    size_t _length = 0;
+
+public:
+    constexpr StringView() {}
+
+    StringView(const char *cstring)
+        : _chars(cstring), _length(strlen(cstring))
+    {
+    }
+
+    constexpr StringView(const char *chars, size_t length)
+        : _chars(chars), _length(length)
+    {
+    }
+
+    const char *chars() const { return _chars; }
+
+    size_t length() const { return _length; }
+
+    bool empty() const { return _length == 0; }
+
+    char operator[](size_t index) const
+    {
+        assert(index < _length);
+        return _chars[index];
+    }
+
+    StringView substring(size_t start, size_t length) const
+    {
+        assert(start <= _length);
+        assert(start + length <= _length);
+
+        return {_chars + start, length};
+    }
+
+    bool starts_with(StringView prefix) const
+    {
+        return prefix._length <= _length && memcmp(_chars, prefix._chars, prefix._length) == 0;
+    }
+
+    bool operator==(StringView other) const
+    {
+        return _length == other._length && memcmp(_chars, other._chars, _length) == 0;
+    }
+
+    bool operator!=(StringView other) const
+    {
+        return !(*this == other);
+    }
+};
+
+} // namespace Utils
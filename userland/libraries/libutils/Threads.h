@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <pthread.h>
+#include <unistd.h>
+#include <libutils/Prelude.h>
+
+// Userland threads are POSIX threads from libpthread, and thread_local
+// works for userland code as it does in base. Work that is split over
+// several threads goes through run_on_threads().
+
+namespace Utils
+{
+
+static constexpr size_t MAX_WORKER_THREADS = 64;
+
+inline size_t processor_count()
+{
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    return processors > 0 ? processors : 1;
+}
+
+template <typename Worker>
+void *__run_worker(void *worker)
+{
+    (*static_cast<Worker *>(worker))();
+    return nullptr;
+}
+
+// Calls worker() on thread_count threads at once, the calling thread
+// being one of them, and returns once all of them returned. Workers take
+// their share from state they have in common, so when a thread can't be
+// created the others simply get more. A thread count of 0 is one per
+// processor.
+template <typename Worker>
+void run_on_threads(size_t thread_count, Worker worker)
+{
+    if (thread_count == 0)
+    {
+        thread_count = processor_count();
+    }
+
+    thread_count = thread_count < MAX_WORKER_THREADS ? thread_count : MAX_WORKER_THREADS;
+
+    pthread_t threads[MAX_WORKER_THREADS];
+    size_t started = 0;
+
+    for (size_t i = 1; i < thread_count; i++)
+    {
+        if (pthread_create(&threads[started], nullptr, __run_worker<Worker>, &worker) != 0)
+        {
+            break;
+        }
+
+        started++;
+    }
+
+    worker();
+
+    for (size_t i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], nullptr);
+    }
+}
+
+}
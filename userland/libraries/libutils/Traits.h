@@ -562,4 +562,18 @@ struct Max<arg1, arg2, others...>
     static constexpr size_t value = arg1 >= arg2 ? Max<arg1, others...>::value : Max<arg2, others...>::value;
 };
 
+template <typename T>
+struct IsTriviallyCopyable : public Constant<bool, __is_trivially_copyable(T)>
+{
+};
+
+// Whether a value can be moved by copying its bytes somewhere else and
+// forgetting about the original, without its move constructor or
+// destructor running. Types that only hold pointers to outside of
+// themselves can say so even when they aren't trivially copyable.
+template <typename T>
+struct IsTriviallyRelocatable : public IsTriviallyCopyable<T>
+{
+};
+
 }
\ No newline at end of file
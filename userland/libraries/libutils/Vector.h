@@ -17,8 +17,18 @@ namespace Utils
 {
 
 template <typename T>
-void typed_copy(T *destination, T *source, size_t count)
+void typed_copy(T *destination, const T *source, size_t count)
 {
+    if constexpr (IsTriviallyCopyable<T>::value)
+    {
+        if (count)
+        {
+            memcpy(destination, source, count * sizeof(T));
+        }
+
+        return;
+    }
+
     for (size_t i = 0; i < count; i++)
     {
         new (&destination[i]) T(source[i]);
@@ -28,6 +38,16 @@ void typed_copy(T *destination, T *source, size_t count)
 template <typename T>
 void typed_move(T *destination, T *source, size_t count)
 {
+    if constexpr (IsTriviallyCopyable<T>::value)
+    {
+        if (count)
+        {
+            memmove(destination, source, count * sizeof(T));
+        }
+
+        return;
+    }
+
     for (size_t i = 0; i < count; i++)
     {
         if (destination <= source)
@@ -41,13 +61,222 @@ void typed_move(T *destination, T *source, size_t count)
     }
 }
 
+// Moves count values to storage where none live yet and ends the lifetime
+// of the originals. The two ranges may overlap.
 template <typename T>
+void typed_relocate(T *destination, T *source, size_t count)
+{
+    if (destination == source || count == 0)
+    {
+        return;
+    }
+
+    if constexpr (IsTriviallyRelocatable<T>::value)
+    {
+        memmove((void *)destination, (const void *)source, count * sizeof(T));
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t index = destination < source ? i : count - i - 1;
+        new (&destination[index]) T(std::move(source[index]));
+        source[index].~T();
+    }
+}
+
+template <typename T, size_t capacity>
+struct VectorInlineStorage
+{
+    alignas(T) unsigned char _data[capacity * sizeof(T)];
+
+    T *get() { return reinterpret_cast<T *>(_data); }
+    const T *get() const { return reinterpret_cast<const T *>(_data); }
+};
+
+template <typename T>
+struct VectorInlineStorage<T, 0>
+{
+    T *get() { return nullptr; }
+    const T *get() const { return nullptr; }
+};
+
+// The first inline_capacity values live inside the vector itself, it only
+// goes to the heap once there are more of them.
+template <typename T, size_t inline_capacity = 0>
 struct Vector
 {
 private:
-    T *_storage = nullptr;
+    [[no_unique_address]] VectorInlineStorage<T, inline_capacity> _inline;
+    T *_storage = _inline.get();
     size_t _count = 0;
-    size_t _capacity = 0;
+    size_t _capacity = inline_capacity;
+
+    bool is_inline() const { return inline_capacity > 0 && _storage == _inline.get(); }
+
+    bool is_on_heap() const { return _storage && !is_inline(); }
+
+    // Moves the values to storage for exactly new_capacity of them, back
+    // inside the vector if they fit.
+    void reallocate(size_t new_capacity)
+    {
+        assert(new_capacity >= _count);
+
+        if (new_capacity <= inline_capacity)
+        {
+            if (is_inline())
+            {
+                return;
+            }
+
+            T *heap_storage = _storage;
+            _storage = _inline.get();
+            typed_relocate(_storage, heap_storage, _count);
+            free(heap_storage);
+            _capacity = inline_capacity;
+
+            return;
+        }
+
+        T *new_storage = nullptr;
+
+        // realloc() can often grow the block where it is, and copies it
+        // in one go otherwise.
+        if constexpr (IsTriviallyRelocatable<T>::value)
+        {
+            if (is_on_heap())
+            {
+                new_storage = reinterpret_cast<T *>(realloc((void *)_storage, new_capacity * sizeof(T)));
+                assert(new_storage);
+
+                _storage = new_storage;
+                _capacity = new_capacity;
+                return;
+            }
+        }
+
+        new_storage = reinterpret_cast<T *>(malloc(new_capacity * sizeof(T)));
+        assert(new_storage);
+
+        typed_relocate(new_storage, _storage, _count);
+
+        if (is_on_heap())
+        {
+            free(_storage);
+        }
+
+        _storage = new_storage;
+        _capacity = new_capacity;
+    }
+
+    // Leaves other empty, with just its inline storage.
+    void take_storage_from(Vector &other)
+    {
+        if (other.is_on_heap())
+        {
+            _storage = other._storage;
+            _capacity = other._capacity;
+            _count = other._count;
+        }
+        else
+        {
+            typed_relocate(_storage, other._storage, other._count);
+            _count = other._count;
+        }
+
+        other._storage = other._inline.get();
+        other._capacity = inline_capacity;
+        other._count = 0;
+    }
+
+    void release_storage()
+    {
+        clear();
+
+        if (is_on_heap())
+        {
+            free(_storage);
+        }
+
+        _storage = _inline.get();
+        _capacity = inline_capacity;
+    }
+
+    // Comparators only have to tell when their left side goes after their
+    // right side, so everything here is asked that way.
+    template <typename Comparator>
+    void sort_range(Comparator &comparator, size_t start, size_t end)
+    {
+        while (end - start > 16)
+        {
+            // The median of three as the pivot, with the largest of them left
+            // at the end, where it stops the scan from the left.
+            size_t middle = start + (end - start) / 2;
+
+            if (comparator(_storage[start], _storage[middle]) > 0)
+            {
+                std::swap(_storage[start], _storage[middle]);
+            }
+
+            if (comparator(_storage[middle], _storage[end - 1]) > 0)
+            {
+                std::swap(_storage[middle], _storage[end - 1]);
+            }
+
+            if (comparator(_storage[start], _storage[middle]) > 0)
+            {
+                std::swap(_storage[start], _storage[middle]);
+            }
+
+            std::swap(_storage[start], _storage[middle]);
+
+            T &pivot = _storage[start];
+            size_t left = start;
+            size_t right = end;
+
+            while (true)
+            {
+                do
+                {
+                    left++;
+                } while (comparator(pivot, _storage[left]) > 0);
+
+                do
+                {
+                    right--;
+                } while (comparator(_storage[right], pivot) > 0);
+
+                if (left >= right)
+                {
+                    break;
+                }
+
+                std::swap(_storage[left], _storage[right]);
+            }
+
+            std::swap(_storage[start], _storage[right]);
+
+            // Recursing into the smaller side keeps the stack shallow.
+            if (right - start < end - right)
+            {
+                sort_range(comparator, start, right);
+                start = right + 1;
+            }
+            else
+            {
+                sort_range(comparator, right + 1, end);
+                end = right;
+            }
+        }
+
+        for (size_t i = start + 1; i < end; i++)
+        {
+            for (size_t j = i; j > start && comparator(_storage[j - 1], _storage[j]) > 0; j--)
+            {
+                std::swap(_storage[j - 1], _storage[j]);
+            }
+        }
+    }
 
 public:
     size_t count() const { return _count; }
@@ -59,6 +288,8 @@ public:
     constexpr T *raw_storage() { return _storage; }
     constexpr const T *raw_storage() const { return _storage; }
 
+    size_t capacity() const { return _capacity; }
+
     T &at(size_t index)
     {
         assert(index < _count);
@@ -71,16 +302,16 @@ public:
         return _storage[index];
     }
 
-    Vector() : Vector(16) {}
+    Vector() {}
 
     Vector(size_t capacity)
     {
-        ensure_capacity(capacity);
+        reserve(capacity);
     }
 
     Vector(std::initializer_list<T> data)
     {
-        ensure_capacity(data.size());
+        reserve(data.size());
 
         for (const auto &el : data)
         {
@@ -97,25 +328,20 @@ public:
 
     Vector(const Vector &other)
     {
-        ensure_capacity(other.count());
+        reserve(other.count());
 
+        typed_copy(_storage, other._storage, other.count());
         _count = other.count();
-        typed_copy(_storage, other._storage, _count);
     }
 
     Vector(Vector &&other)
     {
-        std::swap(_storage, other._storage);
-        std::swap(_count, other._count);
-        std::swap(_capacity, other._capacity);
+        take_storage_from(other);
     }
 
     ~Vector()
     {
-        clear();
-
-        if (_storage)
-            free(_storage);
+        release_storage();
     }
 
     Vector &operator=(const Vector &other)
@@ -124,9 +350,9 @@ public:
         {
             clear();
 
-            ensure_capacity(other.count());
+            reserve(other.count());
+            typed_copy(_storage, other._storage, other.count());
             _count = other.count();
-            typed_copy(_storage, other._storage, _count);
         }
 
         return *this;
@@ -136,9 +362,8 @@ public:
     {
         if (this != &other)
         {
-            std::swap(_storage, other._storage);
-            std::swap(_count, other._count);
-            std::swap(_capacity, other._capacity);
+            release_storage();
+            take_storage_from(other);
         }
 
         return *this;
@@ -188,11 +413,6 @@ public:
 
     void clear()
     {
-        if (!_storage)
-        {
-            return;
-        }
-
         for (size_t i = 0; i < _count; i++)
         {
             _storage[i].~T();
@@ -232,21 +452,12 @@ public:
     template <typename Comparator>
     void sort(Comparator comparator)
     {
-        for (size_t i = 0; i + 1 < _count; i++)
-        {
-            for (size_t j = i + 1; j < _count; j++)
-            {
-                if (comparator(_storage[i], _storage[j]) > 0)
-                {
-                    std::swap(_storage[i], _storage[j]);
-                }
-            }
-        }
+        sort_range(comparator, 0, _count);
     }
 
     void resize(size_t new_count)
     {
-        ensure_capacity(new_count);
+        reserve(new_count);
 
         if (_count < new_count)
         {
@@ -266,87 +477,46 @@ public:
         _count = new_count;
     }
 
-    void ensure_capacity(size_t capacity)
+    // Makes room for capacity values in all, without growing any further.
+    void reserve(size_t capacity)
     {
-        capacity = MAX(capacity, 16);
-
-        if (!_storage)
-        {
-            _storage = reinterpret_cast<T *>(calloc(capacity, sizeof(T)));
-            _capacity = capacity;
-            _count = 0;
-
-            return;
-        }
-
-        capacity = MAX(_count, capacity);
-
         if (capacity <= _capacity)
         {
             return;
         }
 
-        size_t new_capacity = _capacity;
-
-        while (new_capacity <= capacity)
-        {
-            new_capacity += new_capacity / 4;
-        }
+        reallocate(capacity);
+    }
 
-        T *new_storage = reinterpret_cast<T *>(calloc(new_capacity, sizeof(T)));
+    void ensure_capacity(size_t capacity)
+    {
+        reserve(capacity);
+    }
 
-        for (size_t i = 0; i < _count; i++)
+    // Gives back the room past the last value, going back inside the
+    // vector if they fit. Removing values never does that on its own.
+    void shrink_to_fit()
+    {
+        if (_count == _capacity)
         {
-            new (&new_storage[i]) T(std::move(_storage[i]));
+            return;
         }
 
-        free(_storage);
-        _storage = new_storage;
-        _capacity = new_capacity;
+        reallocate(_count);
     }
 
+    // Adds room for one more value at the end, doubling the capacity when
+    // there is none left, and counts it. Constructing it is up to the caller.
     void grow()
     {
-        if (_count + 1 >= _capacity)
+        if (_count == _capacity)
         {
-            size_t new_capacity = _capacity + _capacity / 4;
-            T *new_storage = reinterpret_cast<T *>(calloc(new_capacity, sizeof(T)));
-
-            for (size_t i = 0; i < _count; i++)
-            {
-                new (&new_storage[i]) T(std::move(_storage[i]));
-            }
-
-            free(_storage);
-            _storage = new_storage;
-            _capacity = new_capacity;
+            reallocate(MAX(MAX(_capacity * 2, _count + 1), 4));
         }
 
         _count++;
     }
 
-    void shrink()
-    {
-        _count--;
-
-        size_t new_capacity = _capacity - _capacity / 4;
-
-        if (MAX(_count, 16) < new_capacity)
-        {
-            T *new_storage = reinterpret_cast<T *>(calloc(new_capacity, sizeof(T)));
-
-            for (size_t i = 0; i < _count; i++)
-            {
-                new (&new_storage[i]) T(std::move(_storage[i]));
-                _storage[i].~T();
-            }
-
-            free(_storage);
-            _storage = new_storage;
-            _capacity = new_capacity;
-        }
-    }
-
     T &insert(size_t index, const T &value)
     {
         return insert(index, T(value));
@@ -358,11 +528,7 @@ public:
 
         grow();
 
-        for (size_t j = _count - 1; j > index; j--)
-        {
-            new (&_storage[j]) T(std::move(_storage[j - 1]));
-            at(j - 1).~T();
-        }
+        typed_relocate(&_storage[index + 1], &_storage[index], _count - 1 - index);
 
         new (&_storage[index]) T(std::move(value));
 
@@ -414,13 +580,9 @@ public:
 
         _storage[index].~T();
 
-        for (size_t i = index; i < _count - 1; ++i)
-        {
-            new (&_storage[i]) T(std::move(_storage[i + 1]));
-            _storage[i + 1].~T();
-        }
+        typed_relocate(&_storage[index], &_storage[index + 1], _count - index - 1);
 
-        shrink();
+        _count--;
     }
 
     void remove_value(const T &value)
@@ -487,11 +649,7 @@ public:
     {
         grow();
 
-        for (size_t j = _count - 1; j > 0; j--)
-        {
-            new (&_storage[j]) T(std::move(_storage[j - 1]));
-            at(j - 1).~T();
-        }
+        typed_relocate(&_storage[1], &_storage[0], _count - 1);
 
         new (&_storage[0]) T(std::forward<Args>(args)...);
         return _storage[0];
@@ -516,20 +674,21 @@ public:
         return _storage[_count - 1];
     }
 
-    void push_back_many(const Vector<T> &values)
+    template <size_t other_inline_capacity>
+    void push_back_many(const Vector<T, other_inline_capacity> &values)
     {
-        for (size_t i = 0; i < values.count(); i++)
-        {
-            push_back(values[i]);
-        }
+        push_back_many(values.raw_storage(), values.count());
     }
 
     void push_back_many(const T *data, size_t size)
     {
-        for (size_t i = 0; i < size; i++)
+        if (_count + size > _capacity)
         {
-            push_back(data[i]);
+            reallocate(MAX(_capacity * 2, _count + size));
         }
+
+        typed_copy(&_storage[_count], data, size);
+        _count += size;
     }
 
     T pop()
@@ -586,16 +745,16 @@ struct IsVector : public FalseType
 {
 };
 
-template <typename T>
-struct IsVector<Vector<T>> : public TrueType
+template <typename T, size_t inline_capacity>
+struct IsVector<Vector<T, inline_capacity>> : public TrueType
 {
 };
 
 template <typename T>
 struct TrimVector;
 
-template <typename T>
-struct TrimVector<Vector<T>>
+template <typename T, size_t inline_capacity>
+struct TrimVector<Vector<T, inline_capacity>>
 {
     typedef T type;
 };
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <libcompression/Deflate.h>
+#include <libcompression/Inflate.h>
+
+#include "tests/Driver.h"
+#include "tests/libcompression/TestData.h"
+
+static bool round_trip(unsigned int level, const Vector<uint8_t> &data)
+{
+    Compression::Deflate deflate{level};
+    Compression::Inflate inflate;
+
+    return round_trip(deflate, inflate, data);
+}
+
+TEST(deflate_round_trip_empty)
+{
+    Vector<uint8_t> data;
+
+    for (unsigned int level = 0; level <= 9; level++)
+    {
+        Assert::truth(round_trip(level, data));
+    }
+}
+
+TEST(deflate_round_trip_small)
+{
+    auto data = test_data(100);
+
+    for (unsigned int level = 0; level <= 9; level++)
+    {
+        Assert::truth(round_trip(level, data));
+    }
+}
+
+TEST(deflate_round_trip_sliding_window)
+{
+    auto data = test_data(300 * 1024);
+
+    for (unsigned int level = 0; level <= 9; level++)
+    {
+        Assert::truth(round_trip(level, data));
+    }
+}
+
+TEST(deflate_round_trip_incompressible)
+{
+    auto data = random_data(70000);
+
+    for (unsigned int level = 0; level <= 9; level++)
+    {
+        Assert::truth(round_trip(level, data));
+    }
+}
+
+TEST(deflate_levels_compress_repetitive_data)
+{
+    auto data = test_data(64 * 1024);
+
+    for (unsigned int level = 1; level <= 9; level++)
+    {
+        IO::MemoryWriter compressed;
+        Compression::Deflate deflate{level};
+
+        Assert::truth(compress(deflate, data, compressed) == SUCCESS);
+        Assert::truth(compressed.length().unwrap() < data.count() / 2);
+    }
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <libcompression/Gzip.h>
+#include <libio/Copy.h>
+
+#include "tests/Driver.h"
+#include "tests/libcompression/TestData.h"
+
+static const char *REFERENCE_TEXT = "hello gzip hello gzip hello gzip\n";
+
+// REFERENCE_TEXT as `gzip -9 -n` writes it.
+static const uint8_t REFERENCE_MEMBER[] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xcb, 0x48,
+    0xcd, 0xc9, 0xc9, 0x57, 0x48, 0xaf, 0xca, 0x2c, 0x50, 0xc8, 0xc0, 0xc6,
+    0xe4, 0x02, 0x00, 0xf4, 0x08, 0xa4, 0xd1, 0x21, 0x00, 0x00, 0x00};
+
+// An empty file as `gzip -n` writes it.
+static const uint8_t REFERENCE_EMPTY_MEMBER[] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03,
+    0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+static JResult gunzip(const uint8_t *data, size_t size, IO::MemoryWriter &decompressed)
+{
+    IO::MemoryReader compressed{data, size};
+    Compression::GzipReader gzip{compressed};
+
+    return IO::copy(gzip, decompressed);
+}
+
+TEST(gzip_reads_reference_member)
+{
+    IO::MemoryWriter decompressed;
+
+    Assert::truth(gunzip(REFERENCE_MEMBER, sizeof(REFERENCE_MEMBER), decompressed) == SUCCESS);
+    Assert::truth(same(decompressed, REFERENCE_TEXT, strlen(REFERENCE_TEXT)));
+}
+
+TEST(gzip_round_trip_levels)
+{
+    auto data = test_data(100 * 1024);
+
+    for (unsigned int level = 0; level <= 9; level++)
+    {
+        IO::MemoryWriter compressed;
+
+        {
+            Compression::GzipWriter gzip{compressed, level};
+            Assert::truth(IO::write_all(gzip, Slice{data.raw_storage(), data.count()}) == SUCCESS);
+            Assert::truth(gzip.finish() == SUCCESS);
+        }
+
+        IO::MemoryWriter decompressed;
+        Assert::truth(gunzip(compressed.buffer(), compressed.length().unwrap(), decompressed) == SUCCESS);
+        Assert::truth(same(decompressed, data));
+    }
+}
+
+TEST(gzip_round_trip_in_small_writes)
+{
+    auto data = test_data(50000);
+    IO::MemoryWriter compressed;
+
+    {
+        Compression::GzipWriter gzip{compressed};
+
+        for (size_t i = 0; i < data.count(); i += 17)
+        {
+            Assert::truth(IO::write_all(gzip, Slice{data.raw_storage() + i, MIN((size_t)17, data.count() - i)}) == SUCCESS);
+        }
+    }
+
+    IO::MemoryWriter decompressed;
+    Assert::truth(gunzip(compressed.buffer(), compressed.length().unwrap(), decompressed) == SUCCESS);
+    Assert::truth(same(decompressed, data));
+}
+
+TEST(gzip_round_trip_empty)
+{
+    IO::MemoryWriter decompressed;
+    Assert::truth(gunzip(REFERENCE_EMPTY_MEMBER, sizeof(REFERENCE_EMPTY_MEMBER), decompressed) == SUCCESS);
+    Assert::equal(decompressed.length().unwrap(), 0);
+
+    // Finished by hand and then again by the destructor, or by the
+    // destructor alone, it's one member either way.
+    IO::MemoryWriter finished;
+    IO::MemoryWriter destroyed;
+
+    {
+        Compression::GzipWriter gzip{finished};
+        Assert::truth(gzip.finish() == SUCCESS);
+    }
+
+    {
+        Compression::GzipWriter gzip{destroyed};
+    }
+
+    Assert::truth(same(destroyed, finished.buffer(), finished.length().unwrap()));
+
+    // The same header as gzip's but for the operating system, and the same
+    // CRC and size. The empty block is stored rather than fixed but either
+    // one is nothing.
+    static constexpr size_t HEADER_SIZE = 10;
+    static constexpr size_t TRAILER_SIZE = 8;
+
+    size_t size = finished.length().unwrap();
+
+    Assert::truth(size > HEADER_SIZE + TRAILER_SIZE);
+    Assert::equal(memcmp(finished.buffer(), REFERENCE_EMPTY_MEMBER, HEADER_SIZE - 1), 0);
+    Assert::equal(memcmp(finished.buffer() + size - TRAILER_SIZE, REFERENCE_EMPTY_MEMBER + sizeof(REFERENCE_EMPTY_MEMBER) - TRAILER_SIZE, TRAILER_SIZE), 0);
+
+    Assert::truth(gunzip(finished.buffer(), finished.length().unwrap(), decompressed) == SUCCESS);
+    Assert::equal(decompressed.length().unwrap(), 0);
+}
+
+TEST(gzip_reads_concatenated_members)
+{
+    auto data = test_data(10000);
+    IO::MemoryWriter compressed;
+
+    {
+        Compression::GzipWriter gzip{compressed};
+        IO::write_all(gzip, Slice{data.raw_storage(), 4000});
+        gzip.finish();
+        IO::write_all(gzip, Slice{data.raw_storage() + 4000, data.count() - 4000});
+    }
+
+    compressed.write(REFERENCE_MEMBER, sizeof(REFERENCE_MEMBER));
+
+    IO::MemoryWriter decompressed;
+    Assert::truth(gunzip(compressed.buffer(), compressed.length().unwrap(), decompressed) == SUCCESS);
+    Assert::equal(decompressed.length().unwrap(), data.count() + strlen(REFERENCE_TEXT));
+    Assert::truth(memcmp(decompressed.buffer(), data.raw_storage(), data.count()) == 0);
+}
+
+TEST(gzip_round_trip_parallel)
+{
+    auto data = test_data(3 * 1024 * 1024 + 1234);
+
+    IO::MemoryReader uncompressed{data.raw_storage(), data.count()};
+    IO::MemoryWriter compressed;
+    Assert::truth(Compression::gzip_parallel(uncompressed, compressed, 6, 4) == SUCCESS);
+
+    IO::MemoryWriter decompressed;
+    Assert::truth(gunzip(compressed.buffer(), compressed.length().unwrap(), decompressed) == SUCCESS);
+    Assert::truth(same(decompressed, data));
+}
+
+TEST(gzip_rejects_bad_magic)
+{
+    uint8_t member[sizeof(REFERENCE_MEMBER)];
+    memcpy(member, REFERENCE_MEMBER, sizeof(member));
+    member[1] ^= 1;
+
+    IO::MemoryWriter decompressed;
+    Assert::equal(gunzip(member, sizeof(member), decompressed), ERR_INVALID_DATA);
+}
+
+TEST(gzip_rejects_bad_crc)
+{
+    uint8_t member[sizeof(REFERENCE_MEMBER)];
+    memcpy(member, REFERENCE_MEMBER, sizeof(member));
+    member[sizeof(member) - 8] ^= 1;
+
+    IO::MemoryWriter decompressed;
+    Assert::equal(gunzip(member, sizeof(member), decompressed), ERR_INVALID_DATA);
+}
+
+TEST(gzip_rejects_bad_size)
+{
+    uint8_t member[sizeof(REFERENCE_MEMBER)];
+    memcpy(member, REFERENCE_MEMBER, sizeof(member));
+    member[sizeof(member) - 4] ^= 1;
+
+    IO::MemoryWriter decompressed;
+    Assert::equal(gunzip(member, sizeof(member), decompressed), ERR_INVALID_DATA);
+}
+
+TEST(gzip_rejects_truncated_members)
+{
+    for (size_t size = 1; size < sizeof(REFERENCE_MEMBER); size++)
+    {
+        IO::MemoryWriter decompressed;
+        Assert::falsity(gunzip(REFERENCE_MEMBER, size, decompressed) == SUCCESS);
+    }
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <libcompression/LZ4.h>
+
+#include "tests/Driver.h"
+#include "tests/libcompression/TestData.h"
+
+static const char *REFERENCE_TEXT = "To be, or not to be, that is the question. To be, or not to be, that is the question.\n";
+
+// REFERENCE_TEXT as `lz4 -9` writes it, with a content checksum.
+static const uint8_t REFERENCE_FRAME[] = {
+    0x04, 0x22, 0x4d, 0x18, 0x64, 0x40, 0xa7, 0x34, 0x00, 0x00, 0x00, 0xf2,
+    0x00, 0x54, 0x6f, 0x20, 0x62, 0x65, 0x2c, 0x20, 0x6f, 0x72, 0x20, 0x6e,
+    0x6f, 0x74, 0x20, 0x74, 0x0e, 0x00, 0xff, 0x07, 0x74, 0x68, 0x61, 0x74,
+    0x20, 0x69, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x71, 0x75, 0x65, 0x73,
+    0x74, 0x69, 0x6f, 0x6e, 0x2e, 0x20, 0x2b, 0x00, 0x13, 0x50, 0x69, 0x6f,
+    0x6e, 0x2e, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x3a, 0x6d, 0xa6, 0x3b};
+
+static bool round_trip(const Vector<uint8_t> &data)
+{
+    Compression::LZ4Encoder encoder;
+    Compression::LZ4Decoder decoder;
+
+    return round_trip(encoder, decoder, data);
+}
+
+TEST(lz4_decodes_reference_frame)
+{
+    IO::MemoryWriter decompressed;
+    Compression::LZ4Decoder decoder;
+    auto consumed = decoder.perform(Slice{REFERENCE_FRAME, sizeof(REFERENCE_FRAME)}, decompressed);
+
+    Assert::truth(consumed.success());
+    Assert::equal(consumed.unwrap(), sizeof(REFERENCE_FRAME));
+    Assert::equal(decompressed.length().unwrap(), strlen(REFERENCE_TEXT));
+    Assert::truth(memcmp(decompressed.buffer(), REFERENCE_TEXT, strlen(REFERENCE_TEXT)) == 0);
+}
+
+TEST(lz4_round_trip)
+{
+    Assert::truth(round_trip(Vector<uint8_t>()));
+    Assert::truth(round_trip(test_data(1)));
+    Assert::truth(round_trip(test_data(13)));
+    Assert::truth(round_trip(test_data(4096)));
+}
+
+TEST(lz4_round_trip_linked_blocks)
+{
+    // Several blocks, matches reaching back into the one before.
+    Assert::truth(round_trip(test_data(Compression::LZ4Encoder::BLOCK_SIZE * 3 + 1234)));
+}
+
+TEST(lz4_round_trip_incompressible)
+{
+    Assert::truth(round_trip(random_data(100000)));
+}
+
+TEST(lz4_concatenated_frames)
+{
+    IO::MemoryWriter compressed;
+    compressed.write(REFERENCE_FRAME, sizeof(REFERENCE_FRAME));
+    compressed.write(REFERENCE_FRAME, sizeof(REFERENCE_FRAME));
+
+    IO::MemoryWriter decompressed;
+    Compression::LZ4Decoder decoder;
+
+    Assert::truth(decoder.perform(Slice{compressed.buffer(), (size_t)compressed.length().unwrap()}, decompressed).success());
+    Assert::equal(decompressed.length().unwrap(), 2 * strlen(REFERENCE_TEXT));
+}
+
+TEST(lz4_rejects_bad_magic)
+{
+    uint8_t frame[sizeof(REFERENCE_FRAME)];
+    memcpy(frame, REFERENCE_FRAME, sizeof(frame));
+    frame[0] ^= 1;
+
+    Assert::equal(decompress<Compression::LZ4Decoder>(frame, sizeof(frame)), ERR_INVALID_DATA);
+}
+
+TEST(lz4_rejects_bad_descriptor_checksum)
+{
+    uint8_t frame[sizeof(REFERENCE_FRAME)];
+    memcpy(frame, REFERENCE_FRAME, sizeof(frame));
+    frame[6] ^= 1;
+
+    Assert::equal(decompress<Compression::LZ4Decoder>(frame, sizeof(frame)), ERR_INVALID_DATA);
+}
+
+TEST(lz4_rejects_bad_content_checksum)
+{
+    uint8_t frame[sizeof(REFERENCE_FRAME)];
+    memcpy(frame, REFERENCE_FRAME, sizeof(frame));
+    frame[sizeof(frame) - 1] ^= 1;
+
+    Assert::equal(decompress<Compression::LZ4Decoder>(frame, sizeof(frame)), ERR_INVALID_DATA);
+}
+
+TEST(lz4_rejects_truncated_frames)
+{
+    for (size_t size = 1; size < sizeof(REFERENCE_FRAME); size++)
+    {
+        Assert::falsity(decompress<Compression::LZ4Decoder>(REFERENCE_FRAME, size) == SUCCESS);
+    }
+}
+
+TEST(lz4_rejects_malformed_blocks)
+{
+    uint8_t out[64];
+
+    // A match before the start of the output.
+    const uint8_t before_start[] = {0x00, 0x01, 0x00, 0x00};
+    Assert::falsity(Compression::LZ4Decoder::decompress_block(before_start, sizeof(before_start), out, 0, sizeof(out)).success());
+
+    // An offset of 0.
+    const uint8_t zero_offset[] = {0x10, 'a', 0x00, 0x00, 0x00};
+    Assert::falsity(Compression::LZ4Decoder::decompress_block(zero_offset, sizeof(zero_offset), out, 0, sizeof(out)).success());
+
+    // More literals than there are bytes left.
+    const uint8_t short_literals[] = {0x50, 'a', 'b'};
+    Assert::falsity(Compression::LZ4Decoder::decompress_block(short_literals, sizeof(short_literals), out, 0, sizeof(out)).success());
+
+    // A literal length that goes on past the end.
+    const uint8_t endless_length[] = {0xf0, 0xff, 0xff};
+    Assert::falsity(Compression::LZ4Decoder::decompress_block(endless_length, sizeof(endless_length), out, 0, sizeof(out)).success());
+
+    // A match longer than the room in the output.
+    const uint8_t long_match[] = {0x1f, 'a', 0x01, 0x00, 0xff, 0x00};
+    Assert::falsity(Compression::LZ4Decoder::decompress_block(long_match, sizeof(long_match), out, 0, sizeof(out)).success());
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <string.h>
+#include <libio/MemoryReader.h>
+#include <libio/MemoryWriter.h>
+#include <libutils/Vector.h>
+
+// What the compression tests compress, the same on every run.
+
+// Words, runs and noise, so every compressor finds both matches and
+// literals and the larger sizes slide the window more than once. Past
+// 70000 bytes some of it repeats from further back than a 64K window.
+inline Vector<uint8_t> test_data(size_t size)
+{
+    static const char *words[] = {"deflate ", "window ", "block ", "literal ", "match ", "offset "};
+
+    Vector<uint8_t> data(size);
+    uint32_t state = 12345;
+
+    while (data.count() < size)
+    {
+        state = state * 1103515245 + 12345;
+
+        switch ((state >> 16) % 4)
+        {
+        case 0:
+            for (const char *c = words[(state >> 8) % 6]; *c && data.count() < size; c++)
+            {
+                data.push_back(*c);
+            }
+            break;
+
+        case 1:
+            for (size_t i = 0; i < ((state >> 4) % 300) && data.count() < size; i++)
+            {
+                data.push_back('a' + (state % 4));
+            }
+            break;
+
+        case 2:
+            if (data.count() > 70000)
+            {
+                size_t from = data.count() - 70000;
+
+                for (size_t i = 0; i < 64 && data.count() < size; i++)
+                {
+                    data.push_back(data[from + i]);
+                }
+                break;
+            }
+            [[fallthrough]];
+
+        default:
+            data.push_back(state >> 24);
+            break;
+        }
+    }
+
+    return data;
+}
+
+// Noise, which no compressor makes any smaller.
+inline Vector<uint8_t> random_data(size_t size)
+{
+    Vector<uint8_t> data(size);
+    uint32_t state = 1;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        data.push_back(state);
+    }
+
+    return data;
+}
+
+inline bool same(IO::MemoryWriter &writer, const void *data, size_t size)
+{
+    return writer.length().unwrap() == size && (size == 0 || memcmp(writer.buffer(), data, size) == 0);
+}
+
+inline bool same(IO::MemoryWriter &writer, const Vector<uint8_t> &data)
+{
+    return same(writer, data.raw_storage(), data.count());
+}
+
+template <typename Encoder>
+inline JResult compress(Encoder &encoder, const Vector<uint8_t> &data, IO::MemoryWriter &compressed)
+{
+    IO::MemoryReader uncompressed{data.raw_storage(), data.count()};
+    return encoder.perform(uncompressed, compressed);
+}
+
+// Compresses data with encoder and decodes it again with decoder, which
+// takes all of it as one slice. The compressed data has to be used up and
+// give back the same data.
+template <typename Encoder, typename Decoder>
+inline bool round_trip(Encoder &encoder, Decoder &decoder, const Vector<uint8_t> &data)
+{
+    IO::MemoryWriter compressed;
+
+    if (compress(encoder, data, compressed) != SUCCESS)
+    {
+        return false;
+    }
+
+    size_t compressed_size = compressed.length().unwrap();
+
+    IO::MemoryWriter decompressed;
+    auto consumed = decoder.perform(Slice{compressed.buffer(), compressed_size}, decompressed);
+
+    return consumed.success() && consumed.unwrap() == compressed_size && same(decompressed, data);
+}
+
+// What decoder makes of data, taken as one slice.
+template <typename Decoder>
+inline JResult decompress(const uint8_t *data, size_t size)
+{
+    IO::MemoryWriter decompressed;
+    Decoder decoder;
+
+    return decoder.perform(Slice{data, size}, decompressed).result();
+}
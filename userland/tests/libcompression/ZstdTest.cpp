@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <libcompression/Zstd.h>
+
+#include "tests/Driver.h"
+#include "tests/libcompression/TestData.h"
+
+static const char *REFERENCE_TEXT = "To be, or not to be, that is the question. To be, or not to be, that is the question.\n";
+
+// REFERENCE_TEXT as `zstd -19` writes it: Huffman coded literals and
+// a sequence, with the content size and a checksum.
+static const uint8_t REFERENCE_FRAME[] = {
+    0x28, 0xb5, 0x2f, 0xfd, 0x24, 0x56, 0x75, 0x01, 0x00, 0x62, 0xc2, 0x08,
+    0x10, 0xc0, 0xa7, 0x03, 0x42, 0xc4, 0x8e, 0xd0, 0x22, 0x0a, 0xd5, 0x3f,
+    0x50, 0x99, 0x63, 0xcb, 0x0d, 0x60, 0x81, 0x79, 0x45, 0x95, 0xcc, 0x65,
+    0x1d, 0xdd, 0x25, 0xd6, 0xde, 0xc4, 0x4f, 0x1e, 0xaa, 0x9c, 0x23, 0x02,
+    0x00, 0x3a, 0x05, 0x9b, 0x18, 0x66, 0x1d, 0x6b, 0x84, 0x6c, 0x98};
+
+// 1000 times 'a' as `zstd -3` writes it, one literal and a long match.
+static const uint8_t REFERENCE_RUN_FRAME[] = {
+    0x28, 0xb5, 0x2f, 0xfd, 0x64, 0xe8, 0x02, 0x4d, 0x00, 0x00, 0x10, 0x61,
+    0x61, 0x01, 0x00, 0xe3, 0x2b, 0x80, 0x05, 0x23, 0x42, 0xda, 0x2e};
+
+static bool round_trip(const Vector<uint8_t> &data)
+{
+    Compression::ZstdEncoder encoder;
+    Compression::ZstdDecoder decoder;
+
+    return round_trip(encoder, decoder, data);
+}
+
+TEST(zstd_decodes_reference_frames)
+{
+    IO::MemoryWriter decompressed;
+    Compression::ZstdDecoder decoder;
+    auto consumed = decoder.perform(Slice{REFERENCE_FRAME, sizeof(REFERENCE_FRAME)}, decompressed);
+
+    Assert::truth(consumed.success());
+    Assert::equal(consumed.unwrap(), sizeof(REFERENCE_FRAME));
+    Assert::equal(decompressed.length().unwrap(), strlen(REFERENCE_TEXT));
+    Assert::truth(memcmp(decompressed.buffer(), REFERENCE_TEXT, strlen(REFERENCE_TEXT)) == 0);
+
+    IO::MemoryWriter run;
+    Assert::truth(decoder.perform(Slice{REFERENCE_RUN_FRAME, sizeof(REFERENCE_RUN_FRAME)}, run).success());
+    Assert::equal(run.length().unwrap(), 1000);
+
+    for (size_t i = 0; i < 1000; i++)
+    {
+        Assert::equal(run.buffer()[i], 'a');
+    }
+}
+
+TEST(zstd_round_trip)
+{
+    Assert::truth(round_trip(Vector<uint8_t>()));
+    Assert::truth(round_trip(test_data(1)));
+    Assert::truth(round_trip(test_data(100)));
+    Assert::truth(round_trip(test_data(4096)));
+}
+
+TEST(zstd_round_trip_several_blocks)
+{
+    Assert::truth(round_trip(test_data(Compression::ZstdEncoder::BLOCK_SIZE * 3 + 1234)));
+}
+
+TEST(zstd_round_trip_sliding_window)
+{
+    Assert::truth(round_trip(test_data(Compression::ZstdEncoder::WINDOW_SIZE * 2 + 1234)));
+}
+
+TEST(zstd_round_trip_incompressible)
+{
+    Assert::truth(round_trip(random_data(200000)));
+}
+
+TEST(zstd_skips_skippable_frames)
+{
+    const uint8_t skippable[] = {0x50, 0x2a, 0x4d, 0x18, 0x03, 0x00, 0x00, 0x00, 1, 2, 3};
+
+    IO::MemoryWriter compressed;
+    compressed.write(skippable, sizeof(skippable));
+    compressed.write(REFERENCE_FRAME, sizeof(REFERENCE_FRAME));
+
+    IO::MemoryWriter decompressed;
+    Compression::ZstdDecoder decoder;
+
+    Assert::truth(decoder.perform(Slice{compressed.buffer(), (size_t)compressed.length().unwrap()}, decompressed).success());
+    Assert::equal(decompressed.length().unwrap(), strlen(REFERENCE_TEXT));
+}
+
+TEST(zstd_rejects_bad_magic)
+{
+    uint8_t frame[sizeof(REFERENCE_FRAME)];
+    memcpy(frame, REFERENCE_FRAME, sizeof(frame));
+    frame[0] ^= 1;
+
+    Assert::equal(decompress<Compression::ZstdDecoder>(frame, sizeof(frame)), ERR_INVALID_DATA);
+}
+
+TEST(zstd_rejects_reserved_descriptor_bit)
+{
+    uint8_t frame[sizeof(REFERENCE_FRAME)];
+    memcpy(frame, REFERENCE_FRAME, sizeof(frame));
+    frame[4] |= 0x08;
+
+    Assert::equal(decompress<Compression::ZstdDecoder>(frame, sizeof(frame)), ERR_INVALID_DATA);
+}
+
+TEST(zstd_rejects_wrong_content_size)
+{
+    uint8_t frame[sizeof(REFERENCE_FRAME)];
+    memcpy(frame, REFERENCE_FRAME, sizeof(frame));
+    frame[5]++;
+
+    Assert::equal(decompress<Compression::ZstdDecoder>(frame, sizeof(frame)), ERR_INVALID_DATA);
+}
+
+TEST(zstd_rejects_reserved_block_type)
+{
+    IO::MemoryWriter compressed;
+    Compression::ZstdEncoder encoder;
+    Assert::truth(compress(encoder, test_data(1000), compressed) == SUCCESS);
+
+    // The block header follows the 6 byte frame header.
+    compressed.buffer()[6] |= 0x06;
+
+    Assert::equal(decompress<Compression::ZstdDecoder>(compressed.buffer(), compressed.length().unwrap()), ERR_INVALID_DATA);
+}
+
+TEST(zstd_rejects_bad_checksum)
+{
+    uint8_t frame[sizeof(REFERENCE_FRAME)];
+    memcpy(frame, REFERENCE_FRAME, sizeof(frame));
+    frame[sizeof(frame) - 1] ^= 1;
+
+    Assert::equal(decompress<Compression::ZstdDecoder>(frame, sizeof(frame)), ERR_INVALID_DATA);
+}
+
+TEST(zstd_rejects_truncated_frames)
+{
+    for (size_t size = 1; size < sizeof(REFERENCE_FRAME); size++)
+    {
+        Assert::falsity(decompress<Compression::ZstdDecoder>(REFERENCE_FRAME, size) == SUCCESS);
+    }
+}
+
+TEST(zstd_rejects_corrupted_blocks)
+{
+    // Whatever a flipped bit in the compressed block does, the decoder must
+    // not read or write out of bounds. The checksum catches what changes the
+    // output; some bits, like the padding after the Huffman weights, are
+    // not used at all and the frame still decodes as it should.
+    for (size_t offset = 9; offset < sizeof(REFERENCE_FRAME) - 4; offset++)
+    {
+        for (unsigned int bit = 0; bit < 8; bit++)
+        {
+            uint8_t frame[sizeof(REFERENCE_FRAME)];
+            memcpy(frame, REFERENCE_FRAME, sizeof(frame));
+            frame[offset] ^= 1 << bit;
+
+            IO::MemoryWriter decompressed;
+            Compression::ZstdDecoder decoder;
+
+            if (decoder.perform(Slice{frame, sizeof(frame)}, decompressed).success())
+            {
+                Assert::equal(decompressed.length().unwrap(), strlen(REFERENCE_TEXT));
+                Assert::truth(memcmp(decompressed.buffer(), REFERENCE_TEXT, strlen(REFERENCE_TEXT)) == 0);
+            }
+        }
+    }
+}
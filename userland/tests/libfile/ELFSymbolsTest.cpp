@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <stdio.h>
+#include <string.h>
+#include <libfile/ELFSymbols.h>
+
+#include "tests/Driver.h"
+
+#define ELF_SYMBOL_TYPE_NOTYPE 0
+#define ELF_SYMBOL_TYPE_SECTION 3
+
+struct TestSymbol
+{
+    const char *name;
+    uint64_t address;
+    uint64_t size;
+    uint8_t type = ELF_SYMBOL_TYPE_FUNC;
+    uint16_t shndx = 1;
+};
+
+// An ELF64 image with nothing but a header, the section headers, and a
+// .symtab and/or .dynsym with their string tables.
+struct TestImage
+{
+    Vector<uint8_t> data{};
+    size_t strtab_offset = 0;
+    size_t strtab_size = 0;
+    size_t shoff = 0;
+
+    template <typename T>
+    size_t append(const T &value)
+    {
+        size_t offset = data.count();
+        data.push_back_many(reinterpret_cast<const uint8_t *>(&value), sizeof(T));
+        return offset;
+    }
+
+    // Appends the string table and the symbol table, and returns the two
+    // section headers for them.
+    void append_table(const TestSymbol *symbols, size_t count, uint32_t type, uint32_t strings_index, ELF64Section &table, ELF64Section &strings)
+    {
+        strings = {};
+        strings.type = ELF_SECTION_TYPE_STRTAB;
+        strings.offset = data.count();
+
+        Vector<uint32_t> names{};
+        data.push_back(0);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            names.push_back(data.count() - strings.offset);
+            data.push_back_many(reinterpret_cast<const uint8_t *>(symbols[i].name), strlen(symbols[i].name) + 1);
+        }
+
+        strings.size = data.count() - strings.offset;
+
+        table = {};
+        table.type = type;
+        table.link = strings_index;
+        table.entsize = sizeof(ELF64Symbole);
+        table.offset = data.count();
+
+        for (size_t i = 0; i < count; i++)
+        {
+            ELF64Symbole symbol{};
+            symbol.name = names[i];
+            symbol.info = symbols[i].type;
+            symbol.shndx = symbols[i].shndx;
+            symbol.value = symbols[i].address;
+            symbol.size = symbols[i].size;
+            append(symbol);
+        }
+
+        table.size = data.count() - table.offset;
+    }
+
+    TestImage(const TestSymbol *symtab, size_t symtab_count, const TestSymbol *dynsym = nullptr, size_t dynsym_count = 0)
+    {
+        ELF64Header header{};
+        header.ident[ELF_IDENT_MAG0] = ELF_MAG0;
+        header.ident[ELF_IDENT_MAG1] = ELF_MAG1;
+        header.ident[ELF_IDENT_MAG2] = ELF_MAG2;
+        header.ident[ELF_IDENT_MAG3] = ELF_MAG3;
+        header.ident[ELF_IDENT_CLASS] = ELF_IDENT_CLASS_64;
+        header.ident[ELF_IDENT_DATA] = ELF_IDENT_DATA_LSB;
+        header.ident[ELF_IDENT_VERSION] = 1;
+        header.type = ELF_ETYPE_EXEC;
+        header.machine = ELF_MACHINE_AMD64;
+        header.version = 1;
+        header.ehsize = sizeof(ELF64Header);
+        header.shentsize = sizeof(ELF64Section);
+        header.shnum = 5;
+        append(header);
+
+        ELF64Section sections[5] = {};
+
+        if (symtab_count)
+        {
+            append_table(symtab, symtab_count, ELF_SECTION_TYPE_SYMTAB, 2, sections[1], sections[2]);
+            strtab_offset = sections[2].offset;
+            strtab_size = sections[2].size;
+        }
+
+        if (dynsym_count)
+        {
+            append_table(dynsym, dynsym_count, ELF_SECTION_TYPE_DYNSYM, 4, sections[3], sections[4]);
+        }
+
+        shoff = data.count();
+
+        for (auto &section : sections)
+        {
+            append(section);
+        }
+
+        reinterpret_cast<ELF64Header *>(data.raw_storage())->shoff = shoff;
+    }
+
+    Slice slice() const { return {data.raw_storage(), data.count()}; }
+};
+
+static bool is(const ELFSymbolIndex<ELF64>::Symbol *symbol, const char *name)
+{
+    return symbol && strcmp(symbol->name, name) == 0;
+}
+
+TEST(elf_symbols_lookup)
+{
+    TestSymbol symbols[] = {
+        {"object", 0x2000, 8, ELF_SYMBOL_TYPE_OBJECT, 2},
+        {"first", 0x1000, 0x10},
+        {"unsized", 0x1020, 0},
+        {"notype", 0x1800, 4, ELF_SYMBOL_TYPE_NOTYPE},
+        {"section", 0x1900, 0, ELF_SYMBOL_TYPE_SECTION},
+        {"undefined", 0x1a00, 4, ELF_SYMBOL_TYPE_FUNC, 0},
+        {"at_zero", 0, 4},
+    };
+
+    TestImage image{symbols, 7};
+    ELFSymbolIndex<ELF64> index{image.slice()};
+
+    Assert::equal(index.count(), 3);
+
+    Assert::truth(index.lookup(0) == nullptr);
+    Assert::truth(index.lookup(0xfff) == nullptr);
+    Assert::truth(is(index.lookup(0x1000), "first"));
+    Assert::truth(is(index.lookup(0x100f), "first"));
+    Assert::truth(index.lookup(0x1010) == nullptr);
+
+    // Without a size, a symbol goes up to the next one.
+    Assert::truth(is(index.lookup(0x1020), "unsized"));
+    Assert::truth(is(index.lookup(0x1a00), "unsized"));
+    Assert::truth(is(index.lookup(0x1fff), "unsized"));
+
+    Assert::truth(is(index.lookup(0x2000), "object"));
+    Assert::truth(is(index.lookup(0x2007), "object"));
+    Assert::truth(index.lookup(0x2008) == nullptr);
+    Assert::truth(index.lookup(UINTPTR_MAX) == nullptr);
+}
+
+TEST(elf_symbols_aliases)
+{
+    TestSymbol symbols[] = {
+        {"alias", 0x3000, 0},
+        {"sized", 0x3000, 0x20},
+        {"weak", 0x3000, 0},
+    };
+
+    TestImage image{symbols, 3};
+    ELFSymbolIndex<ELF64> index{image.slice()};
+
+    Assert::equal(index.count(), 3);
+    Assert::truth(is(index.lookup(0x3000), "sized"));
+    Assert::truth(is(index.lookup(0x301f), "sized"));
+    Assert::truth(index.lookup(0x3020) == nullptr);
+}
+
+TEST(elf_symbols_dynsym_fallback)
+{
+    TestSymbol local[] = {{"local", 0x4000, 0x10}};
+    TestSymbol exported[] = {{"exported", 0x4000, 0x10}, {"other", 0x5000, 0x10}};
+
+    TestImage stripped{nullptr, 0, exported, 2};
+    ELFSymbolIndex<ELF64> stripped_index{stripped.slice()};
+
+    Assert::equal(stripped_index.count(), 2);
+    Assert::truth(is(stripped_index.lookup(0x4008), "exported"));
+
+    // .symtab is a superset of .dynsym when there is one.
+    TestImage both{local, 1, exported, 2};
+    ELFSymbolIndex<ELF64> both_index{both.slice()};
+
+    Assert::equal(both_index.count(), 1);
+    Assert::truth(is(both_index.lookup(0x4008), "local"));
+    Assert::truth(both_index.lookup(0x5008) == nullptr);
+}
+
+TEST(elf_symbols_against_reference)
+{
+    static constexpr size_t SYMBOLS = 1000;
+
+    uint32_t state = 1;
+
+    auto next_random = [&] {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    };
+
+    static char names[SYMBOLS][8];
+    static TestSymbol symbols[SYMBOLS];
+    uint64_t address = 0x10000;
+
+    for (size_t i = 0; i < SYMBOLS; i++)
+    {
+        address += 1 + next_random() % 64;
+        snprintf(names[i], sizeof(names[i]), "s%zu", i);
+        symbols[i] = {names[i], address, next_random() % 4 ? next_random() % 48 : 0};
+    }
+
+    // In no particular order, the index sorts them.
+    for (size_t i = SYMBOLS - 1; i > 0; i--)
+    {
+        std::swap(symbols[i], symbols[next_random() % (i + 1)]);
+    }
+
+    TestImage image{symbols, SYMBOLS};
+    ELFSymbolIndex<ELF64> index{image.slice()};
+
+    Assert::equal(index.count(), SYMBOLS);
+
+    static uintptr_t addresses[20000];
+
+    for (auto &address_to_find : addresses)
+    {
+        address_to_find = 0xf000 + next_random() % (address - 0xf000 + 0x100);
+    }
+
+    size_t found = 0;
+    size_t i = 0;
+
+    index.symbolize(addresses, 20000, [&](uintptr_t address_to_find, auto *symbol) {
+        Assert::equal(address_to_find, addresses[i++]);
+
+        const TestSymbol *expected = nullptr;
+
+        for (auto &candidate : symbols)
+        {
+            if (candidate.address <= address_to_find && (!expected || candidate.address > expected->address))
+            {
+                expected = &candidate;
+            }
+        }
+
+        if (expected && expected->size && address_to_find - expected->address >= expected->size)
+        {
+            expected = nullptr;
+        }
+
+        Assert::equal(symbol != nullptr, expected != nullptr);
+        Assert::truth(!expected || is(symbol, expected->name));
+        found += symbol ? 1 : 0;
+    });
+
+    Assert::equal(i, 20000);
+    Assert::truth(found > 0);
+}
+
+TEST(elf_symbols_malformed)
+{
+    TestSymbol symbols[] = {{"first", 0x1000, 0x10}, {"last", 0x2000, 0x10}};
+    TestImage image{symbols, 2};
+
+    // Cut off anywhere, in a buffer of just that size so that reading past
+    // it shows.
+    for (size_t size = 0; size < image.data.count(); size++)
+    {
+        auto *copy = new uint8_t[size];
+        memcpy(copy, image.data.raw_storage(), size);
+
+        ELFSymbolIndex<ELF64> index{Slice{copy, size}};
+        Assert::equal(index.count(), 0);
+
+        delete[] copy;
+    }
+
+    auto *header = reinterpret_cast<ELF64Header *>(image.data.raw_storage());
+    auto *sections = reinterpret_cast<ELF64Section *>(image.data.raw_storage() + image.shoff);
+
+    // The last name no longer ends within its table.
+    image.data[image.strtab_offset + image.strtab_size - 1] = 'x';
+    Assert::equal(ELFSymbolIndex<ELF64>{image.slice()}.count(), 1);
+    image.data[image.strtab_offset + image.strtab_size - 1] = '\0';
+    Assert::equal(ELFSymbolIndex<ELF64>{image.slice()}.count(), 2);
+
+    sections[1].size = UINT64_MAX - 7;
+    Assert::equal(ELFSymbolIndex<ELF64>{image.slice()}.count(), 0);
+    sections[1].size = 2 * sizeof(ELF64Symbole);
+
+    sections[1].link = 100;
+    Assert::equal(ELFSymbolIndex<ELF64>{image.slice()}.count(), 0);
+    sections[1].link = 2;
+
+    header->shoff = UINT64_MAX - 100;
+    Assert::equal(ELFSymbolIndex<ELF64>{image.slice()}.count(), 0);
+    header->shoff = image.shoff;
+
+    header->ident[ELF_IDENT_MAG1] = 'e';
+    Assert::equal(ELFSymbolIndex<ELF64>{image.slice()}.count(), 0);
+}
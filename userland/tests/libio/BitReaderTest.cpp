@@ -97,4 +97,45 @@ TEST(bitreader_should_only_fetch_what_it_need)
     reader.grab_bits(5);
     reader.grab<uint16_t>();
     assert_count_and_reset(3);
-}
\ No newline at end of file
+}
+
+TEST(bitreader_from_slice)
+{
+    uint8_t data[] = {0b01001000, 0b11000011, 0b01011010, 0b11111111, 0b00000000, 0x12, 0x34, 0x56, 0x78, 0x9a};
+    IO::BitReader bit_reader(Slice{data, sizeof(data)});
+
+    Assert::equal(bit_reader.grab_bits(4), 8);
+    Assert::equal(bit_reader.grab_bits(4), 4);
+    Assert::equal(bit_reader.peek_bits_reverse(2), 3);
+    Assert::equal(bit_reader.grab_bits(2), 3);
+    Assert::equal(bit_reader.grab_bits(5), 16);
+    Assert::equal(bit_reader.grab_bits(1), 1);
+    Assert::equal(bit_reader.consumed(), 2);
+
+    Assert::equal(bit_reader.grab_bits(24), 0x00ff5a);
+    Assert::equal(bit_reader.grab_bits(32), 0x78563412);
+    Assert::falsity(bit_reader.ended());
+
+    Assert::equal(bit_reader.grab_bits(8), 0x9a);
+    Assert::truth(bit_reader.ended());
+    Assert::falsity(bit_reader.overrun());
+
+    Assert::equal(bit_reader.grab_bits(8), 0);
+    Assert::truth(bit_reader.overrun());
+}
+
+TEST(bitreader_align_and_read_bytes)
+{
+    uint8_t data[] = {0xff, 0x12, 0x34, 0x56};
+    IO::MemoryReader mem_reader(data, sizeof(data));
+    IO::BitReader bit_reader(mem_reader);
+
+    Assert::equal(bit_reader.grab_bits(3), 7);
+    bit_reader.align();
+
+    uint8_t bytes[3] = {};
+    Assert::equal(bit_reader.read(bytes, sizeof(bytes)).unwrap(), 3);
+    Assert::equal(bytes[0], 0x12);
+    Assert::equal(bytes[1], 0x34);
+    Assert::equal(bytes[2], 0x56);
+}
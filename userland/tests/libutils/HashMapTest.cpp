@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <libutils/HashMap.h>
+
+#include "tests/Driver.h"
+
+// A key with whatever hash it is given, to make keys collide on purpose.
+struct CollidingKey
+{
+    uint32_t hash;
+    uint32_t id;
+
+    bool operator==(const CollidingKey &other) const
+    {
+        return hash == other.hash && id == other.id;
+    }
+};
+
+namespace Utils
+{
+
+template <>
+inline uint32_t hash<CollidingKey>(const CollidingKey &key)
+{
+    return key.hash;
+}
+
+} // namespace Utils
+
+TEST(hashmap_insert_and_lookup)
+{
+    HashMap<uint32_t, uint32_t> map;
+
+    Assert::equal(map.count(), 0);
+    Assert::falsity(map.has_key(1));
+    Assert::truth(map.lookup(1) == nullptr);
+
+    map[1] = 10;
+    map[2] = 20;
+    map[1] = 11;
+
+    Assert::equal(map.count(), 2);
+    Assert::equal(map[1], 11);
+    Assert::equal(*map.lookup(2), 20);
+    Assert::truth(map.has_value(20));
+    Assert::falsity(map.has_value(10));
+}
+
+TEST(hashmap_across_rehash)
+{
+    HashMap<uint32_t, uint32_t> map;
+
+    // From the first 16 slots up through several doublings.
+    for (uint32_t i = 0; i < 5000; i++)
+    {
+        map[i * 7] = i;
+
+        Assert::equal(map.count(), i + 1);
+        Assert::equal(*map.lookup(0), 0);
+        Assert::equal(*map.lookup(i * 7), i);
+    }
+
+    for (uint32_t i = 0; i < 5000; i++)
+    {
+        Assert::equal(*map.lookup(i * 7), i);
+        Assert::truth(map.lookup(i * 7 + 1) == nullptr);
+    }
+
+    // Take every other one out, what's left is still there.
+    for (uint32_t i = 0; i < 5000; i += 2)
+    {
+        map.remove_key(i * 7);
+    }
+
+    Assert::equal(map.count(), 2500);
+
+    for (uint32_t i = 0; i < 5000; i++)
+    {
+        Assert::equal(map.has_key(i * 7), i % 2 == 1);
+    }
+}
+
+TEST(hashmap_colliding_keys)
+{
+    // One probe sequence of 12 keys for each of these hashes. Some of them
+    // start in the last slots of the table and wrap around to the first.
+    for (uint32_t hash = 0; hash < 64; hash++)
+    {
+        HashMap<CollidingKey, uint32_t> map;
+
+        for (uint32_t id = 0; id < 12; id++)
+        {
+            map[{hash, id}] = id;
+        }
+
+        // Anywhere in the sequence, and the ones after it have to move back.
+        for (uint32_t id : {5u, 0u, 11u, 6u})
+        {
+            map.remove_key({hash, id});
+            Assert::falsity(map.has_key({hash, id}));
+        }
+
+        Assert::equal(map.count(), 8);
+
+        for (uint32_t id = 0; id < 12; id++)
+        {
+            bool removed = id == 5 || id == 0 || id == 11 || id == 6;
+            auto *value = map.lookup({hash, id});
+
+            Assert::equal(value == nullptr, removed);
+            Assert::truth(removed || *value == id);
+        }
+
+        // Adding them back fills the holes.
+        for (uint32_t id : {5u, 0u, 11u, 6u})
+        {
+            map[{hash, id}] = id + 100;
+        }
+
+        Assert::equal(map.count(), 12);
+        Assert::equal(*map.lookup({hash, 0}), 100);
+        Assert::equal(*map.lookup({hash, 1}), 1);
+    }
+}
+
+TEST(hashmap_interleaved_probe_sequences)
+{
+    // Two sequences that run into each other: moving one back must not
+    // take the other before its home slot.
+    for (uint32_t hash = 0; hash < 64; hash++)
+    {
+        HashMap<CollidingKey, uint32_t> map;
+
+        for (uint32_t id = 0; id < 6; id++)
+        {
+            map[{hash, id}] = id;
+            map[{hash + 1, id}] = id + 10;
+        }
+
+        for (uint32_t id = 0; id < 6; id++)
+        {
+            map.remove_key({hash, id});
+
+            for (uint32_t other = 0; other < 6; other++)
+            {
+                Assert::equal(*map.lookup({hash + 1, other}), other + 10);
+                Assert::equal(map.has_key({hash, other}), other > id);
+            }
+        }
+
+        Assert::equal(map.count(), 6);
+    }
+}
+
+TEST(hashmap_against_reference)
+{
+    static constexpr uint32_t KEYS = 2048;
+
+    HashMap<uint32_t, uint32_t> map;
+    uint32_t reference[KEYS];
+    bool present[KEYS] = {};
+    size_t count = 0;
+
+    uint32_t state = 1;
+
+    for (size_t i = 0; i < 200000; i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+
+        uint32_t key = (state >> 8) % KEYS;
+
+        switch (state % 4)
+        {
+        case 0:
+        case 1:
+            count += present[key] ? 0 : 1;
+            present[key] = true;
+            reference[key] = state;
+            map[key] = state;
+            break;
+
+        case 2:
+            count -= present[key] ? 1 : 0;
+            present[key] = false;
+            map.remove_key(key);
+            break;
+
+        default:
+        {
+            auto *value = map.lookup(key);
+            Assert::equal(value != nullptr, present[key]);
+            Assert::truth(!present[key] || *value == reference[key]);
+            break;
+        }
+        }
+
+        Assert::equal(map.count(), count);
+    }
+
+    size_t seen = 0;
+
+    map.foreach([&](auto &key, auto &value) {
+        Assert::truth(present[key]);
+        Assert::equal(value, reference[key]);
+        seen++;
+        return Iteration::CONTINUE;
+    });
+
+    Assert::equal(seen, count);
+}
+
+TEST(hashmap_remove_value)
+{
+    HashMap<uint32_t, uint32_t> map;
+
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        map[i] = i % 3;
+    }
+
+    map.remove_value(0);
+
+    Assert::equal(map.count(), 66);
+
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        Assert::equal(map.has_key(i), i % 3 != 0);
+    }
+}
+
+TEST(hashmap_ensure_capacity_and_copy)
+{
+    HashMap<uint32_t, uint32_t> map;
+    map.ensure_capacity(1000);
+
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        map[i] = i;
+    }
+
+    HashMap<uint32_t, uint32_t> copy{map};
+    copy.remove_key(10);
+    copy[5000] = 1;
+
+    Assert::truth(map.has_key(10));
+    Assert::falsity(map.has_key(5000));
+    Assert::equal(copy.count(), 1000);
+    Assert::falsity(copy.has_key(10));
+
+    map.clear();
+
+    Assert::equal(map.count(), 0);
+    Assert::falsity(map.has_key(1));
+
+    map[1] = 1;
+    Assert::equal(*map.lookup(1), 1);
+}
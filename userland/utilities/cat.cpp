@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+// includes
+#include <string.h>
+#include <libio/Copy.h>
+#include <libio/File.h>
+#include <libio/MappedFile.h>
+#include <libio/Streams.h>
+
+// Regular files are mapped and handed to stdout whole, so there is no read
+// and no copy through a buffer of ours. Anything else goes through
+// IO::copy(), which sizes its chunk after what is left to read.
+static JResult cat(IO::File &file)
+{
+    auto type = file.type();
+
+    if (type.success() && type.unwrap() == J_FILE_TYPE_REGULAR)
+    {
+        auto mapped = IO::MappedFile::map(file);
+
+        if (mapped.success())
+        {
+            auto mapping = mapped.unwrap();
+            IO::MemoryReader memory{mapping->start(), mapping->size()};
+
+            return IO::copy(memory, IO::out(), SIZE_MAX);
+        }
+    }
+
+    return IO::copy(file, IO::out());
+}
+
+int main(int argc, char const *argv[])
+{
+    if (argc == 1)
+    {
+        return IO::copy(IO::in(), IO::out()) == SUCCESS ? PROCESS_SUCCESS : PROCESS_FAILURE;
+    }
+
+    int exit_code = PROCESS_SUCCESS;
+
+    for (int i = 1; i < argc; i++)
+    {
+        JResult result;
+
+        if (strcmp(argv[i], "-") == 0)
+        {
+            result = IO::copy(IO::in(), IO::out());
+        }
+        else
+        {
+            IO::File file{argv[i], J_OPEN_READ};
+            result = file.result();
+
+            if (result == SUCCESS)
+            {
+                result = cat(file);
+            }
+        }
+
+        if (result != SUCCESS)
+        {
+            IO::errln("{}: {}: {}", argv[0], argv[i], get_result_description(result));
+            exit_code = PROCESS_FAILURE;
+        }
+    }
+
+    return exit_code;
+}
@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+// includes
+#include <string.h>
+#include <libio/Copy.h>
+#include <libio/Directory.h>
+#include <libio/File.h>
+#include <libio/MappedFile.h>
+#include <libio/NumberScanner.h>
+#include <libio/Streams.h>
+#include <libsystem/io/FileSystem.h>
+#include <libsystem/system/System.h>
+#include <libutils/Threads.h>
+
+static const char *USAGE = "Usage: cp [-r] [-p] [-j THREADS] SOURCE... DESTINATION";
+
+// Mapped files from this size up are copied a chunk per thread at a time,
+// each thread writing through a handle of its own.
+static constexpr size_t PARALLEL_COPY_THRESHOLD = 16 * 1024 * 1024;
+static constexpr size_t COPY_CHUNK_SIZE = 4 * 1024 * 1024;
+
+struct CopyOptions
+{
+    bool recursive = false;
+    bool progress = false;
+
+    // 0 for one per processor.
+    size_t threads = 0;
+};
+
+struct CopyTotals
+{
+    size_t files = 0;
+    size_t bytes = 0;
+};
+
+static bool is_directory(const IO::Path &path)
+{
+    return filesystem_exist(path.string().cstring(), J_FILE_TYPE_DIRECTORY);
+}
+
+static JResult copy_chunk(const IO::Path &destination_path, const uint8_t *start, size_t offset, size_t size)
+{
+    IO::File destination{destination_path.string(), J_OPEN_WRITE};
+    TRY(destination.result());
+    TRY(destination.seek(IO::SeekFrom::start(offset)));
+
+    IO::MemoryReader memory{start + offset, size};
+    TRY(IO::copy(memory, destination, SIZE_MAX));
+
+    return SUCCESS;
+}
+
+// The destination is sized first with its last byte, so that the chunks
+// all land inside of it whichever is written first.
+static JResult copy_chunks(const uint8_t *start, size_t size, IO::File &destination, const IO::Path &destination_path, size_t threads)
+{
+    TRY(destination.seek(IO::SeekFrom::start(size - 1)));
+    TRY(destination.write(start + size - 1, 1));
+
+    size_t chunk_count = (size + COPY_CHUNK_SIZE - 1) / COPY_CHUNK_SIZE;
+    threads = threads ? threads : Utils::processor_count();
+    threads = MIN(threads, chunk_count);
+
+    size_t next_chunk = 0;
+    int first_error = SUCCESS;
+
+    Utils::run_on_threads(threads, [&]() {
+        while (__atomic_load_n(&first_error, __ATOMIC_RELAXED) == SUCCESS)
+        {
+            size_t chunk = __atomic_fetch_add(&next_chunk, 1, __ATOMIC_RELAXED);
+
+            if (chunk >= chunk_count)
+            {
+                return;
+            }
+
+            size_t offset = chunk * COPY_CHUNK_SIZE;
+            JResult result = copy_chunk(destination_path, start, offset, MIN(COPY_CHUNK_SIZE, size - offset));
+
+            if (result != SUCCESS)
+            {
+                int expected = SUCCESS;
+                __atomic_compare_exchange_n(&first_error, &expected, (int)result, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+                return;
+            }
+        }
+    });
+
+    return (JResult)first_error;
+}
+
+// A mapped source goes to the destination in one write, which lets the
+// filesystem size the file once instead of growing it chunk by chunk, or
+// in chunks on several threads when it is big enough.
+static JResult copy_file(const IO::Path &source_path, const IO::Path &destination_path, const CopyOptions &options, CopyTotals &totals)
+{
+    IO::File source{source_path.string(), J_OPEN_READ};
+    TRY(source.result());
+
+    size_t size = source.length().unwrap_or(0);
+
+    // Opening for writing doesn't truncate, what was there is removed
+    // first so a shorter file leaves nothing of it behind.
+    filesystem_unlink(destination_path.string().cstring());
+
+    IO::File destination{destination_path.string(), J_OPEN_WRITE | J_OPEN_CREATE};
+    TRY(destination.result());
+
+    auto mapped = IO::MappedFile::map(source);
+
+    if (mapped.success())
+    {
+        auto mapping = mapped.unwrap();
+        auto *start = (const uint8_t *)mapping->start();
+
+        if (mapping->size() >= PARALLEL_COPY_THRESHOLD && options.threads != 1)
+        {
+            TRY(copy_chunks(start, mapping->size(), destination, destination_path, options.threads));
+        }
+        else
+        {
+            IO::MemoryReader memory{start, mapping->size()};
+            TRY(IO::copy(memory, destination, SIZE_MAX));
+        }
+    }
+    else
+    {
+        TRY(IO::copy(source, destination));
+    }
+
+    totals.files++;
+    totals.bytes += size;
+
+    if (options.progress)
+    {
+        IO::outln("{} -> {} ({} bytes)", source_path.string(), destination_path.string(), size);
+    }
+
+    return SUCCESS;
+}
+
+static bool copy_path(const IO::Path &source_path, const IO::Path &destination_path, const CopyOptions &options, CopyTotals &totals);
+
+// Keeps going past entries that fail, and tells whether all of them were
+// copied.
+static bool copy_directory(const IO::Path &source_path, const IO::Path &destination_path, const CopyOptions &options, CopyTotals &totals)
+{
+    IO::Directory source{source_path};
+
+    if (!source.exist())
+    {
+        IO::errln("cp: {}: {}", source_path.string(), get_result_description(ERR_NO_SUCH_FILE_OR_DIRECTORY));
+        return false;
+    }
+
+    // Fails when it is already there, which is fine: what goes in it
+    // reports its own errors.
+    filesystem_mkdir(destination_path.string().cstring());
+
+    bool copied = true;
+
+    for (auto &entry : source.entries())
+    {
+        copied &= copy_path(IO::Path::join(source_path, entry.name), IO::Path::join(destination_path, entry.name), options, totals);
+    }
+
+    return copied;
+}
+
+static bool copy_path(const IO::Path &source_path, const IO::Path &destination_path, const CopyOptions &options, CopyTotals &totals)
+{
+    if (is_directory(source_path))
+    {
+        if (!options.recursive)
+        {
+            IO::errln("cp: {}: is a directory, use -r to copy it", source_path.string());
+            return false;
+        }
+
+        return copy_directory(source_path, destination_path, options, totals);
+    }
+
+    JResult result = copy_file(source_path, destination_path, options, totals);
+
+    if (result != SUCCESS)
+    {
+        IO::errln("cp: {}: {}", source_path.string(), get_result_description(result));
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char const *argv[])
+{
+    CopyOptions options;
+    Vector<IO::Path> paths{};
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "-R") == 0)
+        {
+            options.recursive = true;
+        }
+        else if (strcmp(argv[i], "-p") == 0)
+        {
+            options.progress = true;
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            i++;
+
+            IO::MemoryReader memory{argv[i]};
+            IO::Scanner scan{memory};
+            auto threads = IO::NumberScanner::decimal().scan_uint(scan);
+
+            if (!threads.present() || !scan.ended())
+            {
+                IO::errln(USAGE);
+                return PROCESS_FAILURE;
+            }
+
+            options.threads = threads.unwrap();
+        }
+        else
+        {
+            paths.push_back(IO::Path::parse(argv[i]));
+        }
+    }
+
+    if (paths.count() < 2)
+    {
+        IO::errln(USAGE);
+        return PROCESS_FAILURE;
+    }
+
+    auto destination = paths.pop_back();
+
+    // Several sources, or one going into an existing directory, keep their
+    // names under the destination.
+    bool into_directory = paths.count() > 1 || is_directory(destination);
+
+    if (paths.count() > 1 && !is_directory(destination))
+    {
+        IO::errln("cp: {}: not a directory", destination.string());
+        return PROCESS_FAILURE;
+    }
+
+    CopyTotals totals;
+    Tick start = system_get_ticks();
+    int exit_code = PROCESS_SUCCESS;
+
+    for (auto &source : paths)
+    {
+        auto target = into_directory ? IO::Path::join(destination, source.basename()) : destination;
+
+        if (!copy_path(source, target, options, totals))
+        {
+            exit_code = PROCESS_FAILURE;
+        }
+    }
+
+    if (options.progress)
+    {
+        Tick elapsed = system_get_ticks() - start;
+        IO::outln("{} files, {} bytes in {} ticks ({} bytes per tick)", totals.files, totals.bytes, elapsed, totals.bytes / (elapsed > 0 ? elapsed : 1));
+    }
+
+    return exit_code;
+}